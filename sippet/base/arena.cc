@@ -0,0 +1,87 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/base/arena.h"
+
+#include "base/logging.h"
+
+namespace sippet {
+
+namespace {
+
+size_t AlignUp(size_t size) {
+  return (size + Arena::kAlignment - 1) & ~(Arena::kAlignment - 1);
+}
+
+char *AlignBlock(char *block) {
+  uintptr_t address = reinterpret_cast<uintptr_t>(block);
+  address = (address + Arena::kAlignment - 1) & ~(Arena::kAlignment - 1);
+  return reinterpret_cast<char*>(address);
+}
+
+}  // namespace
+
+Arena::Arena(size_t block_size)
+  : block_size_(AlignUp(block_size)),
+    current_(NULL),
+    remaining_(0),
+    bytes_allocated_(0),
+    first_block_(NULL) {
+  DCHECK_GT(block_size_, 0u);
+}
+
+Arena::~Arena() {
+  for (std::vector<char*>::iterator i = blocks_.begin(), ie = blocks_.end();
+       i != ie; ++i) {
+    delete [] *i;
+  }
+}
+
+void *Arena::Allocate(size_t size) {
+  size = AlignUp(size);
+  bytes_allocated_ += size;
+  if (size > block_size_ / 4) {
+    // Large objects get their own block, so they don't waste the remaining
+    // space of the current one.
+    return AllocateBlock(size);
+  }
+  if (size > remaining_) {
+    current_ = AllocateBlock(block_size_);
+    remaining_ = block_size_;
+    if (!first_block_)
+      first_block_ = blocks_.back();
+  }
+  char *result = current_;
+  current_ += size;
+  remaining_ -= size;
+  return result;
+}
+
+void Arena::Reset() {
+  for (std::vector<char*>::iterator i = blocks_.begin(), ie = blocks_.end();
+       i != ie; ++i) {
+    if (*i != first_block_)
+      delete [] *i;
+  }
+  blocks_.clear();
+  bytes_allocated_ = 0;
+  if (first_block_) {
+    blocks_.push_back(first_block_);
+    current_ = AlignBlock(first_block_);
+    remaining_ = block_size_;
+  } else {
+    current_ = NULL;
+    remaining_ = 0;
+  }
+}
+
+char *Arena::AllocateBlock(size_t size) {
+  // |operator new[]| of chars is only guaranteed to be aligned for the
+  // fundamental types, so over-allocate to align it ourselves.
+  char *block = new char[size + kAlignment];
+  blocks_.push_back(block);
+  return AlignBlock(block);
+}
+
+}  // namespace sippet
@@ -0,0 +1,53 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_BASE_ARENA_H_
+#define SIPPET_BASE_ARENA_H_
+
+#include <vector>
+
+#include "base/basictypes.h"
+
+namespace sippet {
+
+// A simple bump allocator. Memory is carved out of fixed size blocks and is
+// only given back when the arena is destroyed, so objects allocated from it
+// can't outlive it. Not thread safe.
+class Arena {
+ public:
+  // Every allocation is aligned to this boundary.
+  static const size_t kAlignment = 16;
+
+  static const size_t kDefaultBlockSize = 4096;
+
+  explicit Arena(size_t block_size = kDefaultBlockSize);
+  ~Arena();
+
+  // Returns |size| bytes of uninitialized memory, aligned to |kAlignment|.
+  void *Allocate(size_t size);
+
+  // Gives back all the memory allocated so far, so that the arena can be
+  // reused. The first block is kept, the others are released.
+  void Reset();
+
+  // Total number of bytes handed out by |Allocate|.
+  size_t bytes_allocated() const { return bytes_allocated_; }
+
+ private:
+  char *AllocateBlock(size_t size);
+
+  size_t block_size_;
+  char *current_;
+  size_t remaining_;
+  size_t bytes_allocated_;
+  std::vector<char*> blocks_;
+  // First block of |block_size_| bytes, kept by |Reset|.
+  char *first_block_;
+
+  DISALLOW_COPY_AND_ASSIGN(Arena);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_BASE_ARENA_H_
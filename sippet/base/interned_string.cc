@@ -0,0 +1,152 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/base/interned_string.h"
+
+#include "base/containers/hash_tables.h"
+#include "base/lazy_instance.h"
+#include "base/strings/string_util.h"
+#include "base/synchronization/lock.h"
+#include "base/threading/thread_local_storage.h"
+
+namespace sippet {
+
+namespace {
+
+// Tokens always present in the table, so that the most common ones never
+// depend on the table having room left.
+const char *kWellKnownTokens[] = {
+  "branch", "tag", "transport", "lr", "rport", "received", "maddr",
+  "ttl", "user", "method", "expires", "q", "nonce", "realm", "opaque",
+  "algorithm", "qop", "cnonce", "nc", "response", "uri", "username",
+  "stale", "domain", "ob", "reg-id", "+sip.instance", "purpose",
+  "handling", "duration", "udp", "tcp", "tls", "sctp", "ws", "wss",
+};
+
+// Entries keyed by their own contents, which are never released.
+typedef base::hash_map<base::StringPiece, const std::string*> TokenMap;
+
+// The entries each thread has already interned, so that they're found
+// again without taking the lock of the table.
+class ThreadTokens {
+ public:
+  ThreadTokens() {}
+
+  const std::string *Find(const base::StringPiece &str) const {
+    TokenMap::const_iterator i = tokens_.find(str);
+    return i != tokens_.end() ? i->second : NULL;
+  }
+
+  void Add(const std::string *entry) {
+    tokens_.insert(std::make_pair(base::StringPiece(*entry), entry));
+  }
+
+  static void Destroy(void *tokens) {
+    delete static_cast<ThreadTokens*>(tokens);
+  }
+
+ private:
+  TokenMap tokens_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadTokens);
+};
+
+class InternTable {
+ public:
+  InternTable() : slot_(&ThreadTokens::Destroy) {
+    for (size_t i = 0; i < arraysize(kWellKnownTokens); ++i)
+      Insert(kWellKnownTokens[i]);
+  }
+
+  // Returns NULL if |str| isn't in the table and there's no room for it.
+  const std::string *Intern(const base::StringPiece &str) {
+    ThreadTokens *tokens = static_cast<ThreadTokens*>(slot_.Get());
+    if (!tokens) {
+      tokens = new ThreadTokens;
+      slot_.Set(tokens);
+    } else if (const std::string *entry = tokens->Find(str)) {
+      return entry;
+    }
+    const std::string *entry;
+    {
+      base::AutoLock lock(lock_);
+      TokenMap::const_iterator i = strings_.find(str);
+      if (i != strings_.end())
+        entry = i->second;
+      else if (strings_.size() >= InternedString::kMaxEntries)
+        return NULL;
+      else
+        entry = Insert(str);
+    }
+    tokens->Add(entry);
+    return entry;
+  }
+
+ private:
+  const std::string *Insert(const base::StringPiece &str) {
+    const std::string *entry = new std::string(str.data(), str.size());
+    strings_.insert(std::make_pair(base::StringPiece(*entry), entry));
+    return entry;
+  }
+
+  base::ThreadLocalStorage::Slot slot_;
+  base::Lock lock_;
+  TokenMap strings_;
+
+  DISALLOW_COPY_AND_ASSIGN(InternTable);
+};
+
+base::LazyInstance<InternTable>::Leaky g_intern_table =
+    LAZY_INSTANCE_INITIALIZER;
+
+}  // namespace
+
+InternedString::InternedString()
+  : str_(&base::EmptyString()) {
+}
+
+InternedString::InternedString(const base::StringPiece &str) {
+  Init(str);
+}
+
+InternedString::InternedString(const char *begin, const char *end) {
+  Init(base::StringPiece(begin, end - begin));
+}
+
+InternedString::InternedString(const InternedString &other)
+  : str_(other.str_), owned_(other.owned_) {
+}
+
+InternedString::~InternedString() {
+}
+
+InternedString InternedString::LowerCase(const base::StringPiece &str) {
+  for (base::StringPiece::const_iterator i = str.begin(), ie = str.end();
+       i != ie; ++i) {
+    if ('A' <= *i && *i <= 'Z')
+      return InternedString(base::StringToLowerASCII(str.as_string()));
+  }
+  return InternedString(str);
+}
+
+InternedString &InternedString::operator=(const InternedString &other) {
+  str_ = other.str_;
+  owned_ = other.owned_;
+  return *this;
+}
+
+void InternedString::Init(const base::StringPiece &str) {
+  if (str.empty()) {
+    str_ = &base::EmptyString();
+    return;
+  }
+  str_ = g_intern_table.Get().Intern(str);
+  if (!str_) {
+    std::string copy(str.data(), str.size());
+    owned_ = base::RefCountedString::TakeString(&copy);
+    str_ = &owned_->data();
+  }
+}
+
+}  // namespace sippet
@@ -0,0 +1,105 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_BASE_INTERNED_STRING_H_
+#define SIPPET_BASE_INTERNED_STRING_H_
+
+#include <string>
+
+#include "base/memory/ref_counted.h"
+#include "base/memory/ref_counted_memory.h"
+#include "base/strings/string_piece.h"
+#include "sippet/base/raw_ostream.h"
+
+namespace sippet {
+
+// A token stored once in a process-wide table. Copies share the table entry,
+// and two interned tokens are equal when they point to the same entry.
+//
+// Entries are never released, so this is meant for the small vocabulary that
+// repeats in every message: parameter names, transport and method names.
+// To keep peers from growing the table without limits, once it is full new
+// tokens get a private, reference counted copy; those still compare by
+// content, and copying them still doesn't allocate.
+//
+// Each thread remembers the entries it interned, so that tokens already
+// seen are found without locking the table.
+class InternedString {
+ public:
+  // Maximum number of distinct tokens kept in the table.
+  static const size_t kMaxEntries = 4096;
+
+  // Creates an empty token; doesn't touch the table.
+  InternedString();
+  explicit InternedString(const base::StringPiece &str);
+  InternedString(const char *begin, const char *end);
+  InternedString(const InternedString &other);
+  ~InternedString();
+
+  // Interns |str| in lower case, for the names compared ignoring case, as
+  // parameter names: a name spelled differently by each peer still takes a
+  // single entry.
+  static InternedString LowerCase(const base::StringPiece &str);
+
+  InternedString &operator=(const InternedString &other);
+
+  const std::string &str() const { return *str_; }
+  const char *c_str() const { return str_->c_str(); }
+  size_t size() const { return str_->size(); }
+  bool empty() const { return str_->empty(); }
+
+  // Whether this token lives in the process-wide table.
+  bool is_interned() const { return !owned_.get(); }
+
+  operator const std::string &() const { return *str_; }
+
+  bool operator==(const InternedString &other) const {
+    if (str_ == other.str_)
+      return true;
+    if (is_interned() && other.is_interned())
+      return false;
+    return *str_ == *other.str_;
+  }
+  bool operator!=(const InternedString &other) const {
+    return !operator==(other);
+  }
+  bool operator==(const std::string &other) const {
+    return *str_ == other;
+  }
+  bool operator!=(const std::string &other) const {
+    return *str_ != other;
+  }
+  bool operator==(const char *other) const {
+    return *str_ == other;
+  }
+  bool operator!=(const char *other) const {
+    return *str_ != other;
+  }
+
+ private:
+  void Init(const base::StringPiece &str);
+
+  const std::string *str_;
+  // Only set for tokens that didn't fit in the table.
+  scoped_refptr<base::RefCountedString> owned_;
+};
+
+inline
+bool operator==(const std::string &a, const InternedString &b) {
+  return b == a;
+}
+
+inline
+bool operator!=(const std::string &a, const InternedString &b) {
+  return b != a;
+}
+
+inline
+raw_ostream &operator<<(raw_ostream &os, const InternedString &s) {
+  return os << s.str();
+}
+
+} // End of sippet namespace
+
+#endif // SIPPET_BASE_INTERNED_STRING_H_
@@ -0,0 +1,122 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/base/memory_accounting.h"
+
+#include "base/atomicops.h"
+#include "base/lazy_instance.h"
+#include "base/logging.h"
+#include "base/strings/stringprintf.h"
+#include "base/trace_event/memory_allocator_dump.h"
+#include "base/trace_event/memory_dump_manager.h"
+#include "base/trace_event/memory_dump_provider.h"
+#include "base/trace_event/process_memory_dump.h"
+
+namespace sippet {
+
+namespace {
+
+const char *const kCategoryNames[] = {
+  "write_queues",
+  "read_buffers",
+  "messages",
+  "transactions",
+  "dialogs",
+  "auth_cache",
+};
+
+COMPILE_ASSERT(arraysize(kCategoryNames) == MemoryAccounting::CATEGORY_MAX,
+               category_names_cover_all_categories);
+
+base::subtle::AtomicWord g_bytes[MemoryAccounting::CATEGORY_MAX];
+base::subtle::AtomicWord g_budget;
+
+class DumpProvider : public base::trace_event::MemoryDumpProvider {
+ public:
+  // Registered once, as the lazy instance is created.
+  DumpProvider() {
+    // The counters are atomic, so the dump can run on any thread.
+    base::trace_event::MemoryDumpManager::GetInstance()->RegisterDumpProvider(
+        this);
+  }
+
+  // base::trace_event::MemoryDumpProvider methods:
+  bool OnMemoryDump(const base::trace_event::MemoryDumpArgs &args,
+                    base::trace_event::ProcessMemoryDump *pmd) override {
+    using base::trace_event::MemoryAllocatorDump;
+    for (int i = 0; i < MemoryAccounting::CATEGORY_MAX; ++i) {
+      MemoryAccounting::Category category =
+          static_cast<MemoryAccounting::Category>(i);
+      MemoryAllocatorDump *dump = pmd->CreateAllocatorDump(base::StringPrintf(
+          "sippet/%s", MemoryAccounting::GetCategoryName(category)));
+      dump->AddScalar(MemoryAllocatorDump::kNameSize,
+                      MemoryAllocatorDump::kUnitsBytes,
+                      MemoryAccounting::Get(category));
+    }
+    MemoryAllocatorDump *total = pmd->CreateAllocatorDump("sippet");
+    total->AddScalar("budget", MemoryAllocatorDump::kUnitsBytes,
+                     MemoryAccounting::GetBudget());
+    return true;
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(DumpProvider);
+};
+
+base::LazyInstance<DumpProvider>::Leaky g_dump_provider =
+    LAZY_INSTANCE_INITIALIZER;
+
+}  // namespace
+
+// static
+void MemoryAccounting::Add(Category category, int64 bytes) {
+  DCHECK_LT(category, CATEGORY_MAX);
+  base::subtle::NoBarrier_AtomicIncrement(&g_bytes[category],
+      static_cast<base::subtle::AtomicWord>(bytes));
+}
+
+// static
+int64 MemoryAccounting::Get(Category category) {
+  DCHECK_LT(category, CATEGORY_MAX);
+  return base::subtle::NoBarrier_Load(&g_bytes[category]);
+}
+
+// static
+int64 MemoryAccounting::GetTotal() {
+  int64 total = 0;
+  for (int i = 0; i < CATEGORY_MAX; ++i)
+    total += base::subtle::NoBarrier_Load(&g_bytes[i]);
+  return total;
+}
+
+// static
+const char *MemoryAccounting::GetCategoryName(Category category) {
+  DCHECK_LT(category, CATEGORY_MAX);
+  return kCategoryNames[category];
+}
+
+// static
+void MemoryAccounting::SetBudget(int64 bytes) {
+  DCHECK_GE(bytes, 0);
+  base::subtle::NoBarrier_Store(&g_budget,
+      static_cast<base::subtle::AtomicWord>(bytes));
+}
+
+// static
+int64 MemoryAccounting::GetBudget() {
+  return base::subtle::NoBarrier_Load(&g_budget);
+}
+
+// static
+bool MemoryAccounting::IsOverBudget() {
+  int64 budget = GetBudget();
+  return budget > 0 && GetTotal() >= budget;
+}
+
+// static
+void MemoryAccounting::RegisterDumpProvider() {
+  g_dump_provider.Get();
+}
+
+} // End of sippet namespace
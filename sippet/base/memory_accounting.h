@@ -0,0 +1,67 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_BASE_MEMORY_ACCOUNTING_H_
+#define SIPPET_BASE_MEMORY_ACCOUNTING_H_
+
+#include "base/basictypes.h"
+
+namespace sippet {
+
+// Process wide accounting of the memory held by sippet, by category, so
+// that it can be watched in memory-infra traces (see
+// |RegisterDumpProvider|) and bounded by a budget.
+//
+// Owners account what they hold with |Add| and give it back with negative
+// amounts; the counters are atomic, so it's safe from any thread. Sizes are
+// estimates: the objects themselves and their main buffers, not every
+// string they own.
+//
+// Once the total reaches the budget, the network layers reject new work
+// (new incoming requests with 503, new outgoing ones with
+// |net::ERR_INSUFFICIENT_RESOURCES|, and new channels) while letting the
+// work already accepted finish, instead of running into the OOM killer.
+class MemoryAccounting {
+ public:
+  enum Category {
+    // Bytes of the messages waiting in the socket writers.
+    WRITE_QUEUES,
+    // Receive buffers of the socket readers.
+    READ_BUFFERS,
+    // Messages alive, with their contents; contents shared by messages
+    // count once per message.
+    MESSAGES,
+    // Client and server transactions.
+    TRANSACTIONS,
+    DIALOGS,
+    // Entries of the authentication caches.
+    AUTH_CACHE,
+    CATEGORY_MAX
+  };
+
+  static void Add(Category category, int64 bytes);
+
+  static int64 Get(Category category);
+  static int64 GetTotal();
+
+  // The name of |category| in the memory dumps, under "sippet/".
+  static const char *GetCategoryName(Category category);
+
+  // Bytes at which new work is rejected. Zero, the default, disables the
+  // budget.
+  static void SetBudget(int64 bytes);
+  static int64 GetBudget();
+  static bool IsOverBudget();
+
+  // Reports the categories to the |base::trace_event::MemoryDumpManager|
+  // of the process. It can be called more than once.
+  static void RegisterDumpProvider();
+
+ private:
+  DISALLOW_IMPLICIT_CONSTRUCTORS(MemoryAccounting);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_BASE_MEMORY_ACCOUNTING_H_
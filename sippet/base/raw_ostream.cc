@@ -45,6 +45,7 @@
 
 #include <cctype>
 #include <cerrno>
+#include <cstring>
 #include <algorithm>
 #include <vector>
 
@@ -420,4 +421,52 @@ void raw_string_ostream::write_impl(const char *Ptr, size_t Size) {
   OS.append(Ptr, Size);
 }
 
+//===----------------------------------------------------------------------===//
+//  raw_fixed_buffer_ostream
+//===----------------------------------------------------------------------===//
+
+raw_fixed_buffer_ostream::raw_fixed_buffer_ostream(char *Buffer, size_t Size)
+  : Buffer(Buffer), BufferSize(Size), Pos(0), Overflowed(false) {
+  if (Size)
+    SetBuffer(Buffer, Size);
+  else
+    SetBuffer(Staging, sizeof(Staging));
+}
+
+raw_fixed_buffer_ostream::~raw_fixed_buffer_ostream() {
+  flush();
+}
+
+uint64 raw_fixed_buffer_ostream::current_pos() const {
+  return Overflowed ? Overflow.size() : Pos;
+}
+
+void raw_fixed_buffer_ostream::write_impl(const char *Ptr, size_t Size) {
+  if (Overflowed) {
+    Overflow.append(Ptr, Size);
+    return;
+  }
+
+  // Flushed data is already in place; anything else is written directly.
+  if (Ptr != Buffer + Pos) {
+    if (Size > BufferSize - Pos) {
+      Overflowed = true;
+      Overflow.reserve(std::max(2 * BufferSize, Pos + Size));
+      Overflow.assign(Buffer, Pos);
+      Overflow.append(Ptr, Size);
+      SetBuffer(Staging, sizeof(Staging));
+      return;
+    }
+    memcpy(Buffer + Pos, Ptr, Size);
+  }
+  Pos += Size;
+
+  // Keep writing in place after the data written so far. Once the buffer is
+  // full, further writes go through the staging area and overflow.
+  if (Pos < BufferSize)
+    SetBuffer(Buffer + Pos, BufferSize - Pos);
+  else
+    SetBuffer(Staging, sizeof(Staging));
+}
+
 }  // namespace sippet
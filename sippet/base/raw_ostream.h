@@ -289,6 +289,45 @@ public:
   }
 };
 
+/// raw_fixed_buffer_ostream - A raw_ostream that writes straight into a
+/// caller provided buffer, without allocating. If the output doesn't fit,
+/// the stream falls back to an internal std::string holding the whole
+/// output. This class does not encounter output errors.
+class raw_fixed_buffer_ostream : public raw_ostream {
+  char *Buffer;
+  size_t BufferSize;
+  size_t Pos;
+
+  /// Holds the whole output once it has overflowed the buffer.
+  bool Overflowed;
+  std::string Overflow;
+
+  /// Buffers the writes made after an overflow.
+  char Staging[64];
+
+  /// write_impl - See raw_ostream::write_impl.
+  void write_impl(const char *Ptr, size_t Size) override;
+
+  /// current_pos - Return the current position within the stream, not
+  /// counting the bytes currently in the buffer.
+  uint64 current_pos() const override;
+
+public:
+  raw_fixed_buffer_ostream(char *Buffer, size_t Size);
+  ~raw_fixed_buffer_ostream() override;
+
+  /// overflowed - Return true if the output didn't fit in the buffer.
+  bool overflowed() const { return Overflowed; }
+
+  /// str - Flushes the stream and returns the output: a reference to the
+  /// caller buffer, or to the internal string after an overflow.
+  base::StringPiece str() {
+    flush();
+    return Overflowed ? base::StringPiece(Overflow)
+                      : base::StringPiece(Buffer, Pos);
+  }
+};
+
 } // End of sippet namespace
 
 #endif // SIPPET_BASE_RAW_OSTREAM_H_
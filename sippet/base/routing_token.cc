@@ -0,0 +1,154 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/base/routing_token.h"
+
+#include <algorithm>
+
+#include "base/base64.h"
+#include "base/logging.h"
+#include "crypto/sha2.h"
+
+namespace sippet {
+
+namespace {
+
+// The version, in the high nibble, and the flags of the token format.
+const uint8 kTokenVersion = 0x10;
+const uint8 kVersionMask = 0xf0;
+const uint8 kHasTimestamp = 0x01;
+
+// Version and flags, shard, node and timestamp.
+const size_t kFieldsSize = 1 + 2 + 2 + 4;
+const size_t kMacSize = 6;
+
+// Whole groups of 3 bytes, so that Base64 never needs padding.
+COMPILE_ASSERT(0 == (kFieldsSize + kMacSize) % 3, token_needs_padding);
+COMPILE_ASSERT(RoutingTokenSigner::kEncodedSize
+                   == (kFieldsSize + kMacSize) / 3 * 4,
+               encoded_size_mismatch);
+
+// Tags are led by a letter not found in random ones.
+const char kTagMarker = '-';
+
+void AppendUint(uint32 value, size_t size, std::string *output) {
+  for (size_t i = size; i > 0; --i)
+    output->push_back(static_cast<char>(value >> ((i - 1) * 8)));
+}
+
+uint32 ReadUint(const std::string &input, size_t offset, size_t size) {
+  uint32 value = 0;
+  for (size_t i = 0; i < size; ++i)
+    value = (value << 8) | static_cast<uint8>(input[offset + i]);
+  return value;
+}
+
+}  // namespace
+
+RoutingToken::RoutingToken()
+  : shard(0),
+    node(0) {
+}
+
+RoutingToken::RoutingToken(uint16 shard, uint16 node)
+  : shard(shard),
+    node(node) {
+}
+
+RoutingTokenSigner::RoutingTokenSigner(const base::StringPiece &key)
+  : hmac_(crypto::HMAC::SHA256) {
+  if (!hmac_.Init(key)) {
+    NOTREACHED();
+  }
+}
+
+RoutingTokenSigner::~RoutingTokenSigner() {
+}
+
+void RoutingTokenSigner::Append(const RoutingToken &token,
+                                std::string *output) const {
+  std::string data;
+  data.reserve(kFieldsSize + kMacSize);
+  uint8 flags = kTokenVersion;
+  int64 seconds = 0;
+  if (!token.timestamp.is_null()) {
+    flags |= kHasTimestamp;
+    seconds = (token.timestamp - base::Time::UnixEpoch()).InSeconds();
+    seconds = std::max<int64>(0, std::min<int64>(seconds, kuint32max));
+  }
+  data.push_back(static_cast<char>(flags));
+  AppendUint(token.shard, 2, &data);
+  AppendUint(token.node, 2, &data);
+  AppendUint(static_cast<uint32>(seconds), 4, &data);
+  unsigned char mac[crypto::kSHA256Length];
+  if (!hmac_.Sign(data, mac, sizeof(mac))) {
+    NOTREACHED();
+  }
+  data.append(reinterpret_cast<const char*>(mac), kMacSize);
+  std::string encoded;
+  base::Base64Encode(data, &encoded);
+  std::replace(encoded.begin(), encoded.end(), '/', '.');
+  DCHECK_EQ(kEncodedSize, encoded.size());
+  output->append(encoded);
+}
+
+bool RoutingTokenSigner::Read(const base::StringPiece &input,
+                              RoutingToken *token) const {
+  if (input.size() < kEncodedSize)
+    return false;
+  std::string encoded(input.data(), kEncodedSize);
+  if (std::string::npos != encoded.find_first_of("/="))
+    return false;
+  std::replace(encoded.begin(), encoded.end(), '.', '/');
+  std::string data;
+  if (!base::Base64Decode(encoded, &data)
+      || data.size() != kFieldsSize + kMacSize)
+    return false;
+  uint8 flags = static_cast<uint8>(data[0]);
+  if (kTokenVersion != (flags & kVersionMask))
+    return false;
+  if (!hmac_.VerifyTruncated(base::StringPiece(data.data(), kFieldsSize),
+                             base::StringPiece(data.data() + kFieldsSize,
+                                               kMacSize)))
+    return false;
+  token->shard = static_cast<uint16>(ReadUint(data, 1, 2));
+  token->node = static_cast<uint16>(ReadUint(data, 3, 2));
+  token->timestamp = base::Time();
+  if (flags & kHasTimestamp) {
+    token->timestamp = base::Time::UnixEpoch()
+        + base::TimeDelta::FromSeconds(ReadUint(data, 5, 4));
+  }
+  return true;
+}
+
+RoutingTagGenerator::RoutingTagGenerator(const RoutingTokenSigner *signer,
+                                         const RoutingToken &token,
+                                         bool timestamped)
+  : signer_(signer),
+    token_(token),
+    timestamped_(timestamped) {
+  DCHECK(signer_);
+}
+
+RoutingTagGenerator::~RoutingTagGenerator() {
+}
+
+std::string RoutingTagGenerator::CreateTag() {
+  RoutingToken token(token_);
+  if (timestamped_)
+    token.timestamp = base::Time::Now();
+  std::string tag(1, kTagMarker);
+  signer_->Append(token, &tag);
+  tag.append(CreateRandomString(48));
+  return tag;
+}
+
+bool RoutingTagGenerator::TokenOfTag(const std::string &tag,
+                                     RoutingToken *token) const {
+  if (tag.empty() || kTagMarker != tag[0])
+    return false;
+  return signer_->Read(base::StringPiece(tag).substr(1), token);
+}
+
+} // End of sippet namespace
@@ -0,0 +1,89 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_BASE_ROUTING_TOKEN_H_
+#define SIPPET_BASE_ROUTING_TOKEN_H_
+
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/strings/string_piece.h"
+#include "base/time/time.h"
+#include "crypto/hmac.h"
+#include "sippet/base/tags.h"
+
+namespace sippet {
+
+// Tells where the state of a transaction or dialog lives in a cluster: the
+// node, and the shard within it (see |NetworkLayerShards|). Carried in the
+// branches and tags created by that shard, it lets the messages coming back
+// be routed to it with no lookup table.
+struct RoutingToken {
+  RoutingToken();
+  RoutingToken(uint16 shard, uint16 node);
+
+  uint16 shard;
+  uint16 node;
+  // When the token was created, with a precision of seconds, so that stale
+  // ones can be told apart; null if not carried.
+  base::Time timestamp;
+};
+
+// Writes and reads |RoutingToken|s authenticated by a key shared by all
+// nodes of the cluster, so that forged ones can't steer messages to other
+// shards or nodes. Tokens take |kEncodedSize| characters, all of them valid
+// in SIP tokens: an HMAC-SHA256 of the routing fields, truncated to 48 bits,
+// follows them, and both are written in Base64, with the slash substituted
+// by dot. Can be used from any thread.
+class RoutingTokenSigner {
+ public:
+  static const size_t kEncodedSize = 20;
+
+  explicit RoutingTokenSigner(const base::StringPiece &key);
+  ~RoutingTokenSigner();
+
+  // Appends |token| to |output|.
+  void Append(const RoutingToken &token, std::string *output) const;
+
+  // Reads the token at the start of |input|. Returns false if there's none,
+  // or if it wasn't signed with the same key.
+  bool Read(const base::StringPiece &input, RoutingToken *token) const;
+
+ private:
+  crypto::HMAC hmac_;
+
+  DISALLOW_COPY_AND_ASSIGN(RoutingTokenSigner);
+};
+
+// Creates tags carrying a routing token, followed by 48 random bits that
+// keep them unique. Used by |Request::CreateResponse| for the To tags, and
+// by the user agent for the From tags, through a |ScopedTagGenerator|, so
+// that the in-dialog requests can be routed just like the responses.
+class RoutingTagGenerator : public TagGenerator {
+ public:
+  // The |signer| is not owned, and must outlive the generator. If
+  // |timestamped|, tokens carry the time they were created at.
+  RoutingTagGenerator(const RoutingTokenSigner *signer,
+                      const RoutingToken &token,
+                      bool timestamped);
+  ~RoutingTagGenerator() override;
+
+  // sippet::TagGenerator methods:
+  std::string CreateTag() override;
+
+  // Gets the token from a tag created by a generator using the same key.
+  // Returns false if |tag| has none.
+  bool TokenOfTag(const std::string &tag, RoutingToken *token) const;
+
+ private:
+  const RoutingTokenSigner *signer_;
+  RoutingToken token_;
+  bool timestamped_;
+
+  DISALLOW_COPY_AND_ASSIGN(RoutingTagGenerator);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_BASE_ROUTING_TOKEN_H_
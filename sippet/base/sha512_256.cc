@@ -0,0 +1,134 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/base/sha512_256.h"
+
+#include <string.h>
+
+#include "base/basictypes.h"
+
+namespace sippet {
+
+namespace {
+
+const uint64 kRoundConstants[80] = {
+  0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL,
+  0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+  0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL,
+  0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+  0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+  0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+  0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL, 0x2de92c6f592b0275ULL,
+  0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+  0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL,
+  0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+  0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL,
+  0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+  0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL,
+  0x92722c851482353bULL, 0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+  0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+  0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+  0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL,
+  0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+  0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL,
+  0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+  0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL,
+  0xc67178f2e372532bULL, 0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+  0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL,
+  0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+  0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+  0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+  0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL,
+};
+
+// The initial hash value of SHA-512/256, which is what sets it apart from
+// a truncated SHA-512.
+const uint64 kInitialHash[8] = {
+  0x22312194fc2bf72cULL, 0x9f555fa3c84c64c2ULL, 0x2393b86b6f53b151ULL,
+  0x963877195940eabdULL, 0x96283ee2a88effe3ULL, 0xbe5e1e2553863992ULL,
+  0x2b0199fc2c85b8aaULL, 0x0eb72ddc81c52ca2ULL,
+};
+
+const size_t kBlockSize = 128;
+
+uint64 Rotate(uint64 value, int bits) {
+  return (value >> bits) | (value << (64 - bits));
+}
+
+void ProcessBlock(const uint8 *block, uint64 *hash) {
+  uint64 w[80];
+  for (int i = 0; i < 16; ++i) {
+    w[i] = 0;
+    for (int j = 0; j < 8; ++j)
+      w[i] = (w[i] << 8) | block[i * 8 + j];
+  }
+  for (int i = 16; i < 80; ++i) {
+    uint64 s0 = Rotate(w[i - 15], 1) ^ Rotate(w[i - 15], 8) ^ (w[i - 15] >> 7);
+    uint64 s1 = Rotate(w[i - 2], 19) ^ Rotate(w[i - 2], 61) ^ (w[i - 2] >> 6);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  uint64 a = hash[0], b = hash[1], c = hash[2], d = hash[3];
+  uint64 e = hash[4], f = hash[5], g = hash[6], h = hash[7];
+  for (int i = 0; i < 80; ++i) {
+    uint64 s1 = Rotate(e, 14) ^ Rotate(e, 18) ^ Rotate(e, 41);
+    uint64 ch = (e & f) ^ (~e & g);
+    uint64 t1 = h + s1 + ch + kRoundConstants[i] + w[i];
+    uint64 s0 = Rotate(a, 28) ^ Rotate(a, 34) ^ Rotate(a, 39);
+    uint64 maj = (a & b) ^ (a & c) ^ (b & c);
+    uint64 t2 = s0 + maj;
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  hash[0] += a;
+  hash[1] += b;
+  hash[2] += c;
+  hash[3] += d;
+  hash[4] += e;
+  hash[5] += f;
+  hash[6] += g;
+  hash[7] += h;
+}
+
+}  // namespace
+
+std::string SHA512_256HashString(const base::StringPiece& str) {
+  uint64 hash[8];
+  memcpy(hash, kInitialHash, sizeof(hash));
+
+  const uint8 *data = reinterpret_cast<const uint8*>(str.data());
+  size_t size = str.size();
+  size_t offset = 0;
+  for (; offset + kBlockSize <= size; offset += kBlockSize)
+    ProcessBlock(data + offset, hash);
+
+  // Pad with a one bit, zeros and the 128-bit message length in bits; the
+  // length never needs more than its lower 64 bits here.
+  uint8 tail[2 * kBlockSize];
+  size_t remaining = size - offset;
+  memset(tail, 0, sizeof(tail));
+  if (remaining)
+    memcpy(tail, data + offset, remaining);
+  tail[remaining] = 0x80;
+  size_t tail_size = remaining + 1 + 16 <= kBlockSize ?
+      kBlockSize : 2 * kBlockSize;
+  uint64 bits = static_cast<uint64>(size) << 3;
+  for (int i = 0; i < 8; ++i)
+    tail[tail_size - 1 - i] = static_cast<uint8>(bits >> (i * 8));
+  for (size_t i = 0; i < tail_size; i += kBlockSize)
+    ProcessBlock(tail + i, hash);
+
+  std::string output(kSHA512_256Length, '\0');
+  for (size_t i = 0; i < kSHA512_256Length; ++i)
+    output[i] = static_cast<char>(hash[i / 8] >> (56 - (i % 8) * 8));
+  return output;
+}
+
+} // End of sippet namespace
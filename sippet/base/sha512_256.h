@@ -0,0 +1,24 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_BASE_SHA512_256_H_
+#define SIPPET_BASE_SHA512_256_H_
+
+#include <string>
+
+#include "base/strings/string_piece.h"
+
+namespace sippet {
+
+// Length in bytes of a SHA-512/256 hash.
+static const size_t kSHA512_256Length = 32;
+
+// Computes the SHA-512/256 hash (FIPS 180-4) of |str|, as needed by the
+// SHA-512-256 digest algorithm (RFC 7616) that the crypto library lacks.
+// Returns the binary hash, |kSHA512_256Length| bytes long.
+std::string SHA512_256HashString(const base::StringPiece& str);
+
+} // End of sippet namespace
+
+#endif // SIPPET_BASE_SHA512_256_H_
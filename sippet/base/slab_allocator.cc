@@ -0,0 +1,128 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/base/slab_allocator.h"
+
+#include "base/logging.h"
+
+namespace sippet {
+
+namespace {
+
+// |operator new| returns memory aligned at least like this.
+const size_t kBlockAlignment = 2 * sizeof(void*);
+
+size_t AlignBlockSize(size_t size) {
+  if (size < sizeof(void*))
+    size = sizeof(void*);
+  return (size + kBlockAlignment - 1) & ~(kBlockAlignment - 1);
+}
+
+}  // namespace
+
+SlabAllocator::SlabAllocator(size_t block_size, size_t blocks_per_slab)
+  : block_size_(AlignBlockSize(block_size)),
+    blocks_per_slab_(blocks_per_slab),
+    slot_(&SlabAllocator::OnThreadExit),
+    allocated_blocks_(0),
+    shared_free_list_(NULL) {
+  DCHECK_GT(blocks_per_slab, 0u);
+}
+
+SlabAllocator::~SlabAllocator() {
+  DCHECK_EQ(0u, allocated_blocks());
+  delete static_cast<ThreadCache*>(slot_.Get());
+  slot_.Set(NULL);
+  for (size_t i = 0; i < slabs_.size(); ++i)
+    ::operator delete(slabs_[i]);
+}
+
+void *SlabAllocator::Allocate() {
+  ThreadCache *cache = CurrentCache();
+  if (!cache->free_list)
+    Refill(cache);
+  FreeBlock *block = cache->free_list;
+  cache->free_list = block->next;
+  --cache->free_blocks;
+  base::subtle::NoBarrier_AtomicIncrement(&allocated_blocks_, 1);
+  return block;
+}
+
+void SlabAllocator::Free(void *p) {
+  if (!p)
+    return;
+  DCHECK_GT(allocated_blocks(), 0u);
+  ThreadCache *cache = CurrentCache();
+  FreeBlock *block = static_cast<FreeBlock*>(p);
+  block->next = cache->free_list;
+  cache->free_list = block;
+  ++cache->free_blocks;
+  base::subtle::NoBarrier_AtomicIncrement(&allocated_blocks_, -1);
+  if (cache->free_blocks >= 2 * blocks_per_slab_)
+    Release(cache, blocks_per_slab_);
+}
+
+size_t SlabAllocator::allocated_blocks() const {
+  return static_cast<size_t>(
+      base::subtle::NoBarrier_Load(&allocated_blocks_));
+}
+
+size_t SlabAllocator::reserved_blocks() const {
+  base::AutoLock lock(lock_);
+  return slabs_.size() * blocks_per_slab_;
+}
+
+SlabAllocator::ThreadCache *SlabAllocator::CurrentCache() {
+  ThreadCache *cache = static_cast<ThreadCache*>(slot_.Get());
+  if (!cache) {
+    cache = new ThreadCache(this);
+    slot_.Set(cache);
+  }
+  return cache;
+}
+
+void SlabAllocator::Refill(ThreadCache *cache) {
+  base::AutoLock lock(lock_);
+  if (shared_free_list_) {
+    for (size_t i = 0; i < blocks_per_slab_ && shared_free_list_; ++i) {
+      FreeBlock *block = shared_free_list_;
+      shared_free_list_ = block->next;
+      block->next = cache->free_list;
+      cache->free_list = block;
+      ++cache->free_blocks;
+    }
+    return;
+  }
+  char *slab = static_cast<char*>(
+      ::operator new(block_size_ * blocks_per_slab_));
+  slabs_.push_back(slab);
+  // Thread the new blocks in address order, so they're handed out that way.
+  for (size_t i = blocks_per_slab_; i > 0; --i) {
+    FreeBlock *block = reinterpret_cast<FreeBlock*>(
+        slab + (i - 1) * block_size_);
+    block->next = cache->free_list;
+    cache->free_list = block;
+  }
+  cache->free_blocks += blocks_per_slab_;
+}
+
+void SlabAllocator::Release(ThreadCache *cache, size_t count) {
+  base::AutoLock lock(lock_);
+  for (size_t i = 0; i < count && cache->free_list; ++i) {
+    FreeBlock *block = cache->free_list;
+    cache->free_list = block->next;
+    --cache->free_blocks;
+    block->next = shared_free_list_;
+    shared_free_list_ = block;
+  }
+}
+
+// static
+void SlabAllocator::OnThreadExit(void *cache) {
+  ThreadCache *thread_cache = static_cast<ThreadCache*>(cache);
+  thread_cache->allocator->Release(thread_cache, thread_cache->free_blocks);
+  delete thread_cache;
+}
+
+}  // namespace sippet
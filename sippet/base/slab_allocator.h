@@ -0,0 +1,87 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_BASE_SLAB_ALLOCATOR_H_
+#define SIPPET_BASE_SLAB_ALLOCATOR_H_
+
+#include <vector>
+
+#include "base/atomicops.h"
+#include "base/basictypes.h"
+#include "base/synchronization/lock.h"
+#include "base/threading/thread_local_storage.h"
+
+namespace sippet {
+
+// Hands out blocks of a single, fixed size, carved from slabs holding many
+// blocks each. Freed blocks are kept in a free list and handed out again, so
+// once the working set has been reached, allocating and freeing is a couple
+// of pointer swaps, and there's no per-block allocator overhead.
+//
+// As in |MessagePool|, each thread keeps a free list of its own, so that
+// allocating and freeing take no lock; blocks freed by another thread than
+// the one that allocated them join the free list of the freeing thread.
+// The allocator is only locked to carve a new slab, to move a batch of
+// blocks between a thread and a shared free list, as when a thread that
+// only frees gathers too many of them, and when a thread exits, its blocks
+// going back to the shared list.
+//
+// Slabs are only released when the allocator is destroyed, after all of its
+// blocks have been freed, and the other threads that used it have exited.
+// Each allocator takes a thread-local storage slot, so they're meant to be
+// few and long-lived.
+class SlabAllocator {
+ public:
+  // |block_size| is rounded up to keep blocks aligned for any type.
+  SlabAllocator(size_t block_size, size_t blocks_per_slab);
+  ~SlabAllocator();
+
+  size_t block_size() const { return block_size_; }
+
+  void *Allocate();
+  void Free(void *p);
+
+  // Number of blocks currently allocated, and reserved by slabs.
+  size_t allocated_blocks() const;
+  size_t reserved_blocks() const;
+
+ private:
+  struct FreeBlock {
+    FreeBlock *next;
+  };
+
+  struct ThreadCache {
+    explicit ThreadCache(SlabAllocator *allocator)
+      : allocator(allocator), free_list(NULL), free_blocks(0) {}
+
+    SlabAllocator *allocator;
+    FreeBlock *free_list;
+    size_t free_blocks;
+  };
+
+  ThreadCache *CurrentCache();
+
+  // Gives |cache| a batch of blocks from the shared free list, or a new
+  // slab if it's empty.
+  void Refill(ThreadCache *cache);
+  // Moves up to |count| blocks of |cache| to the shared free list.
+  void Release(ThreadCache *cache, size_t count);
+
+  static void OnThreadExit(void *cache);
+
+  const size_t block_size_;
+  const size_t blocks_per_slab_;
+  base::ThreadLocalStorage::Slot slot_;
+  base::subtle::Atomic32 allocated_blocks_;
+
+  mutable base::Lock lock_;
+  FreeBlock *shared_free_list_;
+  std::vector<void*> slabs_;
+
+  DISALLOW_COPY_AND_ASSIGN(SlabAllocator);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_BASE_SLAB_ALLOCATOR_H_
@@ -0,0 +1,94 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/base/slab_allocator.h"
+
+#include <set>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/location.h"
+#include "base/single_thread_task_runner.h"
+#include "base/threading/thread.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const size_t kBlocksPerSlab = 4;
+
+void FreeAll(SlabAllocator *allocator, const std::vector<void*> &blocks) {
+  for (size_t i = 0; i < blocks.size(); ++i)
+    allocator->Free(blocks[i]);
+}
+
+}  // namespace
+
+TEST(SlabAllocatorTest, ReusesFreedBlocks) {
+  SlabAllocator allocator(sizeof(int) + 1, kBlocksPerSlab);
+  EXPECT_EQ(0u, allocator.block_size() % (2 * sizeof(void*)));
+  EXPECT_EQ(0u, allocator.reserved_blocks());
+
+  void *first = allocator.Allocate();
+  void *second = allocator.Allocate();
+  EXPECT_EQ(static_cast<char*>(first) + allocator.block_size(), second);
+  EXPECT_EQ(2u, allocator.allocated_blocks());
+  EXPECT_EQ(kBlocksPerSlab, allocator.reserved_blocks());
+
+  allocator.Free(first);
+  EXPECT_EQ(first, allocator.Allocate());
+  allocator.Free(second);
+  allocator.Free(first);
+  allocator.Free(NULL);
+  EXPECT_EQ(0u, allocator.allocated_blocks());
+}
+
+TEST(SlabAllocatorTest, AddsSlabsWhenExhausted) {
+  SlabAllocator allocator(sizeof(void*), kBlocksPerSlab);
+  std::vector<void*> blocks;
+  for (size_t i = 0; i < kBlocksPerSlab; ++i)
+    blocks.push_back(allocator.Allocate());
+  EXPECT_EQ(kBlocksPerSlab, allocator.reserved_blocks());
+
+  blocks.push_back(allocator.Allocate());
+  EXPECT_EQ(2 * kBlocksPerSlab, allocator.reserved_blocks());
+  EXPECT_EQ(kBlocksPerSlab + 1, allocator.allocated_blocks());
+  std::set<void*> distinct(blocks.begin(), blocks.end());
+  EXPECT_EQ(blocks.size(), distinct.size());
+
+  // Blocks freed are used before carving more slabs.
+  FreeAll(&allocator, blocks);
+  blocks.clear();
+  for (size_t i = 0; i < 2 * kBlocksPerSlab; ++i)
+    blocks.push_back(allocator.Allocate());
+  EXPECT_EQ(2 * kBlocksPerSlab, allocator.reserved_blocks());
+  FreeAll(&allocator, blocks);
+}
+
+TEST(SlabAllocatorTest, FreesFromAnotherThread) {
+  SlabAllocator allocator(sizeof(void*), kBlocksPerSlab);
+  std::vector<void*> blocks;
+  for (size_t i = 0; i < kBlocksPerSlab; ++i)
+    blocks.push_back(allocator.Allocate());
+
+  // The blocks freed by the thread go back to the allocator as it exits.
+  base::Thread thread("SlabAllocatorTest");
+  ASSERT_TRUE(thread.Start());
+  thread.task_runner()->PostTask(FROM_HERE,
+      base::Bind(&FreeAll, &allocator, blocks));
+  thread.Stop();
+  EXPECT_EQ(0u, allocator.allocated_blocks());
+
+  std::set<void*> freed(blocks.begin(), blocks.end());
+  blocks.clear();
+  for (size_t i = 0; i < kBlocksPerSlab; ++i) {
+    blocks.push_back(allocator.Allocate());
+    EXPECT_TRUE(freed.count(blocks.back()));
+  }
+  EXPECT_EQ(kBlocksPerSlab, allocator.reserved_blocks());
+  FreeAll(&allocator, blocks);
+}
+
+}  // namespace sippet
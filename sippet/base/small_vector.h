@@ -0,0 +1,219 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_BASE_SMALL_VECTOR_H_
+#define SIPPET_BASE_SMALL_VECTOR_H_
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+
+#include "base/compiler_specific.h"
+#include "base/memory/aligned_memory.h"
+
+namespace sippet {
+
+// SmallVector - A vector keeping up to |N| elements inside the object
+// itself, after the fashion of LLVM's SmallVector. It only allocates when
+// growing past |N|, so that containers that are mostly small (header
+// parameters, or the values of a header) don't allocate at all.
+//
+// Iterators are plain pointers, invalidated as with std::vector.
+template<typename T, unsigned N>
+class SmallVector {
+ public:
+  typedef T value_type;
+  typedef T *iterator;
+  typedef const T *const_iterator;
+  typedef std::reverse_iterator<iterator> reverse_iterator;
+  typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+  typedef T &reference;
+  typedef const T &const_reference;
+  typedef T *pointer;
+  typedef const T *const_pointer;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+
+  SmallVector()
+    : begin_(inline_begin()), end_(begin_), capacity_(begin_ + N) {}
+
+  SmallVector(const SmallVector &other)
+    : begin_(inline_begin()), end_(begin_), capacity_(begin_ + N) {
+    append(other.begin(), other.end());
+  }
+
+  template<typename InIt> SmallVector(InIt first, InIt last)
+    : begin_(inline_begin()), end_(begin_), capacity_(begin_ + N) {
+    append(first, last);
+  }
+
+  ~SmallVector() {
+    destroy_range(begin_, end_);
+    if (!is_small())
+      ::operator delete(begin_);
+  }
+
+  SmallVector &operator=(const SmallVector &other) {
+    if (this != &other)
+      assign(other.begin(), other.end());
+    return *this;
+  }
+
+  // Iterator creation methods.
+  iterator begin()             { return begin_; }
+  const_iterator begin() const { return begin_; }
+  iterator end()               { return end_; }
+  const_iterator end() const   { return end_; }
+
+  // reverse iterator creation methods.
+  reverse_iterator rbegin()             { return reverse_iterator(end()); }
+  const_reverse_iterator rbegin() const {
+    return const_reverse_iterator(end());
+  }
+  reverse_iterator rend()               { return reverse_iterator(begin()); }
+  const_reverse_iterator rend() const {
+    return const_reverse_iterator(begin());
+  }
+
+  // Miscellaneous inspection routines.
+  size_type size() const { return end_ - begin_; }
+  size_type capacity() const { return capacity_ - begin_; }
+  size_type max_size() const {
+    return std::numeric_limits<size_type>::max() / sizeof(T);
+  }
+  bool empty() const { return begin_ == end_; }
+
+  // Whether the elements are still kept inside the object.
+  bool is_small() const { return begin_ == inline_begin(); }
+
+  // Element accessors.
+  reference operator[](size_type index) {
+    assert(index < size());
+    return begin_[index];
+  }
+  const_reference operator[](size_type index) const {
+    assert(index < size());
+    return begin_[index];
+  }
+  reference front() { assert(!empty()); return begin_[0]; }
+  const_reference front() const { assert(!empty()); return begin_[0]; }
+  reference back() { assert(!empty()); return end_[-1]; }
+  const_reference back() const { assert(!empty()); return end_[-1]; }
+
+  // modifiers
+  void reserve(size_type n) {
+    if (n > capacity())
+      grow(n);
+  }
+
+  void push_back(const value_type &value) {
+    if (end_ == capacity_) {
+      // |value| may be an element of this vector.
+      value_type copy(value);
+      grow(size() + 1);
+      new (end_) value_type(copy);
+    } else {
+      new (end_) value_type(value);
+    }
+    ++end_;
+  }
+
+  void pop_back() {
+    assert(!empty());
+    --end_;
+    end_->~value_type();
+  }
+
+  template<typename InIt> void append(InIt first, InIt last) {
+    for (; first != last; ++first)
+      push_back(*first);
+  }
+
+  template<typename InIt> void assign(InIt first, InIt last) {
+    clear();
+    append(first, last);
+  }
+
+  iterator insert(iterator where, const value_type &value) {
+    assert(where >= begin_ && where <= end_);
+    if (where == end_) {
+      push_back(value);
+      return end_ - 1;
+    }
+    value_type copy(value);
+    size_type index = where - begin_;
+    if (end_ == capacity_)
+      grow(size() + 1);
+    where = begin_ + index;
+    new (end_) value_type(end_[-1]);
+    std::copy_backward(where, end_ - 1, end_);
+    ++end_;
+    *where = copy;
+    return where;
+  }
+
+  // The ranges inserted are short, so elements are inserted one by one.
+  template<typename InIt> void insert(iterator where, InIt first, InIt last) {
+    size_type index = where - begin_;
+    for (; first != last; ++first, ++index)
+      insert(begin_ + index, *first);
+  }
+
+  // erase - remove a node from the controlled sequence... and delete it.
+  iterator erase(iterator where) {
+    assert(where >= begin_ && where < end_);
+    std::copy(where + 1, end_, where);
+    pop_back();
+    return where;
+  }
+  iterator erase(iterator first, iterator last) {
+    assert(first >= begin_ && first <= last && last <= end_);
+    iterator new_end = std::copy(last, end_, first);
+    destroy_range(new_end, end_);
+    end_ = new_end;
+    return first;
+  }
+
+  // clear everything; the capacity is kept.
+  void clear() {
+    destroy_range(begin_, end_);
+    end_ = begin_;
+  }
+
+ private:
+  T *inline_begin() { return static_cast<T *>(inline_.void_data()); }
+  const T *inline_begin() const {
+    return static_cast<const T *>(inline_.void_data());
+  }
+
+  static void destroy_range(T *first, T *last) {
+    for (; first != last; ++first)
+      first->~T();
+  }
+
+  void grow(size_type min_capacity) {
+    size_type new_capacity = std::max(2 * capacity(), min_capacity);
+    T *new_begin = static_cast<T *>(::operator new(new_capacity * sizeof(T)));
+    T *new_end = std::uninitialized_copy(begin_, end_, new_begin);
+    destroy_range(begin_, end_);
+    if (!is_small())
+      ::operator delete(begin_);
+    begin_ = new_begin;
+    end_ = new_end;
+    capacity_ = new_begin + new_capacity;
+  }
+
+  T *begin_;
+  T *end_;
+  T *capacity_;
+  base::AlignedMemory<sizeof(T) * N, ALIGNOF(T)> inline_;
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_BASE_SMALL_VECTOR_H_
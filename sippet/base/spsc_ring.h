@@ -0,0 +1,107 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_BASE_SPSC_RING_H_
+#define SIPPET_BASE_SPSC_RING_H_
+
+#include <algorithm>
+
+#include "base/atomicops.h"
+#include "base/basictypes.h"
+#include "base/logging.h"
+#include "base/memory/scoped_ptr.h"
+
+namespace sippet {
+
+// A bounded, lock-free queue for exactly one producer thread and one consumer
+// thread. Slots are allocated once, at construction, and elements are swapped
+// in and out of them: given a |swap| that just exchanges pointers, found by
+// argument dependent lookup, elements holding strings or |scoped_refptr|s
+// cross threads without allocating nor touching reference counts. |T| must be
+// default constructible.
+//
+// |Push| must only be called from the producer thread, |Pop| only from the
+// consumer thread; |empty| and |size| may be called from any thread, but are
+// only a snapshot.
+template<typename T>
+class SpscRing {
+ public:
+  // |capacity| is rounded up to the next power of two.
+  explicit SpscRing(size_t capacity)
+    : mask_(RoundUpToPowerOfTwo(capacity) - 1),
+      slots_(new T[mask_ + 1]),
+      head_(0),
+      tail_(0) {
+  }
+
+  size_t capacity() const { return mask_ + 1; }
+
+  // Swaps |value| into the ring. Returns false, leaving |value| untouched, if
+  // the ring is full.
+  bool Push(T *value) {
+    uint32 tail = base::subtle::NoBarrier_Load(&tail_);
+    uint32 head = base::subtle::Acquire_Load(&head_);
+    if (tail - head > mask_)
+      return false;
+    using std::swap;
+    swap(slots_[tail & mask_], *value);
+    // Publish the slot contents before the new tail.
+    base::subtle::Release_Store(&tail_, tail + 1);
+    return true;
+  }
+
+  // Swaps the oldest element out of the ring into |value|. Returns false if
+  // the ring is empty.
+  bool Pop(T *value) {
+    uint32 head = base::subtle::NoBarrier_Load(&head_);
+    uint32 tail = base::subtle::Acquire_Load(&tail_);
+    if (head == tail)
+      return false;
+    using std::swap;
+    swap(slots_[head & mask_], *value);
+    {
+      // Release the previous contents of |value| here, on the consumer
+      // thread, instead of keeping them alive in the slot.
+      T released;
+      swap(slots_[head & mask_], released);
+    }
+    base::subtle::Release_Store(&head_, head + 1);
+    return true;
+  }
+
+  bool empty() const { return size() == 0; }
+
+  size_t size() const {
+    uint32 head = base::subtle::Acquire_Load(&head_);
+    uint32 tail = base::subtle::Acquire_Load(&tail_);
+    return tail - head;
+  }
+
+ private:
+  static size_t RoundUpToPowerOfTwo(size_t n) {
+    DCHECK_GT(n, 0u);
+    DCHECK_LE(n, static_cast<size_t>(1) << 30);  // Fits in 32 bits.
+    size_t result = 1;
+    while (result < n)
+      result <<= 1;
+    return result;
+  }
+
+  const size_t mask_;
+  scoped_ptr<T[]> slots_;
+
+  // Positions grow forever and wrap around, so they are handled as unsigned
+  // values; only their difference and their low bits are meaningful. |head_|
+  // is written by the consumer only, and |tail_| by the producer only, each
+  // one on its own cache line.
+  volatile base::subtle::Atomic32 head_;
+  char head_padding_[64 - sizeof(base::subtle::Atomic32)];
+  volatile base::subtle::Atomic32 tail_;
+
+  DISALLOW_COPY_AND_ASSIGN(SpscRing);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_BASE_SPSC_RING_H_
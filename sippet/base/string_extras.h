@@ -161,6 +161,19 @@ static inline unsigned HashString(const base::StringPiece &Str, unsigned Result
   return Result;
 }
 
+/// HashLowerString - Same as HashString, over the ASCII lower case of \p Str,
+/// so that strings differing only in case hash the same.
+static inline unsigned HashLowerString(const base::StringPiece &Str,
+                                       unsigned Result = 0) {
+  for (size_t i = 0, e = Str.size(); i != e; ++i) {
+    unsigned char C = Str[i];
+    if (C >= 'A' && C <= 'Z')
+      C += 'a' - 'A';
+    Result = Result * 33 + C;
+  }
+  return Result;
+}
+
 /// Returns the English suffix for an ordinal integer (-st, -nd, -rd, -th).
 static inline base::StringPiece getOrdinalSuffix(unsigned Val) {
   // It is critically important that we do this perfectly for
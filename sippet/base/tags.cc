@@ -4,36 +4,178 @@
 
 #include "sippet/base/tags.h"
 
+#include <string.h>
+
+#include "base/basictypes.h"
+#include "base/lazy_instance.h"
+#include "base/threading/thread_local.h"
+#include "base/threading/thread_local_storage.h"
 #include "crypto/random.h"
-#include "base/strings/string_util.h"
-#include "base/base64.h"
 
 namespace sippet {
 
-std::string CreateRandomString(int bits) {
-  // This function uses Base64 for the final encoding, as it will generate a
-  // shorter string than hex (just 33% of overhead).
+namespace {
 
-  // First, round up the number of bits.
-  int bytes = (bits + 7) >> 3;
+// Base64 alphabet, with the slash, an invalid character for SIP tokens,
+// substituted by dot.
+const char kTokenAlphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+.";
 
-  // Avoid Base64 padding at the end (must be multiple of 3).
-  int base64_no_padding = ((bytes + 2) / 3) * 3;
+// Blocks generated before the key is replaced by a new one from the OS.
+const uint32 kRekeyBlocks = 1 << 16;
 
-  char *tag = new char[base64_no_padding];
+// A ChaCha20 keystream, keyed from the OS, used as a fast CSPRNG. There's
+// one per thread, so that no locking is needed.
+class RandomGenerator {
+ public:
+  RandomGenerator() : position_(sizeof(block_)) {
+    Rekey();
+  }
 
-  crypto::RandBytes(tag, base64_no_padding);
-  std::string random_string;
-  base::StringPiece part(tag, base64_no_padding);
-  base::Base64Encode(part, &random_string);
+  ~RandomGenerator() {
+    memset(state_, 0, sizeof(state_));
+    memset(block_, 0, sizeof(block_));
+  }
+
+  static void Destroy(void *generator) {
+    delete static_cast<RandomGenerator*>(generator);
+  }
+
+  uint8 NextByte() {
+    if (position_ == sizeof(block_))
+      NextBlock();
+    return block_[position_++];
+  }
+
+ private:
+  static uint32 Rotate(uint32 value, int bits) {
+    return (value << bits) | (value >> (32 - bits));
+  }
+
+  static void QuarterRound(uint32 *x, int a, int b, int c, int d) {
+    x[a] += x[b]; x[d] = Rotate(x[d] ^ x[a], 16);
+    x[c] += x[d]; x[b] = Rotate(x[b] ^ x[c], 12);
+    x[a] += x[b]; x[d] = Rotate(x[d] ^ x[a], 8);
+    x[c] += x[d]; x[b] = Rotate(x[b] ^ x[c], 7);
+  }
+
+  void Rekey() {
+    // "expand 32-byte k", then the key, the block counter and the nonce.
+    state_[0] = 0x61707865;
+    state_[1] = 0x3320646e;
+    state_[2] = 0x79622d32;
+    state_[3] = 0x6b206574;
+    crypto::RandBytes(&state_[4], 8 * sizeof(uint32));
+    state_[12] = 0;
+    crypto::RandBytes(&state_[13], 3 * sizeof(uint32));
+  }
+
+  void NextBlock() {
+    if (state_[12] == kRekeyBlocks)
+      Rekey();
+    uint32 x[16];
+    memcpy(x, state_, sizeof(x));
+    for (int i = 0; i < 10; ++i) {
+      QuarterRound(x, 0, 4, 8, 12);
+      QuarterRound(x, 1, 5, 9, 13);
+      QuarterRound(x, 2, 6, 10, 14);
+      QuarterRound(x, 3, 7, 11, 15);
+      QuarterRound(x, 0, 5, 10, 15);
+      QuarterRound(x, 1, 6, 11, 12);
+      QuarterRound(x, 2, 7, 8, 13);
+      QuarterRound(x, 3, 4, 9, 14);
+    }
+    for (int i = 0; i < 16; ++i) {
+      uint32 word = x[i] + state_[i];
+      block_[i * 4] = static_cast<uint8>(word);
+      block_[i * 4 + 1] = static_cast<uint8>(word >> 8);
+      block_[i * 4 + 2] = static_cast<uint8>(word >> 16);
+      block_[i * 4 + 3] = static_cast<uint8>(word >> 24);
+    }
+    memset(x, 0, sizeof(x));
+    ++state_[12];
+    position_ = 0;
+  }
+
+  uint32 state_[16];
+  uint8 block_[64];
+  size_t position_;
+
+  DISALLOW_COPY_AND_ASSIGN(RandomGenerator);
+};
+
+struct GeneratorSlot {
+  GeneratorSlot() : slot(&RandomGenerator::Destroy) {}
+  base::ThreadLocalStorage::Slot slot;
+};
+
+base::LazyInstance<GeneratorSlot>::Leaky g_generator_slot =
+    LAZY_INSTANCE_INITIALIZER;
+
+base::LazyInstance<base::ThreadLocalPointer<TagGenerator> >::Leaky
+    g_tag_generator = LAZY_INSTANCE_INITIALIZER;
 
-  delete [] tag;
+RandomGenerator *CurrentGenerator() {
+  base::ThreadLocalStorage::Slot &slot = g_generator_slot.Get().slot;
+  RandomGenerator *generator = static_cast<RandomGenerator*>(slot.Get());
+  if (!generator) {
+    generator = new RandomGenerator;
+    slot.Set(generator);
+  }
+  return generator;
+}
+
+// Appends at least |bits| random bits to |output|, 6 per character, as the
+// Base64 encoding of whole groups of 3 random bytes: no padding is ever
+// needed.
+void AppendRandomString(int bits, std::string *output) {
+  int bytes = (bits + 7) >> 3;
+  int groups = (bytes + 2) / 3;
+  size_t offset = output->size();
+  output->resize(offset + groups * 4);
+  char *out = &(*output)[offset];
+  RandomGenerator *generator = CurrentGenerator();
+  for (int i = 0; i < groups; ++i) {
+    uint8 b0 = generator->NextByte();
+    uint8 b1 = generator->NextByte();
+    uint8 b2 = generator->NextByte();
+    *out++ = kTokenAlphabet[b0 >> 2];
+    *out++ = kTokenAlphabet[((b0 & 0x03) << 4) | (b1 >> 4)];
+    *out++ = kTokenAlphabet[((b1 & 0x0f) << 2) | (b2 >> 6)];
+    *out++ = kTokenAlphabet[b2 & 0x3f];
+  }
+}
 
-  // Slash is an invalid character for SIP tokens, so substitute it by dot.
-  base::ReplaceChars(random_string, "/", ".", &random_string);
+}  // namespace
 
+std::string CreateRandomString(int bits) {
+  std::string random_string;
+  AppendRandomString(bits, &random_string);
   return random_string;
 }
 
-}  // namespace sippet
+ScopedTagGenerator::ScopedTagGenerator(TagGenerator *generator)
+  : previous_(g_tag_generator.Pointer()->Get()) {
+  g_tag_generator.Pointer()->Set(generator);
+}
 
+ScopedTagGenerator::~ScopedTagGenerator() {
+  g_tag_generator.Pointer()->Set(previous_);
+}
+
+std::string CreateTag() {
+  TagGenerator *generator = g_tag_generator.Pointer()->Get();
+  if (generator)
+    return generator->CreateTag();
+  return CreateRandomString(48);
+}
+
+std::string CreateBranch() {
+  std::string branch;
+  branch.reserve(sizeof(kMagicCookie) - 1 + 12);
+  branch.append(kMagicCookie, sizeof(kMagicCookie) - 1);
+  AppendRandomString(72, &branch);
+  return branch;
+}
+
+}  // namespace sippet
@@ -7,23 +7,45 @@
 
 #include <string>
 
+#include "base/basictypes.h"
+
 namespace sippet {
 
-// Create a random string at least of that indicated size of bits
+// Create a random string at least of that indicated size of bits. Strings
+// come from a per-thread ChaCha20 generator keyed by the OS, and are made of
+// SIP token characters.
 std::string CreateRandomString(int bits);
 
 // This is the magic cookie "z9hG4bK" defined in RFC 3261
 static const char kMagicCookie[] = "z9hG4bK";
 
 // Create an unique local branch (72-bit random string, 7+12 characters long).
-inline std::string CreateBranch() {
-  return kMagicCookie + CreateRandomString(72);
-}
-
-// Create a local tag (48-bit random string, 8 characters long).
-inline std::string CreateTag() {
-  return CreateRandomString(48);
-}
+std::string CreateBranch();
+
+// Creates the local tags of a thread instead of |CreateRandomString|, e.g.
+// to carry where the dialog is handled (see |RoutingTagGenerator|).
+class TagGenerator {
+ public:
+  virtual ~TagGenerator() {}
+  virtual std::string CreateTag() = 0;
+};
+
+// Sets the tag generator of the current thread while in scope. The
+// generator is not owned.
+class ScopedTagGenerator {
+ public:
+  explicit ScopedTagGenerator(TagGenerator *generator);
+  ~ScopedTagGenerator();
+
+ private:
+  TagGenerator *previous_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedTagGenerator);
+};
+
+// Create a local tag (48-bit random string, 8 characters long), unless a
+// |TagGenerator| is set for the current thread.
+std::string CreateTag();
 
 // Create an unique Call-ID (120-bit random string, 20 characters long).
 inline std::string CreateCallId() {
@@ -3,11 +3,13 @@
 // found in the LICENSE file.
 
 #include <iostream>
+#include <vector>
 
 #include "base/at_exit.h"
 #include "base/command_line.h"
 #include "base/files/file_path.h"
 #include "base/timer/timer.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/utf_string_conversions.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/string_split.h"
@@ -33,16 +35,18 @@ static void PrintUsage() {
             << " --dial=phone-number"
             << " --route=route-addresses"
             << " \\" << std::endl
-            << "    [--tcp|--udp|--tls|--ws|--wss]\n";
+            << "    [--tcp|--udp|--tls|--ws|--wss]"
+            << " [--calls=count] [--hold=seconds] [--signalling-only]\n";
 }
 
 class Conductor :
     public Phone::Delegate {
  public:
   Conductor(const Settings& settings, const std::string& destination,
-    base::MessageLoop* message_loop) :
-    settings_(settings), destination_(destination),
-    phone_(Phone::Create(this)), message_loop_(message_loop) {
+    int calls, base::TimeDelta hold, base::MessageLoop* message_loop) :
+    settings_(settings), destination_(destination), calls_count_(calls),
+    hold_(hold), phone_(Phone::Create(this)), message_loop_(message_loop),
+    pending_calls_(0), active_calls_(0) {
   }
   virtual ~Conductor() {
     DCHECK(thread_checker_.CalledOnValidThread());
@@ -62,9 +66,22 @@ class Conductor :
  private:
   Settings settings_;
   std::string destination_;
+  int calls_count_;
+  base::TimeDelta hold_;
   scoped_refptr<Phone> phone_;
   base::MessageLoop* message_loop_;
-  scoped_refptr<Call> call_;
+
+  enum CallStatus {
+    CALL_PENDING,
+    CALL_ACTIVE,
+    CALL_ENDED,
+  };
+
+  // All calls are made at once, and hung up together after |hold_|.
+  std::vector<scoped_refptr<Call>> calls_;
+  std::vector<CallStatus> call_status_;
+  int pending_calls_;
+  int active_calls_;
   base::OneShotTimer<Conductor> call_timeout_;
   base::ThreadChecker thread_checker_;
 
@@ -101,15 +118,39 @@ class Conductor :
             base::Unretained(this)));
   }
 
-  void OnCallCompleted(int error) {
+  // Run on the network thread.
+  void OnCallCompleted(size_t index, int error) {
     if (sippet::ERR_SIP_RINGING == error) {
       OnRinging();
+      return;
     } else if (sippet::OK == error) {
       OnEstablished();
     } else if (sippet::IsHangupCause(error)) {
       OnHungUp();
     } else {
-      OnError(error);
+      LOG(ERROR) << "Call error: " << sippet::ErrorToShortString(error);
+    }
+    message_loop_->PostTask(FROM_HERE,
+        base::Bind(&Conductor::OnCallSettled,
+            base::Unretained(this), index, error));
+  }
+
+  void OnCallSettled(size_t index, int error) {
+    DCHECK(thread_checker_.CalledOnValidThread());
+    if (CALL_PENDING == call_status_[index]) {
+      call_status_[index] = sippet::OK == error ? CALL_ACTIVE : CALL_ENDED;
+      if (CALL_ACTIVE == call_status_[index])
+        ++active_calls_;
+      if (0 == --pending_calls_) {
+        LOG(INFO) << active_calls_ << " of " << calls_.size()
+                  << " calls established";
+        OnIOComplete(active_calls_ > 0 ? net::OK : net::ERR_UNEXPECTED);
+      }
+    } else if (CALL_ACTIVE == call_status_[index] && sippet::OK != error) {
+      // Hung up by the other end
+      call_status_[index] = CALL_ENDED;
+      if (0 == --active_calls_ && STATE_CALL_TIMER_COMPLETE == next_state_)
+        OnIOComplete(net::ERR_UNEXPECTED);
     }
   }
 
@@ -135,9 +176,6 @@ class Conductor :
 
   void OnHungUp() {
     LOG(ERROR) << "Hung up call";
-    message_loop_->PostTask(FROM_HERE,
-        base::Bind(&Conductor::OnIOComplete,
-            base::Unretained(this), net::ERR_UNEXPECTED));
   }
 
   enum State {
@@ -231,10 +269,19 @@ class Conductor :
 
   int DoMakeCall() {
     next_state_ = STATE_MAKE_CALL_COMPLETE;
-    call_ = phone_->MakeCall(destination_,
-        base::Bind(&Conductor::OnCallCompleted,
-            base::Unretained(this)));
-    return net::ERR_IO_PENDING;
+    for (int i = 0; i < calls_count_; ++i) {
+      scoped_refptr<Call> call = phone_->MakeCall(destination_,
+          base::Bind(&Conductor::OnCallCompleted,
+              base::Unretained(this), calls_.size()));
+      if (!call) {
+        LOG(ERROR) << "Phone::MakeCall error";
+        break;
+      }
+      calls_.push_back(call);
+      call_status_.push_back(CALL_PENDING);
+      ++pending_calls_;
+    }
+    return pending_calls_ > 0 ? net::ERR_IO_PENDING : net::ERR_UNEXPECTED;
   }
 
   int DoMakeCallComplete(int result) {
@@ -247,8 +294,7 @@ class Conductor :
 
   int DoCallTimer() {
     next_state_ = STATE_CALL_TIMER_COMPLETE;
-    call_timeout_.Start(FROM_HERE,
-        base::TimeDelta::FromSeconds(3600),
+    call_timeout_.Start(FROM_HERE, hold_,
         base::Bind(&Conductor::OnIOComplete,
             base::Unretained(this), net::OK));
     return net::ERR_IO_PENDING;
@@ -266,8 +312,14 @@ class Conductor :
 
   int DoHangup() {
     next_state_ = STATE_HANGUP_COMPLETE;
-    call_->HangUp(base::Bind(&Conductor::OnHangUpCompleted,
-        base::Unretained(this)));
+    for (size_t i = 0; i < calls_.size(); ++i) {
+      if (CALL_ACTIVE != call_status_[i])
+        continue;
+      call_status_[i] = CALL_ENDED;
+      calls_[i]->HangUp(base::Bind(&Conductor::OnHangUpCompleted,
+          base::Unretained(this)));
+    }
+    active_calls_ = 0;
     return net::OK;
   }
 
@@ -359,6 +411,22 @@ int main(int argc, char **argv) {
     route_set = command_line->GetSwitchValueASCII("route");
   }
 
+  int calls = 1;
+  if (command_line->HasSwitch("calls")
+      && (!base::StringToInt(command_line->GetSwitchValueASCII("calls"),
+                             &calls) || calls < 1)) {
+    PrintUsage();
+    return -1;
+  }
+
+  int hold = 3600;
+  if (command_line->HasSwitch("hold")
+      && (!base::StringToInt(command_line->GetSwitchValueASCII("hold"),
+                             &hold) || hold < 0)) {
+    PrintUsage();
+    return -1;
+  }
+
   struct {
     const char *cmd_switch_;
     const char *registrar_uri_;
@@ -390,6 +458,8 @@ int main(int argc, char **argv) {
   settings.set_disable_sctp_data_channels(true);
   settings.set_uri(GURL(uri));
   settings.set_password(password);
+  // Without media, as many calls as the signalling allows can be made.
+  settings.set_signalling_only(command_line->HasSwitch("signalling-only"));
   if (route_set.size() > 0) {
     std::vector<std::string> set;
     base::SplitString(route_set, ',', &set);
@@ -399,7 +469,8 @@ int main(int argc, char **argv) {
     }
   }
 
-  Conductor conductor(settings, destination, &message_loop);
+  Conductor conductor(settings, destination, calls,
+      base::TimeDelta::FromSeconds(hold), &message_loop);
   if (!conductor.Start())
     return -1;
 
@@ -0,0 +1,164 @@
+// Copyright (c) 2015 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/examples/common/introspection_server.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "base/json/json_writer.h"
+#include "base/values.h"
+#include "net/base/net_errors.h"
+#include "net/server/http_server_request_info.h"
+#include "net/socket/tcp_server_socket.h"
+#include "sippet/base/memory_accounting.h"
+#include "sippet/transport/network_layer.h"
+#include "sippet/transport/transport_stats.h"
+#include "sippet/ua/ua_user_agent.h"
+
+namespace {
+
+const char *const kCounterNames[] = {
+  "retransmissions_sent",
+  "retransmissions_absorbed",
+  "timeouts_b",
+  "timeouts_f",
+  "timeouts_h",
+  "bytes_received",
+  "bytes_sent",
+  "parse_failures",
+  "rate_limited",
+  "oversized_messages",
+  "evicted_channels",
+  "refused_channels",
+};
+
+COMPILE_ASSERT(arraysize(kCounterNames) == sippet::TransportStats::COUNTER_MAX,
+               counter_names_mismatch);
+
+// The channels with most transactions first.
+bool HasMoreTransactions(const sippet::NetworkLayer::ChannelInfo &a,
+                         const sippet::NetworkLayer::ChannelInfo &b) {
+  return a.transactions > b.transactions;
+}
+
+// JSON numbers are doubles; counters of a process are far below 2^53.
+double ToNumber(int64 value) {
+  return static_cast<double>(value);
+}
+
+}  // namespace
+
+IntrospectionServer::IntrospectionServer(sippet::NetworkLayer *network_layer,
+                                         sippet::ua::UserAgent *user_agent)
+  : network_layer_(network_layer),
+    user_agent_(user_agent) {
+  DCHECK(network_layer);
+  DCHECK(user_agent);
+}
+
+IntrospectionServer::~IntrospectionServer() {
+}
+
+int IntrospectionServer::Start(int port) {
+  scoped_ptr<net::ServerSocket> server_socket(
+      new net::TCPServerSocket(nullptr, net::NetLog::Source()));
+  int rv = server_socket->ListenWithAddressAndPort("127.0.0.1", port, 1);
+  if (net::OK != rv)
+    return rv;
+  server_.reset(new net::HttpServer(server_socket.Pass(), this));
+  return net::OK;
+}
+
+void IntrospectionServer::OnConnect(int connection_id) {
+}
+
+void IntrospectionServer::OnHttpRequest(
+    int connection_id,
+    const net::HttpServerRequestInfo& info) {
+  if ("/" != info.path) {
+    server_->Send404(connection_id);
+    return;
+  }
+  std::string json;
+  base::JSONWriter::WriteWithOptions(*CreateSnapshot(),
+      base::JSONWriter::OPTIONS_PRETTY_PRINT, &json);
+  server_->Send200(connection_id, json, "application/json");
+}
+
+void IntrospectionServer::OnWebSocketRequest(
+    int connection_id,
+    const net::HttpServerRequestInfo& info) {
+  server_->Send404(connection_id);
+}
+
+void IntrospectionServer::OnWebSocketMessage(int connection_id,
+                                             const std::string& data) {
+}
+
+void IntrospectionServer::OnClose(int connection_id) {
+}
+
+scoped_ptr<base::DictionaryValue> IntrospectionServer::CreateSnapshot() const {
+  scoped_ptr<base::DictionaryValue> snapshot(new base::DictionaryValue);
+
+  sippet::NetworkLayer::Introspection network;
+  network_layer_->Introspect(&network);
+  std::sort(network.channels.begin(), network.channels.end(),
+            &HasMoreTransactions);
+  scoped_ptr<base::ListValue> channels(new base::ListValue);
+  size_t queued_write_bytes = 0;
+  for (std::vector<sippet::NetworkLayer::ChannelInfo>::const_iterator i =
+       network.channels.begin(), ie = network.channels.end(); i != ie; ++i) {
+    scoped_ptr<base::DictionaryValue> channel(new base::DictionaryValue);
+    channel->SetString("destination", i->destination.ToString());
+    channel->SetBoolean("connected", i->connected);
+    channel->SetBoolean("accepted", i->accepted);
+    channel->SetBoolean("idle", i->idle);
+    channel->SetInteger("refs", i->refs);
+    channel->SetDouble("transactions", i->transactions);
+    channel->SetDouble("queued_write_bytes", i->queued_write_bytes);
+    channels->Append(channel.release());
+    queued_write_bytes += i->queued_write_bytes;
+  }
+  scoped_ptr<base::DictionaryValue> network_value(new base::DictionaryValue);
+  network_value->Set("channels", channels.Pass());
+  network_value->SetDouble("idle_channels", network.idle_channels);
+  network_value->SetDouble("client_transactions",
+                           network.client_transactions);
+  network_value->SetDouble("server_transactions",
+                           network.server_transactions);
+  network_value->SetDouble("queued_write_bytes", queued_write_bytes);
+  network_value->SetBoolean("draining", network.draining);
+  snapshot->Set("network_layer", network_value.Pass());
+
+  sippet::ua::UserAgent::Introspection ua;
+  user_agent_->Introspect(&ua);
+  scoped_ptr<base::DictionaryValue> ua_value(new base::DictionaryValue);
+  ua_value->SetDouble("dialogs", ua.dialogs);
+  ua_value->SetDouble("outgoing_requests", ua.outgoing_requests);
+  ua_value->SetDouble("forks", ua.forks);
+  ua_value->SetDouble("auth_cache_entries", ua.auth_cache_entries);
+  snapshot->Set("user_agent", ua_value.Pass());
+
+  scoped_ptr<base::DictionaryValue> memory(new base::DictionaryValue);
+  for (int i = 0; i < sippet::MemoryAccounting::CATEGORY_MAX; ++i) {
+    sippet::MemoryAccounting::Category category =
+        static_cast<sippet::MemoryAccounting::Category>(i);
+    memory->SetDouble(sippet::MemoryAccounting::GetCategoryName(category),
+                      ToNumber(sippet::MemoryAccounting::Get(category)));
+  }
+  memory->SetDouble("total",
+                    ToNumber(sippet::MemoryAccounting::GetTotal()));
+  snapshot->Set("memory", memory.Pass());
+
+  sippet::TransportStats::Snapshot stats;
+  sippet::TransportStats::GetSnapshot(&stats);
+  scoped_ptr<base::DictionaryValue> counters(new base::DictionaryValue);
+  for (int i = 0; i < sippet::TransportStats::COUNTER_MAX; ++i)
+    counters->SetDouble(kCounterNames[i], ToNumber(stats.counters[i]));
+  snapshot->Set("transport_stats", counters.Pass());
+
+  return snapshot.Pass();
+}
@@ -0,0 +1,61 @@
+// Copyright (c) 2015 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_EXAMPLES_COMMON_INTROSPECTION_SERVER_H_
+#define SIPPET_EXAMPLES_COMMON_INTROSPECTION_SERVER_H_
+
+#include <string>
+
+#include "base/memory/scoped_ptr.h"
+#include "net/server/http_server.h"
+
+namespace base {
+class DictionaryValue;
+}
+
+namespace sippet {
+class NetworkLayer;
+namespace ua {
+class UserAgent;
+}
+}
+
+// Serves the state of a network layer and its user agent as JSON, for
+// operators to spot hot destinations and leaks without a debugger:
+//
+//   $ curl http://127.0.0.1:8080/
+//
+// The open channels are listed first by the transactions sending through
+// them. Snapshots are taken on the thread of the network layer, which must
+// run the server too, so they're consistent without stopping it.
+class IntrospectionServer : public net::HttpServer::Delegate {
+ public:
+  IntrospectionServer(sippet::NetworkLayer *network_layer,
+                      sippet::ua::UserAgent *user_agent);
+  ~IntrospectionServer() override;
+
+  // Listens on the loopback |port|, returning a network error code.
+  int Start(int port);
+
+  // net::HttpServer::Delegate methods:
+  void OnConnect(int connection_id) override;
+  void OnHttpRequest(int connection_id,
+                     const net::HttpServerRequestInfo& info) override;
+  void OnWebSocketRequest(int connection_id,
+                          const net::HttpServerRequestInfo& info) override;
+  void OnWebSocketMessage(int connection_id,
+                          const std::string& data) override;
+  void OnClose(int connection_id) override;
+
+ private:
+  scoped_ptr<base::DictionaryValue> CreateSnapshot() const;
+
+  sippet::NetworkLayer *network_layer_;
+  sippet::ua::UserAgent *user_agent_;
+  scoped_ptr<net::HttpServer> server_;
+
+  DISALLOW_COPY_AND_ASSIGN(IntrospectionServer);
+};
+
+#endif // SIPPET_EXAMPLES_COMMON_INTROSPECTION_SERVER_H_
@@ -0,0 +1,648 @@
+// Copyright (c) 2015 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "base/at_exit.h"
+#include "base/bind.h"
+#include "base/command_line.h"
+#include "base/containers/hash_tables.h"
+#include "base/files/file_path.h"
+#include "base/i18n/icu_util.h"
+#include "base/memory/scoped_vector.h"
+#include "base/message_loop/message_loop.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/stringprintf.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/synchronization/lock.h"
+#include "base/time/time.h"
+#include "base/timer/timer.h"
+#include "net/base/net_errors.h"
+#include "net/dns/host_resolver.h"
+#include "net/socket/client_socket_factory.h"
+#include "sippet/examples/common/dump_ssl_cert_error.h"
+#include "sippet/examples/common/static_password_handler.h"
+#include "sippet/examples/common/url_request_context_getter.h"
+#include "sippet/message/headers.h"
+#include "sippet/message/status_code.h"
+#include "sippet/transport/chrome/chrome_channel_factory.h"
+#include "sippet/transport/network_layer_shards.h"
+#include "sippet/transport/transport_stats.h"
+#include "sippet/ua/auth_handler_factory.h"
+#include "sippet/ua/dialog_controller.h"
+#include "sippet/ua/ua_user_agent.h"
+#include "sippet/uri/uri.h"
+
+namespace {
+
+// Scenarios are started in batches, once per tick.
+const int kTickMs = 10;
+
+// Time given to the scenarios still running at the end of the run, enough
+// for an INVITE transaction to time out (64*T1).
+const int kDrainSeconds = 32;
+
+const char kSdpOffer[] =
+    "v=0\r\n"
+    "o=- 0 0 IN IP4 0.0.0.0\r\n"
+    "s=-\r\n"
+    "c=IN IP4 0.0.0.0\r\n"
+    "t=0 0\r\n"
+    "m=audio 9 RTP/AVP 0\r\n"
+    "a=rtpmap:0 PCMU/8000\r\n"
+    "a=inactive\r\n";
+
+enum Scenario {
+  // A REGISTER of each account, answering its challenges.
+  SCENARIO_REGISTER,
+  // An INVITE, acknowledged on 2xx, then a BYE after the hold time.
+  SCENARIO_CALL,
+  // An OPTIONS ping.
+  SCENARIO_OPTIONS,
+};
+
+struct Options {
+  Scenario scenario;
+  std::string server;
+  // Format of the URIs sent to the server, with the transport chosen.
+  std::string uri_format;
+  std::string username;
+  std::string password;
+  std::string dial;
+  // Number of accounts: the username is suffixed with the account index if
+  // there are more than one, and all of them use the same password.
+  int users;
+  // Scenarios started per second.
+  int rate;
+  // Scenarios to start, or 0 to run for |duration|.
+  int total;
+  base::TimeDelta duration;
+  base::TimeDelta hold;
+  size_t shards;
+};
+
+struct Counters {
+  int64 started;
+  int64 succeeded;
+  int64 failed;
+
+  Counters() : started(0), succeeded(0), failed(0) {}
+
+  int64 running() const { return started - succeeded - failed; }
+};
+
+void PrintUsage() {
+  std::cout << "sippet_examples_loadgen"
+            << " --username=user"
+            << " --password=pass"
+            << " \\" << std::endl
+            << "    [--scenario=register|call|options]"
+            << " [--dial=user]"
+            << " [--server=host]"
+            << " \\" << std::endl
+            << "    [--users=1] [--rate=10] [--total=0] [--duration=60]"
+            << " [--hold=1000]"
+            << " \\" << std::endl
+            << "    [--shards=1]"
+            << " [--tcp|--udp|--tls|--ws|--wss]\n";
+}
+
+// Gives the credentials of the account sending each request.
+class AccountPasswordHandlerFactory
+  : public sippet::PasswordHandler::Factory {
+ public:
+  explicit AccountPasswordHandlerFactory(const std::string &password)
+      : password_(base::ASCIIToUTF16(password)) {
+  }
+
+  scoped_ptr<sippet::PasswordHandler> CreatePasswordHandler() override {
+    return CreatePasswordHandlerForRequest(nullptr);
+  }
+
+  scoped_ptr<sippet::PasswordHandler> CreatePasswordHandlerForRequest(
+      const scoped_refptr<sippet::Request> &request) override {
+    std::string username;
+    sippet::From *from = request ? request->get<sippet::From>() : nullptr;
+    if (from)
+      username = sippet::SipURI(from->address()).username();
+    return scoped_ptr<sippet::PasswordHandler>(new StaticPasswordHandler(
+        base::ASCIIToUTF16(username), password_));
+  }
+
+ private:
+  base::string16 password_;
+};
+
+// The user agent of a shard, running its scenarios. Only its counters and
+// latencies are accessed from other threads.
+class ShardAgent : public sippet::ua::UserAgent::Delegate {
+ public:
+  explicit ShardAgent(const Options &options)
+      : options_(options),
+        password_handler_factory_(options.password) {
+  }
+
+  ~ShardAgent() override {}
+
+  // Called on the shard thread.
+  scoped_ptr<sippet::NetworkLayer> CreateNetworkLayer() {
+    base::MessageLoop *message_loop = base::MessageLoop::current();
+    request_context_getter_ =
+        new URLRequestContextGetter(message_loop->task_runner());
+    host_resolver_ = net::HostResolver::CreateDefaultResolver(nullptr);
+    scoped_ptr<sippet::AuthHandlerRegistryFactory> auth_handler_factory(
+        sippet::AuthHandlerFactory::CreateDefault(host_resolver_.get()));
+    auth_handler_factory_ = auth_handler_factory.Pass();
+
+    user_agent_.reset(new sippet::ua::UserAgent(auth_handler_factory_.get(),
+        &password_handler_factory_,
+        sippet::DialogController::GetDefaultDialogController(),
+        net_log_));
+    user_agent_->AppendHandler(this);
+
+    sippet::NetworkSettings network_settings;
+    ssl_cert_error_handler_factory_.reset(
+        new DumpSSLCertError::Factory(true));
+    network_settings.set_ssl_cert_error_handler_factory(
+        ssl_cert_error_handler_factory_.get());
+    scoped_ptr<sippet::NetworkLayer> network_layer(
+        new sippet::NetworkLayer(user_agent_.get(), network_settings));
+
+    net::SSLConfig ssl_config;
+    ssl_config.version_min = net::SSL_PROTOCOL_VERSION_TLS1;
+    channel_factory_.reset(new sippet::ChromeChannelFactory(
+        net::ClientSocketFactory::GetDefaultFactory(),
+        request_context_getter_, ssl_config));
+    network_layer->RegisterChannelFactory(sippet::Protocol::UDP,
+        channel_factory_.get());
+    network_layer->RegisterChannelFactory(sippet::Protocol::TCP,
+        channel_factory_.get());
+    network_layer->RegisterChannelFactory(sippet::Protocol::TLS,
+        channel_factory_.get());
+    user_agent_->SetNetworkLayer(network_layer.get());
+    return network_layer.Pass();
+  }
+
+  // Called on the shard thread, once the network layer is gone.
+  void Destroy() {
+    pending_.clear();
+    channel_factory_.reset();
+    user_agent_.reset();
+    ssl_cert_error_handler_factory_.reset();
+    auth_handler_factory_.reset();
+    host_resolver_.reset();
+    request_context_getter_ = nullptr;
+  }
+
+  // Called on the shard thread to start a scenario from the account |user|.
+  void StartScenario(int user) {
+    if (!user_agent_)
+      return;
+    {
+      base::AutoLock auto_lock(lock_);
+      counters_.started++;
+    }
+    std::string username(options_.username);
+    if (1 < options_.users)
+      username += base::IntToString(user);
+    GURL from("sip:" + username + "@" + options_.server);
+
+    scoped_refptr<sippet::Request> request;
+    if (SCENARIO_REGISTER == options_.scenario) {
+      request = user_agent_->CreateRequest(sippet::Method::REGISTER,
+          GURL(base::StringPrintf(options_.uri_format.c_str(),
+              options_.server.c_str())), from, from);
+    } else {
+      std::string target(options_.dial + "@" + options_.server);
+      GURL to("sip:" + target);
+      GURL request_uri(base::StringPrintf(options_.uri_format.c_str(),
+          target.c_str()));
+      if (SCENARIO_CALL == options_.scenario) {
+        request = user_agent_->CreateRequest(sippet::Method::INVITE,
+            request_uri, from, to);
+        scoped_ptr<sippet::ContentType> content_type(
+            new sippet::ContentType("application", "sdp"));
+        request->push_back(content_type.Pass());
+        request->set_content(kSdpOffer);
+      } else {
+        request = user_agent_->CreateRequest(sippet::Method::OPTIONS,
+            request_uri, from, to);
+      }
+    }
+    Send(request);
+  }
+
+  void GetCounters(Counters *counters) const {
+    base::AutoLock auto_lock(lock_);
+    *counters = counters_;
+  }
+
+  // Appends the response times recorded, in microseconds.
+  void GetLatencies(std::vector<int64> *latencies) const {
+    base::AutoLock auto_lock(lock_);
+    latencies->insert(latencies->end(), latencies_.begin(), latencies_.end());
+  }
+
+  // sippet::ua::UserAgent::Delegate implementation
+  void OnChannelConnected(const sippet::EndPoint &destination,
+                          int err) override {
+    if (net::OK != err) {
+      DVLOG(1) << "Couldn't connect to " << destination.ToString()
+               << ": " << net::ErrorToString(err);
+    }
+  }
+
+  void OnChannelClosed(const sippet::EndPoint &destination) override {
+    DVLOG(1) << "Channel " << destination.ToString() << " closed";
+  }
+
+  void OnIncomingRequest(
+      const scoped_refptr<sippet::Request> &incoming_request,
+      const scoped_refptr<sippet::Dialog> &dialog) override {
+    if (sippet::Method::ACK == incoming_request->method())
+      return;
+    // Peers may hang up or ping first
+    sippet::StatusCode code = sippet::SIP_NOT_IMPLEMENTED;
+    if (sippet::Method::BYE == incoming_request->method()
+        || sippet::Method::OPTIONS == incoming_request->method())
+      code = sippet::SIP_OK;
+    user_agent_->Send(incoming_request->CreateResponse(code),
+        net::CompletionCallback());
+  }
+
+  void OnIncomingResponse(
+      const scoped_refptr<sippet::Response> &incoming_response,
+      const scoped_refptr<sippet::Dialog> &dialog) override {
+    int response_code = incoming_response->response_code();
+    const scoped_refptr<sippet::Request> &request =
+        incoming_response->refer_to();
+    if (200 > response_code || !request)
+      return;
+    bool success = 2 == response_code / 100;
+    if (sippet::Method::INVITE == request->method() && success && dialog) {
+      // Retransmitted 2xx are acknowledged again
+      scoped_refptr<sippet::Request> ack(dialog->CreateAck(request));
+      user_agent_->Send(ack, net::CompletionCallback());
+      // The call completes with the response to its BYE
+      if (Complete(request->id(), true)) {
+        base::MessageLoop::current()->PostDelayedTask(FROM_HERE,
+            base::Bind(&ShardAgent::SendBye, base::Unretained(this), dialog),
+            options_.hold);
+      }
+      return;
+    }
+    if (!Complete(request->id(), success))
+      return;
+    if (!success)
+      DVLOG(1) << request->method().str() << " failed: " << response_code;
+    Finish(success);
+  }
+
+  void OnTimedOut(
+      const scoped_refptr<sippet::Request> &request,
+      const scoped_refptr<sippet::Dialog> &dialog) override {
+    if (Complete(request->id(), false))
+      Finish(false);
+  }
+
+  void OnTransportError(
+      const scoped_refptr<sippet::Request> &request, int error,
+      const scoped_refptr<sippet::Dialog> &dialog) override {
+    if (Complete(request->id(), false)) {
+      DVLOG(1) << request->method().str() << " failed: "
+               << net::ErrorToString(error);
+      Finish(false);
+    }
+  }
+
+ private:
+  typedef base::hash_map<std::string, base::TimeTicks> PendingMap;
+
+  void Send(const scoped_refptr<sippet::Request> &request) {
+    pending_[request->id()] = base::TimeTicks::Now();
+    int rv = user_agent_->Send(request, net::CompletionCallback());
+    if (net::OK != rv && net::ERR_IO_PENDING != rv) {
+      pending_.erase(request->id());
+      Finish(false);
+    }
+  }
+
+  void SendBye(const scoped_refptr<sippet::Dialog> &dialog) {
+    if (!user_agent_)
+      return;
+    Send(dialog->CreateRequest(sippet::Method::BYE));
+  }
+
+  // Records the response time of a pending request. Returns false if it's
+  // not pending, as for retransmitted responses.
+  bool Complete(const std::string &id, bool success) {
+    PendingMap::iterator i = pending_.find(id);
+    if (pending_.end() == i)
+      return false;
+    base::TimeDelta latency(base::TimeTicks::Now() - i->second);
+    pending_.erase(i);
+    if (success) {
+      base::AutoLock auto_lock(lock_);
+      latencies_.push_back(latency.InMicroseconds());
+    }
+    return true;
+  }
+
+  void Finish(bool success) {
+    base::AutoLock auto_lock(lock_);
+    if (success)
+      counters_.succeeded++;
+    else
+      counters_.failed++;
+  }
+
+  const Options &options_;
+  AccountPasswordHandlerFactory password_handler_factory_;
+
+  // Only accessed from the shard thread.
+  scoped_refptr<net::URLRequestContextGetter> request_context_getter_;
+  scoped_ptr<net::HostResolver> host_resolver_;
+  scoped_ptr<sippet::AuthHandlerFactory> auth_handler_factory_;
+  net::BoundNetLog net_log_;
+  scoped_ptr<DumpSSLCertError::Factory> ssl_cert_error_handler_factory_;
+  scoped_ptr<sippet::ua::UserAgent> user_agent_;
+  scoped_ptr<sippet::ChromeChannelFactory> channel_factory_;
+  PendingMap pending_;
+
+  mutable base::Lock lock_;
+  Counters counters_;
+  std::vector<int64> latencies_;
+
+  DISALLOW_COPY_AND_ASSIGN(ShardAgent);
+};
+
+// Starts the scenarios at the configured rate, spread across the shards,
+// and reports the achieved rate every second.
+class LoadGenerator : public sippet::NetworkLayerShards::Delegate {
+ public:
+  explicit LoadGenerator(const Options &options)
+      : options_(options),
+        shards_(this, options.shards),
+        scheduled_(0),
+        last_second_(0) {
+    for (size_t i = 0; i < options.shards; ++i)
+      agents_.push_back(new ShardAgent(options));
+  }
+
+  ~LoadGenerator() override {
+    shards_.Stop();
+  }
+
+  bool Start() {
+    if (!shards_.Start())
+      return false;
+    sippet::TransportStats::GetSnapshot(&start_stats_);
+    start_time_ = base::TimeTicks::Now();
+    tick_timer_.Start(FROM_HERE,
+        base::TimeDelta::FromMilliseconds(kTickMs), this,
+        &LoadGenerator::OnTick);
+    return true;
+  }
+
+  // Prints the summary of the run.
+  void Report() {
+    base::TimeDelta elapsed(end_time_ - start_time_);
+    Counters counters;
+    GetCounters(&counters);
+    std::vector<int64> latencies;
+    for (size_t i = 0; i < agents_.size(); ++i)
+      agents_[i]->GetLatencies(&latencies);
+    std::sort(latencies.begin(), latencies.end());
+
+    sippet::TransportStats::Snapshot stats;
+    sippet::TransportStats::GetSnapshot(&stats);
+    int64 retransmissions =
+        stats.counters[sippet::TransportStats::RETRANSMISSIONS_SENT]
+        - start_stats_.counters[sippet::TransportStats::RETRANSMISSIONS_SENT];
+    int64 timeouts = 0;
+    const sippet::TransportStats::Counter kTimeouts[] = {
+      sippet::TransportStats::TIMEOUTS_B,
+      sippet::TransportStats::TIMEOUTS_F,
+    };
+    for (size_t i = 0; i < arraysize(kTimeouts); ++i)
+      timeouts += stats.counters[kTimeouts[i]]
+          - start_stats_.counters[kTimeouts[i]];
+
+    double seconds = std::max(elapsed.InSecondsF(), 1e-3);
+    std::cout << "\nStarted " << counters.started
+              << ", succeeded " << counters.succeeded
+              << ", failed " << counters.failed
+              << ", unfinished " << counters.running()
+              << " in " << base::StringPrintf("%.1f", seconds) << "s\n"
+              << "Achieved rate: "
+              << base::StringPrintf("%.1f", counters.succeeded / seconds)
+              << "/s\n"
+              << "Response times (ms):"
+              << " p50 " << Percentile(latencies, 50)
+              << ", p90 " << Percentile(latencies, 90)
+              << ", p99 " << Percentile(latencies, 99)
+              << ", max " << Percentile(latencies, 100) << "\n"
+              << "Retransmissions: " << retransmissions
+              << ", transaction timeouts: " << timeouts << "\n";
+  }
+
+  // sippet::NetworkLayerShards::Delegate implementation
+  scoped_ptr<sippet::NetworkLayer> CreateNetworkLayer(size_t shard) override {
+    return agents_[shard]->CreateNetworkLayer();
+  }
+
+  void OnNetworkLayerDestroyed(size_t shard) override {
+    agents_[shard]->Destroy();
+  }
+
+ private:
+  void OnTick() {
+    base::TimeDelta elapsed(base::TimeTicks::Now() - start_time_);
+    bool starting = elapsed < options_.duration
+        && (0 == options_.total || scheduled_ < options_.total);
+    if (starting) {
+      int64 due = elapsed.InMilliseconds() * options_.rate / 1000;
+      if (0 < options_.total)
+        due = std::min<int64>(due, options_.total);
+      for (; scheduled_ < due; ++scheduled_) {
+        size_t shard = scheduled_ % agents_.size();
+        shards_.task_runner(shard)->PostTask(FROM_HERE,
+            base::Bind(&ShardAgent::StartScenario,
+                base::Unretained(agents_[shard]),
+                static_cast<int>(scheduled_ % options_.users)));
+      }
+    } else if (end_time_.is_null()) {
+      end_time_ = base::TimeTicks::Now();
+    }
+
+    int64 second = elapsed.InSeconds();
+    if (second > last_second_) {
+      last_second_ = second;
+      ReportSecond(second);
+    }
+
+    if (!end_time_.is_null()) {
+      Counters counters;
+      GetCounters(&counters);
+      bool drained = counters.started == scheduled_
+          && 0 == counters.running();
+      if (drained || base::TimeTicks::Now() - end_time_
+          > base::TimeDelta::FromSeconds(kDrainSeconds)) {
+        tick_timer_.Stop();
+        end_time_ = base::TimeTicks::Now();
+        base::MessageLoop::current()->Quit();
+      }
+    }
+  }
+
+  void ReportSecond(int64 second) {
+    Counters counters;
+    GetCounters(&counters);
+    std::cout << base::StringPrintf(
+        "%4lds: started %ld/s, succeeded %ld/s, failed %ld/s, running %ld\n",
+        static_cast<long>(second),
+        static_cast<long>(counters.started - last_counters_.started),
+        static_cast<long>(counters.succeeded - last_counters_.succeeded),
+        static_cast<long>(counters.failed - last_counters_.failed),
+        static_cast<long>(counters.running()));
+    last_counters_ = counters;
+  }
+
+  void GetCounters(Counters *counters) const {
+    *counters = Counters();
+    for (size_t i = 0; i < agents_.size(); ++i) {
+      Counters shard_counters;
+      agents_[i]->GetCounters(&shard_counters);
+      counters->started += shard_counters.started;
+      counters->succeeded += shard_counters.succeeded;
+      counters->failed += shard_counters.failed;
+    }
+  }
+
+  // The |percent| percentile of sorted |latencies|, in milliseconds.
+  static double Percentile(const std::vector<int64> &latencies,
+                           int percent) {
+    if (latencies.empty())
+      return 0;
+    size_t index = (latencies.size() - 1) * percent / 100;
+    return latencies[index] / 1000.0;
+  }
+
+  const Options &options_;
+  // Declared before the shards, which stop before they are destroyed.
+  ScopedVector<ShardAgent> agents_;
+  sippet::NetworkLayerShards shards_;
+  base::RepeatingTimer<LoadGenerator> tick_timer_;
+  base::TimeTicks start_time_;
+  // Set once no more scenarios are started.
+  base::TimeTicks end_time_;
+  int64 scheduled_;
+  int64 last_second_;
+  Counters last_counters_;
+  sippet::TransportStats::Snapshot start_stats_;
+
+  DISALLOW_COPY_AND_ASSIGN(LoadGenerator);
+};
+
+int GetIntSwitch(base::CommandLine *command_line, const char *name,
+                 int default_value) {
+  int value;
+  if (!command_line->HasSwitch(name)
+      || !base::StringToInt(command_line->GetSwitchValueASCII(name), &value))
+    return default_value;
+  return value;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  base::AtExitManager at_exit_manager;
+  if (!base::i18n::InitializeICU()) {
+    std::cerr << "Couldn't open ICU library, exiting...\n";
+    return -1;
+  }
+  base::CommandLine::Init(argc, argv);
+  base::CommandLine* command_line = base::CommandLine::ForCurrentProcess();
+
+  if (command_line->GetSwitches().empty() ||
+      command_line->HasSwitch("help") ||
+      !command_line->HasSwitch("username") ||
+      !command_line->HasSwitch("password")) {
+    PrintUsage();
+    return -1;
+  }
+
+  Options options;
+  options.username = command_line->GetSwitchValueASCII("username");
+  options.password = command_line->GetSwitchValueASCII("password");
+  options.server = "localhost";
+  if (command_line->HasSwitch("server"))
+    options.server = command_line->GetSwitchValueASCII("server");
+
+  std::string scenario("register");
+  if (command_line->HasSwitch("scenario"))
+    scenario = command_line->GetSwitchValueASCII("scenario");
+  if ("register" == scenario) {
+    options.scenario = SCENARIO_REGISTER;
+  } else if ("call" == scenario) {
+    options.scenario = SCENARIO_CALL;
+  } else if ("options" == scenario) {
+    options.scenario = SCENARIO_OPTIONS;
+  } else {
+    PrintUsage();
+    return -1;
+  }
+  options.dial = options.username;
+  if (command_line->HasSwitch("dial"))
+    options.dial = command_line->GetSwitchValueASCII("dial");
+
+  options.users = std::max(1, GetIntSwitch(command_line, "users", 1));
+  options.rate = std::max(1, GetIntSwitch(command_line, "rate", 10));
+  options.total = std::max(0, GetIntSwitch(command_line, "total", 0));
+  options.duration = base::TimeDelta::FromSeconds(
+      std::max(1, GetIntSwitch(command_line, "duration", 60)));
+  options.hold = base::TimeDelta::FromMilliseconds(
+      std::max(0, GetIntSwitch(command_line, "hold", 1000)));
+  options.shards = std::max(1, GetIntSwitch(command_line, "shards", 1));
+
+  struct {
+    const char *cmd_switch_;
+    const char *uri_format_;
+  } args[] = {
+    { "udp", "sip:%s" },
+    { "tcp", "sip:%s;transport=tcp" },
+    { "tls", "sips:%s" },
+    { "ws", "sip:%s;transport=ws" },
+    { "wss", "sips:%s;transport=ws" },
+  };
+  // Defaults to UDP
+  options.uri_format = args[0].uri_format_;
+  for (size_t i = 0; i < arraysize(args); i++) {
+    if (command_line->HasSwitch(args[i].cmd_switch_)) {
+      options.uri_format = args[i].uri_format_;
+      break;
+    }
+  }
+
+  logging::LoggingSettings settings;
+  settings.logging_dest = logging::LOG_TO_FILE;
+  settings.log_file = FILE_PATH_LITERAL("loadgen.log");
+  if (!logging::InitLogging(settings)) {
+    std::cout << "Error: could not initialize logging. Exiting.\n";
+    return -1;
+  }
+
+  base::MessageLoop message_loop;
+  LoadGenerator load_generator(options);
+  if (!load_generator.Start()) {
+    std::cerr << "Couldn't start the shard threads\n";
+    return -1;
+  }
+  message_loop.Run();
+  load_generator.Report();
+  return 0;
+}
@@ -7,6 +7,8 @@
 #include <iostream>
 #include "base/i18n/icu_util.h"
 #include "base/files/file_path.h"
+#include "base/strings/string_number_conversions.h"
+#include "net/base/net_errors.h"
 #include "net/socket/client_socket_factory.h"
 #include "sippet/ua/dialog_controller.h"
 
@@ -84,6 +86,25 @@ bool ProgramMain::Init() {
   network_layer_->RegisterChannelFactory(sippet::Protocol::TLS,
       channel_factory_.get());
   user_agent_->SetNetworkLayer(network_layer_.get());
+
+  // Serve the state of the stack to operators, see |IntrospectionServer|.
+  if (command_line()->HasSwitch("introspection-port")) {
+    int port;
+    if (!base::StringToInt(
+            command_line()->GetSwitchValueASCII("introspection-port"),
+            &port)) {
+      std::cerr << "Error: invalid introspection port\n";
+      return false;
+    }
+    introspection_server_.reset(
+        new IntrospectionServer(network_layer_.get(), user_agent_.get()));
+    int rv = introspection_server_->Start(port);
+    if (net::OK != rv) {
+      std::cerr << "Error: could not serve introspection on port " << port
+                << ": " << net::ErrorToString(rv) << "\n";
+      return false;
+    }
+  }
   return true;
 }
 
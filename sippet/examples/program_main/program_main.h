@@ -15,6 +15,7 @@
 #include "sippet/examples/common/url_request_context_getter.h"
 #include "sippet/examples/common/static_password_handler.h"
 #include "sippet/examples/common/dump_ssl_cert_error.h"
+#include "sippet/examples/common/introspection_server.h"
 
 class ProgramMain {
  public:
@@ -43,6 +44,7 @@ class ProgramMain {
   scoped_ptr<DumpSSLCertError::Factory> ssl_cert_error_handler_factory_;
   scoped_ptr<sippet::NetworkLayer> network_layer_;
   scoped_ptr<sippet::ChromeChannelFactory> channel_factory_;
+  scoped_ptr<IntrospectionServer> introspection_server_;
 };
 
 #endif // SIPPET_EXAMPLES_PROGRAM_MAIN_PROGRAM_MAIN_H_
@@ -10,6 +10,7 @@
 #include <functional>
 #include <cstring>
 #include "base/memory/scoped_ptr.h"
+#include "sippet/base/interned_string.h"
 #include "sippet/base/raw_ostream.h"
 
 namespace sippet {
@@ -17,25 +18,20 @@ namespace sippet {
 template<typename T>
 struct AtomTraits;
 
+// Known values are stored inline as their enum type, so creating and
+// copying them doesn't allocate; unknown tokens are interned.
 template<typename T>
 class Atom : public T {
 public:
   typedef AtomTraits<T> Traits;
   typedef typename Traits::type Type;
 
-  Atom() { set_type(Traits::unknown_type); }
-  Atom(const Atom &other)
-    : atom_(other.atom_->clone()) {}
-  Atom(Type t) { set_type(t); }
+  Atom() : type_(Traits::unknown_type) {}
+  Atom(Type t) : type_(t) {}
   explicit Atom(const char *str) { set_str(str); }
   explicit Atom(const std::string &str) { set_str(str); }
   ~Atom() {}
 
-  Atom &operator=(const Atom &other) {
-    atom_.reset(other.atom_->clone());
-    return *this;
-  }
-
   bool operator==(Type t) const {
     return type() == t;
   }
@@ -49,68 +45,34 @@ public:
     return operator==(other.type());
   }
 
-  Type type() const { return atom_->type(); }
+  Type type() const { return type_; }
   void set_type(Type t) {
-    static NullAtom null;
-    if (t != Traits::unknown_type)
-      atom_.reset(new KnownAtom(t));
-    else
-      atom_.reset(&null);
+    type_ = t;
+    unknown_ = InternedString();
   }
 
-  const char *str() const { return atom_->str(); }
+  const char *str() const {
+    return type_ != Traits::unknown_type ? Traits::string_of(type_)
+                                         : unknown_.c_str();
+  }
   void set_str(const std::string &str) {
     set_str(str.c_str());
   }
   void set_str(const char *str) {
-    Type t = Traits::coerce(str);
-    if (t != Traits::unknown_type)
-      atom_.reset(new KnownAtom(t));
+    type_ = Traits::coerce(str);
+    if (type_ != Traits::unknown_type)
+      unknown_ = InternedString();
     else
-      atom_.reset(new UnknownAtom(str));
+      unknown_ = InternedString(str);
   }
 
   void print(raw_ostream &os) const {
     os << str();
   }
 private:
-  struct AtomImp {
-    virtual Type type() = 0;
-    virtual const char *str() = 0;
-    virtual AtomImp *clone() = 0;
-    virtual void release() = 0;
-  };
-
-  struct NullAtom : public AtomImp {
-    Type type() override { return Traits::unknown_type; }
-    const char *str() override { return ""; }
-    NullAtom *clone() override { return this; }
-    void release() override {}
-  };
-  
-  struct KnownAtom : public AtomImp {
-    Type type_;
-    KnownAtom(Type t) : type_(t) {}
-    Type type() override { return type_; }
-    const char *str() override { return Traits::string_of(type_); }
-    KnownAtom *clone() override { return new KnownAtom(*this); }
-    void release() override { delete this; }
-  };
-  
-  struct UnknownAtom : public AtomImp {
-    std::string atom_;
-    UnknownAtom(const char *str) : atom_(str) {}
-    Type type() override { return Traits::unknown_type; }
-    const char *str() override { return atom_.c_str(); }
-    UnknownAtom *clone() override { return new UnknownAtom(*this); }
-    void release() override { delete this; }
-  };
-
-  struct AtomRelease {
-    inline void operator()(AtomImp* ptr) const { ptr->release(); }
-  };
-
-  scoped_ptr<AtomImp, AtomRelease> atom_;
+  Type type_;
+  // Only used by unknown atoms; empty otherwise.
+  InternedString unknown_;
 };
 
 template<typename T>
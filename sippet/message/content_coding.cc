@@ -0,0 +1,128 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/message/content_coding.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/logging.h"
+#include "base/strings/string_util.h"
+#include "third_party/zlib/zlib.h"
+
+namespace sippet {
+
+namespace {
+
+const size_t kChunkSize = 16 * 1024;
+
+// zlib window bits, as given to |deflateInit2| and |inflateInit2|.
+const int kZlibWindowBits = 15;
+const int kGzipWindowBits = 16 + kZlibWindowBits;
+const int kRawWindowBits = -kZlibWindowBits;
+
+int Inflate(int window_bits,
+            const base::StringPiece &input,
+            size_t max_size,
+            std::string *output) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (Z_OK != inflateInit2(&stream, window_bits))
+    return Z_MEM_ERROR;
+  stream.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+  stream.avail_in = static_cast<uInt>(input.size());
+  int result = Z_OK;
+  while (Z_OK == result) {
+    size_t size = output->size();
+    if (size >= max_size) {
+      result = Z_BUF_ERROR;
+      break;
+    }
+    size_t chunk = std::min(kChunkSize, max_size - size);
+    output->resize(size + chunk);
+    stream.next_out = reinterpret_cast<Bytef*>(&(*output)[size]);
+    stream.avail_out = static_cast<uInt>(chunk);
+    result = inflate(&stream, Z_NO_FLUSH);
+    output->resize(size + chunk - stream.avail_out);
+    // A truncated input leaves the stream waiting for more.
+    if (Z_OK == result && 0 == stream.avail_in && 0 != stream.avail_out)
+      result = Z_DATA_ERROR;
+  }
+  inflateEnd(&stream);
+  return result;
+}
+
+}  // namespace
+
+ContentCoding GetContentCoding(const base::StringPiece &name) {
+  if (base::EqualsCaseInsensitiveASCII(name, "identity"))
+    return CONTENT_CODING_IDENTITY;
+  if (base::EqualsCaseInsensitiveASCII(name, "gzip"))
+    return CONTENT_CODING_GZIP;
+  if (base::EqualsCaseInsensitiveASCII(name, "deflate"))
+    return CONTENT_CODING_DEFLATE;
+  return CONTENT_CODING_UNSUPPORTED;
+}
+
+bool EncodeContent(ContentCoding coding,
+                   const base::StringPiece &input,
+                   std::string *output) {
+  DCHECK(CONTENT_CODING_GZIP == coding || CONTENT_CODING_DEFLATE == coding);
+  DCHECK(output);
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  int window_bits = CONTENT_CODING_GZIP == coding
+      ? kGzipWindowBits : kZlibWindowBits;
+  if (Z_OK != deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                           window_bits, 8, Z_DEFAULT_STRATEGY))
+    return false;
+  uLong bound = deflateBound(&stream, static_cast<uLong>(input.size()));
+  output->resize(bound);
+  stream.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+  stream.avail_in = static_cast<uInt>(input.size());
+  stream.next_out = reinterpret_cast<Bytef*>(&(*output)[0]);
+  stream.avail_out = static_cast<uInt>(bound);
+  int result = deflate(&stream, Z_FINISH);
+  output->resize(bound - stream.avail_out);
+  deflateEnd(&stream);
+  if (Z_STREAM_END != result) {
+    output->clear();
+    return false;
+  }
+  return true;
+}
+
+bool DecodeContent(ContentCoding coding,
+                   const base::StringPiece &input,
+                   size_t max_size,
+                   std::string *output) {
+  DCHECK(output);
+  output->clear();
+  switch (coding) {
+    case CONTENT_CODING_IDENTITY:
+      if (input.size() > max_size)
+        return false;
+      input.CopyToString(output);
+      return true;
+    case CONTENT_CODING_GZIP:
+      if (Z_STREAM_END == Inflate(kGzipWindowBits, input, max_size, output))
+        return true;
+      break;
+    case CONTENT_CODING_DEFLATE:
+      if (Z_STREAM_END == Inflate(kZlibWindowBits, input, max_size, output))
+        return true;
+      output->clear();
+      if (Z_STREAM_END == Inflate(kRawWindowBits, input, max_size, output))
+        return true;
+      break;
+    default:
+      break;
+  }
+  output->clear();
+  return false;
+}
+
+} // End of sippet namespace
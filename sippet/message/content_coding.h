@@ -0,0 +1,45 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_MESSAGE_CONTENT_CODING_H_
+#define SIPPET_MESSAGE_CONTENT_CODING_H_
+
+#include <string>
+
+#include "base/strings/string_piece.h"
+
+namespace sippet {
+
+// The content codings of Content-Encoding and Accept-Encoding headers
+// (RFC 3261, section 20.12) supported by sippet.
+enum ContentCoding {
+  CONTENT_CODING_IDENTITY,
+  CONTENT_CODING_GZIP,
+  CONTENT_CODING_DEFLATE,
+  CONTENT_CODING_UNSUPPORTED,
+};
+
+// Limit of a decoded content, so that a small compressed body can't
+// exhaust the memory.
+const size_t kMaxDecodedContentSize = 4 * 1024 * 1024;
+
+// The coding of a Content-Encoding value, ignoring case.
+ContentCoding GetContentCoding(const base::StringPiece &name);
+
+// Compresses |input| with |coding|, that must be gzip or deflate.
+bool EncodeContent(ContentCoding coding,
+                   const base::StringPiece &input,
+                   std::string *output);
+
+// Decompresses |input|, chunk by chunk. Fails if it's malformed, or if the
+// output would exceed |max_size|. Deflate contents can be either zlib
+// streams or raw deflate data, as both are found in the wild.
+bool DecodeContent(ContentCoding coding,
+                   const base::StringPiece &input,
+                   size_t max_size,
+                   std::string *output);
+
+} // End of sippet namespace
+
+#endif // SIPPET_MESSAGE_CONTENT_CODING_H_
@@ -5,41 +5,133 @@
 #include "sippet/message/header.h"
 
 #include <cstring>
-#include <algorithm>
 
 #include "sippet/message/headers/generic.h"
+#include "sippet/base/arena.h"
 
 #include "base/basictypes.h"
+#include "base/lazy_instance.h"
 #include "base/strings/string_util.h"
+#include "base/threading/thread_local.h"
 
 namespace sippet {
 
 namespace {
-  static const char *names[] = {
-#define X(class_name, compact_form, header_name, enum_name, format) \
-    #header_name,
-#include "sippet/message/header_list.h"
-#undef X
+  // What's known of each header type, indexed by |Header::Type|. Names are
+  // printed with their separator in a single write; so are compact forms.
+  struct HeaderInfo {
+    const char *name;
+    size_t name_length;
+    // Zero if there's none.
+    char compact_form;
+    // "Name: ", or "Name:" when cut short by one.
+    const char *prefix;
+    // "c: ", as |prefix|; unused if there's no compact form.
+    char compact_prefix[4];
   };
 
-  static const char compact_forms[] = {
+  constexpr HeaderInfo kHeaderInfo[] = {
 #define X(class_name, compact_form, header_name, enum_name, format) \
-    compact_form,
+    { #header_name, sizeof(#header_name) - 1, compact_form,         \
+      #header_name ": ", { compact_form, ':', ' ', '\0' } },
 #include "sippet/message/header_list.h"
 #undef X
   };
 
-  bool HeaderNameLess(const char *a, const char *b) {
-    return base::strcasecmp(a, b) < 0;
+  static_assert(arraysize(kHeaderInfo) == Header::HDR_GENERIC,
+                "every header type must have its info");
+
+  // Case-insensitive FNV-1a hash of header names. The compile time version
+  // is used to generate the |coerce| switch below; as duplicate case labels
+  // don't compile, the hash is guaranteed to be perfect for known names.
+  const uint32 kFnvOffsetBasis = 2166136261u;
+  const uint32 kFnvPrime = 16777619u;
+
+  constexpr uint32 HashChar(uint32 hash, char c) {
+    return (hash ^ static_cast<uint8>(
+        (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c)) * kFnvPrime;
   }
+
+  constexpr uint32 StaticHashName(const char *str,
+                                  uint32 hash = kFnvOffsetBasis) {
+    return *str ? StaticHashName(str + 1, HashChar(hash, *str)) : hash;
+  }
+
+  uint32 HashName(const char *str, size_t len) {
+    uint32 hash = kFnvOffsetBasis;
+    for (const char *end = str + len; str != end; ++str)
+      hash = HashChar(hash, *str);
+    return hash;
+  }
+
+  base::LazyInstance<base::ThreadLocalPointer<Arena> >::Leaky
+      g_current_arena = LAZY_INSTANCE_INITIALIZER;
+
+  base::LazyInstance<base::ThreadLocalPointer<const Header::PrintStyle> >
+      ::Leaky g_current_print_style = LAZY_INSTANCE_INITIALIZER;
+
+  // Every header allocation is prefixed by the arena it came from (NULL for
+  // the heap), padded to keep the header itself aligned.
+  const size_t kAllocationPrefixSize = Arena::kAlignment;
 }  // namespace
 
+void *Header::operator new(size_t size) {
+  Arena *arena = g_current_arena.Pointer()->Get();
+  size += kAllocationPrefixSize;
+  char *p = static_cast<char*>(arena ? arena->Allocate(size)
+                                     : ::operator new(size));
+  *reinterpret_cast<Arena**>(p) = arena;
+  return p + kAllocationPrefixSize;
+}
+
+void Header::operator delete(void *p) {
+  if (!p)
+    return;
+  char *allocation = static_cast<char*>(p) - kAllocationPrefixSize;
+  if (*reinterpret_cast<Arena**>(allocation) == NULL)
+    ::operator delete(allocation);
+}
+
+Header::ScopedArena::ScopedArena(Arena *arena)
+  : previous_(g_current_arena.Pointer()->Get()) {
+  g_current_arena.Pointer()->Set(arena);
+}
+
+Header::ScopedArena::~ScopedArena() {
+  g_current_arena.Pointer()->Set(previous_);
+}
+
+Header::PrintStyle Header::print_style() {
+  const PrintStyle *style = g_current_print_style.Pointer()->Get();
+  return style ? *style : PRINT_COMPACT;
+}
+
+Header::ScopedPrintStyle::ScopedPrintStyle(PrintStyle style)
+  : style_(style),
+    previous_(g_current_print_style.Pointer()->Get()) {
+  g_current_print_style.Pointer()->Set(&style_);
+}
+
+Header::ScopedPrintStyle::~ScopedPrintStyle() {
+  g_current_print_style.Pointer()->Set(previous_);
+}
+
 Header::Header(Type type)
-  : type_(type) {
+  : type_(type),
+    lazy_(false),
+    index_position_(0) {
+}
+
+Header::Header(Type type, bool lazy)
+  : type_(type),
+    lazy_(lazy),
+    index_position_(0) {
 }
 
 Header::Header(const Header &other)
-  : type_(other.type_) {
+  : type_(other.type_),
+    lazy_(other.lazy_),
+    index_position_(0) {
 }
 
 Header::~Header() {
@@ -52,45 +144,67 @@ const char *Header::name() const {
 }
 
 const char Header::compact_form() const {
-  return compact_forms[static_cast<int>(type_)];
+  if (HDR_GENERIC == type_)
+    return 0;
+  return kHeaderInfo[static_cast<int>(type_)].compact_form;
 }
 
 void Header::print(raw_ostream &os) const {
-  if (compact_form() != 0)
-    os << static_cast<signed char>(compact_form());
+  PrintStyle style = print_style();
+  if (HDR_GENERIC == type_) {
+    os << name() << (PRINT_TIGHT == style ? ":" : ": ");
+    return;
+  }
+  const HeaderInfo &info = kHeaderInfo[static_cast<int>(type_)];
+  // The space after the colon is dropped when tight.
+  size_t cut = PRINT_TIGHT == style ? 1 : 0;
+  if (PRINT_LONG != style && info.compact_form != 0)
+    os.write(info.compact_prefix, 3 - cut);
   else
-    os << name();
-  os << ": ";
+    os.write(info.prefix, info.name_length + 2 - cut);
 }
 
 const char *AtomTraits<Header::Type>::string_of(type t) {
-  return names[static_cast<int>(t)];
+  return kHeaderInfo[static_cast<int>(t)].name;
 }
 
 AtomTraits<Header::Type>::type
 AtomTraits<Header::Type>::coerce(const char *str) {
-  Header::Type type = Header::HDR_GENERIC;
-  size_t len = strlen(str);
-
-  if (strlen(str) == 1) {
-    char h = tolower(str[0]);
-    for (int i = 0; i < arraysize(compact_forms); ++i) {
-      if (h == compact_forms[i]) {
-        type = static_cast<Header::Type>(i);
-        break;
-      }
-    }
-  } else {
-    // Perform a simple binary search
-    const char **first = names;
-    const char **last = names + arraysize(names);
-    const char **found = std::lower_bound(first, last, str, HeaderNameLess);
-    if (found != last
-        && base::strcasecmp(*found, str) == 0) {
-      type = static_cast<Header::Type>(found - first);
+  return coerce(str, strlen(str));
+}
+
+AtomTraits<Header::Type>::type
+AtomTraits<Header::Type>::coerce(const char *str, size_t len) {
+  if (len == 1) {
+    // Headers without a compact form get a negative label of their own,
+    // which no character matches; duplicate compact forms don't compile.
+    switch (tolower(static_cast<unsigned char>(str[0]))) {
+#define X(class_name, compact_form, header_name, enum_name, format) \
+      case compact_form ? compact_form : -1 - Header::HDR_##enum_name: \
+        return Header::HDR_##enum_name;
+#include "sippet/message/header_list.h"
+#undef X
+      default:
+        return Header::HDR_GENERIC;
     }
   }
 
+  Header::Type type;
+  switch (HashName(str, len)) {
+#define X(class_name, compact_form, header_name, enum_name, format) \
+    case StaticHashName(#header_name):                              \
+      type = Header::HDR_##enum_name;                               \
+      break;
+#include "sippet/message/header_list.h"
+#undef X
+    default:
+      return Header::HDR_GENERIC;
+  }
+
+  // Unknown names may still share the hash of a known one.
+  if (kHeaderInfo[type].name_length != len
+      || base::strncasecmp(kHeaderInfo[type].name, str, len) != 0)
+    return Header::HDR_GENERIC;
   return type;
 }
 
@@ -8,12 +8,15 @@
 #include "sippet/base/ilist.h"
 #include "sippet/base/ilist_node.h"
 #include "sippet/base/casting.h"
+#include "base/basictypes.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/strings/string_piece.h"
 #include "sippet/message/atom.h"
 
 namespace sippet {
 
 class raw_ostream;
+class Arena;
 #define X(class_name, compact_form, header_name, enum_name, format) \
 class class_name;
 #include "sippet/message/header_list.h"
@@ -32,7 +35,16 @@ class Header : public ilist_node<Header> {
   };
 
  private:
+  friend class Message;
+
   Type type_;
+  bool lazy_;
+  // Position in the typed index of the message holding this header, see
+  // |Message::IndexOf|. Kept in 16 bits, so that headers don't grow.
+  uint16 index_position_;
+  // The header line as received, see |Message::PARSE_PASSTHROUGH|. Points
+  // into the message holding this header; never copied along with it.
+  base::StringPiece raw_;
 
   Header &operator=(const Header &);
 
@@ -42,14 +54,81 @@ class Header : public ilist_node<Header> {
 
   Header(const Header &other);
   Header(Type type);
+  // Used by headers that only hold the raw value of a |type| header, still
+  // to be decoded. See |Message::PARSE_LAZY|.
+  Header(Type type, bool lazy);
   virtual ~Header();
 
   virtual Header *DoClone() const = 0;
 
  public:
+  // Headers are carved out of the arena attached to the current thread, if
+  // any (see |ScopedArena|), or allocated from the heap otherwise. Arena
+  // headers are destroyed as usual, but their memory is only released along
+  // with the arena.
+  static void *operator new(size_t size);
+  static void operator delete(void *p);
+
+  // Attaches an arena to the current thread while in scope.
+  class ScopedArena {
+   public:
+    explicit ScopedArena(Arena *arena);
+    ~ScopedArena();
+
+   private:
+    Arena *previous_;
+
+    DISALLOW_COPY_AND_ASSIGN(ScopedArena);
+  };
+
+  // How header names and separators are printed, from the longest form to
+  // the shortest one.
+  enum PrintStyle {
+    // Full header names, e.g. "Via: a, b".
+    PRINT_LONG,
+    // Compact forms where defined (see header_list.h), e.g. "v: a, b".
+    PRINT_COMPACT,
+    // Compact forms without optional whitespace, e.g. "v:a,b".
+    PRINT_TIGHT,
+  };
+
+  // Returns the style set for the current thread, |PRINT_COMPACT| if none.
+  static PrintStyle print_style();
+
+  // Sets the print style of the current thread while in scope.
+  class ScopedPrintStyle {
+   public:
+    explicit ScopedPrintStyle(PrintStyle style);
+    ~ScopedPrintStyle();
+
+   private:
+    PrintStyle style_;
+    const PrintStyle *previous_;
+
+    DISALLOW_COPY_AND_ASSIGN(ScopedPrintStyle);
+  };
+
   static scoped_ptr<Header> Parse(const std::string &raw_header);
 
   Type type() const { return type_; }
+
+  // Returns true if this header has not been decoded into its typed class
+  // yet. Lazy headers can't be cast to |type()|; |Message| lookups decode
+  // them when found.
+  bool is_lazy() const { return lazy_; }
+
+  // Returns the header line as received, without its line terminator, or
+  // empty if not kept or handed out for writing since. Messages print it
+  // instead of this header. See |Message::PARSE_PASSTHROUGH|.
+  const base::StringPiece &raw() const { return raw_; }
+
+  // Returns the typed version of a lazy header, or NULL if it can't be
+  // decoded. Other headers are just cloned.
+  virtual scoped_ptr<Header> Decode() const { return Clone(); }
+
+  // Returns the header of another message this one refers to, if it's a
+  // shared header. See |Message::ShareTo|.
+  virtual const Header *shared() const { return NULL; }
   const char *name() const;
   const char compact_form() const;
 
@@ -58,10 +137,10 @@ class Header : public ilist_node<Header> {
   virtual void print(raw_ostream &os) const;
 
   std::string ToString() {
-    std::string result;
-    raw_string_ostream os(result);
+    char buffer[256];
+    raw_fixed_buffer_ostream os(buffer, sizeof(buffer));
     print(os);
-    return os.str();
+    return os.str().as_string();
   }
 };
 
@@ -83,12 +162,28 @@ template <> struct isa_impl<Generic, Header> {
   }
 };
 
+// Maps a header class to its |Header::Type|.
+template<class HeaderType> struct HeaderTraits;
+
+#define X(class_name, compact_form, header_name, enum_name, format) \
+template <> struct HeaderTraits<class_name> {                       \
+  static const Header::Type type = Header::HDR_##enum_name;         \
+};
+#include "sippet/message/header_list.h"
+#undef X
+
+template <> struct HeaderTraits<Generic> {
+  static const Header::Type type = Header::HDR_GENERIC;
+};
+
 template<>
 struct AtomTraits<Header::Type> {
   typedef Header::Type type;
   static const type unknown_type = Header::HDR_GENERIC;
   static const char *string_of(type t);
   static type coerce(const char *str);
+  // Same as above, for names that are not null terminated.
+  static type coerce(const char *str, size_t len);
 };
 
 } // End of sippet namespace
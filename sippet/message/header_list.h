@@ -48,7 +48,7 @@ X(InReplyTo,                  0,   In-Reply-To,                   IN_REPLY_TO,
 X(MaxForwards,                0,   Max-Forwards,                  MAX_FORWARDS,                  SingleInteger)
 X(MimeVersion,                0,   MIME-Version,                  MIME_VERSION,                  MimeVersion)
 X(MinExpires,                 0,   Min-Expires,                   MIN_EXPIRES,                   SingleInteger)
-//X(MinSE,                      0,   Min-SE,                        MIN_SE,                        x)
+X(MinSE,                      0,   Min-SE,                        MIN_SE,                        SingleIntegerParams)
 X(Organization,               0,   Organization,                  ORGANIZATION,                  TrimmedUtf8)
 //X(PAccessNetworkInfo,         0,   P-Access-Network-Info,         P_ACCESS_NETWORK_INFO,         x)
 //X(PAnswerState,               0,   P-Answer-State,                P_ANSWER_STATE,                x)
@@ -82,7 +82,7 @@ X(Priority,                   0,   Priority,                      PRIORITY,
 X(ProxyAuthenticate,          0,   Proxy-Authenticate,            PROXY_AUTHENTICATE,            SchemeAndAuthParams)
 X(ProxyAuthorization,         0,   Proxy-Authorization,           PROXY_AUTHORIZATION,           SchemeAndAuthParams)
 X(ProxyRequire,               0,   Proxy-Require,                 PROXY_REQUIRE,                 MultipleTokens)
-//X(RAck,                       0,   RAck,                          RACK,                          x)
+X(RAck,                        0,   RAck,                          RACK,                          RAck)
 //X(Reason,                     0,   Reason,                        REASON,                        x)
 X(RecordRoute,                0,   Record-Route,                  RECORD_ROUTE,                  MultipleContactParams)
 //X(RecvInfo,                   0,   Recv-Info,                     RECV_INFO,                     x)
@@ -97,13 +97,13 @@ X(Require,                    0,   Require,                       REQUIRE,
 //X(ResourcePriority,           0,   Resource-Priority,             RESOURCE_PRIORITY,             x)
 X(RetryAfter,                 0,   Retry-After,                   RETRY_AFTER,                   RetryAfter)
 X(Route,                      0,   Route,                         ROUTE,                         MultipleContactParams)
-//X(RSeq,                       0,   RSeq,                          RSEQ,                          x)
+X(RSeq,                        0,   RSeq,                          RSEQ,                          SingleInteger)
 //X(SecurityClient,             0,   Security-Client,               SECURITY_CLIENT,               x)
 //X(SecurityServer,             0,   Security-Server,               SECURITY_SERVER,               x)
 //X(SecurityVerify,             0,   Security-Verify,               SECURITY_VERIFY,               x)
 X(Server,                     0,   Server,                        SERVER,                        TrimmedUtf8)
 //X(ServiceRoute,               0,   Service-Route,                 SERVICE_ROUTE,                 x)
-//X(SessionExpires,             0,   Session-Expires,               SESSION_EXPIRES,               x)
+X(SessionExpires,             'x', Session-Expires,               SESSION_EXPIRES,               SingleIntegerParams)
 //X(SIPETag,                    0,   SIP-ETag,                      SIP_ETAG,                      x)
 //X(SIPIfMatch,                 0,   SIP-If-Match,                  SIP_IF_MATCH,                  x)
 X(Subject,                    's', Subject,                       SUBJECT,                       TrimmedUtf8)
@@ -31,17 +31,21 @@
 #include "sippet/message/headers/max_forwards.h"
 #include "sippet/message/headers/mime_version.h"
 #include "sippet/message/headers/min_expires.h"
+#include "sippet/message/headers/min_se.h"
 #include "sippet/message/headers/organization.h"
 #include "sippet/message/headers/priority.h"
 #include "sippet/message/headers/proxy_authenticate.h"
 #include "sippet/message/headers/proxy_authorization.h"
 #include "sippet/message/headers/proxy_require.h"
+#include "sippet/message/headers/rack.h"
 #include "sippet/message/headers/record_route.h"
 #include "sippet/message/headers/reply_to.h"
 #include "sippet/message/headers/require.h"
 #include "sippet/message/headers/retry_after.h"
 #include "sippet/message/headers/route.h"
+#include "sippet/message/headers/rseq.h"
 #include "sippet/message/headers/server.h"
+#include "sippet/message/headers/session_expires.h"
 #include "sippet/message/headers/subject.h"
 #include "sippet/message/headers/supported.h"
 #include "sippet/message/headers/timestamp.h"
@@ -73,7 +73,7 @@ template<class T>
 class has_algorithm {
 public:
   enum Algorithm {
-    MD5 = 0, MD5_sess
+    MD5 = 0, MD5_sess, SHA_256, SHA_256_sess, SHA_512_256, SHA_512_256_sess
   };
 
   bool HasAlgorithm() const {
@@ -88,7 +88,8 @@ public:
     static_cast<T*>(this)->param_set("algorithm", algorithm);
   }
   void set_algorithm(Algorithm a) {
-    const char *rep[] = { "MD5", "MD5-sess" };
+    const char *rep[] = { "MD5", "MD5-sess", "SHA-256", "SHA-256-sess",
+                          "SHA-512-256", "SHA-512-256-sess" };
     static_cast<T*>(this)->param_set("algorithm", rep[static_cast<int>(a)]);
   }
 };
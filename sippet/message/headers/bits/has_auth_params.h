@@ -5,6 +5,7 @@
 #ifndef SIPPET_MESSAGE_HEADERS_BITS_HAS_AUTH_PARAMS_H_
 #define SIPPET_MESSAGE_HEADERS_BITS_HAS_AUTH_PARAMS_H_
 
+#include "sippet/message/header.h"
 #include "sippet/message/headers/bits/has_parameters.h"
 
 namespace sippet {
@@ -49,9 +50,11 @@ public:
   void print(raw_ostream &os) const {
     if (has_scheme_)
       os << scheme_ << " ";
+    const char *separator =
+        Header::PRINT_TIGHT == Header::print_style() ? "," : ", ";
     for (const_param_iterator i = param_begin(), ie = param_end(); i != ie; ++i) {
       if (i != param_begin())
-        os << ", ";
+        os << separator;
       os << i->first << "=" << i->second;
     }
   }
@@ -5,20 +5,24 @@
 #ifndef SIPPET_MESSAGE_HEADERS_BITS_HAS_MULTIPLE_H_
 #define SIPPET_MESSAGE_HEADERS_BITS_HAS_MULTIPLE_H_
 
-#include <vector>
+#include "sippet/base/small_vector.h"
+#include "sippet/message/header.h"
 
 namespace sippet {
 
 template<class T> class has_multiple {
+  // Most headers carry a single value, kept without allocating.
+  typedef SmallVector<T, 1> container_type;
 public:
-  typedef typename std::vector<T>::value_type value_type;
-  typedef typename std::vector<T>::iterator iterator;
-  typedef typename std::vector<T>::const_iterator const_iterator;
-  typedef typename std::vector<T>::reverse_iterator reverse_iterator;
-  typedef typename std::vector<T>::const_reverse_iterator const_reverse_iterator;
-  typedef typename std::vector<T>::reference reference;
-  typedef typename std::vector<T>::const_reference const_reference;
-  typedef typename std::vector<T>::size_type size_type;
+  typedef typename container_type::value_type value_type;
+  typedef typename container_type::iterator iterator;
+  typedef typename container_type::const_iterator const_iterator;
+  typedef typename container_type::reverse_iterator reverse_iterator;
+  typedef typename container_type::const_reverse_iterator
+      const_reverse_iterator;
+  typedef typename container_type::reference reference;
+  typedef typename container_type::const_reference const_reference;
+  typedef typename container_type::size_type size_type;
 
 protected:
   has_multiple(const has_multiple &other) : items_(other.items_) {}
@@ -43,6 +47,7 @@ public:
   const_reverse_iterator rend() const   { return items_.rend();   }
 
   // Miscellaneous inspection routines.
+  size_type size() const { return items_.size(); }
   size_type max_size() const { return items_.max_size(); }
   bool empty() const { return items_.empty(); }
 
@@ -74,14 +79,16 @@ public:
 
   // print elements
   void print(raw_ostream &os) const {
+    const char *separator =
+        Header::PRINT_TIGHT == Header::print_style() ? "," : ", ";
     for (const_iterator i = begin(), ie = end(); i != ie; ++i) {
       if (i != begin())
-        os << ", ";
+        os << separator;
       os << *i;
     }
   }
 private:
-  std::vector<T> items_;
+  container_type items_;
 };
 
 } // End of sippet namespace
@@ -4,21 +4,85 @@
 
 #include "sippet/message/headers/bits/has_parameters.h"
 
+#include <cstring>
+#include <limits>
+
+#include "base/strings/string_util.h"
+
 namespace sippet {
 
-has_parameters::has_parameters() {
+has_parameters::has_parameters()
+  : known_names_(NULL) {
+  ResetKnown();
+}
+
+has_parameters::has_parameters(const char *const *known_names)
+  : known_names_(known_names) {
+  ResetKnown();
 }
 
 has_parameters::~has_parameters() {
 }
 
 has_parameters::has_parameters(const has_parameters &other)
-  : params_(other.params_) {
+  : params_(other.params_),
+    hashes_(other.hashes_),
+    known_names_(other.known_names_) {
+  memcpy(known_positions_, other.known_positions_, sizeof(known_positions_));
 }
 
 has_parameters &has_parameters::operator=(const has_parameters &other) {
   params_ = other.params_;
+  hashes_ = other.hashes_;
+  known_names_ = other.known_names_;
+  memcpy(known_positions_, other.known_positions_, sizeof(known_positions_));
   return *this;
 }
 
+size_t has_parameters::find_index(const base::StringPiece &key,
+                                  unsigned hash) const {
+  for (size_t i = 0, e = params_.size(); i != e; ++i) {
+    if (hashes_[i] != hash)
+      continue;
+    const std::string &name = params_[i].first;
+    if (name.size() == key.size() &&
+        0 == base::strncasecmp(name.data(), key.data(), key.size()))
+      return i;
+  }
+  return params_.size();
+}
+
+void has_parameters::AddParam(const InternedString &key, unsigned hash,
+                              const std::string &value) {
+  params_.push_back(param_type(key, value));
+  hashes_.push_back(hash);
+  if (known_names_)
+    TrackKnown(params_.size() - 1);
+}
+
+void has_parameters::TrackKnown(size_t position) {
+  if (position > static_cast<size_t>(std::numeric_limits<int8_t>::max()))
+    return;
+  const std::string &key = params_[position].first;
+  for (int i = 0; i < kMaxKnownParams && known_names_[i]; ++i) {
+    if (base::LowerCaseEqualsASCII(key, known_names_[i])) {
+      known_positions_[i] = static_cast<int8_t>(position);
+      return;
+    }
+  }
+}
+
+void has_parameters::ForgetKnown(int position) {
+  for (int i = 0; i < kMaxKnownParams; ++i) {
+    if (known_positions_[i] == position)
+      known_positions_[i] = -1;
+    else if (known_positions_[i] > position)
+      --known_positions_[i];
+  }
+}
+
+void has_parameters::ResetKnown() {
+  memset(known_positions_, -1, sizeof(known_positions_));
+}
+
 }  // namespace sippet
@@ -5,25 +5,50 @@
 #ifndef SIPPET_MESSAGE_HEADERS_BITS_HAS_PARAMETERS_H_
 #define SIPPET_MESSAGE_HEADERS_BITS_HAS_PARAMETERS_H_
 
-#include <vector>
 #include <utility>
 #include <algorithm>
 #include <string>
 #include <cassert>
+#include <stdint.h>
+#include "base/strings/string_piece.h"
+#include "sippet/base/interned_string.h"
 #include "sippet/base/raw_ostream.h"
+#include "sippet/base/small_vector.h"
+#include "sippet/base/string_extras.h"
 
 namespace sippet {
 
 class has_parameters {
  public:
-  typedef std::pair<std::string, std::string> param_type;
-  typedef std::vector<param_type>::iterator param_iterator;
-  typedef std::vector<param_type>::const_iterator const_param_iterator;
+  // Parameter names are interned in lower case: they come from a small
+  // vocabulary and repeat in every message, and are compared ignoring case.
+  typedef std::pair<InternedString, std::string> param_type;
+  // Headers rarely carry more than a few parameters (as the Via branch,
+  // rport and received), kept without allocating.
+  typedef SmallVector<param_type, 3> param_container;
+  typedef param_container::iterator param_iterator;
+  typedef param_container::const_iterator const_param_iterator;
 
  protected:
   has_parameters(const has_parameters &other);
   has_parameters &operator=(const has_parameters &other);
 
+  // Maximum number of known parameters, see below.
+  enum { kMaxKnownParams = 4 };
+
+  // The parameters named in |known_names|, a NULL terminated list of at
+  // most |kMaxKnownParams| static strings, have their position tracked, so
+  // that they can be read without searching. Used for those looked up in
+  // every message, such as the Via branch.
+  explicit has_parameters(const char *const *known_names);
+
+  // Returns the value of the parameter named |known_names[index]|, or NULL
+  // if not present.
+  const std::string *known_param(int index) const {
+    int position = known_positions_[index];
+    return position < 0 ? NULL : &params_[position].second;
+  }
+
  public:
   has_parameters();
   ~has_parameters();
@@ -39,30 +64,63 @@ class has_parameters {
 
   // erase - remove a node from the controlled sequence... and delete it.
   param_iterator param_erase(param_iterator where) {
+    int position = static_cast<int>(where - params_.begin());
+    if (known_names_)
+      ForgetKnown(position);
+    hashes_.erase(hashes_.begin() + position);
     return params_.erase(where);
   }
 
   // clear everything
-  void param_clear() { params_.clear(); }
+  void param_clear() {
+    params_.clear();
+    hashes_.clear();
+    ResetKnown();
+  }
+
+  // find an existing parameter; names are compared ignoring case, as
+  // SIP requires.
+  param_iterator param_find(const base::StringPiece &key) {
+    return params_.begin() + find_index(key, HashLowerString(key));
+  }
+  const_param_iterator param_find(const base::StringPiece &key) const {
+    return params_.begin() + find_index(key, HashLowerString(key));
+  }
 
-  // find an existing parameter
-  param_iterator param_find(const std::string &key) {
-    return std::find_if(param_begin(), param_end(), first_equals(key));
+  // Same as above, for interned names.
+  param_iterator param_find(const InternedString &key) {
+    return param_find(base::StringPiece(key.str()));
   }
-  const_param_iterator param_find(const std::string &key) const {
-    return std::find_if(param_begin(), param_end(), first_equals(key));
+  const_param_iterator param_find(const InternedString &key) const {
+    return param_find(base::StringPiece(key.str()));
   }
 
   // set a parameter, or create one if it does not exist
-  void param_set(const std::string &key, const std::string &value) {
+  void param_set(const base::StringPiece &key, const std::string &value) {
     assert(!key.empty() && "Key cannot be empty");
     // TODO: value should be unescaped
-    param_iterator it = param_find(key);
-    if (it == param_end()) {
-      params_.push_back(std::make_pair(key, value));
-    } else {
-      (*it).second = value;
+    unsigned hash = HashLowerString(key);
+    size_t index = find_index(key, hash);
+    if (index == params_.size())
+      AddParam(InternedString::LowerCase(key), hash, value);
+    else
+      params_[index].second = value;
+  }
+
+  // Same as above, over raw character ranges, so that the parser doesn't
+  // need to build intermediate strings.
+  void param_set(const char *key_begin, const char *key_end,
+                 const char *value_begin, const char *value_end) {
+    assert(key_begin != key_end && "Key cannot be empty");
+    base::StringPiece key(key_begin, key_end - key_begin);
+    unsigned hash = HashLowerString(key);
+    size_t index = find_index(key, hash);
+    if (index != params_.size()) {
+      params_[index].second.assign(value_begin, value_end);
+      return;
     }
+    AddParam(InternedString::LowerCase(key), hash,
+             std::string(value_begin, value_end));
   }
 
   // print parameters
@@ -75,16 +133,23 @@ class has_parameters {
     }
   }
 private:
-  std::vector<param_type> params_;
-
-  struct first_equals : std::unary_function<const std::string&,bool> {
-    first_equals(const std::string &key) : key_(key) {}
-    bool operator ()(const param_type &pair) {
-      return pair.first == key_;
-    }
-   private:
-    const std::string &key_;
-  };
+  // Returns the position of the parameter named |key|, whose
+  // |HashLowerString| is |hash|, or the number of parameters if not present.
+  size_t find_index(const base::StringPiece &key, unsigned hash) const;
+
+  void AddParam(const InternedString &key, unsigned hash,
+                const std::string &value);
+
+  void TrackKnown(size_t position);
+  void ForgetKnown(int position);
+  void ResetKnown();
+
+  param_container params_;
+  // The |HashLowerString| of each parameter name, in the same order, so
+  // that lookups only compare names whose hashes match.
+  SmallVector<unsigned, 3> hashes_;
+  const char *const *known_names_;
+  int8_t known_positions_[kMaxKnownParams];
 };
 
 } // End of sippet namespace
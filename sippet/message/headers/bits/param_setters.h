@@ -23,7 +23,7 @@ public:                                                             \
     return static_cast<const T*>(this)->param_find(#Name) !=        \
            static_cast<const T*>(this)->param_end();                \
   }                                                                 \
-  std::string Name() const {                                        \
+  const std::string &Name() const {                                 \
     assert(Has##Capitalized() && "Cannot read " #Name);             \
     return static_cast<const T*>(this)->param_find(#Name)->second;  \
   }                                                                 \
@@ -35,6 +35,7 @@ public:                                                             \
 string_token_param_template(has_tag,        tag,        Tag         )
 string_token_param_template(has_maddr,      maddr,      Maddr       )
 string_token_param_template(has_branch,     branch,     Branch      )
+string_token_param_template(has_refresher,  refresher,  Refresher   )
 
 #undef string_token_param_template
 
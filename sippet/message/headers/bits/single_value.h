@@ -23,7 +23,7 @@ public:
   }
 
   void set_value(const value_type &value) { value_ = value; }
-  value_type value() const { return value_; }
+  const value_type &value() const { return value_; }
 
   void print(raw_ostream &os) const {
     os << value();
@@ -6,17 +6,48 @@
 
 namespace sippet {
 
-ContactBase::ContactBase() {
+ContactBase::ContactBase()
+  : address_parsed_(true), sip_address_parsed_(false) {
 }
 
 ContactBase::ContactBase(const ContactBase &other)
   : has_parameters(other), address_(other.address_),
-    display_name_(other.display_name_) {
+    address_parsed_(other.address_parsed_),
+    raw_address_(other.raw_address_),
+    display_name_(other.display_name_), sip_address_(other.sip_address_),
+    sip_address_parsed_(other.sip_address_parsed_) {
 }
 
 ContactBase::ContactBase(const GURL &address,
                          const std::string &displayName)
-  : address_(address), display_name_(displayName) {
+  : address_(address), address_parsed_(true), display_name_(displayName),
+    sip_address_parsed_(false) {
+}
+
+ContactBase::ContactBase(const base::StringPiece &address,
+                         const std::string &displayName)
+  : address_parsed_(false), raw_address_(address.data(), address.size()),
+    display_name_(displayName), sip_address_parsed_(false) {
+}
+
+ContactBase::ContactBase(const char *const *known_names)
+  : has_parameters(known_names), address_parsed_(true),
+    sip_address_parsed_(false) {
+}
+
+ContactBase::ContactBase(const char *const *known_names,
+                         const GURL &address,
+                         const std::string &displayName)
+  : has_parameters(known_names), address_(address), address_parsed_(true),
+    display_name_(displayName), sip_address_parsed_(false) {
+}
+
+ContactBase::ContactBase(const char *const *known_names,
+                         const base::StringPiece &address,
+                         const std::string &displayName)
+  : has_parameters(known_names), address_parsed_(false),
+    raw_address_(address.data(), address.size()),
+    display_name_(displayName), sip_address_parsed_(false) {
 }
 
 ContactBase::~ContactBase() {
@@ -24,22 +55,54 @@ ContactBase::~ContactBase() {
 
 ContactBase &ContactBase::operator=(const ContactBase &other) {
   address_ = other.address_;
+  address_parsed_ = other.address_parsed_;
+  raw_address_ = other.raw_address_;
   display_name_ = other.display_name_;
+  sip_address_ = other.sip_address_;
+  sip_address_parsed_ = other.sip_address_parsed_;
   has_parameters::operator=(other);
   return *this;
 }
 
+GURL ContactBase::address() const {
+  if (!address_parsed_) {
+    address_ = GURL(raw_address_);
+    address_parsed_ = true;
+  }
+  return address_;
+}
+
+const SipURI &ContactBase::sip_address() const {
+  if (!sip_address_parsed_) {
+    sip_address_ = address_parsed_ ? SipURI(address_)
+                                   : SipURI(raw_address_);
+    sip_address_parsed_ = true;
+  }
+  return sip_address_;
+}
+
 void ContactBase::print(raw_ostream &os) const {
   if (!display_name_.empty()) {
     os << "\"";
     os.write_escaped(display_name_);
     os << "\" ";
   }
-  os << "<" << address_.spec() << ">";
+  // Addresses never read are printed as received.
+  os << "<";
+  if (address_parsed_)
+    os << address_.spec();
+  else
+    os << raw_address_;
+  os << ">";
   has_parameters::print(os);
 }
 
-ContactInfo::ContactInfo() {
+const char *const ContactInfo::kKnownParams[] = {
+  "expires", "q", NULL
+};
+
+ContactInfo::ContactInfo()
+  : ContactBase(kKnownParams) {
 }
 
 ContactInfo::ContactInfo(const ContactInfo &other)
@@ -48,7 +111,12 @@ ContactInfo::ContactInfo(const ContactInfo &other)
 
 ContactInfo::ContactInfo(const GURL &address,
                          const std::string &displayName)
-  : ContactBase(address, displayName) {
+  : ContactBase(kKnownParams, address, displayName) {
+}
+
+ContactInfo::ContactInfo(const base::StringPiece &address,
+                         const std::string &displayName)
+  : ContactBase(kKnownParams, address, displayName) {
 }
 
 ContactInfo::~ContactInfo() {}
@@ -7,11 +7,13 @@
 
 #include <string>
 
+#include "base/strings/string_piece.h"
 #include "sippet/message/header.h"
 #include "sippet/message/headers/bits/has_parameters.h"
 #include "sippet/message/headers/bits/has_multiple.h"
 #include "sippet/message/headers/bits/param_setters.h"
 #include "sippet/base/raw_ostream.h"
+#include "sippet/uri/uri.h"
 #include "url/gurl.h"
 
 namespace sippet {
@@ -23,6 +25,12 @@ class ContactBase :
   ContactBase(const ContactBase &other);
   explicit ContactBase(const GURL &address,
                        const std::string &displayName="");
+  // Same as above, with the address as text, e.g. as parsed from a message.
+  // It is only canonicalized into a |GURL| when |address| is called: most
+  // addresses of incoming messages (Route, Record-Route...) are relayed
+  // without being inspected.
+  ContactBase(const base::StringPiece &address,
+              const std::string &displayName);
   ~ContactBase();
 
   ContactBase &operator=(const ContactBase &other);
@@ -34,18 +42,41 @@ class ContactBase :
     display_name_ = display_name;
   }
 
-  GURL address() const {
-    return address_;
-  }
+  GURL address() const;
   void set_address(const GURL &address) {
     address_ = address;
+    address_parsed_ = true;
+    raw_address_.clear();
+    sip_address_parsed_ = false;
   }
 
+  // Returns the address as a |SipURI|, which is invalid for other schemes.
+  // It is parsed on first use and kept until the address changes, so routing
+  // code can inspect it as often as needed. Addresses still kept as text are
+  // parsed straight into a |SipURI|, without going through a |GURL|.
+  const SipURI &sip_address() const;
+
   void print(raw_ostream &os) const;
 
+ protected:
+  // See has_parameters(const char *const *).
+  explicit ContactBase(const char *const *known_names);
+  ContactBase(const char *const *known_names,
+              const GURL &address,
+              const std::string &displayName);
+  ContactBase(const char *const *known_names,
+              const base::StringPiece &address,
+              const std::string &displayName);
+
  private:
-  GURL address_;
+  // Only valid if |address_parsed_|; |raw_address_| holds the address
+  // otherwise.
+  mutable GURL address_;
+  mutable bool address_parsed_;
+  std::string raw_address_;
   std::string display_name_;
+  mutable SipURI sip_address_;
+  mutable bool sip_address_parsed_;
 };
 
 inline
@@ -63,9 +94,20 @@ class ContactInfo :
   ContactInfo(const ContactInfo &other);
   explicit ContactInfo(const GURL &address,
                        const std::string &displayName="");
+  // See |ContactBase|.
+  ContactInfo(const base::StringPiece &address,
+              const std::string &displayName);
   ~ContactInfo();
 
   ContactInfo &operator=(const ContactInfo &other);
+
+  // Read by registrars for every binding, so tracked instead of searched.
+  bool HasExpires() const { return known_param(kExpires) != NULL; }
+  bool HasQvalue() const { return known_param(kQvalue) != NULL; }
+
+ private:
+  enum { kExpires = 0, kQvalue };
+  static const char *const kKnownParams[];
 };
 
 class Contact :
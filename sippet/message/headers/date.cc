@@ -4,8 +4,77 @@
 
 #include "sippet/message/headers/date.h"
 
+#include <cstring>
+
+#include "base/lazy_instance.h"
+#include "base/strings/string_util.h"
+#include "base/threading/thread_local_storage.h"
+
 namespace sippet {
 
+namespace {
+
+// The last date printed by a thread. Dates are mostly stamped with the
+// current time, so it's formatted once a second, and copied otherwise.
+struct DateCache {
+  DateCache() : second(0), valid(false) {}
+
+  static void Destroy(void *cache) {
+    delete static_cast<DateCache*>(cache);
+  }
+
+  int64 second;
+  bool valid;
+  // "Sun, 06 Nov 1994 08:49:37 GMT", 29 bytes up to year 9999.
+  char text[32];
+};
+
+struct DateCacheSlot {
+  DateCacheSlot() : slot(&DateCache::Destroy) {}
+  base::ThreadLocalStorage::Slot slot;
+};
+
+base::LazyInstance<DateCacheSlot>::Leaky g_date_cache_slot =
+    LAZY_INSTANCE_INITIALIZER;
+
+DateCache *CurrentDateCache() {
+  base::ThreadLocalStorage::Slot &slot = g_date_cache_slot.Get().slot;
+  DateCache *cache = static_cast<DateCache*>(slot.Get());
+  if (!cache) {
+    cache = new DateCache;
+    slot.Set(cache);
+  }
+  return cache;
+}
+
+// Whole seconds since the Unix epoch, rounded down.
+int64 SecondOf(const base::Time &time) {
+  int64 microseconds = (time - base::Time::UnixEpoch()).InMicroseconds();
+  int64 second = microseconds / base::Time::kMicrosecondsPerSecond;
+  if (microseconds % base::Time::kMicrosecondsPerSecond < 0)
+    --second;
+  return second;
+}
+
+void FormatDate(const base::Time &time, char *text, size_t size) {
+  static const char *const kWkday[] = {
+    "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
+  };
+  static const char *const kMonth[] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+  };
+
+  base::Time::Exploded exploded;
+  time.UTCExplode(&exploded);
+  base::snprintf(text, size, "%s, %.2d %s %d %.2d:%.2d:%.2d GMT",
+           kWkday[exploded.day_of_week], exploded.day_of_month,
+           kMonth[exploded.month - 1], exploded.year, exploded.hour,
+           exploded.minute, exploded.second);
+}
+
+}  // namespace
+
 Date::Date()
   : Header(Header::HDR_DATE) {
 }
@@ -26,24 +95,16 @@ Date *Date::DoClone() const {
 }
 
 void Date::print(raw_ostream &os) const {
-  const char *wkday[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
-  const char *month[] = {
-    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
-    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
-  };
-
-  base::Time::Exploded exploded;
-  value().UTCExplode(&exploded);
+  DateCache *cache = CurrentDateCache();
+  int64 second = SecondOf(value());
+  if (!cache->valid || cache->second != second) {
+    FormatDate(value(), cache->text, sizeof(cache->text));
+    cache->second = second;
+    cache->valid = true;
+  }
 
   Header::print(os);
-  os << wkday[exploded.day_of_week]
-     << ", "
-     << format("%.2d %s %d", exploded.day_of_month,
-               month[exploded.month-1], exploded.year)
-     << " "
-     << format("%.2d:%.2d:%.2d", exploded.hour,
-               exploded.minute, exploded.second)
-     << " GMT";
+  os.write(cache->text, strlen(cache->text));
 }
 
 }  // namespace sippet
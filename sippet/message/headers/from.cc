@@ -16,6 +16,11 @@ From::From(const GURL &address, const std::string &displayName)
   : Header(Header::HDR_FROM), ContactBase(address, displayName) {
 }
 
+From::From(const base::StringPiece &address,
+           const std::string &displayName)
+  : Header(Header::HDR_FROM), ContactBase(address, displayName) {
+}
+
 From::From(const From &other)
   : Header(other), ContactBase(other) {
 }
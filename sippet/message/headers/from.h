@@ -21,6 +21,8 @@ private:
 public:
   From();
   From(const GURL &address, const std::string &displayName="");
+  // See |ContactBase|.
+  From(const base::StringPiece &address, const std::string &displayName);
   ~From() override;
 
   scoped_ptr<From> Clone() const {
@@ -0,0 +1,34 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/message/headers/min_se.h"
+
+namespace sippet {
+
+MinSE::MinSE()
+  : Header(Header::HDR_MIN_SE) {
+}
+
+MinSE::MinSE(single_value::value_type seconds)
+  : Header(Header::HDR_MIN_SE), single_value(seconds) {
+}
+
+MinSE::MinSE(const MinSE &other)
+  : Header(other), single_value(other), has_parameters(other) {
+}
+
+MinSE::~MinSE() {
+}
+
+MinSE *MinSE::DoClone() const {
+  return new MinSE(*this);
+}
+
+void MinSE::print(raw_ostream &os) const {
+  Header::print(os);
+  single_value::print(os);
+  has_parameters::print(os);
+}
+
+}  // namespace sippet
@@ -0,0 +1,39 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_MESSAGE_HEADERS_MIN_SE_H_
+#define SIPPET_MESSAGE_HEADERS_MIN_SE_H_
+
+#include "sippet/message/header.h"
+#include "sippet/message/headers/bits/single_value.h"
+#include "sippet/message/headers/bits/has_parameters.h"
+#include "sippet/base/raw_ostream.h"
+
+namespace sippet {
+
+// The minimum session interval (RFC 4028 section 5).
+class MinSE :
+  public Header,
+  public single_value<unsigned>,
+  public has_parameters {
+ private:
+  DISALLOW_ASSIGN(MinSE);
+  MinSE(const MinSE &other);
+  MinSE *DoClone() const override;
+
+ public:
+  MinSE();
+  MinSE(single_value::value_type seconds);
+  ~MinSE() override;
+
+  scoped_ptr<MinSE> Clone() const {
+    return scoped_ptr<MinSE>(DoClone());
+  }
+
+  void print(raw_ostream &os) const override;
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_MESSAGE_HEADERS_MIN_SE_H_
@@ -0,0 +1,35 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/message/headers/rack.h"
+
+namespace sippet {
+
+RAck::RAck()
+  : Header(Header::HDR_RACK) {
+}
+
+RAck::RAck(unsigned response_num, unsigned sequence, const Method &method)
+  : Header(Header::HDR_RACK), response_num_(response_num),
+    sequence_(sequence), method_(method) {
+}
+
+RAck::RAck(const RAck &other)
+  : Header(other), response_num_(other.response_num_),
+    sequence_(other.sequence_), method_(other.method_) {
+}
+
+RAck::~RAck() {
+}
+
+RAck *RAck::DoClone() const {
+  return new RAck(*this);
+}
+
+void RAck::print(raw_ostream &os) const {
+  Header::print(os);
+  os << response_num_ << " " << sequence_ << " " << method_;
+}
+
+}  // namespace sippet
@@ -0,0 +1,54 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_MESSAGE_HEADERS_RACK_H_
+#define SIPPET_MESSAGE_HEADERS_RACK_H_
+
+#include <string>
+#include "sippet/message/header.h"
+#include "sippet/message/method.h"
+#include "sippet/base/raw_ostream.h"
+
+namespace sippet {
+
+// Acknowledges a reliable provisional response in a PRACK (RFC 3262): the
+// |RSeq| of the response, followed by the |CSeq| of its request.
+class RAck :
+  public Header {
+ private:
+  DISALLOW_ASSIGN(RAck);
+  RAck(const RAck &other);
+  RAck *DoClone() const override;
+
+ public:
+  RAck();
+  RAck(unsigned response_num, unsigned sequence, const Method &method);
+  ~RAck() override;
+
+  scoped_ptr<RAck> Clone() const {
+    return scoped_ptr<RAck>(DoClone());
+  }
+
+  unsigned response_num() const { return response_num_; }
+  void set_response_num(unsigned response_num) {
+    response_num_ = response_num;
+  }
+
+  unsigned sequence() const { return sequence_; }
+  void set_sequence(unsigned sequence) { sequence_ = sequence; }
+
+  Method method() const { return method_; }
+  void set_method(const Method &method) { method_ = method; }
+
+  void print(raw_ostream &os) const override;
+
+ private:
+  unsigned response_num_;
+  unsigned sequence_;
+  Method method_;
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_MESSAGE_HEADERS_RACK_H_
@@ -16,6 +16,11 @@ ReplyTo::ReplyTo(const GURL &address, const std::string &displayName)
   : Header(Header::HDR_REPLY_TO), ContactBase(address, displayName) {
 }
 
+ReplyTo::ReplyTo(const base::StringPiece &address,
+                 const std::string &displayName)
+  : Header(Header::HDR_REPLY_TO), ContactBase(address, displayName) {
+}
+
 ReplyTo::ReplyTo(const ReplyTo &other)
   : Header(other), ContactBase(other) {
 }
@@ -20,6 +20,8 @@ class ReplyTo :
  public:
   ReplyTo();
   ReplyTo(const GURL &address, const std::string &displayName="");
+  // See |ContactBase|.
+  ReplyTo(const base::StringPiece &address, const std::string &displayName);
   ~ReplyTo() override;
 
   scoped_ptr<ReplyTo> Clone() const {
@@ -20,6 +20,11 @@ RouteParam::RouteParam(const GURL &address,
   : ContactBase(address, displayName) {
 }
 
+RouteParam::RouteParam(const base::StringPiece &address,
+                       const std::string &displayName)
+  : ContactBase(address, displayName) {
+}
+
 RouteParam::~RouteParam() {
 }
 
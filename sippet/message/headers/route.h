@@ -16,6 +16,9 @@ public:
   RouteParam(const RouteParam &other);
   explicit RouteParam(const GURL &address,
                       const std::string &displayName="");
+  // See |ContactBase|.
+  RouteParam(const base::StringPiece &address,
+             const std::string &displayName);
   ~RouteParam();
 
   RouteParam &operator=(const RouteParam &other);
@@ -0,0 +1,33 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/message/headers/rseq.h"
+
+namespace sippet {
+
+RSeq::RSeq()
+  : Header(Header::HDR_RSEQ) {
+}
+
+RSeq::RSeq(const single_value::value_type &n)
+  : Header(Header::HDR_RSEQ), single_value(n) {
+}
+
+RSeq::RSeq(const RSeq &other)
+  : Header(other), single_value(other) {
+}
+
+RSeq::~RSeq() {
+}
+
+RSeq *RSeq::DoClone() const {
+  return new RSeq(*this);
+}
+
+void RSeq::print(raw_ostream &os) const {
+  Header::print(os);
+  single_value::print(os);
+}
+
+}  // namespace sippet
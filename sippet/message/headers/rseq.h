@@ -0,0 +1,36 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_MESSAGE_HEADERS_RSEQ_H_
+#define SIPPET_MESSAGE_HEADERS_RSEQ_H_
+
+#include "sippet/message/header.h"
+#include "sippet/message/headers/bits/single_value.h"
+#include "sippet/base/raw_ostream.h"
+
+namespace sippet {
+
+class RSeq :
+  public Header,
+  public single_value<unsigned> {
+ private:
+  DISALLOW_ASSIGN(RSeq);
+  RSeq(const RSeq &other);
+  RSeq *DoClone() const override;
+
+ public:
+  RSeq();
+  RSeq(const single_value::value_type &n);
+  ~RSeq() override;
+
+  scoped_ptr<RSeq> Clone() const {
+    return scoped_ptr<RSeq>(DoClone());
+  }
+
+  void print(raw_ostream &os) const override;
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_MESSAGE_HEADERS_RSEQ_H_
@@ -0,0 +1,34 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/message/headers/session_expires.h"
+
+namespace sippet {
+
+SessionExpires::SessionExpires()
+  : Header(Header::HDR_SESSION_EXPIRES) {
+}
+
+SessionExpires::SessionExpires(single_value::value_type seconds)
+  : Header(Header::HDR_SESSION_EXPIRES), single_value(seconds) {
+}
+
+SessionExpires::SessionExpires(const SessionExpires &other)
+  : Header(other), single_value(other), has_parameters(other) {
+}
+
+SessionExpires::~SessionExpires() {
+}
+
+SessionExpires *SessionExpires::DoClone() const {
+  return new SessionExpires(*this);
+}
+
+void SessionExpires::print(raw_ostream &os) const {
+  Header::print(os);
+  single_value::print(os);
+  has_parameters::print(os);
+}
+
+}  // namespace sippet
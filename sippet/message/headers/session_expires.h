@@ -0,0 +1,42 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_MESSAGE_HEADERS_SESSION_EXPIRES_H_
+#define SIPPET_MESSAGE_HEADERS_SESSION_EXPIRES_H_
+
+#include "sippet/message/header.h"
+#include "sippet/message/headers/bits/single_value.h"
+#include "sippet/message/headers/bits/has_parameters.h"
+#include "sippet/message/headers/bits/param_setters.h"
+#include "sippet/base/raw_ostream.h"
+
+namespace sippet {
+
+// The session interval, and which side refreshes the session: either "uac"
+// or "uas", relative to the transaction carrying it (RFC 4028 section 4).
+class SessionExpires :
+  public Header,
+  public single_value<unsigned>,
+  public has_parameters,
+  public has_refresher<SessionExpires> {
+ private:
+  DISALLOW_ASSIGN(SessionExpires);
+  SessionExpires(const SessionExpires &other);
+  SessionExpires *DoClone() const override;
+
+ public:
+  SessionExpires();
+  SessionExpires(single_value::value_type seconds);
+  ~SessionExpires() override;
+
+  scoped_ptr<SessionExpires> Clone() const {
+    return scoped_ptr<SessionExpires>(DoClone());
+  }
+
+  void print(raw_ostream &os) const override;
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_MESSAGE_HEADERS_SESSION_EXPIRES_H_
@@ -32,10 +32,10 @@ class Timestamp :
   }
 
   void set_timestamp(double timestamp) { timestamp_ = timestamp; }
-  double timestamp() { return timestamp_; }
+  double timestamp() const { return timestamp_; }
 
   void set_delay(double delay) { delay_ = delay; }
-  double delay() { return delay_; }
+  double delay() const { return delay_; }
 
   void print(raw_ostream &os) const override;
 
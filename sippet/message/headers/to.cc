@@ -16,6 +16,11 @@ To::To(const GURL &address, const std::string &displayName)
   : Header(Header::HDR_TO), ContactBase(address, displayName) {
 }
 
+To::To(const base::StringPiece &address,
+       const std::string &displayName)
+  : Header(Header::HDR_TO), ContactBase(address, displayName) {
+}
+
 To::To(const To &other)
   : Header(other), ContactBase(other) {
 }
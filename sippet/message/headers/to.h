@@ -21,6 +21,8 @@ class To :
  public:
   To();
   To(const GURL &address, const std::string &displayName="");
+  // See |ContactBase|.
+  To(const base::StringPiece &address, const std::string &displayName);
   ~To() override;
 
   scoped_ptr<To> Clone() const {
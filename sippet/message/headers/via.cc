@@ -6,31 +6,42 @@
 
 #include <string>
 
+#include "base/logging.h"
+#include "base/strings/string_tokenizer.h"
+#include "base/strings/string_util.h"
+
 namespace sippet {
 
+const char *const ViaParam::kKnownParams[] = {
+  "branch", "rport", "received", NULL
+};
+
 ViaParam::ViaParam()
-  : version_(2, 0) {
+  : has_parameters(kKnownParams), version_(2, 0) {
 }
 
 ViaParam::ViaParam(const ViaParam &other)
-  : version_(other.version_), protocol_(other.protocol_),
-    sent_by_(other.sent_by_), has_parameters(other) {
+  : has_parameters(other), version_(other.version_),
+    protocol_(other.protocol_), sent_by_(other.sent_by_) {
 }
 
 ViaParam::ViaParam(const Protocol &p,
                    const net::HostPortPair &sent_by)
-  : version_(2, 0), protocol_(p), sent_by_(sent_by) {
+  : has_parameters(kKnownParams), version_(2, 0), protocol_(p),
+    sent_by_(sent_by) {
 }
 
 ViaParam::ViaParam(const std::string &protocol,
                    const net::HostPortPair &sent_by)
-  : version_(2, 0), protocol_(protocol), sent_by_(sent_by) {
+  : has_parameters(kKnownParams), version_(2, 0), protocol_(protocol),
+    sent_by_(sent_by) {
 }
 
 ViaParam::ViaParam(const Version &version,
                    const std::string &protocol,
                    const net::HostPortPair &sent_by)
-  : version_(version), protocol_(protocol), sent_by_(sent_by) {
+  : has_parameters(kKnownParams), version_(version), protocol_(protocol),
+    sent_by_(sent_by) {
 }
 
 ViaParam::~ViaParam() {
@@ -71,7 +82,8 @@ Via::Via(const ViaParam &param)
 }
 
 Via::Via(const Via &other)
-  : Header(other), has_multiple(other) {
+  : Header(other), has_multiple(other),
+    unparsed_values_(other.unparsed_values_) {
 }
 
 Via::~Via() {
@@ -81,9 +93,50 @@ Via *Via::DoClone() const {
   return new Via(*this);
 }
 
+Via::size_type Via::size() const {
+  size_type count = has_multiple::size();
+  // Split as done by the parser, empty values being skipped.
+  base::StringTokenizer values(unparsed_values_, ",");
+  values.set_quote_chars("\'\"");
+  while (values.GetNext()) {
+    std::string value;
+    base::TrimWhitespaceASCII(values.token(), base::TRIM_ALL, &value);
+    if (!value.empty())
+      ++count;
+  }
+  return count;
+}
+
+void Via::pop_front() {
+  ParseFirst();
+  if (!has_multiple::empty())
+    has_multiple::erase(has_multiple::begin());
+  ParseFirst();
+}
+
+void Via::ParseNext() const {
+  std::string values;
+  values.swap(unparsed_values_);
+  scoped_ptr<Header> header(Header::Parse("Via: " + values));
+  Via *next = header ? dyn_cast<Via>(header.get()) : NULL;
+  if (!next || next->has_multiple::empty()) {
+    DVLOG(1) << "Dropped malformed Via values: " << values;
+    return;
+  }
+  // The parsed values are only logically part of the header.
+  Via *self = const_cast<Via*>(this);
+  self->has_multiple::push_back(next->has_multiple::front());
+  unparsed_values_.swap(next->unparsed_values_);
+}
+
 void Via::print(raw_ostream &os) const {
   Header::print(os);
   has_multiple::print(os);
+  if (!unparsed_values_.empty()) {
+    if (!has_multiple::empty())
+      os << (Header::PRINT_TIGHT == Header::print_style() ? "," : ", ");
+    os << unparsed_values_;
+  }
 }
 
 }  // namespace sippet
@@ -43,14 +43,27 @@ class ViaParam :
   Protocol protocol() const { return protocol_; }
   void set_protocol(const Protocol &protocol) { protocol_ = protocol; }
 
-  net::HostPortPair sent_by() const { return sent_by_; }
+  const net::HostPortPair &sent_by() const { return sent_by_; }
   void set_sent_by(const net::HostPortPair &sent_by) {
     sent_by_ = sent_by;
   }
 
+  // The parameters below are read for every message passing through the
+  // transaction layer, so their positions are tracked instead of searched.
+  bool HasBranch() const { return known_param(kBranch) != NULL; }
+  const std::string &branch() const {
+    assert(HasBranch() && "Cannot read branch");
+    return *known_param(kBranch);
+  }
+  bool HasRport() const { return known_param(kRport) != NULL; }
+  bool HasReceived() const { return known_param(kReceived) != NULL; }
+
   void print(raw_ostream &os) const;
 
  private:
+  enum { kBranch = 0, kRport, kReceived };
+  static const char *const kKnownParams[];
+
   Version version_;
   Protocol protocol_;
   net::HostPortPair sent_by_;
@@ -62,6 +75,13 @@ raw_ostream &operator<<(raw_ostream &os, const ViaParam &p) {
   return os;
 }
 
+// Only the topmost value of a received Via is parsed along with it: the
+// next ones, added by the proxies the message went through, are kept as
+// received, and re-emitted verbatim when the message is forwarded. They're
+// parsed in place the first time they're walked along or changed, even by
+// const accessors, as done by |Message| with lazy headers; |front|,
+// |pop_front|, |empty| and |size| don't parse them. So the parsing cost of
+// a proxied message doesn't grow with the path it went through.
 class Via :
   public Header,
   public has_multiple<ViaParam> {
@@ -79,7 +99,84 @@ class Via :
     return scoped_ptr<Via>(DoClone());
   }
 
+  iterator begin() { ParseAll(); return has_multiple::begin(); }
+  const_iterator begin() const { ParseAll(); return has_multiple::begin(); }
+  iterator end() { ParseAll(); return has_multiple::end(); }
+  const_iterator end() const { ParseAll(); return has_multiple::end(); }
+
+  reverse_iterator rbegin() { ParseAll(); return has_multiple::rbegin(); }
+  const_reverse_iterator rbegin() const {
+    ParseAll(); return has_multiple::rbegin();
+  }
+  reverse_iterator rend() { ParseAll(); return has_multiple::rend(); }
+  const_reverse_iterator rend() const {
+    ParseAll(); return has_multiple::rend();
+  }
+
+  bool empty() const {
+    return has_multiple::empty() && unparsed_values_.empty();
+  }
+  // Counts the unparsed values without parsing them.
+  size_type size() const;
+
+  reference front() { ParseFirst(); return has_multiple::front(); }
+  const_reference front() const {
+    ParseFirst(); return has_multiple::front();
+  }
+  reference back() { ParseAll(); return has_multiple::back(); }
+  const_reference back() const { ParseAll(); return has_multiple::back(); }
+
+  template<typename InIt> void assign(InIt first, InIt last) {
+    unparsed_values_.clear();
+    has_multiple::assign(first, last);
+  }
+  void insert(iterator where, const value_type &val) {
+    ParseAll();
+    has_multiple::insert(where, val);
+  }
+  template<typename InIt> void insert(iterator where, InIt first, InIt last) {
+    ParseAll();
+    has_multiple::insert(where, first, last);
+  }
+  void push_back(const value_type &val) {
+    ParseAll();
+    has_multiple::push_back(val);
+  }
+  iterator erase(iterator where) {
+    ParseAll();
+    return has_multiple::erase(where);
+  }
+  void clear() {
+    unparsed_values_.clear();
+    has_multiple::clear();
+  }
+
+  // Removes the topmost value, parsing the next one only, as done by a
+  // proxy forwarding a response.
+  void pop_front();
+
+  // The values following the parsed ones, as received.
+  const std::string &unparsed_values() const { return unparsed_values_; }
+  void set_unparsed_values(const std::string &values) {
+    unparsed_values_ = values;
+  }
+
   void print(raw_ostream &os) const override;
+
+ private:
+  // Parses the next unparsed value, if any. Malformed values are dropped,
+  // along with the ones following them.
+  void ParseNext() const;
+  void ParseFirst() const {
+    if (has_multiple::empty() && !unparsed_values_.empty())
+      ParseNext();
+  }
+  void ParseAll() const {
+    while (!unparsed_values_.empty())
+      ParseNext();
+  }
+
+  mutable std::string unparsed_values_;
 };
 
 } // End of sippet namespace
@@ -373,6 +373,22 @@ TEST_F(HeaderTest, Date) {
   EXPECT_EQ("Date: Thu, 01 Jan 1970 00:01:02 GMT", os.str());
 }
 
+TEST_F(HeaderTest, DateFormattedOncePerSecond) {
+  const char *expected[] = {
+    "Date: Thu, 01 Jan 1970 00:01:02 GMT",
+    "Date: Thu, 01 Jan 1970 00:01:02 GMT",
+    "Date: Thu, 01 Jan 1970 00:01:03 GMT",
+    "Date: Wed, 31 Dec 1969 23:59:59 GMT",
+  };
+  const double js_times[] = { 62000, 62999.9, 63000, -0.5 };
+  for (size_t i = 0; i < arraysize(js_times); ++i) {
+    std::string buffer;
+    raw_string_ostream os(buffer);
+    Date(base::Time::FromJsTime(js_times[i])).print(os);
+    EXPECT_EQ(expected[i], os.str()) << js_times[i];
+  }
+}
+
 TEST_F(HeaderTest, ErrorInfo) {
   scoped_ptr<ErrorInfo> error_info(new ErrorInfo);
   error_info->push_back(ErrorUri(
@@ -479,6 +495,21 @@ TEST_F(HeaderTest, MinExpires) {
   EXPECT_EQ("Min-Expires: 5", os.str());
 }
 
+TEST_F(HeaderTest, MinSE) {
+  scoped_ptr<MinSE> min_se(new MinSE(90));
+
+  EXPECT_EQ(90, min_se->value());
+
+  Header *h = min_se.get();
+  EXPECT_TRUE(isa<MinSE>(h));
+
+  std::string buffer;
+  raw_string_ostream os(buffer);
+  min_se->print(os);
+
+  EXPECT_EQ("Min-SE: 90", os.str());
+}
+
 TEST_F(HeaderTest, Organization) {
   scoped_ptr<Organization> organization(new Organization("Boxes by Bob"));
 
@@ -567,6 +598,23 @@ TEST_F(HeaderTest, ProxyRequire) {
   EXPECT_EQ("Proxy-Require: foo", os.str());
 }
 
+TEST_F(HeaderTest, RAck) {
+  scoped_ptr<RAck> rack(new RAck(776656, 1, Method::INVITE));
+
+  EXPECT_EQ(776656, rack->response_num());
+  EXPECT_EQ(1, rack->sequence());
+  EXPECT_EQ(Method::INVITE, rack->method());
+
+  Header *h = rack.get();
+  EXPECT_TRUE(isa<RAck>(h));
+
+  std::string buffer;
+  raw_string_ostream os(buffer);
+  rack->print(os);
+
+  EXPECT_EQ("RAck: 776656 1 INVITE", os.str());
+}
+
 TEST_F(HeaderTest, RecordRoute) {
   scoped_ptr<RecordRoute> record_route(
       new RecordRoute(RouteParam(GURL("sip:p2.example.com;lr"))));
@@ -636,6 +684,58 @@ TEST_F(HeaderTest, Route) {
   EXPECT_EQ("Route: <sip:alice@atlanta.com>", os.str());
 }
 
+TEST_F(HeaderTest, RouteSipAddress) {
+  RouteParam param(GURL("sip:p1.example.com;lr"));
+  const SipURI &uri = param.sip_address();
+  ASSERT_TRUE(uri.is_valid());
+  EXPECT_EQ("p1.example.com", uri.host());
+  EXPECT_TRUE(uri.parameter("lr").first);
+  EXPECT_EQ(&uri, &param.sip_address());
+
+  RouteParam copy(param);
+  EXPECT_EQ(uri, copy.sip_address());
+
+  param.set_address(GURL("sips:p2.example.com"));
+  EXPECT_EQ("p2.example.com", param.sip_address().host());
+  EXPECT_FALSE(param.sip_address().parameter("lr").first);
+
+  param.set_address(GURL("tel:+1-201-555-0123"));
+  EXPECT_FALSE(param.sip_address().is_valid());
+}
+
+TEST_F(HeaderTest, RSeq) {
+  scoped_ptr<RSeq> rseq(new RSeq(988789));
+
+  EXPECT_EQ(988789, rseq->value());
+
+  Header *h = rseq.get();
+  EXPECT_TRUE(isa<RSeq>(h));
+
+  std::string buffer;
+  raw_string_ostream os(buffer);
+  rseq->print(os);
+
+  EXPECT_EQ("RSeq: 988789", os.str());
+}
+
+TEST_F(HeaderTest, SessionExpires) {
+  scoped_ptr<SessionExpires> session_expires(new SessionExpires(1800));
+  EXPECT_FALSE(session_expires->HasRefresher());
+  session_expires->set_refresher("uac");
+
+  EXPECT_EQ(1800, session_expires->value());
+  EXPECT_EQ("uac", session_expires->refresher());
+
+  Header *h = session_expires.get();
+  EXPECT_TRUE(isa<SessionExpires>(h));
+
+  std::string buffer;
+  raw_string_ostream os(buffer);
+  session_expires->print(os);
+
+  EXPECT_EQ("Session-Expires: 1800;refresher=uac", os.str());
+}
+
 TEST_F(HeaderTest, Subject) {
   scoped_ptr<Subject> subject(new Subject("Need more boxes"));
 
@@ -734,6 +834,76 @@ TEST_F(HeaderTest, Via) {
       "pc33.atlanta.com;rport;branch=z9hG4bK776asdhds", os.str());
 }
 
+TEST_F(HeaderTest, ViaKnownParams) {
+  ViaParam param(Protocol::UDP, net::HostPortPair("pc33.atlanta.com", 0));
+  EXPECT_FALSE(param.HasBranch());
+  param.param_set("maddr", "224.2.0.1");
+  param.set_branch("z9hG4bK776asdhds");
+  param.set_received("192.0.2.1");
+  EXPECT_TRUE(param.HasBranch());
+  EXPECT_TRUE(param.HasReceived());
+  EXPECT_FALSE(param.HasRport());
+  EXPECT_EQ("z9hG4bK776asdhds", param.branch());
+
+  param.param_erase(param.param_find("maddr"));
+  EXPECT_EQ("z9hG4bK776asdhds", param.branch());
+  EXPECT_EQ("192.0.2.1", param.received());
+
+  ViaParam copy(param);
+  param.param_erase(param.param_find("branch"));
+  EXPECT_FALSE(param.HasBranch());
+  EXPECT_TRUE(param.HasReceived());
+  EXPECT_EQ("z9hG4bK776asdhds", copy.branch());
+
+  param.param_clear();
+  EXPECT_FALSE(param.HasReceived());
+}
+
+TEST_F(HeaderTest, InternedParamNames) {
+  ViaParam a(Protocol::UDP, net::HostPortPair("pc33.atlanta.com", 0));
+  ViaParam b(Protocol::TCP, net::HostPortPair("pc33.atlanta.com", 0));
+  a.set_branch("z9hG4bK776asdhds");
+  b.set_branch("z9hG4bK776asdhdt");
+  EXPECT_EQ(&a.param_begin()->first.str(), &b.param_begin()->first.str());
+
+  InternedString branch("branch");
+  EXPECT_TRUE(branch.is_interned());
+  EXPECT_NE(a.param_end(), a.param_find(branch));
+  EXPECT_EQ(a.param_end(), a.param_find(InternedString("maddr")));
+
+  EXPECT_TRUE(InternedString() == InternedString(""));
+  EXPECT_TRUE(InternedString("x-foo") == InternedString("x-foo"));
+  EXPECT_FALSE(InternedString("x-foo") == InternedString("x-bar"));
+
+  InternedString folded(InternedString::LowerCase("X-Foo"));
+  EXPECT_EQ("x-foo", folded);
+  EXPECT_TRUE(InternedString("x-foo") == folded);
+  EXPECT_EQ(&branch.str(), &InternedString::LowerCase("Branch").str());
+}
+
+TEST_F(HeaderTest, ParamNamesIgnoreCase) {
+  ViaParam param(Protocol::UDP, net::HostPortPair("pc33.atlanta.com", 0));
+  param.param_set("Branch", "z9hG4bK776asdhds");
+  param.param_set("MADDR", "224.2.0.1");
+  EXPECT_TRUE(param.HasBranch());
+  EXPECT_EQ("z9hG4bK776asdhds", param.branch());
+  EXPECT_NE(param.param_end(), param.param_find("maddr"));
+  EXPECT_NE(param.param_end(), param.param_find(InternedString("Maddr")));
+  EXPECT_EQ(param.param_end(), param.param_find("maddrx"));
+
+  // Names are kept in lower case, sharing the entry of the well-known ones.
+  param.param_set("maddr", "224.2.0.2");
+  has_parameters::param_iterator i = param.param_find("maddr");
+  ASSERT_NE(param.param_end(), i);
+  EXPECT_EQ("maddr", i->first);
+  EXPECT_EQ(&InternedString("maddr").str(), &i->first.str());
+  EXPECT_EQ("224.2.0.2", i->second);
+
+  param.param_erase(i);
+  EXPECT_EQ(param.param_end(), param.param_find("maddr"));
+  EXPECT_EQ("z9hG4bK776asdhds", param.branch());
+}
+
 TEST_F(HeaderTest, Warning) {
   scoped_ptr<Warning> warning(new Warning);
   warning->push_back(
@@ -4,45 +4,464 @@
 
 #include "sippet/message/message.h"
 
+#include <cstring>
 #include <string>
 
+#include "sippet/base/arena.h"
+#include "sippet/message/content_coding.h"
+#include "sippet/message/message_pool.h"
+#include "sippet/message/parser/tokenizer.h"
+
 namespace sippet {
 
+namespace {
+
+// Size of the stack buffer used to serialize message heads.
+const size_t kSerializationBufferSize = 2048;
+
+// Header types are written as a single byte by |SerializeBinary|.
+COMPILE_ASSERT(Header::HDR_GENERIC <= kuint8max, header_types_fit_a_byte);
+
+// Appends |value| in groups of 7 bits, least significant first, the high
+// bit telling whether another group follows.
+void WriteVarint(uint64 value, std::string *output) {
+  while (value >= 0x80) {
+    output->push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  output->push_back(static_cast<char>(value));
+}
+
+void WriteBytes(const base::StringPiece &bytes, std::string *output) {
+  WriteVarint(bytes.size(), output);
+  bytes.AppendToString(output);
+}
+
+// Returns the value of a printed header line, after its name and colon.
+base::StringPiece HeaderValue(const base::StringPiece &line) {
+  size_t colon = line.find(':');
+  if (base::StringPiece::npos == colon)
+    return base::StringPiece();
+  base::StringPiece value(line.substr(colon + 1));
+  while (!value.empty() && (value[0] == ' ' || value[0] == '\t'))
+    value.remove_prefix(1);
+  return value;
+}
+
+}  // namespace
+
 Message::Message(bool is_request,
                  Direction direction)
   : is_request_(is_request),
-    direction_(direction) {}
+    lazy_headers_(0),
+    index_dirty_(false),
+    multipart_split_(false),
+    direction_(direction),
+    print_style_(Header::PRINT_COMPACT) {
+  ResetIndex();
+}
 
-Message::~Message() {}
+Message::~Message() {
+  if (content_.get()) {
+    MemoryAccounting::Add(MemoryAccounting::MESSAGES,
+                          -static_cast<int64>(content_->size()));
+  }
+  // Headers lent to other messages are about to go away.
+  DetachLentHeaders();
+  if (arena_) {
+    // Headers have to go before the arena they were allocated from.
+    headers_.clear();
+    MessagePool::ReleaseArena(arena_.Pass());
+  }
+}
+
+void *Message::operator new(size_t size) {
+  MemoryAccounting::Add(MemoryAccounting::MESSAGES, size);
+  return MessagePool::Allocate(size);
+}
+
+void Message::operator delete(void *p, size_t size) {
+  MemoryAccounting::Add(MemoryAccounting::MESSAGES,
+                        -static_cast<int64>(size));
+  MessagePool::Free(p, size);
+}
 
 void Message::print(raw_ostream &os) const {
+  PrintHead(os);
+
+  // Append the content when available
+  if (has_content())
+    os.write(encoded_content().data(), encoded_content().length());
+}
+
+void Message::PrintHead(raw_ostream &os) const {
+  Header::ScopedPrintStyle scoped_print_style(print_style_);
+  PrintStartLine(os);
+  os << canned_headers_;
   for (const_iterator i = headers_.begin(), ie = headers_.end();
        i != ie; ++i) {
     if (isa<ContentLength>(i))
       continue;
-    i->print(os);
+    const base::StringPiece &raw = i->raw();
+    if (!raw.empty())
+      os.write(raw.data(), raw.size());
+    else
+      i->print(os);
     os << "\r\n";
   }
+  if (static_headers_.get()) {
+    for (size_t i = 0, size = static_headers_->size(); i < size; ++i) {
+      Header::Type type = static_headers_->type(i);
+      if (Header::HDR_GENERIC != type && HasIndexed(type))
+        continue;
+      os << static_headers_->line(i, print_style_);
+    }
+  }
 
   // Force the Content Length to match the content size
   scoped_ptr<ContentLength> content_length(
-    new ContentLength(unsigned(content_.length())));
+    new ContentLength(unsigned(encoded_content().length())));
   content_length->print(os);
   os << "\r\n";
 
   // End of header
   os << "\r\n";
-
-  // Append the content when available
-  if (has_content())
-    os.write(content_.data(), content_.length());
 }
 
 std::string Message::ToString() const {
-  std::string output;
-  raw_string_ostream os(output);
-  print(os);
-  return os.str();
+  return SerializedHead() + encoded_content();
+}
+
+void Message::SerializeBinary(std::string *output) const {
+  output->push_back(static_cast<char>(kBinaryFormatVersion));
+  output->push_back(is_request_ ? 1 : 0);
+  if (is_request_) {
+    const Request *request = static_cast<const Request*>(this);
+    output->push_back(static_cast<char>(request->method_.type()));
+    if (Method::Unknown == request->method_.type())
+      WriteBytes(request->method_.str(), output);
+    WriteBytes(request->request_uri_.spec(), output);
+    WriteVarint(request->version_.major_value(), output);
+    WriteVarint(request->version_.minor_value(), output);
+  } else {
+    const Response *response = static_cast<const Response*>(this);
+    WriteVarint(response->response_code_, output);
+    WriteBytes(response->reason_phrase_, output);
+    WriteVarint(response->version_.major_value(), output);
+    WriteVarint(response->version_.minor_value(), output);
+  }
+
+  // Lazy headers are written as they are, without being decoded.
+  WriteVarint(headers_.size(), output);
+  Header::ScopedPrintStyle scoped_print_style(Header::PRINT_TIGHT);
+  std::string line;
+  for (const_iterator i = headers_.begin(), ie = headers_.end();
+       i != ie; ++i) {
+    output->push_back(static_cast<char>(i->type()));
+    if (Header::HDR_GENERIC == i->type())
+      WriteBytes(i->name(), output);
+    base::StringPiece raw(i->raw());
+    if (raw.empty()) {
+      line.clear();
+      raw_string_ostream os(line);
+      i->print(os);
+      raw = os.str();
+    }
+    WriteBytes(HeaderValue(raw), output);
+  }
+  WriteBytes(encoded_content(), output);
+}
+
+const std::string &Message::SerializedHead() const {
+  if (serialized_.empty()) {
+    // Typical messages fit the stack buffer, so that the cache is allocated
+    // once, with its final size.
+    char buffer[kSerializationBufferSize];
+    raw_fixed_buffer_ostream os(buffer, sizeof(buffer));
+    PrintHead(os);
+    base::StringPiece head(os.str());
+    serialized_.assign(head.data(), head.size());
+  }
+  return serialized_;
+}
+
+const scoped_refptr<base::RefCountedString> &Message::SerializedWire() const {
+  if (!wire_.get()) {
+    const std::string &head = SerializedHead();
+    const std::string &body = encoded_content();
+    std::string wire;
+    wire.reserve(head.size() + body.size());
+    wire.append(head);
+    wire.append(body);
+    wire_ = base::RefCountedString::TakeString(&wire);
+  }
+  return wire_;
+}
+
+const std::string &Message::content() const {
+  if (!content_.get())
+    return base::EmptyString();
+  if (!decoded_content_.get())
+    decoded_content_ = DecodeContent();
+  return decoded_content_->data();
+}
+
+scoped_refptr<base::RefCountedString> Message::DecodeContent() const {
+  const ContentEncoding *content_encoding = get<ContentEncoding>();
+  if (!content_encoding || content_encoding->empty())
+    return content_;
+  // Codings are listed in the order they were applied.
+  std::string decoded(content_->data());
+  for (ContentEncoding::const_reverse_iterator
+       i = content_encoding->rbegin(), ie = content_encoding->rend();
+       i != ie; ++i) {
+    std::string input;
+    input.swap(decoded);
+    if (!sippet::DecodeContent(GetContentCoding(i->value()), input,
+                               kMaxDecodedContentSize, &decoded)) {
+      DVLOG(1) << "Can't decode a content in " << i->value();
+      return content_;
+    }
+  }
+  return base::RefCountedString::TakeString(&decoded);
+}
+
+const MultipartBody *Message::multipart_body() const {
+  if (multipart_split_)
+    return multipart_body_.get();
+  multipart_split_ = true;
+  const ContentType *content_type = get<ContentType>();
+  if (!content_type
+      || !base::LowerCaseEqualsASCII(content_type->type(), "multipart"))
+    return NULL;
+  ContentType::const_param_iterator boundary =
+      content_type->param_find("boundary");
+  if (content_type->param_end() == boundary)
+    return NULL;
+  base::StringPiece value(boundary->second);
+  if (value.size() >= 2 && '"' == value[0] && '"' == value[value.size() - 1])
+    value = value.substr(1, value.size() - 2);
+  // Parts are split out of the decoded content.
+  content();
+  multipart_body_ = MultipartBody::Parse(decoded_content_, value);
+  return multipart_body_.get();
+}
+
+bool Message::FindContent(const base::StringPiece &media_type,
+                          base::StringPiece *content) const {
+  DCHECK(content);
+  const ContentType *content_type = get<ContentType>();
+  if (!content_type || !has_content())
+    return false;
+  if (base::EqualsCaseInsensitiveASCII(content_type->value(), media_type)) {
+    *content = Message::content();
+    return true;
+  }
+  const MultipartBody *body = multipart_body();
+  const MultipartBody::Part *part = body ? body->FindPart(media_type) : NULL;
+  if (!part)
+    return false;
+  *content = part->body;
+  return true;
+}
+
+bool Message::HasValidTextContent() const {
+  const ContentType *content_type = get<ContentType>();
+  if (!content_type || !has_content()
+      || !base::EqualsCaseInsensitiveASCII(content_type->type(), "text"))
+    return true;
+  ContentType::const_param_iterator charset =
+      content_type->param_find("charset");
+  if (content_type->param_end() != charset) {
+    base::StringPiece value(charset->second);
+    if (value.size() >= 2 && '"' == value[0]
+        && '"' == value[value.size() - 1])
+      value = value.substr(1, value.size() - 2);
+    if (!base::EqualsCaseInsensitiveASCII(value, "utf-8"))
+      return true;
+  }
+  return Tokenizer::IsValidUtf8(content());
+}
+
+Message::iterator Message::FindFirstDecoded(Header::Type type) const {
+  EnsureIndex();
+  return FindIndexed(type, 0);
+}
+
+Message::iterator Message::FindLastDecoded(Header::Type type) const {
+  EnsureIndex();
+  for (size_t position = index_.size(); position > 0;) {
+    --position;
+    if (type != index_[position].type)
+      continue;
+    // Dropping a header that fails to decode leaves the previous ones in
+    // place, so the scan goes on from the same position.
+    iterator i(index_[position].header);
+    if (!i->is_lazy() || Decode(&i))
+      return ++i;
+  }
+  return headers_.begin();
+}
+
+Message::iterator Message::FindNextDecoded(Header::Type type,
+                                           iterator where) const {
+  EnsureIndex();
+  return FindIndexed(type, IndexOf(&*where) + 1);
+}
+
+Message::iterator Message::FindIndexed(Header::Type type,
+                                       size_t position) const {
+  while (position < index_.size()) {
+    if (type != index_[position].type) {
+      ++position;
+      continue;
+    }
+    iterator i(index_[position].header);
+    if (!i->is_lazy() || Decode(&i))
+      return i;
+    // The header was dropped, and the next one took its position.
+  }
+  return headers_.end();
+}
+
+bool Message::HasIndexed(Header::Type type) const {
+  EnsureIndex();
+  for (HeaderIndex::const_iterator i = index_.begin(), ie = index_.end();
+       i != ie; ++i) {
+    if (type == i->type)
+      return true;
+  }
+  return false;
+}
+
+const Header *Message::FindFirstShared(Header::Type type) const {
+  EnsureIndex();
+  size_t position = 0;
+  while (position < index_.size()) {
+    if (type != index_[position].type) {
+      ++position;
+      continue;
+    }
+    Header *header = index_[position].header;
+    if (!header->is_lazy())
+      return header;
+    if (header->shared())
+      return header->shared();
+    iterator i(header);
+    if (Decode(&i))
+      return &*i;
+  }
+  return NULL;
+}
+
+size_t Message::IndexOf(const Header *header) const {
+  // Past 64K headers, positions wrap around, and the following candidates
+  // are checked too.
+  for (size_t position = header->index_position_;
+       position < index_.size(); position += kuint16max + 1) {
+    if (header == index_[position].header)
+      return position;
+  }
+  NOTREACHED();
+  return index_.size();
+}
+
+void Message::RenumberIndex(size_t position) const {
+  for (size_t size = index_.size(); position < size; ++position)
+    index_[position].header->index_position_ = static_cast<uint16>(position);
+}
+
+void Message::DropAllRawSlow() {
+  for (iterator i = headers_.begin(), ie = headers_.end(); i != ie; ++i)
+    i->raw_.clear();
+}
+
+void Message::IndexInserted(iterator position) const {
+  if (index_dirty_)
+    return;
+  IndexEntry entry = { position->type(), &*position };
+  iterator next(position);
+  ++next;
+  if (next == headers_.end()) {
+    // Appending is the common case, while parsing or building messages.
+    position->index_position_ = static_cast<uint16>(index_.size());
+    index_.push_back(entry);
+    return;
+  }
+  size_t inserted = IndexOf(&*next);
+  index_.insert(index_.begin() + inserted, entry);
+  RenumberIndex(inserted);
+}
+
+void Message::IndexErasing(iterator position) const {
+  if (index_dirty_)
+    return;
+  size_t erased = IndexOf(&*position);
+  index_.erase(index_.begin() + erased);
+  RenumberIndex(erased);
+}
+
+void Message::IndexReplaced(const Header *old_header,
+                            Header *new_header) const {
+  DCHECK_EQ(old_header->type(), new_header->type());
+  if (index_dirty_)
+    return;
+  size_t position = IndexOf(old_header);
+  index_[position].header = new_header;
+  new_header->index_position_ = static_cast<uint16>(position);
+}
+
+void Message::ResetIndex() const {
+  index_.clear();
+  index_dirty_ = false;
+}
+
+void Message::RebuildIndex() const {
+  ResetIndex();
+  for (iterator i = headers_.begin(), ie = headers_.end(); i != ie; ++i) {
+    IndexEntry entry = { i->type(), &*i };
+    i->index_position_ = static_cast<uint16>(index_.size());
+    index_.push_back(entry);
+  }
+}
+
+scoped_refptr<SharedHeader::Source> Message::Lend(
+    const Header *header) const {
+  for (std::vector<scoped_refptr<SharedHeader::Source> >::const_iterator
+       i = lent_headers_.begin(), ie = lent_headers_.end(); i != ie; ++i) {
+    if ((*i)->header() == header)
+      return *i;
+  }
+  scoped_refptr<SharedHeader::Source> source(
+      new SharedHeader::Source(header));
+  lent_headers_.push_back(source);
+  return source;
+}
+
+void Message::ShareAllFrom(const Message &other) {
+  for (const_iterator i = other.begin(), ie = other.end(); i != ie; ++i)
+    PushShared(other.Lend(&*i));
+  set_content(other.shared_content());
+  print_style_ = other.print_style_;
+  static_headers_ = other.static_headers_;
+  canned_headers_ = other.canned_headers_;
+  // Set last, as the changes above drop them.
+  serialized_ = other.SerializedHead();
+  wire_ = other.SerializedWire();
+}
+
+void Message::PushShared(const scoped_refptr<SharedHeader::Source> &source) {
+  push_back(scoped_ptr<Header>(new SharedHeader(source)));
+  ++lazy_headers_;
+}
+
+void Message::DetachLentHeaders() {
+  for (std::vector<scoped_refptr<SharedHeader::Source> >::iterator
+       i = lent_headers_.begin(), ie = lent_headers_.end(); i != ie; ++i) {
+    if (!(*i)->HasOneRef())
+      (*i)->Detach();
+  }
+  lent_headers_.clear();
 }
 
 }  // namespace sippet
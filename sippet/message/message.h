@@ -9,10 +9,19 @@
 #include <vector>
 #include "sippet/base/ilist.h"
 #include "sippet/base/casting.h"
+#include "sippet/base/memory_accounting.h"
+#include "sippet/base/small_vector.h"
 #include "sippet/message/header.h"
+#include "sippet/message/multipart_body.h"
+#include "sippet/message/shared_header.h"
+#include "sippet/message/static_header_block.h"
 #include "base/memory/ref_counted.h"
+#include "base/memory/ref_counted_memory.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/strings/string_piece.h"
+#include "base/strings/string_util.h"
 #include "base/gtest_prod_util.h"
+#include "base/time/time.h"
 
 namespace sippet {
 
@@ -44,6 +53,8 @@ private:
 };
 
 class raw_ostream;
+class Arena;
+class ParseProfile;
 class Request;
 class Response;
 
@@ -55,6 +66,23 @@ class Message
     Outgoing,
   };
 
+  enum ParseMode {
+    // Every header is decoded into its typed class while parsing.
+    PARSE_EAGER,
+    // Known headers are kept as raw values, and only decoded into their
+    // typed class the first time they are looked up by type (|get|,
+    // |find_first|, |find_next|...) or the header list is walked from
+    // |begin()|. Useful when only a few headers are going to be accessed,
+    // e.g. when matching retransmissions to transactions.
+    PARSE_LAZY,
+    // Same as |PARSE_LAZY|, but the message also keeps a copy of the input,
+    // and headers refer to their original bytes. Headers not handed out for
+    // writing (by non-const accessors) are printed as received, so
+    // forwarding a message mostly copies the input back out. Meant for
+    // proxies, where most headers are relayed untouched.
+    PARSE_PASSTHROUGH,
+  };
+
   typedef iplist<Header> HeaderListType;
 
   // Header iterators...
@@ -68,9 +96,49 @@ class Message
 
  private:
   bool is_request_;
-  HeaderListType headers_;
-  std::string content_;
+  // Parsed headers are allocated from here; must outlive |headers_|.
+  scoped_ptr<Arena> arena_;
+  // Lazy headers are replaced by decoded ones in place, possibly from const
+  // lookups.
+  mutable HeaderListType headers_;
+  mutable size_type lazy_headers_;
+  // Copy of the parsed input when |PARSE_PASSTHROUGH|, referred to by the
+  // |Header::raw()| of headers, or by the values of lazy headers when read
+  // by |ParseBinary|; empty otherwise.
+  std::string received_;
+  // Type of each header in |headers_|, in the same order, so that typed
+  // lookups are a linear pass over a few cache lines instead of a walk of
+  // the list. Lazy headers are indexed too. The list is kept for the
+  // iterators, which have to stay valid across insertions and removals.
+  // Each header records its own position, so that |find_next| resumes the
+  // pass without looking for it.
+  struct IndexEntry {
+    Header::Type type;
+    Header *header;
+  };
+  typedef SmallVector<IndexEntry, 16> HeaderIndex;
+  mutable HeaderIndex index_;
+  // Set when the index can't be cheaply updated (e.g. a range of headers is
+  // removed); it is then rebuilt on next lookup.
+  mutable bool index_dirty_;
+  scoped_refptr<base::RefCountedString> content_;
+  // Output of |DecodeContent|, NULL until |content| is read.
+  mutable scoped_refptr<base::RefCountedString> decoded_content_;
+  // Built from |content_| by |multipart_body|, when |multipart_split_|.
+  mutable scoped_ptr<MultipartBody> multipart_body_;
+  mutable bool multipart_split_;
   Direction direction_;
+  base::TimeTicks receive_time_;
+  Header::PrintStyle print_style_;
+  scoped_refptr<StaticHeaderBlock> static_headers_;
+  // Header lines of canned responses, printed right after the start line
+  // (see |Request::CreateCannedResponse|).
+  std::string canned_headers_;
+  // Headers of this message referred to by other messages (see |ShareTo|).
+  mutable std::vector<scoped_refptr<SharedHeader::Source> > lent_headers_;
+
+  // Written first by |SerializeBinary|; bumped whenever the format changes.
+  static const uint8 kBinaryFormatVersion = 1;
 
   DISALLOW_COPY_AND_ASSIGN(Message);
 
@@ -81,15 +149,78 @@ class Message
           Direction direction);
   virtual ~Message();
 
+  // Drops the cached serialization, and gives other messages their own
+  // copy of the headers lent to them. Must be called by all mutators.
+  void InvalidateCache() {
+    serialized_.clear();
+    wire_ = NULL;
+    decoded_content_ = NULL;
+    if (multipart_split_) {
+      multipart_body_.reset();
+      multipart_split_ = false;
+    }
+    if (!lent_headers_.empty())
+      DetachLentHeaders();
+  }
+
+  // Print the start line of the message, including its CRLF.
+  virtual void PrintStartLine(raw_ostream &os) const {}
+
+  // Makes this message refer to all headers of |other|, as |ShareTo| does,
+  // and share its content and serialized bytes. Both messages must print
+  // the same start line.
+  void ShareAllFrom(const Message &other);
+
  public:
-  // Parse a SIP message. Parsed messages have |Incoming| direction.
-  static scoped_refptr<Message> Parse(const std::string &raw_message);
+  // Parse a SIP message. Parsed messages have |Incoming| direction. The
+  // input is parsed in place, so it can point directly into a network
+  // buffer; it is not referenced after this call returns.
+  static scoped_refptr<Message> Parse(const base::StringPiece &raw_message,
+                                      ParseMode mode = PARSE_EAGER);
+
+  // Same as above, but the headers selected by |profile| are decoded right
+  // away even when |mode| defers decoding; e.g. a proxy can decode the
+  // headers it routes on while relaying the others as received.
+  static scoped_refptr<Message> Parse(const base::StringPiece &raw_message,
+                                      ParseMode mode,
+                                      const ParseProfile &profile);
+
+  // Parse a message written by |SerializeBinary|. Parsed messages have
+  // |Incoming| direction. Headers are set up from their values without
+  // being parsed; they are decoded the first time they are looked up, as
+  // with |PARSE_LAZY|. Returns NULL if |data| is truncated or malformed.
+  static scoped_refptr<Message> ParseBinary(const base::StringPiece &data);
+
+  // Messages are recycled by |MessagePool|, when enabled.
+  static void *operator new(size_t size);
+  static void operator delete(void *p, size_t size);
 
   // Returns the message direction.
   Direction direction() const {
     return direction_;
   }
 
+  // When an incoming message was received: stamped by the kernel, where
+  // the transport asks for it (see |SocketOptions::receive_timestamps|),
+  // or else when its reader got it from the socket. Null for messages
+  // that weren't received.
+  const base::TimeTicks &receive_time() const { return receive_time_; }
+  void set_receive_time(const base::TimeTicks &receive_time) {
+    receive_time_ = receive_time;
+  }
+
+  // How headers are printed by |print| and the serialization methods.
+  // Defaults to |Header::PRINT_COMPACT|. Headers kept as received (see
+  // |PARSE_PASSTHROUGH|) are not affected.
+  Header::PrintStyle print_style() const { return print_style_; }
+  void set_print_style(Header::PrintStyle print_style) {
+    if (print_style_ == print_style)
+      return;
+    print_style_ = print_style;
+    serialized_.clear();
+    wire_ = NULL;
+  }
+
   // Returns true if the current message is a request.
   bool IsRequest() const { return is_request_; }
 
@@ -99,68 +230,104 @@ class Message
   //===--------------------------------------------------------------------===//
   // Header iterator methods
   //
-  iterator       begin()       { return headers_.begin(); }
-  const_iterator begin() const { return headers_.begin(); }
+  // Non-const accessors give way to header changes, so they drop the
+  // cached serialization of the message (see |ToString|), and the original
+  // bytes of the headers they hand out (see |PARSE_PASSTHROUGH|).
+  iterator       begin()       {
+    InvalidateCache(); DecodeAll(); DropAllRaw(); return headers_.begin();
+  }
+  const_iterator begin() const { DecodeAll(); return headers_.begin(); }
   iterator       end  ()       { return headers_.end();   }
   const_iterator end  () const { return headers_.end();   }
 
-  reverse_iterator       rbegin()       { return headers_.rbegin(); }
-  const_reverse_iterator rbegin() const { return headers_.rbegin(); }
+  reverse_iterator       rbegin()       {
+    InvalidateCache(); DecodeAll(); DropAllRaw(); return headers_.rbegin();
+  }
+  const_reverse_iterator rbegin() const {
+    DecodeAll(); return headers_.rbegin();
+  }
   reverse_iterator       rend  ()       { return headers_.rend();   }
   const_reverse_iterator rend  () const { return headers_.rend();   }
 
   size_type      size() const { return headers_.size();  }
   bool          empty() const { return headers_.empty(); }
 
-  reference       front()       { return headers_.front(); }
-  const_reference front() const { return headers_.front(); }
-  reference       back()        { return headers_.back();  }
-  const_reference back() const  { return headers_.back();  }
+  reference       front()       {
+    InvalidateCache(); DecodeAll(); return *DropRaw(headers_.begin());
+  }
+  const_reference front() const { DecodeAll(); return headers_.front(); }
+  reference       back()        {
+    InvalidateCache(); DecodeAll(); return *DropRaw(--headers_.end());
+  }
+  const_reference back() const  { DecodeAll(); return headers_.back();  }
 
   // Insert a header before a specific position in the message.
   iterator insert(iterator where, scoped_ptr<Header> header) {
-    return header ? headers_.insert(where, header.release()) : where;
+    InvalidateCache();
+    if (!header)
+      return where;
+    iterator i = headers_.insert(where, header.release());
+    IndexInserted(i);
+    return i;
   }
 
   // Insert a header after a specific position in the message.
   iterator insertAfter(iterator where, scoped_ptr<Header> header) {
-    return header ? headers_.insertAfter(where, header.release()) : where;
+    InvalidateCache();
+    if (!header)
+      return where;
+    iterator i = headers_.insertAfter(where, header.release());
+    IndexInserted(i);
+    return i;
   }
 
   // Insert a header to the beginning of the message.
   void push_front(scoped_ptr<Header> header) {
+    InvalidateCache();
     if (header)
-      headers_.push_front(header.release());
+      IndexInserted(headers_.insert(headers_.begin(), header.release()));
   }
 
   // Insert a header to the end of the message.
   void push_back(scoped_ptr<Header> header) {
+    InvalidateCache();
     if (header)
-      headers_.push_back(header.release());
+      IndexInserted(headers_.insert(headers_.end(), header.release()));
   }
  
   // Remove an existing header and return an iterator to the next header.
   iterator erase(iterator position) {
+    InvalidateCache();
+    IndexErasing(position);
     return headers_.erase(position);
   }
 
   // Remove all headers in the given interval.
   void erase(iterator first, iterator last) {
+    InvalidateCache();
+    index_dirty_ = true;
     headers_.erase(first, last);
   }
 
   // Clear all headers.
   void clear() {
+    InvalidateCache();
     headers_.clear();
+    lazy_headers_ = 0;
+    ResetIndex();
   }
 
   // Remove the first header of the message.
   void pop_front() {
+    InvalidateCache();
+    IndexErasing(headers_.begin());
     headers_.pop_front();
   }
 
   // Remove the last header of the message.
   void pop_back() {
+    InvalidateCache();
+    IndexErasing(--headers_.end());
     headers_.pop_back();
   }
 
@@ -168,51 +335,60 @@ class Message
   // order. The set of headers will be cloned.
   template<class InIt>
   void insert(iterator where, InIt first, InIt last) {
+    InvalidateCache();
     for (; first != last; ++first)
-      headers_.insert(where, (*first)->Clone().release());
+      IndexInserted(headers_.insert(where, (*first)->Clone().release()));
   }
 
   // Erase all headers matching a given predicate.
   template<class Pr1> void erase_if(Pr1 pred) {
+    InvalidateCache();
+    DecodeAll();
+    index_dirty_ = true;
     headers_.erase_if(pred);
   }
 
-  // Find first header of given type.
+  // Find first header of given type. Use the typed index, so only the types
+  // of the headers are scanned.
   template<class HeaderType>
   iterator find_first() {
-    return std::find_if(headers_.begin(), headers_.end(),
-      equals<HeaderType>());
+    InvalidateCache();
+    return DropRaw(FindFirstDecoded(HeaderTraits<HeaderType>::type));
   }
   template<class HeaderType>
   const_iterator find_first() const {
-    return std::find_if(headers_.begin(), headers_.end(),
-      equals<HeaderType>());
+    return FindFirstDecoded(HeaderTraits<HeaderType>::type);
   }
   template<class HeaderType>
   reverse_iterator rfind_first() {
-    return std::find_if(headers_.rbegin(), headers_.rend(),
-      equals<HeaderType>());
+    InvalidateCache();
+    iterator last = FindLastDecoded(HeaderTraits<HeaderType>::type);
+    if (last != headers_.begin()) {
+      iterator found(last);
+      DropRaw(--found);
+    }
+    return reverse_iterator(last);
   }
   template<class HeaderType>
   const_reverse_iterator rfind_first() const {
-    return std::find_if(headers_.rbegin(), headers_.rend(),
-      equals<HeaderType>());
+    return const_reverse_iterator(
+        FindLastDecoded(HeaderTraits<HeaderType>::type));
   }
 
   // Find next header of given type.
   template<class HeaderType>
   iterator find_next(iterator where) {
+    InvalidateCache();
     if (where == end())
       return where;
-    return std::find_if(++where, headers_.end(),
-      equals<HeaderType>());
+    return DropRaw(FindNextDecoded<HeaderType>(where));
   }
   template<class HeaderType>
   const_iterator find_next(const_iterator where) const {
     if (where == end())
       return where;
-    return std::find_if(++where, headers_.end(),
-      equals<HeaderType>());
+    return FindNextDecoded<HeaderType>(
+        iterator(const_cast<Header*>(&*where)));
   }
 
   // Get a specific header.
@@ -221,31 +397,107 @@ class Message
     iterator it = find_first<HeaderType>();
     return it != end() ? dyn_cast<HeaderType>(it) : 0;
   }
+  // Headers shared with other messages are not copied here.
   template<class HeaderType>
   const HeaderType *get() const {
-    const_iterator it = find_first<HeaderType>();
-    return it != end() ? dyn_cast<HeaderType>(it) : 0;
+    const Header *header = FindFirstShared(HeaderTraits<HeaderType>::type);
+    return header ? dyn_cast<HeaderType>(header) : 0;
   }
 
   // Print this message to the output.
   virtual void print(raw_ostream &os) const;
 
+  // Print the start line and the headers of this message, up to and
+  // including the empty line that precedes the content.
+  void PrintHead(raw_ostream &os) const;
+
   // Print the message on a string.
   std::string ToString() const;
 
+  // Appends a compact binary form of the message to |output|, for handing
+  // it over to another process or node: header types are written as bytes,
+  // followed by their printed values, and the content as a length-prefixed
+  // blob. Reading it back with |ParseBinary| doesn't scan for line ends or
+  // header names, and headers not looked up are never parsed. The format is
+  // only meant to be read by the same revision of sippet.
+  void SerializeBinary(std::string *output) const;
+
+  // Returns the output of |PrintHead|. The result is cached until the
+  // message is changed, or a non-const header accessor is called, so
+  // messages sent repeatedly (e.g. retransmissions) are only formatted once.
+  // Header pointers obtained before this call must not be used to change
+  // the message afterwards.
+  const std::string &SerializedHead() const;
+
+  // Returns the whole message as sent on the wire, the head followed by the
+  // content, cached like |SerializedHead|. Transports write it without any
+  // copy, so retransmissions reuse the bytes of the first send.
+  const scoped_refptr<base::RefCountedString> &SerializedWire() const;
+
   // Set the message content.
   void set_content(const std::string &content) {
+    std::string copy(content);
+    set_content(base::RefCountedString::TakeString(&copy));
+  }
+
+  // Set the message content, sharing the given buffer.
+  void set_content(const scoped_refptr<base::RefCountedString> &content) {
+    InvalidateCache();
+    MemoryAccounting::Add(MemoryAccounting::MESSAGES,
+        static_cast<int64>(content.get() ? content->size() : 0)
+        - static_cast<int64>(content_.get() ? content_->size() : 0));
     content_ = content;
   }
 
-  // Get the message content.
-  const std::string &content() const {
+  // Get the message content. A content with a gzip or deflate
+  // Content-Encoding is decoded the first time it's read, and kept until the
+  // message changes; it's left as is if it can't be decoded.
+  const std::string &content() const;
+
+  // Get the message content as sent or received, e.g. still compressed.
+  const std::string &encoded_content() const {
+    return content_.get() ? content_->data() : base::EmptyString();
+  }
+
+  // Get the message content buffer, NULL if none, as sent or received (see
+  // |encoded_content|). It can be shared with other messages or pending
+  // writes, so it must never be changed; use |set_content| instead.
+  const scoped_refptr<base::RefCountedString> &shared_content() const {
     return content_;
   }
 
   // Check if the message has contents.
   bool has_content() const {
-    return !content_.empty();
+    return content_.get() && !content_->data().empty();
+  }
+
+  // The parts of a multipart content, split the first time they're asked
+  // for, and kept until the message changes. NULL unless the Content-Type
+  // is multipart, with a boundary the content is made of.
+  const MultipartBody *multipart_body() const;
+
+  // Finds the content of |media_type|, such as "application/sdp": the whole
+  // content, or else its first part of that type. Returns false if none.
+  bool FindContent(const base::StringPiece &media_type,
+                   base::StringPiece *content) const;
+
+  // Checks that a text content, e.g. text/plain of a MESSAGE, is well-formed
+  // UTF-8, its default charset in SIP (RFC 3261 section 7.4.1). Other
+  // contents, and those of another charset, aren't checked. Meant for the
+  // applications showing the text, which would otherwise check it again.
+  bool HasValidTextContent() const;
+
+  // Constant headers printed after the others, in the print style of the
+  // message. They aren't headers of the message: they aren't found by the
+  // lookup methods, nor written by |SerializeBinary|, and those of a type
+  // the message already has (but generic ones) are left out when printing.
+  const scoped_refptr<StaticHeaderBlock> &static_headers() const {
+    return static_headers_;
+  }
+  void set_static_headers(const scoped_refptr<StaticHeaderBlock> &block) {
+    static_headers_ = block;
+    serialized_.clear();
+    wire_ = NULL;
   }
 
   // Filter the given headers.
@@ -261,17 +513,41 @@ class Message
 
   // Clone all headers of a given type to another message.
   template<class HeaderType>
-  void CloneTo(Message *message) {
-    for (Message::iterator i = find_first<HeaderType>(),
+  void CloneTo(Message *message) const {
+    for (Message::const_iterator i = find_first<HeaderType>(),
          ie = end(); i != ie; i = find_next<HeaderType>(i)) {
       message->push_back(i->Clone().Pass());
     }
   }
 
+  // Same as |CloneTo|, but |message| only refers to the headers of this
+  // one, until either message changes them: headers are copied when looked
+  // up for writing in |message|, or before any change to this message.
+  // Const lookups of |message| refer to the original headers. Header
+  // pointers obtained before this call must not be used to change the
+  // message afterwards.
+  template<class HeaderType>
+  void ShareTo(Message *message) const {
+    for (Message::const_iterator i = find_first<HeaderType>(),
+         ie = end(); i != ie; i = find_next<HeaderType>(i)) {
+      message->PushShared(Lend(&*i));
+    }
+  }
+
+  // Same as |ShareTo|, for all headers satisfying a given predicate, in
+  // order.
+  template<class Pr1>
+  void ShareIf(Message *message, Pr1 pred) const {
+    for (Message::const_iterator i = begin(), ie = end(); i != ie; ++i) {
+      if (pred(*i))
+        message->PushShared(Lend(&*i));
+    }
+  }
+
   // Clone the first matching header, if exists.
   template<class HeaderType>
-  scoped_ptr<HeaderType> Clone() {
-    Message::iterator i = find_first<HeaderType>();
+  scoped_ptr<HeaderType> Clone() const {
+    Message::const_iterator i = find_first<HeaderType>();
     if (i == end())
       return scoped_ptr<HeaderType>();
     Header *clone = i->Clone().release();
@@ -282,20 +558,104 @@ class Message
   virtual std::string GetDialogId() const = 0;
 
  private:
+  friend class Request;
+  friend class RequestTemplate;
   friend class AuthControllerTest;
   FRIEND_TEST_ALL_PREFIXES(AuthControllerTest, NoExplicitCredentialsAllowed);
   FRIEND_TEST_ALL_PREFIXES(NetworkLayerTest, OutgoingRequest);
 
+  // Returns the first header of given type, decoding it first if still
+  // lazy. Lazy headers that fail to decode are dropped, as done when parsing
+  // eagerly.
+  iterator FindFirstDecoded(Header::Type type) const;
+
+  // Same as above, but returns the position following the last header of
+  // given type, or |begin()| if there's none, as expected when creating a
+  // reverse iterator.
+  iterator FindLastDecoded(Header::Type type) const;
+
+  // Same as |FindFirstDecoded|, but returns the original header of shared
+  // ones, or NULL if none.
+  const Header *FindFirstShared(Header::Type type) const;
+
+  // Returns the header of given type following |where|, decoding it first
+  // if still lazy.
   template<class HeaderType>
-  struct equals : public std::unary_function<const Header &, bool> {
-    bool operator()(const Header &header) {
-      return isa<HeaderType>(header);
-    }
-  };
+  iterator FindNextDecoded(iterator where) const {
+    return FindNextDecoded(HeaderTraits<HeaderType>::type, where);
+  }
+  iterator FindNextDecoded(Header::Type type, iterator where) const;
+
+  // Returns the first header of given type at |position| of the index or
+  // after it, decoding it first if still lazy.
+  iterator FindIndexed(Header::Type type, size_t position) const;
+
+  // Whether there's a header of given type, lazy ones included, without
+  // decoding them.
+  bool HasIndexed(Header::Type type) const;
+
+  // Returns the position of |header| in the index, as recorded in the
+  // header itself.
+  size_t IndexOf(const Header *header) const;
+
+  // Records their position in the headers indexed from |position| on.
+  void RenumberIndex(size_t position) const;
+
+  // Decodes the lazy header at |where| in place. On success, |where| is
+  // updated to point to the decoded header; otherwise the header is removed
+  // and |where| points to the next one.
+  bool Decode(iterator *where) const;
+
+  // Drops the original bytes of the header at |where|, if any, as it's
+  // going to be written. Returns |where|.
+  iterator DropRaw(iterator where) {
+    if (where != headers_.end())
+      where->raw_.clear();
+    return where;
+  }
+  void DropAllRaw() {
+    if (!received_.empty())
+      DropAllRawSlow();
+  }
+  void DropAllRawSlow();
+
+  // Decodes all remaining lazy headers.
+  void DecodeAll() const {
+    if (lazy_headers_ > 0)
+      DecodeAllSlow();
+  }
+  void DecodeAllSlow() const;
+
+  // The content after undoing its codings, or |content_| itself if it has
+  // none or can't be decoded.
+  scoped_refptr<base::RefCountedString> DecodeContent() const;
+
+  // Keep the typed index up to date. |IndexInserted| must be called right
+  // after a header is inserted, and |IndexErasing| right before a header is
+  // removed.
+  void IndexInserted(iterator position) const;
+  void IndexErasing(iterator position) const;
+  void IndexReplaced(const Header *old_header, Header *new_header) const;
+  void ResetIndex() const;
+  void EnsureIndex() const {
+    if (index_dirty_)
+      RebuildIndex();
+  }
+  void RebuildIndex() const;
+
+  // Returns a handle to |header| for other messages to share it.
+  scoped_refptr<SharedHeader::Source> Lend(const Header *header) const;
+  void PushShared(const scoped_refptr<SharedHeader::Source> &source);
+  void DetachLentHeaders();
 
   void set_direction(Direction direction) {
     direction_ = direction;
   }
+
+  // Cached output of |SerializedHead|, empty when invalid.
+  mutable std::string serialized_;
+  // Cached output of |SerializedWire|, NULL when invalid.
+  mutable scoped_refptr<base::RefCountedString> wire_;
 };
 
 // isa - Provide some specializations of isa so that we don't have to include
@@ -0,0 +1,113 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string>
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/path_service.h"
+#include "sippet/message/message.h"
+#include "sippet/test/perf/perf_test_util.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+// Number of times each operation is repeated per corpus entry.
+const int kIterations = 20000;
+
+const char *kCorpus[] = {
+  "register_challenge.sip",
+  "register_unauthorized.sip",
+  "invite_record_routes.sip",
+  "ok_many_contacts.sip",
+};
+
+std::string LoadCorpusEntry(const char *name) {
+  base::FilePath path;
+  PathService::Get(base::DIR_SOURCE_ROOT, &path);
+  path = path.AppendASCII("sippet").AppendASCII("test").AppendASCII("data")
+             .AppendASCII("perf").AppendASCII(name);
+  std::string contents;
+  EXPECT_TRUE(base::ReadFileToString(path, &contents)) << path.value();
+  return contents;
+}
+
+// Returns the header lines of |raw_message|, without the start line.
+std::vector<std::string> SplitHeaders(const std::string &raw_message) {
+  std::vector<std::string> lines;
+  size_t end = raw_message.find("\r\n\r\n");
+  size_t start = raw_message.find("\r\n") + 2;
+  while (start < end) {
+    size_t next = raw_message.find("\r\n", start);
+    lines.push_back(raw_message.substr(start, next - start));
+    start = next + 2;
+  }
+  return lines;
+}
+
+std::string TraceName(const char *file_name) {
+  std::string trace(file_name);
+  return trace.substr(0, trace.rfind('.'));
+}
+
+}  // namespace
+
+TEST(MessagePerfTest, Parse) {
+  for (size_t i = 0; i < arraysize(kCorpus); ++i) {
+    std::string raw_message(LoadCorpusEntry(kCorpus[i]));
+    ASSERT_TRUE(Message::Parse(raw_message).get()) << kCorpus[i];
+
+    PerfMeasurement lazy("message_parse_lazy", TraceName(kCorpus[i]),
+                         kIterations);
+    for (int j = 0; j < kIterations; ++j)
+      Message::Parse(raw_message, Message::PARSE_LAZY);
+    lazy.Done("message");
+
+    PerfMeasurement eager("message_parse", TraceName(kCorpus[i]),
+                          kIterations);
+    for (int j = 0; j < kIterations; ++j)
+      Message::Parse(raw_message);
+    eager.Done("message");
+  }
+}
+
+TEST(MessagePerfTest, HeaderParse) {
+  for (size_t i = 0; i < arraysize(kCorpus); ++i) {
+    std::vector<std::string> headers(
+        SplitHeaders(LoadCorpusEntry(kCorpus[i])));
+    ASSERT_FALSE(headers.empty()) << kCorpus[i];
+
+    int iterations = kIterations / static_cast<int>(headers.size()) + 1;
+    PerfMeasurement measurement("header_parse", TraceName(kCorpus[i]),
+        iterations * static_cast<int>(headers.size()));
+    for (int j = 0; j < iterations; ++j) {
+      for (size_t k = 0; k < headers.size(); ++k)
+        Header::Parse(headers[k]);
+    }
+    measurement.Done("header");
+  }
+}
+
+TEST(MessagePerfTest, ToString) {
+  for (size_t i = 0; i < arraysize(kCorpus); ++i) {
+    scoped_refptr<Message> message(
+        Message::Parse(LoadCorpusEntry(kCorpus[i])));
+    ASSERT_TRUE(message.get()) << kCorpus[i];
+
+    // Mutating the message drops its cached serialization, so this measures
+    // printing the headers rather than copying the cache.
+    PerfMeasurement measurement("message_to_string", TraceName(kCorpus[i]),
+                                kIterations);
+    for (int j = 0; j < kIterations; ++j) {
+      message->begin();
+      message->ToString();
+    }
+    measurement.Done("message");
+  }
+}
+
+}  // namespace sippet
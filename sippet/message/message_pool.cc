@@ -0,0 +1,154 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/message/message_pool.h"
+
+#include <vector>
+
+#include "base/atomicops.h"
+#include "base/lazy_instance.h"
+#include "base/stl_util.h"
+#include "base/threading/thread_local_storage.h"
+#include "sippet/base/arena.h"
+
+namespace sippet {
+
+namespace {
+
+// Messages come in a couple of sizes only (|Request| and |Response|).
+const size_t kMaxSizeClasses = 4;
+
+base::subtle::Atomic32 g_enabled = 0;
+
+class ThreadPool {
+ public:
+  ThreadPool() {
+    for (size_t i = 0; i < kMaxSizeClasses; ++i)
+      sizes_[i] = 0;
+  }
+
+  ~ThreadPool() {
+    for (size_t i = 0; i < kMaxSizeClasses; ++i) {
+      for (size_t j = 0; j < blocks_[i].size(); ++j)
+        ::operator delete(blocks_[i][j]);
+    }
+    STLDeleteElements(&arenas_);
+  }
+
+  void *Allocate(size_t size) {
+    std::vector<void*> *blocks = BlocksOf(size, false);
+    if (!blocks || blocks->empty())
+      return NULL;
+    void *p = blocks->back();
+    blocks->pop_back();
+    return p;
+  }
+
+  bool Free(void *p, size_t size) {
+    std::vector<void*> *blocks = BlocksOf(size, true);
+    if (!blocks || blocks->size() >= MessagePool::kMaxPooledBlocks)
+      return false;
+    blocks->push_back(p);
+    return true;
+  }
+
+  Arena *TakeArena() {
+    if (arenas_.empty())
+      return NULL;
+    Arena *arena = arenas_.back();
+    arenas_.pop_back();
+    return arena;
+  }
+
+  bool ReleaseArena(Arena *arena) {
+    if (arenas_.size() >= MessagePool::kMaxPooledBlocks)
+      return false;
+    arena->Reset();
+    arenas_.push_back(arena);
+    return true;
+  }
+
+  static void Destroy(void *pool) {
+    delete static_cast<ThreadPool*>(pool);
+  }
+
+ private:
+  std::vector<void*> *BlocksOf(size_t size, bool create) {
+    for (size_t i = 0; i < kMaxSizeClasses; ++i) {
+      if (sizes_[i] == size)
+        return &blocks_[i];
+      if (sizes_[i] == 0) {
+        if (!create)
+          return NULL;
+        sizes_[i] = size;
+        return &blocks_[i];
+      }
+    }
+    return NULL;
+  }
+
+  size_t sizes_[kMaxSizeClasses];
+  std::vector<void*> blocks_[kMaxSizeClasses];
+  std::vector<Arena*> arenas_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+};
+
+struct PoolSlot {
+  PoolSlot() : slot(&ThreadPool::Destroy) {}
+  base::ThreadLocalStorage::Slot slot;
+};
+
+base::LazyInstance<PoolSlot>::Leaky g_pool_slot = LAZY_INSTANCE_INITIALIZER;
+
+ThreadPool *CurrentPool() {
+  base::ThreadLocalStorage::Slot &slot = g_pool_slot.Get().slot;
+  ThreadPool *pool = static_cast<ThreadPool*>(slot.Get());
+  if (!pool) {
+    pool = new ThreadPool;
+    slot.Set(pool);
+  }
+  return pool;
+}
+
+}  // namespace
+
+void MessagePool::SetEnabled(bool enabled) {
+  base::subtle::NoBarrier_Store(&g_enabled, enabled ? 1 : 0);
+}
+
+bool MessagePool::IsEnabled() {
+  return base::subtle::NoBarrier_Load(&g_enabled) != 0;
+}
+
+void *MessagePool::Allocate(size_t size) {
+  if (IsEnabled()) {
+    if (void *p = CurrentPool()->Allocate(size))
+      return p;
+  }
+  return ::operator new(size);
+}
+
+void MessagePool::Free(void *p, size_t size) {
+  if (!p)
+    return;
+  if (IsEnabled() && CurrentPool()->Free(p, size))
+    return;
+  ::operator delete(p);
+}
+
+scoped_ptr<Arena> MessagePool::TakeArena() {
+  if (IsEnabled()) {
+    if (Arena *arena = CurrentPool()->TakeArena())
+      return scoped_ptr<Arena>(arena);
+  }
+  return scoped_ptr<Arena>(new Arena);
+}
+
+void MessagePool::ReleaseArena(scoped_ptr<Arena> arena) {
+  if (IsEnabled() && CurrentPool()->ReleaseArena(arena.get()))
+    ignore_result(arena.release());
+}
+
+}  // namespace sippet
@@ -0,0 +1,52 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_MESSAGE_MESSAGE_POOL_H_
+#define SIPPET_MESSAGE_MESSAGE_POOL_H_
+
+#include "base/basictypes.h"
+#include "base/memory/scoped_ptr.h"
+
+namespace sippet {
+
+class Arena;
+
+// Recycles the memory of messages once the last reference to them goes
+// away: the |Request| and |Response| objects themselves (with their header
+// list and index), and the arenas parsed headers are allocated from. Under
+// steady traffic, parsing then doesn't go through the global allocator.
+//
+// Pools are kept per thread, so they don't contend with each other; memory
+// released on a thread other than the one that allocated it just moves to
+// that thread's pool. Each pool keeps a bounded number of blocks, and is
+// freed when its thread exits.
+//
+// Pooling is disabled by default. It should be enabled before any message
+// is created, e.g. at startup.
+class MessagePool {
+ public:
+  // Maximum number of blocks of each kind kept by each thread.
+  static const size_t kMaxPooledBlocks = 64;
+
+  static void SetEnabled(bool enabled);
+  static bool IsEnabled();
+
+  // Used by |Message|'s allocation functions.
+  static void *Allocate(size_t size);
+  static void Free(void *p, size_t size);
+
+  // Returns an empty arena, a recycled one if possible.
+  static scoped_ptr<Arena> TakeArena();
+
+  // Gives back an arena from |TakeArena|. Anything allocated from it must
+  // have been destroyed.
+  static void ReleaseArena(scoped_ptr<Arena> arena);
+
+ private:
+  DISALLOW_IMPLICIT_CONSTRUCTORS(MessagePool);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_MESSAGE_MESSAGE_POOL_H_
@@ -4,8 +4,16 @@
 
 #include "sippet/message/message.h"
 
+#include <iterator>
 #include <string>
 
+#include "net/base/net_errors.h"
+#include "sippet/base/routing_token.h"
+#include "sippet/message/content_coding.h"
+#include "sippet/message/message_pool.h"
+#include "sippet/message/request_template.h"
+#include "sippet/message/static_header_block.h"
+#include "sippet/test/allocation_counter.h"
 #include "testing/gtest/include/gtest/gtest.h"
 
 using sippet::Message;
@@ -110,6 +118,20 @@ TEST(RequestTest, Basic) {
   scoped_refptr<Request> request = dyn_cast<Request>(message);
 }
 
+TEST(RequestTest, SipRequestUri) {
+  scoped_refptr<Request> request(new Request(Method::OPTIONS,
+      GURL("sip:carol@chicago.com;transport=tcp")));
+  const SipURI &uri = request->sip_request_uri();
+  ASSERT_TRUE(uri.is_valid());
+  EXPECT_EQ("chicago.com", uri.host());
+  EXPECT_EQ("tcp", uri.parameter("transport").second);
+  EXPECT_EQ(&uri, &request->sip_request_uri());
+
+  request->set_request_uri(GURL("sip:carol@192.0.2.4:5070"));
+  EXPECT_EQ("192.0.2.4", request->sip_request_uri().host());
+  EXPECT_EQ(5070, request->sip_request_uri().IntPort());
+}
+
 TEST(ResponseTest, Basic) {
   const char *raw_message = "SIP/2.0 200 OK\n\n";
   scoped_refptr<Message> message = Message::Parse(raw_message);
@@ -120,3 +142,737 @@ TEST(ResponseTest, Basic) {
 
   scoped_refptr<Response> response = dyn_cast<Response>(message);
 }
+
+TEST(ResponseTest, ReliableProvisional) {
+  scoped_refptr<Message> message =
+      Message::Parse("SIP/2.0 180 Ringing\nRequire: timer, 100REL\n\n");
+  ASSERT_TRUE(isa<Response>(message));
+  EXPECT_TRUE(dyn_cast<Response>(message)->IsReliableProvisional());
+
+  message = Message::Parse("SIP/2.0 183 Session Progress\n\n");
+  ASSERT_TRUE(isa<Response>(message));
+  EXPECT_FALSE(dyn_cast<Response>(message)->IsReliableProvisional());
+
+  message = Message::Parse("SIP/2.0 200 OK\nRequire: 100rel\n\n");
+  ASSERT_TRUE(isa<Response>(message));
+  EXPECT_FALSE(dyn_cast<Response>(message)->IsReliableProvisional());
+}
+
+TEST(RequestTest, SerializationCache) {
+  const char *raw_message =
+    "OPTIONS sip:carol@chicago.com SIP/2.0\r\n"
+    "Call-ID: a84b4c76e66710\r\n"
+    "\r\n";
+  scoped_refptr<Message> message = Message::Parse(raw_message);
+  ASSERT_TRUE(isa<Request>(message));
+  scoped_refptr<Request> request = dyn_cast<Request>(message);
+
+  std::string first = request->ToString();
+  EXPECT_EQ(first, request->ToString());
+
+  // Const lookups keep the cached output.
+  const Request *const_request = request.get();
+  EXPECT_TRUE(const_request->get<sippet::CallId>());
+  EXPECT_EQ(first, request->ToString());
+
+  request->set_method(sippet::Method::INFO);
+  std::string second = request->ToString();
+  EXPECT_NE(first, second);
+  EXPECT_EQ(0u, second.find("INFO sip:carol@chicago.com SIP/2.0\r\n"));
+
+  request->push_back(
+      scoped_ptr<Header>(new sippet::MaxForwards(70)).Pass());
+  EXPECT_NE(std::string::npos, request->ToString().find("Max-Forwards: 70"));
+
+  request->get<sippet::MaxForwards>()->set_value(69);
+  EXPECT_NE(std::string::npos, request->ToString().find("Max-Forwards: 69"));
+}
+
+TEST(RequestTest, SerializedWire) {
+  const char *raw_message =
+    "OPTIONS sip:carol@chicago.com SIP/2.0\r\n"
+    "Call-ID: a84b4c76e66710\r\n"
+    "\r\n";
+  scoped_refptr<Message> message = Message::Parse(raw_message);
+  ASSERT_TRUE(message);
+  message->set_content("hello");
+
+  scoped_refptr<base::RefCountedString> wire = message->SerializedWire();
+  ASSERT_TRUE(wire.get());
+  EXPECT_EQ(message->ToString(), wire->data());
+  // Sending again reuses the same bytes.
+  EXPECT_EQ(wire.get(), message->SerializedWire().get());
+
+  // Changes drop the cache, but not the bytes already handed out.
+  message->set_content("bye");
+  EXPECT_NE(wire.get(), message->SerializedWire().get());
+  EXPECT_EQ(message->ToString(), message->SerializedWire()->data());
+  EXPECT_EQ(std::string::npos, wire->data().find("bye"));
+}
+
+TEST(RequestTest, PrintStyles) {
+  const char *raw_message =
+    "OPTIONS sip:carol@chicago.com SIP/2.0\r\n"
+    "Call-ID: a84b4c76e66710\r\n"
+    "Max-Forwards: 70\r\n"
+    "Supported: timer, 100rel\r\n"
+    "\r\n";
+  scoped_refptr<Message> message = Message::Parse(raw_message);
+  ASSERT_TRUE(message);
+  EXPECT_EQ(Header::PRINT_COMPACT, message->print_style());
+  std::string compact = message->ToString();
+  EXPECT_NE(std::string::npos, compact.find("\r\ni: a84b4c76e66710\r\n"));
+  EXPECT_NE(std::string::npos, compact.find("\r\nk: timer, 100rel\r\n"));
+
+  message->set_print_style(Header::PRINT_LONG);
+  std::string full = message->ToString();
+  EXPECT_NE(std::string::npos, full.find("\r\nCall-ID: a84b4c76e66710\r\n"));
+  EXPECT_NE(std::string::npos, full.find("\r\nMax-Forwards: 70\r\n"));
+  EXPECT_NE(std::string::npos, full.find("\r\nContent-Length: 0\r\n"));
+
+  message->set_print_style(Header::PRINT_TIGHT);
+  std::string tight = message->SerializedWire()->data();
+  EXPECT_NE(std::string::npos, tight.find("\r\ni:a84b4c76e66710\r\n"));
+  EXPECT_NE(std::string::npos, tight.find("\r\nk:timer,100rel\r\n"));
+  EXPECT_NE(std::string::npos, tight.find("\r\nl:0\r\n"));
+  EXPECT_GT(compact.size(), tight.size());
+
+  // The style only applies to the message printed.
+  EXPECT_EQ(Header::PRINT_COMPACT, Header::print_style());
+}
+
+TEST(RequestTest, StaticHeaders) {
+  scoped_refptr<StaticHeaderBlock> block(new StaticHeaderBlock);
+  block->Add(UserAgent("Sippet/1.0"));
+  block->Add(Subject("Lunch"));
+  block->Add(Generic("X-Origin", "lab"));
+
+  const char *raw_message =
+    "OPTIONS sip:carol@chicago.com SIP/2.0\r\n"
+    "Call-ID: a84b4c76e66710\r\n"
+    "Subject: Dinner\r\n"
+    "\r\n";
+  scoped_refptr<Message> message = Message::Parse(raw_message);
+  ASSERT_TRUE(message);
+  message->set_static_headers(block);
+  // The Subject of the message is kept, and the other static headers
+  // printed after its own ones.
+  EXPECT_NE(std::string::npos, message->ToString().find(
+      "\r\ns: Dinner\r\nUser-Agent: Sippet/1.0\r\nX-Origin: lab\r\nl: 0\r\n"));
+  EXPECT_EQ(std::string::npos, message->ToString().find("Lunch"));
+  // They aren't headers of the message.
+  EXPECT_FALSE(message->get<UserAgent>());
+
+  message->set_print_style(Header::PRINT_TIGHT);
+  EXPECT_NE(std::string::npos,
+            message->ToString().find("\r\nUser-Agent:Sippet/1.0\r\n"));
+}
+
+TEST(RequestTest, BinarySerialization) {
+  const char *raw_message =
+    "MESSAGE sip:carol@chicago.com SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds\r\n"
+    "Call-ID: a84b4c76e66710\r\n"
+    "CSeq: 1 MESSAGE\r\n"
+    "X-Custom: custom value\r\n"
+    "Content-Type: text/plain\r\n"
+    "\r\n";
+  scoped_refptr<Message> message =
+      Message::Parse(raw_message, Message::PARSE_LAZY);
+  ASSERT_TRUE(message);
+  message->set_content("hello");
+  // Decoded and lazy headers are written alike.
+  ASSERT_TRUE(message->get<sippet::Via>());
+
+  std::string binary;
+  message->SerializeBinary(&binary);
+  EXPECT_GT(message->ToString().size(), binary.size());
+
+  scoped_refptr<Message> copy = Message::ParseBinary(binary);
+  ASSERT_TRUE(isa<Request>(copy));
+  EXPECT_EQ(Message::Incoming, copy->direction());
+  EXPECT_EQ(message->ToString(), copy->ToString());
+  EXPECT_EQ("hello", copy->content());
+  sippet::Cseq *cseq = copy->get<sippet::Cseq>();
+  ASSERT_TRUE(cseq);
+  EXPECT_EQ(1u, cseq->sequence());
+
+  scoped_refptr<Response> response =
+      dyn_cast<Request>(copy)->CreateResponse(486, "Busy Here");
+  binary.clear();
+  response->SerializeBinary(&binary);
+  scoped_refptr<Message> response_copy = Message::ParseBinary(binary);
+  ASSERT_TRUE(isa<Response>(response_copy));
+  EXPECT_EQ(486, dyn_cast<Response>(response_copy)->response_code());
+  EXPECT_EQ(response->ToString(), response_copy->ToString());
+
+  // Truncated input is rejected.
+  for (size_t size = 0; size < binary.size(); ++size)
+    EXPECT_FALSE(Message::ParseBinary(binary.substr(0, size)));
+}
+
+TEST(RequestTest, RoutingTags) {
+  scoped_refptr<Message> message = Message::Parse(
+      "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+      "To: Bob <sip:bob@biloxi.com>\r\n"
+      "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+      "Call-ID: a84b4c76e66710\r\n"
+      "CSeq: 314159 INVITE\r\n"
+      "\r\n");
+  ASSERT_TRUE(isa<Request>(message));
+  scoped_refptr<Request> request = dyn_cast<Request>(message);
+
+  RoutingTokenSigner signer("cluster key");
+  RoutingTagGenerator generator(&signer, RoutingToken(3, 12), false);
+  std::string tag;
+  {
+    ScopedTagGenerator scoped_generator(&generator);
+    scoped_refptr<Response> response = request->CreateResponse(180,
+                                                               "Ringing");
+    tag = response->get<To>()->tag();
+  }
+  RoutingToken token;
+  ASSERT_TRUE(generator.TokenOfTag(tag, &token));
+  EXPECT_EQ(3, token.shard);
+  EXPECT_EQ(12, token.node);
+  EXPECT_TRUE(token.timestamp.is_null());
+
+  // Tags are random again out of scope, and tokens of another key are
+  // rejected.
+  tag = request->CreateResponse(180, "Ringing")->get<To>()->tag();
+  EXPECT_FALSE(generator.TokenOfTag(tag, &token));
+  RoutingTokenSigner other_signer("other key");
+  RoutingTagGenerator other_generator(&other_signer, RoutingToken(3, 12),
+                                      true);
+  tag = other_generator.CreateTag();
+  EXPECT_FALSE(generator.TokenOfTag(tag, &token));
+  ASSERT_TRUE(other_generator.TokenOfTag(tag, &token));
+  EXPECT_FALSE(token.timestamp.is_null());
+  EXPECT_GE(base::TimeDelta::FromSeconds(1),
+            base::Time::Now() - token.timestamp);
+}
+
+TEST(RequestTest, TypedIndex) {
+  const char *raw_message =
+    "OPTIONS sip:carol@chicago.com SIP/2.0\r\n"
+    "Expires: 1\r\n"
+    "Call-ID: a84b4c76e66710\r\n"
+    "Expires: 2\r\n"
+    "\r\n";
+  scoped_refptr<Message> message =
+      Message::Parse(raw_message, Message::PARSE_LAZY);
+  ASSERT_TRUE(message);
+
+  EXPECT_EQ(1u, message->get<sippet::Expires>()->value());
+  EXPECT_EQ(2u, dyn_cast<sippet::Expires>(
+      &*message->rfind_first<sippet::Expires>())->value());
+  EXPECT_FALSE(message->get<sippet::MaxForwards>());
+  EXPECT_TRUE(message->rfind_first<sippet::MaxForwards>() == message->rend());
+
+  message->push_front(scoped_ptr<Header>(new sippet::Expires(0)));
+  EXPECT_EQ(0u, message->get<sippet::Expires>()->value());
+
+  // Inserted between two headers of the same type.
+  Message::iterator call_id = message->find_first<sippet::CallId>();
+  ASSERT_TRUE(call_id != message->end());
+  message->insert(call_id, scoped_ptr<Header>(new sippet::Expires(5)));
+
+  std::vector<sippet::Expires*> expires = message->filter<sippet::Expires>();
+  ASSERT_EQ(4u, expires.size());
+  EXPECT_EQ(0u, expires[0]->value());
+  EXPECT_EQ(1u, expires[1]->value());
+  EXPECT_EQ(5u, expires[2]->value());
+  EXPECT_EQ(2u, expires[3]->value());
+
+  message->erase(message->find_first<sippet::Expires>());
+  EXPECT_EQ(1u, message->get<sippet::Expires>()->value());
+
+  message->erase(--message->rfind_first<sippet::Expires>().base());
+  EXPECT_EQ(5u, dyn_cast<sippet::Expires>(
+      &*message->rfind_first<sippet::Expires>())->value());
+
+  message->push_back(scoped_ptr<Header>(new sippet::MaxForwards(70)));
+  EXPECT_EQ(70u, message->get<sippet::MaxForwards>()->value());
+  message->pop_back();
+  EXPECT_FALSE(message->get<sippet::MaxForwards>());
+
+  message->clear();
+  EXPECT_FALSE(message->get<sippet::Expires>());
+  EXPECT_FALSE(message->get<sippet::CallId>());
+}
+
+TEST(RequestTest, TypedIndexKeepsPositions) {
+  scoped_refptr<Message> message = Message::Parse(
+      "OPTIONS sip:carol@chicago.com SIP/2.0\r\n"
+      "Call-ID: a84b4c76e66710\r\n"
+      "\r\n");
+  ASSERT_TRUE(message);
+  for (unsigned i = 1; i <= 20; ++i) {
+    message->push_back(scoped_ptr<Header>(new sippet::Expires(i)));
+    message->push_back(scoped_ptr<Header>(new sippet::MaxForwards(i)));
+  }
+
+  // Headers inserted or removed in the middle move the following ones.
+  Message::iterator max_forwards = message->find_first<sippet::MaxForwards>();
+  ASSERT_TRUE(max_forwards != message->end());
+  message->insert(max_forwards, scoped_ptr<Header>(new sippet::Expires(0)));
+  Message::iterator tenth = message->find_first<sippet::Expires>();
+  for (int i = 0; i < 10; ++i)
+    tenth = message->find_next<sippet::Expires>(tenth);
+  ASSERT_TRUE(tenth != message->end());
+  EXPECT_EQ(10u, dyn_cast<sippet::Expires>(&*tenth)->value());
+  message->erase(tenth);
+
+  std::vector<sippet::Expires*> expires = message->filter<sippet::Expires>();
+  ASSERT_EQ(20u, expires.size());
+  EXPECT_EQ(1u, expires[0]->value());
+  EXPECT_EQ(0u, expires[1]->value());
+  EXPECT_EQ(9u, expires[9]->value());
+  EXPECT_EQ(11u, expires[10]->value());
+  EXPECT_EQ(20u, expires[19]->value());
+  EXPECT_EQ(20u, message->filter<sippet::MaxForwards>().size());
+}
+
+TEST(RequestTest, TypedIndexDropsInvalidHeaders) {
+  const char *raw_message =
+    "OPTIONS sip:carol@chicago.com SIP/2.0\r\n"
+    "Expires: 1\r\n"
+    "Expires: one\r\n"
+    "Call-ID: a84b4c76e66710\r\n"
+    "Expires: two\r\n"
+    "Expires: 2\r\n"
+    "\r\n";
+  scoped_refptr<Message> message =
+      Message::Parse(raw_message, Message::PARSE_LAZY);
+  ASSERT_TRUE(message);
+  EXPECT_EQ(5u, message->size());
+
+  const Message *const_message = message.get();
+  Message::const_iterator i = const_message->find_first<sippet::Expires>();
+  ASSERT_TRUE(i != const_message->end());
+  EXPECT_EQ(1u, dyn_cast<sippet::Expires>(&*i)->value());
+  i = const_message->find_next<sippet::Expires>(i);
+  ASSERT_TRUE(i != const_message->end());
+  EXPECT_EQ(2u, dyn_cast<sippet::Expires>(&*i)->value());
+  EXPECT_TRUE(const_message->find_next<sippet::Expires>(i)
+              == const_message->end());
+  EXPECT_EQ(3u, message->size());
+  EXPECT_TRUE(const_message->get<sippet::CallId>());
+}
+
+TEST(RequestTest, CannedResponses) {
+  const char *raw_message =
+    "OPTIONS sip:bob@biloxi.com SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds\r\n"
+    "Max-Forwards: 70\r\n"
+    "To: Bob <sip:bob@biloxi.com>\r\n"
+    "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+    "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+    "CSeq: 63104 OPTIONS\r\n"
+    "Accept: application/sdp\r\n"
+    "\r\n";
+  scoped_refptr<Message> message =
+      Message::Parse(raw_message, Message::PARSE_PASSTHROUGH);
+  ASSERT_TRUE(isa<Request>(message));
+  scoped_refptr<Request> request = dyn_cast<Request>(message);
+
+  scoped_refptr<Response> trying = request->CreateCannedResponse(SIP_TRYING);
+  ASSERT_TRUE(trying);
+  EXPECT_EQ(request.get(), trying->refer_to().get());
+  EXPECT_EQ("SIP/2.0 100 Trying\r\n"
+            "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds\r\n"
+            "To: Bob <sip:bob@biloxi.com>\r\n"
+            "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+            "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+            "CSeq: 63104 OPTIONS\r\n"
+            "l: 0\r\n"
+            "\r\n", trying->ToString());
+
+  // The 200 gets a To tag, and reads back as the response it stands for.
+  scoped_refptr<Response> ok = request->CreateCannedResponse(SIP_OK);
+  ASSERT_TRUE(ok);
+  message = Message::Parse(ok->ToString());
+  ASSERT_TRUE(isa<Response>(message));
+  const Response *parsed = dyn_cast<Response>(message);
+  EXPECT_EQ(200, parsed->response_code());
+  ASSERT_TRUE(parsed->get<sippet::To>());
+  EXPECT_TRUE(parsed->get<sippet::To>()->HasTag());
+  ASSERT_TRUE(parsed->get<sippet::Cseq>());
+  EXPECT_EQ(63104u, parsed->get<sippet::Cseq>()->sequence());
+  EXPECT_FALSE(parsed->get<sippet::MaxForwards>());
+  EXPECT_FALSE(parsed->get<sippet::Accept>());
+}
+
+TEST(RequestTest, SharedHeaders) {
+  const char *raw_message =
+    "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds\r\n"
+    "To: Bob <sip:bob@biloxi.com>\r\n"
+    "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+    "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+    "CSeq: 314159 INVITE\r\n"
+    "\r\n";
+  scoped_refptr<Message> message = Message::Parse(raw_message);
+  ASSERT_TRUE(isa<Request>(message));
+  scoped_refptr<Request> request = dyn_cast<Request>(message);
+  const Request *const_request = request.get();
+
+  scoped_refptr<Response> trying = request->CreateResponse(100, "Trying");
+  scoped_refptr<Response> ringing = request->CreateResponse(180, "Ringing");
+  const Response *const_trying = trying.get();
+  EXPECT_EQ(const_request->get<sippet::Via>(),
+            const_trying->get<sippet::Via>());
+  EXPECT_NE(std::string::npos, trying->ToString().find(
+      "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"));
+
+  // The tag of the 180 was set on its own copy of the To header.
+  EXPECT_FALSE(const_request->get<sippet::To>()->HasTag());
+  EXPECT_FALSE(const_trying->get<sippet::To>()->HasTag());
+  EXPECT_TRUE(ringing->get<sippet::To>()->HasTag());
+
+  // Changes to the request don't reach the shared headers.
+  request->get<sippet::From>()->set_tag("changed");
+  EXPECT_EQ("1928301774", const_trying->get<sippet::From>()->tag());
+
+  // Shared headers outlive the original request.
+  scoped_refptr<Request> cancel;
+  ASSERT_EQ(net::OK, request->CreateCancel(cancel));
+  message = NULL;
+  request = NULL;
+  trying = NULL;
+  ringing = NULL;
+  const Request *const_cancel = cancel.get();
+  EXPECT_EQ("changed", const_cancel->get<sippet::From>()->tag());
+  EXPECT_EQ("a84b4c76e66710@pc33.atlanta.com",
+            const_cancel->get<sippet::CallId>()->value());
+  EXPECT_EQ(314159u, const_cancel->get<sippet::Cseq>()->sequence());
+  EXPECT_TRUE(sippet::Method::CANCEL == cancel->get<sippet::Cseq>()->method());
+}
+
+TEST(RequestTest, CancelHasTopmostVia) {
+  const char *raw_message =
+    "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP bigbox3.site3.atlanta.com;branch=z9hG4bK77ef4c2312983.1,"
+    " SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds\r\n"
+    "Via: SIP/2.0/UDP 192.0.2.1;branch=z9hG4bKnashds8\r\n"
+    "To: Bob <sip:bob@biloxi.com>\r\n"
+    "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+    "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+    "CSeq: 314159 INVITE\r\n"
+    "\r\n";
+  scoped_refptr<Message> message = Message::Parse(raw_message);
+  ASSERT_TRUE(isa<Request>(message));
+  scoped_refptr<Request> request = dyn_cast<Request>(message);
+
+  scoped_refptr<Request> cancel;
+  ASSERT_EQ(net::OK, request->CreateCancel(cancel));
+  const Request *const_cancel = cancel.get();
+  const sippet::Via *via = const_cancel->get<sippet::Via>();
+  ASSERT_TRUE(via);
+  ASSERT_EQ(1u, via->size());
+  EXPECT_EQ("z9hG4bK77ef4c2312983.1", via->front().branch());
+  EXPECT_EQ(const_cancel->end(),
+            const_cancel->find_next<sippet::Via>(
+                const_cancel->find_first<sippet::Via>()));
+}
+
+bool IsNotVia(const Header &header) {
+  return Header::HDR_VIA != header.type();
+}
+
+TEST(RequestTest, ShareIf) {
+  const char *raw_message =
+    "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds\r\n"
+    "To: Bob <sip:bob@biloxi.com>\r\n"
+    "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+    "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+    "CSeq: 314159 INVITE\r\n"
+    "\r\n";
+  scoped_refptr<Message> message = Message::Parse(raw_message);
+  ASSERT_TRUE(message);
+  const Message *const_message = message.get();
+
+  scoped_refptr<Request> fork(
+      new Request(sippet::Method::INVITE, GURL("sip:bob@192.0.2.4")));
+  const_message->ShareIf(fork.get(), IsNotVia);
+  const Request *const_fork = fork.get();
+  EXPECT_FALSE(const_fork->get<sippet::Via>());
+  EXPECT_EQ(const_message->get<sippet::From>(),
+            const_fork->get<sippet::From>());
+  EXPECT_EQ(const_message->get<sippet::Cseq>(),
+            const_fork->get<sippet::Cseq>());
+  EXPECT_EQ(4, std::distance(const_fork->begin(), const_fork->end()));
+}
+
+TEST(RequestTest, Template) {
+  const char *raw_message =
+    "REGISTER sip:registrar.biloxi.com SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP bobspc.biloxi.com:5060;branch=z9hG4bKnashds7\r\n"
+    "Max-Forwards: 70\r\n"
+    "To: Bob <sip:bob@biloxi.com>\r\n"
+    "From: Bob <sip:bob@biloxi.com>;tag=456248\r\n"
+    "Call-ID: 843817637684230@998sdasdh09\r\n"
+    "CSeq: 1826 REGISTER\r\n"
+    "Contact: <sip:bob@192.0.2.4>\r\n"
+    "X-Line: 1\r\n"
+    "Expires: 7200\r\n"
+    "\r\n";
+  scoped_refptr<Request> prototype =
+      dyn_cast<Request>(Message::Parse(raw_message));
+  ASSERT_TRUE(prototype);
+  scoped_refptr<sippet::StaticHeaderBlock> base(
+      new sippet::StaticHeaderBlock);
+  base->Add(sippet::UserAgent("Sippet/1.0"));
+  scoped_ptr<sippet::RequestTemplate> request_template(
+      new sippet::RequestTemplate(*prototype, base));
+
+  scoped_refptr<Request> request(request_template->CreateRequest(100, 3600));
+  const Request *const_request = request.get();
+  EXPECT_TRUE(sippet::Method::REGISTER == request->method());
+  EXPECT_FALSE(const_request->get<sippet::Via>());
+  EXPECT_NE("843817637684230@998sdasdh09",
+            const_request->get<sippet::CallId>()->value());
+  EXPECT_NE("456248", const_request->get<sippet::From>()->tag());
+  EXPECT_EQ(100u, const_request->get<sippet::Cseq>()->sequence());
+  EXPECT_EQ(3600u, const_request->get<sippet::Expires>()->value());
+  // Max-Forwards is preserialized, after the base headers.
+  EXPECT_FALSE(const_request->get<sippet::MaxForwards>());
+  EXPECT_NE(std::string::npos, request->ToString().find(
+      "\r\nUser-Agent: Sippet/1.0\r\nMax-Forwards: 70\r\n"));
+  EXPECT_NE(std::string::npos, request->ToString().find("\r\nX-Line: 1\r\n"));
+
+  // The To and Contact are shared, until written.
+  scoped_refptr<Request> next(
+      request_template->CreateNextRequest(*request, -1));
+  const Request *const_next = next.get();
+  EXPECT_EQ(const_request->get<sippet::Contact>(),
+            const_next->get<sippet::Contact>());
+  next->get<sippet::Contact>()->front().set_address(
+      GURL("sip:bob@192.0.2.5"));
+  EXPECT_EQ(GURL("sip:bob@192.0.2.4"),
+            const_request->get<sippet::Contact>()->front().address());
+  EXPECT_EQ(const_request->get<sippet::CallId>()->value(),
+            const_next->get<sippet::CallId>()->value());
+  EXPECT_EQ(const_request->get<sippet::From>()->tag(),
+            const_next->get<sippet::From>()->tag());
+  EXPECT_EQ(101u, const_next->get<sippet::Cseq>()->sequence());
+  EXPECT_EQ(7200u, const_next->get<sippet::Expires>()->value());
+
+  // Requests outlive their template.
+  request_template.reset();
+  EXPECT_EQ(GURL("sip:bob@biloxi.com"),
+            const_next->get<sippet::To>()->address());
+}
+
+TEST(RequestTest, MultipartContent) {
+  const char *raw_message =
+    "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+    "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+    "Content-Type: multipart/mixed;boundary=\"unique-boundary-1\"\r\n"
+    "Content-Length: 227\r\n"
+    "\r\n"
+    "preamble\r\n"
+    "--unique-boundary-1\r\n"
+    "Content-Type: application/sdp\r\n"
+    "\r\n"
+    "v=0\r\n"
+    "s=-\r\n"
+    "\r\n"
+    "--unique-boundary-1  \r\n"
+    "content-type: Application/ISUP; version=itu-t92+\r\n"
+    "Content-Disposition: signal; handling=optional\r\n"
+    "\r\n"
+    "\x01\x10\x49\r\n"
+    "--unique-boundary-1--\r\n";
+  scoped_refptr<Message> message = Message::Parse(raw_message);
+  ASSERT_TRUE(message);
+  const sippet::MultipartBody *body = message->multipart_body();
+  ASSERT_TRUE(body);
+  EXPECT_EQ(body, message->multipart_body());
+  ASSERT_EQ(2u, body->parts().size());
+  EXPECT_EQ("application/sdp", body->parts()[0].content_type);
+  EXPECT_EQ("v=0\r\ns=-\r\n", body->parts()[0].body);
+  EXPECT_EQ("\x01\x10\x49", body->parts()[1].body.as_string());
+  base::StringPiece value;
+  EXPECT_TRUE(sippet::MultipartBody::GetPartHeader(
+      body->parts()[1], "content-disposition", &value));
+  EXPECT_EQ("signal; handling=optional", value);
+
+  // The parts point into the content, without copies.
+  const std::string &content = message->content();
+  EXPECT_GE(body->parts()[0].body.data(), content.data());
+  EXPECT_LT(body->parts()[0].body.data(), content.data() + content.size());
+
+  base::StringPiece isup;
+  EXPECT_TRUE(message->FindContent("application/isup", &isup));
+  EXPECT_EQ(body->parts()[1].body.data(), isup.data());
+  EXPECT_FALSE(message->FindContent("application/pidf+xml", &value));
+
+  // A new content is split again.
+  message->set_content("v=0\r\n");
+  EXPECT_FALSE(message->multipart_body());
+  message->get<sippet::ContentType>()->set_type("application");
+  message->get<sippet::ContentType>()->set_subtype("sdp");
+  EXPECT_TRUE(message->FindContent("application/sdp", &value));
+  EXPECT_EQ("v=0\r\n", value);
+}
+
+TEST(RequestTest, TextContent) {
+  scoped_refptr<Message> message = Message::Parse(
+      "MESSAGE sip:bob@biloxi.com SIP/2.0\r\n"
+      "Content-Type: text/plain\r\n"
+      "Content-Length: 8\r\n"
+      "\r\n"
+      "Ol\xc3\xa1 \xe2\x82\xac");
+  ASSERT_TRUE(message);
+  EXPECT_TRUE(message->HasValidTextContent());
+
+  message->set_content("Ol\xe1");
+  EXPECT_FALSE(message->HasValidTextContent());
+  sippet::ContentType *content_type = message->get<sippet::ContentType>();
+  content_type->param_set("charset", "\"UTF-8\"");
+  EXPECT_FALSE(message->HasValidTextContent());
+
+  // Other charsets and media types aren't checked.
+  content_type->param_set("charset", "iso-8859-1");
+  EXPECT_TRUE(message->HasValidTextContent());
+  content_type->param_clear();
+  content_type->set_type("application");
+  content_type->set_subtype("octet-stream");
+  EXPECT_TRUE(message->HasValidTextContent());
+}
+
+TEST(RequestTest, MemoryAccounting) {
+  using sippet::MemoryAccounting;
+  int64 before = MemoryAccounting::Get(MemoryAccounting::MESSAGES);
+  scoped_refptr<Message> message = Message::Parse(
+      "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+      "\r\n");
+  ASSERT_TRUE(message);
+  message->set_content(std::string(1000, 'x'));
+  EXPECT_LE(before + 1000, MemoryAccounting::Get(MemoryAccounting::MESSAGES));
+  message->set_content("v=0\r\n");
+  EXPECT_GT(before + 1000, MemoryAccounting::Get(MemoryAccounting::MESSAGES));
+  message = NULL;
+  EXPECT_EQ(before, MemoryAccounting::Get(MemoryAccounting::MESSAGES));
+
+  // The budget covers all categories.
+  EXPECT_FALSE(MemoryAccounting::IsOverBudget());
+  MemoryAccounting::SetBudget(MemoryAccounting::GetTotal() + 1);
+  EXPECT_FALSE(MemoryAccounting::IsOverBudget());
+  MemoryAccounting::Add(MemoryAccounting::DIALOGS, 1);
+  EXPECT_TRUE(MemoryAccounting::IsOverBudget());
+  MemoryAccounting::Add(MemoryAccounting::DIALOGS, -1);
+  MemoryAccounting::SetBudget(0);
+  EXPECT_FALSE(MemoryAccounting::IsOverBudget());
+}
+
+TEST(RequestTest, ContentEncoding) {
+  const std::string kSdp(
+      "v=0\r\no=- 0 0 IN IP4 192.0.2.1\r\ns=-\r\nt=0 0\r\n");
+  std::string compressed;
+  ASSERT_TRUE(sippet::EncodeContent(sippet::CONTENT_CODING_GZIP, kSdp,
+                                    &compressed));
+  scoped_refptr<Message> message = Message::Parse(
+      "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+      "Content-Encoding: gzip\r\n"
+      "\r\n");
+  ASSERT_TRUE(message);
+  message->set_content(compressed);
+  EXPECT_EQ(kSdp, message->content());
+  EXPECT_EQ(&message->content(), &message->content());
+  EXPECT_EQ(compressed, message->encoded_content());
+
+  // Deflate contents and lists of codings are decoded as well.
+  std::string deflated;
+  ASSERT_TRUE(sippet::EncodeContent(sippet::CONTENT_CODING_DEFLATE,
+                                    compressed, &deflated));
+  message->get<sippet::ContentEncoding>()->push_back(
+      sippet::ContentEncoding::value_type("deflate"));
+  message->set_content(deflated);
+  EXPECT_EQ(kSdp, message->content());
+
+  // Contents that can't be decoded are left as is.
+  message->set_content("v=0\r\n");
+  EXPECT_EQ("v=0\r\n", message->content());
+  message->get<sippet::ContentEncoding>()->front() =
+      sippet::ContentEncoding::value_type("br");
+  message->set_content(compressed);
+  EXPECT_EQ(compressed, message->content());
+
+  std::string decoded;
+  EXPECT_FALSE(sippet::DecodeContent(sippet::CONTENT_CODING_GZIP,
+                                     compressed, kSdp.size() - 1, &decoded));
+  EXPECT_FALSE(sippet::DecodeContent(sippet::CONTENT_CODING_GZIP,
+      base::StringPiece(compressed).substr(0, compressed.size() / 2),
+      sippet::kMaxDecodedContentSize, &decoded));
+}
+
+TEST(RequestTest, MessagePool) {
+  const char *raw_message =
+    "OPTIONS sip:carol@chicago.com SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bKhjhs8ass877\r\n"
+    "Call-ID: a84b4c76e66710\r\n"
+    "CSeq: 63104 OPTIONS\r\n"
+    "\r\n";
+  sippet::MessagePool::SetEnabled(true);
+
+  scoped_refptr<Message> message = Message::Parse(raw_message);
+  ASSERT_TRUE(message);
+  const Message *address = message.get();
+  message = NULL;
+
+  // The same memory is handed out again, and state is not carried over.
+  message = Message::Parse(raw_message);
+  ASSERT_TRUE(message);
+  EXPECT_EQ(address, message.get());
+  EXPECT_EQ(3, std::distance(message->begin(), message->end()));
+  EXPECT_EQ("a84b4c76e66710", message->get<sippet::CallId>()->value());
+
+  sippet::MessagePool::SetEnabled(false);
+}
+
+// Ceilings for parsing a typical REGISTER, with some headroom; lower them
+// as the parser gets leaner, so that regressions are caught.
+TEST(RequestTest, ParseAllocationBudget) {
+  const char *raw_message =
+    "REGISTER sip:registrar.biloxi.com SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP bobspc.biloxi.com:5060;branch=z9hG4bKnashds7;rport\r\n"
+    "Max-Forwards: 70\r\n"
+    "To: Bob <sip:bob@biloxi.com>\r\n"
+    "From: Bob <sip:bob@biloxi.com>;tag=456248\r\n"
+    "Call-ID: 843817637684230@998sdasdh09\r\n"
+    "CSeq: 1827 REGISTER\r\n"
+    "Contact: <sip:bob@192.0.2.4;transport=udp>;expires=7200;"
+        "+sip.instance=\"<urn:uuid:00000000-0000-1000-8000-AABBCCDDEEFF>\";"
+        "reg-id=1\r\n"
+    "Authorization: Digest username=\"bob\", realm=\"biloxi.com\", "
+        "nonce=\"dcd98b7102dd2f0e8b11d0f600bfb0c093\", "
+        "uri=\"sip:registrar.biloxi.com\", qop=auth, nc=00000001, "
+        "cnonce=\"0a4f113b\", response=\"6629fae49393a05397450978507c4ef1\", "
+        "opaque=\"5ccc069c403ebaf9f0171e9517f40e41\", algorithm=MD5\r\n"
+    "Supported: path, outbound, gruu\r\n"
+    "Allow: INVITE, ACK, CANCEL, BYE, OPTIONS, INFO, UPDATE, REFER, NOTIFY, "
+        "MESSAGE\r\n"
+    "User-Agent: Softphone Beta1.5\r\n"
+    "Expires: 7200\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n";
+  const int kLazyBudget = 40;
+  const int kEagerBudget = 160;
+
+  {
+    sippet::ScopedAllocationCounter counter;
+    scoped_refptr<Message> message =
+        Message::Parse(raw_message, Message::PARSE_LAZY);
+    ASSERT_TRUE(message);
+    EXPECT_GE(kLazyBudget, counter.allocations());
+  }
+  {
+    sippet::ScopedAllocationCounter counter;
+    scoped_refptr<Message> message = Message::Parse(raw_message);
+    ASSERT_TRUE(message);
+    EXPECT_GE(kEagerBudget, counter.allocations());
+  }
+}
@@ -0,0 +1,139 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/message/multipart_body.h"
+
+#include <string>
+
+#include "base/logging.h"
+#include "base/strings/string_util.h"
+
+namespace sippet {
+
+namespace {
+
+const char kCrlf[] = "\r\n";
+
+base::StringPiece TrimSpaces(base::StringPiece value) {
+  while (!value.empty() && (' ' == value[0] || '\t' == value[0]))
+    value.remove_prefix(1);
+  while (!value.empty() && (' ' == value[value.size() - 1]
+                            || '\t' == value[value.size() - 1]))
+    value.remove_suffix(1);
+  return value;
+}
+
+}  // namespace
+
+MultipartBody::MultipartBody(
+    const scoped_refptr<base::RefCountedString> &content)
+  : content_(content) {
+}
+
+MultipartBody::~MultipartBody() {
+}
+
+scoped_ptr<MultipartBody> MultipartBody::Parse(
+    const scoped_refptr<base::RefCountedString> &content,
+    const base::StringPiece &boundary) {
+  if (!content.get() || boundary.empty())
+    return scoped_ptr<MultipartBody>();
+  scoped_ptr<MultipartBody> body(new MultipartBody(content));
+  if (!body->Split(boundary))
+    return scoped_ptr<MultipartBody>();
+  return body.Pass();
+}
+
+const MultipartBody::Part *MultipartBody::FindPart(
+    const base::StringPiece &media_type) const {
+  for (std::vector<Part>::const_iterator i = parts_.begin(),
+       ie = parts_.end(); i != ie; ++i) {
+    if (IsMediaType(i->content_type, media_type))
+      return &*i;
+  }
+  return NULL;
+}
+
+// static
+bool MultipartBody::GetPartHeader(const Part &part,
+                                  const base::StringPiece &name,
+                                  base::StringPiece *value) {
+  base::StringPiece headers(part.headers);
+  while (!headers.empty()) {
+    size_t end = headers.find(kCrlf);
+    base::StringPiece line(headers.substr(0, end));
+    headers.remove_prefix(base::StringPiece::npos == end
+        ? headers.size() : end + 2);
+    size_t colon = line.find(':');
+    if (base::StringPiece::npos == colon
+        || !base::EqualsCaseInsensitiveASCII(
+               TrimSpaces(line.substr(0, colon)), name))
+      continue;
+    if (value)
+      *value = TrimSpaces(line.substr(colon + 1));
+    return true;
+  }
+  return false;
+}
+
+// static
+bool MultipartBody::IsMediaType(const base::StringPiece &content_type,
+                                const base::StringPiece &media_type) {
+  return base::EqualsCaseInsensitiveASCII(
+      TrimSpaces(content_type.substr(0, content_type.find(';'))),
+      media_type);
+}
+
+bool MultipartBody::Split(const base::StringPiece &boundary) {
+  base::StringPiece content(content_->data());
+  std::string delimiter(kCrlf);
+  delimiter += "--";
+  boundary.AppendToString(&delimiter);
+  // The first delimiter may start the content, without a line break.
+  base::StringPiece first_delimiter(base::StringPiece(delimiter).substr(2));
+  size_t position;
+  if (content.starts_with(first_delimiter)) {
+    position = 0;
+  } else {
+    position = content.find(delimiter);
+    if (base::StringPiece::npos == position)
+      return false;
+    position += 2;
+  }
+
+  for (;;) {
+    position += first_delimiter.size();
+    // The close delimiter ends the parts; the epilogue is ignored.
+    if (content.substr(position, 2) == "--")
+      return !parts_.empty();
+    // Transport padding is allowed before the line break.
+    size_t line_end = content.find(kCrlf, position);
+    if (base::StringPiece::npos == line_end)
+      return false;
+    size_t next = content.find(delimiter, line_end);
+    if (base::StringPiece::npos == next)
+      return false;
+    size_t begin = line_end + 2;
+    base::StringPiece text(next > begin
+        ? content.substr(begin, next - begin) : base::StringPiece());
+
+    Part part;
+    if (text.starts_with(kCrlf)) {
+      part.body = text.substr(2);
+    } else {
+      size_t headers_end = text.find("\r\n\r\n");
+      if (base::StringPiece::npos == headers_end) {
+        part.headers = text;
+      } else {
+        part.headers = text.substr(0, headers_end);
+        part.body = text.substr(headers_end + 4);
+      }
+    }
+    GetPartHeader(part, "Content-Type", &part.content_type);
+    parts_.push_back(part);
+    position = next + 2;
+  }
+}
+
+} // End of sippet namespace
@@ -0,0 +1,70 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_MESSAGE_MULTIPART_BODY_H_
+#define SIPPET_MESSAGE_MULTIPART_BODY_H_
+
+#include <vector>
+
+#include "base/memory/ref_counted.h"
+#include "base/memory/ref_counted_memory.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/strings/string_piece.h"
+
+namespace sippet {
+
+// The parts of a multipart body (RFC 2046, see RFC 5621 for its use in
+// SIP), such as an SDP offer sent along with ISUP or PIDF, split in place:
+// the parts and their headers are |base::StringPiece|s into the content,
+// that is kept alive by the body.
+//
+// Messages build it the first time it's asked for, and keep it until they
+// change (see |Message::multipart_body|).
+class MultipartBody {
+ public:
+  struct Part {
+    // The header lines of the part, without the empty line ending them.
+    // Folded headers aren't unfolded.
+    base::StringPiece headers;
+    // The value of the Content-Type of the part, parameters included.
+    // Empty when the part has none, meaning text/plain.
+    base::StringPiece content_type;
+    base::StringPiece body;
+  };
+
+  ~MultipartBody();
+
+  // Returns NULL unless |content| is made of parts delimited by |boundary|.
+  static scoped_ptr<MultipartBody> Parse(
+      const scoped_refptr<base::RefCountedString> &content,
+      const base::StringPiece &boundary);
+
+  const std::vector<Part> &parts() const { return parts_; }
+
+  // The first part of |media_type|, such as "application/sdp", or NULL.
+  const Part *FindPart(const base::StringPiece &media_type) const;
+
+  // The value of the header |name| of |part|. Returns false if it has none.
+  static bool GetPartHeader(const Part &part,
+                            const base::StringPiece &name,
+                            base::StringPiece *value);
+
+  // Whether |content_type|, parameters included, is of |media_type|.
+  static bool IsMediaType(const base::StringPiece &content_type,
+                          const base::StringPiece &media_type);
+
+ private:
+  explicit MultipartBody(const scoped_refptr<base::RefCountedString> &content);
+
+  bool Split(const base::StringPiece &boundary);
+
+  scoped_refptr<base::RefCountedString> content_;
+  std::vector<Part> parts_;
+
+  DISALLOW_COPY_AND_ASSIGN(MultipartBody);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_MESSAGE_MULTIPART_BODY_H_
@@ -0,0 +1,47 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/message/parse_profile.h"
+
+#include "base/logging.h"
+
+namespace sippet {
+
+ParseProfile::ParseProfile() {
+}
+
+ParseProfile::~ParseProfile() {
+}
+
+// static
+ParseProfile ParseProfile::LoadBalancer() {
+  ParseProfile profile;
+  profile.AddEager(Header::HDR_VIA);
+  profile.AddEager(Header::HDR_CALL_ID);
+  profile.AddEager(Header::HDR_CSEQ);
+  profile.AddEager(Header::HDR_ROUTE);
+  profile.AddEager(Header::HDR_MAX_FORWARDS);
+  return profile;
+}
+
+// static
+ParseProfile ParseProfile::Registrar() {
+  ParseProfile profile;
+  profile.AddEager(Header::HDR_CONTACT);
+  profile.AddEager(Header::HDR_EXPIRES);
+  profile.AddEager(Header::HDR_AUTHORIZATION);
+  return profile;
+}
+
+void ParseProfile::AddEager(Header::Type type) {
+  DCHECK_NE(Header::HDR_GENERIC, type);
+  eager_.set(type);
+}
+
+void ParseProfile::RemoveEager(Header::Type type) {
+  DCHECK_NE(Header::HDR_GENERIC, type);
+  eager_.reset(type);
+}
+
+} // End of sippet namespace
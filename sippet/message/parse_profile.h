@@ -0,0 +1,57 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_MESSAGE_PARSE_PROFILE_H_
+#define SIPPET_MESSAGE_PARSE_PROFILE_H_
+
+#include <bitset>
+
+#include "sippet/message/header.h"
+
+namespace sippet {
+
+// Tells which headers are decoded into their typed class while a message is
+// parsed with |Message::PARSE_LAZY| or |Message::PARSE_PASSTHROUGH|. The
+// other headers are kept as raw values, and only decoded the first time
+// they are looked up, so the parser work scales with the headers an
+// application actually reads. E.g. a load balancer only routes on a few
+// headers, and relays everything else untouched.
+//
+// The default profile selects no header. Unknown headers are always kept
+// as |Generic|s.
+class ParseProfile {
+ public:
+  ParseProfile();
+  ~ParseProfile();
+
+  // Headers needed by a stateless proxy or load balancer.
+  static ParseProfile LoadBalancer();
+
+  // Headers needed by a registrar.
+  static ParseProfile Registrar();
+
+  // Selects or deselects headers of |type| for eager decoding.
+  void AddEager(Header::Type type);
+  void RemoveEager(Header::Type type);
+
+  bool IsEager(Header::Type type) const {
+    return Header::HDR_GENERIC != type && eager_[type];
+  }
+
+  bool empty() const { return eager_.none(); }
+
+  bool operator==(const ParseProfile &other) const {
+    return eager_ == other.eager_;
+  }
+  bool operator!=(const ParseProfile &other) const {
+    return !(*this == other);
+  }
+
+ private:
+  std::bitset<Header::HDR_GENERIC> eager_;
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_MESSAGE_PARSE_PROFILE_H_
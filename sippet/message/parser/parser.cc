@@ -5,14 +5,21 @@
 #include "sippet/message/message.h"
 
 #include <algorithm>
+#include <cstring>
+#include <limits>
 
 #include "sippet/message/parser/tokenizer.h"
+#include "sippet/base/arena.h"
+#include "sippet/message/message_pool.h"
+#include "sippet/message/parse_profile.h"
 #include "base/basictypes.h"
 #include "base/strings/string_split.h"
 #include "base/logging.h"
 #include "base/strings/string_number_conversions.h"
 #include "base/strings/string_util.h"
 #include "base/strings/string_piece.h"
+#include "base/strings/string_tokenizer.h"
+#include "base/trace_event/trace_event.h"
 #include "net/http/http_util.h"
 #include "net/base/net_util.h"
 
@@ -22,11 +29,100 @@ namespace sippet {
 
 namespace {
 
+// The parser works directly over the raw message buffer, without copying it
+// into a |std::string| first.
+typedef Tokenizer::const_iterator const_iterator;
+
+// Same as |net::HttpUtil::TrimLWS|, but over raw character ranges.
+void TrimLWS(const_iterator *begin, const_iterator *end) {
+  while (*begin < *end && net::HttpUtil::IsLWS((*begin)[0]))
+    ++(*begin);
+  while (*begin < *end && net::HttpUtil::IsLWS((*end)[-1]))
+    --(*end);
+}
+
+// Same character set accepted by |net::HttpUtil::IsToken|.
+bool IsTokenChar(char c) {
+  unsigned char u = static_cast<unsigned char>(c);
+  if (u >= 0x80 || u <= 0x1F || u == 0x7F)
+    return false;
+  return strchr("()<>@,;:\\\"/[]?={} \t", c) == NULL;
+}
+
+// Parses the decimal number [begin, end) in place, for the numeric fields
+// present in every message (CSeq, Content-Length, Max-Forwards...). Unlike
+// |base::StringToInt| no string is built, and signs are rejected, as these
+// are 1*DIGIT. Values above the int32 limit are rejected, as before.
+bool ParseDigits(const_iterator begin, const_iterator end, unsigned *output) {
+  if (begin == end)
+    return false;
+  const unsigned kMax =
+      static_cast<unsigned>(std::numeric_limits<int32>::max());
+  unsigned value = 0;
+  for (; begin != end; ++begin) {
+    unsigned digit = static_cast<unsigned char>(*begin) - '0';
+    if (digit > 9 || value > (kMax - digit) / 10)
+      return false;
+    value = value * 10 + digit;
+  }
+  *output = value;
+  return true;
+}
+
+// Same as above, but for numbers that may have a fractional part. Only
+// those actually having one go through |base::StringToDouble|.
+bool ParseDecimal(const_iterator begin, const_iterator end, double *output) {
+  unsigned integer;
+  if (ParseDigits(begin, end, &integer)) {
+    *output = integer;
+    return true;
+  }
+  return base::StringToDouble(std::string(begin, end), output);
+}
+
+// Same as |net::HttpUtil::ValuesIterator|, but over raw character ranges.
+class ValuesIterator {
+ public:
+  ValuesIterator(const_iterator values_begin,
+                 const_iterator values_end,
+                 char delimiter)
+    : values_(values_begin, values_end, std::string(1, delimiter)),
+      value_begin_(values_end),
+      value_end_(values_end) {
+    values_.set_quote_chars("\'\"");
+  }
+
+  ~ValuesIterator() {}
+
+  bool GetNext() {
+    while (values_.GetNext()) {
+      value_begin_ = values_.token_begin();
+      value_end_ = values_.token_end();
+      TrimLWS(&value_begin_, &value_end_);
+
+      // bypass empty values.
+      if (value_begin_ != value_end_)
+        return true;
+    }
+    return false;
+  }
+
+  const_iterator value_begin() const { return value_begin_; }
+  const_iterator value_end() const { return value_end_; }
+  std::string value() const { return std::string(value_begin_, value_end_); }
+
+ private:
+  base::CStringTokenizer values_;
+  const_iterator value_begin_;
+  const_iterator value_end_;
+};
+
 class GenericParametersIterator {
  public:
-  GenericParametersIterator(std::string::const_iterator begin,
-                            std::string::const_iterator end)
-    : props_(begin, end, ';'),
+  GenericParametersIterator(const_iterator begin,
+                            const_iterator end,
+                            char delimiter = ';')
+    : props_(begin, end, delimiter),
       valid_(true),
       name_begin_(end),
       name_end_(end),
@@ -44,7 +140,7 @@ class GenericParametersIterator {
     value_end_ = props_.value_end();
     name_begin_ = name_end_ = value_end_;
 
-    std::string::const_iterator equals =
+    const_iterator equals =
         std::find(value_begin_, value_end_, '=');
     if (equals != value_end_ && equals != value_begin_) {
       name_begin_ = value_begin_;
@@ -56,8 +152,8 @@ class GenericParametersIterator {
       value_begin_ = value_end_;
     }
 
-    net::HttpUtil::TrimLWS(&name_begin_, &name_end_);
-    net::HttpUtil::TrimLWS(&value_begin_, &value_end_);
+    TrimLWS(&name_begin_, &name_end_);
+    TrimLWS(&value_begin_, &value_end_);
     value_is_quoted_ = false;
     unquoted_value_.clear();
 
@@ -68,7 +164,8 @@ class GenericParametersIterator {
           ++value_begin_;
         } else {
           value_is_quoted_ = true;
-          unquoted_value_ = net::HttpUtil::Unquote(value_begin_, value_end_);
+          unquoted_value_ = net::HttpUtil::Unquote(
+              std::string(value_begin_, value_end_));
         }
       }
     }
@@ -78,15 +175,16 @@ class GenericParametersIterator {
 
   bool valid() const { return valid_; }
 
-  std::string::const_iterator name_begin() const { return name_begin_; }
-  std::string::const_iterator name_end() const { return name_end_; }
+  const_iterator name_begin() const { return name_begin_; }
+  const_iterator name_end() const { return name_end_; }
   std::string name() const { return std::string(name_begin_, name_end_); }
 
-  std::string::const_iterator value_begin() const {
-    return value_is_quoted_ ? unquoted_value_.begin() : value_begin_;
+  const_iterator value_begin() const {
+    return value_is_quoted_ ? unquoted_value_.data() : value_begin_;
   }
-  std::string::const_iterator value_end() const {
-    return value_is_quoted_ ? unquoted_value_.end() : value_end_;
+  const_iterator value_end() const {
+    return value_is_quoted_ ?
+        unquoted_value_.data() + unquoted_value_.size() : value_end_;
   }
   std::string value() const {
     return value_is_quoted_ ? unquoted_value_ : std::string(value_begin_,
@@ -97,14 +195,14 @@ class GenericParametersIterator {
                                                       value_end_); }
 
  private:
-  net::HttpUtil::ValuesIterator props_;
+  ValuesIterator props_;
   bool valid_;
 
-  std::string::const_iterator name_begin_;
-  std::string::const_iterator name_end_;
+  const_iterator name_begin_;
+  const_iterator name_end_;
 
-  std::string::const_iterator value_begin_;
-  std::string::const_iterator value_end_;
+  const_iterator value_begin_;
+  const_iterator value_end_;
 
   std::string unquoted_value_;
 
@@ -112,25 +210,25 @@ class GenericParametersIterator {
 };
 
 bool IsStatusLine(
-      std::string::const_iterator line_begin,
-      std::string::const_iterator line_end) {
+      const_iterator line_begin,
+      const_iterator line_end) {
   return ((line_end - line_begin > 4)
       && base::LowerCaseEqualsASCII(
              line_begin, line_begin + 4, "sip/"));
 }
 
-std::string::const_iterator FindLineEnd(
-    std::string::const_iterator begin,
-    std::string::const_iterator end) {
-  size_t i = base::StringPiece(begin, end).find_first_of("\r\n");
+const_iterator FindLineEnd(
+    const_iterator begin,
+    const_iterator end) {
+  size_t i = base::StringPiece(begin, end - begin).find_first_of("\r\n");
   if (i == base::StringPiece::npos)
     return end;
   return begin + i;
 }
 
 Version ParseVersion(
-    std::string::const_iterator line_begin,
-    std::string::const_iterator line_end) {
+    const_iterator line_begin,
+    const_iterator line_end) {
   Tokenizer tok(line_begin, line_end);
 
   if ((line_end - line_begin < 3) ||
@@ -150,10 +248,10 @@ Version ParseVersion(
   }
 
   tok.Skip();
-  std::string::const_iterator major_start = tok.Skip(HTTP_LWS);
+  const_iterator major_start = tok.Skip(HTTP_LWS);
   tok.SkipTo('.');
   tok.Skip();
-  std::string::const_iterator minor_start = tok.Skip(HTTP_LWS);
+  const_iterator minor_start = tok.Skip(HTTP_LWS);
   if (tok.EndOfInput()) {
     DVLOG(1) << "malformed version";
     return Version();
@@ -171,8 +269,8 @@ Version ParseVersion(
 }
 
 bool ParseStatusLine(
-    std::string::const_iterator line_begin,
-    std::string::const_iterator line_end,
+    const_iterator line_begin,
+    const_iterator line_end,
     Version *version,
     int *response_code,
     std::string *reason_phrase) {
@@ -189,7 +287,7 @@ bool ParseStatusLine(
     DVLOG(1) << "assuming SIP/2.0";
   }
 
-  std::string::const_iterator p = std::find(line_begin, line_end, ' ');
+  const_iterator p = std::find(line_begin, line_end, ' ');
 
   if (p == line_end) {
     DVLOG(1) << "missing response status";
@@ -197,21 +295,21 @@ bool ParseStatusLine(
   }
 
   // Skip whitespace.
-  while (*p == ' ')
+  while (p != line_end && *p == ' ')
     ++p;
 
-  std::string::const_iterator code = p;
-  while (*p >= '0' && *p <= '9')
+  const_iterator code = p;
+  while (p != line_end && *p >= '0' && *p <= '9')
     ++p;
 
   if (p == code) {
     DVLOG(1) << "missing response status number";
     return false;
   }
-  base::StringToInt(base::StringPiece(code, p), response_code);
+  base::StringToInt(base::StringPiece(code, p - code), response_code);
 
   // Skip whitespace.
-  while (*p == ' ')
+  while (p != line_end && *p == ' ')
     ++p;
 
   // Trim trailing whitespace.
@@ -229,8 +327,8 @@ bool ParseStatusLine(
 }
 
 bool ParseRequestLine(
-    std::string::const_iterator line_begin,
-    std::string::const_iterator line_end,
+    const_iterator line_begin,
+    const_iterator line_end,
     Method *method,
     GURL *request_uri,
     Version *version) {
@@ -241,8 +339,8 @@ bool ParseRequestLine(
           *line_begin == '\r' || *line_begin == '\n'))
     ++line_begin;
 
-  std::string::const_iterator meth = line_begin;
-  std::string::const_iterator p = std::find(line_begin, line_end, ' ');
+  const_iterator meth = line_begin;
+  const_iterator p = std::find(line_begin, line_end, ' ');
 
   if (p == line_end) {
     DVLOG(1) << "missing method";
@@ -251,10 +349,10 @@ bool ParseRequestLine(
   method->set_str(std::string(meth, p));
 
   // Skip whitespace.
-  while (*p == ' ')
+  while (p != line_end && *p == ' ')
     ++p;
 
-  std::string::const_iterator uri = p;
+  const_iterator uri = p;
   p = std::find(p, line_end, ' ');
 
   if (p == line_end) {
@@ -265,7 +363,7 @@ bool ParseRequestLine(
   *request_uri = GURL(std::string(uri, p));
 
   // Skip whitespace.
-  while (*p == ' ')
+  while (p != line_end && *p == ' ')
     ++p;
 
   // Extract the version number
@@ -281,7 +379,7 @@ bool ParseRequestLine(
 template<class HeaderType, typename Builder>
 bool ParseToken(Tokenizer* tok, scoped_ptr<HeaderType>* header,
     Builder builder) {
-  std::string::const_iterator token_start = tok->Skip(HTTP_LWS);
+  const_iterator token_start = tok->Skip(HTTP_LWS);
   if (tok->EndOfInput()) {
     DVLOG(1) << "empty value";
     return false;
@@ -294,7 +392,7 @@ bool ParseToken(Tokenizer* tok, scoped_ptr<HeaderType>* header,
 template<class HeaderType, typename Builder>
 bool ParseTypeSubtype(Tokenizer* tok, scoped_ptr<HeaderType>* header,
     Builder builder) {
-  std::string::const_iterator type_start = tok->Skip(HTTP_LWS);
+  const_iterator type_start = tok->Skip(HTTP_LWS);
   if (tok->EndOfInput()) {
     // empty header is OK
     return true;
@@ -308,7 +406,7 @@ bool ParseTypeSubtype(Tokenizer* tok, scoped_ptr<HeaderType>* header,
   tok->SkipTo('/');
   tok->Skip();
 
-  std::string::const_iterator subtype_start = tok->Skip(HTTP_LWS);
+  const_iterator subtype_start = tok->Skip(HTTP_LWS);
   if (tok->EndOfInput()) {
     DVLOG(1) << "missing subtype";
     return false;
@@ -327,20 +425,21 @@ template<class HeaderType, typename Setter>
 bool ParseParameters(Tokenizer* tok, scoped_ptr<HeaderType>* header,
     Setter setter) {
   // TODO(david): accept generic param such as ";token"
-  std::string::const_iterator param_start = tok->SkipTo(';');
+  const_iterator param_start = tok->SkipTo(';');
   if (tok->EndOfInput())
     return true;
   tok->Skip();
   GenericParametersIterator it(tok->current(), tok->end());
   while (it.GetNext()) {
-    setter(header, it.name(), it.value());
+    setter(header, it.name_begin(), it.name_end(),
+           it.value_begin(), it.value_end());
   }
   return true;
 }
 
 template<class HeaderType>
 bool ParseAuthScheme(Tokenizer* tok, scoped_ptr<HeaderType>* header) {
-  std::string::const_iterator scheme_start = tok->Skip(HTTP_LWS);
+  const_iterator scheme_start = tok->Skip(HTTP_LWS);
   if (tok->EndOfInput()) {
     DVLOG(1) << "missing authentication scheme";
     return false;
@@ -352,7 +451,7 @@ bool ParseAuthScheme(Tokenizer* tok, scoped_ptr<HeaderType>* header) {
 
 template<class HeaderType>
 bool ParseAuthParams(Tokenizer* tok, scoped_ptr<HeaderType>* header) {
-  net::HttpUtil::NameValuePairsIterator it(tok->current(), tok->end(), ',');
+  GenericParametersIterator it(tok->current(), tok->end(), ',');
   while (it.GetNext()) {
     (*header)->param_set(it.name(), it.raw_value());
   }
@@ -366,8 +465,8 @@ bool ParseUri(Tokenizer* tok, scoped_ptr<HeaderType>* header) {
     DVLOG(1) << "invalid uri";
     return false;
   }
-  std::string::const_iterator uri_start = tok->Skip();
-  std::string::const_iterator uri_end = tok->SkipTo('>');
+  const_iterator uri_start = tok->Skip();
+  const_iterator uri_end = tok->SkipTo('>');
   if (tok->EndOfInput()) {
     DVLOG(1) << "unclosed '<'";
     return false;
@@ -382,11 +481,16 @@ template<class HeaderType, typename Builder>
 bool ParseContact(Tokenizer* tok, scoped_ptr<HeaderType>* header,
     Builder builder) {
   std::string display_name;
-  GURL address;
+  // Canonicalized by the header when first read.
+  base::StringPiece address;
   tok->Skip(HTTP_LWS);
+  if (tok->EndOfInput()) {
+    DVLOG(1) << "empty value";
+    return false;
+  }
   if (net::HttpUtil::IsQuote(*tok->current())) {
     // contact-param = quoted-string LAQUOT addr-spec RAQUOT
-    std::string::const_iterator display_name_start = tok->current();
+    const_iterator display_name_start = tok->current();
     tok->Skip();
     for (; !tok->EndOfInput(); tok->Skip()) {
       if (*tok->current() == '\\') {
@@ -406,13 +510,13 @@ bool ParseContact(Tokenizer* tok, scoped_ptr<HeaderType>* header,
       DVLOG(1) << "missing address";
       return false;
     }
-    std::string::const_iterator address_start = tok->Skip();
+    const_iterator address_start = tok->Skip();
     tok->SkipTo('>');
     if (tok->EndOfInput()) {
       DVLOG(1) << "unclosed '<'";
       return false;
     }
-    address = GURL(std::string(address_start, tok->current()));
+    address.set(address_start, tok->current() - address_start);
   } else {
     Tokenizer laquot(tok->current(), tok->end());
     laquot.SkipTo('<');
@@ -420,17 +524,17 @@ bool ParseContact(Tokenizer* tok, scoped_ptr<HeaderType>* header,
       // contact-param = *(token LWS) LAQUOT addr-spec RAQUOT
       display_name.assign(tok->current(), laquot.current());
       base::TrimString(display_name, HTTP_LWS, &display_name);
-      std::string::const_iterator address_start = laquot.Skip();
+      const_iterator address_start = laquot.Skip();
       laquot.SkipTo('>');
       if (laquot.EndOfInput()) {
         DVLOG(1) << "unclosed '<'";
         return false;
       }
-      address = GURL(std::string(address_start, laquot.current()));
+      address.set(address_start, laquot.current() - address_start);
       tok->set_current(laquot.Skip());
-    } else if (net::HttpUtil::IsToken(tok->current(), tok->current()+1)) {
-      std::string::const_iterator address_start = tok->current();
-      address = GURL(std::string(address_start, tok->SkipNotIn(HTTP_LWS ";")));
+    } else if (IsTokenChar(*tok->current())) {
+      const_iterator address_start = tok->current();
+      address.set(address_start, tok->SkipNotIn(HTTP_LWS ";") - address_start);
     } else {
       DVLOG(1) << "invalid char found";
       return false;
@@ -457,7 +561,7 @@ bool ParseStar(Tokenizer* tok, scoped_ptr<HeaderType>* header) {
 template<class HeaderType, typename Builder>
 bool ParseWarning(Tokenizer* tok, scoped_ptr<HeaderType>* header,
     Builder builder) {
-  std::string::const_iterator code_start = tok->Skip(HTTP_LWS);
+  const_iterator code_start = tok->Skip(HTTP_LWS);
   if (tok->EndOfInput()) {
     DVLOG(1) << "empty input";
     return false;
@@ -469,7 +573,7 @@ bool ParseWarning(Tokenizer* tok, scoped_ptr<HeaderType>* header,
     DVLOG(1) << "invalid code";
     return false;
   }
-  std::string::const_iterator agent_start = tok->Skip(HTTP_LWS);
+  const_iterator agent_start = tok->Skip(HTTP_LWS);
   if (tok->EndOfInput()) {
     DVLOG(1) << "empty warn-agent";
     return false;
@@ -484,7 +588,7 @@ bool ParseWarning(Tokenizer* tok, scoped_ptr<HeaderType>* header,
     DVLOG(1) << "invalid warn-text";
     return false;
   }
-  std::string::const_iterator text_start = tok->current();
+  const_iterator text_start = tok->current();
   tok->Skip();
   for (; !tok->EndOfInput(); tok->Skip()) {
     if (*tok->current() == '\\') {
@@ -507,7 +611,7 @@ bool ParseWarning(Tokenizer* tok, scoped_ptr<HeaderType>* header,
 template<class HeaderType, typename Builder>
 bool ParseVia(Tokenizer* tok, scoped_ptr<HeaderType>* header,
     Builder builder) {
-  std::string::const_iterator version_start = tok->Skip(HTTP_LWS);
+  const_iterator version_start = tok->Skip(HTTP_LWS);
   if ((tok->end() - tok->current() < 3)
       || !LowerCaseEqualsASCII(
           tok->current(), tok->current() + 3, "sip")) {
@@ -525,14 +629,14 @@ bool ParseVia(Tokenizer* tok, scoped_ptr<HeaderType>* header,
     DVLOG(1) << "invalid SIP-version";
     return false;
   }
-  std::string::const_iterator protocol_start = tok->Skip();
+  const_iterator protocol_start = tok->Skip();
   if (tok->EndOfInput()) {
     DVLOG(1) << "missing sent-protocol";
     return false;
   }
   std::string protocol(protocol_start, tok->SkipNotIn(HTTP_LWS));
   base::StringToUpperASCII(&protocol);
-  std::string::const_iterator sentby_start = tok->Skip(HTTP_LWS);
+  const_iterator sentby_start = tok->Skip(HTTP_LWS);
   if (tok->EndOfInput()) {
     DVLOG(1) << "missing sent-by";
     return false;
@@ -575,8 +679,9 @@ struct SingleBuilder {
 template<class HeaderType>
 struct SingleParamSetter {
   void operator()(scoped_ptr<HeaderType>* header,
-      const std::string &key, const std::string &value) {
-    (*header)->param_set(key, value);
+      const_iterator key_begin, const_iterator key_end,
+      const_iterator value_begin, const_iterator value_end) {
+    (*header)->param_set(key_begin, key_end, value_begin, value_end);
   }
 };
 
@@ -591,15 +696,16 @@ struct MultipleBuilder {
 template<class HeaderType>
 struct MultipleParamSetter {
   void operator()(scoped_ptr<HeaderType>* header,
-      const std::string &key, const std::string &value) {
-    (*header)->back().param_set(key, value);
+      const_iterator key_begin, const_iterator key_end,
+      const_iterator value_begin, const_iterator value_end) {
+    (*header)->back().param_set(key_begin, key_end, value_begin, value_end);
   }
 };
 
 template<class HeaderType>
 scoped_ptr<Header> ParseSingleToken(
-    std::string::const_iterator values_begin,
-    std::string::const_iterator values_end) {
+    const_iterator values_begin,
+    const_iterator values_end) {
   scoped_ptr<HeaderType> retval;
   Tokenizer tok(values_begin, values_end);
   if (!ParseToken(&tok, &retval, SingleBuilder<HeaderType>()))
@@ -609,8 +715,8 @@ scoped_ptr<Header> ParseSingleToken(
 
 template<class HeaderType>
 scoped_ptr<Header> ParseSingleTokenParams(
-    std::string::const_iterator values_begin,
-    std::string::const_iterator values_end) {
+    const_iterator values_begin,
+    const_iterator values_end) {
   scoped_ptr<HeaderType> retval;
   Tokenizer tok(values_begin, values_end);
   if (!ParseToken(&tok, &retval, SingleBuilder<HeaderType>()))
@@ -620,10 +726,10 @@ scoped_ptr<Header> ParseSingleTokenParams(
 
 template<class HeaderType>
 scoped_ptr<Header> ParseMultipleTokens(
-    std::string::const_iterator values_begin,
-    std::string::const_iterator values_end) {
+    const_iterator values_begin,
+    const_iterator values_end) {
   scoped_ptr<HeaderType> retval(new HeaderType);
-  net::HttpUtil::ValuesIterator it(values_begin, values_end, ',');
+  ValuesIterator it(values_begin, values_end, ',');
   while (it.GetNext()) {
     Tokenizer tok(it.value_begin(), it.value_end());
     if (!ParseToken(&tok, &retval, MultipleBuilder<HeaderType>()))
@@ -634,10 +740,10 @@ scoped_ptr<Header> ParseMultipleTokens(
 
 template<class HeaderType>
 scoped_ptr<Header> ParseMultipleTokenParams(
-    std::string::const_iterator values_begin,
-    std::string::const_iterator values_end) {
+    const_iterator values_begin,
+    const_iterator values_end) {
   scoped_ptr<HeaderType> retval(new HeaderType);
-  net::HttpUtil::ValuesIterator it(values_begin, values_end, ',');
+  ValuesIterator it(values_begin, values_end, ',');
   while (it.GetNext()) {
     Tokenizer tok(it.value_begin(), it.value_end());
     if (!ParseToken(&tok, &retval, MultipleBuilder<HeaderType>())
@@ -649,8 +755,8 @@ scoped_ptr<Header> ParseMultipleTokenParams(
 
 template<class HeaderType>
 scoped_ptr<Header> ParseSingleTypeSubtypeParams(
-    std::string::const_iterator values_begin,
-    std::string::const_iterator values_end) {
+    const_iterator values_begin,
+    const_iterator values_end) {
   scoped_ptr<HeaderType> retval;
   Tokenizer tok(values_begin, values_end);
   if (!ParseTypeSubtype(&tok, &retval, SingleBuilder<HeaderType>())
@@ -661,10 +767,10 @@ scoped_ptr<Header> ParseSingleTypeSubtypeParams(
 
 template<class HeaderType>
 scoped_ptr<Header> ParseMultipleTypeSubtypeParams(
-    std::string::const_iterator values_begin,
-    std::string::const_iterator values_end) {
+    const_iterator values_begin,
+    const_iterator values_end) {
   scoped_ptr<HeaderType> retval(new HeaderType);
-  net::HttpUtil::ValuesIterator it(values_begin, values_end, ',');
+  ValuesIterator it(values_begin, values_end, ',');
   while (it.GetNext()) {
     Tokenizer tok(it.value_begin(), it.value_end());
     if (!ParseTypeSubtype(&tok, &retval, MultipleBuilder<HeaderType>())
@@ -676,10 +782,10 @@ scoped_ptr<Header> ParseMultipleTypeSubtypeParams(
 
 template<class HeaderType>
 scoped_ptr<Header> ParseMultipleUriParams(
-    std::string::const_iterator values_begin,
-    std::string::const_iterator values_end) {
+    const_iterator values_begin,
+    const_iterator values_end) {
   scoped_ptr<HeaderType> retval(new HeaderType);
-  net::HttpUtil::ValuesIterator it(values_begin, values_end, ',');
+  ValuesIterator it(values_begin, values_end, ',');
   while (it.GetNext()) {
     Tokenizer tok(it.value_begin(), it.value_end());
     if (!ParseUri(&tok, &retval)
@@ -691,25 +797,40 @@ scoped_ptr<Header> ParseMultipleUriParams(
 
 template<class HeaderType>
 scoped_ptr<Header> ParseSingleInteger(
-    std::string::const_iterator values_begin,
-    std::string::const_iterator values_end) {
+    const_iterator values_begin,
+    const_iterator values_end) {
   Tokenizer tok(values_begin, values_end);
-  std::string::const_iterator token_start = tok.Skip(HTTP_LWS);
-  std::string digits(token_start, tok.SkipNotIn(HTTP_LWS));
-  int output = 0;
-  if (!base::StringToInt(digits, &output)) {
+  const_iterator token_start = tok.Skip(HTTP_LWS);
+  unsigned integer = 0;
+  if (!ParseDigits(token_start, tok.SkipNotIn(HTTP_LWS), &integer)) {
     DVLOG(1) << "invalid digits";
     return scoped_ptr<Header>();
   }
-  unsigned integer = static_cast<unsigned>(output);
   scoped_ptr<HeaderType> header(new HeaderType(integer));
   return header.Pass();
 }
 
+template<class HeaderType>
+scoped_ptr<Header> ParseSingleIntegerParams(
+    const_iterator values_begin,
+    const_iterator values_end) {
+  Tokenizer tok(values_begin, values_end);
+  const_iterator token_start = tok.Skip(HTTP_LWS);
+  unsigned integer = 0;
+  if (!ParseDigits(token_start, tok.SkipNotIn(HTTP_LWS ";"), &integer)) {
+    DVLOG(1) << "invalid digits";
+    return scoped_ptr<Header>();
+  }
+  scoped_ptr<HeaderType> header(new HeaderType(integer));
+  if (!ParseParameters(&tok, &header, SingleParamSetter<HeaderType>()))
+    return scoped_ptr<Header>();
+  return header.Pass();
+}
+
 template<class HeaderType>
 scoped_ptr<Header> ParseOnlyAuthParams(
-    std::string::const_iterator values_begin,
-    std::string::const_iterator values_end) {
+    const_iterator values_begin,
+    const_iterator values_end) {
   scoped_ptr<HeaderType> header(new HeaderType);
   Tokenizer tok(values_begin, values_end);
   if (!ParseAuthParams(&tok, &header))
@@ -719,8 +840,8 @@ scoped_ptr<Header> ParseOnlyAuthParams(
 
 template<class HeaderType>
 scoped_ptr<Header> ParseSchemeAndAuthParams(
-    std::string::const_iterator values_begin,
-    std::string::const_iterator values_end) {
+    const_iterator values_begin,
+    const_iterator values_end) {
   scoped_ptr<HeaderType> header;
   Tokenizer tok(values_begin, values_end);
   if (!ParseAuthScheme(&tok, &header)
@@ -731,8 +852,8 @@ scoped_ptr<Header> ParseSchemeAndAuthParams(
 
 template<class HeaderType>
 scoped_ptr<Header> ParseSingleContactParams(
-    std::string::const_iterator values_begin,
-    std::string::const_iterator values_end) {
+    const_iterator values_begin,
+    const_iterator values_end) {
   scoped_ptr<HeaderType> retval;
   Tokenizer tok(values_begin, values_end);
   if (!ParseContact(&tok, &retval, SingleBuilder<HeaderType>())
@@ -743,10 +864,10 @@ scoped_ptr<Header> ParseSingleContactParams(
 
 template<class HeaderType>
 scoped_ptr<Header> ParseMultipleContactParams(
-    std::string::const_iterator values_begin,
-    std::string::const_iterator values_end) {
+    const_iterator values_begin,
+    const_iterator values_end) {
   scoped_ptr<HeaderType> retval(new HeaderType);
-  net::HttpUtil::ValuesIterator it(values_begin, values_end, ',');
+  ValuesIterator it(values_begin, values_end, ',');
   while (it.GetNext()) {
     Tokenizer tok(it.value_begin(), it.value_end());
     if (!ParseContact(&tok, &retval, MultipleBuilder<HeaderType>())
@@ -758,10 +879,10 @@ scoped_ptr<Header> ParseMultipleContactParams(
 
 template<class HeaderType>
 scoped_ptr<Header> ParseStarOrMultipleContactParams(
-    std::string::const_iterator values_begin,
-    std::string::const_iterator values_end) {
+    const_iterator values_begin,
+    const_iterator values_end) {
   scoped_ptr<HeaderType> retval(new HeaderType);
-  net::HttpUtil::ValuesIterator it(values_begin, values_end, ',');
+  ValuesIterator it(values_begin, values_end, ',');
   while (it.GetNext()) {
     Tokenizer tok(it.value_begin(), it.value_end());
     if (!ParseStar(&tok, &retval)) {
@@ -775,32 +896,42 @@ scoped_ptr<Header> ParseStarOrMultipleContactParams(
 
 template<class HeaderType>
 scoped_ptr<Header> ParseTrimmedUtf8(
-    std::string::const_iterator values_begin,
-    std::string::const_iterator values_end) {
-  std::string value(values_begin, values_end);
-  base::TrimString(value, HTTP_LWS, &value);
-  return scoped_ptr<HeaderType>(new HeaderType(value)).Pass();
+    const_iterator values_begin,
+    const_iterator values_end) {
+  // Trimmed before copying, and checked once: the value is kept as is.
+  Tokenizer tok(values_begin, values_end);
+  const_iterator value_begin = tok.Skip(HTTP_LWS);
+  const_iterator value_end = values_end;
+  while (value_end != value_begin
+         && base::StringPiece(HTTP_LWS).find(value_end[-1])
+             != base::StringPiece::npos)
+    --value_end;
+  if (Tokenizer::FindInvalidUtf8(value_begin, value_end) != value_end) {
+    DVLOG(1) << "invalid UTF-8 value";
+    return scoped_ptr<Header>();
+  }
+  return scoped_ptr<HeaderType>(
+      new HeaderType(std::string(value_begin, value_end))).Pass();
 }
 
 template<class HeaderType>
 scoped_ptr<Header> ParseCseq(
-    std::string::const_iterator values_begin,
-    std::string::const_iterator values_end) {
+    const_iterator values_begin,
+    const_iterator values_end) {
   scoped_ptr<HeaderType> retval;
   Tokenizer tok(values_begin, values_end);
   do {
-    std::string::const_iterator integer_start = tok.Skip(HTTP_LWS);
+    const_iterator integer_start = tok.Skip(HTTP_LWS);
     if (tok.EndOfInput()) {
       DVLOG(1) << "missing sequence";
       break;
     }
-    std::string integer_string(integer_start, tok.SkipNotIn(HTTP_LWS));
-    int sequence = 0;
-    if (!base::StringToInt(integer_string, &sequence)) {
+    unsigned sequence = 0;
+    if (!ParseDigits(integer_start, tok.SkipNotIn(HTTP_LWS), &sequence)) {
       DVLOG(1) << "invalid sequence";
       break;
     }
-    std::string::const_iterator method_start = tok.Skip(HTTP_LWS);
+    const_iterator method_start = tok.Skip(HTTP_LWS);
     if (tok.EndOfInput()) {
       DVLOG(1) << "missing method";
       break;
@@ -812,10 +943,50 @@ scoped_ptr<Header> ParseCseq(
   return retval.Pass();
 }
 
+template<class HeaderType>
+scoped_ptr<Header> ParseRAck(
+    const_iterator values_begin,
+    const_iterator values_end) {
+  scoped_ptr<HeaderType> retval;
+  Tokenizer tok(values_begin, values_end);
+  do {
+    const_iterator response_num_start = tok.Skip(HTTP_LWS);
+    if (tok.EndOfInput()) {
+      DVLOG(1) << "missing response number";
+      break;
+    }
+    unsigned response_num = 0;
+    if (!ParseDigits(response_num_start, tok.SkipNotIn(HTTP_LWS),
+                     &response_num)) {
+      DVLOG(1) << "invalid response number";
+      break;
+    }
+    const_iterator sequence_start = tok.Skip(HTTP_LWS);
+    if (tok.EndOfInput()) {
+      DVLOG(1) << "missing sequence";
+      break;
+    }
+    unsigned sequence = 0;
+    if (!ParseDigits(sequence_start, tok.SkipNotIn(HTTP_LWS), &sequence)) {
+      DVLOG(1) << "invalid sequence";
+      break;
+    }
+    const_iterator method_start = tok.Skip(HTTP_LWS);
+    if (tok.EndOfInput()) {
+      DVLOG(1) << "missing method";
+      break;
+    }
+    std::string method_name(method_start, tok.SkipNotIn(HTTP_LWS));
+    Method method(method_name);
+    retval.reset(new HeaderType(response_num, sequence, method));
+  } while (false);
+  return retval.Pass();
+}
+
 template<class HeaderType>
 scoped_ptr<Header> ParseDate(
-    std::string::const_iterator values_begin,
-    std::string::const_iterator values_end) {
+    const_iterator values_begin,
+    const_iterator values_end) {
   scoped_ptr<HeaderType> retval;
   do {
     std::string date(values_begin, values_end);
@@ -831,28 +1002,26 @@ scoped_ptr<Header> ParseDate(
 
 template<class HeaderType>
 scoped_ptr<Header> ParseTimestamp(
-    std::string::const_iterator values_begin,
-    std::string::const_iterator values_end) {
+    const_iterator values_begin,
+    const_iterator values_end) {
   scoped_ptr<HeaderType> retval;
   Tokenizer tok(values_begin, values_end);
   do {
-    std::string::const_iterator timestamp_start = tok.Skip(HTTP_LWS);
+    const_iterator timestamp_start = tok.Skip(HTTP_LWS);
     if (tok.EndOfInput()) {
       DVLOG(1) << "missing timestamp";
       break;
     }
-    std::string timestamp_string(timestamp_start, tok.SkipNotIn(HTTP_LWS));
     double timestamp = .0;
-    if (!base::StringToDouble(timestamp_string, &timestamp)) {
+    if (!ParseDecimal(timestamp_start, tok.SkipNotIn(HTTP_LWS), &timestamp)) {
       DVLOG(1) << "invalid timestamp";
       break;
     }
     // delay is optional
     double delay = .0;
-    std::string::const_iterator delay_start = tok.Skip(HTTP_LWS);
+    const_iterator delay_start = tok.Skip(HTTP_LWS);
     if (!tok.EndOfInput()) {
-      std::string delay_string(delay_start, tok.SkipNotIn(HTTP_LWS));
-      base::StringToDouble(delay_string, &delay);
+      ParseDecimal(delay_start, tok.SkipNotIn(HTTP_LWS), &delay);
       // ignore errors parsing the optional delay
     }
     retval.reset(new HeaderType(timestamp, delay));
@@ -862,12 +1031,12 @@ scoped_ptr<Header> ParseTimestamp(
 
 template<class HeaderType>
 scoped_ptr<Header> ParseMimeVersion(
-    std::string::const_iterator values_begin,
-    std::string::const_iterator values_end) {
+    const_iterator values_begin,
+    const_iterator values_end) {
   scoped_ptr<HeaderType> retval;
   Tokenizer tok(values_begin, values_end);
   do {
-    std::string::const_iterator major_start = tok.Skip(HTTP_LWS);
+    const_iterator major_start = tok.Skip(HTTP_LWS);
     if (tok.EndOfInput()) {
       DVLOG(1) << "missing major";
       break;
@@ -880,7 +1049,7 @@ scoped_ptr<Header> ParseMimeVersion(
       break;
     }
     tok.Skip();
-    std::string::const_iterator minor_start = tok.Skip(HTTP_LWS);
+    const_iterator minor_start = tok.Skip(HTTP_LWS);
     std::string minor_string(minor_start, tok.end());
     int minor = 0;
     if (minor_string.empty()
@@ -896,24 +1065,23 @@ scoped_ptr<Header> ParseMimeVersion(
 
 template<class HeaderType>
 scoped_ptr<Header> ParseRetryAfter(
-    std::string::const_iterator values_begin,
-    std::string::const_iterator values_end) {
+    const_iterator values_begin,
+    const_iterator values_end) {
   scoped_ptr<HeaderType> retval;
   Tokenizer tok(values_begin, values_end);
   do {
-    std::string::const_iterator delta_start = tok.Skip(HTTP_LWS);
+    const_iterator delta_start = tok.Skip(HTTP_LWS);
     if (tok.EndOfInput()) {
       DVLOG(1) << "missing delta-seconds";
       break;
     }
-    std::string delta_string(delta_start, tok.SkipNotIn(HTTP_LWS "(;"));
-    int delta_seconds = 0;
-    if (delta_string.empty()
-        || !base::StringToInt(delta_string, &delta_seconds)) {
+    unsigned delta_seconds = 0;
+    if (!ParseDigits(delta_start, tok.SkipNotIn(HTTP_LWS "(;"),
+                     &delta_seconds)) {
       DVLOG(1) << "missing or invalid delta-seconds";
       break;
     }
-    retval.reset(new HeaderType(static_cast<unsigned>(delta_seconds)));
+    retval.reset(new HeaderType(delta_seconds));
     // ignoring comments
     tok.SkipTo(';');
     if (!tok.EndOfInput()) {
@@ -925,10 +1093,10 @@ scoped_ptr<Header> ParseRetryAfter(
 
 template<class HeaderType>
 scoped_ptr<Header> ParseMultipleWarnings(
-    std::string::const_iterator values_begin,
-    std::string::const_iterator values_end) {
+    const_iterator values_begin,
+    const_iterator values_end) {
   scoped_ptr<HeaderType> retval(new HeaderType);
-  net::HttpUtil::ValuesIterator it(values_begin, values_end, ',');
+  ValuesIterator it(values_begin, values_end, ',');
   while (it.GetNext()) {
     Tokenizer tok(it.value_begin(), it.value_end());
     if (!ParseWarning(&tok, &retval, MultipleBuilder<HeaderType>())) {
@@ -940,22 +1108,26 @@ scoped_ptr<Header> ParseMultipleWarnings(
 
 template<class HeaderType>
 scoped_ptr<Header> ParseMultipleVias(
-    std::string::const_iterator values_begin,
-    std::string::const_iterator values_end) {
+    const_iterator values_begin,
+    const_iterator values_end) {
   scoped_ptr<HeaderType> retval(new HeaderType);
-  net::HttpUtil::ValuesIterator it(values_begin, values_end, ',');
-  while (it.GetNext()) {
-    Tokenizer tok(it.value_begin(), it.value_end());
-    if (!ParseVia(&tok, &retval, MultipleBuilder<HeaderType>())
-        || !ParseParameters(&tok, &retval, MultipleParamSetter<HeaderType>())) {
-      return scoped_ptr<Header>();
-    }
+  ValuesIterator it(values_begin, values_end, ',');
+  if (!it.GetNext())
+    return retval.Pass();
+  Tokenizer tok(it.value_begin(), it.value_end());
+  if (!ParseVia(&tok, &retval, MultipleBuilder<HeaderType>())
+      || !ParseParameters(&tok, &retval, MultipleParamSetter<HeaderType>())) {
+    return scoped_ptr<Header>();
   }
+  // Only the topmost value is parsed; the next ones are kept as they are
+  // until needed (see |Via|).
+  if (it.GetNext())
+    retval->set_unparsed_values(std::string(it.value_begin(), values_end));
   return retval.Pass();
 }
 
-typedef scoped_ptr<Header> (*ParseFunction)(std::string::const_iterator,
-                                            std::string::const_iterator);
+typedef scoped_ptr<Header> (*ParseFunction)(const_iterator,
+                                            const_iterator);
 
 // Attention here: those headers should be sorted
 const ParseFunction parsers[] = {
@@ -965,18 +1137,68 @@ const ParseFunction parsers[] = {
 #undef X
 };
 
+// Holds the raw value of a known header, decoded on demand by |Message|.
+class LazyHeader : public Header {
+ public:
+  // The value is copied, unless |copy| is false: it then has to outlive
+  // this header, as when it points into the message (|PARSE_PASSTHROUGH|).
+  LazyHeader(Type type,
+             const_iterator values_begin,
+             const_iterator values_end,
+             bool copy)
+    : Header(type, true) {
+    if (copy) {
+      storage_.assign(values_begin, values_end);
+      value_ = storage_;
+    } else {
+      value_.set(values_begin, values_end - values_begin);
+    }
+  }
+
+  ~LazyHeader() override {}
+
+  scoped_ptr<Header> Decode() const override {
+    ParseFunction f = parsers[type()];
+    return (*f)(value_.data(), value_.data() + value_.size());
+  }
+
+  void print(raw_ostream &os) const override {
+    Header::print(os);
+    os << value_;
+  }
+
+ private:
+  // Clones are handed out decoded, as they may be changed independently.
+  Header *DoClone() const override {
+    scoped_ptr<Header> header(Decode());
+    if (!header)
+      header.reset(new Generic(name(), value_.as_string()));
+    return header.release();
+  }
+
+  base::StringPiece value_;
+  std::string storage_;
+
+  DISALLOW_COPY_AND_ASSIGN(LazyHeader);
+};
+
 scoped_ptr<Header> ParseHeader(
-    std::string::const_iterator name_begin,
-    std::string::const_iterator name_end,
-    std::string::const_iterator values_begin,
-    std::string::const_iterator values_end) {
+    const_iterator name_begin,
+    const_iterator name_end,
+    const_iterator values_begin,
+    const_iterator values_end,
+    Message::ParseMode mode,
+    const ParseProfile &profile) {
   scoped_ptr<Header> retval;
-  std::string header_name(name_begin, name_end);
-  Header::Type t = AtomTraits<Header::Type>::coerce(header_name.c_str());
+  Header::Type t = AtomTraits<Header::Type>::coerce(name_begin,
+      name_end - name_begin);
   if (t == sippet::Header::HDR_GENERIC) {
     std::string header_name(name_begin, name_end);
     std::string header_value(values_begin, values_end);
     retval.reset(new sippet::Generic(header_name, header_value));
+  } else if (mode != Message::PARSE_EAGER && !profile.IsEager(t)) {
+    retval.reset(new LazyHeader(t, values_begin, values_end,
+                                mode != Message::PARSE_PASSTHROUGH));
   } else {
     ParseFunction f = parsers[static_cast<Header::Type>(t)];
     return (*f)(values_begin, values_end);
@@ -984,58 +1206,198 @@ scoped_ptr<Header> ParseHeader(
   return retval.Pass();
 }
 
-bool AssembleRawHeaders(const std::string &input, std::string *output) {
-  Tokenizer tok(input.begin(), input.end());
-  std::string::const_iterator line_start, line_end;
-
-  output->reserve(input.size());
-  for (;;) {
-    line_start = tok.current();
-    line_end = tok.SkipNotIn("\r\n");
-    if (line_start != line_end)
-      output->append(line_start, line_end);
-    if (tok.EndOfInput())
-      break;
-    if (*tok.current() == '\n') {
-      tok.Skip();  // accept single LF
-    } else if (*tok.current() == '\r') {
-      tok.Skip();
-      if (*tok.current() == '\n')
-        tok.Skip();  // default CRLF sequence
-      else
-        return false;  // invalid CRLF sequence
+// Iterates over the header lines of a raw message, in place. Continuation
+// lines are only unfolded (into an internal buffer) when there are some, so
+// regular headers are handed over straight from the input. The iteration
+// stops at the empty line that ends the header block.
+class HeadersIterator {
+ public:
+  HeadersIterator(const_iterator headers_begin,
+                  const_iterator headers_end)
+    : current_(headers_begin),
+      end_(headers_end),
+      name_begin_(headers_end),
+      name_end_(headers_end),
+      values_begin_(headers_end),
+      values_end_(headers_end),
+      line_begin_(headers_end),
+      line_end_(headers_end) {}
+
+  ~HeadersIterator() {}
+
+  bool GetNext() {
+    while (current_ != end_) {
+      const_iterator line_begin = current_;
+      const_iterator line_end = NextLine();
+      if (line_begin == line_end)
+        break;  // end of header block
+
+      bool folded = false;
+      while (current_ != end_ && net::HttpUtil::IsLWS(*current_)) {
+        line_end = NextLine();
+        folded = true;
+      }
+      line_begin_ = line_begin;
+      line_end_ = line_end;
+
+      if (folded) {
+        unfolded_.clear();
+        unfolded_.reserve(line_end - line_begin);
+        for (const_iterator p = line_begin; p != line_end; ++p) {
+          if (*p != '\r' && *p != '\n')
+            unfolded_.push_back(*p);
+        }
+        line_begin = unfolded_.data();
+        line_end = unfolded_.data() + unfolded_.size();
+      }
+
+      const_iterator colon = std::find(line_begin, line_end, ':');
+      if (colon == line_end)
+        continue;  // skip malformed header
+
+      name_begin_ = line_begin;
+      name_end_ = colon;
+
+      // If the name starts with LWS, it is an invalid line.
+      if (name_begin_ == name_end_ || net::HttpUtil::IsLWS(*name_begin_))
+        continue;
+
+      TrimLWS(&name_begin_, &name_end_);
+      if (name_begin_ == name_end_)
+        continue;  // skip malformed header
+
+      values_begin_ = colon + 1;
+      values_end_ = line_end;
+      TrimLWS(&values_begin_, &values_end_);
+      return true;
     }
-    if (tok.EndOfInput())
-      break;
-    if (!net::HttpUtil::IsLWS(*tok.current()))
-      output->append(1, '\n');  // not line folding
+    current_ = end_;
+    return false;
   }
 
-  return true;
-}
+  const_iterator name_begin() const { return name_begin_; }
+  const_iterator name_end() const { return name_end_; }
+  const_iterator values_begin() const { return values_begin_; }
+  const_iterator values_end() const { return values_end_; }
+
+  // The current header as found in the input, continuation lines included,
+  // without its last line terminator.
+  const_iterator line_begin() const { return line_begin_; }
+  const_iterator line_end() const { return line_end_; }
+
+ private:
+  // Moves to the beginning of the next physical line, returning the end of
+  // the current one. Accepts CRLF and single LF or CR as line terminators.
+  const_iterator NextLine() {
+    const_iterator line_end = FindLineEnd(current_, end_);
+    current_ = line_end;
+    if (current_ != end_ && *current_ == '\r')
+      ++current_;
+    if (current_ != end_ && *current_ == '\n')
+      ++current_;
+    return line_end;
+  }
+
+  const_iterator current_;
+  const_iterator end_;
+
+  const_iterator name_begin_;
+  const_iterator name_end_;
+
+  const_iterator values_begin_;
+  const_iterator values_end_;
+
+  const_iterator line_begin_;
+  const_iterator line_end_;
+
+  // Holds the current header when assembled from several lines.
+  std::string unfolded_;
+};
+
+// Reads the fields written by |Message::SerializeBinary|. Values are handed
+// out referring to the input.
+class BinaryReader {
+ public:
+  explicit BinaryReader(const base::StringPiece &data) : data_(data) {}
+
+  bool ReadByte(uint8 *value) {
+    if (data_.empty())
+      return false;
+    *value = static_cast<uint8>(data_[0]);
+    data_.remove_prefix(1);
+    return true;
+  }
+
+  bool ReadVarint(uint64 *value) {
+    *value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+      uint8 byte;
+      if (!ReadByte(&byte))
+        return false;
+      *value |= static_cast<uint64>(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+        return true;
+    }
+    return false;
+  }
+
+  bool ReadBytes(base::StringPiece *bytes) {
+    uint64 size;
+    if (!ReadVarint(&size) || size > data_.size())
+      return false;
+    bytes->set(data_.data(), static_cast<size_t>(size));
+    data_.remove_prefix(static_cast<size_t>(size));
+    return true;
+  }
+
+  bool ReadVersion(Version *version) {
+    uint64 major, minor;
+    if (!ReadVarint(&major) || !ReadVarint(&minor)
+        || major > kuint16max || minor > kuint16max)
+      return false;
+    *version = Version(static_cast<uint16>(major),
+                       static_cast<uint16>(minor));
+    return true;
+  }
+
+  const base::StringPiece &remaining() const { return data_; }
+
+ private:
+  base::StringPiece data_;
+};
 
 }  // namespace
 
 scoped_ptr<Header> Header::Parse(const std::string &raw_header) {
   scoped_ptr<Header> header;
-  net::HttpUtil::HeadersIterator it(raw_header.begin(),
-    raw_header.end(), "\r\n");
+  HeadersIterator it(raw_header.data(),
+                     raw_header.data() + raw_header.size());
   if (it.GetNext()) {
     header = ParseHeader(it.name_begin(), it.name_end(),
-      it.values_begin(), it.values_end());
+      it.values_begin(), it.values_end(), Message::PARSE_EAGER,
+      ParseProfile());
   }
   return header.Pass();
 }
 
-scoped_refptr<Message> Message::Parse(const std::string &raw_message) {
-  std::string input;
-  AssembleRawHeaders(raw_message, &input);
+scoped_refptr<Message> Message::Parse(const base::StringPiece &raw_message,
+                                      ParseMode mode) {
+  return Parse(raw_message, mode, ParseProfile());
+}
 
+scoped_refptr<Message> Message::Parse(const base::StringPiece &raw_message,
+                                      ParseMode mode,
+                                      const ParseProfile &profile) {
+  TRACE_EVENT1("sippet", "Message::Parse", "size", raw_message.size());
   scoped_refptr<Message> message;
-  std::string::const_iterator i = input.begin();
-  std::string::const_iterator end = input.end();
-  std::string::const_iterator start = i;
+  const_iterator i = raw_message.begin();
+  const_iterator end = raw_message.end();
+
+  // Empty lines before the start line are used as keep-alive.
+  while (i != end && (*i == '\r' || *i == '\n'))
+    ++i;
 
+  const_iterator start = i;
   i = FindLineEnd(start, end);
   do {
     Version version;
@@ -1063,17 +1425,141 @@ scoped_refptr<Message> Message::Parse(const std::string &raw_message) {
   }
 
   if (message) {
-    net::HttpUtil::HeadersIterator it(i, end, "\r\n");
+    // Headers live as long as the message, so allocate them all at once.
+    message->arena_ = MessagePool::TakeArena();
+    Header::ScopedArena scoped_arena(message->arena_.get());
+    if (mode == PARSE_PASSTHROUGH) {
+      // Headers are parsed from the message copy, so they can refer to it.
+      size_t offset = i - raw_message.begin();
+      message->received_.assign(raw_message.data(), raw_message.size());
+      i = message->received_.data() + offset;
+      end = message->received_.data() + message->received_.size();
+    }
+    HeadersIterator it(i, end);
     while (it.GetNext()) {
       scoped_ptr<Header> header =
         ParseHeader(it.name_begin(), it.name_end(),
-                    it.values_begin(), it.values_end());
-      if (header)
-        message->push_back(header.Pass());
+                    it.values_begin(), it.values_end(), mode, profile);
+      if (!header)
+        continue;
+      if (header->is_lazy())
+        ++message->lazy_headers_;
+      if (mode == PARSE_PASSTHROUGH) {
+        header->raw_.set(it.line_begin(),
+                         it.line_end() - it.line_begin());
+      }
+      message->push_back(header.Pass());
+    }
+  }
+
+  return message;
+}
+
+scoped_refptr<Message> Message::ParseBinary(const base::StringPiece &data) {
+  TRACE_EVENT1("sippet", "Message::ParseBinary", "size", data.size());
+  scoped_refptr<Message> message;
+  BinaryReader reader(data);
+  uint8 format, is_request;
+  if (!reader.ReadByte(&format) || kBinaryFormatVersion != format
+      || !reader.ReadByte(&is_request))
+    return message;
+
+  Version version;
+  if (is_request) {
+    uint8 method_type;
+    base::StringPiece method_name, request_uri;
+    if (!reader.ReadByte(&method_type) || method_type > Method::Unknown)
+      return message;
+    Method method(static_cast<Method::Type>(method_type));
+    if (Method::Unknown == method_type) {
+      if (!reader.ReadBytes(&method_name))
+        return message;
+      method = Method(method_name.as_string());
     }
+    if (!reader.ReadBytes(&request_uri) || !reader.ReadVersion(&version))
+      return message;
+    message = new Request(method, GURL(request_uri.as_string()),
+                          Message::Incoming, version);
+  } else {
+    uint64 code;
+    base::StringPiece reason_phrase;
+    if (!reader.ReadVarint(&code) || code > 999
+        || !reader.ReadBytes(&reason_phrase) || !reader.ReadVersion(&version))
+      return message;
+    message = new Response(static_cast<int>(code),
+                           reason_phrase.as_string(), Message::Incoming,
+                           version);
   }
 
+  // Lazy headers refer to their values in a copy of the input.
+  size_t offset = data.size() - reader.remaining().size();
+  message->received_.assign(data.data(), data.size());
+  reader = BinaryReader(base::StringPiece(message->received_).substr(offset));
+
+  message->arena_ = MessagePool::TakeArena();
+  Header::ScopedArena scoped_arena(message->arena_.get());
+  uint64 count;
+  if (!reader.ReadVarint(&count))
+    return NULL;
+  for (; count > 0; --count) {
+    uint8 type;
+    base::StringPiece name, value;
+    if (!reader.ReadByte(&type) || type > Header::HDR_GENERIC)
+      return NULL;
+    scoped_ptr<Header> header;
+    if (Header::HDR_GENERIC == type) {
+      if (!reader.ReadBytes(&name) || !reader.ReadBytes(&value))
+        return NULL;
+      header.reset(new Generic(name.as_string(), value.as_string()));
+    } else {
+      if (!reader.ReadBytes(&value))
+        return NULL;
+      header.reset(new LazyHeader(static_cast<Header::Type>(type),
+                                  value.data(), value.data() + value.size(),
+                                  false));
+      ++message->lazy_headers_;
+    }
+    message->push_back(header.Pass());
+  }
+
+  base::StringPiece content;
+  if (!reader.ReadBytes(&content) || !reader.remaining().empty())
+    return NULL;
+  if (!content.empty())
+    message->set_content(content.as_string());
   return message;
 }
 
+bool Message::Decode(iterator *where) const {
+  DCHECK((*where)->is_lazy());
+  const Header *lazy = &**where;
+  scoped_ptr<Header> header;
+  {
+    Header::ScopedArena scoped_arena(arena_.get());
+    header = lazy->Decode();
+  }
+  if (lazy_headers_ > 0)
+    --lazy_headers_;
+  if (!header) {
+    DVLOG(1) << "dropping invalid header";
+    IndexErasing(*where);
+    *where = headers_.erase(*where);
+    return false;
+  }
+  header->raw_ = lazy->raw_;
+  IndexReplaced(lazy, header.get());
+  *where = headers_.erase(*where);
+  *where = headers_.insert(*where, header.release());
+  return true;
+}
+
+void Message::DecodeAllSlow() const {
+  iterator i = headers_.begin(), ie = headers_.end();
+  while (i != ie) {
+    if (!i->is_lazy() || Decode(&i))
+      ++i;
+  }
+  lazy_headers_ = 0;
+}
+
 }  // namespace sippet
@@ -4,14 +4,207 @@
 
 #include "sippet/message/parser/tokenizer.h"
 
+#include "base/basictypes.h"
+#include "build/build_config.h"
+
+#if defined(ARCH_CPU_X86_FAMILY)
+#include <emmintrin.h>
+#if defined(COMPILER_MSVC)
+#include <intrin.h>
+#endif
+#endif
+
 namespace sippet {
 
-Tokenizer::Tokenizer(std::string::const_iterator string_begin,
-                     std::string::const_iterator string_end)
+namespace {
+
+// A set of characters, stored as a 256-bit bitmap, so that membership is a
+// single lookup regardless of the set size.
+class CharSet {
+ public:
+  explicit CharSet(const base::StringPiece &chars) {
+    memset(bits_, 0, sizeof(bits_));
+    for (base::StringPiece::const_iterator i = chars.begin(),
+         ie = chars.end(); i != ie; ++i) {
+      uint8 c = static_cast<uint8>(*i);
+      bits_[c >> 5] |= 1u << (c & 31);
+    }
+  }
+
+  bool Contains(char ch) const {
+    uint8 c = static_cast<uint8>(ch);
+    return (bits_[c >> 5] & (1u << (c & 31))) != 0;
+  }
+
+ private:
+  uint32 bits_[8];
+};
+
+template<bool kInSet>
+Tokenizer::const_iterator FindFirstScalar(Tokenizer::const_iterator begin,
+                                          Tokenizer::const_iterator end,
+                                          const base::StringPiece &chars) {
+  CharSet set(chars);
+  for (; begin != end; ++begin) {
+    if (set.Contains(*begin) == kInSet)
+      break;
+  }
+  return begin;
+}
+
+// Skips the well-formed multibyte sequence at |*position|, following table
+// 3-7 of the Unicode Standard, or returns false. The second byte range is
+// narrowed after E0, ED, F0 and F4, rejecting overlong forms, surrogates
+// and code points past U+10FFFF.
+bool SkipUtf8Sequence(const uint8 **position, const uint8 *end) {
+  const uint8 *p = *position;
+  uint8 lead = *p;
+  size_t length;
+  uint8 min_second = 0x80;
+  uint8 max_second = 0xbf;
+  if (lead >= 0xc2 && lead <= 0xdf) {
+    length = 2;
+  } else if (lead >= 0xe0 && lead <= 0xef) {
+    length = 3;
+    if (0xe0 == lead)
+      min_second = 0xa0;
+    else if (0xed == lead)
+      max_second = 0x9f;
+  } else if (lead >= 0xf0 && lead <= 0xf4) {
+    length = 4;
+    if (0xf0 == lead)
+      min_second = 0x90;
+    else if (0xf4 == lead)
+      max_second = 0x8f;
+  } else {
+    return false;
+  }
+  if (static_cast<size_t>(end - p) < length
+      || p[1] < min_second || p[1] > max_second)
+    return false;
+  for (size_t i = 2; i < length; ++i) {
+    if ((p[i] & 0xc0) != 0x80)
+      return false;
+  }
+  *position = p + length;
+  return true;
+}
+
+#if defined(ARCH_CPU_X86_FAMILY)
+
+// Larger sets are cheaper to match with the bitmap.
+const size_t kMaxVectorChars = 4;
+
+inline int CountTrailingZeros(uint32 mask) {
+#if defined(COMPILER_MSVC)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return static_cast<int>(index);
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+
+template<bool kInSet>
+Tokenizer::const_iterator FindFirst(Tokenizer::const_iterator begin,
+                                    Tokenizer::const_iterator end,
+                                    const base::StringPiece &chars) {
+  size_t count = chars.size();
+  if (count == 0 || count > kMaxVectorChars)
+    return FindFirstScalar<kInSet>(begin, end, chars);
+
+  __m128i needles[kMaxVectorChars];
+  for (size_t i = 0; i < count; ++i)
+    needles[i] = _mm_set1_epi8(chars[i]);
+
+  while (end - begin >= 16) {
+    __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+    __m128i matches = _mm_cmpeq_epi8(block, needles[0]);
+    for (size_t i = 1; i < count; ++i)
+      matches = _mm_or_si128(matches, _mm_cmpeq_epi8(block, needles[i]));
+    uint32 mask = static_cast<uint32>(_mm_movemask_epi8(matches));
+    if (!kInSet)
+      mask = ~mask & 0xffff;
+    if (mask != 0)
+      return begin + CountTrailingZeros(mask);
+    begin += 16;
+  }
+
+  // Tail, shorter than a vector
+  for (; begin != end; ++begin) {
+    if ((chars.find(*begin) != base::StringPiece::npos) == kInSet)
+      break;
+  }
+  return begin;
+}
+
+// Returns the first byte of [begin, end) with its high bit set, or |end|.
+const uint8 *SkipAscii(const uint8 *begin, const uint8 *end) {
+  while (end - begin >= 16) {
+    __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+    uint32 mask = static_cast<uint32>(_mm_movemask_epi8(block));
+    if (mask != 0)
+      return begin + CountTrailingZeros(mask);
+    begin += 16;
+  }
+  for (; begin != end && *begin < 0x80; ++begin) {}
+  return begin;
+}
+
+#else
+
+template<bool kInSet>
+Tokenizer::const_iterator FindFirst(Tokenizer::const_iterator begin,
+                                    Tokenizer::const_iterator end,
+                                    const base::StringPiece &chars) {
+  return FindFirstScalar<kInSet>(begin, end, chars);
+}
+
+const uint8 *SkipAscii(const uint8 *begin, const uint8 *end) {
+  for (; begin != end && *begin < 0x80; ++begin) {}
+  return begin;
+}
+
+#endif  // defined(ARCH_CPU_X86_FAMILY)
+
+}  // namespace
+
+Tokenizer::Tokenizer(const_iterator string_begin,
+                     const_iterator string_end)
   : current_(string_begin), end_(string_end) {
 }
 
 Tokenizer::~Tokenizer() {
 }
 
+Tokenizer::const_iterator Tokenizer::FindFirstOf(
+    const_iterator begin,
+    const_iterator end,
+    const base::StringPiece &chars) {
+  return FindFirst<true>(begin, end, chars);
+}
+
+Tokenizer::const_iterator Tokenizer::FindFirstNotOf(
+    const_iterator begin,
+    const_iterator end,
+    const base::StringPiece &chars) {
+  return FindFirst<false>(begin, end, chars);
+}
+
+Tokenizer::const_iterator Tokenizer::FindInvalidUtf8(const_iterator begin,
+                                                     const_iterator end) {
+  const uint8 *first = reinterpret_cast<const uint8*>(begin);
+  const uint8 *last = reinterpret_cast<const uint8*>(end);
+  const uint8 *p = first;
+  for (;;) {
+    p = SkipAscii(p, last);
+    if (p == last)
+      return end;
+    if (!SkipUtf8Sequence(&p, last))
+      return begin + (p - first);
+  }
+}
+
 }  // namespace sippet
@@ -5,6 +5,7 @@
 #ifndef SIPPET_MESSAGE_PARSER_TOKENIZER_H_
 #define SIPPET_MESSAGE_PARSER_TOKENIZER_H_
 
+#include <cstring>
 #include <string>
 #include "base/strings/string_piece.h"
 
@@ -12,41 +13,37 @@ namespace sippet {
 
 class Tokenizer {
 public:
-  Tokenizer(std::string::const_iterator string_begin,
-            std::string::const_iterator string_end);
+  typedef base::StringPiece::const_iterator const_iterator;
+
+  Tokenizer(const_iterator string_begin,
+            const_iterator string_end);
   ~Tokenizer();
 
-  std::string::const_iterator Skip(const base::StringPiece &chars) {
-    for (; current_ != end_; ++current_) {
-      if (chars.find(*current_) == std::string::npos)
-        break;
-    }
+  const_iterator Skip(const base::StringPiece &chars) {
+    current_ = FindFirstNotOf(current_, end_, chars);
     return current_;
   }
 
-  std::string::const_iterator SkipNotIn(const base::StringPiece &chars) {
-    for (; current_ != end_; ++current_) {
-      if (chars.find(*current_) != std::string::npos)
-        break;
-    }
+  const_iterator SkipNotIn(const base::StringPiece &chars) {
+    current_ = FindFirstOf(current_, end_, chars);
     return current_;
   }
 
-  std::string::const_iterator SkipTo(char c) {
-    for (; current_ != end_; ++current_) {
-      if (c == *current_)
-        break;
+  const_iterator SkipTo(char c) {
+    if (current_ != end_) {
+      const void *found = memchr(current_, c, end_ - current_);
+      current_ = found ? static_cast<const_iterator>(found) : end_;
     }
     return current_;
   }
 
-  std::string::const_iterator Skip() {
+  const_iterator Skip() {
     if (current_ != end_)
       ++current_;
     return current_;
   }
 
-  std::string::const_iterator Skip(int n) {
+  const_iterator Skip(int n) {
     for (; current_ != end_ && n > 0; --n)
       ++current_;
     return current_;
@@ -56,19 +53,40 @@ public:
     return current_ == end_;
   }
 
-  std::string::const_iterator current() const { return current_; }
-  void set_current(std::string::const_iterator current) {
+  const_iterator current() const { return current_; }
+  void set_current(const_iterator current) {
     current_ = current;
   }
 
-  std::string::const_iterator end() const { return end_; }
-  void set_end(std::string::const_iterator end) {
+  const_iterator end() const { return end_; }
+  void set_end(const_iterator end) {
     end_ = end;
   }
 
+  // Scanning kernels used by |Skip| and |SkipNotIn|: return the first
+  // character in [begin, end) that is (or is not) one of |chars|, or |end|.
+  // Short sets are matched 16 bytes at a time where SSE2 is available.
+  static const_iterator FindFirstOf(const_iterator begin,
+                                    const_iterator end,
+                                    const base::StringPiece &chars);
+  static const_iterator FindFirstNotOf(const_iterator begin,
+                                       const_iterator end,
+                                       const base::StringPiece &chars);
+
+  // Returns the first byte in [begin, end) not starting a well-formed UTF-8
+  // sequence (RFC 3629), or |end|: overlong forms, surrogates and code
+  // points past U+10FFFF are all rejected. ASCII runs are skipped 16 bytes
+  // at a time where SSE2 is available.
+  static const_iterator FindInvalidUtf8(const_iterator begin,
+                                        const_iterator end);
+
+  static bool IsValidUtf8(const base::StringPiece &string) {
+    return FindInvalidUtf8(string.begin(), string.end()) == string.end();
+  }
+
 private:
-  std::string::const_iterator current_;
-  std::string::const_iterator end_;
+  const_iterator current_;
+  const_iterator end_;
 };
 
 } // namespace sippet
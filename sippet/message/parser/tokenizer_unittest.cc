@@ -0,0 +1,95 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/message/parser/tokenizer.h"
+
+#include <string>
+
+#include "base/basictypes.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+Tokenizer::const_iterator NaiveFind(Tokenizer::const_iterator begin,
+                                    Tokenizer::const_iterator end,
+                                    const base::StringPiece &chars,
+                                    bool in_set) {
+  for (; begin != end; ++begin) {
+    if ((chars.find(*begin) != base::StringPiece::npos) == in_set)
+      break;
+  }
+  return begin;
+}
+
+}  // namespace
+
+TEST(Tokenizer, ScanningKernels) {
+  // Long enough to cross several vector blocks, with matches landing on
+  // every possible offset.
+  const std::string input =
+      " \t  sip:alice@atlanta.example.com;transport=tcp;lr \t,"
+      "<sip:proxy.example.com:5060;maddr=10.0.0.1>  \t ;tag=1928301774";
+  const char *sets[] = {
+    " \t", " \t;", ";", ",", " \t(;", "<>;,=@:", "abcdefghijklmnop", "",
+  };
+
+  for (size_t i = 0; i < arraysize(sets); ++i) {
+    for (size_t start = 0; start <= input.size(); ++start) {
+      Tokenizer::const_iterator begin = input.data() + start;
+      Tokenizer::const_iterator end = input.data() + input.size();
+      Tokenizer in(begin, end);
+      EXPECT_EQ(NaiveFind(begin, end, sets[i], true), in.SkipNotIn(sets[i]))
+          << "set " << i << ", offset " << start;
+      Tokenizer not_in(begin, end);
+      EXPECT_EQ(NaiveFind(begin, end, sets[i], false), not_in.Skip(sets[i]))
+          << "set " << i << ", offset " << start;
+    }
+  }
+}
+
+TEST(Tokenizer, SkipTo) {
+  const char input[] = "Alice <sip:alice@atlanta.example.com>;tag=88sja8x";
+  Tokenizer tok(input, input + arraysize(input) - 1);
+  EXPECT_EQ(input + 6, tok.SkipTo('<'));
+  EXPECT_EQ(input + 36, tok.SkipTo('>'));
+  EXPECT_EQ(input + 36, tok.SkipTo('>'));
+  EXPECT_EQ(tok.end(), tok.SkipTo('!'));
+  EXPECT_TRUE(tok.EndOfInput());
+  EXPECT_EQ(tok.end(), tok.SkipTo('<'));
+}
+
+TEST(Tokenizer, FindInvalidUtf8) {
+  // Padded past a vector block, so that multibyte sequences are found
+  // after the ASCII runs skipped 16 bytes at a time.
+  const std::string padding(19, 'a');
+  EXPECT_TRUE(Tokenizer::IsValidUtf8(""));
+  EXPECT_TRUE(Tokenizer::IsValidUtf8(padding));
+  EXPECT_TRUE(Tokenizer::IsValidUtf8(padding + "Jos\xc3\xa9 \xe2\x82\xac"
+                                     "\xed\x9f\xbf \xf0\x90\x80\x80"
+                                     "\xf4\x8f\xbf\xbf"));
+
+  const char *invalid[] = {
+    "\x80",              // Continuation byte alone
+    "\xc0\xaf",          // Overlong '/'
+    "\xe0\x9f\xbf",      // Overlong three byte form
+    "\xed\xa0\x80",      // Surrogate U+D800
+    "\xf4\x90\x80\x80",  // Past U+10FFFF
+    "\xf5\x80\x80\x80",
+    "\xe2\x82",          // Truncated
+    "\xc3(",
+  };
+  for (size_t i = 0; i < arraysize(invalid); ++i) {
+    for (size_t prefix = 0; prefix <= padding.size(); prefix += 3) {
+      std::string input(padding.substr(0, prefix) + invalid[i] + "zz");
+      EXPECT_EQ(input.data() + prefix,
+                Tokenizer::FindInvalidUtf8(input.data(),
+                                           input.data() + input.size()))
+          << "input " << i << ", offset " << prefix;
+    }
+  }
+}
+
+}  // namespace sippet
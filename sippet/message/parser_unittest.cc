@@ -3,7 +3,9 @@
 // found in the LICENSE file.
 
 #include <algorithm>
+#include <cstring>
 #include "sippet/message/message.h"
+#include "sippet/message/parse_profile.h"
 #include "sippet/uri/uri.h"
 #include "testing/gtest/include/gtest/gtest.h"
 
@@ -318,6 +320,256 @@ TEST(SimpleMessages, Bye) {
   ASSERT_TRUE(isa<Request>(message));
 }
 
+TEST(SimpleMessages, ParseInPlace) {
+  // The parser must not read past the given piece, and must stop at the
+  // empty line that ends the header block.
+  const char buffer[] =
+    "\r\n\r\n"
+    "OPTIONS sip:carol@chicago.com SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bKhjhs8ass877\r\n"
+    "Subject: folded\r\n"
+    " subject\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n"
+    "Max-Forwards: 70\r\n"
+    "garbage";
+
+  base::StringPiece raw_message(buffer, sizeof(buffer) - 1 - 7);
+  scoped_refptr<Message> message = Message::Parse(raw_message);
+  ASSERT_TRUE(isa<Request>(message));
+
+  scoped_refptr<Request> request = dyn_cast<Request>(message);
+  EXPECT_EQ(Method::OPTIONS, request->method());
+  EXPECT_EQ(GURL("sip:carol@chicago.com"), request->request_uri());
+
+  Subject *subject = request->get<Subject>();
+  ASSERT_TRUE(subject);
+  EXPECT_EQ("folded subject", subject->value());
+
+  EXPECT_TRUE(request->get<ContentLength>());
+  EXPECT_FALSE(request->get<MaxForwards>());
+}
+
+TEST(SimpleMessages, LazyParse) {
+  const char message_string[] =
+    "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds\r\n"
+    "Max-Forwards: 70\r\n"
+    "To: Bob <sip:bob@biloxi.com>\r\n"
+    "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+    "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+    "CSeq: 314159 INVITE\r\n"
+    "Expires: invalid\r\n"
+    "X-Custom: custom value\r\n"
+    "Contact: <sip:alice@pc33.atlanta.com>\r\n"
+    "\r\n";
+
+  scoped_refptr<Message> message =
+      Message::Parse(message_string, Message::PARSE_LAZY);
+  ASSERT_TRUE(isa<Request>(message));
+
+  // Headers are kept raw until looked up.
+  EXPECT_EQ(10u, message->size());
+
+  Via *via = message->get<Via>();
+  ASSERT_TRUE(via);
+  EXPECT_FALSE(via->is_lazy());
+  EXPECT_EQ("z9hG4bK776asdhds", via->front().branch());
+
+  Cseq *cseq = message->get<Cseq>();
+  ASSERT_TRUE(cseq);
+  EXPECT_EQ(314159u, cseq->sequence());
+  EXPECT_EQ(Method::INVITE, cseq->method());
+
+  // Invalid headers are dropped once decoded.
+  EXPECT_FALSE(message->get<Expires>());
+  EXPECT_EQ(9u, message->size());
+
+  // Walking the whole header list decodes everything else.
+  for (Message::iterator i = message->begin(), ie = message->end();
+       i != ie; ++i) {
+    EXPECT_FALSE(i->is_lazy());
+  }
+  Contact *contact = message->get<Contact>();
+  ASSERT_TRUE(contact);
+  EXPECT_EQ(GURL("sip:alice@pc33.atlanta.com"), contact->front().address());
+}
+
+TEST(SimpleMessages, ParseProfile) {
+  const char message_string[] =
+    "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds\r\n"
+    "Max-Forwards: invalid\r\n"
+    "To: Bob <sip:bob@biloxi.com>\r\n"
+    "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+    "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+    "CSeq: 314159 INVITE\r\n"
+    "Expires: invalid\r\n"
+    "\r\n";
+
+  ParseProfile profile(ParseProfile::LoadBalancer());
+  EXPECT_TRUE(profile.IsEager(Header::HDR_VIA));
+  EXPECT_FALSE(profile.IsEager(Header::HDR_EXPIRES));
+  EXPECT_FALSE(profile.IsEager(Header::HDR_GENERIC));
+
+  scoped_refptr<Message> message =
+      Message::Parse(message_string, Message::PARSE_LAZY, profile);
+  ASSERT_TRUE(isa<Request>(message));
+
+  // Headers in the profile are decoded while parsing, so the invalid
+  // Max-Forwards is already gone, while the invalid Expires is kept raw.
+  EXPECT_EQ(6u, message->size());
+  EXPECT_FALSE(message->get<MaxForwards>());
+
+  const Message *const_message = message.get();
+  const Via *via = const_message->get<Via>();
+  ASSERT_TRUE(via);
+  EXPECT_FALSE(via->is_lazy());
+  EXPECT_EQ("z9hG4bK776asdhds", via->front().branch());
+
+  // The others are still decoded on demand.
+  EXPECT_FALSE(message->get<Expires>());
+  EXPECT_EQ(5u, message->size());
+  From *from = message->get<From>();
+  ASSERT_TRUE(from);
+  EXPECT_EQ("1928301774", from->tag());
+
+  // Eager parsing decodes everything, whatever the profile.
+  message = Message::Parse(message_string, Message::PARSE_EAGER,
+                           ParseProfile());
+  ASSERT_TRUE(isa<Request>(message));
+  EXPECT_EQ(5u, message->size());
+}
+
+TEST(SimpleMessages, AddressesKeptAsText) {
+  const char message_string[] =
+    "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+    "Record-Route: <sip:p2.example.com;lr>, <sip:p1.example.com;lr>\r\n"
+    "To: Bob <sip:bob@biloxi.com>\r\n"
+    "From: \"Alice\" <SIP:alice@atlanta.com>;tag=1928301774\r\n"
+    "\r\n";
+  scoped_refptr<Message> message = Message::Parse(message_string);
+  ASSERT_TRUE(isa<Request>(message));
+
+  // Addresses never read are printed as received.
+  From *from = message->get<From>();
+  ASSERT_TRUE(from);
+  std::string printed(message->ToString());
+  EXPECT_NE(std::string::npos, printed.find("<SIP:alice@atlanta.com>"));
+
+  // And are canonicalized once read.
+  EXPECT_EQ(GURL("sip:alice@atlanta.com"), from->address());
+  EXPECT_EQ("1928301774", from->tag());
+  EXPECT_NE(std::string::npos,
+            message->ToString().find("<sip:alice@atlanta.com>"));
+
+  RecordRoute *record_route = message->get<RecordRoute>();
+  ASSERT_TRUE(record_route);
+  RecordRoute::iterator i = record_route->begin();
+  ASSERT_NE(record_route->end(), i);
+  EXPECT_TRUE(i->sip_address().is_valid());
+  EXPECT_EQ("p2.example.com", i->sip_address().host());
+  ++i;
+  ASSERT_NE(record_route->end(), i);
+  EXPECT_EQ(GURL("sip:p1.example.com;lr"), i->address());
+
+  // Copies keep the address as text.
+  RouteParam copy(*record_route->begin());
+  EXPECT_EQ(GURL("sip:p2.example.com;lr"), copy.address());
+
+  copy.set_address(GURL("sip:p3.example.com;lr"));
+  EXPECT_EQ("p3.example.com", copy.sip_address().host());
+}
+
+TEST(SimpleMessages, PassthroughParse) {
+  const char message_string[] =
+    "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+    "via:SIP/2.0/UDP  pc33.atlanta.com ;branch=z9hG4bK776asdhds\r\n"
+    "Max-Forwards:   70\r\n"
+    "t: Bob <sip:bob@biloxi.com>\r\n"
+    "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+    "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+    "CSeq:314159   INVITE\r\n"
+    "X-Custom: custom\r\n"
+    "  value\r\n"
+    "\r\n";
+
+  std::string input(message_string);
+  scoped_refptr<Message> message =
+      Message::Parse(input, Message::PARSE_PASSTHROUGH);
+  ASSERT_TRUE(isa<Request>(message));
+  // The message doesn't refer to its input.
+  input.assign(input.size(), 'x');
+
+  // Const lookups leave headers as received.
+  const Message *const_message = message.get();
+  const Cseq *cseq = const_message->get<Cseq>();
+  ASSERT_TRUE(cseq);
+  EXPECT_EQ(314159u, cseq->sequence());
+  EXPECT_EQ("CSeq:314159   INVITE", cseq->raw().as_string());
+  EXPECT_EQ("INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+            "via:SIP/2.0/UDP  pc33.atlanta.com ;branch=z9hG4bK776asdhds\r\n"
+            "Max-Forwards:   70\r\n"
+            "t: Bob <sip:bob@biloxi.com>\r\n"
+            "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+            "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+            "CSeq:314159   INVITE\r\n"
+            "X-Custom: custom\r\n"
+            "  value\r\n"
+            "Content-Length: 0\r\n"
+            "\r\n", message->ToString());
+
+  // Headers handed out for writing are printed from their parsed form.
+  MaxForwards *max_forwards = message->get<MaxForwards>();
+  ASSERT_TRUE(max_forwards);
+  EXPECT_TRUE(max_forwards->raw().empty());
+  max_forwards->set_value(69);
+  std::string forwarded(message->ToString());
+  EXPECT_NE(std::string::npos, forwarded.find("\r\nMax-Forwards: 69\r\n"));
+  EXPECT_NE(std::string::npos, forwarded.find(
+      "\r\nvia:SIP/2.0/UDP  pc33.atlanta.com ;branch=z9hG4bK776asdhds\r\n"));
+
+  // Walking the header list for writing drops all original bytes.
+  for (Message::iterator i = message->begin(), ie = message->end();
+       i != ie; ++i) {
+    EXPECT_TRUE(i->raw().empty());
+  }
+  EXPECT_NE(std::string::npos,
+            message->ToString().find("\r\nVia: SIP/2.0/UDP"));
+}
+
+TEST(Headers, Names) {
+  struct {
+    const char *name;
+    Header::Type type;
+  } cases[] = {
+    { "Via", Header::HDR_VIA },
+    { "vIA", Header::HDR_VIA },
+    { "v", Header::HDR_VIA },
+    { "V", Header::HDR_VIA },
+    { "Call-ID", Header::HDR_CALL_ID },
+    { "call-id", Header::HDR_CALL_ID },
+    { "WWW-Authenticate", Header::HDR_WWW_AUTHENTICATE },
+    { "Accept", Header::HDR_ACCEPT },
+    // Unknown names, including prefixes of known ones
+    { "Vi", Header::HDR_GENERIC },
+    { "Viaa", Header::HDR_GENERIC },
+    { "Accep", Header::HDR_GENERIC },
+    { "X-Custom", Header::HDR_GENERIC },
+    { "q", Header::HDR_GENERIC },
+  };
+
+  for (size_t i = 0; i < arraysize(cases); ++i) {
+    EXPECT_EQ(cases[i].type,
+              AtomTraits<Header::Type>::coerce(cases[i].name));
+    // Names are not required to be null terminated.
+    std::string padded(cases[i].name);
+    padded += "-Suffix";
+    EXPECT_EQ(cases[i].type, AtomTraits<Header::Type>::coerce(
+        padded.data(), strlen(cases[i].name)));
+  }
+}
+
 TEST(Headers, Contact) {
   struct {
     const char *input;
@@ -385,4 +637,119 @@ TEST(Headers, Via) {
   }
 }
 
+TEST(Headers, StackedVias) {
+  const char kVias[] =
+      "Via: SIP/2.0/UDP p1.example.com;branch=z9hG4bK1,"
+      " SIP/2.0/TCP p2.example.com;branch=z9hG4bK2 ,"
+      "SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK3";
+  scoped_ptr<Header> header(Header::Parse(kVias));
+  ASSERT_TRUE(isa<Via>(header));
+  Via *via = dyn_cast<Via>(header);
+
+  // The next values are left as received, and printed verbatim.
+  EXPECT_EQ("SIP/2.0/TCP p2.example.com;branch=z9hG4bK2 ,"
+            "SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK3",
+            via->unparsed_values());
+  EXPECT_EQ(3u, via->size());
+  EXPECT_EQ("p1.example.com", via->front().sent_by().host());
+  EXPECT_EQ("v: SIP/2.0/UDP p1.example.com:5060;rport;branch=z9hG4bK1, "
+            "SIP/2.0/TCP p2.example.com;branch=z9hG4bK2 ,"
+            "SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK3",
+            via->ToString());
+
+  // Popping the topmost value parses the next one only.
+  via->pop_front();
+  EXPECT_EQ(2u, via->size());
+  EXPECT_EQ("p2.example.com", via->front().sent_by().host());
+  EXPECT_EQ(Protocol::TCP, via->front().protocol());
+  EXPECT_EQ("SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK3",
+            via->unparsed_values());
+
+  // Walking them parses them all.
+  Via::const_iterator last = --via->end();
+  EXPECT_EQ("pc33.atlanta.com", last->sent_by().host());
+  EXPECT_EQ("z9hG4bK3", last->branch());
+  EXPECT_TRUE(via->unparsed_values().empty());
+  EXPECT_EQ(2u, via->size());
+
+  // Malformed values are dropped once parsed.
+  header = Header::Parse("Via: SIP/2.0/UDP p1.example.com, bad");
+  via = dyn_cast<Via>(header);
+  ASSERT_TRUE(via);
+  EXPECT_EQ(2u, via->size());
+  via->pop_front();
+  EXPECT_TRUE(via->empty());
+}
+
+TEST(Headers, Integers) {
+  scoped_ptr<Header> header(Header::Parse("Content-Length:  1234 "));
+  ASSERT_TRUE(isa<ContentLength>(header));
+  EXPECT_EQ(1234u, dyn_cast<ContentLength>(header)->value());
+
+  header = Header::Parse("CSeq: 2147483647 INVITE");
+  ASSERT_TRUE(isa<Cseq>(header));
+  EXPECT_EQ(2147483647u, dyn_cast<Cseq>(header)->sequence());
+  EXPECT_EQ(Method::INVITE, dyn_cast<Cseq>(header)->method());
+
+  header = Header::Parse("RSeq: 988789");
+  ASSERT_TRUE(isa<RSeq>(header));
+  EXPECT_EQ(988789u, dyn_cast<RSeq>(header)->value());
+
+  header = Header::Parse("RAck: 776656 1 INVITE");
+  ASSERT_TRUE(isa<RAck>(header));
+  EXPECT_EQ(776656u, dyn_cast<RAck>(header)->response_num());
+  EXPECT_EQ(1u, dyn_cast<RAck>(header)->sequence());
+  EXPECT_EQ(Method::INVITE, dyn_cast<RAck>(header)->method());
+
+  header = Header::Parse("Retry-After: 18000;duration=3600");
+  ASSERT_TRUE(isa<RetryAfter>(header));
+  EXPECT_EQ(18000u, dyn_cast<RetryAfter>(header)->value());
+
+  header = Header::Parse("x: 4000 ;refresher=uas");
+  ASSERT_TRUE(isa<SessionExpires>(header));
+  EXPECT_EQ(4000u, dyn_cast<SessionExpires>(header)->value());
+  EXPECT_EQ("uas", dyn_cast<SessionExpires>(header)->refresher());
+
+  header = Header::Parse("Min-SE: 90");
+  ASSERT_TRUE(isa<MinSE>(header));
+  EXPECT_EQ(90u, dyn_cast<MinSE>(header)->value());
+
+  header = Header::Parse("Timestamp: 54 0.5");
+  ASSERT_TRUE(isa<Timestamp>(header));
+  EXPECT_EQ(54, dyn_cast<Timestamp>(header)->timestamp());
+  EXPECT_EQ(0.5, dyn_cast<Timestamp>(header)->delay());
+
+  const char *invalid[] = {
+    "Content-Length: ",
+    "Content-Length: -1",
+    "Content-Length: +1",
+    "Content-Length: 12a",
+    "Max-Forwards: 2147483648",
+    "CSeq: 99999999999 INVITE",
+    "RAck: 776656 INVITE",
+    "Expires: 0x10",
+  };
+  for (size_t i = 0; i < arraysize(invalid); ++i)
+    EXPECT_FALSE(Header::Parse(invalid[i]).get()) << invalid[i];
+}
+
+TEST(Headers, TrimmedUtf8) {
+  scoped_ptr<Header> header(
+      Header::Parse("Subject: \t Reuni\xc3\xa3o de equipe  "));
+  ASSERT_TRUE(isa<Subject>(header));
+  EXPECT_EQ("Reuni\xc3\xa3o de equipe", dyn_cast<Subject>(header)->value());
+
+  header = Header::Parse("User-Agent:   ");
+  ASSERT_TRUE(isa<UserAgent>(header));
+  EXPECT_EQ("", dyn_cast<UserAgent>(header)->value());
+
+  const char *invalid[] = {
+    "Subject: Reuni\xe3o",
+    "Organization: Boxes by Bob \xed\xa0\x80",
+    "Server: \xc0\xaf" "bin",
+  };
+  for (size_t i = 0; i < arraysize(invalid); ++i)
+    EXPECT_FALSE(Header::Parse(invalid[i]).get()) << invalid[i];
+}
+
 }  // namespace sippet
@@ -6,6 +6,7 @@
 
 #include <string>
 
+#include "sippet/base/raw_ostream.h"
 #include "sippet/base/tags.h"
 #include "net/base/net_errors.h"
 #include "base/guid.h"
@@ -15,17 +16,17 @@ namespace sippet {
 Request::Request(const Method &method,
                  const GURL &request_uri,
                  const Version &version)
-  : Message(true, Outgoing), method_(method), request_uri_(request_uri),
-    version_(version), time_stamp_(base::Time::Now()),
-    id_(base::GenerateGUID()) {}
+  : Message(true, Outgoing), method_(method), id_(base::GenerateGUID()),
+    request_uri_(request_uri), sip_request_uri_parsed_(false),
+    version_(version), time_stamp_(base::Time::Now()) {}
 
 Request::Request(const Method &method,
                  const GURL &request_uri,
                  Direction direction,
                  const Version &version)
-  : Message(true, direction), method_(method), request_uri_(request_uri),
-    version_(version), time_stamp_(base::Time::Now()),
-    id_(base::GenerateGUID()) {}
+  : Message(true, direction), method_(method), id_(base::GenerateGUID()),
+    request_uri_(request_uri), sip_request_uri_parsed_(false),
+    version_(version), time_stamp_(base::Time::Now()) {}
 
 Request::~Request() {}
 
@@ -35,6 +36,7 @@ Method Request::method() const {
 
 void Request::set_method(const Method &method) {
   method_ = method;
+  InvalidateCache();
 }
 
 GURL Request::request_uri() const {
@@ -43,6 +45,16 @@ GURL Request::request_uri() const {
 
 void Request::set_request_uri(const GURL &request_uri) {
   request_uri_ = request_uri;
+  sip_request_uri_parsed_ = false;
+  InvalidateCache();
+}
+
+const SipURI &Request::sip_request_uri() const {
+  if (!sip_request_uri_parsed_) {
+    sip_request_uri_ = SipURI(request_uri_);
+    sip_request_uri_parsed_ = true;
+  }
+  return sip_request_uri_;
 }
 
 Version Request::version() const {
@@ -51,15 +63,15 @@ Version Request::version() const {
 
 void Request::set_version(const Version &version) {
   version_ = version;
+  InvalidateCache();
 }
 
-void Request::print(raw_ostream &os) const {
+void Request::PrintStartLine(raw_ostream &os) const {
   os << method_.str() << " "
      << request_uri_.spec() << " "
      << "SIP/" << version_.major_value()
      << "." << version_.minor_value()
      << "\r\n";
-  Message::print(os);
 }
 
 std::string Request::GetDialogId() const {
@@ -88,7 +100,7 @@ scoped_refptr<Request> Request::CloneRequest() const {
     result->push_back(i->Clone().Pass());
   }
   if (has_content())
-    result->set_content(content());
+    result->set_content(shared_content());
   Message::iterator j = result->find_first<Cseq>();
   if (result->end() != j) {
     Cseq *cseq = dyn_cast<Cseq>(j);
@@ -102,9 +114,11 @@ scoped_refptr<Response> Request::CreateResponse(
     const std::string &reason_phrase) {
   scoped_refptr<Response> response(
       CreateResponseInternal(response_code, reason_phrase));
-  To *to = response->get<To>();
+  // Look it up for writing only when needed, as it's shared.
+  const Response *const_response = response.get();
+  const To *to = const_response ? const_response->get<To>() : 0;
   if (response_code > 100 && to && !to->HasTag())
-    to->set_tag(CreateTag());
+    response->get<To>()->set_tag(CreateTag());
   return response;
 }
 
@@ -112,8 +126,46 @@ scoped_refptr<Response> Request::CreateResponse(StatusCode code) {
   return CreateResponse(static_cast<int>(code), GetReasonPhrase(code));
 }
 
+scoped_refptr<Response> Request::CreateCannedResponse(StatusCode code) {
+  DCHECK(SIP_TRYING == code
+         || (SIP_OK == code && Method::OPTIONS == method()));
+  if (Message::Incoming != direction()) {
+    DVLOG(1) << "Trying to create a response from an outgoing request";
+    return 0;
+  }
+  const Request *const_this = this;
+  if (SIP_TRYING == code && const_this->get<Timestamp>())
+    return CreateResponse(code);
+  const To *to = const_this->get<To>();
+  bool needs_tag = SIP_TRYING != code && to && !to->HasTag();
+
+  scoped_refptr<Response> response(
+      new Response(code, GetReasonPhrase(code), Message::Outgoing));
+  raw_string_ostream os(response->canned_headers_);
+  Header::ScopedPrintStyle scoped_print_style(response->print_style());
+  for (const_iterator i = headers_.begin(), ie = headers_.end();
+       i != ie; ++i) {
+    if (!isa<Via>(i) && !isa<From>(i) && !isa<To>(i) && !isa<CallId>(i)
+        && !isa<Cseq>(i) && !isa<RecordRoute>(i))
+      continue;
+    const base::StringPiece &raw = i->raw();
+    if (!raw.empty())
+      os.write(raw.data(), raw.size());
+    else
+      i->print(os);
+    if (needs_tag && isa<To>(i)) {
+      os << ";tag=" << CreateTag();
+      needs_tag = false;
+    }
+    os << "\r\n";
+  }
+  os.flush();
+  response->set_refer_to(this);
+  return response;
+}
+
 int Request::CreateAck(const std::string &remote_tag,
-                       scoped_refptr<Request> &ack) {
+                       scoped_refptr<Request> &ack) const {
   if (Method::INVITE != method()) {
     DVLOG(1) << "Cannot create an ACK from a non-INVITE request";
     return net::ERR_NOT_IMPLEMENTED;
@@ -130,22 +182,26 @@ int Request::CreateAck(const std::string &remote_tag,
     return net::ERR_UNEXPECTED;
   }
   ack = new Request(Method::ACK, request_uri());
-  CloneTo<Via>(ack.get());
+  ShareTopmostVia(ack.get());
   scoped_ptr<MaxForwards> max_forwards(new MaxForwards(70));
   ack->push_back(max_forwards.Pass());
-  CloneTo<From>(ack.get());
-  scoped_ptr<To> to(Clone<To>().Pass());
-  if (to && remote_tag.length() > 0) to->set_tag(remote_tag);
-  ack->push_back(to.Pass());
-  CloneTo<CallId>(ack.get());
+  ShareTo<From>(ack.get());
+  if (remote_tag.length() > 0) {
+    scoped_ptr<To> to(Clone<To>().Pass());
+    if (to) to->set_tag(remote_tag);
+    ack->push_back(to.Pass());
+  } else {
+    ShareTo<To>(ack.get());
+  }
+  ShareTo<CallId>(ack.get());
   scoped_ptr<Cseq> cseq(Clone<Cseq>().Pass());
   if (cseq) cseq->set_method(Method::ACK);
   ack->push_back(cseq.Pass());
-  CloneTo<Route>(ack.get());
+  ShareTo<Route>(ack.get());
   return net::OK;
 }
 
-int Request::CreateCancel(scoped_refptr<Request> &cancel) {
+int Request::CreateCancel(scoped_refptr<Request> &cancel) const {
   if (Method::INVITE != method()) {
     DVLOG(1) << "Cannot create an ACK from a non-INVITE request";
     return net::ERR_NOT_IMPLEMENTED;
@@ -162,19 +218,35 @@ int Request::CreateCancel(scoped_refptr<Request> &cancel) {
     return net::ERR_UNEXPECTED;
   }
   cancel = new Request(Method::CANCEL, request_uri());
-  CloneTo<Via>(cancel.get());
+  ShareTopmostVia(cancel.get());
   scoped_ptr<MaxForwards> max_forwards(new MaxForwards(70));
   cancel->push_back(max_forwards.Pass());
-  CloneTo<From>(cancel.get());
-  CloneTo<To>(cancel.get());
-  CloneTo<CallId>(cancel.get());
+  ShareTo<From>(cancel.get());
+  ShareTo<To>(cancel.get());
+  ShareTo<CallId>(cancel.get());
   scoped_ptr<Cseq> cseq(Clone<Cseq>());
   if (cseq) cseq->set_method(Method::CANCEL);
   cancel->push_back(cseq.Pass());
-  CloneTo<Route>(cancel.get());
+  ShareTo<Route>(cancel.get());
   return net::OK;
 }
 
+void Request::ShareTopmostVia(Request *request) const {
+  const_iterator topmost_via = find_first<Via>();
+  if (end() == topmost_via)
+    return;
+  const Via *via = dyn_cast<Via>(topmost_via);
+  if (1 == via->size()) {
+    request->PushShared(Lend(via));
+    return;
+  }
+  // Only the topmost value, leaving out the ones of the previous hops
+  // (RFC 3261 sections 9.1 and 17.1.1.3).
+  scoped_ptr<Via> topmost(new Via);
+  topmost->push_back(via->front());
+  request->push_back(topmost.Pass());
+}
+
 scoped_refptr<Response> Request::CreateResponseInternal(
     int response_code,
     const std::string &reason_phrase) {
@@ -184,11 +256,11 @@ scoped_refptr<Response> Request::CreateResponseInternal(
   }
   scoped_refptr<Response> response(
       new Response(response_code, reason_phrase, Message::Outgoing));
-  CloneTo<Via>(response.get());
-  CloneTo<From>(response.get());
-  CloneTo<To>(response.get());
-  CloneTo<CallId>(response.get());
-  CloneTo<Cseq>(response.get());
+  ShareTo<Via>(response.get());
+  ShareTo<From>(response.get());
+  ShareTo<To>(response.get());
+  ShareTo<CallId>(response.get());
+  ShareTo<Cseq>(response.get());
   if (response_code == 100) {
     scoped_ptr<Timestamp> timestamp(Clone<Timestamp>());
     if (timestamp) {
@@ -197,7 +269,7 @@ scoped_refptr<Response> Request::CreateResponseInternal(
       response->push_back(timestamp.Pass());
     }
   }
-  CloneTo<RecordRoute>(response.get());
+  ShareTo<RecordRoute>(response.get());
   response->set_refer_to(this);
   return response;
 }
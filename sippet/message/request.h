@@ -9,6 +9,7 @@
 #include "sippet/message/method.h"
 #include "sippet/message/version.h"
 #include "sippet/message/status_code.h"
+#include "sippet/uri/uri.h"
 #include "url/gurl.h"
 #include "base/time/time.h"
 
@@ -34,11 +35,13 @@ class Request :
   GURL request_uri() const;
   void set_request_uri(const GURL &request_uri);
 
+  // The Request-URI as a |SipURI|, parsed on first use and kept until the
+  // Request-URI changes. It is invalid for schemes other than sip and sips.
+  const SipURI &sip_request_uri() const;
+
   Version version() const;
   void set_version(const Version &version);
 
-  void print(raw_ostream &os) const override;
-
   // Responses can be generated from incoming requests by using this method.
   // Headers |From|, |CallId|, |CSeq|, |Via| and |To| are copied from the
   // request. If the |To| header doesn't contain a tag, then a new random one
@@ -48,16 +51,27 @@ class Request :
   // response by using the internal timestamp value of the |Request| creation.
   // By default, any |RecordRoute| header available in the |Request| is copied
   // to the generated |Response|. Created responses have always |Outgoing|
-  // direction.
+  // direction. Copied headers are shared with the request until changed
+  // (see |Message::ShareTo|).
   scoped_refptr<Response> CreateResponse(
       int response_code,
       const std::string &reason_phrase);
   scoped_refptr<Response> CreateResponse(StatusCode code);
 
+  // Same as |CreateResponse|, for the responses sent the most: a 100
+  // (Trying), or a 200 (OK) to an OPTIONS. Instead of being added as
+  // headers, the headers copied from the request are printed right away,
+  // as received if kept (see |PARSE_PASSTHROUGH|), into the head of the
+  // response. Lookups on the response don't find them, so it must be sent
+  // as it is, by a server transaction. A 100 (Trying) to a request with a
+  // |Timestamp| is created by |CreateResponse| instead.
+  scoped_refptr<Response> CreateCannedResponse(StatusCode code);
+
   // A |Method::CANCEL| request can be created from an |Method::INVITE|
   // request by calling this method. Headers |Via|, |MaxForwards|, |From|,
   // |To|, |CallId|, |Cseq| and |Route| are populated from the current request.
-  int CreateCancel(scoped_refptr<Request> &cancel);
+  // Only the topmost |Via| value is copied, as for |CreateAck|.
+  int CreateCancel(scoped_refptr<Request> &cancel) const;
 
   // Get a the dialog identifier.
   std::string GetDialogId() const override;
@@ -67,6 +81,9 @@ class Request :
   // new requests for authentication purposes.
   scoped_refptr<Request> CloneRequest() const;
 
+ protected:
+  void PrintStartLine(raw_ostream &os) const override;
+
  private:
   friend class Dialog;
   friend class Message;
@@ -75,6 +92,8 @@ class Request :
   Method method_;
   std::string id_;
   GURL request_uri_;
+  mutable SipURI sip_request_uri_;
+  mutable bool sip_request_uri_parsed_;
   Version version_;
   base::Time time_stamp_;
 
@@ -88,9 +107,13 @@ class Request :
   // to be used by the transaction layer only. Headers |MaxForwards|, |From|,
   // |To|, |CallId|, |Cseq|, |Route| and |Via| are copied from the current
   // request. A |remote_tag| needs to collected from a |To::tag| contained on
-  // a final response to the initial |Method::INVITE| request.
+  // a final response to the initial |Method::INVITE| request. Only the
+  // topmost |Via| value is copied.
   int CreateAck(const std::string &remote_tag,
-                scoped_refptr<Request> &ack);
+                scoped_refptr<Request> &ack) const;
+
+  // Adds the topmost |Via| value of the current request to |request|.
+  void ShareTopmostVia(Request *request) const;
 
   scoped_refptr<Response> CreateResponseInternal(
       int response_code,
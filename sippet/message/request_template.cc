@@ -0,0 +1,173 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/message/request_template.h"
+
+#include "base/logging.h"
+#include "sippet/base/sequences.h"
+#include "sippet/base/tags.h"
+#include "sippet/message/headers.h"
+#include "sippet/message/static_header_block.h"
+
+namespace sippet {
+
+namespace {
+
+// Headers made anew or copied for each request, or added when it's sent.
+// Generic headers can't be shared (see |SharedHeader|).
+bool IsVariable(Header::Type type) {
+  switch (type) {
+    case Header::HDR_VIA:
+    case Header::HDR_CALL_ID:
+    case Header::HDR_CSEQ:
+    case Header::HDR_FROM:
+    case Header::HDR_EXPIRES:
+    case Header::HDR_AUTHORIZATION:
+    case Header::HDR_PROXY_AUTHORIZATION:
+    case Header::HDR_CONTENT_LENGTH:
+    case Header::HDR_GENERIC:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Headers never looked up on outgoing requests: static headers can't be.
+bool IsOpaque(Header::Type type) {
+  switch (type) {
+    case Header::HDR_ACCEPT:
+    case Header::HDR_ACCEPT_ENCODING:
+    case Header::HDR_ACCEPT_LANGUAGE:
+    case Header::HDR_ALLOW:
+    case Header::HDR_MAX_FORWARDS:
+    case Header::HDR_ORGANIZATION:
+    case Header::HDR_USER_AGENT:
+      return true;
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+RequestTemplate::Part::Part()
+  : header(NULL) {
+}
+
+RequestTemplate::Part::~Part() {
+}
+
+RequestTemplate::RequestTemplate(
+    const Request &prototype,
+    const scoped_refptr<StaticHeaderBlock> &base_headers)
+  : prototype_(prototype.CloneRequest()) {
+  scoped_refptr<StaticHeaderBlock> constant_headers(new StaticHeaderBlock);
+  if (base_headers.get())
+    constant_headers->Append(*base_headers);
+  else if (prototype.static_headers().get())
+    constant_headers->Append(*prototype.static_headers());
+
+  // The headers are all decoded by iterating, so that those lent are never
+  // replaced afterwards.
+  const Request *const_prototype = prototype_.get();
+  for (Message::const_iterator i = const_prototype->begin(),
+       ie = const_prototype->end(); i != ie; ++i) {
+    if (IsOpaque(i->type())) {
+      constant_headers->Add(*i);
+      continue;
+    }
+    Part part;
+    part.header = &*i;
+    if (!IsVariable(i->type()))
+      part.source = const_prototype->Lend(&*i);
+    parts_.push_back(part);
+  }
+  if (!constant_headers->empty())
+    constant_headers_ = constant_headers;
+}
+
+RequestTemplate::~RequestTemplate() {
+}
+
+scoped_refptr<Request> RequestTemplate::CreateRequest(unsigned local_sequence,
+                                                      int expires) const {
+  if (0 == local_sequence) {
+    local_sequence = Create16BitRandomInteger();
+    if (0 == local_sequence)
+      local_sequence = 1;
+  }
+  return Instantiate(CreateCallId(), CreateTag(), local_sequence, expires);
+}
+
+scoped_refptr<Request> RequestTemplate::CreateNextRequest(
+    const Request &previous,
+    int expires) const {
+  const CallId *call_id = previous.get<CallId>();
+  const From *from = previous.get<From>();
+  const Cseq *cseq = previous.get<Cseq>();
+  DCHECK(call_id && from && cseq);
+  return Instantiate(call_id->value(), from->tag(), cseq->sequence() + 1,
+                     expires);
+}
+
+scoped_refptr<Request> RequestTemplate::Instantiate(
+    const std::string &call_id,
+    const std::string &from_tag,
+    unsigned local_sequence,
+    int expires) const {
+  scoped_refptr<Request> request(new Request(prototype_->method(),
+      prototype_->request_uri(), prototype_->version()));
+  bool has_expires = false;
+  for (std::vector<Part>::const_iterator i = parts_.begin(),
+       ie = parts_.end(); i != ie; ++i) {
+    if (i->source.get()) {
+      request->PushShared(i->source);
+      continue;
+    }
+    switch (i->header->type()) {
+      case Header::HDR_CALL_ID: {
+        scoped_ptr<CallId> new_call_id(new CallId(call_id));
+        request->push_back(new_call_id.Pass());
+        break;
+      }
+      case Header::HDR_CSEQ: {
+        scoped_ptr<Cseq> cseq(new Cseq(local_sequence, prototype_->method()));
+        request->push_back(cseq.Pass());
+        break;
+      }
+      case Header::HDR_FROM: {
+        scoped_ptr<Header> header(i->header->Clone());
+        dyn_cast<From>(header.get())->set_tag(from_tag);
+        request->push_back(header.Pass());
+        break;
+      }
+      case Header::HDR_EXPIRES:
+        has_expires = true;
+        if (expires < 0) {
+          request->push_back(i->header->Clone());
+        } else {
+          scoped_ptr<Expires> new_expires(new Expires(expires));
+          request->push_back(new_expires.Pass());
+        }
+        break;
+      case Header::HDR_GENERIC:
+        request->push_back(i->header->Clone());
+        break;
+      default:
+        // Added when sent.
+        break;
+    }
+  }
+  if (expires >= 0 && !has_expires) {
+    scoped_ptr<Expires> new_expires(new Expires(expires));
+    request->push_back(new_expires.Pass());
+  }
+  if (prototype_->has_content())
+    request->set_content(prototype_->shared_content());
+  if (constant_headers_.get())
+    request->set_static_headers(constant_headers_);
+  return request;
+}
+
+} // End of sippet namespace
@@ -0,0 +1,84 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_MESSAGE_REQUEST_TEMPLATE_H_
+#define SIPPET_MESSAGE_REQUEST_TEMPLATE_H_
+
+#include <vector>
+
+#include "base/memory/ref_counted.h"
+#include "sippet/message/request.h"
+#include "sippet/message/shared_header.h"
+
+namespace sippet {
+
+class StaticHeaderBlock;
+
+// Stamps out requests sent over and over with the same headers, such as
+// registration refreshes, NOTIFYs or OPTIONS pings, without building them
+// again from scratch each time.
+//
+// The template is made once from a prototype request, and its headers are
+// split in three:
+//  - the headers that change with every request: Via, Call-ID, CSeq, the
+//    From tag, and the credentials and Content-Length, that are added when
+//    sending. The new request gets its own;
+//  - the headers the stack never looks up for sending, such as Max-Forwards
+//    or Allow, that are serialized once in a |StaticHeaderBlock|;
+//  - the others, such as To, Contact or Route, that are shared with the
+//    prototype (see |SharedHeader|), so that they are neither copied nor
+//    printed afresh until looked up for writing.
+//
+// Requests made from a template are independent of it, and can outlive it.
+// The template itself must be used from a single thread.
+class RequestTemplate {
+ public:
+  // The constant headers are serialized after |base_headers|, if any, such
+  // as the static request headers of the network layer: requests having
+  // static headers are sent without the default ones.
+  RequestTemplate(const Request &prototype,
+                  const scoped_refptr<StaticHeaderBlock> &base_headers);
+  ~RequestTemplate();
+
+  Method method() const { return prototype_->method(); }
+
+  // A new request, out of any call: it takes a new Call-ID and From tag.
+  // A zero |local_sequence| takes a random one. A negative |expires| keeps
+  // the Expires header of the prototype, if any.
+  scoped_refptr<Request> CreateRequest(unsigned local_sequence = 0,
+                                       int expires = -1) const;
+
+  // The request following |previous| in the same call, such as the refresh
+  // of a registration: the Call-ID and From tag are kept, and the CSeq is
+  // the next one.
+  scoped_refptr<Request> CreateNextRequest(const Request &previous,
+                                           int expires = -1) const;
+
+ private:
+  // A header of the prototype, in order. Only the shared ones have a
+  // |source|; the others are made anew for each request.
+  struct Part {
+    Part();
+    ~Part();
+
+    const Header *header;
+    scoped_refptr<SharedHeader::Source> source;
+  };
+
+  scoped_refptr<Request> Instantiate(const std::string &call_id,
+                                     const std::string &from_tag,
+                                     unsigned local_sequence,
+                                     int expires) const;
+
+  // Private copy of the prototype, never modified, lending its headers.
+  scoped_refptr<Request> prototype_;
+  std::vector<Part> parts_;
+  scoped_refptr<StaticHeaderBlock> constant_headers_;
+
+  DISALLOW_COPY_AND_ASSIGN(RequestTemplate);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_MESSAGE_REQUEST_TEMPLATE_H_
@@ -6,8 +6,16 @@
 
 #include <string>
 
+#include "base/strings/string_util.h"
+
 namespace sippet {
 
+namespace {
+
+const char k100relOptionTag[] = "100rel";
+
+}  // namespace
+
 Response::Response(int response_code,
     const std::string &reason_phrase,
     Direction direction,
@@ -20,13 +28,19 @@ Response::Response(int response_code,
 Response::~Response() {
 }
 
-void Response::print(raw_ostream &os) const {
+void Response::PrintStartLine(raw_ostream &os) const {
   os << "SIP/" << version_.major_value()
      << "." << version_.minor_value()
      << " " << response_code_
      << " " << reason_phrase_
      << "\r\n";
-  Message::print(os);
+}
+
+scoped_refptr<Response> Response::CreateRetransmission() const {
+  scoped_refptr<Response> response(
+      new Response(response_code_, reason_phrase_, direction(), version_));
+  response->ShareAllFrom(*this);
+  return response;
 }
 
 std::string Response::GetDialogId() const {
@@ -43,4 +57,19 @@ std::string Response::GetDialogId() const {
   return oss.str();
 }
 
+bool Response::IsReliableProvisional() const {
+  if (response_code_ <= 100 || response_code_ >= 200)
+    return false;
+  for (const_iterator i = find_first<Require>(), ie = end(); i != ie;
+       i = find_next<Require>(i)) {
+    const Require *require = dyn_cast<Require>(i);
+    for (Require::const_iterator j = require->begin(), je = require->end();
+         j != je; ++j) {
+      if (base::EqualsCaseInsensitiveASCII(*j, k100relOptionTag))
+        return true;
+    }
+  }
+  return false;
+}
+
 }  // namespace sippet
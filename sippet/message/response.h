@@ -12,6 +12,7 @@
 namespace sippet {
 
 namespace ua {
+class ForkContext;
 class UserAgent;
 } // namespace ua
 
@@ -29,23 +30,32 @@ public:
   int response_code() const { return response_code_; }
   void set_response_code(int response_code) {
     response_code_ = response_code;
+    InvalidateCache();
   }
 
   std::string reason_phrase() const { return reason_phrase_; }
   void set_reason_phrase(const std::string &reason_phrase) {
     reason_phrase_ = reason_phrase;
+    InvalidateCache();
   }
 
   Version version() const { return version_; }
   void set_version(const Version &version) {
     version_ = version;
+    InvalidateCache();
   }
 
-  void print(raw_ostream &os) const override;
-
   // Get a the dialog identifier.
   std::string GetDialogId() const override;
 
+  // Whether this is a provisional response other than 100 that has to be
+  // acknowledged with a PRACK, as it requires the 100rel extension
+  // (RFC 3262).
+  bool IsReliableProvisional() const;
+
+protected:
+  void PrintStartLine(raw_ostream &os) const override;
+
 private:
   ~Response() override;
 
@@ -55,8 +65,10 @@ private:
   friend class Request;
   friend class Message;
   friend class ClientTransactionImpl;
+  friend class ServerTransactionImpl;
   friend class AuthControllerTest;
   friend class ua::UserAgent;
+  friend class ua::ForkContext;
 
   Version version_;
   int response_code_;
@@ -71,6 +83,11 @@ private:
   void set_refer_to(const scoped_refptr<Request> &request) {
     refer_to_ = request;
   }
+
+  // A copy of this response for transactions to repeat once they release
+  // the request: it shares the headers and the serialized bytes of this
+  // one, but doesn't refer to the request.
+  scoped_refptr<Response> CreateRetransmission() const;
 };
 
 } // End of sippet namespace
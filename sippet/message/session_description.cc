@@ -0,0 +1,316 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/message/session_description.h"
+
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+
+namespace sippet {
+
+namespace {
+
+// Splits the next space-separated token out of |input|.
+bool NextToken(base::StringPiece *input, base::StringPiece *token) {
+  size_t begin = input->find_first_not_of(' ');
+  if (base::StringPiece::npos == begin)
+    return false;
+  input->remove_prefix(begin);
+  size_t end = input->find(' ');
+  if (base::StringPiece::npos == end)
+    end = input->size();
+  *token = input->substr(0, end);
+  input->remove_prefix(end);
+  return true;
+}
+
+// The line break ending |line|, if any.
+base::StringPiece LineBreak(const std::string &body,
+                            const SessionDescription::Line &line) {
+  size_t value_end = line.value.data() + line.value.size() - body.data();
+  return base::StringPiece(body.data() + value_end, line.end - value_end);
+}
+
+}  // namespace
+
+SessionDescription::Media::Media()
+  : port(0), port_count(1), first_line(0), end_line(0) {
+}
+
+SessionDescription::Media::~Media() {
+}
+
+SessionDescription::SessionDescription(
+    const scoped_refptr<base::RefCountedString> &body)
+  : body_(body) {
+}
+
+SessionDescription::~SessionDescription() {
+}
+
+scoped_ptr<SessionDescription> SessionDescription::Parse(
+    const scoped_refptr<base::RefCountedString> &body) {
+  DCHECK(body.get());
+  scoped_ptr<SessionDescription> description(new SessionDescription(body));
+  if (!description->ParseBody())
+    return scoped_ptr<SessionDescription>();
+  return description.Pass();
+}
+
+size_t SessionDescription::FindLine(size_t media_index, char type) const {
+  size_t begin, end;
+  GetRange(media_index, &begin, &end);
+  for (size_t i = begin; i < end; ++i) {
+    if (type == lines_[i].type)
+      return i;
+  }
+  return lines_.size();
+}
+
+bool SessionDescription::GetAttribute(size_t media_index,
+                                      const base::StringPiece &name,
+                                      base::StringPiece *value) const {
+  size_t begin, end;
+  GetRange(media_index, &begin, &end);
+  for (size_t i = begin; i < end; ++i) {
+    if ('a' != lines_[i].type || !lines_[i].value.starts_with(name))
+      continue;
+    base::StringPiece rest(lines_[i].value.substr(name.size()));
+    if (!rest.empty() && ':' != rest[0])
+      continue;
+    if (value)
+      *value = rest.empty() ? rest : rest.substr(1);
+    return true;
+  }
+  return false;
+}
+
+bool SessionDescription::GetConnection(size_t media_index,
+                                       Connection *connection) const {
+  DCHECK(connection);
+  size_t index = FindLine(media_index, 'c');
+  if (lines_.size() == index && kSessionLevel != media_index)
+    index = FindLine(kSessionLevel, 'c');
+  if (lines_.size() == index)
+    return false;
+  return ParseConnection(lines_[index].value, connection);
+}
+
+bool SessionDescription::ParseBody() {
+  const std::string &body = body_->data();
+  size_t begin = 0;
+  while (begin < body.size()) {
+    size_t end = body.find('\n', begin);
+    end = (std::string::npos == end) ? body.size() : end + 1;
+    base::StringPiece content(body.data() + begin, end - begin);
+    if (content.ends_with("\n"))
+      content.remove_suffix(1);
+    if (content.ends_with("\r"))
+      content.remove_suffix(1);
+    if (content.empty()) {
+      // Tolerates blank lines, such as a trailing one.
+      begin = end;
+      continue;
+    }
+    if (content.size() < 2 || '=' != content[1]
+        || content[0] < 'a' || content[0] > 'z')
+      return false;
+    Line line;
+    line.type = content[0];
+    line.value = content.substr(2);
+    line.begin = begin;
+    line.end = end;
+    if (lines_.empty() && 'v' != line.type)
+      return false;
+    if ('m' == line.type) {
+      if (!media_.empty())
+        media_.back().end_line = lines_.size();
+      Media media;
+      if (!ParseMedia(line.value, &media))
+        return false;
+      media.first_line = lines_.size();
+      media_.push_back(media);
+    }
+    lines_.push_back(line);
+    begin = end;
+  }
+  if (lines_.empty())
+    return false;
+  if (!media_.empty())
+    media_.back().end_line = lines_.size();
+  return true;
+}
+
+// static
+bool SessionDescription::ParseMedia(const base::StringPiece &value,
+                                    Media *media) {
+  base::StringPiece input(value);
+  base::StringPiece port;
+  if (!NextToken(&input, &media->media)
+      || !NextToken(&input, &port)
+      || !NextToken(&input, &media->protocol))
+    return false;
+  size_t slash = port.find('/');
+  if (base::StringPiece::npos != slash) {
+    if (!base::StringToInt(port.substr(slash + 1), &media->port_count))
+      return false;
+    port = port.substr(0, slash);
+  }
+  if (!base::StringToInt(port, &media->port))
+    return false;
+  base::StringPiece format;
+  while (NextToken(&input, &format))
+    media->formats.push_back(format);
+  return true;
+}
+
+// static
+bool SessionDescription::ParseConnection(const base::StringPiece &value,
+                                         Connection *connection) {
+  base::StringPiece input(value);
+  if (!NextToken(&input, &connection->network_type)
+      || !NextToken(&input, &connection->address_type)
+      || !NextToken(&input, &connection->address))
+    return false;
+  size_t slash = connection->address.find('/');
+  if (base::StringPiece::npos != slash)
+    connection->address = connection->address.substr(0, slash);
+  return true;
+}
+
+void SessionDescription::GetRange(size_t media_index,
+                                  size_t *begin,
+                                  size_t *end) const {
+  if (kSessionLevel == media_index) {
+    *begin = 0;
+    *end = session_end_line();
+  } else {
+    DCHECK_LT(media_index, media_.size());
+    *begin = media_[media_index].first_line;
+    *end = media_[media_index].end_line;
+  }
+}
+
+SessionDescription::Editor::Change::Change()
+  : removed(false), replaced(false) {
+}
+
+SessionDescription::Editor::Change::~Change() {
+}
+
+SessionDescription::Editor::Editor(const SessionDescription &description)
+  : description_(description) {
+}
+
+SessionDescription::Editor::~Editor() {
+}
+
+void SessionDescription::Editor::ReplaceLine(size_t index,
+                                             const std::string &value) {
+  DCHECK_LT(index, description_.lines().size());
+  Change *change = &changes_[index];
+  change->removed = false;
+  change->replaced = true;
+  change->value.assign(1, description_.lines()[index].type);
+  change->value += "=";
+  change->value += value;
+}
+
+void SessionDescription::Editor::RemoveLine(size_t index) {
+  DCHECK_LT(index, description_.lines().size());
+  Change *change = &changes_[index];
+  change->removed = true;
+  change->replaced = false;
+  change->value.clear();
+}
+
+void SessionDescription::Editor::InsertLine(size_t index,
+                                            char type,
+                                            const std::string &value) {
+  DCHECK_LE(index, description_.lines().size());
+  Change *change = &changes_[index];
+  change->inserted += type;
+  change->inserted += "=";
+  change->inserted += value;
+  change->inserted += "\r\n";
+}
+
+bool SessionDescription::Editor::SetConnectionAddress(
+    size_t media_index,
+    const std::string &address) {
+  size_t index = description_.FindLine(media_index, 'c');
+  if (description_.lines().size() == index)
+    return false;
+  const base::StringPiece &value = description_.lines()[index].value;
+  Connection connection;
+  if (!ParseConnection(value, &connection))
+    return false;
+  size_t address_end =
+      connection.address.data() + connection.address.size() - value.data();
+  std::string new_value;
+  connection.network_type.AppendToString(&new_value);
+  new_value += std::string::npos == address.find(':') ? " IP4 " : " IP6 ";
+  new_value += address;
+  value.substr(address_end).AppendToString(&new_value);
+  ReplaceLine(index, new_value);
+  return true;
+}
+
+void SessionDescription::Editor::SetMediaPort(size_t media_index, int port) {
+  DCHECK_LT(media_index, description_.media().size());
+  const Media &media = description_.media()[media_index];
+  const base::StringPiece &value =
+      description_.lines()[media.first_line].value;
+  std::string new_value;
+  media.media.AppendToString(&new_value);
+  new_value += " ";
+  new_value += base::IntToString(port);
+  if (1 != media.port_count) {
+    new_value += "/";
+    new_value += base::IntToString(media.port_count);
+  }
+  new_value += " ";
+  value.substr(media.protocol.data() - value.data())
+      .AppendToString(&new_value);
+  ReplaceLine(media.first_line, new_value);
+}
+
+std::string SessionDescription::Editor::Build() const {
+  const std::string &body = description_.body();
+  const std::vector<Line> &lines = description_.lines();
+  std::string result;
+  result.reserve(body.size() + 64);
+  // Start of the bytes copied as they are.
+  size_t untouched = 0;
+  for (std::map<size_t, Change>::const_iterator i = changes_.begin(),
+       ie = changes_.end(); i != ie; ++i) {
+    const Change &change = i->second;
+    if (lines.size() == i->first) {
+      result.append(body, untouched, std::string::npos);
+      untouched = body.size();
+      if (!result.empty() && '\n' != result[result.size() - 1])
+        result += "\r\n";
+      result += change.inserted;
+      continue;
+    }
+    const Line &line = lines[i->first];
+    result.append(body, untouched, line.begin - untouched);
+    result += change.inserted;
+    if (change.replaced) {
+      result += change.value;
+      base::StringPiece line_break(LineBreak(body, line));
+      if (line_break.empty())
+        result += "\r\n";
+      else
+        line_break.AppendToString(&result);
+    } else if (!change.removed) {
+      result.append(body, line.begin, line.end - line.begin);
+    }
+    untouched = line.end;
+  }
+  result.append(body, untouched, std::string::npos);
+  return result;
+}
+
+} // End of sippet namespace
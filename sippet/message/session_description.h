@@ -0,0 +1,163 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_MESSAGE_SESSION_DESCRIPTION_H_
+#define SIPPET_MESSAGE_SESSION_DESCRIPTION_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/memory/ref_counted.h"
+#include "base/memory/ref_counted_memory.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/strings/string_piece.h"
+
+namespace sippet {
+
+// A typed view of an SDP body (RFC 4566), such as the content of an INVITE
+// or its 200 (see |Message::shared_content|), for the services that anchor
+// media or rewrite the connection addresses.
+//
+// Parsing copies nothing: every line, and every field of the session and
+// media descriptions, is a |base::StringPiece| into the body, that is kept
+// alive by the view. Changes are made with an |Editor|, that builds the new
+// body by splicing the changed lines between the untouched bytes of the
+// original, instead of printing a whole model again.
+class SessionDescription {
+ public:
+  // Index standing for the session level, where a media index is expected.
+  static const size_t kSessionLevel = static_cast<size_t>(-1);
+
+  // A <type>=<value> line of the body.
+  struct Line {
+    char type;
+    base::StringPiece value;
+    // Offsets in the body of the line, line break included, and of the
+    // next line.
+    size_t begin;
+    size_t end;
+  };
+
+  // A media description: its m= line, then the lines until the next one.
+  struct Media {
+    Media();
+    ~Media();
+
+    base::StringPiece media;
+    int port;
+    // Number of ports, one unless given after the port.
+    int port_count;
+    base::StringPiece protocol;
+    std::vector<base::StringPiece> formats;
+    // Index of the m= line in |lines|, and of the line past the last one of
+    // the media description.
+    size_t first_line;
+    size_t end_line;
+  };
+
+  // The value of a c= line.
+  struct Connection {
+    base::StringPiece network_type;
+    base::StringPiece address_type;
+    // Without the TTL or number of multicast addresses.
+    base::StringPiece address;
+  };
+
+  // Builds a new body out of the lines of |description|. The description
+  // must outlive the editor, and lines are given by their index in it.
+  class Editor {
+   public:
+    explicit Editor(const SessionDescription &description);
+    ~Editor();
+
+    // Sets the value of the line at |index|, keeping its type.
+    void ReplaceLine(size_t index, const std::string &value);
+    void RemoveLine(size_t index);
+    // Lines inserted before the same index keep their order. Inserting at
+    // |lines().size()| appends to the body.
+    void InsertLine(size_t index, char type, const std::string &value);
+
+    // Sets the address of the c= line of the session level or of a media
+    // description, keeping its TTL if any. The address type follows the
+    // address. Returns false if there's no such line.
+    bool SetConnectionAddress(size_t media_index, const std::string &address);
+
+    // Sets the port of the media description at |media_index|.
+    void SetMediaPort(size_t media_index, int port);
+
+    // The body with the changes spliced in.
+    std::string Build() const;
+
+   private:
+    struct Change {
+      Change();
+      ~Change();
+
+      bool removed;
+      // The replaced value, with its type, if not removed.
+      bool replaced;
+      std::string value;
+      // The lines inserted before, with their types and line breaks.
+      std::string inserted;
+    };
+
+    const SessionDescription &description_;
+    std::map<size_t, Change> changes_;
+
+    DISALLOW_COPY_AND_ASSIGN(Editor);
+  };
+
+  ~SessionDescription();
+
+  // Returns NULL unless |body| is a well-formed SDP: <type>=<value> lines,
+  // starting with the v= one.
+  static scoped_ptr<SessionDescription> Parse(
+      const scoped_refptr<base::RefCountedString> &body);
+
+  const std::string &body() const { return body_->data(); }
+  const std::vector<Line> &lines() const { return lines_; }
+  const std::vector<Media> &media() const { return media_; }
+
+  // The lines before the first media description.
+  size_t session_end_line() const {
+    return media_.empty() ? lines_.size() : media_.front().first_line;
+  }
+
+  // Finds the first line of |type| at the session level or in a media
+  // description. Returns |lines().size()| if there's none.
+  size_t FindLine(size_t media_index, char type) const;
+
+  // Finds the a= line |name| of the session level or of a media
+  // description, and its value if any. Returns false if there's none.
+  bool GetAttribute(size_t media_index,
+                    const base::StringPiece &name,
+                    base::StringPiece *value) const;
+
+  // The c= line applying to a media description: its own, or else the one
+  // of the session level. Returns false if there's none, or if malformed.
+  bool GetConnection(size_t media_index, Connection *connection) const;
+
+ private:
+  explicit SessionDescription(
+      const scoped_refptr<base::RefCountedString> &body);
+
+  bool ParseBody();
+  static bool ParseMedia(const base::StringPiece &value, Media *media);
+  static bool ParseConnection(const base::StringPiece &value,
+                              Connection *connection);
+
+  // Line indexes covered by the session level or by a media description.
+  void GetRange(size_t media_index, size_t *begin, size_t *end) const;
+
+  scoped_refptr<base::RefCountedString> body_;
+  std::vector<Line> lines_;
+  std::vector<Media> media_;
+
+  DISALLOW_COPY_AND_ASSIGN(SessionDescription);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_MESSAGE_SESSION_DESCRIPTION_H_
@@ -0,0 +1,126 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/message/session_description.h"
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const char kOffer[] =
+    "v=0\r\n"
+    "o=alice 2890844526 2890844526 IN IP4 atlanta.com\r\n"
+    "s=-\r\n"
+    "c=IN IP4 192.0.2.101\r\n"
+    "t=0 0\r\n"
+    "a=sendrecv\r\n"
+    "m=audio 49172 RTP/AVP 0 8 97\r\n"
+    "a=rtpmap:97 iLBC/8000\r\n"
+    "m=video 51372/2 RTP/AVP 31\r\n"
+    "c=IN IP4 224.2.36.42/127\r\n"
+    "a=recvonly\r\n";
+
+scoped_ptr<SessionDescription> Parse(const std::string &body) {
+  std::string copy(body);
+  return SessionDescription::Parse(
+      base::RefCountedString::TakeString(&copy));
+}
+
+}  // namespace
+
+TEST(SessionDescriptionTest, Parse) {
+  scoped_ptr<SessionDescription> description(Parse(kOffer));
+  ASSERT_TRUE(description);
+  EXPECT_EQ(11u, description->lines().size());
+  EXPECT_EQ(6u, description->session_end_line());
+  ASSERT_EQ(2u, description->media().size());
+
+  const SessionDescription::Media &audio = description->media()[0];
+  EXPECT_EQ("audio", audio.media);
+  EXPECT_EQ(49172, audio.port);
+  EXPECT_EQ(1, audio.port_count);
+  EXPECT_EQ("RTP/AVP", audio.protocol);
+  ASSERT_EQ(3u, audio.formats.size());
+  EXPECT_EQ("97", audio.formats[2]);
+  EXPECT_EQ(6u, audio.first_line);
+  EXPECT_EQ(8u, audio.end_line);
+  const SessionDescription::Media &video = description->media()[1];
+  EXPECT_EQ(51372, video.port);
+  EXPECT_EQ(2, video.port_count);
+
+  // Fields point into the body.
+  const std::string &body = description->body();
+  EXPECT_GE(audio.media.data(), body.data());
+  EXPECT_LT(audio.media.data(), body.data() + body.size());
+
+  base::StringPiece value;
+  EXPECT_TRUE(description->GetAttribute(0, "rtpmap", &value));
+  EXPECT_EQ("97 iLBC/8000", value);
+  EXPECT_TRUE(description->GetAttribute(SessionDescription::kSessionLevel,
+                                        "sendrecv", &value));
+  EXPECT_TRUE(value.empty());
+  EXPECT_FALSE(description->GetAttribute(0, "sendrecv", &value));
+  EXPECT_FALSE(description->GetAttribute(0, "rtp", &value));
+
+  // Media without their own c= line take the one of the session.
+  SessionDescription::Connection connection;
+  ASSERT_TRUE(description->GetConnection(0, &connection));
+  EXPECT_EQ("IP4", connection.address_type);
+  EXPECT_EQ("192.0.2.101", connection.address);
+  ASSERT_TRUE(description->GetConnection(1, &connection));
+  EXPECT_EQ("224.2.36.42", connection.address);
+
+  EXPECT_FALSE(Parse(""));
+  EXPECT_FALSE(Parse("o=alice 1 1 IN IP4 atlanta.com\r\nv=0\r\n"));
+  EXPECT_FALSE(Parse("v=0\r\nmalformed\r\n"));
+  EXPECT_FALSE(Parse("v=0\r\nm=audio port RTP/AVP 0\r\n"));
+  // Bare line feeds and a missing last line break are accepted.
+  EXPECT_TRUE(Parse("v=0\ns=-\nt=0 0"));
+}
+
+TEST(SessionDescriptionTest, Edit) {
+  scoped_ptr<SessionDescription> description(Parse(kOffer));
+  ASSERT_TRUE(description);
+  SessionDescription::Editor editor(*description);
+  EXPECT_EQ(kOffer, editor.Build());
+
+  // Anchor the media: new addresses and port, the TTL is kept.
+  EXPECT_TRUE(editor.SetConnectionAddress(SessionDescription::kSessionLevel,
+                                          "2001:db8::1"));
+  EXPECT_TRUE(editor.SetConnectionAddress(1, "224.2.36.43"));
+  EXPECT_FALSE(editor.SetConnectionAddress(0, "192.0.2.1"));
+  editor.SetMediaPort(0, 20000);
+  editor.SetMediaPort(1, 20002);
+  editor.RemoveLine(description->FindLine(0, 'a'));
+  editor.InsertLine(description->session_end_line(), 'a', "tool:sippet");
+  editor.InsertLine(description->lines().size(), 'a', "ptime:20");
+
+  EXPECT_EQ(
+      "v=0\r\n"
+      "o=alice 2890844526 2890844526 IN IP4 atlanta.com\r\n"
+      "s=-\r\n"
+      "c=IN IP6 2001:db8::1\r\n"
+      "t=0 0\r\n"
+      "a=sendrecv\r\n"
+      "a=tool:sippet\r\n"
+      "m=audio 20000 RTP/AVP 0 8 97\r\n"
+      "m=video 20002/2 RTP/AVP 31\r\n"
+      "c=IN IP4 224.2.36.43/127\r\n"
+      "a=recvonly\r\n"
+      "a=ptime:20\r\n",
+      editor.Build());
+
+  // The original line breaks are kept, and a missing one is added for the
+  // lines appended.
+  scoped_ptr<SessionDescription> bare(Parse("v=0\ns=-\nt=0 0"));
+  ASSERT_TRUE(bare);
+  SessionDescription::Editor bare_editor(*bare);
+  bare_editor.ReplaceLine(1, "Talk");
+  bare_editor.InsertLine(3, 'a', "inactive");
+  EXPECT_EQ("v=0\ns=Talk\nt=0 0\r\na=inactive\r\n", bare_editor.Build());
+}
+
+}  // namespace sippet
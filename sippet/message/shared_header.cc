@@ -0,0 +1,51 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/message/shared_header.h"
+
+#include "base/logging.h"
+
+namespace sippet {
+
+SharedHeader::Source::Source(const Header *header)
+  : header_(header) {
+  DCHECK(header_);
+  DCHECK(!header_->is_lazy());
+}
+
+SharedHeader::Source::~Source() {
+}
+
+void SharedHeader::Source::Detach() {
+  if (!copy_)
+    copy_ = header_->Clone();
+}
+
+SharedHeader::SharedHeader(const scoped_refptr<Source> &source)
+  : Header(source->header()->type(), true),
+    source_(source) {
+  // |Header::name| of generic headers would need the actual class.
+  DCHECK_NE(HDR_GENERIC, type());
+}
+
+SharedHeader::~SharedHeader() {
+}
+
+scoped_ptr<Header> SharedHeader::Decode() const {
+  return source_->header()->Clone();
+}
+
+const Header *SharedHeader::shared() const {
+  return source_->header();
+}
+
+void SharedHeader::print(raw_ostream &os) const {
+  source_->header()->print(os);
+}
+
+Header *SharedHeader::DoClone() const {
+  return Decode().release();
+}
+
+}  // namespace sippet
@@ -0,0 +1,61 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_MESSAGE_SHARED_HEADER_H_
+#define SIPPET_MESSAGE_SHARED_HEADER_H_
+
+#include "sippet/message/header.h"
+#include "base/memory/ref_counted.h"
+#include "base/memory/scoped_ptr.h"
+
+namespace sippet {
+
+// A header referring to a header of another message instead of holding a
+// copy of it. Shared headers are lazy: they are only cloned when looked up
+// for writing, or if the original message is about to change.
+class SharedHeader : public Header {
+ public:
+  // Handle to the original header, shared by all messages referring to it.
+  // Detaching makes a private copy of the original header, that is used
+  // from then on.
+  class Source : public base::RefCountedThreadSafe<Source> {
+   public:
+    explicit Source(const Header *header);
+
+    const Header *header() const {
+      return copy_ ? copy_.get() : header_;
+    }
+
+    bool is_detached() const { return copy_.get() != NULL; }
+
+    void Detach();
+
+   private:
+    friend class base::RefCountedThreadSafe<Source>;
+    ~Source();
+
+    const Header *header_;
+    scoped_ptr<Header> copy_;
+
+    DISALLOW_COPY_AND_ASSIGN(Source);
+  };
+
+  explicit SharedHeader(const scoped_refptr<Source> &source);
+  ~SharedHeader() override;
+
+  scoped_ptr<Header> Decode() const override;
+  const Header *shared() const override;
+  void print(raw_ostream &os) const override;
+
+ private:
+  Header *DoClone() const override;
+
+  scoped_refptr<Source> source_;
+
+  DISALLOW_COPY_AND_ASSIGN(SharedHeader);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_MESSAGE_SHARED_HEADER_H_
@@ -0,0 +1,37 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/message/static_header_block.h"
+
+#include "sippet/base/raw_ostream.h"
+
+namespace sippet {
+
+StaticHeaderBlock::StaticHeaderBlock() {
+}
+
+StaticHeaderBlock::~StaticHeaderBlock() {
+}
+
+void StaticHeaderBlock::Add(const Header &header) {
+  Entry entry;
+  entry.type = header.type();
+  for (int style = Header::PRINT_LONG; style <= Header::PRINT_TIGHT;
+       ++style) {
+    Header::ScopedPrintStyle scoped_print_style(
+        static_cast<Header::PrintStyle>(style));
+    raw_string_ostream os(entry.lines[style]);
+    header.print(os);
+    os << "\r\n";
+    os.flush();
+  }
+  entries_.push_back(entry);
+}
+
+void StaticHeaderBlock::Append(const StaticHeaderBlock &other) {
+  entries_.insert(entries_.end(), other.entries_.begin(),
+                  other.entries_.end());
+}
+
+} // End of sippet namespace
@@ -0,0 +1,61 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_MESSAGE_STATIC_HEADER_BLOCK_H_
+#define SIPPET_MESSAGE_STATIC_HEADER_BLOCK_H_
+
+#include <string>
+#include <vector>
+
+#include "base/memory/ref_counted.h"
+#include "sippet/message/header.h"
+
+namespace sippet {
+
+// Constant headers, such as User-Agent, Allow or Supported, serialized once
+// in every print style. Messages referring to a block (see
+// |Message::set_static_headers|) have its bytes appended to their head when
+// printed, so those headers are never allocated, nor printed again, for
+// each message sent.
+//
+// Blocks are filled when set up, and immutable once shared by messages, so
+// they can be used from any thread.
+class StaticHeaderBlock
+    : public base::RefCountedThreadSafe<StaticHeaderBlock> {
+ public:
+  StaticHeaderBlock();
+
+  // Serializes |header| at the end of the block.
+  void Add(const Header &header);
+
+  // Appends the headers of |other|.
+  void Append(const StaticHeaderBlock &other);
+
+  size_t size() const { return entries_.size(); }
+  bool empty() const { return entries_.empty(); }
+
+  Header::Type type(size_t index) const { return entries_[index].type; }
+
+  // The header at |index| printed with |style|, including its CRLF.
+  const std::string &line(size_t index, Header::PrintStyle style) const {
+    return entries_[index].lines[style];
+  }
+
+ private:
+  friend class base::RefCountedThreadSafe<StaticHeaderBlock>;
+  ~StaticHeaderBlock();
+
+  struct Entry {
+    Header::Type type;
+    std::string lines[Header::PRINT_TIGHT + 1];
+  };
+
+  std::vector<Entry> entries_;
+
+  DISALLOW_COPY_AND_ASSIGN(StaticHeaderBlock);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_MESSAGE_STATIC_HEADER_BLOCK_H_
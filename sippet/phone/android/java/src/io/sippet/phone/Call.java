@@ -79,6 +79,14 @@ public class Call {
         return getEndTime().getTime() - getStartTime().getTime();
     }
 
+    /**
+     * Get the signalling latencies and the last media quality sample of the
+     * |Call|.
+     */
+    public CallMetrics getMetrics() {
+        return nativeGetMetrics(mInstance);
+    }
+
     /**
      * Pick up the call (only for incoming calls).
      * No effect if not in |CallState.RINGING| state.
@@ -129,6 +137,7 @@ public class Call {
     private native long nativeGetCreationTime(long nativeJavaCall);
     private native long nativeGetStartTime(long nativeJavaCall);
     private native long nativeGetEndTime(long nativeJavaCall);
+    private native CallMetrics nativeGetMetrics(long nativeJavaCall);
     private native void nativePickUp(long nativeJavaCall,
                                      CompletionCallback callback);
     private native void nativeReject(long nativeJavaCall);
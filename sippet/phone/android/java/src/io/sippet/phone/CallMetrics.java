@@ -0,0 +1,112 @@
+// Copyright 2015 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+package io.sippet.phone;
+
+import org.chromium.base.CalledByNative;
+
+/**
+ * Signalling latencies and media quality of a |Call|, as of the moment it
+ * was taken. Delays not reached yet, and media figures not sampled yet, are
+ * zero. Times are in milliseconds.
+ */
+public class CallMetrics {
+    private final long mPostDialDelay;
+    private final long mTimeToRinging;
+    private final long mTimeToAnswer;
+    private final long mIceGatheringTime;
+    private final long mMediaSetupTime;
+    private final long mRoundTripTime;
+    private final long mJitter;
+    private final long mPacketsSent;
+    private final long mPacketsReceived;
+    private final long mPacketsLost;
+
+    private CallMetrics(long postDialDelay, long timeToRinging,
+            long timeToAnswer, long iceGatheringTime, long mediaSetupTime,
+            long roundTripTime, long jitter, long packetsSent,
+            long packetsReceived, long packetsLost) {
+        mPostDialDelay = postDialDelay;
+        mTimeToRinging = timeToRinging;
+        mTimeToAnswer = timeToAnswer;
+        mIceGatheringTime = iceGatheringTime;
+        mMediaSetupTime = mediaSetupTime;
+        mRoundTripTime = roundTripTime;
+        mJitter = jitter;
+        mPacketsSent = packetsSent;
+        mPacketsReceived = packetsReceived;
+        mPacketsLost = packetsLost;
+    }
+
+    @CalledByNative
+    private static CallMetrics create(long postDialDelay, long timeToRinging,
+            long timeToAnswer, long iceGatheringTime, long mediaSetupTime,
+            long roundTripTime, long jitter, long packetsSent,
+            long packetsReceived, long packetsLost) {
+        return new CallMetrics(postDialDelay, timeToRinging, timeToAnswer,
+                iceGatheringTime, mediaSetupTime, roundTripTime, jitter,
+                packetsSent, packetsReceived, packetsLost);
+    }
+
+    /**
+     * From the creation of an outgoing call until its first 180 or 183.
+     */
+    public long getPostDialDelay() {
+        return mPostDialDelay;
+    }
+
+    /**
+     * From the INVITE until its first 180 or 183.
+     */
+    public long getTimeToRinging() {
+        return mTimeToRinging;
+    }
+
+    /**
+     * From the INVITE until its 2xx.
+     */
+    public long getTimeToAnswer() {
+        return mTimeToAnswer;
+    }
+
+    /**
+     * Spent gathering candidates before the offer could be sent.
+     */
+    public long getIceGatheringTime() {
+        return mIceGatheringTime;
+    }
+
+    /**
+     * From the answer until ICE connects the media path.
+     */
+    public long getMediaSetupTime() {
+        return mMediaSetupTime;
+    }
+
+    /**
+     * Round trip time reported by RTCP.
+     */
+    public long getRoundTripTime() {
+        return mRoundTripTime;
+    }
+
+    /**
+     * Jitter of the received stream.
+     */
+    public long getJitter() {
+        return mJitter;
+    }
+
+    public long getPacketsSent() {
+        return mPacketsSent;
+    }
+
+    public long getPacketsReceived() {
+        return mPacketsReceived;
+    }
+
+    public long getPacketsLost() {
+        return mPacketsLost;
+    }
+}
@@ -27,4 +27,17 @@ abstract public class CompletionCallback {
             }
         });
     }
+
+    @CalledByNative
+    private static void runAllOnCompleted(final CompletionCallback[] callbacks,
+                                          final int[] statusCodes) {
+        ThreadUtils.postOnUiThread(new Runnable() {
+            @Override
+            public void run() {
+                for (int i = 0; i < callbacks.length; i++) {
+                    callbacks[i].onCompleted(statusCodes[i]);
+                }
+            }
+        });
+    }
 }
@@ -76,6 +76,24 @@ public class Phone {
         return nativeInit(mInstance, settings);
     }
 
+    /**
+     * Initializes the |Phone| instance without waiting for its network
+     * thread; the callback is run once it's ready.
+     */
+    public boolean init(Settings settings, CompletionCallback callback) {
+        assert callback != null;
+        return nativeInitWithCallback(mInstance, settings, callback);
+    }
+
+    /**
+     * Shuts down the |Phone| without waiting for its network thread: its
+     * calls are dropped, and the callback is run once done.
+     */
+    public void shutdown(CompletionCallback callback) {
+        assert callback != null;
+        nativeShutdown(mInstance, callback);
+    }
+
     /**
      * Get the |Phone| state.
      */
@@ -92,6 +110,15 @@ public class Phone {
         nativeRegister(mInstance, callback);
     }
 
+    /**
+     * Refreshes the registration at once, when a push notification of the
+     * provider given in the |Settings| wakes the application, so that the
+     * pending call is received.
+     */
+    public void handlePushNotification() {
+        nativeHandlePushNotification(mInstance);
+    }
+
     /**
      * Unregisters the |Phone|.
      */
@@ -142,12 +169,18 @@ public class Phone {
     private static native void nativeInitApplicationContext(Context context);
     private native long nativeCreate();
     private native boolean nativeInit(long nativeJavaPhone, Settings settings);
+    private native boolean nativeInitWithCallback(long nativeJavaPhone,
+                                                  Settings settings,
+                                                  CompletionCallback callback);
+    private native void nativeShutdown(long nativeJavaPhone,
+                                       CompletionCallback callback);
     private native int nativeGetState(long nativeJavaPhone);
     private native void nativeRegister(long nativeJavaPhone,
                                        CompletionCallback callback);
     private native void nativeStartRefreshRegister(long nativeJavaPhone,
                                                    CompletionCallback callback);
     private native void nativeStopRefreshRegister(long nativeJavaPhone);
+    private native void nativeHandlePushNotification(long nativeJavaPhone);
     private native void nativeUnregister(long nativeJavaPhone,
                                          CompletionCallback callback);
     private native void nativeUnregisterAll(long nativeJavaPhone,
@@ -23,6 +23,14 @@ public class Settings {
     private String mPassword;
     private long mRegisterExpires = 600;
     private String mRegistrarServer;
+    private String mPushProvider;
+    private String mPushParam;
+    private String mPushPrid;
+    private long mRefreshAlignment = 0;
+    private boolean mPreconnect = false;
+    private boolean mPrewarmMedia = false;
+    private boolean mEarlyOffer = false;
+    private int mPeerConnectionPoolSize = 0;
 
     /**
      * Enable/disable streaming encryption.
@@ -154,4 +162,96 @@ public class Settings {
     public void setRegistrarServer(String value) {
         mRegistrarServer = value;
     }
+
+    /**
+     * Set the push notification service (RFC 8599) registered with, such as
+     * "fcm", with its pn-param and the push token of the device as pn-prid.
+     * Incoming calls then wake the application with a push notification,
+     * which must be handed to |Phone.handlePushNotification|. If empty
+     * (default) then no push notifications are used.
+     */
+    @CalledByNative
+    public String getPushProvider() {
+        return mPushProvider;
+    }
+    public void setPushProvider(String value) {
+        mPushProvider = value;
+    }
+    @CalledByNative
+    public String getPushParam() {
+        return mPushParam;
+    }
+    public void setPushParam(String value) {
+        mPushParam = value;
+    }
+    @CalledByNative
+    public String getPushPrid() {
+        return mPushPrid;
+    }
+    public void setPushPrid(String value) {
+        mPushPrid = value;
+    }
+
+    /**
+     * Align the refreshes of the registration on multiples of that many
+     * seconds, such as the windows of inexact alarms, so that they wake the
+     * radio along with other periodic work. Default value is 0 (not
+     * aligned).
+     */
+    @CalledByNative
+    public long getRefreshAlignment() {
+        return mRefreshAlignment;
+    }
+    public void setRefreshAlignment(long value) {
+        mRefreshAlignment = value;
+    }
+
+    /**
+     * Open the channel to the registrar as soon as the phone is
+     * initialized. Default value is false.
+     */
+    @CalledByNative
+    public boolean getPreconnect() {
+        return mPreconnect;
+    }
+    public void setPreconnect(boolean value) {
+        mPreconnect = value;
+    }
+
+    /**
+     * Start the media engine in the background as soon as the phone is
+     * initialized, instead of on the first call. Default value is false.
+     */
+    @CalledByNative
+    public boolean getPrewarmMedia() {
+        return mPrewarmMedia;
+    }
+    public void setPrewarmMedia(boolean value) {
+        mPrewarmMedia = value;
+    }
+
+    /**
+     * Send the offer of outgoing calls once a candidate reachable from
+     * outside is gathered, instead of waiting for all of them. Default
+     * value is false.
+     */
+    @CalledByNative
+    public boolean getEarlyOffer() {
+        return mEarlyOffer;
+    }
+    public void setEarlyOffer(boolean value) {
+        mEarlyOffer = value;
+    }
+
+    /**
+     * Number of peer connections kept ready, with their candidates
+     * gathered, for the next calls. Default value is 0 (none).
+     */
+    @CalledByNative
+    public int getPeerConnectionPoolSize() {
+        return mPeerConnectionPoolSize;
+    }
+    public void setPeerConnectionPoolSize(int value) {
+        mPeerConnectionPoolSize = value;
+    }
 }
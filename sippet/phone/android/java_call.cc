@@ -11,6 +11,7 @@
 
 #include "base/android/jni_android.h"
 #include "base/android/jni_string.h"
+#include "jni/CallMetrics_jni.h"
 #include "jni/Call_jni.h"
 
 namespace sippet {
@@ -56,6 +57,23 @@ jlong JavaCall::GetEndTime(JNIEnv* env, jobject jcaller) {
   return static_cast<jlong>(call_instance_->end_time().ToJavaTime());
 }
 
+ScopedJavaLocalRef<jobject> JavaCall::GetMetrics(JNIEnv* env,
+                                                 jobject jcaller) {
+  // All figures cross JNI at once
+  CallMetrics metrics(call_instance_->metrics());
+  return Java_CallMetrics_create(env,
+      metrics.post_dial_delay.InMilliseconds(),
+      metrics.time_to_ringing.InMilliseconds(),
+      metrics.time_to_answer.InMilliseconds(),
+      metrics.ice_gathering_time.InMilliseconds(),
+      metrics.media_setup_time.InMilliseconds(),
+      metrics.round_trip_time.InMilliseconds(),
+      metrics.jitter.InMilliseconds(),
+      metrics.packets_sent,
+      metrics.packets_received,
+      metrics.packets_lost);
+}
+
 void JavaCall::PickUp(JNIEnv* env, jobject jcaller, jobject jcallback) {
   call_instance_->PickUp(base::Bind(&RunCompletionCallback,
       base::android::ScopedJavaGlobalRef<jobject>(env, jcallback)));
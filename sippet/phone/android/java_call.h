@@ -31,6 +31,8 @@ class JavaCall {
   jlong GetCreationTime(JNIEnv* env, jobject jcaller);
   jlong GetStartTime(JNIEnv* env, jobject jcaller);
   jlong GetEndTime(JNIEnv* env, jobject jcaller);
+  base::android::ScopedJavaLocalRef<jobject>
+      GetMetrics(JNIEnv* env, jobject jcaller);
   void PickUp(JNIEnv* env, jobject jcaller, jobject jcallbacks);
   void Reject(JNIEnv* env, jobject jcaller);
   void HangUp(JNIEnv* env, jobject jcaller, jobject jcallbacks);
@@ -46,6 +46,20 @@ jboolean JavaPhone::Init(JNIEnv* env, jobject jcaller,
       ? JNI_TRUE : JNI_FALSE;
 }
 
+jboolean JavaPhone::InitWithCallback(JNIEnv* env, jobject jcaller,
+                                     jobject settings, jobject jcallback) {
+  Settings s(ConvertJavaSettingsToSettings(env, settings));
+  DCHECK(s.is_valid());
+  return phone_instance_->Init(s, base::Bind(&RunCompletionCallback,
+      base::android::ScopedJavaGlobalRef<jobject>(env, jcallback)))
+      ? JNI_TRUE : JNI_FALSE;
+}
+
+void JavaPhone::Shutdown(JNIEnv* env, jobject jcaller, jobject jcallback) {
+  phone_instance_->Shutdown(base::Bind(&RunCompletionCallback,
+      base::android::ScopedJavaGlobalRef<jobject>(env, jcallback)));
+}
+
 jint JavaPhone::GetState(JNIEnv* env, jobject jcaller) {
   return static_cast<jint>(phone_instance_->state());
 }
@@ -66,6 +80,10 @@ void JavaPhone::StopRefreshRegister(JNIEnv* env, jobject jcaller) {
   phone_instance_->StopRefreshRegister();
 }
 
+void JavaPhone::HandlePushNotification(JNIEnv* env, jobject jcaller) {
+  phone_instance_->HandlePushNotification();
+}
+
 void JavaPhone::Unregister(JNIEnv* env, jobject jcaller,
                            jobject jcallback) {
   phone_instance_->Unregister(base::Bind(&RunCompletionCallback,
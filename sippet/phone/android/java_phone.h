@@ -24,10 +24,14 @@ class JavaPhone :
   // Called from java.
   jboolean Init(JNIEnv* env, jobject jcaller,
                 jobject settings);
+  jboolean InitWithCallback(JNIEnv* env, jobject jcaller,
+                            jobject settings, jobject jcallback);
+  void Shutdown(JNIEnv* env, jobject jcaller, jobject jcallback);
   jint GetState(JNIEnv* env, jobject jcaller);
   void Register(JNIEnv* env, jobject jcaller, jobject jcallback);
   void StartRefreshRegister(JNIEnv* env, jobject jcaller, jobject jcallback);
   void StopRefreshRegister(JNIEnv* env, jobject jcaller);
+  void HandlePushNotification(JNIEnv* env, jobject jcaller);
   void Unregister(JNIEnv* env, jobject jcaller, jobject jcallback);
   void UnregisterAll(JNIEnv* env, jobject jcaller, jobject jcallback);
   jlong MakeCall(JNIEnv* env, jobject jcaller,
@@ -29,6 +29,12 @@ Settings ConvertJavaSettingsToSettings(JNIEnv* env, jobject settings) {
       Java_Settings_getPassword(env, settings);
   ScopedJavaLocalRef<jstring> j_registrar_server =
       Java_Settings_getRegistrarServer(env, settings);
+  ScopedJavaLocalRef<jstring> j_push_provider =
+      Java_Settings_getPushProvider(env, settings);
+  ScopedJavaLocalRef<jstring> j_push_param =
+      Java_Settings_getPushParam(env, settings);
+  ScopedJavaLocalRef<jstring> j_push_prid =
+      Java_Settings_getPushPrid(env, settings);
 
   result.set_disable_encryption(
       Java_Settings_getDisableEncryption(env, settings));
@@ -36,6 +42,16 @@ Settings ConvertJavaSettingsToSettings(JNIEnv* env, jobject settings) {
       Java_Settings_getDisableSctpDataChannels(env, settings));
   result.set_register_expires(
       Java_Settings_getRegisterExpires(env, settings));
+  result.set_preconnect(
+      Java_Settings_getPreconnect(env, settings));
+  result.set_prewarm_media(
+      Java_Settings_getPrewarmMedia(env, settings));
+  result.set_early_offer(
+      Java_Settings_getEarlyOffer(env, settings));
+  result.set_peer_connection_pool_size(
+      Java_Settings_getPeerConnectionPoolSize(env, settings));
+  result.set_refresh_alignment(
+      Java_Settings_getRefreshAlignment(env, settings));
 
   if (!j_uri.is_null()) {
     result.set_uri(GURL(ConvertJavaStringToUTF8(j_uri)));
@@ -59,6 +75,15 @@ Settings ConvertJavaSettingsToSettings(JNIEnv* env, jobject settings) {
     result.set_registrar_server(
         GURL(ConvertJavaStringToUTF8(j_registrar_server)));
   }
+  if (!j_push_provider.is_null()) {
+    result.set_push_provider(ConvertJavaStringToUTF8(j_push_provider));
+  }
+  if (!j_push_param.is_null()) {
+    result.set_push_param(ConvertJavaStringToUTF8(j_push_param));
+  }
+  if (!j_push_prid.is_null()) {
+    result.set_push_prid(ConvertJavaStringToUTF8(j_push_prid));
+  }
   DCHECK(result.is_valid());
   return result;
 }
@@ -8,6 +8,7 @@
 #include "base/android/jni_registrar.h"
 #include "sippet/phone/android/java_phone.h"
 #include "sippet/phone/android/java_call.h"
+#include "sippet/phone/android/run_completion_callback.h"
 
 namespace sippet {
 namespace android {
@@ -15,6 +16,8 @@ namespace android {
 static const base::android::RegistrationMethod kPhoneRegisteredMethods[] = {
     {"JavaPhone", sippet::phone::android::JavaPhone::RegisterBindings},
     {"JavaCall", sippet::phone::android::JavaCall::RegisterBindings},
+    {"CompletionCallback",
+        sippet::phone::android::RegisterCompletionCallback},
 };
 
 bool RegisterPhoneJNI(JNIEnv* env) {
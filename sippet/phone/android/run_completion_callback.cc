@@ -4,19 +4,103 @@
 
 #include "sippet/phone/android/run_completion_callback.h"
 
+#include <vector>
+
+#include "base/android/jni_array.h"
+#include "base/bind.h"
+#include "base/lazy_instance.h"
+#include "base/message_loop/message_loop.h"
+#include "base/threading/thread_local.h"
 #include "jni/CompletionCallback_jni.h"
 
 namespace sippet {
 namespace phone {
 namespace android {
 
-void RunCompletionCallback(
+namespace {
+
+const char kCompletionCallbackClassPath[] =
+    "io/sippet/phone/CompletionCallback";
+
+// Looked up once on |JNI_OnLoad|, as the class loader of the application
+// can't be reached from the native threads.
+base::LazyInstance<base::android::ScopedJavaGlobalRef<jclass> >::Leaky
+    g_completion_callback_class = LAZY_INSTANCE_INITIALIZER;
+
+// The completions run by a single task of a thread, such as the call state
+// changes handled on the network thread, are delivered to Java together at
+// the end of the task, with a single upcall and a single post to the UI
+// thread.
+class CompletionBatch {
+ public:
+  static void Add(
+      const base::android::ScopedJavaGlobalRef<jobject>& callback,
+      int error);
+
+ private:
+  CompletionBatch() {}
+
+  void Flush();
+
+  std::vector<base::android::ScopedJavaGlobalRef<jobject> > callbacks_;
+  std::vector<int> errors_;
+
+  DISALLOW_COPY_AND_ASSIGN(CompletionBatch);
+};
+
+base::LazyInstance<base::ThreadLocalPointer<CompletionBatch> >::Leaky
+    g_current_batch = LAZY_INSTANCE_INITIALIZER;
+
+// static
+void CompletionBatch::Add(
     const base::android::ScopedJavaGlobalRef<jobject>& callback,
     int error) {
+  CompletionBatch* batch = g_current_batch.Pointer()->Get();
+  if (!batch) {
+    batch = new CompletionBatch;
+    g_current_batch.Pointer()->Set(batch);
+    base::MessageLoop::current()->PostTask(FROM_HERE,
+        base::Bind(&CompletionBatch::Flush, base::Owned(batch)));
+  }
+  batch->callbacks_.push_back(callback);
+  batch->errors_.push_back(error);
+}
+
+void CompletionBatch::Flush() {
+  g_current_batch.Pointer()->Set(nullptr);
+
   JNIEnv* env = base::android::AttachCurrentThread();
-  if (!callback.is_null()) {
+  base::android::ScopedJavaLocalRef<jobjectArray> callbacks(env,
+      env->NewObjectArray(static_cast<jsize>(callbacks_.size()),
+          g_completion_callback_class.Get().obj(), nullptr));
+  for (size_t i = 0; i < callbacks_.size(); ++i)
+    env->SetObjectArrayElement(callbacks.obj(), i, callbacks_[i].obj());
+  base::android::ScopedJavaLocalRef<jintArray> errors(
+      base::android::ToJavaIntArray(env, &errors_[0], errors_.size()));
+  Java_CompletionCallback_runAllOnCompleted(env, callbacks.obj(),
+      errors.obj());
+}
+
+}  // namespace
+
+void RunCompletionCallback(
+    const base::android::ScopedJavaGlobalRef<jobject>& callback,
+    int error) {
+  if (callback.is_null())
+    return;
+  if (!base::MessageLoop::current()
+      || g_completion_callback_class.Get().is_null()) {
+    JNIEnv* env = base::android::AttachCurrentThread();
     Java_CompletionCallback_runOnCompleted(env, callback.obj(), error);
+    return;
   }
+  CompletionBatch::Add(callback, error);
+}
+
+bool RegisterCompletionCallback(JNIEnv* env) {
+  g_completion_callback_class.Get().Reset(
+      base::android::GetClass(env, kCompletionCallbackClassPath));
+  return !g_completion_callback_class.Get().is_null();
 }
 
 }  // namespace android
@@ -14,10 +14,15 @@ namespace sippet {
 namespace phone {
 namespace android {
 
+// Runs |callback| on the UI thread. Completions run by the same task are
+// delivered together, after the task.
 void RunCompletionCallback(
     const base::android::ScopedJavaGlobalRef<jobject>& callback,
     int error);
 
+// Caches the Java class of the callbacks; called on |JNI_OnLoad|.
+bool RegisterCompletionCallback(JNIEnv* env);
+
 } // namespace android
 } // namespace phone
 } // namespace sippet
@@ -12,6 +12,7 @@
 #include "url/gurl.h"
 #include "net/base/completion_callback.h"
 
+#include "sippet/phone/call_metrics.h"
 #include "sippet/phone/call_state.h"
 #include "sippet/phone/call_direction.h"
 
@@ -50,6 +51,11 @@ class Call :
   // Get the duration of the |Call|
   virtual base::TimeDelta duration() const = 0;
 
+  // Get the signalling latencies and the last media quality sample of the
+  // |Call|. It's a copy of figures kept up to date on the network thread,
+  // and never waits for it.
+  virtual CallMetrics metrics() const = 0;
+
   // Pick up the call (only for incoming calls). No effect if not in
   // |kStateRinging| state.
   virtual bool PickUp(const net::CompletionCallback& on_completion) = 0;
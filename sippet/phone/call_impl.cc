@@ -11,87 +11,70 @@
 #include "sippet/phone/phone_impl.h"
 
 #include "base/callback.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/stringprintf.h"
 #include "net/base/net_errors.h"
 #include "re2/re2.h"
 #include "sippet/message/status_code.h"
 #include "sippet/phone/completion_status.h"
+#include "sippet/phone/session_description_observers.h"
 
 namespace {
 
-class ProxyCreateSessionDescriptionObserver :
-  public webrtc::CreateSessionDescriptionObserver {
- public:
-  typedef base::Callback<void(webrtc::SessionDescriptionInterface*)>
-      SuccessCallback;
-  typedef base::Callback<void(const std::string&)>
-      FailureCallback;
-
-  static ProxyCreateSessionDescriptionObserver* Create(
-      const SuccessCallback& on_success = SuccessCallback(),
-      const FailureCallback& on_failure = FailureCallback()) {
-    return
-      new rtc::RefCountedObject<ProxyCreateSessionDescriptionObserver>(
-          on_success, on_failure);
+void RunIfNotOk(const net::CompletionCallback& c, int rv) {
+  if (net::OK != rv) {
+    c.Run(rv);
   }
+}
 
-  void OnSuccess(webrtc::SessionDescriptionInterface* desc) override {
-    on_success_.Run(desc);
-  }
+// Types of the candidates reachable from outside the local network.
+const char kServerReflexiveCandidateType[] = "stun";
+const char kRelayedCandidateType[] = "relay";
 
-  void OnFailure(const std::string& error) override {
-    on_failure_.Run(error);
-  }
+// Component of the RTP candidates.
+const int kRtpComponent = 1;
 
- protected:
-  ProxyCreateSessionDescriptionObserver(
-      const SuccessCallback& on_success,
-      const FailureCallback& on_failure) :
-          on_success_(on_success), on_failure_(on_failure) {
-  }
-  ~ProxyCreateSessionDescriptionObserver() override {}
+// Media statistics are sampled at this interval while established.
+const int kStatsIntervalSeconds = 5;
 
-  SuccessCallback on_success_;
-  FailureCallback on_failure_;
-};
+// Offer of the calls without media: an inactive audio stream, to the
+// discard port.
+const char kStubOfferFormat[] =
+    "v=0\r\n"
+    "o=- %s 1 IN IP4 0.0.0.0\r\n"
+    "s=-\r\n"
+    "c=IN IP4 0.0.0.0\r\n"
+    "t=0 0\r\n"
+    "m=audio 9 RTP/AVP 0\r\n"
+    "a=rtpmap:0 PCMU/8000\r\n"
+    "a=inactive\r\n";
 
-class ProxySetSessionDescriptionObserver :
-  public webrtc::SetSessionDescriptionObserver {
+class ProxyStatsObserver : public webrtc::StatsObserver {
  public:
-  typedef base::Callback<void()> SuccessCallback;
-  typedef base::Callback<void(const std::string&)> FailureCallback;
+  typedef base::Callback<void(const webrtc::StatsReports&)> CompleteCallback;
 
-  static ProxySetSessionDescriptionObserver* Create(
-        const SuccessCallback& on_success = SuccessCallback(),
-        const FailureCallback& on_failure = FailureCallback()) {
-    return
-      new rtc::RefCountedObject<ProxySetSessionDescriptionObserver>(
-            on_success, on_failure);
+  static ProxyStatsObserver* Create(const CompleteCallback& on_complete) {
+    return new rtc::RefCountedObject<ProxyStatsObserver>(on_complete);
   }
 
-  void OnSuccess() override {
-    on_success_.Run();
-  }
-
-  void OnFailure(const std::string& error) override {
-    on_failure_.Run(error);
+  void OnComplete(const webrtc::StatsReports& reports) override {
+    on_complete_.Run(reports);
   }
 
  protected:
-  ProxySetSessionDescriptionObserver(
-        const SuccessCallback& on_success,
-        const FailureCallback& on_failure) :
-            on_success_(on_success), on_failure_(on_failure) {
+  explicit ProxyStatsObserver(const CompleteCallback& on_complete) :
+      on_complete_(on_complete) {
   }
-  ~ProxySetSessionDescriptionObserver() override {}
+  ~ProxyStatsObserver() override {}
 
-  SuccessCallback on_success_;
-  FailureCallback on_failure_;
+  CompleteCallback on_complete_;
 };
 
-void RunIfNotOk(const net::CompletionCallback& c, int rv) {
-  if (net::OK != rv) {
-    c.Run(rv);
-  }
+bool GetStatsValue(const webrtc::StatsReport *report,
+                   webrtc::StatsReport::StatsValueName name,
+                   int64 *value) {
+  const webrtc::StatsReport::Value *v = report->FindValue(name);
+  return v && base::StringToInt64(v->ToString(), value);
 }
 
 }  // namespace
@@ -103,12 +86,19 @@ CallImpl::CallImpl(const SipURI& uri, PhoneImpl* phone,
     const net::CompletionCallback& on_completed)
   : direction_(CALL_DIRECTION_OUTGOING), state_(CALL_STATE_CALLING),
     uri_(uri), phone_(phone),
-    on_completed_(on_completed) {
+    on_completed_(on_completed),
+    creation_time_(base::Time::Now()),
+    offer_created_(false),
+    creation_ticks_(base::TimeTicks::Now()) {
 }
 
 CallImpl::CallImpl(const scoped_refptr<Request> &invite, PhoneImpl* phone)
   : direction_(CALL_DIRECTION_INCOMING), state_(CALL_STATE_RINGING),
-    uri_(invite->request_uri()), last_request_(invite), phone_(phone) {
+    uri_(invite->request_uri()), last_request_(invite), phone_(phone),
+    session_timer_(new SessionTimer(phone->user_agent(), this)),
+    creation_time_(base::Time::Now()),
+    offer_created_(false),
+    creation_ticks_(base::TimeTicks::Now()) {
 }
 
 CallImpl::~CallImpl() {
@@ -119,7 +109,29 @@ CallDirection CallImpl::direction() const {
 }
 
 CallState CallImpl::state() const {
-  return state_;
+  return static_cast<CallState>(base::subtle::Acquire_Load(&state_));
+}
+
+void CallImpl::SetState(CallState state) {
+  {
+    base::AutoLock auto_lock(metrics_lock_);
+    if (CALL_STATE_ESTABLISHED == state && start_time_.is_null())
+      start_time_ = base::Time::Now();
+    else if (CALL_STATE_TERMINATED == state && end_time_.is_null())
+      end_time_ = base::Time::Now();
+  }
+  base::subtle::Release_Store(&state_, state);
+
+  // Media statistics are only sampled while established.
+  if (CALL_STATE_ESTABLISHED == state) {
+    if (!stats_timer_)
+      stats_timer_.reset(new TimerWheel::Timer(
+          phone_->user_agent()->timer_wheel()));
+    if (!stats_timer_->IsRunning())
+      StartStatsTimer();
+  } else if (stats_timer_) {
+    stats_timer_->Stop();
+  }
 }
 
 GURL CallImpl::uri() const {
@@ -135,138 +147,115 @@ base::Time CallImpl::creation_time() const {
 }
 
 base::Time CallImpl::start_time() const {
+  base::AutoLock auto_lock(metrics_lock_);
   return start_time_;
 }
 
 base::Time CallImpl::end_time() const {
+  base::AutoLock auto_lock(metrics_lock_);
   return end_time_;
 }
 
 base::TimeDelta CallImpl::duration() const {
+  base::AutoLock auto_lock(metrics_lock_);
   return end_time_ - start_time_;
 }
 
+CallMetrics CallImpl::metrics() const {
+  base::AutoLock auto_lock(metrics_lock_);
+  return metrics_;
+}
+
 bool CallImpl::PickUp(const net::CompletionCallback& on_completed) {
-  if (!last_request_ || Request::Incoming != last_request_->direction()) {
+  if (CALL_DIRECTION_INCOMING != direction_) {
     DVLOG(1) << "Impossible to pick up an outgoing call";
     return false;
   }
-  if (CALL_STATE_RINGING != state_) {
+  if (CALL_STATE_RINGING != state()) {
     DVLOG(1) << "Invalid state to pick up call";
     return false;
   }
-  on_completed_ = on_completed;
-  phone_->GetNetworkMessageLoop()->PostTask(FROM_HERE,
-    base::Bind(&CallImpl::OnPickUp, base::Unretained(this)));
+  phone_->GetNetworkTaskRunner()->PostTask(FROM_HERE,
+    base::Bind(&CallImpl::OnPickUp, base::Unretained(this), on_completed));
   return true;
 }
 
 bool CallImpl::Reject() {
-  if (!last_request_ || Request::Incoming != last_request_->direction()) {
+  if (CALL_DIRECTION_INCOMING != direction_) {
     DVLOG(1) << "Impossible to reject an outgoing call";
     return false;
   }
-  if (CALL_STATE_RINGING != state_) {
+  if (CALL_STATE_RINGING != state()) {
     DVLOG(1) << "Invalid state to reject call";
     return false;
   }
-  phone_->GetNetworkMessageLoop()->PostTask(FROM_HERE,
+  phone_->GetNetworkTaskRunner()->PostTask(FROM_HERE,
     base::Bind(&CallImpl::OnReject, base::Unretained(this)));
   return true;
 }
 
 bool CallImpl::HangUp(const net::CompletionCallback& on_completed) {
-  if (!last_request_) {
-    DVLOG(1) << "Impossible to hangup an uninitiated call";
-    return false;
-  }
-  if (CALL_STATE_TERMINATED == state_) {
+  if (CALL_STATE_TERMINATED == state()) {
     DVLOG(1) << "Cannot hangup a terminated call";
     return false;
   }
-  on_hangup_completed_ = on_completed;
-  phone_->GetNetworkMessageLoop()->PostTask(FROM_HERE,
-    base::Bind(&CallImpl::OnHangup, base::Unretained(this)));
+  phone_->GetNetworkTaskRunner()->PostTask(FROM_HERE,
+    base::Bind(&CallImpl::OnHangup, base::Unretained(this), on_completed));
   return true;
 }
 
 void CallImpl::SendDtmf(const std::string& digits) {
-  if (!last_request_) {
-    DVLOG(1) << "Impossible to send digit to an uninitiated call";
-    return;
-  }
-  if (CALL_STATE_TERMINATED == state_) {
+  if (CALL_STATE_TERMINATED == state()) {
     DVLOG(1) << "Cannot send digit to a terminated call";
     return;
   }
-  phone_->GetNetworkMessageLoop()->PostTask(FROM_HERE,
+  phone_->GetNetworkTaskRunner()->PostTask(FROM_HERE,
     base::Bind(&CallImpl::OnSendDtmf, base::Unretained(this), digits));
 }
 
-bool CallImpl::InitializePeerConnection(
-    webrtc::PeerConnectionFactoryInterface *peer_connection_factory) {
-  webrtc::PeerConnectionInterface::RTCConfiguration config;
-  const Settings::IceServers& ice_servers(phone_->settings().ice_servers());
-  if (ice_servers.size() > 0) {
-    for (Settings::IceServers::const_iterator i = ice_servers.begin(),
-         ie = ice_servers.end(); i != ie; i++) {
-      webrtc::PeerConnectionInterface::IceServer server;
-      server.uri = i->uri();
-      server.username = i->username();
-      server.password = i->password();
-      config.servers.push_back(server);
-    }
-  }
-
-  peer_connection_ = peer_connection_factory->CreatePeerConnection(config,
-    nullptr, nullptr, nullptr, this);
-  if (!peer_connection_.get()) {
-    LOG(ERROR) << "Error: CreatePeerConnection failed\n";
-    DeletePeerConnection();
-    return false;
-  }
-
-  rtc::scoped_refptr<webrtc::AudioTrackInterface> audio_track(
-    peer_connection_factory->CreateAudioTrack(
-    "audio", peer_connection_factory->CreateAudioSource(nullptr)));
-
-  rtc::scoped_refptr<webrtc::MediaStreamInterface> stream =
-    peer_connection_factory->CreateLocalMediaStream("stream");
+void CallImpl::OnMakeCall(scoped_ptr<PeerConnectionPool::Entry> entry) {
+  // TODO(david): handle errors
+  if (!entry)
+    return;
 
-  stream->AddTrack(audio_track);
-  if (!peer_connection_->AddStream(stream)) {
-    LOG(ERROR) << "Adding stream to PeerConnection failed";
-  }
+  peer_connection_entry_ = entry.Pass();
+  peer_connection_ = peer_connection_entry_->peer_connection();
+  webrtc::MediaStreamInterface *stream = peer_connection_entry_->stream();
   active_streams_.insert(std::make_pair(stream->label(), stream));
-  return true;
-}
 
-void CallImpl::DeletePeerConnection() {
-  peer_connection_ = nullptr;
-  active_streams_.clear();
+  // A connection taken from the pool may have gathered its candidates
+  // already; otherwise, wait for allocations.
+  if (peer_connection_entry_->Attach(this))
+    SendOffer();
 }
 
-void CallImpl::OnMakeCall(
-    webrtc::PeerConnectionFactoryInterface *peer_connection_factory) {
-  InitializePeerConnection(peer_connection_factory);
-  // TODO(david): handle errors
-
-  CreateOffer();
-
-  // Wait for allocations
+void CallImpl::OnIceCandidate(
+    const webrtc::IceCandidateInterface* candidate) {
+  // The offer carries no ICE attributes, only the default destination: with
+  // |early_offer|, the first reachable RTP candidate is enough, rather than
+  // waiting for every allocation.
+  if (offer_created_ || !phone_->settings().early_offer())
+    return;
+  const cricket::Candidate &c = candidate->candidate();
+  if (kRtpComponent == c.component()
+      && (kServerReflexiveCandidateType == c.type()
+          || kRelayedCandidateType == c.type())) {
+    SendOffer();
+  }
 }
 
-void CallImpl::CreateOffer() {
-  peer_connection_->CreateOffer(
-      ProxyCreateSessionDescriptionObserver::Create(
-          base::Bind(&CallImpl::OnCreateSessionSuccess,
-              base::Unretained(this)),
-          base::Bind(&CallImpl::OnCreateSessionFailure,
-              base::Unretained(this))),
-      nullptr);
+void CallImpl::OnIceComplete() {
+  if (!offer_created_)
+    SendOffer();
 }
 
-void CallImpl::OnIceComplete() {
+void CallImpl::SendOffer() {
+  offer_created_ = true;
+  {
+    base::AutoLock auto_lock(metrics_lock_);
+    metrics_.ice_gathering_time = base::TimeTicks::Now() - creation_ticks_;
+  }
+
   std::string offer;
   const webrtc::SessionDescriptionInterface* desc =
     peer_connection_->local_description();
@@ -289,32 +278,32 @@ void CallImpl::OnIceComplete() {
     RE2::GlobalReplace(&offer, elem.first, elem.second);
   }
 
-  phone_->GetNetworkMessageLoop()->PostTask(
+  // Already there when the network thread is the signalling thread.
+  if (phone_->GetNetworkTaskRunner()->BelongsToCurrentThread()) {
+    OnCreateOfferCompleted(offer);
+    return;
+  }
+  phone_->GetNetworkTaskRunner()->PostTask(
     FROM_HERE,
     base::Bind(&CallImpl::OnCreateOfferCompleted,
     base::Unretained(this), offer));
 }
 
-void CallImpl::OnCreateSessionSuccess(
-    webrtc::SessionDescriptionInterface* desc) {
-  peer_connection_->SetLocalDescription(
-      ProxySetSessionDescriptionObserver::Create(
-          base::Bind(&CallImpl::OnSetLocalSessionSuccess,
-              base::Unretained(this)),
-          base::Bind(&CallImpl::OnSetLocalSessionFailure,
-              base::Unretained(this))), desc);
-}
-
-void CallImpl::OnCreateSessionFailure(const std::string& error) {
-  // TODO(david)
+void CallImpl::SendStubOffer() {
+  DCHECK(phone_->settings().signalling_only());
+  offer_created_ = true;
+  OnCreateOfferCompleted(base::StringPrintf(kStubOfferFormat,
+      base::Int64ToString(creation_ticks_.ToInternalValue()).c_str()));
 }
 
-void CallImpl::OnSetLocalSessionSuccess() {
-  // TODO(david)
-}
-
-void CallImpl::OnSetLocalSessionFailure(const std::string& error) {
-  // TODO(david)
+void CallImpl::OnSessionExpired() {
+  // RFC 4028 section 10: the session wasn't refreshed in time.
+  if (CALL_STATE_TERMINATED == state())
+    return;
+  SetState(CALL_STATE_TERMINATED);
+  on_hangup_completed_ = on_completed_;
+  on_completed_.Run(ERR_TIMED_OUT);
+  SendBye();
 }
 
 void CallImpl::OnSetRemoteSessionSuccess() {
@@ -329,26 +318,34 @@ void CallImpl::OnCreateOfferCompleted(const std::string& offer) {
   std::string request_uri(uri_.spec());
   std::string to(uri_.spec());
 
-  last_request_ =
-    phone_->user_agent()->CreateRequest(
+  set_last_request(
+    phone_->CreateRequest(
         Method::INVITE,
         GURL(request_uri),
-        phone_->settings().uri(),
-        GURL(to));
+        GURL(to)));
 
   scoped_ptr<ContentType> content_type(
     new ContentType("application", "sdp"));
   last_request_->push_back(content_type.Pass());
   last_request_->set_content(offer);
 
+  if (!session_timer_)
+    session_timer_.reset(new SessionTimer(phone_->user_agent(), this));
+  session_timer_->AddToRequest(last_request_);
+
   int rv = phone_->user_agent()->Send(last_request_,
       base::Bind(&RunIfNotOk, on_completed_));
   if (net::OK != rv && net::ERR_IO_PENDING != rv) {
-    state_ = CALL_STATE_TERMINATED;
+    SetState(CALL_STATE_TERMINATED);
     on_completed_.Run(rv);
     return;
   }
 
+  // Delays are counted from the first INVITE, even if sent again
+  base::AutoLock auto_lock(metrics_lock_);
+  if (invite_ticks_.is_null())
+    invite_ticks_ = base::TimeTicks::Now();
+
   // Wait for SIP response now
 }
 
@@ -358,6 +355,13 @@ void CallImpl::HandleSessionDescriptionAnswer(
   if (content_type != nullptr
       && "application" == content_type->MediaType::type()
       && "sdp" == content_type->subtype()) {
+    if (!peer_connection_) {
+      // Signalling only: there's no media to apply the answer to.
+      base::AutoLock auto_lock(metrics_lock_);
+      if (answer_ticks_.is_null())
+        answer_ticks_ = base::TimeTicks::Now();
+      return;
+    }
     webrtc::SdpParseError error;
     webrtc::SessionDescriptionInterface *desc =
       webrtc::CreateSessionDescription(
@@ -367,6 +371,11 @@ void CallImpl::HandleSessionDescriptionAnswer(
       LOG(WARNING) << "Can't parse received session description message. "
           << "SdpParseError was: " << error.description;
     } else {
+      {
+        base::AutoLock auto_lock(metrics_lock_);
+        if (answer_ticks_.is_null())
+          answer_ticks_ = base::TimeTicks::Now();
+      }
       peer_connection_->SetRemoteDescription(
           ProxySetSessionDescriptionObserver::Create(
               base::Bind(&CallImpl::OnSetRemoteSessionSuccess,
@@ -383,7 +392,7 @@ void CallImpl::SendAck(const scoped_refptr<Response> &incoming_response) {
   int rv = phone_->user_agent()->Send(ack,
       base::Bind(&RunIfNotOk, on_completed_));
   if (net::OK != rv && net::ERR_IO_PENDING != rv) {
-    state_ = CALL_STATE_TERMINATED;
+    SetState(CALL_STATE_TERMINATED);
     on_completed_.Run(rv);
     return;
   }
@@ -411,7 +420,7 @@ void CallImpl::SendCancel() {
 }
 
 void CallImpl::SendBye() {
-  last_request_ = dialog_->CreateRequest(Method::BYE);
+  set_last_request(dialog_->CreateRequest(Method::BYE));
   int rv = phone_->user_agent()->Send(last_request_,
     base::Bind(&RunIfNotOk, on_hangup_completed_));
   if (net::OK != rv && net::ERR_IO_PENDING != rv) {
@@ -425,7 +434,7 @@ void CallImpl::SendBye() {
 void CallImpl::HandleCallingOrRingingResponse(
       const scoped_refptr<Response> &incoming_response,
       const scoped_refptr<Dialog> &dialog) {
-  DCHECK(CALL_STATE_RINGING == state_ || CALL_STATE_CALLING == state_);
+  DCHECK(CALL_STATE_RINGING == state() || CALL_STATE_CALLING == state());
 
   CallState next_state;  // Determine the next state
   int response_code = incoming_response->response_code();
@@ -433,7 +442,7 @@ void CallImpl::HandleCallingOrRingingResponse(
     if (response_code / 10 == 18) {  // 18x
       next_state = CALL_STATE_RINGING;
     } else {
-      next_state = state_;  // Keep on same state
+      next_state = state();  // Keep on same state
     }
   } else if (response_code / 100 == 2) {  // 2xx
     next_state = CALL_STATE_ESTABLISHED;
@@ -446,8 +455,11 @@ void CallImpl::HandleCallingOrRingingResponse(
     SendAck(incoming_response);
   }
 
+  if (state() != next_state)
+    UpdateSignallingMetrics(next_state);
+
   // Handle Session Description on ringing or established
-  if (state_ != next_state) {
+  if (state() != next_state) {
     if (CALL_STATE_RINGING == next_state
         || CALL_STATE_ESTABLISHED == next_state) {
       HandleSessionDescriptionAnswer(incoming_response);
@@ -455,23 +467,93 @@ void CallImpl::HandleCallingOrRingingResponse(
   }
 
   // Now change state and process post changed state conditions
-  state_ = next_state;
-  if (CALL_STATE_RINGING == state_) {
+  SetState(next_state);
+  if (CALL_STATE_RINGING == state()) {
     on_completed_.Run(
         StatusCodeToCompletionStatus(response_code));
-  } else if (CALL_STATE_ESTABLISHED == state_) {
+  } else if (CALL_STATE_ESTABLISHED == state()) {
     on_completed_.Run(net::OK);
-  } else if (CALL_STATE_TERMINATED == state_) {
+  } else if (CALL_STATE_TERMINATED == state()) {
     on_completed_.Run(
         StatusCodeToCompletionStatus(response_code));
     phone_->RemoveCall(this);
   }
 }
 
+void CallImpl::UpdateSignallingMetrics(CallState next_state) {
+  base::AutoLock auto_lock(metrics_lock_);
+  if (invite_ticks_.is_null())
+    return;
+  base::TimeTicks now(base::TimeTicks::Now());
+  if (CALL_STATE_RINGING == next_state
+      && metrics_.time_to_ringing.is_zero()) {
+    metrics_.time_to_ringing = now - invite_ticks_;
+    metrics_.post_dial_delay = now - creation_ticks_;
+  } else if (CALL_STATE_ESTABLISHED == next_state) {
+    metrics_.time_to_answer = now - invite_ticks_;
+  }
+}
+
+void CallImpl::StartStatsTimer() {
+  stats_timer_->Start(base::TimeDelta::FromSeconds(kStatsIntervalSeconds),
+      base::Bind(&CallImpl::OnStatsTimer, base::Unretained(this)));
+}
+
+void CallImpl::OnStatsTimer() {
+  if (!peer_connection_)
+    return;
+  // The reports are collected on the webrtc signalling thread
+  peer_connection_->GetStats(
+      ProxyStatsObserver::Create(
+          base::Bind(&CallImpl::OnStatsComplete, this)),
+      nullptr, webrtc::PeerConnectionInterface::kStatsOutputLevelStandard);
+  StartStatsTimer();
+}
+
+void CallImpl::OnStatsComplete(const webrtc::StatsReports& reports) {
+  base::AutoLock auto_lock(metrics_lock_);
+  for (webrtc::StatsReports::const_iterator i = reports.begin(),
+       ie = reports.end(); i != ie; ++i) {
+    const webrtc::StatsReport *report = *i;
+    if (webrtc::StatsReport::kStatsReportTypeSsrc != report->type())
+      continue;
+    int64 value;
+    if (GetStatsValue(report,
+            webrtc::StatsReport::kStatsValueNamePacketsReceived, &value)) {
+      // A receiving stream
+      metrics_.packets_received = value;
+      if (GetStatsValue(report,
+              webrtc::StatsReport::kStatsValueNamePacketsLost, &value))
+        metrics_.packets_lost = value;
+      if (GetStatsValue(report,
+              webrtc::StatsReport::kStatsValueNameJitterReceived, &value))
+        metrics_.jitter = base::TimeDelta::FromMilliseconds(value);
+    } else if (GetStatsValue(report,
+                   webrtc::StatsReport::kStatsValueNamePacketsSent, &value)) {
+      // A sending stream, with the round trip reported by RTCP
+      metrics_.packets_sent = value;
+      if (GetStatsValue(report,
+              webrtc::StatsReport::kStatsValueNameRtt, &value))
+        metrics_.round_trip_time = base::TimeDelta::FromMilliseconds(value);
+    }
+  }
+}
+
+void CallImpl::OnIceConnectionChange(
+    webrtc::PeerConnectionInterface::IceConnectionState new_state) {
+  if (webrtc::PeerConnectionInterface::kIceConnectionConnected != new_state
+      && webrtc::PeerConnectionInterface::kIceConnectionCompleted
+          != new_state)
+    return;
+  base::AutoLock auto_lock(metrics_lock_);
+  if (!answer_ticks_.is_null() && metrics_.media_setup_time.is_zero())
+    metrics_.media_setup_time = base::TimeTicks::Now() - answer_ticks_;
+}
+
 void CallImpl::HandleHungupResponse(
       const scoped_refptr<Response> &incoming_response,
       const scoped_refptr<Dialog> &dialog) {
-  DCHECK(CALL_STATE_TERMINATED == state_);
+  DCHECK(CALL_STATE_TERMINATED == state());
   int response_code = incoming_response->response_code();
   if (Method::INVITE == incoming_response->refer_to()->method()) {
     if (response_code / 100 == 2) {  // 2xx
@@ -490,12 +572,17 @@ void CallImpl::HandleHungupResponse(
 }
 
 void CallImpl::OnDestroy() {
-  peer_connection_->Close();
+  // Calls not picked up, or failed, have no peer connection
+  if (peer_connection_)
+    peer_connection_->Close();
   peer_connection_ = nullptr;
   active_streams_.clear();
+  peer_connection_entry_.reset();
+  stats_timer_.reset();
 }
 
-void CallImpl::OnPickUp() {
+void CallImpl::OnPickUp(const net::CompletionCallback& on_completed) {
+  on_completed_ = on_completed;
   // TODO(david)
 }
 
@@ -503,8 +590,16 @@ void CallImpl::OnReject() {
   // TODO(david)
 }
 
-void CallImpl::OnHangup() {
-  state_ = CALL_STATE_TERMINATED;
+void CallImpl::OnHangup(const net::CompletionCallback& on_completed) {
+  if (!last_request_) {
+    DVLOG(1) << "Impossible to hangup an uninitiated call";
+    on_completed.Run(net::ERR_UNEXPECTED);
+    return;
+  }
+  on_hangup_completed_ = on_completed;
+  SetState(CALL_STATE_TERMINATED);
+  if (session_timer_)
+    session_timer_->Stop();
   if (!dialog_) {
     // Wait until the server answers a 18x before sending CANCEL
   } else if (Dialog::STATE_EARLY == dialog_->state()) {
@@ -515,6 +610,14 @@ void CallImpl::OnHangup() {
 }
 
 void CallImpl::OnSendDtmf(const std::string& digits) {
+  if (!last_request_) {
+    DVLOG(1) << "Impossible to send digit to an uninitiated call";
+    return;
+  }
+  if (!peer_connection_) {
+    DVLOG(1) << "Impossible to send digit to a call without media";
+    return;
+  }
   if (!dtmf_sender_) {
     rtc::scoped_refptr<webrtc::MediaStreamInterface> stream =
         active_streams_["stream"];
@@ -534,13 +637,19 @@ void CallImpl::OnIncomingRequest(
     const scoped_refptr<Request> &incoming_request,
     const scoped_refptr<Dialog> &dialog) {
   DCHECK(dialog == dialog_);
-  if (Method::BYE == incoming_request->method()) {
+  if (Method::UPDATE == incoming_request->method()) {
+    // A session refresh (RFC 4028), without session description.
+    phone_->user_agent()->Send(
+        session_timer_->HandleRequest(incoming_request, dialog),
+        net::CompletionCallback());
+  } else if (Method::BYE == incoming_request->method()) {
+    session_timer_->Stop();
     OnDestroy();
     scoped_refptr<Response> response =
         dialog->CreateResponse(SIP_OK, incoming_request);
     phone_->user_agent()->Send(response,
         net::CompletionCallback());
-    state_ = CALL_STATE_TERMINATED;
+    SetState(CALL_STATE_TERMINATED);
     // TODO(david): get the BYE reason
     on_completed_.Run(ERR_HANGUP_NOT_DEFINED);
     phone_->RemoveCall(this);
@@ -550,21 +659,40 @@ void CallImpl::OnIncomingRequest(
 void CallImpl::OnIncomingResponse(
     const scoped_refptr<Response> &incoming_response,
     const scoped_refptr<Dialog> &dialog) {
-  dialog_ = dialog;  // Save dialog
-  if (CALL_STATE_CALLING == state_
-      || CALL_STATE_RINGING == state_) {
+  set_dialog(dialog);  // Save dialog
+  if (CALL_STATE_TERMINATED != state()
+      && session_timer_->HandleResponse(incoming_response, dialog)) {
+    // Retry with the session interval asked by the server.
+    OnCreateOfferCompleted(last_request_->content());
+    return;
+  }
+  if (CALL_STATE_CALLING == state()
+      || CALL_STATE_RINGING == state()) {
     HandleCallingOrRingingResponse(incoming_response, dialog);
-  } else if (CALL_STATE_TERMINATED == state_) {
+  } else if (CALL_STATE_TERMINATED == state()) {
     HandleHungupResponse(incoming_response, dialog);
   }
 }
 
+void CallImpl::set_last_request(const scoped_refptr<Request> &request) {
+  phone_->UpdateRequestRoute(this, last_request_, request);
+  last_request_ = request;
+}
+
+void CallImpl::set_dialog(const scoped_refptr<Dialog> &dialog) {
+  if (dialog == dialog_)
+    return;
+  phone_->UpdateDialogRoute(this, dialog_, dialog);
+  dialog_ = dialog;
+}
+
 void CallImpl::OnTimedOut(
     const scoped_refptr<Request> &request,
     const scoped_refptr<Dialog> &dialog) {
-  if (CALL_STATE_CALLING == state_
-      || CALL_STATE_RINGING == state_) {
-    state_ = CALL_STATE_TERMINATED;
+  session_timer_->HandleError(request);
+  if (CALL_STATE_CALLING == state()
+      || CALL_STATE_RINGING == state()) {
+    SetState(CALL_STATE_TERMINATED);
     on_completed_.Run(ERR_TIMED_OUT);
     phone_->RemoveCall(this);
   }
@@ -573,9 +701,10 @@ void CallImpl::OnTimedOut(
 void CallImpl::OnTransportError(
     const scoped_refptr<Request> &request, int error,
     const scoped_refptr<Dialog> &dialog) {
-  if (CALL_STATE_CALLING == state_
-      || CALL_STATE_RINGING == state_) {
-    state_ = CALL_STATE_TERMINATED;
+  session_timer_->HandleError(request);
+  if (CALL_STATE_CALLING == state()
+      || CALL_STATE_RINGING == state()) {
+    SetState(CALL_STATE_TERMINATED);
     on_completed_.Run(error);
     phone_->RemoveCall(this);
   }
@@ -7,10 +7,14 @@
 
 #include <map>
 
+#include "base/atomicops.h"
+#include "base/synchronization/lock.h"
 #include "sippet/uri/uri.h"
 #include "sippet/phone/call.h"
+#include "sippet/phone/peer_connection_pool.h"
 #include "sippet/message/request.h"
 #include "sippet/ua/dialog.h"
+#include "sippet/ua/session_timer.h"
 
 #include "talk/app/webrtc/peerconnectioninterface.h"
 
@@ -21,7 +25,8 @@ class PhoneImpl;
 
 class CallImpl :
   public Call,
-  public webrtc::PeerConnectionObserver {
+  public webrtc::PeerConnectionObserver,
+  public SessionTimer::Delegate {
  private:
   DISALLOW_COPY_AND_ASSIGN(CallImpl);
  public:
@@ -33,6 +38,7 @@ class CallImpl :
   base::Time start_time() const override;
   base::Time end_time() const override;
   base::TimeDelta duration() const override;
+  CallMetrics metrics() const override;
   bool PickUp(const net::CompletionCallback& on_completed) override;
   bool Reject() override;
   bool HangUp(const net::CompletionCallback& on_completed) override;
@@ -40,35 +46,60 @@ class CallImpl :
 
  private:
   friend class PhoneImpl;
+  friend class StackImpl;
   friend class base::RefCountedThreadSafe<Call>;
 
+  void SetState(CallState state);
+
   CallDirection direction_;
-  CallState state_;
+  // Written on the network thread and read from any thread, which is all
+  // the public methods need before posting their commands. The remaining
+  // attributes belong to the network thread.
+  base::subtle::Atomic32 state_;
   SipURI uri_;
   PhoneImpl *phone_;
   scoped_refptr<Request> last_request_;
   scoped_refptr<Dialog> dialog_;
   net::CompletionCallback on_completed_;
   net::CompletionCallback on_hangup_completed_;
+  // Created on the network thread, along with the first request.
+  scoped_ptr<SessionTimer> session_timer_;
 
   base::Time creation_time_;
-  base::Time start_time_;
-  base::Time end_time_;
 
+  // Owns |peer_connection_| and observes it for the call.
+  scoped_ptr<PeerConnectionPool::Entry> peer_connection_entry_;
   rtc::scoped_refptr<webrtc::PeerConnectionInterface> peer_connection_;
   rtc::scoped_refptr<webrtc::DtmfSenderInterface> dtmf_sender_;
   std::map<std::string, rtc::scoped_refptr<webrtc::MediaStreamInterface> >
     active_streams_;
+  // Set once the offer is sent; only accessed on the webrtc signalling
+  // thread, unless the candidates were gathered before the call was made.
+  bool offer_created_;
+
+  // Guards the times and metrics of the call, written on the network and
+  // webrtc signalling threads, and read from any thread.
+  mutable base::Lock metrics_lock_;
+  base::Time start_time_;
+  base::Time end_time_;
+  CallMetrics metrics_;
+  base::TimeTicks creation_ticks_;
+  base::TimeTicks invite_ticks_;
+  base::TimeTicks answer_ticks_;
+  // Samples the media statistics while established.
+  scoped_ptr<TimerWheel::Timer> stats_timer_;
 
   CallImpl(const SipURI& uri, PhoneImpl* phone,
       const net::CompletionCallback& on_completed);
   CallImpl(const scoped_refptr<Request> &invite, PhoneImpl* phone);
   ~CallImpl() override;
 
-  bool InitializePeerConnection(
-        webrtc::PeerConnectionFactoryInterface *peer_connection_factory);
-  void DeletePeerConnection();
-  void CreateOffer();
+  // Sends the local description as the offer, with the candidates gathered
+  // so far.
+  void SendOffer();
+  // Sends a fixed offer, for calls without media (see
+  // |Settings::signalling_only|).
+  void SendStubOffer();
   void OnCreateOfferCompleted(const std::string& offer);
   void HandleSessionDescriptionAnswer(const scoped_refptr<Response> &incoming_response);
   void SendAck(const scoped_refptr<Response> &incoming_response);
@@ -80,6 +111,11 @@ class CallImpl :
   void HandleHungupResponse(
       const scoped_refptr<Response> &incoming_response,
       const scoped_refptr<Dialog> &dialog);
+  void UpdateSignallingMetrics(CallState next_state);
+  void StartStatsTimer();
+  void OnStatsTimer();
+  // Run on the webrtc signalling thread.
+  void OnStatsComplete(const webrtc::StatsReports& reports);
 
   //
   // PeerConnectionObserver implementation.
@@ -89,31 +125,30 @@ class CallImpl :
   void OnDataChannel(webrtc::DataChannelInterface* data_channel) override {}
   void OnRenegotiationNeeded() override {/* TODO*/}
   void OnIceCandidate(
-        const webrtc::IceCandidateInterface* candidate) override {}
+        const webrtc::IceCandidateInterface* candidate) override;
   void OnIceComplete() override;
+  void OnIceConnectionChange(
+        webrtc::PeerConnectionInterface::IceConnectionState new_state)
+      override;
 
   //
-  // CreateSessionDescriptionObserver callbacks.
+  // SessionTimer::Delegate implementation.
   //
-  void OnCreateSessionSuccess(webrtc::SessionDescriptionInterface* desc);
-  void OnCreateSessionFailure(const std::string& error);
+  void OnSessionExpired() override;
 
   //
   // SetSessionDescriptionObserver callbacks.
   //
-  void OnSetLocalSessionSuccess();
-  void OnSetLocalSessionFailure(const std::string& error);
   void OnSetRemoteSessionSuccess();
   void OnSetRemoteSessionFailure(const std::string& error);
 
   //
   // Signalling thread callbacks
   //
-  void OnMakeCall(
-        webrtc::PeerConnectionFactoryInterface *peer_connection_factory);
-  void OnPickUp();
+  void OnMakeCall(scoped_ptr<PeerConnectionPool::Entry> entry);
+  void OnPickUp(const net::CompletionCallback& on_completed);
   void OnReject();
-  void OnHangup();
+  void OnHangup(const net::CompletionCallback& on_completed);
   void OnSendDtmf(const std::string& digits);
   void OnDestroy();
 
@@ -126,6 +161,10 @@ class CallImpl :
   const scoped_refptr<Dialog> &dialog() const {
     return dialog_;
   }
+  // Replace the last request and the dialog, which the phone routes
+  // incoming messages by.
+  void set_last_request(const scoped_refptr<Request> &request);
+  void set_dialog(const scoped_refptr<Dialog> &dialog);
   void OnIncomingRequest(
       const scoped_refptr<Request> &incoming_request,
       const scoped_refptr<Dialog> &dialog);
@@ -0,0 +1,47 @@
+// Copyright (c) 2015 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_PHONE_CALL_METRICS_H_
+#define SIPPET_PHONE_CALL_METRICS_H_
+
+#include "base/basictypes.h"
+#include "base/time/time.h"
+
+namespace sippet {
+namespace phone {
+
+// Signalling latencies and media quality of a call, for service level
+// reporting. Delays not reached yet, and media figures not sampled yet, are
+// zero.
+struct CallMetrics {
+  CallMetrics()
+    : packets_sent(0),
+      packets_received(0),
+      packets_lost(0) {
+  }
+
+  // From the creation of an outgoing call until its first 180 or 183, as
+  // heard by the caller: ICE gathering included.
+  base::TimeDelta post_dial_delay;
+  // From the INVITE until its first 180 or 183 (RFC 6076 section 4.2).
+  base::TimeDelta time_to_ringing;
+  // From the INVITE until its 2xx.
+  base::TimeDelta time_to_answer;
+  // Spent gathering candidates before the offer could be sent.
+  base::TimeDelta ice_gathering_time;
+  // From the answer until ICE connects the media path.
+  base::TimeDelta media_setup_time;
+
+  // Sampled periodically while the call is established.
+  base::TimeDelta round_trip_time;
+  base::TimeDelta jitter;
+  int64 packets_sent;
+  int64 packets_received;
+  int64 packets_lost;
+};
+
+} // namespace sippet
+} // namespace phone
+
+#endif // SIPPET_PHONE_CALL_METRICS_H_
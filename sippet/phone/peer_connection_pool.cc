@@ -0,0 +1,222 @@
+// Copyright (c) 2015 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/phone/peer_connection_pool.h"
+
+#include "base/bind.h"
+#include "base/logging.h"
+#include "base/message_loop/message_loop.h"
+#include "sippet/phone/session_description_observers.h"
+
+namespace sippet {
+namespace phone {
+
+//
+// PeerConnectionPool::Entry implementation
+//
+PeerConnectionPool::Entry::Entry()
+  : creation_time_(base::TimeTicks::Now()),
+    observer_(nullptr),
+    ice_complete_(false) {
+}
+
+PeerConnectionPool::Entry::~Entry() {
+  if (peer_connection_)
+    peer_connection_->Close();
+}
+
+// static
+scoped_ptr<PeerConnectionPool::Entry> PeerConnectionPool::Entry::Create(
+    webrtc::PeerConnectionFactoryInterface *peer_connection_factory,
+    const Settings &settings) {
+  scoped_ptr<Entry> entry(new Entry);
+  if (!entry->Initialize(peer_connection_factory, settings))
+    return nullptr;
+  return entry.Pass();
+}
+
+bool PeerConnectionPool::Entry::Initialize(
+    webrtc::PeerConnectionFactoryInterface *peer_connection_factory,
+    const Settings &settings) {
+  if (!peer_connection_factory) {
+    LOG(ERROR) << "Error: no peer connection factory";
+    return false;
+  }
+
+  webrtc::PeerConnectionInterface::RTCConfiguration config;
+  const Settings::IceServers& ice_servers(settings.ice_servers());
+  for (Settings::IceServers::const_iterator i = ice_servers.begin(),
+       ie = ice_servers.end(); i != ie; i++) {
+    webrtc::PeerConnectionInterface::IceServer server;
+    server.uri = i->uri();
+    server.username = i->username();
+    server.password = i->password();
+    config.servers.push_back(server);
+  }
+
+  peer_connection_ = peer_connection_factory->CreatePeerConnection(config,
+    nullptr, nullptr, nullptr, this);
+  if (!peer_connection_.get()) {
+    LOG(ERROR) << "Error: CreatePeerConnection failed";
+    return false;
+  }
+
+  rtc::scoped_refptr<webrtc::AudioTrackInterface> audio_track(
+    peer_connection_factory->CreateAudioTrack(
+    "audio", peer_connection_factory->CreateAudioSource(nullptr)));
+
+  stream_ = peer_connection_factory->CreateLocalMediaStream("stream");
+  stream_->AddTrack(audio_track);
+  if (!peer_connection_->AddStream(stream_)) {
+    LOG(ERROR) << "Adding stream to PeerConnection failed";
+  }
+
+  // Setting the offer starts gathering the candidates
+  peer_connection_->CreateOffer(
+      ProxyCreateSessionDescriptionObserver::Create(
+          base::Bind(&Entry::OnCreateSessionSuccess,
+              base::Unretained(this)),
+          base::Bind(&Entry::OnCreateSessionFailure,
+              base::Unretained(this))),
+      nullptr);
+  return true;
+}
+
+bool PeerConnectionPool::Entry::Attach(
+    webrtc::PeerConnectionObserver *observer) {
+  base::AutoLock auto_lock(lock_);
+  observer_ = observer;
+  return ice_complete_;
+}
+
+webrtc::PeerConnectionObserver *PeerConnectionPool::Entry::observer() {
+  base::AutoLock auto_lock(lock_);
+  return observer_;
+}
+
+void PeerConnectionPool::Entry::OnCreateSessionSuccess(
+    webrtc::SessionDescriptionInterface* desc) {
+  peer_connection_->SetLocalDescription(
+      ProxySetSessionDescriptionObserver::Create(
+          base::Bind(&Entry::OnSetLocalSessionSuccess,
+              base::Unretained(this)),
+          base::Bind(&Entry::OnSetLocalSessionFailure,
+              base::Unretained(this))), desc);
+}
+
+void PeerConnectionPool::Entry::OnCreateSessionFailure(
+    const std::string& error) {
+  LOG(ERROR) << "Creating the offer failed: " << error;
+}
+
+void PeerConnectionPool::Entry::OnSetLocalSessionSuccess() {
+  // Wait for allocations
+}
+
+void PeerConnectionPool::Entry::OnSetLocalSessionFailure(
+    const std::string& error) {
+  LOG(ERROR) << "Setting the offer failed: " << error;
+}
+
+void PeerConnectionPool::Entry::OnAddStream(
+    webrtc::MediaStreamInterface* stream) {
+  webrtc::PeerConnectionObserver *target = observer();
+  if (target)
+    target->OnAddStream(stream);
+}
+
+void PeerConnectionPool::Entry::OnRemoveStream(
+    webrtc::MediaStreamInterface* stream) {
+  webrtc::PeerConnectionObserver *target = observer();
+  if (target)
+    target->OnRemoveStream(stream);
+}
+
+void PeerConnectionPool::Entry::OnDataChannel(
+    webrtc::DataChannelInterface* data_channel) {
+  webrtc::PeerConnectionObserver *target = observer();
+  if (target)
+    target->OnDataChannel(data_channel);
+}
+
+void PeerConnectionPool::Entry::OnRenegotiationNeeded() {
+  webrtc::PeerConnectionObserver *target = observer();
+  if (target)
+    target->OnRenegotiationNeeded();
+}
+
+void PeerConnectionPool::Entry::OnIceCandidate(
+    const webrtc::IceCandidateInterface* candidate) {
+  webrtc::PeerConnectionObserver *target = observer();
+  if (target)
+    target->OnIceCandidate(candidate);
+}
+
+void PeerConnectionPool::Entry::OnIceComplete() {
+  webrtc::PeerConnectionObserver *target;
+  {
+    base::AutoLock auto_lock(lock_);
+    ice_complete_ = true;
+    target = observer_;
+  }
+  if (target)
+    target->OnIceComplete();
+}
+
+void PeerConnectionPool::Entry::OnIceConnectionChange(
+    webrtc::PeerConnectionInterface::IceConnectionState new_state) {
+  webrtc::PeerConnectionObserver *target = observer();
+  if (target)
+    target->OnIceConnectionChange(new_state);
+}
+
+//
+// PeerConnectionPool implementation
+//
+PeerConnectionPool::PeerConnectionPool(
+    webrtc::PeerConnectionFactoryInterface *peer_connection_factory,
+    const Settings &settings, size_t size)
+  : peer_connection_factory_(peer_connection_factory),
+    settings_(settings),
+    size_(size),
+    weak_factory_(this) {
+}
+
+PeerConnectionPool::~PeerConnectionPool() {
+}
+
+void PeerConnectionPool::Fill() {
+  while (entries_.size() < size_) {
+    scoped_ptr<Entry> entry(
+        Entry::Create(peer_connection_factory_, settings_));
+    if (!entry)
+      return;
+    entries_.push_back(entry.release());
+  }
+}
+
+void PeerConnectionPool::Reset() {
+  entries_.clear();
+  Fill();
+}
+
+scoped_ptr<PeerConnectionPool::Entry> PeerConnectionPool::Take() {
+  base::TimeTicks oldest(base::TimeTicks::Now()
+      - base::TimeDelta::FromSeconds(kMaxIdleSeconds));
+  while (!entries_.empty() && entries_.front()->creation_time() < oldest)
+    entries_.erase(entries_.begin());
+
+  scoped_ptr<Entry> entry;
+  if (!entries_.empty()) {
+    entry.reset(entries_.front());
+    entries_.weak_erase(entries_.begin());
+  }
+  // The replacements aren't created on the call path
+  base::MessageLoop::current()->PostTask(FROM_HERE,
+      base::Bind(&PeerConnectionPool::Fill, weak_factory_.GetWeakPtr()));
+  return entry.Pass();
+}
+
+} // namespace phone
+} // namespace sippet
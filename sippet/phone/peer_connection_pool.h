@@ -0,0 +1,134 @@
+// Copyright (c) 2015 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_PHONE_PEER_CONNECTION_POOL_H_
+#define SIPPET_PHONE_PEER_CONNECTION_POOL_H_
+
+#include <string>
+
+#include "base/memory/scoped_ptr.h"
+#include "base/memory/scoped_vector.h"
+#include "base/memory/weak_ptr.h"
+#include "base/synchronization/lock.h"
+#include "base/time/time.h"
+#include "sippet/phone/settings.h"
+
+#include "talk/app/webrtc/peerconnectioninterface.h"
+
+namespace sippet {
+namespace phone {
+
+// Keeps peer connections ready for the next outgoing calls of a phone, as
+// for back-to-back calls: each one is created with the ICE servers of the
+// phone, has the local audio stream added and its offer set as the local
+// description, so that its candidates, TURN allocations included, are
+// gathered before the call is made. Taken connections are replaced in the
+// background. Only used on the network thread.
+class PeerConnectionPool {
+ public:
+  // Connections kept longer are discarded instead of used, as their
+  // candidates may be stale.
+  static const int kMaxIdleSeconds = 300;
+
+  // A peer connection with its local stream and offer. It's the observer
+  // of its peer connection, and forwards the events to the call attached to
+  // it.
+  class Entry : public webrtc::PeerConnectionObserver {
+   public:
+    // Create a connection and start gathering its candidates, or return
+    // NULL on failure.
+    static scoped_ptr<Entry> Create(
+        webrtc::PeerConnectionFactoryInterface *peer_connection_factory,
+        const Settings &settings);
+
+    // Closes the peer connection.
+    ~Entry() override;
+
+    webrtc::PeerConnectionInterface *peer_connection() const {
+      return peer_connection_.get();
+    }
+    webrtc::MediaStreamInterface *stream() const {
+      return stream_.get();
+    }
+    const base::TimeTicks &creation_time() const { return creation_time_; }
+
+    // Forward the next events to |observer|, which isn't owned. Returns true
+    // if the gathering has already completed, as |OnIceComplete| won't be
+    // called again.
+    bool Attach(webrtc::PeerConnectionObserver *observer);
+
+   private:
+    Entry();
+
+    bool Initialize(
+        webrtc::PeerConnectionFactoryInterface *peer_connection_factory,
+        const Settings &settings);
+    webrtc::PeerConnectionObserver *observer();
+
+    // CreateSessionDescriptionObserver callbacks.
+    void OnCreateSessionSuccess(webrtc::SessionDescriptionInterface* desc);
+    void OnCreateSessionFailure(const std::string& error);
+    // SetSessionDescriptionObserver callbacks.
+    void OnSetLocalSessionSuccess();
+    void OnSetLocalSessionFailure(const std::string& error);
+
+    //
+    // PeerConnectionObserver implementation, run on the webrtc signalling
+    // thread.
+    //
+    void OnAddStream(webrtc::MediaStreamInterface* stream) override;
+    void OnRemoveStream(webrtc::MediaStreamInterface* stream) override;
+    void OnDataChannel(webrtc::DataChannelInterface* data_channel) override;
+    void OnRenegotiationNeeded() override;
+    void OnIceCandidate(
+        const webrtc::IceCandidateInterface* candidate) override;
+    void OnIceComplete() override;
+    void OnIceConnectionChange(
+        webrtc::PeerConnectionInterface::IceConnectionState new_state)
+        override;
+
+    rtc::scoped_refptr<webrtc::PeerConnectionInterface> peer_connection_;
+    rtc::scoped_refptr<webrtc::MediaStreamInterface> stream_;
+    base::TimeTicks creation_time_;
+
+    // Guards the attributes shared with the signalling thread.
+    base::Lock lock_;
+    webrtc::PeerConnectionObserver *observer_;
+    bool ice_complete_;
+
+    DISALLOW_COPY_AND_ASSIGN(Entry);
+  };
+
+  // |peer_connection_factory| isn't owned, and must outlive the pool.
+  PeerConnectionPool(
+      webrtc::PeerConnectionFactoryInterface *peer_connection_factory,
+      const Settings &settings, size_t size);
+  ~PeerConnectionPool();
+
+  // Creates the missing connections of the pool.
+  void Fill();
+
+  // Discards all connections, as when the network changes, and fills the
+  // pool again.
+  void Reset();
+
+  // Takes the oldest connection still fresh, if any, and schedules its
+  // replacement.
+  scoped_ptr<Entry> Take();
+
+ private:
+  webrtc::PeerConnectionFactoryInterface *peer_connection_factory_;
+  Settings settings_;
+  size_t size_;
+  // Oldest first.
+  ScopedVector<Entry> entries_;
+  base::WeakPtrFactory<PeerConnectionPool> weak_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(PeerConnectionPool);
+};
+
+} // namespace phone
+} // namespace sippet
+
+#endif // SIPPET_PHONE_PEER_CONNECTION_POOL_H_
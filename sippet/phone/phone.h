@@ -14,6 +14,7 @@
 #include "sippet/phone/settings.h"
 #include "sippet/phone/call.h"
 #include "sippet/phone/phone_state.h"
+#include "sippet/phone/stack.h"
 
 namespace sippet {
 namespace phone {
@@ -39,12 +40,31 @@ class Phone :
   // Create a |Phone| instance.
   static scoped_refptr<Phone> Create(Delegate *delegate);
 
+  // Create a |Phone| as a line of |stack|, sharing its network thread,
+  // channels and peer connection factory with the other lines created on
+  // it. Lines tell apart their incoming calls by the user of their |uri|,
+  // so it must be unique on the stack.
+  static scoped_refptr<Phone> Create(Delegate *delegate,
+                                     const scoped_refptr<Stack>& stack);
+
   // Get the |Phone| state.
   virtual PhoneState state() const = 0;
 
   // Initialize a |Phone| instance.
   virtual bool Init(const Settings& settings) = 0;
 
+  // Initialize a |Phone| instance, returning at once: |on_completed| is run
+  // on the network thread once the line is set up there.
+  virtual bool Init(const Settings& settings,
+                    const net::CompletionCallback& on_completed) = 0;
+
+  // Shut down the |Phone| without waiting for the network thread: its calls
+  // are dropped, and |on_completed| runs once done. Releasing the |Phone|
+  // afterwards doesn't wait either, except to stop the network thread when
+  // it's the last line of its stack; so the last reference mustn't be
+  // released from |on_completed|.
+  virtual void Shutdown(const net::CompletionCallback& on_completed) = 0;
+
   // Register the Phone to receive incoming requests.
   virtual void Register(const net::CompletionCallback& on_completed) = 0;
 
@@ -55,6 +75,12 @@ class Phone :
   // Stops refreshing registration.
   virtual void StopRefreshRegister() = 0;
 
+  // Called when a push notification of |Settings::push_provider| wakes the
+  // application: the registration is refreshed at once, so that the proxy
+  // forwards the pending call through the new channel (RFC 8599 section
+  // 5.6.2).
+  virtual void HandlePushNotification() = 0;
+
   // Unregister current account.
   virtual void Unregister(const net::CompletionCallback& on_completed) = 0;
 
@@ -12,71 +12,20 @@
 #include "sippet/base/casting.h"
 #include "base/strings/utf_string_conversions.h"
 #include "net/base/net_errors.h"
-#include "net/socket/client_socket_factory.h"
-#include "net/proxy/proxy_config_service.h"
-#include "net/url_request/url_request_context.h"
-#include "net/url_request/url_request_context_builder.h"
-#include "sippet/ua/dialog_controller.h"
+#include "net/base/network_change_notifier.h"
+#include "sippet/message/status_code.h"
 #include "sippet/phone/completion_status.h"
+#include "sippet/uri/uri_util.h"
 #include "talk/media/devices/devicemanager.h"
-#include "jingle/glue/thread_wrapper.h"
 #include "webrtc/base/ssladapter.h"
 
 namespace sippet {
 
 namespace {
 
-// Config getter that always returns direct settings.
-class ProxyConfigServiceDirect : public net::ProxyConfigService {
- public:
-  // Overridden from ProxyConfigService:
-  void AddObserver(Observer* observer) override {}
-  void RemoveObserver(Observer* observer) override {}
-  ConfigAvailability GetLatestProxyConfig(
-    net::ProxyConfig* config) override {
-    *config = net::ProxyConfig::CreateDirect();
-    return CONFIG_VALID;
-  }
-};
-
-class URLRequestContextGetter : public net::URLRequestContextGetter {
- public:
-  explicit URLRequestContextGetter(
-    scoped_refptr<base::SingleThreadTaskRunner> network_task_runner)
-      : network_task_runner_(network_task_runner) {
-  }
-
-  // Overridden from net::URLRequestContextGetter:
-  net::URLRequestContext* GetURLRequestContext() override {
-    CHECK(network_task_runner_->BelongsToCurrentThread());
-    if (!url_request_context_) {
-      net::URLRequestContextBuilder builder;
-      // net::HttpServer fails to parse headers if user-agent header is blank.
-      builder.set_user_agent("Sippet");
-      builder.DisableHttpCache();
-#if defined(OS_LINUX) || defined(OS_ANDROID)
-      builder.set_proxy_config_service(new ProxyConfigServiceDirect());
-#endif
-      url_request_context_.reset(builder.Build());
-    }
-    return url_request_context_.get();
-  }
-
-  scoped_refptr<base::SingleThreadTaskRunner>
-    GetNetworkTaskRunner() const override {
-    return network_task_runner_;
-  }
-
- private:
-  ~URLRequestContextGetter() override {}
-
-  scoped_refptr<base::SingleThreadTaskRunner> network_task_runner_;
-
-  // Only accessed on the IO thread.
-  scoped_ptr<net::URLRequestContext> url_request_context_;
-
-  DISALLOW_COPY_AND_ASSIGN(URLRequestContextGetter);
-};
+// Destinations whose URI is kept, for auto-dialers and click-to-call pages
+// calling the same numbers again.
+const size_t kToUriCacheSize = 256;
 
 void RunIfNotOk(const net::CompletionCallback& c, int rv) {
   if (net::OK != rv) {
@@ -135,26 +84,63 @@ int PhoneImpl::PasswordHandler::GetCredentials(
 //
 // Phone implementation
 //
-PhoneImpl::PhoneImpl(Phone::Delegate *delegate)
+PhoneImpl::PhoneImpl(Phone::Delegate *delegate, StackImpl *stack)
   : state_(PHONE_STATE_OFFLINE),
     last_state_(PHONE_STATE_OFFLINE),
     delegate_(delegate),
-    network_thread_("PhoneSignalling"),
-    network_thread_event_(false, false) {
+    stack_(stack),
+    network_thread_event_(false, false),
+    shutdown_(false),
+    to_uri_cache_(kToUriCacheSize) {
   DCHECK(delegate);
 }
 
 PhoneImpl::~PhoneImpl() {
-  network_thread_.message_loop()->PostTask(FROM_HERE,
+  // On a loop shared with the embedder, the last reference may be released
+  // by a task, that can't wait for another.
+  bool on_network_thread =
+      stack_ && GetNetworkTaskRunner()->BelongsToCurrentThread();
+  if (shutdown_) {
+    // Returns at once, unless the teardown is still running
+    CHECK(!on_network_thread || network_thread_event_.IsSignaled())
+        << "Released before its shutdown completed";
+    if (!on_network_thread)
+      network_thread_event_.Wait();
+    return;
+  }
+  if (PHONE_STATE_OFFLINE == GetState())
+    return;
+  if (on_network_thread) {
+    OnDestroy();
+    return;
+  }
+  GetNetworkTaskRunner()->PostTask(FROM_HERE,
       base::Bind(&PhoneImpl::OnDestroy, base::Unretained(this)));
   network_thread_event_.Wait();
 }
 
 PhoneState PhoneImpl::state() const {
-  return state_;
+  return GetState();
+}
+
+PhoneState PhoneImpl::GetState() const {
+  return static_cast<PhoneState>(base::subtle::Acquire_Load(&state_));
+}
+
+void PhoneImpl::SetState(PhoneState state) {
+  base::subtle::Release_Store(&state_, state);
+}
+
+bool PhoneImpl::SwapState(PhoneState from, PhoneState to) {
+  return from == base::subtle::Acquire_CompareAndSwap(&state_, from, to);
 }
 
 bool PhoneImpl::Init(const Settings& settings) {
+  return Init(settings, net::CompletionCallback());
+}
+
+bool PhoneImpl::Init(const Settings& settings,
+                     const net::CompletionCallback& on_completed) {
   if (settings_.is_valid()) {
     DVLOG(1) << "Already initialized";
     return false;
@@ -163,78 +149,99 @@ bool PhoneImpl::Init(const Settings& settings) {
     DVLOG(1) << "Invalid settings";
     return false;
   }
-  base::Thread::Options options;
+  if (!stack_) {
+    // A stack of its own
+    stack_ = StackImpl::Create(settings);
+    if (!stack_)
+      return false;
+  }
   settings_ = settings;
-  password_handler_factory_.reset(new PasswordHandler::Factory(&settings_));
-  options.message_loop_type = base::MessageLoop::TYPE_IO;
-  if (!network_thread_.StartWithOptions(options)) {
-    return false;
+  {
+    // Normalized with the previous dial plan, if any
+    base::AutoLock auto_lock(to_uri_lock_);
+    to_uri_cache_.Clear();
   }
-  state_ = PHONE_STATE_READY;
-  network_thread_.message_loop()->PostTask(FROM_HERE,
-      base::Bind(&PhoneImpl::OnInit, base::Unretained(this)));
+  password_handler_factory_.reset(new PasswordHandler::Factory(&settings_));
+  SetState(PHONE_STATE_READY);
+  GetNetworkTaskRunner()->PostTask(FROM_HERE,
+      base::Bind(&PhoneImpl::OnInit, base::Unretained(this), on_completed));
   return true;
 }
 
+void PhoneImpl::Shutdown(const net::CompletionCallback& on_completed) {
+  if (shutdown_ || PHONE_STATE_OFFLINE == GetState()) {
+    DVLOG(1) << "Not initialized";
+    return;
+  }
+  shutdown_ = true;
+  // No more commands are accepted
+  SetState(PHONE_STATE_OFFLINE);
+  GetNetworkTaskRunner()->PostTask(FROM_HERE,
+      base::Bind(&PhoneImpl::OnShutdown, base::Unretained(this),
+          on_completed));
+}
+
 void PhoneImpl::Register(const net::CompletionCallback& on_completed) {
-  if (PHONE_STATE_READY != state_) {
+  if (!SwapState(PHONE_STATE_READY, PHONE_STATE_REGISTERING)) {
     DVLOG(1) << "Not ready";
     return;
   }
-  base::AutoLock lock(lock_);
-  state_ = PHONE_STATE_REGISTERING;
-  on_register_completed_ = on_completed;
-  network_thread_.message_loop()->PostTask(FROM_HERE,
-      base::Bind(&PhoneImpl::OnRegister, base::Unretained(this)));
+  GetNetworkTaskRunner()->PostTask(FROM_HERE,
+      base::Bind(&PhoneImpl::OnRegister, base::Unretained(this),
+          on_completed));
 }
 
 void PhoneImpl::StartRefreshRegister(
     const net::CompletionCallback& on_completed) {
-  if (PHONE_STATE_REGISTERED != state_) {
+  if (PHONE_STATE_REGISTERED != GetState()) {
     DVLOG(1) << "Not registered";
     return;
   }
-  base::AutoLock lock(lock_);
-  on_refresh_completed_ = on_completed;
-  network_thread_.message_loop()->PostTask(FROM_HERE,
-      base::Bind(&PhoneImpl::OnStartRefreshRegister, base::Unretained(this)));
+  GetNetworkTaskRunner()->PostTask(FROM_HERE,
+      base::Bind(&PhoneImpl::OnStartRefreshRegister, base::Unretained(this),
+          on_completed));
 }
 
 void PhoneImpl::StopRefreshRegister() {
-  if (PHONE_STATE_REGISTERED != state_) {
+  if (PHONE_STATE_REGISTERED != GetState()) {
     DVLOG(1) << "Not registered";
     return;
   }
-  base::AutoLock lock(lock_);
-  network_thread_.message_loop()->PostTask(FROM_HERE,
+  GetNetworkTaskRunner()->PostTask(FROM_HERE,
       base::Bind(&PhoneImpl::OnStopRefreshRegister, base::Unretained(this)));
 }
 
+void PhoneImpl::HandlePushNotification() {
+  if (PHONE_STATE_REGISTERED != GetState()) {
+    DVLOG(1) << "Not registered";
+    return;
+  }
+  GetNetworkTaskRunner()->PostTask(FROM_HERE,
+      base::Bind(&PhoneImpl::OnPushNotification, base::Unretained(this)));
+}
+
 void PhoneImpl::Unregister(const net::CompletionCallback& on_completed) {
-  if (PHONE_STATE_REGISTERED != state_) {
+  if (!SwapState(PHONE_STATE_REGISTERED, PHONE_STATE_UNREGISTERING)) {
     DVLOG(1) << "Not ready";
     return;
   }
-  base::AutoLock lock(lock_);
-  last_state_ = state_;
-  state_ = PHONE_STATE_UNREGISTERING;
-  on_unregister_completed_ = on_completed;
-  network_thread_.message_loop()->PostTask(FROM_HERE,
-      base::Bind(&PhoneImpl::OnUnregister, base::Unretained(this), false));
+  GetNetworkTaskRunner()->PostTask(FROM_HERE,
+      base::Bind(&PhoneImpl::OnUnregister, base::Unretained(this), false,
+          PHONE_STATE_REGISTERED, on_completed));
 }
 
 void PhoneImpl::UnregisterAll(const net::CompletionCallback& on_completed) {
-  if (PHONE_STATE_READY != state_
-      && PHONE_STATE_REGISTERED != state_) {
-    DVLOG(1) << "Not ready";
-    return;
+  PhoneState last_state = PHONE_STATE_READY;
+  if (!SwapState(last_state, PHONE_STATE_UNREGISTERING)) {
+    last_state = PHONE_STATE_REGISTERED;
+    if (!SwapState(last_state, PHONE_STATE_UNREGISTERING)) {
+      DVLOG(1) << "Not ready";
+      return;
+    }
   }
-  base::AutoLock lock(lock_);
-  last_state_ = state_;
-  state_ = PHONE_STATE_UNREGISTERING;
-  on_unregister_completed_ = on_completed;
-  network_thread_.message_loop()->PostTask(FROM_HERE,
-      base::Bind(&PhoneImpl::OnUnregister, base::Unretained(this), true));
+  GetNetworkTaskRunner()->PostTask(FROM_HERE,
+      base::Bind(&PhoneImpl::OnUnregister, base::Unretained(this), true,
+          last_state, on_completed));
 }
 
 scoped_refptr<Call> PhoneImpl::MakeCall(const std::string& destination,
@@ -243,12 +250,12 @@ scoped_refptr<Call> PhoneImpl::MakeCall(const std::string& destination,
     DVLOG(1) << "Empty destination";
     return nullptr;
   }
-  if (PHONE_STATE_READY != state_
-      && PHONE_STATE_REGISTERED != state_) {
+  PhoneState state = GetState();
+  if (PHONE_STATE_READY != state
+      && PHONE_STATE_REGISTERED != state) {
     DVLOG(1) << "Not ready";
     return nullptr;
   }
-  base::AutoLock lock(lock_);
   SipURI destination_uri(GetToUri(destination));
   if (!destination_uri.is_valid()) {
     DVLOG(1) << "Invalid destination";
@@ -256,132 +263,189 @@ scoped_refptr<Call> PhoneImpl::MakeCall(const std::string& destination,
   }
   scoped_refptr<CallImpl> call(
       new CallImpl(destination_uri, this, on_completed));
-  calls_.push_back(call);
-  network_thread_.message_loop()->PostTask(FROM_HERE,
-      base::Bind(&CallImpl::OnMakeCall, base::Unretained(call.get()),
-          base::Unretained(peer_connection_factory_.get())));
+  GetNetworkTaskRunner()->PostTask(FROM_HERE,
+      base::Bind(&PhoneImpl::OnMakeCall, base::Unretained(this), call));
   return call;
 }
 
-void PhoneImpl::RemoveCall(const scoped_refptr<Call>& call) {
-  base::AutoLock lock(lock_);
-  CallsVector::iterator i;
-  for (i = calls_.begin(); i != calls_.end(); ++i) {
-    if (*i == call.get())
-      break;
+void PhoneImpl::OnMakeCall(const scoped_refptr<CallImpl>& call) {
+  DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
+  calls_.insert(std::make_pair(call.get(), call));
+  if (settings_.signalling_only()) {
+    call->SendStubOffer();
+    return;
+  }
+  scoped_ptr<PeerConnectionPool::Entry> entry;
+  if (peer_connection_pool_)
+    entry = peer_connection_pool_->Take();
+  if (!entry) {
+    entry = PeerConnectionPool::Entry::Create(
+        stack_->GetPeerConnectionFactory(), settings_);
   }
-  if (calls_.end() != i)
-    calls_.erase(i);
+  call->OnMakeCall(entry.Pass());
 }
 
-bool PhoneImpl::InitializePeerConnectionFactory() {
-  DCHECK(peer_connection_factory_.get() == nullptr);
+void PhoneImpl::RemoveCall(CallImpl *call) {
+  DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
+  stack_->RemoveRoutes(call);
+  // The call may be released here.
+  calls_.erase(call);
+}
+
+void PhoneImpl::UpdateRequestRoute(CallImpl *call,
+    const scoped_refptr<Request>& old_request,
+    const scoped_refptr<Request>& new_request) {
+  // Removed calls aren't routed anymore.
+  stack_->UpdateRequestRoute(call, old_request,
+      calls_.count(call) ? new_request : nullptr);
+}
+
+void PhoneImpl::UpdateDialogRoute(CallImpl *call,
+    const scoped_refptr<Dialog>& old_dialog,
+    const scoped_refptr<Dialog>& new_dialog) {
+  stack_->UpdateDialogRoute(call, old_dialog,
+      calls_.count(call) ? new_dialog : nullptr);
+}
+
+scoped_refptr<Request> PhoneImpl::CreateRequest(const Method &method,
+                                                const GURL &request_uri,
+                                                const GURL &to) {
+  scoped_refptr<Request> request(
+      user_agent()->CreateRequest(method, request_uri, settings_.uri(), to));
+  // The network layer keeps the user and the parameters when stamping the
+  // local address.
+  std::string username(GetContactUser());
+  std::string parameters;
+  if (Method::REGISTER == method)
+    parameters = GetPushParameters();
+  Contact *contact = request->get<Contact>();
+  if (contact && (!username.empty() || !parameters.empty())) {
+    std::string address("sip:");
+    if (!username.empty())
+      address += username + "@";
+    address += "domain.invalid" + parameters;
+    contact->front().set_address(GURL(address));
+  }
+  return request;
+}
+
+void PhoneImpl::OnInit(const net::CompletionCallback& on_completed) {
+  DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
 
-  // To allow sending to the signaling/worker threads.
-  jingle_glue::JingleThreadWrapper::EnsureForCurrentMessageLoop();
-  jingle_glue::JingleThreadWrapper::current()->set_send_allowed(true);
+  refresh_.reset(new RefreshScheduler::Refresh(stack_->refresh_scheduler(),
+      base::Bind(&PhoneImpl::OnRefreshRegister, base::Unretained(this))));
+  stack_->AddLine(this);
 
-  peer_connection_factory_ = webrtc::CreatePeerConnectionFactory();
-  if (!peer_connection_factory_.get()) {
-    DeletePeerConnectionFactory();
-    return false;
+  if (settings_.preconnect())
+    Preconnect();
+
+  // Gathering runs on the webrtc threads, but the connections are created
+  // after the phone is up.
+  if (settings_.peer_connection_pool_size() > 0
+      && !settings_.signalling_only()) {
+    GetNetworkTaskRunner()->PostTask(FROM_HERE,
+        base::Bind(&PhoneImpl::OnCreatePeerConnectionPool,
+            base::Unretained(this)));
   }
 
-  webrtc::PeerConnectionFactoryInterface::Options options;
-  options.disable_encryption = settings_.disable_encryption();
-  options.disable_sctp_data_channels = settings_.disable_sctp_data_channels();
-  peer_connection_factory_->SetOptions(options);
-  return true;
+  if (!on_completed.is_null())
+    on_completed.Run(net::OK);
 }
 
-void PhoneImpl::DeletePeerConnectionFactory() {
-  peer_connection_factory_ = nullptr;
+void PhoneImpl::OnCreatePeerConnectionPool() {
+  DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
+  peer_connection_pool_.reset(new PeerConnectionPool(
+      stack_->GetPeerConnectionFactory(), settings_,
+      settings_.peer_connection_pool_size()));
+  peer_connection_pool_->Fill();
 }
 
-void PhoneImpl::OnInit() {
+void PhoneImpl::Preconnect() {
   DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
 
-  base::MessageLoop *message_loop = network_thread_.message_loop();
-  refresh_timer_.reset(new base::OneShotTimer<PhoneImpl>);
-
-  request_context_getter_ =
-      new URLRequestContextGetter(message_loop->task_runner());
-
-  net::ClientSocketFactory *client_socket_factory =
-      net::ClientSocketFactory::GetDefaultFactory();
-  host_resolver_ = net::HostResolver::CreateDefaultResolver(nullptr);
-  scoped_ptr<AuthHandlerRegistryFactory> auth_handler_factory(
-      AuthHandlerFactory::CreateDefault(host_resolver_.get()));
-  auth_handler_factory_ = auth_handler_factory.Pass();
-
-  user_agent_.reset(new ua::UserAgent(auth_handler_factory_.get(),
-      password_handler_factory_.get(),
-      DialogController::GetDefaultDialogController(), net_log_));
-
-  network_layer_.reset(new NetworkLayer(user_agent_.get()));
-
-  // Register the channel factory
-  net::SSLConfig ssl_config;
-  ssl_config.version_min = net::SSL_PROTOCOL_VERSION_TLS1;
-  channel_factory_.reset(new ChromeChannelFactory(client_socket_factory,
-      request_context_getter_, ssl_config));
-  network_layer_->RegisterChannelFactory(Protocol::UDP,
-      channel_factory_.get());
-  network_layer_->RegisterChannelFactory(Protocol::TCP,
-      channel_factory_.get());
-  network_layer_->RegisterChannelFactory(Protocol::TLS,
-      channel_factory_.get());
-  user_agent_->SetNetworkLayer(network_layer_.get());
-  user_agent_->AppendHandler(this);
-
-  InitializePeerConnectionFactory();
-
-  // Initialize the route-set, if available
-  if (settings_.route_set().size() > 0) {
-    user_agent_->set_route_set(settings_.route_set());
+  // The REGISTER is never sent: it's only built to find where the first
+  // one will go, through the route set.
+  // Lines of a shared stack sending to the same registrar reuse the
+  // channel of the first one.
+  scoped_refptr<Request> request =
+      CreateRequest(
+          Method::REGISTER,
+          GURL(GetRegistrarUri()),
+          GURL(GetFromUri()));
+  EndPoint destination(NetworkLayer::GetMessageEndPoint(*request));
+  if (destination.IsEmpty())
+    return;
+  NetworkLayer *network_layer = stack_->network_layer();
+  int rv = network_layer->Connect(destination);
+  if (net::OK != rv && net::ERR_IO_PENDING != rv) {
+    DVLOG(1) << "Preconnect to " << destination.ToString() << " failed: "
+             << net::ErrorToString(rv);
+    return;
   }
+  // Like any channel left unused, it's closed after the reuse lifetime if
+  // nothing is sent through it.
+  if (network_layer->RequestChannel(destination))
+    network_layer->ReleaseChannel(destination);
 }
 
 void PhoneImpl::OnDestroy() {
   DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
+  TearDown();
+  network_thread_event_.Signal();
+}
+
+void PhoneImpl::OnShutdown(const net::CompletionCallback& on_completed) {
+  DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
+  TearDown();
+  // The phone may be gone as soon as signalled
+  network_thread_event_.Signal();
+  if (!on_completed.is_null())
+    on_completed.Run(net::OK);
+}
+
+void PhoneImpl::TearDown() {
+  DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
 
-  for (CallsVector::iterator i = calls_.begin(), ie = calls_.end();
+  for (CallsMap::iterator i = calls_.begin(), ie = calls_.end();
        i != ie; i++) {
-    (*i)->OnDestroy();
+    i->second->OnDestroy();
+    stack_->RemoveRoutes(i->first);
   }
   calls_.clear();
+  stack_->RemoveLine(this);
+  last_request_ = nullptr;
+  register_template_.reset();
 
-  channel_factory_.reset();
-  auth_handler_factory_.reset();
-  host_resolver_.reset();
-  user_agent_ = nullptr;
-  network_layer_ = nullptr;
-  request_context_getter_ = nullptr;
-  DeletePeerConnectionFactory();
-  refresh_timer_->Stop();
-  refresh_timer_.reset();
-
-  network_thread_event_.Signal();
+  refresh_.reset();
+  peer_connection_pool_.reset();
 }
 
-void PhoneImpl::OnRegister() {
+void PhoneImpl::OnRegister(const net::CompletionCallback& on_completed) {
   DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
+  on_register_completed_ = on_completed;
+  SendRegister();
+}
 
-  std::string registrar_uri(GetRegistrarUri());
-  std::string address_of_record(GetFromUri());
+void PhoneImpl::SendRegister() {
+  DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
 
-  last_request_ =
-      user_agent_->CreateRequest(
-          Method::REGISTER,
-          GURL(registrar_uri),
-          GURL(address_of_record),
-          GURL(address_of_record));
+  // Refreshes only differ from the first REGISTER by their Call-ID, tag
+  // and CSeq: they're stamped out of the same template.
+  if (!register_template_) {
+    scoped_refptr<Request> request =
+        CreateRequest(
+            Method::REGISTER,
+            GURL(GetRegistrarUri()),
+            GURL(GetFromUri()));
+    register_template_.reset(new RequestTemplate(*request,
+        stack_->network_layer()->request_headers()));
+  }
 
   // Indicate the desired expiration for the address-of-record binding
-  scoped_ptr<Expires> expires(new Expires(settings_.register_expires()));
-  last_request_->push_back(expires.Pass());
+  last_request_ =
+      register_template_->CreateRequest(0, settings_.register_expires());
 
-  int rv = user_agent_->Send(last_request_,
+  int rv = user_agent()->Send(last_request_,
       base::Bind(&RunIfNotOk, on_register_completed_));
   if (net::OK != rv && net::ERR_IO_PENDING != rv) {
     on_register_completed_.Run(rv);
@@ -391,35 +455,49 @@ void PhoneImpl::OnRegister() {
   // Wait for SIP response now
 }
 
-void PhoneImpl::OnStartRefreshRegister() {
+void PhoneImpl::OnStartRefreshRegister(
+    const net::CompletionCallback& on_completed) {
+  DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
+  on_refresh_completed_ = on_completed;
+  StartRefreshTimer();
+}
+
+void PhoneImpl::StartRefreshTimer() {
   DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
 
-  // Refresh the registration 25 seconds before expiration.
-  base::TimeDelta expiration = register_expires_ - base::Time::Now()
-      - base::TimeDelta::FromSeconds(25);
-  if (expiration < base::TimeDelta::FromSeconds(0))
-    expiration = base::TimeDelta::FromSeconds(0);
-  refresh_timer_->Start(FROM_HERE, expiration,
-      base::Bind(&PhoneImpl::OnRefreshRegister, base::Unretained(this)));
+  // The scheduler spreads the refreshes of the lines sharing the stack.
+  refresh_->ScheduleRefresh(register_expires_ - base::Time::Now());
 }
 
 void PhoneImpl::OnStopRefreshRegister() {
   DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
 
-  refresh_timer_->Stop();
+  refresh_->Cancel();
 }
 
-void PhoneImpl::OnUnregister(bool all) {
+void PhoneImpl::OnPushNotification() {
   DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
+  // Unless an unregistration was started meanwhile
+  if (PHONE_STATE_REGISTERED != GetState())
+    return;
+  // The channel was likely closed while the application slept: the
+  // refresh opens a new one, which the proxy uses to send the call.
+  refresh_->ScheduleNow();
+}
+
+void PhoneImpl::OnUnregister(bool all, PhoneState last_state,
+                             const net::CompletionCallback& on_completed) {
+  DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
+  last_state_ = last_state;
+  on_unregister_completed_ = on_completed;
 
   std::string registrar_uri(GetRegistrarUri());
   std::string address_of_record(GetFromUri());
 
   last_request_ =
-      user_agent_->CreateRequest(
+      CreateRequest(
           Method::REGISTER,
           GURL(registrar_uri),
-          GURL(address_of_record),
           GURL(address_of_record));
 
   if (all) {
@@ -437,7 +515,7 @@ void PhoneImpl::OnUnregister(bool all) {
     contact->front().set_expires(0);
   }
 
-  int rv = user_agent_->Send(last_request_,
+  int rv = user_agent()->Send(last_request_,
       base::Bind(&RunIfNotOk, on_unregister_completed_));
   if (net::OK != rv && net::ERR_IO_PENDING != rv) {
     on_unregister_completed_.Run(rv);
@@ -447,168 +525,127 @@ void PhoneImpl::OnUnregister(bool all) {
   // Wait for SIP response now
 }
 
-void PhoneImpl::OnChannelConnected(const EndPoint &destination, int err) {
-  // Nothing to do
-}
-
-void PhoneImpl::OnChannelClosed(const EndPoint &destination) {
-  // Nothing to do
-}
-
-void PhoneImpl::OnIncomingRequest(
-    const scoped_refptr<Request> &incoming_request,
-    const scoped_refptr<Dialog> &dialog) {
+void PhoneImpl::OnIncomingCall(
+    const scoped_refptr<Request> &incoming_request) {
   DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
-  if (Method::INVITE == incoming_request->method()) {
-    scoped_refptr<CallImpl> call(new CallImpl(incoming_request, this));
-    {
-      base::AutoLock lock(lock_);
-      calls_.push_back(call);
-    }
-    delegate_->OnIncomingCall(call);
-  } else {
-    scoped_refptr<CallImpl> call = RouteToCall(dialog);
-    if (call)
-      call->OnIncomingRequest(incoming_request, dialog);
-  }
+  scoped_refptr<CallImpl> call(new CallImpl(incoming_request, this));
+  calls_.insert(std::make_pair(call.get(), call));
+  stack_->UpdateRequestRoute(call.get(), nullptr, incoming_request);
+  // Announce the call first, and get the media engine ready meanwhile.
+  if (!settings_.signalling_only())
+    stack_->PrewarmPeerConnectionFactory();
+  delegate_->OnIncomingCall(call);
 }
 
-void PhoneImpl::OnIncomingResponse(
-    const scoped_refptr<Response> &incoming_response,
-    const scoped_refptr<Dialog> &dialog) {
+void PhoneImpl::OnRegisterResponse(
+    const scoped_refptr<Response> &incoming_response) {
   DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
-  if (Method::REGISTER == incoming_response->refer_to()->method()) {
-    if (last_request_->id() != incoming_response->refer_to()->id()) {
-      // Discard, as it was unrelated to current REGISTER request
+  if (!last_request_
+      || last_request_->id() != incoming_response->refer_to()->id()) {
+    // Discard, as it was unrelated to current REGISTER request
+    return;
+  }
+  PhoneState state = GetState();
+  if (PHONE_STATE_REGISTERING == state) {  // result of Register
+    int response_code = incoming_response->response_code();
+    if (response_code / 100 == 1) {
+      // Do nothing, wait for a final response
       return;
-    } else if (PHONE_STATE_REGISTERING == state_) {  // result of Register
-      int response_code = incoming_response->response_code();
-      if (response_code / 100 == 1) {
-        // Do nothing, wait for a final response
-        return;
-      } else if (response_code / 100 == 2) {
-        // Save the time when the registration will expire
-        unsigned int expiration = GetContactExpiration(incoming_response);
-        register_expires_ = base::Time::Now() +
-            base::TimeDelta::FromSeconds(expiration);
-        base::AutoLock lock(lock_);
-        state_ = PHONE_STATE_REGISTERED;
-      } else {
-        base::AutoLock lock(lock_);
-        state_ = PHONE_STATE_READY;
-      }
-      // Notify completion
-      on_register_completed_.Run(
-          StatusCodeToCompletionStatus(incoming_response->response_code()));
-    } else if (PHONE_STATE_REGISTERED == state_) {  // after refresh register
-      int response_code = incoming_response->response_code();
-      if (response_code / 100 == 1) {
-        // Do nothing, wait for a final response
-        return;
-      } else if (response_code / 100 == 2) {
-        // Start the timer to refresh login again
-        unsigned int expiration = GetContactExpiration(incoming_response);
-        register_expires_ = base::Time::Now() +
-            base::TimeDelta::FromSeconds(expiration);
-        OnStartRefreshRegister();
-      } else {
-        {
-          base::AutoLock lock(lock_);
-          state_ = PHONE_STATE_READY;
-        }
-        // Notify the problem upwards
-        on_refresh_completed_.Run(
-            StatusCodeToCompletionStatus(incoming_response->response_code()));
-      }
-    } else if (PHONE_STATE_UNREGISTERING == state_) {  // result of Unregister
-      int response_code = incoming_response->response_code();
-      if (response_code / 100 == 1) {
-        // Do nothing, wait for a final response
-        return;
-      } else if (response_code / 100 == 2) {
-        base::AutoLock lock(lock_);
-        state_ = PHONE_STATE_READY;
-      } else {
-        // If registration fails, recall last state
-        base::AutoLock lock(lock_);
-        state_ = last_state_;
-      }
-      // Notify completion
-      on_unregister_completed_.Run(
+    } else if (response_code / 100 == 2) {
+      // Save the time when the registration will expire
+      unsigned int expiration = GetContactExpiration(incoming_response);
+      register_expires_ = base::Time::Now() +
+          base::TimeDelta::FromSeconds(expiration);
+      SetState(PHONE_STATE_REGISTERED);
+    } else {
+      SetState(PHONE_STATE_READY);
+    }
+    // Notify completion
+    on_register_completed_.Run(
+        StatusCodeToCompletionStatus(incoming_response->response_code()));
+  } else if (PHONE_STATE_REGISTERED == state) {  // after refresh register
+    int response_code = incoming_response->response_code();
+    if (response_code / 100 == 1) {
+      // Do nothing, wait for a final response
+      return;
+    } else if (response_code / 100 == 2) {
+      // Start the timer to refresh login again
+      unsigned int expiration = GetContactExpiration(incoming_response);
+      register_expires_ = base::Time::Now() +
+          base::TimeDelta::FromSeconds(expiration);
+      StartRefreshTimer();
+    } else if (!RetryRefresh(response_code)) {
+      // Unless an unregistration was started meanwhile
+      SwapState(PHONE_STATE_REGISTERED, PHONE_STATE_READY);
+      // Notify the problem upwards
+      on_refresh_completed_.Run(
           StatusCodeToCompletionStatus(incoming_response->response_code()));
     }
-  } else if (Method::INVITE == incoming_response->refer_to()->method()
-             || Method::BYE == incoming_response->refer_to()->method()) {
-    CallImpl *call = RouteToCall(incoming_response->refer_to());
-    if (call)
-      call->OnIncomingResponse(incoming_response, dialog);
+  } else if (PHONE_STATE_UNREGISTERING == state) {  // result of Unregister
+    int response_code = incoming_response->response_code();
+    if (response_code / 100 == 1) {
+      // Do nothing, wait for a final response
+      return;
+    } else if (response_code / 100 == 2) {
+      SetState(PHONE_STATE_READY);
+    } else {
+      // If registration fails, recall last state
+      SetState(last_state_);
+    }
+    // Notify completion
+    on_unregister_completed_.Run(
+        StatusCodeToCompletionStatus(incoming_response->response_code()));
   }
 }
 
-void PhoneImpl::OnTimedOut(
-    const scoped_refptr<Request> &request,
-    const scoped_refptr<Dialog> &dialog) {
+void PhoneImpl::OnRegisterError(const scoped_refptr<Request> &request,
+                                int error) {
   DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
-  if (Method::INVITE == request->method()
-      || Method::BYE == request->method()) {
-    CallImpl *call = RouteToCall(request);
-    if (call)
-      call->OnTimedOut(request, dialog);
-  } else if (Method::REGISTER == request->method()) {
-    if (PHONE_STATE_REGISTERING == state_)
-      on_register_completed_.Run(net::ERR_TIMED_OUT);
-    else if (PHONE_STATE_REGISTERED == state_)
-      on_refresh_completed_.Run(net::ERR_TIMED_OUT);
-    else if (PHONE_STATE_UNREGISTERING == state_)
-      on_unregister_completed_.Run(net::ERR_TIMED_OUT);
-  }
-}
-
-void PhoneImpl::OnTransportError(
-    const scoped_refptr<Request> &request, int error,
-    const scoped_refptr<Dialog> &dialog) {
-  DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
-  if (Method::INVITE == request->method()
-      || Method::BYE == request->method()) {
-    CallImpl *call = RouteToCall(request);
-    if (call)
-      call->OnTransportError(request, error, dialog);
-  } else if (Method::REGISTER == request->method()) {
-    if (PHONE_STATE_REGISTERING == state_)
-      on_register_completed_.Run(error);
-    else if (PHONE_STATE_REGISTERED == state_)
-      on_refresh_completed_.Run(error);
-    else if (PHONE_STATE_UNREGISTERING == state_)
-      on_unregister_completed_.Run(error);
-  }
+  if (!last_request_ || last_request_->id() != request->id())
+    return;
+  PhoneState state = GetState();
+  if (PHONE_STATE_REGISTERING == state)
+    on_register_completed_.Run(error);
+  else if (PHONE_STATE_REGISTERED == state && !RetryRefresh(0))
+    on_refresh_completed_.Run(error);
+  else if (PHONE_STATE_UNREGISTERING == state)
+    on_unregister_completed_.Run(error);
 }
 
-void PhoneImpl::OnRefreshRegister() {
+void PhoneImpl::OnNetworkChanged() {
   DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
-  // Just send another REGISTER
-  OnRegister();
+  // Pooled candidates were gathered on the previous network
+  if (peer_connection_pool_)
+    peer_connection_pool_->Reset();
+  if (PHONE_STATE_REGISTERED != GetState())
+    return;
+  // The binding points to a contact on the previous network: refresh it
+  // now instead of waiting for the timer. All lines of the stack are told
+  // at once, so they wait for their turn.
+  refresh_->ScheduleNow();
 }
 
-CallImpl *PhoneImpl::RouteToCall(const scoped_refptr<Request>& request) {
-  base::AutoLock lock(lock_);
-  CallsVector::iterator i;
-  // A simple linear search will do it for a small amount of
-  // simultaneous calls... But you can improve it if you want
-  for (i = calls_.begin(); i != calls_.end(); ++i) {
-    if (i->get()->last_request()->id() == request->id())
-      break;
-  }
-  return calls_.end() != i ? i->get() : nullptr;
+bool PhoneImpl::RetryRefresh(int response_code) {
+  DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
+  // Timeouts, network errors (no response) and server failures are
+  // transient, as when the registrar restarts: the binding is kept while
+  // it lasts, and backed-off retries spread the lines again.
+  if (0 != response_code
+      && SIP_REQUEST_TIMEOUT != response_code
+      && 5 != response_code / 100)
+    return false;
+  if (register_expires_ <= base::Time::Now())
+    return false;
+  DVLOG(1) << "Refresh of " << GetFromUri() << " failed, retry #"
+           << refresh_->failures() + 1;
+  refresh_->ScheduleRetry();
+  return true;
 }
 
-CallImpl *PhoneImpl::RouteToCall(const scoped_refptr<Dialog>& dialog) {
-  base::AutoLock lock(lock_);
-  CallsVector::iterator i;
-  for (i = calls_.begin(); i != calls_.end(); ++i) {
-    if (i->get()->dialog()->id() == dialog->id())
-      break;
-  }
-  return calls_.end() != i ? i->get() : nullptr;
+void PhoneImpl::OnRefreshRegister() {
+  DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
+  // Just send another REGISTER
+  SendRegister();
 }
 
 unsigned int PhoneImpl::GetContactExpiration(
@@ -650,12 +687,16 @@ std::string PhoneImpl::GetRegistrarUri() const {
   if (!settings_.registrar_server().is_empty()) {
     return settings_.registrar_server().spec();
   } else {
-    SipURI uri(SipURI(settings_.uri().spec()));
-    std::string result(uri.scheme() + ":" + uri.host());
-    if (uri.has_port())
-      result += ":" + uri.port();
-    if (uri.has_parameters())
-      result += uri.parameters();
+    SipURI uri(settings_.uri().spec());
+    std::string result;
+    uri.scheme_piece().AppendToString(&result);
+    result += ':';
+    uri.host_piece().AppendToString(&result);
+    if (uri.has_port()) {
+      result += ':';
+      uri.port_piece().AppendToString(&result);
+    }
+    uri.parameters_piece().AppendToString(&result);
     return result;
   }
 }
@@ -664,16 +705,55 @@ std::string PhoneImpl::GetFromUri() const {
   return settings_.uri().spec();
 }
 
+std::string PhoneImpl::GetContactUser() const {
+  return SipURI(settings_.uri().spec()).username();
+}
+
+std::string PhoneImpl::GetPushParameters() const {
+  std::string result;
+  if (settings_.push_provider().empty())
+    return result;
+  result += ";pn-provider=" + settings_.push_provider();
+  if (!settings_.push_param().empty())
+    result += ";pn-param=" + settings_.push_param();
+  if (!settings_.push_prid().empty())
+    result += ";pn-prid=" + settings_.push_prid();
+  return result;
+}
+
 SipURI PhoneImpl::GetToUri(const std::string& destination) const {
+  base::AutoLock auto_lock(to_uri_lock_);
+  ToUriCache::iterator i = to_uri_cache_.Get(destination);
+  if (to_uri_cache_.end() != i)
+    return i->second;
+  SipURI destination_uri(CreateToUri(destination));
+  if (destination_uri.is_valid())
+    to_uri_cache_.Put(destination, destination_uri);
+  return destination_uri;
+}
+
+SipURI PhoneImpl::CreateToUri(const std::string& destination) const {
   SipURI destination_uri;
   if (destination.find('@') == std::string::npos) {
     SipURI uri(GetRegistrarUri());
     if (uri.is_valid()) {
-      std::string result(uri.scheme() + ":" + destination + "@" + uri.host());
-      if (uri.has_port())
-        result += ":" + uri.port();
-      if (uri.has_parameters())
-        result += uri.parameters();
+      std::string user(destination);
+      bool is_phone_number =
+          uri::NormalizeToE164(destination, settings_.dial_plan(), &user);
+      std::string result;
+      result.reserve(uri.spec().size() + user.size() + 12);
+      uri.scheme_piece().AppendToString(&result);
+      result += ':';
+      result += user;
+      result += '@';
+      uri.host_piece().AppendToString(&result);
+      if (uri.has_port()) {
+        result += ':';
+        uri.port_piece().AppendToString(&result);
+      }
+      uri.parameters_piece().AppendToString(&result);
+      if (is_phone_number)
+        result += ";user=phone";
       destination_uri = SipURI(result);
     }
   } else {
@@ -684,20 +764,27 @@ SipURI PhoneImpl::GetToUri(const std::string& destination) const {
 
 scoped_refptr<base::SingleThreadTaskRunner>
 PhoneImpl::GetNetworkTaskRunner() const {
-  return network_thread_.task_runner();
-}
-
-base::MessageLoop *PhoneImpl::GetNetworkMessageLoop() const {
-  return network_thread_.message_loop();
+  return stack_->GetNetworkTaskRunner();
 }
 
 void Phone::Initialize() {
   // Initialize the SSL libraries
   rtc::InitializeSSL();
+
+  // Watch the network changes, so that channels are migrated; the notifier
+  // lives for the whole process.
+  if (!net::NetworkChangeNotifier::HasNetworkChangeNotifier())
+    ignore_result(net::NetworkChangeNotifier::Create());
 }
 
 scoped_refptr<Phone> Phone::Create(Delegate *delegate) {
-  return new PhoneImpl(delegate);
+  return new PhoneImpl(delegate, nullptr);
+}
+
+scoped_refptr<Phone> Phone::Create(Delegate *delegate,
+                                   const scoped_refptr<Stack>& stack) {
+  DCHECK(stack);
+  return new PhoneImpl(delegate, static_cast<StackImpl*>(stack.get()));
 }
 
 }  // namespace phone
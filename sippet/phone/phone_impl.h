@@ -7,38 +7,41 @@
 
 #include "sippet/phone/phone.h"
 
-#include "base/threading/thread.h"
-#include "base/synchronization/waitable_event.h"
+#include <string>
+
+#include "base/atomicops.h"
+#include "base/containers/hash_tables.h"
+#include "base/containers/mru_cache.h"
 #include "base/synchronization/lock.h"
-#include "base/timer/timer.h"
-#include "net/dns/host_resolver.h"
-#include "net/url_request/url_request_context_getter.h"
-
-#include "sippet/transport/network_layer.h"
-#include "sippet/transport/ssl_cert_error_handler.h"
-#include "sippet/transport/chrome/chrome_channel_factory.h"
-#include "sippet/ua/auth_handler_factory.h"
+#include "base/synchronization/waitable_event.h"
+
+#include "sippet/message/request_template.h"
 #include "sippet/ua/password_handler.h"
+#include "sippet/ua/refresh_scheduler.h"
 #include "sippet/ua/ua_user_agent.h"
 #include "sippet/phone/call_impl.h"
-
-#include "talk/app/webrtc/peerconnectioninterface.h"
+#include "sippet/phone/peer_connection_pool.h"
+#include "sippet/phone/stack_impl.h"
 
 namespace sippet {
 namespace phone {
 
-class PhoneImpl :
-  public Phone,
-  public ua::UserAgent::Delegate {
+// A line of a |StackImpl|, which receives the events of its registration
+// and of its calls. A phone created without a stack runs one of its own.
+class PhoneImpl : public Phone {
  private:
   DISALLOW_COPY_AND_ASSIGN(PhoneImpl);
  public:
   PhoneState state() const override;
   bool Init(const Settings& settings) override;
+  bool Init(const Settings& settings,
+            const net::CompletionCallback& on_completed) override;
+  void Shutdown(const net::CompletionCallback& on_completed) override;
   void Register(const net::CompletionCallback& on_completed) override;
   void StartRefreshRegister(
       const net::CompletionCallback& on_completed) override;
   void StopRefreshRegister() override;
+  void HandlePushNotification() override;
   void Unregister(const net::CompletionCallback& on_completed) override;
   void UnregisterAll(const net::CompletionCallback& on_completed) override;
   scoped_refptr<Call> MakeCall(const std::string& destination,
@@ -47,25 +50,40 @@ class PhoneImpl :
  private:
   friend class Phone;
   friend class CallImpl;
+  friend class StackImpl;
   friend class base::RefCountedThreadSafe<Phone>;
-  typedef std::vector<scoped_refptr<CallImpl>> CallsVector;
+  typedef base::hash_map<CallImpl*, scoped_refptr<CallImpl>> CallsMap;
+  typedef base::HashingMRUCache<std::string, SipURI> ToUriCache;
 
-  // Construct a |Phone|.
-  PhoneImpl(Phone::Delegate *delegate);
+  // Construct a |Phone|, on its own stack if |stack| is NULL.
+  PhoneImpl(Phone::Delegate *delegate, StackImpl *stack);
   ~PhoneImpl() override;
 
-  bool InitializePeerConnectionFactory();
-  void DeletePeerConnectionFactory();
+  // Reading the state and claiming a transition out of it are atomic, so
+  // that neither the public methods nor the network thread lock each other
+  // out: the former only post commands, carrying the arguments they need.
+  PhoneState GetState() const;
+  void SetState(PhoneState state);
+  // Changes the state to |to| only if it's still |from|.
+  bool SwapState(PhoneState from, PhoneState to);
 
-  PhoneState state_;
+  base::subtle::Atomic32 state_;
+  // Only accessed on the network thread, like the calls.
   PhoneState last_state_;
-  base::Lock lock_;
-  CallsVector calls_;
+  CallsMap calls_;
   Phone::Delegate *delegate_;
   Settings settings_;
 
-  base::Thread network_thread_;
+  // Set once initialized.
+  scoped_refptr<StackImpl> stack_;
   base::WaitableEvent network_thread_event_;
+  // Set by |Shutdown|, whose teardown signals |network_thread_event_|.
+  bool shutdown_;
+
+  // The destinations called lately, as their number is only normalized
+  // once; calls are made from any thread.
+  mutable base::Lock to_uri_lock_;
+  mutable ToUriCache to_uri_cache_;
 
   class PasswordHandler : public sippet::PasswordHandler {
    public:
@@ -94,43 +112,58 @@ class PhoneImpl :
     Factory *factory_;
   };
 
-  scoped_refptr<net::URLRequestContextGetter> request_context_getter_;
-  scoped_ptr<net::HostResolver> host_resolver_;
-  scoped_ptr<AuthHandlerFactory> auth_handler_factory_;
-  net::BoundNetLog net_log_;
   scoped_ptr<PasswordHandler::Factory> password_handler_factory_;
-  scoped_ptr<ua::UserAgent> user_agent_;
-  scoped_ptr<NetworkLayer> network_layer_;
-  scoped_ptr<ChromeChannelFactory> channel_factory_;
-  scoped_ptr<base::OneShotTimer<PhoneImpl>> refresh_timer_;
-  Settings::IceServers ice_servers_;
+  scoped_ptr<RefreshScheduler::Refresh> refresh_;
+  // Only with |Settings::peer_connection_pool_size|.
+  scoped_ptr<PeerConnectionPool> peer_connection_pool_;
   base::Time register_expires_;
   net::CompletionCallback on_register_completed_;
   net::CompletionCallback on_unregister_completed_;
   net::CompletionCallback on_refresh_completed_;
 
-  rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface>
-    peer_connection_factory_;
-
   scoped_refptr<Request> last_request_;
+  // Built with the first REGISTER, for the refreshes.
+  scoped_ptr<RequestTemplate> register_template_;
 
   //
   // Call attributes
   //
   const Settings& settings() const { return settings_; }
   Phone::Delegate *delegate() { return delegate_; }
-  ua::UserAgent *user_agent() { return user_agent_.get(); }
-  void RemoveCall(const scoped_refptr<Call>& call);
+  ua::UserAgent *user_agent() { return stack_->user_agent(); }
+  // Creates a request from this line, whose |Contact| has its user.
+  scoped_refptr<Request> CreateRequest(const Method &method,
+                                       const GURL &request_uri,
+                                       const GURL &to);
+  void RemoveCall(CallImpl *call);
+  // Keep the routes of |call| up to date when its last request or its
+  // dialog is replaced.
+  void UpdateRequestRoute(CallImpl *call,
+                          const scoped_refptr<Request>& old_request,
+                          const scoped_refptr<Request>& new_request);
+  void UpdateDialogRoute(CallImpl *call,
+                         const scoped_refptr<Dialog>& old_dialog,
+                         const scoped_refptr<Dialog>& new_dialog);
 
   //
   // Signalling thread callbacks
   //
-  void OnInit();
+  void OnInit(const net::CompletionCallback& on_completed);
   void OnDestroy();
-  void OnRegister();
-  void OnStartRefreshRegister();
+  void OnShutdown(const net::CompletionCallback& on_completed);
+  // Drops the calls and removes the line from the stack.
+  void TearDown();
+  void Preconnect();
+  void OnCreatePeerConnectionPool();
+  void OnRegister(const net::CompletionCallback& on_completed);
+  void OnStartRefreshRegister(const net::CompletionCallback& on_completed);
   void OnStopRefreshRegister();
-  void OnUnregister(bool all);
+  void OnPushNotification();
+  void OnUnregister(bool all, PhoneState last_state,
+                    const net::CompletionCallback& on_completed);
+  void OnMakeCall(const scoped_refptr<CallImpl>& call);
+  void SendRegister();
+  void StartRefreshTimer();
 
   //
   // UserAgent callbacks
@@ -138,38 +171,35 @@ class PhoneImpl :
   static void OnRequestSent(const net::CompletionCallback& callback, int rv);
 
   //
-  // ua::UserAgent::Delegate implementation
+  // Line events, dispatched by the stack
   //
-  void OnChannelConnected(const EndPoint &destination, int err) override;
-  void OnChannelClosed(const EndPoint &destination) override;
-  void OnIncomingRequest(
-      const scoped_refptr<Request> &incoming_request,
-      const scoped_refptr<Dialog> &dialog) override;
-  void OnIncomingResponse(
-      const scoped_refptr<Response> &incoming_response,
-      const scoped_refptr<Dialog> &dialog) override;
-  void OnTimedOut(
-      const scoped_refptr<Request> &request,
-      const scoped_refptr<Dialog> &dialog) override;
-  void OnTransportError(
-      const scoped_refptr<Request> &request, int error,
-      const scoped_refptr<Dialog> &dialog) override;
+  void OnIncomingCall(const scoped_refptr<Request> &incoming_request);
+  void OnRegisterResponse(const scoped_refptr<Response> &incoming_response);
+  void OnRegisterError(const scoped_refptr<Request> &request, int error);
+  void OnNetworkChanged();
+
+  // Handles a failed refresh, returning false if it can't be retried.
+  bool RetryRefresh(int response_code);
 
   //
   // Refresh register timer callback
   //
   void OnRefreshRegister();
 
-  CallImpl *RouteToCall(const scoped_refptr<Request>& request);
-  CallImpl *RouteToCall(const scoped_refptr<Dialog>& dialog);
   unsigned int GetContactExpiration(const scoped_refptr<Response>& response);
 
   std::string GetRegistrarUri() const;
   std::string GetFromUri() const;
+  // The user of the |Contact| of the line, to which calls are sent.
+  std::string GetContactUser() const;
+  // The Contact parameters for push notifications (RFC 8599), if any.
+  std::string GetPushParameters() const;
+  // The URI called for |destination|, from |to_uri_cache_| if called
+  // lately.
   SipURI GetToUri(const std::string& destination) const;
+  SipURI CreateToUri(const std::string& destination) const;
 
   scoped_refptr<base::SingleThreadTaskRunner> GetNetworkTaskRunner() const;
-  base::MessageLoop *GetNetworkMessageLoop() const;
 };
 
 } // namespace sippet
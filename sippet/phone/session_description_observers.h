@@ -0,0 +1,93 @@
+// Copyright (c) 2015 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_PHONE_SESSION_DESCRIPTION_OBSERVERS_H_
+#define SIPPET_PHONE_SESSION_DESCRIPTION_OBSERVERS_H_
+
+#include <string>
+
+#include "base/callback.h"
+
+#include "talk/app/webrtc/jsep.h"
+#include "webrtc/base/refcount.h"
+
+namespace sippet {
+namespace phone {
+
+// Session description observers running callbacks, so that their results
+// can be bound to methods of objects that aren't reference counted.
+class ProxyCreateSessionDescriptionObserver :
+  public webrtc::CreateSessionDescriptionObserver {
+ public:
+  typedef base::Callback<void(webrtc::SessionDescriptionInterface*)>
+      SuccessCallback;
+  typedef base::Callback<void(const std::string&)>
+      FailureCallback;
+
+  static ProxyCreateSessionDescriptionObserver* Create(
+      const SuccessCallback& on_success = SuccessCallback(),
+      const FailureCallback& on_failure = FailureCallback()) {
+    return
+      new rtc::RefCountedObject<ProxyCreateSessionDescriptionObserver>(
+          on_success, on_failure);
+  }
+
+  void OnSuccess(webrtc::SessionDescriptionInterface* desc) override {
+    on_success_.Run(desc);
+  }
+
+  void OnFailure(const std::string& error) override {
+    on_failure_.Run(error);
+  }
+
+ protected:
+  ProxyCreateSessionDescriptionObserver(
+      const SuccessCallback& on_success,
+      const FailureCallback& on_failure) :
+          on_success_(on_success), on_failure_(on_failure) {
+  }
+  ~ProxyCreateSessionDescriptionObserver() override {}
+
+  SuccessCallback on_success_;
+  FailureCallback on_failure_;
+};
+
+class ProxySetSessionDescriptionObserver :
+  public webrtc::SetSessionDescriptionObserver {
+ public:
+  typedef base::Callback<void()> SuccessCallback;
+  typedef base::Callback<void(const std::string&)> FailureCallback;
+
+  static ProxySetSessionDescriptionObserver* Create(
+        const SuccessCallback& on_success = SuccessCallback(),
+        const FailureCallback& on_failure = FailureCallback()) {
+    return
+      new rtc::RefCountedObject<ProxySetSessionDescriptionObserver>(
+            on_success, on_failure);
+  }
+
+  void OnSuccess() override {
+    on_success_.Run();
+  }
+
+  void OnFailure(const std::string& error) override {
+    on_failure_.Run(error);
+  }
+
+ protected:
+  ProxySetSessionDescriptionObserver(
+        const SuccessCallback& on_success,
+        const FailureCallback& on_failure) :
+            on_success_(on_success), on_failure_(on_failure) {
+  }
+  ~ProxySetSessionDescriptionObserver() override {}
+
+  SuccessCallback on_success_;
+  FailureCallback on_failure_;
+};
+
+} // namespace phone
+} // namespace sippet
+
+#endif // SIPPET_PHONE_SESSION_DESCRIPTION_OBSERVERS_H_
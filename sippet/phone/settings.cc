@@ -12,7 +12,15 @@ namespace phone {
 Settings::Settings() :
   disable_encryption_(false),
   disable_sctp_data_channels_(false),
-  register_expires_(600) {
+  register_expires_(600),
+  refresh_alignment_(0),
+  preconnect_(false),
+  prewarm_media_(false),
+  early_offer_(false),
+  peer_connection_pool_size_(0),
+  signalling_only_(false),
+  shared_signalling_thread_(false),
+  aead_cipher_suites_only_(false) {
 }
 
 Settings::~Settings() {
@@ -11,6 +11,7 @@
 #include "url/gurl.h"
 
 #include "sippet/phone/ice_server.h"
+#include "sippet/uri/uri_util.h"
 
 namespace sippet {
 namespace phone {
@@ -55,6 +56,17 @@ class Settings {
     return route_set_;
   }
 
+  // The dial plan normalizing the numbers called without a host to E.164
+  // (see |uri::NormalizeToE164|), which are then called as
+  // "sip:+<digits>@<registrar>;user=phone". By default, only the numbers
+  // dialed in their international form are normalized.
+  uri::DialPlan &dial_plan() {
+    return dial_plan_;
+  }
+  const uri::DialPlan &dial_plan() const {
+    return dial_plan_;
+  }
+
   // SIP URI associated to the User Agent. This is a SIP address given to you
   // by your provider.
   const GURL& uri() const {
@@ -116,12 +128,130 @@ class Settings {
   void set_registrar_server(const GURL& value) {
     registrar_server_ = value;
   }
+
+  // The push notification service of the application (RFC 8599), e.g. "fcm"
+  // or "apns". When set, registrations carry it in the pn-provider,
+  // pn-param and pn-prid parameters of their Contact, so that the proxy
+  // wakes the application with a push notification on incoming calls,
+  // instead of the phone keeping its channel open; the application then
+  // calls |Phone::HandlePushNotification|. Values are put in the URI as
+  // given. Empty (default) registers without push notifications.
+  const std::string &push_provider() const {
+    return push_provider_;
+  }
+  void set_push_provider(const std::string &value) {
+    push_provider_ = value;
+  }
+
+  // The pn-param of the registrations, identifying the application to the
+  // push service, if it needs one.
+  const std::string &push_param() const {
+    return push_param_;
+  }
+  void set_push_param(const std::string &value) {
+    push_param_ = value;
+  }
+
+  // The pn-prid of the registrations: the push token of the device.
+  const std::string &push_prid() const {
+    return push_prid_;
+  }
+  void set_push_prid(const std::string &value) {
+    push_prid_ = value;
+  }
+
+  // Align the refreshes of the registrations on multiples of that many
+  // seconds, such as the windows of the inexact alarms of the platform, so
+  // that they wake the radio along with the other periodic work of the
+  // device. Default value is 0 (not aligned).
+  unsigned refresh_alignment() const {
+    return refresh_alignment_;
+  }
+  void set_refresh_alignment(unsigned value) {
+    refresh_alignment_ = value;
+  }
+
+  // Resolve and open the channel to the registrar (or the first route) as
+  // soon as the phone is initialized, so that the first REGISTER and call
+  // don't wait for it. Default value is false.
+  bool preconnect() const {
+    return preconnect_;
+  }
+  void set_preconnect(bool value) {
+    preconnect_ = value;
+  }
+
+  // Create the media engine (threads and audio device of the peer
+  // connection factory) in the background once the phone is initialized,
+  // instead of on the first call. Default value is false.
+  bool prewarm_media() const {
+    return prewarm_media_;
+  }
+  void set_prewarm_media(bool value) {
+    prewarm_media_ = value;
+  }
+
+  // Send the offer of outgoing calls as soon as a candidate reachable from
+  // outside the local network (server reflexive or relayed) is gathered,
+  // instead of waiting for all allocations, TURN included. Default value is
+  // false.
+  bool early_offer() const {
+    return early_offer_;
+  }
+  void set_early_offer(bool value) {
+    early_offer_ = value;
+  }
+
+  // Number of peer connections kept with their candidates gathered, so
+  // that outgoing calls don't wait for STUN and TURN allocations, as for
+  // back-to-back calls. Default value is 0 (none).
+  unsigned peer_connection_pool_size() const {
+    return peer_connection_pool_size_;
+  }
+  void set_peer_connection_pool_size(unsigned value) {
+    peer_connection_pool_size_ = value;
+  }
+
+  // Run calls without media: their offer is a fixed session description,
+  // the answers aren't applied, and no peer connection factory (nor its
+  // threads and audio device) is ever created. Meant for driving many SIP
+  // dialogs from one process, to measure the signalling alone. Default
+  // value is false.
+  bool signalling_only() const {
+    return signalling_only_;
+  }
+  void set_signalling_only(bool value) {
+    signalling_only_ = value;
+  }
+
+  // Run the peer connections on the network thread of the stack, as their
+  // webrtc signalling thread, instead of on a thread of their own: offers,
+  // answers and ICE events then reach the calls without a thread hop. The
+  // media still runs on a worker thread of the peer connection factory.
+  // Default value is false.
+  bool shared_signalling_thread() const {
+    return shared_signalling_thread_;
+  }
+  void set_shared_signalling_thread(bool value) {
+    shared_signalling_thread_ = value;
+  }
+
+  // Negotiate only TLS 1.2 with AEAD cipher suites (AES-GCM,
+  // ChaCha20-Poly1305) on TLS channels, whose records are the cheapest to
+  // encrypt. Servers must support them. Default value is false.
+  bool aead_cipher_suites_only() const {
+    return aead_cipher_suites_only_;
+  }
+  void set_aead_cipher_suites_only(bool value) {
+    aead_cipher_suites_only_ = value;
+  }
  
  private:
   IceServers ice_servers_;
   bool disable_encryption_;
   bool disable_sctp_data_channels_;
   RouteSet route_set_;
+  uri::DialPlan dial_plan_;
   GURL uri_;
   std::string user_agent_;
   std::string authorization_user_;
@@ -129,6 +259,17 @@ class Settings {
   std::string password_;
   unsigned register_expires_;
   GURL registrar_server_;
+  std::string push_provider_;
+  std::string push_param_;
+  std::string push_prid_;
+  unsigned refresh_alignment_;
+  bool preconnect_;
+  bool prewarm_media_;
+  bool early_offer_;
+  unsigned peer_connection_pool_size_;
+  bool signalling_only_;
+  bool shared_signalling_thread_;
+  bool aead_cipher_suites_only_;
 };
 
 } // namespace sippet
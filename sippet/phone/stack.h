@@ -0,0 +1,48 @@
+// Copyright (c) 2015 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_PHONE_STACK_H_
+#define SIPPET_PHONE_STACK_H_
+
+#include "base/memory/ref_counted.h"
+
+#include "sippet/phone/settings.h"
+
+namespace sippet {
+class EventLoop;
+
+namespace phone {
+
+// The signalling stack of phones: a network thread, a network layer with
+// its channels, and a peer connection factory. Each |Phone| runs one of its
+// own, unless created on a shared one: then it's a line of a multi-account
+// user agent, and all lines of the stack use the same thread, channels and
+// factory (see |Phone::Create|).
+class Stack :
+  public base::RefCountedThreadSafe<Stack> {
+ public:
+  // Create and start a |Stack|, or return NULL if its thread can't be
+  // started. Only the route set, the peer connection options, the media
+  // prewarm, |signalling_only|, |shared_signalling_thread|,
+  // |aead_cipher_suites_only| and |refresh_alignment| of |settings| are
+  // used, for all the lines; the account is left for each |Phone|.
+  static scoped_refptr<Stack> Create(const Settings& settings);
+
+  // Create a |Stack| running on |event_loop|, not owned, instead of a
+  // network thread of its own: e.g. an |ExternalEventLoop| sharing the
+  // thread of the embedder loop. The loop must outlive the stack and its
+  // lines. When the stack or a line is released on the loop thread, its
+  // teardown runs at once rather than in a task.
+  static scoped_refptr<Stack> Create(const Settings& settings,
+                                     EventLoop *event_loop);
+
+ protected:
+  friend class base::RefCountedThreadSafe<Stack>;
+  virtual ~Stack() {}
+};
+
+} // namespace sippet
+} // namespace phone
+
+#endif // SIPPET_PHONE_STACK_H_
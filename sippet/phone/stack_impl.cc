@@ -0,0 +1,510 @@
+// Copyright (c) 2015 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/phone/stack_impl.h"
+
+#include <string>
+
+#include "base/bind.h"
+#include "net/base/net_errors.h"
+#include "net/socket/client_socket_factory.h"
+#include "net/proxy/proxy_config_service.h"
+#include "net/url_request/url_request_context.h"
+#include "net/url_request/url_request_context_builder.h"
+#include "sippet/message/status_code.h"
+#include "sippet/phone/call_impl.h"
+#include "sippet/phone/phone_impl.h"
+#include "sippet/ua/dialog_controller.h"
+#include "jingle/glue/thread_wrapper.h"
+
+namespace sippet {
+
+namespace {
+
+// Config getter that always returns direct settings.
+class ProxyConfigServiceDirect : public net::ProxyConfigService {
+ public:
+  // Overridden from ProxyConfigService:
+  void AddObserver(Observer* observer) override {}
+  void RemoveObserver(Observer* observer) override {}
+  ConfigAvailability GetLatestProxyConfig(
+    net::ProxyConfig* config) override {
+    *config = net::ProxyConfig::CreateDirect();
+    return CONFIG_VALID;
+  }
+};
+
+class URLRequestContextGetter : public net::URLRequestContextGetter {
+ public:
+  explicit URLRequestContextGetter(
+    scoped_refptr<base::SingleThreadTaskRunner> network_task_runner)
+      : network_task_runner_(network_task_runner) {
+  }
+
+  // Overridden from net::URLRequestContextGetter:
+  net::URLRequestContext* GetURLRequestContext() override {
+    CHECK(network_task_runner_->BelongsToCurrentThread());
+    if (!url_request_context_) {
+      net::URLRequestContextBuilder builder;
+      // net::HttpServer fails to parse headers if user-agent header is blank.
+      builder.set_user_agent("Sippet");
+      builder.DisableHttpCache();
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+      builder.set_proxy_config_service(new ProxyConfigServiceDirect());
+#endif
+      url_request_context_.reset(builder.Build());
+    }
+    return url_request_context_.get();
+  }
+
+  scoped_refptr<base::SingleThreadTaskRunner>
+    GetNetworkTaskRunner() const override {
+    return network_task_runner_;
+  }
+
+ private:
+  ~URLRequestContextGetter() override {}
+
+  scoped_refptr<base::SingleThreadTaskRunner> network_task_runner_;
+
+  // Only accessed on the IO thread.
+  scoped_ptr<net::URLRequestContext> url_request_context_;
+
+  DISALLOW_COPY_AND_ASSIGN(URLRequestContextGetter);
+};
+
+// Handles the challenges of requests sent by no line.
+class NoCredentialsPasswordHandler : public PasswordHandler {
+ public:
+  NoCredentialsPasswordHandler() {}
+  ~NoCredentialsPasswordHandler() override {}
+
+  int GetCredentials(const net::AuthChallengeInfo* auth_info,
+                     base::string16 *username,
+                     base::string16 *password,
+                     const net::CompletionCallback& callback) override {
+    return net::ERR_ACCESS_DENIED;
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(NoCredentialsPasswordHandler);
+};
+
+template <class T>
+void EraseEntry(base::hash_map<std::string, T*> *map,
+                const std::string &key, T *value) {
+  typename base::hash_map<std::string, T*>::iterator i = map->find(key);
+  if (map->end() != i && value == i->second)
+    map->erase(i);
+}
+
+}  // empty namespace
+
+namespace phone {
+
+//
+// StackImpl::PasswordHandlerFactory implementation
+//
+StackImpl::PasswordHandlerFactory::PasswordHandlerFactory(StackImpl *stack)
+  : stack_(stack) {
+}
+
+StackImpl::PasswordHandlerFactory::~PasswordHandlerFactory() {
+}
+
+scoped_ptr<PasswordHandler>
+    StackImpl::PasswordHandlerFactory::CreatePasswordHandler() {
+  return CreatePasswordHandlerForRequest(nullptr);
+}
+
+scoped_ptr<PasswordHandler>
+    StackImpl::PasswordHandlerFactory::CreatePasswordHandlerForRequest(
+        const scoped_refptr<Request> &request) {
+  return stack_->CreatePasswordHandler(request);
+}
+
+//
+// StackImpl implementation
+//
+StackImpl::StackImpl(const Settings& settings, EventLoop *event_loop)
+  : settings_(settings),
+    event_loop_(event_loop),
+    network_thread_event_(false, false),
+    prewarm_pending_(false) {
+}
+
+StackImpl::~StackImpl() {
+  if (!GetNetworkTaskRunner())
+    return;
+  if (event_loop_->BelongsToCurrentThread()) {
+    // Released by a task of a shared loop, that can't wait for another.
+    OnDestroy();
+    return;
+  }
+  GetNetworkTaskRunner()->PostTask(FROM_HERE,
+      base::Bind(&StackImpl::OnDestroy, base::Unretained(this)));
+  network_thread_event_.Wait();
+}
+
+// static
+scoped_refptr<StackImpl> StackImpl::Create(const Settings& settings,
+                                           EventLoop *event_loop) {
+  scoped_refptr<StackImpl> stack(new StackImpl(settings, event_loop));
+  if (!stack->Start())
+    return nullptr;
+  return stack;
+}
+
+bool StackImpl::Start() {
+  if (!event_loop_) {
+    network_thread_.reset(new ThreadEventLoop("PhoneSignalling"));
+    if (!network_thread_->Start()) {
+      network_thread_.reset();
+      return false;
+    }
+    event_loop_ = network_thread_.get();
+  }
+  if (!GetNetworkTaskRunner())
+    return false;
+  GetNetworkTaskRunner()->PostTask(FROM_HERE,
+      base::Bind(&StackImpl::OnInit, base::Unretained(this)));
+  return true;
+}
+
+scoped_refptr<base::SingleThreadTaskRunner>
+StackImpl::GetNetworkTaskRunner() const {
+  if (!event_loop_)
+    return nullptr;
+  return event_loop_->task_runner();
+}
+
+void StackImpl::AddLine(PhoneImpl *line) {
+  DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
+  std::string username(line->GetContactUser());
+  if (!lines_by_user_.insert(std::make_pair(username, line)).second) {
+    LOG(WARNING) << "Calls to " << username
+                 << " are received by the first line of that user";
+  }
+  if (!lines_by_address_.insert(
+          std::make_pair(line->GetFromUri(), line)).second) {
+    LOG(WARNING) << "Registrations of " << line->GetFromUri()
+                 << " are handled by the first line of that address";
+  }
+}
+
+void StackImpl::RemoveLine(PhoneImpl *line) {
+  DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
+  EraseEntry(&lines_by_user_, line->GetContactUser(), line);
+  EraseEntry(&lines_by_address_, line->GetFromUri(), line);
+}
+
+void StackImpl::UpdateRequestRoute(CallImpl *call,
+    const scoped_refptr<Request>& old_request,
+    const scoped_refptr<Request>& new_request) {
+  DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
+  if (old_request)
+    EraseEntry(&calls_by_request_id_, old_request->id(), call);
+  if (new_request)
+    calls_by_request_id_[new_request->id()] = call;
+}
+
+void StackImpl::UpdateDialogRoute(CallImpl *call,
+    const scoped_refptr<Dialog>& old_dialog,
+    const scoped_refptr<Dialog>& new_dialog) {
+  DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
+  if (old_dialog)
+    EraseEntry(&calls_by_dialog_id_, old_dialog->id(), call);
+  if (new_dialog)
+    calls_by_dialog_id_[new_dialog->id()] = call;
+}
+
+void StackImpl::RemoveRoutes(CallImpl *call) {
+  DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
+  if (call->last_request())
+    EraseEntry(&calls_by_request_id_, call->last_request()->id(), call);
+  if (call->dialog())
+    EraseEntry(&calls_by_dialog_id_, call->dialog()->id(), call);
+}
+
+webrtc::PeerConnectionFactoryInterface *StackImpl::GetPeerConnectionFactory() {
+  DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
+  if (!peer_connection_factory_.get())
+    InitializePeerConnectionFactory();
+  return peer_connection_factory_.get();
+}
+
+void StackImpl::PrewarmPeerConnectionFactory() {
+  DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
+  if (peer_connection_factory_.get() || prewarm_pending_)
+    return;
+  prewarm_pending_ = true;
+  GetNetworkTaskRunner()->PostTask(FROM_HERE,
+      base::Bind(&StackImpl::OnPrewarmPeerConnectionFactory,
+          base::Unretained(this)));
+}
+
+void StackImpl::OnPrewarmPeerConnectionFactory() {
+  // The stack outlives its tasks, as it waits for |OnDestroy|.
+  prewarm_pending_ = false;
+  GetPeerConnectionFactory();
+}
+
+bool StackImpl::InitializePeerConnectionFactory() {
+  DCHECK(peer_connection_factory_.get() == nullptr);
+
+  // To allow sending to the signaling/worker threads.
+  jingle_glue::JingleThreadWrapper::EnsureForCurrentMessageLoop();
+  jingle_glue::JingleThreadWrapper::current()->set_send_allowed(true);
+
+  if (settings_.shared_signalling_thread()) {
+    // The wrapper of the network thread is the signalling thread, so only
+    // the media worker is a thread of its own.
+    worker_thread_.reset(new rtc::Thread);
+    if (!worker_thread_->Start()) {
+      worker_thread_.reset();
+      return false;
+    }
+    peer_connection_factory_ = webrtc::CreatePeerConnectionFactory(
+        worker_thread_.get(), jingle_glue::JingleThreadWrapper::current(),
+        nullptr, nullptr, nullptr);
+  } else {
+    peer_connection_factory_ = webrtc::CreatePeerConnectionFactory();
+  }
+  if (!peer_connection_factory_.get()) {
+    DeletePeerConnectionFactory();
+    return false;
+  }
+
+  webrtc::PeerConnectionFactoryInterface::Options options;
+  options.disable_encryption = settings_.disable_encryption();
+  options.disable_sctp_data_channels = settings_.disable_sctp_data_channels();
+  peer_connection_factory_->SetOptions(options);
+  return true;
+}
+
+void StackImpl::DeletePeerConnectionFactory() {
+  peer_connection_factory_ = nullptr;
+  worker_thread_.reset();
+}
+
+void StackImpl::OnInit() {
+  DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
+
+  request_context_getter_ = new URLRequestContextGetter(GetNetworkTaskRunner());
+
+  net::ClientSocketFactory *client_socket_factory =
+      net::ClientSocketFactory::GetDefaultFactory();
+  host_resolver_ = net::HostResolver::CreateDefaultResolver(nullptr);
+  scoped_ptr<AuthHandlerRegistryFactory> auth_handler_factory(
+      AuthHandlerFactory::CreateDefault(host_resolver_.get()));
+  auth_handler_factory_ = auth_handler_factory.Pass();
+  password_handler_factory_.reset(new PasswordHandlerFactory(this));
+
+  user_agent_.reset(new ua::UserAgent(auth_handler_factory_.get(),
+      password_handler_factory_.get(),
+      DialogController::GetDefaultDialogController(), net_log_));
+
+  network_layer_.reset(new NetworkLayer(user_agent_.get()));
+  refresh_scheduler_.reset(new RefreshScheduler(user_agent_->timer_wheel()));
+  refresh_scheduler_->set_alignment(
+      base::TimeDelta::FromSeconds(settings_.refresh_alignment()));
+
+  // Register the channel factory
+  net::SSLConfig ssl_config;
+  ssl_config.version_min = net::SSL_PROTOCOL_VERSION_TLS1;
+  if (settings_.aead_cipher_suites_only())
+    ChromeChannelFactory::RestrictToAeadCipherSuites(&ssl_config);
+  channel_factory_.reset(new ChromeChannelFactory(client_socket_factory,
+      request_context_getter_, ssl_config));
+  network_layer_->RegisterChannelFactory(Protocol::UDP,
+      channel_factory_.get());
+  network_layer_->RegisterChannelFactory(Protocol::TCP,
+      channel_factory_.get());
+  network_layer_->RegisterChannelFactory(Protocol::TLS,
+      channel_factory_.get());
+  user_agent_->SetNetworkLayer(network_layer_.get());
+  user_agent_->AppendHandler(this);
+
+  // Initialize the route-set, if available
+  if (settings_.route_set().size() > 0) {
+    user_agent_->set_route_set(settings_.route_set());
+  }
+
+  // The phone is usable before the media engine is up
+  if (settings_.prewarm_media() && !settings_.signalling_only())
+    PrewarmPeerConnectionFactory();
+}
+
+void StackImpl::OnDestroy() {
+  DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
+
+  // Lines hold a reference to their stack, so they're all gone.
+  DCHECK(lines_by_address_.empty());
+  calls_by_request_id_.clear();
+  calls_by_dialog_id_.clear();
+
+  channel_factory_.reset();
+  auth_handler_factory_.reset();
+  host_resolver_.reset();
+  refresh_scheduler_.reset();
+  user_agent_ = nullptr;
+  network_layer_ = nullptr;
+  password_handler_factory_.reset();
+  request_context_getter_ = nullptr;
+  DeletePeerConnectionFactory();
+
+  network_thread_event_.Signal();
+}
+
+void StackImpl::OnChannelConnected(const EndPoint &destination, int err) {
+  // Nothing to do
+}
+
+void StackImpl::OnChannelClosed(const EndPoint &destination) {
+  // Nothing to do
+}
+
+void StackImpl::OnIncomingRequest(
+    const scoped_refptr<Request> &incoming_request,
+    const scoped_refptr<Dialog> &dialog) {
+  DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
+  if (Method::INVITE == incoming_request->method()) {
+    PhoneImpl *line =
+        GetLineOfUser(incoming_request->sip_request_uri().username());
+    if (line) {
+      line->OnIncomingCall(incoming_request);
+    } else {
+      user_agent_->Send(incoming_request->CreateResponse(SIP_NOT_FOUND),
+                        net::CompletionCallback());
+    }
+  } else {
+    CallImpl *call = RouteToCall(dialog);
+    if (call)
+      call->OnIncomingRequest(incoming_request, dialog);
+  }
+}
+
+void StackImpl::OnIncomingResponse(
+    const scoped_refptr<Response> &incoming_response,
+    const scoped_refptr<Dialog> &dialog) {
+  DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
+  const scoped_refptr<Request> &request = incoming_response->refer_to();
+  if (Method::REGISTER == request->method()) {
+    PhoneImpl *line = GetLineOfRequest(request.get());
+    if (line)
+      line->OnRegisterResponse(incoming_response);
+  } else if (Method::INVITE == request->method()
+             || Method::BYE == request->method()) {
+    CallImpl *call = RouteToCall(request);
+    if (call)
+      call->OnIncomingResponse(incoming_response, dialog);
+  } else if (Method::UPDATE == request->method()) {
+    // Session refreshes are routed by their dialog
+    scoped_refptr<Dialog> refreshed_dialog(
+        user_agent_->GetDialog(request.get()));
+    CallImpl *call = RouteToCall(refreshed_dialog);
+    if (call)
+      call->OnIncomingResponse(incoming_response, refreshed_dialog);
+  }
+}
+
+void StackImpl::OnTimedOut(
+    const scoped_refptr<Request> &request,
+    const scoped_refptr<Dialog> &dialog) {
+  DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
+  if (Method::INVITE == request->method()
+      || Method::BYE == request->method()) {
+    CallImpl *call = RouteToCall(request);
+    if (call)
+      call->OnTimedOut(request, dialog);
+  } else if (Method::UPDATE == request->method()) {
+    CallImpl *call = RouteToCall(user_agent_->GetDialog(request.get()));
+    if (call)
+      call->OnTimedOut(request, dialog);
+  } else if (Method::REGISTER == request->method()) {
+    PhoneImpl *line = GetLineOfRequest(request.get());
+    if (line)
+      line->OnRegisterError(request, net::ERR_TIMED_OUT);
+  }
+}
+
+void StackImpl::OnTransportError(
+    const scoped_refptr<Request> &request, int error,
+    const scoped_refptr<Dialog> &dialog) {
+  DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
+  if (Method::INVITE == request->method()
+      || Method::BYE == request->method()) {
+    CallImpl *call = RouteToCall(request);
+    if (call)
+      call->OnTransportError(request, error, dialog);
+  } else if (Method::UPDATE == request->method()) {
+    CallImpl *call = RouteToCall(user_agent_->GetDialog(request.get()));
+    if (call)
+      call->OnTransportError(request, error, dialog);
+  } else if (Method::REGISTER == request->method()) {
+    PhoneImpl *line = GetLineOfRequest(request.get());
+    if (line)
+      line->OnRegisterError(request, error);
+  }
+}
+
+void StackImpl::OnNetworkChanged() {
+  DCHECK(GetNetworkTaskRunner()->BelongsToCurrentThread());
+  for (LinesMap::iterator i = lines_by_address_.begin(),
+       ie = lines_by_address_.end(); i != ie; ++i) {
+    i->second->OnNetworkChanged();
+  }
+}
+
+PhoneImpl *StackImpl::GetLineOfUser(const std::string &username) {
+  LinesMap::iterator i = lines_by_user_.find(username);
+  if (lines_by_user_.end() != i)
+    return i->second;
+  if (1 == lines_by_address_.size())
+    return lines_by_address_.begin()->second;
+  return nullptr;
+}
+
+PhoneImpl *StackImpl::GetLineOfRequest(const Request *request) {
+  const From *from = request->get<From>();
+  if (!from)
+    return nullptr;
+  LinesMap::iterator i = lines_by_address_.find(from->address().spec());
+  return lines_by_address_.end() != i ? i->second : nullptr;
+}
+
+scoped_ptr<PasswordHandler> StackImpl::CreatePasswordHandler(
+    const scoped_refptr<Request> &request) {
+  PhoneImpl *line = request ? GetLineOfRequest(request.get()) : nullptr;
+  if (line)
+    return line->password_handler_factory_->CreatePasswordHandler();
+  scoped_ptr<PasswordHandler> password_handler(
+      new NoCredentialsPasswordHandler);
+  return password_handler.Pass();
+}
+
+CallImpl *StackImpl::RouteToCall(const scoped_refptr<Request>& request) {
+  CallRoutesMap::iterator i = calls_by_request_id_.find(request->id());
+  return calls_by_request_id_.end() != i ? i->second : nullptr;
+}
+
+CallImpl *StackImpl::RouteToCall(const scoped_refptr<Dialog>& dialog) {
+  if (!dialog)
+    return nullptr;
+  CallRoutesMap::iterator i = calls_by_dialog_id_.find(dialog->id());
+  return calls_by_dialog_id_.end() != i ? i->second : nullptr;
+}
+
+scoped_refptr<Stack> Stack::Create(const Settings& settings) {
+  return StackImpl::Create(settings);
+}
+
+scoped_refptr<Stack> Stack::Create(const Settings& settings,
+                                   EventLoop *event_loop) {
+  DCHECK(event_loop);
+  return StackImpl::Create(settings, event_loop);
+}
+
+}  // namespace phone
+}  // namespace sippet
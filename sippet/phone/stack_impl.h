@@ -0,0 +1,183 @@
+// Copyright (c) 2015 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_PHONE_STACK_IMPL_H_
+#define SIPPET_PHONE_STACK_IMPL_H_
+
+#include "sippet/phone/stack.h"
+
+#include <string>
+
+#include "base/containers/hash_tables.h"
+#include "base/synchronization/waitable_event.h"
+#include "net/dns/host_resolver.h"
+#include "net/url_request/url_request_context_getter.h"
+
+#include "sippet/transport/event_loop.h"
+#include "sippet/transport/network_layer.h"
+#include "sippet/transport/chrome/chrome_channel_factory.h"
+#include "sippet/ua/auth_handler_factory.h"
+#include "sippet/ua/password_handler.h"
+#include "sippet/ua/refresh_scheduler.h"
+#include "sippet/ua/ua_user_agent.h"
+
+#include "talk/app/webrtc/peerconnectioninterface.h"
+#include "webrtc/base/thread.h"
+
+namespace sippet {
+namespace phone {
+
+class CallImpl;
+class PhoneImpl;
+
+// The |UserAgent| of a stack is shared by all its lines, and so are the
+// channels of its |NetworkLayer|. The stack is the only handler of the
+// user agent, and dispatches each event to the line or the call it belongs
+// to with a single lookup:
+//  - incoming calls by the user of their request URI, which is the one of
+//    the |Contact| registered by the line;
+//  - registrations and credentials by the |From| address of the request;
+//  - calls by the id of their last request or of their dialog.
+class StackImpl :
+  public Stack,
+  public ua::UserAgent::Delegate {
+ private:
+  DISALLOW_COPY_AND_ASSIGN(StackImpl);
+ public:
+  // Create and start a |StackImpl|, on |event_loop| if not NULL, or return
+  // NULL on failure.
+  static scoped_refptr<StackImpl> Create(const Settings& settings,
+                                         EventLoop *event_loop = nullptr);
+
+  //
+  // Network thread attributes, valid once started
+  //
+  ua::UserAgent *user_agent() { return user_agent_.get(); }
+  NetworkLayer *network_layer() { return network_layer_.get(); }
+  // Shared by the registrations of all lines.
+  RefreshScheduler *refresh_scheduler() { return refresh_scheduler_.get(); }
+  // The peer connection factory is created on first use, as its threads
+  // and audio device aren't needed by idle lines. Returns NULL on failure.
+  webrtc::PeerConnectionFactoryInterface *GetPeerConnectionFactory();
+  // Creates the peer connection factory in a task of its own, if not
+  // created yet, so that it's ready for the next call.
+  void PrewarmPeerConnectionFactory();
+
+  scoped_refptr<base::SingleThreadTaskRunner> GetNetworkTaskRunner() const;
+
+  //
+  // Lines and calls, only on the network thread
+  //
+  void AddLine(PhoneImpl *line);
+  void RemoveLine(PhoneImpl *line);
+  // Keep the routes of |call| up to date when its last request or its
+  // dialog is replaced.
+  void UpdateRequestRoute(CallImpl *call,
+                          const scoped_refptr<Request>& old_request,
+                          const scoped_refptr<Request>& new_request);
+  void UpdateDialogRoute(CallImpl *call,
+                         const scoped_refptr<Dialog>& old_dialog,
+                         const scoped_refptr<Dialog>& new_dialog);
+  void RemoveRoutes(CallImpl *call);
+
+ private:
+  friend class base::RefCountedThreadSafe<Stack>;
+  typedef base::hash_map<std::string, PhoneImpl*> LinesMap;
+  typedef base::hash_map<std::string, CallImpl*> CallRoutesMap;
+
+  // Chooses the credentials of the line sending each request.
+  class PasswordHandlerFactory : public PasswordHandler::Factory {
+   public:
+    explicit PasswordHandlerFactory(StackImpl *stack);
+    ~PasswordHandlerFactory() override;
+
+    scoped_ptr<PasswordHandler> CreatePasswordHandler() override;
+    scoped_ptr<PasswordHandler> CreatePasswordHandlerForRequest(
+        const scoped_refptr<Request> &request) override;
+
+   private:
+    StackImpl *stack_;
+  };
+
+  StackImpl(const Settings& settings, EventLoop *event_loop);
+  ~StackImpl() override;
+
+  bool Start();
+
+  bool InitializePeerConnectionFactory();
+  void DeletePeerConnectionFactory();
+  void OnPrewarmPeerConnectionFactory();
+
+  //
+  // Signalling thread callbacks
+  //
+  void OnInit();
+  void OnDestroy();
+
+  //
+  // ua::UserAgent::Delegate implementation
+  //
+  void OnChannelConnected(const EndPoint &destination, int err) override;
+  void OnChannelClosed(const EndPoint &destination) override;
+  void OnIncomingRequest(
+      const scoped_refptr<Request> &incoming_request,
+      const scoped_refptr<Dialog> &dialog) override;
+  void OnIncomingResponse(
+      const scoped_refptr<Response> &incoming_response,
+      const scoped_refptr<Dialog> &dialog) override;
+  void OnTimedOut(
+      const scoped_refptr<Request> &request,
+      const scoped_refptr<Dialog> &dialog) override;
+  void OnTransportError(
+      const scoped_refptr<Request> &request, int error,
+      const scoped_refptr<Dialog> &dialog) override;
+  void OnNetworkChanged() override;
+
+  // Returns the line whose |Contact| has |username|. A single line gets
+  // all incoming calls, as with a stack of its own.
+  PhoneImpl *GetLineOfUser(const std::string &username);
+  // Returns the line that sent |request|, if any.
+  PhoneImpl *GetLineOfRequest(const Request *request);
+  scoped_ptr<PasswordHandler> CreatePasswordHandler(
+      const scoped_refptr<Request> &request);
+
+  CallImpl *RouteToCall(const scoped_refptr<Request>& request);
+  CallImpl *RouteToCall(const scoped_refptr<Dialog>& dialog);
+
+  Settings settings_;
+
+  // Set when the stack runs a thread of its own.
+  scoped_ptr<ThreadEventLoop> network_thread_;
+  // Either |network_thread_| or the loop given by the embedder.
+  EventLoop *event_loop_;
+  base::WaitableEvent network_thread_event_;
+
+  // Only accessed on the network thread.
+  LinesMap lines_by_user_;
+  LinesMap lines_by_address_;
+  CallRoutesMap calls_by_request_id_;
+  CallRoutesMap calls_by_dialog_id_;
+
+  scoped_refptr<net::URLRequestContextGetter> request_context_getter_;
+  scoped_ptr<net::HostResolver> host_resolver_;
+  scoped_ptr<AuthHandlerFactory> auth_handler_factory_;
+  net::BoundNetLog net_log_;
+  scoped_ptr<PasswordHandlerFactory> password_handler_factory_;
+  scoped_ptr<ua::UserAgent> user_agent_;
+  scoped_ptr<NetworkLayer> network_layer_;
+  scoped_ptr<RefreshScheduler> refresh_scheduler_;
+  scoped_ptr<ChromeChannelFactory> channel_factory_;
+
+  rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface>
+    peer_connection_factory_;
+  // The media worker of the factory, when its signalling thread is the
+  // network thread.
+  scoped_ptr<rtc::Thread> worker_thread_;
+  bool prewarm_pending_;
+};
+
+} // namespace sippet
+} // namespace phone
+
+#endif // SIPPET_PHONE_STACK_IMPL_H_
@@ -6,6 +6,7 @@
 
 #include <string>
 
+#include "base/bind.h"
 #include "gin/per_context_data.h"
 
 namespace gin {
@@ -92,6 +93,36 @@ struct Converter<base::TimeDelta> {
   }
 };
 
+// Extend Converter to our type CallMetrics, as a read-only object
+template<>
+struct Converter<sippet::phone::CallMetrics> {
+  static v8::Handle<v8::Value> ToV8(v8::Isolate* isolate,
+      const sippet::phone::CallMetrics& val) {
+    v8::Handle<v8::Object> result(v8::Object::New(isolate));
+    result->Set(StringToSymbol(isolate, "postDialDelay"),
+        ConvertToV8(isolate, val.post_dial_delay));
+    result->Set(StringToSymbol(isolate, "timeToRinging"),
+        ConvertToV8(isolate, val.time_to_ringing));
+    result->Set(StringToSymbol(isolate, "timeToAnswer"),
+        ConvertToV8(isolate, val.time_to_answer));
+    result->Set(StringToSymbol(isolate, "iceGatheringTime"),
+        ConvertToV8(isolate, val.ice_gathering_time));
+    result->Set(StringToSymbol(isolate, "mediaSetupTime"),
+        ConvertToV8(isolate, val.media_setup_time));
+    result->Set(StringToSymbol(isolate, "roundTripTime"),
+        ConvertToV8(isolate, val.round_trip_time));
+    result->Set(StringToSymbol(isolate, "jitter"),
+        ConvertToV8(isolate, val.jitter));
+    result->Set(StringToSymbol(isolate, "packetsSent"),
+        ConvertToV8(isolate, static_cast<double>(val.packets_sent)));
+    result->Set(StringToSymbol(isolate, "packetsReceived"),
+        ConvertToV8(isolate, static_cast<double>(val.packets_received)));
+    result->Set(StringToSymbol(isolate, "packetsLost"),
+        ConvertToV8(isolate, static_cast<double>(val.packets_lost)));
+    return result;
+  }
+};
+
 }  // namespace gin
 
 namespace sippet {
@@ -106,9 +137,10 @@ const char kOnHangupCompleted[] = "::sippet::call::OnHangupCompleted";
 
 gin::WrapperInfo CallJsWrapper::kWrapperInfo = { gin::kEmbedderNativeGin };
 
-CallJsWrapper::CallJsWrapper(v8::Isolate* isolate) :
+CallJsWrapper::CallJsWrapper(v8::Isolate* isolate,
+    const scoped_refptr<JsEventQueue>& event_queue) :
   isolate_(isolate),
-  message_loop_(base::MessageLoop::current()),
+  event_queue_(event_queue),
   on_completed_(kOnCompleted),
   on_hangup_completed_(kOnHangupCompleted) {
 }
@@ -116,8 +148,9 @@ CallJsWrapper::CallJsWrapper(v8::Isolate* isolate) :
 CallJsWrapper::~CallJsWrapper() {
 }
 
-gin::Handle<CallJsWrapper> CallJsWrapper::Create(v8::Isolate* isolate) {
-  return gin::CreateHandle(isolate, new CallJsWrapper(isolate));
+gin::Handle<CallJsWrapper> CallJsWrapper::Create(v8::Isolate* isolate,
+    const scoped_refptr<JsEventQueue>& event_queue) {
+  return gin::CreateHandle(isolate, new CallJsWrapper(isolate, event_queue));
 }
 
 void CallJsWrapper::set_call_instance(
@@ -141,6 +174,7 @@ gin::ObjectTemplateBuilder CallJsWrapper::GetObjectTemplateBuilder(
   builder.SetProperty("startTime", &CallJsWrapper::start_time);
   builder.SetProperty("endTime", &CallJsWrapper::end_time);
   builder.SetProperty("duration", &CallJsWrapper::duration);
+  builder.SetProperty("metrics", &CallJsWrapper::metrics);
   builder.SetMethod("pickUp", &CallJsWrapper::PickUp);
   builder.SetMethod("reject", &CallJsWrapper::Reject);
   builder.SetMethod("hangup", &CallJsWrapper::HangUp);
@@ -180,6 +214,10 @@ base::TimeDelta CallJsWrapper::duration() const {
   return call_->duration();
 }
 
+CallMetrics CallJsWrapper::metrics() const {
+  return call_->metrics();
+}
+
 void CallJsWrapper::PickUp(v8::Handle<v8::Function> function) {
   on_completed_.SetFunction(this, isolate_, function);
   call_->PickUp(base::Bind(
@@ -201,13 +239,13 @@ void CallJsWrapper::SendDtmf(const std::string& digits) {
 }
 
 void CallJsWrapper::OnCompleted(int error) {
-  message_loop_->PostTask(FROM_HERE,
+  event_queue_->Post(
       base::Bind(&CallJsWrapper::RunCompleted,
           base::Unretained(this), error));
 }
 
 void CallJsWrapper::OnHangupCompleted(int error) {
-  message_loop_->PostTask(FROM_HERE,
+  event_queue_->Post(
       base::Bind(&CallJsWrapper::RunHangupCompleted,
           base::Unretained(this), error));
 }
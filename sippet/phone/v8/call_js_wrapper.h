@@ -7,8 +7,8 @@
 
 #include "sippet/phone/call.h"
 #include "sippet/phone/v8/js_callback.h"
+#include "sippet/phone/v8/js_event_queue.h"
 
-#include "base/message_loop/message_loop.h"
 #include "gin/handle.h"
 #include "gin/object_template_builder.h"
 #include "gin/wrappable.h"
@@ -22,8 +22,11 @@ public:
   static gin::WrapperInfo kWrapperInfo;
   ~CallJsWrapper() override;
 
+  // Events of the call are run through |event_queue|, shared with the
+  // phone that made or received it.
   static gin::Handle<CallJsWrapper> Create(
-      v8::Isolate* isolate);
+      v8::Isolate* isolate,
+      const scoped_refptr<JsEventQueue>& event_queue);
 
   void set_call_instance(const scoped_refptr<Call>& instance);
   void set_completed_function(v8::Handle<v8::Function> function);
@@ -41,6 +44,7 @@ public:
   base::Time start_time() const;
   base::Time end_time() const;
   base::TimeDelta duration() const;
+  CallMetrics metrics() const;
   void PickUp(v8::Handle<v8::Function> function);
   void Reject();
   void HangUp(v8::Handle<v8::Function> function);
@@ -59,11 +63,12 @@ public:
   void OnHangupCompleted(int error);
 
 private:
-  explicit CallJsWrapper(v8::Isolate* isolate);
+  CallJsWrapper(v8::Isolate* isolate,
+                const scoped_refptr<JsEventQueue>& event_queue);
 
   v8::Isolate* isolate_;
   scoped_refptr<Call> call_;
-  base::MessageLoop* message_loop_;
+  scoped_refptr<JsEventQueue> event_queue_;
 
   JsCallback<void(int)> on_completed_;
   JsCallback<void(int)> on_hangup_completed_;
@@ -32,7 +32,7 @@ class JsCallback<void(Args...)> {
     runner_ = gin::PerContextData::From(
         isolate->GetCurrentContext())->runner()->GetWeakPtr();
     object->GetWrapper(runner_->GetContextHolder()->isolate())->SetHiddenValue(
-        gin::StringToSymbol(isolate, hidden_name_), function);
+        HiddenKey(isolate), function);
   }
 
   template<typename T>
@@ -47,8 +47,7 @@ class JsCallback<void(Args...)> {
     gin::Runner::Scope scope(runner_.get());
     v8::Isolate* isolate = runner_->GetContextHolder()->isolate();
     v8::Handle<v8::Function> function = v8::Handle<v8::Function>::Cast(
-        object->GetWrapper(isolate)->GetHiddenValue(
-            gin::StringToSymbol(isolate, hidden_name_)));
+        object->GetWrapper(isolate)->GetHiddenValue(HiddenKey(isolate)));
     runner_->Call(function, v8::Undefined(isolate), 0, nullptr);
   }
 
@@ -69,8 +68,7 @@ class JsCallback<void(Args...)> {
     Argv(isolate, argv, 0, args...);
 
     v8::Handle<v8::Function> function = v8::Handle<v8::Function>::Cast(
-        object->GetWrapper(isolate)->GetHiddenValue(
-            gin::StringToSymbol(isolate, hidden_name_)));
+        object->GetWrapper(isolate)->GetHiddenValue(HiddenKey(isolate)));
 
     runner_->Call(function, v8::Undefined(isolate), argc, argv);
   }
@@ -79,6 +77,15 @@ class JsCallback<void(Args...)> {
   const char *hidden_name_;
   base::WeakPtr<gin::Runner> runner_;
 
+  // The interned |hidden_name_|, made once instead of on every call.
+  v8::Eternal<v8::String> hidden_key_;
+
+  v8::Local<v8::String> HiddenKey(v8::Isolate* isolate) {
+    if (hidden_key_.IsEmpty())
+      hidden_key_.Set(isolate, gin::StringToSymbol(isolate, hidden_name_));
+    return hidden_key_.Get(isolate);
+  }
+
   template<typename T>
   void Argv(v8::Isolate* isolate, v8::Local<v8::Value> *argv,
       T arg) {
@@ -0,0 +1,47 @@
+// Copyright (c) 2015 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/phone/v8/js_event_queue.h"
+
+#include "base/bind.h"
+#include "base/message_loop/message_loop.h"
+
+namespace sippet {
+namespace phone {
+
+JsEventQueue::JsEventQueue(base::MessageLoop* message_loop) :
+  message_loop_(message_loop),
+  flush_posted_(false) {
+}
+
+JsEventQueue::~JsEventQueue() {
+}
+
+void JsEventQueue::Post(const base::Closure& event) {
+  base::AutoLock lock(lock_);
+  pending_.push_back(event);
+  if (flush_posted_)
+    return;
+  flush_posted_ = true;
+  message_loop_->PostTask(FROM_HERE,
+      base::Bind(&JsEventQueue::Flush, this));
+}
+
+void JsEventQueue::Flush() {
+  DCHECK_EQ(message_loop_, base::MessageLoop::current());
+  {
+    base::AutoLock lock(lock_);
+    running_.swap(pending_);
+    flush_posted_ = false;
+  }
+  // Events queued while running these are left for the next task.
+  for (std::vector<base::Closure>::iterator i = running_.begin();
+       i != running_.end(); ++i) {
+    i->Run();
+  }
+  running_.clear();
+}
+
+} // namespace phone
+} // namespace sippet
@@ -0,0 +1,56 @@
+// Copyright (c) 2015 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_PHONE_V8_JS_EVENT_QUEUE_H_
+#define SIPPET_PHONE_V8_JS_EVENT_QUEUE_H_
+
+#include <vector>
+
+#include "base/callback.h"
+#include "base/memory/ref_counted.h"
+#include "base/synchronization/lock.h"
+
+namespace base {
+class MessageLoop;
+}
+
+namespace sippet {
+namespace phone {
+
+// Queues events raised by the phone threads, to be run on the JavaScript
+// message loop. Events queued before the loop gets to them are run together
+// by a single task, instead of one task per event, so a burst of call
+// events costs one wake up of the JavaScript thread.
+//
+// A queue is shared by a |PhoneJsWrapper| and all its |CallJsWrapper|s.
+class JsEventQueue : public base::RefCountedThreadSafe<JsEventQueue> {
+ public:
+  // Events will be run on |message_loop|.
+  explicit JsEventQueue(base::MessageLoop* message_loop);
+
+  // Queues |event|. Can be called from any thread.
+  void Post(const base::Closure& event);
+
+ private:
+  friend class base::RefCountedThreadSafe<JsEventQueue>;
+  ~JsEventQueue();
+
+  void Flush();
+
+  base::MessageLoop* message_loop_;
+
+  base::Lock lock_;
+  std::vector<base::Closure> pending_;
+  bool flush_posted_;
+
+  // Swapped with |pending_| on each flush, to keep its capacity.
+  std::vector<base::Closure> running_;
+
+  DISALLOW_COPY_AND_ASSIGN(JsEventQueue);
+};
+
+} // namespace phone
+} // namespace sippet
+
+#endif // SIPPET_PHONE_V8_JS_EVENT_QUEUE_H_
@@ -6,6 +6,8 @@
 
 #include <string>
 
+#include "base/bind.h"
+#include "base/message_loop/message_loop.h"
 #include "sippet/phone/v8/call_js_wrapper.h"
 
 namespace gin {
@@ -62,11 +64,11 @@ struct Converter<sippet::phone::IceServer> {
   static v8::Handle<v8::Value> ToV8(v8::Isolate* isolate,
       const sippet::phone::IceServer &val) {
     v8::Handle<v8::Object> result(v8::Object::New(isolate));
-    result->Set(v8::String::NewFromUtf8(isolate, kUri),
+    result->Set(StringToSymbol(isolate, kUri),
         ConvertToV8(isolate, val.uri()));
-    result->Set(v8::String::NewFromUtf8(isolate, kUsername),
+    result->Set(StringToSymbol(isolate, kUsername),
         ConvertToV8(isolate, val.username()));
-    result->Set(v8::String::NewFromUtf8(isolate, kPassword),
+    result->Set(StringToSymbol(isolate, kPassword),
         ConvertToV8(isolate, val.password()));
     return result;
   }
@@ -77,17 +79,17 @@ struct Converter<sippet::phone::IceServer> {
     if (!val->IsObject())
       return false;
     v8::Handle<v8::Object> input(v8::Handle<v8::Object>::Cast(val));
-    if (!input->Has(v8::String::NewFromUtf8(isolate, kUri)))
+    if (!input->Has(StringToSymbol(isolate, kUri)))
       return false;
     out->set_uri(V8ToString(
-        input->Get(v8::String::NewFromUtf8(isolate, kUri))));
-    if (input->Has(v8::String::NewFromUtf8(isolate, kUsername))) {
+        input->Get(StringToSymbol(isolate, kUri))));
+    if (input->Has(StringToSymbol(isolate, kUsername))) {
       out->set_username(V8ToString(
-          input->Get(v8::String::NewFromUtf8(isolate, kUsername))));
+          input->Get(StringToSymbol(isolate, kUsername))));
     }
-    if (input->Has(v8::String::NewFromUtf8(isolate, kPassword))) {
+    if (input->Has(StringToSymbol(isolate, kPassword))) {
       out->set_password(V8ToString(
-          input->Get(v8::String::NewFromUtf8(isolate, kPassword))));
+          input->Get(StringToSymbol(isolate, kPassword))));
     }
     return true;
   }
@@ -110,48 +112,69 @@ struct Converter<sippet::phone::Settings> {
   static const char kPassword[];
   static const char kRegisterExpires[];
   static const char kRegistrarServer[];
+  static const char kPreconnect[];
+  static const char kPrewarmMedia[];
+  static const char kEarlyOffer[];
+  static const char kPeerConnectionPoolSize[];
+  static const char kSignallingOnly[];
+  static const char kSharedSignallingThread[];
+  static const char kAeadCipherSuitesOnly[];
 
   static v8::Handle<v8::Value> ToV8(v8::Isolate* isolate,
       const sippet::phone::Settings &val) {
     v8::Handle<v8::Object> result(v8::Object::New(isolate));
-    result->Set(v8::String::NewFromUtf8(isolate, kDisableEncryption),
+    result->Set(StringToSymbol(isolate, kDisableEncryption),
         ConvertToV8(isolate, val.disable_encryption()));
     if (!val.ice_servers().empty()) {
-      result->Set(v8::String::NewFromUtf8(isolate, kIceServers),
+      result->Set(StringToSymbol(isolate, kIceServers),
           ConvertToV8(isolate->GetCurrentContext(),
               val.ice_servers()).ToLocalChecked());
     }
     if (!val.route_set().empty()) {
-      result->Set(v8::String::NewFromUtf8(isolate, kRouteSet),
+      result->Set(StringToSymbol(isolate, kRouteSet),
           ConvertToV8(isolate->GetCurrentContext(),
               val.route_set()).ToLocalChecked());
     }
     if (!val.uri().is_empty()) {
-      result->Set(v8::String::NewFromUtf8(isolate, kUri),
+      result->Set(StringToSymbol(isolate, kUri),
           ConvertToV8(isolate, val.uri()));
     }
     if (!val.user_agent().empty()) {
-      result->Set(v8::String::NewFromUtf8(isolate, kUserAgent),
+      result->Set(StringToSymbol(isolate, kUserAgent),
           ConvertToV8(isolate, val.user_agent()));
     }
     if (!val.authorization_user().empty()) {
-      result->Set(v8::String::NewFromUtf8(isolate, kAuthorizationUser),
+      result->Set(StringToSymbol(isolate, kAuthorizationUser),
           ConvertToV8(isolate, val.authorization_user()));
     }
     if (!val.display_name().empty()) {
-      result->Set(v8::String::NewFromUtf8(isolate, kDisplayName),
+      result->Set(StringToSymbol(isolate, kDisplayName),
           ConvertToV8(isolate, val.display_name()));
     }
     if (!val.password().empty()) {
-      result->Set(v8::String::NewFromUtf8(isolate, kPassword),
+      result->Set(StringToSymbol(isolate, kPassword),
           ConvertToV8(isolate, val.password()));
     }
-    result->Set(v8::String::NewFromUtf8(isolate, kRegisterExpires),
+    result->Set(StringToSymbol(isolate, kRegisterExpires),
         ConvertToV8(isolate, val.register_expires()));
     if (!val.registrar_server().is_empty()) {
-      result->Set(v8::String::NewFromUtf8(isolate, kRegistrarServer),
+      result->Set(StringToSymbol(isolate, kRegistrarServer),
           ConvertToV8(isolate, val.registrar_server()));
     }
+    result->Set(StringToSymbol(isolate, kPreconnect),
+        ConvertToV8(isolate, val.preconnect()));
+    result->Set(StringToSymbol(isolate, kPrewarmMedia),
+        ConvertToV8(isolate, val.prewarm_media()));
+    result->Set(StringToSymbol(isolate, kEarlyOffer),
+        ConvertToV8(isolate, val.early_offer()));
+    result->Set(StringToSymbol(isolate, kPeerConnectionPoolSize),
+        ConvertToV8(isolate, val.peer_connection_pool_size()));
+    result->Set(StringToSymbol(isolate, kSignallingOnly),
+        ConvertToV8(isolate, val.signalling_only()));
+    result->Set(StringToSymbol(isolate, kSharedSignallingThread),
+        ConvertToV8(isolate, val.shared_signalling_thread()));
+    result->Set(StringToSymbol(isolate, kAeadCipherSuitesOnly),
+        ConvertToV8(isolate, val.aead_cipher_suites_only()));
     return result;
   }
 
@@ -162,76 +185,127 @@ struct Converter<sippet::phone::Settings> {
       return false;
     sippet::phone::Settings settings;
     v8::Handle<v8::Object> input(v8::Handle<v8::Object>::Cast(val));
-    if (input->Has(v8::String::NewFromUtf8(isolate, kDisableEncryption))) {
+    if (input->Has(StringToSymbol(isolate, kDisableEncryption))) {
       bool disable_encryption = false;
       ConvertFromV8(isolate,
-          input->Get(v8::String::NewFromUtf8(isolate, kDisableEncryption)),
+          input->Get(StringToSymbol(isolate, kDisableEncryption)),
           &disable_encryption);
       settings.set_disable_encryption(disable_encryption);
     }
-    if (input->Has(v8::String::NewFromUtf8(isolate, kIceServers))) {
+    if (input->Has(StringToSymbol(isolate, kIceServers))) {
       sippet::phone::Settings::IceServers ice_servers;
       ConvertFromV8(isolate,
-        input->Get(v8::String::NewFromUtf8(isolate, kIceServers)),
+        input->Get(StringToSymbol(isolate, kIceServers)),
         &ice_servers);
       settings.ice_servers().swap(ice_servers);
     }
-    if (input->Has(v8::String::NewFromUtf8(isolate, kRouteSet))) {
+    if (input->Has(StringToSymbol(isolate, kRouteSet))) {
       sippet::phone::Settings::RouteSet route_set;
       ConvertFromV8(isolate,
-        input->Get(v8::String::NewFromUtf8(isolate, kRouteSet)),
+        input->Get(StringToSymbol(isolate, kRouteSet)),
         &route_set);
       settings.route_set().swap(route_set);
     }
-    if (input->Has(v8::String::NewFromUtf8(isolate, kUri))) {
+    if (input->Has(StringToSymbol(isolate, kUri))) {
       GURL uri;
       ConvertFromV8(isolate,
-        input->Get(v8::String::NewFromUtf8(isolate, kUri)),
+        input->Get(StringToSymbol(isolate, kUri)),
         &uri);
       settings.set_uri(uri);
     }
-    if (input->Has(v8::String::NewFromUtf8(isolate, kUserAgent))) {
+    if (input->Has(StringToSymbol(isolate, kUserAgent))) {
       std::string user_agent;
       ConvertFromV8(isolate,
-        input->Get(v8::String::NewFromUtf8(isolate, kUserAgent)),
+        input->Get(StringToSymbol(isolate, kUserAgent)),
         &user_agent);
       settings.set_user_agent(user_agent);
     }
-    if (input->Has(v8::String::NewFromUtf8(isolate, kAuthorizationUser))) {
+    if (input->Has(StringToSymbol(isolate, kAuthorizationUser))) {
       std::string authorization_user;
       ConvertFromV8(isolate,
-        input->Get(v8::String::NewFromUtf8(isolate, kAuthorizationUser)),
+        input->Get(StringToSymbol(isolate, kAuthorizationUser)),
         &authorization_user);
       settings.set_authorization_user(authorization_user);
     }
-    if (input->Has(v8::String::NewFromUtf8(isolate, kDisplayName))) {
+    if (input->Has(StringToSymbol(isolate, kDisplayName))) {
       std::string display_name;
       ConvertFromV8(isolate,
-        input->Get(v8::String::NewFromUtf8(isolate, kDisplayName)),
+        input->Get(StringToSymbol(isolate, kDisplayName)),
         &display_name);
       settings.set_display_name(display_name);
     }
-    if (input->Has(v8::String::NewFromUtf8(isolate, kPassword))) {
+    if (input->Has(StringToSymbol(isolate, kPassword))) {
       std::string password;
       ConvertFromV8(isolate,
-        input->Get(v8::String::NewFromUtf8(isolate, kPassword)),
+        input->Get(StringToSymbol(isolate, kPassword)),
         &password);
       settings.set_password(password);
     }
-    if (input->Has(v8::String::NewFromUtf8(isolate, kRegisterExpires))) {
+    if (input->Has(StringToSymbol(isolate, kRegisterExpires))) {
       unsigned register_expires;
       ConvertFromV8(isolate,
-        input->Get(v8::String::NewFromUtf8(isolate, kRegisterExpires)),
+        input->Get(StringToSymbol(isolate, kRegisterExpires)),
         &register_expires);
       settings.set_register_expires(register_expires);
     }
-    if (input->Has(v8::String::NewFromUtf8(isolate, kRegistrarServer))) {
+    if (input->Has(StringToSymbol(isolate, kRegistrarServer))) {
       GURL registrar_server;
       ConvertFromV8(isolate,
-        input->Get(v8::String::NewFromUtf8(isolate, kRegistrarServer)),
+        input->Get(StringToSymbol(isolate, kRegistrarServer)),
         &registrar_server);
       settings.set_registrar_server(registrar_server);
     }
+    if (input->Has(StringToSymbol(isolate, kPreconnect))) {
+      bool preconnect = false;
+      ConvertFromV8(isolate,
+          input->Get(StringToSymbol(isolate, kPreconnect)),
+          &preconnect);
+      settings.set_preconnect(preconnect);
+    }
+    if (input->Has(StringToSymbol(isolate, kPrewarmMedia))) {
+      bool prewarm_media = false;
+      ConvertFromV8(isolate,
+          input->Get(StringToSymbol(isolate, kPrewarmMedia)),
+          &prewarm_media);
+      settings.set_prewarm_media(prewarm_media);
+    }
+    if (input->Has(StringToSymbol(isolate, kEarlyOffer))) {
+      bool early_offer = false;
+      ConvertFromV8(isolate,
+          input->Get(StringToSymbol(isolate, kEarlyOffer)),
+          &early_offer);
+      settings.set_early_offer(early_offer);
+    }
+    if (input->Has(
+        StringToSymbol(isolate, kPeerConnectionPoolSize))) {
+      unsigned peer_connection_pool_size = 0;
+      ConvertFromV8(isolate,
+          input->Get(
+              StringToSymbol(isolate, kPeerConnectionPoolSize)),
+          &peer_connection_pool_size);
+      settings.set_peer_connection_pool_size(peer_connection_pool_size);
+    }
+    if (input->Has(StringToSymbol(isolate, kSignallingOnly))) {
+      bool signalling_only = false;
+      ConvertFromV8(isolate,
+          input->Get(StringToSymbol(isolate, kSignallingOnly)),
+          &signalling_only);
+      settings.set_signalling_only(signalling_only);
+    }
+    if (input->Has(StringToSymbol(isolate, kSharedSignallingThread))) {
+      bool shared_signalling_thread = false;
+      ConvertFromV8(isolate,
+          input->Get(StringToSymbol(isolate, kSharedSignallingThread)),
+          &shared_signalling_thread);
+      settings.set_shared_signalling_thread(shared_signalling_thread);
+    }
+    if (input->Has(StringToSymbol(isolate, kAeadCipherSuitesOnly))) {
+      bool aead_cipher_suites_only = false;
+      ConvertFromV8(isolate,
+          input->Get(StringToSymbol(isolate, kAeadCipherSuitesOnly)),
+          &aead_cipher_suites_only);
+      settings.set_aead_cipher_suites_only(aead_cipher_suites_only);
+    }
     *out = settings;
     return true;
   }
@@ -257,6 +331,20 @@ const char Converter<sippet::phone::Settings>::kRegisterExpires[] =
     "register_expires";
 const char Converter<sippet::phone::Settings>::kRegistrarServer[] =
     "registrar_server";
+const char Converter<sippet::phone::Settings>::kPreconnect[] =
+    "preconnect";
+const char Converter<sippet::phone::Settings>::kPrewarmMedia[] =
+    "prewarm_media";
+const char Converter<sippet::phone::Settings>::kEarlyOffer[] =
+    "early_offer";
+const char Converter<sippet::phone::Settings>::kPeerConnectionPoolSize[] =
+    "peer_connection_pool_size";
+const char Converter<sippet::phone::Settings>::kSignallingOnly[] =
+    "signalling_only";
+const char Converter<sippet::phone::Settings>::kSharedSignallingThread[] =
+    "shared_signalling_thread";
+const char Converter<sippet::phone::Settings>::kAeadCipherSuitesOnly[] =
+    "aead_cipher_suites_only";
 
 }  // namespace gin
 
@@ -279,7 +367,7 @@ PhoneJsWrapper::PhoneJsWrapper(
     v8::Isolate* isolate) :
   isolate_(isolate),
   phone_(Phone::Create(this)),
-  message_loop_(base::MessageLoop::current()),
+  event_queue_(new JsEventQueue(base::MessageLoop::current())),
   on_register_completed_(kOnRegisterCompleted),
   on_refresh_completed_(kOnRefreshCompleted),
   on_unregister_completed_(kOnUnregisterCompleted),
@@ -360,11 +448,14 @@ void PhoneJsWrapper::UnregisterAll(v8::Handle<v8::Function> function) {
 gin::Handle<CallJsWrapper> PhoneJsWrapper::MakeCall(
     const std::string& destination,
     v8::Handle<v8::Function> function) {
-  gin::Handle<CallJsWrapper> handle(CallJsWrapper::Create(isolate_));
+  gin::Handle<CallJsWrapper> handle(
+      CallJsWrapper::Create(isolate_, event_queue_));
   handle->set_completed_function(function);
   scoped_refptr<Call> call = phone_->MakeCall(destination,
       base::Bind(&CallJsWrapper::OnCompleted,
           base::Unretained(handle.get())));
+  if (call)
+    handle->set_call_instance(call);
   return handle;
 }
 
@@ -376,25 +467,25 @@ void PhoneJsWrapper::On(const std::string& key,
 }
 
 void PhoneJsWrapper::OnRegisterCompleted(int error) {
-  message_loop_->PostTask(FROM_HERE,
+  event_queue_->Post(
       base::Bind(&PhoneJsWrapper::RunRegisterCompleted, base::Unretained(this),
           error));
 }
 
 void PhoneJsWrapper::OnRefreshCompleted(int error) {
-  message_loop_->PostTask(FROM_HERE,
+  event_queue_->Post(
       base::Bind(&PhoneJsWrapper::RunRefreshCompleted, base::Unretained(this),
           error));
 }
 
 void PhoneJsWrapper::OnUnregisterCompleted(int error) {
-  message_loop_->PostTask(FROM_HERE,
+  event_queue_->Post(
       base::Bind(&PhoneJsWrapper::RunUnregisterCompleted,
           base::Unretained(this), error));
 }
 
 void PhoneJsWrapper::OnIncomingCall(const scoped_refptr<Call>& call) {
-  message_loop_->PostTask(FROM_HERE,
+  event_queue_->Post(
       base::Bind(&PhoneJsWrapper::RunIncomingCall,
           base::Unretained(this), call));
 }
@@ -412,7 +503,8 @@ void PhoneJsWrapper::RunUnregisterCompleted(int error) {
 }
 
 void PhoneJsWrapper::RunIncomingCall(const scoped_refptr<Call>& call) {
-  gin::Handle<CallJsWrapper> handle(CallJsWrapper::Create(isolate_));
+  gin::Handle<CallJsWrapper> handle(
+      CallJsWrapper::Create(isolate_, event_queue_));
   handle->set_call_instance(call);
   on_incoming_call_.Run(this, handle);
 }
@@ -7,8 +7,8 @@
 
 #include "sippet/phone/phone.h"
 #include "sippet/phone/v8/js_callback.h"
+#include "sippet/phone/v8/js_event_queue.h"
 
-#include "base/message_loop/message_loop.h"
 #include "gin/handle.h"
 #include "gin/object_template_builder.h"
 #include "gin/runner.h"
@@ -64,7 +64,7 @@ class PhoneJsWrapper :
 
   v8::Isolate* isolate_;
   scoped_refptr<Phone> phone_;
-  base::MessageLoop* message_loop_;
+  scoped_refptr<JsEventQueue> event_queue_;
 
   JsCallback<void(int)> on_register_completed_;
   JsCallback<void(int)> on_refresh_completed_;
@@ -13,20 +13,36 @@
       'dependencies': [
         'sippet_version',
         '<(DEPTH)/base/base.gyp:base',
+        '<(DEPTH)/crypto/crypto.gyp:crypto',
         '<(DEPTH)/net/net.gyp:net',
+        '<(DEPTH)/third_party/zlib/zlib.gyp:zlib',
       ],
       'include_dirs': [
         '<(DEPTH)',
         '<(DEPTH)/third_party',
       ],
       'sources': [
+        'base/arena.h',
+        'base/arena.cc',
         'base/casting.h',
         'base/format.h',
         'base/ilist.h',
         'base/ilist_node.h',
+        'base/interned_string.h',
+        'base/interned_string.cc',
+        'base/memory_accounting.h',
+        'base/memory_accounting.cc',
         'base/raw_ostream.cc',
         'base/raw_ostream.h',
+        'base/routing_token.h',
+        'base/routing_token.cc',
         'base/sequences.h',
+        'base/sha512_256.h',
+        'base/sha512_256.cc',
+        'base/slab_allocator.h',
+        'base/slab_allocator.cc',
+        'base/small_vector.h',
+        'base/spsc_ring.h',
         'base/stl_extras.h',
         'base/string_extras.h',
         'base/tags.h',
@@ -38,6 +54,8 @@
         'base/version.h',
         'base/version.cc',
         'message/atom.h',
+        'message/content_coding.h',
+        'message/content_coding.cc',
         'message/header.h',
         'message/header.cc',
         'message/headers.h',
@@ -91,6 +109,8 @@
         'message/headers/mime_version.cc',
         'message/headers/min_expires.h',
         'message/headers/min_expires.cc',
+        'message/headers/min_se.h',
+        'message/headers/min_se.cc',
         'message/headers/organization.h',
         'message/headers/organization.cc',
         'message/headers/priority.h',
@@ -101,6 +121,8 @@
         'message/headers/proxy_authorization.cc',
         'message/headers/proxy_require.h',
         'message/headers/proxy_require.cc',
+        'message/headers/rack.h',
+        'message/headers/rack.cc',
         'message/headers/record_route.h',
         'message/headers/record_route.cc',
         'message/headers/reply_to.h',
@@ -111,8 +133,12 @@
         'message/headers/retry_after.cc',
         'message/headers/route.h',
         'message/headers/route.cc',
+        'message/headers/rseq.h',
+        'message/headers/rseq.cc',
         'message/headers/server.h',
         'message/headers/server.cc',
+        'message/headers/session_expires.h',
+        'message/headers/session_expires.cc',
         'message/headers/subject.h',
         'message/headers/subject.cc',
         'message/headers/supported.h',
@@ -144,8 +170,14 @@
         'message/status_code_list.h',
         'message/message.h',
         'message/message.cc',
+        'message/message_pool.h',
+        'message/message_pool.cc',
         'message/method.h',
         'message/method.cc',
+        'message/multipart_body.h',
+        'message/multipart_body.cc',
+        'message/parse_profile.h',
+        'message/parse_profile.cc',
         'message/parser/parser.cc',
         'message/parser/tokenizer.h',
         'message/parser/tokenizer.cc',
@@ -153,8 +185,16 @@
         'message/protocol.cc',
         'message/request.h',
         'message/request.cc',
+        'message/request_template.h',
+        'message/request_template.cc',
         'message/response.h',
         'message/response.cc',
+        'message/session_description.h',
+        'message/session_description.cc',
+        'message/shared_header.h',
+        'message/shared_header.cc',
+        'message/static_header_block.h',
+        'message/static_header_block.cc',
         'message/version.h',
         'message/status_code.h',
         'message/status_code.cc',
@@ -173,17 +213,64 @@
         'transport/aliases_map.cc',
         'transport/end_point.h',
         'transport/end_point.cc',
+        'transport/event_loop.h',
+        'transport/event_loop.cc',
+        'transport/external_event_loop.h',
+        'transport/external_event_loop.cc',
+        'transport/loop_watchdog.h',
+        'transport/loop_watchdog.cc',
+        'transport/message_capture.h',
+        'transport/message_capture.cc',
+        'transport/message_compressor.h',
+        'transport/message_compressor.cc',
+        'transport/message_limits.h',
+        'transport/message_limits.cc',
+        'transport/network_event_queue.h',
+        'transport/network_event_queue.cc',
         'transport/network_layer.h',
         'transport/network_layer.cc',
+        'transport/network_layer_shards.h',
+        'transport/network_layer_shards.cc',
+        'transport/message_ring.h',
+        'transport/message_ring.cc',
+        'transport/ring_channel.h',
+        'transport/ring_channel.cc',
         'transport/network_settings.h',
         'transport/network_settings.cc',
+        'transport/overload_controller.h',
+        'transport/overload_controller.cc',
+        'transport/options_pinger.h',
+        'transport/options_pinger.cc',
+        'transport/source_rate_limiter.h',
+        'transport/source_rate_limiter.cc',
+        'transport/parse_pool.h',
+        'transport/parse_pool.cc',
+        'transport/request_fingerprint.h',
+        'transport/request_fingerprint.cc',
+        'transport/sip_locator.h',
+        'transport/sip_locator.cc',
+        'transport/socket_options.h',
+        'transport/socket_options.cc',
+        'transport/striped_channel.h',
+        'transport/striped_channel.cc',
+        'transport/adaptive_time_delta_factory.h',
+        'transport/adaptive_time_delta_factory.cc',
         'transport/branch_factory.h',
         'transport/branch_factory.cc',
         'transport/channel.h',
         'transport/channel_factory.h',
+        'transport/channel_listener.h',
         'transport/transaction_delegate.h',
         'transport/transaction_factory.h',
         'transport/transaction_factory.cc',
+        'transport/transaction_slab.h',
+        'transport/transaction_timer_policy.h',
+        'transport/transport_log.h',
+        'transport/transport_log.cc',
+        'transport/transport_log_event_type_list.h',
+        'transport/transport_stats.h',
+        'transport/transport_stats.cc',
+        'transport/write_queue_limits.h',
         'transport/client_transaction.h',
         'transport/client_transaction_impl.h',
         'transport/client_transaction_impl.cc',
@@ -193,33 +280,77 @@
         'transport/time_delta_provider.h',
         'transport/time_delta_factory.h',
         'transport/time_delta_factory.cc',
+        'transport/thread_placement.h',
+        'transport/thread_placement.cc',
+        'transport/timer_wheel.h',
+        'transport/timer_wheel.cc',
+        'transport/ssl_cert_decision_cache.h',
+        'transport/ssl_cert_decision_cache.cc',
         'transport/ssl_cert_error_handler.h',
         'transport/ssl_cert_error_transaction.h',
         'transport/ssl_cert_error_transaction.cc',
+        'transport/chrome/message_io_buffer.h',
+        'transport/chrome/message_io_buffer.cc',
+        'transport/chrome/ws_frame_io_buffer.h',
+        'transport/chrome/ws_frame_io_buffer.cc',
+        'transport/chrome/ws_deflate_stream.h',
+        'transport/chrome/ws_deflate_stream.cc',
         'transport/chrome/message_reader.h',
         'transport/chrome/message_reader.cc',
+        'transport/chrome/receive_buffer_pool.h',
+        'transport/chrome/receive_buffer_pool.cc',
         'transport/chrome/chrome_stream_reader.h',
         'transport/chrome/chrome_stream_reader.cc',
         'transport/chrome/chrome_stream_writer.h',
         'transport/chrome/chrome_stream_writer.cc',
+        'transport/chrome/chrome_connection_racer.h',
+        'transport/chrome/chrome_connection_racer.cc',
+        'transport/chrome/chrome_record_resolver.h',
+        'transport/chrome/chrome_record_resolver.cc',
+        'transport/chrome/proxy_decision_cache.h',
+        'transport/chrome/proxy_decision_cache.cc',
         'transport/chrome/chrome_stream_channel.h',
         'transport/chrome/chrome_stream_channel.cc',
+        'transport/chrome/chrome_server_stream_channel.h',
+        'transport/chrome/chrome_server_stream_channel.cc',
+        'transport/chrome/chrome_stream_listener.h',
+        'transport/chrome/chrome_stream_listener.cc',
         'transport/chrome/chrome_datagram_writer.h',
         'transport/chrome/chrome_datagram_writer.cc',
         'transport/chrome/chrome_datagram_reader.h',
         'transport/chrome/chrome_datagram_reader.cc',
         'transport/chrome/chrome_datagram_channel.h',
         'transport/chrome/chrome_datagram_channel.cc',
+        'transport/chrome/chrome_server_datagram_channel.h',
+        'transport/chrome/chrome_server_datagram_channel.cc',
+        'transport/chrome/chrome_datagram_listener.h',
+        'transport/chrome/chrome_datagram_listener.cc',
         'transport/chrome/chrome_channel_factory.h',
         'transport/chrome/chrome_channel_factory.cc',
+        'transport/chrome/write_queue_monitor.h',
+        'transport/chrome/write_queue_monitor.cc',
+        'transport/native/native_datagram_transport.h',
+        'transport/native/native_datagram_transport_linux.cc',
         'ua/ua_user_agent.h',
         'ua/ua_user_agent.cc',
         'ua/dialog.h',
         'ua/dialog.cc',
+        'ua/dialog_replicator.h',
+        'ua/dialog_replicator.cc',
         'ua/dialog_store.h',
         'ua/dialog_store.cc',
         'ua/dialog_controller.h',
         'ua/dialog_controller.cc',
+        'ua/fork_context.h',
+        'ua/fork_context.cc',
+        'ua/b2b_bridge.h',
+        'ua/b2b_bridge.cc',
+        'ua/dispatcher.h',
+        'ua/dispatcher.cc',
+        'ua/hash_ring.h',
+        'ua/hash_ring.cc',
+        'ua/async_user_agent.h',
+        'ua/async_user_agent.cc',
         'ua/auth.h',
         'ua/auth.cc',
         'ua/auth_cache.h',
@@ -234,6 +365,24 @@
         'ua/auth_controller.cc',
         'ua/auth_transaction.h',
         'ua/auth_transaction.cc',
+        'ua/credential_cache.h',
+        'ua/credential_cache.cc',
+        'ua/digest_authenticator.h',
+        'ua/digest_authenticator.cc',
+        'ua/location_service.h',
+        'ua/location_service.cc',
+        'ua/location_cluster.h',
+        'ua/location_cluster.cc',
+        'ua/snapshot_io.h',
+        'ua/snapshot_io.cc',
+        'ua/registrar.h',
+        'ua/registrar.cc',
+        'ua/refresh_scheduler.h',
+        'ua/refresh_scheduler.cc',
+        'ua/session_timer.h',
+        'ua/session_timer.cc',
+        'ua/subscription_manager.h',
+        'ua/subscription_manager.cc',
         'ua/password_handler.h',
       ],
       'conditions': [
@@ -12,6 +12,7 @@
       'type': 'static_library',
       'dependencies': [
         '<(DEPTH)/net/net.gyp:net',
+        '<(DEPTH)/net/net.gyp:http_server',
         '<(DEPTH)/third_party/icu/icu.gyp:icui18n',
         '<(DEPTH)/third_party/icu/icu.gyp:icuuc',
         'sippet.gyp:sippet',
@@ -33,6 +34,8 @@
         'examples/common/static_password_handler.cc',
         'examples/common/dump_ssl_cert_error.h',
         'examples/common/dump_ssl_cert_error.cc',
+        'examples/common/introspection_server.h',
+        'examples/common/introspection_server.cc',
       ],
     },  # target sippet_examples_common
     {
@@ -72,5 +75,15 @@
         'examples/call/call_main.cc',
       ],
     },  # target sippet_examples_call
+    {
+      'target_name': 'sippet_examples_loadgen',
+      'type': 'executable',
+      'dependencies': [
+        'sippet_examples_common',
+      ],
+      'sources': [
+        'examples/loadgen/loadgen_main.cc',
+      ],
+    },  # target sippet_examples_loadgen
   ],
 }
@@ -0,0 +1,48 @@
+# Copyright (c) 2014 The Sippet Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+# Runs the perf suites against test/data/perf/baseline.json. Kept out of
+# all.gyp, so that the benchmarks only run when this target is built.
+{
+  'targets': [
+    {
+      'target_name': 'sippet_perf_regression',
+      'type': 'none',
+      'dependencies': [
+        'sippet_tests.gyp:sippet_perftests',
+        'sippet_tests.gyp:sippet_transport_perftests',
+      ],
+      'actions': [
+        {
+          'action_name': 'run_perftests',
+          'inputs': [
+            '<(script)',
+            '<(baseline)',
+            '<(PRODUCT_DIR)/sippet_perftests<(EXECUTABLE_SUFFIX)',
+            '<(PRODUCT_DIR)/sippet_transport_perftests<(EXECUTABLE_SUFFIX)',
+          ],
+          'outputs': [
+            '<(PRODUCT_DIR)/sippet_perf_results.json',
+          ],
+          'action': ['python',
+                     '<(script)',
+                     '--build-dir', '<(PRODUCT_DIR)',
+                     '--baseline', '<(baseline)',
+                     '--output', '<@(_outputs)',
+                     '--repeat', '<(perf_repeat)',
+                     '--warmup', '1',
+                     '--cpu', '<(perf_cpu)',
+                   ],
+          'variables': {
+            'script': 'test/perf/run_perftests.py',
+            'baseline': 'test/data/perf/baseline.json',
+            'perf_repeat%': '5',
+            'perf_cpu%': '0',
+          },
+          'message': 'Running sippet perf suites',
+        },
+      ],
+    },
+  ],
+}
@@ -15,6 +15,7 @@
           'sources': [
             'phone/android/java/src/io/sippet/phone/Phone.java',
             'phone/android/java/src/io/sippet/phone/Call.java',
+            'phone/android/java/src/io/sippet/phone/CallMetrics.java',
             'phone/android/java/src/io/sippet/phone/Settings.java',
             'phone/android/java/src/io/sippet/phone/IceServer.java',
             'phone/android/java/src/io/sippet/phone/CompletionCallback.java',
@@ -145,8 +146,15 @@
         'phone/phone_state.h'
         'phone/phone_impl.h',
         'phone/phone_impl.cc',
+        'phone/stack.h',
+        'phone/stack_impl.h',
+        'phone/stack_impl.cc',
+        'phone/peer_connection_pool.h',
+        'phone/peer_connection_pool.cc',
+        'phone/session_description_observers.h',
         'phone/call.h',
         'phone/call_direction.h',
+        'phone/call_metrics.h',
         'phone/call_state.h',
         'phone/call_impl.h',
         'phone/call_impl.cc',
@@ -196,6 +204,8 @@
       ],
       'sources': [
         'phone/v8/js_callback.h',
+        'phone/v8/js_event_queue.h',
+        'phone/v8/js_event_queue.cc',
         'phone/v8/phone_js_wrapper.h',
         'phone/v8/phone_js_wrapper.cc',
         'phone/v8/call_js_wrapper.h',
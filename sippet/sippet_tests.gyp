@@ -28,18 +28,102 @@
       ],
       'sources': [
         '../net/test/run_all_unittests.cc',
+        'base/slab_allocator_unittest.cc',
         'message/message_unittest.cc',
         'message/headers_unittest.cc',
         'message/parser_unittest.cc',
+        'message/parser/tokenizer_unittest.cc',
+        'message/session_description_unittest.cc',
         'uri/uri_unittest.cc',
+        'test/replay/capture_file_unittest.cc',
+        'test/simulation/simulated_network_unittest.cc',
+        'transport/adaptive_time_delta_factory_unittest.cc',
+        'transport/client_transaction_impl_unittest.cc',
         'transport/end_point_unittest.cc',
+        'transport/external_event_loop_unittest.cc',
+        'transport/loop_watchdog_unittest.cc',
+        'transport/message_capture_unittest.cc',
+        'transport/message_compressor_unittest.cc',
+        'transport/message_limits_unittest.cc',
+        'transport/network_event_queue_unittest.cc',
         'transport/network_layer_unittest.cc',
+        'transport/network_layer_shards_unittest.cc',
+        'transport/overload_controller_unittest.cc',
+        'transport/options_pinger_unittest.cc',
+        'transport/source_rate_limiter_unittest.cc',
+        'transport/parse_pool_unittest.cc',
+        'transport/request_fingerprint_unittest.cc',
+        'transport/ring_channel_unittest.cc',
+        'transport/server_transaction_impl_unittest.cc',
+        'transport/ssl_cert_decision_cache_unittest.cc',
+        'transport/striped_channel_unittest.cc',
+        'transport/sip_locator_unittest.cc',
+        'transport/thread_placement_unittest.cc',
+        'transport/timer_wheel_unittest.cc',
+        'transport/transaction_timer_policy_unittest.cc',
+        'transport/transport_log_unittest.cc',
+        'transport/transport_stats_unittest.cc',
+        'transport/chrome/chrome_channel_factory_unittest.cc',
+        'transport/chrome/chrome_connection_racer_unittest.cc',
+        'transport/chrome/chrome_datagram_listener_unittest.cc',
         'transport/chrome/chrome_datagram_writer_unittest.cc',
+        'transport/chrome/chrome_stream_reader_unittest.cc',
         'transport/chrome/chrome_stream_writer_unittest.cc',
+        'transport/chrome/message_io_buffer_unittest.cc',
+        'transport/chrome/proxy_decision_cache_unittest.cc',
+        'transport/chrome/write_queue_monitor_unittest.cc',
+        'transport/chrome/ws_deflate_stream_unittest.cc',
+        'transport/chrome/ws_frame_io_buffer_unittest.cc',
+        'transport/native/native_datagram_transport_linux_unittest.cc',
+        'ua/auth_cache_unittest.cc',
         'ua/auth_controller_unittest.cc',
         'ua/auth_handler_digest_unittest.cc',
+        'ua/auth_transaction_unittest.cc',
+        'ua/b2b_bridge_unittest.cc',
+        'ua/credential_cache_unittest.cc',
+        'ua/dialog_store_unittest.cc',
+        'ua/digest_authenticator_unittest.cc',
+        'ua/fork_context_unittest.cc',
+        'ua/hash_ring_unittest.cc',
+        'ua/location_service_unittest.cc',
+        'ua/location_cluster_unittest.cc',
+        'ua/refresh_scheduler_unittest.cc',
       ],
     },  # target sippet_unittest
+    {
+      'target_name': 'sippet_perftests',
+      'type': 'executable',
+      'dependencies': [
+        '<(DEPTH)/base/base.gyp:base',
+        '<(DEPTH)/base/base.gyp:test_support_perf',
+        '<(DEPTH)/testing/gtest.gyp:gtest',
+        '<(DEPTH)/testing/perf/perf_test.gyp:perf_test',
+        'sippet.gyp:sippet',
+      ],
+      'sources': [
+        'message/message_perftest.cc',
+        'test/allocation_counter.h',
+        'test/allocation_counter.cc',
+        'test/perf/perf_test_util.h',
+        'test/perf/perf_test_util.cc',
+        'ua/ua_perftest.cc',
+        'uri/uri_perftest.cc',
+      ],
+    },  # target sippet_perftests
+    {
+      'target_name': 'sippet_transport_perftests',
+      'type': 'executable',
+      'dependencies': [
+        '<(DEPTH)/base/base.gyp:test_support_perf',
+        '<(DEPTH)/net/net.gyp:net_test_support',
+        '<(DEPTH)/testing/gtest.gyp:gtest',
+        '<(DEPTH)/testing/perf/perf_test.gyp:perf_test',
+        'sippet_standalone_test_server',
+      ],
+      'sources': [
+        'transport/network_layer_perftest.cc',
+      ],
+    },  # target sippet_transport_perftests
     {
       'target_name': 'sippet_test_support',
       'type': 'static_library',
@@ -59,8 +143,18 @@
         '<(DEPTH)/testing/gmock.gyp:gmock',
       ],
       'sources': [
+        'test/allocation_counter.h',
+        'test/allocation_counter.cc',
+        'test/replay/capture_file.h',
+        'test/replay/capture_file.cc',
+        'test/simulation/simulated_network.h',
+        'test/simulation/simulated_network.cc',
+        'test/simulation/simulated_peer.h',
+        'test/simulation/simulated_peer.cc',
         'transport/chrome/transport_test_util.h',
         'transport/chrome/transport_test_util.cc',
+        'transport/transaction_test_util.h',
+        'transport/transaction_test_util.cc',
         'ua/auth_handler_mock.h',
         'ua/auth_handler_mock.cc',
       ],
@@ -114,5 +208,16 @@
         'test/standalone_test_server/main.cc',
       ],
     },  # target sippet_standalone_test_server_main
+    {
+      'target_name': 'sippet_replay',
+      'type': 'executable',
+      'dependencies': [
+        '<(DEPTH)/base/base.gyp:base_i18n',
+        'sippet_test_support',
+      ],
+      'sources': [
+        'test/replay/replay_main.cc',
+      ],
+    },  # target sippet_replay
   ],
 }
@@ -0,0 +1,53 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/test/allocation_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+base::subtle::Atomic32 g_allocations = 0;
+
+}  // namespace
+
+void *operator new(size_t size) {
+  base::subtle::NoBarrier_AtomicIncrement(&g_allocations, 1);
+  void *p = malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) throw() {
+  free(p);
+}
+
+void *operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete[](void *p) throw() {
+  operator delete(p);
+}
+
+namespace sippet {
+
+base::subtle::Atomic32 GetAllocationCount() {
+  return base::subtle::NoBarrier_Load(&g_allocations);
+}
+
+ScopedAllocationCounter::ScopedAllocationCounter()
+  : start_(GetAllocationCount()) {
+}
+
+ScopedAllocationCounter::~ScopedAllocationCounter() {
+}
+
+int ScopedAllocationCounter::allocations() const {
+  return GetAllocationCount() - start_;
+}
+
+}  // namespace sippet
@@ -0,0 +1,43 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TEST_ALLOCATION_COUNTER_H_
+#define SIPPET_TEST_ALLOCATION_COUNTER_H_
+
+#include "base/atomicops.h"
+#include "base/basictypes.h"
+
+namespace sippet {
+
+// Returns the number of heap allocations made by the binary so far. Linking
+// this file replaces the global operator new, so that every call to it, from
+// any thread, is counted.
+base::subtle::Atomic32 GetAllocationCount();
+
+// Counts the heap allocations made while in scope, so that tests can keep
+// hot paths within an allocation budget:
+//
+//   ScopedAllocationCounter counter;
+//   Message::Parse(raw_message);
+//   EXPECT_GE(kParseBudget, counter.allocations());
+//
+// Allocations of all threads are counted, so the measured region shouldn't
+// run concurrently with other work.
+class ScopedAllocationCounter {
+ public:
+  ScopedAllocationCounter();
+  ~ScopedAllocationCounter();
+
+  // Allocations made since construction.
+  int allocations() const;
+
+ private:
+  base::subtle::Atomic32 start_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedAllocationCounter);
+};
+
+}  // namespace sippet
+
+#endif  // SIPPET_TEST_ALLOCATION_COUNTER_H_
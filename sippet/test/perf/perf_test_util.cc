@@ -0,0 +1,36 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/test/perf/perf_test_util.h"
+
+#include "testing/perf/perf_test.h"
+
+namespace sippet {
+
+PerfMeasurement::PerfMeasurement(const std::string &name,
+                                 const std::string &trace,
+                                 int iterations)
+  : name_(name), trace_(trace), iterations_(iterations),
+    allocations_(GetAllocationCount()),
+    start_(base::TimeTicks::Now()) {
+}
+
+PerfMeasurement::~PerfMeasurement() {
+}
+
+double PerfMeasurement::Done(const std::string &units) {
+  base::TimeDelta elapsed = base::TimeTicks::Now() - start_;
+  double allocations =
+      static_cast<double>(GetAllocationCount() - allocations_) / iterations_;
+  double seconds = elapsed.InSecondsF();
+  perf_test::PrintResult(name_, "_throughput", trace_,
+      seconds > 0 ? iterations_ / seconds : 0, units + "/sec", true);
+  perf_test::PrintResult(name_, "_time", trace_,
+      elapsed.InMicrosecondsF() * 1000 / iterations_, "ns/" + units, true);
+  perf_test::PrintResult(name_, "_allocations", trace_, allocations,
+      "allocations/" + units, true);
+  return allocations;
+}
+
+}  // namespace sippet
@@ -0,0 +1,39 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TEST_PERF_PERF_TEST_UTIL_H_
+#define SIPPET_TEST_PERF_PERF_TEST_UTIL_H_
+
+#include <string>
+
+#include "base/atomicops.h"
+#include "base/time/time.h"
+#include "sippet/test/allocation_counter.h"
+
+namespace sippet {
+
+// Reports the time and allocations spent from construction until |Done|,
+// over |iterations| operations.
+class PerfMeasurement {
+ public:
+  PerfMeasurement(const std::string &name, const std::string &trace,
+                  int iterations);
+  ~PerfMeasurement();
+
+  // Prints the throughput, the time and the allocations per operation,
+  // named after |units|. Returns the allocations per operation, so that
+  // tests can keep them from growing.
+  double Done(const std::string &units);
+
+ private:
+  std::string name_;
+  std::string trace_;
+  int iterations_;
+  base::subtle::Atomic32 allocations_;
+  base::TimeTicks start_;
+};
+
+}  // namespace sippet
+
+#endif  // SIPPET_TEST_PERF_PERF_TEST_UTIL_H_
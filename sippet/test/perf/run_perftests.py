@@ -0,0 +1,227 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2014 The Sippet Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Runs the sippet perf suites and compares them against a baseline.
+
+Each suite is run a few times to warm up, then repeatedly; the median of
+each result printed through perf_test::PrintResult is kept. The results are
+written as JSON, and compared against the baseline: a result worse than its
+baseline by more than its threshold is a regression, and makes the script
+exit with 1.
+
+  run_perftests.py --build-dir=out/Release --output=results.json
+
+Run with --update-baseline on the reference machine to record new values.
+"""
+
+import json
+import optparse
+import os
+import re
+import subprocess
+import sys
+
+SIPPET_ROOT = os.path.abspath(os.path.join(
+    os.path.dirname(os.path.realpath(__file__)), os.pardir, os.pardir))
+
+DEFAULT_BASELINE = os.path.join(
+    SIPPET_ROOT, 'test', 'data', 'perf', 'baseline.json')
+
+# Executables of the suites, as built by sippet_tests.gyp.
+SUITES = [
+  'sippet_perftests',
+  'sippet_transport_perftests',
+]
+
+# As printed by testing/perf/perf_test.cc: a single value, a list of them
+# in brackets, or a mean and standard deviation in braces.
+RESULT_RE = re.compile(
+    r'^\*?RESULT ([^:]+): ([^=]*)= (\[[^\]]*\]|\{[^}]*\}|\S+) ?(.*)$')
+
+
+def ParseValue(value):
+  if value.startswith('['):
+    values = [float(v) for v in value[1:-1].split(',') if v.strip()]
+    return sum(values) / len(values) if values else None
+  if value.startswith('{'):
+    return float(value[1:-1].split(',')[0])
+  try:
+    return float(value)
+  except ValueError:
+    return None
+
+
+def ParseResults(output):
+  """Returns {'graph/trace': (value, units)} of the results in |output|."""
+  results = {}
+  for line in output.splitlines():
+    match = RESULT_RE.match(line.strip())
+    if not match:
+      continue
+    graph, trace, value, units = match.groups()
+    value = ParseValue(value)
+    if value is not None:
+      results['%s/%s' % (graph, trace.strip())] = (value, units.strip())
+  return results
+
+
+def Median(values):
+  values = sorted(values)
+  middle = len(values) // 2
+  if len(values) % 2:
+    return values[middle]
+  return (values[middle - 1] + values[middle]) / 2.0
+
+
+def HigherIsBetter(units):
+  return units.endswith('/sec')
+
+
+def RunSuite(executable, cpu, gtest_filter):
+  command = [executable]
+  if gtest_filter:
+    command.append('--gtest_filter=' + gtest_filter)
+  if cpu is not None and sys.platform.startswith('linux'):
+    # Pinned, so that the scheduler doesn't move it between cores.
+    command = ['taskset', '-c', str(cpu)] + command
+  process = subprocess.Popen(command, stdout=subprocess.PIPE,
+                             stderr=subprocess.STDOUT,
+                             universal_newlines=True)
+  output = process.communicate()[0]
+  if process.returncode != 0:
+    sys.stderr.write(output)
+    raise RuntimeError('%s failed with %d' % (executable,
+                                               process.returncode))
+  return output
+
+
+def RunAll(options):
+  """Returns the results of all suites, with the values of each run."""
+  results = {}
+  for suite in SUITES:
+    executable = os.path.join(options.build_dir, suite)
+    if sys.platform == 'win32':
+      executable += '.exe'
+    if not os.path.exists(executable):
+      print('Skipping %s, not built' % suite)
+      continue
+    for _ in range(options.warmup):
+      RunSuite(executable, options.cpu, options.gtest_filter)
+    for run in range(options.repeat):
+      print('Running %s (%d of %d)' % (suite, run + 1, options.repeat))
+      output = RunSuite(executable, options.cpu, options.gtest_filter)
+      for name, (value, units) in ParseResults(output).items():
+        entry = results.setdefault(name, {'units': units, 'values': []})
+        entry['values'].append(value)
+  for entry in results.values():
+    entry['median'] = Median(entry['values'])
+  return results
+
+
+def GetThreshold(baseline, name, units):
+  """The relative change allowed for |name|, from the most specific of the
+  baseline entry, the rules matching its units, or the default."""
+  metric = baseline.get('metrics', {}).get(name, {})
+  if 'threshold' in metric:
+    return metric['threshold']
+  thresholds = baseline.get('thresholds', {})
+  # Units as 'allocations/message' are matched by what they count.
+  for prefix, threshold in sorted(thresholds.get('units', {}).items()):
+    if units.split('/')[0] == prefix:
+      return threshold
+  return thresholds.get('default', 0.1)
+
+
+def Compare(results, baseline):
+  """Returns the regressions of |results|, as printable lines."""
+  regressions = []
+  for name in sorted(results):
+    entry = results[name]
+    metric = baseline.get('metrics', {}).get(name)
+    if metric is None:
+      print('  new     %s = %g %s' % (name, entry['median'], entry['units']))
+      continue
+    expected = metric['value']
+    value = entry['median']
+    threshold = GetThreshold(baseline, name, entry['units'])
+    if HigherIsBetter(entry['units']):
+      worse = value < expected * (1 - threshold)
+    else:
+      # Some results, as allocation counts, are expected to be 0.
+      worse = value > expected * (1 + threshold) and value > expected
+    change = (value - expected) / expected * 100 if expected else 0
+    line = '%s = %g %s (baseline %g, %+.1f%%, threshold %g%%)' % (
+        name, value, entry['units'], expected, change, threshold * 100)
+    if worse:
+      regressions.append(line)
+      print('  REGRESS %s' % line)
+    else:
+      print('  ok      %s' % line)
+  return regressions
+
+
+def UpdateBaseline(results, baseline, path):
+  metrics = baseline.setdefault('metrics', {})
+  for name, entry in results.items():
+    metric = metrics.setdefault(name, {})
+    metric['value'] = entry['median']
+    metric['units'] = entry['units']
+  with open(path, 'w') as f:
+    json.dump(baseline, f, indent=2, sort_keys=True)
+    f.write('\n')
+
+
+def main():
+  parser = optparse.OptionParser(usage='%prog [options]')
+  parser.add_option('--build-dir', default=os.path.join('out', 'Release'),
+                    help='Directory holding the perf suites')
+  parser.add_option('--baseline', default=DEFAULT_BASELINE,
+                    help='Baseline to compare against')
+  parser.add_option('--output', help='Where to write the JSON results')
+  parser.add_option('--repeat', type='int', default=5,
+                    help='Measured runs of each suite')
+  parser.add_option('--warmup', type='int', default=1,
+                    help='Runs of each suite before measuring')
+  parser.add_option('--cpu', type='int', default=None,
+                    help='Core to pin the suites to (Linux only)')
+  parser.add_option('--gtest-filter', dest='gtest_filter',
+                    help='Passed to the suites')
+  parser.add_option('--update-baseline', action='store_true',
+                    help='Write the results into the baseline')
+  options, _ = parser.parse_args()
+  if options.repeat < 1:
+    parser.error('--repeat must be at least 1')
+
+  results = RunAll(options)
+  if not results:
+    print('No results: are the perf suites built in %s?' % options.build_dir)
+    return 1
+
+  baseline = {}
+  if os.path.exists(options.baseline):
+    with open(options.baseline) as f:
+      baseline = json.load(f)
+
+  if options.output:
+    with open(options.output, 'w') as f:
+      json.dump({'results': results}, f, indent=2, sort_keys=True)
+      f.write('\n')
+
+  if options.update_baseline:
+    UpdateBaseline(results, baseline, options.baseline)
+    print('Baseline written to %s' % options.baseline)
+    return 0
+
+  print('Comparing against %s' % options.baseline)
+  regressions = Compare(results, baseline)
+  if regressions:
+    print('%d regressions' % len(regressions))
+    return 1
+  return 0
+
+
+if __name__ == '__main__':
+  sys.exit(main())
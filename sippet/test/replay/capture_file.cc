@@ -0,0 +1,253 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/test/replay/capture_file.h"
+
+#include <string>
+
+#include "base/files/file_util.h"
+#include "base/logging.h"
+#include "net/base/net_util.h"
+
+namespace sippet {
+
+namespace {
+
+const size_t kPcapHeaderSize = 24;
+const size_t kPcapRecordHeaderSize = 16;
+
+const uint32 kPcapMagicMicroseconds = 0xa1b2c3d4;
+const uint32 kPcapMagicNanoseconds = 0xa1b23c4d;
+
+// Link layer types, as in the pcap header.
+enum {
+  kLinkTypeNull = 0,
+  kLinkTypeEthernet = 1,
+  kLinkTypeRawBsd = 12,
+  kLinkTypeRaw = 101,
+  kLinkTypeLinuxSll = 113,
+  kLinkTypeIPv4 = 228,
+  kLinkTypeIPv6 = 229,
+  kLinkTypeLinuxSll2 = 276,
+};
+
+const uint16 kEtherTypeIPv4 = 0x0800;
+const uint16 kEtherTypeIPv6 = 0x86dd;
+const uint16 kEtherTypeVlan = 0x8100;
+
+const uint8 kIPProtocolTcp = 6;
+const uint8 kIPProtocolUdp = 17;
+
+uint16 ReadUint16(const char *data) {
+  return static_cast<uint16>((static_cast<uint8>(data[0]) << 8)
+      | static_cast<uint8>(data[1]));
+}
+
+uint32 ReadUint32(const char *data, bool swapped) {
+  const uint8 *bytes = reinterpret_cast<const uint8*>(data);
+  if (swapped) {
+    return (static_cast<uint32>(bytes[0]) << 24)
+        | (static_cast<uint32>(bytes[1]) << 16)
+        | (static_cast<uint32>(bytes[2]) << 8) | bytes[3];
+  }
+  return (static_cast<uint32>(bytes[3]) << 24)
+      | (static_cast<uint32>(bytes[2]) << 16)
+      | (static_cast<uint32>(bytes[1]) << 8) | bytes[0];
+}
+
+std::string ReadAddress(const char *data, size_t size) {
+  net::IPAddressNumber address(data, data + size);
+  return net::IPAddressToString(address);
+}
+
+// Strips the link layer header of |frame|, leaving the IP packet. Returns
+// false if the frame doesn't carry IP.
+bool StripLinkLayer(uint32 link_type, base::StringPiece *frame) {
+  uint16 ether_type;
+  switch (link_type) {
+    case kLinkTypeEthernet:
+      if (frame->size() < 14)
+        return false;
+      ether_type = ReadUint16(frame->data() + 12);
+      frame->remove_prefix(14);
+      while (ether_type == kEtherTypeVlan && frame->size() >= 4) {
+        ether_type = ReadUint16(frame->data() + 2);
+        frame->remove_prefix(4);
+      }
+      break;
+    case kLinkTypeLinuxSll:
+      if (frame->size() < 16)
+        return false;
+      ether_type = ReadUint16(frame->data() + 14);
+      frame->remove_prefix(16);
+      break;
+    case kLinkTypeLinuxSll2:
+      if (frame->size() < 20)
+        return false;
+      ether_type = ReadUint16(frame->data());
+      frame->remove_prefix(20);
+      break;
+    case kLinkTypeNull:
+      // The address family is in the byte order of the capturing host, and
+      // its IPv6 value differs among systems: the IP version tells instead.
+      if (frame->size() < 4)
+        return false;
+      frame->remove_prefix(4);
+      return true;
+    case kLinkTypeRaw:
+    case kLinkTypeRawBsd:
+    case kLinkTypeIPv4:
+    case kLinkTypeIPv6:
+      return true;
+    default:
+      return false;
+  }
+  return ether_type == kEtherTypeIPv4 || ether_type == kEtherTypeIPv6;
+}
+
+// Reads the transport payload of the IP |packet| into |record|. Returns
+// false if it's neither UDP nor TCP, is a fragment, or carries nothing.
+bool ReadIPPacket(const base::StringPiece &packet,
+                  MessageCapture::Record *record) {
+  if (packet.empty())
+    return false;
+  const char *data = packet.data();
+  int version = static_cast<uint8>(data[0]) >> 4;
+  uint8 protocol;
+  std::string source;
+  std::string destination;
+  base::StringPiece segment;
+  if (version == 4) {
+    if (packet.size() < 20)
+      return false;
+    size_t header_size = (static_cast<uint8>(data[0]) & 0x0f) * 4;
+    size_t total_size = ReadUint16(data + 2);
+    uint16 fragment = ReadUint16(data + 6);
+    if ((fragment & 0x3fff) != 0)
+      return false;  // More fragments, or not the first one
+    if (header_size < 20 || total_size < header_size
+        || total_size > packet.size())
+      return false;
+    protocol = static_cast<uint8>(data[9]);
+    source = ReadAddress(data + 12, net::kIPv4AddressSize);
+    destination = ReadAddress(data + 16, net::kIPv4AddressSize);
+    segment = base::StringPiece(data + header_size, total_size - header_size);
+  } else if (version == 6) {
+    if (packet.size() < 40)
+      return false;
+    size_t payload_size = ReadUint16(data + 4);
+    if (40 + payload_size > packet.size())
+      return false;
+    // Extension headers aren't followed.
+    protocol = static_cast<uint8>(data[6]);
+    source = ReadAddress(data + 8, net::kIPv6AddressSize);
+    destination = ReadAddress(data + 24, net::kIPv6AddressSize);
+    segment = base::StringPiece(data + 40, payload_size);
+  } else {
+    return false;
+  }
+
+  uint16 source_port;
+  uint16 destination_port;
+  Protocol::Type transport;
+  if (protocol == kIPProtocolUdp) {
+    if (segment.size() < 8)
+      return false;
+    source_port = ReadUint16(segment.data());
+    destination_port = ReadUint16(segment.data() + 2);
+    segment.remove_prefix(8);
+    transport = Protocol::UDP;
+  } else if (protocol == kIPProtocolTcp) {
+    if (segment.size() < 20)
+      return false;
+    source_port = ReadUint16(segment.data());
+    destination_port = ReadUint16(segment.data() + 2);
+    size_t header_size = (static_cast<uint8>(segment[12]) >> 4) * 4;
+    if (header_size < 20 || header_size > segment.size())
+      return false;
+    segment.remove_prefix(header_size);
+    transport = Protocol::TCP;
+  } else {
+    return false;
+  }
+  if (segment.empty())
+    return false;  // i.e. TCP acknowledgements
+
+  std::string payload;
+  segment.CopyToString(&payload);
+  record->direction = MessageCapture::INCOMING;
+  record->remote = EndPoint(source, source_port, transport);
+  record->local = EndPoint(destination, destination_port, transport);
+  record->bytes = base::RefCountedString::TakeString(&payload);
+  return true;
+}
+
+}  // namespace
+
+bool ParsePcap(const base::StringPiece &contents, CapturedPackets *packets) {
+  DCHECK(packets);
+  if (contents.size() < kPcapHeaderSize)
+    return false;
+  uint32 magic = ReadUint32(contents.data(), false);
+  bool swapped;
+  bool nanoseconds;
+  if (magic == kPcapMagicMicroseconds || magic == kPcapMagicNanoseconds) {
+    swapped = false;
+  } else {
+    magic = ReadUint32(contents.data(), true);
+    if (magic != kPcapMagicMicroseconds && magic != kPcapMagicNanoseconds)
+      return false;
+    swapped = true;
+  }
+  nanoseconds = magic == kPcapMagicNanoseconds;
+  uint32 link_type = ReadUint32(contents.data() + 20, swapped) & 0xffff;
+
+  base::StringPiece input(contents.substr(kPcapHeaderSize));
+  while (!input.empty()) {
+    if (input.size() < kPcapRecordHeaderSize)
+      return false;
+    uint32 seconds = ReadUint32(input.data(), swapped);
+    uint32 fraction = ReadUint32(input.data() + 4, swapped);
+    size_t captured_size = ReadUint32(input.data() + 8, swapped);
+    if (captured_size > input.size() - kPcapRecordHeaderSize)
+      return false;
+    base::StringPiece frame(input.data() + kPcapRecordHeaderSize,
+                            captured_size);
+    input.remove_prefix(kPcapRecordHeaderSize + captured_size);
+
+    MessageCapture::Record record;
+    if (!StripLinkLayer(link_type, &frame) || !ReadIPPacket(frame, &record))
+      continue;
+    record.time = base::Time::UnixEpoch()
+        + base::TimeDelta::FromSeconds(seconds)
+        + base::TimeDelta::FromMicroseconds(
+              nanoseconds ? fraction / 1000 : fraction);
+    packets->push_back(record);
+  }
+  return true;
+}
+
+bool ParseHep3(const base::StringPiece &contents, CapturedPackets *packets) {
+  DCHECK(packets);
+  base::StringPiece input(contents);
+  while (!input.empty()) {
+    MessageCapture::Record record;
+    if (!MessageCapture::DecodeHep3(&input, &record))
+      return false;
+    packets->push_back(record);
+  }
+  return true;
+}
+
+bool ReadCaptureFile(const base::FilePath &path, CapturedPackets *packets) {
+  std::string contents;
+  if (!base::ReadFileToString(path, &contents))
+    return false;
+  base::StringPiece input(contents);
+  if (input.starts_with("HEP3"))
+    return ParseHep3(input, packets);
+  return ParsePcap(input, packets);
+}
+
+} // namespace sippet
@@ -0,0 +1,38 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TEST_REPLAY_CAPTURE_FILE_H_
+#define SIPPET_TEST_REPLAY_CAPTURE_FILE_H_
+
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "base/strings/string_piece.h"
+#include "sippet/transport/message_capture.h"
+
+namespace sippet {
+
+// Captured packets are kept as |MessageCapture::Record|s, all |INCOMING|:
+// |remote| is the source of the packet and |local| its destination.
+typedef std::vector<MessageCapture::Record> CapturedPackets;
+
+// Appends the UDP and TCP payloads of a libpcap file to |packets|, in
+// capture order. Ethernet (optionally VLAN tagged), Linux cooked, BSD
+// loopback and raw IP links are read, over IPv4 and IPv6. TCP segments are
+// taken as they come, without reassembly, and IP fragments are skipped.
+// Returns false if |contents| isn't a pcap file, or is truncated; packets
+// read until then are kept.
+bool ParsePcap(const base::StringPiece &contents, CapturedPackets *packets);
+
+// Appends the packets of a file of HEPv3 packets, as written by
+// |MessageCapture|, to |packets|. Returns false if |contents| holds
+// anything else, keeping the packets read until then.
+bool ParseHep3(const base::StringPiece &contents, CapturedPackets *packets);
+
+// Reads the capture at |path|, in any of the formats above.
+bool ReadCaptureFile(const base::FilePath &path, CapturedPackets *packets);
+
+} // namespace sippet
+
+#endif // SIPPET_TEST_REPLAY_CAPTURE_FILE_H_
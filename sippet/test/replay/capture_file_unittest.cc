@@ -0,0 +1,173 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/test/replay/capture_file.h"
+
+#include <string>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const char kOptions[] =
+  "OPTIONS sip:bob@biloxi.com SIP/2.0\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n";
+
+void AppendUint16(uint16 value, std::string *output) {
+  output->push_back(static_cast<char>(value >> 8));
+  output->push_back(static_cast<char>(value));
+}
+
+// Appends |value| in the byte order of the capturing host: little endian,
+// unless |big_endian|.
+void AppendUint32(uint32 value, bool big_endian, std::string *output) {
+  for (int i = 0; i < 4; ++i) {
+    int shift = big_endian ? 24 - 8 * i : 8 * i;
+    output->push_back(static_cast<char>(value >> shift));
+  }
+}
+
+std::string PcapHeader(uint32 link_type, bool big_endian) {
+  std::string header;
+  AppendUint32(0xa1b2c3d4, big_endian, &header);
+  AppendUint16(big_endian ? 2 : 0x0200, &header);  // Version 2.4
+  AppendUint16(big_endian ? 4 : 0x0400, &header);
+  AppendUint32(0, big_endian, &header);
+  AppendUint32(0, big_endian, &header);
+  AppendUint32(65535, big_endian, &header);
+  AppendUint32(link_type, big_endian, &header);
+  return header;
+}
+
+void AppendPcapRecord(uint32 seconds, uint32 microseconds,
+                      const std::string &frame, bool big_endian,
+                      std::string *output) {
+  AppendUint32(seconds, big_endian, output);
+  AppendUint32(microseconds, big_endian, output);
+  AppendUint32(frame.size(), big_endian, output);
+  AppendUint32(frame.size(), big_endian, output);
+  output->append(frame);
+}
+
+// An IPv4 packet from 10.0.0.1 to 10.0.0.2 carrying |segment|.
+std::string IPv4Packet(uint8 protocol, const std::string &segment) {
+  std::string packet;
+  packet.push_back(0x45);
+  packet.push_back(0);
+  AppendUint16(20 + segment.size(), &packet);
+  AppendUint16(0, &packet);  // Identification
+  AppendUint16(0x4000, &packet);  // Don't fragment
+  packet.push_back(64);
+  packet.push_back(protocol);
+  AppendUint16(0, &packet);  // Checksum, not verified
+  packet.append("\x0a\x00\x00\x01\x0a\x00\x00\x02", 8);
+  packet.append(segment);
+  return packet;
+}
+
+std::string UdpSegment(uint16 source_port, uint16 destination_port,
+                       const std::string &payload) {
+  std::string segment;
+  AppendUint16(source_port, &segment);
+  AppendUint16(destination_port, &segment);
+  AppendUint16(8 + payload.size(), &segment);
+  AppendUint16(0, &segment);
+  segment.append(payload);
+  return segment;
+}
+
+std::string TcpSegment(uint16 source_port, uint16 destination_port,
+                       const std::string &payload) {
+  std::string segment;
+  AppendUint16(source_port, &segment);
+  AppendUint16(destination_port, &segment);
+  segment.append(8, 0);  // Sequence and acknowledgement numbers
+  segment.push_back(0x50);  // 20 bytes header
+  segment.push_back(0x18);  // PSH, ACK
+  segment.append(6, 0);
+  segment.append(payload);
+  return segment;
+}
+
+std::string EthernetFrame(uint16 ether_type, const std::string &packet) {
+  std::string frame(12, 0);
+  AppendUint16(ether_type, &frame);
+  frame.append(packet);
+  return frame;
+}
+
+}  // namespace
+
+TEST(CaptureFileTest, ParsePcapEthernet) {
+  std::string contents(PcapHeader(1, false));
+  AppendPcapRecord(10, 500, EthernetFrame(0x0800,
+      IPv4Packet(17, UdpSegment(5070, 5060, kOptions))), false, &contents);
+  // ARP, and a TCP acknowledgement without any data.
+  AppendPcapRecord(11, 0, EthernetFrame(0x0806, std::string(28, 0)), false,
+                   &contents);
+  AppendPcapRecord(11, 0, EthernetFrame(0x0800,
+      IPv4Packet(6, TcpSegment(5080, 5060, ""))), false, &contents);
+  AppendPcapRecord(12, 0, EthernetFrame(0x0800,
+      IPv4Packet(6, TcpSegment(5080, 5060, kOptions))), false, &contents);
+
+  CapturedPackets packets;
+  ASSERT_TRUE(ParsePcap(contents, &packets));
+  ASSERT_EQ(2u, packets.size());
+  EXPECT_EQ(EndPoint("10.0.0.1", 5070, Protocol::UDP), packets[0].remote);
+  EXPECT_EQ(EndPoint("10.0.0.2", 5060, Protocol::UDP), packets[0].local);
+  EXPECT_EQ(base::Time::UnixEpoch()
+      + base::TimeDelta::FromMicroseconds(10000500), packets[0].time);
+  EXPECT_EQ(kOptions, packets[0].bytes->data());
+  EXPECT_EQ(EndPoint("10.0.0.1", 5080, Protocol::TCP), packets[1].remote);
+  EXPECT_EQ(kOptions, packets[1].bytes->data());
+}
+
+TEST(CaptureFileTest, ParsePcapBigEndianRawIP) {
+  std::string contents(PcapHeader(101, true));
+  AppendPcapRecord(1, 0, IPv4Packet(17, UdpSegment(5060, 5060, kOptions)),
+                   true, &contents);
+
+  CapturedPackets packets;
+  ASSERT_TRUE(ParsePcap(contents, &packets));
+  ASSERT_EQ(1u, packets.size());
+  EXPECT_EQ(kOptions, packets[0].bytes->data());
+}
+
+TEST(CaptureFileTest, ParsePcapTruncated) {
+  std::string contents(PcapHeader(1, false));
+  AppendPcapRecord(10, 0, EthernetFrame(0x0800,
+      IPv4Packet(17, UdpSegment(5070, 5060, kOptions))), false, &contents);
+  AppendPcapRecord(11, 0, EthernetFrame(0x0800,
+      IPv4Packet(17, UdpSegment(5070, 5060, kOptions))), false, &contents);
+  contents.resize(contents.size() - 10);
+
+  CapturedPackets packets;
+  EXPECT_FALSE(ParsePcap(contents, &packets));
+  EXPECT_EQ(1u, packets.size());
+  EXPECT_FALSE(ParsePcap("not a capture file", &packets));
+}
+
+TEST(CaptureFileTest, ParseHep3) {
+  MessageCapture::Record record;
+  record.direction = MessageCapture::OUTGOING;
+  record.local = EndPoint("192.168.0.1", 5060, Protocol::UDP);
+  record.remote = EndPoint("10.0.0.2", 5070, Protocol::UDP);
+  std::string payload(kOptions);
+  record.bytes = base::RefCountedString::TakeString(&payload);
+  std::string contents;
+  MessageCapture::EncodeHep3(record, &contents);
+  MessageCapture::EncodeHep3(record, &contents);
+
+  CapturedPackets packets;
+  ASSERT_TRUE(ParseHep3(contents, &packets));
+  ASSERT_EQ(2u, packets.size());
+  EXPECT_EQ(record.local, packets[1].remote);
+  EXPECT_EQ(kOptions, packets[1].bytes->data());
+  EXPECT_FALSE(ParseHep3("HEP3 but not really", &packets));
+}
+
+} // namespace sippet
@@ -0,0 +1,470 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Replays a capture of SIP traffic through the transport layer, in a single
+// process and without sockets: the captured payloads are framed by a
+// |MessageReader| and handed to |NetworkLayer::OnIncomingMessage| through
+// fake channels, one per source address, as the transports would do. It
+// gives a realistic corpus for the parser and the transaction layer, drawn
+// from production traffic, and flags the messages that couldn't be parsed.
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "base/at_exit.h"
+#include "base/bind.h"
+#include "base/command_line.h"
+#include "base/containers/hash_tables.h"
+#include "base/files/file_path.h"
+#include "base/i18n/icu_util.h"
+#include "base/logging.h"
+#include "base/message_loop/message_loop.h"
+#include "base/run_loop.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/time/time.h"
+#include "net/base/net_errors.h"
+#include "sippet/message/message.h"
+#include "sippet/message/request.h"
+#include "sippet/message/response.h"
+#include "sippet/message/status_code.h"
+#include "sippet/test/allocation_counter.h"
+#include "sippet/test/replay/capture_file.h"
+#include "sippet/transport/channel.h"
+#include "sippet/transport/channel_listener.h"
+#include "sippet/transport/chrome/message_reader.h"
+#include "sippet/transport/network_layer.h"
+#include "sippet/transport/transport_stats.h"
+
+namespace sippet {
+
+namespace {
+
+// Same as the Chrome transports.
+const size_t kMaxMessageSize = 64U * 1024U;
+
+// Parse failures printed in full; the others are only counted.
+const int kMaxReportedFailures = 20;
+
+// Feeds captured payloads to the framing and parsing of |MessageReader|,
+// as a socket would: a datagram replaces whatever was left of the previous
+// one, and stream segments are appended. Either completes a pending read.
+class ReplayReader : public MessageReader {
+ public:
+  explicit ReplayReader(bool is_stream)
+    : is_stream_(is_stream), offset_(0) {}
+  ~ReplayReader() override {}
+
+  void Receive(const std::string &payload) {
+    if (is_stream_) {
+      buffer_.append(payload);
+    } else {
+      buffer_ = payload;
+      offset_ = 0;
+      DidDiscardData();
+    }
+    if (!callback_.is_null()) {
+      net::CompletionCallback callback(callback_);
+      callback_.Reset();
+      callback.Run(static_cast<int>(payload.size()));
+    }
+  }
+
+ protected:
+  int DoIORead(const net::CompletionCallback& callback) override {
+    // Nothing more comes in the same datagram, as in |ChromeDatagramReader|.
+    if (!is_stream_ && (HasMessage() || BytesRemaining() > 0))
+      return net::ERR_INVALID_RESPONSE;
+    buffer_.erase(0, offset_);
+    offset_ = 0;
+    callback_ = callback;
+    return net::ERR_IO_PENDING;
+  }
+
+  char *data() override { return &buffer_[0] + offset_; }
+  size_t max_size() override { return kMaxMessageSize; }
+  int BytesRemaining() const override {
+    return static_cast<int>(buffer_.size() - offset_);
+  }
+  void DidConsume(int bytes) override { offset_ += bytes; }
+
+ private:
+  bool is_stream_;
+  std::string buffer_;
+  size_t offset_;
+  net::CompletionCallback callback_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReplayReader);
+};
+
+// A channel accepted from each captured source. Messages sent through it
+// are serialized, as by the transports, and dropped.
+class ReplayChannel : public Channel {
+ public:
+  ReplayChannel(const EndPoint &origin,
+                const EndPoint &destination,
+                Channel::Delegate *delegate)
+    : origin_(origin),
+      destination_(destination),
+      delegate_(delegate),
+      closed_(false) {
+    ResetReader();
+  }
+
+  ReplayReader *reader() { return reader_.get(); }
+
+  // Replaces the reader, once its framing is lost.
+  void ResetReader() {
+    reader_.reset(new ReplayReader(is_stream()));
+    // Datagram retransmissions are absorbed before parsing, as in
+    // |ChromeDatagramListener|.
+    if (!is_stream()) {
+      reader_->set_head_filter(
+          base::Bind(&Channel::Delegate::AbsorbRetransmission,
+                     base::Unretained(delegate_)));
+    }
+  }
+
+  // sippet::Channel methods:
+  int origin(EndPoint *origin) const override {
+    *origin = origin_;
+    return net::OK;
+  }
+  const EndPoint& destination() const override { return destination_; }
+  bool is_secure() const override { return false; }
+  bool is_connected() const override { return !closed_; }
+  bool is_stream() const override {
+    return Protocol::UDP != destination_.protocol();
+  }
+  void Connect() override { NOTREACHED(); }
+  int ReconnectIgnoringLastError() override {
+    return net::ERR_NOT_IMPLEMENTED;
+  }
+  int ReconnectWithCertificate(net::X509Certificate* client_cert) override {
+    return net::ERR_NOT_IMPLEMENTED;
+  }
+  int Send(const scoped_refptr<Message> &message,
+           const net::CompletionCallback& callback) override {
+    message->SerializedWire();
+    if (delegate_)
+      delegate_->OnOutgoingMessage(this, message);
+    return net::OK;
+  }
+  void Close() override { closed_ = true; }
+  void CloseWithError(int err) override { closed_ = true; }
+  void DetachDelegate() override { delegate_ = nullptr; }
+
+ private:
+  friend class base::RefCountedThreadSafe<ReplayChannel>;
+  ~ReplayChannel() override {}
+
+  EndPoint origin_;
+  EndPoint destination_;
+  Channel::Delegate *delegate_;
+  bool closed_;
+  scoped_ptr<ReplayReader> reader_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReplayChannel);
+};
+
+struct Options {
+  base::FilePath capture;
+  // Replay speed relative to the capture; zero replays as fast as possible.
+  double speed;
+  // Status code of the response sent to each incoming request, other than
+  // ACK; zero leaves the requests unanswered.
+  int respond;
+};
+
+class Replayer : public NetworkLayer::Delegate {
+ public:
+  Replayer(const Options &options, const CapturedPackets &packets)
+    : options_(options),
+      packets_(packets),
+      next_(0),
+      current_index_(0),
+      messages_(0),
+      bytes_(0),
+      parse_failures_(0),
+      requests_(0),
+      responses_(0),
+      timeouts_(0),
+      transport_errors_(0),
+      allocations_(0) {
+    network_layer_.reset(new NetworkLayer(this));
+  }
+
+  ~Replayer() override {
+    // Transactions still running are destroyed along with the channels.
+    network_layer_.reset();
+  }
+
+  void Run() {
+    TransportStats::GetSnapshot(&initial_stats_);
+    start_ = base::TimeTicks::Now();
+    base::RunLoop run_loop;
+    quit_closure_ = run_loop.QuitClosure();
+    FeedNext();
+    run_loop.Run();
+    elapsed_ = base::TimeTicks::Now() - start_;
+  }
+
+  void Report() const {
+    TransportStats::Snapshot stats;
+    TransportStats::GetSnapshot(&stats);
+    double seconds = elapsed_.InSecondsF();
+    std::cout << "packets: " << packets_.size()
+              << ", bytes: " << bytes_ << "\n"
+              << "messages: " << messages_
+              << ", parse failures: " << parse_failures_ << "\n"
+              << "delivered requests: " << requests_
+              << ", responses: " << responses_
+              << ", timeouts: " << timeouts_
+              << ", transport errors: " << transport_errors_ << "\n"
+              << "retransmissions absorbed: "
+              << stats.counters[TransportStats::RETRANSMISSIONS_ABSORBED]
+                 - initial_stats_.counters[
+                     TransportStats::RETRANSMISSIONS_ABSORBED] << "\n"
+              << "elapsed: " << elapsed_.InMillisecondsF() << " ms";
+    if (!packets_.empty()) {
+      base::TimeDelta captured =
+          packets_.back().time - packets_.front().time;
+      std::cout << " (captured: " << captured.InMillisecondsF() << " ms)";
+    }
+    std::cout << "\n";
+    if (seconds > 0) {
+      std::cout << "throughput: " << messages_ / seconds << " messages/s, "
+                << bytes_ / seconds / (1024 * 1024) << " MiB/s\n";
+    }
+    if (messages_ > 0) {
+      std::cout << "allocations: "
+                << static_cast<double>(allocations_) / messages_
+                << " per message, from framing to the delegate\n";
+    }
+  }
+
+  bool has_parse_failures() const { return parse_failures_ > 0; }
+
+  // NetworkLayer::Delegate methods:
+  void OnChannelConnected(const EndPoint &destination, int err) override {}
+  void OnChannelClosed(const EndPoint &destination) override {}
+  void OnIncomingRequest(const scoped_refptr<Request> &request) override {
+    ++requests_;
+    if (!options_.respond || Method::ACK == request->method())
+      return;
+    network_layer_->Send(
+        request->CreateResponse(static_cast<StatusCode>(options_.respond)),
+        net::CompletionCallback());
+  }
+  void OnIncomingResponse(const scoped_refptr<Response> &response) override {
+    ++responses_;
+  }
+  void OnTimedOut(const scoped_refptr<Request> &request) override {
+    ++timeouts_;
+  }
+  void OnTransportError(const scoped_refptr<Request> &request,
+                        int error) override {
+    ++transport_errors_;
+  }
+
+ private:
+  typedef base::hash_map<std::string, scoped_refptr<ReplayChannel> >
+      ChannelsMap;
+
+  // Feeds the packets due, then waits for the next one.
+  void FeedNext() {
+    while (next_ < packets_.size()) {
+      if (options_.speed > 0) {
+        base::TimeDelta offset = packets_[next_].time - packets_[0].time;
+        base::TimeTicks due = start_ + base::TimeDelta::FromMicroseconds(
+            static_cast<int64>(offset.InMicroseconds() / options_.speed));
+        base::TimeTicks now = base::TimeTicks::Now();
+        if (due > now) {
+          base::MessageLoop::current()->PostDelayedTask(FROM_HERE,
+              base::Bind(&Replayer::FeedNext, base::Unretained(this)),
+              due - now);
+          return;
+        }
+      }
+      Feed(next_++);
+    }
+    quit_closure_.Run();
+  }
+
+  void Feed(size_t index) {
+    const MessageCapture::Record &packet = packets_[index];
+    const std::string &payload = packet.bytes->data();
+    bytes_ += payload.size();
+    ReplayChannel *channel = GetChannel(packet);
+    ScopedAllocationCounter counter;
+    int messages = messages_;
+    current_index_ = index;
+    // A read is left pending once the reader needs more data; it completes
+    // on receiving.
+    bool idle = channel->reader()->is_idle();
+    channel->reader()->Receive(payload);
+    if (idle)
+      Read(channel);
+    if (messages_ > messages)
+      allocations_ += counter.allocations();
+  }
+
+  // Reads from |channel| until more data is needed.
+  void Read(ReplayChannel *channel) {
+    for (;;) {
+      int result = channel->reader()->Read(
+          base::Bind(&Replayer::OnReadComplete, base::Unretained(this),
+                     base::Unretained(channel)));
+      if (net::ERR_IO_PENDING == result)
+        return;
+      if (!HandleRead(channel, result))
+        return;
+    }
+  }
+
+  // Pending reads are owned by the reader of |channel|.
+  void OnReadComplete(ReplayChannel *channel, int result) {
+    if (HandleRead(channel, result))
+      Read(channel);
+  }
+
+  // Dispatches the messages read from |channel|. Returns false if the
+  // packet being read couldn't be parsed.
+  bool HandleRead(ReplayChannel *channel, int result) {
+    std::vector<scoped_refptr<Message> > messages;
+    if (net::OK == result) {
+      messages.push_back(channel->reader()->GetIncomingMessage());
+      result = channel->reader()->ReadBuffered(&messages);
+    }
+    for (size_t i = 0; i < messages.size(); ++i)
+      Dispatch(channel, messages[i]);
+    if (net::OK == result)
+      return true;
+    // Either a truncated message, or one that couldn't be parsed. The rest
+    // of a stream can't be framed anymore: start over with the next
+    // segment, as a reconnection would.
+    ReportFailure(current_index_, packets_[current_index_].bytes->data());
+    channel->ResetReader();
+    return false;
+  }
+
+  void Dispatch(ReplayChannel *channel,
+                const scoped_refptr<Message> &message) {
+    ++messages_;
+    Channel::Delegate *channel_delegate = network_layer_.get();
+    channel_delegate->OnIncomingMessage(channel, message);
+  }
+
+  void ReportFailure(size_t index, const std::string &payload) {
+    if (++parse_failures_ > kMaxReportedFailures)
+      return;
+    const MessageCapture::Record &packet = packets_[index];
+    std::string first_line(payload.substr(0, payload.find_first_of("\r\n")));
+    if (first_line.size() > 72)
+      first_line.resize(72);
+    std::cout << "packet #" << index << " from "
+              << packet.remote.ToString() << " failed to parse: "
+              << first_line << "\n";
+  }
+
+  // Returns the channel of the source of |packet|, accepting a new one if
+  // there's none, or the previous one was closed.
+  ReplayChannel *GetChannel(const MessageCapture::Record &packet) {
+    std::string key(packet.remote.ToString());
+    scoped_refptr<ReplayChannel> &channel = channels_[key];
+    if (!channel.get() || !channel->is_connected()) {
+      channel = new ReplayChannel(packet.local, packet.remote,
+                                  network_layer_.get());
+      ChannelListener::Delegate *listener_delegate = network_layer_.get();
+      listener_delegate->OnChannelAccepted(channel.get());
+    }
+    return channel.get();
+  }
+
+  Options options_;
+  const CapturedPackets &packets_;
+  size_t next_;
+  scoped_ptr<NetworkLayer> network_layer_;
+  ChannelsMap channels_;
+  base::Closure quit_closure_;
+  base::TimeTicks start_;
+  base::TimeDelta elapsed_;
+  TransportStats::Snapshot initial_stats_;
+
+  // Packet being read.
+  size_t current_index_;
+
+  int messages_;
+  int64 bytes_;
+  int parse_failures_;
+  int requests_;
+  int responses_;
+  int timeouts_;
+  int transport_errors_;
+  int64 allocations_;
+
+  DISALLOW_COPY_AND_ASSIGN(Replayer);
+};
+
+void PrintUsage() {
+  std::cout << "sippet_replay --capture=file.pcap|file.hep"
+            << " [--speed=0] [--respond=0]\n"
+            << "    --speed: relative to the capture timing; 0 replays as"
+            << " fast as possible\n"
+            << "    --respond: status code answered to each request;"
+            << " 0 doesn't answer\n";
+}
+
+}  // namespace
+
+}  // namespace sippet
+
+int main(int argc, char **argv) {
+  base::AtExitManager at_exit_manager;
+  if (!base::i18n::InitializeICU()) {
+    std::cerr << "Couldn't open ICU library, exiting...\n";
+    return -1;
+  }
+  base::CommandLine::Init(argc, argv);
+  base::CommandLine* command_line = base::CommandLine::ForCurrentProcess();
+  if (command_line->HasSwitch("help") || !command_line->HasSwitch("capture")) {
+    sippet::PrintUsage();
+    return -1;
+  }
+
+  sippet::Options options;
+  options.capture = command_line->GetSwitchValuePath("capture");
+  options.speed = 0;
+  options.respond = 0;
+  if ((command_line->HasSwitch("speed")
+          && (!base::StringToDouble(
+                  command_line->GetSwitchValueASCII("speed"), &options.speed)
+              || options.speed < 0))
+      || (command_line->HasSwitch("respond")
+          && (!base::StringToInt(
+                  command_line->GetSwitchValueASCII("respond"),
+                  &options.respond)
+              || (options.respond && (options.respond < 100
+                                      || options.respond > 699))))) {
+    sippet::PrintUsage();
+    return -1;
+  }
+
+  // Unmatched responses and sent messages are logged by the network layer.
+  logging::SetMinLogLevel(logging::LOG_ERROR);
+
+  sippet::CapturedPackets packets;
+  if (!sippet::ReadCaptureFile(options.capture, &packets)) {
+    std::cerr << "Couldn't read " << options.capture.AsUTF8Unsafe()
+              << (packets.empty() ? "\n" : ", replaying what was read\n");
+    if (packets.empty())
+      return -1;
+  }
+
+  base::MessageLoopForIO message_loop;
+  sippet::Replayer replayer(options, packets);
+  replayer.Run();
+  replayer.Report();
+  return replayer.has_parse_failures() ? 1 : 0;
+}
@@ -0,0 +1,401 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/test/simulation/simulated_network.h"
+
+#include <algorithm>
+
+#include "base/bind.h"
+#include "base/logging.h"
+#include "base/memory/weak_ptr.h"
+#include "base/message_loop/message_loop.h"
+#include "base/run_loop.h"
+#include "net/base/net_errors.h"
+#include "sippet/message/message.h"
+#include "sippet/transport/network_layer.h"
+#include "sippet/transport/network_settings.h"
+#include "sippet/transport/timer_wheel.h"
+
+namespace sippet {
+
+// A datagram channel between two nodes. Sends complete at once; the model
+// only delays or drops what was sent, as the network past a socket would.
+class SimulatedChannel : public Channel {
+ public:
+  SimulatedChannel(SimulatedNetwork::Node *node,
+                   const EndPoint &destination,
+                   Channel::Delegate *delegate,
+                   bool accepted);
+
+  Channel::Delegate *delegate() const { return delegate_; }
+
+  // Called by the node when it's gone.
+  void Orphan() {
+    node_ = nullptr;
+    is_connected_ = false;
+  }
+
+  // sippet::Channel methods:
+  int origin(EndPoint *origin) const override;
+  const EndPoint& destination() const override;
+  bool is_secure() const override;
+  bool is_connected() const override;
+  bool is_stream() const override;
+  void Connect() override;
+  int ReconnectIgnoringLastError() override;
+  int ReconnectWithCertificate(net::X509Certificate* client_cert) override;
+  int Send(const scoped_refptr<Message> &message,
+           const net::CompletionCallback& callback) override;
+  void Close() override;
+  void CloseWithError(int err) override;
+  void DetachDelegate() override;
+
+ private:
+  friend class base::RefCountedThreadSafe<Channel>;
+  ~SimulatedChannel() override;
+
+  void RunUserConnectCallback();
+
+  SimulatedNetwork::Node *node_;
+  EndPoint destination_;
+  Channel::Delegate *delegate_;
+  bool is_connected_;
+  base::WeakPtrFactory<SimulatedChannel> weak_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(SimulatedChannel);
+};
+
+// A network layer on the network: it creates the channels to the other
+// nodes, and accepts the channels of the nodes reaching it.
+class SimulatedNetwork::Node : public ChannelFactory,
+                               public ChannelListener {
+ public:
+  Node(SimulatedNetwork *network, const EndPoint &address)
+    : network_(network),
+      address_(address),
+      listener_delegate_(nullptr),
+      channel_delegate_(nullptr) {
+  }
+
+  ~Node() override {
+    for (ChannelMap::iterator i = channels_.begin(), ie = channels_.end();
+         i != ie; ++i)
+      i->second->Orphan();
+  }
+
+  SimulatedNetwork *network() const { return network_; }
+  const EndPoint &address() const { return address_; }
+
+  // When the last message sent by the node leaves it.
+  base::TimeTicks busy_until() const { return busy_until_; }
+  void set_busy_until(const base::TimeTicks &busy_until) {
+    busy_until_ = busy_until;
+  }
+
+  void RemoveChannel(SimulatedChannel *channel) {
+    ChannelMap::iterator i = channels_.find(channel->destination().ToString());
+    if (channels_.end() != i && channel == i->second)
+      channels_.erase(i);
+  }
+
+  // Returns false if nothing took |data|.
+  bool Deliver(const std::string &from, const std::string &data) {
+    ChannelMap::iterator i = channels_.find(from);
+    scoped_refptr<SimulatedChannel> channel;
+    if (channels_.end() != i) {
+      channel = i->second;
+    } else {
+      if (!listener_delegate_)
+        return false;
+      channel = new SimulatedChannel(this, EndPoint::FromString(from),
+                                     channel_delegate_, true);
+      channels_[from] = channel.get();
+      listener_delegate_->OnChannelAccepted(channel);
+    }
+    scoped_refptr<Message> message(Message::Parse(data));
+    if (!message || !channel->delegate())
+      return false;
+    channel->delegate()->OnIncomingMessage(channel, message);
+    return true;
+  }
+
+  // sippet::ChannelFactory methods:
+  int CreateChannel(const EndPoint &destination,
+                    Channel::Delegate *delegate,
+                    scoped_refptr<Channel> *channel) override {
+    std::string key(destination.ToString());
+    if (channels_.count(key))
+      return net::ERR_ADDRESS_IN_USE;
+    SimulatedChannel *created =
+        new SimulatedChannel(this, destination, delegate, false);
+    channels_[key] = created;
+    *channel = created;
+    return net::OK;
+  }
+
+  // sippet::ChannelListener methods:
+  int Listen(ChannelListener::Delegate *delegate,
+             Channel::Delegate *channel_delegate) override {
+    DCHECK(delegate);
+    DCHECK(channel_delegate);
+    if (listener_delegate_)
+      return net::ERR_ADDRESS_IN_USE;
+    listener_delegate_ = delegate;
+    channel_delegate_ = channel_delegate;
+    return net::OK;
+  }
+
+  int GetLocalEndPoint(EndPoint *local_end_point) const override {
+    if (!listener_delegate_)
+      return net::ERR_SOCKET_NOT_CONNECTED;
+    *local_end_point = address_;
+    return net::OK;
+  }
+
+  void Close() override {
+    // The accepted channels are kept, as with other listeners.
+    listener_delegate_ = nullptr;
+    channel_delegate_ = nullptr;
+  }
+
+ private:
+  // The channels with the other nodes, keyed by their address.
+  typedef base::hash_map<std::string, SimulatedChannel*> ChannelMap;
+
+  SimulatedNetwork *network_;
+  EndPoint address_;
+  ChannelListener::Delegate *listener_delegate_;
+  Channel::Delegate *channel_delegate_;
+  ChannelMap channels_;
+  base::TimeTicks busy_until_;
+
+  DISALLOW_COPY_AND_ASSIGN(Node);
+};
+
+SimulatedChannel::SimulatedChannel(SimulatedNetwork::Node *node,
+                                   const EndPoint &destination,
+                                   Channel::Delegate *delegate,
+                                   bool accepted)
+  : node_(node),
+    destination_(destination),
+    delegate_(delegate),
+    is_connected_(accepted),
+    weak_factory_(this) {
+  DCHECK(node);
+  DCHECK(delegate);
+}
+
+SimulatedChannel::~SimulatedChannel() {
+  if (node_)
+    node_->RemoveChannel(this);
+}
+
+int SimulatedChannel::origin(EndPoint *origin) const {
+  if (!node_)
+    return net::ERR_SOCKET_NOT_CONNECTED;
+  *origin = node_->address();
+  return net::OK;
+}
+
+const EndPoint& SimulatedChannel::destination() const {
+  return destination_;
+}
+
+bool SimulatedChannel::is_secure() const {
+  return false;
+}
+
+bool SimulatedChannel::is_connected() const {
+  return is_connected_;
+}
+
+bool SimulatedChannel::is_stream() const {
+  return false;
+}
+
+void SimulatedChannel::Connect() {
+  DCHECK(!is_connected_);
+  is_connected_ = nullptr != node_;
+  base::MessageLoop::current()->PostTask(FROM_HERE,
+      base::Bind(&SimulatedChannel::RunUserConnectCallback,
+                 weak_factory_.GetWeakPtr()));
+}
+
+int SimulatedChannel::ReconnectIgnoringLastError() {
+  return net::ERR_NOT_IMPLEMENTED;
+}
+
+int SimulatedChannel::ReconnectWithCertificate(
+    net::X509Certificate* client_cert) {
+  return net::ERR_NOT_IMPLEMENTED;
+}
+
+int SimulatedChannel::Send(const scoped_refptr<Message> &message,
+                           const net::CompletionCallback& callback) {
+  if (!is_connected_)
+    return net::ERR_SOCKET_NOT_CONNECTED;
+  if (delegate_)
+    delegate_->OnOutgoingMessage(this, message);
+  node_->network()->Transmit(node_->address(), destination_, message);
+  return net::OK;
+}
+
+void SimulatedChannel::Close() {
+  is_connected_ = false;
+  if (node_)
+    node_->RemoveChannel(this);
+  node_ = nullptr;
+}
+
+void SimulatedChannel::CloseWithError(int err) {
+  // Sends complete synchronously, there's nothing pending.
+  Close();
+}
+
+void SimulatedChannel::DetachDelegate() {
+  delegate_ = nullptr;
+  Close();
+}
+
+void SimulatedChannel::RunUserConnectCallback() {
+  if (delegate_) {
+    delegate_->OnChannelConnected(this,
+        is_connected_ ? net::OK : net::ERR_SOCKET_NOT_CONNECTED);
+  }
+}
+
+SimulatedNetwork::LinkModel::LinkModel()
+  : loss_rate(0),
+    bandwidth(0) {
+}
+
+SimulatedNetwork::Stats::Stats()
+  : sent(0),
+    lost(0),
+    delivered(0),
+    bytes_sent(0) {
+}
+
+SimulatedNetwork::Delivery::Delivery()
+  : sequence(0) {
+}
+
+SimulatedNetwork::Delivery::~Delivery() {
+}
+
+SimulatedNetwork::SimulatedNetwork(uint32 seed)
+  : random_state_(seed),
+    next_sequence_(0) {
+  // Virtual time doesn't start at zero, as real time doesn't.
+  clock_.Advance(base::TimeDelta::FromSeconds(1));
+}
+
+SimulatedNetwork::~SimulatedNetwork() {
+  while (!deliveries_.empty()) {
+    delete deliveries_.top();
+    deliveries_.pop();
+  }
+}
+
+void SimulatedNetwork::ApplyTo(NetworkSettings *settings) {
+  settings->set_tick_clock(&clock_);
+}
+
+void SimulatedNetwork::AddNode(const EndPoint &address,
+                               NetworkLayer *network_layer) {
+  std::string key(address.ToString());
+  DCHECK(!nodes_by_address_.count(key)) << key << " is taken";
+  Node *node = new Node(this, address);
+  nodes_.push_back(node);
+  nodes_by_address_[key] = node;
+  network_layer->RegisterChannelFactory(address.protocol(), node);
+  int rv = network_layer->AddChannelListener(node);
+  DCHECK_EQ(net::OK, rv);
+  AddTimerWheel(network_layer->timer_wheel());
+}
+
+void SimulatedNetwork::AddTimerWheel(TimerWheel *timer_wheel) {
+  DCHECK(timer_wheel);
+  timer_wheels_.push_back(timer_wheel);
+}
+
+void SimulatedNetwork::RunFor(const base::TimeDelta &duration) {
+  base::TimeTicks end = clock_.NowTicks() + duration;
+  base::TimeDelta step =
+      base::TimeDelta::FromMilliseconds(TimerWheel::kDefaultResolutionMs);
+  RunPendingTasks();
+  while (clock_.NowTicks() < end) {
+    base::TimeTicks next = std::min(end, clock_.NowTicks() + step);
+    if (!deliveries_.empty())
+      next = std::min(next, deliveries_.top()->time);
+    clock_.Advance(std::max(next - clock_.NowTicks(), base::TimeDelta()));
+    DeliverDue();
+    for (size_t i = 0; i < timer_wheels_.size(); ++i)
+      timer_wheels_[i]->FireExpiredTimers();
+    RunPendingTasks();
+  }
+}
+
+void SimulatedNetwork::Transmit(const EndPoint &from, const EndPoint &to,
+                                const scoped_refptr<Message> &message) {
+  NodeMap::iterator i = nodes_by_address_.find(from.ToString());
+  DCHECK(nodes_by_address_.end() != i);
+  Node *node = i->second;
+  std::string data(message->ToString());
+  ++stats_.sent;
+  stats_.bytes_sent += data.size();
+
+  // The message leaves once the previous ones are sent, even if lost.
+  base::TimeTicks departure = std::max(clock_.NowTicks(), node->busy_until());
+  if (link_model_.bandwidth > 0) {
+    departure += base::TimeDelta::FromMicroseconds(
+        static_cast<int64>(data.size()) * 8 *
+        base::Time::kMicrosecondsPerSecond / link_model_.bandwidth);
+  }
+  node->set_busy_until(departure);
+  if (NextRandom() < link_model_.loss_rate) {
+    ++stats_.lost;
+    return;
+  }
+
+  Delivery *delivery = new Delivery;
+  delivery->time = departure + link_model_.delay +
+      base::TimeDelta::FromMicroseconds(static_cast<int64>(
+          NextRandom() * link_model_.jitter.InMicroseconds()));
+  delivery->sequence = next_sequence_++;
+  delivery->from = from.ToString();
+  delivery->to = to.ToString();
+  delivery->data.swap(data);
+  deliveries_.push(delivery);
+}
+
+void SimulatedNetwork::DeliverDue() {
+  base::TimeTicks now = clock_.NowTicks();
+  while (!deliveries_.empty() && deliveries_.top()->time <= now) {
+    scoped_ptr<Delivery> delivery(deliveries_.top());
+    deliveries_.pop();
+    NodeMap::iterator i = nodes_by_address_.find(delivery->to);
+    if (nodes_by_address_.end() == i
+        || !i->second->Deliver(delivery->from, delivery->data)) {
+      // Nobody listening there, as a port unreachable.
+      ++stats_.lost;
+      continue;
+    }
+    ++stats_.delivered;
+  }
+}
+
+void SimulatedNetwork::RunPendingTasks() {
+  base::RunLoop().RunUntilIdle();
+}
+
+double SimulatedNetwork::NextRandom() {
+  // Knuth's MMIX generator; deterministic across platforms, unlike
+  // base::RandDouble.
+  random_state_ = random_state_ * GG_UINT64_C(6364136223846793005) +
+      GG_UINT64_C(1442695040888963407);
+  return (random_state_ >> 11) * (1.0 / (GG_UINT64_C(1) << 53));
+}
+
+} // End of sippet namespace
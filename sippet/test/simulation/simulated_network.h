@@ -0,0 +1,169 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TEST_SIMULATION_SIMULATED_NETWORK_H_
+#define SIPPET_TEST_SIMULATION_SIMULATED_NETWORK_H_
+
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "base/containers/hash_tables.h"
+#include "base/memory/scoped_vector.h"
+#include "base/test/simple_test_tick_clock.h"
+#include "base/time/time.h"
+#include "sippet/transport/channel.h"
+#include "sippet/transport/channel_factory.h"
+#include "sippet/transport/channel_listener.h"
+#include "sippet/transport/end_point.h"
+
+namespace sippet {
+
+class Message;
+class NetworkLayer;
+class NetworkSettings;
+class SimulatedChannel;
+class TimerWheel;
+
+// Runs network layers on a virtual clock, over datagram channels carried by
+// an in-memory network with a deterministic model of loss, delay and
+// bandwidth, so that scenarios taking minutes of timers (e.g. the 32s of
+// timers B and F) with many thousands of transactions run in seconds.
+//
+// Each network layer is a node of the network, at its own address: it
+// reaches the other nodes by their addresses, and accepts the channels of
+// the nodes reaching it. Messages are serialized when sent and parsed again
+// when delivered, as on a wire.
+//
+// Example usage:
+//   SimulatedNetwork network;
+//   SimulatedNetwork::LinkModel model;
+//   model.loss_rate = 0.1;
+//   network.set_link_model(model);
+//
+//   NetworkSettings settings;
+//   network.ApplyTo(&settings);
+//   NetworkLayer client(&client_delegate, settings);
+//   NetworkLayer server(&server_delegate, settings);
+//   network.AddNode(EndPoint("10.0.0.1", 5060, Protocol::UDP), &client);
+//   network.AddNode(EndPoint("10.0.0.2", 5060, Protocol::UDP), &server);
+//
+//   ... send requests from |client| to sip:10.0.0.2 ...
+//   network.RunFor(base::TimeDelta::FromSeconds(64));
+//
+// The network layers must be created on a thread running a message loop,
+// which the simulation runs between the steps of the clock, and must be
+// destroyed before the network.
+class SimulatedNetwork {
+ public:
+  // The model of every link; delays are one way.
+  struct LinkModel {
+    LinkModel();
+
+    // The probability of a message being dropped, in [0, 1].
+    double loss_rate;
+    base::TimeDelta delay;
+    // Added to |delay|, evenly distributed in [0, jitter]; messages may
+    // then be delivered out of order.
+    base::TimeDelta jitter;
+    // Bits per second sent by each node; its messages wait for the
+    // previous ones to be sent. Zero doesn't limit it.
+    int64 bandwidth;
+  };
+
+  struct Stats {
+    Stats();
+
+    int64 sent;
+    int64 lost;
+    int64 delivered;
+    int64 bytes_sent;
+  };
+
+  // The same |seed| gives the same losses and jitters.
+  explicit SimulatedNetwork(uint32 seed = 1);
+  ~SimulatedNetwork();
+
+  void set_link_model(const LinkModel &link_model) {
+    link_model_ = link_model;
+  }
+  const LinkModel &link_model() const { return link_model_; }
+
+  // The virtual clock; it only moves forward in |RunFor|.
+  base::TickClock *tick_clock() { return &clock_; }
+  base::TimeTicks NowTicks() { return clock_.NowTicks(); }
+
+  // Lets the network layers created with |settings| run on the virtual
+  // clock.
+  void ApplyTo(NetworkSettings *settings);
+
+  // Adds |network_layer| as the node at |address|, for all protocols of
+  // datagrams. The network layer is not owned, and must have been created
+  // with settings applied by |ApplyTo|.
+  void AddNode(const EndPoint &address, NetworkLayer *network_layer);
+
+  // Also fires the timers of |timer_wheel| as the clock moves, e.g. the
+  // wheel of a |UserAgent| over a node. Not owned.
+  void AddTimerWheel(TimerWheel *timer_wheel);
+
+  // Runs the simulation for |duration| of virtual time, moving the clock in
+  // steps of at most one tick of the timer wheels, and running the message
+  // loop at each one.
+  void RunFor(const base::TimeDelta &duration);
+
+  const Stats &stats() const { return stats_; }
+
+ private:
+  friend class SimulatedChannel;
+  class Node;
+
+  struct Delivery {
+    Delivery();
+    ~Delivery();
+
+    base::TimeTicks time;
+    // Keeps deliveries of the same time in the order they were sent.
+    int64 sequence;
+    std::string from;
+    std::string to;
+    std::string data;
+  };
+
+  struct LaterDelivery {
+    bool operator()(const Delivery *a, const Delivery *b) const {
+      if (a->time != b->time)
+        return a->time > b->time;
+      return a->sequence > b->sequence;
+    }
+  };
+
+  typedef base::hash_map<std::string, Node*> NodeMap;
+  typedef std::priority_queue<Delivery*, std::vector<Delivery*>,
+                              LaterDelivery> DeliveryQueue;
+
+  // Puts |message| on the wire from |from| to |to|.
+  void Transmit(const EndPoint &from, const EndPoint &to,
+                const scoped_refptr<Message> &message);
+  // Delivers what arrives by now.
+  void DeliverDue();
+  void RunPendingTasks();
+  // A uniform deviate in [0, 1), from the seeded generator.
+  double NextRandom();
+
+  base::SimpleTestTickClock clock_;
+  LinkModel link_model_;
+  uint64 random_state_;
+  int64 next_sequence_;
+  ScopedVector<Node> nodes_;
+  NodeMap nodes_by_address_;
+  std::vector<TimerWheel*> timer_wheels_;
+  DeliveryQueue deliveries_;
+  Stats stats_;
+
+  DISALLOW_COPY_AND_ASSIGN(SimulatedNetwork);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TEST_SIMULATION_SIMULATED_NETWORK_H_
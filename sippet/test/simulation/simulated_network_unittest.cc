@@ -0,0 +1,215 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/test/simulation/simulated_network.h"
+
+#include "base/strings/string_number_conversions.h"
+#include "net/base/net_errors.h"
+#include "sippet/message/headers.h"
+#include "sippet/message/request.h"
+#include "sippet/message/response.h"
+#include "sippet/transport/network_layer.h"
+#include "sippet/transport/network_settings.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const char kClientAddress[] = "10.0.0.1:5060/UDP";
+const char kServerAddress[] = "10.0.0.2:5060/UDP";
+
+// Sends OPTIONS to the server node, counting how they end.
+class ClientDelegate : public NetworkLayer::Delegate {
+ public:
+  ClientDelegate() : sent_(0), answered_(0), timed_out_(0), failed_(0) {}
+
+  int finished() const { return answered_ + timed_out_ + failed_; }
+  int answered() const { return answered_; }
+  int timed_out() const { return timed_out_; }
+  int failed() const { return failed_; }
+
+  void SendOptions(NetworkLayer *network_layer) {
+    GURL target("sip:10.0.0.2");
+    scoped_refptr<Request> request(new Request(Method::OPTIONS, target));
+    std::string suffix(base::IntToString(sent_++));
+    scoped_ptr<To> to(new To(target));
+    request->push_back(to.Pass());
+    scoped_ptr<From> from(new From(GURL("sip:simulation@10.0.0.1")));
+    from->set_tag("t" + suffix);
+    request->push_back(from.Pass());
+    scoped_ptr<CallId> call_id(new CallId("simulation-" + suffix));
+    request->push_back(call_id.Pass());
+    scoped_ptr<Cseq> cseq(new Cseq(1, Method::OPTIONS));
+    request->push_back(cseq.Pass());
+    scoped_ptr<MaxForwards> max_forwards(new MaxForwards(70));
+    request->push_back(max_forwards.Pass());
+    int rv = network_layer->Send(request, net::CompletionCallback());
+    if (net::OK != rv && net::ERR_IO_PENDING != rv)
+      ++failed_;
+  }
+
+  // NetworkLayer::Delegate methods:
+  void OnChannelConnected(const EndPoint &destination, int err) override {}
+  void OnChannelClosed(const EndPoint &destination) override {}
+  void OnIncomingRequest(const scoped_refptr<Request> &request) override {}
+  void OnIncomingResponse(const scoped_refptr<Response> &response) override {
+    if (200 <= response->response_code())
+      ++answered_;
+  }
+  void OnTimedOut(const scoped_refptr<Request> &request) override {
+    ++timed_out_;
+  }
+  void OnTransportError(const scoped_refptr<Request> &request,
+                        int error) override {
+    ++failed_;
+  }
+
+ private:
+  int sent_;
+  int answered_;
+  int timed_out_;
+  int failed_;
+};
+
+// Answers every request with a 200.
+class ServerDelegate : public NetworkLayer::Delegate {
+ public:
+  ServerDelegate() : network_layer_(nullptr), received_(0) {}
+
+  void set_network_layer(NetworkLayer *network_layer) {
+    network_layer_ = network_layer;
+  }
+  int received() const { return received_; }
+
+  // NetworkLayer::Delegate methods:
+  void OnChannelConnected(const EndPoint &destination, int err) override {}
+  void OnChannelClosed(const EndPoint &destination) override {}
+  void OnIncomingRequest(const scoped_refptr<Request> &request) override {
+    ++received_;
+    network_layer_->Send(request->CreateResponse(SIP_OK),
+                         net::CompletionCallback());
+  }
+  void OnIncomingResponse(const scoped_refptr<Response> &response) override {}
+  void OnTimedOut(const scoped_refptr<Request> &request) override {}
+  void OnTransportError(const scoped_refptr<Request> &request,
+                        int error) override {}
+
+ private:
+  NetworkLayer *network_layer_;
+  int received_;
+};
+
+class SimulatedNetworkTest : public testing::Test {
+ public:
+  void Initialize(const SimulatedNetwork::LinkModel &model,
+                  uint32 seed = 1) {
+    network_.reset(new SimulatedNetwork(seed));
+    network_->set_link_model(model);
+    NetworkSettings settings;
+    network_->ApplyTo(&settings);
+    client_.reset(new NetworkLayer(&client_delegate_, settings));
+    server_.reset(new NetworkLayer(&server_delegate_, settings));
+    server_delegate_.set_network_layer(server_.get());
+    network_->AddNode(EndPoint::FromString(kClientAddress), client_.get());
+    network_->AddNode(EndPoint::FromString(kServerAddress), server_.get());
+  }
+
+  void TearDown() override {
+    client_.reset();
+    server_.reset();
+    network_.reset();
+  }
+
+  // Sends |count| requests; the first one opens the channel.
+  void SendRequests(int count) {
+    client_delegate_.SendOptions(client_.get());
+    network_->RunFor(base::TimeDelta());
+    for (int i = 1; i < count; ++i)
+      client_delegate_.SendOptions(client_.get());
+  }
+
+ protected:
+  ClientDelegate client_delegate_;
+  ServerDelegate server_delegate_;
+  scoped_ptr<SimulatedNetwork> network_;
+  scoped_ptr<NetworkLayer> client_;
+  scoped_ptr<NetworkLayer> server_;
+};
+
+} // namespace
+
+TEST_F(SimulatedNetworkTest, DeliversWithDelay) {
+  SimulatedNetwork::LinkModel model;
+  model.delay = base::TimeDelta::FromMilliseconds(50);
+  Initialize(model);
+
+  SendRequests(1);
+  network_->RunFor(base::TimeDelta::FromMilliseconds(90));
+  EXPECT_EQ(1, server_delegate_.received());
+  EXPECT_EQ(0, client_delegate_.answered());
+
+  network_->RunFor(base::TimeDelta::FromMilliseconds(20));
+  EXPECT_EQ(1, client_delegate_.answered());
+  EXPECT_EQ(2, network_->stats().sent);
+  EXPECT_EQ(2, network_->stats().delivered);
+}
+
+TEST_F(SimulatedNetworkTest, TimesOutWhenAllLost) {
+  SimulatedNetwork::LinkModel model;
+  model.loss_rate = 1;
+  Initialize(model);
+
+  // Timer F fires after 64*T1, 32s of virtual time.
+  SendRequests(1);
+  network_->RunFor(base::TimeDelta::FromSeconds(31));
+  EXPECT_EQ(0, client_delegate_.timed_out());
+
+  network_->RunFor(base::TimeDelta::FromSeconds(2));
+  EXPECT_EQ(1, client_delegate_.timed_out());
+  EXPECT_EQ(0, server_delegate_.received());
+  // Retransmitted by timer E.
+  EXPECT_LT(1, network_->stats().sent);
+  EXPECT_EQ(network_->stats().sent, network_->stats().lost);
+}
+
+TEST_F(SimulatedNetworkTest, RecoversFromLoss) {
+  const int kTransactions = 2000;
+  SimulatedNetwork::LinkModel model;
+  model.loss_rate = 0.1;
+  model.delay = base::TimeDelta::FromMilliseconds(20);
+  model.jitter = base::TimeDelta::FromMilliseconds(30);
+  Initialize(model);
+
+  SendRequests(kTransactions);
+  network_->RunFor(base::TimeDelta::FromSeconds(40));
+  EXPECT_EQ(kTransactions, client_delegate_.finished());
+  EXPECT_EQ(kTransactions, client_delegate_.answered());
+  EXPECT_LT(0, network_->stats().lost);
+  // Each lost message is made up by a retransmission.
+  EXPECT_LE(2 * kTransactions + network_->stats().lost,
+            network_->stats().sent);
+}
+
+TEST_F(SimulatedNetworkTest, SameSeedSameRun) {
+  const int kTransactions = 100;
+  SimulatedNetwork::LinkModel model;
+  model.loss_rate = 0.3;
+  model.jitter = base::TimeDelta::FromMilliseconds(100);
+  Initialize(model, 7);
+
+  SendRequests(kTransactions);
+  network_->RunFor(base::TimeDelta::FromSeconds(40));
+  SimulatedNetwork::Stats first = network_->stats();
+  TearDown();
+
+  Initialize(model, 7);
+  SendRequests(kTransactions);
+  network_->RunFor(base::TimeDelta::FromSeconds(40));
+  EXPECT_EQ(first.sent, network_->stats().sent);
+  EXPECT_EQ(first.lost, network_->stats().lost);
+  EXPECT_EQ(first.bytes_sent, network_->stats().bytes_sent);
+}
+
+} // End of sippet namespace
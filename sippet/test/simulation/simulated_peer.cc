@@ -0,0 +1,199 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/test/simulation/simulated_peer.h"
+
+#include "base/logging.h"
+#include "net/base/completion_callback.h"
+#include "sippet/base/tags.h"
+#include "sippet/message/headers.h"
+#include "sippet/message/request.h"
+#include "sippet/message/response.h"
+#include "sippet/message/status_code.h"
+#include "sippet/test/simulation/simulated_network.h"
+#include "sippet/transport/network_settings.h"
+
+namespace sippet {
+
+namespace {
+
+std::string GetTopmostBranch(const Message &message) {
+  const Via *via = message.get<Via>();
+  if (!via || via->empty() || !via->front().HasBranch())
+    return std::string();
+  return via->front().branch();
+}
+
+}  // namespace
+
+SimulatedPeer::SimulatedPeer(SimulatedNetwork *network,
+                             const std::string &address)
+  : invite_answer_(0) {
+  DCHECK(network);
+  EndPoint end_point(EndPoint::FromString(address));
+  contact_ = GURL("sip:" + end_point.hostport().ToString());
+  NetworkSettings settings;
+  network->ApplyTo(&settings);
+  network_layer_.reset(new NetworkLayer(this, settings));
+  network->AddNode(end_point, network_layer_.get());
+}
+
+SimulatedPeer::~SimulatedPeer() {
+}
+
+scoped_refptr<Request> SimulatedPeer::CreateRequest(
+    const Method &method,
+    const GURL &request_uri) {
+  scoped_refptr<Request> request(new Request(method, request_uri));
+  scoped_ptr<MaxForwards> max_forwards(new MaxForwards(70));
+  request->push_back(max_forwards.Pass());
+  scoped_ptr<To> to(new To(request_uri));
+  request->push_back(to.Pass());
+  scoped_ptr<From> from(new From(contact_));
+  from->set_tag(CreateTag());
+  request->push_back(from.Pass());
+  scoped_ptr<CallId> call_id(new CallId(CreateCallId()));
+  request->push_back(call_id.Pass());
+  scoped_ptr<Cseq> cseq(new Cseq(1, method));
+  request->push_back(cseq.Pass());
+  scoped_ptr<Contact> contact(new Contact(contact_));
+  request->push_back(contact.Pass());
+  return request;
+}
+
+scoped_refptr<Request> SimulatedPeer::CreateDialogRequest(
+    const Method &method,
+    const scoped_refptr<Response> &response) {
+  const Request *invite = response->refer_to().get();
+  DCHECK(invite);
+  const Response *const_response = response.get();
+  const Contact *contact = const_response->get<Contact>();
+  GURL target(contact && !contact->empty()
+      ? contact->front().address() : invite->request_uri());
+  scoped_refptr<Request> request(new Request(method, target));
+  scoped_ptr<MaxForwards> max_forwards(new MaxForwards(70));
+  request->push_back(max_forwards.Pass());
+  invite->ShareTo<From>(request.get());
+  const_response->ShareTo<To>(request.get());
+  invite->ShareTo<CallId>(request.get());
+  // ACKs of 2xx take the sequence number of their INVITE.
+  const Cseq *cseq = invite->get<Cseq>();
+  scoped_ptr<Cseq> new_cseq(new Cseq(
+      cseq->sequence() + (Method::ACK == method ? 0 : 1), method));
+  request->push_back(new_cseq.Pass());
+  return request;
+}
+
+scoped_refptr<Response> SimulatedPeer::Answer(
+    const scoped_refptr<Request> &request,
+    int response_code,
+    const std::string &to_tag) {
+  scoped_refptr<Response> response(
+      request->CreateResponse(static_cast<StatusCode>(response_code)));
+  if (!to_tag.empty())
+    response->get<To>()->set_tag(to_tag);
+  if (100 < response_code && response_code < 300) {
+    scoped_ptr<Contact> contact(new Contact(contact_));
+    response->push_back(contact.Pass());
+  }
+  if (200 <= response_code)
+    answered_.insert(request->id());
+  Send(response);
+  return response;
+}
+
+int SimulatedPeer::Send(const scoped_refptr<Message> &message) {
+  return network_layer_->Send(message, net::CompletionCallback());
+}
+
+int SimulatedPeer::CountRequests(const Method &method) const {
+  int count = 0;
+  for (std::vector<scoped_refptr<Request> >::const_iterator i =
+       requests_.begin(), ie = requests_.end(); i != ie; ++i) {
+    if (method == (*i)->method())
+      ++count;
+  }
+  return count;
+}
+
+scoped_refptr<Request> SimulatedPeer::LastRequest(
+    const Method &method) const {
+  for (std::vector<scoped_refptr<Request> >::const_reverse_iterator i =
+       requests_.rbegin(), ie = requests_.rend(); i != ie; ++i) {
+    if (method == (*i)->method())
+      return *i;
+  }
+  return nullptr;
+}
+
+scoped_refptr<Response> SimulatedPeer::LastResponse(
+    int response_code) const {
+  for (std::vector<scoped_refptr<Response> >::const_reverse_iterator i =
+       responses_.rbegin(), ie = responses_.rend(); i != ie; ++i) {
+    if (response_code == (*i)->response_code())
+      return *i;
+  }
+  return nullptr;
+}
+
+int SimulatedPeer::FinalResponseCode(const Method &method) const {
+  int response_code = 0;
+  for (std::vector<scoped_refptr<Response> >::const_iterator i =
+       responses_.begin(), ie = responses_.end(); i != ie; ++i) {
+    const Response *response = i->get();
+    const Cseq *cseq = response->get<Cseq>();
+    if (200 <= response->response_code() && cseq
+        && method == cseq->method())
+      response_code = response->response_code();
+  }
+  return response_code;
+}
+
+void SimulatedPeer::OnChannelConnected(const EndPoint &destination,
+                                       int err) {
+}
+
+void SimulatedPeer::OnChannelClosed(const EndPoint &destination) {
+}
+
+void SimulatedPeer::OnIncomingRequest(
+    const scoped_refptr<Request> &request) {
+  requests_.push_back(request);
+  if (Method::CANCEL == request->method()) {
+    scoped_refptr<Request> invite(FindCancelledInvite(*request));
+    Answer(request, SIP_OK);
+    if (invite)
+      Answer(invite, SIP_REQUEST_TERMINATED);
+  } else if (Method::BYE == request->method()) {
+    Answer(request, SIP_OK);
+  } else if (Method::INVITE == request->method() && invite_answer_) {
+    Answer(request, invite_answer_);
+  }
+}
+
+void SimulatedPeer::OnIncomingResponse(
+    const scoped_refptr<Response> &response) {
+  responses_.push_back(response);
+}
+
+void SimulatedPeer::OnTimedOut(const scoped_refptr<Request> &request) {
+}
+
+void SimulatedPeer::OnTransportError(const scoped_refptr<Request> &request,
+                                     int error) {
+}
+
+scoped_refptr<Request> SimulatedPeer::FindCancelledInvite(
+    const Request &cancel) const {
+  std::string branch(GetTopmostBranch(cancel));
+  for (std::vector<scoped_refptr<Request> >::const_iterator i =
+       requests_.begin(), ie = requests_.end(); i != ie; ++i) {
+    if (Method::INVITE == (*i)->method() && !answered_.count((*i)->id())
+        && branch == GetTopmostBranch(**i))
+      return *i;
+  }
+  return nullptr;
+}
+
+} // End of sippet namespace
@@ -0,0 +1,122 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TEST_SIMULATION_SIMULATED_PEER_H_
+#define SIPPET_TEST_SIMULATION_SIMULATED_PEER_H_
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "base/memory/ref_counted.h"
+#include "base/memory/scoped_ptr.h"
+#include "sippet/message/method.h"
+#include "sippet/transport/network_layer.h"
+#include "url/gurl.h"
+
+namespace sippet {
+
+class Message;
+class Request;
+class Response;
+class SimulatedNetwork;
+
+// A remote user agent on a |SimulatedNetwork|, for testing the proxies and
+// the back-to-back user agents in between: a bare |NetworkLayer| keeping
+// what it receives, and answering the requests as told by the test. BYEs
+// and CANCELs are answered right away with a 200, and the INVITEs being
+// cancelled with a 487 (Request Terminated).
+//
+// Example usage:
+//   SimulatedPeer caller(&network, "10.0.0.1:5060/UDP");
+//   SimulatedPeer callee(&network, "10.0.0.2:5060/UDP");
+//   callee.set_invite_answer(SIP_BUSY_HERE);
+//   caller.Send(caller.CreateRequest(Method::INVITE, GURL("sip:10.0.0.2")));
+//   network.RunFor(base::TimeDelta::FromSeconds(1));
+//   EXPECT_EQ(SIP_BUSY_HERE, caller.FinalResponseCode(Method::INVITE));
+//
+// Peers must be destroyed before the network.
+class SimulatedPeer : public NetworkLayer::Delegate {
+ public:
+  // Adds the peer to |network| at |address|, e.g. "10.0.0.1:5060/UDP".
+  SimulatedPeer(SimulatedNetwork *network, const std::string &address);
+  ~SimulatedPeer() override;
+
+  NetworkLayer *network_layer() { return network_layer_.get(); }
+
+  // The address of the peer, as put in its |Contact| headers.
+  const GURL &contact() const { return contact_; }
+
+  // Answers the incoming INVITEs with |response_code| as they arrive, or
+  // leaves them to the test if zero, the default.
+  void set_invite_answer(int response_code) {
+    invite_answer_ = response_code;
+  }
+
+  // Creates a request out of any dialog, from the peer to |request_uri|.
+  scoped_refptr<Request> CreateRequest(const Method &method,
+                                       const GURL &request_uri);
+
+  // Creates a request within the dialog confirmed by |response|, the 2xx
+  // to an INVITE of the peer: its ACK, or a BYE.
+  scoped_refptr<Request> CreateDialogRequest(
+      const Method &method,
+      const scoped_refptr<Response> &response);
+
+  // Sends the response to |request|, tagging it with |to_tag| unless
+  // empty.
+  scoped_refptr<Response> Answer(const scoped_refptr<Request> &request,
+                                 int response_code,
+                                 const std::string &to_tag = std::string());
+
+  int Send(const scoped_refptr<Message> &message);
+
+  // What the peer received, in order.
+  const std::vector<scoped_refptr<Request> > &requests() const {
+    return requests_;
+  }
+  const std::vector<scoped_refptr<Response> > &responses() const {
+    return responses_;
+  }
+
+  int CountRequests(const Method &method) const;
+
+  // The last request of |method| received, or NULL if none.
+  scoped_refptr<Request> LastRequest(const Method &method) const;
+
+  // The last response with |response_code| received, or NULL if none.
+  scoped_refptr<Response> LastResponse(int response_code) const;
+
+  // The code of the last final response to a request of |method|, or zero
+  // if none.
+  int FinalResponseCode(const Method &method) const;
+
+  // NetworkLayer::Delegate methods:
+  void OnChannelConnected(const EndPoint &destination, int err) override;
+  void OnChannelClosed(const EndPoint &destination) override;
+  void OnIncomingRequest(const scoped_refptr<Request> &request) override;
+  void OnIncomingResponse(const scoped_refptr<Response> &response)
+      override;
+  void OnTimedOut(const scoped_refptr<Request> &request) override;
+  void OnTransportError(const scoped_refptr<Request> &request,
+                        int error) override;
+
+ private:
+  // The INVITE not answered yet that |cancel| refers to, or NULL.
+  scoped_refptr<Request> FindCancelledInvite(const Request &cancel) const;
+
+  GURL contact_;
+  int invite_answer_;
+  scoped_ptr<NetworkLayer> network_layer_;
+  std::vector<scoped_refptr<Request> > requests_;
+  std::vector<scoped_refptr<Response> > responses_;
+  // Ids of the requests that got a final response.
+  std::set<std::string> answered_;
+
+  DISALLOW_COPY_AND_ASSIGN(SimulatedPeer);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TEST_SIMULATION_SIMULATED_PEER_H_
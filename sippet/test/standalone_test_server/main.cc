@@ -5,19 +5,37 @@
 #include "sippet/test/standalone_test_server/standalone_test_server.h"
 
 #include "base/at_exit.h"
+#include "base/bind.h"
 #include "base/command_line.h"
 #include "base/files/file_path.h"
 #include "base/logging.h"
 #include "base/path_service.h"
 #include "base/strings/string_number_conversions.h"
 #include "base/message_loop/message_loop.h"
+#include "base/timer/timer.h"
 #include "sippet/uri/uri.h"
 
 using sippet::Protocol;
 using sippet::StandaloneTestServer;
 
 static void PrintUsage() {
-  printf("standalone_test_server {--tcp|--udp|--tls} [--port=nnn]\n");
+  printf("standalone_test_server {--tcp|--udp|--tls} [--port=nnn]\n"
+         "    [--load [--workers=n] [--reply=200|401|486] [--delay=ms]]\n");
+}
+
+// Prints the load counters of the last second.
+static void PrintLoadCounters(
+    StandaloneTestServer *server,
+    StandaloneTestServer::LoadCounters *last_counters) {
+  StandaloneTestServer::LoadCounters counters;
+  server->GetLoadCounters(&counters);
+  printf("requests %ld/s, successes %ld/s, challenges %ld/s, "
+         "failures %ld/s\n",
+         static_cast<long>(counters.requests - last_counters->requests),
+         static_cast<long>(counters.successes - last_counters->successes),
+         static_cast<long>(counters.challenges - last_counters->challenges),
+         static_cast<long>(counters.failures - last_counters->failures));
+  *last_counters = counters;
 }
 
 int main(int argc, char *argv[]) {
@@ -77,6 +95,43 @@ int main(int argc, char *argv[]) {
   scoped_ptr<StandaloneTestServer> server(
     new StandaloneTestServer(protocol, ssl_options, port));
 
+  if (command_line->HasSwitch("load")) {
+    StandaloneTestServer::LoadOptions load_options;
+    if (command_line->HasSwitch("workers")) {
+      if (!base::StringToInt(command_line->GetSwitchValueASCII("workers"),
+              &load_options.worker_threads)
+          || load_options.worker_threads < 1) {
+        PrintUsage();
+        return -1;
+      }
+    }
+    std::string reply("200");
+    if (command_line->HasSwitch("reply"))
+      reply = command_line->GetSwitchValueASCII("reply");
+    if (reply == "200") {
+      load_options.reply = StandaloneTestServer::LoadOptions::REPLY_OK;
+    } else if (reply == "401") {
+      load_options.reply = StandaloneTestServer::LoadOptions::REPLY_CHALLENGE;
+    } else if (reply == "486") {
+      load_options.reply = StandaloneTestServer::LoadOptions::REPLY_BUSY;
+    } else {
+      PrintUsage();
+      return -1;
+    }
+    if (command_line->HasSwitch("delay")) {
+      int delay_ms;
+      if (!base::StringToInt(command_line->GetSwitchValueASCII("delay"),
+              &delay_ms) || delay_ms < 0) {
+        PrintUsage();
+        return -1;
+      }
+      load_options.reply_delay = base::TimeDelta::FromMilliseconds(delay_ms);
+    }
+    server->EnableLoadMode(load_options);
+    // Logging every message would be the bottleneck
+    logging::SetMinLogLevel(logging::LOG_WARNING);
+  }
+
   if (!server->InitializeAndWaitUntilReady()) {
     printf("Error: could not initialize server. Exiting.\n");
     return -1;
@@ -87,6 +142,13 @@ int main(int argc, char *argv[]) {
          "Server started. Press Ctrl+C when done...\n",
          server->base_uri().spec().c_str());
 
+  StandaloneTestServer::LoadCounters last_counters;
+  base::Timer counters_timer(true, true);
+  if (server->load_mode()) {
+    counters_timer.Start(FROM_HERE, base::TimeDelta::FromSeconds(1),
+        base::Bind(&PrintLoadCounters, server.get(), &last_counters));
+  }
+
   message_loop.Run();
 
   if (!server->ShutdownAndWaitUntilComplete()) {
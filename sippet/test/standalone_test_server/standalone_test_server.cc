@@ -9,6 +9,7 @@
 #include <pjlib.h>
 
 #include <string>
+#include <vector>
 
 #include "base/bind.h"
 #include "base/message_loop/message_loop.h"
@@ -115,26 +116,56 @@ pj_status_t LookupCredentials(pj_pool_t *pool,
   return PJ_ENOTFOUND;
 }
 
+// A final response of the auto-responder, sent once the reply delay
+// elapses. Its transaction is kept alive meanwhile.
+struct DelayedResponse {
+  pj_timer_entry timer_entry_;
+  pjsip_transaction *tsx_;
+  pjsip_tx_data *tdata_;
+
+  DelayedResponse(pjsip_transaction *tsx, pjsip_tx_data *tdata)
+    : tsx_(tsx),
+      tdata_(tdata) {
+    pj_timer_entry_init(&timer_entry_, 0, this, &DelayedResponse::OnTimer);
+    pj_grp_lock_add_ref(tsx_->grp_lock);
+  }
+
+  ~DelayedResponse() {
+    pj_grp_lock_dec_ref(tsx_->grp_lock);
+  }
+
+  void Send() {
+    if (pjsip_tsx_send_msg(tsx_, tdata_) != PJ_SUCCESS)
+      pjsip_tx_data_dec_ref(tdata_);
+  }
+
+  static void OnTimer(pj_timer_heap_t *timer_heap, pj_timer_entry *entry) {
+    DelayedResponse *self =
+        reinterpret_cast<DelayedResponse *>(entry->user_data);
+    self->Send();
+    delete self;
+  }
+};
+
 }  // namespace
 
 struct StandaloneTestServer::ControlStruct {
   pj_caching_pool caching_pool_;
   pjsip_endpoint* endpoint_;
   pj_pool_t* pool_;
-  pj_thread_t* thread_;
+  std::vector<pj_thread_t*> threads_;
   pjsip_auth_srv auth_srv_;
 
   ControlStruct()
     : endpoint_(nullptr),
-      pool_(nullptr),
-      thread_(nullptr) {
+      pool_(nullptr) {
     memset(&caching_pool_, 0, sizeof(caching_pool_));
     memset(&auth_srv_, 0, sizeof(auth_srv_));
   }
 
   ~ControlStruct() {
-    if (thread_)
-      StopWorkerThread();
+    if (!threads_.empty())
+      StopWorkerThreads();
     if (endpoint_)
       pjsip_endpt_destroy(endpoint_);
     if (pool_)
@@ -143,14 +174,16 @@ struct StandaloneTestServer::ControlStruct {
       pj_caching_pool_destroy(&caching_pool_);
   }
 
-  bool Init() {
+  // Messages aren't logged if |log_messages| is false, and then only the
+  // errors are.
+  bool Init(bool log_messages) {
     pj_status_t status;
 
     status = pj_init();
     if (status != PJ_SUCCESS)
       return false;
 
-    pj_log_set_level(PJ_LOG_MAX_LEVEL);
+    pj_log_set_level(log_messages ? PJ_LOG_MAX_LEVEL : 1);
 
     status = pjlib_util_init();
     if (status != PJ_SUCCESS)
@@ -167,14 +200,16 @@ struct StandaloneTestServer::ControlStruct {
     if (status != PJ_SUCCESS)
       return false;
 
-    pjsip_endpt_register_module(endpoint_, &msg_logger);
+    if (log_messages)
+      pjsip_endpt_register_module(endpoint_, &msg_logger);
 
     pool_ = pj_pool_create(&caching_pool_.factory, "embedsrv",
         4000, 4000, nullptr);
     return true;
   }
 
-  bool ListenTo(const Protocol& protocol, int* port,
+  // |async_count| is the number of concurrent reads of the transport.
+  bool ListenTo(const Protocol& protocol, int* port, int async_count,
                 const StandaloneTestServer::SSLOptions& options) {
     pj_status_t status;
 
@@ -186,13 +221,15 @@ struct StandaloneTestServer::ControlStruct {
 
     if (Protocol::UDP == protocol) {
       pjsip_transport *tp = nullptr;
-      status = pjsip_udp_transport_start(endpoint_, &addr, nullptr, 1, &tp);
+      status = pjsip_udp_transport_start(endpoint_, &addr, nullptr,
+          async_count, &tp);
       if (status == PJ_SUCCESS)
         *port = tp->local_name.port;
     } else {
       pjsip_tpfactory *tf = nullptr;
       if (Protocol::TCP == protocol) {
-        status = pjsip_tcp_transport_start(endpoint_, &addr, 1, &tf);
+        status = pjsip_tcp_transport_start(endpoint_, &addr, async_count,
+            &tf);
       } else if (Protocol::TLS == protocol) {
         pjsip_tls_setting opt;
         pjsip_tls_setting_default(&opt);
@@ -208,7 +245,7 @@ struct StandaloneTestServer::ControlStruct {
         if (!options.password.empty())
           opt.password = pj_str(const_cast<char*>(options.password.c_str()));
         status = pjsip_tls_transport_start(endpoint_, &opt, &addr,
-          nullptr, 1, &tf);
+          nullptr, async_count, &tf);
       } else {
         NOTREACHED() << "Unknown protocol";
         return false;
@@ -234,18 +271,25 @@ struct StandaloneTestServer::ControlStruct {
     return status == PJ_SUCCESS;
   }
 
-  bool StartWorkerThread() {
+  bool StartWorkerThreads(int count) {
     pj_status_t status;
     quit_flag_ = false;
-    status = pj_thread_create(pool_, "embedsrv", &WorkerThread,
-        this, 0, 0, &thread_);
-    return status == PJ_SUCCESS;
+    for (int i = 0; i < count; ++i) {
+      pj_thread_t *thread = nullptr;
+      status = pj_thread_create(pool_, "embedsrv", &WorkerThread,
+          this, 0, 0, &thread);
+      if (status != PJ_SUCCESS)
+        return false;
+      threads_.push_back(thread);
+    }
+    return true;
   }
 
-  void StopWorkerThread() {
+  void StopWorkerThreads() {
     quit_flag_ = true;
-    pj_thread_join(thread_);
-    thread_ = nullptr;
+    for (size_t i = 0; i < threads_.size(); ++i)
+      pj_thread_join(threads_[i]);
+    threads_.clear();
   }
 
   static bool quit_flag_;
@@ -268,6 +312,21 @@ StandaloneTestServer::SSLOptions::SSLOptions()
 StandaloneTestServer::SSLOptions::~SSLOptions() {
 }
 
+StandaloneTestServer::LoadOptions::LoadOptions()
+    : worker_threads(1),
+      reply(REPLY_OK) {
+}
+
+StandaloneTestServer::LoadOptions::~LoadOptions() {
+}
+
+StandaloneTestServer::LoadCounters::LoadCounters()
+    : requests(0),
+      successes(0),
+      challenges(0),
+      failures(0) {
+}
+
 StandaloneTestServer::StandaloneTestServer(const Protocol &protocol,
     int port) {
   Init(protocol, port, nullptr);
@@ -295,6 +354,7 @@ void StandaloneTestServer::Init(const Protocol &protocol, int port,
   DCHECK(thread_checker_.CalledOnValidThread());
   port_ = port;
   protocol_ = protocol;
+  load_mode_ = false;
   if (ssl_options)
     ssl_options_ = *ssl_options;
   g_server = this;
@@ -328,7 +388,25 @@ bool StandaloneTestServer::Started() const {
   return control_struct_.get() != nullptr;
 }
 
+void StandaloneTestServer::EnableLoadMode(const LoadOptions &load_options) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  DCHECK(!Started());
+  DCHECK_GE(load_options.worker_threads, 1);
+  load_mode_ = true;
+  load_options_ = load_options;
+}
+
+void StandaloneTestServer::GetLoadCounters(LoadCounters *counters) const {
+  base::AutoLock auto_lock(load_counters_lock_);
+  *counters = load_counters_;
+}
+
 void StandaloneTestServer::OnReceiveRequest(pjsip_rx_data *rdata) {
+  if (load_mode_) {
+    AutoRespond(rdata);
+    return;
+  }
+
   if (rdata->msg_info.msg->line.req.method.id == PJSIP_CANCEL_METHOD)
     return;
 
@@ -426,6 +504,83 @@ bool StandaloneTestServer::VerifyRequest(pjsip_rx_data *rdata) {
   return true;
 }
 
+void StandaloneTestServer::AutoRespond(pjsip_rx_data *rdata) {
+  const pj_str_t STR_CONTACT = {"Contact", 7};
+  pjsip_method_e method = rdata->msg_info.msg->line.req.method.id;
+
+  // ACKs of 2xx responses aren't matched by a transaction
+  if (method == PJSIP_ACK_METHOD)
+    return;
+
+  // CANCELs are always accepted
+  int status_code = PJSIP_SC_OK;
+  if (method != PJSIP_CANCEL_METHOD) {
+    if (LoadOptions::REPLY_BUSY == load_options_.reply) {
+      status_code = PJSIP_SC_BUSY_HERE;
+    } else if (LoadOptions::REPLY_CHALLENGE == load_options_.reply
+               && pjsip_msg_find_hdr(rdata->msg_info.msg,
+                      PJSIP_H_AUTHORIZATION, nullptr) == nullptr) {
+      status_code = PJSIP_SC_UNAUTHORIZED;
+    }
+  }
+
+  pj_status_t status;
+  pjsip_tx_data *tdata = nullptr;
+  do {
+    status = pjsip_endpt_create_response(control_struct_->endpoint_,
+        rdata, status_code, nullptr, &tdata);
+    if (status != PJ_SUCCESS)
+      break;
+    if (status_code == PJSIP_SC_UNAUTHORIZED) {
+      status = pjsip_auth_srv_challenge(&control_struct_->auth_srv_,
+          nullptr, nullptr, nullptr, PJ_FALSE, tdata);
+      if (status != PJ_SUCCESS)
+        break;
+    } else if (status_code == PJSIP_SC_OK
+               && method == PJSIP_INVITE_METHOD) {
+      // The dialog needs a remote target
+      pj_str_t value = pj_str(const_cast<char*>(contact_.c_str()));
+      pjsip_generic_string_hdr *contact = pjsip_generic_string_hdr_create(
+          tdata->pool, &STR_CONTACT, &value);
+      pjsip_msg_add_hdr(tdata->msg, reinterpret_cast<pjsip_hdr*>(contact));
+    }
+    pjsip_transaction *uas_tsx;
+    status = pjsip_tsx_create_uas(nullptr, rdata, &uas_tsx);
+    if (status != PJ_SUCCESS)
+      break;
+    pjsip_tsx_recv_msg(uas_tsx, rdata);
+
+    {
+      base::AutoLock auto_lock(load_counters_lock_);
+      load_counters_.requests++;
+      if (status_code == PJSIP_SC_OK)
+        load_counters_.successes++;
+      else if (status_code == PJSIP_SC_UNAUTHORIZED)
+        load_counters_.challenges++;
+      else
+        load_counters_.failures++;
+    }
+
+    DelayedResponse *response = new DelayedResponse(uas_tsx, tdata);
+    if (load_options_.reply_delay > base::TimeDelta()) {
+      int64 delay_ms = load_options_.reply_delay.InMilliseconds();
+      pj_time_val delay;
+      delay.sec = static_cast<long>(delay_ms / 1000);
+      delay.msec = static_cast<long>(delay_ms % 1000);
+      if (pjsip_endpt_schedule_timer(control_struct_->endpoint_,
+              &response->timer_entry_, &delay) == PJ_SUCCESS)
+        return;
+    }
+    response->Send();
+    delete response;
+    return;
+  } while (0);
+  if (tdata)
+    pjsip_tx_data_dec_ref(tdata);
+  pjsip_endpt_respond_stateless(control_struct_->endpoint_, rdata,
+      PJSIP_SC_INTERNAL_SERVER_ERROR, nullptr, nullptr, nullptr);
+}
+
 void StandaloneTestServer::OnReceiveResponse(pjsip_rx_data *rdata) {
 }
 
@@ -433,26 +588,33 @@ void StandaloneTestServer::InitializeOnIOThread() {
   DCHECK(io_thread_->task_runner()->BelongsToCurrentThread());
   DCHECK(!Started());
 
+  int worker_threads = load_mode_ ? load_options_.worker_threads : 1;
   control_struct_.reset(new ControlStruct);
-  if (!control_struct_->Init()
-      || !control_struct_->ListenTo(protocol_, &port_, ssl_options_)
+  if (!control_struct_->Init(!load_mode_)
+      || !control_struct_->ListenTo(protocol_, &port_, worker_threads,
+             ssl_options_)
       || !control_struct_->RegisterModule()
-      || !control_struct_->StartAuthentication()
-      || !control_struct_->StartWorkerThread()) {
+      || !control_struct_->StartAuthentication()) {
     ShutdownOnIOThread();
+    return;
+  }
+
+  std::ostringstream uri;
+  if (Protocol::UDP == protocol_) {
+    uri << "sip:127.0.0.1:" << port_;
+  } else if (Protocol::TCP == protocol_) {
+    uri << "sip:127.0.0.1:" << port_ << ";transport=TCP";
+  } else if (Protocol::TLS == protocol_) {
+    uri << "sips:127.0.0.1:" << port_;
   } else {
-    std::ostringstream uri;
-    if (Protocol::UDP == protocol_) {
-      uri << "sip:127.0.0.1:" << port_;
-    } else if (Protocol::TCP == protocol_) {
-      uri << "sip:127.0.0.1:" << port_ << ";transport=TCP";
-    } else if (Protocol::TLS == protocol_) {
-      uri << "sips:127.0.0.1:" << port_;
-    } else {
-      NOTREACHED() << "Unknown protocol";
-    }
-    base_uri_ = GURL(uri.str());
+    NOTREACHED() << "Unknown protocol";
   }
+  base_uri_ = GURL(uri.str());
+  contact_ = "<" + base_uri_.spec() + ">";
+
+  // Requests may be answered as soon as the workers run
+  if (!control_struct_->StartWorkerThreads(worker_threads))
+    ShutdownOnIOThread();
 }
 
 void StandaloneTestServer::ShutdownOnIOThread() {
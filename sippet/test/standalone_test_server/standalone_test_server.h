@@ -7,9 +7,11 @@
 #include "base/compiler_specific.h"
 #include "base/memory/ref_counted.h"
 #include "base/memory/weak_ptr.h"
+#include "base/synchronization/lock.h"
 #include "base/threading/thread.h"
 #include "base/threading/thread_checker.h"
 #include "base/files/file_path.h"
+#include "base/time/time.h"
 #include "sippet/message/protocol.h"
 #include "url/gurl.h"
 
@@ -43,6 +45,48 @@ class StandaloneTestServer {
     bool request_client_certificate;
   };
 
+  // Options of the load test mode, in which the server is the peer of
+  // throughput benchmarks: requests are answered by an auto-responder,
+  // without being verified nor logged, by several worker threads.
+  struct LoadOptions {
+    enum Reply {
+      // Answer all requests with a 200 (OK).
+      REPLY_OK,
+      // Challenge the requests without credentials with a 401
+      // (Unauthorized), and answer the others with a 200 (OK). Credentials
+      // aren't checked.
+      REPLY_CHALLENGE,
+      // Answer all requests with a 486 (Busy Here).
+      REPLY_BUSY,
+    };
+
+    // Initialize the default LoadOptions: a single worker thread answering
+    // 200 (OK) at once.
+    LoadOptions();
+    ~LoadOptions();
+
+    // Number of threads handling the pjsip events.
+    int worker_threads;
+
+    Reply reply;
+
+    // Time to wait before sending the final responses.
+    base::TimeDelta reply_delay;
+  };
+
+  // Counters of the load test mode, since the server started.
+  struct LoadCounters {
+    LoadCounters();
+
+    // Requests received, except the ACKs and the retransmissions absorbed
+    // by the transactions.
+    int64 requests;
+    // Final responses sent, by class.
+    int64 successes;
+    int64 challenges;
+    int64 failures;
+  };
+
   // Creates a SIP test server. InitializeAndWaitUntilReady() must be called
   // to start the server.
   StandaloneTestServer(const Protocol &protocol, int port = 0);
@@ -59,6 +103,16 @@ class StandaloneTestServer {
   // Checks if the server is started.
   bool Started() const;
 
+  // Switches the server to the load test mode. It must be called before
+  // InitializeAndWaitUntilReady().
+  void EnableLoadMode(const LoadOptions &load_options);
+
+  bool load_mode() const { return load_mode_; }
+
+  // Gets the counters of the load test mode. They can be sampled every
+  // second to get the per-second rates.
+  void GetLoadCounters(LoadCounters *counters) const;
+
   // Returns the base URL to the server, which looks like:
   //
   // - sip:127.0.0.1:<port> for UDP transport
@@ -100,6 +154,9 @@ class StandaloneTestServer {
   // Verify an incoming SIP request.
   bool VerifyRequest(pjsip_rx_data *rdata);
 
+  // Answers an incoming request in the load test mode.
+  void AutoRespond(pjsip_rx_data *rdata);
+
   // Called when a response is received.
   void OnReceiveResponse(pjsip_rx_data *rdata);
 
@@ -114,6 +171,15 @@ class StandaloneTestServer {
   scoped_ptr<ControlStruct> control_struct_;
   SSLOptions ssl_options_;
 
+  bool load_mode_;
+  LoadOptions load_options_;
+  // The Contact of the 2xx answering INVITEs in load test mode.
+  std::string contact_;
+
+  // Updated from the worker threads.
+  mutable base::Lock load_counters_lock_;
+  LoadCounters load_counters_;
+
   DISALLOW_COPY_AND_ASSIGN(StandaloneTestServer);
 };
 
@@ -66,4 +66,26 @@ TEST_F(StandaloneTestServerTest, GetTLSBaseURL) {
     server_->base_uri().spec());
 }
 
+TEST_F(StandaloneTestServerTest, LoadMode) {
+  StandaloneTestServer::LoadOptions load_options;
+  load_options.worker_threads = 4;
+  load_options.reply = StandaloneTestServer::LoadOptions::REPLY_CHALLENGE;
+  load_options.reply_delay = base::TimeDelta::FromMilliseconds(10);
+
+  server_.reset(new StandaloneTestServer(Protocol::UDP));
+  server_->EnableLoadMode(load_options);
+  ASSERT_TRUE(server_->InitializeAndWaitUntilReady());
+  EXPECT_TRUE(server_->load_mode());
+  EXPECT_EQ(
+    base::StringPrintf("sip:127.0.0.1:%d", server_->port()),
+    server_->base_uri().spec());
+
+  StandaloneTestServer::LoadCounters counters;
+  server_->GetLoadCounters(&counters);
+  EXPECT_EQ(0, counters.requests);
+  EXPECT_EQ(0, counters.successes);
+  EXPECT_EQ(0, counters.challenges);
+  EXPECT_EQ(0, counters.failures);
+}
+
 }  // namespace sippet
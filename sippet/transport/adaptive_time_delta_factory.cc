@@ -0,0 +1,134 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/adaptive_time_delta_factory.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "base/time/tick_clock.h"
+
+namespace sippet {
+
+namespace {
+
+// RFC 3261 section 17.1.1.1 lets T1 be smaller on networks known to be
+// faster than the Internet; this is way below a LAN round trip anyway.
+const int64 kDefaultMinT1Milliseconds = 50;
+const int64 kDefaultMaxT1Milliseconds = 4000;
+
+// Estimates not updated for this long are forgotten: the path may have
+// changed since.
+const int64 kEstimateLifetimeMinutes = 10;
+
+base::TimeDelta AbsoluteDifference(const base::TimeDelta &a,
+                                   const base::TimeDelta &b) {
+  return a > b ? a - b : b - a;
+}
+
+}  // namespace
+
+AdaptiveTimeDeltaFactory::AdaptiveTimeDeltaFactory()
+  : min_t1_(base::TimeDelta::FromMilliseconds(kDefaultMinT1Milliseconds)),
+    max_t1_(base::TimeDelta::FromMilliseconds(kDefaultMaxT1Milliseconds)),
+    tick_clock_(nullptr) {
+}
+
+AdaptiveTimeDeltaFactory::AdaptiveTimeDeltaFactory(
+    const base::TimeDelta &min_t1,
+    const base::TimeDelta &max_t1)
+  : min_t1_(min_t1),
+    max_t1_(max_t1),
+    tick_clock_(nullptr) {
+  DCHECK(min_t1 <= max_t1);
+}
+
+AdaptiveTimeDeltaFactory::~AdaptiveTimeDeltaFactory() {
+}
+
+base::TimeDelta AdaptiveTimeDeltaFactory::GetT1(
+    const EndPoint &destination) const {
+  EstimatesMap::const_iterator i = estimates_.find(destination);
+  if (i == estimates_.end() || Now() - i->second.updated >
+      base::TimeDelta::FromMinutes(kEstimateLifetimeMinutes))
+    return GetDefaultT1();
+  base::TimeDelta rto(i->second.srtt + i->second.rttvar * 4);
+  return std::min(std::max(rto, min_t1_), max_t1_);
+}
+
+TimeDeltaProvider* AdaptiveTimeDeltaFactory::CreateClientNonInvite(
+    const EndPoint &destination) {
+  return CreateRfc3261Provider(CLIENT_NON_INVITE, GetT1(destination));
+}
+
+TimeDeltaProvider* AdaptiveTimeDeltaFactory::CreateClientInvite(
+    const EndPoint &destination) {
+  return CreateRfc3261Provider(CLIENT_INVITE, GetT1(destination));
+}
+
+TimeDeltaProvider* AdaptiveTimeDeltaFactory::CreateServerNonInvite(
+    const EndPoint &destination) {
+  return CreateRfc3261Provider(SERVER_NON_INVITE, GetT1(destination));
+}
+
+TimeDeltaProvider* AdaptiveTimeDeltaFactory::CreateServerInvite(
+    const EndPoint &destination) {
+  return CreateRfc3261Provider(SERVER_INVITE, GetT1(destination));
+}
+
+void AdaptiveTimeDeltaFactory::AddRoundTripSample(
+    const EndPoint &destination,
+    const base::TimeDelta &rtt) {
+  if (rtt < base::TimeDelta())
+    return;
+  base::TimeTicks now(Now());
+  EstimatesMap::iterator i = estimates_.find(destination);
+  if (i != estimates_.end() && now - i->second.updated >
+      base::TimeDelta::FromMinutes(kEstimateLifetimeMinutes)) {
+    estimates_.erase(i);
+    i = estimates_.end();
+  }
+  if (i == estimates_.end()) {
+    if (estimates_.size() >= kMaxDestinations)
+      Evict();
+    // First measurement (RFC 6298 section 2.2).
+    Estimate estimate;
+    estimate.srtt = rtt;
+    estimate.rttvar = rtt / 2;
+    estimate.updated = now;
+    estimates_.insert(std::make_pair(destination, estimate));
+    return;
+  }
+  // Subsequent ones, with alpha = 1/8 and beta = 1/4 (section 2.3).
+  Estimate &estimate = i->second;
+  estimate.rttvar = (estimate.rttvar * 3 +
+                     AbsoluteDifference(estimate.srtt, rtt)) / 4;
+  estimate.srtt = (estimate.srtt * 7 + rtt) / 8;
+  estimate.updated = now;
+}
+
+base::TimeTicks AdaptiveTimeDeltaFactory::Now() const {
+  return tick_clock_ ? tick_clock_->NowTicks() : base::TimeTicks::Now();
+}
+
+void AdaptiveTimeDeltaFactory::Evict() {
+  base::TimeTicks now(Now());
+  EstimatesMap::iterator oldest = estimates_.end();
+  for (EstimatesMap::iterator i = estimates_.begin();
+       i != estimates_.end();) {
+    if (now - i->second.updated >
+        base::TimeDelta::FromMinutes(kEstimateLifetimeMinutes)) {
+      estimates_.erase(i++);
+      continue;
+    }
+    if (oldest == estimates_.end() ||
+        i->second.updated < oldest->second.updated)
+      oldest = i;
+    ++i;
+  }
+  if (estimates_.size() >= kMaxDestinations && oldest != estimates_.end())
+    estimates_.erase(oldest);
+}
+
+}  // namespace sippet
@@ -0,0 +1,83 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_ADAPTIVE_TIME_DELTA_FACTORY_H_
+#define SIPPET_TRANSPORT_ADAPTIVE_TIME_DELTA_FACTORY_H_
+
+#include <map>
+
+#include "base/time/time.h"
+#include "sippet/transport/end_point.h"
+#include "sippet/transport/time_delta_factory.h"
+
+namespace base {
+class TickClock;
+}
+
+namespace sippet {
+
+// Scales the RFC 3261 timers of each destination to its measured round-trip
+// time, instead of the fixed T1 of 500ms. Round trips reported by client
+// transactions are smoothed as TCP does (RFC 6298), and T1 is taken as the
+// retransmission timeout SRTT + 4 * RTTVAR, within [min_t1, max_t1].
+// Destinations without recent samples get the default T1.
+//
+// Loss is then recovered from faster on low-latency networks, and slow links
+// (e.g. satellite) don't get spurious retransmissions. It's meant to be used
+// by a single network layer, from its thread.
+class AdaptiveTimeDeltaFactory : public TimeDeltaFactory {
+ public:
+  // Maximum number of destinations kept.
+  static const size_t kMaxDestinations = 4096;
+
+  AdaptiveTimeDeltaFactory();
+  AdaptiveTimeDeltaFactory(const base::TimeDelta &min_t1,
+                           const base::TimeDelta &max_t1);
+  ~AdaptiveTimeDeltaFactory() override;
+
+  // The T1 currently used for |destination|.
+  base::TimeDelta GetT1(const EndPoint &destination) const;
+
+  // TimeDeltaFactory methods:
+  TimeDeltaProvider* CreateClientNonInvite(
+      const EndPoint &destination) override;
+  TimeDeltaProvider* CreateClientInvite(
+      const EndPoint &destination) override;
+  TimeDeltaProvider* CreateServerNonInvite(
+      const EndPoint &destination) override;
+  TimeDeltaProvider* CreateServerInvite(
+      const EndPoint &destination) override;
+  void AddRoundTripSample(const EndPoint &destination,
+                          const base::TimeDelta &rtt) override;
+
+  void set_tick_clock_for_testing(base::TickClock *tick_clock) {
+    tick_clock_ = tick_clock;
+  }
+
+ private:
+  struct Estimate {
+    base::TimeDelta srtt;
+    base::TimeDelta rttvar;
+    base::TimeTicks updated;
+  };
+
+  typedef std::map<EndPoint, Estimate, EndPointLess> EstimatesMap;
+
+  base::TimeTicks Now() const;
+
+  // Makes room for a new destination, dropping the stale ones, or the least
+  // recently updated one if none is.
+  void Evict();
+
+  base::TimeDelta min_t1_;
+  base::TimeDelta max_t1_;
+  EstimatesMap estimates_;
+  base::TickClock *tick_clock_;
+
+  DISALLOW_COPY_AND_ASSIGN(AdaptiveTimeDeltaFactory);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_ADAPTIVE_TIME_DELTA_FACTORY_H_
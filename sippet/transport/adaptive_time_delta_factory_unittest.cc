@@ -0,0 +1,101 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/adaptive_time_delta_factory.h"
+
+#include "base/memory/scoped_ptr.h"
+#include "base/test/simple_test_tick_clock.h"
+#include "sippet/transport/time_delta_provider.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+base::TimeDelta Milliseconds(int64 ms) {
+  return base::TimeDelta::FromMilliseconds(ms);
+}
+
+}  // namespace
+
+class AdaptiveTimeDeltaFactoryTest : public testing::Test {
+ public:
+  AdaptiveTimeDeltaFactoryTest()
+    : lan_("192.0.2.1", 5060, Protocol::UDP),
+      satellite_("198.51.100.1", 5060, Protocol::UDP) {
+    clock_.Advance(base::TimeDelta::FromSeconds(1));
+    factory_.set_tick_clock_for_testing(&clock_);
+  }
+
+  base::SimpleTestTickClock clock_;
+  AdaptiveTimeDeltaFactory factory_;
+  EndPoint lan_;
+  EndPoint satellite_;
+};
+
+TEST_F(AdaptiveTimeDeltaFactoryTest, DefaultsToRfc3261) {
+  EXPECT_EQ(Milliseconds(500), factory_.GetT1(lan_));
+
+  scoped_ptr<TimeDeltaProvider> provider(
+      factory_.CreateClientNonInvite(lan_));
+  EXPECT_EQ(Milliseconds(500), provider->GetNextRetryDelay());
+  EXPECT_EQ(Milliseconds(1000), provider->GetNextRetryDelay());
+  EXPECT_EQ(Milliseconds(2000), provider->GetNextRetryDelay());
+  EXPECT_EQ(Milliseconds(4000), provider->GetNextRetryDelay());
+  EXPECT_EQ(Milliseconds(4000), provider->GetNextRetryDelay());
+  EXPECT_EQ(base::TimeDelta::FromSeconds(32), provider->GetTimeoutDelay());
+}
+
+TEST_F(AdaptiveTimeDeltaFactoryTest, ScalesToRoundTrips) {
+  for (int i = 0; i < 32; ++i) {
+    factory_.AddRoundTripSample(lan_, Milliseconds(10));
+    factory_.AddRoundTripSample(satellite_, Milliseconds(1200));
+  }
+  // Stable round trips converge to the round trip itself, within bounds.
+  EXPECT_EQ(Milliseconds(50), factory_.GetT1(lan_));
+  base::TimeDelta satellite_t1(factory_.GetT1(satellite_));
+  EXPECT_LE(Milliseconds(1200), satellite_t1);
+  EXPECT_GT(Milliseconds(1300), satellite_t1);
+
+  scoped_ptr<TimeDeltaProvider> provider(
+      factory_.CreateClientInvite(satellite_));
+  EXPECT_EQ(satellite_t1, provider->GetNextRetryDelay());
+  EXPECT_EQ(satellite_t1 * 2, provider->GetNextRetryDelay());
+  EXPECT_EQ(satellite_t1 * 64, provider->GetTimeoutDelay());
+
+  // Other transports to the same address aren't affected.
+  EXPECT_EQ(Milliseconds(500),
+            factory_.GetT1(EndPoint("192.0.2.1", 5060, Protocol::TCP)));
+}
+
+TEST_F(AdaptiveTimeDeltaFactoryTest, FirstSampleIsConservative) {
+  factory_.AddRoundTripSample(lan_, Milliseconds(100));
+  // SRTT + 4 * RTTVAR, with RTTVAR = SRTT / 2
+  EXPECT_EQ(Milliseconds(300), factory_.GetT1(lan_));
+}
+
+TEST_F(AdaptiveTimeDeltaFactoryTest, ForgetsStaleEstimates) {
+  factory_.AddRoundTripSample(lan_, Milliseconds(100));
+  clock_.Advance(base::TimeDelta::FromMinutes(11));
+  EXPECT_EQ(Milliseconds(500), factory_.GetT1(lan_));
+
+  factory_.AddRoundTripSample(lan_, Milliseconds(200));
+  EXPECT_EQ(Milliseconds(600), factory_.GetT1(lan_));
+}
+
+TEST_F(AdaptiveTimeDeltaFactoryTest, BoundsDestinations) {
+  for (size_t i = 0; i <= AdaptiveTimeDeltaFactory::kMaxDestinations; ++i) {
+    factory_.AddRoundTripSample(
+        EndPoint("192.0.2.1", static_cast<uint16>(i + 1), Protocol::UDP),
+        Milliseconds(100));
+    clock_.Advance(Milliseconds(1));
+  }
+  // The least recently updated destination was dropped.
+  EXPECT_EQ(Milliseconds(500),
+            factory_.GetT1(EndPoint("192.0.2.1", 1, Protocol::UDP)));
+  EXPECT_EQ(Milliseconds(300),
+            factory_.GetT1(EndPoint("192.0.2.1", 2, Protocol::UDP)));
+}
+
+}  // namespace sippet
@@ -6,17 +6,17 @@
 #define SIPPET_TRANSPORT_ALIASES_MAP_H_
 
 #include <vector>
-#include <map>
 #include <algorithm>
 #include "sippet/transport/end_point.h"
+#include "base/containers/hash_tables.h"
 #include "base/logging.h"
 
 namespace sippet {
 
 class AliasesMap {
  private:
-  typedef std::map<EndPoint, EndPoint, EndPointLess> ReverseMap;
-  typedef std::map<EndPoint, std::vector<EndPoint>, EndPointLess> ForwardMap;
+  typedef base::hash_map<EndPoint, EndPoint> ReverseMap;
+  typedef base::hash_map<EndPoint, std::vector<EndPoint> > ForwardMap;
   typedef ReverseMap::iterator reverse_iterator;
   typedef ForwardMap::iterator forward_iterator;
 
@@ -9,12 +9,21 @@
 #include "base/rand_util.h"
 #include "base/base64.h"
 #include "base/lazy_instance.h"
+#include "base/logging.h"
 #include "base/strings/string_util.h"
+#include "base/strings/stringprintf.h"
 
 namespace sippet {
 
 namespace {
 
+// Follows the magic cookie in the branches with a shard, and ends the shard.
+const char kShardMarker = 's';
+const char kShardEnd = '.';
+
+// Follows the magic cookie in the branches with a routing token.
+const char kRoutingMarker = '~';
+
 class DefaultBranchFactory : public BranchFactory {
  public:
   DefaultBranchFactory() {}
@@ -33,4 +42,79 @@ BranchFactory *BranchFactory::GetDefaultBranchFactory() {
   return g_default_branch_factory.Pointer();
 }
 
+ShardBranchFactory::ShardBranchFactory(size_t shard)
+  : shard_(shard) {
+}
+
+ShardBranchFactory::~ShardBranchFactory() {
+}
+
+std::string ShardBranchFactory::CreateBranch() {
+  std::string branch(kMagicCookie, sizeof(kMagicCookie) - 1);
+  base::StringAppendF(&branch, "%c%x%c", kShardMarker,
+                      static_cast<unsigned>(shard_), kShardEnd);
+  branch.append(CreateRandomString(72));
+  return branch;
+}
+
+// static
+bool ShardBranchFactory::ShardOfBranch(const std::string &branch,
+                                       size_t *shard) {
+  const size_t cookie_size = sizeof(kMagicCookie) - 1;
+  if (branch.size() < cookie_size + 3
+      || 0 != branch.compare(0, cookie_size, kMagicCookie)
+      || kShardMarker != branch[cookie_size])
+    return false;
+  size_t value = 0;
+  size_t i = cookie_size + 1;
+  // Eight digits are more than enough for any count of threads.
+  for (; i < branch.size() && i < cookie_size + 9; ++i) {
+    char c = branch[i];
+    if (c >= '0' && c <= '9')
+      value = (value << 4) | (c - '0');
+    else if (c >= 'a' && c <= 'f')
+      value = (value << 4) | (c - 'a' + 10);
+    else
+      break;
+  }
+  if (i == cookie_size + 1 || i == branch.size() || kShardEnd != branch[i])
+    return false;
+  *shard = value;
+  return true;
+}
+
+RoutingBranchFactory::RoutingBranchFactory(const RoutingTokenSigner *signer,
+                                           const RoutingToken &token,
+                                           bool timestamped)
+  : signer_(signer),
+    token_(token),
+    timestamped_(timestamped) {
+  DCHECK(signer_);
+}
+
+RoutingBranchFactory::~RoutingBranchFactory() {
+}
+
+std::string RoutingBranchFactory::CreateBranch() {
+  RoutingToken token(token_);
+  if (timestamped_)
+    token.timestamp = base::Time::Now();
+  std::string branch(kMagicCookie, sizeof(kMagicCookie) - 1);
+  branch.push_back(kRoutingMarker);
+  signer_->Append(token, &branch);
+  branch.append(CreateRandomString(48));
+  return branch;
+}
+
+bool RoutingBranchFactory::TokenOfBranch(const std::string &branch,
+                                         RoutingToken *token) const {
+  const size_t cookie_size = sizeof(kMagicCookie) - 1;
+  if (branch.size() <= cookie_size
+      || 0 != branch.compare(0, cookie_size, kMagicCookie)
+      || kRoutingMarker != branch[cookie_size])
+    return false;
+  return signer_->Read(base::StringPiece(branch).substr(cookie_size + 1),
+                       token);
+}
+
 }  // namespace sippet
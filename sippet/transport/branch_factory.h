@@ -7,6 +7,9 @@
 
 #include <string>
 
+#include "base/basictypes.h"
+#include "sippet/base/routing_token.h"
+
 namespace sippet {
 
 class BranchFactory {
@@ -18,6 +21,58 @@ class BranchFactory {
   static BranchFactory *GetDefaultBranchFactory();
 };
 
+// Creates branches telling which shard of a |NetworkLayerShards| sent the
+// request, so that a response received by another shard (e.g. when several
+// sockets share a port) can be routed back to it. The shard is given in
+// hexadecimal right after the magic cookie, as in "z9hG4bKs3.Vh29Ae+QpX.w".
+class ShardBranchFactory : public BranchFactory {
+ public:
+  explicit ShardBranchFactory(size_t shard);
+  ~ShardBranchFactory() override;
+
+  size_t shard() const { return shard_; }
+
+  // sippet::BranchFactory methods:
+  std::string CreateBranch() override;
+
+  // Gets the shard from a branch created by this factory. Returns false if
+  // |branch| has no shard.
+  static bool ShardOfBranch(const std::string &branch, size_t *shard);
+
+ private:
+  size_t shard_;
+
+  DISALLOW_COPY_AND_ASSIGN(ShardBranchFactory);
+};
+
+// Creates branches carrying an authenticated |RoutingToken| right after the
+// magic cookie, followed by 48 random bits, so that any node of a cluster
+// sharing the key can tell where the transaction lives, as in
+// "z9hG4bK~EAADAAFUxvXSMqB4Ef+Q7.Vh29Ae".
+class RoutingBranchFactory : public BranchFactory {
+ public:
+  // The |signer| is not owned, and must outlive the factory. If
+  // |timestamped|, tokens carry the time they were created at.
+  RoutingBranchFactory(const RoutingTokenSigner *signer,
+                       const RoutingToken &token,
+                       bool timestamped);
+  ~RoutingBranchFactory() override;
+
+  // sippet::BranchFactory methods:
+  std::string CreateBranch() override;
+
+  // Gets the token from a branch created by a factory using the same key.
+  // Returns false if |branch| has none.
+  bool TokenOfBranch(const std::string &branch, RoutingToken *token) const;
+
+ private:
+  const RoutingTokenSigner *signer_;
+  RoutingToken token_;
+  bool timestamped_;
+
+  DISALLOW_COPY_AND_ASSIGN(RoutingBranchFactory);
+};
+
 } // End of sippet namespace
 
 #endif // SIPPET_TRANSPORT_BRANCH_FACTORY_H_
@@ -8,8 +8,14 @@
 #include "net/base/completion_callback.h"
 #include "net/base/net_export.h"
 #include "net/base/address_list.h"
+#include "net/base/net_errors.h"
 #include "base/memory/ref_counted.h"
+#include "base/strings/string_piece.h"
+#include "sippet/message/parse_profile.h"
 #include "sippet/transport/end_point.h"
+#include "sippet/transport/message_limits.h"
+#include "sippet/transport/socket_options.h"
+#include "sippet/transport/write_queue_limits.h"
 
 namespace net {
 class SSLInfo;
@@ -45,6 +51,30 @@ class NET_EXPORT_PRIVATE Channel :
     virtual void OnSSLCertificateError(const scoped_refptr<Channel> &channel,
                                        const net::SSLInfo &ssl_info,
                                        bool fatal) = 0;
+
+    // Called when a CRLF keep-alive is received from a stream channel, such
+    // as the pong answering |Channel::SendKeepAlive|. Pings from the peer
+    // are answered by the channel itself.
+    virtual void OnKeepAliveReceived(const scoped_refptr<Channel> &channel) {}
+
+    // Called when a message is written to the channel, once serialized, so
+    // that its |Message::SerializedWire| is the data being sent.
+    virtual void OnOutgoingMessage(const scoped_refptr<Channel> &channel,
+                                   const scoped_refptr<Message> &message) {}
+
+    // Called when the messages queued by the channel reach one of the high
+    // watermarks given to |Channel::SetWriteQueueLimits|.
+    virtual void OnChannelCongested(const scoped_refptr<Channel> &channel) {}
+
+    // Called when a congested channel drains back to its low watermarks.
+    virtual void OnChannelWritable(const scoped_refptr<Channel> &channel) {}
+
+    // Called by datagram transports with the head of each incoming message
+    // before it's parsed. Returns true if the message was absorbed as the
+    // retransmission of a request, so that it's dropped without parsing.
+    virtual bool AbsorbRetransmission(const base::StringPiece &head) {
+      return false;
+    }
   };
 
   Channel() {}
@@ -89,6 +119,40 @@ class NET_EXPORT_PRIVATE Channel :
   virtual int Send(const scoped_refptr<Message> &message,
                    const net::CompletionCallback& callback) = 0;
 
+  // Writes a keep-alive ping, a double CRLF (RFC 5626 section 4.4.1), to
+  // the underlying socket. The peer answers with a pong, reported by
+  // |Delegate::OnKeepAliveReceived|. Channels without CRLF keep-alives
+  // return |net::ERR_NOT_IMPLEMENTED|.
+  virtual int SendKeepAlive(const net::CompletionCallback& callback) {
+    return net::ERR_NOT_IMPLEMENTED;
+  }
+
+  // Limits the messages queued while the socket can't take them, see
+  // |WriteQueueLimits|. Channels that don't queue ignore it.
+  virtual void SetWriteQueueLimits(const WriteQueueLimits &limits) {}
+
+  // Bytes of the messages queued while the socket can't take them. Channels
+  // that don't queue have none.
+  virtual size_t queued_write_bytes() const { return 0; }
+
+  // Selects the headers decoded as soon as incoming messages are parsed,
+  // see |ParseProfile|. Channels that don't parse ignore it.
+  virtual void SetParseProfile(const ParseProfile &profile) {}
+
+  // Bounds the incoming messages, see |MessageLimits|. Channels that don't
+  // parse ignore it.
+  virtual void SetMessageLimits(const MessageLimits &limits) {}
+
+  // Sets the options of the socket, see |SocketOptions|. Called before
+  // |Connect|. Channels without a socket of their own ignore it.
+  virtual void SetSocketOptions(const SocketOptions &options) {}
+
+  // Lets the channel decode compressed incoming messages, and compress the
+  // outgoing ones once its peer has shown it can decode them, see
+  // |MessageCompressor|. Returns false if the channel can't, in which case
+  // its Vias must not advertise it.
+  virtual bool EnableCompression() { return false; }
+
   // Requests to close the connection.
   // Once the connection is closed, calls delegate's OnClose.
   virtual void Close() = 0;
@@ -18,6 +18,11 @@ class ChannelFactory {
     const EndPoint &destination,
     Channel::Delegate *delegate,
     scoped_refptr<Channel> *channel) = 0;
+
+  // Resolves the host of |destination| ahead of the channels created to
+  // it, so that they find the addresses cached. Factories whose channels
+  // don't resolve hosts ignore it.
+  virtual void PrefetchHost(const EndPoint &destination) {}
 };
 
 } /// End of sippet namespace
@@ -0,0 +1,73 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_CHANNEL_LISTENER_H_
+#define SIPPET_TRANSPORT_CHANNEL_LISTENER_H_
+
+#include "base/memory/ref_counted.h"
+#include "sippet/transport/end_point.h"
+#include "sippet/transport/channel.h"
+
+namespace sippet {
+
+class ParsePool;
+class SourceRateLimiter;
+
+// The server side counterpart of |ChannelFactory|: it binds to a local
+// address and creates a |Channel| for each inbound peer, be it an accepted
+// connection or the source address of datagrams sharing a bound socket.
+class ChannelListener {
+ public:
+  class Delegate {
+   public:
+    virtual ~Delegate() {}
+
+    // Called when a new inbound channel is available. The channel is already
+    // connected and reading, and reports to the |Channel::Delegate| given to
+    // |Listen|.
+    virtual void OnChannelAccepted(const scoped_refptr<Channel> &channel) = 0;
+  };
+
+  virtual ~ChannelListener() {}
+
+  // Selects the headers decoded as soon as incoming messages are parsed, for
+  // messages read by the listener itself (e.g. datagrams from new peers).
+  // Called before |Listen|. Listeners that don't parse ignore it.
+  virtual void SetParseProfile(const ParseProfile &profile) {}
+
+  // Bounds the messages read by the listener itself, see |MessageLimits|.
+  // Called before |Listen|. Listeners that don't parse ignore it.
+  virtual void SetMessageLimits(const MessageLimits &limits) {}
+
+  // Sets the options of the bound socket, and of the connections accepted
+  // on it, from the profile of the protocol listened to in |profiles|, see
+  // |SocketOptions|. Called before |Listen|.
+  virtual void SetSocketOptions(const SocketOptionsMap &profiles) {}
+
+  // Parses the messages read by the listener itself on |parse_pool|, which
+  // outlives the listener, instead of its own thread. Called before
+  // |Listen|, only when the network layer has a pool. Listeners that don't
+  // parse, or can't hand over raw messages, ignore it.
+  virtual void SetParsePool(ParsePool *parse_pool) {}
+
+  // Drops what comes from sources over the rate of |rate_limiter|, which
+  // outlives the listener, before it's parsed: each datagram takes a token,
+  // as does each accepted connection. Called before |Listen|, only when the
+  // network layer has a limiter.
+  virtual void SetRateLimiter(SourceRateLimiter *rate_limiter) {}
+
+  // Starts accepting inbound channels. Returns a network error code.
+  virtual int Listen(Delegate *delegate,
+                     Channel::Delegate *channel_delegate) = 0;
+
+  // The local address being listened to, available after |Listen|.
+  virtual int GetLocalEndPoint(EndPoint *local_end_point) const = 0;
+
+  // Stops accepting new channels; the already accepted ones are kept.
+  virtual void Close() = 0;
+};
+
+} /// End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_CHANNEL_LISTENER_H_
@@ -3,24 +3,101 @@
 // found in the LICENSE file.
 
 #include "sippet/transport/chrome/chrome_channel_factory.h"
+
+#include <algorithm>
+
 #include "sippet/transport/chrome/chrome_stream_channel.h"
 #include "sippet/transport/chrome/chrome_datagram_channel.h"
+#include "base/bind.h"
+#include "base/hash.h"
+#include "base/stl_util.h"
+#include "net/base/address_list.h"
+#include "net/base/ip_address_number.h"
 #include "net/base/net_errors.h"
+#include "net/dns/single_request_host_resolver.h"
 #include "net/socket/client_socket_factory.h"
+#include "net/url_request/url_request_context.h"
 
 namespace sippet {
 
+namespace {
+
+// The non-AEAD cipher suites that may be negotiated by default.
+const uint16 kNonAeadCipherSuites[] = {
+  0x0004,  // TLS_RSA_WITH_RC4_128_MD5
+  0x0005,  // TLS_RSA_WITH_RC4_128_SHA
+  0x000a,  // TLS_RSA_WITH_3DES_EDE_CBC_SHA
+  0x0016,  // TLS_DHE_RSA_WITH_3DES_EDE_CBC_SHA
+  0x002f,  // TLS_RSA_WITH_AES_128_CBC_SHA
+  0x0033,  // TLS_DHE_RSA_WITH_AES_128_CBC_SHA
+  0x0035,  // TLS_RSA_WITH_AES_256_CBC_SHA
+  0x0039,  // TLS_DHE_RSA_WITH_AES_256_CBC_SHA
+  0x003c,  // TLS_RSA_WITH_AES_128_CBC_SHA256
+  0x003d,  // TLS_RSA_WITH_AES_256_CBC_SHA256
+  0x0067,  // TLS_DHE_RSA_WITH_AES_128_CBC_SHA256
+  0x006b,  // TLS_DHE_RSA_WITH_AES_256_CBC_SHA256
+  0xc007,  // TLS_ECDHE_ECDSA_WITH_RC4_128_SHA
+  0xc008,  // TLS_ECDHE_ECDSA_WITH_3DES_EDE_CBC_SHA
+  0xc009,  // TLS_ECDHE_ECDSA_WITH_AES_128_CBC_SHA
+  0xc00a,  // TLS_ECDHE_ECDSA_WITH_AES_256_CBC_SHA
+  0xc011,  // TLS_ECDHE_RSA_WITH_RC4_128_SHA
+  0xc012,  // TLS_ECDHE_RSA_WITH_3DES_EDE_CBC_SHA
+  0xc013,  // TLS_ECDHE_RSA_WITH_AES_128_CBC_SHA
+  0xc014,  // TLS_ECDHE_RSA_WITH_AES_256_CBC_SHA
+  0xc023,  // TLS_ECDHE_ECDSA_WITH_AES_128_CBC_SHA256
+  0xc024,  // TLS_ECDHE_ECDSA_WITH_AES_256_CBC_SHA384
+  0xc027,  // TLS_ECDHE_RSA_WITH_AES_128_CBC_SHA256
+  0xc028,  // TLS_ECDHE_RSA_WITH_AES_256_CBC_SHA384
+};
+
+}  // namespace
+
+struct ChromeChannelFactory::HostPrefetch {
+  explicit HostPrefetch(net::HostResolver *host_resolver)
+    : resolver(host_resolver) {}
+
+  net::SingleRequestHostResolver resolver;
+  net::AddressList addresses;
+};
+
 ChromeChannelFactory::ChromeChannelFactory(
     net::ClientSocketFactory* client_socket_factory,
     const scoped_refptr<net::URLRequestContextGetter>& request_context_getter,
     const net::SSLConfig& ssl_config)
     : client_socket_factory_(client_socket_factory),
       request_context_getter_(request_context_getter),
-      ssl_config_(ssl_config) {
+      ssl_config_(ssl_config),
+      proxy_decision_cache_(base::TimeDelta::FromSeconds(
+          ProxyDecisionCache::kDefaultTtlSeconds)) {
   CHECK(client_socket_factory_);
 }
 
 ChromeChannelFactory::~ChromeChannelFactory() {
+  // Cancels the pending resolutions.
+  STLDeleteValues(&host_prefetches_);
+}
+
+// static
+void ChromeChannelFactory::RestrictToAeadCipherSuites(
+    net::SSLConfig *ssl_config) {
+  DCHECK(ssl_config);
+  // AEAD suites can't be negotiated before TLS 1.2.
+  ssl_config->version_min = std::max(ssl_config->version_min,
+      static_cast<uint16>(net::SSL_PROTOCOL_VERSION_TLS1_2));
+  ssl_config->version_max = std::max(ssl_config->version_max,
+      ssl_config->version_min);
+  std::vector<uint16> &disabled = ssl_config->disabled_cipher_suites;
+  for (size_t i = 0; i < arraysize(kNonAeadCipherSuites); ++i) {
+    if (std::find(disabled.begin(), disabled.end(), kNonAeadCipherSuites[i])
+        == disabled.end())
+      disabled.push_back(kNonAeadCipherSuites[i]);
+  }
+}
+
+void ChromeChannelFactory::AddDatagramListener(
+    ChromeDatagramListener *listener) {
+  DCHECK(listener);
+  datagram_listeners_.push_back(listener);
 }
 
 int ChromeChannelFactory::CreateChannel(
@@ -29,15 +106,57 @@ int ChromeChannelFactory::CreateChannel(
     scoped_refptr<Channel> *channel) {
   if (destination.protocol() == sippet::Protocol::TCP
       || destination.protocol() == sippet::Protocol::TLS) {
-    *channel = new ChromeStreamChannel(destination, delegate,
-        client_socket_factory_, request_context_getter_, ssl_config_);
+    scoped_refptr<ChromeStreamChannel> stream_channel(
+        new ChromeStreamChannel(destination, delegate,
+            client_socket_factory_, request_context_getter_, ssl_config_));
+    stream_channel->set_proxy_decision_cache(&proxy_decision_cache_);
+    *channel = stream_channel;
     return net::OK;
   } else if (destination.protocol() == sippet::Protocol::UDP) {
+    ChromeDatagramListener *listener = nullptr;
+    if (!datagram_listeners_.empty()) {
+      listener = datagram_listeners_[
+          base::Hash(destination.ToString()) % datagram_listeners_.size()];
+    }
     *channel = new ChromeDatagramChannel(destination, delegate,
-        client_socket_factory_, request_context_getter_);
+        client_socket_factory_, request_context_getter_, listener);
     return net::OK;
   }
   return net::ERR_NOT_IMPLEMENTED;
 }
 
+void ChromeChannelFactory::PrefetchHost(const EndPoint &destination) {
+  const std::string &host = destination.host();
+  net::IPAddressNumber ip_address;
+  if (host.empty() || net::ParseIPLiteralToNumber(host, &ip_address)
+      || host_prefetches_.count(host))
+    return;
+  net::HostResolver *host_resolver =
+      request_context_getter_->GetURLRequestContext()->host_resolver();
+  net::HostResolver::RequestInfo request_info(destination.hostport());
+  request_info.set_is_speculative(true);
+  net::AddressList addresses;
+  if (net::OK == host_resolver->ResolveFromCache(request_info, &addresses,
+                                                 net::BoundNetLog()))
+    return;
+  scoped_ptr<HostPrefetch> prefetch(new HostPrefetch(host_resolver));
+  int rv = prefetch->resolver.Resolve(request_info, net::IDLE,
+      &prefetch->addresses,
+      base::Bind(&ChromeChannelFactory::OnPrefetchHostDone,
+                 base::Unretained(this), host),
+      net::BoundNetLog());
+  if (net::ERR_IO_PENDING == rv)
+    host_prefetches_[host] = prefetch.release();
+}
+
+void ChromeChannelFactory::OnPrefetchHostDone(const std::string &host,
+                                              int result) {
+  DVLOG_IF(1, net::OK != result) << "Couldn't prefetch " << host << ": "
+                                 << net::ErrorToString(result);
+  HostPrefetchMap::iterator i = host_prefetches_.find(host);
+  DCHECK(host_prefetches_.end() != i);
+  delete i->second;
+  host_prefetches_.erase(i);
+}
+
 }  // namespace sippet
@@ -5,7 +5,12 @@
 #ifndef SIPPET_TRANSPORT_CHROME_CHROME_SOCKET_CHANNEL_FACTORY_H_
 #define SIPPET_TRANSPORT_CHROME_CHROME_SOCKET_CHANNEL_FACTORY_H_
 
+#include <map>
+#include <string>
+#include <vector>
+
 #include "sippet/transport/channel_factory.h"
+#include "sippet/transport/chrome/proxy_decision_cache.h"
 #include "base/memory/ref_counted.h"
 #include "net/ssl/ssl_config_service.h"
 #include "net/url_request/url_request_context_getter.h"
@@ -16,6 +21,8 @@ class ClientSocketFactory;
 
 namespace sippet {
 
+class ChromeDatagramListener;
+
 class ChromeChannelFactory : public ChannelFactory {
  public:
   ChromeChannelFactory(net::ClientSocketFactory* client_socket_factory,
@@ -23,15 +30,47 @@ class ChromeChannelFactory : public ChannelFactory {
       const net::SSLConfig& ssl_config);
   ~ChromeChannelFactory();
 
+  // Restricts |ssl_config| to TLS 1.2 sessions with AEAD cipher suites
+  // (AES-GCM, ChaCha20-Poly1305), dropping the CBC, RC4 and 3DES ones. Their
+  // records are the cheapest to encrypt in userspace, where AES-GCM runs on
+  // the CPU's own instructions, with no record splitting or separate MAC;
+  // they are also the only suites that kernel TLS offload could take over.
+  // Peers must support them, which TLS 1.2 trunks normally do. It applies
+  // to the configuration of a |ChromeStreamListener| as well. Phones apply it
+  // when |Settings::aead_cipher_suites_only| is set.
+  static void RestrictToAeadCipherSuites(net::SSLConfig *ssl_config);
+
+  // Makes UDP channels share the socket of |listener|, instead of opening a
+  // connected socket per destination, so that the number of sockets stays
+  // the same no matter how many peers there are. When several listeners are
+  // added, destinations are spread across them. Listeners are not owned, and
+  // must outlive the channels created afterwards.
+  void AddDatagramListener(ChromeDatagramListener *listener);
+
   int CreateChannel(
     const EndPoint &destination,
     Channel::Delegate *delegate,
     scoped_refptr<Channel> *channel) override;
 
+  // Resolves through the host resolver of the request context, whose cache
+  // the channels look up. Hosts already cached, or being resolved, and IP
+  // literals aren't resolved again.
+  void PrefetchHost(const EndPoint &destination) override;
+
  private:
+  struct HostPrefetch;
+  // Keyed by the host being resolved.
+  typedef std::map<std::string, HostPrefetch*> HostPrefetchMap;
+
+  void OnPrefetchHostDone(const std::string &host, int result);
+
   net::ClientSocketFactory* const client_socket_factory_;
   scoped_refptr<net::URLRequestContextGetter> request_context_getter_;
   net::SSLConfig ssl_config_;
+  std::vector<ChromeDatagramListener*> datagram_listeners_;
+  // Shared by the stream channels, see |ProxyDecisionCache|.
+  ProxyDecisionCache proxy_decision_cache_;
+  HostPrefetchMap host_prefetches_;
 
   DISALLOW_COPY_AND_ASSIGN(ChromeChannelFactory);
 };
@@ -0,0 +1,60 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/chrome/chrome_channel_factory.h"
+
+#include <algorithm>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+bool IsDisabled(const net::SSLConfig &ssl_config, uint16 cipher_suite) {
+  const std::vector<uint16> &disabled = ssl_config.disabled_cipher_suites;
+  return disabled.end() != std::find(disabled.begin(), disabled.end(),
+                                     cipher_suite);
+}
+
+}  // namespace
+
+TEST(ChromeChannelFactoryTest, RestrictToAeadCipherSuites) {
+  net::SSLConfig ssl_config;
+  ssl_config.version_min = net::SSL_PROTOCOL_VERSION_TLS1;
+  ChromeChannelFactory::RestrictToAeadCipherSuites(&ssl_config);
+
+  EXPECT_EQ(net::SSL_PROTOCOL_VERSION_TLS1_2, ssl_config.version_min);
+  EXPECT_LE(ssl_config.version_min, ssl_config.version_max);
+
+  // CBC, RC4 and 3DES suites are gone.
+  EXPECT_TRUE(IsDisabled(ssl_config, 0x0005));  // RSA_WITH_RC4_128_SHA
+  EXPECT_TRUE(IsDisabled(ssl_config, 0x000a));  // RSA_WITH_3DES_EDE_CBC_SHA
+  EXPECT_TRUE(IsDisabled(ssl_config, 0x002f));  // RSA_WITH_AES_128_CBC_SHA
+  EXPECT_TRUE(IsDisabled(ssl_config, 0xc013));  // ECDHE_RSA_..._128_CBC_SHA
+  EXPECT_TRUE(IsDisabled(ssl_config, 0xc028));  // ECDHE_RSA_..._256_CBC_SHA384
+
+  // AEAD suites are left.
+  EXPECT_FALSE(IsDisabled(ssl_config, 0x009c));  // RSA_WITH_AES_128_GCM_SHA256
+  EXPECT_FALSE(IsDisabled(ssl_config, 0xc02b));  // ECDHE_ECDSA_..._GCM_SHA256
+  EXPECT_FALSE(IsDisabled(ssl_config, 0xc02f));  // ECDHE_RSA_..._GCM_SHA256
+  EXPECT_FALSE(IsDisabled(ssl_config, 0xcc13));  // ECDHE_RSA_..._CHACHA20
+}
+
+TEST(ChromeChannelFactoryTest, RestrictKeepsDisabledSuites) {
+  net::SSLConfig ssl_config;
+  ssl_config.disabled_cipher_suites.push_back(0x009c);
+  ssl_config.disabled_cipher_suites.push_back(0x002f);
+  ChromeChannelFactory::RestrictToAeadCipherSuites(&ssl_config);
+  size_t size = ssl_config.disabled_cipher_suites.size();
+
+  // Suites disabled beforehand stay so, and none is listed twice.
+  EXPECT_TRUE(IsDisabled(ssl_config, 0x009c));
+  EXPECT_EQ(1, std::count(ssl_config.disabled_cipher_suites.begin(),
+                          ssl_config.disabled_cipher_suites.end(), 0x002f));
+  ChromeChannelFactory::RestrictToAeadCipherSuites(&ssl_config);
+  EXPECT_EQ(size, ssl_config.disabled_cipher_suites.size());
+}
+
+} // End of sippet namespace
@@ -0,0 +1,159 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/chrome/chrome_connection_racer.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/logging.h"
+#include "net/base/net_errors.h"
+#include "net/socket/client_socket_factory.h"
+#include "net/socket/stream_socket.h"
+
+namespace sippet {
+
+ChromeConnectionRacer::ChromeConnectionRacer(
+    net::ClientSocketFactory *client_socket_factory,
+    const net::BoundNetLog &bound_net_log,
+    const base::TimeDelta &attempt_delay)
+  : client_socket_factory_(client_socket_factory),
+    bound_net_log_(bound_net_log),
+    attempt_delay_(attempt_delay),
+    next_address_(0),
+    last_error_(net::OK),
+    weak_ptr_factory_(this) {
+  DCHECK(client_socket_factory_);
+}
+
+ChromeConnectionRacer::~ChromeConnectionRacer() {
+}
+
+int ChromeConnectionRacer::Connect(const net::AddressList &addresses,
+                                   const net::CompletionCallback &callback) {
+  DCHECK(callback_.is_null());
+  DCHECK(attempts_.empty());
+  if (addresses.empty())
+    return net::ERR_NAME_NOT_RESOLVED;
+  addresses_ = InterleaveAddressFamilies(addresses);
+  next_address_ = 0;
+  last_error_ = net::ERR_CONNECTION_FAILED;
+  socket_.reset();
+  int result = StartAttempts();
+  if (result == net::ERR_IO_PENDING)
+    callback_ = callback;
+  return result;
+}
+
+scoped_ptr<net::StreamSocket> ChromeConnectionRacer::PassSocket() {
+  DCHECK(socket_);
+  return socket_.Pass();
+}
+
+net::AddressList ChromeConnectionRacer::InterleaveAddressFamilies(
+    const net::AddressList &addresses) {
+  if (addresses.empty())
+    return addresses;
+  net::AddressFamily first_family = addresses.front().GetFamily();
+  std::vector<net::IPEndPoint> first, second;
+  for (net::AddressList::const_iterator i = addresses.begin(),
+       ie = addresses.end(); i != ie; ++i) {
+    if (i->GetFamily() == first_family)
+      first.push_back(*i);
+    else
+      second.push_back(*i);
+  }
+  net::AddressList result;
+  result.set_canonical_name(addresses.canonical_name());
+  for (size_t i = 0; i < std::max(first.size(), second.size()); ++i) {
+    if (i < first.size())
+      result.push_back(first[i]);
+    if (i < second.size())
+      result.push_back(second[i]);
+  }
+  return result;
+}
+
+int ChromeConnectionRacer::StartAttempts() {
+  while (next_address_ < addresses_.size()) {
+    scoped_ptr<net::StreamSocket> socket(
+        client_socket_factory_->CreateTransportClientSocket(
+            net::AddressList(addresses_[next_address_++]),
+            bound_net_log_.net_log(), bound_net_log_.source()));
+    net::StreamSocket *attempt = socket.get();
+    attempts_.push_back(socket.release());
+    int result = attempt->Connect(
+        base::Bind(&ChromeConnectionRacer::OnAttemptComplete,
+                   weak_ptr_factory_.GetWeakPtr(), attempt));
+    if (result == net::ERR_IO_PENDING) {
+      if (next_address_ < addresses_.size()) {
+        attempt_timer_.Start(FROM_HERE, attempt_delay_, this,
+            &ChromeConnectionRacer::OnAttemptTimer);
+      }
+      return net::ERR_IO_PENDING;
+    }
+    if (result == net::OK) {
+      Win(attempt);
+      return net::OK;
+    }
+    DVLOG(1) << "Connection attempt failed: " << net::ErrorToString(result);
+    last_error_ = result;
+    RemoveAttempt(attempt);
+  }
+  return attempts_.empty() ? last_error_ : net::ERR_IO_PENDING;
+}
+
+void ChromeConnectionRacer::OnAttemptTimer() {
+  int result = StartAttempts();
+  if (result != net::ERR_IO_PENDING)
+    DoCallback(result);
+}
+
+void ChromeConnectionRacer::OnAttemptComplete(net::StreamSocket *socket,
+                                              int result) {
+  DCHECK_NE(net::ERR_IO_PENDING, result);
+  if (result == net::OK) {
+    Win(socket);
+    DoCallback(net::OK);
+    return;
+  }
+  DVLOG(1) << "Connection attempt failed: " << net::ErrorToString(result);
+  last_error_ = result;
+  RemoveAttempt(socket);
+  // Don't wait for the delay to try the next address.
+  attempt_timer_.Stop();
+  result = StartAttempts();
+  if (result != net::ERR_IO_PENDING)
+    DoCallback(result);
+}
+
+void ChromeConnectionRacer::RemoveAttempt(net::StreamSocket *socket) {
+  ScopedVector<net::StreamSocket>::iterator i =
+      std::find(attempts_.begin(), attempts_.end(), socket);
+  DCHECK(i != attempts_.end());
+  attempts_.erase(i);
+}
+
+void ChromeConnectionRacer::Win(net::StreamSocket *socket) {
+  ScopedVector<net::StreamSocket>::iterator i =
+      std::find(attempts_.begin(), attempts_.end(), socket);
+  DCHECK(i != attempts_.end());
+  attempts_.weak_erase(i);
+  socket_.reset(socket);
+  // Cancel the other attempts.
+  attempt_timer_.Stop();
+  attempts_.clear();
+  weak_ptr_factory_.InvalidateWeakPtrs();
+}
+
+void ChromeConnectionRacer::DoCallback(int result) {
+  DCHECK_NE(net::ERR_IO_PENDING, result);
+  DCHECK(!callback_.is_null());
+  net::CompletionCallback c = callback_;
+  callback_.Reset();
+  c.Run(result);
+}
+
+}  // namespace sippet
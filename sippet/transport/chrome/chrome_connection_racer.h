@@ -0,0 +1,83 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_CHROME_CHROME_CONNECTION_RACER_H_
+#define SIPPET_TRANSPORT_CHROME_CHROME_CONNECTION_RACER_H_
+
+#include "base/memory/scoped_ptr.h"
+#include "base/memory/scoped_vector.h"
+#include "base/memory/weak_ptr.h"
+#include "base/time/time.h"
+#include "base/timer/timer.h"
+#include "net/base/address_list.h"
+#include "net/base/completion_callback.h"
+#include "net/log/net_log.h"
+
+namespace net {
+class ClientSocketFactory;
+class StreamSocket;
+}
+
+namespace sippet {
+
+// Connects to the first reachable address of a list, the Happy Eyeballs way
+// (RFC 8305): instead of waiting for each address to time out before trying
+// the next one, a new attempt is started every |attempt_delay|, or as soon
+// as the previous one fails, and the first socket to connect wins. Address
+// families are interleaved, so that a broken IPv6 path doesn't delay IPv4
+// and vice versa. Losing attempts are cancelled.
+class ChromeConnectionRacer {
+ public:
+  // The connection attempt delay recommended by RFC 8305.
+  static const int kDefaultAttemptDelayMs = 250;
+
+  ChromeConnectionRacer(net::ClientSocketFactory *client_socket_factory,
+                        const net::BoundNetLog &bound_net_log,
+                        const base::TimeDelta &attempt_delay);
+  ~ChromeConnectionRacer();
+
+  // Returns |net::OK| once connected, a network error if all addresses
+  // failed, or |net::ERR_IO_PENDING| and then runs |callback| later.
+  // Destroying the racer cancels all pending attempts.
+  int Connect(const net::AddressList &addresses,
+              const net::CompletionCallback &callback);
+
+  // Returns the connected socket, after a successful |Connect|.
+  scoped_ptr<net::StreamSocket> PassSocket();
+
+  // Alternates the address families of |addresses|, starting with the
+  // family of the first one, and keeping the order within each family.
+  static net::AddressList InterleaveAddressFamilies(
+      const net::AddressList &addresses);
+
+ private:
+  // Starts attempts until one of them is pending. Returns |net::OK| if one
+  // connected, |net::ERR_IO_PENDING| while any is pending, or the last
+  // error once all of them failed.
+  int StartAttempts();
+  void OnAttemptTimer();
+  void OnAttemptComplete(net::StreamSocket *socket, int result);
+  void RemoveAttempt(net::StreamSocket *socket);
+  void Win(net::StreamSocket *socket);
+  void DoCallback(int result);
+
+  net::ClientSocketFactory *client_socket_factory_;
+  net::BoundNetLog bound_net_log_;
+  base::TimeDelta attempt_delay_;
+  net::AddressList addresses_;
+  size_t next_address_;
+  ScopedVector<net::StreamSocket> attempts_;
+  scoped_ptr<net::StreamSocket> socket_;
+  int last_error_;
+  net::CompletionCallback callback_;
+  base::OneShotTimer<ChromeConnectionRacer> attempt_timer_;
+
+  base::WeakPtrFactory<ChromeConnectionRacer> weak_ptr_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChromeConnectionRacer);
+};
+
+} /// End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_CHROME_CHROME_CONNECTION_RACER_H_
@@ -0,0 +1,122 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/chrome/chrome_connection_racer.h"
+
+#include "net/base/ip_address_number.h"
+#include "net/base/net_errors.h"
+#include "net/base/test_completion_callback.h"
+#include "net/socket/socket_test_util.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+net::IPEndPoint MakeEndPoint(const char *address, int port) {
+  net::IPAddressNumber number;
+  EXPECT_TRUE(net::ParseIPLiteralToNumber(address, &number));
+  return net::IPEndPoint(number, port);
+}
+
+}  // namespace
+
+class ChromeConnectionRacerTest : public testing::Test {
+ public:
+  ChromeConnectionRacerTest() {
+    addresses_.push_back(MakeEndPoint("2001:db8::1", 5061));
+    addresses_.push_back(MakeEndPoint("192.0.2.1", 5061));
+  }
+
+  void CreateRacer(const base::TimeDelta &attempt_delay) {
+    racer_.reset(new ChromeConnectionRacer(&socket_factory_,
+        net::BoundNetLog(), attempt_delay));
+  }
+
+  void AddConnect(net::StaticSocketDataProvider *data,
+                  net::IoMode mode, int result) {
+    data->set_connect_data(net::MockConnect(mode, result));
+    socket_factory_.AddSocketDataProvider(data);
+  }
+
+  net::MockClientSocketFactory socket_factory_;
+  net::AddressList addresses_;
+  scoped_ptr<ChromeConnectionRacer> racer_;
+  net::TestCompletionCallback callback_;
+};
+
+TEST_F(ChromeConnectionRacerTest, InterleavesAddressFamilies) {
+  net::AddressList addresses;
+  addresses.push_back(MakeEndPoint("2001:db8::1", 5060));
+  addresses.push_back(MakeEndPoint("2001:db8::2", 5060));
+  addresses.push_back(MakeEndPoint("2001:db8::3", 5060));
+  addresses.push_back(MakeEndPoint("192.0.2.1", 5060));
+  addresses.push_back(MakeEndPoint("192.0.2.2", 5060));
+
+  net::AddressList result(
+      ChromeConnectionRacer::InterleaveAddressFamilies(addresses));
+  ASSERT_EQ(5u, result.size());
+  EXPECT_EQ(addresses[0], result[0]);
+  EXPECT_EQ(addresses[3], result[1]);
+  EXPECT_EQ(addresses[1], result[2]);
+  EXPECT_EQ(addresses[4], result[3]);
+  EXPECT_EQ(addresses[2], result[4]);
+}
+
+TEST_F(ChromeConnectionRacerTest, FirstAddressConnects) {
+  net::StaticSocketDataProvider data;
+  AddConnect(&data, net::SYNCHRONOUS, net::OK);
+
+  CreateRacer(base::TimeDelta());
+  EXPECT_EQ(net::OK, racer_->Connect(addresses_, callback_.callback()));
+
+  scoped_ptr<net::StreamSocket> socket(racer_->PassSocket());
+  net::IPEndPoint peer;
+  ASSERT_EQ(net::OK, socket->GetPeerAddress(&peer));
+  EXPECT_EQ(addresses_[0], peer);
+}
+
+TEST_F(ChromeConnectionRacerTest, StalledAttemptIsRaced) {
+  // The IPv6 attempt never completes, so the IPv4 one is started after the
+  // attempt delay, and it wins.
+  net::StaticSocketDataProvider stalled, data;
+  AddConnect(&stalled, net::SYNCHRONOUS, net::ERR_IO_PENDING);
+  AddConnect(&data, net::ASYNC, net::OK);
+
+  CreateRacer(base::TimeDelta::FromMilliseconds(1));
+  ASSERT_EQ(net::ERR_IO_PENDING,
+            racer_->Connect(addresses_, callback_.callback()));
+  EXPECT_EQ(net::OK, callback_.WaitForResult());
+
+  scoped_ptr<net::StreamSocket> socket(racer_->PassSocket());
+  net::IPEndPoint peer;
+  ASSERT_EQ(net::OK, socket->GetPeerAddress(&peer));
+  EXPECT_EQ(addresses_[1], peer);
+}
+
+TEST_F(ChromeConnectionRacerTest, FailedAttemptDoesNotWait) {
+  // A failure starts the next attempt right away, without waiting for the
+  // attempt delay.
+  net::StaticSocketDataProvider refused, data;
+  AddConnect(&refused, net::ASYNC, net::ERR_CONNECTION_REFUSED);
+  AddConnect(&data, net::ASYNC, net::OK);
+
+  CreateRacer(base::TimeDelta::FromHours(1));
+  ASSERT_EQ(net::ERR_IO_PENDING,
+            racer_->Connect(addresses_, callback_.callback()));
+  EXPECT_EQ(net::OK, callback_.WaitForResult());
+}
+
+TEST_F(ChromeConnectionRacerTest, AllAttemptsFail) {
+  net::StaticSocketDataProvider refused, unreachable;
+  AddConnect(&refused, net::ASYNC, net::ERR_CONNECTION_REFUSED);
+  AddConnect(&unreachable, net::ASYNC, net::ERR_ADDRESS_UNREACHABLE);
+
+  CreateRacer(base::TimeDelta());
+  ASSERT_EQ(net::ERR_IO_PENDING,
+            racer_->Connect(addresses_, callback_.callback()));
+  EXPECT_EQ(net::ERR_ADDRESS_UNREACHABLE, callback_.WaitForResult());
+}
+
+}  // namespace sippet
@@ -4,6 +4,9 @@
 
 #include "sippet/transport/chrome/chrome_datagram_channel.h"
 
+#include <cstring>
+#include <string>
+
 #include "base/rand_util.h"
 #include "net/base/net_errors.h"
 #include "net/base/ip_endpoint.h"
@@ -14,6 +17,8 @@
 #include "net/url_request/url_request_context.h"
 #include "net/url_request/url_request_context_getter.h"
 #include "sippet/message/message.h"
+#include "sippet/message/headers/via.h"
+#include "sippet/transport/chrome/message_io_buffer.h"
 
 namespace sippet {
 
@@ -21,13 +26,20 @@ namespace sippet {
 // fragmentation is actually around 1500 bytes.
 const size_t kReadBufSize = 64U * 1024U;
 
+// Datagrams already queued in the socket are read synchronously, without
+// going back to the message loop, up to this many per wakeup.
+const int kMaxReadsPerWakeup = 32;
+
 ChromeDatagramChannel::ChromeDatagramChannel(const EndPoint& destination,
       Channel::Delegate *delegate,
       net::ClientSocketFactory* client_socket_factory,
-      const scoped_refptr<net::URLRequestContextGetter>& request_context_getter)
+      const scoped_refptr<net::URLRequestContextGetter>& request_context_getter,
+      ChromeDatagramListener *shared_listener)
   : destination_(destination),
     delegate_(delegate),
     client_socket_factory_(client_socket_factory),
+    shared_listener_(shared_listener),
+    is_peer_(false),
     weak_ptr_factory_(this),
     is_connected_(false),
     host_resolver_(
@@ -43,9 +55,13 @@ ChromeDatagramChannel::ChromeDatagramChannel(const EndPoint& destination,
 }
 
 ChromeDatagramChannel::~ChromeDatagramChannel() {
+  if (is_peer_)
+    shared_listener_->RemovePeer(peer_address_, this);
 }
 
 int ChromeDatagramChannel::origin(EndPoint *origin) const {
+  if (is_peer_)
+    return shared_listener_->GetLocalEndPoint(origin);
   if (STATE_NONE == next_state_ && socket_.get()) {
     net::IPEndPoint ip_endpoint;
     int rv = socket_->GetLocalAddress(&ip_endpoint);
@@ -103,7 +119,7 @@ int ChromeDatagramChannel::ReconnectWithCertificate(
 
 void ChromeDatagramChannel::RunUserConnectCallback(int result) {
   DCHECK_NE(net::ERR_IO_PENDING, result);
-  if (net::OK == result)
+  if (net::OK == result && datagram_reader_.get())
     PostDoRead();
   if (delegate_)
     delegate_->OnChannelConnected(this, result);
@@ -163,6 +179,20 @@ int ChromeDatagramChannel::DoResolveHostComplete(int result) {
   if (net::OK != result)
     return result;
 
+  if (shared_listener_) {
+    for (net::AddressList::iterator i = addresses_.begin(),
+         ie = addresses_.end(); i != ie; i++) {
+      if (shared_listener_->AddPeer(*i, this)) {
+        peer_address_ = *i;
+        is_peer_ = true;
+        is_connected_ = true;
+        return net::OK;
+      }
+    }
+    VLOG(1) << "Destination " << destination_.ToString()
+            << " already served by the listener, using a new socket";
+  }
+
   net::NetLog::Source no_source;
   scoped_ptr<net::DatagramClientSocket> socket =
       client_socket_factory_->CreateDatagramClientSocket(
@@ -179,8 +209,13 @@ int ChromeDatagramChannel::DoResolveHostComplete(int result) {
       rv = socket->Connect(*i);
       if (rv == net::OK) {
         is_connected_ = true;
+        socket_options_.ApplyBufferSizes(socket.get());
         datagram_reader_.reset(new ChromeDatagramReader(socket.get()));
+        datagram_reader_->set_parse_profile(parse_profile_);
+        datagram_reader_->set_message_limits(message_limits_);
+        datagram_reader_->set_compressor(compressor_.get());
         datagram_writer_.reset(new ChromeDatagramWriter(socket.get()));
+        ApplyWriteQueueLimits();
         break;
       }
     }
@@ -196,12 +231,27 @@ int ChromeDatagramChannel::DoResolveHostComplete(int result) {
 
 int ChromeDatagramChannel::Send(const scoped_refptr<Message> &message,
                                 const net::CompletionCallback& callback) {
+  if (is_peer_) {
+    scoped_refptr<net::IOBufferWithSize> buffer(SerializeMessage(*message));
+    if (delegate_)
+      delegate_->OnOutgoingMessage(this, message);
+    return shared_listener_->SendTo(buffer.get(), buffer->size(),
+        peer_address_, callback);
+  }
   if (is_connected_ && datagram_writer_.get()) {
-    scoped_refptr<net::StringIOBuffer> string_buffer =
-        new net::StringIOBuffer(message->ToString());
-    return datagram_writer_->Write(
-        string_buffer.get(),
-        string_buffer->size(),
+    scoped_refptr<net::IOBufferWithSize> buffer(SerializeMessage(*message));
+    std::string compressed;
+    if (compressor_.get() && compressor_->Compress(
+            base::StringPiece(buffer->data(), buffer->size()), &compressed)) {
+      buffer = new net::IOBufferWithSize(compressed.size());
+      memcpy(buffer->data(), compressed.data(), compressed.size());
+    }
+    if (delegate_)
+      delegate_->OnOutgoingMessage(this, message);
+    return datagram_writer_->WriteMessage(
+        buffer.get(),
+        buffer->size(),
+        GetWritePriority(*message),
         callback);
   }
   NOTREACHED();
@@ -218,11 +268,100 @@ void ChromeDatagramChannel::CloseWithError(int err) {
   }
 }
 
+void ChromeDatagramChannel::SetWriteQueueLimits(
+    const WriteQueueLimits &limits) {
+  write_queue_limits_ = limits;
+  if (datagram_writer_.get())
+    ApplyWriteQueueLimits();
+}
+
+size_t ChromeDatagramChannel::queued_write_bytes() const {
+  return datagram_writer_.get() ? datagram_writer_->queued_bytes() : 0;
+}
+
+void ChromeDatagramChannel::SetParseProfile(const ParseProfile &profile) {
+  parse_profile_ = profile;
+  if (datagram_reader_.get())
+    datagram_reader_->set_parse_profile(parse_profile_);
+}
+
+void ChromeDatagramChannel::SetMessageLimits(const MessageLimits &limits) {
+  message_limits_ = limits;
+  if (datagram_reader_.get())
+    datagram_reader_->set_message_limits(message_limits_);
+}
+
+void ChromeDatagramChannel::SetSocketOptions(const SocketOptions &options) {
+  socket_options_ = options;
+}
+
+bool ChromeDatagramChannel::EnableCompression() {
+  if (shared_listener_)
+    return false;
+  if (!compressor_.get()) {
+    compressor_.reset(new MessageCompressor);
+    if (datagram_reader_.get())
+      datagram_reader_->set_compressor(compressor_.get());
+  }
+  return true;
+}
+
+void ChromeDatagramChannel::LearnCompression(const Message &message) {
+  // RFC 3486 section 5: the sender of a request with a comp= parameter in
+  // its topmost Via can decode compressed responses.
+  const Via *via = message.get<Via>();
+  if (!isa<Request>(message) || !via || via->empty())
+    return;
+  ViaParam::const_param_iterator comp = via->front().param_find("comp");
+  if (via->front().param_end() != comp
+      && MessageCompressor::kCompressionName == comp->second)
+    compressor_->set_peer_decompresses(true);
+}
+
+void ChromeDatagramChannel::ApplyWriteQueueLimits() {
+  datagram_writer_->SetWriteQueueLimits(write_queue_limits_,
+      base::Bind(&ChromeDatagramChannel::OnWriteQueueStateChanged,
+                 base::Unretained(this)));
+}
+
+void ChromeDatagramChannel::OnWriteQueueStateChanged(bool congested) {
+  if (!delegate_)
+    return;
+  if (congested)
+    delegate_->OnChannelCongested(this);
+  else
+    delegate_->OnChannelWritable(this);
+}
+
 void ChromeDatagramChannel::DetachDelegate() {
   delegate_ = nullptr;
 }
 
+void ChromeDatagramChannel::HandleIncomingMessage(
+    const scoped_refptr<Message> &message) {
+  if (delegate_)
+    delegate_->OnIncomingMessage(this, message);
+}
+
+void ChromeDatagramChannel::DetachListener() {
+  is_peer_ = false;
+  shared_listener_ = nullptr;
+  if (!is_connected_)
+    return;
+  // The listener is in the middle of closing, so report it later.
+  base::MessageLoop* message_loop = base::MessageLoop::current();
+  CHECK(message_loop);
+  message_loop->PostTask(
+      FROM_HERE,
+      base::Bind(&ChromeDatagramChannel::RunUserChannelClosed,
+                 weak_ptr_factory_.GetWeakPtr(), net::ERR_CONNECTION_CLOSED));
+}
+
 void ChromeDatagramChannel::CloseTransportSocket() {
+  if (is_peer_) {
+    shared_listener_->RemovePeer(peer_address_, this);
+    is_peer_ = false;
+  }
   if (socket_.get())
     socket_->Close();
   socket_.reset();
@@ -242,24 +381,39 @@ void ChromeDatagramChannel::PostDoRead() {
 }
 
 void ChromeDatagramChannel::DoRead() {
-  DCHECK(datagram_reader_.get());
-  int result = datagram_reader_->Read(
-      base::Bind(&ChromeDatagramChannel::OnReadComplete,
-                 weak_ptr_factory_.GetWeakPtr()));
-  if (net::ERR_IO_PENDING == result)
-    return;
-  OnReadComplete(result);
+  for (int i = 0; i < kMaxReadsPerWakeup; ++i) {
+    DCHECK(datagram_reader_.get());
+    int result = datagram_reader_->Read(
+        base::Bind(&ChromeDatagramChannel::OnReadComplete,
+                   weak_ptr_factory_.GetWeakPtr()));
+    if (net::ERR_IO_PENDING == result || !HandleReadResult(result))
+      return;
+  }
+  // Let other tasks run before draining the socket further.
+  PostDoRead();
 }
 
 void ChromeDatagramChannel::OnReadComplete(int result) {
+  if (HandleReadResult(result))
+    DoRead();
+}
+
+bool ChromeDatagramChannel::HandleReadResult(int result) {
   DCHECK_NE(net::ERR_IO_PENDING, result);
-  if (net::OK == result) {
-    PostDoRead();
-    delegate_->OnIncomingMessage(this, datagram_reader_->GetIncomingMessage());
-  } else if (result < 0) {
+  if (net::OK != result) {
     RunUserChannelClosed(result);
     // |this| may be deleted after this call.
+    return false;
   }
+  base::WeakPtr<ChromeDatagramChannel> weak_this(
+      weak_ptr_factory_.GetWeakPtr());
+  scoped_refptr<Message> message(datagram_reader_->GetIncomingMessage());
+  if (compressor_.get() && !compressor_->peer_decompresses())
+    LearnCompression(*message);
+  if (delegate_)
+    delegate_->OnIncomingMessage(this, message);
+  // The channel may have been closed meanwhile.
+  return weak_this.get() != nullptr;
 }
 
 }  // namespace sippet
@@ -6,8 +6,10 @@
 #define SIPPET_TRANSPORT_CHROME_CHROME_DATAGRAM_CHANNEL_H_
 
 #include "sippet/transport/channel.h"
+#include "sippet/transport/chrome/chrome_datagram_listener.h"
 #include "sippet/transport/chrome/chrome_datagram_writer.h"
 #include "sippet/transport/chrome/chrome_datagram_reader.h"
+#include "sippet/transport/message_compressor.h"
 #include "base/memory/weak_ptr.h"
 #include "net/base/address_list.h"
 #include "net/dns/host_resolver.h"
@@ -27,12 +29,18 @@ namespace sippet {
 
 class Message;
 
-class ChromeDatagramChannel : public Channel {
+class ChromeDatagramChannel : public Channel,
+                              public ChromeDatagramListener::Peer {
  public:
+  // When |shared_listener| is given, datagrams are exchanged through its
+  // socket instead of a connected socket of the channel's own. The channel
+  // falls back to its own socket if the destination address already belongs
+  // to another peer of the listener.
   ChromeDatagramChannel(const EndPoint& destination,
       Channel::Delegate *delegate,
       net::ClientSocketFactory* client_socket_factory,
-      const scoped_refptr<net::URLRequestContextGetter>& request_context_getter);
+      const scoped_refptr<net::URLRequestContextGetter>& request_context_getter,
+      ChromeDatagramListener *shared_listener = nullptr);
 
   int origin(EndPoint *origin) const override;
   const EndPoint& destination() const override;
@@ -52,12 +60,34 @@ class ChromeDatagramChannel : public Channel {
 
   void CloseWithError(int err) override;
 
+  void SetWriteQueueLimits(const WriteQueueLimits &limits) override;
+
+  size_t queued_write_bytes() const override;
+
+  void SetParseProfile(const ParseProfile &profile) override;
+  void SetMessageLimits(const MessageLimits &limits) override;
+  void SetSocketOptions(const SocketOptions &options) override;
+  // Only the channels with their own socket can compress; datagrams of a
+  // shared listener are parsed before reaching the channel.
+  bool EnableCompression() override;
+
   void DetachDelegate() override;
 
+  // sippet::ChromeDatagramListener::Peer methods:
+  void HandleIncomingMessage(const scoped_refptr<Message> &message) override;
+  void DetachListener() override;
+
  private:
   friend class base::RefCountedThreadSafe<Channel>;
   ~ChromeDatagramChannel() override;
 
+  // Whether |message| tells its sender decodes compressed messages.
+  void LearnCompression(const Message &message);
+
+  // Hands |write_queue_limits_| to the writer.
+  void ApplyWriteQueueLimits();
+  void OnWriteQueueStateChanged(bool congested);
+
   enum State {
     STATE_RESOLVE_HOST,
     STATE_RESOLVE_HOST_COMPLETE,
@@ -78,11 +108,17 @@ class ChromeDatagramChannel : public Channel {
   void PostDoRead();
   void DoRead();
   void OnReadComplete(int result);
+  // Returns false if no more datagrams should be read.
+  bool HandleReadResult(int result);
 
   State next_state_;
 
   EndPoint destination_;
   Channel::Delegate *delegate_;
+  WriteQueueLimits write_queue_limits_;
+  ParseProfile parse_profile_;
+  MessageLimits message_limits_;
+  SocketOptions socket_options_;
 
   net::SingleRequestHostResolver host_resolver_;
   net::AddressList addresses_;
@@ -91,6 +127,11 @@ class ChromeDatagramChannel : public Channel {
   scoped_ptr<net::DatagramClientSocket> socket_;
   scoped_ptr<ChromeDatagramReader> datagram_reader_;
   scoped_ptr<ChromeDatagramWriter> datagram_writer_;
+  scoped_ptr<MessageCompressor> compressor_;
+  ChromeDatagramListener *shared_listener_;
+  // The destination address, while registered with |shared_listener_|.
+  net::IPEndPoint peer_address_;
+  bool is_peer_;
   net::BoundNetLog bound_net_log_;
 
   bool is_connected_;
@@ -0,0 +1,388 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/chrome/chrome_datagram_listener.h"
+
+#include "base/bind.h"
+#include "base/hash.h"
+#include "base/logging.h"
+#include "base/message_loop/message_loop.h"
+#include "base/stl_util.h"
+#include "base/trace_event/trace_event.h"
+#include "net/base/io_buffer.h"
+#include "net/base/ip_address_number.h"
+#include "net/base/net_errors.h"
+#include "net/udp/udp_server_socket.h"
+#include "sippet/message/message.h"
+#include "sippet/transport/chrome/chrome_datagram_reader.h"
+#include "sippet/transport/chrome/chrome_server_datagram_channel.h"
+#include "sippet/transport/parse_pool.h"
+#include "sippet/transport/source_rate_limiter.h"
+#include "sippet/transport/transport_stats.h"
+
+namespace sippet {
+
+namespace {
+
+// Datagrams already queued in the socket are read synchronously, without
+// going back to the message loop, up to this many per wakeup. The loop then
+// yields so that a busy socket doesn't starve other tasks.
+const int kMaxReadsPerWakeup = 32;
+
+// Large enough for any datagram, as with |ChromeDatagramReader|.
+const int kRawReadBufSize = 64 * 1024;
+
+}  // namespace
+
+ChromeDatagramListener::PendingSend::PendingSend(
+    net::IOBuffer *buf, int buf_len,
+    const net::IPEndPoint &address,
+    const net::CompletionCallback &callback)
+  : buf_(buf), buf_len_(buf_len), address_(address), callback_(callback) {
+}
+
+ChromeDatagramListener::PendingSend::~PendingSend() {
+}
+
+ChromeDatagramListener::ChromeDatagramListener(
+    const EndPoint &local_end_point,
+    net::NetLog *net_log)
+  : local_end_point_(local_end_point),
+    net_log_(net_log),
+    delegate_(nullptr),
+    channel_delegate_(nullptr),
+    parse_pool_(nullptr),
+    rate_limiter_(nullptr),
+    weak_ptr_factory_(this) {
+  DCHECK(Protocol::UDP == local_end_point_.protocol());
+}
+
+ChromeDatagramListener::~ChromeDatagramListener() {
+  Close();
+}
+
+int ChromeDatagramListener::Listen(ChannelListener::Delegate *delegate,
+                                   Channel::Delegate *channel_delegate) {
+  DCHECK(delegate);
+  DCHECK(channel_delegate);
+  DCHECK(!socket_);
+
+  net::IPAddressNumber address;
+  if (!net::ParseIPLiteralToNumber(local_end_point_.host(), &address))
+    return net::ERR_ADDRESS_INVALID;
+
+  socket_.reset(new net::UDPServerSocket(net_log_, net::NetLog::Source()));
+  socket_->AllowAddressReuse();
+  int result = socket_->Listen(
+      net::IPEndPoint(address, local_end_point_.port()));
+  if (result != net::OK) {
+    socket_.reset();
+    return result;
+  }
+  socket_options_.ApplyBufferSizes(socket_.get());
+  if (net::DSCP_NO_CHANGE != socket_options_.dscp) {
+    result = socket_->SetDiffServCodePoint(socket_options_.dscp);
+    LOG_IF(WARNING, net::OK != result)
+        << "Failed to set the DSCP of " << local_end_point_.ToString()
+        << ": " << net::ErrorToString(result);
+  }
+
+  delegate_ = delegate;
+  channel_delegate_ = channel_delegate;
+  if (reads_raw())
+    raw_buf_ = new net::IOBufferWithSize(kRawReadBufSize);
+  else
+    CreateReader();
+  PostDoRead();
+  return net::OK;
+}
+
+int ChromeDatagramListener::GetLocalEndPoint(
+    EndPoint *local_end_point) const {
+  if (!socket_)
+    return net::ERR_SOCKET_NOT_CONNECTED;
+  net::IPEndPoint ip_endpoint;
+  int result = socket_->GetLocalAddress(&ip_endpoint);
+  if (result != net::OK)
+    return result;
+  *local_end_point = EndPoint(net::HostPortPair::FromIPEndPoint(ip_endpoint),
+      Protocol::UDP);
+  return net::OK;
+}
+
+void ChromeDatagramListener::Close() {
+  weak_ptr_factory_.InvalidateWeakPtrs();
+  PeersMap peers;
+  peers.swap(peers_);
+  for (PeersMap::iterator i = peers.begin(), ie = peers.end(); i != ie; ++i)
+    i->second->DetachListener();
+  datagram_reader_.reset();
+  socket_.reset();
+  raw_buf_ = NULL;
+
+  std::deque<PendingSend*> pending_sends;
+  pending_sends.swap(pending_sends_);
+  for (std::deque<PendingSend*>::iterator i = pending_sends.begin(),
+       ie = pending_sends.end(); i != ie; ++i) {
+    if (!(*i)->callback_.is_null())
+      (*i)->callback_.Run(net::ERR_CONNECTION_CLOSED);
+  }
+  STLDeleteElements(&pending_sends);
+}
+
+void ChromeDatagramListener::SetParseProfile(const ParseProfile &profile) {
+  parse_profile_ = profile;
+  if (datagram_reader_.get())
+    datagram_reader_->set_parse_profile(parse_profile_);
+}
+
+void ChromeDatagramListener::SetParsePool(ParsePool *parse_pool) {
+  DCHECK(!socket_);
+  parse_pool_ = parse_pool;
+}
+
+void ChromeDatagramListener::SetRateLimiter(SourceRateLimiter *rate_limiter) {
+  DCHECK(!socket_);
+  rate_limiter_ = rate_limiter;
+}
+
+void ChromeDatagramListener::SetMessageLimits(const MessageLimits &limits) {
+  message_limits_ = limits;
+  if (datagram_reader_.get())
+    datagram_reader_->set_message_limits(message_limits_);
+}
+
+void ChromeDatagramListener::SetSocketOptions(
+    const SocketOptionsMap &profiles) {
+  DCHECK(!socket_);
+  socket_options_ = GetSocketOptions(profiles, local_end_point_.protocol());
+}
+
+int ChromeDatagramListener::SendTo(net::IOBuffer *buf, int buf_len,
+                                   const net::IPEndPoint &address,
+                                   const net::CompletionCallback &callback) {
+  TRACE_EVENT1("sippet", "ChromeDatagramListener::SendTo", "size", buf_len);
+  if (!socket_)
+    return net::ERR_SOCKET_NOT_CONNECTED;
+  TransportStats::Count(TransportStats::BYTES_SENT, buf_len);
+  if (pending_sends_.empty()) {
+    int result = socket_->SendTo(buf, buf_len, address,
+        base::Bind(&ChromeDatagramListener::OnSendComplete,
+                   base::Unretained(this)));
+    if (result != net::ERR_IO_PENDING)
+      return result < 0 ? result : net::OK;
+  }
+  pending_sends_.push_back(new PendingSend(buf, buf_len, address, callback));
+  return net::ERR_IO_PENDING;
+}
+
+bool ChromeDatagramListener::AddPeer(const net::IPEndPoint &address,
+                                     Peer *peer) {
+  DCHECK(peer);
+  if (!socket_)
+    return false;
+  return peers_.insert(std::make_pair(address, peer)).second;
+}
+
+void ChromeDatagramListener::RemovePeer(const net::IPEndPoint &address,
+                                        Peer *peer) {
+  PeersMap::iterator i = peers_.find(address);
+  if (i != peers_.end() && i->second == peer)
+    peers_.erase(i);
+}
+
+void ChromeDatagramListener::CreateReader() {
+  datagram_reader_.reset(new ChromeDatagramReader(socket_.get()));
+  datagram_reader_->set_parse_profile(parse_profile_);
+  datagram_reader_->set_message_limits(message_limits_);
+  datagram_reader_->set_head_filter(
+      base::Bind(&Channel::Delegate::AbsorbRetransmission,
+                 base::Unretained(channel_delegate_)));
+}
+
+void ChromeDatagramListener::PostDoRead() {
+  base::MessageLoop* message_loop = base::MessageLoop::current();
+  CHECK(message_loop);
+  message_loop->PostTask(
+      FROM_HERE,
+      base::Bind(&ChromeDatagramListener::DoRead,
+                 weak_ptr_factory_.GetWeakPtr()));
+}
+
+void ChromeDatagramListener::DoRead() {
+  if (reads_raw()) {
+    DoReadRaw();
+    return;
+  }
+  base::WeakPtr<ChromeDatagramListener> weak_this(
+      weak_ptr_factory_.GetWeakPtr());
+  for (int i = 0; i < kMaxReadsPerWakeup; ++i) {
+    DCHECK(datagram_reader_.get());
+    int result = datagram_reader_->Read(
+        base::Bind(&ChromeDatagramListener::OnReadComplete, weak_this));
+    if (net::ERR_IO_PENDING == result)
+      return;
+    HandleReadResult(result);
+    if (!weak_this)
+      return;  // The listener was closed meanwhile
+  }
+  PostDoRead();
+}
+
+void ChromeDatagramListener::OnReadComplete(int result) {
+  base::WeakPtr<ChromeDatagramListener> weak_this(
+      weak_ptr_factory_.GetWeakPtr());
+  HandleReadResult(result);
+  // Drain whatever was queued while waiting for this datagram.
+  if (weak_this)
+    DoRead();
+}
+
+void ChromeDatagramListener::HandleReadResult(int result) {
+  DCHECK_NE(net::ERR_IO_PENDING, result);
+  if (net::OK != result) {
+    // Errors concern a single datagram (malformed, or the ICMP error of an
+    // earlier send), so keep serving the other peers.
+    DVLOG(1) << "Discarded incoming datagram: " << net::ErrorToString(result);
+    CreateReader();
+    return;
+  }
+  scoped_refptr<Message> message(datagram_reader_->GetIncomingMessage());
+  net::IPEndPoint address(datagram_reader_->recv_address());
+  DispatchMessage(message, address);
+}
+
+void ChromeDatagramListener::DoReadRaw() {
+  base::WeakPtr<ChromeDatagramListener> weak_this(
+      weak_ptr_factory_.GetWeakPtr());
+  for (int i = 0; i < kMaxReadsPerWakeup; ++i) {
+    DCHECK(raw_buf_.get());
+    int result = socket_->RecvFrom(raw_buf_.get(), raw_buf_->size(),
+        &raw_address_,
+        base::Bind(&ChromeDatagramListener::OnRawReadComplete, weak_this));
+    if (net::ERR_IO_PENDING == result)
+      return;
+    HandleRawDatagram(result);
+    if (!weak_this)
+      return;  // The listener was closed meanwhile
+  }
+  PostDoRead();
+}
+
+void ChromeDatagramListener::OnRawReadComplete(int result) {
+  base::WeakPtr<ChromeDatagramListener> weak_this(
+      weak_ptr_factory_.GetWeakPtr());
+  HandleRawDatagram(result);
+  if (weak_this)
+    DoReadRaw();
+}
+
+void ChromeDatagramListener::HandleRawDatagram(int result) {
+  DCHECK_NE(net::ERR_IO_PENDING, result);
+  if (result <= 0) {
+    // ICMP errors of earlier sends concern a single peer.
+    DVLOG(1) << "Discarded incoming datagram: " << net::ErrorToString(result);
+    return;
+  }
+  base::TimeTicks receive_time(base::TimeTicks::Now());
+  TransportStats::Count(TransportStats::BYTES_RECEIVED, result);
+  if (rate_limiter_ && !rate_limiter_->Admit(raw_address_.address())) {
+    TransportStats::Count(TransportStats::RATE_LIMITED);
+    return;
+  }
+  base::StringPiece datagram(raw_buf_->data(), result);
+  size_t start = datagram.find_first_not_of("\r\n");
+  if (base::StringPiece::npos == start)
+    return;  // A CRLF keep-alive
+  datagram.remove_prefix(start);
+  size_t head_size = ParsePool::FindHeadSize(datagram);
+  if (base::StringPiece::npos != head_size) {
+    base::StringPiece head(datagram.substr(0, head_size));
+    if (!message_limits_.AdmitsHead(head, true)
+        || !message_limits_.AdmitsContentLength(
+               datagram.size() - head.size())) {
+      DVLOG(1) << "Discarded incoming datagram: over the message limits";
+      TransportStats::Count(TransportStats::OVERSIZED_MESSAGES);
+      return;
+    }
+    if (channel_delegate_->AbsorbRetransmission(head))
+      return;
+  }
+  if (!parse_pool_) {
+    OnDatagramParsed(raw_address_, receive_time,
+                     ParsePool::ParseDatagram(datagram, parse_profile_));
+    return;
+  }
+  scoped_refptr<base::RefCountedString> data(new base::RefCountedString);
+  datagram.CopyToString(&data->data());
+  // Datagrams of a peer go to the same worker, so they're kept in order.
+  const net::IPAddressNumber &address = raw_address_.address();
+  size_t key = base::Hash(reinterpret_cast<const char*>(&address[0]),
+                          address.size()) + raw_address_.port();
+  parse_pool_->Parse(data, key, parse_profile_,
+      base::Bind(&ChromeDatagramListener::OnDatagramParsed,
+                 weak_ptr_factory_.GetWeakPtr(), raw_address_,
+                 receive_time));
+}
+
+void ChromeDatagramListener::OnDatagramParsed(
+    const net::IPEndPoint &address,
+    const base::TimeTicks &receive_time,
+    const scoped_refptr<Message> &message) {
+  if (!message) {
+    DVLOG(1) << "Discarded incoming datagram: unparseable message";
+    TransportStats::Count(TransportStats::PARSE_FAILURES);
+    return;
+  }
+  if (!message_limits_.AdmitsMessage(*message)) {
+    DVLOG(1) << "Discarded incoming datagram: too many routing entries";
+    TransportStats::Count(TransportStats::OVERSIZED_MESSAGES);
+    return;
+  }
+  // Parsed off the thread, so the time waiting for a worker is counted.
+  message->set_receive_time(receive_time);
+  DispatchMessage(message, address);
+}
+
+void ChromeDatagramListener::DispatchMessage(
+    const scoped_refptr<Message> &message,
+    const net::IPEndPoint &address) {
+  PeersMap::iterator i = peers_.find(address);
+  if (i != peers_.end()) {
+    i->second->HandleIncomingMessage(message);
+    return;
+  }
+  EndPoint destination(net::HostPortPair::FromIPEndPoint(address),
+      Protocol::UDP);
+  scoped_refptr<ChromeServerDatagramChannel> channel(
+      new ChromeServerDatagramChannel(destination, channel_delegate_, this,
+          address));
+  peers_[address] = channel.get();
+  delegate_->OnChannelAccepted(channel);
+  channel->HandleIncomingMessage(message);
+}
+
+void ChromeDatagramListener::OnSendComplete(int result) {
+  TRACE_EVENT1("sippet", "ChromeDatagramListener::OnSendComplete",
+               "result", result);
+  DCHECK(!pending_sends_.empty());
+  for (;;) {
+    PendingSend *pending = pending_sends_.front();
+    pending_sends_.pop_front();
+    if (!pending->callback_.is_null())
+      pending->callback_.Run(result < 0 ? result : net::OK);
+    delete pending;
+    if (!socket_ || pending_sends_.empty())
+      return;
+    pending = pending_sends_.front();
+    result = socket_->SendTo(pending->buf_.get(), pending->buf_len_,
+        pending->address_,
+        base::Bind(&ChromeDatagramListener::OnSendComplete,
+                   base::Unretained(this)));
+    if (result == net::ERR_IO_PENDING)
+      return;
+  }
+}
+
+}  // namespace sippet
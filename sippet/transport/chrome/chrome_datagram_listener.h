@@ -0,0 +1,153 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_CHROME_CHROME_DATAGRAM_LISTENER_H_
+#define SIPPET_TRANSPORT_CHROME_CHROME_DATAGRAM_LISTENER_H_
+
+#include <deque>
+#include <map>
+
+#include "base/memory/scoped_ptr.h"
+#include "base/memory/weak_ptr.h"
+#include "base/time/time.h"
+#include "net/base/completion_callback.h"
+#include "net/base/ip_endpoint.h"
+#include "sippet/transport/channel_listener.h"
+
+namespace net {
+class IOBuffer;
+class IOBufferWithSize;
+class NetLog;
+class UDPServerSocket;
+}
+
+namespace sippet {
+
+class ChromeDatagramReader;
+class Message;
+class ParsePool;
+class SourceRateLimiter;
+
+// Serves many UDP peers from a single bound socket. Datagrams are
+// demultiplexed by source address into |ChromeServerDatagramChannel|s, created
+// on the first datagram of each peer, and all of them send through the same
+// socket. The number of sockets and pending reads stays the same no matter
+// how many peers there are.
+//
+// Outbound channels can share the socket too: by registering as a |Peer| of
+// their destination address, they get its datagrams instead of a new channel
+// being accepted for them.
+//
+// With a |ParsePool|, datagrams are read raw, and parsed by the pool workers
+// instead; their heads are still given to
+// |Channel::Delegate::AbsorbRetransmission| first, on the listener thread.
+// With a |SourceRateLimiter|, they're read raw too, so that those of the
+// sources over the rate are dropped before being parsed.
+class ChromeDatagramListener : public ChannelListener {
+ public:
+  // Receives the datagrams of a single peer address.
+  class Peer {
+   public:
+    // Called for each message received from the peer address.
+    virtual void HandleIncomingMessage(
+        const scoped_refptr<Message> &message) = 0;
+
+    // Called when the listener socket is closed; the peer is then removed.
+    virtual void DetachListener() = 0;
+
+   protected:
+    virtual ~Peer() {}
+  };
+
+  // |local_end_point| must have an IP literal host, and the UDP protocol.
+  ChromeDatagramListener(const EndPoint &local_end_point,
+                         net::NetLog *net_log);
+  ~ChromeDatagramListener() override;
+
+  // sippet::ChannelListener methods:
+  int Listen(ChannelListener::Delegate *delegate,
+             Channel::Delegate *channel_delegate) override;
+  int GetLocalEndPoint(EndPoint *local_end_point) const override;
+  void Close() override;
+  void SetParseProfile(const ParseProfile &profile) override;
+  void SetParsePool(ParsePool *parse_pool) override;
+  void SetRateLimiter(SourceRateLimiter *rate_limiter) override;
+  void SetMessageLimits(const MessageLimits &limits) override;
+  void SetSocketOptions(const SocketOptionsMap &profiles) override;
+
+  // Sends a datagram to |address|. Sends are queued while the socket is busy,
+  // so it returns |net::ERR_IO_PENDING| and calls |callback| later.
+  int SendTo(net::IOBuffer *buf, int buf_len,
+             const net::IPEndPoint &address,
+             const net::CompletionCallback &callback);
+
+  // Routes the datagrams received from |address| to |peer|. Returns false if
+  // the address already belongs to another peer.
+  bool AddPeer(const net::IPEndPoint &address, Peer *peer);
+
+  // Unregisters |peer|; called when it's closed or destroyed.
+  void RemovePeer(const net::IPEndPoint &address, Peer *peer);
+
+ private:
+  struct PendingSend {
+    PendingSend(net::IOBuffer *buf, int buf_len,
+                const net::IPEndPoint &address,
+                const net::CompletionCallback &callback);
+    ~PendingSend();
+    scoped_refptr<net::IOBuffer> buf_;
+    int buf_len_;
+    net::IPEndPoint address_;
+    net::CompletionCallback callback_;
+  };
+
+  typedef std::map<net::IPEndPoint, Peer*> PeersMap;
+
+  // (Re)creates the reader, giving the heads of incoming datagrams to
+  // |Channel::Delegate::AbsorbRetransmission| first.
+  void CreateReader();
+  void PostDoRead();
+  void DoRead();
+  void OnReadComplete(int result);
+  void HandleReadResult(int result);
+  // Whether datagrams are read raw, for |parse_pool_| or |rate_limiter_|.
+  bool reads_raw() const { return parse_pool_ || rate_limiter_; }
+  // Same as above, reading raw datagrams.
+  void DoReadRaw();
+  void OnRawReadComplete(int result);
+  void HandleRawDatagram(int result);
+  void OnDatagramParsed(const net::IPEndPoint &address,
+                        const base::TimeTicks &receive_time,
+                        const scoped_refptr<Message> &message);
+  void DispatchMessage(const scoped_refptr<Message> &message,
+                       const net::IPEndPoint &address);
+
+  void OnSendComplete(int result);
+
+  EndPoint local_end_point_;
+  net::NetLog *net_log_;
+  ChannelListener::Delegate *delegate_;
+  Channel::Delegate *channel_delegate_;
+
+  scoped_ptr<net::UDPServerSocket> socket_;
+  scoped_ptr<ChromeDatagramReader> datagram_reader_;
+  ParseProfile parse_profile_;
+  ParsePool *parse_pool_;
+  SourceRateLimiter *rate_limiter_;
+  MessageLimits message_limits_;
+  SocketOptions socket_options_;
+  // Raw datagrams are read here, when |reads_raw|.
+  scoped_refptr<net::IOBufferWithSize> raw_buf_;
+  net::IPEndPoint raw_address_;
+  PeersMap peers_;
+  // The front one is being written, when the socket is busy.
+  std::deque<PendingSend*> pending_sends_;
+
+  base::WeakPtrFactory<ChromeDatagramListener> weak_ptr_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChromeDatagramListener);
+};
+
+} /// End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_CHROME_CHROME_DATAGRAM_LISTENER_H_
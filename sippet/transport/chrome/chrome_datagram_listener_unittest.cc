@@ -0,0 +1,240 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/chrome/chrome_datagram_listener.h"
+
+#include <string>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/rand_util.h"
+#include "base/run_loop.h"
+#include "net/base/io_buffer.h"
+#include "net/base/ip_address_number.h"
+#include "net/base/net_errors.h"
+#include "net/base/test_completion_callback.h"
+#include "net/udp/udp_client_socket.h"
+#include "sippet/message/message.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const char kOptionsRequest[] =
+  "OPTIONS sip:carol@chicago.com SIP/2.0\r\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bKhjhs8ass877\r\n"
+  "Max-Forwards: 70\r\n"
+  "To: <sip:carol@chicago.com>\r\n"
+  "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+  "Call-ID: a84b4c76e66710\r\n"
+  "CSeq: 63104 OPTIONS\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n";
+
+const char kOptionsResponse[] =
+  "SIP/2.0 200 OK\r\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bKhjhs8ass877\r\n"
+  "To: <sip:carol@chicago.com>;tag=93810874\r\n"
+  "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+  "Call-ID: a84b4c76e66710\r\n"
+  "CSeq: 63104 OPTIONS\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n";
+
+class RecordingDelegate : public ChannelListener::Delegate,
+                          public Channel::Delegate {
+ public:
+  RecordingDelegate() : run_loop_(nullptr), messages_(0), expected_(0) {}
+
+  void WaitForMessage() {
+    WaitForMessages(messages_ + 1);
+  }
+
+  void WaitForMessages(int count) {
+    if (messages_ >= count)
+      return;
+    expected_ = count;
+    base::RunLoop run_loop;
+    run_loop_ = &run_loop;
+    run_loop.Run();
+    run_loop_ = nullptr;
+  }
+
+  const std::vector<scoped_refptr<Channel> > &channels() const {
+    return channels_;
+  }
+  int messages() const { return messages_; }
+
+  // sippet::ChannelListener::Delegate methods:
+  void OnChannelAccepted(const scoped_refptr<Channel> &channel) override {
+    EXPECT_TRUE(channel->is_connected());
+    channels_.push_back(channel);
+  }
+
+  // sippet::Channel::Delegate methods:
+  void OnChannelConnected(const scoped_refptr<Channel> &channel,
+                          int error) override {
+    ADD_FAILURE() << "Accepted channels are connected already";
+  }
+  void OnIncomingMessage(const scoped_refptr<Channel> &channel,
+                         const scoped_refptr<Message> &message) override {
+    EXPECT_TRUE(isa<Request>(message));
+    ++messages_;
+    if (run_loop_ && messages_ >= expected_)
+      run_loop_->Quit();
+  }
+  void OnChannelClosed(const scoped_refptr<Channel> &channel,
+                       int error) override {}
+  void OnSSLCertificateError(const scoped_refptr<Channel> &channel,
+                             const net::SSLInfo &ssl_info,
+                             bool fatal) override {}
+
+ private:
+  base::RunLoop *run_loop_;
+  std::vector<scoped_refptr<Channel> > channels_;
+  int messages_;
+  int expected_;
+};
+
+class RecordingPeer : public ChromeDatagramListener::Peer {
+ public:
+  RecordingPeer() : messages_(0), detached_(false) {}
+  ~RecordingPeer() override {}
+
+  void set_quit_closure(const base::Closure &quit_closure) {
+    quit_closure_ = quit_closure;
+  }
+  int messages() const { return messages_; }
+  bool detached() const { return detached_; }
+
+  void HandleIncomingMessage(const scoped_refptr<Message> &message) override {
+    ++messages_;
+    if (!quit_closure_.is_null())
+      quit_closure_.Run();
+  }
+  void DetachListener() override {
+    detached_ = true;
+  }
+
+ private:
+  base::Closure quit_closure_;
+  int messages_;
+  bool detached_;
+};
+
+}  // namespace
+
+class ChromeDatagramListenerTest : public testing::Test {
+ public:
+  void SetUp() override {
+    listener_.reset(new ChromeDatagramListener(
+        EndPoint(net::HostPortPair("127.0.0.1", 0), Protocol::UDP),
+        nullptr));
+    ASSERT_EQ(net::OK, listener_->Listen(&delegate_, &delegate_));
+    ASSERT_EQ(net::OK, listener_->GetLocalEndPoint(&local_end_point_));
+    EXPECT_NE(0, local_end_point_.port());
+  }
+
+  scoped_ptr<net::UDPClientSocket> CreateClient() {
+    scoped_ptr<net::UDPClientSocket> client(new net::UDPClientSocket(
+        net::DatagramSocket::DEFAULT_BIND, base::Bind(&base::RandInt),
+        nullptr, net::NetLog::Source()));
+    net::IPAddressNumber loopback;
+    EXPECT_TRUE(net::ParseIPLiteralToNumber("127.0.0.1", &loopback));
+    EXPECT_EQ(net::OK, client->Connect(
+        net::IPEndPoint(loopback, local_end_point_.port())));
+    return client.Pass();
+  }
+
+  static void Send(net::UDPClientSocket *client, const char *data) {
+    scoped_refptr<net::StringIOBuffer> buffer(new net::StringIOBuffer(data));
+    net::TestCompletionCallback callback;
+    int result = client->Write(buffer.get(), buffer->size(),
+        callback.callback());
+    EXPECT_EQ(buffer->size(), callback.GetResult(result));
+  }
+
+  RecordingDelegate delegate_;
+  scoped_ptr<ChromeDatagramListener> listener_;
+  EndPoint local_end_point_;
+};
+
+TEST_F(ChromeDatagramListenerTest, DemultiplexesPeers) {
+  scoped_ptr<net::UDPClientSocket> alice(CreateClient());
+  scoped_ptr<net::UDPClientSocket> bob(CreateClient());
+
+  Send(alice.get(), kOptionsRequest);
+  delegate_.WaitForMessage();
+  Send(alice.get(), kOptionsRequest);
+  delegate_.WaitForMessage();
+  Send(bob.get(), kOptionsRequest);
+  delegate_.WaitForMessage();
+
+  // One channel per peer, all of them on the same socket.
+  EXPECT_EQ(3, delegate_.messages());
+  ASSERT_EQ(2u, delegate_.channels().size());
+  net::IPEndPoint alice_address;
+  ASSERT_EQ(net::OK, alice->GetLocalAddress(&alice_address));
+  EXPECT_EQ(alice_address.port(),
+            delegate_.channels()[0]->destination().port());
+  EndPoint origin;
+  ASSERT_EQ(net::OK, delegate_.channels()[0]->origin(&origin));
+  EXPECT_EQ(local_end_point_.port(), origin.port());
+
+  // Responses go back to the right peer through the shared socket.
+  net::TestCompletionCallback send_callback;
+  int result = delegate_.channels()[0]->Send(
+      Message::Parse(kOptionsResponse), send_callback.callback());
+  EXPECT_EQ(net::OK, send_callback.GetResult(result));
+
+  scoped_refptr<net::IOBufferWithSize> buffer(
+      new net::IOBufferWithSize(1500));
+  net::TestCompletionCallback read_callback;
+  result = alice->Read(buffer.get(), buffer->size(),
+      read_callback.callback());
+  result = read_callback.GetResult(result);
+  ASSERT_GT(result, 0);
+  EXPECT_EQ(0u, std::string(buffer->data(), result).find("SIP/2.0 200 OK"));
+
+  listener_->Close();
+  EXPECT_FALSE(delegate_.channels()[0]->is_connected());
+}
+
+TEST_F(ChromeDatagramListenerTest, ReadsBurstsOfDatagrams) {
+  scoped_ptr<net::UDPClientSocket> alice(CreateClient());
+
+  // More than can be read in a single wakeup.
+  const int kBurstSize = 100;
+  for (int i = 0; i < kBurstSize; ++i)
+    Send(alice.get(), kOptionsRequest);
+  delegate_.WaitForMessages(kBurstSize);
+
+  EXPECT_EQ(kBurstSize, delegate_.messages());
+  EXPECT_EQ(1u, delegate_.channels().size());
+}
+
+TEST_F(ChromeDatagramListenerTest, RoutesToRegisteredPeer) {
+  scoped_ptr<net::UDPClientSocket> alice(CreateClient());
+  net::IPEndPoint alice_address;
+  ASSERT_EQ(net::OK, alice->GetLocalAddress(&alice_address));
+
+  RecordingPeer peer;
+  ASSERT_TRUE(listener_->AddPeer(alice_address, &peer));
+  EXPECT_FALSE(listener_->AddPeer(alice_address, &peer));
+
+  base::RunLoop run_loop;
+  peer.set_quit_closure(run_loop.QuitClosure());
+  Send(alice.get(), kOptionsRequest);
+  run_loop.Run();
+
+  // No channel is accepted for a registered peer.
+  EXPECT_EQ(1, peer.messages());
+  EXPECT_TRUE(delegate_.channels().empty());
+
+  listener_->Close();
+  EXPECT_TRUE(peer.detached());
+}
+
+}  // namespace sippet
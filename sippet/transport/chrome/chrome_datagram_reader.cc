@@ -7,6 +7,10 @@
 #include "net/base/net_errors.h"
 #include "net/base/io_buffer.h"
 #include "net/socket/socket.h"
+#include "net/udp/datagram_server_socket.h"
+#include "sippet/base/memory_accounting.h"
+#include "sippet/transport/message_compressor.h"
+#include "sippet/transport/transport_stats.h"
 
 namespace sippet {
 
@@ -16,14 +20,32 @@ static const size_t kReadBufSize = 64U * 1024U;
 ChromeDatagramReader::ChromeDatagramReader(
     net::Socket* socket_to_wrap)
     : wrapped_socket_(socket_to_wrap),
+      wrapped_server_socket_(nullptr),
       read_buf_(new net::IOBufferWithSize(kReadBufSize)),
+      compressor_(nullptr),
       read_complete_(base::Bind(&ChromeDatagramReader::OnReceiveDataComplete,
           base::Unretained(this))) {
   DCHECK(socket_to_wrap);
-  read_start_ = read_end_ = read_buf_->data();
+  datagram_start_ = read_start_ = read_end_ = read_buf_->data();
+  MemoryAccounting::Add(MemoryAccounting::READ_BUFFERS, kReadBufSize);
+}
+
+ChromeDatagramReader::ChromeDatagramReader(
+    net::DatagramServerSocket* socket_to_wrap)
+    : wrapped_socket_(nullptr),
+      wrapped_server_socket_(socket_to_wrap),
+      read_buf_(new net::IOBufferWithSize(kReadBufSize)),
+      compressor_(nullptr),
+      read_complete_(base::Bind(&ChromeDatagramReader::OnReceiveDataComplete,
+          base::Unretained(this))) {
+  DCHECK(socket_to_wrap);
+  datagram_start_ = read_start_ = read_end_ = read_buf_->data();
+  MemoryAccounting::Add(MemoryAccounting::READ_BUFFERS, kReadBufSize);
 }
 
 ChromeDatagramReader::~ChromeDatagramReader() {
+  MemoryAccounting::Add(MemoryAccounting::READ_BUFFERS,
+      -static_cast<int64>(kReadBufSize + decompressed_.capacity()));
 }
 
 int ChromeDatagramReader::DoIORead(
@@ -31,12 +53,18 @@ int ChromeDatagramReader::DoIORead(
   if (HasMessage()) {
     VLOG(1) << "Discarded incoming datagram: truncated body";
     return net::ERR_INVALID_RESPONSE;
-  } else if (BytesRemaining() > 0 && read_start_ == read_buf_->data()) {
+  } else if (BytesRemaining() > 0 && read_start_ == datagram_start_) {
     VLOG(1) << "Discarded incoming datagram: truncated header";
     return net::ERR_INVALID_RESPONSE;
   }
-  int result = wrapped_socket_->Read(read_buf_.get(), read_buf_->size(),
-      read_complete_);
+  int result;
+  if (wrapped_server_socket_) {
+    result = wrapped_server_socket_->RecvFrom(read_buf_.get(),
+        read_buf_->size(), &recv_address_, read_complete_);
+  } else {
+    result = wrapped_socket_->Read(read_buf_.get(), read_buf_->size(),
+        read_complete_);
+  }
   if (result > net::OK) {
     ReceivedData(result);
     return net::OK;
@@ -62,8 +90,31 @@ void ChromeDatagramReader::OnReceiveDataComplete(int result) {
 
 void ChromeDatagramReader::ReceivedData(size_t bytes) {
   DCHECK_GT(bytes, 0U);
-  read_start_ = read_buf_->data();
+  TransportStats::Count(TransportStats::BYTES_RECEIVED, bytes);
+  // Any unconsumed bytes of the previous datagram are gone.
+  DidDiscardData();
+  datagram_start_ = read_start_ = read_buf_->data();
   read_end_ = read_buf_->data() + bytes;
+  if (!compressor_)
+    return;
+  base::StringPiece datagram(read_buf_->data(), bytes);
+  if (!MessageCompressor::IsCompressed(datagram)) {
+    compressor_->DidReceive(datagram);
+    return;
+  }
+  // Datagrams that can't be decoded are dropped, as if they were lost.
+  int64 capacity = static_cast<int64>(decompressed_.capacity());
+  bool decompressed =
+      compressor_->Decompress(datagram, kReadBufSize, &decompressed_);
+  MemoryAccounting::Add(MemoryAccounting::READ_BUFFERS,
+      static_cast<int64>(decompressed_.capacity()) - capacity);
+  if (!decompressed || decompressed_.empty()) {
+    VLOG(1) << "Discarded incoming datagram: can't decompress it";
+    read_end_ = read_start_;
+    return;
+  }
+  datagram_start_ = read_start_ = &decompressed_[0];
+  read_end_ = read_start_ + decompressed_.size();
 }
 
 void ChromeDatagramReader::DoCallback(int result) {
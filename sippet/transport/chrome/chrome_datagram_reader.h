@@ -5,9 +5,13 @@
 #ifndef SIPPET_TRANSPORT_CHROME_CHROME_DATAGRAM_READER_H_
 #define SIPPET_TRANSPORT_CHROME_CHROME_DATAGRAM_READER_H_
 
+#include <string>
+
+#include "net/base/ip_endpoint.h"
 #include "sippet/transport/chrome/message_reader.h"
 
 namespace net {
+class DatagramServerSocket;
 class Socket;
 class IOBufferWithSize;
 }
@@ -15,13 +19,25 @@ class IOBufferWithSize;
 namespace sippet {
 
 class Message;
+class MessageCompressor;
 
 class ChromeDatagramReader
   : public MessageReader {
  public:
   ChromeDatagramReader(net::Socket* socket_to_wrap);
+  // Reads from an unconnected socket shared by many peers; the source of the
+  // last datagram is then given by |recv_address|.
+  ChromeDatagramReader(net::DatagramServerSocket* socket_to_wrap);
   ~ChromeDatagramReader() override;
 
+  const net::IPEndPoint &recv_address() const { return recv_address_; }
+
+  // Decodes the compressed datagrams with |compressor|, that outlives the
+  // reader, and records the other ones as received by it.
+  void set_compressor(MessageCompressor *compressor) {
+    compressor_ = compressor;
+  }
+
  private:
   int DoIORead(const net::CompletionCallback& callback) override;
   char *data() override;
@@ -34,7 +50,15 @@ class ChromeDatagramReader
   void DoCallback(int result);
 
   net::Socket* wrapped_socket_;
+  net::DatagramServerSocket* wrapped_server_socket_;
+  net::IPEndPoint recv_address_;
   scoped_refptr<net::IOBufferWithSize> read_buf_;
+  MessageCompressor *compressor_;
+  // The last datagram, once decompressed.
+  std::string decompressed_;
+  // Where the last datagram starts, either in |read_buf_| or in
+  // |decompressed_|.
+  char *datagram_start_;
   net::CompletionCallback callback_;
   net::CompletionCallback read_complete_;
   char *read_start_;
@@ -5,9 +5,11 @@
 #include "sippet/transport/chrome/chrome_datagram_writer.h"
 
 #include "base/stl_util.h"
+#include "base/trace_event/trace_event.h"
 #include "net/base/io_buffer.h"
 #include "net/base/net_errors.h"
 #include "net/socket/socket.h"
+#include "sippet/transport/transport_stats.h"
 
 namespace sippet {
 
@@ -24,18 +26,30 @@ ChromeDatagramWriter::ChromeDatagramWriter(
     net::Socket *socket_to_wrap)
     : wrapped_socket_(socket_to_wrap),
       weak_factory_(this),
-      error_(net::OK) {
+      error_(net::OK),
+      overtaken_(0) {
 }
 
 ChromeDatagramWriter::~ChromeDatagramWriter() {
   STLDeleteElements(&pending_messages_);
+  STLDeleteElements(&deferred_messages_);
 }
 
 int ChromeDatagramWriter::Write(net::IOBuffer* buf, int buf_len,
                                    const net::CompletionCallback& callback) {
+  return WriteMessage(buf, buf_len, WRITE_PRIORITY_URGENT, callback);
+}
+
+int ChromeDatagramWriter::WriteMessage(
+    net::IOBuffer* buf, int buf_len, WritePriority priority,
+    const net::CompletionCallback& callback) {
+  TRACE_EVENT1("sippet", "ChromeDatagramWriter::Write", "size", buf_len);
   if (error_ != net::OK)
     return error_;
+  if (!queue_monitor_.CanQueue())
+    return net::ERR_INSUFFICIENT_RESOURCES;
 
+  TransportStats::Count(TransportStats::BYTES_SENT, buf_len);
   if (pending_messages_.empty()) {
     int res = Drain(buf, buf_len);
     if (res == net::OK || res != net::ERR_IO_PENDING) {
@@ -44,17 +58,36 @@ int ChromeDatagramWriter::Write(net::IOBuffer* buf, int buf_len,
     }
   }
 
-  pending_messages_.push_back(new PendingFrame(buf, buf_len, callback));
+  PendingFrame *pending = new PendingFrame(buf, buf_len, callback);
+  // Bulk messages are only deferred when there's something to wait for.
+  if (WRITE_PRIORITY_BULK == priority && !pending_messages_.empty()) {
+    deferred_messages_.push_back(pending);
+  } else {
+    if (!deferred_messages_.empty())
+      ++overtaken_;
+    pending_messages_.push_back(pending);
+  }
+  queue_monitor_.Queued(buf_len);
   return net::ERR_IO_PENDING;
 }
 
 void ChromeDatagramWriter::CloseWithError(int err) {
   error_ = err;
+  pending_messages_.insert(pending_messages_.end(),
+      deferred_messages_.begin(), deferred_messages_.end());
+  deferred_messages_.clear();
   while (!pending_messages_.empty())
     Pop(err);
 }
 
+void ChromeDatagramWriter::SetWriteQueueLimits(
+    const WriteQueueLimits &limits,
+    const WriteQueueMonitor::StateCallback &callback) {
+  queue_monitor_.SetLimits(limits, callback);
+}
+
 void ChromeDatagramWriter::DidWrite(int result) {
+  TRACE_EVENT1("sippet", "ChromeDatagramWriter::DidWrite", "result", result);
   DCHECK(!pending_messages_.empty());
 
   if (result > 0) {
@@ -69,6 +102,7 @@ void ChromeDatagramWriter::DidWrite(int result) {
 void ChromeDatagramWriter::DidConsume() {
   for (;;) {
     Pop(net::OK);
+    ScheduleDeferred();
     if (pending_messages_.empty())
       break;  // done
     PendingFrame *pending = pending_messages_.front();
@@ -81,9 +115,20 @@ void ChromeDatagramWriter::DidConsume() {
   }
 }
 
+void ChromeDatagramWriter::ScheduleDeferred() {
+  if (deferred_messages_.empty())
+    return;
+  if (!pending_messages_.empty() && overtaken_ < kMaxOvertaken)
+    return;
+  pending_messages_.push_back(deferred_messages_.front());
+  deferred_messages_.pop_front();
+  overtaken_ = 0;
+}
+
 void ChromeDatagramWriter::Pop(int result) {
   PendingFrame *pending = pending_messages_.front();
   pending->callback_.Run(result);
+  queue_monitor_.Dequeued(pending->buf_len_);
   delete pending;
   pending_messages_.pop_front();
 }
@@ -8,6 +8,7 @@
 #include <deque>
 #include "base/memory/weak_ptr.h"
 #include "net/base/completion_callback.h"
+#include "sippet/transport/chrome/write_queue_monitor.h"
 
 namespace base {
 class TimeDelta;
@@ -26,17 +27,36 @@ namespace sippet {
 // But messages will be truncated instead of cutting them down in frame
 // boundaries.
 //
-// There are no bounds on the local buffer size. Use carefully.
+// Bulk messages wait for the urgent ones queued after them, see
+// |WritePriority|, but never for more than |kMaxOvertaken| of them.
+//
+// There are no bounds on the local buffer size, unless limited by
+// |SetWriteQueueLimits|.
 class ChromeDatagramWriter {
  public:
+  // Urgent messages a bulk one waits for at most.
+  static const int kMaxOvertaken = 8;
+
   ChromeDatagramWriter(net::Socket* socket_to_wrap);
   virtual ~ChromeDatagramWriter();
 
+  // Writes an urgent message.
   int Write(net::IOBuffer* buf, int buf_len,
             const net::CompletionCallback& callback);
 
+  int WriteMessage(net::IOBuffer* buf, int buf_len, WritePriority priority,
+                   const net::CompletionCallback& callback);
+
   void CloseWithError(int err);
 
+  // Watch the queued frames, running |callback| as the writer becomes
+  // congested or writable again.
+  void SetWriteQueueLimits(const WriteQueueLimits &limits,
+                           const WriteQueueMonitor::StateCallback &callback);
+
+  // Bytes of the messages queued.
+  size_t queued_bytes() const { return queue_monitor_.bytes(); }
+
  private:
   net::Socket* wrapped_socket_;
   int error_;
@@ -51,9 +71,16 @@ class ChromeDatagramWriter {
   };
 
   std::deque<PendingFrame*> pending_messages_;
+  // Bulk messages not yet moved to |pending_messages_|. Never left behind an
+  // empty |pending_messages_|.
+  std::deque<PendingFrame*> deferred_messages_;
+  // Urgent messages queued ahead of the first deferred one.
+  int overtaken_;
+  WriteQueueMonitor queue_monitor_;
 
   void DidWrite(int result);
   void DidConsume();
+  void ScheduleDeferred();
   void Pop(int result);
   int Drain(net::IOBuffer* buf, int buf_len);
 
@@ -4,7 +4,9 @@
 
 #include "sippet/transport/chrome/chrome_datagram_writer.h"
 
+#include <cstring>
 #include <string>
+#include <vector>
 
 #include "sippet/message/message.h"
 #include "net/socket/socket_test_util.h"
@@ -25,6 +27,9 @@ using sippet::ContentLength;
 using sippet::ChromeDatagramWriter;
 using sippet::Method;
 using sippet::Protocol;
+using sippet::WritePriority;
+using sippet::WRITE_PRIORITY_BULK;
+using sippet::WRITE_PRIORITY_URGENT;
 
 class DatagramChannelTest : public testing::Test {
  public:
@@ -86,6 +91,13 @@ class DatagramChannelTest : public testing::Test {
     return writer_->Write(buf.get(), data.size(), callback);
   }
 
+  int WriteData(const char *data, WritePriority priority,
+                const net::CompletionCallback &callback) {
+    scoped_refptr<net::IOBuffer> buf(new net::IOBuffer(strlen(data)));
+    memcpy(buf->data(), data, strlen(data));
+    return writer_->WriteMessage(buf.get(), strlen(data), priority, callback);
+  }
+
   net::DeterministicMockTCPClientSocket* wrapped_socket_;
   scoped_ptr<net::DeterministicSocketData> data_;
   scoped_ptr<ChromeDatagramWriter> writer_;
@@ -237,3 +249,42 @@ TEST_F(DatagramChannelTest, AsyncConnReset) {
 
   Finish();
 }
+
+TEST_F(DatagramChannelTest, PrioritizedSend) {
+  // A bulk message waits for the urgent ones queued after it, but only up
+  // to |kMaxOvertaken|; urgent messages queued later wait for it.
+  std::vector<net::MockWrite> writes;
+  writes.push_back(net::MockWrite(net::ASYNC, 0, "first"));
+  for (int i = 0; i < ChromeDatagramWriter::kMaxOvertaken; ++i)
+    writes.push_back(net::MockWrite(net::ASYNC, static_cast<int>(writes.size()),
+        "urgent"));
+  writes.push_back(net::MockWrite(net::ASYNC, static_cast<int>(writes.size()),
+        "bulk"));
+  writes.push_back(net::MockWrite(net::ASYNC, static_cast<int>(writes.size()),
+        "late"));
+
+  Initialize(&writes[0], writes.size());
+
+  net::TestCompletionCallback bulk_callback;
+  ASSERT_EQ(net::ERR_IO_PENDING,
+      WriteData("first", WRITE_PRIORITY_BULK, callback_.callback()));
+  ASSERT_EQ(net::ERR_IO_PENDING,
+      WriteData("bulk", WRITE_PRIORITY_BULK, bulk_callback.callback()));
+  for (int i = 0; i < ChromeDatagramWriter::kMaxOvertaken; ++i) {
+    ASSERT_EQ(net::ERR_IO_PENDING,
+        WriteData("urgent", WRITE_PRIORITY_URGENT, callback_.callback()));
+  }
+
+  wrapped_socket_->CompleteWrite();
+  data_->RunFor(1);
+  ASSERT_EQ(net::ERR_IO_PENDING,
+      WriteData("late", WRITE_PRIORITY_URGENT, callback_.callback()));
+  for (size_t i = 1; i < writes.size(); ++i) {
+    wrapped_socket_->CompleteWrite();
+    data_->RunFor(1);
+  }
+  ASSERT_TRUE(bulk_callback.have_result());
+  EXPECT_EQ(net::OK, bulk_callback.WaitForResult());
+
+  Finish();
+}
@@ -0,0 +1,180 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/chrome/chrome_record_resolver.h"
+
+#include <algorithm>
+
+#include "base/big_endian.h"
+#include "base/bind.h"
+#include "base/logging.h"
+#include "net/base/net_errors.h"
+#include "net/dns/dns_client.h"
+#include "net/dns/dns_protocol.h"
+#include "net/dns/dns_response.h"
+#include "net/dns/dns_transaction.h"
+
+namespace sippet {
+
+namespace {
+
+// Not defined by net/dns/dns_protocol.h.
+const uint16 kTypeNAPTR = 35;
+
+// For how long a missing record is remembered.
+const int kNegativeTtlSeconds = 60;
+
+bool ReadCharacterString(base::BigEndianReader *reader, std::string *out) {
+  uint8 length;
+  base::StringPiece piece;
+  if (!reader->ReadU8(&length) || !reader->ReadPiece(&piece, length))
+    return false;
+  piece.CopyToString(out);
+  return true;
+}
+
+void UpdateTtl(uint32 record_ttl, bool first, base::TimeDelta *ttl) {
+  base::TimeDelta record_delta(base::TimeDelta::FromSeconds(record_ttl));
+  *ttl = first ? record_delta : std::min(*ttl, record_delta);
+}
+
+}  // namespace
+
+ChromeRecordResolver::ChromeRecordResolver(
+    net::DnsClient *dns_client,
+    const net::BoundNetLog &bound_net_log)
+  : dns_client_(dns_client),
+    bound_net_log_(bound_net_log),
+    weak_ptr_factory_(this) {
+  DCHECK(dns_client_);
+}
+
+ChromeRecordResolver::~ChromeRecordResolver() {
+}
+
+void ChromeRecordResolver::ResolveNaptr(const std::string &domain,
+                                        const NaptrCallback &callback) {
+  StartTransaction(domain, kTypeNAPTR,
+      base::Bind(&ChromeRecordResolver::OnNaptrResponse, callback));
+}
+
+void ChromeRecordResolver::ResolveSrv(const std::string &name,
+                                      const SrvCallback &callback) {
+  StartTransaction(name, net::dns_protocol::kTypeSRV,
+      base::Bind(&ChromeRecordResolver::OnSrvResponse, callback));
+}
+
+int ChromeRecordResolver::ParseNaptrResponse(
+    const net::DnsResponse &response,
+    SipLocator::NaptrRecords *records,
+    base::TimeDelta *ttl) {
+  net::DnsRecordParser parser(response.Parser());
+  for (unsigned i = 0; i < response.answer_count(); ++i) {
+    net::DnsResourceRecord record;
+    if (!parser.ReadRecord(&record))
+      return net::ERR_DNS_MALFORMED_RESPONSE;
+    if (record.type != kTypeNAPTR)
+      continue;
+    base::BigEndianReader reader(record.rdata.data(), record.rdata.size());
+    SipLocator::NaptrRecord naptr;
+    std::string regexp;
+    if (!reader.ReadU16(&naptr.order) ||
+        !reader.ReadU16(&naptr.preference) ||
+        !ReadCharacterString(&reader, &naptr.flags) ||
+        !ReadCharacterString(&reader, &naptr.service) ||
+        !ReadCharacterString(&reader, &regexp) ||
+        !parser.ReadName(reader.ptr(), &naptr.replacement))
+      return net::ERR_DNS_MALFORMED_RESPONSE;
+    UpdateTtl(record.ttl, records->empty(), ttl);
+    records->push_back(naptr);
+  }
+  return records->empty() ? net::ERR_NAME_NOT_RESOLVED : net::OK;
+}
+
+int ChromeRecordResolver::ParseSrvResponse(
+    const net::DnsResponse &response,
+    SipLocator::SrvRecords *records,
+    base::TimeDelta *ttl) {
+  net::DnsRecordParser parser(response.Parser());
+  for (unsigned i = 0; i < response.answer_count(); ++i) {
+    net::DnsResourceRecord record;
+    if (!parser.ReadRecord(&record))
+      return net::ERR_DNS_MALFORMED_RESPONSE;
+    if (record.type != net::dns_protocol::kTypeSRV)
+      continue;
+    base::BigEndianReader reader(record.rdata.data(), record.rdata.size());
+    SipLocator::SrvRecord srv;
+    if (!reader.ReadU16(&srv.priority) ||
+        !reader.ReadU16(&srv.weight) ||
+        !reader.ReadU16(&srv.port) ||
+        !parser.ReadName(reader.ptr(), &srv.target))
+      return net::ERR_DNS_MALFORMED_RESPONSE;
+    UpdateTtl(record.ttl, records->empty(), ttl);
+    records->push_back(srv);
+  }
+  return records->empty() ? net::ERR_NAME_NOT_RESOLVED : net::OK;
+}
+
+void ChromeRecordResolver::StartTransaction(
+    const std::string &name, uint16 qtype,
+    const ResponseCallback &callback) {
+  net::DnsTransactionFactory *factory = dns_client_->GetTransactionFactory();
+  if (!factory) {
+    // There's no DNS configuration yet.
+    callback.Run(net::ERR_NAME_NOT_RESOLVED, nullptr);
+    return;
+  }
+  scoped_ptr<net::DnsTransaction> transaction(factory->CreateTransaction(
+      name, qtype,
+      base::Bind(&ChromeRecordResolver::OnTransactionComplete,
+                 weak_ptr_factory_.GetWeakPtr(), callback),
+      bound_net_log_));
+  net::DnsTransaction *raw_transaction = transaction.get();
+  transactions_.push_back(transaction.release());
+  raw_transaction->Start();
+}
+
+void ChromeRecordResolver::OnTransactionComplete(
+    const ResponseCallback &callback,
+    net::DnsTransaction *transaction,
+    int result,
+    const net::DnsResponse *response) {
+  ScopedVector<net::DnsTransaction>::iterator i =
+      std::find(transactions_.begin(), transactions_.end(), transaction);
+  DCHECK(i != transactions_.end());
+  // Keep the transaction, which owns |response|, until the callback is run.
+  scoped_ptr<net::DnsTransaction> owned_transaction(*i);
+  transactions_.weak_erase(i);
+  callback.Run(result, result == net::OK ? response : nullptr);
+}
+
+void ChromeRecordResolver::OnNaptrResponse(
+    const NaptrCallback &callback, int result,
+    const net::DnsResponse *response) {
+  SipLocator::NaptrRecords records;
+  base::TimeDelta ttl(base::TimeDelta::FromSeconds(kNegativeTtlSeconds));
+  if (result == net::OK)
+    result = ParseNaptrResponse(*response, &records, &ttl);
+  if (result != net::OK) {
+    records.clear();
+    ttl = base::TimeDelta::FromSeconds(kNegativeTtlSeconds);
+  }
+  callback.Run(result, records, ttl);
+}
+
+void ChromeRecordResolver::OnSrvResponse(
+    const SrvCallback &callback, int result,
+    const net::DnsResponse *response) {
+  SipLocator::SrvRecords records;
+  base::TimeDelta ttl(base::TimeDelta::FromSeconds(kNegativeTtlSeconds));
+  if (result == net::OK)
+    result = ParseSrvResponse(*response, &records, &ttl);
+  if (result != net::OK) {
+    records.clear();
+    ttl = base::TimeDelta::FromSeconds(kNegativeTtlSeconds);
+  }
+  callback.Run(result, records, ttl);
+}
+
+}  // namespace sippet
@@ -0,0 +1,72 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_CHROME_CHROME_RECORD_RESOLVER_H_
+#define SIPPET_TRANSPORT_CHROME_CHROME_RECORD_RESOLVER_H_
+
+#include "base/memory/scoped_vector.h"
+#include "base/memory/weak_ptr.h"
+#include "net/log/net_log.h"
+#include "sippet/transport/sip_locator.h"
+
+namespace net {
+class DnsClient;
+class DnsResponse;
+class DnsTransaction;
+}
+
+namespace sippet {
+
+// Queries NAPTR and SRV records through Chrome's asynchronous DNS client.
+class ChromeRecordResolver : public SipLocator::RecordResolver {
+ public:
+  // |dns_client| is not owned, and must outlive the resolver.
+  ChromeRecordResolver(net::DnsClient *dns_client,
+                       const net::BoundNetLog &bound_net_log);
+  ~ChromeRecordResolver() override;
+
+  // sippet::SipLocator::RecordResolver methods:
+  void ResolveNaptr(const std::string &domain,
+                    const NaptrCallback &callback) override;
+  void ResolveSrv(const std::string &name,
+                  const SrvCallback &callback) override;
+
+  // Parse the answers of a DNS response. Return |net::OK| with at least one
+  // record, and the smallest TTL among them.
+  static int ParseNaptrResponse(const net::DnsResponse &response,
+                                SipLocator::NaptrRecords *records,
+                                base::TimeDelta *ttl);
+  static int ParseSrvResponse(const net::DnsResponse &response,
+                              SipLocator::SrvRecords *records,
+                              base::TimeDelta *ttl);
+
+ private:
+  // |response| is null unless |result| is |net::OK|.
+  typedef base::Callback<void(int result, const net::DnsResponse *response)>
+      ResponseCallback;
+
+  void StartTransaction(const std::string &name, uint16 qtype,
+                        const ResponseCallback &callback);
+  void OnTransactionComplete(const ResponseCallback &callback,
+                             net::DnsTransaction *transaction,
+                             int result,
+                             const net::DnsResponse *response);
+
+  static void OnNaptrResponse(const NaptrCallback &callback, int result,
+                              const net::DnsResponse *response);
+  static void OnSrvResponse(const SrvCallback &callback, int result,
+                            const net::DnsResponse *response);
+
+  net::DnsClient *dns_client_;
+  net::BoundNetLog bound_net_log_;
+  ScopedVector<net::DnsTransaction> transactions_;
+
+  base::WeakPtrFactory<ChromeRecordResolver> weak_ptr_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChromeRecordResolver);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_CHROME_CHROME_RECORD_RESOLVER_H_
@@ -0,0 +1,103 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/chrome/chrome_server_datagram_channel.h"
+
+#include "base/logging.h"
+#include "net/base/io_buffer.h"
+#include "net/base/net_errors.h"
+#include "sippet/message/message.h"
+#include "sippet/transport/chrome/message_io_buffer.h"
+
+namespace sippet {
+
+ChromeServerDatagramChannel::ChromeServerDatagramChannel(
+    const EndPoint& destination,
+    Channel::Delegate *delegate,
+    ChromeDatagramListener *listener,
+    const net::IPEndPoint &address)
+  : destination_(destination),
+    delegate_(delegate),
+    listener_(listener),
+    address_(address) {
+  DCHECK(delegate_);
+  DCHECK(listener_);
+}
+
+ChromeServerDatagramChannel::~ChromeServerDatagramChannel() {
+  if (listener_)
+    listener_->RemovePeer(address_, this);
+}
+
+void ChromeServerDatagramChannel::HandleIncomingMessage(
+    const scoped_refptr<Message> &message) {
+  if (delegate_)
+    delegate_->OnIncomingMessage(this, message);
+}
+
+void ChromeServerDatagramChannel::DetachListener() {
+  listener_ = nullptr;
+}
+
+int ChromeServerDatagramChannel::origin(EndPoint *origin) const {
+  if (!listener_)
+    return net::ERR_SOCKET_NOT_CONNECTED;
+  return listener_->GetLocalEndPoint(origin);
+}
+
+const EndPoint& ChromeServerDatagramChannel::destination() const {
+  return destination_;
+}
+
+bool ChromeServerDatagramChannel::is_secure() const {
+  return false;
+}
+
+bool ChromeServerDatagramChannel::is_connected() const {
+  return listener_ != nullptr;
+}
+
+bool ChromeServerDatagramChannel::is_stream() const {
+  return false;
+}
+
+void ChromeServerDatagramChannel::Connect() {
+  NOTREACHED() << "accepted channels are already connected";
+}
+
+int ChromeServerDatagramChannel::ReconnectIgnoringLastError() {
+  return net::ERR_NOT_IMPLEMENTED;
+}
+
+int ChromeServerDatagramChannel::ReconnectWithCertificate(
+    net::X509Certificate* client_cert) {
+  return net::ERR_NOT_IMPLEMENTED;
+}
+
+int ChromeServerDatagramChannel::Send(const scoped_refptr<Message> &message,
+        const net::CompletionCallback& callback) {
+  if (!listener_)
+    return net::ERR_SOCKET_NOT_CONNECTED;
+  scoped_refptr<net::IOBufferWithSize> buffer(SerializeMessage(*message));
+  if (delegate_)
+    delegate_->OnOutgoingMessage(this, message);
+  return listener_->SendTo(buffer.get(), buffer->size(), address_, callback);
+}
+
+void ChromeServerDatagramChannel::Close() {
+  // Further datagrams from the peer will create a new channel.
+  if (listener_)
+    listener_->RemovePeer(address_, this);
+  listener_ = nullptr;
+}
+
+void ChromeServerDatagramChannel::CloseWithError(int err) {
+  // Sends are queued by the listener, which completes them on its own.
+}
+
+void ChromeServerDatagramChannel::DetachDelegate() {
+  delegate_ = nullptr;
+}
+
+}  // namespace sippet
@@ -0,0 +1,67 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_CHROME_CHROME_SERVER_DATAGRAM_CHANNEL_H_
+#define SIPPET_TRANSPORT_CHROME_CHROME_SERVER_DATAGRAM_CHANNEL_H_
+
+#include "sippet/transport/channel.h"
+#include "sippet/transport/chrome/chrome_datagram_listener.h"
+#include "net/base/ip_endpoint.h"
+
+namespace sippet {
+
+class Message;
+
+// A logical channel to a single peer of a |ChromeDatagramListener|. It has no
+// socket of its own: datagrams are sent through the listener's shared socket,
+// and the listener hands over the messages received from the peer address.
+class ChromeServerDatagramChannel : public Channel,
+                                    public ChromeDatagramListener::Peer {
+ public:
+  ChromeServerDatagramChannel(const EndPoint& destination,
+      Channel::Delegate *delegate,
+      ChromeDatagramListener *listener,
+      const net::IPEndPoint &address);
+
+  const net::IPEndPoint &address() const { return address_; }
+
+  // sippet::ChromeDatagramListener::Peer methods:
+  void HandleIncomingMessage(const scoped_refptr<Message> &message) override;
+  void DetachListener() override;
+
+  int origin(EndPoint *origin) const override;
+  const EndPoint& destination() const override;
+
+  bool is_secure() const override;
+  bool is_connected() const override;
+  bool is_stream() const override;
+
+  void Connect() override;
+  int ReconnectIgnoringLastError() override;
+  int ReconnectWithCertificate(net::X509Certificate* client_cert) override;
+
+  int Send(const scoped_refptr<Message> &message,
+           const net::CompletionCallback& callback) override;
+
+  void Close() override;
+
+  void CloseWithError(int err) override;
+
+  void DetachDelegate() override;
+
+ private:
+  friend class base::RefCountedThreadSafe<Channel>;
+  ~ChromeServerDatagramChannel() override;
+
+  EndPoint destination_;
+  Channel::Delegate *delegate_;
+  ChromeDatagramListener *listener_;
+  net::IPEndPoint address_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChromeServerDatagramChannel);
+};
+
+} /// End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_CHROME_CHROME_SERVER_DATAGRAM_CHANNEL_H_
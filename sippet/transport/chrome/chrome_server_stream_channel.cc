@@ -0,0 +1,237 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/chrome/chrome_server_stream_channel.h"
+
+#include <vector>
+
+#include "base/bind.h"
+#include "base/logging.h"
+#include "base/message_loop/message_loop.h"
+#include "net/base/io_buffer.h"
+#include "net/base/net_errors.h"
+#include "net/socket/stream_socket.h"
+#include "sippet/message/message.h"
+#include "sippet/transport/chrome/message_io_buffer.h"
+
+namespace sippet {
+
+namespace {
+
+void IgnoreWriteResult(int result) {}
+
+}  // namespace
+
+ChromeServerStreamChannel::ChromeServerStreamChannel(
+    const EndPoint& destination,
+    Channel::Delegate *delegate,
+    scoped_ptr<net::StreamSocket> socket)
+  : destination_(destination),
+    delegate_(delegate),
+    socket_(socket.Pass()),
+    weak_ptr_factory_(this) {
+  DCHECK(delegate_);
+  DCHECK(socket_);
+  stream_reader_.reset(new ChromeStreamReader(socket_.get()));
+  stream_reader_->set_keepalive_callback(
+      base::Bind(&ChromeServerStreamChannel::OnKeepAlive,
+                 weak_ptr_factory_.GetWeakPtr()));
+  stream_writer_.reset(new ChromeStreamWriter(socket_.get()));
+  ApplyWriteQueueLimits();
+}
+
+ChromeServerStreamChannel::~ChromeServerStreamChannel() {
+}
+
+void ChromeServerStreamChannel::Start() {
+  PostDoRead();
+}
+
+int ChromeServerStreamChannel::origin(EndPoint *origin) const {
+  if (!socket_.get())
+    return net::ERR_SOCKET_NOT_CONNECTED;
+  net::IPEndPoint ip_endpoint;
+  int rv = socket_->GetLocalAddress(&ip_endpoint);
+  if (net::OK != rv)
+    return rv;
+  *origin = EndPoint(net::HostPortPair::FromIPEndPoint(ip_endpoint),
+      destination_.protocol());
+  return net::OK;
+}
+
+const EndPoint& ChromeServerStreamChannel::destination() const {
+  return destination_;
+}
+
+bool ChromeServerStreamChannel::is_secure() const {
+  return Protocol::TLS == destination_.protocol();
+}
+
+bool ChromeServerStreamChannel::is_connected() const {
+  return socket_.get() && socket_->IsConnected();
+}
+
+bool ChromeServerStreamChannel::is_stream() const {
+  return true;
+}
+
+void ChromeServerStreamChannel::Connect() {
+  NOTREACHED() << "accepted channels are already connected";
+}
+
+int ChromeServerStreamChannel::ReconnectIgnoringLastError() {
+  return net::ERR_NOT_IMPLEMENTED;
+}
+
+int ChromeServerStreamChannel::ReconnectWithCertificate(
+    net::X509Certificate* client_cert) {
+  return net::ERR_NOT_IMPLEMENTED;
+}
+
+int ChromeServerStreamChannel::Send(const scoped_refptr<Message> &message,
+        const net::CompletionCallback& callback) {
+  if (!socket_.get())
+    return net::ERR_SOCKET_NOT_CONNECTED;
+  IOBufferList buffers;
+  SerializeMessage(*message, &buffers);
+  if (delegate_)
+    delegate_->OnOutgoingMessage(this, message);
+  return stream_writer_->WriteMessage(buffers, GetWritePriority(*message),
+      callback);
+}
+
+int ChromeServerStreamChannel::SendKeepAlive(
+    const net::CompletionCallback& callback) {
+  if (!stream_writer_.get())
+    return net::ERR_SOCKET_NOT_CONNECTED;
+  return stream_writer_->WriteKeepAlive(false, callback);
+}
+
+void ChromeServerStreamChannel::Close() {
+  CloseTransportSocket();
+}
+
+void ChromeServerStreamChannel::CloseWithError(int err) {
+  if (stream_writer_.get())
+    stream_writer_->CloseWithError(err);
+}
+
+void ChromeServerStreamChannel::SetWriteQueueLimits(
+    const WriteQueueLimits &limits) {
+  write_queue_limits_ = limits;
+  if (stream_writer_.get())
+    ApplyWriteQueueLimits();
+}
+
+size_t ChromeServerStreamChannel::queued_write_bytes() const {
+  return stream_writer_.get() ? stream_writer_->queued_bytes() : 0;
+}
+
+void ChromeServerStreamChannel::SetParseProfile(const ParseProfile &profile) {
+  parse_profile_ = profile;
+  if (stream_reader_.get())
+    stream_reader_->set_parse_profile(parse_profile_);
+}
+
+void ChromeServerStreamChannel::SetMessageLimits(const MessageLimits &limits) {
+  message_limits_ = limits;
+  if (stream_reader_.get())
+    stream_reader_->set_message_limits(message_limits_);
+}
+
+void ChromeServerStreamChannel::ApplyWriteQueueLimits() {
+  stream_writer_->SetWriteQueueLimits(write_queue_limits_,
+      base::Bind(&ChromeServerStreamChannel::OnWriteQueueStateChanged,
+                 base::Unretained(this)));
+}
+
+void ChromeServerStreamChannel::OnWriteQueueStateChanged(bool congested) {
+  if (!delegate_)
+    return;
+  if (congested)
+    delegate_->OnChannelCongested(this);
+  else
+    delegate_->OnChannelWritable(this);
+}
+
+void ChromeServerStreamChannel::DetachDelegate() {
+  delegate_ = nullptr;
+}
+
+void ChromeServerStreamChannel::CloseTransportSocket() {
+  if (socket_.get())
+    socket_->Disconnect();
+  stream_reader_.reset();
+  stream_writer_.reset();
+  socket_.reset();
+  weak_ptr_factory_.InvalidateWeakPtrs();
+}
+
+void ChromeServerStreamChannel::RunUserChannelClosed(int status) {
+  DCHECK_LE(status, net::OK);
+  if (delegate_)
+    delegate_->OnChannelClosed(this, status);
+}
+
+void ChromeServerStreamChannel::PostDoRead() {
+  base::MessageLoop* message_loop = base::MessageLoop::current();
+  CHECK(message_loop);
+  message_loop->PostTask(
+      FROM_HERE,
+      base::Bind(&ChromeServerStreamChannel::DoRead,
+                 weak_ptr_factory_.GetWeakPtr()));
+}
+
+void ChromeServerStreamChannel::DoRead() {
+  DCHECK(stream_reader_.get());
+  int result = stream_reader_->Read(
+      base::Bind(&ChromeServerStreamChannel::OnReadComplete,
+                 weak_ptr_factory_.GetWeakPtr()));
+  if (net::ERR_IO_PENDING == result)
+    return;
+  OnReadComplete(result);
+}
+
+void ChromeServerStreamChannel::OnReadComplete(int result) {
+  DCHECK_NE(net::ERR_IO_PENDING, result);
+  if (net::OK == result) {
+    std::vector<scoped_refptr<Message> > messages;
+    messages.push_back(stream_reader_->GetIncomingMessage());
+    result = stream_reader_->ReadBuffered(&messages);
+    if (net::OK == result)
+      PostDoRead();
+    base::WeakPtr<ChromeServerStreamChannel> weak_this(
+        weak_ptr_factory_.GetWeakPtr());
+    for (std::vector<scoped_refptr<Message> >::iterator i = messages.begin(),
+         ie = messages.end(); i != ie; ++i) {
+      if (delegate_)
+        delegate_->OnIncomingMessage(this, *i);
+      if (!weak_this)
+        return;  // The channel was closed meanwhile
+    }
+  }
+  if (result < 0) {
+    RunUserChannelClosed(result);
+    // |this| may be deleted after this call.
+  }
+}
+
+void ChromeServerStreamChannel::OnKeepAlive(int empty_lines) {
+  // A double CRLF is a ping, answered with a single CRLF pong.
+  if (empty_lines >= 2)
+    stream_writer_->WriteKeepAlive(true, base::Bind(&IgnoreWriteResult));
+  base::MessageLoop* message_loop = base::MessageLoop::current();
+  CHECK(message_loop);
+  message_loop->PostTask(
+      FROM_HERE,
+      base::Bind(&ChromeServerStreamChannel::RunUserKeepAliveReceived,
+                 weak_ptr_factory_.GetWeakPtr()));
+}
+
+void ChromeServerStreamChannel::RunUserKeepAliveReceived() {
+  if (delegate_)
+    delegate_->OnKeepAliveReceived(this);
+}
+
+}  // namespace sippet
@@ -0,0 +1,98 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_CHROME_CHROME_SERVER_STREAM_CHANNEL_H_
+#define SIPPET_TRANSPORT_CHROME_CHROME_SERVER_STREAM_CHANNEL_H_
+
+#include "sippet/transport/channel.h"
+#include "sippet/transport/chrome/chrome_stream_writer.h"
+#include "sippet/transport/chrome/chrome_stream_reader.h"
+#include "base/memory/weak_ptr.h"
+
+namespace net {
+class StreamSocket;
+}
+
+namespace sippet {
+
+class Message;
+
+// A stream channel accepted by a |ChromeStreamListener|. Unlike the
+// |ChromeStreamChannel|, it never connects by itself: it wraps a socket that
+// is already connected, and already through the TLS handshake for secure
+// channels.
+class ChromeServerStreamChannel : public Channel {
+ public:
+  ChromeServerStreamChannel(const EndPoint& destination,
+      Channel::Delegate *delegate,
+      scoped_ptr<net::StreamSocket> socket);
+
+  // Starts reading messages from the socket.
+  void Start();
+
+  int origin(EndPoint *origin) const override;
+  const EndPoint& destination() const override;
+
+  bool is_secure() const override;
+  bool is_connected() const override;
+  bool is_stream() const override;
+
+  void Connect() override;
+  int ReconnectIgnoringLastError() override;
+  int ReconnectWithCertificate(net::X509Certificate* client_cert) override;
+
+  int Send(const scoped_refptr<Message> &message,
+           const net::CompletionCallback& callback) override;
+
+  int SendKeepAlive(const net::CompletionCallback& callback) override;
+
+  void Close() override;
+
+  void CloseWithError(int err) override;
+
+  void SetWriteQueueLimits(const WriteQueueLimits &limits) override;
+
+  size_t queued_write_bytes() const override;
+
+  void SetParseProfile(const ParseProfile &profile) override;
+  void SetMessageLimits(const MessageLimits &limits) override;
+
+  void DetachDelegate() override;
+
+ private:
+  friend class base::RefCountedThreadSafe<Channel>;
+  ~ChromeServerStreamChannel() override;
+
+  // Hands |write_queue_limits_| to the writer.
+  void ApplyWriteQueueLimits();
+  void OnWriteQueueStateChanged(bool congested);
+
+  void CloseTransportSocket();
+  void RunUserChannelClosed(int status);
+
+  void PostDoRead();
+  void DoRead();
+  void OnReadComplete(int result);
+
+  void OnKeepAlive(int empty_lines);
+  void RunUserKeepAliveReceived();
+
+  EndPoint destination_;
+  Channel::Delegate *delegate_;
+  WriteQueueLimits write_queue_limits_;
+  ParseProfile parse_profile_;
+  MessageLimits message_limits_;
+
+  scoped_ptr<net::StreamSocket> socket_;
+  scoped_ptr<ChromeStreamReader> stream_reader_;
+  scoped_ptr<ChromeStreamWriter> stream_writer_;
+
+  base::WeakPtrFactory<ChromeServerStreamChannel> weak_ptr_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChromeServerStreamChannel);
+};
+
+} /// End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_CHROME_CHROME_SERVER_STREAM_CHANNEL_H_
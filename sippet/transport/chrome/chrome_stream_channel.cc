@@ -13,6 +13,7 @@
 #include "base/compiler_specific.h"
 #include "base/logging.h"
 #include "base/strings/string_number_conversions.h"
+#include "base/strings/stringprintf.h"
 #include "net/base/io_buffer.h"
 #include "net/base/net_errors.h"
 #include "net/http/http_network_session.h"
@@ -24,9 +25,27 @@
 #include "net/url_request/url_request_context_getter.h"
 #include "net/ssl/ssl_cert_request_info.h"
 #include "sippet/message/message.h"
+#include "sippet/transport/chrome/chrome_connection_racer.h"
+#include "sippet/transport/chrome/proxy_decision_cache.h"
+#include "sippet/transport/chrome/message_io_buffer.h"
 
 namespace sippet {
 
+namespace {
+
+void IgnoreWriteResult(int result) {}
+
+// SSL client sockets cache TLS sessions by destination host and port,
+// within a shard; nothing is cached without one. A shard per request
+// context lets reconnections to the same end point resume the previous
+// session, saving the key exchange and a round trip.
+std::string SSLSessionCacheShard(
+    const net::URLRequestContext *request_context) {
+  return base::StringPrintf("sippet/%p", request_context);
+}
+
+}  // namespace
+
 // This number will couple with quite long SIP messages
 const size_t kReadBufSize = 64U * 1024U;
 
@@ -43,6 +62,7 @@ ChromeStreamChannel::ChromeStreamChannel(const EndPoint& destination,
                          base::Unretained(this))),
           ssl_config_(ssl_config),
           pac_request_(nullptr),
+          proxy_decision_cache_(nullptr),
           destination_(destination),
           // Assume that we intend to do TLS on this socket; that means that
           // if a proxy is found, then CONNECT will be used on it first.
@@ -56,6 +76,8 @@ ChromeStreamChannel::ChromeStreamChannel(const EndPoint& destination,
           dest_host_port_pair_(destination.host(), destination.port()),
           delegate_(delegate),
           is_connecting_(false),
+          host_resolver_(
+              request_context_getter->GetURLRequestContext()->host_resolver()),
           request_context_getter_(request_context_getter),
           client_socket_factory_(client_socket_factory) {
   DCHECK(request_context_getter.get());
@@ -81,6 +103,8 @@ ChromeStreamChannel::ChromeStreamChannel(const EndPoint& destination,
   session_params.http_server_properties =
       request_context->http_server_properties();
   session_params.net_log = request_context->net_log();
+  session_params.ssl_session_cache_shard =
+      SSLSessionCacheShard(request_context);
 
   const net::HttpNetworkSession::Params* reference_params =
       request_context->GetNetworkSessionParams();
@@ -138,14 +162,23 @@ void ChromeStreamChannel::Connect() {
 
   tried_direct_connect_fallback_ = false;
 
-  // First we try and resolve the proxy.
-  int status = network_session_->proxy_service()->ResolveProxy(
-      proxy_url_, 0,
-      &proxy_info_,
-      proxy_resolve_callback_,
-      &pac_request_,
-      nullptr,
-      bound_net_log_);
+  // First we try and resolve the proxy, unless it was done lately.
+  int status;
+  net::ProxyService *proxy_service = network_session_->proxy_service();
+  if (proxy_decision_cache_
+      && proxy_decision_cache_->Lookup(proxy_url_, &proxy_info_)) {
+    // As the proxy service does, proxies that failed lately are tried last.
+    proxy_info_.DeprioritizeBadProxies(proxy_service->proxy_retry_info());
+    status = net::OK;
+  } else {
+    status = proxy_service->ResolveProxy(
+        proxy_url_, 0,
+        &proxy_info_,
+        proxy_resolve_callback_,
+        &pac_request_,
+        nullptr,
+        bound_net_log_);
+  }
   if (status != net::ERR_IO_PENDING) {
     // We defer execution of ProcessProxyResolveDone instead of calling it
     // directly here for simplicity. From the caller's point of view,
@@ -189,17 +222,24 @@ int ChromeStreamChannel::ReconnectWithCertificate(
 int ChromeStreamChannel::Send(const scoped_refptr<Message> &message,
         const net::CompletionCallback& callback) {
   if (transport_.get() && transport_->socket()) {
-    scoped_refptr<net::StringIOBuffer> string_buffer =
-        new net::StringIOBuffer(message->ToString());
-    return stream_writer_->Write(
-        string_buffer.get(),
-        string_buffer->size(),
+    IOBufferList buffers;
+    SerializeMessage(*message, &buffers);
+    if (delegate_)
+      delegate_->OnOutgoingMessage(this, message);
+    return stream_writer_->WriteMessage(buffers, GetWritePriority(*message),
         callback);
   }
   NOTREACHED();
   return net::ERR_SOCKET_NOT_CONNECTED;
 }
 
+int ChromeStreamChannel::SendKeepAlive(
+    const net::CompletionCallback& callback) {
+  if (!stream_writer_.get())
+    return net::ERR_SOCKET_NOT_CONNECTED;
+  return stream_writer_->WriteKeepAlive(false, callback);
+}
+
 void ChromeStreamChannel::Close() {
   CloseTransportSocket();
 }
@@ -210,6 +250,47 @@ void ChromeStreamChannel::CloseWithError(int err) {
   }
 }
 
+void ChromeStreamChannel::SetWriteQueueLimits(const WriteQueueLimits &limits) {
+  write_queue_limits_ = limits;
+  if (stream_writer_.get())
+    ApplyWriteQueueLimits();
+}
+
+size_t ChromeStreamChannel::queued_write_bytes() const {
+  return stream_writer_.get() ? stream_writer_->queued_bytes() : 0;
+}
+
+void ChromeStreamChannel::SetParseProfile(const ParseProfile &profile) {
+  parse_profile_ = profile;
+  if (stream_reader_.get())
+    stream_reader_->set_parse_profile(parse_profile_);
+}
+
+void ChromeStreamChannel::SetMessageLimits(const MessageLimits &limits) {
+  message_limits_ = limits;
+  if (stream_reader_.get())
+    stream_reader_->set_message_limits(message_limits_);
+}
+
+void ChromeStreamChannel::SetSocketOptions(const SocketOptions &options) {
+  socket_options_ = options;
+}
+
+void ChromeStreamChannel::ApplyWriteQueueLimits() {
+  stream_writer_->SetWriteQueueLimits(write_queue_limits_,
+      base::Bind(&ChromeStreamChannel::OnWriteQueueStateChanged,
+                 base::Unretained(this)));
+}
+
+void ChromeStreamChannel::OnWriteQueueStateChanged(bool congested) {
+  if (!delegate_)
+    return;
+  if (congested)
+    delegate_->OnChannelCongested(this);
+  else
+    delegate_->OnChannelWritable(this);
+}
+
 void ChromeStreamChannel::DetachDelegate() {
   delegate_ = nullptr;
 }
@@ -244,8 +325,12 @@ void ChromeStreamChannel::ProcessProxyResolveDone(int status) {
       // No proxies/direct to choose from. This happens when we don't support
       // any of the proxies in the returned list.
       status = net::ERR_NO_SUPPORTED_PROXIES;
+    } else if (proxy_decision_cache_) {
+      proxy_decision_cache_->Store(proxy_url_, proxy_info_);
     }
   }
+  if (status != net::OK && proxy_decision_cache_)
+    proxy_decision_cache_->Remove(proxy_url_);
 
   // Since we are faking the URL, it is possible that no proxies match our URL.
   // Try falling back to a direct connection if we have not tried that before.
@@ -279,6 +364,18 @@ void ChromeStreamChannel::DoTcpConnect() {
         net::kPrivacyModeDisabled, bound_net_log_, transport_.get(),
         resolution_callback_, connect_callback_);
      */
+  } else if (proxy_info_.is_direct()) {
+    // Resolve the destination here, so that its addresses can be raced.
+    net::HostResolver::RequestInfo request_info(dest_host_port_pair_);
+    int status = host_resolver_.Resolve(
+        request_info,
+        net::DEFAULT_PRIORITY,
+        &addresses_,
+        base::Bind(&ChromeStreamChannel::ProcessResolveHostDone,
+                   weak_ptr_factory_.GetWeakPtr()),
+        bound_net_log_);
+    if (status != net::ERR_IO_PENDING)
+      ProcessResolveHostDone(status);
   } else {
     int status = net::InitSocketHandleForRawConnect(
         dest_host_port_pair_, network_session_.get(), proxy_info_, ssl_config_,
@@ -293,6 +390,30 @@ void ChromeStreamChannel::DoTcpConnect() {
   }
 }
 
+void ChromeStreamChannel::ProcessResolveHostDone(int status) {
+  DCHECK_NE(status, net::ERR_IO_PENDING);
+  if (status != net::OK) {
+    ProcessConnectDone(status);
+    return;
+  }
+  connection_racer_.reset(new ChromeConnectionRacer(client_socket_factory_,
+      bound_net_log_, base::TimeDelta::FromMilliseconds(
+          ChromeConnectionRacer::kDefaultAttemptDelayMs)));
+  status = connection_racer_->Connect(addresses_,
+      base::Bind(&ChromeStreamChannel::ProcessRaceDone,
+                 weak_ptr_factory_.GetWeakPtr()));
+  if (status != net::ERR_IO_PENDING)
+    ProcessRaceDone(status);
+}
+
+void ChromeStreamChannel::ProcessRaceDone(int status) {
+  DCHECK_NE(status, net::ERR_IO_PENDING);
+  if (status == net::OK)
+    transport_->SetSocket(connection_racer_->PassSocket());
+  connection_racer_.reset();
+  ProcessConnectDone(status);
+}
+
 void ChromeStreamChannel::ProcessConnectDone(int status) {
   if (status != net::OK) {
     // If the connection fails, try another proxy.
@@ -307,8 +428,15 @@ void ChromeStreamChannel::ProcessConnectDone(int status) {
     CloseTransportSocket();
   } else {
     ReportSuccessfulProxyConnection();
+    socket_options_.ApplyBufferSizes(transport_->socket());
     stream_reader_.reset(new ChromeStreamReader(transport_->socket()));
+    stream_reader_->set_parse_profile(parse_profile_);
+    stream_reader_->set_message_limits(message_limits_);
+    stream_reader_->set_keepalive_callback(
+        base::Bind(&ChromeStreamChannel::OnKeepAlive,
+                   weak_ptr_factory_.GetWeakPtr()));
     stream_writer_.reset(new ChromeStreamWriter(transport_->socket()));
+    ApplyWriteQueueLimits();
   }
   if (status != net::OK) {
     // If the connection failed, notify immediately
@@ -407,6 +535,8 @@ void ChromeStreamChannel::CloseTransportSocket() {
   if (transport_.get() && transport_->socket())
     transport_->socket()->Disconnect();
   transport_.reset();
+  host_resolver_.Cancel();
+  connection_racer_.reset();
   stream_reader_.reset();
   stream_writer_.reset();
   is_connecting_ = false;
@@ -435,9 +565,22 @@ void ChromeStreamChannel::DoRead() {
 void ChromeStreamChannel::OnReadComplete(int result) {
   DCHECK_NE(net::ERR_IO_PENDING, result);
   if (net::OK == result) {
-    PostDoRead();
-    delegate_->OnIncomingMessage(this, stream_reader_->GetIncomingMessage());
-  } else if (result < 0) {
+    // Hand over all messages that came in the same read at once.
+    std::vector<scoped_refptr<Message> > messages;
+    messages.push_back(stream_reader_->GetIncomingMessage());
+    result = stream_reader_->ReadBuffered(&messages);
+    if (net::OK == result)
+      PostDoRead();
+    base::WeakPtr<ChromeStreamChannel> weak_this(
+        weak_ptr_factory_.GetWeakPtr());
+    for (std::vector<scoped_refptr<Message> >::iterator i = messages.begin(),
+         ie = messages.end(); i != ie; ++i) {
+      delegate_->OnIncomingMessage(this, *i);
+      if (!weak_this)
+        return;  // The channel was closed meanwhile
+    }
+  }
+  if (result < 0) {
     RunUserChannelClosed(result);
     // |this| may be deleted after this call.
   }
@@ -454,13 +597,13 @@ void ChromeStreamChannel::StartTls() {
         new net::ClientSocketHandle());
     socket_handle->SetSocket(transport_->PassSocket().Pass());
 
+    net::URLRequestContext* request_context =
+        request_context_getter_->GetURLRequestContext();
     net::SSLClientSocketContext context;
-    context.cert_verifier =
-        request_context_getter_->GetURLRequestContext()
-            ->cert_verifier();
+    context.cert_verifier = request_context->cert_verifier();
     context.transport_security_state =
-        request_context_getter_->GetURLRequestContext()
-            ->transport_security_state();
+        request_context->transport_security_state();
+    context.ssl_session_cache_shard = SSLSessionCacheShard(request_context);
 
     DCHECK(context.transport_security_state);
 
@@ -634,4 +777,21 @@ void ChromeStreamChannel::ProcessSSLConnectDone(int status) {
   // |this| may be deleted after this call.
 }
 
+void ChromeStreamChannel::OnKeepAlive(int empty_lines) {
+  // A double CRLF is a ping, answered with a single CRLF pong.
+  if (empty_lines >= 2)
+    stream_writer_->WriteKeepAlive(true, base::Bind(&IgnoreWriteResult));
+  base::MessageLoop* message_loop = base::MessageLoop::current();
+  CHECK(message_loop);
+  message_loop->PostTask(
+      FROM_HERE,
+      base::Bind(&ChromeStreamChannel::RunUserKeepAliveReceived,
+                 weak_ptr_factory_.GetWeakPtr()));
+}
+
+void ChromeStreamChannel::RunUserKeepAliveReceived() {
+  if (delegate_)
+    delegate_->OnKeepAliveReceived(this);
+}
+
 }  // namespace sippet
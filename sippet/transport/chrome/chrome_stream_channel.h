@@ -9,6 +9,8 @@
 #include "sippet/transport/chrome/chrome_stream_writer.h"
 #include "sippet/transport/chrome/chrome_stream_reader.h"
 #include "base/memory/weak_ptr.h"
+#include "net/base/address_list.h"
+#include "net/dns/single_request_host_resolver.h"
 #include "net/proxy/proxy_info.h"
 #include "net/proxy/proxy_service.h"
 #include "net/ssl/ssl_config_service.h"
@@ -23,8 +25,12 @@ class HttpNetworkSession;
 
 namespace sippet {
 
+class ChromeConnectionRacer;
 class Message;
+class ProxyDecisionCache;
 
+// Direct connections race the resolved addresses of the destination, see
+// |ChromeConnectionRacer|; proxied ones go through the net socket pools.
 class ChromeStreamChannel : public Channel {
  public:
   ChromeStreamChannel(const EndPoint& destination,
@@ -33,6 +39,12 @@ class ChromeStreamChannel : public Channel {
       const scoped_refptr<net::URLRequestContextGetter>& request_context_getter,
       const net::SSLConfig& ssl_config);
 
+  // Reuses the proxies resolved for the same destination by other channels,
+  // and shares those resolved here. It must outlive the channel.
+  void set_proxy_decision_cache(ProxyDecisionCache *proxy_decision_cache) {
+    proxy_decision_cache_ = proxy_decision_cache;
+  }
+
   int origin(EndPoint *origin) const override;
   const EndPoint& destination() const override;
 
@@ -47,19 +59,35 @@ class ChromeStreamChannel : public Channel {
   int Send(const scoped_refptr<Message> &message,
            const net::CompletionCallback& callback) override;
 
+  int SendKeepAlive(const net::CompletionCallback& callback) override;
+
   void Close() override;
 
   void CloseWithError(int err) override;
 
+  void SetWriteQueueLimits(const WriteQueueLimits &limits) override;
+
+  size_t queued_write_bytes() const override;
+
+  void SetParseProfile(const ParseProfile &profile) override;
+  void SetMessageLimits(const MessageLimits &limits) override;
+  void SetSocketOptions(const SocketOptions &options) override;
+
   void DetachDelegate() override;
 
  private:
   friend class base::RefCountedThreadSafe<Channel>;
   ~ChromeStreamChannel() override;
 
+  // Hands |write_queue_limits_| to the writer.
+  void ApplyWriteQueueLimits();
+  void OnWriteQueueStateChanged(bool congested);
+
   // Proxy resolution and connection functions.
   void ProcessProxyResolveDone(int status);
   void DoTcpConnect();
+  void ProcessResolveHostDone(int status);
+  void ProcessRaceDone(int status);
   void ProcessConnectDone(int status);
 
   void CloseTransportSocket();
@@ -75,12 +103,19 @@ class ChromeStreamChannel : public Channel {
   void DoRead();
   void OnReadComplete(int result);
 
+  void OnKeepAlive(int empty_lines);
+  void RunUserKeepAliveReceived();
+
   // TLS related functions
   void StartTls();
   void ProcessSSLConnectDone(int status);
 
   EndPoint destination_;
   Channel::Delegate *delegate_;
+  WriteQueueLimits write_queue_limits_;
+  ParseProfile parse_profile_;
+  MessageLimits message_limits_;
+  SocketOptions socket_options_;
 
   // Callbacks passed to net APIs.
   net::CompletionCallback proxy_resolve_callback_;
@@ -90,6 +125,11 @@ class ChromeStreamChannel : public Channel {
   scoped_refptr<net::URLRequestContextGetter> request_context_getter_;
   net::ClientSocketFactory* client_socket_factory_;
 
+  // Used for direct connections only.
+  net::SingleRequestHostResolver host_resolver_;
+  net::AddressList addresses_;
+  scoped_ptr<ChromeConnectionRacer> connection_racer_;
+
   // The transport socket.
   scoped_ptr<net::ClientSocketHandle> transport_;
   scoped_ptr<ChromeStreamReader> stream_reader_;
@@ -99,6 +139,7 @@ class ChromeStreamChannel : public Channel {
   net::SSLConfig ssl_config_;
   net::ProxyService::PacRequest* pac_request_;
   net::ProxyInfo proxy_info_;
+  ProxyDecisionCache *proxy_decision_cache_;
   const net::HostPortPair dest_host_port_pair_;
   const GURL proxy_url_;
   bool tried_direct_connect_fallback_;
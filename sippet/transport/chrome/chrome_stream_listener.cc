@@ -0,0 +1,241 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/chrome/chrome_stream_listener.h"
+
+#include "base/bind.h"
+#include "base/logging.h"
+#include "base/message_loop/message_loop.h"
+#include "crypto/rsa_private_key.h"
+#include "net/base/ip_address_number.h"
+#include "net/base/net_errors.h"
+#include "net/cert/x509_certificate.h"
+#include "net/socket/ssl_server_socket.h"
+#include "net/socket/stream_socket.h"
+#include "net/socket/tcp_client_socket.h"
+#include "net/socket/tcp_server_socket.h"
+#include "sippet/transport/chrome/chrome_server_stream_channel.h"
+#include "sippet/transport/source_rate_limiter.h"
+#include "sippet/transport/transport_stats.h"
+
+namespace sippet {
+
+namespace {
+
+// Same as the default used by Chrome's own servers.
+const int kListenBacklog = 10;
+
+}  // namespace
+
+ChromeStreamListener::PendingHandshake::PendingHandshake(
+    scoped_ptr<net::SSLServerSocket> socket,
+    const EndPoint &destination)
+  : socket_(socket.Pass()), destination_(destination) {
+}
+
+ChromeStreamListener::PendingHandshake::~PendingHandshake() {
+}
+
+ChromeStreamListener::ChromeStreamListener(
+    const EndPoint &local_end_point,
+    net::NetLog *net_log)
+  : local_end_point_(local_end_point),
+    net_log_(net_log),
+    delegate_(nullptr),
+    channel_delegate_(nullptr),
+    rate_limiter_(nullptr),
+    weak_ptr_factory_(this) {
+  DCHECK(Protocol::TCP == local_end_point_.protocol());
+}
+
+ChromeStreamListener::ChromeStreamListener(
+    const EndPoint &local_end_point,
+    net::NetLog *net_log,
+    const scoped_refptr<net::X509Certificate> &server_cert,
+    scoped_ptr<crypto::RSAPrivateKey> server_key,
+    const net::SSLConfig &ssl_config)
+  : local_end_point_(local_end_point),
+    net_log_(net_log),
+    server_cert_(server_cert),
+    server_key_(server_key.Pass()),
+    ssl_config_(ssl_config),
+    delegate_(nullptr),
+    channel_delegate_(nullptr),
+    rate_limiter_(nullptr),
+    weak_ptr_factory_(this) {
+  DCHECK(Protocol::TLS == local_end_point_.protocol());
+  DCHECK(server_cert_.get());
+  DCHECK(server_key_);
+}
+
+ChromeStreamListener::~ChromeStreamListener() {
+  Close();
+}
+
+int ChromeStreamListener::Listen(ChannelListener::Delegate *delegate,
+                                 Channel::Delegate *channel_delegate) {
+  DCHECK(delegate);
+  DCHECK(channel_delegate);
+  DCHECK(!socket_);
+
+  net::IPAddressNumber address;
+  if (!net::ParseIPLiteralToNumber(local_end_point_.host(), &address))
+    return net::ERR_ADDRESS_INVALID;
+
+  socket_.reset(new net::TCPServerSocket(net_log_, net::NetLog::Source()));
+  int result = socket_->Listen(
+      net::IPEndPoint(address, local_end_point_.port()), kListenBacklog);
+  if (result != net::OK) {
+    socket_.reset();
+    return result;
+  }
+
+  delegate_ = delegate;
+  channel_delegate_ = channel_delegate;
+  PostDoAccept();
+  return net::OK;
+}
+
+int ChromeStreamListener::GetLocalEndPoint(EndPoint *local_end_point) const {
+  if (!socket_)
+    return net::ERR_SOCKET_NOT_CONNECTED;
+  net::IPEndPoint ip_endpoint;
+  int result = socket_->GetLocalAddress(&ip_endpoint);
+  if (result != net::OK)
+    return result;
+  *local_end_point = EndPoint(net::HostPortPair::FromIPEndPoint(ip_endpoint),
+      local_end_point_.protocol());
+  return net::OK;
+}
+
+void ChromeStreamListener::Close() {
+  weak_ptr_factory_.InvalidateWeakPtrs();
+  pending_handshakes_.clear();
+  accepted_socket_.reset();
+  socket_.reset();
+}
+
+void ChromeStreamListener::SetRateLimiter(SourceRateLimiter *rate_limiter) {
+  DCHECK(!socket_);
+  rate_limiter_ = rate_limiter;
+}
+
+void ChromeStreamListener::SetSocketOptions(
+    const SocketOptionsMap &profiles) {
+  DCHECK(!socket_);
+  socket_options_ = GetSocketOptions(profiles, local_end_point_.protocol());
+}
+
+void ChromeStreamListener::PostDoAccept() {
+  base::MessageLoop* message_loop = base::MessageLoop::current();
+  CHECK(message_loop);
+  message_loop->PostTask(
+      FROM_HERE,
+      base::Bind(&ChromeStreamListener::DoAccept,
+                 weak_ptr_factory_.GetWeakPtr()));
+}
+
+void ChromeStreamListener::DoAccept() {
+  for (;;) {
+    int result = socket_->Accept(&accepted_socket_,
+        base::Bind(&ChromeStreamListener::OnAcceptComplete,
+                   weak_ptr_factory_.GetWeakPtr()));
+    if (result == net::ERR_IO_PENDING || !HandleAcceptResult(result))
+      return;
+  }
+}
+
+void ChromeStreamListener::OnAcceptComplete(int result) {
+  if (HandleAcceptResult(result))
+    DoAccept();
+}
+
+bool ChromeStreamListener::HandleAcceptResult(int result) {
+  DCHECK_NE(net::ERR_IO_PENDING, result);
+  if (result != net::OK) {
+    LOG(ERROR) << "Stopped accepting connections on "
+               << local_end_point_.ToString() << ": "
+               << net::ErrorToString(result);
+    return false;
+  }
+  net::IPEndPoint peer;
+  if (accepted_socket_->GetPeerAddress(&peer) != net::OK) {
+    // The peer is gone already.
+    accepted_socket_.reset();
+    return true;
+  }
+  if (rate_limiter_ && !rate_limiter_->Admit(peer.address())) {
+    // Closed before anything is read, or any handshake is done.
+    TransportStats::Count(TransportStats::RATE_LIMITED);
+    accepted_socket_.reset();
+    return true;
+  }
+  // The server socket accepts TCP client sockets.
+  ApplySocketOptions(
+      static_cast<net::TCPClientSocket*>(accepted_socket_.get()));
+  EndPoint destination(net::HostPortPair::FromIPEndPoint(peer),
+      local_end_point_.protocol());
+  base::WeakPtr<ChromeStreamListener> weak_this(
+      weak_ptr_factory_.GetWeakPtr());
+  if (Protocol::TLS == local_end_point_.protocol())
+    StartTls(accepted_socket_.Pass(), destination);
+  else
+    AcceptChannel(accepted_socket_.Pass(), destination);
+  // The delegate may have closed the listener meanwhile.
+  return weak_this.get() != nullptr;
+}
+
+void ChromeStreamListener::ApplySocketOptions(net::TCPClientSocket *socket) {
+  socket_options_.ApplyBufferSizes(socket);
+  if (socket_options_.no_delay && !socket->SetNoDelay(true))
+    LOG(WARNING) << "Failed to set TCP_NODELAY";
+  if (socket_options_.keepalive_delay > 0
+      && !socket->SetKeepAlive(true, socket_options_.keepalive_delay))
+    LOG(WARNING) << "Failed to set the TCP keep-alive delay";
+}
+
+void ChromeStreamListener::StartTls(scoped_ptr<net::StreamSocket> socket,
+                                    const EndPoint &destination) {
+  scoped_ptr<net::SSLServerSocket> ssl_socket(net::CreateSSLServerSocket(
+      socket.Pass(), server_cert_.get(), server_key_.get(), ssl_config_));
+  net::SSLServerSocket *raw_socket = ssl_socket.get();
+  pending_handshakes_.push_back(
+      new PendingHandshake(ssl_socket.Pass(), destination));
+  int result = raw_socket->Handshake(
+      base::Bind(&ChromeStreamListener::OnHandshakeComplete,
+                 weak_ptr_factory_.GetWeakPtr(), raw_socket));
+  if (result != net::ERR_IO_PENDING)
+    OnHandshakeComplete(raw_socket, result);
+}
+
+void ChromeStreamListener::OnHandshakeComplete(net::SSLServerSocket *socket,
+                                               int result) {
+  ScopedVector<PendingHandshake>::iterator i = pending_handshakes_.begin();
+  for (; i != pending_handshakes_.end(); ++i) {
+    if ((*i)->socket_.get() == socket)
+      break;
+  }
+  DCHECK(i != pending_handshakes_.end());
+  scoped_ptr<net::StreamSocket> ssl_socket((*i)->socket_.Pass());
+  EndPoint destination((*i)->destination_);
+  pending_handshakes_.erase(i);
+  if (result != net::OK) {
+    DVLOG(1) << "TLS handshake with " << destination.ToString()
+             << " failed: " << net::ErrorToString(result);
+    return;
+  }
+  AcceptChannel(ssl_socket.Pass(), destination);
+}
+
+void ChromeStreamListener::AcceptChannel(
+    scoped_ptr<net::StreamSocket> socket,
+    const EndPoint &destination) {
+  scoped_refptr<ChromeServerStreamChannel> channel(
+      new ChromeServerStreamChannel(destination, channel_delegate_,
+          socket.Pass()));
+  delegate_->OnChannelAccepted(channel);
+  channel->Start();
+}
+
+}  // namespace sippet
@@ -0,0 +1,97 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_CHROME_CHROME_STREAM_LISTENER_H_
+#define SIPPET_TRANSPORT_CHROME_CHROME_STREAM_LISTENER_H_
+
+#include "base/memory/ref_counted.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/memory/scoped_vector.h"
+#include "base/memory/weak_ptr.h"
+#include "net/ssl/ssl_config_service.h"
+#include "sippet/transport/channel_listener.h"
+
+namespace crypto {
+class RSAPrivateKey;
+}
+
+namespace net {
+class NetLog;
+class SSLServerSocket;
+class StreamSocket;
+class TCPClientSocket;
+class TCPServerSocket;
+class X509Certificate;
+}
+
+namespace sippet {
+
+// Accepts inbound TCP connections, or TLS ones when the local end point uses
+// the TLS protocol, and hands each one over as a |ChromeServerStreamChannel|.
+// TLS channels are only handed over once the server handshake is complete.
+class ChromeStreamListener : public ChannelListener {
+ public:
+  // |local_end_point| must have an IP literal host, and the TCP protocol.
+  ChromeStreamListener(const EndPoint &local_end_point,
+                       net::NetLog *net_log);
+  // |local_end_point| must have an IP literal host, and the TLS protocol.
+  ChromeStreamListener(const EndPoint &local_end_point,
+                       net::NetLog *net_log,
+                       const scoped_refptr<net::X509Certificate> &server_cert,
+                       scoped_ptr<crypto::RSAPrivateKey> server_key,
+                       const net::SSLConfig &ssl_config);
+  ~ChromeStreamListener() override;
+
+  // sippet::ChannelListener methods:
+  int Listen(ChannelListener::Delegate *delegate,
+             Channel::Delegate *channel_delegate) override;
+  int GetLocalEndPoint(EndPoint *local_end_point) const override;
+  void Close() override;
+  void SetRateLimiter(SourceRateLimiter *rate_limiter) override;
+  void SetSocketOptions(const SocketOptionsMap &profiles) override;
+
+ private:
+  struct PendingHandshake {
+    PendingHandshake(scoped_ptr<net::SSLServerSocket> socket,
+                     const EndPoint &destination);
+    ~PendingHandshake();
+    scoped_ptr<net::SSLServerSocket> socket_;
+    EndPoint destination_;
+  };
+
+  void PostDoAccept();
+  void DoAccept();
+  void OnAcceptComplete(int result);
+  bool HandleAcceptResult(int result);
+  // Sets |socket_options_| on a connection just accepted.
+  void ApplySocketOptions(net::TCPClientSocket *socket);
+
+  void StartTls(scoped_ptr<net::StreamSocket> socket,
+                const EndPoint &destination);
+  void OnHandshakeComplete(net::SSLServerSocket *socket, int result);
+  void AcceptChannel(scoped_ptr<net::StreamSocket> socket,
+                     const EndPoint &destination);
+
+  EndPoint local_end_point_;
+  net::NetLog *net_log_;
+  scoped_refptr<net::X509Certificate> server_cert_;
+  scoped_ptr<crypto::RSAPrivateKey> server_key_;
+  net::SSLConfig ssl_config_;
+  ChannelListener::Delegate *delegate_;
+  Channel::Delegate *channel_delegate_;
+  SourceRateLimiter *rate_limiter_;
+  SocketOptions socket_options_;
+
+  scoped_ptr<net::TCPServerSocket> socket_;
+  scoped_ptr<net::StreamSocket> accepted_socket_;
+  ScopedVector<PendingHandshake> pending_handshakes_;
+
+  base::WeakPtrFactory<ChromeStreamListener> weak_ptr_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChromeStreamListener);
+};
+
+} /// End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_CHROME_CHROME_STREAM_LISTENER_H_
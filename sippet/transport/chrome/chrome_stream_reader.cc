@@ -4,73 +4,134 @@
 
 #include "sippet/transport/chrome/chrome_stream_reader.h"
 
+#include <algorithm>
+
 #include "net/base/net_errors.h"
 #include "net/base/io_buffer.h"
 #include "net/socket/socket.h"
+#include "sippet/base/memory_accounting.h"
+#include "sippet/transport/chrome/receive_buffer_pool.h"
+#include "sippet/transport/transport_stats.h"
 
 namespace sippet {
 
 // This number will couple with quite long SIP messages
-static const size_t kReadBufSize = 64U * 1024U;
+static const size_t kReadBufSize = ReceiveBufferPool::kBufferSize;
+
+// Heads that don't fit the pooled buffer are read into a buffer of their
+// own, doubled up to this size.
+static const size_t kMaxReadBufSize = 4 * kReadBufSize;
+
+// Enough for most requests and responses, and for keep-alives.
+static const size_t kIdleReadBufSize = 4U * 1024U;
+
+// Pending bytes are only moved to the front of the buffer when the room
+// left after them is less than this fraction of the buffer.
+static const size_t kMinRoomFraction = 4;
+
+// Contents don't need to fit the read buffer, as they are moved out of it
+// while being received.
+static const size_t kMaxContentSize = 4U * 1024U * 1024U;
 
 ChromeStreamReader::ChromeStreamReader(net::Socket* socket_to_wrap)
     : wrapped_socket_(socket_to_wrap),
-      read_buf_(new net::IOBufferWithSize(kReadBufSize)),
       read_complete_(base::Bind(&ChromeStreamReader::ReceiveDataComplete,
-          base::Unretained(this))) {
+          base::Unretained(this))),
+      read_end_(nullptr),
+      filled_read_buf_(false) {
   DCHECK(socket_to_wrap);
-  drainable_read_buf_ =
-      new net::DrainableIOBuffer(read_buf_.get(), read_buf_->size());
-  read_end_ = drainable_read_buf_->data();
+  SetReadBuffer(new net::IOBufferWithSize(kIdleReadBufSize), 0);
 }
 
 ChromeStreamReader::~ChromeStreamReader() {
+  MemoryAccounting::Add(MemoryAccounting::READ_BUFFERS, -read_buf_->size());
+  drainable_read_buf_ = nullptr;
+  ReceiveBufferPool::Release(&read_buf_);
 }
 
 int ChromeStreamReader::DoIORead(
     const net::CompletionCallback& callback) {
-  if (read_end_ == read_buf_->data() + read_buf_->size()) {
-    // Close the connection: the server is trying to send a message (header
-    // or content) that exceeds the maximum size allowed (64kb).
+  size_t pending_bytes = static_cast<size_t>(BytesRemaining());
+  size_t size = static_cast<size_t>(read_buf_->size());
+  if (pending_bytes == kMaxReadBufSize) {
+    // Close the connection: the server is trying to send a head that
+    // exceeds the maximum size allowed (256kb).
     return net::ERR_MSG_TOO_BIG;
   }
-  if (read_end_ - drainable_read_buf_->data() > 0) {
-    // Rearrange the still pending data to the beginning of the buffer.
-    size_t pending_bytes = read_end_ - drainable_read_buf_->data();
-    memmove(read_buf_->data(), drainable_read_buf_->data(), pending_bytes);
+  // Keep the full size buffer only while it's needed: the pending bytes
+  // don't fit the small one, or data is arriving faster than it can hold.
+  // A head filling the full size one grows it instead.
+  size_t wanted_size = kIdleReadBufSize;
+  if (pending_bytes == size && size >= kReadBufSize)
+    wanted_size = std::min(2 * size, kMaxReadBufSize);
+  else if (pending_bytes > kReadBufSize)
+    wanted_size = size;
+  else if (pending_bytes == size || pending_bytes > kIdleReadBufSize
+           || filled_read_buf_)
+    wanted_size = kReadBufSize;
+  if (size == wanted_size)
+    ReuseReadBuffer();
+  else if (wanted_size == kReadBufSize)
+    SetReadBuffer(ReceiveBufferPool::Take(), static_cast<int>(pending_bytes));
+  else
+    SetReadBuffer(new net::IOBufferWithSize(static_cast<int>(wanted_size)),
+                  static_cast<int>(pending_bytes));
 
-    // Move the reading buffer after the pending bytes
-    drainable_read_buf_->SetOffset(static_cast<int>(pending_bytes));
-  } else {
-    // The next read will take a clean buffer
-    drainable_read_buf_->SetOffset(0);
-  }
-  read_end_ = drainable_read_buf_->data();
-  if (read_end_ - drainable_read_buf_->data() > 0) {
-    // There are more data to be read, just continue
-    return net::OK;
-  }
-  int result = wrapped_socket_->Read(drainable_read_buf_.get(),
-      drainable_read_buf_->size(), read_complete_);
-  if (net::ERR_IO_PENDING == result)
+  // Read after the pending bytes.
+  scoped_refptr<net::DrainableIOBuffer> buf(
+      new net::DrainableIOBuffer(read_buf_.get(), read_buf_->size()));
+  buf->SetOffset(static_cast<int>(read_end_ - read_buf_->data()));
+  int result = wrapped_socket_->Read(buf.get(), buf->BytesRemaining(),
+      read_complete_);
+  if (net::ERR_IO_PENDING == result) {
     callback_ = callback;
-  return result;
+    return result;
+  }
+  return DidReceiveData(result);
+}
+
+void ChromeStreamReader::SetReadBuffer(
+    const scoped_refptr<net::IOBufferWithSize> &buf, int pending_bytes) {
+  DCHECK_NE(read_buf_.get(), buf.get());
+  DCHECK_LE(pending_bytes, buf->size());
+  if (pending_bytes > 0)
+    memcpy(buf->data(), drainable_read_buf_->data(), pending_bytes);
+  scoped_refptr<net::IOBufferWithSize> old_buf(read_buf_);
+  read_buf_ = buf;
+  drainable_read_buf_ =
+      new net::DrainableIOBuffer(read_buf_.get(), read_buf_->size());
+  read_end_ = drainable_read_buf_->data() + pending_bytes;
+  MemoryAccounting::Add(MemoryAccounting::READ_BUFFERS,
+      read_buf_->size() - (old_buf.get() ? old_buf->size() : 0));
+  ReceiveBufferPool::Release(&old_buf);
+}
+
+void ChromeStreamReader::ReuseReadBuffer() {
+  int pending_bytes = BytesRemaining();
+  size_t room = read_buf_->data() + read_buf_->size() - read_end_;
+  if (pending_bytes > 0
+      && room >= static_cast<size_t>(read_buf_->size()) / kMinRoomFraction)
+    return;
+  if (pending_bytes > 0)
+    memmove(read_buf_->data(), drainable_read_buf_->data(), pending_bytes);
+  drainable_read_buf_->SetOffset(0);
+  read_end_ = read_buf_->data() + pending_bytes;
 }
 
 void ChromeStreamReader::ReceiveDataComplete(int result) {
-  if (result < 0) {
-    DoCallback(result);
-  } else if (result == 0) {
-    DoCallback(net::ERR_CONNECTION_CLOSED);
-  } else {
-    // Move the end buffer mark accordingly to the number of bytes read.
-    read_end_ = drainable_read_buf_->data() + static_cast<size_t>(result);
-    if (drainable_read_buf_->data() > read_buf_->data()) {
-      // Move the begin buffer to the buffer start.
-      drainable_read_buf_->SetOffset(0);
-    }
-    DoCallback(net::OK);
-  }
+  DoCallback(DidReceiveData(result));
+}
+
+int ChromeStreamReader::DidReceiveData(int result) {
+  if (result < 0)
+    return result;
+  if (result == 0)
+    return net::ERR_CONNECTION_CLOSED;
+  TransportStats::Count(TransportStats::BYTES_RECEIVED, result);
+  // Move the end buffer mark accordingly to the number of bytes read.
+  read_end_ += result;
+  filled_read_buf_ = read_end_ == read_buf_->data() + read_buf_->size();
+  return net::OK;
 }
 
 void ChromeStreamReader::DoCallback(int result) {
@@ -86,7 +147,11 @@ char *ChromeStreamReader::data() {
 }
 
 size_t ChromeStreamReader::max_size() {
-  return kReadBufSize;
+  return kMaxReadBufSize;
+}
+
+size_t ChromeStreamReader::max_content_size() {
+  return kMaxContentSize;
 }
 
 int ChromeStreamReader::BytesRemaining() const {
@@ -17,6 +17,11 @@ namespace sippet {
 
 class Message;
 
+// Reads messages from a stream socket. While idle, it waits on a small read
+// buffer; a full size one is borrowed from the |ReceiveBufferPool| when a
+// message doesn't fit, or when data keeps filling the small one up. Heads
+// larger than it get a larger buffer of their own, up to 256 KB; contents
+// are moved out of the buffer as they arrive, so they aren't bound by it.
 class ChromeStreamReader
   : public MessageReader {
  public:
@@ -27,10 +32,22 @@ class ChromeStreamReader
   int DoIORead(const net::CompletionCallback& callback) override;
   char *data() override;
   size_t max_size() override;
+  size_t max_content_size() override;
   int BytesRemaining() const override;
   void DidConsume(int bytes) override;
 
+  // Copies the |pending_bytes| not consumed yet to the beginning of |buf|,
+  // which becomes the read buffer.
+  void SetReadBuffer(const scoped_refptr<net::IOBufferWithSize> &buf,
+                     int pending_bytes);
+
+  // Keeps reading into the current buffer, after the pending bytes. They
+  // are only moved to its beginning when little room is left after them,
+  // so that pipelined messages are parsed where they were received.
+  void ReuseReadBuffer();
+
   void ReceiveDataComplete(int result);
+  int DidReceiveData(int result);
   void DoCallback(int result);
 
   net::Socket* wrapped_socket_;
@@ -39,6 +56,8 @@ class ChromeStreamReader
   net::CompletionCallback callback_;
   net::CompletionCallback read_complete_;
   char *read_end_;
+  // Whether the last read filled the read buffer up.
+  bool filled_read_buf_;
 
   DISALLOW_COPY_AND_ASSIGN(ChromeStreamReader);
 };
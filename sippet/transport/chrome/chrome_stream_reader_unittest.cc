@@ -0,0 +1,293 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/chrome/chrome_stream_reader.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/strings/string_number_conversions.h"
+#include "sippet/message/message.h"
+#include "sippet/transport/chrome/receive_buffer_pool.h"
+#include "net/socket/socket_test_util.h"
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+using sippet::Message;
+using sippet::Request;
+using sippet::CallId;
+using sippet::ChromeStreamReader;
+using sippet::ReceiveBufferPool;
+
+namespace {
+
+void AppendEmptyLines(std::vector<int> *lines, int empty_lines) {
+  lines->push_back(empty_lines);
+}
+
+}  // namespace
+
+class StreamReaderTest : public testing::Test {
+ public:
+  void Initialize(net::MockRead* reads, size_t reads_count) {
+    data_.reset(
+      new net::StaticSocketDataProvider(reads, reads_count, nullptr, 0));
+    data_->set_connect_data(net::MockConnect(net::SYNCHRONOUS, net::OK));
+    wrapped_socket_.reset(new net::MockTCPClientSocket(
+        net::AddressList(), net_log_.net_log(), data_.get()));
+    wrapped_socket_->Connect(callback_.callback());
+    reader_.reset(new ChromeStreamReader(wrapped_socket_.get()));
+  }
+
+  int Read() {
+    int rv = reader_->Read(callback_.callback());
+    if (rv == net::ERR_IO_PENDING)
+      rv = callback_.WaitForResult();
+    return rv;
+  }
+
+  static std::string CallIdOf(const scoped_refptr<Message> &message) {
+    return message->get<CallId>()->value();
+  }
+
+  scoped_ptr<net::StaticSocketDataProvider> data_;
+  scoped_ptr<net::MockTCPClientSocket> wrapped_socket_;
+  scoped_ptr<ChromeStreamReader> reader_;
+  net::BoundNetLog net_log_;
+  net::TestCompletionCallback callback_;
+};
+
+TEST_F(StreamReaderTest, ReadBuffered) {
+  net::MockRead reads[] = {
+    net::MockRead(net::ASYNC,
+       "OPTIONS sip:carol@chicago.com SIP/2.0\r\n"
+       "i: 1\r\n"
+       "l: 0\r\n"
+       "\r\n"
+       "MESSAGE sip:carol@chicago.com SIP/2.0\r\n"
+       "i: 2\r\n"
+       "l: 5\r\n"
+       "\r\n"
+       "hello"
+       "\r\n\r\n"  // keep-alive
+       "OPTIONS sip:carol@chicago.com SIP/2.0\r\n"
+       "i: 3\r\n"
+       "l: 0\r\n"
+       "\r\n"
+       "OPTIONS sip:carol@chicago.com SIP/2.0\r\n"
+       "i: 4\r\n"),
+    net::MockRead(net::ASYNC,
+       "l: 0\r\n"
+       "\r\n"),
+  };
+
+  Initialize(reads, arraysize(reads));
+
+  ASSERT_EQ(net::OK, Read());
+  std::vector<scoped_refptr<Message> > messages;
+  messages.push_back(reader_->GetIncomingMessage());
+  ASSERT_EQ(net::OK, reader_->ReadBuffered(&messages));
+  ASSERT_EQ(3u, messages.size());
+  EXPECT_EQ("1", CallIdOf(messages[0]));
+  EXPECT_EQ("2", CallIdOf(messages[1]));
+  EXPECT_EQ("hello", messages[1]->content());
+  EXPECT_EQ("3", CallIdOf(messages[2]));
+
+  // The incomplete message is completed by the next read.
+  ASSERT_EQ(net::OK, Read());
+  scoped_refptr<Message> message(reader_->GetIncomingMessage());
+  ASSERT_TRUE(message);
+  EXPECT_EQ("4", CallIdOf(message));
+
+  messages.clear();
+  EXPECT_EQ(net::OK, reader_->ReadBuffered(&messages));
+  EXPECT_TRUE(messages.empty());
+}
+
+TEST_F(StreamReaderTest, ReceiveTime) {
+  net::MockRead reads[] = {
+    net::MockRead(net::ASYNC,
+       "OPTIONS sip:carol@chicago.com SIP/2.0\r\n"
+       "i: 1\r\n"
+       "l: 0\r\n"
+       "\r\n"
+       "OPTIONS sip:carol@chicago.com SIP/2.0\r\n"
+       "i: 2\r\n"
+       "l: 0\r\n"
+       "\r\n"),
+    net::MockRead(net::ASYNC,
+       "OPTIONS sip:carol@chicago.com SIP/2.0\r\n"
+       "i: 3\r\n"
+       "l: 0\r\n"
+       "\r\n"),
+  };
+
+  Initialize(reads, arraysize(reads));
+
+  base::TimeTicks before(base::TimeTicks::Now());
+  ASSERT_EQ(net::OK, Read());
+  scoped_refptr<Message> first(reader_->GetIncomingMessage());
+  std::vector<scoped_refptr<Message> > messages;
+  ASSERT_EQ(net::OK, reader_->ReadBuffered(&messages));
+  ASSERT_EQ(1u, messages.size());
+  // Messages are stamped with the read that completed their heads.
+  EXPECT_LE(before, first->receive_time());
+  EXPECT_EQ(first->receive_time(), messages[0]->receive_time());
+
+  ASSERT_EQ(net::OK, Read());
+  scoped_refptr<Message> last(reader_->GetIncomingMessage());
+  ASSERT_TRUE(last);
+  EXPECT_LE(first->receive_time(), last->receive_time());
+  EXPECT_LE(last->receive_time(), base::TimeTicks::Now());
+}
+
+TEST_F(StreamReaderTest, ContentLength) {
+  net::MockRead reads[] = {
+    net::MockRead(net::ASYNC,
+       "MESSAGE sip:carol@chicago.com SIP/2.0\r\n"
+       "i: 1\r\n"
+       "Content-Le"),
+    net::MockRead(net::ASYNC,
+       "ngth: 5\r\n"
+       "\r\n"
+       "hello"
+       "MESSAGE sip:carol@chicago.com SIP/2.0\r\n"
+       "i: 2\r\n"
+       "Content-Length:\r\n"
+       " 3\r\n"
+       "\r\n"
+       "abc"
+       "MESSAGE sip:carol@chicago.com SIP/2.0\r\n"
+       "i: 3\r\n"
+       "l: 2\r\n"
+       "\r\n"
+       "hi"),
+  };
+
+  Initialize(reads, arraysize(reads));
+
+  ASSERT_EQ(net::OK, Read());
+  std::vector<scoped_refptr<Message> > messages;
+  messages.push_back(reader_->GetIncomingMessage());
+  ASSERT_EQ(net::OK, reader_->ReadBuffered(&messages));
+  ASSERT_EQ(3u, messages.size());
+  EXPECT_EQ("hello", messages[0]->content());
+  // Folded headers are left to the parser.
+  EXPECT_EQ("abc", messages[1]->content());
+  EXPECT_EQ("hi", messages[2]->content());
+}
+
+TEST_F(StreamReaderTest, LargeContent) {
+  // Larger than the read buffer, and split across several reads.
+  const size_t kContentSize = 200 * 1024;
+  const size_t kChunkSize = 48 * 1024;
+  std::string content;
+  for (size_t i = 0; i < kContentSize; ++i)
+    content.push_back(static_cast<char>('a' + i % 26));
+  std::string stream(
+      "MESSAGE sip:carol@chicago.com SIP/2.0\r\n"
+      "i: 1\r\n"
+      "l: " + base::SizeTToString(kContentSize) + "\r\n"
+      "\r\n" + content);
+
+  std::vector<net::MockRead> reads;
+  for (size_t offset = 0; offset < stream.size(); offset += kChunkSize) {
+    size_t size = std::min(kChunkSize, stream.size() - offset);
+    reads.push_back(net::MockRead(net::ASYNC, stream.data() + offset,
+                                  static_cast<int>(size)));
+  }
+
+  Initialize(&reads[0], reads.size());
+
+  ASSERT_EQ(net::OK, Read());
+  scoped_refptr<Message> message(reader_->GetIncomingMessage());
+  ASSERT_TRUE(message);
+  EXPECT_EQ("1", CallIdOf(message));
+  EXPECT_EQ(content, message->content());
+}
+
+TEST_F(StreamReaderTest, LargeHead) {
+  // Larger than the pooled buffer, followed by a message in the same read.
+  std::string subject(150 * 1024, 's');
+  std::string stream(
+      "MESSAGE sip:carol@chicago.com SIP/2.0\r\n"
+      "i: 1\r\n"
+      "s: " + subject + "\r\n"
+      "l: 0\r\n"
+      "\r\n"
+      "OPTIONS sip:carol@chicago.com SIP/2.0\r\n"
+      "i: 2\r\n"
+      "l: 0\r\n"
+      "\r\n");
+  const size_t kChunkSize = 48 * 1024;
+  std::vector<net::MockRead> reads;
+  for (size_t offset = 0; offset < stream.size(); offset += kChunkSize) {
+    size_t size = std::min(kChunkSize, stream.size() - offset);
+    reads.push_back(net::MockRead(net::ASYNC, stream.data() + offset,
+                                  static_cast<int>(size)));
+  }
+
+  Initialize(&reads[0], reads.size());
+
+  ASSERT_EQ(net::OK, Read());
+  scoped_refptr<Message> message(reader_->GetIncomingMessage());
+  ASSERT_TRUE(message);
+  EXPECT_EQ("1", CallIdOf(message));
+  std::vector<scoped_refptr<Message> > messages;
+  ASSERT_EQ(net::OK, reader_->ReadBuffered(&messages));
+  ASSERT_EQ(1u, messages.size());
+  EXPECT_EQ("2", CallIdOf(messages[0]));
+}
+
+TEST_F(StreamReaderTest, ReleasesBufferWhenIdle) {
+  // Larger than the idle read buffer, so a pooled one is taken.
+  std::string content(20 * 1024, 'a');
+  std::string stream(
+      "MESSAGE sip:carol@chicago.com SIP/2.0\r\n"
+      "i: 1\r\n"
+      "l: " + base::SizeTToString(content.size()) + "\r\n"
+      "\r\n" + content);
+  net::MockRead reads[] = {
+    net::MockRead(net::ASYNC, stream.data(), static_cast<int>(stream.size())),
+    net::MockRead(net::SYNCHRONOUS, net::ERR_IO_PENDING),  // Never completes
+  };
+
+  Initialize(reads, arraysize(reads));
+
+  ASSERT_EQ(net::OK, Read());
+  scoped_refptr<Message> message(reader_->GetIncomingMessage());
+  ASSERT_TRUE(message);
+  EXPECT_EQ(content, message->content());
+
+  // Waiting for the next message gives the pooled buffer back.
+  size_t pooled = ReceiveBufferPool::GetPooledCountForTesting();
+  EXPECT_EQ(net::ERR_IO_PENDING, reader_->Read(callback_.callback()));
+  EXPECT_EQ(pooled + 1, ReceiveBufferPool::GetPooledCountForTesting());
+}
+
+TEST_F(StreamReaderTest, KeepAlives) {
+  net::MockRead reads[] = {
+    net::MockRead(net::ASYNC, "\r\n\r\n"),  // ping
+    net::MockRead(net::ASYNC, "\r\n"),  // pong
+    net::MockRead(net::ASYNC,
+       "OPTIONS sip:carol@chicago.com SIP/2.0\r\n"
+       "i: 1\r\n"
+       "l: 0\r\n"
+       "\r\n"),
+  };
+
+  Initialize(reads, arraysize(reads));
+  std::vector<int> lines;
+  reader_->set_keepalive_callback(base::Bind(&AppendEmptyLines, &lines));
+
+  ASSERT_EQ(net::OK, Read());
+  scoped_refptr<Message> message(reader_->GetIncomingMessage());
+  ASSERT_TRUE(message);
+  EXPECT_EQ("1", CallIdOf(message));
+  ASSERT_EQ(2u, lines.size());
+  EXPECT_EQ(2, lines[0]);
+  EXPECT_EQ(1, lines[1]);
+}
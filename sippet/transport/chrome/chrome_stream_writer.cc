@@ -4,17 +4,33 @@
 
 #include "sippet/transport/chrome/chrome_stream_writer.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include "base/stl_util.h"
+#include "base/trace_event/trace_event.h"
 #include "net/base/io_buffer.h"
 #include "net/base/net_errors.h"
 #include "net/socket/socket.h"
+#include "sippet/transport/transport_stats.h"
 
 namespace sippet {
 
+namespace {
+
+// The size of a full TLS record.
+const int kMaxCoalescedBytes = 16 * 1024;
+
+const char kKeepAlivePing[] = "\r\n\r\n";
+const char kKeepAlivePong[] = "\r\n";
+
+}  // namespace
+
 ChromeStreamWriter::PendingBlock::PendingBlock(
-        net::DrainableIOBuffer *io_buffer,
+        net::DrainableIOBuffer *io_buffer, bool last,
         const net::CompletionCallback& callback)
-  : io_buffer_(io_buffer), callback_(callback) {
+  : io_buffer_(io_buffer), callback_(callback),
+    queued_bytes_(io_buffer->BytesRemaining()), last_(last) {
 }
 
 ChromeStreamWriter::PendingBlock::~PendingBlock() {
@@ -24,22 +40,63 @@ ChromeStreamWriter::ChromeStreamWriter(
     net::Socket *socket_to_wrap)
     : wrapped_socket_(socket_to_wrap),
       weak_factory_(this),
-      error_(net::OK) {
+      error_(net::OK),
+      overtaken_(0) {
 }
 
 ChromeStreamWriter::~ChromeStreamWriter() {
   STLDeleteElements(&pending_messages_);
+  STLDeleteElements(&deferred_messages_);
 }
 
 int ChromeStreamWriter::Write(
     net::IOBuffer* buf, int buf_len,
     const net::CompletionCallback& callback) {
+  TRACE_EVENT1("sippet", "ChromeStreamWriter::Write", "size", buf_len);
+  if (error_ != net::OK)
+    return error_;
+  if (!queue_monitor_.CanQueue())
+    return net::ERR_INSUFFICIENT_RESOURCES;
+
+  if (!deferred_messages_.empty())
+    ++overtaken_;
+  return Enqueue(buf, buf_len, true, false, callback);
+}
+
+int ChromeStreamWriter::WriteMessage(
+    const IOBufferList &blocks, WritePriority priority,
+    const net::CompletionCallback& callback) {
+  DCHECK(!blocks.empty());
+  TRACE_EVENT1("sippet", "ChromeStreamWriter::WriteMessage",
+               "blocks", blocks.size());
   if (error_ != net::OK)
     return error_;
+  if (!queue_monitor_.CanQueue())
+    return net::ERR_INSUFFICIENT_RESOURCES;
 
+  // Bulk messages are only deferred when there's something to wait for.
+  bool deferred =
+      WRITE_PRIORITY_BULK == priority && !pending_messages_.empty();
+  if (!deferred && !deferred_messages_.empty())
+    ++overtaken_;
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    bool last = blocks.size() - 1 == i;
+    int result = Enqueue(blocks[i].get(), blocks[i]->size(), last, deferred,
+        last ? callback : net::CompletionCallback());
+    if (last || (result != net::OK && result != net::ERR_IO_PENDING))
+      return result;
+  }
+  NOTREACHED();
+  return net::ERR_UNEXPECTED;
+}
+
+int ChromeStreamWriter::Enqueue(
+    net::IOBuffer* buf, int buf_len, bool last, bool deferred,
+    const net::CompletionCallback& callback) {
+  TransportStats::Count(TransportStats::BYTES_SENT, buf_len);
   scoped_refptr<net::DrainableIOBuffer> io_buffer(
       new net::DrainableIOBuffer(buf, buf_len));
-  if (pending_messages_.empty()) {
+  if (!deferred && pending_messages_.empty()) {
     int res = Drain(io_buffer.get());
     if (res == net::OK || res != net::ERR_IO_PENDING) {
       error_ = res;
@@ -47,18 +104,41 @@ int ChromeStreamWriter::Write(
     }
   }
 
-  pending_messages_.push_back(new PendingBlock(io_buffer.get(), callback));
+  PendingBlock *pending = new PendingBlock(io_buffer.get(), last, callback);
+  if (deferred)
+    deferred_messages_.push_back(pending);
+  else
+    pending_messages_.push_back(pending);
+  queue_monitor_.Queued(pending->queued_bytes_);
   return net::ERR_IO_PENDING;
 }
 
+int ChromeStreamWriter::WriteKeepAlive(
+    bool pong, const net::CompletionCallback& callback) {
+  scoped_refptr<net::StringIOBuffer> buf(
+      new net::StringIOBuffer(pong ? kKeepAlivePong : kKeepAlivePing));
+  return Write(buf.get(), buf->size(), callback);
+}
+
 void ChromeStreamWriter::CloseWithError(int err) {
   error_ = err;
+  pending_messages_.insert(pending_messages_.end(),
+      deferred_messages_.begin(), deferred_messages_.end());
+  deferred_messages_.clear();
   while (!pending_messages_.empty())
     Pop(err);
 }
 
+void ChromeStreamWriter::SetWriteQueueLimits(
+    const WriteQueueLimits &limits,
+    const WriteQueueMonitor::StateCallback &callback) {
+  queue_monitor_.SetLimits(limits, callback);
+}
+
 void ChromeStreamWriter::DidWrite(int result) {
+  TRACE_EVENT1("sippet", "ChromeStreamWriter::DidWrite", "result", result);
   DCHECK(!pending_messages_.empty());
+  write_buf_ = nullptr;
 
   if (result > 0) {
     DidConsume(result);
@@ -70,29 +150,92 @@ void ChromeStreamWriter::DidWrite(int result) {
 }
 
 void ChromeStreamWriter::DidConsume(int result) {
-  PendingBlock *pending = pending_messages_.front();
-  pending->io_buffer_->DidConsume(result);
   for (;;) {
-    if (pending->io_buffer_->BytesRemaining() == 0) {
-      Pop(net::OK);
-      if (pending_messages_.empty())
-        break;  // done
-      pending = pending_messages_.front();
-      continue;
-    } else {
-      result = Drain(pending->io_buffer_.get());
-      if (result < 0) {
-        if (result != net::ERR_IO_PENDING)
-          CloseWithError(result);
-        break;
-      }
+    ConsumeBytes(result);
+    ScheduleDeferred();
+    if (pending_messages_.empty())
+      break;  // done
+    int buf_len = PrepareWriteBuffer();
+    result = wrapped_socket_->Write(write_buf_.get(), buf_len,
+        base::Bind(&ChromeStreamWriter::DidWrite,
+                   base::Unretained(this)));
+    if (result <= 0) {
+      if (result == 0)
+        result = net::ERR_CONNECTION_RESET;
+      if (result != net::ERR_IO_PENDING)
+        CloseWithError(result);
+      break;
     }
   }
 }
 
+void ChromeStreamWriter::ConsumeBytes(int bytes) {
+  // A write may span several frames; notify the ones fully written.
+  while (bytes > 0) {
+    DCHECK(!pending_messages_.empty());
+    net::DrainableIOBuffer *io_buffer =
+        pending_messages_.front()->io_buffer_.get();
+    int consumed = std::min(bytes, io_buffer->BytesRemaining());
+    io_buffer->DidConsume(consumed);
+    bytes -= consumed;
+    if (io_buffer->BytesRemaining() == 0)
+      Pop(net::OK);
+  }
+}
+
+void ChromeStreamWriter::ScheduleDeferred() {
+  if (deferred_messages_.empty())
+    return;
+  bool idle = pending_messages_.empty();
+  if (!idle && overtaken_ < kMaxOvertaken)
+    return;
+  // Whole messages are moved: the first one when it waited long enough, or
+  // as many as a write coalesces when there's nothing else to write.
+  int bytes = 0;
+  do {
+    PendingBlock *pending;
+    do {
+      DCHECK(!deferred_messages_.empty());
+      pending = deferred_messages_.front();
+      deferred_messages_.pop_front();
+      bytes += pending->io_buffer_->BytesRemaining();
+      pending_messages_.push_back(pending);
+    } while (!pending->last_);
+  } while (idle && !deferred_messages_.empty() && bytes < kMaxCoalescedBytes);
+  overtaken_ = 0;
+}
+
+int ChromeStreamWriter::PrepareWriteBuffer() {
+  DCHECK(!pending_messages_.empty());
+  std::deque<PendingBlock*>::iterator i = pending_messages_.begin();
+  int buf_len = (*i)->io_buffer_->BytesRemaining();
+  int frames = 1;
+  for (++i; i != pending_messages_.end(); ++i, ++frames) {
+    int remaining = (*i)->io_buffer_->BytesRemaining();
+    if (buf_len + remaining > kMaxCoalescedBytes)
+      break;
+    buf_len += remaining;
+  }
+  if (frames == 1) {
+    // Nothing to coalesce, write the frame as is.
+    write_buf_ = pending_messages_.front()->io_buffer_;
+    return buf_len;
+  }
+  write_buf_ = new net::IOBuffer(buf_len);
+  char *data = write_buf_->data();
+  for (i = pending_messages_.begin(); frames > 0; ++i, --frames) {
+    int remaining = (*i)->io_buffer_->BytesRemaining();
+    memcpy(data, (*i)->io_buffer_->data(), remaining);
+    data += remaining;
+  }
+  return buf_len;
+}
+
 void ChromeStreamWriter::Pop(int result) {
   PendingBlock *pending = pending_messages_.front();
-  pending->callback_.Run(result);
+  if (!pending->callback_.is_null())
+    pending->callback_.Run(result);
+  queue_monitor_.Dequeued(pending->queued_bytes_);
   delete pending;
   pending_messages_.pop_front();
 }
@@ -8,6 +8,8 @@
 #include <deque>
 #include "base/memory/weak_ptr.h"
 #include "net/base/completion_callback.h"
+#include "sippet/transport/chrome/message_io_buffer.h"
+#include "sippet/transport/chrome/write_queue_monitor.h"
 
 namespace base {
 class TimeDelta;
@@ -26,33 +28,83 @@ namespace sippet {
 // locally when the wrapped socket returns asynchronously for Write().
 // Each enqueued frame will be notified after write completion.
 //
-// There are no bounds on the local buffer size. Use carefully.
+// Frames enqueued while a write is pending are coalesced into a single
+// socket write, up to |kMaxCoalescedBytes|, when that write completes. On
+// busy connections this saves system calls and, for TLS, records, without
+// delaying anything: a write is issued as soon as the socket is writable.
+//
+// Bulk messages wait for the urgent ones queued after them, see
+// |WritePriority|, but never for more than |kMaxOvertaken| of them, so that
+// new requests still make progress when a connection stays busy. Messages
+// of the same priority, and the blocks of a message, keep their order.
+//
+// There are no bounds on the local buffer size, unless limited by
+// |SetWriteQueueLimits|.
 class ChromeStreamWriter {
  public:
+  // Urgent messages a bulk one waits for at most.
+  static const int kMaxOvertaken = 8;
+
   ChromeStreamWriter(net::Socket* socket_to_wrap);
   virtual ~ChromeStreamWriter();
 
+  // Writes a single block urgent message.
   int Write(net::IOBuffer* buf, int buf_len,
             const net::CompletionCallback& callback);
 
+  // Writes a message made of |blocks|, running |callback| once the last one
+  // is written.
+  int WriteMessage(const IOBufferList &blocks, WritePriority priority,
+                   const net::CompletionCallback& callback);
+
+  // Writes a CRLF keep-alive (RFC 5626 section 3.5.1): a double CRLF ping,
+  // or the single CRLF pong answering one.
+  int WriteKeepAlive(bool pong, const net::CompletionCallback& callback);
+
   void CloseWithError(int err);
 
+  // Watch the queued blocks, running |callback| as the writer becomes
+  // congested or writable again.
+  void SetWriteQueueLimits(const WriteQueueLimits &limits,
+                           const WriteQueueMonitor::StateCallback &callback);
+
+  // Bytes of the messages queued.
+  size_t queued_bytes() const { return queue_monitor_.bytes(); }
+
  private:
   net::Socket* wrapped_socket_;
   int error_;
 
   struct PendingBlock {
-    PendingBlock(net::DrainableIOBuffer* io_buffer,
+    PendingBlock(net::DrainableIOBuffer* io_buffer, bool last,
                  const net::CompletionCallback& callback);
     ~PendingBlock();
     scoped_refptr<net::DrainableIOBuffer> io_buffer_;
     net::CompletionCallback callback_;
+    // The bytes accounted in |queue_monitor_|.
+    int queued_bytes_;
+    // Whether this is the last block of its message.
+    bool last_;
   };
 
+  WriteQueueMonitor queue_monitor_;
+
   std::deque<PendingBlock*> pending_messages_;
+  // Bulk messages not yet moved to |pending_messages_|. Never left behind an
+  // empty |pending_messages_|.
+  std::deque<PendingBlock*> deferred_messages_;
+  // Urgent messages queued ahead of the first deferred one.
+  int overtaken_;
+  // Buffer given to the socket for the current write, if not a frame's own.
+  scoped_refptr<net::IOBuffer> write_buf_;
 
+  int Enqueue(net::IOBuffer* buf, int buf_len, bool last, bool deferred,
+              const net::CompletionCallback& callback);
   void DidWrite(int result);
   void DidConsume(int result);
+  void ConsumeBytes(int bytes);
+  void ScheduleDeferred();
+  int PrepareWriteBuffer();
   void Pop(int result);
   int Drain(net::DrainableIOBuffer* buf);
 
@@ -4,6 +4,7 @@
 
 #include "sippet/transport/chrome/chrome_stream_writer.h"
 
+#include <cstring>
 #include <string>
 
 #include "sippet/message/message.h"
@@ -25,6 +26,9 @@ using sippet::Expires;
 using sippet::ContentLength;
 using sippet::ChromeStreamWriter;
 using sippet::Method;
+using sippet::IOBufferList;
+using sippet::WRITE_PRIORITY_BULK;
+using sippet::WRITE_PRIORITY_URGENT;
 
 class StreamChannelTest : public testing::Test {
  public:
@@ -87,6 +91,13 @@ class StreamChannelTest : public testing::Test {
     return writer_->Write(buf.get(), data.size(), callback);
   }
 
+  static scoped_refptr<net::IOBufferWithSize> CreateBlock(const char *data) {
+    scoped_refptr<net::IOBufferWithSize> block(
+        new net::IOBufferWithSize(strlen(data)));
+    memcpy(block->data(), data, strlen(data));
+    return block;
+  }
+
   net::DeterministicMockTCPClientSocket* wrapped_socket_;
   scoped_ptr<net::DeterministicSocketData> data_;
   scoped_ptr<ChromeStreamWriter> writer_;
@@ -197,6 +208,42 @@ TEST_F(StreamChannelTest, OverlappedSend) {
   Finish();
 }
 
+TEST_F(StreamChannelTest, CoalescedSend) {
+  // Requests enqueued while a write is pending are sent in a single write,
+  // but still notified one by one.
+  std::string coalesced(std::string(RegisterRequest) + RegisterRequest);
+  net::MockWrite writes[] = {
+    net::MockWrite(net::ASYNC, 0, RegisterRequest),
+    net::MockWrite(net::ASYNC, 1, coalesced.c_str()),
+  };
+
+  Initialize(writes, arraysize(writes));
+
+  net::TestCompletionCallback callback1, callback2, callback3;
+  int rv = WriteMessage(callback1.callback());
+  ASSERT_EQ(net::ERR_IO_PENDING, rv);
+  rv = WriteMessage(callback2.callback());
+  ASSERT_EQ(net::ERR_IO_PENDING, rv);
+  rv = WriteMessage(callback3.callback());
+  ASSERT_EQ(net::ERR_IO_PENDING, rv);
+
+  // First message is sent, the other two are written together.
+  wrapped_socket_->CompleteWrite();
+  data_->RunFor(1);
+  ASSERT_TRUE(callback1.have_result());
+  ASSERT_EQ(net::OK, callback1.WaitForResult());
+  ASSERT_FALSE(callback2.have_result());
+
+  wrapped_socket_->CompleteWrite();
+  data_->RunFor(1);
+  ASSERT_TRUE(callback2.have_result());
+  ASSERT_EQ(net::OK, callback2.WaitForResult());
+  ASSERT_TRUE(callback3.have_result());
+  ASSERT_EQ(net::OK, callback3.WaitForResult());
+
+  Finish();
+}
+
 TEST_F(StreamChannelTest, SyncSendError) {
   // Synchronous error while sending data.
   net::MockWrite writes[] = {
@@ -265,3 +312,48 @@ TEST_F(StreamChannelTest, AsyncConnReset) {
 
   Finish();
 }
+
+TEST_F(StreamChannelTest, PrioritizedSend) {
+  // Urgent messages are written ahead of the bulk ones queued before them,
+  // which keep their blocks together.
+  net::MockWrite writes[] = {
+    net::MockWrite(net::ASYNC, 0, "first"),
+    net::MockWrite(net::ASYNC, 1, "urgent"),
+    net::MockWrite(net::ASYNC, 2, "bulk-head;bulk-body"),
+  };
+
+  Initialize(writes, arraysize(writes));
+
+  IOBufferList first;
+  first.push_back(CreateBlock("first"));
+  ASSERT_EQ(net::ERR_IO_PENDING,
+      writer_->WriteMessage(first, WRITE_PRIORITY_BULK,
+                            callback_.callback()));
+  IOBufferList bulk;
+  bulk.push_back(CreateBlock("bulk-head;"));
+  bulk.push_back(CreateBlock("bulk-body"));
+  net::TestCompletionCallback bulk_callback;
+  ASSERT_EQ(net::ERR_IO_PENDING,
+      writer_->WriteMessage(bulk, WRITE_PRIORITY_BULK,
+                            bulk_callback.callback()));
+  IOBufferList urgent;
+  urgent.push_back(CreateBlock("urgent"));
+  net::TestCompletionCallback urgent_callback;
+  ASSERT_EQ(net::ERR_IO_PENDING,
+      writer_->WriteMessage(urgent, WRITE_PRIORITY_URGENT,
+                            urgent_callback.callback()));
+
+  wrapped_socket_->CompleteWrite();
+  data_->RunFor(1);
+  wrapped_socket_->CompleteWrite();
+  data_->RunFor(1);
+  ASSERT_TRUE(urgent_callback.have_result());
+  ASSERT_FALSE(bulk_callback.have_result());
+
+  wrapped_socket_->CompleteWrite();
+  data_->RunFor(1);
+  ASSERT_TRUE(bulk_callback.have_result());
+  EXPECT_EQ(net::OK, bulk_callback.WaitForResult());
+
+  Finish();
+}
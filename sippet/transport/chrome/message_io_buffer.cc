@@ -0,0 +1,92 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/chrome/message_io_buffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include "base/trace_event/trace_event.h"
+#include "sippet/message/message.h"
+
+namespace sippet {
+
+SharedIOBuffer::SharedIOBuffer(base::RefCountedMemory *memory)
+  : net::IOBufferWithSize(
+        reinterpret_cast<char*>(const_cast<unsigned char*>(memory->front())),
+        static_cast<int>(memory->size())),
+    memory_(memory) {
+}
+
+SharedIOBuffer::~SharedIOBuffer() {
+  // The memory is owned by |memory_|, avoid the base class deleting it.
+  data_ = NULL;
+}
+
+raw_io_buffer_ostream::raw_io_buffer_ostream(net::GrowableIOBuffer *buffer)
+  : buffer_(buffer), start_offset_(buffer->offset()) {
+  Reserve(1);
+}
+
+raw_io_buffer_ostream::~raw_io_buffer_ostream() {
+  flush();
+}
+
+uint64 raw_io_buffer_ostream::current_pos() const {
+  return static_cast<uint64>(buffer_->offset() - start_offset_);
+}
+
+void raw_io_buffer_ostream::write_impl(const char *ptr, size_t size) {
+  // Flushed data is already in place; anything else is written directly.
+  if (ptr != buffer_->data()) {
+    Reserve(size);
+    memcpy(buffer_->data(), ptr, size);
+  }
+  buffer_->set_offset(buffer_->offset() + static_cast<int>(size));
+  Reserve(1);
+}
+
+void raw_io_buffer_ostream::Reserve(size_t size) {
+  if (static_cast<size_t>(buffer_->RemainingCapacity()) < size) {
+    size_t capacity = std::max(static_cast<size_t>(buffer_->capacity()) * 2,
+                               buffer_->offset() + size);
+    buffer_->SetCapacity(static_cast<int>(capacity));
+  }
+  SetBuffer(buffer_->data(), buffer_->RemainingCapacity());
+}
+
+void SerializeMessage(const Message &message, IOBufferList *buffers) {
+  TRACE_EVENT0("sippet", "SerializeMessage");
+  DCHECK(buffers);
+  const std::string &head = message.SerializedHead();
+  scoped_refptr<net::IOBufferWithSize> head_buffer(
+      new net::IOBufferWithSize(static_cast<int>(head.size())));
+  memcpy(head_buffer->data(), head.data(), head.size());
+  buffers->push_back(head_buffer);
+  if (message.has_content())
+    buffers->push_back(new SharedIOBuffer(message.shared_content().get()));
+}
+
+scoped_refptr<net::IOBufferWithSize> SerializeMessage(const Message &message) {
+  TRACE_EVENT0("sippet", "SerializeMessage");
+  return new SharedIOBuffer(message.SerializedWire().get());
+}
+
+WritePriority GetWritePriority(const Message &message) {
+  const Request *request = dyn_cast<Request>(&message);
+  if (!request)
+    return WRITE_PRIORITY_URGENT;
+  if (Method::ACK == request->method()
+      || Method::CANCEL == request->method()
+      || Method::BYE == request->method()
+      || Method::PRACK == request->method())
+    return WRITE_PRIORITY_URGENT;
+  const To *to = request->get<To>();
+  if (to && to->HasTag())
+    return WRITE_PRIORITY_URGENT;
+  return WRITE_PRIORITY_BULK;
+}
+
+}  // namespace sippet
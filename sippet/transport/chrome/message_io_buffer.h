@@ -0,0 +1,83 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_CHROME_MESSAGE_IO_BUFFER_H_
+#define SIPPET_TRANSPORT_CHROME_MESSAGE_IO_BUFFER_H_
+
+#include <vector>
+
+#include "base/memory/ref_counted.h"
+#include "base/memory/ref_counted_memory.h"
+#include "net/base/io_buffer.h"
+#include "sippet/base/raw_ostream.h"
+#include "sippet/transport/chrome/write_queue_monitor.h"
+
+namespace sippet {
+
+class Message;
+
+// An |IOBuffer| sharing a ref-counted memory block instead of owning a copy
+// of it. The block is kept alive until the buffer is released.
+class SharedIOBuffer : public net::IOBufferWithSize {
+ public:
+  explicit SharedIOBuffer(base::RefCountedMemory *memory);
+
+ private:
+  ~SharedIOBuffer() override;
+
+  scoped_refptr<base::RefCountedMemory> memory_;
+
+  DISALLOW_COPY_AND_ASSIGN(SharedIOBuffer);
+};
+
+// A |raw_ostream| writing straight into a |GrowableIOBuffer|, starting at
+// its current offset. The buffer is grown when the output doesn't fit its
+// capacity, so preallocating the expected size avoids any allocation. The
+// buffer offset is left at the end of the output once the stream is
+// flushed.
+class raw_io_buffer_ostream : public raw_ostream {
+ public:
+  explicit raw_io_buffer_ostream(net::GrowableIOBuffer *buffer);
+  ~raw_io_buffer_ostream() override;
+
+  // Number of bytes written to the buffer, flushing the stream.
+  size_t size() {
+    flush();
+    return static_cast<size_t>(buffer_->offset() - start_offset_);
+  }
+
+ private:
+  void write_impl(const char *ptr, size_t size) override;
+  uint64 current_pos() const override;
+
+  // Grows the buffer so that at least |size| bytes fit after its offset, and
+  // makes the remaining capacity the stream buffer.
+  void Reserve(size_t size);
+
+  scoped_refptr<net::GrowableIOBuffer> buffer_;
+  int start_offset_;
+
+  DISALLOW_COPY_AND_ASSIGN(raw_io_buffer_ostream);
+};
+
+typedef std::vector<scoped_refptr<net::IOBufferWithSize> > IOBufferList;
+
+// Serializes |message| into the list of buffers to be written in order by
+// stream transports: the start line and headers, then the content, if any.
+// The content is shared with the message, never copied.
+void SerializeMessage(const Message &message, IOBufferList *buffers);
+
+// Serializes |message| into a single buffer, as required by datagram
+// transports. The buffer shares the wire bytes cached by the message, so
+// sending it again (e.g. a retransmission) doesn't copy nor format anything.
+scoped_refptr<net::IOBufferWithSize> SerializeMessage(const Message &message);
+
+// The priority |message| is queued with by the socket writers: responses,
+// and requests for a dialog or transaction already established, are
+// urgent; out-of-dialog requests other than ACK and CANCEL are bulk.
+WritePriority GetWritePriority(const Message &message);
+
+} // namespace sippet
+
+#endif // SIPPET_TRANSPORT_CHROME_MESSAGE_IO_BUFFER_H_
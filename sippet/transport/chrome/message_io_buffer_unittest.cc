@@ -0,0 +1,95 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/chrome/message_io_buffer.h"
+
+#include <cstring>
+#include <string>
+
+#include "sippet/message/message.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+void PrintSample(raw_ostream &os, int lines) {
+  for (int i = 0; i < lines; ++i)
+    os << "Via: SIP/2.0/UDP 192.0.2." << i << ";branch=z9hG4bK" << i << "\r\n";
+}
+
+std::string SampleString(int lines) {
+  std::string result;
+  raw_string_ostream os(result);
+  PrintSample(os, lines);
+  return os.str();
+}
+
+}  // namespace
+
+TEST(FixedBufferOstreamTest, FitsBuffer) {
+  char buffer[512];
+  raw_fixed_buffer_ostream os(buffer, sizeof(buffer));
+  PrintSample(os, 4);
+  base::StringPiece output(os.str());
+  EXPECT_FALSE(os.overflowed());
+  EXPECT_EQ(buffer, output.data());
+  EXPECT_EQ(SampleString(4), output.as_string());
+}
+
+TEST(FixedBufferOstreamTest, Overflow) {
+  for (size_t size = 0; size < 128; ++size) {
+    char buffer[128];
+    raw_fixed_buffer_ostream os(buffer, size);
+    PrintSample(os, 8);
+    EXPECT_TRUE(os.overflowed());
+    EXPECT_EQ(SampleString(8), os.str().as_string());
+  }
+}
+
+TEST(IOBufferOstreamTest, Preallocated) {
+  scoped_refptr<net::GrowableIOBuffer> buffer(new net::GrowableIOBuffer);
+  buffer->SetCapacity(512);
+  char *start = buffer->StartOfBuffer();
+  raw_io_buffer_ostream os(buffer.get());
+  PrintSample(os, 4);
+  std::string expected(SampleString(4));
+  ASSERT_EQ(expected.size(), os.size());
+  EXPECT_EQ(start, buffer->StartOfBuffer());
+  EXPECT_EQ(static_cast<int>(expected.size()), buffer->offset());
+  EXPECT_EQ(expected, std::string(start, expected.size()));
+}
+
+TEST(IOBufferOstreamTest, Grows) {
+  scoped_refptr<net::GrowableIOBuffer> buffer(new net::GrowableIOBuffer);
+  buffer->SetCapacity(16);
+  buffer->set_offset(3);
+  memcpy(buffer->StartOfBuffer(), "abc", 3);
+  {
+    raw_io_buffer_ostream os(buffer.get());
+    PrintSample(os, 32);
+  }
+  std::string expected("abc" + SampleString(32));
+  ASSERT_EQ(static_cast<int>(expected.size()), buffer->offset());
+  EXPECT_EQ(expected, std::string(buffer->StartOfBuffer(), expected.size()));
+}
+
+TEST(SerializeMessageTest, DatagramReusesWireBytes) {
+  scoped_refptr<Message> message = Message::Parse(
+      "OPTIONS sip:carol@chicago.com SIP/2.0\r\n"
+      "Call-ID: a84b4c76e66710\r\n"
+      "\r\n");
+  ASSERT_TRUE(message);
+  message->set_content("hello");
+
+  scoped_refptr<net::IOBufferWithSize> first(SerializeMessage(*message));
+  EXPECT_EQ(message->ToString(), std::string(first->data(), first->size()));
+
+  // Retransmissions share the bytes of the first send.
+  scoped_refptr<net::IOBufferWithSize> second(SerializeMessage(*message));
+  EXPECT_EQ(first->data(), second->data());
+  EXPECT_EQ(first->size(), second->size());
+}
+
+}  // namespace sippet
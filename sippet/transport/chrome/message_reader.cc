@@ -4,18 +4,117 @@
 
 #include "sippet/transport/chrome/message_reader.h"
 
+#include <algorithm>
+#include <cstring>
 #include <string>
 
 #include "base/message_loop/message_loop.h"
+#include "base/strings/string_util.h"
+#include "base/trace_event/trace_event.h"
 #include "net/base/net_errors.h"
 #include "net/base/io_buffer.h"
 #include "net/socket/stream_socket.h"
 #include "sippet/message/message.h"
+#include "sippet/transport/transport_stats.h"
 
 namespace sippet {
 
+namespace {
+
+const char kContentLength[] = "content-length";
+
+// Value of a Content-Length scan that has to be left to the parser.
+const int64 kContentLengthUnscannable = -2;
+
+// Returns the value of the header line [line, end), if it's a Content-Length
+// header, in its long or compact form, holding a plain number. Returns -1
+// otherwise, leaving anything unusual to the parser.
+int64 ParseContentLengthLine(const char *line, const char *end) {
+  const char *p = line;
+  if (end - p > 1 && (*p == 'l' || *p == 'L')
+      && (p[1] == ':' || p[1] == ' ' || p[1] == '\t')) {
+    ++p;
+  } else if (end - p > static_cast<ptrdiff_t>(arraysize(kContentLength) - 1)
+      && base::strncasecmp(p, kContentLength,
+                           arraysize(kContentLength) - 1) == 0) {
+    p += arraysize(kContentLength) - 1;
+  } else {
+    return -1;
+  }
+  while (p != end && (*p == ' ' || *p == '\t'))
+    ++p;
+  if (p == end || *p++ != ':')
+    return -1;
+  while (p != end && (*p == ' ' || *p == '\t'))
+    ++p;
+  int64 value = 0;
+  int digits = 0;
+  for (; p != end && *p >= '0' && *p <= '9'; ++p, ++digits) {
+    if (digits == 9)
+      return -1;  // Way over the maximum message size anyway
+    value = value * 10 + (*p - '0');
+  }
+  if (digits == 0)
+    return -1;
+  while (p != end && (*p == ' ' || *p == '\t' || *p == '\r'))
+    ++p;
+  return p == end ? value : -1;
+}
+
+// Finds the empty line ending the header block, accepting both CRLF CRLF and
+// LF LF, starting at |offset|. Returns the offset of the terminator and sets
+// |terminator_size|, or returns |base::StringPiece::npos|. Jumps from LF to
+// LF with |memchr|, which is vectorized by the C library, instead of
+// matching at every offset. Lines ending after |offset| are also checked
+// for a Content-Length header, until one is found, unless |*content_length|
+// is |kContentLengthUnscannable|. Folded headers make it so.
+size_t FindEndOfHeaders(const base::StringPiece &input,
+                        size_t offset,
+                        size_t *terminator_size,
+                        int64 *content_length) {
+  const char *begin = input.data();
+  const char *end = begin + input.size();
+  const char *p = begin + std::min(offset, input.size());
+  // Start of the line containing |p|.
+  const char *line = p;
+  while (line != begin && line[-1] != '\n')
+    --line;
+  while (p != end) {
+    const char *lf = static_cast<const char*>(memchr(p, '\n', end - p));
+    if (!lf)
+      break;
+    if (line != lf && (*line == ' ' || *line == '\t'))
+      *content_length = kContentLengthUnscannable;
+    else if (*content_length == -1)
+      *content_length = ParseContentLengthLine(line, lf);
+    line = lf + 1;
+    if (end - lf < 2)
+      break;
+    if (lf[1] == '\n') {
+      *terminator_size = 2;
+      return lf - begin;
+    }
+    if (lf > begin && lf[-1] == '\r' && end - lf >= 3
+        && lf[1] == '\r' && lf[2] == '\n') {
+      *terminator_size = 4;
+      return lf - 1 - begin;
+    }
+    p = lf + 1;
+  }
+  return base::StringPiece::npos;
+}
+
+// |MessageReader::content_length_| to be taken from the parsed headers.
+const size_t kUnknownContentLength = static_cast<size_t>(-1);
+
+}  // namespace
+
 MessageReader::MessageReader()
     : next_state_(STATE_NONE),
+      headers_scanned_(0),
+      scanned_content_length_(-1),
+      content_length_(0),
+      buffered_only_(false),
       io_callback_(base::Bind(&MessageReader::OnIOComplete,
           base::Unretained(this))) {
 }
@@ -24,6 +123,7 @@ MessageReader::~MessageReader() {
 }
 
 int MessageReader::Read(const net::CompletionCallback& callback) {
+  TRACE_EVENT0("sippet", "MessageReader::Read");
   DCHECK_EQ(STATE_NONE, next_state_);
   callback_ = callback;
   next_state_ = STATE_RECEIVE_DATA;
@@ -33,6 +133,36 @@ int MessageReader::Read(const net::CompletionCallback& callback) {
   return rv;
 }
 
+int MessageReader::ReadBuffered(
+    std::vector<scoped_refptr<Message> > *messages) {
+  DCHECK_EQ(STATE_NONE, next_state_);
+  DCHECK(!current_message_);
+  DCHECK(messages);
+  buffered_only_ = true;
+  int rv = net::OK;
+  while (BytesRemaining() > 0) {
+    next_state_ = STATE_READ_HEADERS;
+    rv = DoLoop(net::OK);
+    if (rv != net::OK)
+      break;
+    messages->push_back(GetIncomingMessage());
+  }
+  buffered_only_ = false;
+  next_state_ = STATE_NONE;
+  // Pending means the remaining data is incomplete.
+  return rv == net::ERR_IO_PENDING ? net::OK : rv;
+}
+
+void MessageReader::DidDiscardData() {
+  headers_scanned_ = 0;
+  scanned_content_length_ = -1;
+  content_.clear();
+}
+
+size_t MessageReader::max_content_size() {
+  return max_size();
+}
+
 scoped_refptr<Message> MessageReader::GetIncomingMessage() {
   scoped_refptr<Message> message(current_message_);
   current_message_ = nullptr;
@@ -50,6 +180,9 @@ void MessageReader::DoCallback(int result) {
 }
 
 void MessageReader::OnIOComplete(int result) {
+  TRACE_EVENT1("sippet", "MessageReader::OnIOComplete", "result", result);
+  if (result >= 0)
+    receive_time_ = base::TimeTicks::Now();
   int rv = DoLoop(result);
   if (rv != net::ERR_IO_PENDING)
     DoCallback(rv);
@@ -100,7 +233,7 @@ int MessageReader::DoReceiveData() {
     // There are more data to be read, just continue
     return net::OK;
   } else {
-    return DoIORead(io_callback_);
+    return DoTimedIORead();
   }
 }
 
@@ -112,38 +245,81 @@ int MessageReader::DoReceiveDataComplete(int result) {
 }
 
 int MessageReader::DoReadHeaders() {
+  TRACE_EVENT0("sippet", "MessageReader::DoReadHeaders");
   // Eliminate all blanks from the message start. They're used as keep-alive.
+  int empty_lines = 0;
   while (BytesRemaining() > 0) {
     switch (data()[0]) {
-      case '\r': case '\n':
+      case '\n':
+        ++empty_lines;
+        // Fall through
+      case '\r':
         DidConsume(1);
+        if (headers_scanned_ > 0)
+          --headers_scanned_;
         continue;
     }
     break;
   }
+  if (empty_lines > 0 && !keepalive_callback_.is_null())
+    keepalive_callback_.Run(empty_lines);
   if (BytesRemaining() == 0) {
     // The reading buffer was full of empty lines, read more...
     return ReadMore();
   }
   base::StringPiece string_piece(data(), BytesRemaining());
-  size_t end_size = 4;
-  size_t end = string_piece.find("\r\n\r\n");
-  if (end == base::StringPiece::npos) {
-    // CRLF is the standard, but we're accepting just LF
-    end = string_piece.find("\n\n");
-    end_size = 2;
-  }
+  // CRLF is the standard, but we're accepting just LF. Resume the scan from
+  // where the previous read stopped, backing up enough to catch a terminator
+  // split across reads.
+  size_t end_size = 0;
+  size_t resume_at = headers_scanned_ > 3 ? headers_scanned_ - 3 : 0;
+  size_t end = FindEndOfHeaders(string_piece, resume_at, &end_size,
+                                &scanned_content_length_);
   if (end == base::StringPiece::npos) {
+    // Oversized heads are dropped without waiting for their end.
+    if (!message_limits_.AdmitsHead(string_piece, false))
+      return RejectOverLimits("head");
+    headers_scanned_ = string_piece.size();
     // Read more...
     return ReadMore();
   }
-  std::string header(data(), end + end_size);
-  DidConsume(static_cast<int>(end + end_size));
-  current_message_ = Message::Parse(header);
+  headers_scanned_ = 0;
+  content_length_ = scanned_content_length_ >= 0
+      ? static_cast<size_t>(scanned_content_length_)
+      : kUnknownContentLength;
+  scanned_content_length_ = -1;
+  size_t head_size = end + end_size;
+  if (!message_limits_.AdmitsHead(base::StringPiece(data(), head_size), true))
+    return RejectOverLimits("head");
+  if (content_length_ != kUnknownContentLength
+      && !message_limits_.AdmitsContentLength(content_length_))
+    return RejectOverLimits("content");
+  if (!head_filter_.is_null() && content_length_ != kUnknownContentLength
+      && head_size + content_length_ <= string_piece.size()
+      && head_filter_.Run(base::StringPiece(data(), head_size))) {
+    DidConsume(static_cast<int>(head_size + content_length_));
+    next_state_ = STATE_READ_HEADERS;
+    return net::OK;
+  }
+  // Most incoming messages are only looked up by a few headers (e.g.
+  // retransmissions absorbed by transactions), so decode them on demand,
+  // except for those the application asked to be decoded upfront.
+  current_message_ = Message::Parse(
+      base::StringPiece(data(), head_size), Message::PARSE_LAZY,
+      parse_profile_);
+  DidConsume(static_cast<int>(head_size));
   if (!current_message_) {
+    TransportStats::Count(TransportStats::PARSE_FAILURES);
     // Close connection: bad protocol
     return net::ERR_INVALID_RESPONSE;  // XXX: what if it's a request?
   }
+  if (!message_limits_.AdmitsMessage(*current_message_)) {
+    current_message_ = nullptr;
+    return RejectOverLimits("routing entries");
+  }
+  current_message_->set_receive_time(receive_time_);
+  // Incoming messages are followed up to their delegate by their address.
+  TRACE_EVENT_FLOW_BEGIN0("sippet", "IncomingMessage", current_message_.get());
   next_state_ = STATE_READ_HEADERS_COMPLETE;
   return net::OK;
 }
@@ -151,15 +327,24 @@ int MessageReader::DoReadHeaders() {
 int MessageReader::DoReadHeadersComplete() {
   DCHECK(current_message_);
 
-  // If there's no Content-Length, then we accept as if the content is empty
-  ContentLength *content_length = current_message_->get<ContentLength>();
-  if (content_length && content_length->value() > 0) {
-    if (content_length->value() > max_size()) {
+  // Content-Length is usually known from the scan already. If there's none,
+  // then we accept as if the content is empty.
+  if (content_length_ == kUnknownContentLength) {
+    const Message *message = current_message_.get();
+    const ContentLength *content_length = message->get<ContentLength>();
+    content_length_ = content_length ? content_length->value() : 0;
+    if (!message_limits_.AdmitsContentLength(content_length_)) {
+      current_message_ = nullptr;
+      return RejectOverLimits("content");
+    }
+  }
+  if (content_length_ > 0) {
+    if (content_length_ > max_content_size()) {
       // Close the connection immediately: the server is trying to send a
-      // too large content. Maximum size allowed is 64kb.
+      // too large content.
       VLOG(1) << "Trying to receive a too large message content: "
-              << content_length->value()
-              << ", max = " << max_size();
+              << content_length_
+              << ", max = " << max_content_size();
       return net::ERR_MSG_TOO_BIG;
     }
     next_state_ = STATE_READ_BODY;
@@ -172,15 +357,22 @@ int MessageReader::DoReadHeadersComplete() {
 }
 
 int MessageReader::DoReadBody() {
-  ContentLength *content_length = current_message_->get<ContentLength>();
-  DCHECK(content_length);
-  if (content_length->value() > static_cast<unsigned>(BytesRemaining())) {
+  DCHECK_GT(content_length_, 0u);
+  // The content is moved out of the read buffer as it arrives, so it can be
+  // larger than the buffer, and it's never copied again: the message takes
+  // it over once complete.
+  if (content_.empty())
+    content_.reserve(content_length_);
+  size_t bytes = std::min(content_length_ - content_.size(),
+                          static_cast<size_t>(BytesRemaining()));
+  content_.append(data(), bytes);
+  DidConsume(static_cast<int>(bytes));
+  if (content_.size() < content_length_) {
     // Read more...
     return ReadMore();
   }
-  std::string content(data(), content_length->value());
-  DidConsume(content_length->value());
-  current_message_->set_content(content);
+  current_message_->set_content(
+      base::RefCountedString::TakeString(&content_));
   next_state_ = STATE_READ_BODY_COMPLETE;
   return net::OK;
 }
@@ -197,8 +389,28 @@ int MessageReader::ReadMore() {
     // or content) that exceeds the maximum size allowed.
     return net::ERR_MSG_TOO_BIG;
   }
-  next_state_ = STATE_RECEIVE_DATA;
-  return net::OK;
+  if (buffered_only_) {
+    next_state_ = STATE_NONE;
+    return net::ERR_IO_PENDING;
+  }
+  // Don't go through STATE_RECEIVE_DATA: the unconsumed bytes are known to
+  // be incomplete, so they have to be followed by more data.
+  next_state_ = STATE_RECEIVE_DATA_COMPLETE;
+  return DoTimedIORead();
+}
+
+int MessageReader::DoTimedIORead() {
+  int rv = DoIORead(io_callback_);
+  if (rv >= 0)
+    receive_time_ = base::TimeTicks::Now();
+  return rv;
+}
+
+int MessageReader::RejectOverLimits(const char *what) {
+  VLOG(1) << "Discarded incoming message: " << what << " over the limits";
+  TransportStats::Count(TransportStats::OVERSIZED_MESSAGES);
+  next_state_ = STATE_NONE;
+  return net::ERR_MSG_TOO_BIG;
 }
 
 }  // namespace sippet
@@ -5,8 +5,18 @@
 #ifndef SIPPET_TRANSPORT_CHROME_MESSAGE_READER_H_
 #define SIPPET_TRANSPORT_CHROME_MESSAGE_READER_H_
 
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/callback.h"
+#include "base/memory/ref_counted.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/strings/string_piece.h"
+#include "base/time/time.h"
 #include "net/base/completion_callback.h"
+#include "sippet/message/parse_profile.h"
+#include "sippet/transport/message_limits.h"
 
 namespace sippet {
 
@@ -20,6 +30,43 @@ class MessageReader {
   int Read(const net::CompletionCallback& callback);
   scoped_refptr<Message> GetIncomingMessage();
 
+  // Parses the complete messages already buffered after the one returned
+  // by |GetIncomingMessage|, without any I/O, and appends them to
+  // |messages|. Bursts of messages are then handled in a single pass,
+  // instead of one |Read| per message. A trailing incomplete message is
+  // left for the next |Read|. Returns a network error if the buffered data
+  // can't be parsed; messages parsed before the error are still appended.
+  int ReadBuffered(std::vector<scoped_refptr<Message> > *messages);
+
+  // Called with the number of empty lines skipped before a message: the CRLF
+  // keep-alives of RFC 5626, where a double CRLF is a ping and a single one
+  // is a pong. It's run in the middle of |Read|, so it must not destroy the
+  // reader.
+  void set_keepalive_callback(const base::Callback<void(int)> &callback) {
+    keepalive_callback_ = callback;
+  }
+
+  // Called with the head of each message fully buffered along with its
+  // content, before it's parsed. If it returns true, the message is dropped
+  // without being parsed. Like |set_keepalive_callback|, it's run in the
+  // middle of |Read|.
+  void set_head_filter(
+      const base::Callback<bool(const base::StringPiece&)> &filter) {
+    head_filter_ = filter;
+  }
+
+  // Headers decoded as soon as a message is parsed; the others are decoded
+  // when first looked up. See |ParseProfile|.
+  void set_parse_profile(const ParseProfile &parse_profile) {
+    parse_profile_ = parse_profile;
+  }
+
+  // Bounds of the messages read; those over them fail the read with
+  // |net::ERR_MSG_TOO_BIG|, as soon as they are known to be over.
+  void set_message_limits(const MessageLimits &message_limits) {
+    message_limits_ = message_limits;
+  }
+
   bool is_idle() const {
     return next_state_ == STATE_NONE;
   }
@@ -38,6 +85,12 @@ class MessageReader {
   // Returns the max size of the internal read buffer.
   virtual size_t max_size() = 0;
 
+  // Returns the max size of a message content. Contents are consumed from
+  // the read buffer as they arrive, so they may be larger than |max_size|
+  // when the underlying transport keeps delivering data (i.e. streams).
+  // Defaults to |max_size|.
+  virtual size_t max_content_size();
+
   // Returns the number of unconsumed bytes.
   virtual int BytesRemaining() const = 0;
 
@@ -45,6 +98,11 @@ class MessageReader {
   // to the first unconsumed byte.
   virtual void DidConsume(int bytes) = 0;
 
+  // Unconsumed bytes are expected to be kept across |DoIORead| calls, so
+  // header parsing can resume where it stopped. Implementations dropping
+  // unconsumed bytes must call this.
+  void DidDiscardData();
+
  private:
   enum State {
     STATE_NONE,
@@ -71,11 +129,33 @@ class MessageReader {
   int DoReadBody();
   int DoReadBodyComplete();
   int ReadMore();
+  // Runs |DoIORead|, recording when data was received.
+  int DoTimedIORead();
+  // Drops the message being read for being over |message_limits_|.
+  int RejectOverLimits(const char *what);
 
   State next_state_;
   scoped_refptr<Message> current_message_;
+  // Number of unconsumed bytes already scanned for the end of the headers.
+  size_t headers_scanned_;
+  // Content-Length value found while scanning for the end of the headers,
+  // negative if none.
+  int64 scanned_content_length_;
+  // Content length of |current_message_|.
+  size_t content_length_;
+  // Content of |current_message_| received so far.
+  std::string content_;
+  // Set while running |ReadBuffered|, so that no I/O is done.
+  bool buffered_only_;
+  // When the last read completed, the receive time of the messages whose
+  // heads it completed.
+  base::TimeTicks receive_time_;
   net::CompletionCallback callback_;
   net::CompletionCallback io_callback_;
+  base::Callback<void(int)> keepalive_callback_;
+  base::Callback<bool(const base::StringPiece&)> head_filter_;
+  ParseProfile parse_profile_;
+  MessageLimits message_limits_;
 
   DISALLOW_COPY_AND_ASSIGN(MessageReader);
 };
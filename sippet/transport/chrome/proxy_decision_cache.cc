@@ -0,0 +1,93 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/chrome/proxy_decision_cache.h"
+
+#include "base/logging.h"
+#include "base/time/tick_clock.h"
+
+namespace sippet {
+
+ProxyDecisionCache::ProxyDecisionCache(base::TimeDelta ttl)
+  : ttl_(ttl),
+    tick_clock_(nullptr) {
+  net::NetworkChangeNotifier::AddIPAddressObserver(this);
+}
+
+ProxyDecisionCache::~ProxyDecisionCache() {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  net::NetworkChangeNotifier::RemoveIPAddressObserver(this);
+}
+
+bool ProxyDecisionCache::Lookup(const GURL &url,
+                                net::ProxyInfo *proxy_info) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  EntriesMap::iterator i = entries_.find(url);
+  if (i == entries_.end())
+    return false;
+  if (Now() >= i->second.expiration) {
+    entries_.erase(i);
+    return false;
+  }
+  *proxy_info = i->second.proxy_info;
+  return true;
+}
+
+void ProxyDecisionCache::Store(const GURL &url,
+                               const net::ProxyInfo &proxy_info) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  if (ttl_ <= base::TimeDelta())
+    return;
+  base::TimeTicks now = Now();
+  if (entries_.size() >= kMaxEntries && entries_.end() == entries_.find(url)) {
+    // Expired entries go first, then the one closest to expire.
+    for (EntriesMap::iterator i = entries_.begin(); i != entries_.end();) {
+      if (now >= i->second.expiration)
+        entries_.erase(i++);
+      else
+        ++i;
+    }
+    if (entries_.size() >= kMaxEntries) {
+      EntriesMap::iterator oldest = entries_.begin();
+      for (EntriesMap::iterator i = entries_.begin(), ie = entries_.end();
+           i != ie; ++i) {
+        if (i->second.expiration < oldest->second.expiration)
+          oldest = i;
+      }
+      entries_.erase(oldest);
+    }
+  }
+  EntriesMap::iterator i = entries_.find(url);
+  if (i != entries_.end() && now < i->second.expiration) {
+    // Updated, e.g. after falling back to another proxy, but still expiring
+    // when the PAC script would have been run again.
+    i->second.proxy_info = proxy_info;
+    return;
+  }
+  Entry &entry = entries_[url];
+  entry.proxy_info = proxy_info;
+  entry.expiration = now + ttl_;
+}
+
+void ProxyDecisionCache::Remove(const GURL &url) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  entries_.erase(url);
+}
+
+void ProxyDecisionCache::Clear() {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  entries_.clear();
+}
+
+void ProxyDecisionCache::OnIPAddressChanged() {
+  DVLOG(1) << "Network changed, forgetting " << entries_.size()
+           << " proxy decisions";
+  Clear();
+}
+
+base::TimeTicks ProxyDecisionCache::Now() const {
+  return tick_clock_ ? tick_clock_->NowTicks() : base::TimeTicks::Now();
+}
+
+} // End of sippet namespace
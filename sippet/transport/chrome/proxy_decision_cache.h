@@ -0,0 +1,84 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_CHROME_PROXY_DECISION_CACHE_H_
+#define SIPPET_TRANSPORT_CHROME_PROXY_DECISION_CACHE_H_
+
+#include <map>
+
+#include "base/basictypes.h"
+#include "base/threading/thread_checker.h"
+#include "base/time/time.h"
+#include "net/base/network_change_notifier.h"
+#include "net/proxy/proxy_info.h"
+#include "url/gurl.h"
+
+namespace base {
+class TickClock;
+}
+
+namespace sippet {
+
+// Remembers the proxies resolved for the destinations of stream channels
+// for a short while, so that reconnections and parallel connections to the
+// same registrar or proxy don't run a PAC script again. Decisions are keyed
+// by the URL given to the proxy service, which holds the destination host
+// and port, and forgotten when the IP address of the host changes, as the
+// network, and its proxy configuration, may have changed too.
+//
+// It's meant to be used from the network thread only.
+class ProxyDecisionCache
+    : public net::NetworkChangeNotifier::IPAddressObserver {
+ public:
+  // Decisions kept, at most; the oldest ones are dropped first.
+  static const size_t kMaxEntries = 64;
+
+  static const int kDefaultTtlSeconds = 30;
+
+  explicit ProxyDecisionCache(base::TimeDelta ttl);
+  ~ProxyDecisionCache() override;
+
+  // Copies the decision made for |url| into |proxy_info|, if any and not
+  // expired yet.
+  bool Lookup(const GURL &url, net::ProxyInfo *proxy_info);
+
+  // Remembers |proxy_info|, as resolved for |url|. Replacing a decision
+  // doesn't postpone its expiration.
+  void Store(const GURL &url, const net::ProxyInfo &proxy_info);
+
+  // Forgets the decision for |url|, e.g. when none of its proxies worked.
+  void Remove(const GURL &url);
+
+  void Clear();
+
+  size_t size() const { return entries_.size(); }
+
+  void set_tick_clock_for_testing(base::TickClock *tick_clock) {
+    tick_clock_ = tick_clock;
+  }
+
+  // net::NetworkChangeNotifier::IPAddressObserver methods:
+  void OnIPAddressChanged() override;
+
+ private:
+  struct Entry {
+    net::ProxyInfo proxy_info;
+    base::TimeTicks expiration;
+  };
+
+  typedef std::map<GURL, Entry> EntriesMap;
+
+  base::TimeTicks Now() const;
+
+  base::TimeDelta ttl_;
+  EntriesMap entries_;
+  base::TickClock *tick_clock_;
+  base::ThreadChecker thread_checker_;
+
+  DISALLOW_COPY_AND_ASSIGN(ProxyDecisionCache);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_CHROME_PROXY_DECISION_CACHE_H_
@@ -0,0 +1,75 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/chrome/proxy_decision_cache.h"
+
+#include "base/strings/string_number_conversions.h"
+#include "base/test/simple_test_tick_clock.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+class ProxyDecisionCacheTest : public testing::Test {
+ public:
+  ProxyDecisionCacheTest()
+    : cache_(base::TimeDelta::FromSeconds(30)),
+      url_("https://registrar.example.com:5061") {
+    clock_.Advance(base::TimeDelta::FromSeconds(1));
+    cache_.set_tick_clock_for_testing(&clock_);
+    proxy_info_.UseNamedProxy("proxy.example.com:8080");
+  }
+
+  base::SimpleTestTickClock clock_;
+  ProxyDecisionCache cache_;
+  GURL url_;
+  net::ProxyInfo proxy_info_;
+};
+
+TEST_F(ProxyDecisionCacheTest, ExpiresAfterTtl) {
+  net::ProxyInfo proxy_info;
+  EXPECT_FALSE(cache_.Lookup(url_, &proxy_info));
+  cache_.Store(url_, proxy_info_);
+  ASSERT_TRUE(cache_.Lookup(url_, &proxy_info));
+  EXPECT_EQ("proxy.example.com:8080",
+            proxy_info.proxy_server().host_port_pair().ToString());
+  EXPECT_FALSE(cache_.Lookup(GURL("https://registrar.example.com:5062"),
+                             &proxy_info));
+
+  // Replacing the decision doesn't keep it for longer.
+  clock_.Advance(base::TimeDelta::FromSeconds(20));
+  net::ProxyInfo direct;
+  direct.UseDirect();
+  cache_.Store(url_, direct);
+  ASSERT_TRUE(cache_.Lookup(url_, &proxy_info));
+  EXPECT_TRUE(proxy_info.is_direct());
+  clock_.Advance(base::TimeDelta::FromSeconds(10));
+  EXPECT_FALSE(cache_.Lookup(url_, &proxy_info));
+  EXPECT_EQ(0u, cache_.size());
+}
+
+TEST_F(ProxyDecisionCacheTest, ForgetsOnNetworkChange) {
+  cache_.Store(url_, proxy_info_);
+  cache_.OnIPAddressChanged();
+  net::ProxyInfo proxy_info;
+  EXPECT_FALSE(cache_.Lookup(url_, &proxy_info));
+
+  cache_.Store(url_, proxy_info_);
+  cache_.Remove(url_);
+  EXPECT_FALSE(cache_.Lookup(url_, &proxy_info));
+}
+
+TEST_F(ProxyDecisionCacheTest, Bounded) {
+  for (size_t i = 0; i <= ProxyDecisionCache::kMaxEntries; ++i) {
+    clock_.Advance(base::TimeDelta::FromMilliseconds(1));
+    cache_.Store(GURL("https://host" + base::SizeTToString(i) + ":5061"),
+                 proxy_info_);
+  }
+  EXPECT_EQ(ProxyDecisionCache::kMaxEntries, cache_.size());
+  // The oldest decision made way for the last one.
+  net::ProxyInfo proxy_info;
+  EXPECT_FALSE(cache_.Lookup(GURL("https://host0:5061"), &proxy_info));
+  EXPECT_TRUE(cache_.Lookup(GURL("https://host1:5061"), &proxy_info));
+}
+
+}  // namespace sippet
@@ -0,0 +1,60 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/chrome/receive_buffer_pool.h"
+
+#include <vector>
+
+#include "base/lazy_instance.h"
+#include "base/synchronization/lock.h"
+#include "net/base/io_buffer.h"
+
+namespace sippet {
+
+namespace {
+
+struct Pool {
+  base::Lock lock;
+  std::vector<scoped_refptr<net::IOBufferWithSize> > buffers;
+};
+
+base::LazyInstance<Pool>::Leaky g_pool = LAZY_INSTANCE_INITIALIZER;
+
+}  // namespace
+
+scoped_refptr<net::IOBufferWithSize> ReceiveBufferPool::Take() {
+  scoped_refptr<net::IOBufferWithSize> buffer;
+  {
+    Pool &pool = g_pool.Get();
+    base::AutoLock lock(pool.lock);
+    if (!pool.buffers.empty()) {
+      buffer.swap(pool.buffers.back());
+      pool.buffers.pop_back();
+    }
+  }
+  if (!buffer.get())
+    buffer = new net::IOBufferWithSize(kBufferSize);
+  return buffer;
+}
+
+void ReceiveBufferPool::Release(scoped_refptr<net::IOBufferWithSize> *buffer) {
+  DCHECK(buffer);
+  scoped_refptr<net::IOBufferWithSize> released;
+  released.swap(*buffer);
+  if (!released.get() || released->size() != kBufferSize
+      || !released->HasOneRef())
+    return;
+  Pool &pool = g_pool.Get();
+  base::AutoLock lock(pool.lock);
+  if (pool.buffers.size() < kMaxPooledBuffers)
+    pool.buffers.push_back(released);
+}
+
+size_t ReceiveBufferPool::GetPooledCountForTesting() {
+  Pool &pool = g_pool.Get();
+  base::AutoLock lock(pool.lock);
+  return pool.buffers.size();
+}
+
+}  // namespace sippet
@@ -0,0 +1,47 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_CHROME_RECEIVE_BUFFER_POOL_H_
+#define SIPPET_TRANSPORT_CHROME_RECEIVE_BUFFER_POOL_H_
+
+#include "base/basictypes.h"
+#include "base/memory/ref_counted.h"
+
+namespace net {
+class IOBufferWithSize;
+}
+
+namespace sippet {
+
+// Lends full size receive buffers to readers while they're receiving a
+// large message. Idle readers give them back and wait on a small buffer of
+// their own, so that an idle connection holds a few KB instead of a full
+// receive buffer. Given back buffers are recycled, up to |kMaxPooledBuffers|,
+// so that busy connections don't go through the allocator for each message.
+//
+// It's safe to use the pool from any thread.
+class ReceiveBufferPool {
+ public:
+  // Size of the lent buffers.
+  static const int kBufferSize = 64 * 1024;
+
+  // Maximum number of buffers kept for reuse.
+  static const size_t kMaxPooledBuffers = 32;
+
+  // Returns a buffer of |kBufferSize| bytes, a recycled one if possible.
+  static scoped_refptr<net::IOBufferWithSize> Take();
+
+  // Gives back a buffer from |Take|, and resets |buffer|. The buffer is only
+  // recycled if nothing else references it, e.g. a pending socket read.
+  static void Release(scoped_refptr<net::IOBufferWithSize> *buffer);
+
+  static size_t GetPooledCountForTesting();
+
+ private:
+  DISALLOW_IMPLICIT_CONSTRUCTORS(ReceiveBufferPool);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_CHROME_RECEIVE_BUFFER_POOL_H_
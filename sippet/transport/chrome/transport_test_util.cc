@@ -841,6 +841,7 @@ ClientTransaction *MockTransactionFactory::CreateClientTransaction(
       const std::string &transaction_id,
       const scoped_refptr<Channel> &channel,
       TimeDeltaFactory *time_delta_factory,
+      TimerWheel *timer_wheel,
       TransactionDelegate *delegate) {
   MockClientTransaction *client_transaction =
     new MockClientTransaction(data_provider_);
@@ -856,6 +857,7 @@ ServerTransaction *MockTransactionFactory::CreateServerTransaction(
     const std::string &transaction_id,
     const scoped_refptr<Channel> &channel,
     TimeDeltaFactory *time_delta_factory,
+    TimerWheel *timer_wheel,
     TransactionDelegate *delegate) {
   MockServerTransaction *server_transaction =
     new MockServerTransaction(data_provider_);
@@ -377,10 +377,18 @@ class MockChannelFactory : public ChannelFactory {
           const EndPoint &destination,
           Channel::Delegate *delegate,
           scoped_refptr<Channel> *channel) override;
+  void PrefetchHost(const EndPoint &destination) override {
+    prefetched_hosts_.push_back(destination);
+  }
+
+  const std::vector<EndPoint> &prefetched_hosts() const {
+    return prefetched_hosts_;
+  }
 
  private:
   net::ClientSocketFactory *socket_factory_;
   net::BoundNetLog net_log_;
+  std::vector<EndPoint> prefetched_hosts_;
 };
 
 class MockClientTransaction : public ClientTransaction {
@@ -474,12 +482,14 @@ class MockTransactionFactory : public TransactionFactory {
       const std::string &transaction_id,
       const scoped_refptr<Channel> &channel,
       TimeDeltaFactory *time_delta_factory,
+      TimerWheel *timer_wheel,
       TransactionDelegate *delegate) override;
   ServerTransaction *CreateServerTransaction(
       const Method &method,
       const std::string &transaction_id,
       const scoped_refptr<Channel> &channel,
       TimeDeltaFactory *time_delta_factory,
+      TimerWheel *timer_wheel,
       TransactionDelegate *delegate) override;
  private:
   DataProvider *data_provider_;
@@ -0,0 +1,60 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/chrome/write_queue_monitor.h"
+
+#include "base/logging.h"
+#include "sippet/base/memory_accounting.h"
+
+namespace sippet {
+
+WriteQueueMonitor::WriteQueueMonitor()
+  : bytes_(0), messages_(0), congested_(false) {
+}
+
+WriteQueueMonitor::~WriteQueueMonitor() {
+  MemoryAccounting::Add(MemoryAccounting::WRITE_QUEUES,
+                        -static_cast<int64>(bytes_));
+}
+
+void WriteQueueMonitor::SetLimits(const WriteQueueLimits &limits,
+                                  const StateCallback &callback) {
+  limits_ = limits;
+  callback_ = callback;
+}
+
+void WriteQueueMonitor::Queued(size_t bytes) {
+  MemoryAccounting::Add(MemoryAccounting::WRITE_QUEUES, bytes);
+  bytes_ += bytes;
+  ++messages_;
+  if (congested_ || !limits_.IsEnabled())
+    return;
+  if ((limits_.high_water_bytes > 0 && bytes_ >= limits_.high_water_bytes)
+      || (limits_.high_water_messages > 0
+          && messages_ >= limits_.high_water_messages)) {
+    congested_ = true;
+    if (!callback_.is_null())
+      callback_.Run(true);
+  }
+}
+
+void WriteQueueMonitor::Dequeued(size_t bytes) {
+  DCHECK_GE(bytes_, bytes);
+  DCHECK_GT(messages_, 0u);
+  MemoryAccounting::Add(MemoryAccounting::WRITE_QUEUES,
+                        -static_cast<int64>(bytes));
+  bytes_ -= bytes;
+  --messages_;
+  if (!congested_)
+    return;
+  if ((limits_.high_water_bytes == 0 || bytes_ <= limits_.low_water_bytes)
+      && (limits_.high_water_messages == 0
+          || messages_ <= limits_.low_water_messages)) {
+    congested_ = false;
+    if (!callback_.is_null())
+      callback_.Run(false);
+  }
+}
+
+} // End of sippet namespace
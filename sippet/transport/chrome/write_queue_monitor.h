@@ -0,0 +1,66 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_CHROME_WRITE_QUEUE_MONITOR_H_
+#define SIPPET_TRANSPORT_CHROME_WRITE_QUEUE_MONITOR_H_
+
+#include "base/basictypes.h"
+#include "base/callback.h"
+#include "sippet/transport/write_queue_limits.h"
+
+namespace sippet {
+
+// The order messages are written by the socket writers when they queue up.
+// Urgent messages finish or tear down what's already going on: responses,
+// and ACK, CANCEL, BYE, or any other in-dialog request. They are written
+// ahead of the bulk ones, the requests starting something new, so that a
+// congested connection doesn't turn into retransmissions and timeouts of
+// the established calls.
+enum WritePriority {
+  WRITE_PRIORITY_URGENT,
+  WRITE_PRIORITY_BULK,
+};
+
+// Accounts the messages queued by a socket writer against its
+// |WriteQueueLimits|, and reports when it becomes congested and writable
+// again.
+class WriteQueueMonitor {
+ public:
+  // Run with true when the queue reaches a high watermark, and with false
+  // once it drains under the low watermarks.
+  typedef base::Callback<void(bool congested)> StateCallback;
+
+  WriteQueueMonitor();
+  ~WriteQueueMonitor();
+
+  void SetLimits(const WriteQueueLimits &limits,
+                 const StateCallback &callback);
+
+  // Whether a new message may be queued: false when congested and the
+  // limits ask to fail the writes.
+  bool CanQueue() const {
+    return !congested_ || !limits_.fail_when_congested;
+  }
+
+  // Called as a message of |bytes| enters and leaves the queue.
+  void Queued(size_t bytes);
+  void Dequeued(size_t bytes);
+
+  bool congested() const { return congested_; }
+  size_t bytes() const { return bytes_; }
+  size_t messages() const { return messages_; }
+
+ private:
+  WriteQueueLimits limits_;
+  StateCallback callback_;
+  size_t bytes_;
+  size_t messages_;
+  bool congested_;
+
+  DISALLOW_COPY_AND_ASSIGN(WriteQueueMonitor);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_CHROME_WRITE_QUEUE_MONITOR_H_
@@ -0,0 +1,84 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/chrome/write_queue_monitor.h"
+
+#include <vector>
+
+#include "base/bind.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+void RecordState(std::vector<bool> *states, bool congested) {
+  states->push_back(congested);
+}
+
+}  // namespace
+
+TEST(WriteQueueMonitorTest, DisabledByDefault) {
+  WriteQueueMonitor monitor;
+  for (int i = 0; i < 100; ++i)
+    monitor.Queued(1000);
+  EXPECT_FALSE(monitor.congested());
+  EXPECT_TRUE(monitor.CanQueue());
+  EXPECT_EQ(100000u, monitor.bytes());
+  EXPECT_EQ(100u, monitor.messages());
+}
+
+TEST(WriteQueueMonitorTest, ByteWatermarks) {
+  WriteQueueLimits limits;
+  limits.high_water_bytes = 3000;
+  limits.low_water_bytes = 1000;
+  std::vector<bool> states;
+  WriteQueueMonitor monitor;
+  monitor.SetLimits(limits, base::Bind(&RecordState, &states));
+
+  monitor.Queued(1000);
+  monitor.Queued(1000);
+  EXPECT_TRUE(states.empty());
+  monitor.Queued(1000);
+  ASSERT_EQ(1u, states.size());
+  EXPECT_TRUE(states[0]);
+  EXPECT_TRUE(monitor.congested());
+  // Writes are still queued unless asked to fail.
+  EXPECT_TRUE(monitor.CanQueue());
+  monitor.Queued(1000);
+  EXPECT_EQ(1u, states.size());
+
+  monitor.Dequeued(1000);
+  monitor.Dequeued(1000);
+  EXPECT_EQ(1u, states.size());
+  monitor.Dequeued(1000);
+  ASSERT_EQ(2u, states.size());
+  EXPECT_FALSE(states[1]);
+  EXPECT_FALSE(monitor.congested());
+}
+
+TEST(WriteQueueMonitorTest, MessageWatermarksFailFast) {
+  WriteQueueLimits limits;
+  limits.high_water_messages = 2;
+  limits.low_water_messages = 0;
+  limits.fail_when_congested = true;
+  std::vector<bool> states;
+  WriteQueueMonitor monitor;
+  monitor.SetLimits(limits, base::Bind(&RecordState, &states));
+
+  monitor.Queued(10);
+  EXPECT_TRUE(monitor.CanQueue());
+  monitor.Queued(10);
+  EXPECT_TRUE(monitor.congested());
+  EXPECT_FALSE(monitor.CanQueue());
+
+  monitor.Dequeued(10);
+  EXPECT_FALSE(monitor.CanQueue());
+  monitor.Dequeued(10);
+  EXPECT_TRUE(monitor.CanQueue());
+  ASSERT_EQ(2u, states.size());
+  EXPECT_FALSE(states[1]);
+}
+
+} // End of sippet namespace
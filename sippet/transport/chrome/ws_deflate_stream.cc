@@ -0,0 +1,290 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/chrome/ws_deflate_stream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
+#include "base/strings/string_util.h"
+
+namespace sippet {
+
+namespace {
+
+const char kExtensionName[] = "permessage-deflate";
+const char kServerNoContextTakeover[] = "server_no_context_takeover";
+const char kClientNoContextTakeover[] = "client_no_context_takeover";
+const char kServerMaxWindowBits[] = "server_max_window_bits";
+const char kClientMaxWindowBits[] = "client_max_window_bits";
+
+const size_t kChunkSize = 4 * 1024;
+
+// zlib can't deflate with windows smaller than this.
+const int kMinDeflateWindowBits = 9;
+
+// Ends every message flushed with Z_SYNC_FLUSH, and is left out of the
+// frames (RFC 7692 section 7.2.1).
+const char kFlushTrailer[] = { '\x00', '\x00', '\xff', '\xff' };
+
+// Window bits are an integer from 8 to 15, without leading zeros.
+bool ParseWindowBits(const std::string &value, int *bits) {
+  if (value.empty() || value.size() > 2 || '0' == value[0])
+    return false;
+  for (std::string::const_iterator i = value.begin(), ie = value.end();
+       i != ie; ++i) {
+    if (*i < '0' || *i > '9')
+      return false;
+  }
+  base::StringToInt(value, bits);
+  return *bits >= WebSocketDeflateParameters::kMinWindowBits
+      && *bits <= WebSocketDeflateParameters::kMaxWindowBits;
+}
+
+}  // namespace
+
+WebSocketDeflateParameters::WebSocketDeflateParameters()
+  : server_no_context_takeover(false),
+    client_no_context_takeover(false),
+    server_max_window_bits(0),
+    client_max_window_bits(0) {
+}
+
+bool WebSocketDeflateParameters::Parse(const base::StringPiece &extension) {
+  std::vector<std::string> parts;
+  base::SplitString(extension.as_string(), ';', &parts);
+  if (parts.empty() || parts[0] != kExtensionName)
+    return false;
+  *this = WebSocketDeflateParameters();
+  for (size_t i = 1; i < parts.size(); ++i) {
+    std::string name(parts[i]);
+    std::string value;
+    bool has_value = false;
+    size_t equals = name.find('=');
+    if (std::string::npos != equals) {
+      base::TrimWhitespaceASCII(name.substr(equals + 1), base::TRIM_ALL,
+                                &value);
+      base::TrimWhitespaceASCII(name.substr(0, equals), base::TRIM_ALL,
+                                &name);
+      if (value.size() >= 2 && '"' == value[0]
+          && '"' == value[value.size() - 1])
+        value = value.substr(1, value.size() - 2);
+      has_value = true;
+    }
+    if (kServerNoContextTakeover == name) {
+      if (has_value || server_no_context_takeover)
+        return false;
+      server_no_context_takeover = true;
+    } else if (kClientNoContextTakeover == name) {
+      if (has_value || client_no_context_takeover)
+        return false;
+      client_no_context_takeover = true;
+    } else if (kServerMaxWindowBits == name) {
+      if (0 != server_max_window_bits
+          || !ParseWindowBits(value, &server_max_window_bits))
+        return false;
+    } else if (kClientMaxWindowBits == name) {
+      if (0 != client_max_window_bits)
+        return false;
+      if (!has_value)
+        client_max_window_bits = kMaxWindowBits;
+      else if (!ParseWindowBits(value, &client_max_window_bits))
+        return false;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string WebSocketDeflateParameters::ToString() const {
+  std::string extension(kExtensionName);
+  if (server_no_context_takeover)
+    extension.append("; ").append(kServerNoContextTakeover);
+  if (client_no_context_takeover)
+    extension.append("; ").append(kClientNoContextTakeover);
+  if (0 != server_max_window_bits) {
+    extension.append("; ").append(kServerMaxWindowBits).append("=")
+        .append(base::IntToString(server_max_window_bits));
+  }
+  if (0 != client_max_window_bits) {
+    extension.append("; ").append(kClientMaxWindowBits).append("=")
+        .append(base::IntToString(client_max_window_bits));
+  }
+  return extension;
+}
+
+bool WebSocketDeflateParameters::Negotiate(
+    const base::StringPiece &offers,
+    int max_window_bits,
+    WebSocketDeflateParameters *response) {
+  DCHECK(response);
+  DCHECK_LE(kMinDeflateWindowBits, max_window_bits);
+  DCHECK_GE(kMaxWindowBits, max_window_bits);
+  std::vector<std::string> extensions;
+  base::SplitString(offers.as_string(), ',', &extensions);
+  for (std::vector<std::string>::const_iterator i = extensions.begin(),
+       ie = extensions.end(); i != ie; ++i) {
+    WebSocketDeflateParameters offer;
+    if (!offer.Parse(*i))
+      continue;
+    if (0 != offer.server_max_window_bits
+        && offer.server_max_window_bits < kMinDeflateWindowBits) {
+      DVLOG(1) << "Declining a permessage-deflate window of 2^"
+               << offer.server_max_window_bits << " bytes";
+      continue;
+    }
+    *response = offer;
+    // The server may announce a smaller window than offered, so that the
+    // client inflates with less memory.
+    if (0 != offer.server_max_window_bits) {
+      response->server_max_window_bits =
+          std::min(max_window_bits, offer.server_max_window_bits);
+    } else if (max_window_bits < kMaxWindowBits) {
+      response->server_max_window_bits = max_window_bits;
+    }
+    if (0 != offer.client_max_window_bits) {
+      response->client_max_window_bits =
+          std::min(max_window_bits, offer.client_max_window_bits);
+    }
+    return true;
+  }
+  return false;
+}
+
+WebSocketDeflateStream::WebSocketDeflateStream(
+    const WebSocketDeflateParameters &parameters,
+    bool is_server,
+    int mem_level)
+  : deflate_context_takeover_(is_server
+        ? !parameters.server_no_context_takeover
+        : !parameters.client_no_context_takeover),
+    inflate_context_takeover_(is_server
+        ? !parameters.client_no_context_takeover
+        : !parameters.server_no_context_takeover),
+    deflate_window_bits_(is_server
+        ? parameters.server_max_window_bits
+        : parameters.client_max_window_bits),
+    inflate_window_bits_(is_server
+        ? parameters.client_max_window_bits
+        : parameters.server_max_window_bits),
+    mem_level_(mem_level),
+    initialized_(false) {
+  if (0 == deflate_window_bits_)
+    deflate_window_bits_ = WebSocketDeflateParameters::kMaxWindowBits;
+  if (0 == inflate_window_bits_)
+    inflate_window_bits_ = WebSocketDeflateParameters::kMaxWindowBits;
+  memset(&deflate_, 0, sizeof(deflate_));
+  memset(&inflate_, 0, sizeof(inflate_));
+}
+
+WebSocketDeflateStream::~WebSocketDeflateStream() {
+  if (initialized_) {
+    deflateEnd(&deflate_);
+    inflateEnd(&inflate_);
+  }
+}
+
+bool WebSocketDeflateStream::Init() {
+  DCHECK(!initialized_);
+  // Negative window bits make raw deflate streams, without zlib headers.
+  if (deflate_window_bits_ < kMinDeflateWindowBits
+      || Z_OK != deflateInit2(&deflate_, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                              -deflate_window_bits_, mem_level_,
+                              Z_DEFAULT_STRATEGY))
+    return false;
+  if (Z_OK != inflateInit2(&inflate_, -inflate_window_bits_)) {
+    deflateEnd(&deflate_);
+    return false;
+  }
+  initialized_ = true;
+  return true;
+}
+
+bool WebSocketDeflateStream::Compress(const base::StringPiece &head,
+                                      const base::StringPiece &content,
+                                      std::string *payload) {
+  DCHECK(initialized_);
+  DCHECK(payload);
+  payload->clear();
+  if (!Deflate(head, Z_NO_FLUSH, payload)
+      || !Deflate(content, Z_SYNC_FLUSH, payload))
+    return false;
+  DCHECK_LE(sizeof(kFlushTrailer), payload->size());
+  DCHECK_EQ(0, memcmp(payload->data() + payload->size()
+      - sizeof(kFlushTrailer), kFlushTrailer, sizeof(kFlushTrailer)));
+  payload->resize(payload->size() - sizeof(kFlushTrailer));
+  if (!deflate_context_takeover_)
+    deflateReset(&deflate_);
+  return true;
+}
+
+bool WebSocketDeflateStream::Decompress(const base::StringPiece &payload,
+                                        size_t max_size,
+                                        std::string *message) {
+  DCHECK(initialized_);
+  DCHECK(message);
+  message->clear();
+  bool decompressed = Inflate(payload, max_size, message)
+      && Inflate(base::StringPiece(kFlushTrailer, sizeof(kFlushTrailer)),
+                 max_size, message);
+  // A context left in the middle of a message can't be used anymore.
+  if (!decompressed || !inflate_context_takeover_)
+    inflateReset(&inflate_);
+  return decompressed;
+}
+
+bool WebSocketDeflateStream::Deflate(const base::StringPiece &input,
+                                     int flush,
+                                     std::string *output) {
+  deflate_.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+  deflate_.avail_in = static_cast<uInt>(input.size());
+  do {
+    size_t size = output->size();
+    output->resize(size + kChunkSize);
+    deflate_.next_out = reinterpret_cast<Bytef*>(&(*output)[size]);
+    deflate_.avail_out = static_cast<uInt>(kChunkSize);
+    int result = deflate(&deflate_, flush);
+    output->resize(size + kChunkSize - deflate_.avail_out);
+    // Z_BUF_ERROR only tells that there was nothing left to do.
+    if (Z_OK != result && Z_BUF_ERROR != result)
+      return false;
+  } while (0 != deflate_.avail_in || 0 == deflate_.avail_out);
+  return true;
+}
+
+bool WebSocketDeflateStream::Inflate(const base::StringPiece &input,
+                                     size_t max_size,
+                                     std::string *output) {
+  inflate_.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+  inflate_.avail_in = static_cast<uInt>(input.size());
+  do {
+    size_t size = output->size();
+    // Once at |max_size|, one byte more is let out, to tell whether there's
+    // anything left of the message.
+    size_t chunk = size < max_size ? std::min(kChunkSize, max_size - size) : 1;
+    output->resize(size + chunk);
+    inflate_.next_out = reinterpret_cast<Bytef*>(&(*output)[size]);
+    inflate_.avail_out = static_cast<uInt>(chunk);
+    int result = inflate(&inflate_, Z_SYNC_FLUSH);
+    output->resize(size + chunk - inflate_.avail_out);
+    if (max_size < output->size())
+      return false;
+    // Senders may end a message with a final block, which resets their
+    // context as well.
+    if (Z_STREAM_END == result)
+      result = inflateReset(&inflate_);
+    if (Z_OK != result && Z_BUF_ERROR != result)
+      return false;
+  } while (0 != inflate_.avail_in || 0 == inflate_.avail_out);
+  return true;
+}
+
+}  // namespace sippet
@@ -0,0 +1,110 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_CHROME_WS_DEFLATE_STREAM_H_
+#define SIPPET_TRANSPORT_CHROME_WS_DEFLATE_STREAM_H_
+
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/strings/string_piece.h"
+#include "third_party/zlib/zlib.h"
+
+namespace sippet {
+
+// Parameters of the permessage-deflate extension (RFC 7692), as offered in,
+// or answering, a Sec-WebSocket-Extensions header.
+struct WebSocketDeflateParameters {
+  // Window sizes, as base-2 logarithms of their bytes.
+  static const int kMinWindowBits = 8;
+  static const int kMaxWindowBits = 15;
+
+  WebSocketDeflateParameters();
+
+  // Parses one extension of a Sec-WebSocket-Extensions list. Returns false
+  // if it isn't permessage-deflate, or has unknown, repeated or malformed
+  // parameters. A client_max_window_bits offered without a value is taken
+  // as |kMaxWindowBits|.
+  bool Parse(const base::StringPiece &extension);
+
+  // The extension, as written in a Sec-WebSocket-Extensions header.
+  std::string ToString() const;
+
+  // Picks the first offer of |offers|, the Sec-WebSocket-Extensions of a
+  // client, that a server can accept, bounding both windows to
+  // |max_window_bits|; the client window stays at |kMaxWindowBits| if it
+  // isn't offered to be bound. Returns false if there's none.
+  static bool Negotiate(const base::StringPiece &offers,
+                        int max_window_bits,
+                        WebSocketDeflateParameters *response);
+
+  bool server_no_context_takeover;
+  bool client_no_context_takeover;
+  // Zero if absent.
+  int server_max_window_bits;
+  int client_max_window_bits;
+};
+
+// Compresses the messages sent, and decompresses the ones received, over a
+// WebSocket connection that negotiated permessage-deflate. SIP messages
+// repeat most of their headers, so the compression contexts are kept from
+// one message to the next, unless the parameters say otherwise.
+//
+// Each stream keeps a deflate and an inflate context: their memory is
+// about 2^(w+2) + 2^(m+9) bytes for deflating with a window of 2^w bytes
+// and a |mem_level| of m, plus 2^w bytes for inflating.
+class WebSocketDeflateStream {
+ public:
+  // Default window bound of the connections accepted.
+  static const int kDefaultMaxWindowBits = 13;
+
+  // Default zlib memory level of the deflate context, from 1 to 9.
+  static const int kDefaultMemLevel = 6;
+
+  // |is_server| tells which side of the |parameters| applies to the
+  // messages sent.
+  WebSocketDeflateStream(const WebSocketDeflateParameters &parameters,
+                         bool is_server,
+                         int mem_level);
+  ~WebSocketDeflateStream();
+
+  // Sets up the contexts. Returns false if zlib refuses the parameters,
+  // e.g. a deflate window of 2^8 bytes.
+  bool Init();
+
+  // Compresses a message, given in two parts so that they aren't joined
+  // first, into the |payload| of a frame with RSV1 set.
+  bool Compress(const base::StringPiece &head,
+                const base::StringPiece &content,
+                std::string *payload);
+
+  // Decompresses the |payload| of a frame with RSV1 set. Fails if it's
+  // malformed, or if the message would exceed |max_size|.
+  bool Decompress(const base::StringPiece &payload,
+                  size_t max_size,
+                  std::string *message);
+
+ private:
+  bool Deflate(const base::StringPiece &input,
+               int flush,
+               std::string *output);
+  bool Inflate(const base::StringPiece &input,
+               size_t max_size,
+               std::string *output);
+
+  bool deflate_context_takeover_;
+  bool inflate_context_takeover_;
+  int deflate_window_bits_;
+  int inflate_window_bits_;
+  int mem_level_;
+  bool initialized_;
+  z_stream deflate_;
+  z_stream inflate_;
+
+  DISALLOW_COPY_AND_ASSIGN(WebSocketDeflateStream);
+};
+
+} // namespace sippet
+
+#endif // SIPPET_TRANSPORT_CHROME_WS_DEFLATE_STREAM_H_
@@ -0,0 +1,173 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/chrome/ws_deflate_stream.h"
+
+#include <string.h>
+
+#include <string>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const char kHead[] =
+  "MESSAGE sip:carol@chicago.com SIP/2.0\r\n"
+  "Via: SIP/2.0/WS df7jal23ls0d.invalid;branch=z9hG4bK56sdasks\r\n"
+  "Max-Forwards: 70\r\n"
+  "To: <sip:carol@chicago.com>\r\n"
+  "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+  "Call-ID: a84b4c76e66710\r\n"
+  "CSeq: 1 MESSAGE\r\n"
+  "User-Agent: Sippet/1.0\r\n"
+  "Content-Length: 5\r\n"
+  "\r\n";
+const char kContent[] = "hello";
+
+const size_t kMaxSize = 64 * 1024;
+
+WebSocketDeflateParameters Negotiate(const char *offers) {
+  WebSocketDeflateParameters response;
+  EXPECT_TRUE(WebSocketDeflateParameters::Negotiate(offers,
+      WebSocketDeflateStream::kDefaultMaxWindowBits, &response)) << offers;
+  return response;
+}
+
+}  // namespace
+
+TEST(WebSocketDeflateStreamTest, Negotiate) {
+  // As offered by browsers.
+  EXPECT_EQ("permessage-deflate; server_max_window_bits=13; "
+            "client_max_window_bits=13",
+            Negotiate("permessage-deflate; client_max_window_bits")
+                .ToString());
+  EXPECT_EQ("permessage-deflate; client_no_context_takeover; "
+            "server_max_window_bits=10",
+            Negotiate("permessage-deflate; server_max_window_bits=\"10\"; "
+                      "client_no_context_takeover").ToString());
+  EXPECT_EQ("permessage-deflate; server_max_window_bits=9",
+            Negotiate("permessage-deflate; server_max_window_bits=8, "
+                      "permessage-deflate; server_max_window_bits=9")
+                .ToString());
+
+  const char *declined[] = {
+    "",
+    "x-webkit-deflate-frame",
+    "permessage-deflate; server_max_window_bits=8",
+    "permessage-deflate; server_max_window_bits",
+    "permessage-deflate; server_max_window_bits=08",
+    "permessage-deflate; client_max_window_bits=16",
+    "permessage-deflate; server_no_context_takeover; "
+        "server_no_context_takeover",
+    "permessage-deflate; client_no_context_takeover=1",
+    "permessage-deflate; unknown",
+  };
+  for (size_t i = 0; i < arraysize(declined); ++i) {
+    WebSocketDeflateParameters response;
+    EXPECT_FALSE(WebSocketDeflateParameters::Negotiate(declined[i],
+        WebSocketDeflateStream::kDefaultMaxWindowBits, &response))
+        << declined[i];
+  }
+}
+
+TEST(WebSocketDeflateStreamTest, ContextTakeover) {
+  WebSocketDeflateParameters parameters(
+      Negotiate("permessage-deflate; client_max_window_bits"));
+  WebSocketDeflateStream server(parameters, true,
+                                WebSocketDeflateStream::kDefaultMemLevel);
+  WebSocketDeflateStream client(parameters, false,
+                                WebSocketDeflateStream::kDefaultMemLevel);
+  ASSERT_TRUE(server.Init());
+  ASSERT_TRUE(client.Init());
+
+  std::string first, second, message;
+  ASSERT_TRUE(server.Compress(kHead, kContent, &first));
+  ASSERT_TRUE(server.Compress(kHead, kContent, &second));
+  // The second message refers back to the first.
+  EXPECT_LT(second.size() * 4, first.size());
+  ASSERT_TRUE(client.Decompress(first, kMaxSize, &message));
+  EXPECT_EQ(std::string(kHead) + kContent, message);
+  ASSERT_TRUE(client.Decompress(second, kMaxSize, &message));
+  EXPECT_EQ(std::string(kHead) + kContent, message);
+
+  // And the other way around.
+  ASSERT_TRUE(client.Compress(kHead, kContent, &first));
+  ASSERT_TRUE(server.Decompress(first, kMaxSize, &message));
+  EXPECT_EQ(std::string(kHead) + kContent, message);
+}
+
+TEST(WebSocketDeflateStreamTest, NoContextTakeover) {
+  WebSocketDeflateParameters parameters(
+      Negotiate("permessage-deflate; server_no_context_takeover"));
+  WebSocketDeflateStream server(parameters, true,
+                                WebSocketDeflateStream::kDefaultMemLevel);
+  WebSocketDeflateStream client(parameters, false,
+                                WebSocketDeflateStream::kDefaultMemLevel);
+  ASSERT_TRUE(server.Init());
+  ASSERT_TRUE(client.Init());
+
+  std::string first, second, message;
+  ASSERT_TRUE(server.Compress(kHead, kContent, &first));
+  ASSERT_TRUE(server.Compress(kHead, kContent, &second));
+  EXPECT_EQ(first, second);
+  ASSERT_TRUE(client.Decompress(second, kMaxSize, &message));
+  EXPECT_EQ(std::string(kHead) + kContent, message);
+}
+
+TEST(WebSocketDeflateStreamTest, Decompress) {
+  WebSocketDeflateParameters parameters;
+  WebSocketDeflateStream stream(parameters, true,
+                                WebSocketDeflateStream::kDefaultMemLevel);
+  ASSERT_TRUE(stream.Init());
+
+  // RFC 7692 section 7.2.3.1.
+  const char hello[] = { '\xf2', '\x48', '\xcd', '\xc9', '\xc9', '\x07',
+                         '\x00' };
+  std::string message;
+  ASSERT_TRUE(stream.Decompress(base::StringPiece(hello, sizeof(hello)),
+                                kMaxSize, &message));
+  EXPECT_EQ("Hello", message);
+
+  // Section 7.2.3.2 sends the same message again with the same context.
+  const char hello_again[] = { '\xf2', '\x00', '\x11', '\x00', '\x00' };
+  ASSERT_TRUE(stream.Decompress(
+      base::StringPiece(hello_again, sizeof(hello_again)), kMaxSize,
+      &message));
+  EXPECT_EQ("Hello", message);
+
+  EXPECT_FALSE(stream.Decompress(base::StringPiece(hello, sizeof(hello)),
+                                 4, &message));
+  EXPECT_FALSE(stream.Decompress("\xff\xff\xff", kMaxSize, &message));
+}
+
+TEST(WebSocketDeflateStreamTest, DecompressUpToMaxSize) {
+  // The client drops its context when a message is too big, so the server
+  // must not refer back to it.
+  WebSocketDeflateParameters parameters(
+      Negotiate("permessage-deflate; server_no_context_takeover"));
+  WebSocketDeflateStream server(parameters, true,
+                                WebSocketDeflateStream::kDefaultMemLevel);
+  WebSocketDeflateStream client(parameters, false,
+                                WebSocketDeflateStream::kDefaultMemLevel);
+  ASSERT_TRUE(server.Init());
+  ASSERT_TRUE(client.Init());
+
+  // A message of exactly the maximum size, spanning several chunks.
+  std::string content(kMaxSize - strlen(kHead), 'a');
+  std::string payload, message;
+  ASSERT_TRUE(server.Compress(kHead, content, &payload));
+  ASSERT_TRUE(client.Decompress(payload, kMaxSize, &message));
+  EXPECT_EQ(std::string(kHead) + content, message);
+  EXPECT_FALSE(client.Decompress(payload, kMaxSize - 1, &message));
+
+  // And a short one.
+  ASSERT_TRUE(server.Compress(kHead, kContent, &payload));
+  ASSERT_TRUE(client.Decompress(payload, strlen(kHead) + strlen(kContent),
+                                &message));
+  EXPECT_EQ(std::string(kHead) + kContent, message);
+}
+
+}  // namespace sippet
@@ -0,0 +1,170 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/chrome/ws_frame_io_buffer.h"
+
+#include <cstring>
+#include <limits>
+#include <string>
+
+#include "base/big_endian.h"
+#include "base/logging.h"
+#include "net/base/net_errors.h"
+#include "sippet/message/message.h"
+#include "sippet/transport/chrome/ws_deflate_stream.h"
+
+namespace sippet {
+
+namespace {
+
+const uint8 kFinalBit = 0x80;
+const uint8 kReservedBits = 0x70;
+const uint8 kReserved1Bit = 0x40;
+const uint8 kOpCodeMask = 0x0F;
+const uint8 kMaskBit = 0x80;
+const uint8 kPayloadLengthMask = 0x7F;
+const uint8 kPayloadLength16 = 126;
+const uint8 kPayloadLength64 = 127;
+
+}  // namespace
+
+scoped_refptr<net::IOBufferWithSize> SerializeWebSocketFrame(
+    const Message &message,
+    const net::WebSocketMaskingKey *masking_key) {
+  const std::string &head = message.SerializedHead();
+  const std::string &content = message.content();
+  size_t payload_size = head.size() + content.size();
+
+  net::WebSocketFrameHeader header(net::WebSocketFrameHeader::kOpCodeText);
+  header.final = true;
+  header.masked = masking_key != nullptr;
+  header.payload_length = payload_size;
+  int header_size = net::GetWebSocketFrameHeaderSize(header);
+
+  scoped_refptr<net::IOBufferWithSize> buffer(new net::IOBufferWithSize(
+      header_size + static_cast<int>(payload_size)));
+  int written = net::WriteWebSocketFrameHeader(header, masking_key,
+      buffer->data(), header_size);
+  DCHECK_EQ(header_size, written);
+  char *payload = buffer->data() + header_size;
+  memcpy(payload, head.data(), head.size());
+  if (!content.empty())
+    memcpy(payload + head.size(), content.data(), content.size());
+  if (masking_key) {
+    net::MaskWebSocketFramePayload(*masking_key, 0, payload,
+        static_cast<int>(payload_size));
+  }
+  return buffer;
+}
+
+scoped_refptr<net::IOBufferWithSize> SerializeCompressedWebSocketFrame(
+    const Message &message,
+    const net::WebSocketMaskingKey *masking_key,
+    WebSocketDeflateStream *deflate_stream) {
+  DCHECK(deflate_stream);
+  std::string compressed;
+  if (!deflate_stream->Compress(message.SerializedHead(), message.content(),
+                                &compressed))
+    return nullptr;
+
+  net::WebSocketFrameHeader header(net::WebSocketFrameHeader::kOpCodeText);
+  header.final = true;
+  header.reserved1 = true;
+  header.masked = masking_key != nullptr;
+  header.payload_length = compressed.size();
+  int header_size = net::GetWebSocketFrameHeaderSize(header);
+
+  scoped_refptr<net::IOBufferWithSize> buffer(new net::IOBufferWithSize(
+      header_size + static_cast<int>(compressed.size())));
+  int written = net::WriteWebSocketFrameHeader(header, masking_key,
+      buffer->data(), header_size);
+  DCHECK_EQ(header_size, written);
+  char *payload = buffer->data() + header_size;
+  if (!compressed.empty())
+    memcpy(payload, compressed.data(), compressed.size());
+  if (masking_key) {
+    net::MaskWebSocketFramePayload(*masking_key, 0, payload,
+        static_cast<int>(compressed.size()));
+  }
+  return buffer;
+}
+
+int DecodeWebSocketFrame(char *data,
+                         int size,
+                         net::WebSocketFrameHeader::OpCode *opcode,
+                         base::StringPiece *payload) {
+  return DecodeWebSocketFrame(data, size, opcode, nullptr, payload);
+}
+
+int DecodeWebSocketFrame(char *data,
+                         int size,
+                         net::WebSocketFrameHeader::OpCode *opcode,
+                         bool *compressed,
+                         base::StringPiece *payload) {
+  DCHECK(data);
+  DCHECK(opcode);
+  DCHECK(payload);
+  if (size < 2)
+    return 0;
+  uint8 first_byte = static_cast<uint8>(data[0]);
+  uint8 second_byte = static_cast<uint8>(data[1]);
+  // RSV1 is only set by permessage-deflate, on data frames.
+  uint8 reserved_bits = first_byte & kReservedBits;
+  if (compressed && kReserved1Bit == reserved_bits
+      && net::WebSocketFrameHeader::IsKnownDataOpCode(
+          first_byte & kOpCodeMask))
+    reserved_bits = 0;
+  if (reserved_bits != 0)
+    return net::ERR_WS_PROTOCOL_ERROR;
+  if ((first_byte & kFinalBit) == 0) {
+    DVLOG(1) << "Fragmented WebSocket messages aren't supported";
+    return net::ERR_WS_PROTOCOL_ERROR;
+  }
+
+  int offset = 2;
+  uint64 payload_length = second_byte & kPayloadLengthMask;
+  if (payload_length == kPayloadLength16) {
+    if (size < offset + 2)
+      return 0;
+    uint16 length16;
+    base::ReadBigEndian(data + offset, &length16);
+    payload_length = length16;
+    offset += 2;
+  } else if (payload_length == kPayloadLength64) {
+    if (size < offset + 8)
+      return 0;
+    base::ReadBigEndian(data + offset, &payload_length);
+    offset += 8;
+  }
+  if (payload_length > static_cast<uint64>(std::numeric_limits<int>::max()
+                                           - offset - 4))
+    return net::ERR_MSG_TOO_BIG;
+
+  net::WebSocketMaskingKey masking_key;
+  bool masked = (second_byte & kMaskBit) != 0;
+  if (masked) {
+    if (size < offset + net::WebSocketFrameHeader::kMaskingKeyLength)
+      return 0;
+    memcpy(masking_key.key, data + offset,
+           net::WebSocketFrameHeader::kMaskingKeyLength);
+    offset += net::WebSocketFrameHeader::kMaskingKeyLength;
+  }
+
+  int frame_size = offset + static_cast<int>(payload_length);
+  if (size < frame_size)
+    return 0;
+  char *frame_payload = data + offset;
+  if (masked) {
+    net::MaskWebSocketFramePayload(masking_key, 0, frame_payload,
+        static_cast<int>(payload_length));
+  }
+  *opcode = first_byte & kOpCodeMask;
+  if (compressed)
+    *compressed = (first_byte & kReserved1Bit) != 0;
+  *payload = base::StringPiece(frame_payload,
+                               static_cast<size_t>(payload_length));
+  return frame_size;
+}
+
+}  // namespace sippet
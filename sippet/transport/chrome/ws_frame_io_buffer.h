@@ -0,0 +1,55 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_CHROME_WS_FRAME_IO_BUFFER_H_
+#define SIPPET_TRANSPORT_CHROME_WS_FRAME_IO_BUFFER_H_
+
+#include "base/strings/string_piece.h"
+#include "net/base/io_buffer.h"
+#include "net/websockets/websocket_frame.h"
+
+namespace sippet {
+
+class Message;
+class WebSocketDeflateStream;
+
+// Serializes |message| into a single WebSocket text frame (RFC 7118). The
+// frame header size is known in advance, so the message is written straight
+// into the frame payload, and masked there, instead of being serialized and
+// then copied into a frame. |masking_key| is required for frames sent by
+// clients, and must be null for the ones sent by servers.
+scoped_refptr<net::IOBufferWithSize> SerializeWebSocketFrame(
+    const Message &message,
+    const net::WebSocketMaskingKey *masking_key);
+
+// Serializes |message| into a single text frame compressed by
+// |deflate_stream| (RFC 7692), with RSV1 set. The message is compressed
+// first, and then copied into the frame. Returns NULL if compression fails.
+scoped_refptr<net::IOBufferWithSize> SerializeCompressedWebSocketFrame(
+    const Message &message,
+    const net::WebSocketMaskingKey *masking_key,
+    WebSocketDeflateStream *deflate_stream);
+
+// Decodes the WebSocket frame at the start of |data|, unmasking its payload
+// in place, so that the message can be parsed from |payload|, which points
+// into |data|. Returns the size of the frame, zero if |data| doesn't hold a
+// complete frame yet, or a network error. Fragmented messages aren't
+// accepted, as SIP messages are sent in a single frame.
+int DecodeWebSocketFrame(char *data,
+                         int size,
+                         net::WebSocketFrameHeader::OpCode *opcode,
+                         base::StringPiece *payload);
+
+// As above, on connections that negotiated permessage-deflate: frames of
+// compressed messages, with RSV1 set, are accepted too, and |compressed| is
+// set for them, so that |payload| is decompressed before being parsed.
+int DecodeWebSocketFrame(char *data,
+                         int size,
+                         net::WebSocketFrameHeader::OpCode *opcode,
+                         bool *compressed,
+                         base::StringPiece *payload);
+
+} // namespace sippet
+
+#endif // SIPPET_TRANSPORT_CHROME_WS_FRAME_IO_BUFFER_H_
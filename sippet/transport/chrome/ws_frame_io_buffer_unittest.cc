@@ -0,0 +1,136 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/chrome/ws_frame_io_buffer.h"
+
+#include <string>
+
+#include "net/base/net_errors.h"
+#include "sippet/message/content_coding.h"
+#include "sippet/message/message.h"
+#include "sippet/transport/chrome/ws_deflate_stream.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const char kMessageRequest[] =
+  "MESSAGE sip:carol@chicago.com SIP/2.0\r\n"
+  "Via: SIP/2.0/WS df7jal23ls0d.invalid;branch=z9hG4bK56sdasks\r\n"
+  "Max-Forwards: 70\r\n"
+  "To: <sip:carol@chicago.com>\r\n"
+  "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+  "Call-ID: a84b4c76e66710\r\n"
+  "CSeq: 1 MESSAGE\r\n"
+  "Content-Length: 5\r\n"
+  "\r\n";
+
+scoped_refptr<Message> CreateMessage() {
+  scoped_refptr<Message> message(Message::Parse(kMessageRequest));
+  if (message)
+    message->set_content("hello");
+  return message;
+}
+
+std::string Serialize(const scoped_refptr<Message> &message) {
+  return message->SerializedHead() + message->content();
+}
+
+}  // namespace
+
+TEST(WebSocketFrameTest, MaskedRoundTrip) {
+  scoped_refptr<Message> message(CreateMessage());
+  ASSERT_TRUE(message);
+  net::WebSocketMaskingKey masking_key = {{'\x12', '\x34', '\x56', '\x78'}};
+  scoped_refptr<net::IOBufferWithSize> frame(
+      SerializeWebSocketFrame(*message, &masking_key));
+  std::string expected(Serialize(message));
+  // 2 bytes, a 16-bit length and the masking key.
+  ASSERT_EQ(static_cast<int>(8 + expected.size()), frame->size());
+  EXPECT_NE(expected, std::string(frame->data() + 8, expected.size()));
+
+  // Incomplete frames are left for later.
+  net::WebSocketFrameHeader::OpCode opcode;
+  base::StringPiece payload;
+  EXPECT_EQ(0, DecodeWebSocketFrame(frame->data(), 1, &opcode, &payload));
+  EXPECT_EQ(0, DecodeWebSocketFrame(frame->data(), frame->size() - 1,
+                                    &opcode, &payload));
+
+  EXPECT_EQ(frame->size(), DecodeWebSocketFrame(frame->data(), frame->size(),
+                                                &opcode, &payload));
+  EXPECT_EQ(net::WebSocketFrameHeader::kOpCodeText, opcode);
+  // Unmasked in place.
+  EXPECT_EQ(frame->data() + 8, payload.data());
+  EXPECT_EQ(expected, payload.as_string());
+  EXPECT_TRUE(Message::Parse(payload));
+}
+
+TEST(WebSocketFrameTest, Unmasked) {
+  scoped_refptr<Message> message(CreateMessage());
+  ASSERT_TRUE(message);
+  scoped_refptr<net::IOBufferWithSize> frame(
+      SerializeWebSocketFrame(*message, nullptr));
+  std::string expected(Serialize(message));
+  ASSERT_EQ(static_cast<int>(4 + expected.size()), frame->size());
+  EXPECT_EQ(expected, std::string(frame->data() + 4, expected.size()));
+
+  net::WebSocketFrameHeader::OpCode opcode;
+  base::StringPiece payload;
+  EXPECT_EQ(frame->size(), DecodeWebSocketFrame(frame->data(), frame->size(),
+                                                &opcode, &payload));
+  EXPECT_EQ(expected, payload.as_string());
+}
+
+TEST(WebSocketFrameTest, Compressed) {
+  scoped_refptr<Message> message(CreateMessage());
+  ASSERT_TRUE(message);
+  WebSocketDeflateParameters parameters;
+  WebSocketDeflateStream server(parameters, true,
+                                WebSocketDeflateStream::kDefaultMemLevel);
+  WebSocketDeflateStream client(parameters, false,
+                                WebSocketDeflateStream::kDefaultMemLevel);
+  ASSERT_TRUE(server.Init());
+  ASSERT_TRUE(client.Init());
+  net::WebSocketMaskingKey masking_key = {{'\x12', '\x34', '\x56', '\x78'}};
+  scoped_refptr<net::IOBufferWithSize> frame(
+      SerializeCompressedWebSocketFrame(*message, &masking_key, &client));
+  ASSERT_TRUE(frame);
+  std::string expected(Serialize(message));
+  EXPECT_GT(static_cast<int>(expected.size()), frame->size());
+
+  // Rejected unless permessage-deflate was negotiated.
+  net::WebSocketFrameHeader::OpCode opcode;
+  base::StringPiece payload;
+  EXPECT_EQ(net::ERR_WS_PROTOCOL_ERROR,
+            DecodeWebSocketFrame(frame->data(), frame->size(), &opcode,
+                                 &payload));
+
+  bool compressed = false;
+  EXPECT_EQ(frame->size(), DecodeWebSocketFrame(frame->data(), frame->size(),
+                                                &opcode, &compressed,
+                                                &payload));
+  EXPECT_EQ(net::WebSocketFrameHeader::kOpCodeText, opcode);
+  EXPECT_TRUE(compressed);
+  std::string decompressed;
+  ASSERT_TRUE(server.Decompress(payload, kMaxDecodedContentSize,
+                                &decompressed));
+  EXPECT_EQ(expected, decompressed);
+
+  // Control frames can't be compressed.
+  char ping[] = { '\xc9', '\x00' };
+  EXPECT_EQ(net::ERR_WS_PROTOCOL_ERROR,
+            DecodeWebSocketFrame(ping, sizeof(ping), &opcode, &compressed,
+                                 &payload));
+}
+
+TEST(WebSocketFrameTest, RejectsFragments) {
+  char frame[] = { '\x01', '\x02', 'h', 'i' };  // Not final
+  net::WebSocketFrameHeader::OpCode opcode;
+  base::StringPiece payload;
+  EXPECT_EQ(net::ERR_WS_PROTOCOL_ERROR,
+            DecodeWebSocketFrame(frame, sizeof(frame), &opcode, &payload));
+}
+
+}  // namespace sippet
@@ -9,6 +9,7 @@
 #include "base/memory/ref_counted.h"
 #include "sippet/message/message.h"
 #include "sippet/transport/channel.h"
+#include "sippet/transport/transport_log.h"
 
 namespace sippet {
 
@@ -22,6 +23,10 @@ class ClientTransaction :
   virtual const std::string& id() const = 0;
   virtual scoped_refptr<Channel> channel() const = 0;
 
+  // Traces the transaction in |net_log|. It's called before |Start|, and
+  // only for the transactions sampled.
+  virtual void SetNetLog(const BoundTransportLog &net_log) {}
+
   virtual void Start(const scoped_refptr<Request> &outgoing_request) = 0;
 
   virtual void HandleIncomingResponse(
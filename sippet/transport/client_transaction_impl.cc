@@ -4,27 +4,58 @@
 
 #include "sippet/transport/client_transaction_impl.h"
 
+#include <cmath>
 #include <string>
 
+#include "base/trace_event/trace_event.h"
 #include "net/base/net_errors.h"
+#include "sippet/message/headers/timestamp.h"
+#include "sippet/transport/transaction_slab.h"
+#include "sippet/transport/transport_stats.h"
 
 namespace sippet {
 
+namespace {
+
+// Timestamps are echoed as printed, so they may lose some precision.
+const double kTimestampTolerance = 1e-3;
+
+}  // namespace
+
 ClientTransactionImpl::ClientTransactionImpl(
                           const std::string &id,
                           const scoped_refptr<Channel> &channel,
                           TransactionDelegate *delegate,
-                          TimeDeltaFactory *time_delta_factory)
+                          TimeDeltaFactory *time_delta_factory,
+                          TimerWheel *timer_wheel,
+                          const TransactionTimerPolicy &timer_policy)
   : weak_factory_(this),
     id_(id), channel_(channel), delegate_(delegate),
+    timer_policy_(timer_policy),
+    started_(false),
+    retransmitTimer_(timer_wheel), timedOutTimer_(timer_wheel),
+    timer_wheel_(timer_wheel),
+    retransmitted_(false),
     time_delta_factory_(time_delta_factory) {
   DCHECK(id.length());
   DCHECK(channel);
   DCHECK(delegate);
   DCHECK(time_delta_factory);
+  DCHECK(timer_wheel);
 }
 
-ClientTransactionImpl::~ClientTransactionImpl() {}
+ClientTransactionImpl::~ClientTransactionImpl() {
+  if (started_)
+    TransportStats::AddTransaction(TransportStats::CLIENT, method_, -1);
+}
+
+void *ClientTransactionImpl::operator new(size_t size) {
+  return TransactionSlab<ClientTransactionImpl>::New(size);
+}
+
+void ClientTransactionImpl::operator delete(void *p, size_t size) {
+  TransactionSlab<ClientTransactionImpl>::Delete(p, size);
+}
 
 const std::string& ClientTransactionImpl::id() const {
   return id_;
@@ -34,33 +65,65 @@ scoped_refptr<Channel> ClientTransactionImpl::channel() const {
   return channel_;
 }
 
+void ClientTransactionImpl::SetNetLog(const BoundTransportLog &net_log) {
+  net_log_ = net_log;
+}
+
 void ClientTransactionImpl::Start(
       const scoped_refptr<Request> &outgoing_request) {
   DCHECK(outgoing_request);
+  if (net_log_.IsCapturing()) {
+    net_log_.BeginEvent(TransportLog::TYPE_TRANSACTION_ALIVE,
+        TransportLog::StringPairCallback("id", id_,
+            "method", outgoing_request->method().str()));
+  }
+  LogMessage(TransportLog::TYPE_SIP_MESSAGE_SENT, outgoing_request);
 
   initial_request_ = outgoing_request;
+  method_ = outgoing_request->method();
+  started_ = true;
+  start_time_ = timer_wheel_->NowTicks();
+  retransmit_task_ = base::Bind(&ClientTransactionImpl::OnRetransmit,
+      weak_factory_.GetWeakPtr());
+  write_callback_ = base::Bind(&ClientTransactionImpl::OnWrite,
+      weak_factory_.GetWeakPtr());
+  TransportStats::AddTransaction(TransportStats::CLIENT,
+      outgoing_request->method(), 1);
   if (Method::INVITE == outgoing_request->method()) {
     mode_ = MODE_INVITE;
     next_state_ = STATE_CALLING;
-    time_delta_provider_.reset(time_delta_factory_->CreateClientInvite());
+    time_delta_provider_.reset(time_delta_factory_->CreateClientInvite(
+        channel_->destination()));
   } else {
     mode_ = MODE_NORMAL;
     next_state_ = STATE_TRYING;
-    time_delta_provider_.reset(time_delta_factory_->CreateClientNonInvite());
+    time_delta_provider_.reset(time_delta_factory_->CreateClientNonInvite(
+        channel_->destination()));
   }
 
-  if (!channel_->is_stream())
+  if (timer_policy_.retransmit)
     ScheduleRetry();
   ScheduleTimeout();
 }
 
 void ClientTransactionImpl::HandleIncomingResponse(
       const scoped_refptr<Response> &response) {
+  TRACE_EVENT0("sippet", "ClientTransactionImpl::HandleIncomingResponse");
+  TRACE_EVENT_FLOW_STEP0("sippet", "IncomingMessage", response.get(),
+                         "ClientTransaction");
   DCHECK(response);
   DCHECK(next_state_ != STATE_TERMINATED);
 
   State state = next_state_;
   int response_code = response->response_code();
+  LogMessage(TransportLog::TYPE_SIP_MESSAGE_RECEIVED, response);
+
+  if (STATE_CALLING == state || STATE_TRYING == state)
+    ReportRoundTrip(response);
+  if (STATE_COMPLETED != state && response_code >= 200) {
+    TransportStats::RecordLatency(TransportStats::CLIENT,
+        timer_wheel_->NowTicks() - start_time_);
+  }
 
   switch (state) {
     case STATE_TRYING:
@@ -102,11 +165,15 @@ void ClientTransactionImpl::HandleIncomingResponse(
 
   if (mode_ == MODE_INVITE) {
     if (next_state_ != STATE_CALLING)
-      retryTimer_.Stop();
+      retransmitTimer_.Stop();
   } else {
     if (next_state_ == STATE_COMPLETED)
-      retryTimer_.Stop();
+      retransmitTimer_.Stop();
   }
+  // Timers B and F only run until the final response: left running, they
+  // would end the linger period of timers D and K.
+  if (STATE_COMPLETED == next_state_)
+    timedOutTimer_.Stop();
 
   if (mode_ == MODE_INVITE
       && response_code/100 >= 3) {
@@ -125,19 +192,29 @@ void ClientTransactionImpl::HandleIncomingResponse(
     StopTimers();
   }
 
-  if (mode_ == MODE_INVITE
-      || state != STATE_COMPLETED) {
+  // Retransmissions of a final response other than a 2xx to an INVITE are
+  // absorbed (RFC 3261 section 17.1.1.2), as the request is gone.
+  if (state != STATE_COMPLETED || initial_request_) {
     response->set_refer_to(initial_request_);
     delegate_->OnIncomingResponse(response);
   }
 
+  if (STATE_COMPLETED == next_state_ && next_state_ != state
+      && (MODE_INVITE != mode_ || response_code/100 != 2)) {
+    // Retransmissions are over, and the ACK absorbing the ones of the
+    // final response is already built.
+    initial_request_ = NULL;
+  }
+
   if (STATE_COMPLETED == next_state_) {
-    if (channel_->is_stream())
+    if (!timer_policy_.linger)
       next_state_ = STATE_TERMINATED;
     else if (next_state_ != state)
       ScheduleTerminate();
   }
 
+  if (next_state_ != state)
+    LogStateChange(state);
   if (STATE_TERMINATED == next_state_)
     Terminate();
 }
@@ -147,7 +224,7 @@ void ClientTransactionImpl::Close() {
 }
 
 void ClientTransactionImpl::OnRetransmit() {
-  DCHECK(!channel_->is_stream());
+  DCHECK(timer_policy_.retransmit);
 
   if (MODE_INVITE == mode_) {
     DCHECK(STATE_CALLING == next_state_);
@@ -155,8 +232,10 @@ void ClientTransactionImpl::OnRetransmit() {
     DCHECK(STATE_TRYING == next_state_ || STATE_PROCEEDING == next_state_);
   }
 
-  int result = channel_->Send(initial_request_,
-    base::Bind(&ClientTransactionImpl::OnWrite, weak_factory_.GetWeakPtr()));
+  retransmitted_ = true;
+  TransportStats::Count(TransportStats::RETRANSMISSIONS_SENT);
+  LogMessage(TransportLog::TYPE_SIP_MESSAGE_SENT, initial_request_);
+  int result = channel_->Send(initial_request_, write_callback_);
   if (net::ERR_IO_PENDING != result)
     OnWrite(result);
 }
@@ -168,62 +247,130 @@ void ClientTransactionImpl::OnTimedOut() {
 
   State state = next_state_;
   next_state_ = STATE_TERMINATED;
+  LogStateChange(state);
   if (STATE_COMPLETED != state) {
+    TransportStats::Count(MODE_INVITE == mode_ ? TransportStats::TIMEOUTS_B
+                                               : TransportStats::TIMEOUTS_F);
     delegate_->OnTimedOut(initial_request_);
   }
   Terminate();
 }
 
 void ClientTransactionImpl::OnTerminated() {
-  DCHECK(!channel_->is_stream());
+  DCHECK(timer_policy_.linger);
   DCHECK(STATE_COMPLETED == next_state_);
 
   next_state_ = STATE_TERMINATED;
+  LogStateChange(STATE_COMPLETED);
   Terminate();
 }
 
 void ClientTransactionImpl::OnWrite(int result) {
   if (net::OK == result) {
-    ScheduleRetry();
-  } else if (net::ERR_IO_PENDING != result) {
+    // A final response may have arrived meanwhile, and the timer been taken
+    // over by timer D or K.
+    bool retransmitting = MODE_INVITE == mode_
+        ? STATE_CALLING == next_state_
+        : (STATE_TRYING == next_state_ || STATE_PROCEEDING == next_state_);
+    if (retransmitting)
+      ScheduleRetry();
+  } else if (net::ERR_IO_PENDING != result && initial_request_) {
+    // Retransmissions still being written once the request was answered
+    // don't matter anymore.
     delegate_->OnTransportError(initial_request_, result);
   }
 }
 
+void ClientTransactionImpl::ReportRoundTrip(
+      const scoped_refptr<Response> &response) {
+  // Karn's algorithm: once the request is retransmitted, there's no telling
+  // which of the copies the response answers.
+  if (retransmitted_)
+    return;
+  base::TimeDelta rtt(timer_wheel_->NowTicks() - start_time_);
+  // Leave out the time the peer took to answer, if it echoed our Timestamp
+  // (RFC 3261 section 8.2.6.1).
+  const Timestamp *sent = static_cast<const Request*>(
+      initial_request_.get())->get<Timestamp>();
+  const Timestamp *echoed = static_cast<const Response*>(
+      response.get())->get<Timestamp>();
+  if (sent && echoed
+      && std::abs(sent->timestamp() - echoed->timestamp())
+         < kTimestampTolerance) {
+    base::TimeDelta delay(base::TimeDelta::FromMicroseconds(
+        static_cast<int64>(echoed->delay()
+                           * base::Time::kMicrosecondsPerSecond)));
+    if (delay > base::TimeDelta() && delay < rtt)
+      rtt -= delay;
+  }
+  time_delta_factory_->AddRoundTripSample(channel_->destination(), rtt);
+}
+
+void ClientTransactionImpl::LogMessage(
+      TransportLog::EventType type,
+      const scoped_refptr<Message> &message) const {
+  if (net_log_.IsCapturing())
+    net_log_.AddEvent(type, TransportLog::MessageCallback(message));
+}
+
+void ClientTransactionImpl::LogStateChange(State from) const {
+  if (net_log_.IsCapturing()) {
+    net_log_.AddEvent(TransportLog::TYPE_TRANSACTION_STATE_CHANGED,
+        TransportLog::StringPairCallback("from", StateToString(from),
+                                         "to", StateToString(next_state_)));
+  }
+}
+
+// static
+const char *ClientTransactionImpl::StateToString(State state) {
+  switch (state) {
+    case STATE_CALLING: return "calling";
+    case STATE_TRYING: return "trying";
+    case STATE_PROCEEDING: return "proceeding";
+    case STATE_PROCEED_CALLING: return "proceeding";
+    case STATE_COMPLETED: return "completed";
+    case STATE_TERMINATED: return "terminated";
+  }
+  NOTREACHED();
+  return "";
+}
+
 void ClientTransactionImpl::StopTimers() {
-  retryTimer_.Stop();
+  retransmitTimer_.Stop();
   timedOutTimer_.Stop();
-  terminateTimer_.Stop();
 }
 
 void ClientTransactionImpl::SendAck(const std::string &to_tag) {
-  if (!generated_ack_)
+  if (!generated_ack_ && initial_request_)
     ignore_result(initial_request_->CreateAck(to_tag, generated_ack_));
+  if (!generated_ack_)
+    return;
+  LogMessage(TransportLog::TYPE_SIP_MESSAGE_SENT, generated_ack_);
   channel_->Send(generated_ack_, net::CompletionCallback());
 }
 
 void ClientTransactionImpl::ScheduleRetry() {
-  retryTimer_.Start(FROM_HERE,
-      time_delta_provider_->GetNextRetryDelay(),
-      base::Bind(&ClientTransactionImpl::OnRetransmit,
-          weak_factory_.GetWeakPtr()));
+  retransmitTimer_.Start(
+      time_delta_provider_->GetNextRetryDelay(), retransmit_task_);
 }
 
 void ClientTransactionImpl::ScheduleTimeout() {
-  timedOutTimer_.Start(FROM_HERE,
+  timedOutTimer_.Start(
       time_delta_provider_->GetTimeoutDelay(),
       base::Bind(&ClientTransactionImpl::OnTimedOut,
           weak_factory_.GetWeakPtr()));
 }
 
 void ClientTransactionImpl::ScheduleTerminate() {
-  terminateTimer_.Start(FROM_HERE,
+  retransmitTimer_.Start(
       time_delta_provider_->GetTerminateDelay(),
       base::Bind(&ClientTransactionImpl::OnTerminated,
           weak_factory_.GetWeakPtr()));
 }
 
 void ClientTransactionImpl::Terminate() {
+  StopTimers();
+  net_log_.EndEvent(TransportLog::TYPE_TRANSACTION_ALIVE);
   delegate_->OnTransactionTerminated(id_);
 }
 
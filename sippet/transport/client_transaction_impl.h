@@ -5,12 +5,13 @@
 #ifndef SIPPET_TRANSPORT_CLIENT_TRANSACTION_IMPL_H_
 #define SIPPET_TRANSPORT_CLIENT_TRANSACTION_IMPL_H_
 
-#include "base/timer/timer.h"
 #include "base/memory/weak_ptr.h"
 #include "sippet/transport/client_transaction.h"
 #include "sippet/transport/transaction_delegate.h"
 #include "sippet/transport/time_delta_factory.h"
 #include "sippet/transport/time_delta_provider.h"
+#include "sippet/transport/timer_wheel.h"
+#include "sippet/transport/transaction_timer_policy.h"
 
 namespace sippet {
 
@@ -22,15 +23,23 @@ class ClientTransactionImpl : public ClientTransaction {
         const std::string &id,
         const scoped_refptr<Channel> &channel,
         TransactionDelegate *delegate,
-        TimeDeltaFactory *time_delta_factory);
+        TimeDeltaFactory *time_delta_factory,
+        TimerWheel *timer_wheel,
+        const TransactionTimerPolicy &timer_policy);
 
   // ClientTransaction methods:
   const std::string& id() const override;
   scoped_refptr<Channel> channel() const override;
+  void SetNetLog(const BoundTransportLog &net_log) override;
   void Start(const scoped_refptr<Request> &outgoing_request) override;
   void HandleIncomingResponse(
       const scoped_refptr<Response> &response) override;
   void Close() override;
+
+  // Transactions are carved from slabs shared by all network layers, see
+  // |TransactionSlab|.
+  static void *operator new(size_t size);
+  static void operator delete(void *p, size_t size);
  private:
   friend class base::RefCountedThreadSafe<ClientTransactionImpl>;
   ~ClientTransactionImpl() override;
@@ -56,17 +65,41 @@ class ClientTransactionImpl : public ClientTransaction {
   State next_state_;
   
   TransactionDelegate *delegate_;
+  TransactionTimerPolicy timer_policy_;
+  // Released once the final response arrives, unless it's a 2xx to an
+  // INVITE, whose retransmissions are still passed up with it; only the
+  // bodiless |generated_ack_| is kept then, for the ones to absorb.
   scoped_refptr<Request> initial_request_;
   scoped_refptr<Request> generated_ack_;
-  base::OneShotTimer<ClientTransactionImpl> retryTimer_;
-  base::OneShotTimer<ClientTransactionImpl> timedOutTimer_;
-  base::OneShotTimer<ClientTransactionImpl> terminateTimer_;
+  Method method_;
+  bool started_;
+  // Timers A or E while retransmitting, then D or K once completed; they
+  // never run at the same time, and neither runs on reliable transports.
+  TimerWheel::Timer retransmitTimer_;
+  TimerWheel::Timer timedOutTimer_;
+  // Its clock times the round trips.
+  TimerWheel *timer_wheel_;
+  base::TimeTicks start_time_;
+  bool retransmitted_;
+  BoundTransportLog net_log_;
+  // Bound once by |Start|, so that retransmissions don't allocate them.
+  base::Closure retransmit_task_;
+  net::CompletionCallback write_callback_;
 
   void OnRetransmit();
   void OnTimedOut();
   void OnTerminated();
   void OnWrite(int result);
 
+  // Gives the time the request took to be answered to the time delta
+  // factory, unless the request has been retransmitted.
+  void ReportRoundTrip(const scoped_refptr<Response> &response);
+
+  void LogMessage(TransportLog::EventType type,
+                  const scoped_refptr<Message> &message) const;
+  void LogStateChange(State from) const;
+  static const char *StateToString(State state);
+
   void StopTimers();
   void SendAck(const std::string &to_tag);
   void ScheduleRetry();
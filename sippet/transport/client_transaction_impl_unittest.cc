@@ -0,0 +1,294 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/client_transaction_impl.h"
+
+#include "net/base/net_errors.h"
+#include "sippet/transport/transaction_test_util.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const char kInviteRequest[] =
+  "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK74bf9\r\n"
+  "Max-Forwards: 70\r\n"
+  "To: Bob <sip:bob@biloxi.com>\r\n"
+  "From: Alice <sip:alice@atlanta.com>;tag=9fxced76sl\r\n"
+  "Call-ID: 3848276298220188511@atlanta.com\r\n"
+  "CSeq: 1 INVITE\r\n"
+  "Contact: <sip:alice@pc33.atlanta.com>\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n";
+
+const char kBusyHereResponse[] =
+  "SIP/2.0 486 Busy Here\r\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK74bf9\r\n"
+  "To: Bob <sip:bob@biloxi.com>;tag=8321234356\r\n"
+  "From: Alice <sip:alice@atlanta.com>;tag=9fxced76sl\r\n"
+  "Call-ID: 3848276298220188511@atlanta.com\r\n"
+  "CSeq: 1 INVITE\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n";
+
+const char kOptionsRequest[] =
+  "OPTIONS sip:bob@biloxi.com SIP/2.0\r\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds\r\n"
+  "Max-Forwards: 70\r\n"
+  "To: Bob <sip:bob@biloxi.com>\r\n"
+  "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+  "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+  "CSeq: 314159 OPTIONS\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n";
+
+const char kOptionsResponse[] =
+  "SIP/2.0 200 OK\r\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds\r\n"
+  "To: Bob <sip:bob@biloxi.com>;tag=93810874\r\n"
+  "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+  "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+  "CSeq: 314159 OPTIONS\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n";
+
+base::TimeDelta Milliseconds(int64 ms) {
+  return base::TimeDelta::FromMilliseconds(ms);
+}
+
+}  // namespace
+
+class ClientTransactionImplTest : public testing::Test {
+ public:
+  // Starts a client transaction for |raw_request|, sent through a reliable
+  // transport if |is_stream|, with the timers it needs.
+  void Start(const char *raw_request, bool is_stream) {
+    channel_ = new FakeTransactionChannel(is_stream);
+    StartWithPolicy(raw_request, TransactionTimerPolicy::ForChannel(
+        *channel_));
+  }
+
+  void StartWithPolicy(const char *raw_request,
+                       const TransactionTimerPolicy &timer_policy) {
+    if (!channel_.get())
+      channel_ = new FakeTransactionChannel(false);
+    request_ = ParseRequest(raw_request);
+    transaction_ = new ClientTransactionImpl("z9hG4bK74bf9", channel_,
+        &delegate_, TimeDeltaFactory::GetDefaultFactory(),
+        clock_.timer_wheel(), timer_policy);
+    transaction_->Start(request_);
+  }
+
+  void Receive(const char *raw_response) {
+    transaction_->HandleIncomingResponse(ParseResponse(raw_response));
+  }
+
+  // Checks that the transaction terminated, leaving no timer behind.
+  void ExpectTerminated() {
+    EXPECT_TRUE(delegate_.terminated());
+    EXPECT_EQ(0u, clock_.timer_wheel()->size());
+  }
+
+ protected:
+  TransactionTestClock clock_;
+  RecordingTransactionDelegate delegate_;
+  scoped_refptr<FakeTransactionChannel> channel_;
+  scoped_refptr<Request> request_;
+  scoped_refptr<ClientTransactionImpl> transaction_;
+};
+
+TEST_F(ClientTransactionImplTest, NonInviteRetransmitsUntilTimerF) {
+  Start(kOptionsRequest, false);
+
+  // Timer E doubles from T1 up to T2: 0.5s, 1.5s, 3.5s, then every 4s.
+  clock_.Advance(Milliseconds(499));
+  EXPECT_EQ(0u, channel_->sent().size());
+  clock_.Advance(Milliseconds(1));
+  EXPECT_EQ(1u, channel_->sent().size());
+  clock_.Advance(Milliseconds(1000));
+  EXPECT_EQ(2u, channel_->sent().size());
+  clock_.Advance(Milliseconds(2000));
+  EXPECT_EQ(3u, channel_->sent().size());
+  clock_.Advance(Milliseconds(4000));
+  EXPECT_EQ(4u, channel_->sent().size());
+
+  // Timer F fires at 64*T1, right after the retransmission at 31.5s.
+  clock_.Advance(Milliseconds(31999 - 7500));
+  EXPECT_EQ(10u, channel_->CountSent("OPTIONS "));
+  EXPECT_EQ(0, delegate_.timed_out());
+  EXPECT_FALSE(delegate_.terminated());
+  clock_.Advance(Milliseconds(1));
+  EXPECT_EQ(1, delegate_.timed_out());
+  ExpectTerminated();
+  EXPECT_EQ(10u, channel_->sent().size());
+}
+
+TEST_F(ClientTransactionImplTest, NonInviteLingersForTimerK) {
+  Start(kOptionsRequest, false);
+  clock_.Advance(Milliseconds(1000));
+  Receive(kOptionsResponse);
+  ASSERT_EQ(1u, delegate_.response_codes().size());
+  EXPECT_EQ(200, delegate_.response_codes()[0]);
+
+  // Timer K takes over from timer E, and timer F is gone.
+  size_t sent = channel_->sent().size();
+  clock_.Advance(Milliseconds(4999));
+  EXPECT_EQ(sent, channel_->sent().size());
+  EXPECT_FALSE(delegate_.terminated());
+  clock_.Advance(Milliseconds(1));
+  ExpectTerminated();
+  EXPECT_EQ(0, delegate_.timed_out());
+}
+
+TEST_F(ClientTransactionImplTest, NonInviteOnReliableTransport) {
+  Start(kOptionsRequest, true);
+
+  // Only timer F runs.
+  EXPECT_EQ(1u, clock_.timer_wheel()->size());
+  clock_.Advance(Milliseconds(31999));
+  EXPECT_TRUE(channel_->sent().empty());
+  EXPECT_EQ(0, delegate_.timed_out());
+  clock_.Advance(Milliseconds(1));
+  EXPECT_EQ(1, delegate_.timed_out());
+  ExpectTerminated();
+}
+
+TEST_F(ClientTransactionImplTest, NonInviteCompletesOnReliableTransport) {
+  Start(kOptionsRequest, true);
+  Receive(kOptionsResponse);
+
+  // There's no timer K on reliable transports.
+  EXPECT_EQ(1u, delegate_.response_codes().size());
+  ExpectTerminated();
+}
+
+TEST_F(ClientTransactionImplTest, InviteRetransmitsUntilTimerB) {
+  Start(kInviteRequest, false);
+
+  // Timer A doubles from T1, without limit: 0.5s, 1.5s, 3.5s, 7.5s, 15.5s
+  // and 31.5s.
+  clock_.Advance(Milliseconds(500));
+  EXPECT_EQ(1u, channel_->sent().size());
+  clock_.Advance(Milliseconds(7000));
+  EXPECT_EQ(4u, channel_->sent().size());
+  clock_.Advance(Milliseconds(8000));
+  EXPECT_EQ(5u, channel_->sent().size());
+  clock_.Advance(Milliseconds(31999 - 15500));
+  EXPECT_EQ(6u, channel_->CountSent("INVITE "));
+  EXPECT_EQ(0, delegate_.timed_out());
+
+  // Timer B fires at 64*T1.
+  clock_.Advance(Milliseconds(1));
+  EXPECT_EQ(1, delegate_.timed_out());
+  ExpectTerminated();
+}
+
+TEST_F(ClientTransactionImplTest, InviteLingersForTimerD) {
+  Start(kInviteRequest, false);
+  clock_.Advance(Milliseconds(1000));
+  Receive(kBusyHereResponse);
+  EXPECT_EQ(1u, delegate_.response_codes().size());
+  EXPECT_EQ(1u, channel_->CountSent("INVITE "));
+  EXPECT_EQ(1u, channel_->CountSent("ACK "));
+
+  // Timer D takes over from timer A. Timer B must not end it early.
+  clock_.Advance(Milliseconds(33999));
+  EXPECT_EQ(2u, channel_->sent().size());
+  EXPECT_EQ(0, delegate_.timed_out());
+  EXPECT_FALSE(delegate_.terminated());
+  clock_.Advance(Milliseconds(1000));
+  EXPECT_FALSE(delegate_.terminated());
+  clock_.Advance(Milliseconds(1));
+  ExpectTerminated();
+  EXPECT_EQ(0, delegate_.timed_out());
+}
+
+TEST_F(ClientTransactionImplTest, InviteOnReliableTransport) {
+  Start(kInviteRequest, true);
+
+  // Only timer B runs.
+  EXPECT_EQ(1u, clock_.timer_wheel()->size());
+  clock_.Advance(Milliseconds(31999));
+  EXPECT_TRUE(channel_->sent().empty());
+  clock_.Advance(Milliseconds(1));
+  EXPECT_EQ(1, delegate_.timed_out());
+  ExpectTerminated();
+}
+
+TEST_F(ClientTransactionImplTest, InviteCompletesOnReliableTransport) {
+  Start(kInviteRequest, true);
+  Receive(kBusyHereResponse);
+
+  // The ACK is still sent, but there's no timer D.
+  EXPECT_EQ(1u, delegate_.response_codes().size());
+  EXPECT_EQ(1u, channel_->CountSent("ACK "));
+  ExpectTerminated();
+}
+
+TEST_F(ClientTransactionImplTest, RetransmitsWithoutLinger) {
+  TransactionTimerPolicy timer_policy;
+  timer_policy.linger = false;
+  StartWithPolicy(kInviteRequest, timer_policy);
+  clock_.Advance(Milliseconds(500));
+  EXPECT_EQ(1u, channel_->CountSent("INVITE "));
+
+  // Timer A runs, but the transaction ends at the final response.
+  Receive(kBusyHereResponse);
+  EXPECT_EQ(1u, channel_->CountSent("ACK "));
+  ExpectTerminated();
+}
+
+TEST_F(ClientTransactionImplTest, InviteAbsorbsRetransmittedFinal) {
+  Start(kInviteRequest, false);
+  Receive(kBusyHereResponse);
+  Receive(kBusyHereResponse);
+
+  // Each copy is acknowledged, but only the first one is passed up.
+  ASSERT_EQ(1u, delegate_.response_codes().size());
+  EXPECT_EQ(486, delegate_.response_codes()[0]);
+  EXPECT_EQ(2u, channel_->CountSent("ACK "));
+}
+
+TEST_F(ClientTransactionImplTest, ReleasesRequestAtFinalResponse) {
+  Start(kOptionsRequest, false);
+  EXPECT_FALSE(request_->HasOneRef());
+  Receive(kOptionsResponse);
+  EXPECT_TRUE(request_->HasOneRef());
+  EXPECT_FALSE(delegate_.terminated());
+}
+
+TEST_F(ClientTransactionImplTest, ReleasesInviteAtNonSuccessFinal) {
+  Start(kInviteRequest, false);
+  Receive(kBusyHereResponse);
+
+  // The ACK absorbing the retransmissions doesn't need it.
+  EXPECT_TRUE(request_->HasOneRef());
+  Receive(kBusyHereResponse);
+  EXPECT_EQ(2u, channel_->CountSent("ACK "));
+}
+
+TEST_F(ClientTransactionImplTest, NoTransportErrorOnceRequestReleased) {
+  Start(kOptionsRequest, false);
+  channel_->set_pending_writes(true);
+  clock_.Advance(Milliseconds(500));
+  ASSERT_EQ(1u, channel_->sent().size());
+
+  // The retransmission fails once the request is answered.
+  Receive(kOptionsResponse);
+  channel_->CompleteWrites(net::ERR_CONNECTION_RESET);
+  EXPECT_EQ(0, delegate_.transport_errors());
+  EXPECT_EQ(1u, delegate_.response_codes().size());
+}
+
+TEST_F(ClientTransactionImplTest, TransportErrorWhileRetransmitting) {
+  Start(kOptionsRequest, false);
+  channel_->set_pending_writes(true);
+  clock_.Advance(Milliseconds(500));
+  channel_->CompleteWrites(net::ERR_CONNECTION_RESET);
+  EXPECT_EQ(1, delegate_.transport_errors());
+}
+
+} // End of sippet namespace
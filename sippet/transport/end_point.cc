@@ -7,6 +7,7 @@
 #include <utility>
 #include <vector>
 
+#include "base/strings/string_piece.h"
 #include "base/strings/string_split.h"
 #include "net/base/net_util.h"
 
@@ -14,28 +15,34 @@ namespace sippet {
 
 EndPoint::EndPoint()
   : protocol_(Protocol::Unknown) {
+  UpdateHash();
 }
 
 EndPoint::EndPoint(const EndPoint &other)
-  : hostport_(other.hostport_), protocol_(other.protocol_) {
+  : hostport_(other.hostport_), protocol_(other.protocol_),
+    hash_(other.hash_) {
 }
 
 EndPoint::EndPoint(const net::HostPortPair &hostport, const Protocol &protocol)
   : hostport_(hostport), protocol_(protocol) {
+  UpdateHash();
 }
 
 EndPoint::EndPoint(const net::HostPortPair &hostport, Protocol::Type protocol)
   : hostport_(hostport), protocol_(protocol) {
+  UpdateHash();
 }
 
 EndPoint::EndPoint(const std::string& host, uint16 port,
                    const Protocol &protocol)
   : hostport_(host, port), protocol_(protocol) {
+  UpdateHash();
 }
 
 EndPoint::EndPoint(const std::string& host, uint16 port,
                    Protocol::Type protocol)
   : hostport_(host, port), protocol_(protocol) {
+  UpdateHash();
 }
 
 EndPoint::~EndPoint() {
@@ -63,17 +70,19 @@ EndPoint EndPoint::FromString(const std::string& str) {
 }
 
 EndPoint EndPoint::FromSipURI(const SipURI& uri) {
-  std::pair<bool, std::string> result =
-    uri.parameter("transport");
+  if (!uri.is_valid())
+    return EndPoint();
+  base::StringPiece transport;
+  bool has_transport = uri.parameter("transport", &transport);
   // There should be no transport parameter when using SIPS
-  if (uri.SchemeIsSecure() && result.first) {
+  if (uri.SchemeIsSecure() && has_transport) {
     NOTREACHED() << "'sips' scheme doesn't accept transport parameter";
     return EndPoint();
   }
   // The default transport is UDP.
-  Protocol protocol = (!result.first)
+  Protocol protocol = (!has_transport)
                     ? (uri.SchemeIsSecure() ? Protocol::TLS : Protocol::UDP)
-                    : Protocol(result.second);
+                    : Protocol(transport.as_string());
   return EndPoint(uri.host(), uri.EffectiveIntPort(), protocol);
 }
 
@@ -87,4 +96,11 @@ std::string EndPoint::ToString() const {
   return hostport_.ToString() + "/" + protocol_.str();
 }
 
+void EndPoint::UpdateHash() {
+  size_t hash = BASE_HASH_NAMESPACE::hash<std::string>()(hostport_.host());
+  hash = hash * 31 + hostport_.port();
+  hash = hash * 31 + protocol_.type();
+  hash_ = hash;
+}
+
 }  // namespace sippet
@@ -8,6 +8,7 @@
 #include <string>
 #include <functional>
 
+#include "base/containers/hash_tables.h"
 #include "net/base/host_port_pair.h"
 #include "sippet/message/protocol.h"
 #include "sippet/uri/uri.h"
@@ -30,7 +31,7 @@ class EndPoint {
   // Creates an EndPoint from a string formatted in same manner as ToString().
   static EndPoint FromString(const std::string& str);
 
-  // Creates an EndPoint from a SIP-URI.
+  // Creates an EndPoint from a SIP-URI. Invalid URIs give an empty EndPoint.
   static EndPoint FromSipURI(const SipURI& uri);
 
   // Creates an EndPoint from a GURL.
@@ -42,6 +43,12 @@ class EndPoint {
 
   bool Equals(const EndPoint &other) const;
 
+  // Hash of the protocol, host and port, computed whenever they change, so
+  // that hashed tables of end points don't go through the host string.
+  size_t hash() const {
+    return hash_;
+  }
+
   // XXX: broken Google style, but doesn't matter now
   bool operator==(const EndPoint &other) const {
     return Equals(other);
@@ -65,18 +72,22 @@ class EndPoint {
 
   void set_host(const std::string& host) {
     hostport_.set_host(host);
+    UpdateHash();
   }
 
   void set_port(uint16 port) {
     hostport_.set_port(port);
+    UpdateHash();
   }
 
   void set_protocol(const Protocol &protocol) {
     protocol_ = protocol;
+    UpdateHash();
   }
 
   void set_hostport(const net::HostPortPair &hostport) {
     hostport_ = hostport;
+    UpdateHash();
   }
 
   // ToString() will convert the EndPoint tuple into "host:port/protocol".
@@ -86,15 +97,20 @@ class EndPoint {
 private:
   friend struct EndPointEquals;
   friend struct EndPointLess;
+
+  void UpdateHash();
+
   net::HostPortPair hostport_;
   Protocol protocol_;
+  size_t hash_;
 };
 
 // To be used in std::find
 struct EndPointEquals :
   public std::binary_function<EndPoint, EndPoint, bool> {
   bool operator()(const EndPoint &a, const EndPoint &b) const {
-    return a.protocol_.type() == b.protocol_.type()
+    return a.hash_ == b.hash_
+           && a.protocol_.type() == b.protocol_.type()
            && a.hostport_.Equals(b.hostport_);
   }
 };
@@ -116,4 +132,16 @@ bool EndPoint::Equals(const EndPoint &other) const {
 
 } // End of sippet namespace
 
+// To be used in base::hash_map
+namespace BASE_HASH_NAMESPACE {
+
+template<>
+struct hash<sippet::EndPoint> {
+  size_t operator()(const sippet::EndPoint &endpoint) const {
+    return endpoint.hash();
+  }
+};
+
+} // End of BASE_HASH_NAMESPACE namespace
+
 #endif // SIPPET_TRANSPORT_END_POINT_H_
@@ -57,3 +57,26 @@ TEST(EndPoint, ToString) {
     EXPECT_EQ(cases[i].output, str);
   }
 }
+
+TEST(EndPoint, Hash) {
+  EndPoint a("192.168.0.1", 5060, Protocol::TCP);
+  EndPoint b(EndPoint::FromString("192.168.0.1:5060/TCP"));
+  EXPECT_EQ(a.hash(), b.hash());
+  EXPECT_TRUE(a.Equals(b));
+
+  // Setters keep the hash up to date.
+  b.set_protocol(Protocol::UDP);
+  EXPECT_FALSE(a.Equals(b));
+  b.set_protocol(Protocol::TCP);
+  EXPECT_EQ(a.hash(), b.hash());
+  b.set_port(5061);
+  EXPECT_FALSE(a.Equals(b));
+  b.set_hostport(a.hostport());
+  EXPECT_EQ(a.hash(), b.hash());
+  EXPECT_TRUE(a.Equals(b));
+
+  base::hash_map<EndPoint, int> map;
+  map[a] = 1;
+  EXPECT_EQ(1, map[b]);
+  EXPECT_EQ(0u, map.count(EndPoint("192.168.0.1", 5060, Protocol::UDP)));
+}
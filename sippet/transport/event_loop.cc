@@ -0,0 +1,39 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/event_loop.h"
+
+#include "base/message_loop/message_loop.h"
+
+namespace sippet {
+
+bool EventLoop::BelongsToCurrentThread() const {
+  scoped_refptr<base::SingleThreadTaskRunner> runner(task_runner());
+  return runner.get() && runner->BelongsToCurrentThread();
+}
+
+ThreadEventLoop::ThreadEventLoop(const std::string &name)
+  : thread_(name) {
+}
+
+ThreadEventLoop::~ThreadEventLoop() {
+  Stop();
+}
+
+bool ThreadEventLoop::Start() {
+  base::Thread::Options options;
+  options.message_loop_type = base::MessageLoop::TYPE_IO;
+  return thread_.StartWithOptions(options);
+}
+
+void ThreadEventLoop::Stop() {
+  thread_.Stop();
+}
+
+scoped_refptr<base::SingleThreadTaskRunner>
+ThreadEventLoop::task_runner() const {
+  return thread_.task_runner();
+}
+
+} // End of sippet namespace
@@ -0,0 +1,61 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_EVENT_LOOP_H_
+#define SIPPET_TRANSPORT_EVENT_LOOP_H_
+
+#include <string>
+
+#include "base/memory/ref_counted.h"
+#include "base/single_thread_task_runner.h"
+#include "base/threading/thread.h"
+
+namespace sippet {
+
+// The I/O and timer loop a |NetworkLayer| runs on, along with its channels,
+// transactions and the user agent above it: a thread running a
+// |base::MessageLoopForIO|, which watches the sockets and fires the timers.
+// Everything of the stack must be created, used and destroyed on that
+// thread, with the tasks posted to |task_runner|.
+//
+// Sippet either runs a thread of its own (see |ThreadEventLoop|), or shares
+// a thread driven by the event loop of the embedder (see
+// |ExternalEventLoop|), so that messages don't hop between threads.
+class EventLoop {
+ public:
+  virtual ~EventLoop() {}
+
+  // The task runner of the loop thread, or NULL when not running. Tasks
+  // must be posted through it, rather than through the message loop of the
+  // thread, as some loops are only run when told about them.
+  virtual scoped_refptr<base::SingleThreadTaskRunner> task_runner() const = 0;
+
+  // Whether the calling thread is the loop thread.
+  bool BelongsToCurrentThread() const;
+};
+
+// A loop running on a dedicated thread, started by |Start|.
+class ThreadEventLoop : public EventLoop {
+ public:
+  explicit ThreadEventLoop(const std::string &name);
+
+  // Joins the thread, if still running; the tasks not run yet are dropped.
+  ~ThreadEventLoop() override;
+
+  // Returns false if the thread can't be started.
+  bool Start();
+  void Stop();
+
+  // EventLoop methods:
+  scoped_refptr<base::SingleThreadTaskRunner> task_runner() const override;
+
+ private:
+  base::Thread thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadEventLoop);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_EVENT_LOOP_H_
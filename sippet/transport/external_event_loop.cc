@@ -0,0 +1,98 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/external_event_loop.h"
+
+#include "base/logging.h"
+#include "base/message_loop/message_loop.h"
+#include "base/run_loop.h"
+#include "base/synchronization/lock.h"
+
+namespace sippet {
+
+// Forwards the tasks to the message loop, telling the delegate about them.
+// It may outlive the loop, in the hands of other threads: then the tasks
+// are dropped.
+class ExternalEventLoop::TaskRunner : public base::SingleThreadTaskRunner {
+ public:
+  TaskRunner(Delegate *delegate,
+             const scoped_refptr<base::SingleThreadTaskRunner> &target)
+    : delegate_(delegate),
+      target_(target) {
+  }
+
+  void Detach() {
+    base::AutoLock lock(lock_);
+    delegate_ = nullptr;
+  }
+
+  // base::SingleThreadTaskRunner methods:
+  bool PostDelayedTask(const tracked_objects::Location &from_here,
+                       const base::Closure &task,
+                       base::TimeDelta delay) override {
+    base::AutoLock lock(lock_);
+    if (!delegate_ || !target_->PostDelayedTask(from_here, task, delay))
+      return false;
+    delegate_->OnWorkScheduled(delay);
+    return true;
+  }
+
+  bool PostNonNestableDelayedTask(const tracked_objects::Location &from_here,
+                                  const base::Closure &task,
+                                  base::TimeDelta delay) override {
+    base::AutoLock lock(lock_);
+    if (!delegate_ ||
+        !target_->PostNonNestableDelayedTask(from_here, task, delay))
+      return false;
+    delegate_->OnWorkScheduled(delay);
+    return true;
+  }
+
+  bool RunsTasksOnCurrentThread() const override {
+    return target_->RunsTasksOnCurrentThread();
+  }
+
+ private:
+  ~TaskRunner() override {}
+
+  // Held while calling the delegate, so that it's not gone meanwhile.
+  base::Lock lock_;
+  Delegate *delegate_;
+  scoped_refptr<base::SingleThreadTaskRunner> target_;
+
+  DISALLOW_COPY_AND_ASSIGN(TaskRunner);
+};
+
+ExternalEventLoop::ExternalEventLoop(Delegate *delegate)
+  : poll_interval_(base::TimeDelta::FromMilliseconds(kDefaultPollIntervalMs)),
+    running_(false) {
+  DCHECK(delegate);
+  DCHECK(!base::MessageLoop::current())
+      << "The thread has a message loop already";
+  message_loop_.reset(new base::MessageLoopForIO);
+  task_runner_ = new TaskRunner(delegate, message_loop_->task_runner());
+}
+
+ExternalEventLoop::~ExternalEventLoop() {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  DCHECK(!running_);
+  task_runner_->Detach();
+  message_loop_.reset();
+}
+
+void ExternalEventLoop::RunPending() {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  DCHECK(!running_) << "Called from a task of the loop";
+  running_ = true;
+  // With the libevent pump, it also polls the sockets, without waiting.
+  base::RunLoop().RunUntilIdle();
+  running_ = false;
+}
+
+scoped_refptr<base::SingleThreadTaskRunner>
+ExternalEventLoop::task_runner() const {
+  return task_runner_;
+}
+
+} // End of sippet namespace
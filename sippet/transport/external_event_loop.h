@@ -0,0 +1,94 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_EXTERNAL_EVENT_LOOP_H_
+#define SIPPET_TRANSPORT_EXTERNAL_EVENT_LOOP_H_
+
+#include "base/memory/scoped_ptr.h"
+#include "base/threading/thread_checker.h"
+#include "base/time/time.h"
+#include "sippet/transport/event_loop.h"
+#include "sippet/transport/timer_wheel.h"
+
+namespace base {
+class MessageLoopForIO;
+}
+
+namespace sippet {
+
+// An |EventLoop| sharing a thread of the embedder, whose own event loop
+// (asio, libuv...) drives it: the |base::MessageLoopForIO| of sippet is
+// bound to that thread but never blocks it, and only runs when the
+// embedder calls |RunPending|.
+//
+// The embedder must call |RunPending|:
+//  - when told by |Delegate::OnWorkScheduled|, after the given delay. It
+//    happens for the tasks posted through |task_runner|, from any thread;
+//  - every |poll_interval|, for the socket events and the timers armed by
+//    sippet on its own thread, which the message loop doesn't expose. The
+//    default interval is the resolution of the |TimerWheel| driving the
+//    transactions, so that they are not delayed any further.
+//
+// Example usage, with asio:
+//   class AsioDriver : public ExternalEventLoop::Delegate {
+//    public:
+//     void OnWorkScheduled(const base::TimeDelta &delay) override {
+//       io_service_.post([this] { loop_->RunPending(); });
+//     }
+//   };
+//
+//   // On the io_service thread:
+//   ExternalEventLoop loop(&driver);
+//   ... a repeating asio timer of |loop.poll_interval()| calling
+//   ... |loop.RunPending()|, and the stack created on |loop|.
+class ExternalEventLoop : public EventLoop {
+ public:
+  class Delegate {
+   public:
+    virtual ~Delegate() {}
+
+    // Called on any thread: |RunPending| must be called on the loop thread
+    // within |delay|. It must not call |RunPending| itself, but post it to
+    // the event loop of the embedder.
+    virtual void OnWorkScheduled(const base::TimeDelta &delay) = 0;
+  };
+
+  static const int kDefaultPollIntervalMs = TimerWheel::kDefaultResolutionMs;
+
+  // Must be constructed on the thread of the embedder loop, which becomes
+  // the loop thread; it must not have a message loop already. The
+  // |delegate| is not owned.
+  explicit ExternalEventLoop(Delegate *delegate);
+
+  // Drops the tasks not run yet. Tasks posted afterwards are dropped too.
+  ~ExternalEventLoop() override;
+
+  // Runs the tasks, timers and socket events that are ready, including
+  // those they make ready, and returns without blocking. It must not be
+  // called from the tasks it runs.
+  void RunPending();
+
+  base::TimeDelta poll_interval() const { return poll_interval_; }
+  void set_poll_interval(const base::TimeDelta &poll_interval) {
+    poll_interval_ = poll_interval;
+  }
+
+  // EventLoop methods:
+  scoped_refptr<base::SingleThreadTaskRunner> task_runner() const override;
+
+ private:
+  class TaskRunner;
+
+  base::TimeDelta poll_interval_;
+  scoped_ptr<base::MessageLoopForIO> message_loop_;
+  scoped_refptr<TaskRunner> task_runner_;
+  bool running_;
+  base::ThreadChecker thread_checker_;
+
+  DISALLOW_COPY_AND_ASSIGN(ExternalEventLoop);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_EXTERNAL_EVENT_LOOP_H_
@@ -0,0 +1,118 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/external_event_loop.h"
+
+#include "base/bind.h"
+#include "base/location.h"
+#include "base/threading/platform_thread.h"
+#include "base/threading/simple_thread.h"
+#include "base/threading/thread.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+class RecordingDelegate : public ExternalEventLoop::Delegate {
+ public:
+  RecordingDelegate() : scheduled_(0) {}
+
+  void OnWorkScheduled(const base::TimeDelta &delay) override {
+    ++scheduled_;
+    last_delay_ = delay;
+  }
+
+  int scheduled_;
+  base::TimeDelta last_delay_;
+};
+
+void Increment(int *runs) {
+  ++*runs;
+}
+
+void PostIncrement(
+    const scoped_refptr<base::SingleThreadTaskRunner> &task_runner,
+    int *runs) {
+  task_runner->PostTask(FROM_HERE, base::Bind(&Increment, runs));
+}
+
+class ClosureRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  explicit ClosureRunner(const base::Closure &closure) : closure_(closure) {}
+
+  void Run() override { closure_.Run(); }
+
+ private:
+  base::Closure closure_;
+};
+
+// The test thread runs a message loop already, which the thread of an
+// embedder loop would not.
+void RunOnEmbedderThread(const base::Closure &body) {
+  ClosureRunner runner(body);
+  base::DelegateSimpleThread thread(&runner, "Embedder");
+  thread.Start();
+  thread.Join();
+}
+
+void TestRunPending() {
+  RecordingDelegate delegate;
+  ExternalEventLoop loop(&delegate);
+  EXPECT_TRUE(loop.BelongsToCurrentThread());
+
+  // Nothing runs until the embedder says so.
+  int runs = 0;
+  loop.task_runner()->PostTask(FROM_HERE, base::Bind(&Increment, &runs));
+  EXPECT_EQ(1, delegate.scheduled_);
+  EXPECT_EQ(base::TimeDelta(), delegate.last_delay_);
+  EXPECT_EQ(0, runs);
+  loop.RunPending();
+  EXPECT_EQ(1, runs);
+
+  // Tasks posted from other threads wake the embedder up as well.
+  base::Thread thread("Poster");
+  ASSERT_TRUE(thread.Start());
+  EXPECT_FALSE(thread.task_runner()->BelongsToCurrentThread());
+  thread.task_runner()->PostTask(FROM_HERE,
+      base::Bind(&PostIncrement, loop.task_runner(), &runs));
+  thread.Stop();
+  EXPECT_EQ(2, delegate.scheduled_);
+  loop.RunPending();
+  EXPECT_EQ(2, runs);
+
+  // Delayed tasks run once due.
+  base::TimeDelta delay(base::TimeDelta::FromMilliseconds(5));
+  loop.task_runner()->PostDelayedTask(FROM_HERE,
+      base::Bind(&Increment, &runs), delay);
+  EXPECT_EQ(delay, delegate.last_delay_);
+  base::PlatformThread::Sleep(delay * 2);
+  loop.RunPending();
+  EXPECT_EQ(3, runs);
+}
+
+void TestOutlivedTaskRunner() {
+  RecordingDelegate delegate;
+  scoped_refptr<base::SingleThreadTaskRunner> task_runner;
+  int runs = 0;
+  {
+    ExternalEventLoop loop(&delegate);
+    task_runner = loop.task_runner();
+  }
+  EXPECT_FALSE(task_runner->PostTask(FROM_HERE,
+      base::Bind(&Increment, &runs)));
+  EXPECT_EQ(0, delegate.scheduled_);
+}
+
+}  // namespace
+
+TEST(ExternalEventLoopTest, RunPending) {
+  RunOnEmbedderThread(base::Bind(&TestRunPending));
+}
+
+TEST(ExternalEventLoopTest, OutlivedTaskRunner) {
+  RunOnEmbedderThread(base::Bind(&TestOutlivedTaskRunner));
+}
+
+}  // namespace sippet
@@ -0,0 +1,106 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/loop_watchdog.h"
+
+#include <algorithm>
+
+#include "base/bind.h"
+#include "base/logging.h"
+#include "base/message_loop/message_loop.h"
+#include "base/time/tick_clock.h"
+#include "sippet/transport/overload_controller.h"
+#include "sippet/transport/timer_wheel.h"
+#include "sippet/transport/transport_stats.h"
+
+namespace sippet {
+
+namespace {
+
+base::TimeDelta Smooth(const base::TimeDelta &smoothed,
+                       const base::TimeDelta &measure) {
+  return smoothed - smoothed / 8 + measure / 8;
+}
+
+}  // namespace
+
+LoopWatchdog::LoopWatchdog(Delegate *delegate,
+                           TimerWheel *timer_wheel,
+                           const base::TimeDelta &threshold)
+  : delegate_(delegate),
+    timer_wheel_(timer_wheel),
+    threshold_(threshold),
+    overload_controller_(nullptr),
+    lagging_(false),
+    tick_clock_(nullptr),
+    weak_factory_(this) {
+  DCHECK(delegate);
+  DCHECK(timer_wheel);
+  DCHECK(threshold > base::TimeDelta());
+}
+
+LoopWatchdog::~LoopWatchdog() {
+}
+
+void LoopWatchdog::Start(const base::TimeDelta &interval) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  // Lateness accumulated before the start isn't ours to report.
+  timer_wheel_->TakeMaxLateness();
+  probe_timer_.Start(FROM_HERE, interval, this, &LoopWatchdog::OnProbe);
+}
+
+void LoopWatchdog::Stop() {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  probe_timer_.Stop();
+  weak_factory_.InvalidateWeakPtrs();
+}
+
+void LoopWatchdog::ReportTaskLag(const base::TimeDelta &lag) {
+  TransportStats::RecordLoopLag(TransportStats::TASK_QUEUEING, lag);
+  task_lag_ = Smooth(task_lag_, lag);
+  Evaluate();
+}
+
+void LoopWatchdog::ReportTimerLag(const base::TimeDelta &lag) {
+  TransportStats::RecordLoopLag(TransportStats::TIMER_LATENESS, lag);
+  timer_lag_ = Smooth(timer_lag_, lag);
+  Evaluate();
+}
+
+base::TimeTicks LoopWatchdog::Now() const {
+  return tick_clock_ ? tick_clock_->NowTicks() : base::TimeTicks::Now();
+}
+
+void LoopWatchdog::OnProbe() {
+  last_timer_lateness_ = timer_wheel_->TakeMaxLateness();
+  ReportTimerLag(last_timer_lateness_);
+  base::MessageLoop* message_loop = base::MessageLoop::current();
+  CHECK(message_loop);
+  message_loop->PostTask(
+      FROM_HERE,
+      base::Bind(&LoopWatchdog::OnProbeRun, weak_factory_.GetWeakPtr(),
+                 Now()));
+}
+
+void LoopWatchdog::OnProbeRun(const base::TimeTicks &posted) {
+  base::TimeDelta lag = std::max(Now() - posted, base::TimeDelta());
+  if (overload_controller_)
+    overload_controller_->ReportLoopLag(std::max(lag, last_timer_lateness_));
+  ReportTaskLag(lag);
+}
+
+void LoopWatchdog::Evaluate() {
+  base::TimeDelta current = lag();
+  if (!lagging_ && current >= threshold_) {
+    DVLOG(1) << "Network thread lagging by " << current.InMilliseconds()
+             << "ms";
+    lagging_ = true;
+    delegate_->OnLoopLagging(current);
+  } else if (lagging_ && current < threshold_ / 2) {
+    lagging_ = false;
+    delegate_->OnLoopRecovered(current);
+  }
+}
+
+} // End of sippet namespace
@@ -0,0 +1,117 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_LOOP_WATCHDOG_H_
+#define SIPPET_TRANSPORT_LOOP_WATCHDOG_H_
+
+#include <algorithm>
+
+#include "base/memory/weak_ptr.h"
+#include "base/threading/thread_checker.h"
+#include "base/time/time.h"
+#include "base/timer/timer.h"
+
+namespace base {
+class TickClock;
+}
+
+namespace sippet {
+
+class OverloadController;
+class TimerWheel;
+
+// Watches how far behind the thread running a |NetworkLayer| is. Two lags
+// are measured at every probe: how long a task posted to the message loop
+// waits before it runs, and how late the timers of the |TimerWheel|, such as
+// the retransmission timers A and E, fire. Both are recorded in the
+// |TransportStats| histograms.
+//
+// The delegate is told when the lag, the worst of both smoothed as RFC 6298
+// does with round trips, reaches the threshold, and again when it's back
+// below half of it, so that it doesn't flap around the threshold. It can
+// also feed an |OverloadController|, instead of its own lag probe.
+//
+// It must be created, used and destroyed on the network thread, and must
+// not outlive the wheel.
+class LoopWatchdog {
+ public:
+  class Delegate {
+   public:
+    virtual ~Delegate() {}
+
+    // The lag reached the threshold.
+    virtual void OnLoopLagging(const base::TimeDelta &lag) = 0;
+
+    // The lag is back below half of the threshold.
+    virtual void OnLoopRecovered(const base::TimeDelta &lag) = 0;
+  };
+
+  // How often the lags are measured, by default.
+  static const int kDefaultProbeIntervalMs = 100;
+
+  // The |delegate| and |timer_wheel| are not owned.
+  LoopWatchdog(Delegate *delegate,
+               TimerWheel *timer_wheel,
+               const base::TimeDelta &threshold);
+  ~LoopWatchdog();
+
+  // Feed the measures to |overload_controller|, not owned, as well.
+  void set_overload_controller(OverloadController *overload_controller) {
+    overload_controller_ = overload_controller;
+  }
+
+  // Starts probing every |interval|; it must be called from a thread
+  // running a message loop.
+  void Start(const base::TimeDelta &interval =
+                 base::TimeDelta::FromMilliseconds(kDefaultProbeIntervalMs));
+  void Stop();
+
+  // The smoothed lags.
+  base::TimeDelta task_lag() const { return task_lag_; }
+  base::TimeDelta timer_lag() const { return timer_lag_; }
+  base::TimeDelta lag() const { return std::max(task_lag_, timer_lag_); }
+
+  // Whether the delegate was told the loop is lagging.
+  bool lagging() const { return lagging_; }
+
+  // Feed a measure, as the probes do.
+  void ReportTaskLag(const base::TimeDelta &lag);
+  void ReportTimerLag(const base::TimeDelta &lag);
+
+  void set_tick_clock_for_testing(base::TickClock *tick_clock) {
+    tick_clock_ = tick_clock;
+  }
+
+ private:
+  base::TimeTicks Now() const;
+
+  // Posts the task measuring the queueing delay, and takes the timer
+  // lateness.
+  void OnProbe();
+  void OnProbeRun(const base::TimeTicks &posted);
+
+  // Tells the delegate about the threshold crossings.
+  void Evaluate();
+
+  Delegate *delegate_;
+  TimerWheel *timer_wheel_;
+  base::TimeDelta threshold_;
+  OverloadController *overload_controller_;
+  base::TimeDelta task_lag_;
+  base::TimeDelta timer_lag_;
+  // The last timer lateness measured, fed to |overload_controller_| along
+  // with the next queueing delay.
+  base::TimeDelta last_timer_lateness_;
+  bool lagging_;
+  base::RepeatingTimer<LoopWatchdog> probe_timer_;
+  base::TickClock *tick_clock_;
+  base::ThreadChecker thread_checker_;
+  base::WeakPtrFactory<LoopWatchdog> weak_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(LoopWatchdog);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_LOOP_WATCHDOG_H_
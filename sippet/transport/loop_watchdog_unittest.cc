@@ -0,0 +1,87 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/loop_watchdog.h"
+
+#include "sippet/transport/timer_wheel.h"
+#include "sippet/transport/transport_stats.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const int kThresholdMs = 200;
+
+class CountingDelegate : public LoopWatchdog::Delegate {
+ public:
+  CountingDelegate() : lagging_(0), recovered_(0) {}
+
+  void OnLoopLagging(const base::TimeDelta &lag) override {
+    EXPECT_LE(kThresholdMs, lag.InMilliseconds());
+    ++lagging_;
+  }
+
+  void OnLoopRecovered(const base::TimeDelta &lag) override {
+    EXPECT_GT(kThresholdMs / 2, lag.InMilliseconds());
+    ++recovered_;
+  }
+
+  int lagging_;
+  int recovered_;
+};
+
+}  // namespace
+
+TEST(LoopWatchdogTest, Thresholds) {
+  CountingDelegate delegate;
+  TimerWheel wheel;
+  LoopWatchdog watchdog(&delegate, &wheel,
+                        base::TimeDelta::FromMilliseconds(kThresholdMs));
+  TransportStats::Snapshot before;
+  TransportStats::GetSnapshot(&before);
+
+  // A single slow task isn't enough.
+  base::TimeDelta slow(base::TimeDelta::FromMilliseconds(2 * kThresholdMs));
+  watchdog.ReportTaskLag(slow);
+  EXPECT_FALSE(watchdog.lagging());
+  EXPECT_EQ(0, delegate.lagging_);
+  int reports = 1;
+  while (!watchdog.lagging() && reports < 100) {
+    watchdog.ReportTaskLag(slow);
+    ++reports;
+  }
+  EXPECT_TRUE(watchdog.lagging());
+  EXPECT_EQ(1, delegate.lagging_);
+  EXPECT_LT(1, reports);
+
+  // Lags between half the threshold and the threshold change nothing.
+  watchdog.ReportTaskLag(base::TimeDelta());
+  EXPECT_TRUE(watchdog.lagging());
+  EXPECT_EQ(0, delegate.recovered_);
+  while (watchdog.lagging() && reports < 200) {
+    watchdog.ReportTaskLag(base::TimeDelta());
+    ++reports;
+  }
+  EXPECT_EQ(1, delegate.recovered_);
+  EXPECT_EQ(1, delegate.lagging_);
+
+  // Late timers count as well.
+  while (!watchdog.lagging() && reports < 300) {
+    watchdog.ReportTimerLag(slow);
+    ++reports;
+  }
+  EXPECT_EQ(2, delegate.lagging_);
+  EXPECT_EQ(watchdog.timer_lag(), watchdog.lag());
+
+  TransportStats::Snapshot after;
+  TransportStats::GetSnapshot(&after);
+  int bucket = TransportStats::GetLatencyBucket(slow);
+  EXPECT_LT(before.loop_lag[TransportStats::TASK_QUEUEING][bucket],
+            after.loop_lag[TransportStats::TASK_QUEUEING][bucket]);
+  EXPECT_LT(before.loop_lag[TransportStats::TIMER_LATENESS][bucket],
+            after.loop_lag[TransportStats::TIMER_LATENESS][bucket]);
+}
+
+}  // namespace sippet
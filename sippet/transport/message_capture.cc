@@ -0,0 +1,384 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/message_capture.h"
+
+#include <algorithm>
+
+#include "base/bind.h"
+#include "base/location.h"
+#include "base/logging.h"
+#include "base/single_thread_task_runner.h"
+#include "net/base/net_util.h"
+
+namespace sippet {
+
+namespace {
+
+// HEPv3 chunk types, all from the generic vendor (0).
+enum {
+  kHepChunkFamily = 0x0001,
+  kHepChunkProtocolId = 0x0002,
+  kHepChunkIPv4Source = 0x0003,
+  kHepChunkIPv4Destination = 0x0004,
+  kHepChunkIPv6Source = 0x0005,
+  kHepChunkIPv6Destination = 0x0006,
+  kHepChunkSourcePort = 0x0007,
+  kHepChunkDestinationPort = 0x0008,
+  kHepChunkSeconds = 0x0009,
+  kHepChunkMicroseconds = 0x000a,
+  kHepChunkProtocolType = 0x000b,
+  kHepChunkPayload = 0x000f,
+};
+
+const uint8 kHepFamilyIPv4 = 2;
+const uint8 kHepFamilyIPv6 = 10;
+const uint8 kHepProtocolTypeSIP = 1;
+
+const size_t kHepChunkHeaderSize = 6;
+const size_t kHepMaxSize = 0xffff;
+
+void AppendUint8(uint8 value, std::string *output) {
+  output->push_back(static_cast<char>(value));
+}
+
+void AppendUint16(uint16 value, std::string *output) {
+  output->push_back(static_cast<char>(value >> 8));
+  output->push_back(static_cast<char>(value));
+}
+
+void AppendUint32(uint32 value, std::string *output) {
+  AppendUint16(static_cast<uint16>(value >> 16), output);
+  AppendUint16(static_cast<uint16>(value), output);
+}
+
+void AppendChunkHeader(uint16 type, size_t payload_size,
+                       std::string *output) {
+  AppendUint16(0, output);  // Generic vendor
+  AppendUint16(type, output);
+  AppendUint16(static_cast<uint16>(kHepChunkHeaderSize + payload_size),
+               output);
+}
+
+void AppendUint8Chunk(uint16 type, uint8 value, std::string *output) {
+  AppendChunkHeader(type, 1, output);
+  AppendUint8(value, output);
+}
+
+void AppendUint16Chunk(uint16 type, uint16 value, std::string *output) {
+  AppendChunkHeader(type, 2, output);
+  AppendUint16(value, output);
+}
+
+void AppendUint32Chunk(uint16 type, uint32 value, std::string *output) {
+  AppendChunkHeader(type, 4, output);
+  AppendUint32(value, output);
+}
+
+void AppendBytesChunk(uint16 type, const char *data, size_t size,
+                      std::string *output) {
+  AppendChunkHeader(type, size, output);
+  output->append(data, size);
+}
+
+// The IP protocol carrying |protocol|, as in the IP header.
+uint8 GetIPProtocolId(const Protocol &protocol) {
+  switch (protocol.type()) {
+    case Protocol::UDP:
+    case Protocol::DTLS:
+      return 17;
+    case Protocol::SCTP:
+      return 132;
+    case Protocol::DCCP:
+      return 33;
+    default:
+      return 6;  // TCP
+  }
+}
+
+uint16 ReadUint16(const char *data) {
+  return static_cast<uint16>((static_cast<uint8>(data[0]) << 8)
+      | static_cast<uint8>(data[1]));
+}
+
+uint32 ReadUint32(const char *data) {
+  return (static_cast<uint32>(ReadUint16(data)) << 16) | ReadUint16(data + 2);
+}
+
+// The inverse of |GetIPProtocolId|.
+Protocol::Type GetProtocolOfIPProtocolId(uint8 protocol_id) {
+  switch (protocol_id) {
+    case 17:
+      return Protocol::UDP;
+    case 132:
+      return Protocol::SCTP;
+    case 33:
+      return Protocol::DCCP;
+    default:
+      return Protocol::TCP;
+  }
+}
+
+// Returns the address in |value|, or an empty string if it's not one.
+std::string ReadAddress(const base::StringPiece &value) {
+  if (value.size() != net::kIPv4AddressSize
+      && value.size() != net::kIPv6AddressSize)
+    return std::string();
+  net::IPAddressNumber address(value.begin(), value.end());
+  return net::IPAddressToString(address);
+}
+
+// Channel destinations may be host names; those are written as unspecified
+// addresses of the other end's family.
+void GetAddresses(const EndPoint &source, const EndPoint &destination,
+                  net::IPAddressNumber *source_address,
+                  net::IPAddressNumber *destination_address) {
+  bool has_source =
+      net::ParseIPLiteralToNumber(source.host(), source_address);
+  bool has_destination =
+      net::ParseIPLiteralToNumber(destination.host(), destination_address);
+  if (has_source && has_destination
+      && source_address->size() == destination_address->size())
+    return;
+  size_t size = net::kIPv4AddressSize;
+  if (has_source)
+    size = source_address->size();
+  else if (has_destination)
+    size = destination_address->size();
+  if (!has_source || source_address->size() != size)
+    source_address->assign(size, 0);
+  if (!has_destination || destination_address->size() != size)
+    destination_address->assign(size, 0);
+}
+
+}  // namespace
+
+MessageCapture::Record::Record()
+  : direction(INCOMING) {
+}
+
+MessageCapture::Record::~Record() {
+}
+
+void MessageCapture::Record::swap(Record &other) {
+  std::swap(direction, other.direction);
+  std::swap(time, other.time);
+  std::swap(local, other.local);
+  std::swap(remote, other.remote);
+  bytes.swap(other.bytes);
+}
+
+MessageCapture::MessageCapture(size_t capacity)
+  : ring_(capacity),
+    dropped_records_(0),
+    drain_interval_(
+        base::TimeDelta::FromMilliseconds(kDefaultDrainIntervalMs)),
+    writer_thread_("SipMessageCapture") {
+}
+
+MessageCapture::~MessageCapture() {
+  Stop();
+}
+
+bool MessageCapture::Start(const base::FilePath &path) {
+  DCHECK(!writer_thread_.IsRunning());
+  if (!writer_thread_.Start())
+    return false;
+  writer_thread_.task_runner()->PostTask(FROM_HERE,
+      base::Bind(&MessageCapture::OnStart, base::Unretained(this), path));
+  return true;
+}
+
+void MessageCapture::Stop() {
+  if (!writer_thread_.IsRunning())
+    return;
+  writer_thread_.task_runner()->PostTask(FROM_HERE,
+      base::Bind(&MessageCapture::OnStop, base::Unretained(this)));
+  writer_thread_.Stop();
+}
+
+void MessageCapture::Capture(
+    Direction direction,
+    const EndPoint &local,
+    const EndPoint &remote,
+    const scoped_refptr<base::RefCountedString> &bytes) {
+  Record record;
+  record.direction = direction;
+  record.time = base::Time::Now();
+  record.local = local;
+  record.remote = remote;
+  record.bytes = bytes;
+  if (!ring_.Push(&record))
+    base::subtle::NoBarrier_AtomicIncrement(&dropped_records_, 1);
+}
+
+int MessageCapture::dropped_records() const {
+  return base::subtle::NoBarrier_Load(&dropped_records_);
+}
+
+void MessageCapture::EncodeHep3(const Record &record, std::string *output) {
+  const EndPoint &source =
+      record.direction == INCOMING ? record.remote : record.local;
+  const EndPoint &destination =
+      record.direction == INCOMING ? record.local : record.remote;
+  net::IPAddressNumber source_address;
+  net::IPAddressNumber destination_address;
+  GetAddresses(source, destination, &source_address, &destination_address);
+  bool ipv4 = source_address.size() == net::kIPv4AddressSize;
+
+  std::string packet("HEP3");
+  AppendUint16(0, &packet);  // Total length, set below
+  AppendUint8Chunk(kHepChunkFamily, ipv4 ? kHepFamilyIPv4 : kHepFamilyIPv6,
+      &packet);
+  AppendUint8Chunk(kHepChunkProtocolId,
+      GetIPProtocolId(record.remote.protocol()), &packet);
+  AppendBytesChunk(ipv4 ? kHepChunkIPv4Source : kHepChunkIPv6Source,
+      reinterpret_cast<const char*>(&source_address[0]),
+      source_address.size(), &packet);
+  AppendBytesChunk(ipv4 ? kHepChunkIPv4Destination : kHepChunkIPv6Destination,
+      reinterpret_cast<const char*>(&destination_address[0]),
+      destination_address.size(), &packet);
+  AppendUint16Chunk(kHepChunkSourcePort, source.port(), &packet);
+  AppendUint16Chunk(kHepChunkDestinationPort, destination.port(), &packet);
+  int64 microseconds =
+      (record.time - base::Time::UnixEpoch()).InMicroseconds();
+  AppendUint32Chunk(kHepChunkSeconds,
+      static_cast<uint32>(microseconds / base::Time::kMicrosecondsPerSecond),
+      &packet);
+  AppendUint32Chunk(kHepChunkMicroseconds,
+      static_cast<uint32>(microseconds % base::Time::kMicrosecondsPerSecond),
+      &packet);
+  AppendUint8Chunk(kHepChunkProtocolType, kHepProtocolTypeSIP, &packet);
+
+  size_t payload_size = 0;
+  if (record.bytes.get()) {
+    payload_size = std::min(record.bytes->size(),
+        kHepMaxSize - packet.size() - kHepChunkHeaderSize);
+  }
+  AppendBytesChunk(kHepChunkPayload,
+      payload_size ? record.bytes->data().data() : "", payload_size,
+      &packet);
+
+  DCHECK_LE(packet.size(), kHepMaxSize);
+  packet[4] = static_cast<char>(packet.size() >> 8);
+  packet[5] = static_cast<char>(packet.size());
+  output->append(packet);
+}
+
+bool MessageCapture::DecodeHep3(base::StringPiece *input, Record *record) {
+  DCHECK(input);
+  DCHECK(record);
+  if (input->size() < kHepChunkHeaderSize || !input->starts_with("HEP3"))
+    return false;
+  size_t length = ReadUint16(input->data() + 4);
+  if (length < kHepChunkHeaderSize || length > input->size())
+    return false;
+  base::StringPiece chunks(input->data() + kHepChunkHeaderSize,
+                           length - kHepChunkHeaderSize);
+  input->remove_prefix(length);
+
+  std::string source_host;
+  std::string destination_host;
+  uint16 source_port = 0;
+  uint16 destination_port = 0;
+  uint8 protocol_id = 6;
+  int64 seconds = 0;
+  int64 microseconds = 0;
+  bool has_payload = false;
+  std::string payload;
+  while (chunks.size() >= kHepChunkHeaderSize) {
+    uint16 vendor = ReadUint16(chunks.data());
+    uint16 type = ReadUint16(chunks.data() + 2);
+    size_t chunk_length = ReadUint16(chunks.data() + 4);
+    if (chunk_length < kHepChunkHeaderSize || chunk_length > chunks.size())
+      return false;
+    base::StringPiece value(chunks.data() + kHepChunkHeaderSize,
+                            chunk_length - kHepChunkHeaderSize);
+    chunks.remove_prefix(chunk_length);
+    if (vendor != 0)
+      continue;  // Unknown vendor chunks are skipped
+    switch (type) {
+      case kHepChunkProtocolId:
+        if (value.size() == 1)
+          protocol_id = static_cast<uint8>(value[0]);
+        break;
+      case kHepChunkIPv4Source:
+      case kHepChunkIPv6Source:
+        source_host = ReadAddress(value);
+        break;
+      case kHepChunkIPv4Destination:
+      case kHepChunkIPv6Destination:
+        destination_host = ReadAddress(value);
+        break;
+      case kHepChunkSourcePort:
+        if (value.size() == 2)
+          source_port = ReadUint16(value.data());
+        break;
+      case kHepChunkDestinationPort:
+        if (value.size() == 2)
+          destination_port = ReadUint16(value.data());
+        break;
+      case kHepChunkSeconds:
+        if (value.size() == 4)
+          seconds = ReadUint32(value.data());
+        break;
+      case kHepChunkMicroseconds:
+        if (value.size() == 4)
+          microseconds = ReadUint32(value.data());
+        break;
+      case kHepChunkPayload:
+        value.CopyToString(&payload);
+        has_payload = true;
+        break;
+    }
+  }
+  if (!has_payload)
+    return false;
+
+  Protocol::Type protocol = GetProtocolOfIPProtocolId(protocol_id);
+  record->direction = INCOMING;
+  record->time = base::Time::UnixEpoch()
+      + base::TimeDelta::FromSeconds(seconds)
+      + base::TimeDelta::FromMicroseconds(microseconds);
+  record->remote = EndPoint(source_host, source_port, protocol);
+  record->local = EndPoint(destination_host, destination_port, protocol);
+  record->bytes = base::RefCountedString::TakeString(&payload);
+  return true;
+}
+
+void MessageCapture::OnStart(const base::FilePath &path) {
+  file_.Initialize(path, base::File::FLAG_CREATE_ALWAYS |
+                         base::File::FLAG_WRITE);
+  if (!file_.IsValid()) {
+    LOG(WARNING) << "Failed to open the capture file "
+                 << path.AsUTF8Unsafe() << ": "
+                 << base::File::ErrorToString(file_.error_details());
+  }
+  drain_timer_.reset(new base::RepeatingTimer<MessageCapture>);
+  drain_timer_->Start(FROM_HERE, drain_interval_, this,
+      &MessageCapture::Drain);
+  Drain();
+}
+
+void MessageCapture::OnStop() {
+  drain_timer_.reset();
+  Drain();
+  file_.Close();
+}
+
+void MessageCapture::Drain() {
+  Record record;
+  while (ring_.Pop(&record))
+    EncodeHep3(record, &buffer_);
+  if (buffer_.empty())
+    return;
+  if (file_.IsValid()) {
+    int size = static_cast<int>(buffer_.size());
+    if (file_.WriteAtCurrentPos(buffer_.data(), size) != size)
+      DVLOG(1) << "Capture write failed";
+  }
+  buffer_.clear();
+}
+
+} // End of sippet namespace
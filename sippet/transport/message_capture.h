@@ -0,0 +1,130 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_MESSAGE_CAPTURE_H_
+#define SIPPET_TRANSPORT_MESSAGE_CAPTURE_H_
+
+#include <string>
+
+#include "base/atomicops.h"
+#include "base/files/file.h"
+#include "base/files/file_path.h"
+#include "base/memory/ref_counted.h"
+#include "base/memory/ref_counted_memory.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/strings/string_piece.h"
+#include "base/threading/thread.h"
+#include "base/time/time.h"
+#include "base/timer/timer.h"
+#include "sippet/base/spsc_ring.h"
+#include "sippet/transport/end_point.h"
+
+namespace sippet {
+
+// Captures the SIP messages sent and received by a network layer, as they
+// are on the wire before TLS or WebSocket framing, to a file of HEPv3
+// (Homer Encapsulation Protocol) packets. Unlike a tcpdump, it sees the
+// traffic of secure transports too.
+//
+// Messages are captured on the network thread by |Capture|, which only
+// takes a reference to the bytes the transports send, and swaps a record
+// into a bounded ring. A writer thread drains the ring periodically and
+// does the encoding and the writes. When the ring is full, records are
+// dropped and counted, so that the network thread never waits for the disk.
+//
+// The ring has a single producer: a capture can't be shared by network
+// layers running on different threads.
+class MessageCapture {
+ public:
+  enum Direction {
+    INCOMING,
+    OUTGOING,
+  };
+
+  struct Record {
+    Record();
+    ~Record();
+
+    // Exchanges contents without touching the bytes reference count.
+    void swap(Record &other);
+
+    Direction direction;
+    base::Time time;
+    EndPoint local;
+    EndPoint remote;
+    scoped_refptr<base::RefCountedString> bytes;
+  };
+
+  // Default number of records held by the ring.
+  static const size_t kDefaultCapacity = 4096;
+
+  // Default interval between writer thread drains.
+  static const int kDefaultDrainIntervalMs = 100;
+
+  explicit MessageCapture(size_t capacity = kDefaultCapacity);
+
+  // Stops the capture, if still running.
+  ~MessageCapture();
+
+  // Starts the writer thread, which creates or truncates the file at
+  // |path|. Records captured before are kept, up to the ring capacity, and
+  // written once started. Returns false if the thread could not be started.
+  bool Start(const base::FilePath &path);
+
+  // Writes what's left in the ring, closes the file and joins the writer
+  // thread. Records captured afterwards stay in the ring.
+  void Stop();
+
+  // Called from the network thread for each message sent or received
+  // through the channel from |local| to |remote|, with the serialized
+  // message. Never blocks.
+  void Capture(Direction direction,
+               const EndPoint &local,
+               const EndPoint &remote,
+               const scoped_refptr<base::RefCountedString> &bytes);
+
+  // The records lost because the ring was full.
+  int dropped_records() const;
+
+  // Appends the HEPv3 packet of |record| to |output|. The payload is
+  // truncated if the packet would exceed the 16-bit HEP length.
+  static void EncodeHep3(const Record &record, std::string *output);
+
+  // Decodes the HEPv3 packet at the start of |input| into |record|, and
+  // removes it from |input|. Records are decoded as |INCOMING|, from the
+  // source to the destination of the packet; secure transports are read
+  // back as the IP protocol carrying them. Returns false if |input| doesn't
+  // start with a complete packet holding a payload.
+  static bool DecodeHep3(base::StringPiece *input, Record *record);
+
+  void set_drain_interval_for_testing(base::TimeDelta interval) {
+    drain_interval_ = interval;
+  }
+
+ private:
+  // Run on the writer thread.
+  void OnStart(const base::FilePath &path);
+  void OnStop();
+  void Drain();
+
+  SpscRing<Record> ring_;
+  base::subtle::Atomic32 dropped_records_;
+  base::TimeDelta drain_interval_;
+  base::Thread writer_thread_;
+
+  // Only accessed from |writer_thread_|.
+  base::File file_;
+  scoped_ptr<base::RepeatingTimer<MessageCapture> > drain_timer_;
+  std::string buffer_;
+
+  DISALLOW_COPY_AND_ASSIGN(MessageCapture);
+};
+
+inline void swap(MessageCapture::Record &a, MessageCapture::Record &b) {
+  a.swap(b);
+}
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_MESSAGE_CAPTURE_H_
@@ -0,0 +1,158 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/message_capture.h"
+
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const char kInvite[] =
+  "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n";
+
+scoped_refptr<base::RefCountedString> MakeBytes(const char *data) {
+  std::string copy(data);
+  return base::RefCountedString::TakeString(&copy);
+}
+
+uint16 ReadUint16(const std::string &data, size_t offset) {
+  return (static_cast<uint8>(data[offset]) << 8)
+      | static_cast<uint8>(data[offset + 1]);
+}
+
+// Finds the chunk of |type| in |packet|, returning its payload.
+bool FindChunk(const std::string &packet, uint16 type, std::string *payload) {
+  size_t offset = 6;
+  while (offset + 6 <= packet.size()) {
+    uint16 length = ReadUint16(packet, offset + 4);
+    if (ReadUint16(packet, offset + 2) == type) {
+      payload->assign(packet, offset + 6, length - 6);
+      return true;
+    }
+    offset += length;
+  }
+  return false;
+}
+
+}  // namespace
+
+TEST(MessageCaptureTest, EncodeHep3) {
+  MessageCapture::Record record;
+  record.direction = MessageCapture::OUTGOING;
+  record.time = base::Time::UnixEpoch() + base::TimeDelta::FromSeconds(10);
+  record.local = EndPoint("192.168.0.1", 5060, Protocol::TLS);
+  record.remote = EndPoint("10.0.0.2", 5061, Protocol::TLS);
+  record.bytes = MakeBytes(kInvite);
+
+  std::string packet;
+  MessageCapture::EncodeHep3(record, &packet);
+  ASSERT_LT(6u, packet.size());
+  EXPECT_EQ("HEP3", packet.substr(0, 4));
+  EXPECT_EQ(packet.size(), ReadUint16(packet, 4));
+
+  std::string chunk;
+  ASSERT_TRUE(FindChunk(packet, 0x0001, &chunk));
+  EXPECT_EQ(std::string(1, 2), chunk);  // IPv4
+  ASSERT_TRUE(FindChunk(packet, 0x0002, &chunk));
+  EXPECT_EQ(std::string(1, 6), chunk);  // TCP
+  ASSERT_TRUE(FindChunk(packet, 0x0003, &chunk));
+  EXPECT_EQ(std::string("\xc0\xa8\x00\x01", 4), chunk);
+  ASSERT_TRUE(FindChunk(packet, 0x0004, &chunk));
+  EXPECT_EQ(std::string("\x0a\x00\x00\x02", 4), chunk);
+  ASSERT_TRUE(FindChunk(packet, 0x0008, &chunk));
+  EXPECT_EQ(5061, ReadUint16(chunk, 0));
+  ASSERT_TRUE(FindChunk(packet, 0x0009, &chunk));
+  EXPECT_EQ(std::string("\x00\x00\x00\x0a", 4), chunk);
+  ASSERT_TRUE(FindChunk(packet, 0x000f, &chunk));
+  EXPECT_EQ(kInvite, chunk);
+}
+
+TEST(MessageCaptureTest, IncomingFromHostName) {
+  MessageCapture::Record record;
+  record.local = EndPoint("::1", 5060, Protocol::UDP);
+  record.remote = EndPoint("example.com", 5060, Protocol::UDP);
+  record.bytes = MakeBytes(kInvite);
+
+  std::string packet;
+  MessageCapture::EncodeHep3(record, &packet);
+  std::string chunk;
+  ASSERT_TRUE(FindChunk(packet, 0x0001, &chunk));
+  EXPECT_EQ(std::string(1, 10), chunk);  // IPv6
+  ASSERT_TRUE(FindChunk(packet, 0x0005, &chunk));
+  EXPECT_EQ(std::string(16, 0), chunk);
+  ASSERT_TRUE(FindChunk(packet, 0x0006, &chunk));
+  EXPECT_EQ(16u, chunk.size());
+  EXPECT_EQ(1, chunk[15]);
+}
+
+TEST(MessageCaptureTest, DecodeHep3) {
+  MessageCapture::Record outgoing;
+  outgoing.direction = MessageCapture::OUTGOING;
+  outgoing.time = base::Time::UnixEpoch()
+      + base::TimeDelta::FromMicroseconds(10000123);
+  outgoing.local = EndPoint("192.168.0.1", 5060, Protocol::UDP);
+  outgoing.remote = EndPoint("10.0.0.2", 5070, Protocol::UDP);
+  outgoing.bytes = MakeBytes(kInvite);
+  MessageCapture::Record incoming;
+  incoming.local = EndPoint("::1", 5060, Protocol::TCP);
+  incoming.remote = EndPoint("::2", 5080, Protocol::TCP);
+  incoming.bytes = MakeBytes(kInvite);
+
+  std::string packets;
+  MessageCapture::EncodeHep3(outgoing, &packets);
+  MessageCapture::EncodeHep3(incoming, &packets);
+  base::StringPiece input(packets);
+
+  // Decoded as received by the destination.
+  MessageCapture::Record record;
+  ASSERT_TRUE(MessageCapture::DecodeHep3(&input, &record));
+  EXPECT_EQ(MessageCapture::INCOMING, record.direction);
+  EXPECT_EQ(outgoing.time, record.time);
+  EXPECT_EQ(outgoing.local, record.remote);
+  EXPECT_EQ(outgoing.remote, record.local);
+  ASSERT_TRUE(record.bytes.get());
+  EXPECT_EQ(kInvite, record.bytes->data());
+
+  ASSERT_TRUE(MessageCapture::DecodeHep3(&input, &record));
+  EXPECT_EQ(incoming.local, record.local);
+  EXPECT_EQ(incoming.remote, record.remote);
+  EXPECT_TRUE(input.empty());
+
+  EXPECT_FALSE(MessageCapture::DecodeHep3(&input, &record));
+  base::StringPiece truncated(packets.data(), 20);
+  EXPECT_FALSE(MessageCapture::DecodeHep3(&truncated, &record));
+}
+
+TEST(MessageCaptureTest, DropsWhenFullAndWrites) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath path(temp_dir.path().AppendASCII("capture.hep"));
+
+  MessageCapture capture(2);
+  EndPoint local("127.0.0.1", 5060, Protocol::UDP);
+  EndPoint remote("127.0.0.1", 5070, Protocol::UDP);
+  for (int i = 0; i < 3; ++i) {
+    capture.Capture(MessageCapture::INCOMING, local, remote,
+                    MakeBytes(kInvite));
+  }
+  EXPECT_EQ(1, capture.dropped_records());
+
+  ASSERT_TRUE(capture.Start(path));
+  capture.Stop();
+
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(path, &contents));
+  ASSERT_LT(6u, contents.size());
+  uint16 length = ReadUint16(contents, 4);
+  ASSERT_EQ(2u * length, contents.size());
+  EXPECT_EQ("HEP3", contents.substr(length, 4));
+}
+
+} // End of sippet namespace
@@ -0,0 +1,209 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/message_compressor.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/logging.h"
+#include "third_party/zlib/zlib.h"
+
+namespace sippet {
+
+namespace {
+
+const int kWindowBits = 15;
+const size_t kMaxDictionarySize = 1 << kWindowBits;
+const size_t kChunkSize = 4 * 1024;
+
+// Strings found in most SIP messages and their SDP bodies. Deflate refers
+// back to the nearest match, so the most frequent ones come last.
+const char kStaticDictionary[] =
+    "application/pidf+xmlapplication/isupmultipart/mixed"
+    "Proxy-AuthenticateProxy-AuthorizationWWW-AuthenticateAuthorization: "
+    "Digest username=\"realm=\"nonce=\"uri=\"response=\"algorithm=MD5"
+    "qop=authopaque=\"cnonce=\"nc=00000001stale=FALSE"
+    "Subscription-State: active;expires=Event: presenceallow-events"
+    "P-Asserted-Identity: Privacy: Reason: Q.850;cause=Refer-To: "
+    "Referred-By: Replaces: Session-Expires: Min-SE: refresher=uac"
+    "Record-Route: <sip:;lr>Route: <sip:Path: Service-Route: "
+    "Accept-Encoding: Accept-Language: Accept: application/sdp"
+    "Supported: timer, 100rel, replaces, pathRequire: Unsupported: "
+    "Allow: INVITE, ACK, CANCEL, BYE, OPTIONS, PRACK, UPDATE, INFO, "
+    "NOTIFY, SUBSCRIBE, REFER, MESSAGE, REGISTERUser-Agent: Server: "
+    "Warning: Retry-After: Date: Expires: 3600Min-Expires: "
+    "Content-Disposition: session;handling=requiredRSeq: RAck: "
+    "SIP/2.0 100 TryingSIP/2.0 180 RingingSIP/2.0 183 Session Progress"
+    "SIP/2.0 401 UnauthorizedSIP/2.0 407 Proxy Authentication Required"
+    "SIP/2.0 486 Busy HereSIP/2.0 487 Request Terminated"
+    "SIP/2.0 481 Call/Transaction Does Not Exist"
+    "SIP/2.0 200 OK\r\n"
+    "v=0\r\no=- IN IP4 s=-\r\nc=IN IP4 t=0 0\r\nm=audio RTP/AVP "
+    "a=rtpmap:0 PCMU/8000\r\na=rtpmap:8 PCMA/8000\r\n"
+    "a=rtpmap:101 telephone-event/8000\r\na=fmtp:101 0-15\r\n"
+    "a=ptime:20\r\na=sendrecv\r\n"
+    "Max-Forwards: 70\r\nContent-Type: application/sdp\r\n"
+    "Content-Length: 0\r\n"
+    "Contact: <sip:>;expires=;q=;+sip.instance=\"<urn:uuid:>\";reg-id=1"
+    "From: <sip:>;tag=To: <sip:>;tag=Call-ID: CSeq: 1 "
+    "Via: SIP/2.0/UDP ;branch=z9hG4bK;rport;received=;comp=x-dict\r\n"
+    "INVITE sip:ACK sip:BYE sip:CANCEL sip:REGISTER sip: SIP/2.0\r\n";
+
+uint32 DictionaryId(const std::string &dictionary) {
+  uLong id = adler32(0L, Z_NULL, 0);
+  return static_cast<uint32>(adler32(id,
+      reinterpret_cast<const Bytef*>(dictionary.data()),
+      static_cast<uInt>(dictionary.size())));
+}
+
+}  // namespace
+
+const char MessageCompressor::kCompressionName[] = "x-dict";
+
+MessageCompressor::State::State() : id(0) {
+}
+
+MessageCompressor::State::~State() {
+}
+
+MessageCompressor::MessageCompressor()
+  : peer_decompresses_(false) {
+  MakeState(base::StringPiece(), &static_state_);
+  received_state_ = static_state_;
+}
+
+MessageCompressor::~MessageCompressor() {
+}
+
+bool MessageCompressor::Compress(const base::StringPiece &message,
+                                 std::string *output) {
+  DCHECK(output);
+  State sent;
+  MakeState(message, &sent);
+  // A retransmission only refreshes its state.
+  for (std::deque<State>::iterator i = sent_states_.begin(),
+       ie = sent_states_.end(); i != ie; ++i) {
+    if (i->id == sent.id) {
+      sent_states_.erase(i);
+      break;
+    }
+  }
+  sent_states_.push_back(State());
+  sent_states_.back().dictionary.swap(sent.dictionary);
+  sent_states_.back().id = sent.id;
+  if (sent_states_.size() > kMaxSentStates)
+    sent_states_.pop_front();
+  if (!peer_decompresses_ || message.empty())
+    return false;
+
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (Z_OK != deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED,
+                           kWindowBits, 8, Z_DEFAULT_STRATEGY))
+    return false;
+  const std::string &dictionary = received_state_.dictionary;
+  deflateSetDictionary(&stream,
+      reinterpret_cast<const Bytef*>(dictionary.data()),
+      static_cast<uInt>(dictionary.size()));
+  uLong bound = deflateBound(&stream, static_cast<uLong>(message.size()));
+  output->resize(1 + bound);
+  (*output)[0] = kCompressedPrefix;
+  stream.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(message.data()));
+  stream.avail_in = static_cast<uInt>(message.size());
+  stream.next_out = reinterpret_cast<Bytef*>(&(*output)[1]);
+  stream.avail_out = static_cast<uInt>(bound);
+  int result = deflate(&stream, Z_FINISH);
+  output->resize(1 + bound - stream.avail_out);
+  deflateEnd(&stream);
+  if (Z_STREAM_END != result || output->size() >= message.size()) {
+    output->clear();
+    return false;
+  }
+  return true;
+}
+
+bool MessageCompressor::Decompress(const base::StringPiece &datagram,
+                                   size_t max_size,
+                                   std::string *output) {
+  DCHECK(IsCompressed(datagram));
+  DCHECK(output);
+  output->clear();
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (Z_OK != inflateInit2(&stream, kWindowBits))
+    return false;
+  stream.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(datagram.data() + 1));
+  stream.avail_in = static_cast<uInt>(datagram.size() - 1);
+  int result = Z_OK;
+  while (Z_OK == result) {
+    size_t size = output->size();
+    if (size >= max_size) {
+      result = Z_BUF_ERROR;
+      break;
+    }
+    size_t chunk = std::min(kChunkSize, max_size - size);
+    output->resize(size + chunk);
+    stream.next_out = reinterpret_cast<Bytef*>(&(*output)[size]);
+    stream.avail_out = static_cast<uInt>(chunk);
+    result = inflate(&stream, Z_NO_FLUSH);
+    output->resize(size + chunk - stream.avail_out);
+    if (Z_NEED_DICT == result) {
+      const State *state = FindState(static_cast<uint32>(stream.adler));
+      if (!state) {
+        DVLOG(1) << "Compressed message referring to an unknown state";
+        break;
+      }
+      result = inflateSetDictionary(&stream,
+          reinterpret_cast<const Bytef*>(state->dictionary.data()),
+          static_cast<uInt>(state->dictionary.size()));
+    } else if (Z_OK == result && 0 == stream.avail_in
+               && 0 != stream.avail_out) {
+      // Truncated
+      result = Z_DATA_ERROR;
+    }
+  }
+  inflateEnd(&stream);
+  if (Z_STREAM_END != result) {
+    output->clear();
+    return false;
+  }
+  peer_decompresses_ = true;
+  DidReceive(*output);
+  return true;
+}
+
+void MessageCompressor::DidReceive(const base::StringPiece &message) {
+  if (message.empty() || '\r' == message[0] || '\n' == message[0])
+    return;
+  MakeState(message, &received_state_);
+}
+
+void MessageCompressor::MakeState(const base::StringPiece &message,
+                                  State *state) const {
+  state->dictionary.assign(kStaticDictionary, sizeof(kStaticDictionary) - 1);
+  message.AppendToString(&state->dictionary);
+  // zlib only uses the end of larger dictionaries.
+  if (state->dictionary.size() > kMaxDictionarySize) {
+    state->dictionary.erase(0,
+        state->dictionary.size() - kMaxDictionarySize);
+  }
+  state->id = DictionaryId(state->dictionary);
+}
+
+const MessageCompressor::State *MessageCompressor::FindState(
+    uint32 id) const {
+  for (std::deque<State>::const_reverse_iterator i = sent_states_.rbegin(),
+       ie = sent_states_.rend(); i != ie; ++i) {
+    if (i->id == id)
+      return &*i;
+  }
+  if (static_state_.id == id)
+    return &static_state_;
+  return NULL;
+}
+
+} // End of sippet namespace
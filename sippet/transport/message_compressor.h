@@ -0,0 +1,94 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_MESSAGE_COMPRESSOR_H_
+#define SIPPET_TRANSPORT_MESSAGE_COMPRESSOR_H_
+
+#include <deque>
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/strings/string_piece.h"
+
+namespace sippet {
+
+// Compresses the messages of a flow, such as a UDP channel, for links where
+// the message size drives the call setup latency. It follows the ideas of
+// SigComp (RFC 3320) without its bytecode machine: messages are deflated
+// with a preset dictionary, made of a static SIP dictionary in the spirit of
+// RFC 3485, followed by the last message received from the peer. The peer
+// keeps the last messages it sent, and finds the one used by the dictionary
+// id of the zlib stream.
+//
+// Support is advertised with the Via parameter comp=|kCompressionName|
+// (RFC 3486). Messages are only compressed once the peer has shown it can
+// decode them, by sending a request with such a Via or a compressed message;
+// until then they're sent as they are, but still kept as states the peer
+// may refer to.
+class MessageCompressor {
+ public:
+  // The value of the Via comp= parameter.
+  static const char kCompressionName[];
+
+  // The first byte of compressed messages. As with SigComp, it can't start
+  // a SIP message.
+  static const char kCompressedPrefix = '\xf8';
+
+  // Number of sent messages kept for the peer to refer to. Retransmissions
+  // take a single one.
+  static const size_t kMaxSentStates = 4;
+
+  MessageCompressor();
+  ~MessageCompressor();
+
+  static bool IsCompressed(const base::StringPiece &datagram) {
+    return !datagram.empty() && kCompressedPrefix == datagram[0];
+  }
+
+  // Whether the peer can decode compressed messages: it has sent one, or
+  // advertised it in the Via of a request.
+  bool peer_decompresses() const { return peer_decompresses_; }
+  void set_peer_decompresses(bool value) { peer_decompresses_ = value; }
+
+  // Records |message| as sent, and compresses it into |output| if the peer
+  // can decode it. Returns false, leaving |message| to be sent as is, if
+  // it can't or the result wouldn't be smaller.
+  bool Compress(const base::StringPiece &message, std::string *output);
+
+  // Decodes a compressed |datagram| into |output|, recording it as received.
+  // Fails if it's malformed, if it refers to a message no longer kept, or if
+  // the output would exceed |max_size|.
+  bool Decompress(const base::StringPiece &datagram,
+                  size_t max_size,
+                  std::string *output);
+
+  // Records a message received uncompressed. Keep-alives are ignored.
+  void DidReceive(const base::StringPiece &message);
+
+ private:
+  struct State {
+    State();
+    ~State();
+
+    // The static dictionary followed by the message, cut to the zlib
+    // window.
+    std::string dictionary;
+    // The zlib id (its Adler-32) of |dictionary|.
+    uint32 id;
+  };
+
+  void MakeState(const base::StringPiece &message, State *state) const;
+  const State *FindState(uint32 id) const;
+
+  State static_state_;
+  State received_state_;
+  std::deque<State> sent_states_;
+  bool peer_decompresses_;
+
+  DISALLOW_COPY_AND_ASSIGN(MessageCompressor);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_MESSAGE_COMPRESSOR_H_
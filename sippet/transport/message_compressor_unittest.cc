@@ -0,0 +1,131 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/message_compressor.h"
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const size_t kMaxSize = 64 * 1024;
+
+const char kInvite[] =
+    "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds"
+    ";comp=x-dict\r\n"
+    "Max-Forwards: 70\r\n"
+    "To: Bob <sip:bob@biloxi.com>\r\n"
+    "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+    "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+    "CSeq: 314159 INVITE\r\n"
+    "Contact: <sip:alice@pc33.atlanta.com>\r\n"
+    "Content-Type: application/sdp\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n";
+
+const char kRinging[] =
+    "SIP/2.0 180 Ringing\r\n"
+    "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds"
+    ";comp=x-dict\r\n"
+    "To: Bob <sip:bob@biloxi.com>;tag=a6c85cf\r\n"
+    "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+    "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+    "CSeq: 314159 INVITE\r\n"
+    "Contact: <sip:bob@192.0.2.4>\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n";
+
+const char kOk[] =
+    "SIP/2.0 200 OK\r\n"
+    "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds"
+    ";comp=x-dict\r\n"
+    "To: Bob <sip:bob@biloxi.com>;tag=a6c85cf\r\n"
+    "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+    "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+    "CSeq: 314159 INVITE\r\n"
+    "Contact: <sip:bob@192.0.2.4>\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n";
+
+}  // namespace
+
+TEST(MessageCompressorTest, Exchange) {
+  MessageCompressor alice;
+  MessageCompressor bob;
+  std::string datagram;
+  std::string message;
+
+  // Nothing is compressed before the peer shows it decompresses.
+  EXPECT_FALSE(alice.Compress(kInvite, &datagram));
+  EXPECT_FALSE(MessageCompressor::IsCompressed(kInvite));
+  bob.DidReceive(kInvite);
+  bob.set_peer_decompresses(true);
+
+  // The responses refer to the INVITE kept by Alice.
+  ASSERT_TRUE(bob.Compress(kRinging, &datagram));
+  EXPECT_TRUE(MessageCompressor::IsCompressed(datagram));
+  EXPECT_LT(datagram.size(), sizeof(kRinging) / 2);
+  EXPECT_FALSE(alice.peer_decompresses());
+  ASSERT_TRUE(alice.Decompress(datagram, kMaxSize, &message));
+  EXPECT_EQ(kRinging, message);
+  EXPECT_TRUE(alice.peer_decompresses());
+  ASSERT_TRUE(bob.Compress(kOk, &datagram));
+  ASSERT_TRUE(alice.Decompress(datagram, kMaxSize, &message));
+  EXPECT_EQ(kOk, message);
+
+  // Then Alice's messages refer to the last response.
+  std::string ack(kInvite);
+  ack.replace(0, 6, "ACK");
+  ASSERT_TRUE(alice.Compress(ack, &datagram));
+  ASSERT_TRUE(bob.Decompress(datagram, kMaxSize, &message));
+  EXPECT_EQ(ack, message);
+
+  // Malformed, truncated or too large messages aren't decoded.
+  EXPECT_FALSE(bob.Decompress(
+      std::string(1, MessageCompressor::kCompressedPrefix), kMaxSize,
+      &message));
+  EXPECT_FALSE(bob.Decompress(datagram.substr(0, datagram.size() / 2),
+                              kMaxSize, &message));
+  EXPECT_FALSE(bob.Decompress(datagram, ack.size() - 1, &message));
+  EXPECT_TRUE(message.empty());
+}
+
+TEST(MessageCompressorTest, States) {
+  MessageCompressor alice;
+  MessageCompressor bob;
+  bob.set_peer_decompresses(true);
+  std::string datagram;
+  std::string message;
+
+  // Without any message received, only the static dictionary is used.
+  ASSERT_TRUE(bob.Compress(kOk, &datagram));
+  ASSERT_TRUE(alice.Decompress(datagram, kMaxSize, &message));
+  EXPECT_EQ(kOk, message);
+
+  // Retransmissions don't push the other states out.
+  alice.Compress(kInvite, &datagram);
+  bob.DidReceive(kInvite);
+  for (size_t i = 0; i < MessageCompressor::kMaxSentStates; ++i)
+    alice.Compress(kRinging, &datagram);
+  ASSERT_TRUE(bob.Compress(kOk, &datagram));
+  EXPECT_TRUE(alice.Decompress(datagram, kMaxSize, &message));
+
+  // But the peer fails to find the states no longer kept.
+  std::string state(kInvite);
+  for (size_t i = 0; i < MessageCompressor::kMaxSentStates; ++i) {
+    state += "a";
+    alice.Compress(state, &datagram);
+  }
+  ASSERT_TRUE(bob.Compress(kOk, &datagram));
+  EXPECT_FALSE(alice.Decompress(datagram, kMaxSize, &message));
+
+  // Keep-alives aren't states.
+  bob.DidReceive("\r\n");
+  ASSERT_TRUE(bob.Compress(kOk, &datagram));
+  EXPECT_FALSE(alice.Decompress(datagram, kMaxSize, &message));
+}
+
+}  // namespace sippet
@@ -0,0 +1,58 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/message_limits.h"
+
+#include <algorithm>
+
+#include "sippet/message/message.h"
+
+namespace sippet {
+
+namespace {
+
+// Total of the entries of all |HeaderType| headers, stopping as soon as
+// |max| is exceeded.
+template<class HeaderType>
+size_t CountEntries(const Message &message, size_t max) {
+  size_t count = 0;
+  for (Message::const_iterator i = message.find_first<HeaderType>(),
+       ie = message.end(); i != ie && count <= max;
+       i = message.find_next<HeaderType>(i)) {
+    count += dyn_cast<HeaderType>(&*i)->size();
+  }
+  return count;
+}
+
+}  // namespace
+
+bool MessageLimits::AdmitsHead(const base::StringPiece &head,
+                               bool complete) const {
+  if (max_head_size > 0 && head.size() > max_head_size)
+    return false;
+  // Lines are only counted once, not at every read of an incomplete head;
+  // its size bounds them meanwhile.
+  if (complete && max_header_lines > 0) {
+    // The start line and the terminating empty line aren't headers.
+    size_t lines = std::count(head.begin(), head.end(), '\n');
+    if (lines > max_header_lines + 2)
+      return false;
+  }
+  return true;
+}
+
+bool MessageLimits::AdmitsMessage(const Message &message) const {
+  if (max_via_entries > 0
+      && CountEntries<Via>(message, max_via_entries) > max_via_entries)
+    return false;
+  if (max_route_entries > 0
+      && (CountEntries<Route>(message, max_route_entries)
+              > max_route_entries
+          || CountEntries<RecordRoute>(message, max_route_entries)
+              > max_route_entries))
+    return false;
+  return true;
+}
+
+} // End of sippet namespace
@@ -0,0 +1,62 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_MESSAGE_LIMITS_H_
+#define SIPPET_TRANSPORT_MESSAGE_LIMITS_H_
+
+#include <stddef.h>
+
+#include "base/strings/string_piece.h"
+
+namespace sippet {
+
+class Message;
+
+// Bounds of the incoming messages, enforced by the readers while framing
+// them, so that the memory held by each connection stays bounded and
+// pathological messages don't reach the parser, or the application. The
+// size of the head is checked as it's received, its lines once its end is
+// found, before it's parsed, and the routing entries right after. Messages
+// over the limits fail the read with |net::ERR_MSG_TOO_BIG|, which closes
+// stream channels. Zero limits are not checked.
+struct MessageLimits {
+  MessageLimits()
+    : max_head_size(0),
+      max_header_lines(0),
+      max_content_size(0),
+      max_via_entries(0),
+      max_route_entries(0) {}
+
+  bool IsEnabled() const {
+    return max_head_size > 0 || max_header_lines > 0
+        || max_content_size > 0 || max_via_entries > 0
+        || max_route_entries > 0;
+  }
+
+  // Whether |head|, including its terminating empty line if |complete|, or
+  // what was received of it so far otherwise, is within the limits.
+  bool AdmitsHead(const base::StringPiece &head, bool complete) const;
+
+  bool AdmitsContentLength(size_t content_length) const {
+    return 0 == max_content_size || content_length <= max_content_size;
+  }
+
+  // Whether the entries of the Via, and of the Route and Record-Route
+  // headers of the parsed |message| are within the limits. Those headers
+  // are decoded.
+  bool AdmitsMessage(const Message &message) const;
+
+  // Bytes of the start line and headers.
+  size_t max_head_size;
+  // Header lines, folded ones included.
+  size_t max_header_lines;
+  size_t max_content_size;
+  size_t max_via_entries;
+  // Entries of the Route and Record-Route headers, each.
+  size_t max_route_entries;
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_MESSAGE_LIMITS_H_
@@ -0,0 +1,78 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/message_limits.h"
+
+#include "sippet/message/message.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const char kInvite[] =
+  "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds\r\n"
+  "Via: SIP/2.0/UDP bigbox3.site3.atlanta.com;branch=z9hG4bK77ef4c2312983.1,"
+      " SIP/2.0/UDP 192.0.2.1;branch=z9hG4bKnashds8\r\n"
+  "Route: <sip:p1.example.com;lr>, <sip:p2.example.com;lr>\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n";
+
+}  // namespace
+
+TEST(MessageLimitsTest, Disabled) {
+  MessageLimits limits;
+  EXPECT_FALSE(limits.IsEnabled());
+  EXPECT_TRUE(limits.AdmitsHead(kInvite, true));
+  EXPECT_TRUE(limits.AdmitsContentLength(1 << 30));
+  scoped_refptr<Message> message(Message::Parse(kInvite));
+  ASSERT_TRUE(message);
+  EXPECT_TRUE(limits.AdmitsMessage(*message));
+}
+
+TEST(MessageLimitsTest, Head) {
+  base::StringPiece head(kInvite);
+  MessageLimits limits;
+  limits.max_head_size = head.size();
+  EXPECT_TRUE(limits.AdmitsHead(head, true));
+  limits.max_head_size = head.size() - 1;
+  EXPECT_FALSE(limits.AdmitsHead(head, false));
+
+  // The start line and the empty line aren't counted; lines are only
+  // checked once the head is complete.
+  limits.max_head_size = 0;
+  limits.max_header_lines = 4;
+  EXPECT_TRUE(limits.AdmitsHead(head, true));
+  limits.max_header_lines = 3;
+  EXPECT_FALSE(limits.AdmitsHead(head, true));
+  EXPECT_TRUE(limits.AdmitsHead(head, false));
+}
+
+TEST(MessageLimitsTest, ContentLength) {
+  MessageLimits limits;
+  limits.max_content_size = 1024;
+  EXPECT_TRUE(limits.AdmitsContentLength(1024));
+  EXPECT_FALSE(limits.AdmitsContentLength(1025));
+}
+
+TEST(MessageLimitsTest, RoutingEntries) {
+  scoped_refptr<Message> message(Message::Parse(kInvite));
+  ASSERT_TRUE(message);
+
+  // Entries of all the Via headers are added up.
+  MessageLimits limits;
+  limits.max_via_entries = 3;
+  EXPECT_TRUE(limits.AdmitsMessage(*message));
+  limits.max_via_entries = 2;
+  EXPECT_FALSE(limits.AdmitsMessage(*message));
+
+  limits.max_via_entries = 0;
+  limits.max_route_entries = 2;
+  EXPECT_TRUE(limits.AdmitsMessage(*message));
+  limits.max_route_entries = 1;
+  EXPECT_FALSE(limits.AdmitsMessage(*message));
+}
+
+}  // namespace sippet
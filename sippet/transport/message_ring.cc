@@ -0,0 +1,177 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/message_ring.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/logging.h"
+#include "sippet/message/message.h"
+
+namespace sippet {
+
+namespace {
+
+// Tells a mapped region holds a ring ("SIPR").
+const uint32 kRingMagic = 0x53495052;
+
+const size_t kMinCapacity = 4096;
+const size_t kMaxCapacity = 1 << 30;
+
+// Records are prefixed by their size.
+typedef uint32 RecordSize;
+
+}  // namespace
+
+// Lives at the start of the region, followed by the buffer. The positions
+// keep growing, wrapping at 2^32; each one is written by a single side, and
+// is kept on its own cache line so that both sides don't contend for it.
+struct MessageRing::Header {
+  uint32 magic;
+  uint32 capacity;
+  char padding0[56];
+  base::subtle::Atomic32 write_position;
+  char padding1[60];
+  base::subtle::Atomic32 read_position;
+  char padding2[60];
+};
+
+MessageRing::MessageRing(scoped_ptr<base::SharedMemory> shared_memory,
+                         size_t capacity)
+  : shared_memory_(shared_memory.Pass()),
+    header_(static_cast<Header*>(shared_memory_->memory())),
+    buffer_(static_cast<char*>(shared_memory_->memory()) + sizeof(Header)),
+    mask_(static_cast<uint32>(capacity - 1)) {
+}
+
+MessageRing::~MessageRing() {
+}
+
+// static
+scoped_ptr<MessageRing> MessageRing::Create(size_t capacity) {
+  capacity = std::max(capacity, kMinCapacity);
+  if (capacity > kMaxCapacity)
+    return scoped_ptr<MessageRing>();
+  size_t rounded = kMinCapacity;
+  while (rounded < capacity)
+    rounded <<= 1;
+
+  scoped_ptr<base::SharedMemory> shared_memory(new base::SharedMemory);
+  if (!shared_memory->CreateAndMapAnonymous(sizeof(Header) + rounded)) {
+    LOG(WARNING) << "Failed to create a message ring of " << rounded
+                 << " bytes";
+    return scoped_ptr<MessageRing>();
+  }
+  Header *header = static_cast<Header*>(shared_memory->memory());
+  memset(header, 0, sizeof(Header));
+  header->magic = kRingMagic;
+  header->capacity = static_cast<uint32>(rounded);
+  return scoped_ptr<MessageRing>(
+      new MessageRing(shared_memory.Pass(), rounded));
+}
+
+// static
+scoped_ptr<MessageRing> MessageRing::Open(
+    const base::SharedMemoryHandle &handle) {
+  scoped_ptr<base::SharedMemory> shared_memory(
+      new base::SharedMemory(handle, false));
+  // The size of the region is only known once its header is mapped.
+  if (!shared_memory->Map(sizeof(Header)))
+    return scoped_ptr<MessageRing>();
+  const Header *header = static_cast<const Header*>(shared_memory->memory());
+  uint32 capacity = header->capacity;
+  if (kRingMagic != header->magic || capacity < kMinCapacity
+      || capacity > kMaxCapacity || (capacity & (capacity - 1)) != 0) {
+    LOG(WARNING) << "Shared memory doesn't hold a message ring";
+    return scoped_ptr<MessageRing>();
+  }
+  shared_memory->Unmap();
+  if (!shared_memory->Map(sizeof(Header) + capacity))
+    return scoped_ptr<MessageRing>();
+  return scoped_ptr<MessageRing>(
+      new MessageRing(shared_memory.Pass(), capacity));
+}
+
+bool MessageRing::Write(const base::StringPiece &record) {
+  if (record.size() > capacity() - sizeof(RecordSize))
+    return false;
+  uint32 write = static_cast<uint32>(
+      base::subtle::NoBarrier_Load(&header_->write_position));
+  // Acquired, so that the consumer is done with the bytes reused here.
+  uint32 read = static_cast<uint32>(
+      base::subtle::Acquire_Load(&header_->read_position));
+  uint32 used = write - read;
+  if (used > capacity()
+      || capacity() - used < sizeof(RecordSize) + record.size())
+    return false;
+  RecordSize size = static_cast<RecordSize>(record.size());
+  CopyIn(write, reinterpret_cast<const char*>(&size), sizeof(size));
+  CopyIn(write + sizeof(size), record.data(), record.size());
+  // Released, so that the record is complete once the consumer sees it.
+  base::subtle::Release_Store(&header_->write_position,
+      static_cast<base::subtle::Atomic32>(write + sizeof(size) + size));
+  return true;
+}
+
+bool MessageRing::WriteMessage(const Message &message) {
+  scratch_.clear();
+  message.SerializeBinary(&scratch_);
+  return Write(scratch_);
+}
+
+bool MessageRing::Read(std::string *record) {
+  uint32 read = static_cast<uint32>(
+      base::subtle::NoBarrier_Load(&header_->read_position));
+  uint32 write = static_cast<uint32>(
+      base::subtle::Acquire_Load(&header_->write_position));
+  uint32 available = write - read;
+  if (0 == available)
+    return false;
+  RecordSize size = 0;
+  if (available >= sizeof(size))
+    CopyOut(read, reinterpret_cast<char*>(&size), sizeof(size));
+  if (available < sizeof(size) || available > capacity()
+      || size > available - sizeof(size)) {
+    // The other side is broken; what's left can't be trusted.
+    LOG(WARNING) << "Dropping " << available << " bytes of a broken ring";
+    base::subtle::Release_Store(&header_->read_position,
+        static_cast<base::subtle::Atomic32>(write));
+    return false;
+  }
+  record->resize(size);
+  if (size > 0)
+    CopyOut(read + sizeof(size), &(*record)[0], size);
+  base::subtle::Release_Store(&header_->read_position,
+      static_cast<base::subtle::Atomic32>(read + sizeof(size) + size));
+  return true;
+}
+
+scoped_refptr<Message> MessageRing::ReadMessage(bool *empty) {
+  *empty = !Read(&scratch_);
+  if (*empty)
+    return NULL;
+  return Message::ParseBinary(scratch_);
+}
+
+bool MessageRing::IsEmpty() const {
+  return base::subtle::Acquire_Load(&header_->write_position)
+      == base::subtle::NoBarrier_Load(&header_->read_position);
+}
+
+void MessageRing::CopyIn(uint32 position, const char *data, size_t size) {
+  size_t offset = position & mask_;
+  size_t first = std::min(size, capacity() - offset);
+  memcpy(buffer_ + offset, data, first);
+  memcpy(buffer_, data + first, size - first);
+}
+
+void MessageRing::CopyOut(uint32 position, char *data, size_t size) const {
+  size_t offset = position & mask_;
+  size_t first = std::min(size, capacity() - offset);
+  memcpy(data, buffer_ + offset, first);
+  memcpy(data + first, buffer_, size - first);
+}
+
+} // End of sippet namespace
@@ -0,0 +1,89 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_MESSAGE_RING_H_
+#define SIPPET_TRANSPORT_MESSAGE_RING_H_
+
+#include <string>
+
+#include "base/atomicops.h"
+#include "base/basictypes.h"
+#include "base/memory/ref_counted.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/memory/shared_memory.h"
+#include "base/strings/string_piece.h"
+
+namespace sippet {
+
+class Message;
+
+// A single producer, single consumer queue of messages laid out in a shared
+// memory region, so that a process can hand messages over to another one
+// (e.g. a frontend owning the sockets, and its workers) without any system
+// call. Messages are written in the form of |Message::SerializeBinary|, as
+// length-prefixed records in a circular buffer.
+//
+// The region is created by one process with |Create|, and mapped by the
+// other one with |Open|, from a handle shared with it (see
+// |base::SharedMemory::ShareToProcess|). Either process may be the
+// producer, but each ring has exactly one; a pair of rings carries
+// messages both ways.
+//
+// Neither side blocks: |Write| fails when the ring is full, and |Read| when
+// it is empty, so the consumer has to poll (see |RingChannel|).
+class MessageRing {
+ public:
+  ~MessageRing();
+
+  // Creates a ring able to hold |capacity| bytes of records, rounded up to
+  // a power of two, in a new shared memory region. Returns NULL on failure.
+  static scoped_ptr<MessageRing> Create(size_t capacity);
+
+  // Maps the ring created by |Create| in another process. Returns NULL if
+  // the region can't be mapped, or doesn't hold a ring.
+  static scoped_ptr<MessageRing> Open(const base::SharedMemoryHandle &handle);
+
+  // The region holding the ring, to be shared with the other process.
+  base::SharedMemory *shared_memory() { return shared_memory_.get(); }
+
+  // Bytes available for records.
+  size_t capacity() const { return mask_ + 1; }
+
+  // Appends |record|, returning false if there isn't enough room for it.
+  bool Write(const base::StringPiece &record);
+
+  // Appends |message|, serialized by |Message::SerializeBinary|.
+  bool WriteMessage(const Message &message);
+
+  // Takes the oldest record into |record|, returning false if there's none.
+  bool Read(std::string *record);
+
+  // Takes the oldest message, NULL if the ring is empty or the message
+  // can't be parsed; |empty| tells both cases apart.
+  scoped_refptr<Message> ReadMessage(bool *empty);
+
+  bool IsEmpty() const;
+
+ private:
+  struct Header;
+
+  MessageRing(scoped_ptr<base::SharedMemory> shared_memory, size_t capacity);
+
+  // Copies from and to the circular buffer at |position|, wrapping around.
+  void CopyIn(uint32 position, const char *data, size_t size);
+  void CopyOut(uint32 position, char *data, size_t size) const;
+
+  scoped_ptr<base::SharedMemory> shared_memory_;
+  Header *header_;
+  char *buffer_;
+  uint32 mask_;
+  // Reused by |WriteMessage| and |ReadMessage|.
+  std::string scratch_;
+
+  DISALLOW_COPY_AND_ASSIGN(MessageRing);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_MESSAGE_RING_H_
@@ -0,0 +1,205 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_NATIVE_NATIVE_DATAGRAM_TRANSPORT_H_
+#define SIPPET_TRANSPORT_NATIVE_NATIVE_DATAGRAM_TRANSPORT_H_
+
+#include <deque>
+#include <map>
+#include <vector>
+
+#include "base/memory/weak_ptr.h"
+#include "base/message_loop/message_loop.h"
+#include "base/threading/thread_checker.h"
+#include "base/time/time.h"
+#include "net/base/completion_callback.h"
+#include "net/base/ip_endpoint.h"
+#include "sippet/transport/channel_factory.h"
+#include "sippet/transport/channel_listener.h"
+
+namespace net {
+class IOBufferWithSize;
+}
+
+namespace sippet {
+
+class Message;
+class NativeDatagramTransport;
+
+// A channel to a single peer of a |NativeDatagramTransport|, either accepted
+// from the first datagram of the peer, or created by the transport factory.
+// As with |ChromeServerDatagramChannel|, it has no socket of its own.
+class NativeDatagramChannel : public Channel {
+ public:
+  NativeDatagramChannel(const EndPoint &destination,
+                        Channel::Delegate *delegate,
+                        NativeDatagramTransport *transport,
+                        const net::IPEndPoint &address,
+                        bool accepted);
+
+  const net::IPEndPoint &address() const { return address_; }
+
+  // Called by the transport for each message received from |address|.
+  void HandleIncomingMessage(const scoped_refptr<Message> &message);
+
+  // Called when the transport socket is closed.
+  void DetachTransport();
+
+  // sippet::Channel methods:
+  int origin(EndPoint *origin) const override;
+  const EndPoint& destination() const override;
+  bool is_secure() const override;
+  bool is_connected() const override;
+  bool is_stream() const override;
+  void Connect() override;
+  int ReconnectIgnoringLastError() override;
+  int ReconnectWithCertificate(net::X509Certificate* client_cert) override;
+  int Send(const scoped_refptr<Message> &message,
+           const net::CompletionCallback& callback) override;
+  void Close() override;
+  void CloseWithError(int err) override;
+  void DetachDelegate() override;
+
+ private:
+  friend class base::RefCountedThreadSafe<Channel>;
+  ~NativeDatagramChannel() override;
+
+  void RunUserConnectCallback();
+
+  EndPoint destination_;
+  Channel::Delegate *delegate_;
+  NativeDatagramTransport *transport_;
+  net::IPEndPoint address_;
+  bool is_connected_;
+  base::WeakPtrFactory<NativeDatagramChannel> weak_ptr_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(NativeDatagramChannel);
+};
+
+// A UDP transport for Linux servers, working on a plain socket watched by
+// the |base::MessageLoopForIO| of its thread instead of a |net::Socket|, so
+// that the system calls and callbacks don't grow with the number of
+// messages:
+//
+//   - Datagrams are received in batches of up to |kMaxBatchSize| with a
+//     single |recvmmsg|, into buffers allocated once for the lifetime of
+//     the socket.
+//   - Datagrams can be stamped by the kernel as they're received (see
+//     |SocketOptions::receive_timestamps|), so that the time spent in the
+//     socket queue shows in their |Message::receive_time|.
+//   - Datagrams sent by all the channels during a message loop iteration
+//     are queued and written out by a single |sendmmsg|, from a task posted
+//     by the first of them. Sends always complete asynchronously.
+//
+// The transport is both the |ChannelFactory| and the |ChannelListener| of
+// the UDP protocol, and all channels share its socket:
+//
+//   NativeDatagramTransport transport(
+//       EndPoint(net::HostPortPair("0.0.0.0", 5060), Protocol::UDP));
+//   network_layer->RegisterChannelFactory(Protocol::UDP, &transport);
+//   network_layer->AddChannelListener(&transport);
+//
+// Destinations must have an IP literal host; the network layer resolves
+// them beforehand. The transport must outlive its channels.
+class NativeDatagramTransport : public ChannelFactory,
+                                public ChannelListener,
+                                public base::MessageLoopForIO::Watcher {
+ public:
+  // Datagrams received or sent by a single system call.
+  static const size_t kMaxBatchSize = 16;
+
+  // |local_end_point| must have an IP literal host, and the UDP protocol.
+  explicit NativeDatagramTransport(const EndPoint &local_end_point);
+  ~NativeDatagramTransport() override;
+
+  // Lets several transports, e.g. one per |NetworkLayerShards| thread, bind
+  // the same address, with the kernel spreading the peers among them.
+  // Called before the socket is opened.
+  void set_reuse_port(bool reuse_port) { reuse_port_ = reuse_port; }
+
+  // sippet::ChannelFactory methods:
+  int CreateChannel(const EndPoint &destination,
+                    Channel::Delegate *delegate,
+                    scoped_refptr<Channel> *channel) override;
+
+  // sippet::ChannelListener methods:
+  int Listen(ChannelListener::Delegate *delegate,
+             Channel::Delegate *channel_delegate) override;
+  int GetLocalEndPoint(EndPoint *local_end_point) const override;
+  void Close() override;
+  void SetParseProfile(const ParseProfile &profile) override;
+  void SetRateLimiter(SourceRateLimiter *rate_limiter) override;
+  void SetMessageLimits(const MessageLimits &limits) override;
+  void SetSocketOptions(const SocketOptionsMap &profiles) override;
+
+  // Queues a datagram to |address|, to be sent along with the others queued
+  // during this message loop iteration. Returns |net::ERR_IO_PENDING|, and
+  // calls |callback| once sent.
+  int SendTo(net::IOBufferWithSize *buf,
+             const net::IPEndPoint &address,
+             const net::CompletionCallback &callback);
+
+  // Unregisters |channel|; called when it's closed or destroyed.
+  void RemovePeer(NativeDatagramChannel *channel);
+
+  // base::MessageLoopForIO::Watcher methods:
+  void OnFileCanReadWithoutBlocking(int fd) override;
+  void OnFileCanWriteWithoutBlocking(int fd) override;
+
+ private:
+  struct PendingSend {
+    PendingSend(net::IOBufferWithSize *buf,
+                const net::IPEndPoint &address,
+                const net::CompletionCallback &callback);
+    ~PendingSend();
+    scoped_refptr<net::IOBufferWithSize> buf_;
+    net::IPEndPoint address_;
+    net::CompletionCallback callback_;
+  };
+
+  typedef std::map<net::IPEndPoint, NativeDatagramChannel*> PeersMap;
+
+  // Opens and binds the socket, if not yet. Returns a network error code.
+  int Open();
+  // Sets |socket_options_| on the bound socket.
+  void ApplySocketOptions(int family);
+  void ReadBatches();
+  void HandleDatagram(const char *data, size_t size,
+                      const net::IPEndPoint &address,
+                      const base::TimeTicks &receive_time);
+  void DispatchMessage(const scoped_refptr<Message> &message,
+                       const net::IPEndPoint &address);
+  void FlushSends();
+  // Takes the first |count| pending sends out, and completes them.
+  void CompleteSends(size_t count, int result);
+
+  EndPoint local_end_point_;
+  bool reuse_port_;
+  int socket_;
+  ChannelListener::Delegate *delegate_;
+  Channel::Delegate *channel_delegate_;
+  ParseProfile parse_profile_;
+  SourceRateLimiter *rate_limiter_;
+  MessageLimits message_limits_;
+  SocketOptions socket_options_;
+
+  base::MessageLoopForIO::FileDescriptorWatcher read_watcher_;
+  base::MessageLoopForIO::FileDescriptorWatcher write_watcher_;
+  // Receive buffers of all the datagrams of a batch, one after the other.
+  std::vector<char> recv_buffers_;
+
+  PeersMap peers_;
+  std::deque<PendingSend*> pending_sends_;
+  bool flush_posted_;
+  bool waiting_writable_;
+
+  base::ThreadChecker thread_checker_;
+  base::WeakPtrFactory<NativeDatagramTransport> weak_ptr_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(NativeDatagramTransport);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_NATIVE_NATIVE_DATAGRAM_TRANSPORT_H_
@@ -0,0 +1,609 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/native/native_datagram_transport.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "base/bind.h"
+#include "base/logging.h"
+#include "base/posix/eintr_wrapper.h"
+#include "base/stl_util.h"
+#include "base/trace_event/trace_event.h"
+#include "net/base/io_buffer.h"
+#include "net/base/ip_address_number.h"
+#include "net/base/net_errors.h"
+#include "sippet/message/message.h"
+#include "sippet/transport/chrome/message_io_buffer.h"
+#include "sippet/transport/parse_pool.h"
+#include "sippet/transport/source_rate_limiter.h"
+#include "sippet/transport/transport_stats.h"
+
+namespace sippet {
+
+namespace {
+
+// Large enough for any datagram, as with |ChromeDatagramReader|.
+const size_t kRecvBufferSize = 64 * 1024;
+
+// Batches read per wakeup; the watcher is level triggered, so whatever is
+// left is read on the next one, once other tasks had their turn.
+const int kMaxBatchesPerWakeup = 4;
+
+// Room for the control message of a receive timestamp.
+const size_t kControlBufferSize = CMSG_SPACE(sizeof(timespec));
+
+// The time the kernel stamped on |header|, if any, on the clock of
+// |now_ticks|; otherwise |now_ticks|, when the batch was read.
+base::TimeTicks GetReceiveTime(msghdr *header,
+                               const base::Time &now,
+                               const base::TimeTicks &now_ticks) {
+#if defined(SO_TIMESTAMPNS)
+  for (cmsghdr *control = CMSG_FIRSTHDR(header); control;
+       control = CMSG_NXTHDR(header, control)) {
+    if (SOL_SOCKET != control->cmsg_level
+        || SCM_TIMESTAMPNS != control->cmsg_type)
+      continue;
+    timespec stamp;
+    memcpy(&stamp, CMSG_DATA(control), sizeof(stamp));
+    // The stamp is on the wall clock, which can be stepped meanwhile.
+    base::TimeDelta queued(now - base::Time::FromTimeSpec(stamp));
+    if (queued > base::TimeDelta())
+      return now_ticks - queued;
+    break;
+  }
+#endif
+  return now_ticks;
+}
+
+}  // namespace
+
+NativeDatagramChannel::NativeDatagramChannel(
+    const EndPoint &destination,
+    Channel::Delegate *delegate,
+    NativeDatagramTransport *transport,
+    const net::IPEndPoint &address,
+    bool accepted)
+  : destination_(destination),
+    delegate_(delegate),
+    transport_(transport),
+    address_(address),
+    is_connected_(accepted),
+    weak_ptr_factory_(this) {
+  DCHECK(delegate_);
+  DCHECK(transport_);
+}
+
+NativeDatagramChannel::~NativeDatagramChannel() {
+  if (transport_)
+    transport_->RemovePeer(this);
+}
+
+void NativeDatagramChannel::HandleIncomingMessage(
+    const scoped_refptr<Message> &message) {
+  if (delegate_)
+    delegate_->OnIncomingMessage(this, message);
+}
+
+void NativeDatagramChannel::DetachTransport() {
+  transport_ = nullptr;
+}
+
+int NativeDatagramChannel::origin(EndPoint *origin) const {
+  if (!transport_)
+    return net::ERR_SOCKET_NOT_CONNECTED;
+  return transport_->GetLocalEndPoint(origin);
+}
+
+const EndPoint& NativeDatagramChannel::destination() const {
+  return destination_;
+}
+
+bool NativeDatagramChannel::is_secure() const {
+  return false;
+}
+
+bool NativeDatagramChannel::is_connected() const {
+  return is_connected_ && transport_ != nullptr;
+}
+
+bool NativeDatagramChannel::is_stream() const {
+  return false;
+}
+
+void NativeDatagramChannel::Connect() {
+  DCHECK(!is_connected_);
+  // There's nothing to connect: the socket is bound already.
+  is_connected_ = true;
+  base::MessageLoop::current()->PostTask(FROM_HERE,
+      base::Bind(&NativeDatagramChannel::RunUserConnectCallback,
+                 weak_ptr_factory_.GetWeakPtr()));
+}
+
+int NativeDatagramChannel::ReconnectIgnoringLastError() {
+  return net::ERR_NOT_IMPLEMENTED;
+}
+
+int NativeDatagramChannel::ReconnectWithCertificate(
+    net::X509Certificate* client_cert) {
+  return net::ERR_NOT_IMPLEMENTED;
+}
+
+int NativeDatagramChannel::Send(const scoped_refptr<Message> &message,
+                                const net::CompletionCallback& callback) {
+  if (!is_connected())
+    return net::ERR_SOCKET_NOT_CONNECTED;
+  scoped_refptr<net::IOBufferWithSize> buffer(SerializeMessage(*message));
+  if (delegate_)
+    delegate_->OnOutgoingMessage(this, message);
+  return transport_->SendTo(buffer.get(), address_, callback);
+}
+
+void NativeDatagramChannel::Close() {
+  // Further datagrams from the peer will create a new channel.
+  if (transport_)
+    transport_->RemovePeer(this);
+  transport_ = nullptr;
+  is_connected_ = false;
+}
+
+void NativeDatagramChannel::CloseWithError(int err) {
+  // Sends are queued by the transport, which completes them on its own.
+  Close();
+}
+
+void NativeDatagramChannel::DetachDelegate() {
+  delegate_ = nullptr;
+}
+
+void NativeDatagramChannel::RunUserConnectCallback() {
+  if (delegate_) {
+    delegate_->OnChannelConnected(this,
+        is_connected() ? net::OK : net::ERR_SOCKET_NOT_CONNECTED);
+  }
+}
+
+NativeDatagramTransport::PendingSend::PendingSend(
+    net::IOBufferWithSize *buf,
+    const net::IPEndPoint &address,
+    const net::CompletionCallback &callback)
+  : buf_(buf), address_(address), callback_(callback) {
+}
+
+NativeDatagramTransport::PendingSend::~PendingSend() {
+}
+
+NativeDatagramTransport::NativeDatagramTransport(
+    const EndPoint &local_end_point)
+  : local_end_point_(local_end_point),
+    reuse_port_(false),
+    socket_(-1),
+    delegate_(nullptr),
+    channel_delegate_(nullptr),
+    rate_limiter_(nullptr),
+    flush_posted_(false),
+    waiting_writable_(false),
+    weak_ptr_factory_(this) {
+  DCHECK(Protocol::UDP == local_end_point_.protocol());
+}
+
+NativeDatagramTransport::~NativeDatagramTransport() {
+  Close();
+}
+
+int NativeDatagramTransport::CreateChannel(const EndPoint &destination,
+                                           Channel::Delegate *delegate,
+                                           scoped_refptr<Channel> *channel) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  net::IPAddressNumber address;
+  if (!net::ParseIPLiteralToNumber(destination.host(), &address))
+    return net::ERR_ADDRESS_INVALID;
+  int result = Open();
+  if (net::OK != result)
+    return result;
+  net::IPEndPoint ip_endpoint(address, destination.port());
+  if (peers_.count(ip_endpoint))
+    return net::ERR_ADDRESS_IN_USE;
+  scoped_refptr<NativeDatagramChannel> new_channel(
+      new NativeDatagramChannel(destination, delegate, this, ip_endpoint,
+                                false));
+  peers_[ip_endpoint] = new_channel.get();
+  *channel = new_channel;
+  return net::OK;
+}
+
+int NativeDatagramTransport::Listen(ChannelListener::Delegate *delegate,
+                                    Channel::Delegate *channel_delegate) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  DCHECK(delegate);
+  DCHECK(channel_delegate);
+  if (delegate_)
+    return net::ERR_ADDRESS_IN_USE;
+  int result = Open();
+  if (net::OK != result)
+    return result;
+  delegate_ = delegate;
+  channel_delegate_ = channel_delegate;
+  return net::OK;
+}
+
+int NativeDatagramTransport::GetLocalEndPoint(
+    EndPoint *local_end_point) const {
+  if (-1 == socket_)
+    return net::ERR_SOCKET_NOT_CONNECTED;
+  sockaddr_storage storage;
+  socklen_t length = sizeof(storage);
+  sockaddr *address = reinterpret_cast<sockaddr*>(&storage);
+  if (getsockname(socket_, address, &length) < 0)
+    return net::MapSystemError(errno);
+  net::IPEndPoint ip_endpoint;
+  if (!ip_endpoint.FromSockAddr(address, length))
+    return net::ERR_ADDRESS_INVALID;
+  *local_end_point = EndPoint(net::HostPortPair::FromIPEndPoint(ip_endpoint),
+      Protocol::UDP);
+  return net::OK;
+}
+
+void NativeDatagramTransport::Close() {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  weak_ptr_factory_.InvalidateWeakPtrs();
+  delegate_ = nullptr;
+  channel_delegate_ = nullptr;
+  flush_posted_ = false;
+  waiting_writable_ = false;
+  PeersMap peers;
+  peers.swap(peers_);
+  for (PeersMap::iterator i = peers.begin(), ie = peers.end(); i != ie; ++i)
+    i->second->DetachTransport();
+  if (-1 != socket_) {
+    read_watcher_.StopWatchingFileDescriptor();
+    write_watcher_.StopWatchingFileDescriptor();
+    if (IGNORE_EINTR(close(socket_)) < 0)
+      DPLOG(ERROR) << "close";
+    socket_ = -1;
+  }
+  std::vector<char>().swap(recv_buffers_);
+
+  std::deque<PendingSend*> pending_sends;
+  pending_sends.swap(pending_sends_);
+  for (std::deque<PendingSend*>::iterator i = pending_sends.begin(),
+       ie = pending_sends.end(); i != ie; ++i) {
+    if (!(*i)->callback_.is_null())
+      (*i)->callback_.Run(net::ERR_CONNECTION_CLOSED);
+  }
+  STLDeleteElements(&pending_sends);
+}
+
+void NativeDatagramTransport::SetParseProfile(const ParseProfile &profile) {
+  parse_profile_ = profile;
+}
+
+void NativeDatagramTransport::SetRateLimiter(
+    SourceRateLimiter *rate_limiter) {
+  DCHECK_EQ(-1, socket_);
+  rate_limiter_ = rate_limiter;
+}
+
+void NativeDatagramTransport::SetMessageLimits(const MessageLimits &limits) {
+  message_limits_ = limits;
+}
+
+void NativeDatagramTransport::SetSocketOptions(
+    const SocketOptionsMap &profiles) {
+  DCHECK_EQ(-1, socket_);
+  socket_options_ = GetSocketOptions(profiles, local_end_point_.protocol());
+}
+
+int NativeDatagramTransport::SendTo(net::IOBufferWithSize *buf,
+                                    const net::IPEndPoint &address,
+                                    const net::CompletionCallback &callback) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  if (-1 == socket_)
+    return net::ERR_SOCKET_NOT_CONNECTED;
+  TransportStats::Count(TransportStats::BYTES_SENT, buf->size());
+  pending_sends_.push_back(new PendingSend(buf, address, callback));
+  if (!flush_posted_ && !waiting_writable_) {
+    flush_posted_ = true;
+    base::MessageLoop::current()->PostTask(FROM_HERE,
+        base::Bind(&NativeDatagramTransport::FlushSends,
+                   weak_ptr_factory_.GetWeakPtr()));
+  }
+  return net::ERR_IO_PENDING;
+}
+
+void NativeDatagramTransport::RemovePeer(NativeDatagramChannel *channel) {
+  PeersMap::iterator i = peers_.find(channel->address());
+  if (i != peers_.end() && i->second == channel)
+    peers_.erase(i);
+}
+
+void NativeDatagramTransport::OnFileCanReadWithoutBlocking(int fd) {
+  DCHECK_EQ(socket_, fd);
+  ReadBatches();
+}
+
+void NativeDatagramTransport::OnFileCanWriteWithoutBlocking(int fd) {
+  DCHECK_EQ(socket_, fd);
+  waiting_writable_ = false;
+  FlushSends();
+}
+
+int NativeDatagramTransport::Open() {
+  if (-1 != socket_)
+    return net::OK;
+  net::IPAddressNumber address;
+  if (!net::ParseIPLiteralToNumber(local_end_point_.host(), &address))
+    return net::ERR_ADDRESS_INVALID;
+  sockaddr_storage storage;
+  socklen_t length = sizeof(storage);
+  sockaddr *bind_address = reinterpret_cast<sockaddr*>(&storage);
+  if (!net::IPEndPoint(address, local_end_point_.port()).ToSockAddr(
+          bind_address, &length))
+    return net::ERR_ADDRESS_INVALID;
+
+  int fd = socket(bind_address->sa_family,
+                  SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_UDP);
+  if (fd < 0)
+    return net::MapSystemError(errno);
+  int on = 1;
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0
+      || (reuse_port_
+          && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0)
+      || bind(fd, bind_address, length) < 0) {
+    int result = net::MapSystemError(errno);
+    IGNORE_EINTR(close(fd));
+    return result;
+  }
+  socket_ = fd;
+  ApplySocketOptions(bind_address->sa_family);
+  if (!base::MessageLoopForIO::current()->WatchFileDescriptor(socket_, true,
+          base::MessageLoopForIO::WATCH_READ, &read_watcher_, this)) {
+    int result = net::MapSystemError(errno);
+    Close();
+    return result;
+  }
+  recv_buffers_.resize(kMaxBatchSize * kRecvBufferSize);
+  return net::OK;
+}
+
+void NativeDatagramTransport::ApplySocketOptions(int family) {
+  if (net::DSCP_NO_CHANGE != socket_options_.dscp) {
+    // The code point takes the upper six bits of the TOS, or traffic class.
+    int tos = socket_options_.dscp << 2;
+    int rv = AF_INET6 == family
+        ? setsockopt(socket_, IPPROTO_IPV6, IPV6_TCLASS, &tos, sizeof(tos))
+        : setsockopt(socket_, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+    PLOG_IF(WARNING, rv < 0) << "Failed to set the DSCP";
+  }
+  if (socket_options_.send_buffer_size > 0) {
+    int size = socket_options_.send_buffer_size;
+    PLOG_IF(WARNING,
+            setsockopt(socket_, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) < 0)
+        << "Failed to set SO_SNDBUF";
+  }
+  if (socket_options_.receive_buffer_size > 0) {
+    int size = socket_options_.receive_buffer_size;
+    PLOG_IF(WARNING,
+            setsockopt(socket_, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) < 0)
+        << "Failed to set SO_RCVBUF";
+  }
+#if defined(SO_BUSY_POLL)
+  if (socket_options_.busy_poll_usecs > 0) {
+    int usecs = socket_options_.busy_poll_usecs;
+    PLOG_IF(WARNING, setsockopt(socket_, SOL_SOCKET, SO_BUSY_POLL, &usecs,
+                                sizeof(usecs)) < 0)
+        << "Failed to set SO_BUSY_POLL";
+  }
+#endif
+#if defined(SO_TIMESTAMPNS)
+  if (socket_options_.receive_timestamps) {
+    int on = 1;
+    PLOG_IF(WARNING, setsockopt(socket_, SOL_SOCKET, SO_TIMESTAMPNS, &on,
+                                sizeof(on)) < 0)
+        << "Failed to set SO_TIMESTAMPNS";
+  }
+#endif
+}
+
+void NativeDatagramTransport::ReadBatches() {
+  TRACE_EVENT0("sippet", "NativeDatagramTransport::ReadBatches");
+  mmsghdr messages[kMaxBatchSize];
+  iovec buffers[kMaxBatchSize];
+  sockaddr_storage addresses[kMaxBatchSize];
+  char controls[kMaxBatchSize][kControlBufferSize];
+  base::WeakPtr<NativeDatagramTransport> weak_this(
+      weak_ptr_factory_.GetWeakPtr());
+  for (int batch = 0; batch < kMaxBatchesPerWakeup; ++batch) {
+    memset(messages, 0, sizeof(messages));
+    for (size_t i = 0; i < kMaxBatchSize; ++i) {
+      buffers[i].iov_base = &recv_buffers_[i * kRecvBufferSize];
+      buffers[i].iov_len = kRecvBufferSize;
+      messages[i].msg_hdr.msg_name = &addresses[i];
+      messages[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+      messages[i].msg_hdr.msg_iov = &buffers[i];
+      messages[i].msg_hdr.msg_iovlen = 1;
+      if (socket_options_.receive_timestamps) {
+        messages[i].msg_hdr.msg_control = controls[i];
+        messages[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+      }
+    }
+    int count = HANDLE_EINTR(
+        recvmmsg(socket_, messages, kMaxBatchSize, MSG_DONTWAIT, nullptr));
+    if (count < 0) {
+      if (EAGAIN != errno && EWOULDBLOCK != errno) {
+        // Errors concern a single datagram (e.g. the ICMP error of an
+        // earlier send), so keep serving the other peers.
+        DVLOG(1) << "Discarded incoming datagram: "
+                 << net::ErrorToString(net::MapSystemError(errno));
+      }
+      return;
+    }
+    // The clocks are read once per batch.
+    base::TimeTicks now_ticks(base::TimeTicks::Now());
+    base::Time now;
+    if (socket_options_.receive_timestamps)
+      now = base::Time::Now();
+    for (int i = 0; i < count; ++i) {
+      const msghdr &header = messages[i].msg_hdr;
+      net::IPEndPoint address;
+      if ((header.msg_flags & MSG_TRUNC) || !address.FromSockAddr(
+              reinterpret_cast<const sockaddr*>(header.msg_name),
+              header.msg_namelen)) {
+        DVLOG(1) << "Discarded incoming datagram: truncated or unknown "
+                 << "sender";
+        continue;
+      }
+      base::TimeTicks receive_time(now_ticks);
+      if (socket_options_.receive_timestamps)
+        receive_time = GetReceiveTime(&messages[i].msg_hdr, now, now_ticks);
+      HandleDatagram(static_cast<const char*>(buffers[i].iov_base),
+                     messages[i].msg_len, address, receive_time);
+      if (!weak_this)
+        return;  // The transport was closed meanwhile
+    }
+    if (static_cast<size_t>(count) < kMaxBatchSize)
+      return;
+  }
+}
+
+void NativeDatagramTransport::HandleDatagram(
+    const char *data,
+    size_t size,
+    const net::IPEndPoint &address,
+    const base::TimeTicks &receive_time) {
+  TransportStats::Count(TransportStats::BYTES_RECEIVED, size);
+  if (rate_limiter_ && !rate_limiter_->Admit(address.address())) {
+    TransportStats::Count(TransportStats::RATE_LIMITED);
+    return;
+  }
+  base::StringPiece datagram(data, size);
+  size_t start = datagram.find_first_not_of("\r\n");
+  if (base::StringPiece::npos == start)
+    return;  // A CRLF keep-alive
+  datagram.remove_prefix(start);
+  size_t head_size = ParsePool::FindHeadSize(datagram);
+  if (base::StringPiece::npos == head_size) {
+    DVLOG(1) << "Discarded incoming datagram: truncated header";
+    TransportStats::Count(TransportStats::PARSE_FAILURES);
+    return;
+  }
+  base::StringPiece head(datagram.substr(0, head_size));
+  if (!message_limits_.AdmitsHead(head, true)
+      || !message_limits_.AdmitsContentLength(datagram.size() - head.size())) {
+    DVLOG(1) << "Discarded incoming datagram: over the message limits";
+    TransportStats::Count(TransportStats::OVERSIZED_MESSAGES);
+    return;
+  }
+  if (channel_delegate_ && channel_delegate_->AbsorbRetransmission(head))
+    return;
+  scoped_refptr<Message> message(
+      ParsePool::ParseDatagram(datagram, parse_profile_));
+  if (!message) {
+    DVLOG(1) << "Discarded incoming datagram: unparseable or truncated "
+             << "message";
+    TransportStats::Count(TransportStats::PARSE_FAILURES);
+    return;
+  }
+  if (!message_limits_.AdmitsMessage(*message)) {
+    DVLOG(1) << "Discarded incoming datagram: too many routing entries";
+    TransportStats::Count(TransportStats::OVERSIZED_MESSAGES);
+    return;
+  }
+  message->set_receive_time(receive_time);
+  DispatchMessage(message, address);
+}
+
+void NativeDatagramTransport::DispatchMessage(
+    const scoped_refptr<Message> &message,
+    const net::IPEndPoint &address) {
+  PeersMap::iterator i = peers_.find(address);
+  if (i != peers_.end()) {
+    i->second->HandleIncomingMessage(message);
+    return;
+  }
+  if (!delegate_) {
+    DVLOG(1) << "Discarded incoming datagram from unknown peer "
+             << address.ToString();
+    return;
+  }
+  EndPoint destination(net::HostPortPair::FromIPEndPoint(address),
+      Protocol::UDP);
+  scoped_refptr<NativeDatagramChannel> channel(
+      new NativeDatagramChannel(destination, channel_delegate_, this,
+                                address, true));
+  peers_[address] = channel.get();
+  delegate_->OnChannelAccepted(channel);
+  channel->HandleIncomingMessage(message);
+}
+
+void NativeDatagramTransport::FlushSends() {
+  TRACE_EVENT1("sippet", "NativeDatagramTransport::FlushSends",
+               "pending", pending_sends_.size());
+  flush_posted_ = false;
+  mmsghdr messages[kMaxBatchSize];
+  iovec buffers[kMaxBatchSize];
+  sockaddr_storage addresses[kMaxBatchSize];
+  base::WeakPtr<NativeDatagramTransport> weak_this(
+      weak_ptr_factory_.GetWeakPtr());
+  while (weak_this && !pending_sends_.empty()) {
+    size_t count = std::min(pending_sends_.size(), kMaxBatchSize);
+    memset(messages, 0, sizeof(messages));
+    for (size_t i = 0; i < count; ++i) {
+      PendingSend *pending = pending_sends_[i];
+      socklen_t length = sizeof(addresses[i]);
+      if (!pending->address_.ToSockAddr(
+              reinterpret_cast<sockaddr*>(&addresses[i]), &length)) {
+        NOTREACHED();
+      }
+      buffers[i].iov_base = pending->buf_->data();
+      buffers[i].iov_len = pending->buf_->size();
+      messages[i].msg_hdr.msg_name = &addresses[i];
+      messages[i].msg_hdr.msg_namelen = length;
+      messages[i].msg_hdr.msg_iov = &buffers[i];
+      messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    int sent = HANDLE_EINTR(
+        sendmmsg(socket_, messages, count, MSG_DONTWAIT));
+    if (sent < 0) {
+      int result = net::MapSystemError(errno);
+      if (net::ERR_IO_PENDING == result) {
+        // The socket buffer is full; carry on once it drains.
+        waiting_writable_ = base::MessageLoopForIO::current()->
+            WatchFileDescriptor(socket_, false,
+                base::MessageLoopForIO::WATCH_WRITE, &write_watcher_, this);
+        if (waiting_writable_)
+          return;
+        // As with a full ring, the datagram is left for retransmissions.
+        result = net::ERR_INSUFFICIENT_RESOURCES;
+      }
+      // Only the first datagram failed (e.g. the ICMP error of an earlier
+      // send to the same peer), so complete it and keep going.
+      CompleteSends(1, result);
+      continue;
+    }
+    CompleteSends(sent, net::OK);
+  }
+}
+
+void NativeDatagramTransport::CompleteSends(size_t count, int result) {
+  DCHECK_LE(count, pending_sends_.size());
+  std::vector<PendingSend*> completed(pending_sends_.begin(),
+                                      pending_sends_.begin() + count);
+  pending_sends_.erase(pending_sends_.begin(),
+                       pending_sends_.begin() + count);
+  // Callbacks may close the transport, so nothing is touched afterwards.
+  for (size_t i = 0; i < completed.size(); ++i) {
+    if (!completed[i]->callback_.is_null())
+      completed[i]->callback_.Run(result);
+  }
+  STLDeleteElements(&completed);
+}
+
+} // End of sippet namespace
@@ -0,0 +1,232 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/native/native_datagram_transport.h"
+
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "base/run_loop.h"
+#include "net/base/net_errors.h"
+#include "net/base/test_completion_callback.h"
+#include "sippet/message/message.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const char kOptionsRequest[] =
+  "OPTIONS sip:carol@chicago.com SIP/2.0\r\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bKhjhs8ass877\r\n"
+  "Max-Forwards: 70\r\n"
+  "To: <sip:carol@chicago.com>\r\n"
+  "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+  "Call-ID: a84b4c76e66710\r\n"
+  "CSeq: 63104 OPTIONS\r\n"
+  "Content-Length: 5\r\n"
+  "\r\n"
+  "hello";
+
+// The head of |kOptionsRequest| with bare LFs, a Content-Length of 5
+// still to be appended.
+const char kOptionsHeadWithLineFeeds[] =
+  "OPTIONS sip:carol@chicago.com SIP/2.0\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bKhjhs8ass877\n"
+  "Max-Forwards: 70\n"
+  "To: <sip:carol@chicago.com>\n"
+  "From: Alice <sip:alice@atlanta.com>;tag=1928301774\n"
+  "Call-ID: a84b4c76e66710\n"
+  "CSeq: 63104 OPTIONS\n"
+  "Content-Length: 5\n"
+  "\n";
+
+class RecordingDelegate : public ChannelListener::Delegate,
+                          public Channel::Delegate {
+ public:
+  RecordingDelegate() : run_loop_(nullptr), expected_(0), connected_(0) {}
+
+  void WaitForMessages(size_t count) {
+    if (messages_.size() >= count)
+      return;
+    expected_ = count;
+    base::RunLoop run_loop;
+    run_loop_ = &run_loop;
+    run_loop.Run();
+    run_loop_ = nullptr;
+  }
+
+  // sippet::ChannelListener::Delegate methods:
+  void OnChannelAccepted(const scoped_refptr<Channel> &channel) override {
+    EXPECT_TRUE(channel->is_connected());
+    channels_.push_back(channel);
+  }
+
+  // sippet::Channel::Delegate methods:
+  void OnChannelConnected(const scoped_refptr<Channel> &channel,
+                          int error) override {
+    EXPECT_EQ(net::OK, error);
+    ++connected_;
+  }
+  void OnIncomingMessage(const scoped_refptr<Channel> &channel,
+                         const scoped_refptr<Message> &message) override {
+    messages_.push_back(message);
+    if (run_loop_ && messages_.size() >= expected_)
+      run_loop_->Quit();
+  }
+  void OnChannelClosed(const scoped_refptr<Channel> &channel,
+                       int error) override {}
+  void OnSSLCertificateError(const scoped_refptr<Channel> &channel,
+                             const net::SSLInfo &ssl_info,
+                             bool fatal) override {}
+
+  base::RunLoop *run_loop_;
+  size_t expected_;
+  int connected_;
+  std::vector<scoped_refptr<Channel> > channels_;
+  std::vector<scoped_refptr<Message> > messages_;
+};
+
+}  // namespace
+
+class NativeDatagramTransportTest : public testing::Test {
+ public:
+  NativeDatagramTransportTest()
+    : server_(EndPoint(net::HostPortPair("127.0.0.1", 0), Protocol::UDP)),
+      client_(EndPoint(net::HostPortPair("127.0.0.1", 0), Protocol::UDP)) {}
+
+  void SetUp() override {
+    ASSERT_EQ(net::OK, server_.Listen(&server_delegate_, &server_delegate_));
+    ASSERT_EQ(net::OK, server_.GetLocalEndPoint(&server_end_point_));
+    EXPECT_NE(0, server_end_point_.port());
+  }
+
+  NativeDatagramTransport server_;
+  NativeDatagramTransport client_;
+  RecordingDelegate server_delegate_;
+  RecordingDelegate client_delegate_;
+  EndPoint server_end_point_;
+};
+
+TEST_F(NativeDatagramTransportTest, RequestAndResponse) {
+  scoped_refptr<Channel> channel;
+  EXPECT_EQ(net::ERR_ADDRESS_INVALID, client_.CreateChannel(
+      EndPoint(net::HostPortPair("chicago.com", 5060), Protocol::UDP),
+      &client_delegate_, &channel));
+  ASSERT_EQ(net::OK, client_.CreateChannel(server_end_point_,
+                                           &client_delegate_, &channel));
+  scoped_refptr<Channel> other;
+  EXPECT_EQ(net::ERR_ADDRESS_IN_USE, client_.CreateChannel(server_end_point_,
+      &client_delegate_, &other));
+  channel->Connect();
+
+  scoped_refptr<Message> request(Message::Parse(kOptionsRequest));
+  ASSERT_TRUE(request);
+  net::TestCompletionCallback callback;
+  EXPECT_EQ(net::ERR_IO_PENDING, channel->Send(request, callback.callback()));
+  EXPECT_EQ(net::OK, callback.WaitForResult());
+  EXPECT_EQ(1, client_delegate_.connected_);
+
+  server_delegate_.WaitForMessages(1);
+  ASSERT_EQ(1u, server_delegate_.channels_.size());
+  ASSERT_TRUE(isa<Request>(server_delegate_.messages_[0]));
+  EXPECT_EQ("hello", server_delegate_.messages_[0]->content());
+  EndPoint client_end_point;
+  ASSERT_EQ(net::OK, client_.GetLocalEndPoint(&client_end_point));
+  EXPECT_EQ(client_end_point.port(),
+            server_delegate_.channels_[0]->destination().port());
+
+  // Responses from the server reach the channel instead of a new one.
+  scoped_refptr<Response> response =
+      dyn_cast<Request>(server_delegate_.messages_[0])->CreateResponse(
+          200, "OK");
+  EXPECT_EQ(net::ERR_IO_PENDING, server_delegate_.channels_[0]->Send(
+      response, net::CompletionCallback()));
+  client_delegate_.WaitForMessages(1);
+  EXPECT_TRUE(client_delegate_.channels_.empty());
+  EXPECT_TRUE(isa<Response>(client_delegate_.messages_[0]));
+
+  // Closing the transport fails the queued sends.
+  EXPECT_EQ(net::ERR_IO_PENDING, channel->Send(request, callback.callback()));
+  client_.Close();
+  EXPECT_EQ(net::ERR_CONNECTION_CLOSED, callback.WaitForResult());
+  EXPECT_FALSE(channel->is_connected());
+}
+
+TEST_F(NativeDatagramTransportTest, SendsInBatches) {
+  scoped_refptr<Channel> channel;
+  ASSERT_EQ(net::OK, client_.CreateChannel(server_end_point_,
+                                           &client_delegate_, &channel));
+  channel->Connect();
+
+  // More datagrams than fit in one batch, all sent in the same iteration.
+  const size_t kCount = NativeDatagramTransport::kMaxBatchSize * 2 + 1;
+  scoped_refptr<Message> request(Message::Parse(kOptionsRequest));
+  ASSERT_TRUE(request);
+  for (size_t i = 0; i < kCount; ++i) {
+    EXPECT_EQ(net::ERR_IO_PENDING,
+              channel->Send(request, net::CompletionCallback()));
+  }
+  server_delegate_.WaitForMessages(kCount);
+  EXPECT_EQ(kCount, server_delegate_.messages_.size());
+  EXPECT_EQ(1u, server_delegate_.channels_.size());
+}
+
+TEST_F(NativeDatagramTransportTest, SocketOptions) {
+  SocketOptions options;
+  options.dscp = net::DSCP_CS3;
+  options.send_buffer_size = 256 * 1024;
+  options.receive_buffer_size = 256 * 1024;
+  SocketOptionsMap profiles;
+  profiles[Protocol::UDP] = options;
+  client_.SetSocketOptions(profiles);
+
+  scoped_refptr<Channel> channel;
+  ASSERT_EQ(net::OK, client_.CreateChannel(server_end_point_,
+                                           &client_delegate_, &channel));
+  channel->Connect();
+  scoped_refptr<Message> request(Message::Parse(kOptionsRequest));
+  ASSERT_TRUE(request);
+  EXPECT_EQ(net::ERR_IO_PENDING,
+            channel->Send(request, net::CompletionCallback()));
+  server_delegate_.WaitForMessages(1);
+  EXPECT_EQ("hello", server_delegate_.messages_[0]->content());
+}
+
+TEST_F(NativeDatagramTransportTest, ContentBoundedByContentLength) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  ASSERT_LE(0, fd);
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(server_end_point_.port());
+  const std::string datagrams[] = {
+    // Shorter than its Content-Length: discarded.
+    std::string(kOptionsHeadWithLineFeeds) + "hel",
+    // The head may end in bare LFs.
+    std::string(kOptionsHeadWithLineFeeds) + "hello",
+    // The bytes past the Content-Length are dropped.
+    std::string(kOptionsRequest) + "\r\nhello",
+  };
+  for (size_t i = 0; i < arraysize(datagrams); ++i) {
+    EXPECT_EQ(static_cast<ssize_t>(datagrams[i].size()),
+              sendto(fd, datagrams[i].data(), datagrams[i].size(), 0,
+                     reinterpret_cast<sockaddr*>(&address),
+                     sizeof(address)));
+  }
+  close(fd);
+
+  server_delegate_.WaitForMessages(2);
+  ASSERT_EQ(2u, server_delegate_.messages_.size());
+  EXPECT_EQ("hello", server_delegate_.messages_[0]->content());
+  EXPECT_EQ("hello", server_delegate_.messages_[1]->content());
+}
+
+}  // namespace sippet
@@ -0,0 +1,158 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/network_event_queue.h"
+
+#include <algorithm>
+
+#include "base/bind.h"
+#include "base/location.h"
+#include "base/thread_task_runner_handle.h"
+#include "net/base/net_errors.h"
+
+namespace sippet {
+
+namespace {
+
+// Delay before retrying to move the backlog into a full ring.
+const int kFlushBacklogDelayMs = 1;
+
+}  // namespace
+
+NetworkEventQueue::Event::Event()
+  : type(NONE), error(net::OK) {
+}
+
+NetworkEventQueue::Event::~Event() {
+}
+
+void NetworkEventQueue::Event::swap(Event &other) {
+  std::swap(type, other.type);
+  message.swap(other.message);
+  std::swap(destination, other.destination);
+  std::swap(error, other.error);
+}
+
+NetworkEventQueue::NetworkEventQueue(
+    const scoped_refptr<base::SingleThreadTaskRunner> &consumer_task_runner,
+    const base::Closure &on_events,
+    size_t capacity)
+  : ring_(capacity),
+    consumer_task_runner_(consumer_task_runner),
+    on_events_(on_events),
+    consumer_idle_(1),
+    flush_scheduled_(false),
+    weak_factory_(this) {
+  DCHECK(consumer_task_runner_.get());
+  DCHECK(!on_events_.is_null());
+  // Both threads are only known on first use.
+  producer_thread_checker_.DetachFromThread();
+  consumer_thread_checker_.DetachFromThread();
+}
+
+NetworkEventQueue::~NetworkEventQueue() {
+}
+
+bool NetworkEventQueue::Pop(Event *event) {
+  DCHECK(consumer_thread_checker_.CalledOnValidThread());
+  if (ring_.Pop(event))
+    return true;
+  base::subtle::Release_Store(&consumer_idle_, 1);
+  // Pairs with the barrier in |NotifyConsumer|: either the producer sees the
+  // consumer idle, or the consumer sees the pushed event.
+  base::subtle::MemoryBarrier();
+  if (!ring_.Pop(event))
+    return false;
+  // If the producer has already cleared the flag, an extra |on_events_| is on
+  // its way; it will just find the queue empty.
+  base::subtle::NoBarrier_CompareAndSwap(&consumer_idle_, 1, 0);
+  return true;
+}
+
+void NetworkEventQueue::OnChannelConnected(const EndPoint &destination,
+                                           int err) {
+  Event event;
+  event.type = Event::CHANNEL_CONNECTED;
+  event.destination = destination;
+  event.error = err;
+  Push(&event);
+}
+
+void NetworkEventQueue::OnChannelClosed(const EndPoint &destination) {
+  Event event;
+  event.type = Event::CHANNEL_CLOSED;
+  event.destination = destination;
+  Push(&event);
+}
+
+void NetworkEventQueue::OnIncomingRequest(
+    const scoped_refptr<Request> &request) {
+  Event event;
+  event.type = Event::INCOMING_REQUEST;
+  event.message = request;
+  Push(&event);
+}
+
+void NetworkEventQueue::OnIncomingResponse(
+    const scoped_refptr<Response> &response) {
+  Event event;
+  event.type = Event::INCOMING_RESPONSE;
+  event.message = response;
+  Push(&event);
+}
+
+void NetworkEventQueue::OnTimedOut(const scoped_refptr<Request> &request) {
+  Event event;
+  event.type = Event::TIMED_OUT;
+  event.message = request;
+  Push(&event);
+}
+
+void NetworkEventQueue::OnTransportError(
+    const scoped_refptr<Request> &request, int error) {
+  Event event;
+  event.type = Event::TRANSPORT_ERROR;
+  event.message = request;
+  event.error = error;
+  Push(&event);
+}
+
+void NetworkEventQueue::Push(Event *event) {
+  DCHECK(producer_thread_checker_.CalledOnValidThread());
+  if (backlog_.empty() && ring_.Push(event)) {
+    NotifyConsumer();
+    return;
+  }
+  // Keep the order: once something is waiting, everything else waits too.
+  backlog_.push_back(Event());
+  backlog_.back().swap(*event);
+  FlushBacklog();
+}
+
+void NetworkEventQueue::FlushBacklog() {
+  while (!backlog_.empty() && ring_.Push(&backlog_.front()))
+    backlog_.pop_front();
+  NotifyConsumer();
+  if (!backlog_.empty() && !flush_scheduled_) {
+    flush_scheduled_ = true;
+    base::ThreadTaskRunnerHandle::Get()->PostDelayedTask(FROM_HERE,
+        base::Bind(&NetworkEventQueue::OnFlushBacklog,
+            weak_factory_.GetWeakPtr()),
+        base::TimeDelta::FromMilliseconds(kFlushBacklogDelayMs));
+  }
+}
+
+void NetworkEventQueue::OnFlushBacklog() {
+  DCHECK(producer_thread_checker_.CalledOnValidThread());
+  flush_scheduled_ = false;
+  FlushBacklog();
+}
+
+void NetworkEventQueue::NotifyConsumer() {
+  base::subtle::MemoryBarrier();
+  if (base::subtle::NoBarrier_CompareAndSwap(&consumer_idle_, 1, 0) == 1)
+    consumer_task_runner_->PostTask(FROM_HERE, on_events_);
+}
+
+} // End of sippet namespace
@@ -0,0 +1,129 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_NETWORK_EVENT_QUEUE_H_
+#define SIPPET_TRANSPORT_NETWORK_EVENT_QUEUE_H_
+
+#include <deque>
+
+#include "base/atomicops.h"
+#include "base/callback.h"
+#include "base/memory/ref_counted.h"
+#include "base/memory/weak_ptr.h"
+#include "base/single_thread_task_runner.h"
+#include "base/threading/thread_checker.h"
+#include "sippet/base/spsc_ring.h"
+#include "sippet/message/message.h"
+#include "sippet/transport/end_point.h"
+#include "sippet/transport/network_layer.h"
+
+namespace sippet {
+
+// A |NetworkLayer::Delegate| that hands the network layer events over to an
+// application thread, through a lock-free single producer/single consumer
+// ring, instead of posting a bound task per event.
+//
+// The network thread is the producer: the |NetworkLayer| calls the delegate
+// methods below, and each one becomes an |Event| swapped into the ring. The
+// application thread is the consumer, and drains the events with |Pop|. The
+// consumer is only woken once per burst: |on_events| is posted to it when an
+// event arrives and the consumer had previously found the queue empty.
+//
+// Events never get lost: when the ring is full, they wait in a backlog on the
+// network thread, which is moved into the ring as the consumer catches up.
+//
+// Example usage, on the application thread:
+//   void MyServer::OnEvents() {
+//     NetworkEventQueue::Event event;
+//     while (queue_->Pop(&event)) {
+//       if (event.type == NetworkEventQueue::Event::INCOMING_REQUEST)
+//         HandleRequest(dyn_cast<Request>(event.message));
+//       ...
+//     }
+//   }
+class NetworkEventQueue : public NetworkLayer::Delegate {
+ public:
+  struct Event {
+    enum Type {
+      NONE,
+      CHANNEL_CONNECTED,
+      CHANNEL_CLOSED,
+      INCOMING_REQUEST,
+      INCOMING_RESPONSE,
+      TIMED_OUT,
+      TRANSPORT_ERROR,
+    };
+
+    Event();
+    ~Event();
+
+    // Exchanges contents without copying the message or the end point host.
+    void swap(Event &other);
+
+    Type type;
+    // The request or response, for all but the channel events.
+    scoped_refptr<Message> message;
+    // The channel destination, for channel events.
+    EndPoint destination;
+    // The network error, for |CHANNEL_CONNECTED| and |TRANSPORT_ERROR|.
+    int error;
+  };
+
+  // Default number of events held by the ring.
+  static const size_t kDefaultCapacity = 1024;
+
+  // Construct a queue whose consumer runs on |consumer_task_runner|, where
+  // |on_events| is posted when there are new events to |Pop|.
+  NetworkEventQueue(
+      const scoped_refptr<base::SingleThreadTaskRunner> &consumer_task_runner,
+      const base::Closure &on_events,
+      size_t capacity = kDefaultCapacity);
+  ~NetworkEventQueue() override;
+
+  // Called from the consumer thread to get the next event. When it returns
+  // false, |on_events| will be posted again once there are new events.
+  bool Pop(Event *event);
+
+  // sippet::NetworkLayer::Delegate methods, called from the producer thread:
+  void OnChannelConnected(const EndPoint &destination, int err) override;
+  void OnChannelClosed(const EndPoint &destination) override;
+  void OnIncomingRequest(const scoped_refptr<Request> &request) override;
+  void OnIncomingResponse(const scoped_refptr<Response> &response) override;
+  void OnTimedOut(const scoped_refptr<Request> &request) override;
+  void OnTransportError(const scoped_refptr<Request> &request,
+                        int error) override;
+
+ private:
+  void Push(Event *event);
+  void FlushBacklog();
+  void OnFlushBacklog();
+  void NotifyConsumer();
+
+  SpscRing<Event> ring_;
+  scoped_refptr<base::SingleThreadTaskRunner> consumer_task_runner_;
+  base::Closure on_events_;
+
+  // Set by the consumer when it finds the ring empty, and cleared by whoever
+  // sees it first: the producer, which then posts |on_events_|, or the
+  // consumer, when the ring turned out not to be empty after all.
+  volatile base::subtle::Atomic32 consumer_idle_;
+
+  // Only accessed from the producer thread.
+  std::deque<Event> backlog_;
+  bool flush_scheduled_;
+
+  base::ThreadChecker producer_thread_checker_;
+  base::ThreadChecker consumer_thread_checker_;
+  base::WeakPtrFactory<NetworkEventQueue> weak_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(NetworkEventQueue);
+};
+
+inline void swap(NetworkEventQueue::Event &a, NetworkEventQueue::Event &b) {
+  a.swap(b);
+}
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_NETWORK_EVENT_QUEUE_H_
@@ -0,0 +1,127 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/network_event_queue.h"
+
+#include <vector>
+
+#include "base/bind.h"
+#include "base/run_loop.h"
+#include "base/thread_task_runner_handle.h"
+#include "base/threading/thread.h"
+#include "sippet/message/request.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+class EventCollector {
+ public:
+  EventCollector(base::RunLoop *run_loop, size_t expected)
+    : run_loop_(run_loop), expected_(expected), queue_(nullptr),
+      wake_ups_(0) {}
+
+  void set_queue(NetworkEventQueue *queue) { queue_ = queue; }
+
+  void OnEvents() {
+    ++wake_ups_;
+    NetworkEventQueue::Event event;
+    while (queue_->Pop(&event)) {
+      errors_.push_back(event.error);
+      EXPECT_EQ(NetworkEventQueue::Event::TRANSPORT_ERROR, event.type);
+      EXPECT_TRUE(event.message.get());
+    }
+    if (errors_.size() == expected_)
+      run_loop_->Quit();
+  }
+
+  const std::vector<int> &errors() const { return errors_; }
+  int wake_ups() const { return wake_ups_; }
+
+ private:
+  base::RunLoop *run_loop_;
+  size_t expected_;
+  NetworkEventQueue *queue_;
+  std::vector<int> errors_;
+  int wake_ups_;
+};
+
+void ProduceEvents(NetworkEventQueue *queue, int count) {
+  scoped_refptr<Request> request(
+      new Request(Method::OPTIONS, GURL("sip:bob@biloxi.com")));
+  for (int i = 0; i < count; ++i)
+    queue->OnTransportError(request, i);
+}
+
+}  // namespace
+
+TEST(SpscRingTest, PushAndPop) {
+  SpscRing<int> ring(3);
+  EXPECT_EQ(4u, ring.capacity());
+  EXPECT_TRUE(ring.empty());
+
+  int value = 0;
+  EXPECT_FALSE(ring.Pop(&value));
+  for (int i = 0; i < 4; ++i) {
+    value = i;
+    EXPECT_TRUE(ring.Push(&value));
+  }
+  value = 4;
+  EXPECT_FALSE(ring.Push(&value));
+  EXPECT_EQ(4u, ring.size());
+
+  // Wrap around a few times.
+  for (int i = 0; i < 20; ++i) {
+    ASSERT_TRUE(ring.Pop(&value));
+    EXPECT_EQ(i, value);
+    value = i + 4;
+    EXPECT_TRUE(ring.Push(&value));
+  }
+  EXPECT_EQ(4u, ring.size());
+}
+
+TEST(SpscRingTest, ReleasesPoppedReferences) {
+  SpscRing<NetworkEventQueue::Event> ring(2);
+  scoped_refptr<Request> request(
+      new Request(Method::INVITE, GURL("sip:bob@biloxi.com")));
+
+  NetworkEventQueue::Event event;
+  event.message = request;
+  ASSERT_TRUE(ring.Push(&event));
+  EXPECT_FALSE(event.message.get());
+  EXPECT_FALSE(request->HasOneRef());
+
+  NetworkEventQueue::Event popped;
+  ASSERT_TRUE(ring.Pop(&popped));
+  EXPECT_EQ(request.get(), popped.message.get());
+  popped.message = nullptr;
+  // Nothing stays behind in the ring slot.
+  EXPECT_TRUE(request->HasOneRef());
+}
+
+TEST(NetworkEventQueueTest, DeliversEventsInOrder) {
+  const int kEvents = 10000;
+  base::RunLoop run_loop;
+  EventCollector collector(&run_loop, kEvents);
+  // A small ring, so the backlog gets exercised.
+  NetworkEventQueue queue(base::ThreadTaskRunnerHandle::Get(),
+      base::Bind(&EventCollector::OnEvents, base::Unretained(&collector)), 16);
+  collector.set_queue(&queue);
+
+  base::Thread producer("Producer");
+  ASSERT_TRUE(producer.Start());
+  producer.task_runner()->PostTask(FROM_HERE,
+      base::Bind(&ProduceEvents, base::Unretained(&queue), kEvents));
+  run_loop.Run();
+  producer.Stop();
+
+  ASSERT_EQ(static_cast<size_t>(kEvents), collector.errors().size());
+  for (int i = 0; i < kEvents; ++i)
+    EXPECT_EQ(i, collector.errors()[i]);
+  // Wake ups are coalesced.
+  EXPECT_GT(kEvents, collector.wake_ups());
+}
+
+}  // namespace sippet
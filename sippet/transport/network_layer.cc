@@ -5,55 +5,242 @@
 #include "sippet/transport/network_layer.h"
 
 #include <string>
-#include <functional>
 
+#include "base/bind.h"
+#include "base/md5.h"
 #include "base/stl_util.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/string_util.h"
+#include "base/trace_event/trace_event.h"
 #include "net/base/net_errors.h"
 #include "net/cert/x509_certificate.h"
+#include "sippet/base/memory_accounting.h"
 #include "sippet/base/tags.h"
 #include "sippet/uri/uri.h"
 #include "sippet/message/headers/via.h"
 #include "sippet/message/headers/cseq.h"
+#include "sippet/message/content_coding.h"
 #include "sippet/transport/channel.h"
 #include "sippet/transport/channel_factory.h"
+#include "sippet/transport/message_compressor.h"
+#include "sippet/transport/overload_controller.h"
+#include "sippet/transport/request_fingerprint.h"
+#include "sippet/transport/sip_locator.h"
 #include "sippet/transport/transaction_factory.h"
 #include "sippet/transport/time_delta_factory.h"
+#include "sippet/transport/transport_stats.h"
 #include "sippet/transport/ssl_cert_error_transaction.h"
 
 namespace sippet {
 
-NetworkLayer::ChannelContext::ChannelContext()
-  : refs_(0) {
+namespace {
+
+// Transaction ids of incoming messages are printed into a buffer of this size
+// on the stack; longer ids still work, but allocate.
+const size_t kTransactionIdBufferSize = 256;
+
+// Same output as |net::HostPortPair::ToString|, without the temporaries.
+void PrintSentBy(raw_ostream &os, const base::StringPiece &host, int port) {
+  if (host.find(':') != base::StringPiece::npos)
+    os << "[" << host << "]";
+  else
+    os << host;
+  os << ":" << port;
+}
+
+void PrintSentBy(raw_ostream &os, const net::HostPortPair &sent_by) {
+  PrintSentBy(os, sent_by.host(), sent_by.port());
+}
+
+void IgnoreKeepAliveResult(int result) {}
+
+// Messages are expected to be fragmented over UDP when larger than this, as
+// the path MTU is unknown (RFC 3261 section 18.1.1).
+const size_t kMaxDatagramMessageSize = 1300;
+
+// Seconds clients are asked to wait when rejected for being over the memory
+// budget, without an |OverloadController| to tell.
+const int kOverBudgetRetryAfter = 5;
+
+// Max-Forwards of forwarded requests without one (RFC 3261 section 16.6).
+const unsigned kDefaultMaxForwards = 70;
+
+// Branches of the requests forwarded statelessly: the magic cookie, a dash,
+// which random branches never have, and an MD5 in hexadecimal.
+const char kStatelessBranchPrefix[] = "z9hG4bK-";
+const size_t kStatelessBranchLength = sizeof(kStatelessBranchPrefix) - 1 + 32;
+
+// Requests being forwarded are the incoming ones, as |NetworkLayer::Send|
+// only takes outgoing messages.
+bool IsForwarded(const Request &request) {
+  return Message::Incoming == request.direction();
+}
+
+// The block of |header|, followed by the static headers of |settings|.
+scoped_refptr<StaticHeaderBlock> MakeStaticHeaders(
+    const Header &header, const NetworkSettings &settings) {
+  scoped_refptr<StaticHeaderBlock> block(new StaticHeaderBlock);
+  block->Add(header);
+  if (settings.static_headers().get())
+    block->Append(*settings.static_headers());
+  return block;
+}
+
+// The static request headers, advertising compression when enabled.
+scoped_refptr<StaticHeaderBlock> MakeRequestHeaders(
+    const NetworkSettings &settings) {
+  scoped_refptr<StaticHeaderBlock> block(MakeStaticHeaders(
+      UserAgent(settings.software_name()), settings));
+  if (settings.compression_threshold() > 0) {
+    AcceptEncoding accept_encoding;
+    accept_encoding.push_back(Encoding("gzip"));
+    block->Add(accept_encoding);
+  }
+  return block;
+}
+
+// Whether |request| starts something new, rather than finishing or tearing
+// down what's already accepted.
+bool StartsNewWork(const Request &request) {
+  if (Method::ACK == request.method() || Method::CANCEL == request.method())
+    return false;
+  const To *to = request.get<To>();
+  return !to || !to->HasTag();
+}
+
+// Whether |message| lists gzip in its Accept-Encoding.
+bool AcceptsGzip(const Message &message) {
+  const AcceptEncoding *accept_encoding = message.get<AcceptEncoding>();
+  if (!accept_encoding)
+    return false;
+  for (AcceptEncoding::const_iterator i = accept_encoding->begin(),
+       ie = accept_encoding->end(); i != ie; ++i) {
+    if ((i->AllowsAll() || CONTENT_CODING_GZIP == GetContentCoding(i->value()))
+        && (!i->HasQvalue() || i->qvalue() > 0))
+      return true;
+  }
+  return false;
+}
+
+// The topmost |Via| branch of |message|, if it's an RFC 3261 one.
+base::StringPiece GetRfc3261Branch(const Message &message) {
+  const Via *via = message.get<Via>();
+  if (!via || via->empty() || !via->front().HasBranch()
+      || !base::StartsWith(via->front().branch(), kMagicCookie,
+                           base::CompareCase::SENSITIVE))
+    return base::StringPiece();
+  return via->front().branch();
 }
 
+// Keys the decisions taken on the server certificate of |ssl_info|.
+net::SHA256HashValue GetFingerprint(const net::SSLInfo &ssl_info) {
+  return net::X509Certificate::CalculateFingerprint256(
+      ssl_info.cert->os_cert_handle());
+}
+
+}  // namespace
+
 NetworkLayer::ChannelContext::ChannelContext(
+    TimerWheel *timer_wheel,
     Channel *channel,
     const scoped_refptr<Request> &initial_request,
     const net::CompletionCallback& initial_callback)
-  : channel_(channel), refs_(0), initial_request_(initial_request),
-    initial_callback_(initial_callback) {
+  : channel_(channel), refs_(0), timer_(timer_wheel), idle_(false),
+    evicted_(false), accepted_(false), compression_(false),
+    accepts_gzip_(false),
+    keepalive_timer_(timer_wheel), pong_timer_(timer_wheel),
+    initial_request_(initial_request), initial_callback_(initial_callback),
+    located_(false), stamps_cached_(false) {
+  TransportStats::AddChannel(channel->destination().protocol(), 1);
 }
 
 NetworkLayer::ChannelContext::~ChannelContext() {
+  TransportStats::AddChannel(channel_->destination().protocol(), -1);
+}
+
+NetworkLayer::TransactionEntry::TransactionEntry(
+    const scoped_refptr<ClientTransaction> &client_transaction)
+  : client_transaction_(client_transaction) {
+}
+
+NetworkLayer::TransactionEntry::TransactionEntry(
+    const scoped_refptr<ServerTransaction> &server_transaction)
+  : server_transaction_(server_transaction) {
+}
+
+NetworkLayer::TransactionEntry::~TransactionEntry() {
+  Detach();
+}
+
+void NetworkLayer::TransactionEntry::Detach() {
+  if (next())
+    RemoveFromList();
+}
+
+NetworkLayer::TransactionEvent::TransactionEvent(
+    Type type, const scoped_refptr<Message> &message, int error)
+  : type(type), message(message), error(error) {
+}
+
+NetworkLayer::TransactionEvent::~TransactionEvent() {
+}
+
+NetworkLayer::ChannelInfo::ChannelInfo()
+  : connected(false), accepted(false), idle(false), refs(0),
+    transactions(0), queued_write_bytes(0) {
+}
+
+NetworkLayer::ChannelInfo::~ChannelInfo() {
+}
+
+NetworkLayer::Introspection::Introspection()
+  : idle_channels(0), client_transactions(0), server_transactions(0),
+    draining(false) {
+}
+
+NetworkLayer::Introspection::~Introspection() {
 }
 
 NetworkLayer::NetworkLayer(Delegate *delegate,
                            const NetworkSettings &network_settings)
   : delegate_(delegate),
+    locator_(nullptr),
+    overload_controller_(nullptr),
+    idle_channel_count_(0),
+    evicted_channel_count_(0),
     network_settings_(network_settings),
+    request_headers_(MakeRequestHeaders(network_settings)),
+    response_headers_(MakeStaticHeaders(
+        Server(network_settings.software_name()), network_settings)),
+    timer_wheel_(
+        base::TimeDelta::FromMilliseconds(TimerWheel::kDefaultResolutionMs),
+        network_settings.tick_clock()),
+    batch_delegate_(nullptr),
+    stateless_delegate_(nullptr),
+    response_router_(nullptr),
     weak_factory_(this),
     ssl_cert_error_handler_factory_(
-        network_settings.ssl_cert_error_handler_factory()) {
+        network_settings.ssl_cert_error_handler_factory()),
+    draining_(false) {
   DCHECK(delegate);
+  // Before the channels and transactions are allocated.
+  if (!network_settings.thread_placement().empty())
+    ignore_result(network_settings.thread_placement().ApplyToCurrentThread());
+  net::NetworkChangeNotifier::AddIPAddressObserver(this);
 }
 
 NetworkLayer::~NetworkLayer() {
   DCHECK(thread_checker_.CalledOnValidThread());
+  net::NetworkChangeNotifier::RemoveIPAddressObserver(this);
+  for (std::vector<ChannelListener*>::iterator i = listeners_.begin(),
+       ie = listeners_.end(); i != ie; ++i) {
+    (*i)->Close();
+  }
   // Close all pending transactions
   while (!channels_.empty()) {
     DestroyChannelContext(channels_.begin()->second);
   }
+  STLDeleteValues(&ssl_cert_error_transactions_);
 }
 
 void NetworkLayer::RegisterChannelFactory(const Protocol &protocol,
@@ -62,6 +249,64 @@ void NetworkLayer::RegisterChannelFactory(const Protocol &protocol,
   factories_.insert(std::make_pair(protocol, channel_factory));
 }
 
+int NetworkLayer::AddChannelListener(ChannelListener *channel_listener) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  DCHECK(channel_listener);
+  channel_listener->SetParseProfile(network_settings_.parse_profile());
+  channel_listener->SetMessageLimits(network_settings_.message_limits());
+  channel_listener->SetSocketOptions(network_settings_.socket_options_map());
+  if (network_settings_.parse_pool())
+    channel_listener->SetParsePool(network_settings_.parse_pool());
+  if (network_settings_.rate_limiter())
+    channel_listener->SetRateLimiter(network_settings_.rate_limiter());
+  int result = channel_listener->Listen(this, this);
+  if (result == net::OK)
+    listeners_.push_back(channel_listener);
+  return result;
+}
+
+void NetworkLayer::SetLocator(SipLocator *locator) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  locator_ = locator;
+}
+
+void NetworkLayer::SetOverloadController(
+    OverloadController *overload_controller) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  overload_controller_ = overload_controller;
+}
+
+void NetworkLayer::SetBatchDelegate(BatchDelegate *batch_delegate) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  batch_delegate_ = batch_delegate;
+}
+
+void NetworkLayer::SetStatelessDelegate(
+    StatelessDelegate *stateless_delegate) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  stateless_delegate_ = stateless_delegate;
+}
+
+void NetworkLayer::SetResponseRouter(ResponseRouter *response_router) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  response_router_ = response_router;
+}
+
+void NetworkLayer::HandleRoutedResponse(
+    const scoped_refptr<Response> &response) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  scoped_refptr<ClientTransaction> client_transaction =
+    GetClientTransaction(*response);
+  if (client_transaction) {
+    client_transaction->HandleIncomingResponse(response);
+    return;
+  }
+  LOG(WARNING) << "Discarded routed response ("
+               << response->response_code()
+               << " " << response->reason_phrase()
+               << "), unattached to any request";
+}
+
 bool NetworkLayer::RequestChannel(const EndPoint &destination) {
   ChannelContext *channel_context = GetChannelContext(destination);
   if (channel_context)
@@ -90,11 +335,35 @@ int NetworkLayer::Connect(const EndPoint &destination) {
   return net::ERR_IO_PENDING;
 }
 
+void NetworkLayer::Prefetch(const EndPoint &destination, bool preconnect) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  if (destination.IsEmpty() || draining_ || GetChannelContext(destination))
+    return;
+  if (preconnect && (Protocol::TCP == destination.protocol()
+                     || Protocol::TLS == destination.protocol())) {
+    int rv = Connect(destination);
+    if (net::OK != rv && net::ERR_IO_PENDING != rv) {
+      DVLOG(1) << "Preconnect to " << destination.ToString() << " failed: "
+               << net::ErrorToString(rv);
+      return;
+    }
+    // Like any channel left unused, it's closed after the reuse lifetime
+    // if nothing is sent through it.
+    if (RequestChannel(destination))
+      ReleaseChannel(destination);
+    return;
+  }
+  FactoriesMap::iterator i = factories_.find(destination.protocol());
+  if (factories_.end() != i)
+    i->second->PrefetchHost(destination);
+}
+
 int NetworkLayer::ReconnectIgnoringLastError(const EndPoint &destination) {
   DCHECK(thread_checker_.CalledOnValidThread());
   ChannelContext *channel_context = GetChannelContext(destination);
   if (!channel_context)
     return net::ERR_CONNECTION_CLOSED;
+  ClearStamps(channel_context);
   return channel_context->channel_->ReconnectIgnoringLastError();
 }
 
@@ -104,6 +373,7 @@ int NetworkLayer::ReconnectWithCertificate(const EndPoint &destination,
   ChannelContext *channel_context = GetChannelContext(destination);
   if (!channel_context)
     return net::ERR_CONNECTION_CLOSED;
+  ClearStamps(channel_context);
   return channel_context->channel_->ReconnectWithCertificate(client_cert);
 }
 
@@ -129,6 +399,8 @@ int NetworkLayer::GetOriginOf(const EndPoint& destination, EndPoint *origin) {
 
 int NetworkLayer::Send(const scoped_refptr<Message> &message,
                        const net::CompletionCallback& callback) {
+  TRACE_EVENT0("sippet", "NetworkLayer::Send");
+  TRACE_EVENT_FLOW_BEGIN0("sippet", "OutgoingMessage", message.get());
   DCHECK(thread_checker_.CalledOnValidThread());
   LOG(INFO) << message->ToString();
   if (Message::Outgoing != message->direction()) {
@@ -137,6 +409,11 @@ int NetworkLayer::Send(const scoped_refptr<Message> &message,
   }
   if (isa<Request>(message)) {
     scoped_refptr<Request> request = dyn_cast<Request>(message);
+    if (MemoryAccounting::IsOverBudget() && StartsNewWork(*request)) {
+      DVLOG(1) << "Over the memory budget, not sending "
+               << request->method().str();
+      return net::ERR_INSUFFICIENT_RESOURCES;
+    }
     return SendRequest(request, callback);
   } else {
     scoped_refptr<Response> response = dyn_cast<Response>(message);
@@ -144,6 +421,165 @@ int NetworkLayer::Send(const scoped_refptr<Message> &message,
   }
 }
 
+int NetworkLayer::SendToNextHop(const scoped_refptr<Request> &request,
+                                const EndPoint &next_hop,
+                                const net::CompletionCallback& callback) {
+  TRACE_EVENT0("sippet", "NetworkLayer::SendToNextHop");
+  TRACE_EVENT_FLOW_BEGIN0("sippet", "OutgoingMessage", request.get());
+  DCHECK(thread_checker_.CalledOnValidThread());
+  LOG(INFO) << request->ToString();
+  if (Message::Outgoing != request->direction()) {
+    DVLOG(1) << "Trying to send an incoming message";
+    return net::ERR_UNEXPECTED;
+  }
+  scoped_refptr<Request> outgoing_request(request);
+  if (next_hop.IsEmpty())
+    return SendRequest(outgoing_request, callback);
+  return SendRequestToDestination(outgoing_request, next_hop, callback);
+}
+
+int NetworkLayer::ForwardRequest(const scoped_refptr<Request> &request,
+                                 const GURL &target,
+                                 const net::CompletionCallback& callback) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  int rv = PrepareForwardedRequest(request);
+  if (net::OK != rv)
+    return rv;
+  if (target.is_valid())
+    request->set_request_uri(target);
+  LOG(INFO) << "Forwarding " << request->ToString();
+  scoped_refptr<Request> forwarded_request(request);
+  return SendRequest(forwarded_request, callback);
+}
+
+int NetworkLayer::ForwardRequestToNextHop(
+    const scoped_refptr<Request> &request,
+    const EndPoint &next_hop,
+    const net::CompletionCallback& callback) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  if (next_hop.IsEmpty())
+    return ForwardRequest(request, GURL(), callback);
+  int rv = PrepareForwardedRequest(request);
+  if (net::OK != rv)
+    return rv;
+  LOG(INFO) << "Forwarding to " << next_hop.ToString() << " "
+            << request->ToString();
+  scoped_refptr<Request> forwarded_request(request);
+  // The next hop is already located: the Request-URI doesn't matter here.
+  ChannelContext *channel_context = GetChannelContext(next_hop);
+  if (channel_context) {
+    return SendRequestUsingChannelContext(forwarded_request, channel_context,
+                                          callback);
+  }
+  return SendRequestThroughNewChannel(forwarded_request, next_hop, callback);
+}
+
+void NetworkLayer::StartDraining(const std::vector<GURL> &alternates,
+                                 const base::Closure &callback) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  DCHECK(!callback.is_null());
+  LOG(INFO) << "Draining, " << client_transactions_.size() << " client and "
+            << server_transactions_.size() << " server transactions left";
+  draining_ = true;
+  drain_alternates_ = alternates;
+  drained_callback_ = callback;
+  while (!idle_channels_.empty())
+    EvictIdleChannel(idle_channels_.head()->value());
+  CheckDrained();
+}
+
+int NetworkLayer::SendOutOfTransaction(
+    const scoped_refptr<Request> &request,
+    const net::CompletionCallback& callback) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  if (Message::Outgoing != request->direction()) {
+    DVLOG(1) << "Trying to send an incoming message";
+    return net::ERR_UNEXPECTED;
+  }
+  out_of_transaction_requests_.insert(request->id());
+  scoped_refptr<Request> outgoing_request(request);
+  int rv = SendRequest(outgoing_request, callback);
+  // Only kept while waiting for its channel to connect.
+  if (net::ERR_IO_PENDING != rv)
+    out_of_transaction_requests_.erase(request->id());
+  return rv;
+}
+
+int NetworkLayer::SendProxiedRequest(
+    const scoped_refptr<Request> &request,
+    const net::CompletionCallback& callback) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  if (Message::Outgoing != request->direction()) {
+    DVLOG(1) << "Trying to send an incoming message";
+    return net::ERR_UNEXPECTED;
+  }
+  proxied_requests_.insert(request->id());
+  int rv = Send(request, callback);
+  // Only kept while waiting for its channel to connect.
+  if (net::ERR_IO_PENDING != rv)
+    proxied_requests_.erase(request->id());
+  return rv;
+}
+
+int NetworkLayer::PrepareForwardedRequest(
+    const scoped_refptr<Request> &request) {
+  if (!IsForwarded(*request)) {
+    DVLOG(1) << "Trying to forward an outgoing request";
+    return net::ERR_UNEXPECTED;
+  }
+  MaxForwards *max_forwards = request->get<MaxForwards>();
+  if (max_forwards) {
+    if (0 == max_forwards->value()) {
+      DVLOG(1) << "Max-Forwards exhausted";
+      return net::ERR_TOO_MANY_REDIRECTS;
+    }
+    max_forwards->set_value(max_forwards->value() - 1);
+  } else {
+    scoped_ptr<MaxForwards> new_max_forwards(
+        new MaxForwards(kDefaultMaxForwards));
+    request->push_back(new_max_forwards.Pass());
+  }
+  // RFC 3261 section 16.4: the Route entry of this proxy goes away.
+  Message::iterator route_it = request->find_first<Route>();
+  if (request->end() != route_it) {
+    Route *route = dyn_cast<Route>(route_it);
+    if (!route->empty() && IsLocalURI(route->front().sip_address())) {
+      route->erase(route->begin());
+      if (route->empty())
+        request->erase(route_it);
+    }
+  }
+  return net::OK;
+}
+
+void NetworkLayer::Introspect(Introspection *introspection) const {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  DCHECK(introspection);
+  introspection->channels.clear();
+  introspection->channels.reserve(channels_.size());
+  for (ChannelsMap::const_iterator i = channels_.begin(),
+       ie = channels_.end(); i != ie; ++i) {
+    const ChannelContext *channel_context = i->second;
+    ChannelInfo info;
+    info.destination = i->first;
+    info.connected = channel_context->channel_->is_connected();
+    info.accepted = channel_context->accepted_;
+    info.idle = channel_context->idle_;
+    info.refs = channel_context->refs_;
+    info.transactions = 0;
+    for (const base::LinkNode<TransactionEntry> *j =
+         channel_context->transactions_.head();
+         j != channel_context->transactions_.end(); j = j->next())
+      ++info.transactions;
+    info.queued_write_bytes = channel_context->channel_->queued_write_bytes();
+    introspection->channels.push_back(info);
+  }
+  introspection->idle_channels = static_cast<size_t>(idle_channel_count_);
+  introspection->client_transactions = client_transactions_.size();
+  introspection->server_transactions = server_transactions_.size();
+  introspection->draining = draining_;
+}
+
 bool NetworkLayer::AddAlias(const EndPoint &destination,
     const EndPoint &alias) {
   DCHECK(thread_checker_.CalledOnValidThread());
@@ -155,55 +591,118 @@ bool NetworkLayer::AddAlias(const EndPoint &destination,
 
 int NetworkLayer::SendRequest(scoped_refptr<Request> &request,
     const net::CompletionCallback& callback) {
-  EndPoint destination(GetMessageEndPoint(request));
+  EndPoint destination(GetMessageEndPoint(*request));
   if (destination.IsEmpty()) {
     DVLOG(1) << "invalid Request-URI";
     return net::ERR_INVALID_ARGUMENT;
   }
+  return SendRequestToDestination(request, destination, callback);
+}
+
+int NetworkLayer::SendRequestToDestination(scoped_refptr<Request> &request,
+    const EndPoint &destination,
+    const net::CompletionCallback& callback) {
   LOG(INFO) << "Sent to " << destination.ToString();
 
-  // Add a User-Agent header if there's none
-  if (!request->get<UserAgent>()) {
-    scoped_ptr<UserAgent> user_agent(
-        new UserAgent(network_settings_.software_name()));
-    request->push_back(user_agent.Pass());
-  }
+  // Add the User-Agent and static headers, unless the request has them
+  if (!IsForwarded(*request) && !request->static_headers().get())
+    request->set_static_headers(request_headers_);
 
   ChannelContext *channel_context = GetChannelContext(destination);
   if (channel_context) {
     return SendRequestUsingChannelContext(request, channel_context, callback);
-  } else {
-    if (Method::ACK == request->method()) {
-      // ACK requests can't open connections, therefore they will be rejected.
-      DVLOG(1) << "ACK requests can't open connections";
-      return net::ERR_ABORTED;
-    }
-    int result = CreateChannelContext(
-      destination, request, callback, &channel_context);
+  } else if (locator_ && SipLocator::NeedsLookup(GetRequestTarget(*request))) {
+    std::vector<EndPoint> targets;
+    int result = locator_->Locate(GetRequestTarget(*request), &targets,
+        base::Bind(&NetworkLayer::OnLocateComplete,
+                   weak_factory_.GetWeakPtr(), request, callback));
     if (result != net::OK)
       return result;
-    channel_context->channel_->Connect();
-    // Now wait for the asynchronous connect. When using UDP,
-    // the connect event will occur in the next event loop.
-    return net::ERR_IO_PENDING;
+    return SendRequestToTargets(request, targets, callback);
+  } else {
+    return SendRequestThroughNewChannel(request, destination, callback);
   }
 }
 
+int NetworkLayer::SendRequestThroughNewChannel(
+    scoped_refptr<Request> &request,
+    const EndPoint &destination,
+    const net::CompletionCallback& callback) {
+  if (Method::ACK == request->method()) {
+    // ACK requests can't open connections, therefore they will be rejected.
+    DVLOG(1) << "ACK requests can't open connections";
+    return net::ERR_ABORTED;
+  }
+  ChannelContext *channel_context;
+  int result = CreateChannelContext(
+    destination, request, callback, &channel_context);
+  if (result != net::OK)
+    return result;
+  channel_context->channel_->Connect();
+  // Now wait for the asynchronous connect. When using UDP,
+  // the connect event will occur in the next event loop.
+  return net::ERR_IO_PENDING;
+}
+
 int NetworkLayer::SendRequestUsingChannelContext(
     scoped_refptr<Request> &request,
     ChannelContext *channel_context,
     const net::CompletionCallback& callback) {
   if (!channel_context->channel_->is_connected()) {
+    // A channel still being opened by |Connect| takes the first request,
+    // as if the request had opened it.
+    if (!channel_context->initial_request_ &&
+        Method::ACK != request->method()) {
+      channel_context->initial_request_ = request;
+      channel_context->initial_callback_ = callback;
+      return net::ERR_IO_PENDING;
+    }
     DVLOG(1) << "Cannot send a request yet";
     return net::ERR_SOCKET_NOT_CONNECTED;
   }
-  // Case the upper layer didn't copy a previous Via, create a new one
-  if (request->end() == request->find_first<Via>())
-    StampClientTopmostVia(request, channel_context->channel_);
+  if (overload_controller_ && overload_controller_->ShouldThrottle(
+          channel_context->channel_->destination(), *request)) {
+    DVLOG(1) << "Request throttled, as asked by the destination";
+    return net::ERR_TEMPORARILY_THROTTLED;
+  }
+  const EndPoint &destination = channel_context->channel_->destination();
+  if (IsForwarded(*request)) {
+    // Sent out of transactions, as its responses will be.
+    StampTopmostVia(request, channel_context,
+                    CreateStatelessBranch(*request));
+    if (NeedsTcpFallback(request.get(), destination.protocol())) {
+      request->erase(request->find_first<Via>());
+      return SendRequestToDestination(request,
+          EndPoint(destination.hostport(), Protocol::TCP), callback);
+    }
+    return channel_context->channel_->Send(request, callback);
+  }
+  // Case the upper layer didn't copy a previous Via, or it's proxying the
+  // request, create a new one
+  bool stamped_via = false;
+  if (request->end() == request->find_first<Via>()
+      || proxied_requests_.count(request->id())) {
+    StampClientTopmostVia(request, channel_context);
+    stamped_via = true;
+    if (overload_controller_)
+      overload_controller_->AdvertiseSupport(request);
+  }
   // Substitute the existing Contact by the real one
-  StampContact(request, channel_context->channel_);
-  // Send ACKs out of transactions
-  if (Method::ACK != request->method()) {
+  StampContact(request, channel_context);
+  if (channel_context->accepts_gzip_)
+    CompressContent(request.get());
+  if (NeedsTcpFallback(request.get(), destination.protocol())) {
+    // The Via and Contact are stamped again for the new channel.
+    if (stamped_via)
+      request->erase(request->find_first<Via>());
+    return SendRequestToDestination(request,
+        EndPoint(destination.hostport(), Protocol::TCP), callback);
+  }
+  proxied_requests_.erase(request->id());
+  // Send ACKs, and the requests given to |SendOutOfTransaction|, out of
+  // transactions
+  if (Method::ACK != request->method()
+      && !out_of_transaction_requests_.erase(request->id())) {
     // The created transaction will handle the response processing.
     // Requests don't need to be passed to client transactions.
     ignore_result(CreateClientTransaction(request, channel_context));
@@ -211,23 +710,83 @@ int NetworkLayer::SendRequestUsingChannelContext(
   return channel_context->channel_->Send(request, callback);
 }
 
+int NetworkLayer::SendRequestToTargets(scoped_refptr<Request> &request,
+    const std::vector<EndPoint> &targets,
+    const net::CompletionCallback& callback) {
+  for (std::vector<EndPoint>::const_iterator i = targets.begin(),
+       ie = targets.end(); i != ie; ++i) {
+    ChannelContext *channel_context = GetChannelContext(*i);
+    if (channel_context)
+      return SendRequestUsingChannelContext(request, channel_context,
+          callback);
+  }
+  if (Method::ACK == request->method()) {
+    DVLOG(1) << "ACK requests can't open connections";
+    return net::ERR_ABORTED;
+  }
+  int result = net::ERR_ADDRESS_UNREACHABLE;
+  for (std::vector<EndPoint>::const_iterator i = targets.begin(),
+       ie = targets.end(); i != ie; ++i) {
+    ChannelContext *channel_context;
+    result = CreateChannelContext(*i, request, callback, &channel_context);
+    if (result != net::OK)
+      continue;  // e.g. there's no factory for the protocol
+    LOG(INFO) << "Located " << i->ToString();
+    channel_context->located_ = true;
+    channel_context->fallback_targets_.assign(i + 1, ie);
+    channel_context->channel_->Connect();
+    return net::ERR_IO_PENDING;
+  }
+  return result;
+}
+
+void NetworkLayer::OnLocateComplete(scoped_refptr<Request> request,
+    const net::CompletionCallback& callback,
+    int result, const std::vector<EndPoint> &targets) {
+  if (result == net::OK)
+    result = SendRequestToTargets(request, targets, callback);
+  if (result != net::ERR_IO_PENDING && !callback.is_null())
+    callback.Run(result);
+}
+
 int NetworkLayer::SendResponse(const scoped_refptr<Response> &response,
                                const net::CompletionCallback& callback) {
-  // Add a Server header if there's none
-  if (!response->get<Server>()) {
-    scoped_ptr<Server> server(
-        new Server(network_settings_.software_name()));
-    response->push_back(server.Pass());
+  // Add the Server and static headers, unless the response has them
+  if (!response->static_headers().get())
+    response->set_static_headers(response_headers_);
+  if (overload_controller_) {
+    overload_controller_->AddFeedback(response,
+        server_transactions_.size());
+  }
+  if (response->refer_to().get() && AcceptsGzip(*response->refer_to()))
+    CompressContent(response.get());
+
+  if (!FitToTransport(response.get(),
+                      GetMessageEndPoint(*response).protocol())) {
+    DVLOG(1) << "Sending a response too large for UDP";
   }
 
   scoped_refptr<ServerTransaction> server_transaction =
-    GetServerTransaction(response);
+    GetServerTransaction(*response);
   if (server_transaction) {
+    const Response *const_response = response.get();
+    if (const_response->IsReliableProvisional()) {
+      // Registered once, for the PRACKs of all its reliable provisional
+      // responses.
+      ServerTransactionsMap::iterator i =
+          server_transactions_.find(server_transaction->id());
+      const Cseq *cseq = const_response->get<Cseq>();
+      if (i != server_transactions_.end() && i->second.prack_key_.empty()
+          && cseq && Method::INVITE == cseq->method()) {
+        i->second.prack_key_ = PrackKey(*const_response, cseq->sequence());
+        prack_transactions_[i->second.prack_key_] = server_transaction;
+      }
+    }
     server_transaction->Send(response);
   } else {
     // When there's no server transaction available, tries to send the
     // response directly through an available channel.
-    EndPoint destination(GetMessageEndPoint(response));
+    EndPoint destination(GetMessageEndPoint(*response));
     if (destination.IsEmpty()) {
       DVLOG(1) << "Impossible to route without Via";
       return net::ERR_INVALID_ARGUMENT;
@@ -243,6 +802,55 @@ int NetworkLayer::SendResponse(const scoped_refptr<Response> &response,
   return net::OK;
 }
 
+bool NetworkLayer::FitToTransport(Message *message,
+                                  const Protocol &protocol) {
+  Header::PrintStyle style = network_settings_.enable_compact_headers()
+      ? Header::PRINT_COMPACT : Header::PRINT_LONG;
+  message->set_print_style(style);
+  if (Protocol::UDP != protocol)
+    return true;
+  while (message->SerializedWire()->size() > kMaxDatagramMessageSize) {
+    if (Header::PRINT_TIGHT == style)
+      return false;
+    style = static_cast<Header::PrintStyle>(style + 1);
+    message->set_print_style(style);
+  }
+  return true;
+}
+
+bool NetworkLayer::NeedsTcpFallback(Request *request,
+                                    const Protocol &protocol) {
+  if (FitToTransport(request, protocol))
+    return false;
+  // ACKs go where their INVITE went, and can't open channels anyway.
+  if (Method::ACK == request->method()
+      || factories_.end() == factories_.find(Protocol::TCP)) {
+    DVLOG(1) << "Sending a request too large for UDP";
+    return false;
+  }
+  DVLOG(1) << "Request too large for UDP, sending it over TCP";
+  return true;
+}
+
+void NetworkLayer::CompressContent(Message *message) {
+  int threshold = network_settings_.compression_threshold();
+  const Message *const_message = message;
+  const std::string &content = const_message->encoded_content();
+  if (0 >= threshold
+      || content.size() < static_cast<size_t>(threshold)
+      || const_message->get<ContentEncoding>()
+      || const_message->get<Authorization>()
+      || const_message->get<ProxyAuthorization>())
+    return;
+  std::string compressed;
+  if (!EncodeContent(CONTENT_CODING_GZIP, content, &compressed)
+      || compressed.size() >= content.size())
+    return;
+  message->set_content(base::RefCountedString::TakeString(&compressed));
+  scoped_ptr<ContentEncoding> content_encoding(new ContentEncoding("gzip"));
+  message->push_back(content_encoding.Pass());
+}
+
 void NetworkLayer::RequestChannelInternal(ChannelContext *channel_context) {
   DCHECK(channel_context);
 
@@ -250,6 +858,15 @@ void NetworkLayer::RequestChannelInternal(ChannelContext *channel_context) {
   channel_context->refs_++;
   if (channel_context->timer_.IsRunning())
     channel_context->timer_.Stop();
+  if (channel_context->evicted_) {
+    channel_context->evicted_ = false;
+    --evicted_channel_count_;
+  }
+  if (channel_context->idle_) {
+    TransportStats::RecordIdleTime(
+        timer_wheel_.NowTicks() - channel_context->idle_since_);
+  }
+  RemoveIdleChannel(channel_context);
 }
 
 void NetworkLayer::ReleaseChannelInternal(ChannelContext *channel_context) {
@@ -258,12 +875,77 @@ void NetworkLayer::ReleaseChannelInternal(ChannelContext *channel_context) {
   channel_context->refs_--;
   // When all references reach zero, start the timer.
   if (channel_context->refs_ == 0) {
-    channel_context->timer_.Start(FROM_HERE,
+    channel_context->timer_.Start(
         base::TimeDelta::FromSeconds(network_settings_.reuse_lifetime()),
         base::Bind(&NetworkLayer::OnIdleChannelTimedOut,
             weak_factory_.GetWeakPtr(),
             channel_context->channel_->destination()));
+    AddIdleChannel(channel_context);
+    if (draining_) {
+      if (channel_context->idle_)
+        EvictIdleChannel(channel_context);
+      CheckDrained();
+    }
+  }
+}
+
+void NetworkLayer::AddIdleChannel(ChannelContext *channel_context) {
+  DCHECK(!channel_context->idle_);
+  channel_context->idle_ = true;
+  channel_context->idle_since_ = timer_wheel_.NowTicks();
+  idle_channels_.Append(channel_context);
+  ++idle_channel_count_;
+  int max_idle_channels = network_settings_.max_idle_channels();
+  if (max_idle_channels > 0 && idle_channel_count_ > max_idle_channels)
+    EvictIdleChannel(idle_channels_.head()->value());
+}
+
+void NetworkLayer::RemoveIdleChannel(ChannelContext *channel_context) {
+  if (!channel_context->idle_)
+    return;
+  channel_context->RemoveFromList();
+  channel_context->idle_ = false;
+  --idle_channel_count_;
+}
+
+void NetworkLayer::EvictIdleChannel(ChannelContext *channel_context) {
+  DCHECK(channel_context->idle_);
+  RemoveIdleChannel(channel_context);
+  channel_context->evicted_ = true;
+  ++evicted_channel_count_;
+  TransportStats::Count(TransportStats::EVICTED_CHANNELS);
+  channel_context->timer_.Start(base::TimeDelta(),
+      base::Bind(&NetworkLayer::OnIdleChannelTimedOut,
+          weak_factory_.GetWeakPtr(),
+          channel_context->channel_->destination()));
+}
+
+bool NetworkLayer::MakeRoomForChannel() {
+  int max_open_channels = network_settings_.max_open_channels();
+  if (max_open_channels <= 0)
+    return true;
+  // Evicted channels are as good as closed.
+  int open_channels =
+      static_cast<int>(channels_.size()) - evicted_channel_count_;
+  if (open_channels < max_open_channels)
+    return true;
+  if (idle_channels_.empty()) {
+    TransportStats::Count(TransportStats::REFUSED_CHANNELS);
+    return false;
   }
+  EvictIdleChannel(idle_channels_.head()->value());
+  return true;
+}
+
+void NetworkLayer::StartKeepAlive(ChannelContext *channel_context) {
+  int interval = network_settings_.keepalive_interval();
+  if (interval <= 0 || !channel_context->channel_->is_stream())
+    return;
+  channel_context->keepalive_timer_.Start(
+      base::TimeDelta::FromSeconds(interval),
+      base::Bind(&NetworkLayer::OnKeepAliveTimer,
+          weak_factory_.GetWeakPtr(),
+          channel_context->channel_->destination()));
 }
 
 ClientTransaction *NetworkLayer::CreateClientTransaction(
@@ -274,10 +956,18 @@ ClientTransaction *NetworkLayer::CreateClientTransaction(
       request->method(),
       ClientTransactionId(request),
       channel_context->channel_,
-      TimeDeltaFactory::GetDefaultFactory(),
+      network_settings_.time_delta_factory(),
+      &timer_wheel_,
       this);
-  client_transactions_[client_transaction->id()] = client_transaction;
-  channel_context->transactions_.insert(client_transaction->id());
+  BoundTransportLog net_log(MakeTransactionLog());
+  if (net_log.log())
+    client_transaction->SetNetLog(net_log);
+  // The table is keyed by the transaction's own copy of its id.
+  client_transactions_.erase(client_transaction->id());
+  ClientTransactionsMap::iterator i = client_transactions_.insert(
+      std::make_pair(base::StringPiece(client_transaction->id()),
+                     TransactionEntry(client_transaction))).first;
+  channel_context->transactions_.Append(&i->second);
   RequestChannelInternal(channel_context);
   client_transaction->Start(request);
   return client_transaction.get();
@@ -291,10 +981,30 @@ ServerTransaction *NetworkLayer::CreateServerTransaction(
       request->method(),
       ServerTransactionId(request),
       channel_context->channel_,
-      TimeDeltaFactory::GetDefaultFactory(),
+      network_settings_.time_delta_factory(),
+      &timer_wheel_,
       this);
-  server_transactions_[server_transaction->id()] = server_transaction;
-  channel_context->transactions_.insert(server_transaction->id());
+  BoundTransportLog net_log(MakeTransactionLog());
+  if (net_log.log())
+    server_transaction->SetNetLog(net_log);
+  ServerTransactionsMap::iterator i =
+      server_transactions_.find(server_transaction->id());
+  if (server_transactions_.end() != i)
+    EraseServerTransaction(i);
+  i = server_transactions_.insert(
+      std::make_pair(base::StringPiece(server_transaction->id()),
+                     TransactionEntry(server_transaction))).first;
+  if (Method::INVITE == request->method()) {
+    // Printed right after the "s:" of the id.
+    size_t branch_size = GetRfc3261Branch(*request).size();
+    if (branch_size > 0) {
+      i->second.invite_branch_ =
+          base::StringPiece(server_transaction->id()).substr(2, branch_size);
+      invite_transactions_[i->second.invite_branch_] =
+          server_transaction.get();
+    }
+  }
+  channel_context->transactions_.Append(&i->second);
   RequestChannelInternal(channel_context);
   server_transaction->Start(request);
   return server_transaction.get();
@@ -305,24 +1015,37 @@ void NetworkLayer::DestroyClientTransaction(
   client_transactions_.erase(client_transaction->id());
   ChannelContext *channel_context =
     GetChannelContext(client_transaction->channel()->destination());
-  if (channel_context) {
-    channel_context->transactions_.erase(client_transaction->id());
+  if (channel_context)
     ReleaseChannelInternal(channel_context);
-  }
   client_transaction->Close();
 }
 void NetworkLayer::DestroyServerTransaction(
                 const scoped_refptr<ServerTransaction> &server_transaction) {
-  server_transactions_.erase(server_transaction->id());
+  ServerTransactionsMap::iterator i =
+      server_transactions_.find(server_transaction->id());
+  if (i != server_transactions_.end())
+    EraseServerTransaction(i);
   ChannelContext *channel_context =
     GetChannelContext(server_transaction->channel()->destination());
-  if (channel_context) {
-    channel_context->transactions_.erase(server_transaction->id());
+  if (channel_context)
     ReleaseChannelInternal(channel_context);
-  }
   server_transaction->Close();
 }
 
+void NetworkLayer::EraseServerTransaction(ServerTransactionsMap::iterator i) {
+  if (!i->second.prack_key_.empty())
+    prack_transactions_.erase(i->second.prack_key_);
+  if (!i->second.invite_branch_.empty()) {
+    InviteTransactionsMap::iterator j =
+        invite_transactions_.find(i->second.invite_branch_);
+    // A later INVITE with the same branch may have taken the key over.
+    if (invite_transactions_.end() != j
+        && i->second.server_transaction_.get() == j->second)
+      invite_transactions_.erase(j);
+  }
+  server_transactions_.erase(i);
+}
+
 int NetworkLayer::CreateChannelContext(
           const EndPoint &destination,
           const scoped_refptr<Request> &request,
@@ -336,55 +1059,168 @@ int NetworkLayer::CreateChannelContext(
     factories_.find(destination.protocol());
   if (factories_it == factories_.end())
     return net::ERR_ADDRESS_UNREACHABLE;
+  if (!MakeRoomForChannel()) {
+    DVLOG(1) << "Too many open channels to reach " << destination.ToString();
+    return net::ERR_INSUFFICIENT_RESOURCES;
+  }
+  if (MemoryAccounting::IsOverBudget()) {
+    DVLOG(1) << "Over the memory budget, not opening a channel to "
+             << destination.ToString();
+    return net::ERR_INSUFFICIENT_RESOURCES;
+  }
   int result = factories_it->second->CreateChannel(
       destination, this, &channel);
   if (result != net::OK)
     return result;
 
+  channel->SetWriteQueueLimits(network_settings_.write_queue_limits());
+  channel->SetParseProfile(network_settings_.parse_profile());
+  channel->SetMessageLimits(network_settings_.message_limits());
+  channel->SetSocketOptions(
+      network_settings_.socket_options(destination.protocol()));
   *created_channel_context =
-      new ChannelContext(channel.get(), request, callback);
+      new ChannelContext(&timer_wheel_, channel.get(), request, callback);
+  (*created_channel_context)->compression_ =
+      network_settings_.enable_message_compression()
+      && channel->EnableCompression();
   channels_[destination] = *created_channel_context;
+  StartChannelLog(*created_channel_context);
+  // The caller connects the channel right away.
+  (*created_channel_context)->net_log_.BeginEvent(
+      TransportLog::TYPE_CHANNEL_CONNECT);
   return net::OK;
 }
 
 void NetworkLayer::DestroyChannelContext(ChannelContext *channel_context) {
   DCHECK(channel_context);
 
+  RemoveIdleChannel(channel_context);
+  if (channel_context->evicted_)
+    --evicted_channel_count_;
+
   channels_.erase(channel_context->channel_->destination());
 
   // The following code works as a 'cascade on delete'
   // for existing transactions still using the channel.
-  for (std::set<std::string>::iterator i =
-         channel_context->transactions_.begin(),
-       ie = channel_context->transactions_.end();
-       i != ie;) {
-    OnTransactionTerminated(*i++);
+  while (!channel_context->transactions_.empty()) {
+    TransactionEntry *entry = channel_context->transactions_.head()->value();
+    entry->Detach();
+    if (entry->client_transaction_.get()) {
+      scoped_refptr<ClientTransaction> client_transaction(
+          entry->client_transaction_);
+      DestroyClientTransaction(client_transaction);
+    } else {
+      scoped_refptr<ServerTransaction> server_transaction(
+          entry->server_transaction_);
+      DestroyServerTransaction(server_transaction);
+    }
   }
 
+  channel_context->net_log_.EndEvent(TransportLog::TYPE_CHANNEL_ALIVE);
   delete channel_context;
+  if (draining_)
+    CheckDrained();
+}
+
+void NetworkLayer::StartChannelLog(ChannelContext *channel_context) {
+  TransportLog *transport_log = network_settings_.transport_log();
+  if (!transport_log)
+    return;
+  channel_context->net_log_ = BoundTransportLog::Make(transport_log);
+  if (channel_context->net_log_.IsCapturing()) {
+    channel_context->net_log_.BeginEvent(TransportLog::TYPE_CHANNEL_ALIVE,
+        TransportLog::StringCallback("destination",
+            channel_context->channel_->destination().ToString()));
+  }
+}
+
+BoundTransportLog NetworkLayer::MakeTransactionLog() {
+  TransportLog *transport_log = network_settings_.transport_log();
+  if (!transport_log || !transport_log->ShouldTraceTransaction())
+    return BoundTransportLog();
+  return BoundTransportLog::Make(transport_log);
+}
+
+void NetworkLayer::CaptureMessage(MessageCapture::Direction direction,
+                                  const scoped_refptr<Channel> &channel,
+                                  const scoped_refptr<Message> &message) {
+  MessageCapture *message_capture = network_settings_.message_capture();
+  if (!message_capture)
+    return;
+  EndPoint origin;
+  if (channel->origin(&origin) != net::OK)
+    origin = EndPoint();
+  message_capture->Capture(direction, origin, channel->destination(),
+                           message->SerializedWire());
 }
 
 std::string NetworkLayer::CreateBranch() {
   return network_settings_.branch_factory()->CreateBranch();
 }
 
+bool NetworkLayer::CacheStamps(ChannelContext *channel_context) {
+  if (channel_context->stamps_cached_)
+    return true;
+  const scoped_refptr<Channel> &channel = channel_context->channel_;
+  EndPoint origin;
+  if (net::OK != channel->origin(&origin) || origin.IsEmpty())
+    return false;
+  channel_context->sent_by_ = ViaParam(origin.protocol(), origin.hostport());
+  if (channel_context->compression_) {
+    channel_context->sent_by_.param_set("comp",
+                                        MessageCompressor::kCompressionName);
+  }
+  std::string contact_address("sip:");
+  contact_address += origin.hostport().ToString();
+  if (Protocol::UDP == channel->destination().protocol()) {
+    // do nothing
+  } else if (Protocol::TCP == channel->destination().protocol()) {
+    contact_address += ";transport=tcp";
+  } else if (Protocol::TLS == channel->destination().protocol()) {
+    contact_address += ";transport=tls";
+  } else if (Protocol::WS == channel->destination().protocol()) {
+    contact_address += ";transport=ws";
+  } else if (Protocol::WSS == channel->destination().protocol()) {
+    contact_address += ";transport=wss";
+  }
+  channel_context->contact_address_ = GURL(contact_address);
+  channel_context->outbound_contact_address_ =
+      GURL(contact_address + ";ob");
+  channel_context->stamps_cached_ = true;
+  return true;
+}
+
+void NetworkLayer::ClearStamps(ChannelContext *channel_context) {
+  channel_context->stamps_cached_ = false;
+  channel_context->sent_by_ = ViaParam();
+  channel_context->contact_address_ = GURL();
+  channel_context->outbound_contact_address_ = GURL();
+}
+
 void NetworkLayer::StampClientTopmostVia(
     const scoped_refptr<Request> &request,
-    const scoped_refptr<Channel> &channel) {
-  EndPoint origin;
-  int rv = channel->origin(&origin);
-  CHECK(net::OK == rv);
+    ChannelContext *channel_context) {
+  StampTopmostVia(request, channel_context, CreateBranch());
+}
+
+void NetworkLayer::StampTopmostVia(
+    const scoped_refptr<Request> &request,
+    ChannelContext *channel_context,
+    const std::string &branch) {
+  bool cached = CacheStamps(channel_context);
+  CHECK(cached);
   scoped_ptr<Via> via(new Via);
-  net::HostPortPair hostport(origin.host(), origin.port());
-  via->push_back(ViaParam(origin.protocol(), hostport));
-  via->back().set_branch(CreateBranch());
+  via->push_back(channel_context->sent_by_);
+  via->back().set_branch(branch);
   request->push_front(via.Pass());
 }
 
 void NetworkLayer::StampServerTopmostVia(
     const scoped_refptr<Request> &request,
     const scoped_refptr<Channel> &channel) {
-  EndPoint destination(channel->destination());
+  // Incoming messages are stamped with the destination known by the
+  // channel, which holds the received-IP string already.
+  const EndPoint &destination = channel->destination();
   Message::iterator topmost_via = request->find_first<Via>();
   if (topmost_via == request->end()) {
     // When there's no Via header, we create one
@@ -404,199 +1240,135 @@ void NetworkLayer::StampServerTopmostVia(
 
 void NetworkLayer::StampContact(
     const scoped_refptr<Request> &request,
-    const scoped_refptr<Channel> &channel) {
+    ChannelContext *channel_context) {
   Contact *contact = request->get<Contact>();
-  if (!contact)
+  if (!contact || !CacheStamps(channel_context))
     return;
-  std::string contact_address("sip:");
-  EndPoint endpoint;
-  ignore_result(channel->origin(&endpoint));
-  if (endpoint.IsEmpty())
-    return;
-  contact_address += endpoint.hostport().ToString();
-  if (Protocol::UDP == channel->destination().protocol()) {
-    // do nothing
-  } else if (Protocol::TCP == channel->destination().protocol()) {
-    contact_address += ";transport=tcp";
-  } else if (Protocol::TLS == channel->destination().protocol()) {
-    contact_address += ";transport=tls";
-  } else if (Protocol::WS == channel->destination().protocol()) {
-    contact_address += ";transport=ws";
-  } else if (Protocol::WSS == channel->destination().protocol()) {
-    contact_address += ";transport=wss";
-  }
-  if (Method::REGISTER != request->method()) {
-    contact_address += ";ob";
-  }
+  const GURL &contact_address = Method::REGISTER == request->method()
+      ? channel_context->contact_address_
+      : channel_context->outbound_contact_address_;
   for (has_multiple<ContactInfo>::iterator i = contact->begin(),
        ie = contact->end(); i != ie; i++) {
     if (i->address().SchemeIs("sip") || i->address().SchemeIs("sips")) {
       SipURI uri(i->address());
-      if ("domain.invalid" == uri.host())
-        i->set_address(GURL(contact_address));
+      if ("domain.invalid" != uri.host())
+        continue;
+      // Users are kept, as they tell apart the accounts of a user agent
+      // sharing the same address; and so are parameters, such as those of
+      // push notifications (RFC 8599).
+      std::string username(uri.username());
+      if (username.empty() && !uri.has_parameters()) {
+        i->set_address(contact_address);
+      } else {
+        std::string address(contact_address.spec());
+        if (!username.empty())
+          address.insert(sizeof("sip:") - 1, username + "@");
+        uri.parameters_piece().AppendToString(&address);
+        i->set_address(GURL(address));
+      }
     }
   }
 }
 
 std::string NetworkLayer::ClientTransactionId(
               const scoped_refptr<Request> &request) {
-  Message::const_iterator topmost_via = request->find_first<Via>();
-  DCHECK(topmost_via != request->end());
-  const Via *via = dyn_cast<Via>(topmost_via);
   std::string id;
-  id += "c:";   // Protect against clashes with server transactions
-  id += via->front().branch();
-  id += ":";
-  id += request->method().str();
+  raw_string_ostream os(id);
+  PrintClientTransactionId(os, *request.get(), request->method());
+  os.flush();
   return id;
 }
 
-std::string NetworkLayer::ClientTransactionId(
-              const scoped_refptr<Response> &response) {
-  Message::const_iterator topmost_via = response->find_first<Via>();
-  Message::const_iterator cseq_it = response->find_first<Cseq>();
-  DCHECK(topmost_via != response->end());
-  DCHECK(cseq_it != response->end());
-  const Via *via = dyn_cast<Via>(topmost_via);
-  const Cseq *cseq = dyn_cast<Cseq>(cseq_it);
+std::string NetworkLayer::ServerTransactionId(
+              const scoped_refptr<Request> &request) {
   std::string id;
-  id += "c:";
-  id += via->front().branch();
-  id += ":";
-  id += cseq->method().str();
+  raw_string_ostream os(id);
+  PrintServerTransactionId(os, *request.get(), request->method());
+  os.flush();
   return id;
 }
 
-std::string NetworkLayer::ServerTransactionId(
-              const scoped_refptr<Request> &request) {
-  Message::const_iterator topmost_via = request->find_first<Via>();
-  if (topmost_via != request->end()) {
+std::string NetworkLayer::PrackKey(const Message &message, unsigned sequence) {
+  const CallId *call_id = message.get<CallId>();
+  const From *from = message.get<From>();
+  std::string key;
+  raw_string_ostream os(key);
+  if (call_id)
+    os << call_id->value();
+  os << ":";
+  if (from && from->HasTag())
+    os << from->tag();
+  os << ":" << sequence;
+  os.flush();
+  return key;
+}
+
+void NetworkLayer::PrintClientTransactionId(raw_ostream &os,
+                                            const Message &message,
+                                            const Method &method) {
+  Message::const_iterator topmost_via = message.find_first<Via>();
+  DCHECK(topmost_via != message.end());
+  const Via *via = dyn_cast<Via>(topmost_via);
+  os << "c:"   // Protect against clashes with server transactions
+     << via->front().branch() << ":" << method.str();
+}
+
+void NetworkLayer::PrintServerTransactionId(raw_ostream &os,
+                                            const Message &message,
+                                            const Method &method) {
+  const char *method_str =
+      method == Method::ACK ? Method(Method::INVITE).str() : method.str();
+  Message::const_iterator topmost_via = message.find_first<Via>();
+  if (topmost_via != message.end()) {
     const Via *via = dyn_cast<Via>(topmost_via);
     if (via->front().HasBranch()
         && base::StartsWith(via->front().branch(), kMagicCookie,
             base::CompareCase::SENSITIVE)) {
-      std::string id;
-      id += "s:";  // Protect against clashes with server transactions
-      id += via->front().branch();
-      id += ":";
-      id += via->front().sent_by().ToString();
-      id += ":";
-      Method method(request->method());
-      if (method == Method::ACK)
-        method = Method::INVITE;
-      id += method.str();
-      return id;
+      os << "s:"  // Protect against clashes with client transactions
+         << via->front().branch() << ":";
+      PrintSentBy(os, via->front().sent_by());
+      os << ":" << method_str;
+      return;
     }
   }
-  Message::const_iterator to_it = request->find_first<To>();
-  Message::const_iterator from_it = request->find_first<From>();
-  Message::const_iterator callid_it = request->find_first<CallId>();
-  Message::const_iterator cseq_it = request->find_first<Cseq>();
+  Message::const_iterator to_it = message.find_first<To>();
+  Message::const_iterator from_it = message.find_first<From>();
+  Message::const_iterator callid_it = message.find_first<CallId>();
+  Message::const_iterator cseq_it = message.find_first<Cseq>();
   // These headers are mandatory:
-  DCHECK(to_it != request->end() && from_it != request->end()
-         && callid_it != request->end() && cseq_it != request->end());
+  DCHECK(to_it != message.end() && from_it != message.end()
+         && callid_it != message.end() && cseq_it != message.end());
   // This is the fallback compatibility with ancient RFC 2543 implementations.
   // We're not considering the Request-URI as there's no way to relate the
   // subsequent responses to the transaction afterwards. There's a possibility
   // to exist clashes, but in practice they will be very rare.
-  std::string id;
-  id += "s:";
+  os << "s:";
   if (dyn_cast<To>(to_it)->HasTag())
-    id += dyn_cast<To>(to_it)->tag();
-  id += ":";
+    os << dyn_cast<To>(to_it)->tag();
+  os << ":";
   if (dyn_cast<From>(from_it)->HasTag())
-    id += dyn_cast<From>(from_it)->tag();
-  id += ":";
-  id += dyn_cast<CallId>(callid_it)->value();
-  id += ":";
-  id += base::IntToString(dyn_cast<Cseq>(cseq_it)->sequence());
-  id += ":";
-  Method method(request->method());
-  if (method == Method::ACK)
-    method = Method::INVITE;
-  id += method.str();
-  id += ":";
-  if (topmost_via != request->end()) {
+    os << dyn_cast<From>(from_it)->tag();
+  os << ":" << dyn_cast<CallId>(callid_it)->value()
+     << ":" << dyn_cast<Cseq>(cseq_it)->sequence()
+     << ":" << method_str << ":";
+  if (topmost_via != message.end()) {
     const Via *via = dyn_cast<Via>(topmost_via);
-    id += via->front().sent_by().ToString();
-    id += ":";
+    PrintSentBy(os, via->front().sent_by());
+    os << ":";
     if (via->front().HasBranch())
-      id += via->front().branch();
+      os << via->front().branch();
   }
-  return id;
 }
 
-std::string NetworkLayer::ServerTransactionId(
-              const scoped_refptr<Response> &response) {
-  Message::const_iterator topmost_via = response->find_first<Via>();
-  Message::const_iterator cseq_it = response->find_first<Cseq>();
-  DCHECK(cseq_it != response->end());
-  if (topmost_via != response->end()) {
-    const Via *via = dyn_cast<Via>(topmost_via);
-    if (via->front().HasBranch()
-        && base::StartsWith(via->front().branch(), kMagicCookie,
-            base::CompareCase::SENSITIVE)) {
-      std::string id;
-      id += "s:";  // Protect against clashes with server transactions
-      id += via->front().branch();
-      id += ":";
-      id += via->front().sent_by().ToString();
-      id += ":";
-      // Remember ACKs normally doesn't get answers from UAS's
-      id += dyn_cast<Cseq>(cseq_it)->method().str();
-      return id;
-    }
-  }
-  Message::const_iterator to_it = response->find_first<To>();
-  Message::const_iterator from_it = response->find_first<From>();
-  Message::const_iterator callid_it = response->find_first<CallId>();
-  // These headers are mandatory:
-  DCHECK(to_it != response->end() && from_it != response->end()
-         && callid_it != response->end());
-  // This is the fallback compatibility with ancient RFC 2543 implementations
-  std::string id;
-  id += "s:";
-  if (dyn_cast<To>(to_it)->HasTag())
-    id += dyn_cast<To>(to_it)->tag();
-  id += ":";
-  if (dyn_cast<From>(from_it)->HasTag())
-    id += dyn_cast<From>(from_it)->tag();
-  id += ":";
-  id += dyn_cast<CallId>(callid_it)->value();
-  id += ":";
-  id += base::IntToString(dyn_cast<Cseq>(cseq_it)->sequence());
-  id += ":";
-  Method method(dyn_cast<Cseq>(cseq_it)->method());
-  if (method == Method::ACK)
-    method = Method::INVITE;
-  id += method.str();
-  id += ":";
-  if (topmost_via != response->end()) {
-    const Via *via = dyn_cast<Via>(topmost_via);
-    id += via->front().sent_by().ToString();
-    id += ":";
-    if (via->front().HasBranch())
-      id += via->front().branch();
-  }
-  return id;
-}
-
-EndPoint NetworkLayer::GetMessageEndPoint(
-    const scoped_refptr<Message> &message) {
-  if (isa<Request>(message)) {
-    scoped_refptr<Request> request = dyn_cast<Request>(message);
-    GURL destination;
-    Route *route = request->get<Route>();
-    if (route && !route->empty())
-      return EndPoint::FromGURL(route->front().address());
-    else
-      return EndPoint::FromGURL(request->request_uri());
+EndPoint NetworkLayer::GetMessageEndPoint(const Message &message) {
+  if (isa<Request>(&message)) {
+    const Request *request = dyn_cast<Request>(&message);
+    return EndPoint::FromSipURI(GetRequestTarget(*request));
   } else {
-    scoped_refptr<Response> response = dyn_cast<Response>(message);
-    Message::iterator topmost_via = response->find_first<Via>();
-    if (topmost_via == response->end())
+    Message::const_iterator topmost_via = message.find_first<Via>();
+    if (topmost_via == message.end())
       return EndPoint();
-    Via *via = dyn_cast<Via>(topmost_via);
+    const Via *via = dyn_cast<Via>(topmost_via);
     EndPoint result(via->front().sent_by(), via->front().protocol());
     if (via->front().HasReceived())
       result.set_host(via->front().received());
@@ -606,6 +1378,68 @@ EndPoint NetworkLayer::GetMessageEndPoint(
   }
 }
 
+std::string NetworkLayer::CreateStatelessBranch(const Request &request) {
+  // RFC 3261 section 16.11: hash the received branch, or the fields
+  // identifying the transaction of RFC 2543 requests. The method is left
+  // out, so that CANCELs and ACKs match the INVITE downstream. The
+  // Request-URI is added, so that forks get branches of their own.
+  std::string input;
+  const Via *via = request.get<Via>();
+  if (via && !via->empty() && via->front().HasBranch()
+      && base::StartsWith(via->front().branch(), kMagicCookie,
+          base::CompareCase::SENSITIVE)) {
+    input.append(via->front().branch());
+  } else {
+    const To *to = request.get<To>();
+    const From *from = request.get<From>();
+    const CallId *call_id = request.get<CallId>();
+    const Cseq *cseq = request.get<Cseq>();
+    if (to && to->HasTag())
+      input.append(to->tag());
+    input.append(":");
+    if (from && from->HasTag())
+      input.append(from->tag());
+    input.append(":");
+    if (call_id)
+      input.append(call_id->value());
+    input.append(":");
+    if (cseq)
+      input.append(base::UintToString(cseq->sequence()));
+    input.append(":");
+    if (via && !via->empty())
+      input.append(via->front().sent_by().ToString());
+  }
+  input.append(":");
+  input.append(request.request_uri().spec());
+  return kStatelessBranchPrefix + base::MD5String(input);
+}
+
+bool NetworkLayer::IsStatelessBranch(const std::string &branch) {
+  return kStatelessBranchLength == branch.size()
+      && base::StartsWith(branch, kStatelessBranchPrefix,
+          base::CompareCase::SENSITIVE);
+}
+
+bool NetworkLayer::IsLocalURI(const SipURI &uri) const {
+  EndPoint endpoint(EndPoint::FromSipURI(uri));
+  for (std::vector<ChannelListener*>::const_iterator i = listeners_.begin(),
+       ie = listeners_.end(); i != ie; ++i) {
+    EndPoint local;
+    if (net::OK == (*i)->GetLocalEndPoint(&local)
+        && local.port() == endpoint.port()
+        && base::EqualsCaseInsensitiveASCII(endpoint.host(), local.host()))
+      return true;
+  }
+  return false;
+}
+
+SipURI NetworkLayer::GetRequestTarget(const Request &request) {
+  const Route *route = request.get<Route>();
+  if (route && !route->empty())
+    return route->front().sip_address();
+  return request.sip_request_uri();
+}
+
 NetworkLayer::ChannelContext *NetworkLayer::GetChannelContext(
     const EndPoint &destination) {
   ChannelsMap::iterator channel_it;
@@ -616,42 +1450,62 @@ NetworkLayer::ChannelContext *NetworkLayer::GetChannelContext(
 }
 
 scoped_refptr<ClientTransaction> NetworkLayer::GetClientTransaction(
-                                      const scoped_refptr<Message> &message) {
-  DCHECK(isa<Response>(message));
-
-  scoped_refptr<Response> response = dyn_cast<Response>(message);
-  std::string transaction_id(ClientTransactionId(response));
-  return GetClientTransaction(transaction_id);
+                                      const Response &response) {
+  const Cseq *cseq = response.get<Cseq>();
+  DCHECK(cseq);
+  char buffer[kTransactionIdBufferSize];
+  raw_fixed_buffer_ostream os(buffer, sizeof(buffer));
+  PrintClientTransactionId(os, response, cseq->method());
+  return GetClientTransaction(os.str());
 }
 
 scoped_refptr<ServerTransaction> NetworkLayer::GetServerTransaction(
-                                      const scoped_refptr<Message> &message) {
-  std::string transaction_id;
-  if (isa<Request>(message)) {
-    scoped_refptr<Request> request = dyn_cast<Request>(message);
-    transaction_id = ServerTransactionId(request);
+                                      const Message &message) {
+  char buffer[kTransactionIdBufferSize];
+  raw_fixed_buffer_ostream os(buffer, sizeof(buffer));
+  if (isa<Request>(&message)) {
+    const Request *request = dyn_cast<Request>(&message);
+    if (Method::ACK == request->method()
+        && !GetRfc3261Branch(message).empty()) {
+      // ACKs of non-2xx responses share the branch of their INVITE; those
+      // of 2xx responses have branches of their own, and match nothing.
+      return GetInviteServerTransaction(message);
+    }
+    PrintServerTransactionId(os, message, request->method());
   } else {
-    scoped_refptr<Response> response = dyn_cast<Response>(message);
-    transaction_id = ServerTransactionId(response);
+    const Cseq *cseq = message.get<Cseq>();
+    DCHECK(cseq);
+    PrintServerTransactionId(os, message, cseq->method());
   }
-  return GetServerTransaction(transaction_id);
+  return GetServerTransaction(os.str());
 }
 
 scoped_refptr<ClientTransaction> NetworkLayer::GetClientTransaction(
-                      const std::string &transaction_id) {
+                      const base::StringPiece &transaction_id) {
   ClientTransactionsMap::iterator client_transactions_it =
     client_transactions_.find(transaction_id);
   if (client_transactions_it == client_transactions_.end())
     return 0;
-  return client_transactions_it->second;
+  return client_transactions_it->second.client_transaction_;
 }
 scoped_refptr<ServerTransaction> NetworkLayer::GetServerTransaction(
-                      const std::string &transaction_id) {
+                      const base::StringPiece &transaction_id) {
   ServerTransactionsMap::iterator server_transactions_it =
     server_transactions_.find(transaction_id);
   if (server_transactions_it == server_transactions_.end())
     return 0;
-  return server_transactions_it->second;
+  return server_transactions_it->second.server_transaction_;
+}
+
+scoped_refptr<ServerTransaction> NetworkLayer::GetInviteServerTransaction(
+                      const Message &message) {
+  base::StringPiece branch(GetRfc3261Branch(message));
+  if (branch.empty())
+    return 0;
+  InviteTransactionsMap::iterator i = invite_transactions_.find(branch);
+  if (i == invite_transactions_.end())
+    return 0;
+  return i->second;
 }
 
 void NetworkLayer::OnChannelConnected(const scoped_refptr<Channel> &channel,
@@ -663,8 +1517,19 @@ void NetworkLayer::OnChannelConnected(const scoped_refptr<Channel> &channel,
   ChannelContext *channel_context = channel_it->second;
   EndPoint destination(channel_context->channel_->destination());
   int initial_result = result;
+  channel_context->net_log_.EndEventWithNetErrorCode(
+      TransportLog::TYPE_CHANNEL_CONNECT, result);
   delegate_->OnChannelConnected(destination, initial_result);
+  if (locator_ && channel_context->located_) {
+    if (result == net::OK)
+      locator_->ReportTargetSuccess(destination);
+    else
+      locator_->ReportTargetFailure(destination);
+  }
   if (result == net::OK) {
+    // A channel connected again may have been given another origin.
+    ClearStamps(channel_context);
+    StartKeepAlive(channel_context);
     if (channel_context->initial_request_) {
       result = SendRequestUsingChannelContext(channel_context->initial_request_,
         channel_context, channel_context->initial_callback_);
@@ -684,10 +1549,25 @@ void NetworkLayer::OnChannelConnected(const scoped_refptr<Channel> &channel,
   }
   if (result != net::OK && result != net::ERR_IO_PENDING) {
     net::CompletionCallback callback(channel_context->initial_callback_);
+    scoped_refptr<Request> initial_request(channel_context->initial_request_);
+    std::vector<EndPoint> fallback_targets;
+    fallback_targets.swap(channel_context->fallback_targets_);
     scoped_refptr<Channel> channel(channel_context->channel_);
     EndPoint destination(channel_context->channel_->destination());
     DestroyChannelContext(channel_context);
     channel->Close();
+    if (initial_result != net::OK && initial_request &&
+        !fallback_targets.empty()) {
+      // Fail over to the next located server (RFC 3263 section 4.3).
+      result = SendRequestToTargets(initial_request, fallback_targets,
+          callback);
+      if (result == net::ERR_IO_PENDING)
+        return;
+    }
+    if (initial_request) {
+      out_of_transaction_requests_.erase(initial_request->id());
+      proxied_requests_.erase(initial_request->id());
+    }
     if (!callback.is_null())
       callback.Run(result);
     if (initial_result == net::OK)
@@ -697,19 +1577,37 @@ void NetworkLayer::OnChannelConnected(const scoped_refptr<Channel> &channel,
 
 void NetworkLayer::OnIncomingMessage(const scoped_refptr<Channel> &channel,
                                      const scoped_refptr<Message> &message) {
+  TRACE_EVENT0("sippet", "NetworkLayer::OnIncomingMessage");
+  TRACE_EVENT_FLOW_STEP0("sippet", "IncomingMessage", message.get(),
+                         "NetworkLayer");
+  // Splits the network and queueing time from the processing one.
+  if (!message->receive_time().is_null()) {
+    TransportStats::RecordLoopLag(TransportStats::RECEIVE_QUEUEING,
+        base::TimeTicks::Now() - message->receive_time());
+  }
+  CaptureMessage(MessageCapture::INCOMING, channel, message);
+  if (network_settings_.compression_threshold() > 0
+      && AcceptsGzip(*message)) {
+    ChannelContext *channel_context =
+        GetChannelContext(channel->destination());
+    if (channel_context)
+      channel_context->accepts_gzip_ = true;
+  }
   if (isa<Request>(message)) {
     scoped_refptr<Request> request = dyn_cast<Request>(message);
     StampServerTopmostVia(request, channel);
     scoped_refptr<ServerTransaction> server_transaction =
-      GetServerTransaction(request);
+      GetServerTransaction(*request);
     if (server_transaction)
       server_transaction->HandleIncomingRequest(request);
     else
       HandleIncomingRequest(channel, request);
   } else {  // response
     scoped_refptr<Response> response = dyn_cast<Response>(message);
+    if (overload_controller_)
+      overload_controller_->HandleFeedback(channel->destination(), *response);
     scoped_refptr<ClientTransaction> client_transaction =
-      GetClientTransaction(response);
+      GetClientTransaction(*response);
     if (client_transaction)
       client_transaction->HandleIncomingResponse(response);
     else
@@ -725,11 +1623,137 @@ void NetworkLayer::HandleIncomingRequest(
 
   DCHECK(channel_context);
 
+  if (stateless_delegate_ &&
+      stateless_delegate_->HandleStatelessRequest(request))
+    return;
+
+  if (Method::ACK == request->method()) {
+    // The ACKs of 2xx responses (RFC 3261 section 13.3.1.4) are handed
+    // straight to the delegate, to find their dialogs: no transaction
+    // takes them.
+    TRACE_EVENT0("sippet", "NetworkLayer::Delegate::OnIncomingRequest");
+    TRACE_EVENT_FLOW_END0("sippet", "IncomingMessage", request.get());
+    delegate_->OnIncomingRequest(request);
+    return;
+  }
+
   // Server transactions are created in advance
+  bool overloaded = overload_controller_ &&
+      overload_controller_->ShouldReject(*request,
+                                         server_transactions_.size());
+  if (!overloaded && MemoryAccounting::IsOverBudget()
+      && StartsNewWork(*request)) {
+    overloaded = true;
+  }
   CreateServerTransaction(request, channel_context);
+  if (overloaded) {
+    // Answered here, so that the retransmissions are absorbed by the
+    // transaction and the delegate never sees the request.
+    LOG(WARNING) << "Overloaded, rejecting " << request->method().str();
+    scoped_refptr<Response> response =
+        request->CreateResponse(SIP_SERVICE_UNAVAILABLE);
+    scoped_ptr<RetryAfter> retry_after(new RetryAfter(overload_controller_
+        ? overload_controller_->retry_after() : kOverBudgetRetryAfter));
+    response->push_back(retry_after.Pass());
+    SendResponse(response, net::CompletionCallback());
+    return;
+  }
+  if (draining_ && StartsNewWork(*request)) {
+    RejectWhileDraining(request);
+    return;
+  }
+  if (Method::CANCEL == request->method()
+      && !GetRfc3261Branch(*request).empty()
+      && !GetInviteServerTransaction(*request)) {
+    // RFC 3261 section 9.2: nothing left to cancel. CANCELs of RFC 2543
+    // clients are left to the delegate.
+    DVLOG(1) << "CANCEL matching no INVITE server transaction";
+    SendResponse(
+        request->CreateResponse(SIP_CALL_TRANSACTION_DOES_NOT_EXIST),
+        net::CompletionCallback());
+    return;
+  }
+  if (Method::PRACK == request->method() && !HandlePrack(request)) {
+    // RFC 3262 section 3: nothing left to acknowledge.
+    DVLOG(1) << "PRACK matching no reliable provisional response";
+    SendResponse(
+        request->CreateResponse(SIP_CALL_TRANSACTION_DOES_NOT_EXIST),
+        net::CompletionCallback());
+    return;
+  }
+  if (network_settings_.answer_options() && AnswerOptions(channel, request))
+    return;
+  TRACE_EVENT0("sippet", "NetworkLayer::Delegate::OnIncomingRequest");
+  TRACE_EVENT_FLOW_END0("sippet", "IncomingMessage", request.get());
   delegate_->OnIncomingRequest(request);
 }
 
+void NetworkLayer::RejectWhileDraining(const scoped_refptr<Request> &request) {
+  DVLOG(1) << "Draining, turning away " << request->method().str();
+  scoped_refptr<Response> response;
+  if (drain_alternates_.empty()) {
+    response = request->CreateResponse(SIP_SERVICE_UNAVAILABLE);
+    scoped_ptr<RetryAfter> retry_after(new RetryAfter(overload_controller_
+        ? overload_controller_->retry_after() : kOverBudgetRetryAfter));
+    response->push_back(retry_after.Pass());
+  } else {
+    response = request->CreateResponse(SIP_MOVED_TEMPORARILY);
+    scoped_ptr<Contact> contact(new Contact);
+    for (std::vector<GURL>::const_iterator i = drain_alternates_.begin(),
+         ie = drain_alternates_.end(); i != ie; ++i)
+      contact->push_back(ContactInfo(*i));
+    response->push_back(contact.Pass());
+  }
+  SendResponse(response, net::CompletionCallback());
+}
+
+void NetworkLayer::CheckDrained() {
+  if (drained_callback_.is_null() || !client_transactions_.empty()
+      || !server_transactions_.empty())
+    return;
+  for (ChannelsMap::const_iterator i = channels_.begin(),
+       ie = channels_.end(); i != ie; ++i) {
+    if (i->second->refs_ > 0)
+      return;
+  }
+  LOG(INFO) << "Drained";
+  base::MessageLoop* message_loop = base::MessageLoop::current();
+  CHECK(message_loop);
+  message_loop->PostTask(FROM_HERE, drained_callback_);
+  drained_callback_.Reset();
+}
+
+bool NetworkLayer::AnswerOptions(const scoped_refptr<Channel> &channel,
+                                 const scoped_refptr<Request> &request) {
+  const Request *const_request = request.get();
+  const To *to = const_request->get<To>();
+  if (Method::OPTIONS != request->method() || (to && to->HasTag()))
+    return false;
+  scoped_refptr<ServerTransaction> server_transaction =
+      GetServerTransaction(*request);
+  if (!server_transaction)
+    return false;
+  // Sent by the transaction itself, as the canned response can't be
+  // matched to it.
+  scoped_refptr<Response> response = request->CreateCannedResponse(SIP_OK);
+  response->set_static_headers(response_headers_);
+  FitToTransport(response.get(), channel->destination().protocol());
+  server_transaction->Send(response);
+  return true;
+}
+
+bool NetworkLayer::HandlePrack(const scoped_refptr<Request> &prack) {
+  const Request *const_prack = prack.get();
+  const RAck *rack = const_prack->get<RAck>();
+  if (!rack)
+    return false;
+  PrackTransactionsMap::iterator i =
+      prack_transactions_.find(PrackKey(*const_prack, rack->sequence()));
+  if (i == prack_transactions_.end())
+    return false;
+  return i->second->HandlePrack(prack);
+}
+
 void NetworkLayer::HandleIncomingResponse(
                                  const scoped_refptr<Channel> &channel,
                                  const scoped_refptr<Response> &response) {
@@ -738,6 +1762,17 @@ void NetworkLayer::HandleIncomingResponse(
 
   DCHECK(channel_context);
 
+  const Response *const_response = response.get();
+  const Via *via = const_response->get<Via>();
+  if (via && !via->empty() && via->front().HasBranch()
+      && IsStatelessBranch(via->front().branch())) {
+    ForwardResponse(response);
+    return;
+  }
+
+  if (response_router_ && response_router_->RouteResponse(response))
+    return;
+
   // It's not a good idea to pass these responses up, as they aren't related
   // to an initiated request, so we're going to discard them at this point.
 
@@ -747,6 +1782,30 @@ void NetworkLayer::HandleIncomingResponse(
                << "), unattached to any request";
 }
 
+void NetworkLayer::ForwardResponse(const scoped_refptr<Response> &response) {
+  // RFC 3261 section 16.7, step 3: remove the Via of this proxy, and send
+  // the response to the next one.
+  Message::iterator topmost_via = response->find_first<Via>();
+  Via *via = dyn_cast<Via>(topmost_via);
+  via->pop_front();
+  if (via->empty())
+    response->erase(topmost_via);
+  EndPoint destination(GetMessageEndPoint(*response));
+  if (destination.IsEmpty()) {
+    DVLOG(1) << "Discarded forwarded response, without a Via to route it";
+    return;
+  }
+  ChannelContext *channel_context = GetChannelContext(destination);
+  if (!channel_context) {
+    DVLOG(1) << "No channel can forward the response to "
+             << destination.ToString();
+    return;
+  }
+  if (!FitToTransport(response.get(), destination.protocol()))
+    DVLOG(1) << "Forwarding a response too large for UDP";
+  channel_context->channel_->Send(response, net::CompletionCallback());
+}
+
 void NetworkLayer::OnChannelClosed(const scoped_refptr<Channel> &channel,
                                    int error) {
   ChannelContext *channel_context = GetChannelContext(channel->destination());
@@ -754,71 +1813,265 @@ void NetworkLayer::OnChannelClosed(const scoped_refptr<Channel> &channel,
 
   EndPoint destination(channel->destination());
   scoped_refptr<Channel> closing_channel(channel);
+  if (channel_context->net_log_.IsCapturing()) {
+    channel_context->net_log_.AddEvent(TransportLog::TYPE_CHANNEL_CLOSED,
+        TransportLog::IntegerCallback("net_error", error));
+  }
   DestroyChannelContext(channel_context);
   closing_channel->CloseWithError(error);
   delegate_->OnChannelClosed(destination);
 }
 
+void NetworkLayer::OnKeepAliveReceived(const scoped_refptr<Channel> &channel) {
+  ChannelContext *channel_context = GetChannelContext(channel->destination());
+  if (!channel_context || channel_context->channel_ != channel)
+    return;
+  // Pings from the peer have been answered by the channel already.
+  if (!channel_context->pong_timer_.IsRunning())
+    return;
+  channel_context->pong_timer_.Stop();
+  StartKeepAlive(channel_context);
+}
+
+void NetworkLayer::OnChannelCongested(const scoped_refptr<Channel> &channel) {
+  ChannelContext *channel_context = GetChannelContext(channel->destination());
+  if (!channel_context || channel_context->channel_ != channel)
+    return;
+  DVLOG(1) << "Channel to " << channel->destination().ToString()
+           << " congested";
+  delegate_->OnChannelCongested(channel->destination());
+}
+
+void NetworkLayer::OnChannelWritable(const scoped_refptr<Channel> &channel) {
+  ChannelContext *channel_context = GetChannelContext(channel->destination());
+  if (!channel_context || channel_context->channel_ != channel)
+    return;
+  delegate_->OnChannelWritable(channel->destination());
+}
+
+void NetworkLayer::OnOutgoingMessage(const scoped_refptr<Channel> &channel,
+                                     const scoped_refptr<Message> &message) {
+  // Channels report messages once serialized, right before writing them.
+  TRACE_EVENT_FLOW_END0("sippet", "OutgoingMessage", message.get());
+  CaptureMessage(MessageCapture::OUTGOING, channel, message);
+}
+
+bool NetworkLayer::AbsorbRetransmission(const base::StringPiece &head) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  RequestFingerprint fingerprint;
+  if (server_transactions_.empty()
+      || !ScanRequestFingerprint(head, &fingerprint))
+    return false;
+  // Same id as |PrintServerTransactionId| prints for RFC 3261 branches.
+  char buffer[kTransactionIdBufferSize];
+  raw_fixed_buffer_ostream os(buffer, sizeof(buffer));
+  os << "s:" << fingerprint.branch << ":";
+  PrintSentBy(os, fingerprint.host, fingerprint.port);
+  os << ":" << fingerprint.method;
+  scoped_refptr<ServerTransaction> server_transaction =
+      GetServerTransaction(os.str());
+  if (!server_transaction)
+    return false;
+  return server_transaction->HandleRetransmission();
+}
+
+void NetworkLayer::OnChannelAccepted(const scoped_refptr<Channel> &channel) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  EndPoint destination(channel->destination());
+  ChannelContext *channel_context = GetChannelContext(destination);
+  if (channel_context) {
+    // Datagrams from a peer we're already talking to keep going through the
+    // existing channel.
+    if (!channel_context->channel_->is_stream())
+      return;
+    // The peer reconnected from the same address, so the previous connection
+    // is gone.
+    DVLOG(1) << "Replacing channel to " << destination.ToString();
+    OnChannelClosed(channel_context->channel_, net::ERR_CONNECTION_RESET);
+  }
+  if (!MakeRoomForChannel() || MemoryAccounting::IsOverBudget()) {
+    DVLOG(1) << "Refusing " << destination.ToString() << ", for lack of room";
+    channel->DetachDelegate();
+    channel->Close();
+    return;
+  }
+  channel->SetWriteQueueLimits(network_settings_.write_queue_limits());
+  channel->SetParseProfile(network_settings_.parse_profile());
+  channel->SetMessageLimits(network_settings_.message_limits());
+  channel_context = new ChannelContext(&timer_wheel_, channel.get(),
+      nullptr, net::CompletionCallback());
+  channel_context->accepted_ = true;
+  channel_context->compression_ =
+      network_settings_.enable_message_compression()
+      && channel->EnableCompression();
+  channels_[destination] = channel_context;
+  StartChannelLog(channel_context);
+  // Nobody uses the channel yet: let it time out if it stays idle.
+  RequestChannelInternal(channel_context);
+  ReleaseChannelInternal(channel_context);
+  delegate_->OnChannelConnected(destination, net::OK);
+}
+
+void NetworkLayer::OnIPAddressChanged() {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  if (!network_settings_.migrate_on_network_change()) {
+    // The channels are kept, but the local addresses they stamped may be
+    // gone.
+    for (ChannelsMap::iterator i = channels_.begin(), ie = channels_.end();
+         i != ie; ++i) {
+      ClearStamps(i->second);
+    }
+    return;
+  }
+
+  // The sockets are bound to addresses of the previous network, and would
+  // only notice it once a transaction times out, so they are all closed
+  // now. Outbound channels someone requested are opened again, holding
+  // the same number of requests, the transactions on them excluded.
+  std::vector<scoped_refptr<Channel> > stale_channels;
+  for (ChannelsMap::iterator i = channels_.begin(), ie = channels_.end();
+       i != ie; ++i) {
+    stale_channels.push_back(i->second->channel_);
+  }
+  std::vector<std::pair<EndPoint, int> > requested_channels;
+  for (std::vector<scoped_refptr<Channel> >::iterator
+       i = stale_channels.begin(), ie = stale_channels.end(); i != ie; ++i) {
+    ChannelContext *channel_context = GetChannelContext((*i)->destination());
+    if (!channel_context || channel_context->channel_ != *i)
+      continue;
+    int requests = channel_context->refs_;
+    for (base::LinkNode<TransactionEntry> *node =
+             channel_context->transactions_.head();
+         node != channel_context->transactions_.end(); node = node->next()) {
+      --requests;
+    }
+    if (requests > 0 && !channel_context->accepted_)
+      requested_channels.push_back(
+          std::make_pair((*i)->destination(), requests));
+    OnChannelClosed(*i, net::ERR_NETWORK_CHANGED);
+  }
+
+  for (std::vector<std::pair<EndPoint, int> >::iterator
+       i = requested_channels.begin(), ie = requested_channels.end();
+       i != ie; ++i) {
+    int result = Connect(i->first);
+    if (result != net::OK && result != net::ERR_IO_PENDING) {
+      DVLOG(1) << "Failed to reconnect to " << i->first.ToString()
+               << ": " << net::ErrorToString(result);
+      continue;
+    }
+    ChannelContext *channel_context = GetChannelContext(i->first);
+    for (int requests = 0; requests < i->second; ++requests)
+      RequestChannelInternal(channel_context);
+  }
+
+  delegate_->OnNetworkChanged();
+}
+
 void NetworkLayer::OnSSLCertificateError(const scoped_refptr<Channel> &channel,
                                          const net::SSLInfo &ssl_info,
                                          bool fatal) {
   EndPoint destination(channel->destination());
-  if (ssl_cert_error_handler_factory_) {
-    SSLCertErrorTransaction *ssl_cert_error_transaction =
-        new SSLCertErrorTransaction(ssl_cert_error_handler_factory_);
-    ssl_cert_error_transactions_.push_back(ssl_cert_error_transaction);
-    int rv = ssl_cert_error_transaction->HandleSSLCertError(
-        destination, ssl_info, fatal,
-        base::Bind(&NetworkLayer::OnSSLCertErrorTransactionComplete,
-            base::Unretained(this), ssl_cert_error_transaction));
-    if (net::OK == rv) {
-      OnSSLCertErrorTransactionComplete(ssl_cert_error_transaction, net::OK);
-    } else if (net::ERR_IO_PENDING == rv) {
+  if (!ssl_cert_error_handler_factory_) {
+    ignore_result(DismissLastConnectionAttempt(destination));
+    return;
+  }
+  // Client certificate requests come without a server certificate.
+  if (ssl_info.cert.get()) {
+    SSLCertDecisionCache::Decision decision = ssl_cert_decisions_.Lookup(
+        destination.host(), GetFingerprint(ssl_info), ssl_info.cert_status);
+    if (SSLCertDecisionCache::REJECTED == decision
+        || (SSLCertDecisionCache::ACCEPTED == decision && !fatal)) {
+      DVLOG(1) << "Certificate of " << destination.ToString()
+               << " already " << (SSLCertDecisionCache::ACCEPTED == decision
+                                  ? "accepted" : "rejected");
+      if (SSLCertDecisionCache::ACCEPTED == decision
+          && net::ERR_IO_PENDING == ReconnectIgnoringLastError(destination))
+        return;
+      ignore_result(DismissLastConnectionAttempt(destination));
       return;
     }
-  } else {
-    ignore_result(DismissLastConnectionAttempt(destination));
   }
+  if (ssl_cert_error_transactions_.end()
+      != ssl_cert_error_transactions_.find(destination)) {
+    // The channel waits for the decision already being taken.
+    DVLOG(1) << "Certificate error of " << destination.ToString()
+             << " already being handled";
+    return;
+  }
+  SSLCertErrorTransaction *ssl_cert_error_transaction =
+      new SSLCertErrorTransaction(ssl_cert_error_handler_factory_);
+  ssl_cert_error_transactions_[destination] = ssl_cert_error_transaction;
+  int rv = ssl_cert_error_transaction->HandleSSLCertError(
+      destination, ssl_info, fatal,
+      base::Bind(&NetworkLayer::OnSSLCertErrorTransactionComplete,
+          base::Unretained(this), ssl_cert_error_transaction));
+  if (net::ERR_IO_PENDING != rv)
+    OnSSLCertErrorTransactionComplete(ssl_cert_error_transaction, rv);
 }
 
 void NetworkLayer::OnSSLCertErrorTransactionComplete(
     SSLCertErrorTransaction* ssl_cert_error_transaction, int rv) {
   DCHECK(ssl_cert_error_transaction);
+  // Released first, so that another error of the destination, raised by
+  // the reconnection, is handled anew.
+  EndPoint destination(ssl_cert_error_transaction->destination());
+  SSLCertErrorTransactionsMap::iterator i =
+      ssl_cert_error_transactions_.find(destination);
+  DCHECK(i != ssl_cert_error_transactions_.end());
+  DCHECK_EQ(ssl_cert_error_transaction, i->second);
+  scoped_ptr<SSLCertErrorTransaction> transaction(i->second);
+  ssl_cert_error_transactions_.erase(i);
+
   if (net::OK == rv) {
-    if (ssl_cert_error_transaction->client_cert()) {
-      rv = ReconnectWithCertificate(
-          ssl_cert_error_transaction->destination(),
-          ssl_cert_error_transaction->client_cert().get());
-      if (net::ERR_IO_PENDING == rv)
-        return;
-    } else if (ssl_cert_error_transaction->is_accepted()) {
-      rv = ReconnectIgnoringLastError(
-          ssl_cert_error_transaction->destination());
+    const net::SSLInfo &ssl_info = transaction->ssl_info();
+    if (transaction->client_cert()) {
+      rv = ReconnectWithCertificate(destination,
+          transaction->client_cert().get());
       if (net::ERR_IO_PENDING == rv)
         return;
+    } else {
+      if (ssl_info.cert.get()) {
+        ssl_cert_decisions_.Add(destination.host(), GetFingerprint(ssl_info),
+            ssl_info.cert_status, transaction->is_accepted());
+      }
+      if (transaction->is_accepted()) {
+        rv = ReconnectIgnoringLastError(destination);
+        if (net::ERR_IO_PENDING == rv)
+          return;
+      }
     }
   }
-  ignore_result(DismissLastConnectionAttempt(
-      ssl_cert_error_transaction->destination()));
-  ScopedVector<SSLCertErrorTransaction>::iterator i =
-      std::find_if(ssl_cert_error_transactions_.begin(),
-        ssl_cert_error_transactions_.end(),
-        std::bind1st(std::equal_to<SSLCertErrorTransaction*>(),
-            ssl_cert_error_transaction));
-  DCHECK(i != ssl_cert_error_transactions_.end());
-  ssl_cert_error_transactions_.erase(i);
+  ignore_result(DismissLastConnectionAttempt(destination));
 }
 
 void NetworkLayer::OnIncomingResponse(const scoped_refptr<Response> &response) {
+  if (batch_delegate_) {
+    // Batches are traced as a whole when flushed.
+    TRACE_EVENT_FLOW_END0("sippet", "IncomingMessage", response.get());
+    QueueTransactionEvent(TransactionEvent::INCOMING_RESPONSE, response,
+                          net::OK);
+    return;
+  }
+  TRACE_EVENT0("sippet", "NetworkLayer::Delegate::OnIncomingResponse");
+  TRACE_EVENT_FLOW_END0("sippet", "IncomingMessage", response.get());
   delegate_->OnIncomingResponse(response);
 }
 
 void NetworkLayer::OnTimedOut(const scoped_refptr<Request> &request) {
+  if (batch_delegate_) {
+    QueueTransactionEvent(TransactionEvent::TIMED_OUT, request, net::OK);
+    return;
+  }
   delegate_->OnTimedOut(request);
 }
 
 void NetworkLayer::OnTransportError(
     const scoped_refptr<Request> &request, int error) {
+  if (batch_delegate_) {
+    QueueTransactionEvent(TransactionEvent::TRANSPORT_ERROR, request, error);
+    return;
+  }
   delegate_->OnTransportError(request, error);
 }
 
@@ -840,6 +2093,30 @@ void NetworkLayer::OnIdleChannelTimedOut(const EndPoint &endpoint) {
   OnChannelClosed(channel_context->channel_, net::ERR_TIMED_OUT);
 }
 
+void NetworkLayer::OnKeepAliveTimer(const EndPoint &endpoint) {
+  ChannelContext *channel_context = GetChannelContext(endpoint);
+  DCHECK(channel_context);
+  int result = channel_context->channel_->SendKeepAlive(
+      base::Bind(&IgnoreKeepAliveResult));
+  if (result == net::ERR_NOT_IMPLEMENTED)
+    return;
+  if (result != net::OK && result != net::ERR_IO_PENDING) {
+    OnChannelClosed(channel_context->channel_, result);
+    return;
+  }
+  channel_context->pong_timer_.Start(
+      base::TimeDelta::FromSeconds(network_settings_.keepalive_timeout()),
+      base::Bind(&NetworkLayer::OnKeepAliveTimedOut,
+          weak_factory_.GetWeakPtr(), endpoint));
+}
+
+void NetworkLayer::OnKeepAliveTimedOut(const EndPoint &endpoint) {
+  ChannelContext *channel_context = GetChannelContext(endpoint);
+  DCHECK(channel_context);
+  DVLOG(1) << "No keep-alive pong from " << endpoint.ToString();
+  OnChannelClosed(channel_context->channel_, net::ERR_TIMED_OUT);
+}
+
 void NetworkLayer::PostOnChannelClosed(const EndPoint &destination) {
   base::MessageLoop* message_loop = base::MessageLoop::current();
   CHECK(message_loop);
@@ -849,4 +2126,46 @@ void NetworkLayer::PostOnChannelClosed(const EndPoint &destination) {
           base::Unretained(delegate_), destination));
 }
 
+void NetworkLayer::QueueTransactionEvent(
+    TransactionEvent::Type type,
+    const scoped_refptr<Message> &message,
+    int error) {
+  pending_events_.push_back(TransactionEvent(type, message, error));
+  if (pending_events_.size() > 1)
+    return;
+  base::MessageLoop* message_loop = base::MessageLoop::current();
+  CHECK(message_loop);
+  message_loop->PostTask(
+      FROM_HERE,
+      base::Bind(&NetworkLayer::FlushTransactionEvents,
+          weak_factory_.GetWeakPtr()));
+}
+
+void NetworkLayer::FlushTransactionEvents() {
+  TRACE_EVENT1("sippet", "NetworkLayer::FlushTransactionEvents",
+               "count", pending_events_.size());
+  DCHECK(thread_checker_.CalledOnValidThread());
+  TransactionEvents events;
+  events.swap(pending_events_);
+  if (batch_delegate_) {
+    batch_delegate_->OnTransactionEvents(events);
+    return;
+  }
+  // The batch delegate was removed meanwhile.
+  for (TransactionEvents::const_iterator i = events.begin(),
+       ie = events.end(); i != ie; ++i) {
+    switch (i->type) {
+      case TransactionEvent::INCOMING_RESPONSE:
+        delegate_->OnIncomingResponse(dyn_cast<Response>(i->message));
+        break;
+      case TransactionEvent::TIMED_OUT:
+        delegate_->OnTimedOut(dyn_cast<Request>(i->message));
+        break;
+      case TransactionEvent::TRANSPORT_ERROR:
+        delegate_->OnTransportError(dyn_cast<Request>(i->message), i->error);
+        break;
+    }
+  }
+}
+
 }  // namespace sippet
@@ -5,25 +5,33 @@
 #ifndef SIPPET_TRANSPORT_NETWORK_LAYER_H_
 #define SIPPET_TRANSPORT_NETWORK_LAYER_H_
 
-#include <set>
+#include <vector>
 
-#include "base/timer/timer.h"
+#include "base/containers/hash_tables.h"
+#include "base/containers/linked_list.h"
 #include "base/memory/ref_counted.h"
-#include "base/memory/scoped_vector.h"
 #include "base/system_monitor/system_monitor.h"
 #include "base/gtest_prod_util.h"
+#include "base/strings/string_piece.h"
 #include "base/threading/thread_checker.h"
+#include "base/time/time.h"
 #include "net/base/completion_callback.h"
+#include "net/base/network_change_notifier.h"
+#include "sippet/base/raw_ostream.h"
 #include "sippet/message/protocol.h"
 #include "sippet/message/message.h"
 #include "sippet/transport/channel.h"
+#include "sippet/transport/channel_listener.h"
 #include "sippet/transport/end_point.h"
 #include "sippet/transport/client_transaction.h"
 #include "sippet/transport/server_transaction.h"
 #include "sippet/transport/transaction_delegate.h"
 #include "sippet/transport/aliases_map.h"
 #include "sippet/transport/network_settings.h"
+#include "sippet/transport/ssl_cert_decision_cache.h"
 #include "sippet/transport/ssl_cert_error_handler.h"
+#include "sippet/transport/timer_wheel.h"
+#include "url/gurl.h"
 
 namespace net {
 class X509Certificate;
@@ -34,6 +42,9 @@ namespace sippet {
 class ChannelFactory;
 class TransactionFactory;
 class SSLCertErrorTransaction;
+class OverloadController;
+class SipLocator;
+class SipURI;
 
 // The |NetworkLayer| is the main message dispatcher of sippet. It receives
 // messages from network and sends them to a delegate object, and is the
@@ -96,7 +107,9 @@ class SSLCertErrorTransaction;
 //   
 class NetworkLayer :
   public TransactionDelegate,
-  public Channel::Delegate {
+  public Channel::Delegate,
+  public ChannelListener::Delegate,
+  public net::NetworkChangeNotifier::IPAddressObserver {
  private:
   DISALLOW_COPY_AND_ASSIGN(NetworkLayer);
  public:
@@ -113,7 +126,10 @@ class NetworkLayer :
     // port unreachable) is detected by the network layer.
     virtual void OnChannelClosed(const EndPoint &destination) = 0;
 
-    // Called whenever a new request is received.
+    // Called whenever a new request is received. The ACKs of 2xx responses
+    // come without a server transaction, and CANCELs matching no INVITE
+    // server transaction are answered with a 481 (Call/Transaction Does
+    // Not Exist) instead.
     virtual void OnIncomingRequest(
         const scoped_refptr<Request> &request) = 0;
 
@@ -143,6 +159,107 @@ class NetworkLayer :
     // |error| the network error arised while handling the messages.
     virtual void OnTransportError(
         const scoped_refptr<Request> &request, int error) = 0;
+
+    // Called when the messages queued to |destination| reach one of the
+    // high watermarks of |NetworkSettings::write_queue_limits|. Senders
+    // should hold new messages to it until |OnChannelWritable|.
+    virtual void OnChannelCongested(const EndPoint &destination) {}
+
+    // Called when a congested channel drains back to its low watermarks.
+    virtual void OnChannelWritable(const EndPoint &destination) {}
+
+    // Called after the channels have been closed because the IP addresses
+    // of the host changed, with |OnChannelClosed| called for each one.
+    // Requested channels are being reconnected, and |OnChannelConnected|
+    // follows for them; anything registered through the old addresses
+    // should be registered again.
+    virtual void OnNetworkChanged() {}
+  };
+
+  // A transaction event, as passed to |BatchDelegate::OnTransactionEvents|.
+  struct TransactionEvent {
+    enum Type {
+      INCOMING_RESPONSE,
+      TIMED_OUT,
+      TRANSPORT_ERROR,
+    };
+
+    TransactionEvent(Type type, const scoped_refptr<Message> &message,
+                     int error);
+    ~TransactionEvent();
+
+    Type type;
+    // The response for |INCOMING_RESPONSE|, and the transaction request
+    // otherwise, as in the equivalent |Delegate| methods.
+    scoped_refptr<Message> message;
+    // The network error, for |TRANSPORT_ERROR|.
+    int error;
+  };
+
+  typedef std::vector<TransactionEvent> TransactionEvents;
+
+  class BatchDelegate {
+   public:
+    virtual ~BatchDelegate() {}
+
+    // Called once per message loop iteration with all the transaction
+    // events raised since the previous call, in order: a channel failing
+    // with thousands of transactions on it costs a single call.
+    virtual void OnTransactionEvents(const TransactionEvents &events) = 0;
+  };
+
+  class StatelessDelegate {
+   public:
+    virtual ~StatelessDelegate() {}
+
+    // Called for each incoming request not matching a server transaction,
+    // before one is created for it. Returns true if the request is taken:
+    // forwarded using |NetworkLayer::ForwardRequest|, or dropped. Otherwise,
+    // the request is handled statefully, and passed to the |Delegate|.
+    virtual bool HandleStatelessRequest(
+        const scoped_refptr<Request> &request) = 0;
+  };
+
+  class ResponseRouter {
+   public:
+    virtual ~ResponseRouter() {}
+
+    // Called for each incoming response matching no client transaction,
+    // nor a request forwarded statelessly. Returns true if the response is
+    // taken: typically handed to the network layer that sent the request
+    // (e.g. running on another thread), using
+    // |NetworkLayer::HandleRoutedResponse|. Otherwise, it's discarded.
+    virtual bool RouteResponse(const scoped_refptr<Response> &response) = 0;
+  };
+
+  // What |Introspect| reports of a channel.
+  struct ChannelInfo {
+    ChannelInfo();
+    ~ChannelInfo();
+
+    EndPoint destination;
+    bool connected;
+    bool accepted;
+    bool idle;
+    // Users holding the channel, with |RequestChannel|.
+    int refs;
+    // Transactions sending through the channel.
+    size_t transactions;
+    // Bytes of the messages waiting for the socket.
+    size_t queued_write_bytes;
+  };
+
+  // The state of a network layer, for operators to spot hot destinations
+  // and leaks (see |Introspect|).
+  struct Introspection {
+    Introspection();
+    ~Introspection();
+
+    std::vector<ChannelInfo> channels;
+    size_t idle_channels;
+    size_t client_transactions;
+    size_t server_transactions;
+    bool draining;
   };
 
   // Construct a |NetworkLayer|.
@@ -155,12 +272,60 @@ class NetworkLayer :
   void RegisterChannelFactory(const Protocol &protocol,
                               ChannelFactory *channel_factory);
 
+  // Start accepting inbound channels from a |ChannelListener|. Accepted
+  // channels are handled as the ones opened by the channel factories, and
+  // |NetworkLayer::Delegate::OnChannelConnected| is called for each one.
+  // Listeners are not owned, but they are closed on |NetworkLayer|
+  // destruction. Returns a network error code.
+  int AddChannelListener(ChannelListener *channel_listener);
+
+  // Use a |SipLocator| to find the servers of request destinations given by
+  // a host name and no port (RFC 3263). When a server can't be reached, the
+  // next one located is tried, and the locator is told, to try it last for
+  // a while. The locator is not owned, and must outlive the |NetworkLayer|.
+  // Without a locator, destinations are used as they are.
+  void SetLocator(SipLocator *locator);
+
+  // Use an |OverloadController| to reject new requests when overloaded, and
+  // to honor the overload feedback of the servers. The controller is not
+  // owned, and must outlive the |NetworkLayer|.
+  void SetOverloadController(OverloadController *overload_controller);
+
+  // Deliver the incoming responses, timeouts and transport errors of the
+  // transactions in batches to |batch_delegate|, instead of calling the
+  // |Delegate| for each one. Events are then delivered asynchronously, and
+  // may come after channel events and incoming requests raised later. The
+  // batch delegate is not owned, and must outlive the |NetworkLayer|; NULL
+  // restores the |Delegate| calls.
+  void SetBatchDelegate(BatchDelegate *batch_delegate);
+
+  // Offer the incoming requests to |stateless_delegate| before creating
+  // their server transactions, so that a load balancer or another stateless
+  // proxy can forward them at no transaction cost. The stateless delegate is
+  // not owned, and must outlive the |NetworkLayer|; NULL, the default,
+  // handles all requests statefully.
+  void SetStatelessDelegate(StatelessDelegate *stateless_delegate);
+
+  // Offer the incoming responses matching none of the client transactions
+  // to |response_router|, so that several network layers sharing the same
+  // sockets can give them to the one that sent the requests. The router is
+  // not owned, and must outlive the |NetworkLayer|; NULL, the default,
+  // discards them.
+  void SetResponseRouter(ResponseRouter *response_router);
+
+  // Handle a response received by another network layer, and routed to this
+  // one by its |ResponseRouter|, as if it came from its channel. Responses
+  // matching none of the client transactions are discarded.
+  void HandleRoutedResponse(const scoped_refptr<Response> &response);
+
   // Requests the use of a channel for a given destination. This will make the
   // channel to live longer than the individual transactions and normal
   // timeouts. It should be called after some initial transaction completion,
   // as the channels are created on demand when sending the messages. When
   // trying to request the use of a non existing channel, it will return
-  // false.
+  // false. Requested channels are reconnected when the network changes
+  // (see |NetworkSettings::migrate_on_network_change|), keeping their
+  // requests.
   bool RequestChannel(const EndPoint &destination);
 
   // Called to release a channel once it is no longer needed. If the channel
@@ -172,9 +337,18 @@ class NetworkLayer :
   // Forces a connection to a given destination. If there is no connected
   // channel to the given destination, then |net::ERR_IO_PENDING| is returned
   // and |NetworkLayer::Delegate::OnChannelConnected| is called when completed.
-  // Otherwise, |net::OK| is just returned.
+  // Otherwise, |net::OK| is just returned. The first request sent meanwhile
+  // waits for the connection, instead of failing.
   int Connect(const EndPoint &destination);
 
+  // Gets ready to send to |destination| before the first request does, so
+  // that it doesn't wait for DNS: its host is resolved ahead by the channel
+  // factory of its protocol (see |ChannelFactory::PrefetchHost|). If
+  // |preconnect| is set, TCP and TLS channels are opened as well, and left
+  // idle for the first request. Does nothing if there's a channel to
+  // |destination| already, or while draining.
+  void Prefetch(const EndPoint &destination, bool preconnect);
+
   // Get the origin |EndPoint| of a given destination. This function returns
   // |net::OK| only if there is a channel available for that destination.
   int GetOriginOf(const EndPoint& destination, EndPoint *origin);
@@ -199,6 +373,93 @@ class NetworkLayer :
   int Send(const scoped_refptr<Message> &message,
            const net::CompletionCallback& callback);
 
+  // Same as |Send|, for a request whose next hop is already known, such as
+  // the one cached by its dialog (see |Dialog::next_hop|): its Route and
+  // Request-URI aren't parsed to find the destination, and the channel to
+  // |next_hop| is used if there's one. An empty |next_hop| is the same as
+  // calling |Send|.
+  int SendToNextHop(const scoped_refptr<Request> &request,
+                    const EndPoint &next_hop,
+                    const net::CompletionCallback& callback);
+
+  // Forward an incoming request statelessly (RFC 3261 section 16.11): no
+  // transaction is created for it, neither here nor downstream, and its
+  // responses are routed back using their |Via| headers only.
+  //
+  // The Max-Forwards is decremented, or set to 70 if absent, and the topmost
+  // |Route| entry is removed if it refers to one of the channel listeners.
+  // If |target| is valid, it replaces the Request-URI. A topmost |Via| is
+  // then added, with a branch hashed from the request, so that its
+  // retransmissions, and its CANCEL or ACK, get the same one. No other
+  // header is added or changed.
+  //
+  // Returns |net::ERR_TOO_MANY_REDIRECTS| if the Max-Forwards is already
+  // zero, and the request should be answered with a 483 (Too Many Hops);
+  // otherwise, the same results as |Send|.
+  int ForwardRequest(const scoped_refptr<Request> &request,
+                     const GURL &target,
+                     const net::CompletionCallback& callback);
+
+  // Same as |ForwardRequest|, to a |next_hop| chosen by the caller, such as
+  // the backend picked by a load balancer: the Request-URI and the Route
+  // entries of the next hops are kept, but the request is sent to
+  // |next_hop| regardless. An empty |next_hop| is the same as calling
+  // |ForwardRequest| without a target.
+  int ForwardRequestToNextHop(const scoped_refptr<Request> &request,
+                              const EndPoint &next_hop,
+                              const net::CompletionCallback& callback);
+
+  // Same as |Send|, for an outgoing request sent out of transactions, as
+  // ACKs are: it's sent once, with no retransmission nor timeout, and its
+  // responses, matching no client transaction, are offered to the
+  // |ResponseRouter|. Meant for probes keeping their own timeouts, such as
+  // the pings of |OptionsPinger|.
+  int SendOutOfTransaction(const scoped_refptr<Request> &request,
+                           const net::CompletionCallback& callback);
+
+  // Same as |Send|, for an outgoing request a stateful proxy forwards, such
+  // as a branch of a |ForkContext|: it carries the Via headers of the
+  // incoming request, and its own Via, with a new branch, is stamped on top
+  // of them (RFC 3261 section 16.6, step 8).
+  int SendProxiedRequest(const scoped_refptr<Request> &request,
+                         const net::CompletionCallback& callback);
+
+  // The wheel driving the transaction and channel timers, to be shared by
+  // the services running on top of the network layer.
+  TimerWheel *timer_wheel() { return &timer_wheel_; }
+
+  // Drains the network layer before closing it, e.g. for a rolling restart
+  // or a scale-in, so that its peers don't lose what's in flight: incoming
+  // requests out of dialogs are answered with 302 (Moved Temporarily) to
+  // |alternates|, or with 503 (Service Unavailable) and a Retry-After when
+  // there are none, while transactions in progress and requests within
+  // dialogs are served as usual. Idle channels are closed at once, and the
+  // others as soon as they are left idle. |callback| is posted once no
+  // transaction is left and no channel is in use; dialogs are for the
+  // delegate to wait for, as they only use channels while sending.
+  void StartDraining(const std::vector<GURL> &alternates,
+                     const base::Closure &callback);
+
+  bool is_draining() const { return draining_; }
+
+  // Fills |introspection| with the channels and transactions of the network
+  // layer. It walks the tables without changing anything, so it's cheap
+  // enough to be polled while serving; called on the thread of the layer,
+  // between two of its tasks, it's also consistent. Other threads post a
+  // task to it. The process wide |TransportStats| and |MemoryAccounting|
+  // complete it.
+  void Introspect(Introspection *introspection) const;
+
+  // The decisions taken on the certificate errors of the destinations, to
+  // be cleared when the user revokes them.
+  SSLCertDecisionCache *ssl_cert_decisions() { return &ssl_cert_decisions_; }
+
+  // The static headers added to the requests sent without their own, such
+  // as the User-Agent.
+  const scoped_refptr<StaticHeaderBlock> &request_headers() const {
+    return request_headers_;
+  }
+
   // Add an alias to an existing channel endpoint. It is considered an error
   // to add aliases using different protocols. Return true if the alias has
   // been successfully created.
@@ -206,68 +467,227 @@ class NetworkLayer :
 
   // This function gets the end point of sending messages. For requests, it
   // uses the request-URI; for responses, use the topmost Via header.
-  static EndPoint GetMessageEndPoint(const scoped_refptr<Message> &message);
+  static EndPoint GetMessageEndPoint(const Message &message);
+
+  // Get the URI a request is sent to: the first |Route| header entry, if
+  // exists, or |Request::request_uri| otherwise.
+  static SipURI GetRequestTarget(const Request &request);
 
  private:
   friend struct base::DefaultDeleter<NetworkLayer>;
   ~NetworkLayer() override;
 
   FRIEND_TEST_ALL_PREFIXES(NetworkLayerTest, StaticFunctions);
+  FRIEND_TEST_ALL_PREFIXES(NetworkLayerTest, TransactionIds);
+  FRIEND_TEST_ALL_PREFIXES(NetworkLayerTest, StatelessBranches);
 
   // Just for testing purposes
   friend class NetworkLayerTest;
 
-  struct ChannelContext {
+  // A transaction table entry, also linked into the list of transactions
+  // using the same channel. Entries don't move while in the hash tables, so
+  // attaching a transaction to its channel and detaching it are constant
+  // time, with no allocation. Exactly one of the transactions is set.
+  struct TransactionEntry : public base::LinkNode<TransactionEntry> {
+    explicit TransactionEntry(
+        const scoped_refptr<ClientTransaction> &client_transaction);
+    explicit TransactionEntry(
+        const scoped_refptr<ServerTransaction> &server_transaction);
+    ~TransactionEntry();
+
+    // Unlinks the entry from its channel list, if linked.
+    void Detach();
+
+    scoped_refptr<ClientTransaction> client_transaction_;
+    scoped_refptr<ServerTransaction> server_transaction_;
+    // The key of the server transaction in |prack_transactions_|, if any.
+    std::string prack_key_;
+    // The key of the server transaction in |invite_transactions_|, if any:
+    // the branch within its own id.
+    base::StringPiece invite_branch_;
+  };
+
+  struct ChannelContext : public base::LinkNode<ChannelContext> {
     // Holds the channel instance.
     scoped_refptr<Channel> channel_;
     // Used to count number of current uses.
     int refs_;
     // Used to keep the channel opened so they can be reused.
-    base::OneShotTimer<NetworkLayer> timer_;
+    TimerWheel::Timer timer_;
+    // Whether the channel is linked into |idle_channels_|.
+    bool idle_;
+    // Since when, if idle.
+    base::TimeTicks idle_since_;
+    // Whether the channel is being closed to make room for others.
+    bool evicted_;
+    // Whether the channel was accepted from a listener.
+    bool accepted_;
+    // Whether the channel compresses messages, advertised in its Vias.
+    bool compression_;
+    // Whether a message received through the channel accepted gzip
+    // contents (see |NetworkSettings::compression_threshold|).
+    bool accepts_gzip_;
+    // Sends the keep-alive pings, and waits for their pongs.
+    TimerWheel::Timer keepalive_timer_;
+    TimerWheel::Timer pong_timer_;
     // Keep the request used to open the channel.
     scoped_refptr<Request> initial_request_;
     // Keep the first callback to be called after connected and sent.
     net::CompletionCallback initial_callback_;
-    // Keep references to transactions using this channel.
-    std::set<std::string> transactions_;
-
-    ChannelContext();
-    explicit ChannelContext(Channel *channel,
-                            const scoped_refptr<Request> &initial_request,
-                            const net::CompletionCallback& initial_callback);
+    // Transactions using this channel.
+    base::LinkedList<TransactionEntry> transactions_;
+    // Whether the destination was given by the locator, which is told
+    // whether it could be connected.
+    bool located_;
+    // Located destinations to try if the channel fails to connect.
+    std::vector<EndPoint> fallback_targets_;
+    BoundTransportLog net_log_;
+    // Derived from the addresses of the channel once it's connected, so
+    // that stamping doesn't rebuild them for each message (see
+    // |CacheStamps|): the sent-by of the Via headers, and the Contact
+    // address, with and without the ";ob" parameter.
+    bool stamps_cached_;
+    ViaParam sent_by_;
+    GURL contact_address_;
+    GURL outbound_contact_address_;
+
+    ChannelContext(TimerWheel *timer_wheel,
+                   Channel *channel,
+                   const scoped_refptr<Request> &initial_request,
+                   const net::CompletionCallback& initial_callback);
     ~ChannelContext();
   };
 
+  // Traces |channel_context|, when there's a transport log.
+  void StartChannelLog(ChannelContext *channel_context);
+  // The log of a new transaction: an empty one, unless it's sampled.
+  BoundTransportLog MakeTransactionLog();
+  // Hands |message| to the message capture, when there's one.
+  void CaptureMessage(MessageCapture::Direction direction,
+                      const scoped_refptr<Channel> &channel,
+                      const scoped_refptr<Message> &message);
+
   typedef std::map<Protocol, ChannelFactory*, ProtocolLess> FactoriesMap;
-  typedef std::map<EndPoint, ChannelContext*, EndPointLess> ChannelsMap;
+  // Keyed by the precomputed |EndPoint::hash|, as every message sent or
+  // received looks its channel up.
+  typedef base::hash_map<EndPoint, ChannelContext*> ChannelsMap;
 
-  typedef std::map<std::string, scoped_refptr<ClientTransaction> >
+  // Transaction tables are keyed by pieces of the transaction's own id, so
+  // that incoming messages can be matched without building a string.
+  typedef base::hash_map<base::StringPiece, TransactionEntry>
       ClientTransactionsMap;
-  typedef std::map<std::string, scoped_refptr<ServerTransaction> >
+  typedef base::hash_map<base::StringPiece, TransactionEntry>
       ServerTransactionsMap;
+  // INVITE server transactions that sent reliable provisional responses,
+  // keyed by what the PRACKs acknowledging them refer to (see |PrackKey|).
+  typedef base::hash_map<std::string, scoped_refptr<ServerTransaction> >
+      PrackTransactionsMap;
+  // INVITE server transactions with RFC 3261 branches, keyed by them, so
+  // that their CANCELs and the ACKs of their non-2xx responses are matched
+  // with a single probe, without printing a transaction id. Only the
+  // branch, unique to each sender, is compared, as for forks.
+  typedef base::hash_map<base::StringPiece, ServerTransaction*>
+      InviteTransactionsMap;
+  // Owns the transactions, keyed by the destination whose certificate
+  // error they handle.
+  typedef base::hash_map<EndPoint, SSLCertErrorTransaction*>
+      SSLCertErrorTransactionsMap;
 
   NetworkSettings network_settings_;
+  // The User-Agent, or Server header, followed by the static headers of
+  // |network_settings_|, for the requests and responses sent.
+  scoped_refptr<StaticHeaderBlock> request_headers_;
+  scoped_refptr<StaticHeaderBlock> response_headers_;
+  // Drives all transaction and channel timers; it must outlive them.
+  TimerWheel timer_wheel_;
   AliasesMap aliases_map_;
   Delegate *delegate_;
+  SipLocator *locator_;
+  OverloadController *overload_controller_;
   FactoriesMap factories_;
+  std::vector<ChannelListener*> listeners_;
   ChannelsMap channels_;
+  // Channels nobody uses, the longest idle first.
+  base::LinkedList<ChannelContext> idle_channels_;
+  int idle_channel_count_;
+  // Channels in |channels_| being closed by |EvictIdleChannel|.
+  int evicted_channel_count_;
+  // Ids of the requests given to |SendOutOfTransaction| not yet sent.
+  base::hash_set<std::string> out_of_transaction_requests_;
+  // Ids of the requests given to |SendProxiedRequest| not yet sent.
+  base::hash_set<std::string> proxied_requests_;
   ClientTransactionsMap client_transactions_;
   ServerTransactionsMap server_transactions_;
+  PrackTransactionsMap prack_transactions_;
+  InviteTransactionsMap invite_transactions_;
   SSLCertErrorHandler::Factory *ssl_cert_error_handler_factory_;
-  ScopedVector<SSLCertErrorTransaction> ssl_cert_error_transactions_;
+  SSLCertErrorTransactionsMap ssl_cert_error_transactions_;
+  // Outlives the channels, so that reconnections don't ask again.
+  SSLCertDecisionCache ssl_cert_decisions_;
+  // Set by |StartDraining|; the callback is reset once run.
+  bool draining_;
+  std::vector<GURL> drain_alternates_;
+  base::Closure drained_callback_;
 
   int SendRequest(scoped_refptr<Request> &request,
       const net::CompletionCallback& callback);
+  int SendRequestToDestination(scoped_refptr<Request> &request,
+      const EndPoint &destination,
+      const net::CompletionCallback& callback);
+  // Opens a channel to |destination|, sending |request| once connected.
+  int SendRequestThroughNewChannel(scoped_refptr<Request> &request,
+      const EndPoint &destination,
+      const net::CompletionCallback& callback);
   int SendRequestUsingChannelContext(scoped_refptr<Request> &request,
       ChannelContext *channel_context,
       const net::CompletionCallback& callback);
   int SendResponse(const scoped_refptr<Response> &message,
       const net::CompletionCallback& callback);
 
+  // Chooses how |message| is printed over |protocol|: as set by
+  // |NetworkSettings::enable_compact_headers|, or as compact as needed to
+  // keep UDP messages from being fragmented. Returns false if even the most
+  // compact form is too large.
+  bool FitToTransport(Message *message, const Protocol &protocol);
+
+  // Same as |FitToTransport| for requests, but returns true if |request|
+  // doesn't fit and can be sent over TCP instead (RFC 3261 section 18.1.1).
+  bool NeedsTcpFallback(Request *request, const Protocol &protocol);
+
+  // Compresses the content of |message| with gzip, if it's at least
+  // |NetworkSettings::compression_threshold| bytes long and gets smaller.
+  // Contents already encoded, and those of authenticated messages, whose
+  // digests may cover them as sent, are left alone.
+  void CompressContent(Message *message);
+
+  // Send the request using the first of |targets| having a channel, or
+  // open a channel to the first one that can be created, keeping the others
+  // for failing over.
+  int SendRequestToTargets(scoped_refptr<Request> &request,
+      const std::vector<EndPoint> &targets,
+      const net::CompletionCallback& callback);
+  void OnLocateComplete(scoped_refptr<Request> request,
+      const net::CompletionCallback& callback,
+      int result, const std::vector<EndPoint> &targets);
+
   // Manage the number of channel references to start/stop the idle timeout
   void RequestChannelInternal(ChannelContext *channel_context);
   void ReleaseChannelInternal(ChannelContext *channel_context);
 
+  // Keep track of idle channels, bounded by
+  // |NetworkSettings::max_idle_channels|.
+  void AddIdleChannel(ChannelContext *channel_context);
+  void RemoveIdleChannel(ChannelContext *channel_context);
+  // Closes the idle |channel_context| on the next timer tick, as the
+  // caller may be using other channels.
+  void EvictIdleChannel(ChannelContext *channel_context);
+  // Whether a new channel fits |NetworkSettings::max_open_channels|,
+  // evicting the channel idle for the longest if needed.
+  bool MakeRoomForChannel();
+
+  // Schedule the next keep-alive ping of outbound stream channels.
+  void StartKeepAlive(ChannelContext *channel_context);
+
   // Create transactions, associating to referencing tables
   ClientTransaction *CreateClientTransaction(
       const scoped_refptr<Request> &request,
@@ -279,6 +699,8 @@ class NetworkLayer :
       const scoped_refptr<ClientTransaction> &client_transaction);
   void DestroyServerTransaction(
       const scoped_refptr<ServerTransaction> &server_transaction);
+  // Drops the entry of a server transaction, and its secondary keys.
+  void EraseServerTransaction(ServerTransactionsMap::iterator i);
 
   // Create channel contexts, associating to referencing tables
   int CreateChannelContext(
@@ -290,39 +712,78 @@ class NetworkLayer :
 
   // Set of utility functions used internally
   std::string CreateBranch();
+  // Fills the stamps of |channel_context|, if not yet. Returns false if
+  // the origin of the channel isn't known yet.
+  bool CacheStamps(ChannelContext *channel_context);
+  // Drops the stamps of |channel_context|, for them to be derived again
+  // from the origin the channel has once it's reconnected.
+  void ClearStamps(ChannelContext *channel_context);
   void StampClientTopmostVia(
       const scoped_refptr<Request> &request,
-      const scoped_refptr<Channel> &channel);
+      ChannelContext *channel_context);
+  void StampTopmostVia(
+      const scoped_refptr<Request> &request,
+      ChannelContext *channel_context,
+      const std::string &branch);
   void StampServerTopmostVia(
       const scoped_refptr<Request> &request,
       const scoped_refptr<Channel> &channel);
   void StampContact(
       const scoped_refptr<Request> &request,
-      const scoped_refptr<Channel> &channel);
+      ChannelContext *channel_context);
   static std::string ClientTransactionId(
       const scoped_refptr<Request> &request);
-  static std::string ClientTransactionId(
-      const scoped_refptr<Response> &response);
   static std::string ServerTransactionId(
       const scoped_refptr<Request> &request);
-  static std::string ServerTransactionId(
-      const scoped_refptr<Response> &response);
-
-  // Recover channel and transaction contexts from referencing tables
+  // The Call-ID, From tag and CSeq |sequence| of the INVITE a PRACK
+  // acknowledges, as its RAck doesn't carry the branch of the INVITE.
+  static std::string PrackKey(const Message &message, unsigned sequence);
+  // Print the id of the transaction |message| belongs to, where |method| is
+  // the request method or the response CSeq method.
+  static void PrintClientTransactionId(raw_ostream &os,
+                                       const Message &message,
+                                       const Method &method);
+  static void PrintServerTransactionId(raw_ostream &os,
+                                       const Message &message,
+                                       const Method &method);
+
+  // Recover channel and transaction contexts from referencing tables. The
+  // messages are taken by reference, so that looking up a request or a
+  // response doesn't take a reference to it as a |Message|.
   ChannelContext *GetChannelContext(const EndPoint &destination);
   scoped_refptr<ClientTransaction> GetClientTransaction(
-                        const scoped_refptr<Message> &message);
+                        const Response &response);
   scoped_refptr<ServerTransaction> GetServerTransaction(
-                        const scoped_refptr<Message> &message);
+                        const Message &message);
   scoped_refptr<ClientTransaction> GetClientTransaction(
-                        const std::string &transaction_id);
+                        const base::StringPiece &transaction_id);
   scoped_refptr<ServerTransaction> GetServerTransaction(
-                        const std::string &transaction_id);
+                        const base::StringPiece &transaction_id);
+  // The INVITE server transaction sharing the topmost |Via| branch of
+  // |message|, a CANCEL or an ACK, if any.
+  scoped_refptr<ServerTransaction> GetInviteServerTransaction(
+                        const Message &message);
 
   // Handle new incoming requests (not retransmissions). Server transactions
   // are created in advance while receiving new requests
   void HandleIncomingRequest(const scoped_refptr<Channel> &channel,
                              const scoped_refptr<Request> &request);
+
+  // Turns away a request starting new work while draining, as told by
+  // |StartDraining|.
+  void RejectWhileDraining(const scoped_refptr<Request> &request);
+  // Posts the callback given to |StartDraining| if no transaction is left
+  // and no channel is in use.
+  void CheckDrained();
+
+  // Answers an OPTIONS outside of a dialog with a canned 200 (OK), when
+  // |NetworkSettings::answer_options|. Returns false if it's not one.
+  bool AnswerOptions(const scoped_refptr<Channel> &channel,
+                     const scoped_refptr<Request> &request);
+
+  // Gives a new PRACK to the INVITE server transaction whose reliable
+  // provisional response it acknowledges. Returns false if there's none.
+  bool HandlePrack(const scoped_refptr<Request> &prack);
   
   // Handle responses not matching any of the existing client transactions.
   // These responses are actually discarded, as they aren't related to any
@@ -338,6 +799,18 @@ class NetworkLayer :
   void OnSSLCertificateError(const scoped_refptr<Channel> &channel,
                              const net::SSLInfo &ssl_info,
                              bool fatal) override;
+  void OnKeepAliveReceived(const scoped_refptr<Channel> &channel) override;
+  void OnChannelCongested(const scoped_refptr<Channel> &channel) override;
+  void OnChannelWritable(const scoped_refptr<Channel> &channel) override;
+  void OnOutgoingMessage(const scoped_refptr<Channel> &channel,
+                         const scoped_refptr<Message> &message) override;
+  bool AbsorbRetransmission(const base::StringPiece &head) override;
+
+  // sippet::ChannelListener::Delegate methods:
+  void OnChannelAccepted(const scoped_refptr<Channel> &channel) override;
+
+  // net::NetworkChangeNotifier::IPAddressObserver methods:
+  void OnIPAddressChanged() override;
 
   // SSL Certificate handshake transaction complete
   void OnSSLCertErrorTransactionComplete(
@@ -364,9 +837,38 @@ class NetworkLayer :
 
   // Timer callbacks
   void OnIdleChannelTimedOut(const EndPoint &endpoint);
+  void OnKeepAliveTimer(const EndPoint &endpoint);
+  void OnKeepAliveTimedOut(const EndPoint &endpoint);
 
   void PostOnChannelClosed(const EndPoint &destination);
 
+  // Queues an event for the batch delegate, posting a flush for the first
+  // one of a batch.
+  void QueueTransactionEvent(TransactionEvent::Type type,
+                             const scoped_refptr<Message> &message,
+                             int error);
+  void FlushTransactionEvents();
+
+  // Computes the branch of a forwarded request, and recognizes it on the
+  // responses.
+  static std::string CreateStatelessBranch(const Request &request);
+  static bool IsStatelessBranch(const std::string &branch);
+
+  // Returns true if |uri| refers to one of the channel listeners.
+  bool IsLocalURI(const SipURI &uri) const;
+
+  // Updates the Max-Forwards and the Route of a request being forwarded.
+  // Returns a network error code.
+  int PrepareForwardedRequest(const scoped_refptr<Request> &request);
+
+  // Sends a response to a forwarded request to the next |Via|.
+  void ForwardResponse(const scoped_refptr<Response> &response);
+
+  BatchDelegate *batch_delegate_;
+  TransactionEvents pending_events_;
+  StatelessDelegate *stateless_delegate_;
+  ResponseRouter *response_router_;
+
   base::ThreadChecker thread_checker_;
   base::WeakPtrFactory<NetworkLayer> weak_factory_;
 };
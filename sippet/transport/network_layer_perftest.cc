@@ -0,0 +1,338 @@
+// Copyright (c) 2015 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "base/containers/hash_tables.h"
+#include "base/files/file_path.h"
+#include "base/memory/scoped_vector.h"
+#include "base/message_loop/message_loop.h"
+#include "base/path_service.h"
+#include "base/process/process_metrics.h"
+#include "base/run_loop.h"
+#include "base/strings/string_number_conversions.h"
+#include "net/base/net_errors.h"
+#include "net/socket/client_socket_factory.h"
+#include "net/url_request/url_request_test_util.h"
+#include "sippet/message/headers.h"
+#include "sippet/message/request.h"
+#include "sippet/message/response.h"
+#include "sippet/test/standalone_test_server/standalone_test_server.h"
+#include "sippet/transport/chrome/chrome_channel_factory.h"
+#include "sippet/transport/end_point.h"
+#include "sippet/transport/network_layer.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+
+namespace sippet {
+
+namespace {
+
+// Transactions measured per protocol.
+const int kTransactions = 5000;
+
+// Transactions kept in flight at once.
+const int kWindow = 32;
+
+// Channels opened to measure the memory taken by each one.
+const int kChannels = 64;
+
+// The loopback server uses a self-signed certificate.
+class AcceptingSSLCertErrorHandler : public SSLCertErrorHandler {
+ public:
+  class Factory : public SSLCertErrorHandler::Factory {
+   public:
+    scoped_ptr<SSLCertErrorHandler> CreateSSLCertificateErrorHandler()
+        override {
+      return scoped_ptr<SSLCertErrorHandler>(
+          new AcceptingSSLCertErrorHandler);
+    }
+  };
+
+  int GetUserApproval(const EndPoint &destination,
+                      const net::SSLInfo &ssl_info,
+                      bool fatal,
+                      bool *is_accepted,
+                      const net::CompletionCallback& callback) override {
+    *is_accepted = true;
+    return net::OK;
+  }
+
+  int GetClientCert(const EndPoint &destination,
+                    const net::SSLInfo &ssl_info,
+                    scoped_refptr<net::X509Certificate> *client_cert,
+                    const net::CompletionCallback& callback) override {
+    *client_cert = nullptr;
+    return net::OK;
+  }
+};
+
+// Runs OPTIONS transactions to |target|, keeping |window| of them in
+// flight, and records the time from each request to its final response.
+class TransactionDriver : public NetworkLayer::Delegate {
+ public:
+  TransactionDriver(const GURL &target, int count, int window)
+    : target_(target),
+      count_(count),
+      window_(window),
+      sent_(0),
+      finished_(0),
+      failures_(0),
+      connected_(false) {
+  }
+
+  ~TransactionDriver() override {}
+
+  const std::vector<int64> &latencies() const { return latencies_; }
+  int failures() const { return failures_; }
+  bool connected() const { return connected_; }
+
+  // Runs all transactions, returning once they are finished.
+  void Run(NetworkLayer *network_layer) {
+    network_layer_ = network_layer;
+    for (int i = 0; i < window_ && sent_ < count_; ++i)
+      SendNext();
+    if (finished_ < count_) {
+      base::RunLoop run_loop;
+      quit_closure_ = run_loop.QuitClosure();
+      run_loop.Run();
+    }
+  }
+
+  // Connects |network_layer| to the target, returning once connected.
+  void Connect(NetworkLayer *network_layer) {
+    int rv = network_layer->Connect(EndPoint::FromGURL(target_));
+    if (net::ERR_IO_PENDING != rv) {
+      connected_ = net::OK == rv;
+      return;
+    }
+    base::RunLoop run_loop;
+    connect_closure_ = run_loop.QuitClosure();
+    run_loop.Run();
+    connect_closure_.Reset();
+  }
+
+  // NetworkLayer::Delegate implementation
+  void OnChannelConnected(const EndPoint &destination, int err) override {
+    connected_ = net::OK == err;
+    if (!connect_closure_.is_null())
+      connect_closure_.Run();
+  }
+
+  void OnChannelClosed(const EndPoint &destination) override {}
+
+  void OnIncomingRequest(const scoped_refptr<Request> &request) override {}
+
+  void OnIncomingResponse(const scoped_refptr<Response> &response) override {
+    if (200 > response->response_code() || !response->refer_to())
+      return;
+    Finish(response->refer_to()->id(), 2 == response->response_code() / 100);
+  }
+
+  void OnTimedOut(const scoped_refptr<Request> &request) override {
+    Finish(request->id(), false);
+  }
+
+  void OnTransportError(const scoped_refptr<Request> &request,
+                        int error) override {
+    Finish(request->id(), false);
+  }
+
+ private:
+  typedef base::hash_map<std::string, base::TimeTicks> PendingMap;
+
+  void SendNext() {
+    scoped_refptr<Request> request(new Request(Method::OPTIONS, target_));
+    std::string suffix(base::IntToString(sent_++));
+    scoped_ptr<To> to(new To(target_));
+    request->push_back(to.Pass());
+    scoped_ptr<From> from(new From(GURL("sip:perftest@127.0.0.1")));
+    from->set_tag("t" + suffix);
+    request->push_back(from.Pass());
+    scoped_ptr<CallId> call_id(new CallId("perftest-" + suffix));
+    request->push_back(call_id.Pass());
+    scoped_ptr<Cseq> cseq(new Cseq(1, Method::OPTIONS));
+    request->push_back(cseq.Pass());
+    scoped_ptr<MaxForwards> max_forwards(new MaxForwards(70));
+    request->push_back(max_forwards.Pass());
+
+    pending_[request->id()] = base::TimeTicks::Now();
+    int rv = network_layer_->Send(request, net::CompletionCallback());
+    if (net::OK != rv && net::ERR_IO_PENDING != rv)
+      Finish(request->id(), false);
+  }
+
+  void Finish(const std::string &id, bool success) {
+    PendingMap::iterator i = pending_.find(id);
+    if (pending_.end() == i)
+      return;
+    if (success)
+      latencies_.push_back((base::TimeTicks::Now() - i->second)
+          .InMicroseconds());
+    else
+      failures_++;
+    pending_.erase(i);
+    if (sent_ < count_)
+      SendNext();
+    if (++finished_ == count_ && !quit_closure_.is_null())
+      quit_closure_.Run();
+  }
+
+  GURL target_;
+  int count_;
+  int window_;
+  int sent_;
+  int finished_;
+  int failures_;
+  bool connected_;
+  NetworkLayer *network_layer_;
+  PendingMap pending_;
+  std::vector<int64> latencies_;
+  base::Closure quit_closure_;
+  base::Closure connect_closure_;
+
+  DISALLOW_COPY_AND_ASSIGN(TransactionDriver);
+};
+
+// The |percent| percentile of sorted |latencies|, in milliseconds.
+double Percentile(const std::vector<int64> &latencies, int percent) {
+  if (latencies.empty())
+    return 0;
+  return latencies[(latencies.size() - 1) * percent / 100] / 1000.0;
+}
+
+}  // namespace
+
+// Drives a |NetworkLayer| against the |StandaloneTestServer| over the
+// loopback interface. The server runs in load mode in the same process, so
+// the CPU times reported include its own.
+class TransportPerfTest : public testing::Test {
+ public:
+  TransportPerfTest()
+    : request_context_getter_(new net::TestURLRequestContextGetter(
+          message_loop_.task_runner())) {
+    net::SSLConfig ssl_config;
+    channel_factory_.reset(new ChromeChannelFactory(
+        net::ClientSocketFactory::GetDefaultFactory(),
+        request_context_getter_, ssl_config));
+    network_settings_.set_ssl_cert_error_handler_factory(
+        &ssl_cert_error_handler_factory_);
+  }
+
+  void RunProtocol(const Protocol &protocol, const std::string &trace) {
+    StandaloneTestServer::SSLOptions ssl_options;
+    if (Protocol::TLS == protocol) {
+      base::FilePath certs_dir;
+      PathService::Get(base::DIR_SOURCE_ROOT, &certs_dir);
+      certs_dir = certs_dir.Append(
+          FILE_PATH_LITERAL("net/data/ssl/certificates"));
+      ssl_options.certificate_file = certs_dir.AppendASCII("ok_cert.pem");
+      ssl_options.privatekey_file = certs_dir.AppendASCII("ok_cert.pem");
+    }
+    StandaloneTestServer server(protocol, ssl_options);
+    StandaloneTestServer::LoadOptions load_options;
+    load_options.worker_threads = 2;
+    server.EnableLoadMode(load_options);
+    ASSERT_TRUE(server.InitializeAndWaitUntilReady());
+
+    MeasureTransactions(protocol, server.base_uri(), trace);
+    MeasureChannels(protocol, server.base_uri(), trace);
+
+    ASSERT_TRUE(server.ShutdownAndWaitUntilComplete());
+  }
+
+ private:
+  struct Channel {
+    scoped_ptr<TransactionDriver> driver_;
+    // Destroyed before its delegate.
+    scoped_ptr<NetworkLayer> network_layer_;
+  };
+
+  scoped_ptr<NetworkLayer> CreateNetworkLayer(
+      const Protocol &protocol, NetworkLayer::Delegate *delegate) {
+    scoped_ptr<NetworkLayer> network_layer(
+        new NetworkLayer(delegate, network_settings_));
+    network_layer->RegisterChannelFactory(protocol, channel_factory_.get());
+    return network_layer.Pass();
+  }
+
+  void MeasureTransactions(const Protocol &protocol, const GURL &target,
+                           const std::string &trace) {
+    TransactionDriver driver(target, kTransactions, kWindow);
+    scoped_ptr<NetworkLayer> network_layer(
+        CreateNetworkLayer(protocol, &driver));
+    // Connecting isn't measured
+    driver.Connect(network_layer.get());
+    ASSERT_TRUE(driver.connected());
+
+    scoped_ptr<base::ProcessMetrics> metrics(
+        base::ProcessMetrics::CreateCurrentProcessMetrics());
+    metrics->GetCPUUsage();
+    base::TimeTicks start(base::TimeTicks::Now());
+    driver.Run(network_layer.get());
+    base::TimeDelta elapsed(base::TimeTicks::Now() - start);
+    double cpu_percent = metrics->GetCPUUsage();
+
+    EXPECT_EQ(0, driver.failures());
+    std::vector<int64> latencies(driver.latencies());
+    std::sort(latencies.begin(), latencies.end());
+    double seconds = elapsed.InSecondsF();
+    perf_test::PrintResult("transport_transactions", "_throughput", trace,
+        seconds > 0 ? kTransactions / seconds : 0, "transactions/sec", true);
+    perf_test::PrintResult("transport_latency", "_p50", trace,
+        Percentile(latencies, 50), "ms", true);
+    perf_test::PrintResult("transport_latency", "_p99", trace,
+        Percentile(latencies, 99), "ms", true);
+    perf_test::PrintResult("transport_cpu", "_per_transaction", trace,
+        cpu_percent / 100 * elapsed.InMicrosecondsF() / kTransactions,
+        "us/transaction", true);
+  }
+
+  void MeasureChannels(const Protocol &protocol, const GURL &target,
+                       const std::string &trace) {
+    // Each network layer opens a channel of its own to the same server
+    scoped_ptr<base::ProcessMetrics> metrics(
+        base::ProcessMetrics::CreateCurrentProcessMetrics());
+    size_t working_set = metrics->GetWorkingSetSize();
+    ScopedVector<Channel> channels;
+    for (int i = 0; i < kChannels; ++i) {
+      Channel *channel = new Channel;
+      channels.push_back(channel);
+      channel->driver_.reset(new TransactionDriver(target, 0, 0));
+      channel->network_layer_ =
+          CreateNetworkLayer(protocol, channel->driver_.get());
+      channel->driver_->Connect(channel->network_layer_.get());
+      ASSERT_TRUE(channel->driver_->connected());
+    }
+    double per_channel = (static_cast<double>(metrics->GetWorkingSetSize())
+        - working_set) / kChannels;
+    perf_test::PrintResult("transport_channel", "_rss", trace,
+        std::max(per_channel, 0.0), "bytes/channel", true);
+
+    channels.clear();
+    base::RunLoop().RunUntilIdle();
+  }
+
+  base::MessageLoopForIO message_loop_;
+  scoped_refptr<net::TestURLRequestContextGetter> request_context_getter_;
+  AcceptingSSLCertErrorHandler::Factory ssl_cert_error_handler_factory_;
+  NetworkSettings network_settings_;
+  scoped_ptr<ChromeChannelFactory> channel_factory_;
+};
+
+TEST_F(TransportPerfTest, Udp) {
+  RunProtocol(Protocol::UDP, "udp");
+}
+
+TEST_F(TransportPerfTest, Tcp) {
+  RunProtocol(Protocol::TCP, "tcp");
+}
+
+TEST_F(TransportPerfTest, Tls) {
+  RunProtocol(Protocol::TLS, "tls");
+}
+
+}  // namespace sippet
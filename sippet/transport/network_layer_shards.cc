@@ -0,0 +1,205 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/network_layer_shards.h"
+
+#include "base/bind.h"
+#include "base/hash.h"
+#include "base/strings/stringprintf.h"
+#include "base/thread_task_runner_handle.h"
+#include "net/base/net_errors.h"
+#include "sippet/message/headers/call_id.h"
+#include "sippet/message/headers/via.h"
+
+namespace sippet {
+
+// Gives the responses received by a shard, but sent by another one, to the
+// shard that sent them.
+class NetworkLayerShards::ResponseRouter
+    : public NetworkLayer::ResponseRouter {
+ public:
+  ResponseRouter(NetworkLayerShards *shards, size_t shard)
+    : shards_(shards), shard_(shard) {}
+  ~ResponseRouter() override {}
+
+  // sippet::NetworkLayer::ResponseRouter methods:
+  bool RouteResponse(const scoped_refptr<Response> &response) override {
+    const Response *const_response = response.get();
+    const Via *via = const_response->get<Via>();
+    size_t shard;
+    if (!via || via->empty() || !via->front().HasBranch()
+        || !ShardBranchFactory::ShardOfBranch(via->front().branch(), &shard)
+        || shard == shard_ || shard >= shards_->shards_.size())
+      return false;
+    shards_->shards_[shard]->task_runner_->PostTask(FROM_HERE,
+        base::Bind(&NetworkLayerShards::OnRoutedResponse,
+            base::Unretained(shards_), shard, response));
+    return true;
+  }
+
+ private:
+  NetworkLayerShards *shards_;
+  size_t shard_;
+
+  DISALLOW_COPY_AND_ASSIGN(ResponseRouter);
+};
+
+NetworkLayerShards::Shard::Shard(const std::string &name, size_t index)
+  : thread_(name),
+    branch_factory_(index) {
+}
+
+NetworkLayerShards::Shard::~Shard() {
+}
+
+NetworkLayerShards::NetworkLayerShards(Delegate *delegate,
+                                       size_t shard_count)
+  : delegate_(delegate),
+    started_(false) {
+  DCHECK(delegate);
+  DCHECK_GT(shard_count, 0u);
+  for (size_t i = 0; i < shard_count; ++i) {
+    shards_.push_back(new Shard(base::StringPrintf(
+        "SipNetworkShard%d", static_cast<int>(i)), i));
+  }
+}
+
+NetworkLayerShards::~NetworkLayerShards() {
+  Stop();
+}
+
+bool NetworkLayerShards::Start() {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  if (started_)
+    return true;
+  base::Thread::Options options;
+  options.message_loop_type = base::MessageLoop::TYPE_IO;
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    if (!shards_[i]->thread_.StartWithOptions(options)) {
+      DVLOG(1) << "Couldn't start shard " << i;
+      started_ = true;
+      Stop();
+      return false;
+    }
+    shards_[i]->task_runner_ = shards_[i]->thread_.task_runner();
+  }
+  // Network layers are only created once all task runners are known, as
+  // any shard may route responses to the others.
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    shards_[i]->task_runner_->PostTask(FROM_HERE,
+        base::Bind(&NetworkLayerShards::OnStartShard,
+            base::Unretained(this), i));
+  }
+  started_ = true;
+  return true;
+}
+
+void NetworkLayerShards::Stop() {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  if (!started_)
+    return;
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    if (!shards_[i]->thread_.IsRunning())
+      continue;
+    shards_[i]->thread_.task_runner()->PostTask(FROM_HERE,
+        base::Bind(&NetworkLayerShards::OnStopShard,
+            base::Unretained(this), i));
+  }
+  // Joining runs the pending tasks first, so all network layers are gone
+  // once the threads are stopped.
+  for (size_t i = 0; i < shards_.size(); ++i)
+    shards_[i]->thread_.Stop();
+  started_ = false;
+}
+
+scoped_refptr<base::SingleThreadTaskRunner>
+NetworkLayerShards::task_runner(size_t shard) const {
+  DCHECK_LT(shard, shards_.size());
+  if (!shards_[shard]->thread_.IsRunning())
+    return NULL;
+  return shards_[shard]->thread_.task_runner();
+}
+
+BranchFactory *NetworkLayerShards::branch_factory(size_t shard) {
+  DCHECK_LT(shard, shards_.size());
+  return &shards_[shard]->branch_factory_;
+}
+
+size_t NetworkLayerShards::ShardOf(
+    const scoped_refptr<Message> &message) const {
+  return ShardOf(*message.get(), shards_.size());
+}
+
+// static
+size_t NetworkLayerShards::ShardOf(const Message &message,
+                                   size_t shard_count) {
+  DCHECK_GT(shard_count, 0u);
+  const CallId *call_id = message.get<CallId>();
+  if (!call_id)
+    return 0;
+  return base::Hash(call_id->value()) % shard_count;
+}
+
+void NetworkLayerShards::Send(const scoped_refptr<Message> &message,
+                              const net::CompletionCallback &callback) {
+  DCHECK(started_);
+  size_t shard = ShardOf(message);
+  scoped_refptr<base::SingleThreadTaskRunner> reply_runner;
+  if (!callback.is_null())
+    reply_runner = base::ThreadTaskRunnerHandle::Get();
+  shards_[shard]->thread_.task_runner()->PostTask(FROM_HERE,
+      base::Bind(&NetworkLayerShards::OnSend, base::Unretained(this),
+          shard, message, reply_runner, callback));
+}
+
+void NetworkLayerShards::OnStartShard(size_t shard) {
+  DCHECK(shards_[shard]->thread_.task_runner()->BelongsToCurrentThread());
+  shards_[shard]->network_layer_ = delegate_->CreateNetworkLayer(shard);
+  DCHECK(shards_[shard]->network_layer_);
+  shards_[shard]->response_router_.reset(new ResponseRouter(this, shard));
+  shards_[shard]->network_layer_->SetResponseRouter(
+      shards_[shard]->response_router_.get());
+}
+
+void NetworkLayerShards::OnStopShard(size_t shard) {
+  DCHECK(shards_[shard]->thread_.task_runner()->BelongsToCurrentThread());
+  shards_[shard]->network_layer_.reset();
+  shards_[shard]->response_router_.reset();
+  delegate_->OnNetworkLayerDestroyed(shard);
+}
+
+void NetworkLayerShards::OnSend(
+    size_t shard,
+    const scoped_refptr<Message> &message,
+    const scoped_refptr<base::SingleThreadTaskRunner> &reply_runner,
+    const net::CompletionCallback &callback) {
+  NetworkLayer *network_layer = shards_[shard]->network_layer_.get();
+  net::CompletionCallback on_sent;
+  if (!callback.is_null()) {
+    on_sent = base::Bind(&NetworkLayerShards::PostResult,
+        reply_runner, callback);
+  }
+  int result = network_layer->Send(message, on_sent);
+  if (result != net::ERR_IO_PENDING && !on_sent.is_null())
+    on_sent.Run(result);
+}
+
+void NetworkLayerShards::OnRoutedResponse(
+    size_t shard,
+    const scoped_refptr<Response> &response) {
+  // Responses may still be routed to a shard being stopped.
+  NetworkLayer *network_layer = shards_[shard]->network_layer_.get();
+  if (network_layer)
+    network_layer->HandleRoutedResponse(response);
+}
+
+// static
+void NetworkLayerShards::PostResult(
+    const scoped_refptr<base::SingleThreadTaskRunner> &reply_runner,
+    const net::CompletionCallback &callback,
+    int result) {
+  reply_runner->PostTask(FROM_HERE, base::Bind(callback, result));
+}
+
+} // End of sippet namespace
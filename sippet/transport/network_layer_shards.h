@@ -0,0 +1,147 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_NETWORK_LAYER_SHARDS_H_
+#define SIPPET_TRANSPORT_NETWORK_LAYER_SHARDS_H_
+
+#include "base/memory/ref_counted.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/memory/scoped_vector.h"
+#include "base/single_thread_task_runner.h"
+#include "base/threading/thread.h"
+#include "base/threading/thread_checker.h"
+#include "net/base/completion_callback.h"
+#include "sippet/message/message.h"
+#include "sippet/transport/branch_factory.h"
+#include "sippet/transport/network_layer.h"
+
+namespace sippet {
+
+// Runs several |NetworkLayer| instances, each one on its own IO thread, so
+// that a single process can spread its SIP traffic across many cores.
+//
+// Messages are pinned to a shard by hashing their Call-ID, so that all
+// transactions and dialogs of a given call are handled by the same network
+// layer and none of their state is ever shared between threads. Each network
+// layer owns the channels it opens, so messages received through them are
+// also delivered on the shard thread, to the delegate of that shard.
+//
+// Shards may also have listeners of their own, possibly on sockets sharing
+// the same port, among which the system spreads the inbound traffic. The
+// responses may then reach another shard than the one that sent the
+// requests: when the requests are sent with the branches of
+// |branch_factory|, the responses are routed back to their shard.
+//
+// Example usage:
+//   class MyShardsDelegate : public NetworkLayerShards::Delegate {
+//    public:
+//     scoped_ptr<NetworkLayer> CreateNetworkLayer(size_t shard) override {
+//       NetworkSettings settings;
+//       settings.set_branch_factory(shards_->branch_factory(shard));
+//       // Pinned near the network device, each shard on its own CPUs.
+//       settings.set_thread_placement(nic_placement_.ForShard(
+//           shard, shards_->shard_count()));
+//       scoped_ptr<NetworkLayer> network_layer(
+//           new NetworkLayer(delegates_[shard], settings));
+//       network_layer->RegisterChannelFactory(Protocol::UDP,
+//           channel_factories_[shard]);
+//       return network_layer.Pass();
+//     }
+//   };
+//
+//   NetworkLayerShards shards(&my_shards_delegate, 4);
+//   shards.Start();
+//   shards.Send(request, base::Bind(&OnRequestSent));
+class NetworkLayerShards {
+ public:
+  class Delegate {
+   public:
+    virtual ~Delegate() {}
+
+    // Called on the thread of |shard| to create its |NetworkLayer|, with its
+    // own delegate and channel factories. Everything created here should be
+    // used from that thread only.
+    virtual scoped_ptr<NetworkLayer> CreateNetworkLayer(size_t shard) = 0;
+
+    // Called on the thread of |shard|, right after its network layer has
+    // been destroyed, so that per-shard objects can be released.
+    virtual void OnNetworkLayerDestroyed(size_t shard) {}
+  };
+
+  // Construct |shard_count| shards; threads are only started by |Start|.
+  NetworkLayerShards(Delegate *delegate, size_t shard_count);
+
+  // Stops all shards, if still running.
+  ~NetworkLayerShards();
+
+  // Starts all shard threads and creates their network layers. Returns false
+  // if some thread could not be started.
+  bool Start();
+
+  // Destroys all network layers on their threads and joins them.
+  void Stop();
+
+  size_t shard_count() const { return shards_.size(); }
+
+  // Returns the task runner of the thread running |shard|, or NULL when not
+  // started.
+  scoped_refptr<base::SingleThreadTaskRunner> task_runner(size_t shard) const;
+
+  // Returns the branch factory to be used by the network layer of |shard|,
+  // so that responses received by other shards are routed back to it.
+  BranchFactory *branch_factory(size_t shard);
+
+  // Returns the shard that handles |message|, computed from its Call-ID.
+  // Messages without a Call-ID go to the first shard.
+  size_t ShardOf(const scoped_refptr<Message> &message) const;
+  static size_t ShardOf(const Message &message, size_t shard_count);
+
+  // Sends |message| through the network layer of its shard, the same way as
+  // |NetworkLayer::Send|. The |message| is handed over to the shard thread,
+  // so it must not be modified afterwards. The |callback| is run on the
+  // calling thread, which must have a message loop, with the result.
+  void Send(const scoped_refptr<Message> &message,
+            const net::CompletionCallback &callback);
+
+ private:
+  class ResponseRouter;
+
+  struct Shard {
+    Shard(const std::string &name, size_t index);
+    ~Shard();
+
+    base::Thread thread_;
+    // Kept while stopping, so that routed responses can still be posted.
+    scoped_refptr<base::SingleThreadTaskRunner> task_runner_;
+    ShardBranchFactory branch_factory_;
+    // Only accessed from |thread_|.
+    scoped_ptr<ResponseRouter> response_router_;
+    scoped_ptr<NetworkLayer> network_layer_;
+  };
+
+  void OnStartShard(size_t shard);
+  void OnStopShard(size_t shard);
+  void OnSend(size_t shard,
+              const scoped_refptr<Message> &message,
+              const scoped_refptr<base::SingleThreadTaskRunner> &reply_runner,
+              const net::CompletionCallback &callback);
+  void OnRoutedResponse(size_t shard,
+                        const scoped_refptr<Response> &response);
+
+  static void PostResult(
+      const scoped_refptr<base::SingleThreadTaskRunner> &reply_runner,
+      const net::CompletionCallback &callback,
+      int result);
+
+  Delegate *delegate_;
+  ScopedVector<Shard> shards_;
+  bool started_;
+  base::ThreadChecker thread_checker_;
+
+  DISALLOW_COPY_AND_ASSIGN(NetworkLayerShards);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_NETWORK_LAYER_SHARDS_H_
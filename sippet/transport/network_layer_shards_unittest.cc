@@ -0,0 +1,168 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/network_layer_shards.h"
+
+#include <set>
+
+#include "base/strings/stringprintf.h"
+#include "base/synchronization/lock.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const char kInviteRequest[] =
+  "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds\r\n"
+  "Max-Forwards: 70\r\n"
+  "To: Bob <sip:bob@biloxi.com>\r\n"
+  "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+  "Call-ID: %s\r\n"
+  "CSeq: 314159 INVITE\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n";
+
+const char kRingingResponse[] =
+  "SIP/2.0 180 Ringing\r\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds\r\n"
+  "To: Bob <sip:bob@biloxi.com>;tag=a6c85cf\r\n"
+  "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+  "Call-ID: %s\r\n"
+  "CSeq: 314159 INVITE\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n";
+
+class NullNetworkLayerDelegate : public NetworkLayer::Delegate {
+ public:
+  void OnChannelConnected(const EndPoint &destination, int err) override {}
+  void OnChannelClosed(const EndPoint &destination) override {}
+  void OnIncomingRequest(const scoped_refptr<Request> &request) override {}
+  void OnIncomingResponse(const scoped_refptr<Response> &response) override {}
+  void OnTimedOut(const scoped_refptr<Request> &request) override {}
+  void OnTransportError(const scoped_refptr<Request> &request,
+                        int error) override {}
+};
+
+class CountingShardsDelegate : public NetworkLayerShards::Delegate {
+ public:
+  CountingShardsDelegate() : created_(0), destroyed_(0) {}
+
+  scoped_ptr<NetworkLayer> CreateNetworkLayer(size_t shard) override {
+    base::AutoLock lock(lock_);
+    ++created_;
+    return scoped_ptr<NetworkLayer>(new NetworkLayer(&delegate_));
+  }
+
+  void OnNetworkLayerDestroyed(size_t shard) override {
+    base::AutoLock lock(lock_);
+    ++destroyed_;
+  }
+
+  int created() {
+    base::AutoLock lock(lock_);
+    return created_;
+  }
+  int destroyed() {
+    base::AutoLock lock(lock_);
+    return destroyed_;
+  }
+
+ private:
+  base::Lock lock_;
+  NullNetworkLayerDelegate delegate_;
+  int created_;
+  int destroyed_;
+};
+
+scoped_refptr<Message> ParseWithCallId(const char *format,
+                                       const std::string &call_id) {
+  return Message::Parse(base::StringPrintf(format, call_id.c_str()));
+}
+
+}  // namespace
+
+TEST(NetworkLayerShardsTest, RequestsAndResponsesShareShard) {
+  const size_t kShardCount = 4;
+  std::set<size_t> used;
+  for (int i = 0; i < 64; ++i) {
+    std::string call_id(base::StringPrintf("%d-a84b4c76e66710@atlanta", i));
+    scoped_refptr<Message> request(ParseWithCallId(kInviteRequest, call_id));
+    scoped_refptr<Message> response(
+        ParseWithCallId(kRingingResponse, call_id));
+    ASSERT_TRUE(request.get());
+    ASSERT_TRUE(response.get());
+    size_t shard = NetworkLayerShards::ShardOf(*request.get(), kShardCount);
+    EXPECT_GT(kShardCount, shard);
+    EXPECT_EQ(shard,
+              NetworkLayerShards::ShardOf(*response.get(), kShardCount));
+    used.insert(shard);
+  }
+  // Calls are spread across all shards.
+  EXPECT_EQ(kShardCount, used.size());
+}
+
+TEST(NetworkLayerShardsTest, StartAndStop) {
+  CountingShardsDelegate delegate;
+  NetworkLayerShards shards(&delegate, 3);
+  EXPECT_EQ(3u, shards.shard_count());
+  EXPECT_FALSE(shards.task_runner(0).get());
+
+  ASSERT_TRUE(shards.Start());
+  for (size_t i = 0; i < shards.shard_count(); ++i)
+    EXPECT_TRUE(shards.task_runner(i).get());
+
+  shards.Stop();
+  EXPECT_EQ(3, delegate.created());
+  EXPECT_EQ(3, delegate.destroyed());
+  EXPECT_FALSE(shards.task_runner(0).get());
+}
+
+TEST(NetworkLayerShardsTest, BranchesTellTheirShard) {
+  CountingShardsDelegate delegate;
+  NetworkLayerShards shards(&delegate, 20);
+  for (size_t i = 0; i < shards.shard_count(); ++i) {
+    std::string branch(shards.branch_factory(i)->CreateBranch());
+    EXPECT_EQ(0u, branch.find("z9hG4bK"));
+    size_t shard = shards.shard_count();
+    ASSERT_TRUE(ShardBranchFactory::ShardOfBranch(branch, &shard));
+    EXPECT_EQ(i, shard);
+    EXPECT_NE(branch, shards.branch_factory(i)->CreateBranch());
+  }
+
+  size_t shard;
+  EXPECT_FALSE(ShardBranchFactory::ShardOfBranch("z9hG4bK776asdhds",
+                                                 &shard));
+  EXPECT_FALSE(ShardBranchFactory::ShardOfBranch("z9hG4bKs.abc", &shard));
+  EXPECT_FALSE(ShardBranchFactory::ShardOfBranch("z9hG4bKs12", &shard));
+  EXPECT_FALSE(ShardBranchFactory::ShardOfBranch("z9hG4bKsq.abc", &shard));
+  EXPECT_FALSE(ShardBranchFactory::ShardOfBranch("abcdefgs1.abc", &shard));
+  EXPECT_TRUE(ShardBranchFactory::ShardOfBranch("z9hG4bKs1f.x", &shard));
+  EXPECT_EQ(31u, shard);
+}
+
+TEST(NetworkLayerShardsTest, RoutingBranches) {
+  RoutingTokenSigner signer("cluster key");
+  RoutingBranchFactory factory(&signer, RoutingToken(7, 513), true);
+  std::string branch(factory.CreateBranch());
+  EXPECT_EQ(0u, branch.find("z9hG4bK~"));
+  EXPECT_EQ(8 + RoutingTokenSigner::kEncodedSize + 8, branch.size());
+  EXPECT_NE(branch, factory.CreateBranch());
+
+  RoutingToken token;
+  ASSERT_TRUE(factory.TokenOfBranch(branch, &token));
+  EXPECT_EQ(7, token.shard);
+  EXPECT_EQ(513, token.node);
+  EXPECT_FALSE(token.timestamp.is_null());
+
+  // Tampered tokens are rejected.
+  std::string forged(branch);
+  forged[10] = 'A' == forged[10] ? 'B' : 'A';
+  EXPECT_FALSE(factory.TokenOfBranch(forged, &token));
+  EXPECT_FALSE(factory.TokenOfBranch("z9hG4bK776asdhds", &token));
+  EXPECT_FALSE(factory.TokenOfBranch("z9hG4bK~short", &token));
+}
+
+}  // namespace sippet
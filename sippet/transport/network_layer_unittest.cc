@@ -4,6 +4,7 @@
 
 #include "sippet/transport/chrome/transport_test_util.h"
 
+#include "base/bind.h"
 #include "sippet/base/tags.h"
 
 namespace sippet {
@@ -62,6 +63,103 @@ const char kOptionsResponse[] =
   "l: 0\r\n"
   "\r\n";
 
+const char kInviteRequest[] =
+  "INVITE sip:bob@192.0.2.33;transport=TCP SIP/2.0\r\n"
+  "v: SIP/2.0/TCP 192.0.4.42:123;branch=z9hG4bK74bf9\r\n"
+  "Max-Forwards: 70\r\n"
+  "t: \"Bob\" <sip:bob@biloxi.com>\r\n"
+  "f: \"Alice\" <sip:alice@atlanta.com>;tag=9fxced76sl\r\n"
+  "i: 3848276298220188511@atlanta.com\r\n"
+  "CSeq: 1 INVITE\r\n"
+  "m: <sip:alice@pc33.atlanta.com>\r\n"
+  "l: 0\r\n"
+  "\r\n";
+
+// Same branch as the INVITE, as are the ACKs of non-2xx responses.
+const char kCancelRequest[] =
+  "CANCEL sip:bob@192.0.2.33;transport=TCP SIP/2.0\r\n"
+  "v: SIP/2.0/TCP 192.0.4.42:123;branch=z9hG4bK74bf9\r\n"
+  "Max-Forwards: 70\r\n"
+  "t: \"Bob\" <sip:bob@biloxi.com>\r\n"
+  "f: \"Alice\" <sip:alice@atlanta.com>;tag=9fxced76sl\r\n"
+  "i: 3848276298220188511@atlanta.com\r\n"
+  "CSeq: 1 CANCEL\r\n"
+  "l: 0\r\n"
+  "\r\n";
+
+const char kAckRequest[] =
+  "ACK sip:bob@192.0.2.33;transport=TCP SIP/2.0\r\n"
+  "v: SIP/2.0/TCP 192.0.4.42:123;branch=z9hG4bK74bf9\r\n"
+  "Max-Forwards: 70\r\n"
+  "t: \"Bob\" <sip:bob@biloxi.com>;tag=8321234356\r\n"
+  "f: \"Alice\" <sip:alice@atlanta.com>;tag=9fxced76sl\r\n"
+  "i: 3848276298220188511@atlanta.com\r\n"
+  "CSeq: 1 ACK\r\n"
+  "l: 0\r\n"
+  "\r\n";
+
+// The ACK of a 2xx response, with a branch of its own.
+const char kAck2xxRequest[] =
+  "ACK sip:bob@192.0.2.33;transport=TCP SIP/2.0\r\n"
+  "v: SIP/2.0/TCP 192.0.4.42:123;branch=z9hG4bKnashds9\r\n"
+  "Max-Forwards: 70\r\n"
+  "t: \"Bob\" <sip:bob@biloxi.com>;tag=8321234356\r\n"
+  "f: \"Alice\" <sip:alice@atlanta.com>;tag=9fxced76sl\r\n"
+  "i: 3848276298220188511@atlanta.com\r\n"
+  "CSeq: 1 ACK\r\n"
+  "l: 0\r\n"
+  "\r\n";
+
+class FakeChannelListener : public ChannelListener {
+ public:
+  FakeChannelListener()
+    : delegate_(nullptr), channel_delegate_(nullptr), closed_(false) {}
+
+  ChannelListener::Delegate *delegate() const { return delegate_; }
+  Channel::Delegate *channel_delegate() const { return channel_delegate_; }
+  bool closed() const { return closed_; }
+
+  // sippet::ChannelListener methods:
+  int Listen(ChannelListener::Delegate *delegate,
+             Channel::Delegate *channel_delegate) override {
+    delegate_ = delegate;
+    channel_delegate_ = channel_delegate;
+    return net::OK;
+  }
+  int GetLocalEndPoint(EndPoint *local_end_point) const override {
+    *local_end_point = EndPoint(net::HostPortPair("192.0.2.33", 5060),
+        Protocol::TCP);
+    return net::OK;
+  }
+  void Close() override {
+    closed_ = true;
+  }
+
+ private:
+  ChannelListener::Delegate *delegate_;
+  Channel::Delegate *channel_delegate_;
+  bool closed_;
+};
+
+void SetTrue(bool *value) {
+  *value = true;
+}
+
+class RecordingBatchDelegate : public NetworkLayer::BatchDelegate {
+ public:
+  void OnTransactionEvents(
+      const NetworkLayer::TransactionEvents &events) override {
+    batches_.push_back(events);
+  }
+
+  const std::vector<NetworkLayer::TransactionEvents> &batches() const {
+    return batches_;
+  }
+
+ private:
+  std::vector<NetworkLayer::TransactionEvents> batches_;
+};
+
 }  // namespace
 
 class NetworkLayerTest : public testing::Test {
@@ -77,7 +175,7 @@ class NetworkLayerTest : public testing::Test {
                   net::MockWrite* writes = nullptr, size_t writes_count = 0,
                   MockEvent* events = nullptr, size_t events_count = 0,
                   const char *branches[] = nullptr, size_t branches_count = 0) {
-    NetworkSettings settings;
+    NetworkSettings settings(settings_);
     if (branches != nullptr) {
       branch_factory_.reset(new MockBranchFactory(branches, branches_count));
       settings.set_branch_factory(branch_factory_.get());
@@ -98,6 +196,8 @@ class NetworkLayerTest : public testing::Test {
         Protocol::TCP, channel_factory_.get());
   }
 
+  // Given to the network layer by |Initialize|.
+  NetworkSettings settings_;
   scoped_ptr<DataProvider> data_provider_;
   scoped_ptr<net::DeterministicSocketData> data_;
   scoped_ptr<net::DeterministicMockClientSocketFactory> socket_factory_;
@@ -121,14 +221,54 @@ TEST_F(NetworkLayerTest, StaticFunctions) {
                                   network_layer_.get(),
                                   &channel);
 
+  NetworkLayer::ChannelContext channel_context(&network_layer_->timer_wheel_,
+      channel.get(), NULL, net::CompletionCallback());
   scoped_refptr<Request> client_request =
     new Request(Method::INVITE, GURL("sip:foo@bar.com"));
-  network_layer_->StampClientTopmostVia(client_request, channel);
+  network_layer_->StampClientTopmostVia(client_request, &channel_context);
   EXPECT_TRUE(base::StartsWith(client_request->ToString(),
     "INVITE sip:foo@bar.com SIP/2.0\r\n"
     "v: SIP/2.0/TCP 192.0.2.33:123;rport;branch=z9",
     base::CompareCase::SENSITIVE));
 
+  // Stamps are cached, and given their own parameters.
+  scoped_refptr<Request> second_request =
+    new Request(Method::INVITE, GURL("sip:foo@bar.com"));
+  network_layer_->StampClientTopmostVia(second_request, &channel_context);
+  EXPECT_TRUE(channel_context.stamps_cached_);
+  EXPECT_NE(client_request->get<Via>()->front().branch(),
+            second_request->get<Via>()->front().branch());
+  EXPECT_FALSE(channel_context.sent_by_.HasBranch());
+
+  scoped_refptr<Request> register_request =
+    new Request(Method::REGISTER, GURL("sip:bar.com"));
+  scoped_ptr<Contact> contact(new Contact(GURL("sip:alice@domain.invalid")));
+  register_request->push_back(contact.Pass());
+  network_layer_->StampContact(register_request, &channel_context);
+  EXPECT_EQ(GURL("sip:alice@192.0.2.33:123;transport=tcp"),
+            register_request->get<Contact>()->front().address());
+
+  scoped_refptr<Request> push_register_request =
+    new Request(Method::REGISTER, GURL("sip:bar.com"));
+  scoped_ptr<Contact> push_contact(new Contact(
+      GURL("sip:alice@domain.invalid;pn-provider=fcm;pn-prid=abc")));
+  push_register_request->push_back(push_contact.Pass());
+  network_layer_->StampContact(push_register_request, &channel_context);
+  EXPECT_EQ(GURL("sip:alice@192.0.2.33:123;transport=tcp"
+                 ";pn-provider=fcm;pn-prid=abc"),
+            push_register_request->get<Contact>()->front().address());
+
+  // Stamps are derived again once the channel is reconnected.
+  network_layer_->ClearStamps(&channel_context);
+  EXPECT_FALSE(channel_context.stamps_cached_);
+  EXPECT_TRUE(channel_context.contact_address_.is_empty());
+  scoped_refptr<Request> reconnected_request =
+    new Request(Method::INVITE, GURL("sip:foo@bar.com"));
+  network_layer_->StampClientTopmostVia(reconnected_request, &channel_context);
+  EXPECT_TRUE(channel_context.stamps_cached_);
+  EXPECT_EQ("192.0.2.33",
+            reconnected_request->get<Via>()->front().sent_by().host());
+
   scoped_refptr<Request> empty_via_request =
     new Request(Method::INVITE, GURL("sip:bar@foo.com"));
   network_layer_->StampServerTopmostVia(empty_via_request, channel);
@@ -150,13 +290,13 @@ TEST_F(NetworkLayerTest, StaticFunctions) {
     base::CompareCase::SENSITIVE));
 
   EndPoint single_via_request_endpoint =
-    NetworkLayer::GetMessageEndPoint(single_via_request);
+    NetworkLayer::GetMessageEndPoint(*single_via_request);
   EXPECT_EQ(EndPoint("foo.com", 5060, Protocol::UDP),
     single_via_request_endpoint);
 
   single_via_request->set_request_uri(GURL("sip:foobar@foo.com;transport=TCP"));
   single_via_request_endpoint =
-    NetworkLayer::GetMessageEndPoint(single_via_request);
+    NetworkLayer::GetMessageEndPoint(*single_via_request);
   EXPECT_EQ(EndPoint("foo.com", 5060, Protocol::TCP),
     single_via_request_endpoint);
 
@@ -167,7 +307,7 @@ TEST_F(NetworkLayerTest, StaticFunctions) {
       net::HostPortPair("192.168.0.1", 7001)));
   single_via_response->push_front(via.Pass());
   EndPoint single_via_response_endpoint =
-    NetworkLayer::GetMessageEndPoint(single_via_response);
+    NetworkLayer::GetMessageEndPoint(*single_via_response);
   EXPECT_EQ(EndPoint("192.168.0.1", 7001, Protocol::TCP),
     single_via_response_endpoint);
 
@@ -178,7 +318,7 @@ TEST_F(NetworkLayerTest, StaticFunctions) {
   via->front().set_received("189.187.200.23");
   single_via_response->push_front(via.Pass());
   single_via_response_endpoint =
-    NetworkLayer::GetMessageEndPoint(single_via_response);
+    NetworkLayer::GetMessageEndPoint(*single_via_response);
   EXPECT_EQ(EndPoint("189.187.200.23", 7001, Protocol::TCP),
     single_via_response_endpoint);
 
@@ -190,13 +330,73 @@ TEST_F(NetworkLayerTest, StaticFunctions) {
   via->front().set_rport(5002);
   single_via_response->push_front(via.Pass());
   single_via_response_endpoint =
-    NetworkLayer::GetMessageEndPoint(single_via_response);
+    NetworkLayer::GetMessageEndPoint(*single_via_response);
   EXPECT_EQ(EndPoint("189.187.200.23", 5002, Protocol::TCP),
     single_via_response_endpoint);
 
   Finish();
 }
 
+TEST_F(NetworkLayerTest, TransactionIds) {
+  scoped_refptr<Request> request =
+    dyn_cast<Request>(Message::Parse(kOptionsRequest));
+  scoped_refptr<Response> response =
+    dyn_cast<Response>(Message::Parse(kOptionsResponse));
+  ASSERT_TRUE(request.get());
+  ASSERT_TRUE(response.get());
+
+  std::string client_id(NetworkLayer::ClientTransactionId(request));
+  EXPECT_EQ("c:z9hG4bK776asdhds:OPTIONS", client_id);
+  std::string server_id(NetworkLayer::ServerTransactionId(request));
+  EXPECT_EQ("s:z9hG4bK776asdhds:192.0.4.42:123:OPTIONS", server_id);
+
+  // Responses are matched by printing the same ids into a fixed buffer,
+  // even when they don't fit in it.
+  char buffer[16];
+  raw_fixed_buffer_ostream client_os(buffer, sizeof(buffer));
+  NetworkLayer::PrintClientTransactionId(client_os, *response.get(),
+      response->get<Cseq>()->method());
+  EXPECT_TRUE(client_os.overflowed());
+  EXPECT_EQ(client_id, client_os.str().as_string());
+
+  char large_buffer[256];
+  raw_fixed_buffer_ostream server_os(large_buffer, sizeof(large_buffer));
+  NetworkLayer::PrintServerTransactionId(server_os, *response.get(),
+      response->get<Cseq>()->method());
+  EXPECT_FALSE(server_os.overflowed());
+  EXPECT_EQ(server_id, server_os.str().as_string());
+
+  // Requests from RFC 2543 implementations fall back to dialog fields.
+  request->get<Via>()->front().set_branch("776asdhds");
+  EXPECT_EQ("s::1928301774:a84b4c76e66710@pc33.atlanta.com:314159:OPTIONS:"
+            "192.0.4.42:123:776asdhds",
+            NetworkLayer::ServerTransactionId(request));
+}
+
+TEST_F(NetworkLayerTest, StatelessBranches) {
+  scoped_refptr<Request> request =
+    dyn_cast<Request>(Message::Parse(kOptionsRequest));
+  ASSERT_TRUE(request.get());
+
+  // Retransmissions get the same branch, and forks different ones.
+  std::string branch(NetworkLayer::CreateStatelessBranch(*request));
+  EXPECT_TRUE(NetworkLayer::IsStatelessBranch(branch));
+  EXPECT_EQ(branch, NetworkLayer::CreateStatelessBranch(*request));
+  request->set_request_uri(GURL("sip:carol@192.0.2.5"));
+  std::string fork_branch(NetworkLayer::CreateStatelessBranch(*request));
+  EXPECT_TRUE(NetworkLayer::IsStatelessBranch(fork_branch));
+  EXPECT_NE(branch, fork_branch);
+
+  // RFC 2543 requests are hashed by their dialog fields.
+  request->get<Via>()->front().set_branch("776asdhds");
+  std::string rfc2543_branch(NetworkLayer::CreateStatelessBranch(*request));
+  EXPECT_TRUE(NetworkLayer::IsStatelessBranch(rfc2543_branch));
+  EXPECT_NE(fork_branch, rfc2543_branch);
+
+  EXPECT_FALSE(NetworkLayer::IsStatelessBranch(CreateBranch()));
+  EXPECT_FALSE(NetworkLayer::IsStatelessBranch("z9hG4bK-776asdhds"));
+}
+
 TEST_F(NetworkLayerTest, OutgoingRequest) {
   const char *branches[] = {
     "z9hG4bKnashds7"
@@ -265,4 +465,285 @@ TEST_F(NetworkLayerTest, OutgoingRequest) {
   Finish();
 }
 
+TEST_F(NetworkLayerTest, AcceptedChannel) {
+  std::string server_tid;
+  MockEvent expected_events[] = {
+    ExpectConnectChannel("192.0.4.42:123/TCP", net::OK),
+    ExpectStartTransaction("^OPTIONS sip:192.0.2.33.*", &server_tid),
+    ExpectIncomingMessage("^OPTIONS sip:192.0.2.33.*"),
+    ExpectTransactionClose(&server_tid),
+  };
+
+  Initialize(nullptr, 0, nullptr, 0,
+             expected_events, arraysize(expected_events));
+
+  FakeChannelListener listener;
+  EXPECT_EQ(net::OK, network_layer_->AddChannelListener(&listener));
+  ASSERT_TRUE(listener.delegate());
+  ASSERT_TRUE(listener.channel_delegate());
+
+  EndPoint peer(net::HostPortPair("192.0.4.42", 123), Protocol::TCP);
+  scoped_refptr<Channel> channel(new MockChannel(
+      new TCPChannelAdapter(socket_factory_.get(), nullptr), true,
+      listener.channel_delegate(), peer));
+  listener.delegate()->OnChannelAccepted(channel);
+
+  // The accepted channel is used as any other channel.
+  EXPECT_TRUE(network_layer_->RequestChannel(peer));
+  network_layer_->ReleaseChannel(peer);
+
+  listener.channel_delegate()->OnIncomingMessage(channel,
+      Message::Parse(kOptionsRequest));
+  transaction_factory_->server_transaction(0)->Terminate();
+
+  network_layer_.reset();
+  EXPECT_TRUE(listener.closed());
+  EXPECT_TRUE(data_provider_->at_events_end());
+}
+
+TEST_F(NetworkLayerTest, MaxOpenChannels) {
+  MockEvent expected_events[] = {
+    ExpectConnectChannel("192.0.4.42:123/TCP", net::OK),
+    ExpectConnectChannel("192.0.4.43:123/TCP", net::OK),
+  };
+
+  settings_.set_max_open_channels(1);
+  Initialize(nullptr, 0, nullptr, 0,
+             expected_events, arraysize(expected_events));
+
+  FakeChannelListener listener;
+  EXPECT_EQ(net::OK, network_layer_->AddChannelListener(&listener));
+
+  // The idle channel is evicted to make room for the next one.
+  EndPoint first(net::HostPortPair("192.0.4.42", 123), Protocol::TCP);
+  listener.delegate()->OnChannelAccepted(new MockChannel(
+      new TCPChannelAdapter(socket_factory_.get(), nullptr), true,
+      listener.channel_delegate(), first));
+  EndPoint second(net::HostPortPair("192.0.4.43", 123), Protocol::TCP);
+  listener.delegate()->OnChannelAccepted(new MockChannel(
+      new TCPChannelAdapter(socket_factory_.get(), nullptr), true,
+      listener.channel_delegate(), second));
+  EXPECT_TRUE(network_layer_->RequestChannel(second));
+
+  // No channel is idle now, so the next one is refused.
+  EndPoint third(net::HostPortPair("192.0.4.44", 123), Protocol::TCP);
+  listener.delegate()->OnChannelAccepted(new MockChannel(
+      new TCPChannelAdapter(socket_factory_.get(), nullptr), true,
+      listener.channel_delegate(), third));
+  EXPECT_FALSE(network_layer_->RequestChannel(third));
+  EXPECT_TRUE(data_provider_->at_events_end());
+}
+
+TEST_F(NetworkLayerTest, NetworkChangeClosesChannels) {
+  MockEvent expected_events[] = {
+    ExpectConnectChannel("192.0.4.42:123/TCP", net::OK),
+    ExpectCloseChannel("192.0.4.42:123/TCP"),
+  };
+
+  Initialize(nullptr, 0, nullptr, 0,
+             expected_events, arraysize(expected_events));
+
+  FakeChannelListener listener;
+  EXPECT_EQ(net::OK, network_layer_->AddChannelListener(&listener));
+
+  EndPoint peer(net::HostPortPair("192.0.4.42", 123), Protocol::TCP);
+  scoped_refptr<Channel> channel(new MockChannel(
+      new TCPChannelAdapter(socket_factory_.get(), nullptr), true,
+      listener.channel_delegate(), peer));
+  listener.delegate()->OnChannelAccepted(channel);
+  EXPECT_TRUE(network_layer_->RequestChannel(peer));
+
+  net::NetworkChangeNotifier::IPAddressObserver *observer =
+      network_layer_.get();
+  observer->OnIPAddressChanged();
+
+  // Accepted channels are not reconnected.
+  EXPECT_FALSE(network_layer_->RequestChannel(peer));
+  EXPECT_TRUE(data_provider_->at_events_end());
+}
+
+TEST_F(NetworkLayerTest, DrainWaitsForChannelsInUse) {
+  MockEvent expected_events[] = {
+    ExpectConnectChannel("192.0.4.42:123/TCP", net::OK),
+  };
+
+  Initialize(nullptr, 0, nullptr, 0,
+             expected_events, arraysize(expected_events));
+
+  FakeChannelListener listener;
+  EXPECT_EQ(net::OK, network_layer_->AddChannelListener(&listener));
+
+  EndPoint peer(net::HostPortPair("192.0.4.42", 123), Protocol::TCP);
+  listener.delegate()->OnChannelAccepted(new MockChannel(
+      new TCPChannelAdapter(socket_factory_.get(), nullptr), true,
+      listener.channel_delegate(), peer));
+  EXPECT_TRUE(network_layer_->RequestChannel(peer));
+
+  bool drained = false;
+  network_layer_->StartDraining(std::vector<GURL>(),
+                                base::Bind(&SetTrue, &drained));
+  EXPECT_TRUE(network_layer_->is_draining());
+  base::MessageLoop::current()->RunUntilIdle();
+  EXPECT_FALSE(drained);
+
+  // Reported once the last channel in use is released.
+  network_layer_->ReleaseChannel(peer);
+  EXPECT_FALSE(drained);
+  base::MessageLoop::current()->RunUntilIdle();
+  EXPECT_TRUE(drained);
+  EXPECT_TRUE(data_provider_->at_events_end());
+}
+
+TEST_F(NetworkLayerTest, IntrospectChannelsAndTransactions) {
+  std::string server_tid;
+  MockEvent expected_events[] = {
+    ExpectConnectChannel("192.0.4.42:123/TCP", net::OK),
+    ExpectStartTransaction("^OPTIONS sip:192.0.2.33.*", &server_tid),
+    ExpectIncomingMessage("^OPTIONS sip:192.0.2.33.*"),
+    ExpectTransactionClose(&server_tid),
+  };
+
+  Initialize(nullptr, 0, nullptr, 0,
+             expected_events, arraysize(expected_events));
+
+  FakeChannelListener listener;
+  EXPECT_EQ(net::OK, network_layer_->AddChannelListener(&listener));
+
+  EndPoint peer(net::HostPortPair("192.0.4.42", 123), Protocol::TCP);
+  scoped_refptr<Channel> channel(new MockChannel(
+      new TCPChannelAdapter(socket_factory_.get(), nullptr), true,
+      listener.channel_delegate(), peer));
+  listener.delegate()->OnChannelAccepted(channel);
+  listener.channel_delegate()->OnIncomingMessage(channel,
+      Message::Parse(kOptionsRequest));
+
+  NetworkLayer::Introspection introspection;
+  network_layer_->Introspect(&introspection);
+  ASSERT_EQ(1u, introspection.channels.size());
+  EXPECT_EQ(peer, introspection.channels[0].destination);
+  EXPECT_TRUE(introspection.channels[0].accepted);
+  EXPECT_EQ(1u, introspection.channels[0].transactions);
+  EXPECT_EQ(0u, introspection.client_transactions);
+  EXPECT_EQ(1u, introspection.server_transactions);
+  EXPECT_FALSE(introspection.draining);
+
+  transaction_factory_->server_transaction(0)->Terminate();
+  network_layer_->Introspect(&introspection);
+  ASSERT_EQ(1u, introspection.channels.size());
+  EXPECT_EQ(0u, introspection.channels[0].transactions);
+  EXPECT_EQ(0u, introspection.server_transactions);
+  EXPECT_TRUE(data_provider_->at_events_end());
+}
+
+TEST_F(NetworkLayerTest, CancelsAndAcksMatchInviteByBranch) {
+  std::string invite_tid;
+  std::string cancel_tid;
+  MockEvent expected_events[] = {
+    ExpectConnectChannel("192.0.4.42:123/TCP", net::OK),
+    ExpectStartTransaction("^INVITE sip:bob@192.0.2.33.*", &invite_tid),
+    ExpectIncomingMessage("^INVITE sip:bob@192.0.2.33.*"),
+    ExpectIncomingRequest("^ACK sip:bob@192.0.2.33.*", &invite_tid),
+    ExpectIncomingMessage("^ACK sip:bob@192.0.2.33.*"),
+    ExpectStartTransaction("^CANCEL sip:bob@192.0.2.33.*", &cancel_tid),
+    ExpectIncomingMessage("^CANCEL sip:bob@192.0.2.33.*"),
+    ExpectTransactionClose(&cancel_tid),
+    ExpectTransactionClose(&invite_tid),
+  };
+
+  Initialize(nullptr, 0, nullptr, 0,
+             expected_events, arraysize(expected_events));
+
+  FakeChannelListener listener;
+  EXPECT_EQ(net::OK, network_layer_->AddChannelListener(&listener));
+
+  EndPoint peer(net::HostPortPair("192.0.4.42", 123), Protocol::TCP);
+  scoped_refptr<Channel> channel(new MockChannel(
+      new TCPChannelAdapter(socket_factory_.get(), nullptr), true,
+      listener.channel_delegate(), peer));
+  listener.delegate()->OnChannelAccepted(channel);
+  listener.channel_delegate()->OnIncomingMessage(channel,
+      Message::Parse(kInviteRequest));
+
+  // The ACK of a non-2xx response is taken by the INVITE transaction,
+  // while the one of a 2xx goes to the delegate, without a transaction.
+  listener.channel_delegate()->OnIncomingMessage(channel,
+      Message::Parse(kAckRequest));
+  listener.channel_delegate()->OnIncomingMessage(channel,
+      Message::Parse(kAck2xxRequest));
+  NetworkLayer::Introspection introspection;
+  network_layer_->Introspect(&introspection);
+  EXPECT_EQ(1u, introspection.server_transactions);
+
+  // The CANCEL gets a transaction of its own, and goes to the delegate,
+  // as it matches the INVITE.
+  listener.channel_delegate()->OnIncomingMessage(channel,
+      Message::Parse(kCancelRequest));
+  network_layer_->Introspect(&introspection);
+  EXPECT_EQ(2u, introspection.server_transactions);
+
+  transaction_factory_->server_transaction(1)->Terminate();
+  transaction_factory_->server_transaction(0)->Terminate();
+  EXPECT_TRUE(data_provider_->at_events_end());
+}
+
+TEST_F(NetworkLayerTest, PrefetchResolvesUnlessChannelExists) {
+  MockEvent expected_events[] = {
+    ExpectConnectChannel("192.0.4.42:123/TCP", net::OK),
+  };
+
+  Initialize(nullptr, 0, nullptr, 0,
+             expected_events, arraysize(expected_events));
+
+  EndPoint peer(net::HostPortPair("192.0.4.42", 123), Protocol::TCP);
+  network_layer_->Prefetch(peer, false);
+  ASSERT_EQ(1u, channel_factory_->prefetched_hosts().size());
+  EXPECT_EQ(peer, channel_factory_->prefetched_hosts()[0]);
+
+  // Nothing to prefetch once there's a channel.
+  FakeChannelListener listener;
+  EXPECT_EQ(net::OK, network_layer_->AddChannelListener(&listener));
+  listener.delegate()->OnChannelAccepted(new MockChannel(
+      new TCPChannelAdapter(socket_factory_.get(), nullptr), true,
+      listener.channel_delegate(), peer));
+  network_layer_->Prefetch(peer, false);
+  network_layer_->Prefetch(peer, true);
+  EXPECT_EQ(1u, channel_factory_->prefetched_hosts().size());
+  EXPECT_TRUE(data_provider_->at_events_end());
+}
+
+TEST_F(NetworkLayerTest, BatchedTransactionEvents) {
+  Initialize();
+  RecordingBatchDelegate batch_delegate;
+  network_layer_->SetBatchDelegate(&batch_delegate);
+
+  scoped_refptr<Request> request(
+      dyn_cast<Request>(Message::Parse(kRegisterRequest)));
+  scoped_refptr<Response> response(
+      dyn_cast<Response>(Message::Parse(kRegisterResponse)));
+  TransactionDelegate *transaction_delegate = network_layer_.get();
+  transaction_delegate->OnIncomingResponse(response);
+  transaction_delegate->OnTimedOut(request);
+  transaction_delegate->OnTransportError(request, net::ERR_CONNECTION_RESET);
+  EXPECT_TRUE(batch_delegate.batches().empty());
+
+  base::MessageLoop::current()->RunUntilIdle();
+  ASSERT_EQ(1u, batch_delegate.batches().size());
+  const NetworkLayer::TransactionEvents &events = batch_delegate.batches()[0];
+  ASSERT_EQ(3u, events.size());
+  EXPECT_EQ(NetworkLayer::TransactionEvent::INCOMING_RESPONSE,
+            events[0].type);
+  EXPECT_EQ(response.get(), events[0].message.get());
+  EXPECT_EQ(NetworkLayer::TransactionEvent::TIMED_OUT, events[1].type);
+  EXPECT_EQ(NetworkLayer::TransactionEvent::TRANSPORT_ERROR, events[2].type);
+  EXPECT_EQ(request.get(), events[2].message.get());
+  EXPECT_EQ(net::ERR_CONNECTION_RESET, events[2].error);
+
+  // A new batch is started by the next event.
+  transaction_delegate->OnTimedOut(request);
+  base::MessageLoop::current()->RunUntilIdle();
+  ASSERT_EQ(2u, batch_delegate.batches().size());
+  EXPECT_EQ(1u, batch_delegate.batches()[1].size());
+  Finish();
+}
+
 }  // namespace sippet
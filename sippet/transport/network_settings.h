@@ -7,14 +7,30 @@
 
 #include "net/base/net_export.h"
 #include "base/memory/ref_counted.h"
+#include "sippet/message/parse_profile.h"
+#include "sippet/message/static_header_block.h"
 #include "sippet/transport/branch_factory.h"
+#include "sippet/transport/message_capture.h"
+#include "sippet/transport/message_limits.h"
+#include "sippet/transport/socket_options.h"
 #include "sippet/transport/transaction_factory.h"
+#include "sippet/transport/time_delta_factory.h"
+#include "sippet/transport/transport_log.h"
 #include "sippet/transport/ssl_cert_error_handler.h"
+#include "sippet/transport/thread_placement.h"
+#include "sippet/transport/write_queue_limits.h"
 
 #include <string>
 
+namespace base {
+class TickClock;
+}
+
 namespace sippet {
 
+class ParsePool;
+class SourceRateLimiter;
+
 class NetworkSettings {
  public:
   static std::string GetDefaultSoftwareName();
@@ -22,19 +38,53 @@ class NetworkSettings {
  private:
   struct Data {
     int reuse_lifetime_;
+    int max_idle_channels_;
+    int max_open_channels_;
+    int keepalive_interval_;
+    int keepalive_timeout_;
     bool enable_compact_headers_;
+    bool migrate_on_network_change_;
+    bool answer_options_;
+    int compression_threshold_;
+    bool enable_message_compression_;
     std::string software_name_;
     BranchFactory *branch_factory_;
     TransactionFactory *transaction_factory_;
+    TimeDeltaFactory *time_delta_factory_;
     SSLCertErrorHandler::Factory *ssl_cert_error_handler_factory_;
+    TransportLog *transport_log_;
+    MessageCapture *message_capture_;
+    WriteQueueLimits write_queue_limits_;
+    ParseProfile parse_profile_;
+    MessageLimits message_limits_;
+    SocketOptionsMap socket_options_;
+    ParsePool *parse_pool_;
+    SourceRateLimiter *rate_limiter_;
+    base::TickClock *tick_clock_;
+    scoped_refptr<StaticHeaderBlock> static_headers_;
+    ThreadPlacement thread_placement_;
     // Default values
     Data() :
       reuse_lifetime_(60),
+      max_idle_channels_(0),
+      max_open_channels_(0),
+      keepalive_interval_(0),
+      keepalive_timeout_(10),
       enable_compact_headers_(true),
+      migrate_on_network_change_(true),
+      answer_options_(false),
+      compression_threshold_(0),
+      enable_message_compression_(false),
       software_name_(GetDefaultSoftwareName()),
       branch_factory_(BranchFactory::GetDefaultBranchFactory()),
       transaction_factory_(TransactionFactory::GetDefaultTransactionFactory()),
-      ssl_cert_error_handler_factory_(nullptr) {}
+      time_delta_factory_(TimeDeltaFactory::GetDefaultFactory()),
+      ssl_cert_error_handler_factory_(nullptr),
+      transport_log_(nullptr),
+      message_capture_(nullptr),
+      parse_pool_(nullptr),
+      rate_limiter_(nullptr),
+      tick_clock_(nullptr) {}
   };
 
   Data data_;
@@ -56,7 +106,49 @@ class NetworkSettings {
     data_.reuse_lifetime_ = value;
   }
 
-  // Whether to use compact headers in generated messages
+  // Max number of idle channels kept open for reuse; when exceeded, the
+  // channel idle for the longest is closed. Zero means no limit.
+  int max_idle_channels() const {
+    return data_.max_idle_channels_;
+  }
+  void set_max_idle_channels(int value) {
+    data_.max_idle_channels_ = value;
+  }
+
+  // Max number of channels open at once, so that a burst of peers can't
+  // exhaust the file descriptors. When reached, the channel idle for the
+  // longest is closed to make room for a new one; if none is idle, new
+  // channels fail with |net::ERR_INSUFFICIENT_RESOURCES| and accepted ones
+  // are closed. Zero means no limit.
+  int max_open_channels() const {
+    return data_.max_open_channels_;
+  }
+  void set_max_open_channels(int value) {
+    data_.max_open_channels_ = value;
+  }
+
+  // Seconds between the keep-alive pings sent on outbound stream channels
+  // (RFC 5626), keeping NAT bindings open and detecting dead connections.
+  // Zero disables keep-alives.
+  int keepalive_interval() const {
+    return data_.keepalive_interval_;
+  }
+  void set_keepalive_interval(int value) {
+    data_.keepalive_interval_ = value;
+  }
+
+  // Seconds to wait for the pong answering a keep-alive ping before
+  // closing the channel.
+  int keepalive_timeout() const {
+    return data_.keepalive_timeout_;
+  }
+  void set_keepalive_timeout(int value) {
+    data_.keepalive_timeout_ = value;
+  }
+
+  // Whether to use compact headers in generated messages. Messages sent
+  // over UDP use them anyway, without optional whitespace if needed, when
+  // they would be fragmented otherwise.
   bool enable_compact_headers() const {
     return data_.enable_compact_headers_;
   }
@@ -64,6 +156,48 @@ class NetworkSettings {
     data_.enable_compact_headers_ = value;
   }
 
+  // Whether to close the channels when the IP addresses of the host change,
+  // reconnecting the requested ones.
+  bool migrate_on_network_change() const {
+    return data_.migrate_on_network_change_;
+  }
+  void set_migrate_on_network_change(bool value) {
+    data_.migrate_on_network_change_ = value;
+  }
+
+  // Whether OPTIONS outside of dialogs, such as keep-alive pings, are
+  // answered by the network layer itself with a canned 200 (OK) (see
+  // |Request::CreateCannedResponse|), without reaching the delegate.
+  // Disabled by default.
+  bool answer_options() const {
+    return data_.answer_options_;
+  }
+  void set_answer_options(bool value) {
+    data_.answer_options_ = value;
+  }
+
+  // Contents of at least this many bytes are sent compressed with gzip to
+  // the peers accepting it: the responses to the requests listing it in
+  // their Accept-Encoding, and the requests sent through channels that
+  // received such a message. Requests then advertise it too. Zero, the
+  // default, disables compression; received contents are decoded anyway.
+  int compression_threshold() const {
+    return data_.compression_threshold_;
+  }
+  void set_compression_threshold(int value) {
+    data_.compression_threshold_ = value;
+  }
+
+  // Whether to compress whole messages on the channels supporting it, for
+  // constrained links (see |MessageCompressor|). Their Vias then advertise
+  // it, and the peers compressing back get compressed messages.
+  bool enable_message_compression() const {
+    return data_.enable_message_compression_;
+  }
+  void set_enable_message_compression(bool value) {
+    data_.enable_message_compression_ = value;
+  }
+
   // Set the software name (the value added to User-Agent headers)
   std::string software_name() const {
     return data_.software_name_;
@@ -90,6 +224,26 @@ class NetworkSettings {
     data_.transaction_factory_ = transaction_factory;
   }
 
+  // The transaction timers to use, e.g. an |AdaptiveTimeDeltaFactory|. It
+  // must outlive the network layer.
+  TimeDeltaFactory *time_delta_factory() const {
+    return data_.time_delta_factory_;
+  }
+  void set_time_delta_factory(TimeDeltaFactory *time_delta_factory) {
+    DCHECK(time_delta_factory);
+    data_.time_delta_factory_ = time_delta_factory;
+  }
+
+  // The clock of the transaction and channel timers, e.g. the virtual
+  // clock of a simulation; NULL, the default, is the system clock. It must
+  // outlive the network layer.
+  base::TickClock *tick_clock() const {
+    return data_.tick_clock_;
+  }
+  void set_tick_clock(base::TickClock *tick_clock) {
+    data_.tick_clock_ = tick_clock;
+  }
+
   // The SSL certificate error handler factory to use
   SSLCertErrorHandler::Factory *ssl_cert_error_handler_factory() const {
     return data_.ssl_cert_error_handler_factory_;
@@ -99,6 +253,110 @@ class NetworkSettings {
     DCHECK(ssl_cert_error_handler_factory);
     data_.ssl_cert_error_handler_factory_ = ssl_cert_error_handler_factory;
   }
+
+  // Where channels and the sampled transactions are traced, if anywhere. It
+  // must outlive the network layer.
+  TransportLog *transport_log() const {
+    return data_.transport_log_;
+  }
+  void set_transport_log(TransportLog *transport_log) {
+    data_.transport_log_ = transport_log;
+  }
+
+  // Where the messages sent and received are captured, if anywhere. It
+  // must outlive the network layer, and can't be shared with other network
+  // layers.
+  MessageCapture *message_capture() const {
+    return data_.message_capture_;
+  }
+  void set_message_capture(MessageCapture *message_capture) {
+    data_.message_capture_ = message_capture;
+  }
+
+  // Watermarks of the messages queued by each channel. By default, there
+  // are none, and queues grow without bounds.
+  const WriteQueueLimits &write_queue_limits() const {
+    return data_.write_queue_limits_;
+  }
+  void set_write_queue_limits(const WriteQueueLimits &write_queue_limits) {
+    data_.write_queue_limits_ = write_queue_limits;
+  }
+
+  // Headers decoded as soon as incoming messages are parsed; the others are
+  // decoded when first looked up. By default, none is, which suits user
+  // agents; proxies and registrars may select the headers they work on
+  // (e.g. |ParseProfile::LoadBalancer|).
+  const ParseProfile &parse_profile() const {
+    return data_.parse_profile_;
+  }
+  void set_parse_profile(const ParseProfile &parse_profile) {
+    data_.parse_profile_ = parse_profile;
+  }
+
+  // Bounds of the incoming messages, enforced while they are framed; those
+  // over them are dropped, and stream channels closed. By default, there
+  // are none besides the size of the read buffers.
+  const MessageLimits &message_limits() const {
+    return data_.message_limits_;
+  }
+  void set_message_limits(const MessageLimits &message_limits) {
+    data_.message_limits_ = message_limits;
+  }
+
+  // Options of the sockets of each protocol, e.g. to mark the signalling
+  // with DSCP CS3 (see |SocketOptions|), set on the channels created and on
+  // the listeners added. By default, the system ones are left.
+  SocketOptions socket_options(const Protocol &protocol) const {
+    return GetSocketOptions(data_.socket_options_, protocol);
+  }
+  const SocketOptionsMap &socket_options_map() const {
+    return data_.socket_options_;
+  }
+  void set_socket_options(const Protocol &protocol,
+                          const SocketOptions &socket_options) {
+    data_.socket_options_[protocol] = socket_options;
+  }
+
+  // Where the datagrams read by the listeners are parsed, off the thread of
+  // the network layer (see |ParsePool|). It must outlive the network layer.
+  // By default, there's none, and messages are parsed as they are read.
+  ParsePool *parse_pool() const {
+    return data_.parse_pool_;
+  }
+  void set_parse_pool(ParsePool *parse_pool) {
+    data_.parse_pool_ = parse_pool;
+  }
+
+  // Drops the datagrams and connections of the sources flooding the
+  // listeners, before they're parsed (see |SourceRateLimiter|). It must
+  // outlive the network layer. By default, there's none.
+  SourceRateLimiter *rate_limiter() const {
+    return data_.rate_limiter_;
+  }
+  void set_rate_limiter(SourceRateLimiter *rate_limiter) {
+    data_.rate_limiter_ = rate_limiter;
+  }
+
+  // Constant headers (e.g. Allow, Supported, Accept) given to all the
+  // requests and responses sent by the network layer, after its User-Agent
+  // or Server header. They are serialized once, instead of being added to
+  // and printed for each message. By default, there's none.
+  const scoped_refptr<StaticHeaderBlock> &static_headers() const {
+    return data_.static_headers_;
+  }
+  void set_static_headers(const scoped_refptr<StaticHeaderBlock> &block) {
+    data_.static_headers_ = block;
+  }
+
+  // The CPUs and NUMA node of the thread of the network layer, applied to
+  // it when the network layer is created, on that thread (see
+  // |ThreadPlacement|). By default, it's left where the system puts it.
+  const ThreadPlacement &thread_placement() const {
+    return data_.thread_placement_;
+  }
+  void set_thread_placement(const ThreadPlacement &thread_placement) {
+    data_.thread_placement_ = thread_placement;
+  }
 };
 
 } // End of sippet namespace
@@ -0,0 +1,204 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/options_pinger.h"
+
+#include <algorithm>
+
+#include "base/bind.h"
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/time/tick_clock.h"
+#include "net/base/net_errors.h"
+#include "sippet/base/tags.h"
+#include "sippet/message/headers.h"
+#include "sippet/message/request.h"
+#include "sippet/message/response.h"
+#include "sippet/message/static_header_block.h"
+
+namespace sippet {
+
+OptionsPinger::Target::Target()
+  : sequence(0), status(STATUS_UNKNOWN) {
+}
+
+OptionsPinger::Target::~Target() {
+}
+
+OptionsPinger::OptionsPinger(NetworkLayer *network_layer,
+                             const GURL &local_uri,
+                             Delegate *delegate)
+  : network_layer_(network_layer),
+    delegate_(delegate),
+    next_router_(NULL),
+    interval_(base::TimeDelta::FromSeconds(kDefaultIntervalSeconds)),
+    timeout_(base::TimeDelta::FromMilliseconds(kDefaultTimeoutMs)),
+    call_id_prefix_(CreateCallId() + "-"),
+    ping_headers_(new StaticHeaderBlock),
+    cursor_(0),
+    credit_(0),
+    next_sequence_(1),
+    tick_clock_(NULL),
+    tick_timer_(network_layer->timer_wheel()) {
+  DCHECK(network_layer);
+  DCHECK(delegate);
+  From from(local_uri);
+  from.set_tag(CreateTag());
+  ping_headers_->Add(MaxForwards(70));
+  ping_headers_->Add(from);
+}
+
+OptionsPinger::~OptionsPinger() {
+}
+
+bool OptionsPinger::AddTarget(const GURL &target) {
+  if (slots_by_target_.count(target.spec()))
+    return false;
+  size_t slot = targets_.size();
+  if (free_slots_.empty()) {
+    targets_.push_back(Target());
+  } else {
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+  }
+  targets_[slot].target = target;
+  slots_by_target_[target.spec()] = slot;
+  if (!tick_timer_.IsRunning())
+    ScheduleTick();
+  return true;
+}
+
+bool OptionsPinger::RemoveTarget(const GURL &target) {
+  base::hash_map<std::string, size_t>::iterator i =
+      slots_by_target_.find(target.spec());
+  if (slots_by_target_.end() == i)
+    return false;
+  // Pending pings of the slot are told apart by their sequence.
+  targets_[i->second] = Target();
+  free_slots_.push_back(i->second);
+  slots_by_target_.erase(i);
+  if (slots_by_target_.empty())
+    tick_timer_.Stop();
+  return true;
+}
+
+OptionsPinger::Status OptionsPinger::GetStatus(const GURL &target) const {
+  base::hash_map<std::string, size_t>::const_iterator i =
+      slots_by_target_.find(target.spec());
+  if (slots_by_target_.end() == i)
+    return STATUS_UNKNOWN;
+  return targets_[i->second].status;
+}
+
+bool OptionsPinger::RouteResponse(const scoped_refptr<Response> &response) {
+  const Response *const_response = response.get();
+  const CallId *call_id = const_response->get<CallId>();
+  size_t slot;
+  if (!call_id || !ParseCallId(call_id->value(), &slot))
+    return next_router_ && next_router_->RouteResponse(response);
+  // Late answers, and answers to removed targets, are dropped.
+  const Cseq *cseq = const_response->get<Cseq>();
+  Target *target = &targets_[slot];
+  if (!cseq || 0 == target->sequence || cseq->sequence() != target->sequence
+      || response->response_code() < 200)
+    return true;
+  target->sequence = 0;
+  SetStatus(target, SIP_SERVICE_UNAVAILABLE == response->response_code()
+      ? STATUS_DOWN : STATUS_UP);
+  return true;
+}
+
+base::TimeTicks OptionsPinger::Now() const {
+  return tick_clock_ ? tick_clock_->NowTicks() : base::TimeTicks::Now();
+}
+
+void OptionsPinger::OnTick() {
+  base::TimeTicks now(Now());
+  while (!pending_pings_.empty() && pending_pings_.front().deadline <= now) {
+    const PendingPing &ping = pending_pings_.front();
+    Target *target = &targets_[ping.slot];
+    if (ping.sequence == target->sequence) {
+      target->sequence = 0;
+      SetStatus(target, STATUS_DOWN);
+    }
+    pending_pings_.pop_front();
+  }
+
+  // Each target is pinged once per interval, a few of them at each tick.
+  size_t count = slots_by_target_.size();
+  credit_ += static_cast<double>(count) * kTickMs
+      / std::max<int64>(interval_.InMilliseconds(), kTickMs);
+  credit_ = std::min(credit_, static_cast<double>(count));
+  // The delegate may remove targets as their status changes.
+  for (; credit_ >= 1 && !slots_by_target_.empty(); credit_ -= 1) {
+    while (targets_[cursor_ % targets_.size()].target.is_empty())
+      ++cursor_;
+    cursor_ %= targets_.size();
+    SendPing(cursor_++, now);
+  }
+  if (!slots_by_target_.empty())
+    ScheduleTick();
+}
+
+void OptionsPinger::ScheduleTick() {
+  tick_timer_.Start(base::TimeDelta::FromMilliseconds(kTickMs),
+      base::Bind(&OptionsPinger::OnTick, base::Unretained(this)));
+}
+
+void OptionsPinger::SendPing(size_t slot, const base::TimeTicks &now) {
+  uint32 sequence = next_sequence_++;
+  if (0 == next_sequence_)
+    next_sequence_ = 1;
+  targets_[slot].sequence = sequence;
+  PendingPing ping;
+  ping.slot = slot;
+  ping.sequence = sequence;
+  ping.deadline = now + timeout_;
+  pending_pings_.push_back(ping);
+  int rv = network_layer_->SendOutOfTransaction(CreatePing(slot, sequence),
+                                                net::CompletionCallback());
+  if (net::OK != rv && net::ERR_IO_PENDING != rv) {
+    DVLOG(1) << "Failed to ping " << targets_[slot].target.spec() << ": "
+             << net::ErrorToString(rv);
+    targets_[slot].sequence = 0;
+    SetStatus(&targets_[slot], STATUS_DOWN);
+  }
+}
+
+scoped_refptr<Request> OptionsPinger::CreatePing(size_t slot,
+                                                 uint32 sequence) const {
+  const GURL &target = targets_[slot].target;
+  scoped_refptr<Request> request(new Request(Method::OPTIONS, target));
+  scoped_ptr<To> to(new To(target));
+  request->push_back(to.Pass());
+  scoped_ptr<CallId> call_id(new CallId(call_id_prefix_
+      + base::SizeTToString(slot) + "-" + base::UintToString(sequence)));
+  request->push_back(call_id.Pass());
+  scoped_ptr<Cseq> cseq(new Cseq(sequence, Method::OPTIONS));
+  request->push_back(cseq.Pass());
+  request->set_static_headers(ping_headers_);
+  return request;
+}
+
+bool OptionsPinger::ParseCallId(const base::StringPiece &call_id,
+                                size_t *slot) const {
+  if (!call_id.starts_with(call_id_prefix_))
+    return false;
+  base::StringPiece rest(call_id.substr(call_id_prefix_.size()));
+  size_t separator = rest.find('-');
+  if (base::StringPiece::npos == separator
+      || !base::StringToSizeT(rest.substr(0, separator), slot)
+      || *slot >= targets_.size())
+    return false;
+  return true;
+}
+
+void OptionsPinger::SetStatus(Target *target, Status status) {
+  if (status == target->status)
+    return;
+  target->status = status;
+  delegate_->OnStatusChanged(target->target, status);
+}
+
+} // End of sippet namespace
@@ -0,0 +1,169 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_OPTIONS_PINGER_H_
+#define SIPPET_TRANSPORT_OPTIONS_PINGER_H_
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "base/containers/hash_tables.h"
+#include "base/gtest_prod_util.h"
+#include "base/memory/ref_counted.h"
+#include "base/strings/string_piece.h"
+#include "base/time/time.h"
+#include "sippet/transport/network_layer.h"
+#include "sippet/transport/timer_wheel.h"
+#include "url/gurl.h"
+
+namespace base {
+class TickClock;
+}
+
+namespace sippet {
+
+class StaticHeaderBlock;
+
+// Monitors the reachability of a large number of targets, such as gateways,
+// by sending them OPTIONS requests, at a fraction of the cost of a client
+// transaction per ping.
+//
+// Pings are spread evenly over the |interval|: every tick of the network
+// layer timer wheel sends the share of the targets due, so that thousands
+// of targets never make a burst. They are sent out of transactions (see
+// |NetworkLayer::SendOutOfTransaction|), with the constant headers built
+// once in a |StaticHeaderBlock|: only the Via branch, the Call-ID and the
+// CSeq of each ping are new. The Call-ID carries the slot of the target,
+// so that responses, given to the pinger as the |ResponseRouter| of the
+// network layer, find it without a lookup. Pings unanswered after the
+// |timeout| expire from a queue swept on the same tick, instead of running
+// a Timer F each.
+//
+// Any final response but a 503 (Service Unavailable) means a target is up;
+// a 503 or a timeout, that it's down.
+class OptionsPinger : public NetworkLayer::ResponseRouter {
+ public:
+  enum Status {
+    STATUS_UNKNOWN,
+    STATUS_UP,
+    STATUS_DOWN,
+  };
+
+  class Delegate {
+   public:
+    virtual ~Delegate() {}
+
+    // The status of |target| changed.
+    virtual void OnStatusChanged(const GURL &target, Status status) = 0;
+  };
+
+  // Default interval between the pings of each target, in seconds.
+  static const int kDefaultIntervalSeconds = 30;
+
+  // Default time a ping waits for its response, in milliseconds.
+  static const int kDefaultTimeoutMs = 5000;
+
+  // Interval between the ticks sending the pings due, in milliseconds.
+  static const int kTickMs = 100;
+
+  // Pings are sent by |network_layer| from |local_uri|, and the status
+  // changes notified to |delegate|. Neither is owned, and both must outlive
+  // the pinger. The pinger must be set as the |ResponseRouter| of the
+  // network layer.
+  OptionsPinger(NetworkLayer *network_layer,
+                const GURL &local_uri,
+                Delegate *delegate);
+  ~OptionsPinger() override;
+
+  void set_interval(const base::TimeDelta &interval) {
+    interval_ = interval;
+  }
+  void set_timeout(const base::TimeDelta &timeout) { timeout_ = timeout; }
+
+  // The responses that aren't pings are offered to |next_router|, if any.
+  void set_next_router(NetworkLayer::ResponseRouter *next_router) {
+    next_router_ = next_router;
+  }
+
+  // Adds a target, of unknown status until its first ping completes.
+  // Returns false if it's already there.
+  bool AddTarget(const GURL &target);
+
+  // Returns false if |target| is unknown.
+  bool RemoveTarget(const GURL &target);
+
+  Status GetStatus(const GURL &target) const;
+
+  size_t size() const { return slots_by_target_.size(); }
+
+  // NetworkLayer::ResponseRouter methods:
+  bool RouteResponse(const scoped_refptr<Response> &response) override;
+
+  void set_tick_clock_for_testing(base::TickClock *tick_clock) {
+    tick_clock_ = tick_clock;
+  }
+
+ private:
+  FRIEND_TEST_ALL_PREFIXES(OptionsPingerTest, Responses);
+  FRIEND_TEST_ALL_PREFIXES(OptionsPingerTest, SpreadsPings);
+
+  // A slot of |targets_|, free when |target| is empty.
+  struct Target {
+    Target();
+    ~Target();
+
+    GURL target;
+    // Sequence of the ping in flight, or zero.
+    uint32 sequence;
+    Status status;
+  };
+
+  struct PendingPing {
+    size_t slot;
+    uint32 sequence;
+    base::TimeTicks deadline;
+  };
+
+  base::TimeTicks Now() const;
+
+  // Sends the pings due, and expires the unanswered ones.
+  void OnTick();
+  void ScheduleTick();
+
+  void SendPing(size_t slot, const base::TimeTicks &now);
+  scoped_refptr<Request> CreatePing(size_t slot, uint32 sequence) const;
+
+  // Finds the slot in the Call-ID of a ping.
+  bool ParseCallId(const base::StringPiece &call_id, size_t *slot) const;
+
+  void SetStatus(Target *target, Status status);
+
+  NetworkLayer *network_layer_;
+  Delegate *delegate_;
+  NetworkLayer::ResponseRouter *next_router_;
+  base::TimeDelta interval_;
+  base::TimeDelta timeout_;
+  // Prefix of the Call-IDs of the pings, unique to this pinger.
+  std::string call_id_prefix_;
+  // Max-Forwards and From, shared by all pings.
+  scoped_refptr<StaticHeaderBlock> ping_headers_;
+  std::vector<Target> targets_;
+  std::vector<size_t> free_slots_;
+  base::hash_map<std::string, size_t> slots_by_target_;
+  // In the order sent, which is the order of their deadlines.
+  std::deque<PendingPing> pending_pings_;
+  // Next slot to ping, and the pings owed to the current tick.
+  size_t cursor_;
+  double credit_;
+  uint32 next_sequence_;
+  base::TickClock *tick_clock_;
+  TimerWheel::Timer tick_timer_;
+
+  DISALLOW_COPY_AND_ASSIGN(OptionsPinger);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_OPTIONS_PINGER_H_
@@ -0,0 +1,152 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/options_pinger.h"
+
+#include <utility>
+#include <vector>
+
+#include "base/strings/string_number_conversions.h"
+#include "base/test/simple_test_tick_clock.h"
+#include "sippet/message/message.h"
+#include "sippet/transport/chrome/transport_test_util.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+class RecordingDelegate : public OptionsPinger::Delegate {
+ public:
+  void OnStatusChanged(const GURL &target,
+                       OptionsPinger::Status status) override {
+    changes_.push_back(std::make_pair(target, status));
+  }
+
+  std::vector<std::pair<GURL, OptionsPinger::Status> > changes_;
+};
+
+class RecordingRouter : public NetworkLayer::ResponseRouter {
+ public:
+  RecordingRouter() : routed_(0) {}
+
+  bool RouteResponse(const scoped_refptr<Response> &response) override {
+    ++routed_;
+    return true;
+  }
+
+  int routed_;
+};
+
+// The response to |request| with |response_code|, as received.
+scoped_refptr<Response> CreateResponse(const Request &request,
+                                       int response_code) {
+  std::string response("SIP/2.0 ");
+  response += base::IntToString(response_code) + " Whatever\r\n";
+  response += "v: SIP/2.0/UDP 192.0.2.33;branch=z9hG4bKnashds7\r\n";
+  response += "i: " + request.get<CallId>()->value() + "\r\n";
+  response += "CSeq: "
+      + base::UintToString(request.get<Cseq>()->sequence()) + " OPTIONS\r\n";
+  response += "l: 0\r\n\r\n";
+  return dyn_cast<Response>(Message::Parse(response));
+}
+
+}  // namespace
+
+class OptionsPingerTest : public testing::Test {
+ public:
+  OptionsPingerTest()
+    : delegate_(&data_provider_),
+      network_layer_(&delegate_) {
+    clock_.Advance(base::TimeDelta::FromSeconds(1));
+  }
+
+  StaticDataProvider data_provider_;
+  StaticNetworkLayerDelegate delegate_;
+  NetworkLayer network_layer_;
+  base::SimpleTestTickClock clock_;
+};
+
+TEST_F(OptionsPingerTest, Responses) {
+  RecordingDelegate delegate;
+  RecordingRouter router;
+  OptionsPinger pinger(&network_layer_, GURL("sip:monitor@192.0.2.33"),
+                       &delegate);
+  pinger.set_next_router(&router);
+  GURL target("sip:192.0.2.40");
+  ASSERT_TRUE(pinger.AddTarget(target));
+  EXPECT_FALSE(pinger.AddTarget(target));
+  EXPECT_EQ(OptionsPinger::STATUS_UNKNOWN, pinger.GetStatus(target));
+
+  // Only the Call-ID and CSeq vary between pings.
+  pinger.targets_[0].sequence = 7;
+  scoped_refptr<Request> ping(pinger.CreatePing(0, 7));
+  EXPECT_EQ(Method::OPTIONS, ping->method());
+  EXPECT_EQ(7u, ping->get<Cseq>()->sequence());
+  scoped_refptr<Request> next_ping(pinger.CreatePing(0, 8));
+  EXPECT_NE(ping->get<CallId>()->value(), next_ping->get<CallId>()->value());
+  EXPECT_EQ(ping->static_headers().get(), next_ping->static_headers().get());
+
+  // Provisional and late responses are taken, but change nothing.
+  EXPECT_TRUE(pinger.RouteResponse(CreateResponse(*ping, 100)));
+  EXPECT_TRUE(pinger.RouteResponse(CreateResponse(*next_ping, 200)));
+  EXPECT_EQ(OptionsPinger::STATUS_UNKNOWN, pinger.GetStatus(target));
+
+  // Any final response but a 503 means the target is up.
+  EXPECT_TRUE(pinger.RouteResponse(CreateResponse(*ping, 405)));
+  EXPECT_EQ(OptionsPinger::STATUS_UP, pinger.GetStatus(target));
+  pinger.targets_[0].sequence = 8;
+  EXPECT_TRUE(pinger.RouteResponse(CreateResponse(*next_ping, 503)));
+  EXPECT_EQ(OptionsPinger::STATUS_DOWN, pinger.GetStatus(target));
+  ASSERT_EQ(2u, delegate.changes_.size());
+  EXPECT_EQ(target, delegate.changes_[1].first);
+
+  // Other responses go to the next router.
+  scoped_refptr<Request> other(new Request(Method::OPTIONS, target));
+  scoped_ptr<CallId> call_id(new CallId("a84b4c76e66710@pc33.atlanta.com"));
+  other->push_back(call_id.Pass());
+  scoped_ptr<Cseq> cseq(new Cseq(7, Method::OPTIONS));
+  other->push_back(cseq.Pass());
+  EXPECT_TRUE(pinger.RouteResponse(CreateResponse(*other, 200)));
+  EXPECT_EQ(1, router.routed_);
+}
+
+TEST_F(OptionsPingerTest, SpreadsPings) {
+  RecordingDelegate delegate;
+  OptionsPinger pinger(&network_layer_, GURL("sip:monitor@192.0.2.33"),
+                       &delegate);
+  pinger.set_tick_clock_for_testing(&clock_);
+  pinger.set_interval(
+      base::TimeDelta::FromMilliseconds(OptionsPinger::kTickMs * 5));
+  for (int i = 0; i < 10; ++i)
+    pinger.AddTarget(GURL("sip:192.0.2." + base::IntToString(40 + i)));
+
+  // There's no channel factory: pings fail as they are sent, two of the
+  // targets each tick.
+  for (int i = 1; i <= 5; ++i) {
+    pinger.OnTick();
+    EXPECT_EQ(static_cast<size_t>(2 * i), delegate.changes_.size());
+  }
+  pinger.OnTick();
+  EXPECT_EQ(10u, delegate.changes_.size());
+
+  // Unanswered pings expire on the tick following their deadline.
+  pinger.pending_pings_.clear();
+  pinger.targets_[3].sequence = 42;
+  OptionsPinger::PendingPing ping;
+  ping.slot = 3;
+  ping.sequence = 42;
+  ping.deadline = clock_.NowTicks() + base::TimeDelta::FromSeconds(1);
+  pinger.pending_pings_.push_back(ping);
+  pinger.targets_[3].status = OptionsPinger::STATUS_UP;
+  pinger.set_interval(base::TimeDelta::FromDays(1));
+  pinger.OnTick();
+  EXPECT_EQ(OptionsPinger::STATUS_UP, pinger.targets_[3].status);
+  clock_.Advance(base::TimeDelta::FromSeconds(1));
+  pinger.OnTick();
+  EXPECT_EQ(OptionsPinger::STATUS_DOWN, pinger.targets_[3].status);
+  EXPECT_EQ(0u, pinger.targets_[3].sequence);
+}
+
+}  // namespace sippet
@@ -0,0 +1,232 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/overload_controller.h"
+
+#include <algorithm>
+
+#include "base/bind.h"
+#include "base/logging.h"
+#include "base/rand_util.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/tick_clock.h"
+#include "sippet/message/message.h"
+#include "sippet/message/headers/via.h"
+
+namespace sippet {
+
+namespace {
+
+const int kDefaultRetryAfterSeconds = 5;
+const int64 kDefaultFeedbackValidityMilliseconds = 2000;
+
+// The oc-validity assumed when a server doesn't send one (RFC 7339
+// section 5.2).
+const int64 kImplicitValidityMilliseconds = 500;
+
+// How often the message loop lag is measured.
+const int64 kLagProbeIntervalMilliseconds = 100;
+
+// Clients are asked to reduce their traffic when the load passes this
+// point, so that the hard limit is hopefully never reached.
+const double kFeedbackOnset = 0.8;
+
+const char kOc[] = "oc";
+const char kOcAlgo[] = "oc-algo";
+const char kOcValidity[] = "oc-validity";
+const char kOcSeq[] = "oc-seq";
+const char kLossAlgorithm[] = "loss";
+
+// Only the requests starting something new are worth rejecting: the ones
+// inside dialogs, ACKs and CANCELs finish work already accepted.
+bool IsReducible(const Request &request) {
+  if (request.method() != Method::INVITE &&
+      request.method() != Method::REGISTER)
+    return false;
+  const To *to = request.get<To>();
+  return !to || !to->HasTag();
+}
+
+bool OffersLossAlgorithm(const ViaParam &via_param) {
+  ViaParam::const_param_iterator algo = via_param.param_find(kOcAlgo);
+  return algo == via_param.param_end() ||
+         algo->second.find(kLossAlgorithm) != std::string::npos;
+}
+
+}  // namespace
+
+OverloadController::OverloadController(size_t max_pending_transactions,
+                                       const base::TimeDelta &max_loop_lag)
+  : max_pending_transactions_(max_pending_transactions),
+    max_loop_lag_(max_loop_lag),
+    retry_after_(kDefaultRetryAfterSeconds),
+    feedback_validity_(base::TimeDelta::FromMilliseconds(
+        kDefaultFeedbackValidityMilliseconds)),
+    tick_clock_(nullptr),
+    rand_int_(base::Bind(&base::RandInt)) {
+  DCHECK_GT(max_pending_transactions, 0u);
+}
+
+OverloadController::~OverloadController() {
+}
+
+void OverloadController::StartLagProbe() {
+  last_probe_ = Now();
+  probe_timer_.Start(FROM_HERE,
+      base::TimeDelta::FromMilliseconds(kLagProbeIntervalMilliseconds),
+      this, &OverloadController::OnLagProbe);
+}
+
+void OverloadController::ReportLoopLag(const base::TimeDelta &lag) {
+  // Smoothed as RFC 6298 does with round trips, so that a single slow task
+  // doesn't trigger the rejections.
+  loop_lag_ = loop_lag_ - loop_lag_ / 8 + lag / 8;
+}
+
+double OverloadController::GetLoad(size_t pending_transactions) const {
+  double load = static_cast<double>(pending_transactions) /
+      max_pending_transactions_;
+  if (max_loop_lag_ > base::TimeDelta()) {
+    load = std::max(load, loop_lag_.InMillisecondsF() /
+        max_loop_lag_.InMillisecondsF());
+  }
+  return load;
+}
+
+int OverloadController::GetReduction(size_t pending_transactions) const {
+  double load = GetLoad(pending_transactions);
+  if (load <= kFeedbackOnset)
+    return 0;
+  double reduction = (load - kFeedbackOnset) / (1 - kFeedbackOnset) * 100;
+  return std::min(100, static_cast<int>(reduction + 0.5));
+}
+
+bool OverloadController::ShouldReject(const Request &request,
+                                      size_t pending_transactions) const {
+  return GetLoad(pending_transactions) >= 1 && IsReducible(request);
+}
+
+void OverloadController::AddFeedback(const scoped_refptr<Response> &response,
+                                     size_t pending_transactions) const {
+  const Via *via = static_cast<const Response*>(response.get())->get<Via>();
+  if (!via || via->empty())
+    return;
+  const ViaParam &via_param = via->front();
+  if (via_param.param_find(kOc) == via_param.param_end() ||
+      !OffersLossAlgorithm(via_param))
+    return;
+  int reduction = GetReduction(pending_transactions);
+  if (reduction == 0)
+    return;
+  ViaParam &topmost = response->get<Via>()->front();
+  topmost.param_set(kOc, base::IntToString(reduction));
+  topmost.param_set(kOcAlgo, base::StringPrintf("\"%s\"", kLossAlgorithm));
+  topmost.param_set(kOcValidity,
+      base::Int64ToString(feedback_validity_.InMilliseconds()));
+  topmost.param_set(kOcSeq,
+      base::StringPrintf("%.3f", base::Time::Now().ToDoubleT()));
+}
+
+void OverloadController::AdvertiseSupport(
+    const scoped_refptr<Request> &request) const {
+  Via *via = request->get<Via>();
+  if (!via || via->empty())
+    return;
+  via->front().param_set(kOc, std::string());
+  via->front().param_set(kOcAlgo,
+      base::StringPrintf("\"%s\"", kLossAlgorithm));
+}
+
+void OverloadController::HandleFeedback(const EndPoint &destination,
+                                        const Response &response) {
+  const Via *via = response.get<Via>();
+  if (!via || via->empty())
+    return;
+  const ViaParam &via_param = via->front();
+  ViaParam::const_param_iterator oc = via_param.param_find(kOc);
+  int reduction;
+  if (oc == via_param.param_end() ||
+      !base::StringToInt(oc->second, &reduction))
+    return;
+  int64 validity_ms = kImplicitValidityMilliseconds;
+  ViaParam::const_param_iterator validity =
+      via_param.param_find(kOcValidity);
+  if (validity != via_param.param_end() &&
+      !base::StringToInt64(validity->second, &validity_ms))
+    return;
+  double sequence = 0;
+  ViaParam::const_param_iterator seq = via_param.param_find(kOcSeq);
+  if (seq != via_param.param_end() &&
+      !base::StringToDouble(seq->second, &sequence))
+    return;
+
+  base::TimeTicks now(Now());
+  FeedbackMap::iterator i = feedback_.find(destination);
+  if (i != feedback_.end() && i->second.expires > now &&
+      sequence < i->second.sequence)
+    return;  // Reordered, older than the one in use
+  if (reduction <= 0 || validity_ms <= 0) {
+    // The server has recovered.
+    if (i != feedback_.end())
+      feedback_.erase(i);
+    return;
+  }
+  if (i == feedback_.end()) {
+    if (feedback_.size() >= kMaxDestinations)
+      Evict();
+    i = feedback_.insert(std::make_pair(destination, Feedback())).first;
+  }
+  i->second.reduction = std::min(reduction, 100);
+  i->second.sequence = sequence;
+  i->second.expires = now + base::TimeDelta::FromMilliseconds(validity_ms);
+  DVLOG(1) << destination.ToString() << " asked for a reduction of "
+           << i->second.reduction << "%";
+}
+
+int OverloadController::GetThrottling(const EndPoint &destination) const {
+  FeedbackMap::const_iterator i = feedback_.find(destination);
+  if (i == feedback_.end() || i->second.expires <= Now())
+    return 0;
+  return i->second.reduction;
+}
+
+bool OverloadController::ShouldThrottle(const EndPoint &destination,
+                                        const Request &request) {
+  if (feedback_.empty() || !IsReducible(request))
+    return false;
+  int reduction = GetThrottling(destination);
+  return reduction > 0 && rand_int_.Run(0, 99) < reduction;
+}
+
+base::TimeTicks OverloadController::Now() const {
+  return tick_clock_ ? tick_clock_->NowTicks() : base::TimeTicks::Now();
+}
+
+void OverloadController::OnLagProbe() {
+  base::TimeTicks now(Now());
+  base::TimeDelta lag = now - last_probe_ -
+      base::TimeDelta::FromMilliseconds(kLagProbeIntervalMilliseconds);
+  last_probe_ = now;
+  ReportLoopLag(std::max(lag, base::TimeDelta()));
+}
+
+void OverloadController::Evict() {
+  base::TimeTicks now(Now());
+  FeedbackMap::iterator first_expiring = feedback_.end();
+  for (FeedbackMap::iterator i = feedback_.begin(); i != feedback_.end();) {
+    if (i->second.expires <= now) {
+      feedback_.erase(i++);
+      continue;
+    }
+    if (first_expiring == feedback_.end() ||
+        i->second.expires < first_expiring->second.expires)
+      first_expiring = i;
+    ++i;
+  }
+  if (feedback_.size() >= kMaxDestinations)
+    feedback_.erase(first_expiring);
+}
+
+} // End of sippet namespace
@@ -0,0 +1,141 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_OVERLOAD_CONTROLLER_H_
+#define SIPPET_TRANSPORT_OVERLOAD_CONTROLLER_H_
+
+#include <map>
+
+#include "base/memory/ref_counted.h"
+#include "base/time/time.h"
+#include "base/timer/timer.h"
+#include "net/base/rand_callback.h"
+#include "sippet/transport/end_point.h"
+
+namespace base {
+class TickClock;
+}
+
+namespace sippet {
+
+class Request;
+class Response;
+
+// Protects the network layer, and the servers it talks to, from overload.
+//
+// As a server, the load is taken from the number of pending server
+// transactions and from how late the message loop runs its tasks. When any
+// of them reaches its limit, new INVITE and REGISTER requests are answered
+// with 503 (Service Unavailable) and a Retry-After before they reach the
+// delegate, so that the few cycles left go to the calls already accepted.
+// Before that point, clients supporting RFC 7339 are asked, through the
+// |oc| parameter of the response Via, to reduce their traffic.
+//
+// As a client, support for RFC 7339 is advertised in the request Via, and
+// the reductions asked by each destination are applied with the loss
+// algorithm: a percentage of the new requests sent there fail locally with
+// |net::ERR_TEMPORARILY_THROTTLED| until the feedback expires.
+//
+// It's meant to be used by a single network layer, from its thread.
+class OverloadController {
+ public:
+  // Maximum number of destinations whose feedback is kept.
+  static const size_t kMaxDestinations = 1024;
+
+  OverloadController(size_t max_pending_transactions,
+                     const base::TimeDelta &max_loop_lag);
+  ~OverloadController();
+
+  // Seconds clients are asked to wait in the Retry-After of the 503
+  // responses.
+  int retry_after() const { return retry_after_; }
+  void set_retry_after(int seconds) { retry_after_ = seconds; }
+
+  // For how long the reductions sent to clients are valid.
+  base::TimeDelta feedback_validity() const { return feedback_validity_; }
+  void set_feedback_validity(const base::TimeDelta &validity) {
+    feedback_validity_ = validity;
+  }
+
+  // Starts measuring the message loop lag with a repeating task. It must be
+  // called from a thread running a message loop.
+  void StartLagProbe();
+
+  // Feeds a measure of the message loop lag, done by the probe or by the
+  // embedder.
+  void ReportLoopLag(const base::TimeDelta &lag);
+
+  // The smoothed message loop lag.
+  base::TimeDelta loop_lag() const { return loop_lag_; }
+
+  // The load, where 1.0 is the limit, given the number of pending server
+  // transactions.
+  double GetLoad(size_t pending_transactions) const;
+
+  // Percentage of the traffic clients are asked to give up.
+  int GetReduction(size_t pending_transactions) const;
+
+  // Whether |request| must be answered with 503 instead of being processed.
+  bool ShouldReject(const Request &request,
+                    size_t pending_transactions) const;
+
+  // Asks the client of |response| to reduce its traffic, if it supports
+  // RFC 7339 and there's something to reduce.
+  void AddFeedback(const scoped_refptr<Response> &response,
+                   size_t pending_transactions) const;
+
+  // Advertises support for RFC 7339 in the topmost Via of |request|.
+  void AdvertiseSupport(const scoped_refptr<Request> &request) const;
+
+  // Takes the reduction asked by |destination| in |response|, if any.
+  void HandleFeedback(const EndPoint &destination,
+                      const Response &response);
+
+  // The reduction currently applied to the requests sent to |destination|.
+  int GetThrottling(const EndPoint &destination) const;
+
+  // Whether |request| must not be sent to |destination|, as the loss
+  // algorithm decided.
+  bool ShouldThrottle(const EndPoint &destination, const Request &request);
+
+  void set_tick_clock_for_testing(base::TickClock *tick_clock) {
+    tick_clock_ = tick_clock;
+  }
+  void set_rand_int_for_testing(const net::RandIntCallback &rand_int) {
+    rand_int_ = rand_int;
+  }
+
+ private:
+  struct Feedback {
+    int reduction;
+    double sequence;
+    base::TimeTicks expires;
+  };
+
+  typedef std::map<EndPoint, Feedback, EndPointLess> FeedbackMap;
+
+  base::TimeTicks Now() const;
+  void OnLagProbe();
+
+  // Makes room for a new destination, dropping the expired feedback, or
+  // the one expiring first if none is.
+  void Evict();
+
+  size_t max_pending_transactions_;
+  base::TimeDelta max_loop_lag_;
+  int retry_after_;
+  base::TimeDelta feedback_validity_;
+  base::TimeDelta loop_lag_;
+  base::TimeTicks last_probe_;
+  base::RepeatingTimer<OverloadController> probe_timer_;
+  FeedbackMap feedback_;
+  base::TickClock *tick_clock_;
+  net::RandIntCallback rand_int_;
+
+  DISALLOW_COPY_AND_ASSIGN(OverloadController);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_OVERLOAD_CONTROLLER_H_
@@ -0,0 +1,165 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/overload_controller.h"
+
+#include "base/bind.h"
+#include "base/test/simple_test_tick_clock.h"
+#include "sippet/message/message.h"
+#include "sippet/message/headers/via.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const size_t kMaxPending = 100;
+
+const char kInvite[] =
+  "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds;oc\r\n"
+  "Max-Forwards: 70\r\n"
+  "To: Bob <sip:bob@biloxi.com>\r\n"
+  "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+  "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+  "CSeq: 314159 INVITE\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n";
+
+const char kReInvite[] =
+  "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds\r\n"
+  "To: Bob <sip:bob@biloxi.com>;tag=a6c85cf\r\n"
+  "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+  "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+  "CSeq: 314160 INVITE\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n";
+
+const char kOptions[] =
+  "OPTIONS sip:bob@biloxi.com SIP/2.0\r\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds\r\n"
+  "To: Bob <sip:bob@biloxi.com>\r\n"
+  "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+  "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+  "CSeq: 1 OPTIONS\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n";
+
+const char kFeedbackResponse[] =
+  "SIP/2.0 100 Trying\r\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds"
+      ";oc=40;oc-algo=\"loss\";oc-validity=1000;oc-seq=1282321615.782\r\n"
+  "To: Bob <sip:bob@biloxi.com>\r\n"
+  "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+  "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+  "CSeq: 314159 INVITE\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n";
+
+scoped_refptr<Request> ParseRequest(const char *raw) {
+  return dyn_cast<Request>(Message::Parse(raw));
+}
+
+int FixedRandInt(int *value, int min, int max) {
+  return *value;
+}
+
+}  // namespace
+
+class OverloadControllerTest : public testing::Test {
+ public:
+  OverloadControllerTest()
+    : controller_(kMaxPending, base::TimeDelta::FromMilliseconds(200)),
+      server_("192.0.2.1", 5060, Protocol::UDP),
+      rand_value_(0) {
+    clock_.Advance(base::TimeDelta::FromSeconds(1));
+    controller_.set_tick_clock_for_testing(&clock_);
+    controller_.set_rand_int_for_testing(
+        base::Bind(&FixedRandInt, &rand_value_));
+  }
+
+  base::SimpleTestTickClock clock_;
+  OverloadController controller_;
+  EndPoint server_;
+  int rand_value_;
+};
+
+TEST_F(OverloadControllerTest, RejectsNewRequestsAtTheLimit) {
+  scoped_refptr<Request> invite(ParseRequest(kInvite));
+  scoped_refptr<Request> reinvite(ParseRequest(kReInvite));
+  scoped_refptr<Request> options(ParseRequest(kOptions));
+
+  EXPECT_FALSE(controller_.ShouldReject(*invite, kMaxPending - 1));
+  EXPECT_TRUE(controller_.ShouldReject(*invite, kMaxPending));
+  // Requests finishing work already accepted still go through.
+  EXPECT_FALSE(controller_.ShouldReject(*reinvite, kMaxPending));
+  EXPECT_FALSE(controller_.ShouldReject(*options, kMaxPending));
+}
+
+TEST_F(OverloadControllerTest, RejectsOnLoopLag) {
+  scoped_refptr<Request> invite(ParseRequest(kInvite));
+  for (int i = 0; i < 64; ++i)
+    controller_.ReportLoopLag(base::TimeDelta::FromMilliseconds(400));
+  EXPECT_LT(1.0, controller_.GetLoad(0));
+  EXPECT_TRUE(controller_.ShouldReject(*invite, 0));
+
+  for (int i = 0; i < 64; ++i)
+    controller_.ReportLoopLag(base::TimeDelta());
+  EXPECT_FALSE(controller_.ShouldReject(*invite, 0));
+}
+
+TEST_F(OverloadControllerTest, AsksClientsToReduce) {
+  EXPECT_EQ(0, controller_.GetReduction(80));
+  EXPECT_EQ(50, controller_.GetReduction(90));
+  EXPECT_EQ(100, controller_.GetReduction(150));
+
+  scoped_refptr<Request> invite(ParseRequest(kInvite));
+  scoped_refptr<Response> response(invite->CreateResponse(SIP_TRYING));
+  controller_.AddFeedback(response, 90);
+  const ViaParam &via_param = response->get<Via>()->front();
+  ASSERT_NE(via_param.param_end(), via_param.param_find("oc"));
+  EXPECT_EQ("50", via_param.param_find("oc")->second);
+  EXPECT_EQ("\"loss\"", via_param.param_find("oc-algo")->second);
+  EXPECT_EQ("2000", via_param.param_find("oc-validity")->second);
+  EXPECT_NE(via_param.param_end(), via_param.param_find("oc-seq"));
+
+  // Clients that don't support RFC 7339 get nothing.
+  scoped_refptr<Request> options(ParseRequest(kOptions));
+  response = options->CreateResponse(SIP_OK);
+  controller_.AddFeedback(response, 90);
+  const ViaParam &other_param = response->get<Via>()->front();
+  EXPECT_EQ(other_param.param_end(), other_param.param_find("oc"));
+}
+
+TEST_F(OverloadControllerTest, ThrottlesAsAskedByServers) {
+  scoped_refptr<Request> invite(ParseRequest(kInvite));
+  scoped_refptr<Response> response(
+      dyn_cast<Response>(Message::Parse(kFeedbackResponse)));
+  controller_.HandleFeedback(server_, *response);
+  EXPECT_EQ(40, controller_.GetThrottling(server_));
+
+  rand_value_ = 39;
+  EXPECT_TRUE(controller_.ShouldThrottle(server_, *invite));
+  rand_value_ = 40;
+  EXPECT_FALSE(controller_.ShouldThrottle(server_, *invite));
+  rand_value_ = 0;
+  EXPECT_FALSE(controller_.ShouldThrottle(server_,
+                                          *ParseRequest(kReInvite)));
+
+  // The feedback expires after its validity.
+  clock_.Advance(base::TimeDelta::FromMilliseconds(1001));
+  EXPECT_EQ(0, controller_.GetThrottling(server_));
+  EXPECT_FALSE(controller_.ShouldThrottle(server_, *invite));
+}
+
+TEST_F(OverloadControllerTest, AdvertisesSupport) {
+  scoped_refptr<Request> options(ParseRequest(kOptions));
+  controller_.AdvertiseSupport(options);
+  const ViaParam &via_param = options->get<Via>()->front();
+  EXPECT_NE(via_param.param_end(), via_param.param_find("oc"));
+  EXPECT_EQ("\"loss\"", via_param.param_find("oc-algo")->second);
+}
+
+} // End of sippet namespace
@@ -0,0 +1,126 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/parse_pool.h"
+
+#include "base/bind.h"
+#include "base/logging.h"
+#include "base/strings/stringprintf.h"
+#include "base/thread_task_runner_handle.h"
+#include "base/trace_event/trace_event.h"
+#include "sippet/message/message.h"
+
+namespace sippet {
+
+ParsePool::ParsePool(size_t thread_count)
+  : started_(false) {
+  DCHECK_GT(thread_count, 0u);
+  for (size_t i = 0; i < thread_count; ++i) {
+    workers_.push_back(new base::Thread(base::StringPrintf(
+        "SipParseWorker%d", static_cast<int>(i))));
+  }
+}
+
+ParsePool::~ParsePool() {
+  Stop();
+}
+
+bool ParsePool::Start() {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  if (started_)
+    return true;
+  started_ = true;
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    if (!workers_[i]->Start()) {
+      DVLOG(1) << "Couldn't start parse worker " << i;
+      Stop();
+      return false;
+    }
+  }
+  return true;
+}
+
+void ParsePool::Stop() {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  if (!started_)
+    return;
+  for (size_t i = 0; i < workers_.size(); ++i)
+    workers_[i]->Stop();
+  started_ = false;
+}
+
+void ParsePool::Parse(const scoped_refptr<base::RefCountedString> &data,
+                      size_t key,
+                      const ParseProfile &profile,
+                      const ParseCallback &callback) {
+  DCHECK(started_);
+  DCHECK(!callback.is_null());
+  base::Thread *worker = workers_[key % workers_.size()];
+  worker->task_runner()->PostTask(FROM_HERE,
+      base::Bind(&ParsePool::ParseOnWorker, data, profile,
+          base::ThreadTaskRunnerHandle::Get(), callback));
+}
+
+// static
+void ParsePool::ParseOnWorker(
+    const scoped_refptr<base::RefCountedString> &data,
+    const ParseProfile &profile,
+    const scoped_refptr<base::SingleThreadTaskRunner> &reply_runner,
+    const ParseCallback &callback) {
+  TRACE_EVENT1("sippet", "ParsePool::ParseOnWorker",
+               "size", data->data().size());
+  ParseProfile matching(profile);
+  matching.AddEager(Header::HDR_VIA);
+  matching.AddEager(Header::HDR_CSEQ);
+  matching.AddEager(Header::HDR_CALL_ID);
+  scoped_refptr<Message> message(ParseDatagram(data->data(), matching));
+  reply_runner->PostTask(FROM_HERE, base::Bind(callback, message));
+}
+
+// static
+size_t ParsePool::FindHeadSize(const base::StringPiece &datagram) {
+  // CRLF is the standard, but we're accepting just LF, as stream transports
+  // do.
+  for (size_t lf = datagram.find('\n'); base::StringPiece::npos != lf;
+       lf = datagram.find('\n', lf + 1)) {
+    if (lf + 1 < datagram.size() && '\n' == datagram[lf + 1])
+      return lf + 2;
+    if (lf + 2 < datagram.size() && '\r' == datagram[lf + 1]
+        && '\n' == datagram[lf + 2])
+      return lf + 3;
+  }
+  return base::StringPiece::npos;
+}
+
+// static
+scoped_refptr<Message> ParsePool::ParseDatagram(
+    const base::StringPiece &datagram,
+    const ParseProfile &profile) {
+  // The parser stops at the end of the head, and the content follows.
+  size_t head_size = FindHeadSize(datagram);
+  if (base::StringPiece::npos == head_size)
+    head_size = datagram.size();
+  scoped_refptr<Message> message(Message::Parse(
+      datagram.substr(0, head_size), Message::PARSE_LAZY, profile));
+  if (!message)
+    return message;
+  base::StringPiece content(datagram.substr(head_size));
+  // RFC 3261 section 18.3: the bytes past the Content-Length are dropped,
+  // and so is a message whose content is cut short. Without one, the
+  // content extends to the end of the datagram.
+  const ContentLength *content_length =
+      static_cast<const Message*>(message.get())->get<ContentLength>();
+  if (content_length) {
+    if (content_length->value() > content.size()) {
+      DVLOG(1) << "Datagram shorter than its Content-Length";
+      return NULL;
+    }
+    content = content.substr(0, content_length->value());
+  }
+  if (!content.empty())
+    message->set_content(content.as_string());
+  return message;
+}
+
+} // End of sippet namespace
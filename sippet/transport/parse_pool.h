@@ -0,0 +1,99 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_PARSE_POOL_H_
+#define SIPPET_TRANSPORT_PARSE_POOL_H_
+
+#include "base/callback.h"
+#include "base/memory/ref_counted.h"
+#include "base/memory/ref_counted_memory.h"
+#include "base/memory/scoped_vector.h"
+#include "base/single_thread_task_runner.h"
+#include "base/strings/string_piece.h"
+#include "base/threading/thread.h"
+#include "base/threading/thread_checker.h"
+#include "sippet/message/parse_profile.h"
+
+namespace sippet {
+
+class Message;
+
+// Parses incoming messages on a pool of worker threads, off the thread of
+// the network layer that handles them, so that parsing, the most CPU-heavy
+// and stateless step of the receive path, can use all cores. Listeners
+// reading raw datagrams hand them over with |Parse|, and get the messages
+// back on their own thread, ready to be matched to their transactions: the
+// headers used for matching (Via, CSeq and Call-ID) are already decoded.
+//
+// The pool may be shared by several network layers, on different threads,
+// through |NetworkSettings::set_parse_pool|; it must outlive them.
+//
+// Example usage:
+//   ParsePool parse_pool(3);
+//   parse_pool.Start();
+//   NetworkSettings settings;
+//   settings.set_parse_pool(&parse_pool);
+//   NetworkLayer network_layer(&delegate, settings);
+class ParsePool {
+ public:
+  typedef base::Callback<void(const scoped_refptr<Message>&)> ParseCallback;
+
+  // Construct a pool of |thread_count| workers; threads are only started by
+  // |Start|.
+  explicit ParsePool(size_t thread_count);
+
+  // Stops all workers, if still running.
+  ~ParsePool();
+
+  // Starts all worker threads. Returns false if some thread could not be
+  // started.
+  bool Start();
+
+  // Joins all workers. Messages already handed over are parsed first, but
+  // their callbacks are run only if their threads are still running.
+  void Stop();
+
+  size_t thread_count() const { return workers_.size(); }
+
+  // Parses |data| on a worker thread, with the headers of |profile| and the
+  // ones used for matching decoded right away, and the others lazily. The
+  // |callback| is then run with the message, or NULL if it can't be parsed,
+  // on the calling thread, which must have a message loop. Data sharing the
+  // same |key| (e.g. the hash of the peer address) is parsed by the same
+  // worker, so their callbacks run in order.
+  void Parse(const scoped_refptr<base::RefCountedString> &data,
+             size_t key,
+             const ParseProfile &profile,
+             const ParseCallback &callback);
+
+  // Parses a whole datagram on the calling thread: its head, with the
+  // headers of |profile| decoded right away, and the content following it,
+  // up to its Content-Length. Returns NULL if it can't be parsed, or its
+  // content is shorter than the Content-Length.
+  static scoped_refptr<Message> ParseDatagram(
+      const base::StringPiece &datagram,
+      const ParseProfile &profile);
+
+  // Returns the size of the head of |datagram|, up to and including the
+  // empty line ending it, either CRLF CRLF or LF LF. Returns
+  // |base::StringPiece::npos| if there's no empty line.
+  static size_t FindHeadSize(const base::StringPiece &datagram);
+
+ private:
+  static void ParseOnWorker(
+      const scoped_refptr<base::RefCountedString> &data,
+      const ParseProfile &profile,
+      const scoped_refptr<base::SingleThreadTaskRunner> &reply_runner,
+      const ParseCallback &callback);
+
+  ScopedVector<base::Thread> workers_;
+  bool started_;
+  base::ThreadChecker thread_checker_;
+
+  DISALLOW_COPY_AND_ASSIGN(ParsePool);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_PARSE_POOL_H_
@@ -0,0 +1,183 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/parse_pool.h"
+
+#include <string>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/run_loop.h"
+#include "base/strings/stringprintf.h"
+#include "sippet/message/message.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const char kOptionsRequest[] =
+  "OPTIONS sip:carol@chicago.com SIP/2.0\r\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds\r\n"
+  "Max-Forwards: 70\r\n"
+  "Call-ID: a84b4c76e66710\r\n"
+  "CSeq: %d OPTIONS\r\n"
+  "Expires: 30\r\n"
+  "\r\n";
+
+const char kInvalidHeadersRequest[] =
+  "OPTIONS sip:carol@chicago.com SIP/2.0\r\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds\r\n"
+  "Max-Forwards: invalid\r\n"
+  "Call-ID: a84b4c76e66710\r\n"
+  "CSeq: 1 OPTIONS\r\n"
+  "Expires: invalid\r\n"
+  "\r\n";
+
+class ParsedMessages {
+ public:
+  explicit ParsedMessages(size_t expected) : expected_(expected) {}
+
+  void OnParsed(const scoped_refptr<Message> &message) {
+    messages_.push_back(message);
+    if (messages_.size() == expected_ && !quit_closure_.is_null())
+      quit_closure_.Run();
+  }
+
+  // Runs the message loop until all messages are back.
+  void Wait() {
+    if (messages_.size() == expected_)
+      return;
+    base::RunLoop run_loop;
+    quit_closure_ = run_loop.QuitClosure();
+    run_loop.Run();
+    quit_closure_.Reset();
+  }
+
+  size_t expected_;
+  std::vector<scoped_refptr<Message> > messages_;
+  base::Closure quit_closure_;
+};
+
+scoped_refptr<base::RefCountedString> MakeData(const std::string &text) {
+  scoped_refptr<base::RefCountedString> data(new base::RefCountedString);
+  data->data() = text;
+  return data;
+}
+
+}  // namespace
+
+TEST(ParsePoolTest, ParsesInOrderPerKey) {
+  ParsePool parse_pool(3);
+  EXPECT_EQ(3u, parse_pool.thread_count());
+  ASSERT_TRUE(parse_pool.Start());
+
+  const int kCount = 50;
+  ParsedMessages parsed(kCount + 1);
+  for (int i = 0; i < kCount; ++i) {
+    parse_pool.Parse(MakeData(base::StringPrintf(kOptionsRequest, i)), 7,
+                     ParseProfile(),
+                     base::Bind(&ParsedMessages::OnParsed,
+                                base::Unretained(&parsed)));
+  }
+  parse_pool.Parse(MakeData("not a message"), 7, ParseProfile(),
+                   base::Bind(&ParsedMessages::OnParsed,
+                              base::Unretained(&parsed)));
+  parsed.Wait();
+
+  ASSERT_EQ(static_cast<size_t>(kCount + 1), parsed.messages_.size());
+  for (int i = 0; i < kCount; ++i) {
+    const Message *message = parsed.messages_[i].get();
+    ASSERT_TRUE(message);
+    EXPECT_TRUE(isa<Request>(message));
+    EXPECT_EQ(Message::Incoming, message->direction());
+    EXPECT_EQ(static_cast<unsigned>(i), message->get<Cseq>()->sequence());
+  }
+  EXPECT_FALSE(parsed.messages_[kCount].get());
+  parse_pool.Stop();
+}
+
+TEST(ParsePoolTest, DecodesMatchingHeaders) {
+  ParsePool parse_pool(2);
+  ASSERT_TRUE(parse_pool.Start());
+
+  ParseProfile profile;
+  profile.AddEager(Header::HDR_EXPIRES);
+  ParsedMessages parsed(1);
+  parse_pool.Parse(MakeData(kInvalidHeadersRequest), 0, profile,
+                   base::Bind(&ParsedMessages::OnParsed,
+                              base::Unretained(&parsed)));
+  parsed.Wait();
+
+  ASSERT_EQ(1u, parsed.messages_.size());
+  scoped_refptr<Message> message(parsed.messages_[0]);
+  ASSERT_TRUE(message);
+  // The invalid Expires of the profile was dropped while parsing, while the
+  // invalid Max-Forwards is kept raw until looked up.
+  EXPECT_EQ(4u, message->size());
+  const Message *const_message = message.get();
+  const Via *via = const_message->get<Via>();
+  ASSERT_TRUE(via);
+  EXPECT_FALSE(via->is_lazy());
+  EXPECT_FALSE(const_message->get<Cseq>()->is_lazy());
+  EXPECT_FALSE(const_message->get<CallId>()->is_lazy());
+  EXPECT_FALSE(message->get<MaxForwards>());
+  EXPECT_EQ(3u, message->size());
+  parse_pool.Stop();
+}
+
+TEST(ParsePoolTest, KeepsContent) {
+  ParsePool parse_pool(1);
+  ASSERT_TRUE(parse_pool.Start());
+
+  ParsedMessages parsed(1);
+  parse_pool.Parse(
+      MakeData(base::StringPrintf(kOptionsRequest, 1) + "hello"), 0,
+      ParseProfile(),
+      base::Bind(&ParsedMessages::OnParsed, base::Unretained(&parsed)));
+  parsed.Wait();
+
+  ASSERT_EQ(1u, parsed.messages_.size());
+  ASSERT_TRUE(parsed.messages_[0]);
+  EXPECT_EQ("hello", parsed.messages_[0]->content());
+  EXPECT_FALSE(ParsePool::ParseDatagram(kOptionsRequest,
+                                        ParseProfile())->has_content());
+  parse_pool.Stop();
+}
+
+TEST(ParsePoolTest, DatagramContentLength) {
+  std::string head(base::StringPrintf(kOptionsRequest, 1));
+  head.insert(head.size() - 2, "Content-Length: 5\r\n");
+
+  // Bytes past the Content-Length are dropped.
+  scoped_refptr<Message> message(
+      ParsePool::ParseDatagram(head + "hello\r\n", ParseProfile()));
+  ASSERT_TRUE(message);
+  EXPECT_EQ("hello", message->content());
+
+  // A content cut short drops the whole message.
+  EXPECT_FALSE(ParsePool::ParseDatagram(head + "hell", ParseProfile()));
+}
+
+TEST(ParsePoolTest, DatagramWithBareLineFeeds) {
+  const char kDatagram[] =
+    "OPTIONS sip:carol@chicago.com SIP/2.0\n"
+    "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds\n"
+    "Max-Forwards: 70\n"
+    "Call-ID: a84b4c76e66710\n"
+    "CSeq: 1 OPTIONS\n"
+    "Expires: 30\n"
+    "\n"
+    "hello";
+
+  scoped_refptr<Message> message(
+      ParsePool::ParseDatagram(kDatagram, ParseProfile()));
+  ASSERT_TRUE(message);
+  EXPECT_EQ("hello", message->content());
+  EXPECT_EQ(5u, message->size());
+  EXPECT_EQ(arraysize(kDatagram) - 1 - 5,
+            ParsePool::FindHeadSize(kDatagram));
+}
+
+}  // namespace sippet
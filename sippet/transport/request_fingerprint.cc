@@ -0,0 +1,145 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/request_fingerprint.h"
+
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_util.h"
+#include "sippet/base/tags.h"
+
+namespace sippet {
+
+namespace {
+
+bool LowerCaseEquals(const base::StringPiece &piece, const char *lowercase) {
+  return base::LowerCaseEqualsASCII(piece.begin(), piece.end(), lowercase);
+}
+
+bool IsLWS(char c) {
+  return c == ' ' || c == '\t';
+}
+
+base::StringPiece TrimLWS(base::StringPiece piece) {
+  while (!piece.empty() && IsLWS(piece[0]))
+    piece.remove_prefix(1);
+  while (!piece.empty() && IsLWS(piece[piece.size() - 1]))
+    piece.remove_suffix(1);
+  return piece;
+}
+
+// Splits |*input| at the first |c|, returning the part before it and leaving
+// the rest after it in |*input|; the whole input is returned if there's none.
+base::StringPiece SplitAt(base::StringPiece *input, char c) {
+  size_t pos = input->find(c);
+  base::StringPiece head(input->substr(0, pos));
+  if (pos == base::StringPiece::npos)
+    input->clear();
+  else
+    input->remove_prefix(pos + 1);
+  return head;
+}
+
+// Returns the next line of |*head|, without its terminator.
+base::StringPiece NextLine(base::StringPiece *head) {
+  base::StringPiece line(SplitAt(head, '\n'));
+  if (!line.empty() && line[line.size() - 1] == '\r')
+    line.remove_suffix(1);
+  return line;
+}
+
+int DefaultPort(const base::StringPiece &protocol) {
+  if (LowerCaseEquals(protocol, "udp") ||
+      LowerCaseEquals(protocol, "tcp"))
+    return 5060;
+  if (LowerCaseEquals(protocol, "tls"))
+    return 5061;
+  return 0;
+}
+
+bool ScanSentBy(base::StringPiece sent_by, const base::StringPiece &protocol,
+                RequestFingerprint *fingerprint) {
+  base::StringPiece port;
+  if (!sent_by.empty() && sent_by[0] == '[') {
+    size_t end = sent_by.find(']');
+    if (end == base::StringPiece::npos)
+      return false;
+    fingerprint->host = sent_by.substr(1, end - 1);
+    sent_by.remove_prefix(end + 1);
+    if (!sent_by.empty()) {
+      if (sent_by[0] != ':')
+        return false;
+      port = sent_by.substr(1);
+    }
+  } else {
+    fingerprint->host = SplitAt(&sent_by, ':');
+    port = sent_by;
+  }
+  if (fingerprint->host.empty())
+    return false;
+  if (port.empty()) {
+    fingerprint->port = DefaultPort(protocol);
+    return true;
+  }
+  return base::StringToInt(port, &fingerprint->port) &&
+      fingerprint->port > 0 && fingerprint->port <= 65535;
+}
+
+// Scans the first via-parm of a Via header value.
+bool ScanVia(base::StringPiece value, RequestFingerprint *fingerprint) {
+  value = SplitAt(&value, ',');
+  // sent-protocol: SIP / 2.0 / transport
+  SplitAt(&value, '/');
+  SplitAt(&value, '/');
+  value = TrimLWS(value);
+  size_t protocol_end = value.find_first_of(" \t");
+  if (protocol_end == base::StringPiece::npos)
+    return false;
+  base::StringPiece protocol(value.substr(0, protocol_end));
+  value.remove_prefix(protocol_end);
+  if (!ScanSentBy(TrimLWS(SplitAt(&value, ';')), protocol, fingerprint))
+    return false;
+  while (!value.empty()) {
+    base::StringPiece param(SplitAt(&value, ';'));
+    base::StringPiece name(TrimLWS(SplitAt(&param, '=')));
+    if (LowerCaseEquals(name, "branch")) {
+      fingerprint->branch = TrimLWS(param);
+      return fingerprint->branch.starts_with(kMagicCookie);
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+bool ScanRequestFingerprint(const base::StringPiece &head,
+                            RequestFingerprint *fingerprint) {
+  base::StringPiece rest(head);
+  base::StringPiece request_line(NextLine(&rest));
+  if (request_line.starts_with("SIP/"))
+    return false;  // A response
+  size_t method_end = request_line.find(' ');
+  if (method_end == 0 || method_end == base::StringPiece::npos)
+    return false;
+  fingerprint->method = request_line.substr(0, method_end);
+  if (fingerprint->method == "ACK")
+    return false;
+
+  while (!rest.empty()) {
+    base::StringPiece line(NextLine(&rest));
+    if (line.empty())
+      break;  // End of the headers
+    base::StringPiece value(line);
+    base::StringPiece name(TrimLWS(SplitAt(&value, ':')));
+    if (!LowerCaseEquals(name, "via") &&
+        !LowerCaseEquals(name, "v"))
+      continue;
+    // Folded values are left to the parser.
+    if (!rest.empty() && IsLWS(rest[0]))
+      return false;
+    return ScanVia(value, fingerprint);
+  }
+  return false;
+}
+
+}  // namespace sippet
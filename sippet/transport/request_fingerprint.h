@@ -0,0 +1,36 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_REQUEST_FINGERPRINT_H_
+#define SIPPET_TRANSPORT_REQUEST_FINGERPRINT_H_
+
+#include "base/strings/string_piece.h"
+
+namespace sippet {
+
+// The pieces of a request identifying the server transaction it belongs to
+// (RFC 3261 section 17.2.3), scanned from the raw message head without
+// parsing it. The pieces point into the scanned head.
+struct RequestFingerprint {
+  RequestFingerprint() : port(0) {}
+
+  base::StringPiece method;
+  base::StringPiece branch;
+  // IPv6 addresses are given without brackets.
+  base::StringPiece host;
+  // The default port of the Via transport if the sent-by has none.
+  int port;
+};
+
+// Scans the head of a request for its fingerprint. Returns false if |head|
+// isn't a request, is an ACK (which changes the transaction state instead
+// of being absorbed), its top Via has no RFC 3261 branch, or the scan isn't
+// conclusive, e.g. the top Via is folded across lines. Messages that aren't
+// recognized here must be handled by the parser.
+bool ScanRequestFingerprint(const base::StringPiece &head,
+                            RequestFingerprint *fingerprint);
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_REQUEST_FINGERPRINT_H_
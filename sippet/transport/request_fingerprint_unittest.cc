@@ -0,0 +1,81 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/request_fingerprint.h"
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+using sippet::RequestFingerprint;
+using sippet::ScanRequestFingerprint;
+
+TEST(RequestFingerprint, Scan) {
+  struct {
+    const char *input;
+    bool valid;
+    const char *method;
+    const char *branch;
+    const char *host;
+    int port;
+  } cases[] = {
+    { "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+      "Max-Forwards: 70\r\n"
+      "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds\r\n"
+      "Via: SIP/2.0/UDP bigbox3.site3.atlanta.com;branch=z9hG4bK77ef4c2\r\n"
+      "\r\n",
+      true, "INVITE", "z9hG4bK776asdhds", "pc33.atlanta.com", 5060 },
+    { "OPTIONS sip:carol@chicago.com SIP/2.0\n"
+      "v : SIP / 2.0 / TLS [::1]:5071 ; received=::1 ; BRANCH = z9hG4bKa, "
+      "SIP/2.0/UDP 192.0.2.1;branch=z9hG4bKb\n"
+      "\n",
+      true, "OPTIONS", "z9hG4bKa", "::1", 5071 },
+    { "REGISTER sip:registrar.biloxi.com SIP/2.0\r\n"
+      "via: SIP/2.0/TLS 192.0.2.4;branch=z9hG4bKnashds7\r\n"
+      "\r\n",
+      true, "REGISTER", "z9hG4bKnashds7", "192.0.2.4", 5061 },
+    // Responses and ACKs aren't absorbed.
+    { "SIP/2.0 200 OK\r\n"
+      "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds\r\n"
+      "\r\n",
+      false },
+    { "ACK sip:bob@biloxi.com SIP/2.0\r\n"
+      "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds\r\n"
+      "\r\n",
+      false },
+    // RFC 2543 branches.
+    { "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+      "Via: SIP/2.0/UDP pc33.atlanta.com;branch=776asdhds\r\n"
+      "\r\n",
+      false },
+    { "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+      "Via: SIP/2.0/UDP pc33.atlanta.com\r\n"
+      "\r\n",
+      false },
+    // Folded Via headers are left to the parser.
+    { "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+      "Via: SIP/2.0/UDP pc33.atlanta.com\r\n"
+      " ;branch=z9hG4bK776asdhds\r\n"
+      "\r\n",
+      false },
+    { "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+      "Via: SIP/2.0/UDP pc33.atlanta.com:99999;branch=z9hG4bK776asdhds\r\n"
+      "\r\n",
+      false },
+    { "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+      "\r\n"
+      "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds\r\n",
+      false },
+  };
+
+  for (size_t i = 0; i < arraysize(cases); ++i) {
+    RequestFingerprint fingerprint;
+    bool valid = ScanRequestFingerprint(cases[i].input, &fingerprint);
+    EXPECT_EQ(cases[i].valid, valid) << "case " << i;
+    if (!valid || !cases[i].valid)
+      continue;
+    EXPECT_EQ(cases[i].method, fingerprint.method.as_string());
+    EXPECT_EQ(cases[i].branch, fingerprint.branch.as_string());
+    EXPECT_EQ(cases[i].host, fingerprint.host.as_string());
+    EXPECT_EQ(cases[i].port, fingerprint.port);
+  }
+}
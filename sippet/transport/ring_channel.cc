@@ -0,0 +1,236 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/ring_channel.h"
+
+#include "base/bind.h"
+#include "base/logging.h"
+#include "base/message_loop/message_loop.h"
+#include "net/base/net_errors.h"
+#include "sippet/message/message.h"
+#include "sippet/transport/network_layer_shards.h"
+#include "sippet/transport/transport_stats.h"
+
+namespace sippet {
+
+RingChannel::RingChannel(const EndPoint &destination,
+                         Channel::Delegate *delegate,
+                         RingChannelFactory *factory)
+  : destination_(destination),
+    delegate_(delegate),
+    factory_(factory),
+    is_connected_(false),
+    next_inbound_(0),
+    weak_ptr_factory_(this) {
+  DCHECK(delegate_);
+  DCHECK(factory_);
+  DCHECK(!factory_->channel_);
+  factory_->channel_ = this;
+}
+
+RingChannel::~RingChannel() {
+  ReleaseRings();
+}
+
+int RingChannel::origin(EndPoint *origin) const {
+  if (!factory_)
+    return net::ERR_SOCKET_NOT_CONNECTED;
+  *origin = factory_->local_end_point_;
+  return net::OK;
+}
+
+const EndPoint& RingChannel::destination() const {
+  return destination_;
+}
+
+bool RingChannel::is_secure() const {
+  // Rings never leave the host.
+  return true;
+}
+
+bool RingChannel::is_connected() const {
+  return is_connected_;
+}
+
+bool RingChannel::is_stream() const {
+  return false;
+}
+
+void RingChannel::Connect() {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  DCHECK(!is_connected_);
+  if (factory_)
+    StartPolling();
+  base::MessageLoop::current()->PostTask(FROM_HERE,
+      base::Bind(&RingChannel::RunUserConnectCallback,
+                 weak_ptr_factory_.GetWeakPtr()));
+}
+
+int RingChannel::ReconnectIgnoringLastError() {
+  return net::ERR_NOT_IMPLEMENTED;
+}
+
+int RingChannel::ReconnectWithCertificate(
+    net::X509Certificate* client_cert) {
+  return net::ERR_NOT_IMPLEMENTED;
+}
+
+int RingChannel::Send(const scoped_refptr<Message> &message,
+                      const net::CompletionCallback& callback) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  if (!is_connected_)
+    return net::ERR_SOCKET_NOT_CONNECTED;
+  ScopedVector<MessageRing> &outbound = factory_->outbound_;
+  size_t ring = outbound.size() > 1
+      ? NetworkLayerShards::ShardOf(*message, outbound.size()) : 0;
+  if (delegate_)
+    delegate_->OnOutgoingMessage(this, message);
+  if (!outbound[ring]->WriteMessage(*message)) {
+    // The other end isn't keeping up; like a full socket buffer, the
+    // message is dropped and left for retransmissions.
+    DVLOG(1) << "Message ring " << ring << " to " << destination_.ToString()
+             << " is full";
+    return net::ERR_INSUFFICIENT_RESOURCES;
+  }
+  return net::OK;
+}
+
+void RingChannel::Close() {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  poll_timer_.Stop();
+  is_connected_ = false;
+  ReleaseRings();
+}
+
+void RingChannel::CloseWithError(int err) {
+  // Sends complete synchronously, there's nothing pending.
+  Close();
+}
+
+void RingChannel::DetachDelegate() {
+  delegate_ = nullptr;
+  Close();
+}
+
+void RingChannel::StartAccepted() {
+  DCHECK(!is_connected_);
+  StartPolling();
+}
+
+void RingChannel::StartPolling() {
+  is_connected_ = true;
+  poll_timer_.Start(FROM_HERE, factory_->poll_interval_, this,
+                    &RingChannel::OnPoll);
+}
+
+void RingChannel::RunUserConnectCallback() {
+  if (delegate_) {
+    delegate_->OnChannelConnected(this,
+        is_connected_ ? net::OK : net::ERR_SOCKET_NOT_CONNECTED);
+  }
+}
+
+void RingChannel::OnPoll() {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  if (!is_connected_)
+    return;
+  // The delegate may close the channel, and release its last reference.
+  scoped_refptr<Channel> protect(this);
+  ScopedVector<MessageRing> &inbound = factory_->inbound_;
+  bool more = false;
+  // Rings are taken in turns, so that none is always served first.
+  for (size_t i = 0; i < inbound.size() && is_connected_; ++i) {
+    MessageRing *ring = inbound[(next_inbound_ + i) % inbound.size()];
+    for (size_t j = 0; is_connected_; ++j) {
+      if (kMaxMessagesPerPoll == j) {
+        more = true;
+        break;
+      }
+      bool empty;
+      scoped_refptr<Message> message(ring->ReadMessage(&empty));
+      if (empty)
+        break;
+      if (!message) {
+        TransportStats::Count(TransportStats::PARSE_FAILURES);
+        continue;
+      }
+      if (delegate_)
+        delegate_->OnIncomingMessage(this, message);
+    }
+  }
+  if (!is_connected_ || inbound.empty())
+    return;
+  next_inbound_ = (next_inbound_ + 1) % inbound.size();
+  // Busy rings are polled again as soon as other tasks had their turn.
+  if (more) {
+    base::MessageLoop::current()->PostTask(FROM_HERE,
+        base::Bind(&RingChannel::OnPoll, weak_ptr_factory_.GetWeakPtr()));
+  }
+}
+
+void RingChannel::ReleaseRings() {
+  if (!factory_)
+    return;
+  DCHECK_EQ(this, factory_->channel_);
+  factory_->channel_ = nullptr;
+  factory_ = nullptr;
+}
+
+RingChannelFactory::RingChannelFactory(const EndPoint &local_end_point,
+                                       const EndPoint &destination,
+                                       ScopedVector<MessageRing> outbound,
+                                       ScopedVector<MessageRing> inbound)
+  : local_end_point_(local_end_point),
+    destination_(destination),
+    outbound_(outbound.Pass()),
+    inbound_(inbound.Pass()),
+    poll_interval_(base::TimeDelta::FromMilliseconds(
+        RingChannel::kDefaultPollIntervalMs)),
+    channel_(nullptr),
+    listening_(false) {
+  DCHECK(!outbound_.empty());
+}
+
+RingChannelFactory::~RingChannelFactory() {
+  DCHECK(!channel_) << "channels must not outlive their factory";
+}
+
+int RingChannelFactory::CreateChannel(const EndPoint &destination,
+                                      Channel::Delegate *delegate,
+                                      scoped_refptr<Channel> *channel) {
+  if (!destination_.Equals(destination))
+    return net::ERR_ADDRESS_UNREACHABLE;
+  if (channel_)
+    return net::ERR_ADDRESS_IN_USE;
+  *channel = new RingChannel(destination, delegate, this);
+  return net::OK;
+}
+
+int RingChannelFactory::Listen(ChannelListener::Delegate *delegate,
+                               Channel::Delegate *channel_delegate) {
+  DCHECK(delegate);
+  DCHECK(channel_delegate);
+  if (listening_ || channel_)
+    return net::ERR_ADDRESS_IN_USE;
+  listening_ = true;
+  scoped_refptr<RingChannel> channel(
+      new RingChannel(destination_, channel_delegate, this));
+  channel->StartAccepted();
+  delegate->OnChannelAccepted(channel);
+  return net::OK;
+}
+
+int RingChannelFactory::GetLocalEndPoint(EndPoint *local_end_point) const {
+  if (!listening_)
+    return net::ERR_SOCKET_NOT_CONNECTED;
+  *local_end_point = local_end_point_;
+  return net::OK;
+}
+
+void RingChannelFactory::Close() {
+  // The accepted channel is kept, as with other listeners.
+  listening_ = false;
+}
+
+} // End of sippet namespace
@@ -0,0 +1,149 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_RING_CHANNEL_H_
+#define SIPPET_TRANSPORT_RING_CHANNEL_H_
+
+#include "base/memory/scoped_vector.h"
+#include "base/memory/weak_ptr.h"
+#include "base/threading/thread_checker.h"
+#include "base/time/time.h"
+#include "base/timer/timer.h"
+#include "sippet/transport/channel.h"
+#include "sippet/transport/channel_factory.h"
+#include "sippet/transport/channel_listener.h"
+#include "sippet/transport/message_ring.h"
+
+namespace sippet {
+
+class RingChannelFactory;
+
+// A |Channel| carrying messages through |MessageRing|s, between network
+// layers running in different processes of the same host: typically a
+// frontend owning the sockets, and the workers handling the calls. Messages
+// sent are written to one of the outbound rings, picked by the hash of
+// their Call-ID (see |NetworkLayerShards::ShardOf|), so that all messages
+// of a call reach the same worker. Messages are read from all the inbound
+// rings, which are polled on the message loop of the channel.
+//
+// Channels are created by a |RingChannelFactory|, which owns the rings.
+class RingChannel : public Channel {
+ public:
+  // Interval between polls of the inbound rings, while they're empty.
+  static const int kDefaultPollIntervalMs = 1;
+
+  // Messages taken from each inbound ring in a single poll, so that a busy
+  // ring doesn't starve the message loop.
+  static const size_t kMaxMessagesPerPoll = 64;
+
+  RingChannel(const EndPoint &destination,
+              Channel::Delegate *delegate,
+              RingChannelFactory *factory);
+
+  // sippet::Channel methods:
+  int origin(EndPoint *origin) const override;
+  const EndPoint& destination() const override;
+  bool is_secure() const override;
+  bool is_connected() const override;
+  bool is_stream() const override;
+  void Connect() override;
+  int ReconnectIgnoringLastError() override;
+  int ReconnectWithCertificate(net::X509Certificate* client_cert) override;
+  int Send(const scoped_refptr<Message> &message,
+           const net::CompletionCallback& callback) override;
+  void Close() override;
+  void CloseWithError(int err) override;
+  void DetachDelegate() override;
+
+  // Marks the channel connected and starts polling right away, instead of
+  // through |Connect|; used for channels accepted by the factory.
+  void StartAccepted();
+
+ private:
+  friend class base::RefCountedThreadSafe<Channel>;
+  ~RingChannel() override;
+
+  void StartPolling();
+  void RunUserConnectCallback();
+  void OnPoll();
+  // Gives the rings back to the factory.
+  void ReleaseRings();
+
+  EndPoint destination_;
+  Channel::Delegate *delegate_;
+  RingChannelFactory *factory_;
+  bool is_connected_;
+  size_t next_inbound_;
+  base::RepeatingTimer<RingChannel> poll_timer_;
+  base::ThreadChecker thread_checker_;
+  base::WeakPtrFactory<RingChannel> weak_ptr_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(RingChannel);
+};
+
+// Creates the |RingChannel| to a single |destination|, the process at the
+// other end of the rings, which is reached from |local_end_point| (e.g.
+// the addresses the frontend and the workers put in their Via headers).
+// The factory is also a listener, so that the process on the receiving end
+// (e.g. a worker) gets the channel accepted as soon as it's added to its
+// network layer:
+//
+//   // In the frontend, rings created with |MessageRing::Create|, and
+//   // shared with each worker beforehand.
+//   RingChannelFactory factory(frontend_end_point, workers_end_point,
+//       to_workers.Pass(), from_workers.Pass());
+//   network_layer->RegisterChannelFactory(Protocol::TCP, &factory);
+//
+//   // In each worker, rings opened with |MessageRing::Open|.
+//   RingChannelFactory factory(worker_end_point, frontend_end_point,
+//       to_frontend.Pass(), from_frontend.Pass());
+//   network_layer->AddChannelListener(&factory);
+//
+// Rings have a single producer and consumer, so only one channel uses them
+// at a time; another one may be created once it's closed. The factory must
+// outlive its channels.
+class RingChannelFactory : public ChannelFactory,
+                           public ChannelListener {
+ public:
+  RingChannelFactory(const EndPoint &local_end_point,
+                     const EndPoint &destination,
+                     ScopedVector<MessageRing> outbound,
+                     ScopedVector<MessageRing> inbound);
+  ~RingChannelFactory() override;
+
+  const EndPoint &destination() const { return destination_; }
+
+  // sippet::ChannelFactory methods:
+  int CreateChannel(const EndPoint &destination,
+                    Channel::Delegate *delegate,
+                    scoped_refptr<Channel> *channel) override;
+
+  // sippet::ChannelListener methods:
+  int Listen(ChannelListener::Delegate *delegate,
+             Channel::Delegate *channel_delegate) override;
+  int GetLocalEndPoint(EndPoint *local_end_point) const override;
+  void Close() override;
+
+  void set_poll_interval(const base::TimeDelta &poll_interval) {
+    poll_interval_ = poll_interval;
+  }
+
+ private:
+  friend class RingChannel;
+
+  EndPoint local_end_point_;
+  EndPoint destination_;
+  ScopedVector<MessageRing> outbound_;
+  ScopedVector<MessageRing> inbound_;
+  base::TimeDelta poll_interval_;
+  // The channel using the rings, if any.
+  RingChannel *channel_;
+  bool listening_;
+
+  DISALLOW_COPY_AND_ASSIGN(RingChannelFactory);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_RING_CHANNEL_H_
@@ -0,0 +1,209 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/ring_channel.h"
+
+#include <string>
+#include <vector>
+
+#include "base/process/process_handle.h"
+#include "base/run_loop.h"
+#include "net/base/net_errors.h"
+#include "sippet/message/message.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const char kOptionsRequest[] =
+  "OPTIONS sip:carol@chicago.com SIP/2.0\r\n"
+  "Via: SIP/2.0/TCP pc33.atlanta.com;branch=z9hG4bK776asdhds\r\n"
+  "Call-ID: a84b4c76e66710\r\n"
+  "CSeq: 63104 OPTIONS\r\n"
+  "\r\n";
+
+// Maps the region of |ring| a second time, as another process would.
+scoped_ptr<MessageRing> OpenAgain(MessageRing *ring) {
+  base::SharedMemoryHandle handle;
+  if (!ring->shared_memory()->ShareToProcess(base::GetCurrentProcessHandle(),
+                                             &handle))
+    return scoped_ptr<MessageRing>();
+  return MessageRing::Open(handle);
+}
+
+class RecordingChannelDelegate : public Channel::Delegate {
+ public:
+  RecordingChannelDelegate() : connected_(false) {}
+
+  void OnChannelConnected(const scoped_refptr<Channel> &channel,
+                          int error) override {
+    connected_ = net::OK == error;
+  }
+  void OnIncomingMessage(const scoped_refptr<Channel> &channel,
+                         const scoped_refptr<Message> &message) override {
+    messages_.push_back(message);
+    if (!quit_closure_.is_null())
+      quit_closure_.Run();
+  }
+  void OnChannelClosed(const scoped_refptr<Channel> &channel,
+                       int error) override {}
+  void OnSSLCertificateError(const scoped_refptr<Channel> &channel,
+                             const net::SSLInfo &ssl_info,
+                             bool fatal) override {}
+
+  // Runs the message loop until a message is received.
+  void WaitForMessage() {
+    base::RunLoop run_loop;
+    quit_closure_ = run_loop.QuitClosure();
+    run_loop.Run();
+    quit_closure_.Reset();
+  }
+
+  bool connected_;
+  std::vector<scoped_refptr<Message> > messages_;
+  base::Closure quit_closure_;
+};
+
+class RecordingListenerDelegate : public ChannelListener::Delegate {
+ public:
+  void OnChannelAccepted(const scoped_refptr<Channel> &channel) override {
+    channels_.push_back(channel);
+  }
+
+  std::vector<scoped_refptr<Channel> > channels_;
+};
+
+}  // namespace
+
+TEST(MessageRingTest, WriteAndRead) {
+  scoped_ptr<MessageRing> ring(MessageRing::Create(0));
+  ASSERT_TRUE(ring);
+  EXPECT_EQ(4096u, ring->capacity());
+  EXPECT_TRUE(ring->IsEmpty());
+
+  EXPECT_TRUE(ring->Write("first"));
+  EXPECT_TRUE(ring->Write(""));
+  EXPECT_FALSE(ring->IsEmpty());
+
+  std::string record;
+  EXPECT_TRUE(ring->Read(&record));
+  EXPECT_EQ("first", record);
+  EXPECT_TRUE(ring->Read(&record));
+  EXPECT_EQ("", record);
+  EXPECT_FALSE(ring->Read(&record));
+  EXPECT_TRUE(ring->IsEmpty());
+}
+
+TEST(MessageRingTest, FullAndWrapAround) {
+  scoped_ptr<MessageRing> ring(MessageRing::Create(4096));
+  ASSERT_TRUE(ring);
+  EXPECT_FALSE(ring->Write(std::string(ring->capacity(), 'x')));
+
+  // Fill the ring with records of different contents.
+  const size_t kRecordSize = 1000;
+  int written = 0;
+  while (ring->Write(std::string(kRecordSize, 'a' + written)))
+    ++written;
+  EXPECT_EQ(4, written);
+
+  // Room made by the consumer is reused, wrapping around the buffer.
+  std::string record;
+  for (int i = 0; i < 20; ++i) {
+    ASSERT_TRUE(ring->Read(&record));
+    EXPECT_EQ(std::string(kRecordSize, 'a' + i % 26), record);
+    ASSERT_TRUE(ring->Write(std::string(kRecordSize,
+                                        'a' + (written++) % 26)));
+  }
+}
+
+TEST(MessageRingTest, SharedMessages) {
+  scoped_ptr<MessageRing> producer(MessageRing::Create(16384));
+  ASSERT_TRUE(producer);
+  scoped_ptr<MessageRing> consumer(OpenAgain(producer.get()));
+  ASSERT_TRUE(consumer);
+  EXPECT_EQ(producer->capacity(), consumer->capacity());
+
+  scoped_refptr<Message> message(Message::Parse(kOptionsRequest));
+  ASSERT_TRUE(message);
+  message->set_content("hello");
+  EXPECT_TRUE(producer->WriteMessage(*message));
+
+  bool empty;
+  scoped_refptr<Message> received(consumer->ReadMessage(&empty));
+  EXPECT_FALSE(empty);
+  ASSERT_TRUE(isa<Request>(received));
+  EXPECT_EQ(message->ToString(), received->ToString());
+
+  EXPECT_FALSE(consumer->ReadMessage(&empty));
+  EXPECT_TRUE(empty);
+}
+
+TEST(RingChannelTest, FrontendToWorker) {
+  EndPoint frontend("10.0.0.1", 5060, Protocol::TCP);
+  EndPoint worker("10.0.0.2", 5060, Protocol::TCP);
+
+  ScopedVector<MessageRing> to_worker, from_worker;
+  to_worker.push_back(MessageRing::Create(16384).release());
+  from_worker.push_back(MessageRing::Create(16384).release());
+  ScopedVector<MessageRing> worker_inbound, worker_outbound;
+  worker_inbound.push_back(OpenAgain(to_worker[0]).release());
+  worker_outbound.push_back(OpenAgain(from_worker[0]).release());
+
+  RingChannelFactory frontend_factory(frontend, worker,
+      to_worker.Pass(), from_worker.Pass());
+  RingChannelFactory worker_factory(worker, frontend,
+      worker_outbound.Pass(), worker_inbound.Pass());
+
+  RecordingChannelDelegate frontend_delegate;
+  scoped_refptr<Channel> channel;
+  EXPECT_EQ(net::ERR_ADDRESS_UNREACHABLE,
+            frontend_factory.CreateChannel(frontend, &frontend_delegate,
+                                           &channel));
+  ASSERT_EQ(net::OK, frontend_factory.CreateChannel(worker,
+      &frontend_delegate, &channel));
+  // Rings have a single user.
+  scoped_refptr<Channel> other;
+  EXPECT_EQ(net::ERR_ADDRESS_IN_USE, frontend_factory.CreateChannel(worker,
+      &frontend_delegate, &other));
+  channel->Connect();
+
+  RecordingListenerDelegate listener_delegate;
+  RecordingChannelDelegate worker_delegate;
+  ASSERT_EQ(net::OK, worker_factory.Listen(&listener_delegate,
+                                           &worker_delegate));
+  ASSERT_EQ(1u, listener_delegate.channels_.size());
+  scoped_refptr<Channel> accepted(listener_delegate.channels_[0]);
+  EXPECT_TRUE(accepted->is_connected());
+  EndPoint origin;
+  ASSERT_EQ(net::OK, accepted->origin(&origin));
+  EXPECT_TRUE(worker.Equals(origin));
+
+  scoped_refptr<Message> request(Message::Parse(kOptionsRequest));
+  ASSERT_TRUE(request);
+  EXPECT_EQ(net::OK, channel->Send(request, net::CompletionCallback()));
+  worker_delegate.WaitForMessage();
+  EXPECT_TRUE(frontend_delegate.connected_);
+  ASSERT_EQ(1u, worker_delegate.messages_.size());
+  EXPECT_EQ(request->ToString(), worker_delegate.messages_[0]->ToString());
+
+  scoped_refptr<Response> response =
+      dyn_cast<Request>(worker_delegate.messages_[0])->CreateResponse(
+          200, "OK");
+  EXPECT_EQ(net::OK, accepted->Send(response, net::CompletionCallback()));
+  frontend_delegate.WaitForMessage();
+  ASSERT_EQ(1u, frontend_delegate.messages_.size());
+  EXPECT_TRUE(isa<Response>(frontend_delegate.messages_[0]));
+
+  // Once closed, the rings can be used by a new channel.
+  channel->Close();
+  EXPECT_EQ(net::ERR_SOCKET_NOT_CONNECTED,
+            channel->Send(request, net::CompletionCallback()));
+  EXPECT_EQ(net::OK, frontend_factory.CreateChannel(worker,
+      &frontend_delegate, &other));
+  other->Close();
+  accepted->Close();
+}
+
+}  // namespace sippet
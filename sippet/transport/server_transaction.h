@@ -9,6 +9,7 @@
 #include "base/memory/ref_counted.h"
 #include "sippet/message/response.h"
 #include "sippet/transport/channel.h"
+#include "sippet/transport/transport_log.h"
 
 namespace sippet {
 
@@ -23,6 +24,10 @@ class ServerTransaction :
 
   virtual scoped_refptr<Channel> channel() const = 0;
 
+  // Traces the transaction in |net_log|. It's called before |Start|, and
+  // only for the transactions sampled.
+  virtual void SetNetLog(const BoundTransportLog &net_log) {}
+
   virtual void Start(const scoped_refptr<Request> &incoming_request) = 0;
 
   virtual void Send(const scoped_refptr<Response> &response) = 0;
@@ -30,6 +35,19 @@ class ServerTransaction :
   virtual void HandleIncomingRequest(
                     const scoped_refptr<Request> &request) = 0;
 
+  // Handles a retransmission of the initial request matched before it was
+  // parsed, repeating the latest response if any. Returns false if the
+  // retransmission has to be parsed and given to |HandleIncomingRequest|.
+  virtual bool HandleRetransmission() { return false; }
+
+  // Handles a PRACK of the reliable provisional response being
+  // retransmitted (RFC 3262), which stops its retransmissions. Returns
+  // false if |prack| doesn't acknowledge it, and has to be answered with a
+  // 481.
+  virtual bool HandlePrack(const scoped_refptr<Request> &prack) {
+    return false;
+  }
+
   virtual void Close() = 0;
 
  protected:
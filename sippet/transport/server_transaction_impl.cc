@@ -6,25 +6,58 @@
 
 #include <string>
 
+#include "base/rand_util.h"
+#include "base/trace_event/trace_event.h"
 #include "net/base/net_errors.h"
+#include "sippet/transport/transaction_slab.h"
+#include "sippet/transport/transport_stats.h"
 
 namespace sippet {
 
+namespace {
+
+// Errors repeating responses are found by the next send, if any.
+void IgnoreRepeatResult(int result) {}
+
+}  // namespace
+
 ServerTransactionImpl::ServerTransactionImpl(
                           const std::string &id,
                           const scoped_refptr<Channel> &channel,
                           TransactionDelegate *delegate,
-                          TimeDeltaFactory *time_delta_factory)
+                          TimeDeltaFactory *time_delta_factory,
+                          TimerWheel *timer_wheel,
+                          const TransactionTimerPolicy &timer_policy)
   : weak_factory_(this),
     id_(id), channel_(channel), delegate_(delegate),
+    timer_policy_(timer_policy),
+    started_(false),
+    retransmitTimer_(timer_wheel), timedOutTimer_(timer_wheel),
+    provisionalTimer_(timer_wheel),
+    next_rseq_(0),
+    reliableRetransmitTimer_(timer_wheel),
+    reliableTimedOutTimer_(timer_wheel),
+    timer_wheel_(timer_wheel),
     time_delta_factory_(time_delta_factory) {
   DCHECK(id.length());
   DCHECK(channel);
   DCHECK(delegate);
   DCHECK(time_delta_factory);
+  DCHECK(timer_wheel);
+}
+
+ServerTransactionImpl::~ServerTransactionImpl() {
+  if (started_)
+    TransportStats::AddTransaction(TransportStats::SERVER, method_, -1);
+}
+
+void *ServerTransactionImpl::operator new(size_t size) {
+  return TransactionSlab<ServerTransactionImpl>::New(size);
 }
 
-ServerTransactionImpl::~ServerTransactionImpl() {}
+void ServerTransactionImpl::operator delete(void *p, size_t size) {
+  TransactionSlab<ServerTransactionImpl>::Delete(p, size);
+}
 
 const std::string& ServerTransactionImpl::id() const {
   return id_;
@@ -34,37 +67,72 @@ scoped_refptr<Channel> ServerTransactionImpl::channel() const {
   return channel_;
 }
 
+void ServerTransactionImpl::SetNetLog(const BoundTransportLog &net_log) {
+  net_log_ = net_log;
+}
+
 void ServerTransactionImpl::Start(
       const scoped_refptr<Request> &incoming_request) {
   DCHECK(incoming_request);
+  if (net_log_.IsCapturing()) {
+    net_log_.BeginEvent(TransportLog::TYPE_TRANSACTION_ALIVE,
+        TransportLog::StringPairCallback("id", id_,
+            "method", incoming_request->method().str()));
+  }
+  LogMessage(TransportLog::TYPE_SIP_MESSAGE_RECEIVED, incoming_request);
   initial_request_ = incoming_request;
+  method_ = incoming_request->method();
+  started_ = true;
+  start_time_ = timer_wheel_->NowTicks();
+  TransportStats::AddTransaction(TransportStats::SERVER,
+      incoming_request->method(), 1);
   if (Method::INVITE == incoming_request->method()) {
     mode_ = MODE_INVITE;
     next_state_ = STATE_PROCEED_CALLING;
-    time_delta_provider_.reset(time_delta_factory_->CreateServerInvite());
+    time_delta_provider_.reset(time_delta_factory_->CreateServerInvite(
+        channel_->destination()));
     ScheduleProvisionalResponse();
   } else {
     mode_ = MODE_NORMAL;
     next_state_ = STATE_TRYING;
-    time_delta_provider_.reset(time_delta_factory_->CreateServerNonInvite());
+    time_delta_provider_.reset(time_delta_factory_->CreateServerNonInvite(
+        channel_->destination()));
   }
 }
 
 void ServerTransactionImpl::Send(const scoped_refptr<Response> &response) {
   DCHECK(response);
-  DCHECK(response->refer_to() == initial_request_);
 
   if (STATE_PROCEED_CALLING < next_state_) {
     DVLOG(1) << "Ignored second final response attempt";
     return;
   }
+  DCHECK(response->refer_to() == initial_request_);
 
   if (STATE_PROCEED_CALLING == next_state_)
     StopProvisionalResponse();
 
+  if (MODE_INVITE == mode_ && response->IsReliableProvisional()) {
+    if (unacked_response_) {
+      // RFC 3262 section 3: sent once the previous one is acknowledged.
+      queued_responses_.push_back(response);
+      return;
+    }
+    StartReliableProvisional(response);
+  } else if (response->response_code() >= 200) {
+    // The final response doesn't wait for the pending PRACKs.
+    queued_responses_.clear();
+    StopReliableProvisional();
+  }
+
   LOG(INFO) << "Sent to " << channel_->destination().ToString();
 
+  if (response->response_code() >= 200) {
+    TransportStats::RecordLatency(TransportStats::SERVER,
+        timer_wheel_->NowTicks() - start_time_);
+  }
   latest_response_ = response;
+  LogMessage(TransportLog::TYPE_SIP_MESSAGE_SENT, response);
   int result = channel_->Send(response,
       base::Bind(&ServerTransactionImpl::OnSendWriteComplete,
           weak_factory_.GetWeakPtr(), response));
@@ -75,11 +143,17 @@ void ServerTransactionImpl::Send(const scoped_refptr<Response> &response) {
 void ServerTransactionImpl::OnSendWriteComplete(
           scoped_refptr<Response> response, int result) {
   if (net::OK != result) {
-    delegate_->OnTransportError(initial_request_, result);
+    // Provisional responses may still be written once the final one is.
+    if (initial_request_)
+      delegate_->OnTransportError(initial_request_, result);
     return;
   }
 
   State state = next_state_;
+  if (STATE_PROCEED_CALLING < state) {
+    // A provisional response written after the final one.
+    return;
+  }
   int response_code = response->response_code();
   switch (state) {
     case STATE_TRYING:
@@ -108,18 +182,21 @@ void ServerTransactionImpl::OnSendWriteComplete(
   if (STATE_COMPLETED == next_state_
       && next_state_ != state) {
     if (MODE_INVITE == mode_) {
-      if (!channel_->is_stream())
+      if (timer_policy_.retransmit)
         ScheduleRetry();
       ScheduleTimeout();
     } else {
-      if (channel_->is_stream()) {
+      if (!timer_policy_.linger) {
         next_state_ = STATE_TERMINATED;
       } else {
         ScheduleTerminate();
+        ReleaseRequest();
       }
     }
   }
 
+  if (next_state_ != state)
+    LogStateChange(state);
   if (STATE_TERMINATED == next_state_) {
     Terminate();
   }
@@ -127,14 +204,25 @@ void ServerTransactionImpl::OnSendWriteComplete(
 
 void ServerTransactionImpl::HandleIncomingRequest(
       const scoped_refptr<Request> &request) {
+  TRACE_EVENT0("sippet", "ServerTransactionImpl::HandleIncomingRequest");
+  TRACE_EVENT_FLOW_END0("sippet", "IncomingMessage", request.get());
   DCHECK(request);
   DCHECK(next_state_ != STATE_TERMINATED);
 
+  LogMessage(TransportLog::TYPE_SIP_MESSAGE_RECEIVED, request);
+  if (Method::ACK != request->method() || STATE_CONFIRMED == next_state_)
+    TransportStats::Count(TransportStats::RETRANSMISSIONS_ABSORBED);
+
   int result = net::OK;
-  if (STATE_PROCEEDING == next_state_
-      || STATE_PROCEED_CALLING == next_state_
-      || (STATE_COMPLETED == next_state_
-          && Method::ACK != request->method())) {
+  // An INVITE may be retransmitted before its 100 Trying is sent, and then
+  // there's nothing to repeat yet.
+  if (latest_response_
+      && (STATE_PROCEEDING == next_state_
+          || STATE_PROCEED_CALLING == next_state_
+          || (STATE_COMPLETED == next_state_
+              && Method::ACK != request->method()))) {
+    TransportStats::Count(TransportStats::RETRANSMISSIONS_SENT);
+    LogMessage(TransportLog::TYPE_SIP_MESSAGE_SENT, latest_response_);
     result = channel_->Send(latest_response_,
       base::Bind(&ServerTransactionImpl::OnRepeatResponseWriteComplete,
         this, request));
@@ -144,6 +232,47 @@ void ServerTransactionImpl::HandleIncomingRequest(
     OnRepeatResponseWriteComplete(request, result);
 }
 
+bool ServerTransactionImpl::HandleRetransmission() {
+  DCHECK(next_state_ != STATE_TERMINATED);
+  // Same as |HandleIncomingRequest| for anything but an ACK, which isn't
+  // absorbed: the response is just repeated, with no state change.
+  TransportStats::Count(TransportStats::RETRANSMISSIONS_ABSORBED);
+  net_log_.AddEvent(TransportLog::TYPE_SIP_RETRANSMISSION_ABSORBED);
+  if (latest_response_
+      && (STATE_PROCEEDING == next_state_
+          || STATE_PROCEED_CALLING == next_state_
+          || STATE_COMPLETED == next_state_)) {
+    TransportStats::Count(TransportStats::RETRANSMISSIONS_SENT);
+    LogMessage(TransportLog::TYPE_SIP_MESSAGE_SENT, latest_response_);
+    channel_->Send(latest_response_, base::Bind(&IgnoreRepeatResult));
+  }
+  return true;
+}
+
+bool ServerTransactionImpl::HandlePrack(const scoped_refptr<Request> &prack) {
+  DCHECK(prack);
+  if (!unacked_response_)
+    return false;
+  const Request *const_prack = prack.get();
+  const Request *const_request = initial_request_.get();
+  const Response *const_response = unacked_response_.get();
+  const RAck *rack = const_prack->get<RAck>();
+  const Cseq *cseq = const_request->get<Cseq>();
+  const RSeq *rseq = const_response->get<RSeq>();
+  if (!rack || !cseq || !rseq
+      || rack->response_num() != rseq->value()
+      || rack->sequence() != cseq->sequence()
+      || !rack->method().Equals(cseq->method()))
+    return false;
+  StopReliableProvisional();
+  if (!queued_responses_.empty()) {
+    scoped_refptr<Response> response(queued_responses_.front());
+    queued_responses_.pop_front();
+    Send(response);
+  }
+  return true;
+}
+
 void ServerTransactionImpl::OnRepeatResponseWriteComplete(
           scoped_refptr<Request> request, int result) {
   State state = next_state_;
@@ -167,13 +296,16 @@ void ServerTransactionImpl::OnRepeatResponseWriteComplete(
   if (STATE_CONFIRMED == next_state_
       && next_state_ != state) {
     StopTimers();
-    if (channel_->is_stream()) {
+    if (!timer_policy_.linger) {
       next_state_ = STATE_TERMINATED;
     } else {
       ScheduleTerminate();
+      ReleaseRequest();
     }
   }
 
+  if (next_state_ != state)
+    LogStateChange(state);
   if (STATE_TERMINATED == next_state_) {
     Terminate();
   }
@@ -184,10 +316,12 @@ void ServerTransactionImpl::Close() {
 }
 
 void ServerTransactionImpl::OnRetransmit() {
-  DCHECK(!channel_->is_stream());
+  DCHECK(timer_policy_.retransmit);
   DCHECK(MODE_INVITE == mode_);
   DCHECK(STATE_COMPLETED == next_state_);
 
+  TransportStats::Count(TransportStats::RETRANSMISSIONS_SENT);
+  LogMessage(TransportLog::TYPE_SIP_MESSAGE_SENT, latest_response_);
   int result = channel_->Send(latest_response_,
       base::Bind(&ServerTransactionImpl::OnRetransmitWriteComplete,
           weak_factory_.GetWeakPtr()));
@@ -201,12 +335,14 @@ void ServerTransactionImpl::OnTimedOut() {
   DCHECK(STATE_COMPLETED == next_state_);
 
   next_state_ = STATE_TERMINATED;
+  LogStateChange(STATE_COMPLETED);
+  TransportStats::Count(TransportStats::TIMEOUTS_H);
   delegate_->OnTimedOut(initial_request_);
   Terminate();
 }
 
 void ServerTransactionImpl::OnTerminated() {
-  DCHECK(!channel_->is_stream());
+  DCHECK(timer_policy_.linger);
 
   if (MODE_INVITE == mode_) {
     DCHECK(STATE_CONFIRMED == next_state_);
@@ -214,15 +350,20 @@ void ServerTransactionImpl::OnTerminated() {
     DCHECK(STATE_COMPLETED == next_state_);
   }
 
+  State state = next_state_;
   next_state_ = STATE_TERMINATED;
+  LogStateChange(state);
   Terminate();
 }
 
 void ServerTransactionImpl::OnSendProvisionalResponse() {
-  DCHECK(MODE_INVITE == mode_ && STATE_PROCEEDING == next_state_);
+  DCHECK(MODE_INVITE == mode_ && STATE_PROCEED_CALLING == next_state_);
 
   scoped_refptr<Response> response =
-      initial_request_->CreateResponse(SIP_TRYING);
+      initial_request_->CreateCannedResponse(SIP_TRYING);
+  // Repeated to the retransmissions of the INVITE, until the TU responds.
+  latest_response_ = response;
+  LogMessage(TransportLog::TYPE_SIP_MESSAGE_SENT, response);
   int result = channel_->Send(response,
       base::Bind(&ServerTransactionImpl::OnSendProvisionalResponseWriteComplete,
           weak_factory_.GetWeakPtr()));
@@ -231,60 +372,164 @@ void ServerTransactionImpl::OnSendProvisionalResponse() {
     OnSendProvisionalResponseWriteComplete(result);
 }
 
+void ServerTransactionImpl::OnReliableRetransmit() {
+  DCHECK(unacked_response_);
+
+  TransportStats::Count(TransportStats::RETRANSMISSIONS_SENT);
+  LogMessage(TransportLog::TYPE_SIP_MESSAGE_SENT, unacked_response_);
+  channel_->Send(unacked_response_, base::Bind(&IgnoreRepeatResult));
+  reliable_retry_delay_ = reliable_retry_delay_ * 2;
+  reliableRetransmitTimer_.Start(
+      reliable_retry_delay_,
+      base::Bind(&ServerTransactionImpl::OnReliableRetransmit,
+          weak_factory_.GetWeakPtr()));
+}
+
+void ServerTransactionImpl::OnReliableTimedOut() {
+  DCHECK(MODE_INVITE == mode_ && STATE_PROCEED_CALLING == next_state_);
+
+  // RFC 3262 section 3: the INVITE is rejected, as its reliable provisional
+  // response was never acknowledged.
+  DVLOG(1) << "Reliable provisional response not acknowledged";
+  queued_responses_.clear();
+  StopReliableProvisional();
+  Send(initial_request_->CreateResponse(SIP_SERVER_INTERNAL_ERROR));
+  delegate_->OnTimedOut(initial_request_);
+}
+
 void ServerTransactionImpl::OnRetransmitWriteComplete(int result) {
   if (net::OK == result) {
-    ScheduleRetry();
+    // The ACK may have arrived meanwhile, and the timer been taken over by
+    // timer I.
+    if (STATE_COMPLETED == next_state_)
+      ScheduleRetry();
   } else if (net::ERR_IO_PENDING != result) {
-    delegate_->OnTransportError(initial_request_, result);
+    // The ACK may have released the request meanwhile.
+    if (initial_request_)
+      delegate_->OnTransportError(initial_request_, result);
   }
 }
 
 void ServerTransactionImpl::OnSendProvisionalResponseWriteComplete(int result) {
-  if (net::ERR_IO_PENDING != result) {
-    delegate_->OnTransportError(initial_request_, result);
+  if (net::OK != result && net::ERR_IO_PENDING != result) {
+    // The final response may have released the request meanwhile.
+    if (initial_request_)
+      delegate_->OnTransportError(initial_request_, result);
+  }
+}
+
+void ServerTransactionImpl::LogMessage(
+      TransportLog::EventType type,
+      const scoped_refptr<Message> &message) const {
+  if (net_log_.IsCapturing())
+    net_log_.AddEvent(type, TransportLog::MessageCallback(message));
+}
+
+void ServerTransactionImpl::LogStateChange(State from) const {
+  if (net_log_.IsCapturing()) {
+    net_log_.AddEvent(TransportLog::TYPE_TRANSACTION_STATE_CHANGED,
+        TransportLog::StringPairCallback("from", StateToString(from),
+                                         "to", StateToString(next_state_)));
+  }
+}
+
+// static
+const char *ServerTransactionImpl::StateToString(State state) {
+  switch (state) {
+    case STATE_TRYING: return "trying";
+    case STATE_PROCEEDING: return "proceeding";
+    case STATE_PROCEED_CALLING: return "proceeding";
+    case STATE_COMPLETED: return "completed";
+    case STATE_CONFIRMED: return "confirmed";
+    case STATE_TERMINATED: return "terminated";
   }
+  NOTREACHED();
+  return "";
 }
 
 void ServerTransactionImpl::StopTimers() {
-  retryTimer_.Stop();
+  retransmitTimer_.Stop();
   timedOutTimer_.Stop();
-  terminateTimer_.Stop();
   provisionalTimer_.Stop();
+  reliableRetransmitTimer_.Stop();
+  reliableTimedOutTimer_.Stop();
 }
 
 void ServerTransactionImpl::StopProvisionalResponse() {
   provisionalTimer_.Stop();
 }
 
+void ServerTransactionImpl::ReleaseRequest() {
+  // The response given by the TU still refers to the request, and is left
+  // as it is.
+  latest_response_ = latest_response_->CreateRetransmission();
+  initial_request_ = NULL;
+}
+
 void ServerTransactionImpl::ScheduleRetry() {
-  retryTimer_.Start(FROM_HERE,
+  retransmitTimer_.Start(
       time_delta_provider_->GetNextRetryDelay(),
       base::Bind(&ServerTransactionImpl::OnRetransmit,
           weak_factory_.GetWeakPtr()));
 }
 
 void ServerTransactionImpl::ScheduleTimeout() {
-  timedOutTimer_.Start(FROM_HERE,
+  timedOutTimer_.Start(
       time_delta_provider_->GetTimeoutDelay(),
       base::Bind(&ServerTransactionImpl::OnTimedOut,
           weak_factory_.GetWeakPtr()));
 }
 
 void ServerTransactionImpl::ScheduleTerminate() {
-  terminateTimer_.Start(FROM_HERE,
+  retransmitTimer_.Start(
       time_delta_provider_->GetTerminateDelay(),
       base::Bind(&ServerTransactionImpl::OnTerminated,
           weak_factory_.GetWeakPtr()));
 }
 
 void ServerTransactionImpl::ScheduleProvisionalResponse() {
-  provisionalTimer_.Start(FROM_HERE,
+  provisionalTimer_.Start(
       base::TimeDelta::FromMilliseconds(200),
       base::Bind(&ServerTransactionImpl::OnSendProvisionalResponse,
           weak_factory_.GetWeakPtr()));
 }
 
+void ServerTransactionImpl::StartReliableProvisional(
+      const scoped_refptr<Response> &response) {
+  if (!next_rseq_) {
+    // RFC 3262 section 3: the first RSeq is chosen at random.
+    next_rseq_ = static_cast<uint32>(base::RandInt(1, kint32max));
+  }
+  if (!response->get<RSeq>()) {
+    scoped_ptr<RSeq> rseq(new RSeq(next_rseq_++));
+    response->push_back(rseq.Pass());
+  }
+  unacked_response_ = response;
+  // Timer H is 64*T1 as well. Like timer G, no retransmissions are sent on
+  // reliable transports.
+  base::TimeDelta timeout(time_delta_provider_->GetTimeoutDelay());
+  if (timer_policy_.retransmit) {
+    reliable_retry_delay_ = timeout / 64;
+    reliableRetransmitTimer_.Start(
+        reliable_retry_delay_,
+        base::Bind(&ServerTransactionImpl::OnReliableRetransmit,
+            weak_factory_.GetWeakPtr()));
+  }
+  reliableTimedOutTimer_.Start(
+      timeout,
+      base::Bind(&ServerTransactionImpl::OnReliableTimedOut,
+          weak_factory_.GetWeakPtr()));
+}
+
+void ServerTransactionImpl::StopReliableProvisional() {
+  reliableRetransmitTimer_.Stop();
+  reliableTimedOutTimer_.Stop();
+  unacked_response_ = NULL;
+}
+
 void ServerTransactionImpl::Terminate() {
+  StopTimers();
+  net_log_.EndEvent(TransportLog::TYPE_TRANSACTION_ALIVE);
   delegate_->OnTransactionTerminated(id_);
 }
 
@@ -5,11 +5,14 @@
 #ifndef SIPPET_TRANSPORT_SERVER_TRANSACTION_IMPL_H_
 #define SIPPET_TRANSPORT_SERVER_TRANSACTION_IMPL_H_
 
-#include "base/timer/timer.h"
+#include <deque>
+
 #include "sippet/transport/server_transaction.h"
 #include "sippet/transport/transaction_delegate.h"
 #include "sippet/transport/time_delta_factory.h"
 #include "sippet/transport/time_delta_provider.h"
+#include "sippet/transport/timer_wheel.h"
+#include "sippet/transport/transaction_timer_policy.h"
 
 namespace sippet {
 
@@ -21,17 +24,27 @@ class ServerTransactionImpl : public ServerTransaction {
         const std::string &id,
         const scoped_refptr<Channel> &channel,
         TransactionDelegate *delegate,
-        TimeDeltaFactory *time_delta_factory);
+        TimeDeltaFactory *time_delta_factory,
+        TimerWheel *timer_wheel,
+        const TransactionTimerPolicy &timer_policy);
 
   // ServerTransaction methods:
   const std::string& id() const override;
   scoped_refptr<Channel> channel() const override;
+  void SetNetLog(const BoundTransportLog &net_log) override;
   void Start(const scoped_refptr<Request> &incoming_request) override;
   void Send(const scoped_refptr<Response> &response) override;
   void HandleIncomingRequest(
           const scoped_refptr<Request> &request) override;
+  bool HandleRetransmission() override;
+  bool HandlePrack(const scoped_refptr<Request> &prack) override;
 
   void Close() override;
+
+  // Transactions are carved from slabs shared by all network layers, see
+  // |TransactionSlab|.
+  static void *operator new(size_t size);
+  static void operator delete(void *p, size_t size);
  private:
   friend class base::RefCountedThreadSafe<ServerTransactionImpl>;
   ~ServerTransactionImpl() override;
@@ -57,29 +70,62 @@ class ServerTransactionImpl : public ServerTransaction {
   State next_state_;
   
   TransactionDelegate *delegate_;
+  TransactionTimerPolicy timer_policy_;
+  // Released once nothing but the final response is left to repeat: when a
+  // non-INVITE is answered, or an ACK stops timer H. |latest_response_| is
+  // then a private copy of the final response, which doesn't refer to the
+  // request, and repeats the serialized bytes of the first send.
   scoped_refptr<Request> initial_request_;
   scoped_refptr<Response> latest_response_;
-  base::OneShotTimer<ServerTransactionImpl> retryTimer_;
-  base::OneShotTimer<ServerTransactionImpl> timedOutTimer_;
-  base::OneShotTimer<ServerTransactionImpl> terminateTimer_;
-  base::OneShotTimer<ServerTransactionImpl> provisionalTimer_;
+  Method method_;
+  bool started_;
+  // Timer G while retransmitting, then I or J once confirmed or completed;
+  // they never run at the same time, and neither runs on reliable
+  // transports.
+  TimerWheel::Timer retransmitTimer_;
+  TimerWheel::Timer timedOutTimer_;
+  TimerWheel::Timer provisionalTimer_;
+  // The reliable provisional response waiting for its PRACK, retransmitted
+  // from T1 on, doubling each time, until 64*T1 (RFC 3262 section 3). The
+  // same serialized message is repeated. Later reliable provisional
+  // responses are queued until it's acknowledged.
+  scoped_refptr<Response> unacked_response_;
+  std::deque<scoped_refptr<Response> > queued_responses_;
+  uint32 next_rseq_;
+  base::TimeDelta reliable_retry_delay_;
+  TimerWheel::Timer reliableRetransmitTimer_;
+  TimerWheel::Timer reliableTimedOutTimer_;
+  // Its clock times the transaction.
+  TimerWheel *timer_wheel_;
+  base::TimeTicks start_time_;
+  BoundTransportLog net_log_;
 
   void OnRetransmit();
   void OnTimedOut();
   void OnTerminated();
   void OnSendProvisionalResponse();
+  void OnReliableRetransmit();
+  void OnReliableTimedOut();
   
   void OnSendWriteComplete(scoped_refptr<Response> response, int result);
   void OnRepeatResponseWriteComplete(scoped_refptr<Request> request, int result);
   void OnRetransmitWriteComplete(int result);
   void OnSendProvisionalResponseWriteComplete(int result);
 
+  void LogMessage(TransportLog::EventType type,
+                  const scoped_refptr<Message> &message) const;
+  void LogStateChange(State from) const;
+  static const char *StateToString(State state);
+
   void StopTimers();
   void StopProvisionalResponse();
+  void ReleaseRequest();
   void ScheduleRetry();
   void ScheduleTimeout();
   void ScheduleTerminate();
   void ScheduleProvisionalResponse();
+  void StartReliableProvisional(const scoped_refptr<Response> &response);
+  void StopReliableProvisional();
   void Terminate();
 
   TimeDeltaFactory *time_delta_factory_;
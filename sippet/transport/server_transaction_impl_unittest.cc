@@ -0,0 +1,303 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/server_transaction_impl.h"
+
+#include "net/base/net_errors.h"
+#include "sippet/transport/transaction_test_util.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const char kInviteRequest[] =
+  "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK74bf9\r\n"
+  "Max-Forwards: 70\r\n"
+  "To: Bob <sip:bob@biloxi.com>\r\n"
+  "From: Alice <sip:alice@atlanta.com>;tag=9fxced76sl\r\n"
+  "Call-ID: 3848276298220188511@atlanta.com\r\n"
+  "CSeq: 1 INVITE\r\n"
+  "Contact: <sip:alice@pc33.atlanta.com>\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n";
+
+// The ACK of a non-2xx final response, in the INVITE transaction.
+const char kAckRequest[] =
+  "ACK sip:bob@biloxi.com SIP/2.0\r\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK74bf9\r\n"
+  "Max-Forwards: 70\r\n"
+  "To: Bob <sip:bob@biloxi.com>;tag=8321234356\r\n"
+  "From: Alice <sip:alice@atlanta.com>;tag=9fxced76sl\r\n"
+  "Call-ID: 3848276298220188511@atlanta.com\r\n"
+  "CSeq: 1 ACK\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n";
+
+const char kOptionsRequest[] =
+  "OPTIONS sip:bob@biloxi.com SIP/2.0\r\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds\r\n"
+  "Max-Forwards: 70\r\n"
+  "To: Bob <sip:bob@biloxi.com>\r\n"
+  "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+  "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+  "CSeq: 314159 OPTIONS\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n";
+
+base::TimeDelta Milliseconds(int64 ms) {
+  return base::TimeDelta::FromMilliseconds(ms);
+}
+
+}  // namespace
+
+class ServerTransactionImplTest : public testing::Test {
+ public:
+  // Starts a server transaction for |raw_request|, received from a reliable
+  // transport if |is_stream|, with the timers it needs.
+  void Start(const char *raw_request, bool is_stream) {
+    channel_ = new FakeTransactionChannel(is_stream);
+    StartWithPolicy(raw_request, TransactionTimerPolicy::ForChannel(
+        *channel_));
+  }
+
+  void StartWithPolicy(const char *raw_request,
+                       const TransactionTimerPolicy &timer_policy) {
+    if (!channel_.get())
+      channel_ = new FakeTransactionChannel(false);
+    request_ = ParseRequest(raw_request);
+    transaction_ = new ServerTransactionImpl("z9hG4bK74bf9", channel_,
+        &delegate_, TimeDeltaFactory::GetDefaultFactory(),
+        clock_.timer_wheel(), timer_policy);
+    transaction_->Start(request_);
+  }
+
+  void Respond(StatusCode code) {
+    transaction_->Send(request_->CreateResponse(code));
+  }
+
+  // Checks that the transaction terminated, leaving no timer behind.
+  void ExpectTerminated() {
+    EXPECT_TRUE(delegate_.terminated());
+    EXPECT_EQ(0u, clock_.timer_wheel()->size());
+  }
+
+ protected:
+  TransactionTestClock clock_;
+  RecordingTransactionDelegate delegate_;
+  scoped_refptr<FakeTransactionChannel> channel_;
+  scoped_refptr<Request> request_;
+  scoped_refptr<ServerTransactionImpl> transaction_;
+};
+
+TEST_F(ServerTransactionImplTest, InviteRetransmittedBeforeAnyResponse) {
+  Start(kInviteRequest, false);
+
+  // Nothing to repeat yet, but the retransmission is still absorbed.
+  EXPECT_TRUE(transaction_->HandleRetransmission());
+  transaction_->HandleIncomingRequest(ParseRequest(kInviteRequest));
+  EXPECT_TRUE(channel_->sent().empty());
+
+  // Once the 100 Trying is sent, it's what retransmissions get.
+  clock_.Advance(base::TimeDelta::FromMilliseconds(200));
+  ASSERT_EQ(1u, channel_->CountSent("SIP/2.0 100 "));
+  EXPECT_TRUE(transaction_->HandleRetransmission());
+  EXPECT_EQ(2u, channel_->CountSent("SIP/2.0 100 "));
+  EXPECT_EQ(2u, channel_->sent().size());
+  EXPECT_EQ(0, delegate_.transport_errors());
+  EXPECT_FALSE(delegate_.terminated());
+}
+
+TEST_F(ServerTransactionImplTest, NonInviteLingersForTimerJ) {
+  Start(kOptionsRequest, false);
+  Respond(SIP_OK);
+  EXPECT_EQ(1u, channel_->CountSent("SIP/2.0 200 "));
+
+  // Retransmissions get the final response again until timer J fires, at
+  // 64*T1.
+  clock_.Advance(Milliseconds(31999));
+  transaction_->HandleIncomingRequest(ParseRequest(kOptionsRequest));
+  EXPECT_EQ(2u, channel_->CountSent("SIP/2.0 200 "));
+  EXPECT_FALSE(delegate_.terminated());
+  clock_.Advance(Milliseconds(1));
+  ExpectTerminated();
+  EXPECT_EQ(2u, channel_->sent().size());
+}
+
+TEST_F(ServerTransactionImplTest, NonInviteOnReliableTransport) {
+  Start(kOptionsRequest, true);
+  Respond(SIP_OK);
+
+  // There's no timer J on reliable transports.
+  EXPECT_EQ(1u, channel_->CountSent("SIP/2.0 200 "));
+  ExpectTerminated();
+}
+
+TEST_F(ServerTransactionImplTest, InviteRetransmitsUntilTimerH) {
+  Start(kInviteRequest, false);
+  Respond(SIP_BUSY_HERE);
+  EXPECT_EQ(1u, channel_->sent().size());
+
+  // Timer G doubles from T1 up to T2: 0.5s, 1.5s, 3.5s, then every 4s.
+  clock_.Advance(Milliseconds(499));
+  EXPECT_EQ(1u, channel_->sent().size());
+  clock_.Advance(Milliseconds(1));
+  EXPECT_EQ(2u, channel_->sent().size());
+  clock_.Advance(Milliseconds(3000));
+  EXPECT_EQ(4u, channel_->sent().size());
+  clock_.Advance(Milliseconds(4000));
+  EXPECT_EQ(5u, channel_->sent().size());
+
+  // Without an ACK, timer H fires at 64*T1, right after the retransmission
+  // at 31.5s.
+  clock_.Advance(Milliseconds(31999 - 7500));
+  EXPECT_EQ(11u, channel_->CountSent("SIP/2.0 486 "));
+  EXPECT_EQ(0, delegate_.timed_out());
+  clock_.Advance(Milliseconds(1));
+  EXPECT_EQ(1, delegate_.timed_out());
+  ExpectTerminated();
+  EXPECT_EQ(11u, channel_->sent().size());
+}
+
+TEST_F(ServerTransactionImplTest, InviteLingersForTimerI) {
+  Start(kInviteRequest, false);
+  Respond(SIP_BUSY_HERE);
+  clock_.Advance(Milliseconds(1000));
+  EXPECT_EQ(2u, channel_->sent().size());
+  transaction_->HandleIncomingRequest(ParseRequest(kAckRequest));
+
+  // Timer I takes over from timer G, and timer H is gone. Retransmitted
+  // ACKs are absorbed.
+  clock_.Advance(Milliseconds(4999));
+  transaction_->HandleIncomingRequest(ParseRequest(kAckRequest));
+  EXPECT_EQ(2u, channel_->sent().size());
+  EXPECT_FALSE(delegate_.terminated());
+  clock_.Advance(Milliseconds(1));
+  ExpectTerminated();
+  EXPECT_EQ(0, delegate_.timed_out());
+}
+
+TEST_F(ServerTransactionImplTest, InviteOnReliableTransport) {
+  Start(kInviteRequest, true);
+  Respond(SIP_BUSY_HERE);
+
+  // Only timer H runs.
+  EXPECT_EQ(1u, clock_.timer_wheel()->size());
+  clock_.Advance(Milliseconds(31999));
+  EXPECT_EQ(1u, channel_->sent().size());
+  EXPECT_EQ(0, delegate_.timed_out());
+  clock_.Advance(Milliseconds(1));
+  EXPECT_EQ(1, delegate_.timed_out());
+  ExpectTerminated();
+}
+
+TEST_F(ServerTransactionImplTest, InviteConfirmedOnReliableTransport) {
+  Start(kInviteRequest, true);
+  Respond(SIP_BUSY_HERE);
+  transaction_->HandleIncomingRequest(ParseRequest(kAckRequest));
+
+  // There's no timer I on reliable transports.
+  EXPECT_EQ(1u, channel_->sent().size());
+  ExpectTerminated();
+}
+
+TEST_F(ServerTransactionImplTest, RetransmitsWithoutLinger) {
+  TransactionTimerPolicy timer_policy;
+  timer_policy.linger = false;
+  StartWithPolicy(kInviteRequest, timer_policy);
+  Respond(SIP_BUSY_HERE);
+  clock_.Advance(Milliseconds(500));
+  EXPECT_EQ(2u, channel_->CountSent("SIP/2.0 486 "));
+
+  // Timer G runs, but the transaction ends at the ACK.
+  transaction_->HandleIncomingRequest(ParseRequest(kAckRequest));
+  ExpectTerminated();
+}
+
+TEST_F(ServerTransactionImplTest, ReleasesRequestOnceAnswered) {
+  Start(kOptionsRequest, false);
+  scoped_refptr<Response> response(request_->CreateResponse(SIP_OK));
+  transaction_->Send(response);
+
+  // The response of the TU is left as it was.
+  EXPECT_EQ(request_.get(), response->refer_to().get());
+  response = NULL;
+  EXPECT_TRUE(request_->HasOneRef());
+
+  // Retransmissions are still answered.
+  transaction_->HandleIncomingRequest(ParseRequest(kOptionsRequest));
+  EXPECT_EQ(2u, channel_->CountSent("SIP/2.0 200 "));
+  EXPECT_TRUE(transaction_->HandleRetransmission());
+  EXPECT_EQ(3u, channel_->CountSent("SIP/2.0 200 "));
+}
+
+TEST_F(ServerTransactionImplTest, ReleasesInviteAtAck) {
+  Start(kInviteRequest, false);
+  scoped_refptr<Response> response(request_->CreateResponse(SIP_BUSY_HERE));
+  transaction_->Send(response);
+  response = NULL;
+
+  // Timer H still reports the request until the ACK arrives.
+  EXPECT_FALSE(request_->HasOneRef());
+  transaction_->HandleIncomingRequest(ParseRequest(kAckRequest));
+  EXPECT_TRUE(request_->HasOneRef());
+  EXPECT_FALSE(delegate_.terminated());
+}
+
+TEST_F(ServerTransactionImplTest, NoTransportErrorOnceRequestReleased) {
+  Start(kOptionsRequest, false);
+  channel_->set_pending_writes(true);
+  Respond(SIP_TRYING);
+  channel_->set_pending_writes(false);
+  Respond(SIP_OK);
+
+  // The provisional response fails once the final one is written.
+  channel_->CompleteWrites(net::ERR_CONNECTION_RESET);
+  EXPECT_EQ(0, delegate_.transport_errors());
+  EXPECT_EQ(2u, channel_->sent().size());
+}
+
+TEST_F(ServerTransactionImplTest, NoRetransmitErrorOnceRequestReleased) {
+  Start(kInviteRequest, false);
+  Respond(SIP_BUSY_HERE);
+  channel_->set_pending_writes(true);
+  clock_.Advance(Milliseconds(500));
+  EXPECT_EQ(2u, channel_->CountSent("SIP/2.0 486 "));
+
+  // The retransmission fails once the ACK released the request.
+  transaction_->HandleIncomingRequest(ParseRequest(kAckRequest));
+  channel_->CompleteWrites(net::ERR_CONNECTION_RESET);
+  EXPECT_EQ(0, delegate_.transport_errors());
+}
+
+TEST_F(ServerTransactionImplTest, NoTryingErrorOnceRequestReleased) {
+  Start(kInviteRequest, false);
+  channel_->set_pending_writes(true);
+  clock_.Advance(Milliseconds(200));
+  ASSERT_EQ(1u, channel_->CountSent("SIP/2.0 100 "));
+  channel_->set_pending_writes(false);
+  Respond(SIP_BUSY_HERE);
+
+  // The 100 Trying fails once the ACK released the request.
+  transaction_->HandleIncomingRequest(ParseRequest(kAckRequest));
+  channel_->CompleteWrites(net::ERR_CONNECTION_RESET);
+  EXPECT_EQ(0, delegate_.transport_errors());
+}
+
+TEST_F(ServerTransactionImplTest, ProvisionalWrittenAfterFinal) {
+  Start(kOptionsRequest, false);
+  channel_->set_pending_writes(true);
+  Respond(SIP_TRYING);
+  channel_->set_pending_writes(false);
+  Respond(SIP_OK);
+
+  // Timer J is left running.
+  channel_->CompleteWrites(net::OK);
+  EXPECT_EQ(1u, clock_.timer_wheel()->size());
+  clock_.Advance(Milliseconds(32000));
+  ExpectTerminated();
+}
+
+} // End of sippet namespace
@@ -0,0 +1,615 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/sip_locator.h"
+
+#include <algorithm>
+#include <map>
+
+#include "base/bind.h"
+#include "base/logging.h"
+#include "base/rand_util.h"
+#include "base/stl_util.h"
+#include "base/strings/string_util.h"
+#include "base/time/tick_clock.h"
+#include "net/base/net_errors.h"
+#include "sippet/uri/uri.h"
+
+namespace sippet {
+
+namespace {
+
+const int kDefaultSipPort = 5060;
+const int kDefaultSipsPort = 5061;
+
+// Bounds the memory used by each record cache, and by the failed targets
+// remembered.
+const size_t kMaxCacheEntries = 1024;
+
+// Failed queries are retried after their TTL, but no sooner than
+// |kMinRetryDelaySeconds|, doubling the delay each time they fail again in
+// a row, up to |kMaxRetryDelaySeconds|.
+const int kMinRetryDelaySeconds = 1;
+const int kMaxRetryDelaySeconds = 300;
+
+// Failed targets are first given after the others for about the time a
+// transaction takes to time out (64*T1).
+const int kTargetRetryDelaySeconds = 32;
+
+// A missing name is an answer, cached for its TTL; other errors, e.g. time
+// outs or server failures, tell that the query failed.
+bool IsQueryFailure(int result) {
+  return net::OK != result && net::ERR_NAME_NOT_RESOLVED != result;
+}
+
+base::TimeDelta RetryDelay(const base::TimeDelta &ttl, int failures) {
+  base::TimeDelta max_delay(
+      base::TimeDelta::FromSeconds(kMaxRetryDelaySeconds));
+  base::TimeDelta delay(std::max(ttl,
+      base::TimeDelta::FromSeconds(kMinRetryDelaySeconds)));
+  for (int i = 1; i < failures && delay < max_delay; ++i)
+    delay = delay * 2;
+  return std::max(ttl, std::min(delay, max_delay));
+}
+
+// Returns the SRV name of |protocol| at |domain|, or an empty string if the
+// protocol has no SRV service defined.
+std::string SrvName(const Protocol &protocol, const std::string &domain) {
+  if (Protocol::UDP == protocol)
+    return "_sip._udp." + domain;
+  if (Protocol::TCP == protocol)
+    return "_sip._tcp." + domain;
+  if (Protocol::TLS == protocol)
+    return "_sips._tcp." + domain;
+  return std::string();
+}
+
+// Maps a NAPTR service field to the protocol it selects.
+Protocol ServiceProtocol(const std::string &service, bool secure) {
+  if (base::LowerCaseEqualsASCII(service, "sips+d2t"))
+    return Protocol::TLS;
+  if (!secure) {
+    if (base::LowerCaseEqualsASCII(service, "sip+d2u"))
+      return Protocol::UDP;
+    if (base::LowerCaseEqualsASCII(service, "sip+d2t"))
+      return Protocol::TCP;
+  }
+  return Protocol::Unknown;
+}
+
+bool NaptrLess(const SipLocator::NaptrRecord &a,
+               const SipLocator::NaptrRecord &b) {
+  if (a.order != b.order)
+    return a.order < b.order;
+  return a.preference < b.preference;
+}
+
+bool SrvPriorityLess(const SipLocator::SrvRecord &a,
+                     const SipLocator::SrvRecord &b) {
+  return a.priority < b.priority;
+}
+
+bool HasZeroWeight(const SipLocator::SrvRecord &record) {
+  return record.weight == 0;
+}
+
+std::string StripTrailingDot(const std::string &name) {
+  if (!name.empty() && name[name.size() - 1] == '.')
+    return name.substr(0, name.size() - 1);
+  return name;
+}
+
+}  // namespace
+
+SipLocator::NaptrRecord::NaptrRecord()
+  : order(0), preference(0) {
+}
+
+SipLocator::NaptrRecord::~NaptrRecord() {
+}
+
+SipLocator::SrvRecord::SrvRecord()
+  : priority(0), weight(0), port(0) {
+}
+
+SipLocator::SrvRecord::~SrvRecord() {
+}
+
+// Keeps the answers of one record type, and the callbacks waiting for the
+// queries still in progress.
+template<class Records>
+class SipLocator::RecordCache {
+ public:
+  typedef base::Callback<void(int, const Records&)> Callback;
+  typedef std::vector<Callback> Waiters;
+
+  RecordCache()
+    : max_stale_(base::TimeDelta::FromSeconds(kDefaultMaxStaleSeconds)) {}
+  ~RecordCache() {}
+
+  void set_max_stale(const base::TimeDelta &max_stale) {
+    max_stale_ = max_stale;
+  }
+
+  // Returns true and fills |result| and |records| if the answer of |name|
+  // is known. Otherwise queues |callback|, running |start_query| first if
+  // there's no query for |name| in progress. The query is allowed to
+  // complete synchronously, in which case its answer is returned, even if
+  // it can't be cached. A stale answer is returned too, |start_query|
+  // refreshing it without waiting.
+  bool Lookup(const std::string &name,
+              const base::TimeTicks &now,
+              int *result,
+              Records *records,
+              const Callback &callback,
+              const base::Closure &start_query) {
+    typename EntryMap::iterator i = entries_.find(name);
+    if (i == entries_.end()) {
+      if (entries_.size() >= kMaxCacheEntries)
+        Evict(now);
+      i = entries_.insert(std::make_pair(name, Entry())).first;
+    } else if (!i->second.pending && i->second.expiration > now) {
+      *result = i->second.result;
+      *records = i->second.records;
+      return true;
+    }
+    // Expired entries are queried again in place, keeping their failures.
+    bool stale = i->second.IsStale(now);
+    if (!i->second.pending) {
+      if (!stale) {
+        i->second.records.clear();
+        i->second.stale_until = base::TimeTicks();
+      }
+      i->second.pending = true;
+      start_query.Run();
+      i = entries_.find(name);
+      DCHECK(i != entries_.end());
+      if (!i->second.pending) {
+        *result = i->second.result;
+        *records = i->second.records;
+        return true;
+      }
+    }
+    if (stale) {
+      *result = i->second.result;
+      *records = i->second.records;
+      return true;
+    }
+    i->second.waiters.push_back(callback);
+    return false;
+  }
+
+  // Stores the answer of |name|, to be cached for |ttl|, and moves out the
+  // callbacks waiting for it. Failures are cached for longer each time they
+  // repeat, and don't replace a positive answer that is still returned
+  // stale.
+  void Set(const std::string &name,
+           int result,
+           const Records &records,
+           const base::TimeDelta &ttl,
+           const base::TimeTicks &now,
+           Waiters *waiters) {
+    Entry &entry = entries_[name];
+    entry.pending = false;
+    waiters->swap(entry.waiters);
+    base::TimeDelta delay(ttl);
+    if (IsQueryFailure(result)) {
+      delay = RetryDelay(ttl, ++entry.failures);
+      if (entry.IsStale(now)) {
+        DCHECK(waiters->empty());
+        entry.expiration = std::min(now + delay, entry.stale_until);
+        return;
+      }
+    } else {
+      entry.failures = 0;
+    }
+    entry.result = result;
+    entry.records = records;
+    entry.expiration = now + delay;
+    entry.stale_until = (net::OK == result && delay > base::TimeDelta())
+        ? entry.expiration + max_stale_ : base::TimeTicks();
+  }
+
+ private:
+  struct Entry {
+    Entry() : pending(false), result(net::ERR_FAILED), failures(0) {}
+
+    // Whether the positive answer can still be returned, while refreshed.
+    bool IsStale(const base::TimeTicks &now) const {
+      return net::OK == result && stale_until > now;
+    }
+
+    bool pending;
+    int result;
+    Records records;
+    base::TimeTicks expiration;
+    base::TimeTicks stale_until;
+    // Consecutive failed queries.
+    int failures;
+    Waiters waiters;
+  };
+
+  typedef std::map<std::string, Entry> EntryMap;
+
+  // Removes the expired answers, or all of them if none is expired.
+  // Queries in progress are kept.
+  void Evict(const base::TimeTicks &now) {
+    size_t size = entries_.size();
+    for (int pass = 0; pass < 2 && entries_.size() == size; ++pass) {
+      for (typename EntryMap::iterator i = entries_.begin();
+           i != entries_.end();) {
+        if (!i->second.pending && (pass > 0 || i->second.expiration <= now))
+          entries_.erase(i++);
+        else
+          ++i;
+      }
+    }
+  }
+
+  base::TimeDelta max_stale_;
+  EntryMap entries_;
+
+  DISALLOW_COPY_AND_ASSIGN(RecordCache);
+};
+
+// Runs the lookups of a single URI: NAPTR, then SRV, then the fallback to
+// the URI host itself.
+class SipLocator::Job {
+ public:
+  Job(SipLocator *locator, const SipURI &uri,
+      const LocateCallback &callback);
+  ~Job();
+
+  // Returns |net::OK| and fills |targets| when done synchronously.
+  int Start(std::vector<EndPoint> *targets);
+
+  const LocateCallback &callback() const { return callback_; }
+
+ private:
+  struct SrvQuery {
+    SrvQuery(const std::string &name, const Protocol &protocol)
+      : name(name), protocol(protocol) {}
+
+    std::string name;
+    Protocol protocol;
+  };
+
+  void OnNaptrComplete(int result, const NaptrRecords &records);
+  void OnSrvComplete(int result, const SrvRecords &records);
+
+  void HandleNaptrResult(int result, const NaptrRecords &records);
+  void HandleSrvResult(int result, const SrvRecords &records);
+
+  // Runs the SRV queries left, returning |net::ERR_IO_PENDING| if one of
+  // them is waiting for DNS.
+  int DoSrvQueries();
+  void AddQuery(const Protocol &protocol, const std::string &domain);
+
+  SipLocator *locator_;
+  std::string host_;
+  bool secure_;
+  bool has_transport_;
+  Protocol transport_;
+  LocateCallback callback_;
+
+  std::vector<SrvQuery> queries_;
+  size_t next_query_;
+  std::vector<EndPoint> targets_;
+
+  base::WeakPtrFactory<Job> weak_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(Job);
+};
+
+SipLocator::Job::Job(SipLocator *locator, const SipURI &uri,
+                     const LocateCallback &callback)
+  : locator_(locator),
+    host_(uri.HostNoBrackets()),
+    secure_(uri.SchemeIsSecure()),
+    has_transport_(false),
+    callback_(callback),
+    next_query_(0),
+    weak_factory_(this) {
+  base::StringPiece transport;
+  if (!secure_ && uri.parameter("transport", &transport)) {
+    has_transport_ = true;
+    transport_ = Protocol(transport.as_string());
+  }
+}
+
+SipLocator::Job::~Job() {
+}
+
+int SipLocator::Job::Start(std::vector<EndPoint> *targets) {
+  if (has_transport_) {
+    AddQuery(transport_, host_);
+  } else {
+    int result;
+    NaptrRecords records;
+    if (!locator_->LookupNaptr(host_, &result, &records,
+            base::Bind(&Job::OnNaptrComplete, weak_factory_.GetWeakPtr())))
+      return net::ERR_IO_PENDING;
+    HandleNaptrResult(result, records);
+  }
+  int result = DoSrvQueries();
+  if (result == net::OK)
+    *targets = targets_;
+  return result;
+}
+
+void SipLocator::Job::OnNaptrComplete(int result,
+                                      const NaptrRecords &records) {
+  HandleNaptrResult(result, records);
+  if (DoSrvQueries() != net::ERR_IO_PENDING)
+    locator_->OnJobComplete(this, net::OK, targets_);
+}
+
+void SipLocator::Job::OnSrvComplete(int result, const SrvRecords &records) {
+  HandleSrvResult(result, records);
+  if (DoSrvQueries() != net::ERR_IO_PENDING)
+    locator_->OnJobComplete(this, net::OK, targets_);
+}
+
+void SipLocator::Job::HandleNaptrResult(int result,
+                                        const NaptrRecords &records) {
+  if (result == net::OK) {
+    NaptrRecords sorted(records);
+    std::stable_sort(sorted.begin(), sorted.end(), NaptrLess);
+    for (NaptrRecords::const_iterator i = sorted.begin(), ie = sorted.end();
+         i != ie; ++i) {
+      if (!base::LowerCaseEqualsASCII(i->flags, "s"))
+        continue;
+      Protocol protocol(ServiceProtocol(i->service, secure_));
+      if (Protocol::Unknown == protocol)
+        continue;
+      std::string replacement(StripTrailingDot(i->replacement));
+      if (replacement.empty())
+        continue;
+      queries_.push_back(SrvQuery(replacement, protocol));
+    }
+  }
+  if (!queries_.empty())
+    return;
+  // No usable NAPTR records: query the SRV records of every transport
+  // allowed by the scheme, in order of preference.
+  if (!secure_) {
+    AddQuery(Protocol::UDP, host_);
+    AddQuery(Protocol::TCP, host_);
+  }
+  AddQuery(Protocol::TLS, host_);
+}
+
+void SipLocator::Job::HandleSrvResult(int result, const SrvRecords &records) {
+  const Protocol &protocol = queries_[next_query_++].protocol;
+  if (result != net::OK)
+    return;
+  SrvRecords sorted(records);
+  SortSrvRecords(&sorted, locator_->rand_int_);
+  for (SrvRecords::const_iterator i = sorted.begin(), ie = sorted.end();
+       i != ie; ++i) {
+    // A target of "." means the service isn't available at this domain.
+    std::string target(StripTrailingDot(i->target));
+    if (target.empty())
+      continue;
+    targets_.push_back(EndPoint(target, i->port, protocol));
+  }
+}
+
+int SipLocator::Job::DoSrvQueries() {
+  while (next_query_ < queries_.size()) {
+    int result;
+    SrvRecords records;
+    if (!locator_->LookupSrv(queries_[next_query_].name, &result, &records,
+            base::Bind(&Job::OnSrvComplete, weak_factory_.GetWeakPtr())))
+      return net::ERR_IO_PENDING;
+    HandleSrvResult(result, records);
+  }
+  if (targets_.empty()) {
+    // No SRV records: use the URI host with the default port.
+    Protocol protocol(has_transport_ ? transport_ :
+        Protocol(secure_ ? Protocol::TLS : Protocol::UDP));
+    int port = (Protocol::TLS == protocol) ? kDefaultSipsPort
+                                           : kDefaultSipPort;
+    targets_.push_back(EndPoint(host_, port, protocol));
+  }
+  return net::OK;
+}
+
+void SipLocator::Job::AddQuery(const Protocol &protocol,
+                               const std::string &domain) {
+  std::string name(SrvName(protocol, domain));
+  if (!name.empty())
+    queries_.push_back(SrvQuery(name, protocol));
+}
+
+SipLocator::SipLocator(scoped_ptr<RecordResolver> resolver)
+  : resolver_(resolver.Pass()),
+    naptr_cache_(new RecordCache<NaptrRecords>),
+    srv_cache_(new RecordCache<SrvRecords>),
+    tick_clock_(nullptr),
+    rand_int_(base::Bind(&base::RandInt)),
+    weak_factory_(this) {
+  DCHECK(resolver_);
+}
+
+SipLocator::~SipLocator() {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  STLDeleteElements(&jobs_);
+}
+
+void SipLocator::set_max_stale(const base::TimeDelta &max_stale) {
+  naptr_cache_->set_max_stale(max_stale);
+  srv_cache_->set_max_stale(max_stale);
+}
+
+bool SipLocator::NeedsLookup(const SipURI &uri) {
+  return uri.is_valid() && !uri.HostIsIPAddress() && !uri.has_port();
+}
+
+int SipLocator::Locate(const SipURI &uri,
+                       std::vector<EndPoint> *targets,
+                       const LocateCallback &callback) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  DCHECK(targets);
+  if (!uri.is_valid())
+    return net::ERR_INVALID_ARGUMENT;
+  if (!NeedsLookup(uri)) {
+    targets->assign(1, EndPoint::FromSipURI(uri));
+    return net::OK;
+  }
+  scoped_ptr<Job> job(new Job(this, uri, callback));
+  int result = job->Start(targets);
+  if (result == net::ERR_IO_PENDING)
+    jobs_.insert(job.release());
+  else
+    MoveFailedTargetsLast(targets);
+  return result;
+}
+
+void SipLocator::ReportTargetFailure(const EndPoint &target) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  base::TimeTicks now(NowTicks());
+  if (target_failures_.size() >= kMaxCacheEntries
+      && target_failures_.end() == target_failures_.find(target)) {
+    // Forget the targets being tried again, or all of them.
+    for (TargetFailureMap::iterator i = target_failures_.begin();
+         i != target_failures_.end();) {
+      if (i->second.retry_time <= now)
+        target_failures_.erase(i++);
+      else
+        ++i;
+    }
+    if (target_failures_.size() >= kMaxCacheEntries)
+      target_failures_.clear();
+  }
+  TargetFailure &failure = target_failures_[target];
+  failure.retry_time = now + RetryDelay(
+      base::TimeDelta::FromSeconds(kTargetRetryDelaySeconds),
+      ++failure.failures);
+  DVLOG(1) << "Target " << target.ToString() << " failed "
+           << failure.failures << " times in a row";
+}
+
+void SipLocator::ReportTargetSuccess(const EndPoint &target) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  target_failures_.erase(target);
+}
+
+void SipLocator::SortSrvRecords(SrvRecords *records,
+                                const net::RandIntCallback &rand_int) {
+  std::stable_sort(records->begin(), records->end(), SrvPriorityLess);
+  SrvRecords::iterator begin = records->begin();
+  while (begin != records->end()) {
+    SrvRecords::iterator end = begin;
+    while (end != records->end() && end->priority == begin->priority)
+      ++end;
+    // Within the same priority, pick each record at random, in proportion
+    // to its weight; records with zero weight go first, so that they have
+    // a small chance of being selected.
+    std::stable_partition(begin, end, HasZeroWeight);
+    for (SrvRecords::iterator i = begin; i != end; ++i) {
+      int total = 0;
+      for (SrvRecords::iterator j = i; j != end; ++j)
+        total += j->weight;
+      int pick = rand_int.Run(0, total);
+      int running_sum = 0;
+      SrvRecords::iterator j = i;
+      for (; j + 1 != end; ++j) {
+        running_sum += j->weight;
+        if (running_sum >= pick)
+          break;
+      }
+      std::rotate(i, j, j + 1);
+    }
+    begin = end;
+  }
+}
+
+bool SipLocator::LookupNaptr(const std::string &domain,
+                             int *result, NaptrRecords *records,
+                             const NaptrLookupCallback &callback) {
+  return naptr_cache_->Lookup(domain, NowTicks(), result, records, callback,
+      base::Bind(&RecordResolver::ResolveNaptr,
+                 base::Unretained(resolver_.get()), domain,
+                 base::Bind(&SipLocator::OnNaptrResolved,
+                            weak_factory_.GetWeakPtr(), domain)));
+}
+
+bool SipLocator::LookupSrv(const std::string &name,
+                           int *result, SrvRecords *records,
+                           const SrvLookupCallback &callback) {
+  return srv_cache_->Lookup(name, NowTicks(), result, records, callback,
+      base::Bind(&RecordResolver::ResolveSrv,
+                 base::Unretained(resolver_.get()), name,
+                 base::Bind(&SipLocator::OnSrvResolved,
+                            weak_factory_.GetWeakPtr(), name)));
+}
+
+base::TimeTicks SipLocator::NowTicks() const {
+  return tick_clock_ ? tick_clock_->NowTicks() : base::TimeTicks::Now();
+}
+
+void SipLocator::OnNaptrResolved(const std::string &domain, int result,
+                                 const NaptrRecords &records,
+                                 const base::TimeDelta &ttl) {
+  DVLOG(1) << "NAPTR " << domain << ": " << net::ErrorToShortString(result)
+           << ", " << records.size() << " records";
+  RecordCache<NaptrRecords>::Waiters waiters;
+  naptr_cache_->Set(domain, result, records, ttl, NowTicks(), &waiters);
+  base::WeakPtr<SipLocator> weak_this(weak_factory_.GetWeakPtr());
+  for (RecordCache<NaptrRecords>::Waiters::iterator i = waiters.begin(),
+       ie = waiters.end(); i != ie; ++i) {
+    i->Run(result, records);
+    if (!weak_this)
+      return;  // The locator was destroyed meanwhile
+  }
+}
+
+void SipLocator::OnSrvResolved(const std::string &name, int result,
+                               const SrvRecords &records,
+                               const base::TimeDelta &ttl) {
+  DVLOG(1) << "SRV " << name << ": " << net::ErrorToShortString(result)
+           << ", " << records.size() << " records";
+  RecordCache<SrvRecords>::Waiters waiters;
+  srv_cache_->Set(name, result, records, ttl, NowTicks(), &waiters);
+  base::WeakPtr<SipLocator> weak_this(weak_factory_.GetWeakPtr());
+  for (RecordCache<SrvRecords>::Waiters::iterator i = waiters.begin(),
+       ie = waiters.end(); i != ie; ++i) {
+    i->Run(result, records);
+    if (!weak_this)
+      return;  // The locator was destroyed meanwhile
+  }
+}
+
+void SipLocator::OnJobComplete(Job *job, int result,
+                               const std::vector<EndPoint> &targets) {
+  scoped_ptr<Job> owned_job(job);
+  jobs_.erase(job);
+  LocateCallback callback(job->callback());
+  std::vector<EndPoint> result_targets(targets);
+  owned_job.reset();
+  MoveFailedTargetsLast(&result_targets);
+  callback.Run(result, result_targets);
+}
+
+void SipLocator::MoveFailedTargetsLast(
+    std::vector<EndPoint> *targets) const {
+  if (target_failures_.empty())
+    return;
+  base::TimeTicks now(NowTicks());
+  std::vector<EndPoint> failed;
+  std::vector<EndPoint>::iterator last = targets->begin();
+  for (std::vector<EndPoint>::iterator i = targets->begin(),
+       ie = targets->end(); i != ie; ++i) {
+    TargetFailureMap::const_iterator failure = target_failures_.find(*i);
+    if (target_failures_.end() != failure
+        && failure->second.retry_time > now)
+      failed.push_back(*i);
+    else
+      *last++ = *i;
+  }
+  std::copy(failed.begin(), failed.end(), last);
+}
+
+}  // namespace sippet
@@ -0,0 +1,210 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_SIP_LOCATOR_H_
+#define SIPPET_TRANSPORT_SIP_LOCATOR_H_
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/callback.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/memory/weak_ptr.h"
+#include "base/threading/thread_checker.h"
+#include "base/time/time.h"
+#include "net/base/rand_callback.h"
+#include "sippet/transport/end_point.h"
+
+namespace base {
+class TickClock;
+}
+
+namespace sippet {
+
+class SipURI;
+
+// Locates the SIP servers of a URI as described in RFC 3263: NAPTR records
+// select the transports, and SRV records the hosts and ports, ordered by
+// priority and weight as described in RFC 2782. The result is a list of
+// targets to be tried in turn; their host names are left to the host
+// resolver of the channels, which has a cache of its own.
+//
+// NAPTR and SRV answers, negative ones included, are cached for their TTL,
+// and concurrent lookups of the same name share a single query, so that DNS
+// is only queried once per domain no matter how many requests are sent.
+// Queries that fail, e.g. time out, are cached as well, and retried later
+// each time they fail again in a row. Positive answers are still returned
+// for up to |max_stale| after they expire, while being refreshed, and for
+// as long as the refreshes fail, so that a flapping DNS server doesn't
+// hold the requests sent meanwhile.
+//
+// Targets whose connections failed, as reported by |ReportTargetFailure|,
+// are given after the others for a while, so that new requests don't wait
+// for them to time out again first.
+//
+// Only the "s" NAPTR flag, and the UDP, TCP and TLS transports are handled.
+//
+// It must be used on a single thread.
+class SipLocator {
+ public:
+  struct NaptrRecord {
+    NaptrRecord();
+    ~NaptrRecord();
+
+    uint16 order;
+    uint16 preference;
+    std::string flags;
+    std::string service;
+    std::string replacement;
+  };
+
+  struct SrvRecord {
+    SrvRecord();
+    ~SrvRecord();
+
+    uint16 priority;
+    uint16 weight;
+    uint16 port;
+    std::string target;
+  };
+
+  typedef std::vector<NaptrRecord> NaptrRecords;
+  typedef std::vector<SrvRecord> SrvRecords;
+
+  // Performs the DNS queries.
+  class RecordResolver {
+   public:
+    // |result| is a network error code, |net::ERR_NAME_NOT_RESOLVED| when
+    // there are no records. |ttl| tells for how long the answer, positive or
+    // negative, can be cached.
+    typedef base::Callback<void(int result,
+                                const NaptrRecords &records,
+                                const base::TimeDelta &ttl)> NaptrCallback;
+    typedef base::Callback<void(int result,
+                                const SrvRecords &records,
+                                const base::TimeDelta &ttl)> SrvCallback;
+
+    virtual ~RecordResolver() {}
+
+    // Queries the NAPTR records of |domain|. |callback| may be run
+    // synchronously.
+    virtual void ResolveNaptr(const std::string &domain,
+                              const NaptrCallback &callback) = 0;
+
+    // Queries the SRV records of |name|, e.g. "_sip._udp.example.com".
+    // |callback| may be run synchronously.
+    virtual void ResolveSrv(const std::string &name,
+                            const SrvCallback &callback) = 0;
+  };
+
+  // |result| is a network error code; |targets| are ordered by preference.
+  typedef base::Callback<void(int result,
+                              const std::vector<EndPoint> &targets)>
+      LocateCallback;
+
+  // Default time positive answers are still returned after they expire,
+  // in seconds.
+  static const int kDefaultMaxStaleSeconds = 300;
+
+  explicit SipLocator(scoped_ptr<RecordResolver> resolver);
+  ~SipLocator();
+
+  // Answers with a TTL of zero are never returned stale.
+  void set_max_stale(const base::TimeDelta &max_stale);
+
+  // Returns true if locating |uri| involves NAPTR or SRV lookups, i.e. if it
+  // has a host name and no explicit port. Otherwise, the target is given by
+  // |EndPoint::FromSipURI|.
+  static bool NeedsLookup(const SipURI &uri);
+
+  // Locates the targets of |uri|. Returns |net::OK| and fills |targets| when
+  // they're known without querying DNS, e.g. from cached answers; otherwise
+  // returns |net::ERR_IO_PENDING| and runs |callback| when done. Destroying
+  // the locator cancels the pending lookups.
+  int Locate(const SipURI &uri,
+             std::vector<EndPoint> *targets,
+             const LocateCallback &callback);
+
+  // Tells that a connection to |target|, one of the targets located, failed,
+  // e.g. timed out. It's given after the others for a while, longer each
+  // time it fails again in a row, until |ReportTargetSuccess| is called.
+  void ReportTargetFailure(const EndPoint &target);
+  void ReportTargetSuccess(const EndPoint &target);
+
+  // Orders |records| by ascending priority, and by a weighted random
+  // selection among records of the same priority (RFC 2782).
+  static void SortSrvRecords(SrvRecords *records,
+                             const net::RandIntCallback &rand_int);
+
+  void set_tick_clock_for_testing(base::TickClock *tick_clock) {
+    tick_clock_ = tick_clock;
+  }
+  void set_rand_int_for_testing(const net::RandIntCallback &rand_int) {
+    rand_int_ = rand_int;
+  }
+
+ private:
+  class Job;
+  template<class Records> class RecordCache;
+
+  typedef base::Callback<void(int, const NaptrRecords&)> NaptrLookupCallback;
+  typedef base::Callback<void(int, const SrvRecords&)> SrvLookupCallback;
+
+  // Look up the cache first; return true and fill |result| and |records|
+  // if the answer is known. Otherwise start a query, or join the pending
+  // one, and run |callback| later.
+  bool LookupNaptr(const std::string &domain,
+                   int *result, NaptrRecords *records,
+                   const NaptrLookupCallback &callback);
+  bool LookupSrv(const std::string &name,
+                 int *result, SrvRecords *records,
+                 const SrvLookupCallback &callback);
+
+  base::TimeTicks NowTicks() const;
+
+  void OnNaptrResolved(const std::string &domain, int result,
+                       const NaptrRecords &records,
+                       const base::TimeDelta &ttl);
+  void OnSrvResolved(const std::string &name, int result,
+                     const SrvRecords &records,
+                     const base::TimeDelta &ttl);
+
+  void OnJobComplete(Job *job, int result,
+                     const std::vector<EndPoint> &targets);
+
+  // Moves the targets that failed recently after the others, keeping their
+  // order otherwise.
+  void MoveFailedTargetsLast(std::vector<EndPoint> *targets) const;
+
+  struct TargetFailure {
+    TargetFailure() : failures(0) {}
+
+    // Consecutive failures of the target.
+    int failures;
+    // Until when the target is given after the others.
+    base::TimeTicks retry_time;
+  };
+
+  typedef std::map<EndPoint, TargetFailure, EndPointLess> TargetFailureMap;
+
+  scoped_ptr<RecordResolver> resolver_;
+  scoped_ptr<RecordCache<NaptrRecords> > naptr_cache_;
+  scoped_ptr<RecordCache<SrvRecords> > srv_cache_;
+  TargetFailureMap target_failures_;
+  std::set<Job*> jobs_;
+  base::TickClock *tick_clock_;
+  net::RandIntCallback rand_int_;
+  base::ThreadChecker thread_checker_;
+
+  base::WeakPtrFactory<SipLocator> weak_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(SipLocator);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_SIP_LOCATOR_H_
@@ -0,0 +1,539 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/sip_locator.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/test/simple_test_tick_clock.h"
+#include "net/base/net_errors.h"
+#include "sippet/uri/uri.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+SipLocator::NaptrRecord Naptr(uint16 order, uint16 preference,
+                              const char *flags, const char *service,
+                              const char *replacement) {
+  SipLocator::NaptrRecord record;
+  record.order = order;
+  record.preference = preference;
+  record.flags = flags;
+  record.service = service;
+  record.replacement = replacement;
+  return record;
+}
+
+SipLocator::SrvRecord Srv(uint16 priority, uint16 weight, uint16 port,
+                          const char *target) {
+  SipLocator::SrvRecord record;
+  record.priority = priority;
+  record.weight = weight;
+  record.port = port;
+  record.target = target;
+  return record;
+}
+
+int ReturnMin(int min, int max) {
+  return min;
+}
+
+int ReturnMax(int min, int max) {
+  return max;
+}
+
+// Answers from a fixed set of records; queries are held until |Complete|
+// is called, unless the resolver is synchronous.
+class FakeRecordResolver : public SipLocator::RecordResolver {
+ public:
+  FakeRecordResolver()
+    : synchronous_(false), ttl_(base::TimeDelta::FromMinutes(5)),
+      error_(net::OK) {}
+  ~FakeRecordResolver() override {}
+
+  void set_synchronous(bool synchronous) { synchronous_ = synchronous; }
+  void set_ttl(const base::TimeDelta &ttl) { ttl_ = ttl; }
+  // Fails the queries with |error|, unless it's |net::OK|.
+  void set_error(int error) { error_ = error; }
+
+  void AddNaptr(const std::string &domain,
+                const SipLocator::NaptrRecord &record) {
+    naptr_records_[domain].push_back(record);
+  }
+  void AddSrv(const std::string &name, const SipLocator::SrvRecord &record) {
+    srv_records_[name].push_back(record);
+  }
+
+  // Answers the pending queries, and the ones they lead to.
+  void Complete() {
+    while (!pending_.empty()) {
+      std::vector<base::Closure> pending;
+      pending.swap(pending_);
+      for (size_t i = 0; i < pending.size(); ++i)
+        pending[i].Run();
+    }
+  }
+
+  const std::vector<std::string> &queries() const { return queries_; }
+  void clear_queries() { queries_.clear(); }
+
+  // sippet::SipLocator::RecordResolver methods:
+  void ResolveNaptr(const std::string &domain,
+                    const NaptrCallback &callback) override {
+    queries_.push_back("NAPTR " + domain);
+    Answer(base::Bind(&FakeRecordResolver::AnswerNaptr,
+                      base::Unretained(this), domain, callback));
+  }
+  void ResolveSrv(const std::string &name,
+                  const SrvCallback &callback) override {
+    queries_.push_back("SRV " + name);
+    Answer(base::Bind(&FakeRecordResolver::AnswerSrv,
+                      base::Unretained(this), name, callback));
+  }
+
+ private:
+  void Answer(const base::Closure &answer) {
+    if (synchronous_)
+      answer.Run();
+    else
+      pending_.push_back(answer);
+  }
+  void AnswerNaptr(const std::string &domain, const NaptrCallback &callback) {
+    if (net::OK != error_) {
+      callback.Run(error_, SipLocator::NaptrRecords(), ttl_);
+      return;
+    }
+    const SipLocator::NaptrRecords &records = naptr_records_[domain];
+    callback.Run(records.empty() ? net::ERR_NAME_NOT_RESOLVED : net::OK,
+                 records, ttl_);
+  }
+  void AnswerSrv(const std::string &name, const SrvCallback &callback) {
+    if (net::OK != error_) {
+      callback.Run(error_, SipLocator::SrvRecords(), ttl_);
+      return;
+    }
+    const SipLocator::SrvRecords &records = srv_records_[name];
+    callback.Run(records.empty() ? net::ERR_NAME_NOT_RESOLVED : net::OK,
+                 records, ttl_);
+  }
+
+  bool synchronous_;
+  base::TimeDelta ttl_;
+  int error_;
+  std::map<std::string, SipLocator::NaptrRecords> naptr_records_;
+  std::map<std::string, SipLocator::SrvRecords> srv_records_;
+  std::vector<base::Closure> pending_;
+  std::vector<std::string> queries_;
+};
+
+class LocateResult {
+ public:
+  LocateResult() : result_(net::ERR_IO_PENDING), runs_(0) {}
+
+  SipLocator::LocateCallback callback() {
+    return base::Bind(&LocateResult::OnLocate, base::Unretained(this));
+  }
+
+  int result() const { return result_; }
+  int runs() const { return runs_; }
+  const std::vector<EndPoint> &targets() const { return targets_; }
+
+ private:
+  void OnLocate(int result, const std::vector<EndPoint> &targets) {
+    result_ = result;
+    targets_ = targets;
+    ++runs_;
+  }
+
+  int result_;
+  int runs_;
+  std::vector<EndPoint> targets_;
+};
+
+}  // namespace
+
+class SipLocatorTest : public testing::Test {
+ public:
+  void SetUp() override {
+    resolver_ = new FakeRecordResolver;
+    locator_.reset(new SipLocator(
+        scoped_ptr<SipLocator::RecordResolver>(resolver_)));
+    locator_->set_tick_clock_for_testing(&tick_clock_);
+    locator_->set_rand_int_for_testing(base::Bind(&ReturnMin));
+  }
+
+  int Locate(const char *uri, std::vector<EndPoint> *targets,
+             LocateResult *result) {
+    return locator_->Locate(SipURI(uri), targets, result->callback());
+  }
+
+  FakeRecordResolver *resolver_;
+  scoped_ptr<SipLocator> locator_;
+  base::SimpleTestTickClock tick_clock_;
+};
+
+TEST_F(SipLocatorTest, NeedsLookup) {
+  EXPECT_TRUE(SipLocator::NeedsLookup(SipURI("sip:example.com")));
+  EXPECT_TRUE(SipLocator::NeedsLookup(SipURI("sips:bob@example.com")));
+  EXPECT_FALSE(SipLocator::NeedsLookup(SipURI("sip:example.com:5060")));
+  EXPECT_FALSE(SipLocator::NeedsLookup(SipURI("sip:192.0.2.1")));
+  EXPECT_FALSE(SipLocator::NeedsLookup(SipURI("sip:[2001:db8::1]")));
+}
+
+TEST_F(SipLocatorTest, NoLookupWithPort) {
+  std::vector<EndPoint> targets;
+  LocateResult result;
+  EXPECT_EQ(net::OK, Locate("sip:example.com:5080;transport=tcp",
+                            &targets, &result));
+  ASSERT_EQ(1u, targets.size());
+  EXPECT_TRUE(EndPoint("example.com", 5080, Protocol::TCP) == targets[0]);
+  EXPECT_TRUE(resolver_->queries().empty());
+}
+
+TEST_F(SipLocatorTest, NaptrThenSrv) {
+  resolver_->AddNaptr("example.com",
+      Naptr(10, 20, "s", "SIP+D2T", "_sip._tcp.example.com"));
+  resolver_->AddNaptr("example.com",
+      Naptr(10, 10, "S", "SIP+D2U", "_sip._udp.example.com"));
+  resolver_->AddNaptr("example.com",
+      Naptr(5, 10, "u", "E2U+sip", "!^.*$!sip:info@example.com!"));
+  resolver_->AddSrv("_sip._udp.example.com",
+      Srv(0, 0, 5060, "a.example.com"));
+  resolver_->AddSrv("_sip._tcp.example.com",
+      Srv(1, 0, 5070, "c.example.com"));
+  resolver_->AddSrv("_sip._tcp.example.com",
+      Srv(0, 0, 5070, "b.example.com"));
+
+  std::vector<EndPoint> targets;
+  LocateResult result;
+  EXPECT_EQ(net::ERR_IO_PENDING, Locate("sip:example.com", &targets, &result));
+  resolver_->Complete();
+
+  EXPECT_EQ(1, result.runs());
+  EXPECT_EQ(net::OK, result.result());
+  ASSERT_EQ(3u, result.targets().size());
+  EXPECT_TRUE(EndPoint("a.example.com", 5060, Protocol::UDP) ==
+              result.targets()[0]);
+  EXPECT_TRUE(EndPoint("b.example.com", 5070, Protocol::TCP) ==
+              result.targets()[1]);
+  EXPECT_TRUE(EndPoint("c.example.com", 5070, Protocol::TCP) ==
+              result.targets()[2]);
+  ASSERT_EQ(3u, resolver_->queries().size());
+  EXPECT_EQ("NAPTR example.com", resolver_->queries()[0]);
+  EXPECT_EQ("SRV _sip._udp.example.com", resolver_->queries()[1]);
+  EXPECT_EQ("SRV _sip._tcp.example.com", resolver_->queries()[2]);
+}
+
+TEST_F(SipLocatorTest, SecureSchemeOnlyUsesTls) {
+  resolver_->AddNaptr("example.com",
+      Naptr(10, 10, "s", "SIP+D2U", "_sip._udp.example.com"));
+  resolver_->AddNaptr("example.com",
+      Naptr(20, 10, "s", "SIPS+D2T", "_sips._tcp.example.com"));
+  resolver_->AddSrv("_sips._tcp.example.com",
+      Srv(0, 0, 5061, "tls.example.com."));
+  resolver_->set_synchronous(true);
+
+  std::vector<EndPoint> targets;
+  LocateResult result;
+  EXPECT_EQ(net::OK, Locate("sips:example.com", &targets, &result));
+  EXPECT_EQ(0, result.runs());
+  ASSERT_EQ(1u, targets.size());
+  EXPECT_TRUE(EndPoint("tls.example.com", 5061, Protocol::TLS) ==
+              targets[0]);
+}
+
+TEST_F(SipLocatorTest, ExplicitTransport) {
+  resolver_->AddSrv("_sip._tcp.example.com",
+      Srv(0, 0, 5070, "tcp.example.com"));
+
+  std::vector<EndPoint> targets;
+  LocateResult result;
+  EXPECT_EQ(net::ERR_IO_PENDING,
+            Locate("sip:example.com;transport=tcp", &targets, &result));
+  resolver_->Complete();
+
+  ASSERT_EQ(1u, result.targets().size());
+  EXPECT_TRUE(EndPoint("tcp.example.com", 5070, Protocol::TCP) ==
+              result.targets()[0]);
+  ASSERT_EQ(1u, resolver_->queries().size());
+  EXPECT_EQ("SRV _sip._tcp.example.com", resolver_->queries()[0]);
+}
+
+TEST_F(SipLocatorTest, FallsBackToHost) {
+  resolver_->set_synchronous(true);
+
+  std::vector<EndPoint> targets;
+  LocateResult result;
+  EXPECT_EQ(net::OK, Locate("sip:example.com", &targets, &result));
+  ASSERT_EQ(1u, targets.size());
+  EXPECT_TRUE(EndPoint("example.com", 5060, Protocol::UDP) == targets[0]);
+  ASSERT_EQ(4u, resolver_->queries().size());
+  EXPECT_EQ("NAPTR example.com", resolver_->queries()[0]);
+  EXPECT_EQ("SRV _sip._udp.example.com", resolver_->queries()[1]);
+  EXPECT_EQ("SRV _sip._tcp.example.com", resolver_->queries()[2]);
+  EXPECT_EQ("SRV _sips._tcp.example.com", resolver_->queries()[3]);
+
+  resolver_->clear_queries();
+  EXPECT_EQ(net::OK, Locate("sips:example.org", &targets, &result));
+  ASSERT_EQ(1u, targets.size());
+  EXPECT_TRUE(EndPoint("example.org", 5061, Protocol::TLS) == targets[0]);
+  ASSERT_EQ(2u, resolver_->queries().size());
+  EXPECT_EQ("SRV _sips._tcp.example.org", resolver_->queries()[1]);
+}
+
+TEST_F(SipLocatorTest, SkipsUnavailableService) {
+  resolver_->AddSrv("_sip._udp.example.com", Srv(0, 0, 0, "."));
+  resolver_->set_synchronous(true);
+
+  std::vector<EndPoint> targets;
+  LocateResult result;
+  EXPECT_EQ(net::OK, Locate("sip:example.com;transport=udp",
+                            &targets, &result));
+  ASSERT_EQ(1u, targets.size());
+  EXPECT_TRUE(EndPoint("example.com", 5060, Protocol::UDP) == targets[0]);
+}
+
+TEST_F(SipLocatorTest, CachesAnswers) {
+  resolver_->AddSrv("_sip._udp.example.com",
+      Srv(0, 0, 5060, "a.example.com"));
+
+  // Concurrent lookups share the same queries.
+  std::vector<EndPoint> targets;
+  LocateResult first, second;
+  EXPECT_EQ(net::ERR_IO_PENDING, Locate("sip:example.com", &targets, &first));
+  EXPECT_EQ(net::ERR_IO_PENDING,
+            Locate("sip:alice@example.com", &targets, &second));
+  resolver_->Complete();
+  EXPECT_EQ(1, first.runs());
+  EXPECT_EQ(1, second.runs());
+  ASSERT_EQ(1u, second.targets().size());
+  EXPECT_TRUE(first.targets()[0] == second.targets()[0]);
+  size_t queries = resolver_->queries().size();
+  EXPECT_EQ(4u, queries);
+
+  // Positive and negative answers are cached.
+  LocateResult third;
+  EXPECT_EQ(net::OK, Locate("sip:bob@example.com", &targets, &third));
+  ASSERT_EQ(1u, targets.size());
+  EXPECT_TRUE(EndPoint("a.example.com", 5060, Protocol::UDP) == targets[0]);
+  EXPECT_EQ(queries, resolver_->queries().size());
+}
+
+TEST_F(SipLocatorTest, ExpiresAnswers) {
+  resolver_->set_ttl(base::TimeDelta::FromSeconds(30));
+  resolver_->set_synchronous(true);
+
+  std::vector<EndPoint> targets;
+  LocateResult result;
+  EXPECT_EQ(net::OK, Locate("sip:example.com;transport=tcp",
+                            &targets, &result));
+  EXPECT_EQ(1u, resolver_->queries().size());
+
+  tick_clock_.Advance(base::TimeDelta::FromSeconds(29));
+  EXPECT_EQ(net::OK, Locate("sip:example.com;transport=tcp",
+                            &targets, &result));
+  EXPECT_EQ(1u, resolver_->queries().size());
+
+  tick_clock_.Advance(base::TimeDelta::FromSeconds(1));
+  EXPECT_EQ(net::OK, Locate("sip:example.com;transport=tcp",
+                            &targets, &result));
+  EXPECT_EQ(2u, resolver_->queries().size());
+
+  // Answers without TTL aren't kept.
+  resolver_->set_ttl(base::TimeDelta());
+  tick_clock_.Advance(base::TimeDelta::FromSeconds(30));
+  EXPECT_EQ(net::OK, Locate("sip:example.com;transport=tcp",
+                            &targets, &result));
+  tick_clock_.Advance(base::TimeDelta::FromMilliseconds(1));
+  EXPECT_EQ(net::OK, Locate("sip:example.com;transport=tcp",
+                            &targets, &result));
+  EXPECT_EQ(4u, resolver_->queries().size());
+}
+
+TEST_F(SipLocatorTest, RetriesFailedQueriesLater) {
+  resolver_->set_ttl(base::TimeDelta());
+  resolver_->set_synchronous(true);
+  resolver_->set_error(net::ERR_DNS_TIMED_OUT);
+
+  std::vector<EndPoint> targets;
+  LocateResult result;
+  EXPECT_EQ(net::OK, Locate("sip:example.com;transport=tcp",
+                            &targets, &result));
+  ASSERT_EQ(1u, targets.size());
+  EXPECT_TRUE(EndPoint("example.com", 5060, Protocol::TCP) == targets[0]);
+  EXPECT_EQ(1u, resolver_->queries().size());
+
+  // Kept for a second, then twice as long each time it fails again.
+  tick_clock_.Advance(base::TimeDelta::FromMilliseconds(999));
+  EXPECT_EQ(net::OK, Locate("sip:example.com;transport=tcp",
+                            &targets, &result));
+  EXPECT_EQ(1u, resolver_->queries().size());
+  tick_clock_.Advance(base::TimeDelta::FromMilliseconds(1));
+  EXPECT_EQ(net::OK, Locate("sip:example.com;transport=tcp",
+                            &targets, &result));
+  EXPECT_EQ(2u, resolver_->queries().size());
+  tick_clock_.Advance(base::TimeDelta::FromMilliseconds(1999));
+  EXPECT_EQ(net::OK, Locate("sip:example.com;transport=tcp",
+                            &targets, &result));
+  EXPECT_EQ(2u, resolver_->queries().size());
+  tick_clock_.Advance(base::TimeDelta::FromMilliseconds(1));
+  EXPECT_EQ(net::OK, Locate("sip:example.com;transport=tcp",
+                            &targets, &result));
+  EXPECT_EQ(3u, resolver_->queries().size());
+
+  // Answers stop the backoff; without TTL, they aren't kept.
+  resolver_->set_error(net::OK);
+  resolver_->AddSrv("_sip._tcp.example.com",
+      Srv(0, 0, 5070, "tcp.example.com"));
+  tick_clock_.Advance(base::TimeDelta::FromSeconds(4));
+  EXPECT_EQ(net::OK, Locate("sip:example.com;transport=tcp",
+                            &targets, &result));
+  ASSERT_EQ(1u, targets.size());
+  EXPECT_TRUE(EndPoint("tcp.example.com", 5070, Protocol::TCP) ==
+              targets[0]);
+  EXPECT_EQ(4u, resolver_->queries().size());
+  EXPECT_EQ(net::OK, Locate("sip:example.com;transport=tcp",
+                            &targets, &result));
+  EXPECT_EQ(5u, resolver_->queries().size());
+  EXPECT_EQ(0, result.runs());
+}
+
+TEST_F(SipLocatorTest, ServesStaleAnswers) {
+  resolver_->AddSrv("_sip._tcp.example.com",
+      Srv(0, 0, 5070, "tcp.example.com"));
+  resolver_->set_ttl(base::TimeDelta::FromSeconds(30));
+  locator_->set_max_stale(base::TimeDelta::FromSeconds(60));
+  EndPoint target("tcp.example.com", 5070, Protocol::TCP);
+
+  std::vector<EndPoint> targets;
+  LocateResult result;
+  EXPECT_EQ(net::ERR_IO_PENDING,
+            Locate("sip:example.com;transport=tcp", &targets, &result));
+  resolver_->Complete();
+  EXPECT_EQ(1, result.runs());
+
+  // Expired answers are returned right away, while being refreshed.
+  tick_clock_.Advance(base::TimeDelta::FromSeconds(30));
+  EXPECT_EQ(net::OK, Locate("sip:example.com;transport=tcp",
+                            &targets, &result));
+  ASSERT_EQ(1u, targets.size());
+  EXPECT_TRUE(target == targets[0]);
+  EXPECT_EQ(net::OK, Locate("sip:example.com;transport=tcp",
+                            &targets, &result));
+  EXPECT_EQ(2u, resolver_->queries().size());
+  resolver_->Complete();
+  EXPECT_EQ(1, result.runs());
+  tick_clock_.Advance(base::TimeDelta::FromSeconds(29));
+  EXPECT_EQ(net::OK, Locate("sip:example.com;transport=tcp",
+                            &targets, &result));
+  EXPECT_EQ(2u, resolver_->queries().size());
+
+  // Refreshes that fail keep them, until they're stale for too long.
+  resolver_->set_error(net::ERR_DNS_SERVER_FAILED);
+  resolver_->set_synchronous(true);
+  tick_clock_.Advance(base::TimeDelta::FromSeconds(1));
+  EXPECT_EQ(net::OK, Locate("sip:example.com;transport=tcp",
+                            &targets, &result));
+  ASSERT_EQ(1u, targets.size());
+  EXPECT_TRUE(target == targets[0]);
+  EXPECT_EQ(3u, resolver_->queries().size());
+  tick_clock_.Advance(base::TimeDelta::FromSeconds(29));
+  EXPECT_EQ(net::OK, Locate("sip:example.com;transport=tcp",
+                            &targets, &result));
+  EXPECT_EQ(3u, resolver_->queries().size());
+  tick_clock_.Advance(base::TimeDelta::FromSeconds(1));
+  EXPECT_EQ(net::OK, Locate("sip:example.com;transport=tcp",
+                            &targets, &result));
+  EXPECT_TRUE(target == targets[0]);
+  EXPECT_EQ(4u, resolver_->queries().size());
+  tick_clock_.Advance(base::TimeDelta::FromSeconds(30));
+  EXPECT_EQ(net::OK, Locate("sip:example.com;transport=tcp",
+                            &targets, &result));
+  ASSERT_EQ(1u, targets.size());
+  EXPECT_TRUE(EndPoint("example.com", 5060, Protocol::TCP) == targets[0]);
+  EXPECT_EQ(5u, resolver_->queries().size());
+}
+
+TEST_F(SipLocatorTest, TriesFailedTargetsLast) {
+  resolver_->AddSrv("_sip._tcp.example.com",
+      Srv(0, 0, 5070, "a.example.com"));
+  resolver_->AddSrv("_sip._tcp.example.com",
+      Srv(1, 0, 5070, "b.example.com"));
+  resolver_->set_synchronous(true);
+  EndPoint a("a.example.com", 5070, Protocol::TCP);
+  EndPoint b("b.example.com", 5070, Protocol::TCP);
+
+  std::vector<EndPoint> targets;
+  LocateResult result;
+  locator_->ReportTargetFailure(a);
+  EXPECT_EQ(net::OK, Locate("sip:example.com;transport=tcp",
+                            &targets, &result));
+  ASSERT_EQ(2u, targets.size());
+  EXPECT_TRUE(b == targets[0]);
+  EXPECT_TRUE(a == targets[1]);
+
+  // For a while, twice as long each time it fails again.
+  tick_clock_.Advance(base::TimeDelta::FromSeconds(32));
+  EXPECT_EQ(net::OK, Locate("sip:example.com;transport=tcp",
+                            &targets, &result));
+  ASSERT_EQ(2u, targets.size());
+  EXPECT_TRUE(a == targets[0]);
+  locator_->ReportTargetFailure(a);
+  tick_clock_.Advance(base::TimeDelta::FromSeconds(63));
+  EXPECT_EQ(net::OK, Locate("sip:example.com;transport=tcp",
+                            &targets, &result));
+  ASSERT_EQ(2u, targets.size());
+  EXPECT_TRUE(b == targets[0]);
+  tick_clock_.Advance(base::TimeDelta::FromSeconds(1));
+  EXPECT_EQ(net::OK, Locate("sip:example.com;transport=tcp",
+                            &targets, &result));
+  ASSERT_EQ(2u, targets.size());
+  EXPECT_TRUE(a == targets[0]);
+
+  locator_->ReportTargetFailure(a);
+  locator_->ReportTargetSuccess(a);
+  EXPECT_EQ(net::OK, Locate("sip:example.com;transport=tcp",
+                            &targets, &result));
+  ASSERT_EQ(2u, targets.size());
+  EXPECT_TRUE(a == targets[0]);
+}
+
+TEST_F(SipLocatorTest, DestroyedWhilePending) {
+  std::vector<EndPoint> targets;
+  LocateResult result;
+  EXPECT_EQ(net::ERR_IO_PENDING, Locate("sip:example.com", &targets, &result));
+  locator_.reset();
+  EXPECT_EQ(0, result.runs());
+}
+
+TEST(SipLocatorSortTest, SortSrvRecords) {
+  SipLocator::SrvRecords records;
+  records.push_back(Srv(1, 0, 5060, "a"));
+  records.push_back(Srv(0, 10, 5060, "b"));
+  records.push_back(Srv(0, 20, 5060, "c"));
+  records.push_back(Srv(1, 5, 5060, "d"));
+
+  SipLocator::SrvRecords sorted(records);
+  SipLocator::SortSrvRecords(&sorted, base::Bind(&ReturnMax));
+  ASSERT_EQ(4u, sorted.size());
+  EXPECT_EQ("c", sorted[0].target);
+  EXPECT_EQ("b", sorted[1].target);
+  EXPECT_EQ("d", sorted[2].target);
+  EXPECT_EQ("a", sorted[3].target);
+
+  sorted = records;
+  SipLocator::SortSrvRecords(&sorted, base::Bind(&ReturnMin));
+  ASSERT_EQ(4u, sorted.size());
+  EXPECT_EQ("b", sorted[0].target);
+  EXPECT_EQ("c", sorted[1].target);
+  EXPECT_EQ("a", sorted[2].target);
+  EXPECT_EQ("d", sorted[3].target);
+}
+
+}  // namespace sippet
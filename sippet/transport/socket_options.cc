@@ -0,0 +1,17 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/socket_options.h"
+
+namespace sippet {
+
+SocketOptions GetSocketOptions(const SocketOptionsMap &profiles,
+                               const Protocol &protocol) {
+  SocketOptionsMap::const_iterator i = profiles.find(protocol);
+  if (profiles.end() == i)
+    return SocketOptions();
+  return i->second;
+}
+
+} // End of sippet namespace
@@ -0,0 +1,89 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_SOCKET_OPTIONS_H_
+#define SIPPET_TRANSPORT_SOCKET_OPTIONS_H_
+
+#include <map>
+
+#include "base/basictypes.h"
+#include "base/logging.h"
+#include "net/base/net_errors.h"
+#include "net/udp/diff_serv_code_point.h"
+#include "sippet/message/protocol.h"
+
+namespace sippet {
+
+// Options of the sockets carrying the signalling, so that it gets ahead of
+// bulk traffic under congestion, e.g. marked with DSCP CS3 or AF31 for the
+// routers of a managed network. They are applied as the sockets are
+// created: by channels when connecting, and by listeners when binding, and
+// to the connections they accept. Options a transport or platform can't
+// set are left to the system; failures are logged, and don't fail the
+// socket. The defaults leave every option as the system sets it.
+struct SocketOptions {
+  SocketOptions()
+    : dscp(net::DSCP_NO_CHANGE),
+      no_delay(false),
+      keepalive_delay(0),
+      send_buffer_size(0),
+      receive_buffer_size(0),
+      busy_poll_usecs(0),
+      receive_timestamps(false) {}
+
+  bool IsEnabled() const {
+    return net::DSCP_NO_CHANGE != dscp || no_delay || keepalive_delay > 0
+        || send_buffer_size > 0 || receive_buffer_size > 0
+        || busy_poll_usecs > 0 || receive_timestamps;
+  }
+
+  // Sets the buffer sizes of |socket|, those that are not zero; either a
+  // |net::Socket| or a |net::DatagramServerSocket|.
+  template<class SocketType>
+  void ApplyBufferSizes(SocketType *socket) const {
+    DCHECK(socket);
+    if (send_buffer_size > 0) {
+      int result = socket->SetSendBufferSize(send_buffer_size);
+      LOG_IF(WARNING, net::OK != result)
+          << "Failed to set SO_SNDBUF: " << net::ErrorToString(result);
+    }
+    if (receive_buffer_size > 0) {
+      int result = socket->SetReceiveBufferSize(receive_buffer_size);
+      LOG_IF(WARNING, net::OK != result)
+          << "Failed to set SO_RCVBUF: " << net::ErrorToString(result);
+    }
+  }
+
+  // The code point of the outgoing packets.
+  net::DiffServCodePoint dscp;
+  // Sets TCP_NODELAY, disabling Nagle's algorithm, on the accepted TCP
+  // connections. Outgoing ones always have it, set by the net sockets.
+  bool no_delay;
+  // Seconds of idle TCP connections before TCP keep-alives are sent. Zero
+  // leaves the system default. Outgoing connections keep the 45 seconds of
+  // the net sockets.
+  int keepalive_delay;
+  // Bytes of the SO_SNDBUF and SO_RCVBUF buffers.
+  int32 send_buffer_size;
+  int32 receive_buffer_size;
+  // Microseconds of SO_BUSY_POLL on receive, trading CPU for latency. Only
+  // set by the native Linux transport.
+  int busy_poll_usecs;
+  // Has the kernel stamp the datagrams received (SO_TIMESTAMPNS), so that
+  // their |Message::receive_time| includes the time spent in the socket
+  // queue. Only set by the native Linux transport; other readers stamp
+  // messages as they read them.
+  bool receive_timestamps;
+};
+
+// Socket options by protocol, see |NetworkSettings::socket_options|.
+typedef std::map<Protocol, SocketOptions, ProtocolLess> SocketOptionsMap;
+
+// The options of |protocol| in |profiles|, the defaults if it has none.
+SocketOptions GetSocketOptions(const SocketOptionsMap &profiles,
+                               const Protocol &protocol);
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_SOCKET_OPTIONS_H_
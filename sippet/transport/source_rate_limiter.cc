@@ -0,0 +1,79 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/source_rate_limiter.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "base/hash.h"
+#include "base/logging.h"
+#include "base/rand_util.h"
+#include "base/time/tick_clock.h"
+
+namespace sippet {
+
+namespace {
+
+// Keys are the seed and the row, followed by the address.
+const size_t kKeyPrefixSize = sizeof(uint32) + 1;
+
+// Large enough for IPv6 addresses.
+const size_t kMaxAddressSize = 16;
+
+}  // namespace
+
+SourceRateLimiter::SourceRateLimiter(double rate, double burst, size_t width)
+  : rate_(rate),
+    burst_(std::max(burst, 1.0)),
+    width_(width),
+    seed_(static_cast<uint32>(base::RandUint64())),
+    tick_clock_(nullptr) {
+  DCHECK_GT(rate_, 0.0);
+  DCHECK_GT(width_, 0u);
+  Bucket full = { burst_, base::TimeTicks() };
+  buckets_.resize(kDepth * width_, full);
+}
+
+SourceRateLimiter::~SourceRateLimiter() {
+}
+
+bool SourceRateLimiter::Admit(const net::IPAddressNumber &address) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  base::TimeTicks now = Now();
+  char key[kKeyPrefixSize + kMaxAddressSize];
+  size_t address_size = std::min(address.size(), kMaxAddressSize);
+  memcpy(key, &seed_, sizeof(seed_));
+  if (address_size > 0)
+    memcpy(key + kKeyPrefixSize, &address[0], address_size);
+  size_t key_size = kKeyPrefixSize + address_size;
+
+  Bucket *rows[kDepth];
+  bool admitted = false;
+  for (size_t row = 0; row < kDepth; ++row) {
+    key[kKeyPrefixSize - 1] = static_cast<char>(row);
+    Bucket *bucket = &buckets_[row * width_
+        + base::Hash(key, key_size) % width_];
+    if (!bucket->last_refill.is_null()) {
+      double elapsed = (now - bucket->last_refill).InSecondsF();
+      bucket->tokens = std::min(burst_, bucket->tokens + elapsed * rate_);
+    }
+    bucket->last_refill = now;
+    if (bucket->tokens >= 1.0)
+      admitted = true;
+    rows[row] = bucket;
+  }
+  if (!admitted)
+    return false;
+  for (size_t row = 0; row < kDepth; ++row)
+    rows[row]->tokens = std::max(0.0, rows[row]->tokens - 1.0);
+  return true;
+}
+
+base::TimeTicks SourceRateLimiter::Now() const {
+  return tick_clock_ ? tick_clock_->NowTicks() : base::TimeTicks::Now();
+}
+
+} // End of sippet namespace
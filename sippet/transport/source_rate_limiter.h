@@ -0,0 +1,74 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_SOURCE_RATE_LIMITER_H_
+#define SIPPET_TRANSPORT_SOURCE_RATE_LIMITER_H_
+
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/threading/thread_checker.h"
+#include "base/time/time.h"
+#include "net/base/ip_address_number.h"
+
+namespace base {
+class TickClock;
+}
+
+namespace sippet {
+
+// Limits the rate of the messages, or connections, accepted from each
+// source IP address, so that a flooding peer is dropped by the listeners
+// before anything is parsed or allocated for it.
+//
+// Each address is given a token bucket, refilled at |rate| tokens per
+// second up to |burst|, and taking one token per message. The buckets are
+// kept in a count-min sketch: |kDepth| rows of |width| buckets, where each
+// address hashes to one bucket per row, so that memory stays bounded no
+// matter how many addresses are seen. An address is admitted while any of
+// its buckets has a token left; colliding with a heavy hitter in some row
+// doesn't penalize it, only a source depleting all its buckets is dropped.
+//
+// It's meant to be used from a single thread; each network layer of
+// |NetworkLayerShards| needs its own.
+class SourceRateLimiter {
+ public:
+  // Rows of the sketch.
+  static const size_t kDepth = 4;
+
+  SourceRateLimiter(double rate, double burst, size_t width);
+  ~SourceRateLimiter();
+
+  // Takes a token from the buckets of |address|, returning false if there
+  // was none, and the message must be dropped.
+  bool Admit(const net::IPAddressNumber &address);
+
+  void set_tick_clock_for_testing(base::TickClock *tick_clock) {
+    tick_clock_ = tick_clock;
+  }
+
+ private:
+  struct Bucket {
+    double tokens;
+    base::TimeTicks last_refill;
+  };
+
+  base::TimeTicks Now() const;
+
+  double rate_;
+  double burst_;
+  size_t width_;
+  // Row after row, |width_| buckets each.
+  std::vector<Bucket> buckets_;
+  // Makes the buckets of an address unpredictable to the peers.
+  uint32 seed_;
+  base::TickClock *tick_clock_;
+  base::ThreadChecker thread_checker_;
+
+  DISALLOW_COPY_AND_ASSIGN(SourceRateLimiter);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_SOURCE_RATE_LIMITER_H_
@@ -0,0 +1,75 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/source_rate_limiter.h"
+
+#include "base/test/simple_test_tick_clock.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+net::IPAddressNumber MakeAddress(int host) {
+  net::IPAddressNumber address;
+  address.push_back(10);
+  address.push_back(0);
+  address.push_back(static_cast<unsigned char>(host >> 8));
+  address.push_back(static_cast<unsigned char>(host));
+  return address;
+}
+
+}  // namespace
+
+class SourceRateLimiterTest : public testing::Test {
+ public:
+  SourceRateLimiterTest() {
+    clock_.Advance(base::TimeDelta::FromSeconds(1));
+  }
+
+  base::SimpleTestTickClock clock_;
+};
+
+TEST_F(SourceRateLimiterTest, RefillsAtRate) {
+  SourceRateLimiter limiter(10, 5, 1024);
+  limiter.set_tick_clock_for_testing(&clock_);
+  net::IPAddressNumber address(MakeAddress(1));
+
+  // The burst goes through, then the source is held to the rate.
+  for (int i = 0; i < 5; ++i)
+    EXPECT_TRUE(limiter.Admit(address)) << i;
+  EXPECT_FALSE(limiter.Admit(address));
+  clock_.Advance(base::TimeDelta::FromMilliseconds(100));
+  EXPECT_TRUE(limiter.Admit(address));
+  EXPECT_FALSE(limiter.Admit(address));
+
+  // Buckets never hold more than the burst.
+  clock_.Advance(base::TimeDelta::FromSeconds(60));
+  for (int i = 0; i < 5; ++i)
+    EXPECT_TRUE(limiter.Admit(address)) << i;
+  EXPECT_FALSE(limiter.Admit(address));
+}
+
+TEST_F(SourceRateLimiterTest, SparesOtherSources) {
+  SourceRateLimiter limiter(1, 2, 256);
+  limiter.set_tick_clock_for_testing(&clock_);
+  net::IPAddressNumber flooder(MakeAddress(1));
+  int dropped = 0;
+  for (int i = 0; i < 100; ++i) {
+    if (!limiter.Admit(flooder))
+      ++dropped;
+  }
+  EXPECT_EQ(98, dropped);
+
+  // Sharing a bucket with the flooder in some rows doesn't drop a source;
+  // only colliding in all of them would, which is rare.
+  int admitted = 0;
+  for (int host = 2; host < 52; ++host) {
+    if (limiter.Admit(MakeAddress(host)))
+      ++admitted;
+  }
+  EXPECT_GE(admitted, 48);
+}
+
+}  // namespace sippet
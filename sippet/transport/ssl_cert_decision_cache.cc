@@ -0,0 +1,72 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/ssl_cert_decision_cache.h"
+
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/time/tick_clock.h"
+
+namespace sippet {
+
+SSLCertDecisionCache::SSLCertDecisionCache(size_t max_entries)
+  : ttl_(base::TimeDelta::FromSeconds(kDefaultTtlSeconds)),
+    entries_(max_entries),
+    tick_clock_(nullptr) {
+}
+
+SSLCertDecisionCache::~SSLCertDecisionCache() {
+}
+
+SSLCertDecisionCache::Decision SSLCertDecisionCache::Lookup(
+    const std::string &host,
+    const net::SHA256HashValue &fingerprint,
+    net::CertStatus cert_status) {
+  EntryCache::iterator i = entries_.Get(GetKey(host, fingerprint));
+  if (entries_.end() == i)
+    return UNKNOWN;
+  if (i->second.expires <= NowTicks()) {
+    entries_.Erase(i);
+    return UNKNOWN;
+  }
+  net::CertStatus errors = cert_status & net::CERT_STATUS_ALL_ERRORS;
+  if (i->second.accepted)
+    return (errors & ~i->second.errors) ? UNKNOWN : ACCEPTED;
+  return (i->second.errors & ~errors) ? UNKNOWN : REJECTED;
+}
+
+void SSLCertDecisionCache::Add(const std::string &host,
+                               const net::SHA256HashValue &fingerprint,
+                               net::CertStatus cert_status,
+                               bool accepted) {
+  if (ttl_ <= base::TimeDelta())
+    return;
+  DVLOG(1) << "Remembering the certificate of " << host << " as "
+           << (accepted ? "accepted" : "rejected");
+  Entry entry;
+  entry.accepted = accepted;
+  entry.errors = cert_status & net::CERT_STATUS_ALL_ERRORS;
+  entry.expires = NowTicks() + ttl_;
+  entries_.Put(GetKey(host, fingerprint), entry);
+}
+
+void SSLCertDecisionCache::Clear() {
+  entries_.Clear();
+}
+
+std::string SSLCertDecisionCache::GetKey(
+    const std::string &host,
+    const net::SHA256HashValue &fingerprint) {
+  // Host names can't hold a NUL.
+  std::string key(host);
+  key.append(1, '\0').append(
+      base::HexEncode(fingerprint.data, sizeof(fingerprint.data)));
+  return key;
+}
+
+base::TimeTicks SSLCertDecisionCache::NowTicks() const {
+  return tick_clock_ ? tick_clock_->NowTicks() : base::TimeTicks::Now();
+}
+
+} // End of sippet namespace
@@ -0,0 +1,103 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_SSL_CERT_DECISION_CACHE_H_
+#define SIPPET_TRANSPORT_SSL_CERT_DECISION_CACHE_H_
+
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/containers/mru_cache.h"
+#include "base/time/time.h"
+#include "net/base/hash_value.h"
+#include "net/cert/cert_status_flags.h"
+
+namespace base {
+class TickClock;
+}
+
+namespace sippet {
+
+// Remembers what the |SSLCertErrorHandler| decided about the certificate
+// errors of SIPS and WSS destinations, so that reconnections, and the new
+// channels opened after the old ones were closed, don't ask again. The
+// certificate itself is verified again by the SSL socket, whose verifier
+// keeps the results of its own; what's kept here is the answer, which may
+// have taken a user prompt.
+//
+// Decisions are keyed by the host and the SHA-256 fingerprint of the
+// server certificate, and only apply to the errors they were taken for:
+// an accepted certificate is accepted again while it shows no other
+// errors, and a rejected one is rejected again while it shows the same
+// errors, at least.
+class SSLCertDecisionCache {
+ public:
+  enum Decision {
+    UNKNOWN,
+    ACCEPTED,
+    REJECTED,
+  };
+
+  // Default time decisions are kept, in seconds.
+  static const int kDefaultTtlSeconds = 3600;
+  // Default number of decisions kept; the least recently used ones are
+  // dropped first.
+  static const size_t kDefaultMaxEntries = 256;
+
+  explicit SSLCertDecisionCache(size_t max_entries = kDefaultMaxEntries);
+  ~SSLCertDecisionCache();
+
+  void set_ttl(base::TimeDelta ttl) {
+    ttl_ = ttl;
+  }
+
+  // The decision taken for the certificate of |fingerprint| presented by
+  // |host|, failing with |cert_status|, if any and not expired yet.
+  Decision Lookup(const std::string &host,
+                  const net::SHA256HashValue &fingerprint,
+                  net::CertStatus cert_status);
+
+  // Remembers the decision taken for the certificate of |fingerprint|
+  // presented by |host|, failing with |cert_status|.
+  void Add(const std::string &host,
+           const net::SHA256HashValue &fingerprint,
+           net::CertStatus cert_status,
+           bool accepted);
+
+  // Forgets all decisions, e.g. when the user revokes them.
+  void Clear();
+
+  size_t size() const {
+    return entries_.size();
+  }
+
+  void set_tick_clock_for_testing(base::TickClock *tick_clock) {
+    tick_clock_ = tick_clock;
+  }
+
+ private:
+  struct Entry {
+    bool accepted;
+    // The errors the decision was taken for.
+    net::CertStatus errors;
+    base::TimeTicks expires;
+  };
+
+  typedef base::HashingMRUCache<std::string, Entry> EntryCache;
+
+  static std::string GetKey(const std::string &host,
+                            const net::SHA256HashValue &fingerprint);
+
+  base::TimeTicks NowTicks() const;
+
+  base::TimeDelta ttl_;
+  EntryCache entries_;
+  base::TickClock *tick_clock_;
+
+  DISALLOW_COPY_AND_ASSIGN(SSLCertDecisionCache);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_SSL_CERT_DECISION_CACHE_H_
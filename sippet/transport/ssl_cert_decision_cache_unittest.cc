@@ -0,0 +1,82 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/ssl_cert_decision_cache.h"
+
+#include <string.h>
+
+#include "base/test/simple_test_tick_clock.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const char kHost[] = "proxy.atlanta.com";
+
+net::SHA256HashValue MakeFingerprint(unsigned char value) {
+  net::SHA256HashValue fingerprint;
+  memset(fingerprint.data, value, sizeof(fingerprint.data));
+  return fingerprint;
+}
+
+class SSLCertDecisionCacheTest : public testing::Test {
+ public:
+  SSLCertDecisionCacheTest()
+    : fingerprint_(MakeFingerprint(1)) {
+    clock_.Advance(base::TimeDelta::FromSeconds(1));
+    cache_.set_tick_clock_for_testing(&clock_);
+  }
+
+  base::SimpleTestTickClock clock_;
+  SSLCertDecisionCache cache_;
+  net::SHA256HashValue fingerprint_;
+};
+
+}  // namespace
+
+TEST_F(SSLCertDecisionCacheTest, ExpiresAfterTtl) {
+  EXPECT_EQ(SSLCertDecisionCache::UNKNOWN, cache_.Lookup(
+      kHost, fingerprint_, net::CERT_STATUS_AUTHORITY_INVALID));
+  cache_.Add(kHost, fingerprint_, net::CERT_STATUS_AUTHORITY_INVALID, true);
+  EXPECT_EQ(SSLCertDecisionCache::ACCEPTED, cache_.Lookup(
+      kHost, fingerprint_, net::CERT_STATUS_AUTHORITY_INVALID));
+
+  // Another certificate, or another host presenting it, is asked again.
+  EXPECT_EQ(SSLCertDecisionCache::UNKNOWN, cache_.Lookup(
+      kHost, MakeFingerprint(2), net::CERT_STATUS_AUTHORITY_INVALID));
+  EXPECT_EQ(SSLCertDecisionCache::UNKNOWN, cache_.Lookup(
+      "proxy.biloxi.com", fingerprint_, net::CERT_STATUS_AUTHORITY_INVALID));
+
+  clock_.Advance(base::TimeDelta::FromSeconds(
+      SSLCertDecisionCache::kDefaultTtlSeconds));
+  EXPECT_EQ(SSLCertDecisionCache::UNKNOWN, cache_.Lookup(
+      kHost, fingerprint_, net::CERT_STATUS_AUTHORITY_INVALID));
+  EXPECT_EQ(0u, cache_.size());
+}
+
+TEST_F(SSLCertDecisionCacheTest, AppliesToSameErrors) {
+  cache_.Add(kHost, fingerprint_, net::CERT_STATUS_AUTHORITY_INVALID, true);
+  // Accepting a self-signed certificate doesn't accept it expired.
+  EXPECT_EQ(SSLCertDecisionCache::UNKNOWN, cache_.Lookup(
+      kHost, fingerprint_,
+      net::CERT_STATUS_AUTHORITY_INVALID | net::CERT_STATUS_DATE_INVALID));
+  // Flags other than errors don't matter.
+  EXPECT_EQ(SSLCertDecisionCache::ACCEPTED, cache_.Lookup(
+      kHost, fingerprint_,
+      net::CERT_STATUS_AUTHORITY_INVALID | net::CERT_STATUS_IS_EV));
+
+  // Rejecting an expired certificate doesn't reject it once renewed.
+  cache_.Add(kHost, fingerprint_, net::CERT_STATUS_DATE_INVALID, false);
+  EXPECT_EQ(SSLCertDecisionCache::REJECTED, cache_.Lookup(
+      kHost, fingerprint_,
+      net::CERT_STATUS_DATE_INVALID | net::CERT_STATUS_AUTHORITY_INVALID));
+  EXPECT_EQ(SSLCertDecisionCache::UNKNOWN, cache_.Lookup(
+      kHost, fingerprint_, net::CERT_STATUS_AUTHORITY_INVALID));
+
+  cache_.Clear();
+  EXPECT_EQ(0u, cache_.size());
+}
+
+} // End of sippet namespace
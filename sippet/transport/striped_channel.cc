@@ -0,0 +1,385 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/striped_channel.h"
+
+#include "base/logging.h"
+#include "net/base/net_errors.h"
+#include "sippet/message/message.h"
+#include "sippet/transport/network_layer_shards.h"
+
+namespace sippet {
+
+StripedChannel::Stripe::Stripe()
+  : connected(false),
+    congested(false) {
+}
+
+StripedChannel::Stripe::~Stripe() {
+}
+
+StripedChannel::StripedChannel(const EndPoint &destination,
+                               Channel::Delegate *delegate,
+                               ChannelFactory *factory,
+                               size_t stripe_count)
+  : destination_(destination),
+    delegate_(delegate),
+    factory_(factory),
+    stripe_count_(stripe_count),
+    is_connected_(false),
+    is_congested_(false) {
+  DCHECK(delegate_);
+  DCHECK(factory_);
+  DCHECK_GT(stripe_count_, 0u);
+}
+
+StripedChannel::~StripedChannel() {
+  for (size_t i = 0; i < stripes_.size(); ++i) {
+    if (stripes_[i].channel.get())
+      stripes_[i].channel->DetachDelegate();
+  }
+}
+
+int StripedChannel::Init() {
+  DCHECK(stripes_.empty());
+  scoped_refptr<Channel> channel;
+  int result = factory_->CreateChannel(destination_, this, &channel);
+  if (net::OK != result)
+    return result;
+  DCHECK(channel->is_stream());
+  stripes_.resize(1);
+  stripes_[0].channel = channel;
+  return net::OK;
+}
+
+size_t StripedChannel::GetConnectedStripeCount() const {
+  size_t count = 0;
+  for (size_t i = 0; i < stripes_.size(); ++i) {
+    if (stripes_[i].connected)
+      ++count;
+  }
+  return count;
+}
+
+int StripedChannel::origin(EndPoint *origin) const {
+  Channel *channel = primary();
+  if (!channel)
+    return net::ERR_SOCKET_NOT_CONNECTED;
+  return channel->origin(origin);
+}
+
+const EndPoint& StripedChannel::destination() const {
+  return destination_;
+}
+
+bool StripedChannel::is_secure() const {
+  Channel *channel = primary();
+  return channel && channel->is_secure();
+}
+
+bool StripedChannel::is_connected() const {
+  return is_connected_;
+}
+
+bool StripedChannel::is_stream() const {
+  return true;
+}
+
+void StripedChannel::Connect() {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  DCHECK(!is_connected_);
+  DCHECK_EQ(1u, stripes_.size());
+  ApplySettings(stripes_[0].channel.get());
+  stripes_[0].channel->Connect();
+}
+
+int StripedChannel::ReconnectIgnoringLastError() {
+  if (is_connected_ || !stripes_[0].channel.get())
+    return net::ERR_UNEXPECTED;
+  return stripes_[0].channel->ReconnectIgnoringLastError();
+}
+
+int StripedChannel::ReconnectWithCertificate(
+    net::X509Certificate* client_cert) {
+  if (is_connected_ || !stripes_[0].channel.get())
+    return net::ERR_UNEXPECTED;
+  return stripes_[0].channel->ReconnectWithCertificate(client_cert);
+}
+
+int StripedChannel::Send(const scoped_refptr<Message> &message,
+                         const net::CompletionCallback& callback) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  if (!is_connected_)
+    return net::ERR_SOCKET_NOT_CONNECTED;
+  size_t first = NetworkLayerShards::ShardOf(*message, stripe_count_);
+  for (size_t i = 0; i < stripe_count_; ++i) {
+    size_t index = (first + i) % stripe_count_;
+    if (index < stripes_.size() && stripes_[index].connected)
+      return stripes_[index].channel->Send(message, callback);
+  }
+  NOTREACHED();
+  return net::ERR_SOCKET_NOT_CONNECTED;
+}
+
+int StripedChannel::SendKeepAlive(const net::CompletionCallback& callback) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  // Each connection crosses the NATs on its own, so all are kept alive; the
+  // result is the one of the first.
+  int result = net::ERR_SOCKET_NOT_CONNECTED;
+  bool first = true;
+  for (size_t i = 0; i < stripes_.size(); ++i) {
+    if (!stripes_[i].connected)
+      continue;
+    if (first) {
+      result = stripes_[i].channel->SendKeepAlive(callback);
+      first = false;
+    } else {
+      stripes_[i].channel->SendKeepAlive(net::CompletionCallback());
+    }
+  }
+  return result;
+}
+
+void StripedChannel::SetWriteQueueLimits(const WriteQueueLimits &limits) {
+  write_queue_limits_ = limits;
+  for (size_t i = 0; i < stripes_.size(); ++i) {
+    if (stripes_[i].channel.get())
+      stripes_[i].channel->SetWriteQueueLimits(limits);
+  }
+}
+
+void StripedChannel::SetParseProfile(const ParseProfile &profile) {
+  parse_profile_ = profile;
+  for (size_t i = 0; i < stripes_.size(); ++i) {
+    if (stripes_[i].channel.get())
+      stripes_[i].channel->SetParseProfile(profile);
+  }
+}
+
+void StripedChannel::SetMessageLimits(const MessageLimits &limits) {
+  message_limits_ = limits;
+  for (size_t i = 0; i < stripes_.size(); ++i) {
+    if (stripes_[i].channel.get())
+      stripes_[i].channel->SetMessageLimits(limits);
+  }
+}
+
+void StripedChannel::SetSocketOptions(const SocketOptions &options) {
+  socket_options_ = options;
+}
+
+void StripedChannel::Close() {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  is_connected_ = false;
+  for (size_t i = 0; i < stripes_.size(); ++i) {
+    if (stripes_[i].channel.get())
+      stripes_[i].channel->Close();
+  }
+}
+
+void StripedChannel::CloseWithError(int err) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  for (size_t i = 0; i < stripes_.size(); ++i) {
+    if (stripes_[i].channel.get())
+      stripes_[i].channel->CloseWithError(err);
+  }
+}
+
+void StripedChannel::DetachDelegate() {
+  delegate_ = nullptr;
+  Close();
+}
+
+void StripedChannel::OnChannelConnected(const scoped_refptr<Channel> &channel,
+                                        int error) {
+  size_t index = IndexOf(channel);
+  if (stripes_.size() == index)
+    return;
+  if (net::OK != error) {
+    if (0 == index && !is_connected_) {
+      // Kept for |ReconnectIgnoringLastError|.
+      if (delegate_)
+        delegate_->OnChannelConnected(this, error);
+      return;
+    }
+    DVLOG(1) << "Stripe " << index << " to " << destination_.ToString()
+             << " failed to connect: " << net::ErrorToString(error);
+    DropStripe(index);
+    return;
+  }
+  stripes_[index].connected = true;
+  if (0 == index && !is_connected_) {
+    is_connected_ = true;
+    // The delegate may close the channel, and release its last reference.
+    scoped_refptr<Channel> protect(this);
+    if (delegate_)
+      delegate_->OnChannelConnected(this, net::OK);
+    if (is_connected_)
+      ConnectOtherStripes();
+  }
+}
+
+void StripedChannel::OnIncomingMessage(const scoped_refptr<Channel> &channel,
+                                       const scoped_refptr<Message> &message) {
+  if (delegate_)
+    delegate_->OnIncomingMessage(this, message);
+}
+
+void StripedChannel::OnChannelClosed(const scoped_refptr<Channel> &channel,
+                                     int error) {
+  size_t index = IndexOf(channel);
+  if (stripes_.size() == index)
+    return;
+  DVLOG(1) << "Stripe " << index << " to " << destination_.ToString()
+           << " closed: " << net::ErrorToString(error);
+  DropStripe(index);
+  if (!is_connected_ || GetConnectedStripeCount() > 0)
+    return;
+  // Those still connecting are not waited for.
+  for (size_t i = 0; i < stripes_.size(); ++i) {
+    if (stripes_[i].channel.get())
+      DropStripe(i);
+  }
+  is_connected_ = false;
+  if (delegate_)
+    delegate_->OnChannelClosed(this, error);
+}
+
+void StripedChannel::OnSSLCertificateError(
+    const scoped_refptr<Channel> &channel,
+    const net::SSLInfo &ssl_info,
+    bool fatal) {
+  size_t index = IndexOf(channel);
+  if (stripes_.size() == index)
+    return;
+  if (0 == index && !is_connected_) {
+    if (delegate_)
+      delegate_->OnSSLCertificateError(this, ssl_info, fatal);
+    return;
+  }
+  // The certificate of the first stripe was accepted already; another one
+  // is not worth asking for.
+  DVLOG(1) << "Stripe " << index << " to " << destination_.ToString()
+           << " got a different certificate";
+  DropStripe(index);
+}
+
+void StripedChannel::OnKeepAliveReceived(
+    const scoped_refptr<Channel> &channel) {
+  if (delegate_)
+    delegate_->OnKeepAliveReceived(this);
+}
+
+void StripedChannel::OnOutgoingMessage(const scoped_refptr<Channel> &channel,
+                                       const scoped_refptr<Message> &message) {
+  if (delegate_)
+    delegate_->OnOutgoingMessage(this, message);
+}
+
+void StripedChannel::OnChannelCongested(
+    const scoped_refptr<Channel> &channel) {
+  size_t index = IndexOf(channel);
+  if (stripes_.size() == index)
+    return;
+  stripes_[index].congested = true;
+  UpdateCongestion();
+}
+
+void StripedChannel::OnChannelWritable(const scoped_refptr<Channel> &channel) {
+  size_t index = IndexOf(channel);
+  if (stripes_.size() == index)
+    return;
+  stripes_[index].congested = false;
+  UpdateCongestion();
+}
+
+size_t StripedChannel::IndexOf(const scoped_refptr<Channel> &channel) const {
+  for (size_t i = 0; i < stripes_.size(); ++i) {
+    if (stripes_[i].channel.get() == channel.get())
+      return i;
+  }
+  return stripes_.size();
+}
+
+Channel *StripedChannel::primary() const {
+  for (size_t i = 0; i < stripes_.size(); ++i) {
+    if (stripes_[i].channel.get())
+      return stripes_[i].channel.get();
+  }
+  return nullptr;
+}
+
+void StripedChannel::ConnectOtherStripes() {
+  DCHECK_EQ(1u, stripes_.size());
+  stripes_.resize(stripe_count_);
+  for (size_t i = 1; i < stripe_count_; ++i) {
+    scoped_refptr<Channel> channel;
+    int result = factory_->CreateChannel(destination_, this, &channel);
+    if (net::OK != result) {
+      DVLOG(1) << "Failed to create stripe " << i << " to "
+               << destination_.ToString() << ": "
+               << net::ErrorToString(result);
+      continue;
+    }
+    stripes_[i].channel = channel;
+    ApplySettings(channel.get());
+    channel->Connect();
+  }
+}
+
+void StripedChannel::ApplySettings(Channel *channel) {
+  channel->SetWriteQueueLimits(write_queue_limits_);
+  channel->SetParseProfile(parse_profile_);
+  channel->SetMessageLimits(message_limits_);
+  channel->SetSocketOptions(socket_options_);
+}
+
+void StripedChannel::DropStripe(size_t index) {
+  scoped_refptr<Channel> channel;
+  channel.swap(stripes_[index].channel);
+  stripes_[index].connected = false;
+  stripes_[index].congested = false;
+  channel->DetachDelegate();
+  UpdateCongestion();
+}
+
+void StripedChannel::UpdateCongestion() {
+  bool congested = false;
+  for (size_t i = 0; i < stripes_.size(); ++i)
+    congested = congested || stripes_[i].congested;
+  if (congested == is_congested_)
+    return;
+  is_congested_ = congested;
+  if (!delegate_)
+    return;
+  if (congested)
+    delegate_->OnChannelCongested(this);
+  else
+    delegate_->OnChannelWritable(this);
+}
+
+StripedChannelFactory::StripedChannelFactory(ChannelFactory *factory,
+                                             size_t stripe_count)
+  : factory_(factory),
+    stripe_count_(stripe_count) {
+  DCHECK(factory_);
+  DCHECK_GT(stripe_count_, 0u);
+}
+
+StripedChannelFactory::~StripedChannelFactory() {
+}
+
+int StripedChannelFactory::CreateChannel(const EndPoint &destination,
+                                         Channel::Delegate *delegate,
+                                         scoped_refptr<Channel> *channel) {
+  scoped_refptr<StripedChannel> striped_channel(
+      new StripedChannel(destination, delegate, factory_, stripe_count_));
+  int result = striped_channel->Init();
+  if (net::OK != result)
+    return result;
+  *channel = striped_channel;
+  return net::OK;
+}
+
+} // End of sippet namespace
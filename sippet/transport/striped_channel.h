@@ -0,0 +1,151 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_STRIPED_CHANNEL_H_
+#define SIPPET_TRANSPORT_STRIPED_CHANNEL_H_
+
+#include <vector>
+
+#include "base/threading/thread_checker.h"
+#include "sippet/transport/channel.h"
+#include "sippet/transport/channel_factory.h"
+
+namespace sippet {
+
+// A stream |Channel| made of several connections to the same destination,
+// the stripes, so that a segment lost on one of them stalls only the calls
+// it carries, instead of every transaction multiplexed on a single TCP or
+// TLS connection. Messages are sent on the stripe picked by the hash of
+// their Call-ID (see |NetworkLayerShards::ShardOf|), so that all messages
+// of a dialog keep their order on the same connection; those of a stripe
+// that is gone move to the next connected one.
+//
+// The first stripe is connected alone, and the channel is connected with
+// it; certificate errors are only reported for it. The others are
+// connected next, and reuse its TLS session, so they skip the full
+// handshake. Stripes that fail or close are dropped; the channel is closed
+// with the last one.
+//
+// Channels are created by a |StripedChannelFactory| over the factory of the
+// stripes:
+//
+//   StripedChannelFactory striped_factory(&chrome_channel_factory, 4);
+//   network_layer->RegisterChannelFactory(Protocol::TLS, &striped_factory);
+class StripedChannel : public Channel,
+                       public Channel::Delegate {
+ public:
+  // |factory| creates the stripes; it must outlive the channel.
+  StripedChannel(const EndPoint &destination,
+                 Channel::Delegate *delegate,
+                 ChannelFactory *factory,
+                 size_t stripe_count);
+
+  // Creates the first stripe. Returns a network error code.
+  int Init();
+
+  // The stripes connected, for testing.
+  size_t GetConnectedStripeCount() const;
+
+  // sippet::Channel methods:
+  int origin(EndPoint *origin) const override;
+  const EndPoint& destination() const override;
+  bool is_secure() const override;
+  bool is_connected() const override;
+  bool is_stream() const override;
+  void Connect() override;
+  int ReconnectIgnoringLastError() override;
+  int ReconnectWithCertificate(net::X509Certificate* client_cert) override;
+  int Send(const scoped_refptr<Message> &message,
+           const net::CompletionCallback& callback) override;
+  int SendKeepAlive(const net::CompletionCallback& callback) override;
+  void SetWriteQueueLimits(const WriteQueueLimits &limits) override;
+  void SetParseProfile(const ParseProfile &profile) override;
+  void SetMessageLimits(const MessageLimits &limits) override;
+  void SetSocketOptions(const SocketOptions &options) override;
+  void Close() override;
+  void CloseWithError(int err) override;
+  void DetachDelegate() override;
+
+  // sippet::Channel::Delegate methods:
+  void OnChannelConnected(const scoped_refptr<Channel> &channel,
+                          int error) override;
+  void OnIncomingMessage(const scoped_refptr<Channel> &channel,
+                         const scoped_refptr<Message> &message) override;
+  void OnChannelClosed(const scoped_refptr<Channel> &channel,
+                       int error) override;
+  void OnSSLCertificateError(const scoped_refptr<Channel> &channel,
+                             const net::SSLInfo &ssl_info,
+                             bool fatal) override;
+  void OnKeepAliveReceived(const scoped_refptr<Channel> &channel) override;
+  void OnOutgoingMessage(const scoped_refptr<Channel> &channel,
+                         const scoped_refptr<Message> &message) override;
+  void OnChannelCongested(const scoped_refptr<Channel> &channel) override;
+  void OnChannelWritable(const scoped_refptr<Channel> &channel) override;
+
+ private:
+  friend class base::RefCountedThreadSafe<Channel>;
+  ~StripedChannel() override;
+
+  struct Stripe {
+    Stripe();
+    ~Stripe();
+
+    scoped_refptr<Channel> channel;
+    bool connected;
+    bool congested;
+  };
+
+  // Index of the stripe of |channel|, or |stripes_.size()| if none.
+  size_t IndexOf(const scoped_refptr<Channel> &channel) const;
+  // The first stripe still open, or null.
+  Channel *primary() const;
+  // Opens the stripes after the first one.
+  void ConnectOtherStripes();
+  void ApplySettings(Channel *channel);
+  // Drops the stripe at |index|, closing it.
+  void DropStripe(size_t index);
+  void UpdateCongestion();
+
+  EndPoint destination_;
+  Channel::Delegate *delegate_;
+  ChannelFactory *factory_;
+  size_t stripe_count_;
+  std::vector<Stripe> stripes_;
+  bool is_connected_;
+  bool is_congested_;
+  WriteQueueLimits write_queue_limits_;
+  ParseProfile parse_profile_;
+  MessageLimits message_limits_;
+  SocketOptions socket_options_;
+  base::ThreadChecker thread_checker_;
+
+  DISALLOW_COPY_AND_ASSIGN(StripedChannel);
+};
+
+// Creates |StripedChannel|s over the channels created by another factory.
+class StripedChannelFactory : public ChannelFactory {
+ public:
+  // Connections per channel, by default.
+  static const size_t kDefaultStripeCount = 4;
+
+  // |factory| creates the stripes; not owned, it must outlive the channels.
+  explicit StripedChannelFactory(ChannelFactory *factory,
+                                 size_t stripe_count = kDefaultStripeCount);
+  virtual ~StripedChannelFactory();
+
+  // sippet::ChannelFactory methods:
+  int CreateChannel(const EndPoint &destination,
+                    Channel::Delegate *delegate,
+                    scoped_refptr<Channel> *channel) override;
+
+ private:
+  ChannelFactory *factory_;
+  size_t stripe_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(StripedChannelFactory);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_STRIPED_CHANNEL_H_
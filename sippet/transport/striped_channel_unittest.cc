@@ -0,0 +1,235 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/striped_channel.h"
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "base/strings/string_number_conversions.h"
+#include "net/base/net_errors.h"
+#include "sippet/message/headers.h"
+#include "sippet/message/message.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const char kDestination[] = "192.0.2.1:5061/TLS";
+
+scoped_refptr<Message> CreateRequest(const std::string &call_id) {
+  return Message::Parse(
+      "OPTIONS sip:carol@chicago.com SIP/2.0\r\n"
+      "Via: SIP/2.0/TLS pc33.atlanta.com;branch=z9hG4bK776asdhds\r\n"
+      "Call-ID: " + call_id + "\r\n"
+      "CSeq: 63104 OPTIONS\r\n"
+      "\r\n");
+}
+
+// A stream channel completing its connection when told to.
+class FakeChannel : public Channel {
+ public:
+  FakeChannel(const EndPoint &destination, Channel::Delegate *delegate)
+    : destination_(destination),
+      delegate_(delegate),
+      connecting_(false),
+      is_connected_(false) {}
+
+  void CompleteConnect(int error) {
+    ASSERT_TRUE(connecting_);
+    connecting_ = false;
+    is_connected_ = net::OK == error;
+    delegate_->OnChannelConnected(this, error);
+  }
+
+  void CloseByPeer() {
+    is_connected_ = false;
+    delegate_->OnChannelClosed(this, net::ERR_CONNECTION_RESET);
+  }
+
+  bool connecting() const { return connecting_; }
+  const std::vector<std::string> &sent() const { return sent_; }
+
+  // sippet::Channel methods:
+  int origin(EndPoint *origin) const override {
+    *origin = EndPoint::FromString("192.0.2.2:40000/TLS");
+    return net::OK;
+  }
+  const EndPoint& destination() const override { return destination_; }
+  bool is_secure() const override { return true; }
+  bool is_connected() const override { return is_connected_; }
+  bool is_stream() const override { return true; }
+  void Connect() override { connecting_ = true; }
+  int ReconnectIgnoringLastError() override {
+    connecting_ = true;
+    return net::ERR_IO_PENDING;
+  }
+  int ReconnectWithCertificate(net::X509Certificate* client_cert) override {
+    return net::ERR_NOT_IMPLEMENTED;
+  }
+  int Send(const scoped_refptr<Message> &message,
+           const net::CompletionCallback& callback) override {
+    EXPECT_TRUE(is_connected_);
+    sent_.push_back(message->get<CallId>()->value());
+    return net::OK;
+  }
+  void Close() override { is_connected_ = false; }
+  void CloseWithError(int err) override { is_connected_ = false; }
+  void DetachDelegate() override { Close(); }
+
+ private:
+  ~FakeChannel() override {}
+
+  EndPoint destination_;
+  Channel::Delegate *delegate_;
+  bool connecting_;
+  bool is_connected_;
+  std::vector<std::string> sent_;
+};
+
+class FakeChannelFactory : public ChannelFactory {
+ public:
+  int CreateChannel(const EndPoint &destination,
+                    Channel::Delegate *delegate,
+                    scoped_refptr<Channel> *channel) override {
+    scoped_refptr<FakeChannel> fake(new FakeChannel(destination, delegate));
+    channels_.push_back(fake);
+    *channel = fake;
+    return net::OK;
+  }
+
+  std::vector<scoped_refptr<FakeChannel> > channels_;
+};
+
+class RecordingDelegate : public Channel::Delegate {
+ public:
+  RecordingDelegate() : connected_(0), closed_(0), last_error_(net::OK) {}
+
+  void OnChannelConnected(const scoped_refptr<Channel> &channel,
+                          int error) override {
+    ++connected_;
+    last_error_ = error;
+  }
+  void OnIncomingMessage(const scoped_refptr<Channel> &channel,
+                         const scoped_refptr<Message> &message) override {}
+  void OnChannelClosed(const scoped_refptr<Channel> &channel,
+                       int error) override {
+    ++closed_;
+    last_error_ = error;
+  }
+  void OnSSLCertificateError(const scoped_refptr<Channel> &channel,
+                             const net::SSLInfo &ssl_info,
+                             bool fatal) override {}
+
+  int connected_;
+  int closed_;
+  int last_error_;
+};
+
+class StripedChannelTest : public testing::Test {
+ public:
+  StripedChannelTest() : striped_factory_(&factory_, 3) {}
+
+  void SetUp() override {
+    ASSERT_EQ(net::OK, striped_factory_.CreateChannel(
+        EndPoint::FromString(kDestination), &delegate_, &channel_));
+    ASSERT_EQ(1u, factory_.channels_.size());
+  }
+
+  // Connects the channel, and then all the stripes.
+  void ConnectAll() {
+    channel_->Connect();
+    factory_.channels_[0]->CompleteConnect(net::OK);
+    ASSERT_EQ(3u, factory_.channels_.size());
+    factory_.channels_[1]->CompleteConnect(net::OK);
+    factory_.channels_[2]->CompleteConnect(net::OK);
+  }
+
+  // Sends a request for each Call-ID of |count|.
+  void SendRequests(int count) {
+    for (int i = 0; i < count; ++i) {
+      EXPECT_EQ(net::OK, channel_->Send(
+          CreateRequest("call-" + base::IntToString(i)),
+          net::CompletionCallback()));
+    }
+  }
+
+  FakeChannelFactory factory_;
+  StripedChannelFactory striped_factory_;
+  RecordingDelegate delegate_;
+  scoped_refptr<Channel> channel_;
+};
+
+}  // namespace
+
+TEST_F(StripedChannelTest, ConnectsWithFirstStripe) {
+  channel_->Connect();
+  EXPECT_FALSE(channel_->is_connected());
+  factory_.channels_[0]->CompleteConnect(net::OK);
+  EXPECT_TRUE(channel_->is_connected());
+  EXPECT_EQ(1, delegate_.connected_);
+  EXPECT_EQ(net::OK, delegate_.last_error_);
+
+  // The other stripes are opened next; until connected, the first one
+  // takes all the messages.
+  ASSERT_EQ(3u, factory_.channels_.size());
+  EXPECT_TRUE(factory_.channels_[1]->connecting());
+  EXPECT_TRUE(factory_.channels_[2]->connecting());
+  SendRequests(10);
+  EXPECT_EQ(10u, factory_.channels_[0]->sent().size());
+
+  // Failed stripes are dropped, without closing the channel.
+  factory_.channels_[2]->CompleteConnect(net::ERR_CONNECTION_REFUSED);
+  EXPECT_TRUE(channel_->is_connected());
+  EXPECT_EQ(1, delegate_.connected_);
+}
+
+TEST_F(StripedChannelTest, FirstStripeFails) {
+  channel_->Connect();
+  factory_.channels_[0]->CompleteConnect(net::ERR_CONNECTION_REFUSED);
+  EXPECT_FALSE(channel_->is_connected());
+  EXPECT_EQ(net::ERR_CONNECTION_REFUSED, delegate_.last_error_);
+  EXPECT_EQ(1u, factory_.channels_.size());
+}
+
+TEST_F(StripedChannelTest, DialogsKeepTheirStripe) {
+  ConnectAll();
+  SendRequests(30);
+  SendRequests(30);
+
+  std::set<std::string> seen;
+  for (size_t i = 0; i < factory_.channels_.size(); ++i) {
+    const std::vector<std::string> &sent = factory_.channels_[i]->sent();
+    // Spread over all the stripes.
+    EXPECT_FALSE(sent.empty());
+    std::set<std::string> call_ids(sent.begin(), sent.end());
+    EXPECT_EQ(sent.size(), 2 * call_ids.size());
+    for (std::set<std::string>::const_iterator j = call_ids.begin();
+         j != call_ids.end(); ++j)
+      EXPECT_TRUE(seen.insert(*j).second) << *j << " on several stripes";
+  }
+  EXPECT_EQ(30u, seen.size());
+}
+
+TEST_F(StripedChannelTest, ClosesWithLastStripe) {
+  ConnectAll();
+  factory_.channels_[0]->CloseByPeer();
+  factory_.channels_[2]->CloseByPeer();
+  EXPECT_TRUE(channel_->is_connected());
+  EXPECT_EQ(0, delegate_.closed_);
+
+  // The dialogs of the closed stripes move to the one left.
+  size_t before = factory_.channels_[1]->sent().size();
+  SendRequests(10);
+  EXPECT_EQ(before + 10, factory_.channels_[1]->sent().size());
+
+  factory_.channels_[1]->CloseByPeer();
+  EXPECT_FALSE(channel_->is_connected());
+  EXPECT_EQ(1, delegate_.closed_);
+  EXPECT_EQ(net::ERR_CONNECTION_RESET, delegate_.last_error_);
+}
+
+} // End of sippet namespace
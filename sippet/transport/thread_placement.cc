@@ -0,0 +1,166 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/thread_placement.h"
+
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
+#include "base/strings/string_util.h"
+#include "base/strings/stringprintf.h"
+#include "build/build_config.h"
+
+#if defined(OS_LINUX)
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace sippet {
+
+namespace {
+
+#if defined(OS_LINUX)
+// Nodes a memory policy can name, as in the node masks of libnuma.
+const int kMaxNodes = 1024;
+#endif
+
+// Reads the value of a sysfs attribute, without its trailing newline.
+bool ReadSysFile(const std::string &path, std::string *value) {
+  if (!base::ReadFileToString(base::FilePath(path), value))
+    return false;
+  base::TrimWhitespaceASCII(*value, base::TRIM_ALL, value);
+  return true;
+}
+
+} // namespace
+
+ThreadPlacement::ThreadPlacement()
+  : numa_node_(-1) {
+}
+
+ThreadPlacement::~ThreadPlacement() {
+}
+
+// static
+ThreadPlacement ThreadPlacement::OnNode(int node) {
+  ThreadPlacement placement;
+  std::string list;
+  std::vector<int> cpus;
+  if (node < 0
+      || !ReadSysFile(base::StringPrintf(
+             "/sys/devices/system/node/node%d/cpulist", node), &list)
+      || !ParseCpuList(list, &cpus)) {
+    DVLOG(1) << "No CPUs known for NUMA node " << node;
+    return placement;
+  }
+  placement.set_cpus(cpus);
+  placement.set_numa_node(node);
+  return placement;
+}
+
+// static
+ThreadPlacement ThreadPlacement::NearNetworkDevice(
+    const std::string &interface_name) {
+  std::string value;
+  int node;
+  if (!ReadSysFile("/sys/class/net/" + interface_name + "/device/numa_node",
+                   &value)
+      || !base::StringToInt(value, &node) || node < 0) {
+    DVLOG(1) << "No NUMA node known for " << interface_name;
+    return ThreadPlacement();
+  }
+  return OnNode(node);
+}
+
+// static
+bool ThreadPlacement::ParseCpuList(const std::string &list,
+                                   std::vector<int> *cpus) {
+  DCHECK(cpus);
+  cpus->clear();
+  std::vector<std::string> ranges;
+  base::SplitString(list, ',', &ranges);
+  for (std::vector<std::string>::const_iterator i = ranges.begin(),
+       ie = ranges.end(); i != ie; ++i) {
+    if (i->empty())
+      continue;
+    size_t dash = i->find('-');
+    int first, last;
+    if (!base::StringToInt(i->substr(0, dash), &first))
+      return false;
+    if (std::string::npos == dash)
+      last = first;
+    else if (!base::StringToInt(i->substr(dash + 1), &last))
+      return false;
+    if (first < 0 || last < first)
+      return false;
+    for (int cpu = first; cpu <= last; ++cpu)
+      cpus->push_back(cpu);
+  }
+  return true;
+}
+
+ThreadPlacement ThreadPlacement::ForShard(size_t shard,
+                                          size_t shard_count) const {
+  DCHECK_LT(shard, shard_count);
+  ThreadPlacement placement;
+  placement.set_numa_node(numa_node_);
+  if (cpus_.empty())
+    return placement;
+  std::vector<int> cpus;
+  if (cpus_.size() < shard_count) {
+    cpus.push_back(cpus_[shard % cpus_.size()]);
+  } else {
+    cpus.assign(cpus_.begin() + shard * cpus_.size() / shard_count,
+                cpus_.begin() + (shard + 1) * cpus_.size() / shard_count);
+  }
+  placement.set_cpus(cpus);
+  return placement;
+}
+
+bool ThreadPlacement::ApplyToCurrentThread() const {
+#if defined(OS_LINUX)
+  bool applied = true;
+  if (!cpus_.empty()) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (std::vector<int>::const_iterator i = cpus_.begin(),
+         ie = cpus_.end(); i != ie; ++i) {
+      if (*i < CPU_SETSIZE)
+        CPU_SET(*i, &cpu_set);
+    }
+    // Zero is the calling thread, not the whole process.
+    if (0 != sched_setaffinity(0, sizeof(cpu_set), &cpu_set)) {
+      PLOG(WARNING) << "Couldn't pin the thread to its CPUs";
+      applied = false;
+    }
+  }
+  if (numa_node_ >= kMaxNodes) {
+    LOG(WARNING) << "NUMA node " << numa_node_ << " out of range";
+    applied = false;
+  } else if (numa_node_ >= 0) {
+    const size_t bits_per_word = 8 * sizeof(unsigned long);
+    unsigned long node_mask[kMaxNodes / bits_per_word] = {0};
+    node_mask[numa_node_ / bits_per_word] |=
+        1UL << (numa_node_ % bits_per_word);
+    // Falls back to other nodes once the preferred one is full.
+    if (0 != syscall(__NR_set_mempolicy, MPOL_PREFERRED, node_mask,
+                     kMaxNodes + 1)) {
+      PLOG(WARNING) << "Couldn't prefer the memory of NUMA node "
+                    << numa_node_;
+      applied = false;
+    }
+  }
+  return applied;
+#else
+  if (!empty())
+    DVLOG(1) << "Thread placement not supported, ignored";
+  return empty();
+#endif
+}
+
+} // End of sippet namespace
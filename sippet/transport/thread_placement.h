@@ -0,0 +1,79 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_THREAD_PLACEMENT_H_
+#define SIPPET_TRANSPORT_THREAD_PLACEMENT_H_
+
+#include <string>
+#include <vector>
+
+namespace sippet {
+
+// Where the thread of a network layer runs: the CPUs it's pinned to, and the
+// NUMA node its memory is allocated from. On hosts with several sockets, a
+// network layer placed on the node of the network device it serves doesn't
+// bounce its sockets, timers and pools across the interconnect, and keeps
+// its latency steady.
+//
+// Memory is allocated by the system from the node of the CPU first touching
+// it, so the placement must be applied before the thread creates what it
+// uses; |NetworkLayer| applies the one of its |NetworkSettings| when
+// created, on its own thread:
+//
+//   ThreadPlacement nic(ThreadPlacement::NearNetworkDevice("eth0"));
+//   ...
+//   scoped_ptr<NetworkLayer> CreateNetworkLayer(size_t shard) override {
+//     NetworkSettings settings;
+//     settings.set_thread_placement(nic.ForShard(shard, shard_count));
+//     ...
+//   }
+//
+// Placements are only applied on Linux; elsewhere they're ignored.
+class ThreadPlacement {
+ public:
+  ThreadPlacement();
+  ~ThreadPlacement();
+
+  // On the CPUs of NUMA |node|, with memory allocated from it. Empty if the
+  // node isn't known.
+  static ThreadPlacement OnNode(int node);
+
+  // On the NUMA node of the network device |interface_name|, e.g. "eth0",
+  // which takes the interrupts of its queues. Empty if the device doesn't
+  // tell, as on hosts with a single node.
+  static ThreadPlacement NearNetworkDevice(const std::string &interface_name);
+
+  // Parses a list of CPUs as written by the kernel, e.g. "0-3,8,10-11".
+  // Returns false if malformed.
+  static bool ParseCpuList(const std::string &list, std::vector<int> *cpus);
+
+  // Whether the thread is left where the system puts it.
+  bool empty() const { return cpus_.empty() && numa_node_ < 0; }
+
+  // The CPUs the thread may run on; none leaves it to the system.
+  const std::vector<int> &cpus() const { return cpus_; }
+  void set_cpus(const std::vector<int> &cpus) { cpus_ = cpus; }
+
+  // The node memory is allocated from, when it has room left; -1, the
+  // default, keeps the policy of the system.
+  int numa_node() const { return numa_node_; }
+  void set_numa_node(int numa_node) { numa_node_ = numa_node; }
+
+  // The share of |shard| out of |shard_count| shards: the same node, and a
+  // slice of the CPUs, so that shards don't compete for them. Shards share
+  // CPUs when there are fewer CPUs than shards.
+  ThreadPlacement ForShard(size_t shard, size_t shard_count) const;
+
+  // Places the calling thread. Returns false, logging why, if some of it
+  // couldn't be applied.
+  bool ApplyToCurrentThread() const;
+
+ private:
+  std::vector<int> cpus_;
+  int numa_node_;
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_THREAD_PLACEMENT_H_
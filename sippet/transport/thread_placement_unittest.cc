@@ -0,0 +1,47 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/thread_placement.h"
+
+#include "base/basictypes.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+TEST(ThreadPlacementTest, ParseCpuList) {
+  std::vector<int> cpus;
+  ASSERT_TRUE(ThreadPlacement::ParseCpuList("0-3,8,10-11\n", &cpus));
+  int expected[] = { 0, 1, 2, 3, 8, 10, 11 };
+  EXPECT_EQ(std::vector<int>(expected, expected + arraysize(expected)), cpus);
+
+  EXPECT_TRUE(ThreadPlacement::ParseCpuList("", &cpus));
+  EXPECT_TRUE(cpus.empty());
+  EXPECT_FALSE(ThreadPlacement::ParseCpuList("3-1", &cpus));
+  EXPECT_FALSE(ThreadPlacement::ParseCpuList("0-x", &cpus));
+}
+
+TEST(ThreadPlacementTest, ForShard) {
+  ThreadPlacement placement;
+  EXPECT_TRUE(placement.empty());
+  std::vector<int> cpus;
+  ASSERT_TRUE(ThreadPlacement::ParseCpuList("8-13", &cpus));
+  placement.set_cpus(cpus);
+  placement.set_numa_node(1);
+
+  // Each shard gets CPUs of its own, on the same node.
+  ThreadPlacement first(placement.ForShard(0, 3));
+  ThreadPlacement last(placement.ForShard(2, 3));
+  EXPECT_EQ(1, last.numa_node());
+  ASSERT_EQ(2u, first.cpus().size());
+  EXPECT_EQ(8, first.cpus()[0]);
+  ASSERT_EQ(2u, last.cpus().size());
+  EXPECT_EQ(12, last.cpus()[0]);
+
+  // Shared when there are more shards than CPUs.
+  ThreadPlacement wrapped(placement.ForShard(7, 8));
+  ASSERT_EQ(1u, wrapped.cpus().size());
+  EXPECT_EQ(9, wrapped.cpus()[0]);
+}
+
+} // End of sippet namespace
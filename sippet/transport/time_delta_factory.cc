@@ -5,31 +5,37 @@
 #include "sippet/transport/time_delta_factory.h"
 #include "sippet/transport/time_delta_provider.h"
 
+#include <algorithm>
+
 #include "base/lazy_instance.h"
 #include "base/compiler_specific.h"
+#include "base/logging.h"
 
 namespace sippet {
 
 namespace {
 
+const int64 kDefaultT1Milliseconds = 500;
+const int64 kT2Milliseconds = 4000;
+
+base::TimeDelta T2() {
+  return base::TimeDelta::FromMilliseconds(kT2Milliseconds);
+}
+
 class ClientNonInvite : public TimeDeltaProvider {
  public:
-  ClientNonInvite() : count_(0) {}
+  explicit ClientNonInvite(const base::TimeDelta &t1)
+    : t1_(t1), next_retry_(t1) {}
   ~ClientNonInvite() override {}
   base::TimeDelta GetNextRetryDelay() override {
-    // Implement the exponential backoff up to 4 seconds
-    int64 seconds;
-    switch (count_++) {
-      case 0: seconds = 500; break;
-      case 1: seconds = 1000; break;
-      case 2: seconds = 2000; break;
-      default: seconds = 4000; break;
-    }
-    return base::TimeDelta::FromMilliseconds(seconds);
+    // Timer E: implement the exponential backoff up to T2
+    base::TimeDelta delay(next_retry_);
+    next_retry_ = std::min(next_retry_ * 2, std::max(T2(), t1_));
+    return delay;
   }
   base::TimeDelta GetTimeoutDelay() override {
-    // This is 64*T1, where T1 = 500ms
-    return base::TimeDelta::FromSeconds(32);
+    // Timer F is 64*T1
+    return t1_ * 64;
   }
   base::TimeDelta GetTerminateDelay() override {
     // Timer K equal to 5s
@@ -37,34 +43,37 @@ class ClientNonInvite : public TimeDeltaProvider {
   }
 
  private:
-  int count_;
+  base::TimeDelta t1_;
+  base::TimeDelta next_retry_;
 };
 
 class ClientInvite : public TimeDeltaProvider {
  public:
-  ClientInvite() : multiply_(1) {}
+  explicit ClientInvite(const base::TimeDelta &t1)
+    : t1_(t1), next_retry_(t1) {}
   ~ClientInvite() override {}
   base::TimeDelta GetNextRetryDelay() override {
-    // Implement the exponential backoff *2 at each retransmission
-    int64 seconds = multiply_ * 500;
-    multiply_ <<= 1;
-    return base::TimeDelta::FromMilliseconds(seconds);
+    // Timer A: implement the exponential backoff *2 at each retransmission
+    base::TimeDelta delay(next_retry_);
+    next_retry_ *= 2;
+    return delay;
   }
   base::TimeDelta GetTimeoutDelay() override {
-    // This is 64*T1, where T1 = 500ms
-    return base::TimeDelta::FromSeconds(32);
+    // Timer B is 64*T1
+    return t1_ * 64;
   }
   base::TimeDelta GetTerminateDelay() override {
     // Timer D is greater than 32s (35 is greater than 32s)
     return base::TimeDelta::FromSeconds(35);
   }
  private:
-  int multiply_;
+  base::TimeDelta t1_;
+  base::TimeDelta next_retry_;
 };
 
 class ServerNonInvite : public TimeDeltaProvider {
  public:
-  ServerNonInvite() {}
+  explicit ServerNonInvite(const base::TimeDelta &t1) : t1_(t1) {}
   ~ServerNonInvite() override {}
   base::TimeDelta GetNextRetryDelay() override {
     // There's no retry on server non-INVITE transactions
@@ -75,29 +84,27 @@ class ServerNonInvite : public TimeDeltaProvider {
     return base::TimeDelta();
   }
   base::TimeDelta GetTerminateDelay() override {
-    // Timer J equal to 5s
-    return base::TimeDelta::FromSeconds(32);
+    // Timer J is 64*T1
+    return t1_ * 64;
   }
+ private:
+  base::TimeDelta t1_;
 };
 
 class ServerInvite : public TimeDeltaProvider {
  public:
-  ServerInvite() : count_(0) {}
+  explicit ServerInvite(const base::TimeDelta &t1)
+    : t1_(t1), next_retry_(t1) {}
   ~ServerInvite() override {}
   base::TimeDelta GetNextRetryDelay() override {
-    // Timer G: implement the exponential backoff up to 4 seconds
-    int64 seconds;
-    switch (count_++) {
-      case 0: seconds = 500; break;
-      case 1: seconds = 1000; break;
-      case 2: seconds = 2000; break;
-      default: seconds = 4000; break;
-    }
-    return base::TimeDelta::FromMilliseconds(seconds);
+    // Timer G: implement the exponential backoff up to T2
+    base::TimeDelta delay(next_retry_);
+    next_retry_ = std::min(next_retry_ * 2, std::max(T2(), t1_));
+    return delay;
   }
   base::TimeDelta GetTimeoutDelay() override {
-    // Timer H is 64*T1, where T1 = 500ms
-    return base::TimeDelta::FromSeconds(32);
+    // Timer H is 64*T1
+    return t1_ * 64;
   }
   base::TimeDelta GetTerminateDelay() override {
     // Timer I equal to 5s
@@ -105,7 +112,8 @@ class ServerInvite : public TimeDeltaProvider {
   }
 
  private:
-  int count_;
+  base::TimeDelta t1_;
+  base::TimeDelta next_retry_;
 };
 
 class DefaultTimeDeltaFactory : public TimeDeltaFactory {
@@ -113,20 +121,24 @@ class DefaultTimeDeltaFactory : public TimeDeltaFactory {
   DefaultTimeDeltaFactory() {}
   ~DefaultTimeDeltaFactory() override {}
 
-  TimeDeltaProvider* CreateClientNonInvite() override {
-    return new ClientNonInvite;
+  TimeDeltaProvider* CreateClientNonInvite(
+      const EndPoint &destination) override {
+    return CreateRfc3261Provider(CLIENT_NON_INVITE, GetDefaultT1());
   }
 
-  TimeDeltaProvider* CreateClientInvite() override {
-    return new ClientInvite;
+  TimeDeltaProvider* CreateClientInvite(
+      const EndPoint &destination) override {
+    return CreateRfc3261Provider(CLIENT_INVITE, GetDefaultT1());
   }
 
-  TimeDeltaProvider* CreateServerNonInvite() override {
-    return new ServerNonInvite;
+  TimeDeltaProvider* CreateServerNonInvite(
+      const EndPoint &destination) override {
+    return CreateRfc3261Provider(SERVER_NON_INVITE, GetDefaultT1());
   }
 
-  TimeDeltaProvider* CreateServerInvite() override {
-    return new ServerInvite;
+  TimeDeltaProvider* CreateServerInvite(
+      const EndPoint &destination) override {
+    return CreateRfc3261Provider(SERVER_INVITE, GetDefaultT1());
   }
 };
 
@@ -135,6 +147,26 @@ static base::LazyInstance<DefaultTimeDeltaFactory>::Leaky
 
 }  // namespace
 
+TimeDeltaProvider *TimeDeltaFactory::CreateRfc3261Provider(
+    TransactionKind kind, const base::TimeDelta &t1) {
+  switch (kind) {
+    case CLIENT_NON_INVITE:
+      return new ClientNonInvite(t1);
+    case CLIENT_INVITE:
+      return new ClientInvite(t1);
+    case SERVER_NON_INVITE:
+      return new ServerNonInvite(t1);
+    case SERVER_INVITE:
+      return new ServerInvite(t1);
+  }
+  NOTREACHED();
+  return NULL;
+}
+
+base::TimeDelta TimeDeltaFactory::GetDefaultT1() {
+  return base::TimeDelta::FromMilliseconds(kDefaultT1Milliseconds);
+}
+
 TimeDeltaFactory *TimeDeltaFactory::GetDefaultFactory() {
   return g_default_time_delta_factory.Pointer();
 }
@@ -6,22 +6,50 @@
 #define SIPPET_TRANSPORT_TIME_DELTA_FACTORY_H_
 
 #include "base/basictypes.h"
+#include "base/time/time.h"
 
 namespace sippet {
 
+class EndPoint;
 class TimeDeltaProvider;
 
 class TimeDeltaFactory {
  private:
   DISALLOW_COPY_AND_ASSIGN(TimeDeltaFactory);
  public:
+  enum TransactionKind {
+    CLIENT_NON_INVITE,
+    CLIENT_INVITE,
+    SERVER_NON_INVITE,
+    SERVER_INVITE,
+  };
+
   TimeDeltaFactory() {}
   virtual ~TimeDeltaFactory() {}
 
-  virtual TimeDeltaProvider* CreateClientNonInvite() = 0;
-  virtual TimeDeltaProvider* CreateClientInvite() = 0;
-  virtual TimeDeltaProvider* CreateServerNonInvite() = 0;
-  virtual TimeDeltaProvider* CreateServerInvite() = 0;
+  // Create the timers of a transaction with the peer at |destination|.
+  virtual TimeDeltaProvider* CreateClientNonInvite(
+      const EndPoint &destination) = 0;
+  virtual TimeDeltaProvider* CreateClientInvite(
+      const EndPoint &destination) = 0;
+  virtual TimeDeltaProvider* CreateServerNonInvite(
+      const EndPoint &destination) = 0;
+  virtual TimeDeltaProvider* CreateServerInvite(
+      const EndPoint &destination) = 0;
+
+  // Called by client transactions with the time their request took to be
+  // answered by |destination|. Ignored by default.
+  virtual void AddRoundTripSample(const EndPoint &destination,
+                                  const base::TimeDelta &rtt) {}
+
+  // Creates the RFC 3261 timers of a transaction of the given |kind|, all of
+  // them derived from the round-trip estimate |t1| as in table 4 of section
+  // A, capped by T2 (4s).
+  static TimeDeltaProvider *CreateRfc3261Provider(TransactionKind kind,
+                                                  const base::TimeDelta &t1);
+
+  // The default value of T1 (500ms).
+  static base::TimeDelta GetDefaultT1();
 
   static TimeDeltaFactory *GetDefaultFactory();
 };
@@ -0,0 +1,209 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/timer_wheel.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "base/time/default_tick_clock.h"
+
+namespace sippet {
+
+TimerWheel::Timer::Timer(TimerWheel *wheel)
+  : wheel_(wheel), expiration_(0), running_(false) {
+  DCHECK(wheel);
+}
+
+TimerWheel::Timer::~Timer() {
+  Stop();
+}
+
+void TimerWheel::Timer::Start(const base::TimeDelta &delay,
+                              const base::Closure &user_task) {
+  DCHECK(wheel_);
+  Stop();
+  user_task_ = user_task;
+  if (wheel_)
+    wheel_->Schedule(this, delay);
+}
+
+void TimerWheel::Timer::Stop() {
+  if (!running_)
+    return;
+  wheel_->Cancel(this);
+}
+
+TimerWheel::TimerWheel(const base::TimeDelta &resolution,
+                       base::TickClock *tick_clock)
+  : resolution_(resolution),
+    tick_clock_(tick_clock),
+    current_tick_(0),
+    size_(0),
+    max_lateness_(0),
+    weak_factory_(this) {
+  DCHECK_GT(resolution.InMicroseconds(), 0);
+  if (!tick_clock_) {
+    default_tick_clock_.reset(new base::DefaultTickClock);
+    tick_clock_ = default_tick_clock_.get();
+  }
+  origin_ = tick_clock_->NowTicks();
+  self_ = weak_factory_.GetWeakPtr();
+}
+
+TimerWheel::~TimerWheel() {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  TimerList *lists[] = { root_, levels_[0], levels_[1], levels_[2],
+                         levels_[3], &expired_ };
+  size_t lengths[] = { kRootSize, kLevelSize, kLevelSize, kLevelSize,
+                       kLevelSize, 1 };
+  COMPILE_ASSERT(arraysize(lists) == kLevels + 2, lists_cover_all_levels);
+  for (size_t i = 0; i < arraysize(lists); ++i) {
+    for (size_t j = 0; j < lengths[i]; ++j) {
+      TimerList &list = lists[i][j];
+      while (!list.empty()) {
+        Timer *timer = list.head()->value();
+        timer->RemoveFromList();
+        timer->running_ = false;
+        timer->wheel_ = NULL;
+        timer->user_task_.Reset();
+      }
+    }
+  }
+}
+
+void TimerWheel::Schedule(Timer *timer, const base::TimeDelta &delay) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  DCHECK(!timer->running_);
+
+  // Round the expiration up, so that timers never fire earlier than asked.
+  base::TimeDelta from_origin = tick_clock_->NowTicks() - origin_ + delay;
+  int64 resolution = resolution_.InMicroseconds();
+  int64 expiration =
+      (from_origin.InMicroseconds() + resolution - 1) / resolution;
+
+  if (size_ == 0) {
+    // Nothing is pending, so all elapsed ticks can just be skipped over.
+    current_tick_ = std::max(current_tick_, Now());
+    if (!tick_timer_.IsRunning())
+      tick_timer_.Start(FROM_HERE, resolution_, this, &TimerWheel::OnTick);
+  }
+
+  timer->expiration_ = std::max(expiration, current_tick_);
+  timer->running_ = true;
+  ++size_;
+  Add(timer);
+}
+
+void TimerWheel::Cancel(Timer *timer) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  DCHECK(timer->running_);
+  timer->RemoveFromList();
+  timer->running_ = false;
+  timer->user_task_.Reset();
+  --size_;
+}
+
+void TimerWheel::Add(Timer *timer) {
+  int64 expiration = timer->expiration_;
+  int64 delta = expiration - current_tick_;
+  DCHECK_GE(delta, 0);
+  if (delta < kRootSize) {
+    root_[expiration & kRootMask].Append(timer);
+    return;
+  }
+  int level = 0;
+  int shift = kRootBits;
+  int64 range = GG_INT64_C(1) << (shift + kLevelBits);
+  while (level < kLevels - 1 && delta >= range) {
+    ++level;
+    shift += kLevelBits;
+    range <<= kLevelBits;
+  }
+  if (delta >= range) {
+    // Beyond the wheel range; clamp to the farthest tick it can hold.
+    expiration = current_tick_ + range - 1;
+    timer->expiration_ = expiration;
+  }
+  levels_[level][(expiration >> shift) & kLevelMask].Append(timer);
+}
+
+int TimerWheel::Cascade(int level) {
+  int index = static_cast<int>(
+      (current_tick_ >> (kRootBits + level * kLevelBits)) & kLevelMask);
+  TimerList &slot = levels_[level][index];
+  while (!slot.empty()) {
+    Timer *timer = slot.head()->value();
+    timer->RemoveFromList();
+    Add(timer);
+  }
+  return index;
+}
+
+int64 TimerWheel::Now() const {
+  return (tick_clock_->NowTicks() - origin_).InMicroseconds() /
+      resolution_.InMicroseconds();
+}
+
+base::TimeDelta TimerWheel::TakeMaxLateness() {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  base::TimeDelta lateness = resolution_ * max_lateness_;
+  max_lateness_ = 0;
+  return lateness;
+}
+
+void TimerWheel::FireExpiredTimers() {
+  OnTick();
+}
+
+void TimerWheel::OnTick() {
+  if (!RunUntil(Now()))
+    return;
+  if (size_ == 0)
+    tick_timer_.Stop();
+}
+
+bool TimerWheel::RunUntil(int64 tick) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  base::WeakPtr<TimerWheel> self(self_);
+  while (current_tick_ <= tick) {
+    if (size_ == 0) {
+      current_tick_ = tick + 1;
+      break;
+    }
+    int index = static_cast<int>(current_tick_ & kRootMask);
+    if (index == 0) {
+      for (int level = 0; level < kLevels; ++level) {
+        if (Cascade(level) != 0)
+          break;
+      }
+    }
+    TimerList &slot = root_[index];
+    while (!slot.empty()) {
+      Timer *timer = slot.head()->value();
+      timer->RemoveFromList();
+      expired_.Append(timer);
+    }
+    if (!expired_.empty())
+      max_lateness_ = std::max(max_lateness_, tick - current_tick_);
+    ++current_tick_;
+
+    // Fired tasks may freely start and stop other timers, including the
+    // ones still waiting in |expired_|.
+    while (!expired_.empty()) {
+      Timer *timer = expired_.head()->value();
+      timer->RemoveFromList();
+      timer->running_ = false;
+      --size_;
+      base::Closure user_task(timer->user_task_);
+      timer->user_task_.Reset();
+      user_task.Run();
+      if (!self)
+        return false;
+    }
+  }
+  return true;
+}
+
+} // End of sippet namespace
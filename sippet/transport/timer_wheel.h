@@ -0,0 +1,159 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_TIMER_WHEEL_H_
+#define SIPPET_TRANSPORT_TIMER_WHEEL_H_
+
+#include "base/basictypes.h"
+#include "base/callback.h"
+#include "base/containers/linked_list.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/memory/weak_ptr.h"
+#include "base/threading/thread_checker.h"
+#include "base/time/tick_clock.h"
+#include "base/time/time.h"
+#include "base/timer/timer.h"
+
+namespace sippet {
+
+// A hierarchical timing wheel, used to drive all transaction and channel
+// timers of a |NetworkLayer| from a single periodic tick, instead of posting
+// one delayed task per timer to the message loop.
+//
+// Time is divided in ticks of |resolution|. Timers expiring within the next
+// 256 ticks are kept in the root wheel, one list per tick; farther timers are
+// kept in four coarser wheels of 64 slots each, and are cascaded down as the
+// root wheel wraps around. Both arming and cancelling a timer are O(1), as
+// timers are linked directly into their slot lists. The periodic tick only
+// runs while there are pending timers.
+//
+// Timers never fire before their delay has elapsed, but may fire up to one
+// tick later than requested.
+class TimerWheel {
+ public:
+  // A one-shot timer driven by a |TimerWheel|, with an interface similar to
+  // |base::OneShotTimer|. Destroying a running timer cancels it. The wheel
+  // must outlive its timers while they are running; timers still pending
+  // when the wheel is destroyed are cancelled.
+  class Timer : public base::LinkNode<Timer> {
+   public:
+    explicit Timer(TimerWheel *wheel);
+    ~Timer();
+
+    // Returns true if the timer is running (i.e., not stopped).
+    bool IsRunning() const { return running_; }
+
+    // Start the timer to run |user_task| after |delay|. If the timer is
+    // already running, it will be replaced.
+    void Start(const base::TimeDelta &delay, const base::Closure &user_task);
+
+    // Call this method to stop and cancel the timer. It is a no-op if the
+    // timer is not running.
+    void Stop();
+
+   private:
+    friend class TimerWheel;
+
+    TimerWheel *wheel_;
+    int64 expiration_;
+    bool running_;
+    base::Closure user_task_;
+
+    DISALLOW_COPY_AND_ASSIGN(Timer);
+  };
+
+  // Default duration of each wheel tick, in milliseconds.
+  static const int kDefaultResolutionMs = 10;
+
+  // Construct a |TimerWheel| ticking at every |resolution|. The wheel reads
+  // the current time from |tick_clock|, which is not owned; if NULL, the
+  // system clock is used.
+  explicit TimerWheel(
+      const base::TimeDelta &resolution =
+          base::TimeDelta::FromMilliseconds(kDefaultResolutionMs),
+      base::TickClock *tick_clock = NULL);
+  ~TimerWheel();
+
+  // Number of timers currently pending.
+  size_t size() const { return size_; }
+
+  // The time of the tick clock, by which the timers expire; users timing
+  // their own events with it follow the same clock, virtual or not.
+  base::TimeTicks NowTicks() const { return tick_clock_->NowTicks(); }
+
+  // Fires the timers expired by now, as the periodic tick does. It lets a
+  // virtual tick clock drive the wheel without waiting for the message
+  // loop.
+  void FireExpiredTimers();
+
+  // The worst lateness of the timers fired since the last call, in whole
+  // ticks: how much later than their tick the message loop let them run.
+  // Zero if none fired late.
+  base::TimeDelta TakeMaxLateness();
+
+ private:
+  friend class TimerWheelTest;
+
+  enum {
+    kRootBits = 8,
+    kRootSize = 1 << kRootBits,
+    kRootMask = kRootSize - 1,
+    kLevelBits = 6,
+    kLevelSize = 1 << kLevelBits,
+    kLevelMask = kLevelSize - 1,
+    kLevels = 4,
+  };
+
+  typedef base::LinkedList<Timer> TimerList;
+
+  // Arm and cancel timers; called by |Timer|.
+  void Schedule(Timer *timer, const base::TimeDelta &delay);
+  void Cancel(Timer *timer);
+
+  // Link |timer| into the slot corresponding to its expiration tick.
+  void Add(Timer *timer);
+
+  // Move all timers of a given slot in a coarser wheel to finer wheels.
+  // Returns the slot index, so that a zero means the next wheel has to be
+  // cascaded too.
+  int Cascade(int level);
+
+  // Current tick, according to the tick clock.
+  int64 Now() const;
+
+  // Called periodically; fires all expired timers.
+  void OnTick();
+
+  // Fire all timers expiring until |tick|, inclusive. Returns false if the
+  // wheel has been destroyed by one of the fired tasks.
+  bool RunUntil(int64 tick);
+
+  base::TimeDelta resolution_;
+  scoped_ptr<base::TickClock> default_tick_clock_;
+  base::TickClock *tick_clock_;
+  base::TimeTicks origin_;
+
+  // The next tick to be processed.
+  int64 current_tick_;
+  size_t size_;
+  // The ticks fired timers were late, at most, since |TakeMaxLateness|.
+  int64 max_lateness_;
+
+  TimerList root_[kRootSize];
+  TimerList levels_[kLevels][kLevelSize];
+  // Holds timers expired in the current tick until they are fired.
+  TimerList expired_;
+
+  base::RepeatingTimer<TimerWheel> tick_timer_;
+  base::ThreadChecker thread_checker_;
+  base::WeakPtrFactory<TimerWheel> weak_factory_;
+  // Kept alive, so that each tick doesn't allocate a new weak reference.
+  base::WeakPtr<TimerWheel> self_;
+
+  DISALLOW_COPY_AND_ASSIGN(TimerWheel);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_TIMER_WHEEL_H_
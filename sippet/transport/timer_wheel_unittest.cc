@@ -0,0 +1,224 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/timer_wheel.h"
+
+#include <vector>
+
+#include "base/bind.h"
+#include "base/test/simple_test_tick_clock.h"
+#include "sippet/test/allocation_counter.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const int kResolutionMs = 10;
+
+void Increment(int *counter) {
+  ++*counter;
+}
+
+void ExpectFiredAt(base::SimpleTestTickClock *clock,
+                   base::TimeTicks expected, int *counter) {
+  EXPECT_LE(expected, clock->NowTicks());
+  EXPECT_GE(expected + base::TimeDelta::FromMilliseconds(kResolutionMs),
+            clock->NowTicks());
+  ++*counter;
+}
+
+void StopTimer(TimerWheel::Timer *timer) {
+  timer->Stop();
+}
+
+}  // namespace
+
+class TimerWheelTest : public testing::Test {
+ public:
+  TimerWheelTest()
+    : wheel_(base::TimeDelta::FromMilliseconds(kResolutionMs), &clock_) {}
+
+  // Advance the clock in steps of one tick, as the periodic tick would.
+  void Advance(const base::TimeDelta &delta) {
+    base::TimeTicks end = clock_.NowTicks() + delta;
+    base::TimeDelta step = base::TimeDelta::FromMilliseconds(kResolutionMs);
+    while (clock_.NowTicks() + step <= end) {
+      clock_.Advance(step);
+      wheel_.OnTick();
+    }
+    clock_.Advance(end - clock_.NowTicks());
+    wheel_.OnTick();
+  }
+
+  bool IsTicking() const {
+    return wheel_.tick_timer_.IsRunning();
+  }
+
+ protected:
+  base::SimpleTestTickClock clock_;
+  TimerWheel wheel_;
+};
+
+TEST_F(TimerWheelTest, FiresOnce) {
+  int fired = 0;
+  TimerWheel::Timer timer(&wheel_);
+  timer.Start(base::TimeDelta::FromMilliseconds(500),
+      base::Bind(&Increment, &fired));
+  EXPECT_TRUE(timer.IsRunning());
+  EXPECT_TRUE(IsTicking());
+  EXPECT_EQ(1u, wheel_.size());
+
+  Advance(base::TimeDelta::FromMilliseconds(499));
+  EXPECT_EQ(0, fired);
+  Advance(base::TimeDelta::FromMilliseconds(1));
+  EXPECT_EQ(1, fired);
+  EXPECT_FALSE(timer.IsRunning());
+  EXPECT_EQ(0u, wheel_.size());
+  EXPECT_FALSE(IsTicking());
+
+  Advance(base::TimeDelta::FromSeconds(10));
+  EXPECT_EQ(1, fired);
+}
+
+TEST_F(TimerWheelTest, Lateness) {
+  int fired = 0;
+  TimerWheel::Timer timer(&wheel_);
+  timer.Start(base::TimeDelta::FromMilliseconds(kResolutionMs),
+      base::Bind(&Increment, &fired));
+  Advance(base::TimeDelta::FromMilliseconds(kResolutionMs));
+  EXPECT_EQ(1, fired);
+  EXPECT_EQ(base::TimeDelta(), wheel_.TakeMaxLateness());
+
+  // The periodic tick runs four ticks late.
+  timer.Start(base::TimeDelta::FromMilliseconds(kResolutionMs),
+      base::Bind(&Increment, &fired));
+  clock_.Advance(base::TimeDelta::FromMilliseconds(5 * kResolutionMs));
+  wheel_.OnTick();
+  EXPECT_EQ(2, fired);
+  EXPECT_EQ(base::TimeDelta::FromMilliseconds(4 * kResolutionMs),
+            wheel_.TakeMaxLateness());
+  EXPECT_EQ(base::TimeDelta(), wheel_.TakeMaxLateness());
+}
+
+TEST_F(TimerWheelTest, StopAndRestart) {
+  int fired = 0;
+  TimerWheel::Timer timer(&wheel_);
+  timer.Start(base::TimeDelta::FromSeconds(1),
+      base::Bind(&Increment, &fired));
+  timer.Stop();
+  EXPECT_FALSE(timer.IsRunning());
+  EXPECT_EQ(0u, wheel_.size());
+  timer.Stop();
+
+  timer.Start(base::TimeDelta::FromSeconds(1),
+      base::Bind(&Increment, &fired));
+  Advance(base::TimeDelta::FromMilliseconds(500));
+  timer.Start(base::TimeDelta::FromSeconds(1),
+      base::Bind(&Increment, &fired));
+  EXPECT_EQ(1u, wheel_.size());
+  Advance(base::TimeDelta::FromMilliseconds(999));
+  EXPECT_EQ(0, fired);
+  Advance(base::TimeDelta::FromMilliseconds(1));
+  EXPECT_EQ(1, fired);
+}
+
+TEST_F(TimerWheelTest, DestroyingTimerCancels) {
+  int fired = 0;
+  {
+    TimerWheel::Timer timer(&wheel_);
+    timer.Start(base::TimeDelta::FromMilliseconds(100),
+        base::Bind(&Increment, &fired));
+  }
+  EXPECT_EQ(0u, wheel_.size());
+  Advance(base::TimeDelta::FromSeconds(1));
+  EXPECT_EQ(0, fired);
+}
+
+// Covers delays in every wheel level, so that timers are cascaded down
+// before firing: SIP timers range from T1 (500ms) to idle channel timeouts.
+TEST_F(TimerWheelTest, Cascades) {
+  const int64 kDelaysMs[] = {
+    0, 10, 15, 500, 2550, 2560, 4000, 32000, 64 * 500, 60000, 163840,
+    200000, 3600000,
+  };
+  int fired = 0;
+  std::vector<TimerWheel::Timer*> timers;
+  for (size_t i = 0; i < arraysize(kDelaysMs); ++i) {
+    base::TimeDelta delay = base::TimeDelta::FromMilliseconds(kDelaysMs[i]);
+    TimerWheel::Timer *timer = new TimerWheel::Timer(&wheel_);
+    timer->Start(delay, base::Bind(&ExpectFiredAt, &clock_,
+        clock_.NowTicks() + delay, &fired));
+    timers.push_back(timer);
+  }
+  EXPECT_EQ(arraysize(kDelaysMs), wheel_.size());
+  Advance(base::TimeDelta::FromMilliseconds(3600000 + kResolutionMs));
+  EXPECT_EQ(static_cast<int>(arraysize(kDelaysMs)), fired);
+  EXPECT_EQ(0u, wheel_.size());
+  for (size_t i = 0; i < timers.size(); ++i)
+    delete timers[i];
+}
+
+TEST_F(TimerWheelTest, LateTickFiresAllExpired) {
+  int fired = 0;
+  TimerWheel::Timer first(&wheel_), second(&wheel_);
+  first.Start(base::TimeDelta::FromMilliseconds(100),
+      base::Bind(&Increment, &fired));
+  second.Start(base::TimeDelta::FromSeconds(5),
+      base::Bind(&Increment, &fired));
+  clock_.Advance(base::TimeDelta::FromSeconds(10));
+  wheel_.OnTick();
+  EXPECT_EQ(2, fired);
+}
+
+TEST_F(TimerWheelTest, TaskStopsExpiredTimer) {
+  int fired = 0;
+  TimerWheel::Timer first(&wheel_), second(&wheel_);
+  first.Start(base::TimeDelta::FromMilliseconds(100),
+      base::Bind(&StopTimer, &second));
+  second.Start(base::TimeDelta::FromMilliseconds(100),
+      base::Bind(&Increment, &fired));
+  Advance(base::TimeDelta::FromMilliseconds(100));
+  EXPECT_EQ(0, fired);
+  EXPECT_FALSE(second.IsRunning());
+  EXPECT_EQ(0u, wheel_.size());
+}
+
+// Transactions re-arm their retransmission timer with a task bound once, so
+// that retransmitting doesn't touch the heap.
+TEST_F(TimerWheelTest, RearmDoesNotAllocate) {
+  int fired = 0;
+  TimerWheel::Timer pending(&wheel_), timer(&wheel_);
+  pending.Start(base::TimeDelta::FromMinutes(1),
+      base::Bind(&Increment, &fired));
+  base::Closure task(base::Bind(&Increment, &fired));
+  timer.Start(base::TimeDelta::FromMilliseconds(500), task);
+  {
+    ScopedAllocationCounter counter;
+    for (int i = 0; i < 16; ++i) {
+      Advance(base::TimeDelta::FromMilliseconds(500));
+      timer.Start(base::TimeDelta::FromMilliseconds(500), task);
+    }
+    EXPECT_EQ(0, counter.allocations());
+  }
+  EXPECT_EQ(16, fired);
+}
+
+TEST(TimerWheel, DestroyingWheelCancels) {
+  int fired = 0;
+  base::SimpleTestTickClock clock;
+  TimerWheel::Timer *timer;
+  {
+    TimerWheel wheel(base::TimeDelta::FromMilliseconds(kResolutionMs),
+        &clock);
+    timer = new TimerWheel::Timer(&wheel);
+    timer->Start(base::TimeDelta::FromMilliseconds(100),
+        base::Bind(&Increment, &fired));
+  }
+  EXPECT_FALSE(timer->IsRunning());
+  delete timer;
+  EXPECT_EQ(0, fired);
+}
+
+}  // namespace sippet
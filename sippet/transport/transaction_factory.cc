@@ -22,9 +22,11 @@ class DefaultTransactionFactory : public TransactionFactory {
       const std::string &transaction_id,
       const scoped_refptr<Channel> &channel,
       TimeDeltaFactory *time_delta_factory,
+      TimerWheel *timer_wheel,
       TransactionDelegate *delegate) override {
     return new ClientTransactionImpl(transaction_id, channel,
-        delegate, time_delta_factory);
+        delegate, time_delta_factory, timer_wheel,
+        TransactionTimerPolicy::ForChannel(*channel.get()));
   }
 
   ServerTransaction *CreateServerTransaction(
@@ -32,9 +34,11 @@ class DefaultTransactionFactory : public TransactionFactory {
       const std::string &transaction_id,
       const scoped_refptr<Channel> &channel,
       TimeDeltaFactory *time_delta_factory,
+      TimerWheel *timer_wheel,
       TransactionDelegate *delegate) override {
     return new ServerTransactionImpl(transaction_id, channel,
-        delegate, time_delta_factory);
+        delegate, time_delta_factory, timer_wheel,
+        TransactionTimerPolicy::ForChannel(*channel.get()));
   }
 };
 
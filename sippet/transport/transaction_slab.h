@@ -0,0 +1,52 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_TRANSACTION_SLAB_H_
+#define SIPPET_TRANSPORT_TRANSACTION_SLAB_H_
+
+#include "base/lazy_instance.h"
+#include "sippet/base/memory_accounting.h"
+#include "sippet/base/slab_allocator.h"
+
+namespace sippet {
+
+// Backs the class |operator new| and |operator delete| of the transactions
+// of type |T|: they're carved from a slab shared by all network layers, and
+// accounted as |MemoryAccounting::TRANSACTIONS|. Instances of subclasses
+// don't fit in the blocks, and come from the heap.
+template <class T>
+class TransactionSlab : public SlabAllocator {
+ public:
+  static const size_t kTransactionsPerSlab = 512;
+
+  TransactionSlab() : SlabAllocator(sizeof(T), kTransactionsPerSlab) {}
+
+  static void *New(size_t size) {
+    MemoryAccounting::Add(MemoryAccounting::TRANSACTIONS, size);
+    if (size != sizeof(T))
+      return ::operator new(size);
+    return slab_.Get().Allocate();
+  }
+
+  static void Delete(void *p, size_t size) {
+    MemoryAccounting::Add(MemoryAccounting::TRANSACTIONS,
+                          -static_cast<int64>(size));
+    if (size != sizeof(T)) {
+      ::operator delete(p);
+      return;
+    }
+    slab_.Get().Free(p);
+  }
+
+ private:
+  static typename base::LazyInstance<TransactionSlab<T> >::Leaky slab_;
+};
+
+template <class T>
+typename base::LazyInstance<TransactionSlab<T> >::Leaky
+    TransactionSlab<T>::slab_ = LAZY_INSTANCE_INITIALIZER;
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_TRANSACTION_SLAB_H_
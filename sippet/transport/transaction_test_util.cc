@@ -0,0 +1,154 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/transaction_test_util.h"
+
+#include "net/base/net_errors.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+FakeTransactionChannel::FakeTransactionChannel(bool is_stream)
+  : destination_(EndPoint::FromString(
+        is_stream ? "192.0.2.1:5060/TCP" : "192.0.2.1:5060/UDP")),
+    is_stream_(is_stream),
+    pending_writes_(false) {
+}
+
+FakeTransactionChannel::~FakeTransactionChannel() {
+}
+
+size_t FakeTransactionChannel::CountSent(const std::string &prefix) const {
+  size_t count = 0;
+  for (std::vector<std::string>::const_iterator i = sent_.begin(),
+       ie = sent_.end(); i != ie; ++i) {
+    if (0 == i->compare(0, prefix.size(), prefix))
+      ++count;
+  }
+  return count;
+}
+
+void FakeTransactionChannel::CompleteWrites(int result) {
+  std::vector<net::CompletionCallback> callbacks;
+  callbacks.swap(pending_callbacks_);
+  for (std::vector<net::CompletionCallback>::iterator i = callbacks.begin(),
+       ie = callbacks.end(); i != ie; ++i) {
+    if (!i->is_null())
+      i->Run(result);
+  }
+}
+
+int FakeTransactionChannel::origin(EndPoint *origin) const {
+  *origin = EndPoint::FromString(
+      is_stream_ ? "192.0.2.2:5060/TCP" : "192.0.2.2:5060/UDP");
+  return net::OK;
+}
+
+const EndPoint& FakeTransactionChannel::destination() const {
+  return destination_;
+}
+
+bool FakeTransactionChannel::is_secure() const {
+  return false;
+}
+
+bool FakeTransactionChannel::is_connected() const {
+  return true;
+}
+
+bool FakeTransactionChannel::is_stream() const {
+  return is_stream_;
+}
+
+void FakeTransactionChannel::Connect() {
+}
+
+int FakeTransactionChannel::ReconnectIgnoringLastError() {
+  return net::ERR_NOT_IMPLEMENTED;
+}
+
+int FakeTransactionChannel::ReconnectWithCertificate(
+    net::X509Certificate* client_cert) {
+  return net::ERR_NOT_IMPLEMENTED;
+}
+
+int FakeTransactionChannel::Send(const scoped_refptr<Message> &message,
+                                 const net::CompletionCallback& callback) {
+  const std::string &head = message->SerializedHead();
+  sent_.push_back(head.substr(0, head.find("\r\n")));
+  if (!pending_writes_)
+    return net::OK;
+  pending_callbacks_.push_back(callback);
+  return net::ERR_IO_PENDING;
+}
+
+void FakeTransactionChannel::Close() {
+}
+
+void FakeTransactionChannel::CloseWithError(int err) {
+}
+
+void FakeTransactionChannel::DetachDelegate() {
+}
+
+RecordingTransactionDelegate::RecordingTransactionDelegate()
+  : timed_out_(0), transport_errors_(0), terminated_(false) {
+}
+
+RecordingTransactionDelegate::~RecordingTransactionDelegate() {
+}
+
+void RecordingTransactionDelegate::OnIncomingResponse(
+    const scoped_refptr<Response> &response) {
+  EXPECT_FALSE(terminated_);
+  response_codes_.push_back(response->response_code());
+}
+
+void RecordingTransactionDelegate::OnTimedOut(
+    const scoped_refptr<Request> &request) {
+  EXPECT_TRUE(request.get());
+  ++timed_out_;
+}
+
+void RecordingTransactionDelegate::OnTransportError(
+    const scoped_refptr<Request> &request, int error) {
+  EXPECT_TRUE(request.get());
+  ++transport_errors_;
+}
+
+void RecordingTransactionDelegate::OnTransactionTerminated(
+    const std::string &transaction_id) {
+  EXPECT_FALSE(terminated_);
+  terminated_ = true;
+}
+
+TransactionTestClock::TransactionTestClock()
+  : wheel_(base::TimeDelta::FromMilliseconds(
+               TimerWheel::kDefaultResolutionMs), &clock_) {
+}
+
+TransactionTestClock::~TransactionTestClock() {
+}
+
+void TransactionTestClock::Advance(const base::TimeDelta &delta) {
+  base::TimeTicks end = clock_.NowTicks() + delta;
+  base::TimeDelta step = base::TimeDelta::FromMilliseconds(
+      TimerWheel::kDefaultResolutionMs);
+  while (clock_.NowTicks() + step <= end) {
+    clock_.Advance(step);
+    wheel_.FireExpiredTimers();
+  }
+  clock_.Advance(end - clock_.NowTicks());
+  wheel_.FireExpiredTimers();
+}
+
+scoped_refptr<Request> ParseRequest(const std::string &raw) {
+  return dyn_cast<Request>(Message::Parse(raw));
+}
+
+scoped_refptr<Response> ParseResponse(const std::string &raw) {
+  return dyn_cast<Response>(Message::Parse(raw));
+}
+
+} // End of sippet namespace
@@ -0,0 +1,124 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_TRANSACTION_TEST_UTIL_H_
+#define SIPPET_TRANSPORT_TRANSACTION_TEST_UTIL_H_
+
+#include <string>
+#include <vector>
+
+#include "base/test/simple_test_tick_clock.h"
+#include "sippet/message/request.h"
+#include "sippet/message/response.h"
+#include "sippet/transport/channel.h"
+#include "sippet/transport/timer_wheel.h"
+#include "sippet/transport/transaction_delegate.h"
+
+namespace sippet {
+
+// A channel recording the start line of each message sent to it. Writes
+// complete at once, unless |set_pending_writes| is set: they are then held
+// until |CompleteWrites|.
+class FakeTransactionChannel : public Channel {
+ public:
+  explicit FakeTransactionChannel(bool is_stream);
+
+  // Start lines of the messages sent, in order.
+  const std::vector<std::string> &sent() const { return sent_; }
+
+  // Number of messages sent whose start line begins with |prefix|.
+  size_t CountSent(const std::string &prefix) const;
+
+  void ClearSent() { sent_.clear(); }
+
+  void set_pending_writes(bool pending_writes) {
+    pending_writes_ = pending_writes;
+  }
+
+  // Completes the writes held so far with |result|.
+  void CompleteWrites(int result);
+
+  // sippet::Channel methods:
+  int origin(EndPoint *origin) const override;
+  const EndPoint& destination() const override;
+  bool is_secure() const override;
+  bool is_connected() const override;
+  bool is_stream() const override;
+  void Connect() override;
+  int ReconnectIgnoringLastError() override;
+  int ReconnectWithCertificate(net::X509Certificate* client_cert) override;
+  int Send(const scoped_refptr<Message> &message,
+           const net::CompletionCallback& callback) override;
+  void Close() override;
+  void CloseWithError(int err) override;
+  void DetachDelegate() override;
+
+ private:
+  ~FakeTransactionChannel() override;
+
+  EndPoint destination_;
+  bool is_stream_;
+  bool pending_writes_;
+  std::vector<std::string> sent_;
+  std::vector<net::CompletionCallback> pending_callbacks_;
+
+  DISALLOW_COPY_AND_ASSIGN(FakeTransactionChannel);
+};
+
+// Records what transactions report. Responses aren't kept, so that they
+// don't hold on to the requests they refer to.
+class RecordingTransactionDelegate : public TransactionDelegate {
+ public:
+  RecordingTransactionDelegate();
+  ~RecordingTransactionDelegate() override;
+
+  // Codes of the responses passed up, in order.
+  const std::vector<int> &response_codes() const { return response_codes_; }
+  int timed_out() const { return timed_out_; }
+  int transport_errors() const { return transport_errors_; }
+  bool terminated() const { return terminated_; }
+
+  // sippet::TransactionDelegate methods:
+  void OnIncomingResponse(const scoped_refptr<Response> &response) override;
+  void OnTimedOut(const scoped_refptr<Request> &request) override;
+  void OnTransportError(
+      const scoped_refptr<Request> &request, int error) override;
+  void OnTransactionTerminated(const std::string &transaction_id) override;
+
+ private:
+  std::vector<int> response_codes_;
+  int timed_out_;
+  int transport_errors_;
+  bool terminated_;
+
+  DISALLOW_COPY_AND_ASSIGN(RecordingTransactionDelegate);
+};
+
+// A |TimerWheel| driven by a virtual clock, for the transaction timers to
+// be run without waiting.
+class TransactionTestClock {
+ public:
+  TransactionTestClock();
+  ~TransactionTestClock();
+
+  TimerWheel *timer_wheel() { return &wheel_; }
+
+  // Advances the clock by |delta|, one wheel tick at a time, firing the
+  // timers expired as the periodic tick would.
+  void Advance(const base::TimeDelta &delta);
+
+ private:
+  base::SimpleTestTickClock clock_;
+  TimerWheel wheel_;
+
+  DISALLOW_COPY_AND_ASSIGN(TransactionTestClock);
+};
+
+// Parses a request or a response given as text.
+scoped_refptr<Request> ParseRequest(const std::string &raw);
+scoped_refptr<Response> ParseResponse(const std::string &raw);
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_TRANSACTION_TEST_UTIL_H_
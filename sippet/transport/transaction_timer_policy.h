@@ -0,0 +1,36 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_TRANSACTION_TIMER_POLICY_H_
+#define SIPPET_TRANSPORT_TRANSACTION_TIMER_POLICY_H_
+
+#include "sippet/transport/channel.h"
+
+namespace sippet {
+
+// Which of the RFC 3261 transaction timers are needed on a transport. It's
+// decided once, when the transaction is created by its |TransactionFactory|.
+struct TransactionTimerPolicy {
+  TransactionTimerPolicy() : retransmit(true), linger(true) {}
+
+  // Reliable transports don't retransmit, and since there's nothing to be
+  // absorbed, transactions terminate as soon as they complete: only the
+  // timeouts (timers B, F and H) are armed on them.
+  static TransactionTimerPolicy ForChannel(const Channel &channel) {
+    TransactionTimerPolicy policy;
+    policy.retransmit = !channel.is_stream();
+    policy.linger = !channel.is_stream();
+    return policy;
+  }
+
+  // Retransmit requests and responses (timers A, E and G).
+  bool retransmit;
+  // Stay around to absorb retransmissions once completed (timers D, I, J
+  // and K).
+  bool linger;
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_TRANSACTION_TIMER_POLICY_H_
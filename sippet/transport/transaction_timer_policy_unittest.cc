@@ -0,0 +1,34 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/transaction_timer_policy.h"
+
+#include "sippet/transport/transaction_test_util.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+TEST(TransactionTimerPolicyTest, AllTimersByDefault) {
+  TransactionTimerPolicy policy;
+  EXPECT_TRUE(policy.retransmit);
+  EXPECT_TRUE(policy.linger);
+}
+
+TEST(TransactionTimerPolicyTest, UnreliableTransport) {
+  scoped_refptr<FakeTransactionChannel> channel(
+      new FakeTransactionChannel(false));
+  TransactionTimerPolicy policy(TransactionTimerPolicy::ForChannel(*channel));
+  EXPECT_TRUE(policy.retransmit);
+  EXPECT_TRUE(policy.linger);
+}
+
+TEST(TransactionTimerPolicyTest, ReliableTransport) {
+  scoped_refptr<FakeTransactionChannel> channel(
+      new FakeTransactionChannel(true));
+  TransactionTimerPolicy policy(TransactionTimerPolicy::ForChannel(*channel));
+  EXPECT_FALSE(policy.retransmit);
+  EXPECT_FALSE(policy.linger);
+}
+
+} // End of sippet namespace
@@ -0,0 +1,232 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/transport_log.h"
+
+#include <algorithm>
+
+#include "base/bind.h"
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/values.h"
+#include "net/base/net_errors.h"
+#include "sippet/message/message.h"
+
+namespace sippet {
+
+namespace {
+
+base::Value *IntegerParams(const char *name, int value) {
+  base::DictionaryValue *dict = new base::DictionaryValue();
+  dict->SetInteger(name, value);
+  return dict;
+}
+
+base::Value *StringParams(const char *name, const std::string &value) {
+  base::DictionaryValue *dict = new base::DictionaryValue();
+  dict->SetString(name, value);
+  return dict;
+}
+
+base::Value *StringPairParams(const char *name1, const std::string &value1,
+                             const char *name2, const std::string &value2) {
+  base::DictionaryValue *dict = new base::DictionaryValue();
+  dict->SetString(name1, value1);
+  dict->SetString(name2, value2);
+  return dict;
+}
+
+base::Value *MessageParams(const scoped_refptr<Message> &message) {
+  base::DictionaryValue *dict = new base::DictionaryValue();
+  dict->SetString("headers", message->SerializedHead());
+  return dict;
+}
+
+}  // namespace
+
+TransportLog::Entry::Entry(EventType type, uint32 source_id,
+                           EventPhase phase,
+                           const ParametersCallback *parameters_callback)
+  : type_(type),
+    source_id_(source_id),
+    phase_(phase),
+    time_(base::TimeTicks::Now()),
+    parameters_callback_(parameters_callback) {
+}
+
+scoped_ptr<base::Value> TransportLog::Entry::ParametersToValue() const {
+  if (!parameters_callback_ || parameters_callback_->is_null())
+    return scoped_ptr<base::Value>();
+  return make_scoped_ptr(parameters_callback_->Run());
+}
+
+scoped_ptr<base::Value> TransportLog::Entry::ToValue() const {
+  scoped_ptr<base::DictionaryValue> dict(new base::DictionaryValue());
+  dict->SetString("time", base::Int64ToString(
+      (time_ - base::TimeTicks()).InMilliseconds()));
+  dict->SetString("type", EventTypeToString(type_));
+  dict->SetInteger("source_id", static_cast<int>(source_id_));
+  dict->SetInteger("phase", phase_);
+  scoped_ptr<base::Value> params(ParametersToValue());
+  if (params)
+    dict->Set("params", params.release());
+  return dict.Pass();
+}
+
+TransportLog::TransportLog()
+  : observer_count_(0),
+    last_id_(0),
+    transaction_sampling_(1),
+    transaction_count_(0) {
+}
+
+TransportLog::~TransportLog() {
+  DCHECK(observers_.empty());
+}
+
+void TransportLog::AddObserver(Observer *observer) {
+  DCHECK(observer);
+  base::AutoLock lock(lock_);
+  DCHECK(std::find(observers_.begin(), observers_.end(), observer)
+         == observers_.end());
+  observers_.push_back(observer);
+  base::subtle::NoBarrier_Store(&observer_count_,
+      static_cast<base::subtle::Atomic32>(observers_.size()));
+}
+
+void TransportLog::RemoveObserver(Observer *observer) {
+  base::AutoLock lock(lock_);
+  std::vector<Observer*>::iterator i =
+      std::find(observers_.begin(), observers_.end(), observer);
+  DCHECK(i != observers_.end());
+  if (i != observers_.end())
+    observers_.erase(i);
+  base::subtle::NoBarrier_Store(&observer_count_,
+      static_cast<base::subtle::Atomic32>(observers_.size()));
+}
+
+bool TransportLog::IsCapturing() const {
+  return base::subtle::NoBarrier_Load(&observer_count_) > 0;
+}
+
+uint32 TransportLog::NextId() {
+  return base::subtle::NoBarrier_AtomicIncrement(&last_id_, 1);
+}
+
+void TransportLog::set_transaction_sampling(int rate) {
+  DCHECK_GT(rate, 0);
+  base::subtle::NoBarrier_Store(&transaction_sampling_, rate);
+}
+
+int TransportLog::transaction_sampling() const {
+  return base::subtle::NoBarrier_Load(&transaction_sampling_);
+}
+
+bool TransportLog::ShouldTraceTransaction() {
+  if (!IsCapturing())
+    return false;
+  int rate = transaction_sampling();
+  if (rate <= 1)
+    return true;
+  base::subtle::Atomic32 count =
+      base::subtle::NoBarrier_AtomicIncrement(&transaction_count_, 1);
+  return static_cast<uint32>(count) % rate == 0;
+}
+
+void TransportLog::AddEntry(EventType type, uint32 source_id,
+                            EventPhase phase,
+                            const ParametersCallback *parameters_callback) {
+  if (!IsCapturing())
+    return;
+  Entry entry(type, source_id, phase, parameters_callback);
+  base::AutoLock lock(lock_);
+  for (std::vector<Observer*>::iterator i = observers_.begin(),
+       ie = observers_.end(); i != ie; ++i) {
+    (*i)->OnAddEntry(entry);
+  }
+}
+
+const char *TransportLog::EventTypeToString(EventType type) {
+  switch (type) {
+#define TRANSPORT_LOG_EVENT_TYPE(label) \
+    case TYPE_ ## label: return #label;
+#include "sippet/transport/transport_log_event_type_list.h"
+#undef TRANSPORT_LOG_EVENT_TYPE
+    default:
+      NOTREACHED();
+      return nullptr;
+  }
+}
+
+TransportLog::ParametersCallback TransportLog::IntegerCallback(
+    const char *name, int value) {
+  return base::Bind(&IntegerParams, name, value);
+}
+
+TransportLog::ParametersCallback TransportLog::StringCallback(
+    const char *name, const std::string &value) {
+  return base::Bind(&StringParams, name, value);
+}
+
+TransportLog::ParametersCallback TransportLog::StringPairCallback(
+    const char *name1, const std::string &value1,
+    const char *name2, const std::string &value2) {
+  return base::Bind(&StringPairParams, name1, value1, name2, value2);
+}
+
+TransportLog::ParametersCallback TransportLog::MessageCallback(
+    const scoped_refptr<Message> &message) {
+  return base::Bind(&MessageParams, message);
+}
+
+BoundTransportLog BoundTransportLog::Make(TransportLog *log) {
+  if (!log)
+    return BoundTransportLog();
+  return BoundTransportLog(log, log->NextId());
+}
+
+void BoundTransportLog::AddEvent(TransportLog::EventType type) const {
+  AddEntry(type, TransportLog::PHASE_NONE, nullptr);
+}
+
+void BoundTransportLog::AddEvent(
+    TransportLog::EventType type,
+    const TransportLog::ParametersCallback &callback) const {
+  AddEntry(type, TransportLog::PHASE_NONE, &callback);
+}
+
+void BoundTransportLog::BeginEvent(TransportLog::EventType type) const {
+  AddEntry(type, TransportLog::PHASE_BEGIN, nullptr);
+}
+
+void BoundTransportLog::BeginEvent(
+    TransportLog::EventType type,
+    const TransportLog::ParametersCallback &callback) const {
+  AddEntry(type, TransportLog::PHASE_BEGIN, &callback);
+}
+
+void BoundTransportLog::EndEvent(TransportLog::EventType type) const {
+  AddEntry(type, TransportLog::PHASE_END, nullptr);
+}
+
+void BoundTransportLog::EndEventWithNetErrorCode(
+    TransportLog::EventType type, int net_error) const {
+  if (net_error == net::OK) {
+    EndEvent(type);
+    return;
+  }
+  TransportLog::ParametersCallback callback(
+      TransportLog::IntegerCallback("net_error", net_error));
+  AddEntry(type, TransportLog::PHASE_END, &callback);
+}
+
+void BoundTransportLog::AddEntry(
+    TransportLog::EventType type,
+    TransportLog::EventPhase phase,
+    const TransportLog::ParametersCallback *callback) const {
+  if (log_)
+    log_->AddEntry(type, source_id_, phase, callback);
+}
+
+} // End of sippet namespace
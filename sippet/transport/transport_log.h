@@ -0,0 +1,182 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_TRANSPORT_LOG_H_
+#define SIPPET_TRANSPORT_TRANSPORT_LOG_H_
+
+#include <string>
+#include <vector>
+
+#include "base/atomicops.h"
+#include "base/callback.h"
+#include "base/memory/ref_counted.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/synchronization/lock.h"
+#include "base/time/time.h"
+
+namespace base {
+class Value;
+}
+
+namespace sippet {
+
+class Message;
+
+// Event log of the network layer, its channels and transactions, shaped
+// after |net::NetLog|, whose closed list of event types can't be extended
+// from outside Chromium. Entries go to the observers only while there's
+// any, and their parameters are built by callbacks run only then, so an
+// idle log costs a branch per event.
+//
+// To keep the log on in production, transactions can be sampled: only one
+// in |transaction_sampling| of them is traced, with all of its messages.
+//
+// It may be shared by network layers running on different threads.
+class TransportLog {
+ public:
+  enum EventType {
+#define TRANSPORT_LOG_EVENT_TYPE(label) TYPE_ ## label,
+#include "sippet/transport/transport_log_event_type_list.h"
+#undef TRANSPORT_LOG_EVENT_TYPE
+    EVENT_COUNT
+  };
+
+  enum EventPhase {
+    PHASE_NONE,
+    PHASE_BEGIN,
+    PHASE_END,
+  };
+
+  // Builds the parameters of an entry. The caller takes ownership of the
+  // returned value, which may be NULL.
+  typedef base::Callback<base::Value*()> ParametersCallback;
+
+  class Entry {
+   public:
+    EventType type() const { return type_; }
+    uint32 source_id() const { return source_id_; }
+    EventPhase phase() const { return phase_; }
+    base::TimeTicks time() const { return time_; }
+
+    // Runs the parameters callback, if any. Entries don't outlive the call
+    // to |Observer::OnAddEntry|, so they must be converted there.
+    scoped_ptr<base::Value> ParametersToValue() const;
+
+    // The entry as a dictionary, like the ones in net-internals dumps.
+    scoped_ptr<base::Value> ToValue() const;
+
+   private:
+    friend class TransportLog;
+
+    Entry(EventType type, uint32 source_id, EventPhase phase,
+          const ParametersCallback *parameters_callback);
+
+    EventType type_;
+    uint32 source_id_;
+    EventPhase phase_;
+    base::TimeTicks time_;
+    const ParametersCallback *parameters_callback_;
+
+    DISALLOW_COPY_AND_ASSIGN(Entry);
+  };
+
+  class Observer {
+   public:
+    // Called on the thread adding the entry, with the log locked: it must
+    // not add entries, nor add or remove observers.
+    virtual void OnAddEntry(const Entry &entry) = 0;
+
+   protected:
+    virtual ~Observer() {}
+  };
+
+  TransportLog();
+  ~TransportLog();
+
+  void AddObserver(Observer *observer);
+  void RemoveObserver(Observer *observer);
+
+  // Whether there's any observer.
+  bool IsCapturing() const;
+
+  // A new source id, for a |BoundTransportLog|.
+  uint32 NextId();
+
+  // Only one in |rate| transactions is traced; one, the default, traces
+  // all of them.
+  void set_transaction_sampling(int rate);
+  int transaction_sampling() const;
+
+  // Whether the next transaction has to be traced.
+  bool ShouldTraceTransaction();
+
+  void AddEntry(EventType type, uint32 source_id, EventPhase phase,
+                const ParametersCallback *parameters_callback);
+
+  static const char *EventTypeToString(EventType type);
+
+  // Callbacks of common parameters. Strings are copied.
+  static ParametersCallback IntegerCallback(const char *name, int value);
+  static ParametersCallback StringCallback(const char *name,
+                                           const std::string &value);
+  static ParametersCallback StringPairCallback(const char *name1,
+                                               const std::string &value1,
+                                               const char *name2,
+                                               const std::string &value2);
+  // The head of |message|, serialized only when needed.
+  static ParametersCallback MessageCallback(
+      const scoped_refptr<Message> &message);
+
+ private:
+  base::Lock lock_;
+  std::vector<Observer*> observers_;
+  base::subtle::Atomic32 observer_count_;
+  base::subtle::Atomic32 last_id_;
+  base::subtle::Atomic32 transaction_sampling_;
+  base::subtle::Atomic32 transaction_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(TransportLog);
+};
+
+// A |TransportLog| and the source id events are added with, e.g. a channel
+// or a transaction. Default constructed ones log nothing.
+class BoundTransportLog {
+ public:
+  BoundTransportLog() : log_(nullptr), source_id_(0) {}
+
+  static BoundTransportLog Make(TransportLog *log);
+
+  void AddEvent(TransportLog::EventType type) const;
+  void AddEvent(TransportLog::EventType type,
+                const TransportLog::ParametersCallback &callback) const;
+  void BeginEvent(TransportLog::EventType type) const;
+  void BeginEvent(TransportLog::EventType type,
+                  const TransportLog::ParametersCallback &callback) const;
+  void EndEvent(TransportLog::EventType type) const;
+  // Adds the |net_error| parameter, unless it's |net::OK|.
+  void EndEventWithNetErrorCode(TransportLog::EventType type,
+                                int net_error) const;
+
+  bool IsCapturing() const {
+    return log_ && log_->IsCapturing();
+  }
+
+  TransportLog *log() const { return log_; }
+  uint32 source_id() const { return source_id_; }
+
+ private:
+  BoundTransportLog(TransportLog *log, uint32 source_id)
+    : log_(log), source_id_(source_id) {}
+
+  void AddEntry(TransportLog::EventType type,
+                TransportLog::EventPhase phase,
+                const TransportLog::ParametersCallback *callback) const;
+
+  TransportLog *log_;
+  uint32 source_id_;
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_TRANSPORT_LOG_H_
@@ -0,0 +1,62 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// This file intentionally does not have header guards, it's included inside
+// a macro to generate enum.
+//
+// This file contains the list of transport log event types, in the same
+// spirit of net/log/net_log_event_type_list.h.
+
+#ifndef TRANSPORT_LOG_EVENT_TYPE
+#error "TRANSPORT_LOG_EVENT_TYPE should be defined before including this file"
+#endif
+
+// The lifetime of a channel in the network layer.
+//
+// The BEGIN phase contains the following parameters:
+//   {
+//     "destination": <The channel destination>,
+//   }
+TRANSPORT_LOG_EVENT_TYPE(CHANNEL_ALIVE)
+
+// Connecting an outbound channel.
+//
+// The END phase contains the following parameters:
+//   {
+//     "net_error": <The net error code, if it failed>,
+//   }
+TRANSPORT_LOG_EVENT_TYPE(CHANNEL_CONNECT)
+
+// The channel was closed by the peer or by an error.
+//   {
+//     "net_error": <The net error code>,
+//   }
+TRANSPORT_LOG_EVENT_TYPE(CHANNEL_CLOSED)
+
+// The lifetime of a traced transaction.
+//
+// The BEGIN phase contains the following parameters:
+//   {
+//     "id": <The transaction id>,
+//     "method": <The request method>,
+//   }
+TRANSPORT_LOG_EVENT_TYPE(TRANSACTION_ALIVE)
+
+// The transaction went to a new state.
+//   {
+//     "from": <The previous state>,
+//     "to": <The new state>,
+//   }
+TRANSPORT_LOG_EVENT_TYPE(TRANSACTION_STATE_CHANGED)
+
+// A message was sent or received by a transaction, retransmissions
+// included.
+//   {
+//     "headers": <The message head, as on the wire>,
+//   }
+TRANSPORT_LOG_EVENT_TYPE(SIP_MESSAGE_SENT)
+TRANSPORT_LOG_EVENT_TYPE(SIP_MESSAGE_RECEIVED)
+
+// A retransmitted request was absorbed before being parsed.
+TRANSPORT_LOG_EVENT_TYPE(SIP_RETRANSMISSION_ABSORBED)
@@ -0,0 +1,124 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/transport_log.h"
+
+#include <string>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/values.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+class RecordingObserver : public TransportLog::Observer {
+ public:
+  struct Record {
+    TransportLog::EventType type;
+    uint32 source_id;
+    TransportLog::EventPhase phase;
+    std::string params;
+  };
+
+  ~RecordingObserver() override {}
+
+  void OnAddEntry(const TransportLog::Entry &entry) override {
+    Record record;
+    record.type = entry.type();
+    record.source_id = entry.source_id();
+    record.phase = entry.phase();
+    scoped_ptr<base::Value> params(entry.ParametersToValue());
+    const base::DictionaryValue *dict;
+    if (params && params->GetAsDictionary(&dict))
+      dict->GetString("id", &record.params);
+    records_.push_back(record);
+  }
+
+  const std::vector<Record> &records() const { return records_; }
+
+ private:
+  std::vector<Record> records_;
+};
+
+base::Value *CountingParams(int *runs) {
+  ++*runs;
+  return nullptr;
+}
+
+}  // namespace
+
+TEST(TransportLogTest, BuildsParametersOnlyWhenCapturing) {
+  TransportLog log;
+  BoundTransportLog bound(BoundTransportLog::Make(&log));
+  int runs = 0;
+  TransportLog::ParametersCallback callback(
+      base::Bind(&CountingParams, &runs));
+
+  EXPECT_FALSE(bound.IsCapturing());
+  bound.AddEvent(TransportLog::TYPE_CHANNEL_CLOSED, callback);
+  EXPECT_EQ(0, runs);
+
+  RecordingObserver observer;
+  log.AddObserver(&observer);
+  EXPECT_TRUE(bound.IsCapturing());
+  bound.AddEvent(TransportLog::TYPE_CHANNEL_CLOSED, callback);
+  EXPECT_EQ(1, runs);
+  log.RemoveObserver(&observer);
+
+  ASSERT_EQ(1u, observer.records().size());
+  EXPECT_EQ(TransportLog::TYPE_CHANNEL_CLOSED, observer.records()[0].type);
+  EXPECT_EQ(bound.source_id(), observer.records()[0].source_id);
+}
+
+TEST(TransportLogTest, BoundLogs) {
+  TransportLog log;
+  RecordingObserver observer;
+  log.AddObserver(&observer);
+
+  BoundTransportLog first(BoundTransportLog::Make(&log));
+  BoundTransportLog second(BoundTransportLog::Make(&log));
+  EXPECT_NE(first.source_id(), second.source_id());
+
+  first.BeginEvent(TransportLog::TYPE_TRANSACTION_ALIVE,
+      TransportLog::StringPairCallback("id", "c:z9hG4bK1:INVITE",
+                                       "method", "INVITE"));
+  second.EndEventWithNetErrorCode(TransportLog::TYPE_CHANNEL_CONNECT, -1);
+  first.EndEvent(TransportLog::TYPE_TRANSACTION_ALIVE);
+  // Empty ones log nothing.
+  BoundTransportLog().AddEvent(TransportLog::TYPE_CHANNEL_CLOSED);
+  log.RemoveObserver(&observer);
+
+  ASSERT_EQ(3u, observer.records().size());
+  EXPECT_EQ(TransportLog::PHASE_BEGIN, observer.records()[0].phase);
+  EXPECT_EQ("c:z9hG4bK1:INVITE", observer.records()[0].params);
+  EXPECT_EQ(second.source_id(), observer.records()[1].source_id);
+  EXPECT_EQ(TransportLog::PHASE_END, observer.records()[1].phase);
+  EXPECT_EQ(TransportLog::PHASE_END, observer.records()[2].phase);
+  EXPECT_STREQ("TRANSACTION_ALIVE", TransportLog::EventTypeToString(
+      TransportLog::TYPE_TRANSACTION_ALIVE));
+}
+
+TEST(TransportLogTest, SamplesTransactions) {
+  TransportLog log;
+  // Nothing is traced while there's nobody to see it.
+  EXPECT_FALSE(log.ShouldTraceTransaction());
+
+  RecordingObserver observer;
+  log.AddObserver(&observer);
+  EXPECT_TRUE(log.ShouldTraceTransaction());
+
+  log.set_transaction_sampling(4);
+  int traced = 0;
+  for (int i = 0; i < 100; ++i) {
+    if (log.ShouldTraceTransaction())
+      ++traced;
+  }
+  EXPECT_EQ(25, traced);
+  log.RemoveObserver(&observer);
+}
+
+} // End of sippet namespace
@@ -0,0 +1,109 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/transport_stats.h"
+
+#include <cstring>
+
+#include "base/lazy_instance.h"
+#include "base/logging.h"
+#include "base/synchronization/lock.h"
+
+namespace sippet {
+
+namespace {
+
+struct Registry {
+  base::Lock lock;
+  TransportStats::Snapshot values;
+};
+
+base::LazyInstance<Registry>::Leaky g_registry = LAZY_INSTANCE_INITIALIZER;
+
+}  // namespace
+
+TransportStats::Snapshot::Snapshot() {
+  memset(counters, 0, sizeof(counters));
+  memset(transactions, 0, sizeof(transactions));
+  memset(channels, 0, sizeof(channels));
+  memset(latency, 0, sizeof(latency));
+  memset(idle_time, 0, sizeof(idle_time));
+  memset(loop_lag, 0, sizeof(loop_lag));
+}
+
+int64 TransportStats::Snapshot::latency_count(Side side) const {
+  int64 count = 0;
+  for (int i = 0; i < kLatencyBuckets; ++i)
+    count += latency[side][i];
+  return count;
+}
+
+base::TimeDelta TransportStats::Snapshot::latency_mean(Side side) const {
+  int64 count = latency_count(side);
+  return count > 0 ? latency_sum[side] / count : base::TimeDelta();
+}
+
+void TransportStats::Count(Counter counter, int64 amount) {
+  DCHECK_LT(counter, COUNTER_MAX);
+  Registry &registry = g_registry.Get();
+  base::AutoLock lock(registry.lock);
+  registry.values.counters[counter] += amount;
+}
+
+void TransportStats::AddTransaction(Side side, const Method &method,
+                                    int delta) {
+  Registry &registry = g_registry.Get();
+  base::AutoLock lock(registry.lock);
+  registry.values.transactions[side][method.type()] += delta;
+}
+
+void TransportStats::AddChannel(const Protocol &protocol, int delta) {
+  Registry &registry = g_registry.Get();
+  base::AutoLock lock(registry.lock);
+  registry.values.channels[protocol.type()] += delta;
+}
+
+void TransportStats::RecordLatency(Side side,
+                                   const base::TimeDelta &latency) {
+  int bucket = GetLatencyBucket(latency);
+  Registry &registry = g_registry.Get();
+  base::AutoLock lock(registry.lock);
+  registry.values.latency[side][bucket]++;
+  registry.values.latency_sum[side] += latency;
+}
+
+void TransportStats::RecordIdleTime(const base::TimeDelta &idle_time) {
+  int bucket = GetLatencyBucket(idle_time);
+  Registry &registry = g_registry.Get();
+  base::AutoLock lock(registry.lock);
+  registry.values.idle_time[bucket]++;
+}
+
+void TransportStats::RecordLoopLag(LoopLag kind,
+                                   const base::TimeDelta &lag) {
+  DCHECK_LT(kind, LOOP_LAG_MAX);
+  int bucket = GetLatencyBucket(lag);
+  Registry &registry = g_registry.Get();
+  base::AutoLock lock(registry.lock);
+  registry.values.loop_lag[kind][bucket]++;
+}
+
+void TransportStats::GetSnapshot(Snapshot *snapshot) {
+  DCHECK(snapshot);
+  Registry &registry = g_registry.Get();
+  base::AutoLock lock(registry.lock);
+  *snapshot = registry.values;
+}
+
+int TransportStats::GetLatencyBucket(const base::TimeDelta &latency) {
+  int64 ms = latency.InMilliseconds();
+  int bucket = 0;
+  while (ms > 0 && bucket < kLatencyBuckets - 1) {
+    ms >>= 1;
+    ++bucket;
+  }
+  return bucket;
+}
+
+} // End of sippet namespace
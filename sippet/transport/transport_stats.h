@@ -0,0 +1,119 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_TRANSPORT_STATS_H_
+#define SIPPET_TRANSPORT_TRANSPORT_STATS_H_
+
+#include "base/basictypes.h"
+#include "base/time/time.h"
+#include "sippet/message/method.h"
+#include "sippet/message/protocol.h"
+
+namespace sippet {
+
+// Process wide counters of the transport layer, in the spirit of UMA
+// histograms: transactions, channels and readers record into them from the
+// threads of all network layers, and embedders poll |GetSnapshot| to
+// export them to their monitoring.
+class TransportStats {
+ public:
+  enum Counter {
+    // Requests and responses sent again by transactions, either on their
+    // timers or to answer a retransmitted request.
+    RETRANSMISSIONS_SENT,
+    // Retransmitted requests swallowed by server transactions.
+    RETRANSMISSIONS_ABSORBED,
+    // Client INVITE transactions that timed out (timer B).
+    TIMEOUTS_B,
+    // Client non-INVITE transactions that timed out (timer F).
+    TIMEOUTS_F,
+    // Server INVITE transactions never acknowledged (timer H).
+    TIMEOUTS_H,
+    // Bytes read from, and handed to, the sockets.
+    BYTES_RECEIVED,
+    BYTES_SENT,
+    // Incoming messages that couldn't be parsed.
+    PARSE_FAILURES,
+    // Datagrams and connections dropped by a |SourceRateLimiter|, before
+    // being parsed.
+    RATE_LIMITED,
+    // Incoming messages dropped for being over the |MessageLimits|.
+    OVERSIZED_MESSAGES,
+    // Idle channels closed before their reuse lifetime, to stay within the
+    // max idle or open channels of the network settings.
+    EVICTED_CHANNELS,
+    // Channels not opened, or accepted ones closed, for being over the max
+    // open channels.
+    REFUSED_CHANNELS,
+    COUNTER_MAX
+  };
+
+  enum Side {
+    CLIENT,
+    SERVER,
+    SIDE_MAX
+  };
+
+  // Lags of the threads running network layers, see |LoopWatchdog|.
+  enum LoopLag {
+    // Time posted tasks waited in the queue.
+    TASK_QUEUEING,
+    // How late timers fired.
+    TIMER_LATENESS,
+    // Time incoming messages waited from being received (see
+    // |Message::receive_time|) to being handled by the network layer.
+    RECEIVE_QUEUEING,
+    LOOP_LAG_MAX
+  };
+
+  // Latencies are kept in buckets of powers of two milliseconds: the bucket
+  // |i| holds the ones below 2^i ms, and at least 2^(i-1) ms, while the
+  // last one holds all the longer ones.
+  static const int kLatencyBuckets = 18;
+
+  static const int kMethodCount = Method::Unknown + 1;
+  static const int kProtocolCount = Protocol::Unknown + 1;
+
+  struct Snapshot {
+    int64 counters[COUNTER_MAX];
+    // Active transactions, by method; unknown methods are kept together.
+    int64 transactions[SIDE_MAX][kMethodCount];
+    // Open channels, by protocol.
+    int64 channels[kProtocolCount];
+    // Time from the request to its final response: sent to received on
+    // the client side, received to sent on the server side.
+    int64 latency[SIDE_MAX][kLatencyBuckets];
+    base::TimeDelta latency_sum[SIDE_MAX];
+    // Time idle channels stayed unused until reused, in the buckets of the
+    // latencies: the reuse lifetime should cover most of them.
+    int64 idle_time[kLatencyBuckets];
+    // Lags of the network threads, in the buckets of the latencies.
+    int64 loop_lag[LOOP_LAG_MAX][kLatencyBuckets];
+
+    Snapshot();
+
+    int64 latency_count(Side side) const;
+    // Mean latency, or zero if there's none.
+    base::TimeDelta latency_mean(Side side) const;
+  };
+
+  static void Count(Counter counter, int64 amount = 1);
+  static void AddTransaction(Side side, const Method &method, int delta);
+  static void AddChannel(const Protocol &protocol, int delta);
+  static void RecordLatency(Side side, const base::TimeDelta &latency);
+  static void RecordIdleTime(const base::TimeDelta &idle_time);
+  static void RecordLoopLag(LoopLag kind, const base::TimeDelta &lag);
+
+  static void GetSnapshot(Snapshot *snapshot);
+
+  // The bucket of |latency|.
+  static int GetLatencyBucket(const base::TimeDelta &latency);
+
+ private:
+  DISALLOW_IMPLICIT_CONSTRUCTORS(TransportStats);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_TRANSPORT_STATS_H_
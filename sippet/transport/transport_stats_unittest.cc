@@ -0,0 +1,75 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/transport/transport_stats.h"
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+base::TimeDelta Milliseconds(int64 ms) {
+  return base::TimeDelta::FromMilliseconds(ms);
+}
+
+}  // namespace
+
+TEST(TransportStatsTest, LatencyBuckets) {
+  EXPECT_EQ(0, TransportStats::GetLatencyBucket(base::TimeDelta()));
+  EXPECT_EQ(0, TransportStats::GetLatencyBucket(
+      base::TimeDelta::FromMicroseconds(999)));
+  EXPECT_EQ(1, TransportStats::GetLatencyBucket(Milliseconds(1)));
+  EXPECT_EQ(2, TransportStats::GetLatencyBucket(Milliseconds(2)));
+  EXPECT_EQ(2, TransportStats::GetLatencyBucket(Milliseconds(3)));
+  EXPECT_EQ(10, TransportStats::GetLatencyBucket(Milliseconds(1000)));
+  EXPECT_EQ(TransportStats::kLatencyBuckets - 1,
+            TransportStats::GetLatencyBucket(base::TimeDelta::FromHours(1)));
+}
+
+// Stats are shared by the whole process, so only differences are checked.
+TEST(TransportStatsTest, Snapshot) {
+  TransportStats::Snapshot before;
+  TransportStats::GetSnapshot(&before);
+
+  TransportStats::Count(TransportStats::BYTES_SENT, 100);
+  TransportStats::Count(TransportStats::TIMEOUTS_B);
+  TransportStats::AddTransaction(TransportStats::CLIENT,
+                                 Method(Method::INVITE), 1);
+  TransportStats::AddTransaction(TransportStats::SERVER,
+                                 Method("FOO"), 1);
+  TransportStats::AddChannel(Protocol(Protocol::TCP), 1);
+  TransportStats::RecordLatency(TransportStats::CLIENT, Milliseconds(30));
+  TransportStats::RecordLatency(TransportStats::CLIENT, Milliseconds(50));
+  TransportStats::RecordIdleTime(base::TimeDelta::FromSeconds(30));
+
+  TransportStats::Snapshot after;
+  TransportStats::GetSnapshot(&after);
+  EXPECT_EQ(100, after.counters[TransportStats::BYTES_SENT] -
+                 before.counters[TransportStats::BYTES_SENT]);
+  EXPECT_EQ(1, after.counters[TransportStats::TIMEOUTS_B] -
+               before.counters[TransportStats::TIMEOUTS_B]);
+  EXPECT_EQ(1, after.transactions[TransportStats::CLIENT][Method::INVITE] -
+               before.transactions[TransportStats::CLIENT][Method::INVITE]);
+  EXPECT_EQ(1, after.transactions[TransportStats::SERVER][Method::Unknown] -
+               before.transactions[TransportStats::SERVER][Method::Unknown]);
+  EXPECT_EQ(1, after.channels[Protocol::TCP] -
+               before.channels[Protocol::TCP]);
+  EXPECT_EQ(2, after.latency_count(TransportStats::CLIENT) -
+               before.latency_count(TransportStats::CLIENT));
+  EXPECT_EQ(Milliseconds(80),
+            after.latency_sum[TransportStats::CLIENT] -
+            before.latency_sum[TransportStats::CLIENT]);
+  int idle_bucket =
+      TransportStats::GetLatencyBucket(base::TimeDelta::FromSeconds(30));
+  EXPECT_EQ(1, after.idle_time[idle_bucket] - before.idle_time[idle_bucket]);
+
+  TransportStats::AddTransaction(TransportStats::CLIENT,
+                                 Method(Method::INVITE), -1);
+  TransportStats::AddTransaction(TransportStats::SERVER,
+                                 Method("FOO"), -1);
+  TransportStats::AddChannel(Protocol(Protocol::TCP), -1);
+}
+
+} // End of sippet namespace
@@ -0,0 +1,40 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_TRANSPORT_WRITE_QUEUE_LIMITS_H_
+#define SIPPET_TRANSPORT_WRITE_QUEUE_LIMITS_H_
+
+#include <stddef.h>
+
+namespace sippet {
+
+// Watermarks of the messages queued by a channel while its socket can't
+// take them. A channel becomes congested once its queue reaches any of the
+// high watermarks, and writable again once it's back at or under the low
+// ones. Zero high watermarks, and their low ones, are not checked.
+struct WriteQueueLimits {
+  WriteQueueLimits()
+    : high_water_bytes(0),
+      low_water_bytes(0),
+      high_water_messages(0),
+      low_water_messages(0),
+      fail_when_congested(false) {}
+
+  bool IsEnabled() const {
+    return high_water_bytes > 0 || high_water_messages > 0;
+  }
+
+  size_t high_water_bytes;
+  size_t low_water_bytes;
+  size_t high_water_messages;
+  size_t low_water_messages;
+
+  // Whether writes to a congested channel fail with
+  // |net::ERR_INSUFFICIENT_RESOURCES| instead of being queued.
+  bool fail_when_congested;
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_TRANSPORT_WRITE_QUEUE_LIMITS_H_
@@ -0,0 +1,145 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/ua/async_user_agent.h"
+
+#include "base/bind.h"
+#include "base/logging.h"
+#include "net/base/net_errors.h"
+#include "sippet/message/request.h"
+#include "sippet/message/response.h"
+
+namespace sippet {
+
+AsyncUserAgent::AsyncUserAgent(ua::UserAgent *user_agent)
+  : user_agent_(user_agent),
+    max_queued_requests_(kDefaultMaxQueuedRequests),
+    read_request_(nullptr),
+    read_dialog_(nullptr),
+    weak_factory_(this) {
+  DCHECK(user_agent);
+}
+
+AsyncUserAgent::~AsyncUserAgent() {
+}
+
+int AsyncUserAgent::SendRequest(const scoped_refptr<Request> &request,
+                                scoped_refptr<Response> *response,
+                                const net::CompletionCallback &callback) {
+  DCHECK(response);
+  DCHECK(!callback.is_null());
+  // ACKs get no response.
+  DCHECK(Method::ACK != request->method());
+  std::string request_id(request->id());
+  if (pending_sends_.count(request_id))
+    return net::ERR_UNEXPECTED;
+  int rv = user_agent_->Send(request,
+      base::Bind(&AsyncUserAgent::OnSendComplete,
+                 weak_factory_.GetWeakPtr(), request_id));
+  if (net::OK != rv && net::ERR_IO_PENDING != rv)
+    return rv;
+  PendingSend &pending = pending_sends_[request_id];
+  pending.response = response;
+  pending.callback = callback;
+  return net::ERR_IO_PENDING;
+}
+
+int AsyncUserAgent::ReadRequest(scoped_refptr<Request> *request,
+                                scoped_refptr<Dialog> *dialog,
+                                const net::CompletionCallback &callback) {
+  DCHECK(request);
+  DCHECK(dialog);
+  DCHECK(!callback.is_null());
+  DCHECK(read_callback_.is_null()) << "A read is pending already";
+  if (!incoming_requests_.empty()) {
+    *request = incoming_requests_.front().request;
+    *dialog = incoming_requests_.front().dialog;
+    incoming_requests_.pop_front();
+    return net::OK;
+  }
+  read_request_ = request;
+  read_dialog_ = dialog;
+  read_callback_ = callback;
+  return net::ERR_IO_PENDING;
+}
+
+void AsyncUserAgent::OnChannelConnected(const EndPoint &destination,
+                                        int err) {
+  // Nothing to do
+}
+
+void AsyncUserAgent::OnChannelClosed(const EndPoint &destination) {
+  // Nothing to do
+}
+
+void AsyncUserAgent::OnIncomingRequest(
+    const scoped_refptr<Request> &incoming_request,
+    const scoped_refptr<Dialog> &dialog) {
+  if (!read_callback_.is_null()) {
+    DCHECK(incoming_requests_.empty());
+    *read_request_ = incoming_request;
+    *read_dialog_ = dialog;
+    read_request_ = nullptr;
+    read_dialog_ = nullptr;
+    net::CompletionCallback callback(read_callback_);
+    read_callback_.Reset();
+    callback.Run(net::OK);
+    return;
+  }
+  if (incoming_requests_.size() >= max_queued_requests_) {
+    DVLOG(1) << "Too many requests unread, refusing "
+             << incoming_request->id();
+    if (Method::ACK != incoming_request->method()) {
+      user_agent_->Send(
+          incoming_request->CreateResponse(SIP_SERVICE_UNAVAILABLE),
+          net::CompletionCallback());
+    }
+    return;
+  }
+  IncomingRequest queued;
+  queued.request = incoming_request;
+  queued.dialog = dialog;
+  incoming_requests_.push_back(queued);
+}
+
+void AsyncUserAgent::OnIncomingResponse(
+    const scoped_refptr<Response> &incoming_response,
+    const scoped_refptr<Dialog> &dialog) {
+  if (200 > incoming_response->response_code()
+      || !incoming_response->refer_to())
+    return;
+  CompleteSend(incoming_response->refer_to()->id(), net::OK,
+               incoming_response);
+}
+
+void AsyncUserAgent::OnTimedOut(
+    const scoped_refptr<Request> &request,
+    const scoped_refptr<Dialog> &dialog) {
+  CompleteSend(request->id(), net::ERR_TIMED_OUT, nullptr);
+}
+
+void AsyncUserAgent::OnTransportError(
+    const scoped_refptr<Request> &request, int error,
+    const scoped_refptr<Dialog> &dialog) {
+  CompleteSend(request->id(), error, nullptr);
+}
+
+void AsyncUserAgent::OnSendComplete(const std::string &request_id, int rv) {
+  // Sent, the outcome comes with the response.
+  if (net::OK != rv)
+    CompleteSend(request_id, rv, nullptr);
+}
+
+void AsyncUserAgent::CompleteSend(const std::string &request_id, int rv,
+                                  const scoped_refptr<Response> &response) {
+  PendingSendMap::iterator i = pending_sends_.find(request_id);
+  if (pending_sends_.end() == i)
+    return;
+  *i->second.response = response;
+  net::CompletionCallback callback(i->second.callback);
+  pending_sends_.erase(i);
+  callback.Run(rv);
+}
+
+} // namespace sippet
@@ -0,0 +1,121 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_UA_ASYNC_USER_AGENT_H_
+#define SIPPET_UA_ASYNC_USER_AGENT_H_
+
+#include <deque>
+#include <string>
+
+#include "base/callback.h"
+#include "base/containers/hash_tables.h"
+#include "base/memory/weak_ptr.h"
+#include "net/base/completion_callback.h"
+#include "sippet/ua/ua_user_agent.h"
+
+namespace sippet {
+
+// A request/response facade over a |UserAgent|, for sequential logic such
+// as a B2BUA leg: |SendRequest| completes once, with the final response or
+// the error ending the transaction, instead of spreading the outcome over
+// the |UserAgent::Delegate| events; and |ReadRequest| pulls the incoming
+// requests one at a time, the way |net::Socket::Read| pulls bytes.
+//
+// Both follow the net conventions: a result available at once is returned,
+// and the callback isn't run; otherwise |net::ERR_IO_PENDING| is returned,
+// and the callback is run later, unless the facade is destroyed first.
+// Callbacks may destroy the facade.
+//
+// Example usage:
+//   int Leg::DoSendInvite() {
+//     next_state_ = STATE_SEND_INVITE_COMPLETE;
+//     return async_user_agent_->SendRequest(invite_, &response_,
+//         base::Bind(&Leg::OnIOComplete, base::Unretained(this)));
+//   }
+//
+// Provisional responses are left to the other handlers of the |UserAgent|.
+class AsyncUserAgent : public ua::UserAgent::Delegate {
+ public:
+  // Incoming requests queued while not read, by default. Further requests
+  // are answered with a 503 (Service Unavailable), and further ACKs
+  // dropped.
+  static const size_t kDefaultMaxQueuedRequests = 64;
+
+  // |user_agent| sends the requests; the facade must be set as one of its
+  // handlers. Not owned, it must outlive the facade.
+  explicit AsyncUserAgent(ua::UserAgent *user_agent);
+  ~AsyncUserAgent() override;
+
+  void set_max_queued_requests(size_t max_queued_requests) {
+    max_queued_requests_ = max_queued_requests;
+  }
+
+  // Sends |request|, and sets |*response| to its final response. The result
+  // is |net::OK| on a final response, whatever its code,
+  // |net::ERR_TIMED_OUT| when it's unanswered, or the transport error.
+  // |response| must stay valid until then.
+  int SendRequest(const scoped_refptr<Request> &request,
+                  scoped_refptr<Response> *response,
+                  const net::CompletionCallback &callback);
+
+  // Sets |*request| to the next incoming request, and |*dialog| to the
+  // dialog it pertains to, if any. Only one read can be pending; |request|
+  // and |dialog| must stay valid until it completes.
+  int ReadRequest(scoped_refptr<Request> *request,
+                  scoped_refptr<Dialog> *dialog,
+                  const net::CompletionCallback &callback);
+
+  // ua::UserAgent::Delegate methods:
+  void OnChannelConnected(const EndPoint &destination, int err) override;
+  void OnChannelClosed(const EndPoint &destination) override;
+  void OnIncomingRequest(
+      const scoped_refptr<Request> &incoming_request,
+      const scoped_refptr<Dialog> &dialog) override;
+  void OnIncomingResponse(
+      const scoped_refptr<Response> &incoming_response,
+      const scoped_refptr<Dialog> &dialog) override;
+  void OnTimedOut(
+      const scoped_refptr<Request> &request,
+      const scoped_refptr<Dialog> &dialog) override;
+  void OnTransportError(
+      const scoped_refptr<Request> &request, int error,
+      const scoped_refptr<Dialog> &dialog) override;
+
+ private:
+  struct PendingSend {
+    scoped_refptr<Response> *response;
+    net::CompletionCallback callback;
+  };
+
+  struct IncomingRequest {
+    scoped_refptr<Request> request;
+    scoped_refptr<Dialog> dialog;
+  };
+
+  // Keyed by the id of the sent requests, which their authenticated
+  // retries share.
+  typedef base::hash_map<std::string, PendingSend> PendingSendMap;
+
+  void OnSendComplete(const std::string &request_id, int rv);
+  // Completes the send of |request_id|, if pending.
+  void CompleteSend(const std::string &request_id, int rv,
+                    const scoped_refptr<Response> &response);
+
+  ua::UserAgent *user_agent_;
+  size_t max_queued_requests_;
+  PendingSendMap pending_sends_;
+  std::deque<IncomingRequest> incoming_requests_;
+  // Set while a read is pending.
+  scoped_refptr<Request> *read_request_;
+  scoped_refptr<Dialog> *read_dialog_;
+  net::CompletionCallback read_callback_;
+
+  base::WeakPtrFactory<AsyncUserAgent> weak_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(AsyncUserAgent);
+};
+
+} // namespace sippet
+
+#endif // SIPPET_UA_ASYNC_USER_AGENT_H_
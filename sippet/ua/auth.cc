@@ -7,6 +7,7 @@
 #include <sstream>
 #include <utility>
 #include <string>
+#include <algorithm>
 
 #include "sippet/ua/auth_handler.h"
 #include "sippet/ua/auth_handler_factory.h"
@@ -88,14 +89,35 @@ Challenge& Auth::GetChallengeFromHeader(Header* header) {
   return *challenge;
 }
 
+std::string Auth::GetChallengeRealm(const Challenge& challenge) {
+  return challenge.HasRealm() ? challenge.realm() : std::string();
+}
+
+void Auth::GetChallengeRealms(const scoped_refptr<Response> &response,
+                              std::vector<std::string>* realms) {
+  DCHECK(realms);
+  realms->clear();
+  Auth::Target target = GetChallengeTarget(response);
+  if (net::HttpAuth::AUTH_NONE == target)
+    return;
+  Header::Type header_type = GetChallengeHeaderType(target);
+  for (Message::iterator i = response->begin(), ie = response->end();
+       i != ie; i++) {
+    if (header_type != i->type())
+      continue;
+    std::string realm(GetChallengeRealm(GetChallengeFromHeader(i)));
+    if (std::find(realms->begin(), realms->end(), realm) == realms->end())
+      realms->push_back(realm);
+  }
+}
+
 GURL Auth::GetResponseOrigin(const scoped_refptr<Response>& response) {
   std::ostringstream spec;
   if (response->refer_to() != nullptr) {
-    GURL request_uri(response->refer_to()->request_uri());
-    if (request_uri.SchemeIs("sip") || request_uri.SchemeIs("sips")) {
-      SipURI uri(request_uri);
-      spec << uri.scheme() << ":"
-           << uri.host() << ":"
+    const SipURI &uri = response->refer_to()->sip_request_uri();
+    if (uri.is_valid()) {
+      spec << uri.scheme_piece() << ":"
+           << uri.host_piece() << ":"
            << uri.EffectiveIntPort();
       std::pair<bool, std::string> result = uri.parameter("transport");
       if (result.first)
@@ -109,11 +131,14 @@ GURL Auth::GetResponseOrigin(const scoped_refptr<Response>& response) {
 void Auth::ChooseBestChallenge(
     AuthHandlerFactory* auth_handler_factory,
     const scoped_refptr<Response> &response,
+    const std::string& realm,
     const std::set<Scheme>& disabled_schemes,
     const net::BoundNetLog& net_log,
-    scoped_ptr<AuthHandler>* handler) {
+    scoped_ptr<AuthHandler>* handler,
+    scoped_ptr<Challenge>* challenge) {
   DCHECK(auth_handler_factory);
   DCHECK(handler->get() == nullptr);
+  DCHECK(challenge);
 
   Auth::Target target = GetChallengeTarget(response);
   if (net::HttpAuth::AUTH_NONE == target)
@@ -121,12 +146,15 @@ void Auth::ChooseBestChallenge(
 
   // Choose the challenge whose authentication handler gives the maximum score.
   scoped_ptr<AuthHandler> best;
+  Challenge* best_challenge = nullptr;
   GURL origin(GetResponseOrigin(response));
   Header::Type header_type = GetChallengeHeaderType(target);
   for (Message::iterator i = response->begin(), ie = response->end();
        i != ie; i++) {
     if (header_type == i->type()) {
       Challenge& cur_challenge = GetChallengeFromHeader(i);
+      if (!realm.empty() && realm != GetChallengeRealm(cur_challenge))
+        continue;
       scoped_ptr<AuthHandler> cur;
       int rv = auth_handler_factory->CreateChallengeAuthHandler(
           cur_challenge, target, origin, net_log, &cur);
@@ -137,16 +165,20 @@ void Auth::ChooseBestChallenge(
         continue;
       }
       if (cur.get() && (!best.get() || best->score() < cur->score()) &&
-          (disabled_schemes.find(cur->auth_scheme()) == disabled_schemes.end()))
+          disabled_schemes.find(cur->auth_scheme()) == disabled_schemes.end()) {
         best.swap(cur);
+        best_challenge = &cur_challenge;
+      }
     }
   }
   handler->swap(best);
+  challenge->reset(best_challenge ? new Challenge(*best_challenge) : nullptr);
 }
 
 Auth::AuthorizationResult Auth::HandleChallengeResponse(
       AuthHandler* handler,
       const scoped_refptr<Response> &response,
+      const std::string& realm,
       const std::set<Scheme>& disabled_schemes) {
   DCHECK(handler);
   DCHECK(response);
@@ -165,6 +197,8 @@ Auth::AuthorizationResult Auth::HandleChallengeResponse(
       if (!base::LowerCaseEqualsASCII(challenge.scheme(),
           current_scheme_name.c_str()))
         continue;
+      if (!realm.empty() && realm != GetChallengeRealm(challenge))
+        continue;
       authorization_result = handler->HandleAnotherChallenge(challenge);
       if (net::HttpAuth::AUTHORIZATION_RESULT_INVALID != authorization_result)
         return authorization_result;
@@ -6,6 +6,8 @@
 #define SIPPET_UA_AUTH_H_
 
 #include <set>
+#include <string>
+#include <vector>
 #include "net/base/auth.h"
 #include "net/http/http_auth.h"
 #include "sippet/message/header.h"
@@ -61,23 +63,38 @@ struct Auth {
   // Returns the challenge from a given authenticate header.
   static Challenge& GetChallengeFromHeader(Header* header);
 
+  // Returns the realm of |challenge|, or empty if it has none.
+  static std::string GetChallengeRealm(const Challenge& challenge);
+
+  // Collects the distinct realms of the challenges in |response|, in the
+  // order they come. Several realms mean several proxies challenging the
+  // same request, each one expecting its own credentials.
+  static void GetChallengeRealms(const scoped_refptr<Response> &response,
+                                 std::vector<std::string>* realms);
+
   // Returns the response origin.
   static GURL GetResponseOrigin(const scoped_refptr<Response>& response);
 
   // Iterate through the challenge headers, and pick the best one that
   // we support. Obtains the implementation class for handling the challenge,
   // and passes it back in |*handler|. If no supported challenge was found,
-  // |*handler| is set to NULL.
+  // |*handler| is set to NULL. A copy of the chosen challenge is passed
+  // back in |*challenge|.
   //
   // |target| is discovered from the challenge contained in the response.
   //
+  // |realm|, unless empty, restricts the choice to the challenges of that
+  // realm.
+  //
   // |disabled_schemes| is the set of schemes that we should not use.
   static void ChooseBestChallenge(
       AuthHandlerFactory* auth_handler_factory,
       const scoped_refptr<Response> &response,
+      const std::string& realm,
       const std::set<Scheme>& disabled_schemes,
       const net::BoundNetLog& net_log,
-      scoped_ptr<AuthHandler>* handler);
+      scoped_ptr<AuthHandler>* handler,
+      scoped_ptr<Challenge>* challenge);
 
   // Handle a 401/407 response from a server/proxy after a previous
   // authentication attempt. For connection-based authentication schemes, the
@@ -94,6 +111,8 @@ struct Auth {
   // |target| specifies whether the authentication challenge response came
   // from a server or a proxy.
   //
+  // |realm|, unless empty, restricts the challenges considered to that realm.
+  //
   // |disabled_schemes| are the authentication schemes to ignore.
   //
   // |challenge_used| is the text of the authentication challenge used in
@@ -103,6 +122,7 @@ struct Auth {
   static AuthorizationResult HandleChallengeResponse(
       AuthHandler* handler,
       const scoped_refptr<Response> &response,
+      const std::string& realm,
       const std::set<Scheme>& disabled_schemes);
 };
 
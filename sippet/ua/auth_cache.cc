@@ -6,6 +6,10 @@
 
 #include <string>
 
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_util.h"
+#include "base/time/tick_clock.h"
+#include "sippet/base/memory_accounting.h"
 #include "sippet/uri/uri.h"
 
 namespace sippet {
@@ -19,6 +23,10 @@ namespace sippet {
 
 namespace {
 
+// Accounted per entry, with its list node and index; the strings are left
+// out.
+const int64 kEntrySize = sizeof(AuthCache::Entry) + 4 * sizeof(void*);
+
 // Debug helper to check that |origin| arguments are properly formed.
 void CheckOriginIsValid(const GURL& origin) {
   DCHECK(origin.SchemeIs("sip") || origin.SchemeIs("sips"));
@@ -31,53 +39,101 @@ void CheckOriginIsValid(const GURL& origin) {
 
 AuthCache::Entry::Entry()
   : scheme_(net::HttpAuth::AUTH_SCHEME_MAX),
-    nonce_count_(0) {
+    nonce_count_(0),
+    target_(net::HttpAuth::AUTH_NONE) {
 }
 
 AuthCache::Entry::~Entry() {
 }
 
+const std::string& AuthCache::Entry::digest_ha1(
+    const std::string& hash) const {
+  return digest_ha1_hash_ == hash ? digest_ha1_ : base::EmptyString();
+}
+
 void AuthCache::Entry::UpdateStaleChallenge() {
   nonce_count_ = 1;
 }
 
-AuthCache::AuthCache() {
+void AuthCache::Entry::SetChallenge(const Challenge &challenge,
+                                    Auth::Target target,
+                                    const GURL &origin) {
+  challenge_ = challenge;
+  target_ = target;
+  origin_ = origin;
+}
+
+AuthCache::AuthCache()
+  : max_entries_(kMaxNumRealmEntries),
+    tick_clock_(nullptr) {
 }
 
 AuthCache::~AuthCache() {
+  MemoryAccounting::Add(MemoryAccounting::AUTH_CACHE,
+                        -kEntrySize * static_cast<int64>(entries_.size()));
+}
+
+void AuthCache::set_max_entries(size_t max_entries) {
+  DCHECK_GT(max_entries, 0u);
+  max_entries_ = max_entries;
+  while (entries_.size() > max_entries_) {
+    const Entry& oldest = entries_.back();
+    Erase(entries_by_key_.find(
+        GetKey(oldest.realm_, oldest.scheme_, oldest.account_)));
+  }
 }
 
 AuthCache::Entry* AuthCache::Lookup(const std::string& realm,
-                                    Auth::Scheme scheme) {
-  // Linear scan through the realm entries.
-  for (EntryList::iterator it = entries_.begin(); it != entries_.end(); ++it) {
-    if (it->realm() == realm && it->scheme() == scheme)
-      return &(*it);
+                                    Auth::Scheme scheme,
+                                    const std::string& account) {
+  EntryMap::iterator it = entries_by_key_.find(
+      GetKey(realm, scheme, account));
+  if (it == entries_by_key_.end())
+    return nullptr;  // No realm entry found.
+  base::TimeTicks now = NowTicks();
+  if (IsExpired(*it->second, now)) {
+    Erase(it);
+    return nullptr;
   }
-  return nullptr;  // No realm entry found.
+  // Move it to the front, as the most recently used.
+  entries_.splice(entries_.begin(), entries_, it->second);
+  Entry* entry = &entries_.front();
+  entry->last_used_ = now;
+  return entry;
 }
 
 AuthCache::Entry* AuthCache::Add(const std::string& realm,
                                  Auth::Scheme scheme,
+                                 const std::string& account,
                                  const net::AuthCredentials& credentials) {
   // Check for existing entry (we will re-use it if present).
-  AuthCache::Entry* entry = Lookup(realm, scheme);
+  AuthCache::Entry* entry = Lookup(realm, scheme, account);
   if (!entry) {
     // Failsafe to prevent unbounded memory growth of the cache.
-    if (entries_.size() >= kMaxNumRealmEntries) {
+    if (entries_.size() >= max_entries_) {
       LOG(WARNING) << "Num auth cache entries reached limit -- evicting";
-      entries_.pop_back();
+      const Entry& oldest = entries_.back();
+      Erase(entries_by_key_.find(
+          GetKey(oldest.realm_, oldest.scheme_, oldest.account_)));
     }
 
     entries_.push_front(Entry());
+    MemoryAccounting::Add(MemoryAccounting::AUTH_CACHE, kEntrySize);
     entry = &entries_.front();
     entry->realm_ = realm;
     entry->scheme_ = scheme;
+    entry->account_ = account;
+    entry->last_used_ = NowTicks();
+    entries_by_key_[GetKey(realm, scheme, account)] = entries_.begin();
   }
   DCHECK_EQ(realm, entry->realm_);
   DCHECK_EQ(scheme, entry->scheme_);
 
-  entry->credentials_ = credentials;
+  if (!entry->credentials_.Equals(credentials)) {
+    entry->credentials_ = credentials;
+    entry->digest_ha1_hash_.clear();
+    entry->digest_ha1_.clear();
+  }
   entry->nonce_count_ = 1;
 
   return entry;
@@ -85,36 +141,94 @@ AuthCache::Entry* AuthCache::Add(const std::string& realm,
 
 bool AuthCache::Remove(const std::string& realm,
                        Auth::Scheme scheme,
+                       const std::string& account,
                        const net::AuthCredentials& credentials) {
-  for (EntryList::iterator it = entries_.begin(); it != entries_.end(); ++it) {
-    if (it->realm() == realm && it->scheme() == scheme) {
-      if (credentials.Equals(it->credentials())) {
-        entries_.erase(it);
-        return true;
-      }
-      return false;
-    }
-  }
-  return false;
+  EntryMap::iterator it = entries_by_key_.find(
+      GetKey(realm, scheme, account));
+  if (it == entries_by_key_.end())
+    return false;
+  if (!credentials.Equals(it->second->credentials()))
+    return false;
+  Erase(it);
+  return true;
 }
 
 bool AuthCache::UpdateStaleChallenge(const std::string& realm,
-                                     Auth::Scheme scheme) {
-  AuthCache::Entry* entry = Lookup(realm, scheme);
+                                     Auth::Scheme scheme,
+                                     const std::string& account) {
+  AuthCache::Entry* entry = Lookup(realm, scheme, account);
   if (!entry)
     return false;
   entry->UpdateStaleChallenge();
   return true;
 }
 
+void AuthCache::LookupPreemptive(const std::string& account,
+                                 std::vector<Entry*>* entries) {
+  DCHECK(entries);
+  base::TimeTicks now = NowTicks();
+  std::vector<EntryList::iterator> found;
+  for (EntryList::iterator it = entries_.begin(); it != entries_.end();) {
+    EntryList::iterator current = it++;
+    if (current->account_ != account)
+      continue;
+    if (IsExpired(*current, now)) {
+      Erase(entries_by_key_.find(
+          GetKey(current->realm_, current->scheme_, current->account_)));
+      continue;
+    }
+    if (current->has_challenge())
+      found.push_back(current);
+  }
+  // Move them to the front, keeping their relative order.
+  for (std::vector<EntryList::iterator>::reverse_iterator i = found.rbegin();
+       i != found.rend(); ++i) {
+    entries_.splice(entries_.begin(), entries_, *i);
+    (*i)->last_used_ = now;
+  }
+  for (size_t i = 0; i < found.size(); ++i)
+    entries->push_back(&*found[i]);
+}
+
 void AuthCache::UpdateAllFrom(const AuthCache& other) {
-  for (EntryList::const_iterator it = other.entries_.begin();
-       it != other.entries_.end(); ++it) {
-    Entry* entry = Add(it->realm(), it->scheme(), it->credentials());
+  // Oldest first, so that the recency order is kept.
+  for (EntryList::const_reverse_iterator it = other.entries_.rbegin();
+       it != other.entries_.rend(); ++it) {
+    Entry* entry = Add(it->realm(), it->scheme(), it->account(),
+                       it->credentials());
     // Copy nonce count (for digest authentication).
     entry->nonce_count_ = it->nonce_count_;
+    entry->set_digest_ha1(it->digest_ha1_hash_, it->digest_ha1_);
+    entry->SetChallenge(it->challenge_, it->target_, it->origin_);
   }
 }
 
+// static
+std::string AuthCache::GetKey(const std::string& realm,
+                              Auth::Scheme scheme,
+                              const std::string& account) {
+  // Realms and accounts can't hold a NUL.
+  std::string key(base::IntToString(scheme));
+  key.reserve(key.size() + realm.size() + account.size() + 2);
+  key.append(1, '\0').append(realm).append(1, '\0').append(account);
+  return key;
+}
+
+base::TimeTicks AuthCache::NowTicks() const {
+  return tick_clock_ ? tick_clock_->NowTicks() : base::TimeTicks::Now();
+}
+
+bool AuthCache::IsExpired(const Entry& entry, base::TimeTicks now) const {
+  return entry_lifetime_ > base::TimeDelta()
+      && now - entry.last_used_ > entry_lifetime_;
+}
+
+void AuthCache::Erase(EntryMap::iterator it) {
+  DCHECK(it != entries_by_key_.end());
+  MemoryAccounting::Add(MemoryAccounting::AUTH_CACHE, -kEntrySize);
+  entries_.erase(it->second);
+  entries_by_key_.erase(it);
+}
+
 }  // namespace sippet
 
@@ -6,11 +6,20 @@
 #define SIPPET_UA_AUTH_CACHE_H_
 
 #include <list>
+#include <string>
+#include <vector>
 
+#include "base/containers/hash_tables.h"
+#include "base/time/time.h"
 #include "net/base/auth.h"
+#include "sippet/message/headers/www_authenticate.h"
 #include "sippet/ua/auth.h"
 #include "url/gurl.h"
 
+namespace base {
+class TickClock;
+}
+
 namespace sippet {
 
 // Based on net/http/http_auth_cache.h,
@@ -21,12 +30,15 @@ namespace sippet {
 // found in the LICENSE file.
 
 // AuthCache stores SIP authentication identities and challenge info.
-// For each (origin, realm, scheme) triple the cache stores a
+// For each (realm, scheme, account) triple the cache stores a
 // AuthCache::Entry, which holds:
-//   - the origin server {protocol scheme, host, port}
 //   - the last identity used (username/password)
-//   - the last auth handler used (contains realm and authentication scheme)
-// Entries can be looked up by (origin, realm, scheme).
+//   - the nonce count of digest authentication
+//   - the last challenge accepted, so that it can be answered preemptively
+// The account is the address of record authenticating, so that a single
+// cache may serve many accounts of the same realm. Entries are hashed by
+// the triple, and the least recently used one is evicted when the cache
+// is full. Entries unused for longer than |entry_lifetime| are dropped.
 class AuthCache {
  public:
   class Entry {
@@ -43,16 +55,50 @@ class AuthCache {
       return scheme_;
     }
 
+    // The account authenticating, or empty if not given.
+    const std::string &account() const {
+      return account_;
+    }
+
     // The login credentials.
     const net::AuthCredentials& credentials() const {
       return credentials_;
     }
 
+    // The last challenge accepted, if any, along with the target and the
+    // origin it was issued for.
+    bool has_challenge() const {
+      return challenge_.HasScheme();
+    }
+    const Challenge &challenge() const {
+      return challenge_;
+    }
+    Auth::Target target() const {
+      return target_;
+    }
+    const GURL &origin() const {
+      return origin_;
+    }
+
+    // The digest H(user:realm:password) of the credentials for the |hash|
+    // function, or empty if not computed yet. Dropped with the credentials.
+    const std::string& digest_ha1(const std::string& hash) const;
+    void set_digest_ha1(const std::string& hash, const std::string& ha1) {
+      digest_ha1_hash_ = hash;
+      digest_ha1_ = ha1;
+    }
+
     // Increment the nonce count.
     int IncrementNonceCount() {
       return ++nonce_count_;
     }
 
+    // Keeps |challenge| for building credentials before being challenged
+    // again.
+    void SetChallenge(const Challenge &challenge,
+                      Auth::Target target,
+                      const GURL &origin);
+
     void UpdateStaleChallenge();
 
    private:
@@ -60,69 +106,132 @@ class AuthCache {
 
     Entry();
 
-    // |origin_| contains the {protocol, host, port} of the server.
     std::string realm_;
     Auth::Scheme scheme_;
+    std::string account_;
+
+    // Lookups refresh it; used to expire the entry.
+    base::TimeTicks last_used_;
 
     // Identity.
     net::AuthCredentials credentials_;
 
     // Nonce count.
     int nonce_count_;
+
+    // Digest H(A1), and the name of the hash function computing it.
+    std::string digest_ha1_hash_;
+    std::string digest_ha1_;
+
+    // Challenge.
+    Challenge challenge_;
+    Auth::Target target_;
+    GURL origin_;
   };
 
-  // Prevent unbounded memory growth. These are safeguards for abuse; it is
-  // not expected that the limits will be reached in ordinary usage.
-  // This also defines the worst-case lookup times (which grow linearly
-  // with number of elements in the cache).
+  // Prevent unbounded memory growth. This is the default safeguard for a
+  // single user agent; gateways serving many accounts should raise it with
+  // |set_max_entries|.
   enum { kMaxNumRealmEntries = 10 };
 
   AuthCache();
   ~AuthCache();
 
-  // Find the realm entry on server |origin| for realm |realm| and
-  // scheme |scheme|.
-  //   |realm|  - case sensitive realm string.
-  //   |scheme| - the authentication scheme (i.e. basic, negotiate).
-  //   returns  - the matched entry or NULL.
+  // The most entries kept; the least recently used is evicted beyond it.
+  size_t max_entries() const {
+    return max_entries_;
+  }
+  void set_max_entries(size_t max_entries);
+
+  // Time an entry is kept without being looked up or added; zero (the
+  // default) keeps entries until evicted.
+  base::TimeDelta entry_lifetime() const {
+    return entry_lifetime_;
+  }
+  void set_entry_lifetime(base::TimeDelta entry_lifetime) {
+    entry_lifetime_ = entry_lifetime;
+  }
+
+  // Find the entry for realm |realm|, scheme |scheme| and account
+  // |account|, making it the most recently used.
+  //   |realm|   - case sensitive realm string.
+  //   |scheme|  - the authentication scheme (i.e. basic, negotiate).
+  //   |account| - the account authenticating, or empty.
+  //   returns   - the matched entry or NULL.
   Entry* Lookup(const std::string& realm,
-                Auth::Scheme scheme);
+                Auth::Scheme scheme,
+                const std::string& account);
 
-  // Add an entry on server |origin| for realm |handler->realm()| and
-  // scheme |handler->scheme()|.  If an entry for this (realm,scheme)
-  // already exists, update it rather than replace it.
+  // Add an entry for realm |realm|, scheme |scheme| and account |account|.
+  // If an entry for this triple already exists, update it rather than
+  // replace it.
   //   |realm|    - the auth realm for the challenge.
   //   |scheme|   - the authentication scheme (i.e. basic, negotiate).
+  //   |account|  - the account authenticating, or empty.
   //   |credentials| - login information for the realm.
   //   returns    - the entry that was just added/updated.
   Entry* Add(const std::string& realm,
              Auth::Scheme scheme,
+             const std::string& account,
              const net::AuthCredentials& credentials);
 
-  // Remove entry on server |origin| for realm |realm| and scheme |scheme|
-  // if one exists AND if the cached credentials matches |credentials|.
-  //   |realm|    - case sensitive realm string.
-  //   |scheme|   - the authentication scheme (i.e. basic, negotiate).
+  // Remove the entry for realm |realm|, scheme |scheme| and account
+  // |account| if one exists AND if the cached credentials matches
+  // |credentials|.
   //   |credentials| - the credentials to match.
   //   returns    - true if an entry was removed.
   bool Remove(const std::string& realm,
               Auth::Scheme scheme,
+              const std::string& account,
               const net::AuthCredentials& credentials);
 
-  // Updates a stale digest entry on server |origin| for realm |realm| and
-  // scheme |scheme|. The cached auth challenge is replaced with
-  // |auth_challenge| and the nonce count is reset.
+  // Updates a stale digest entry for realm |realm|, scheme |scheme| and
+  // account |account|: the nonce count is reset.
   // |UpdateStaleChallenge()| returns true if a matching entry exists in the
   // cache, false otherwise.
   bool UpdateStaleChallenge(const std::string& realm,
-                            Auth::Scheme scheme);
+                            Auth::Scheme scheme,
+                            const std::string& account);
+
+  // Finds the entries of account |account| that hold a challenge, to
+  // authorize its new requests preemptively, making them the most recently
+  // used. Entries are scanned linearly, which is fine for the few realms a
+  // single account authenticates to.
+  //   |account| - the account authenticating, or empty.
+  //   |entries| - receives the matched entries.
+  void LookupPreemptive(const std::string& account,
+                        std::vector<Entry*>* entries);
 
   // Copies all entries from |other| cache.
   void UpdateAllFrom(const AuthCache& other);
 
+  // Number of entries currently cached.
+  size_t size() const {
+    return entries_.size();
+  }
+
+  // The clock used to expire entries. Not owned.
+  void set_tick_clock_for_testing(base::TickClock* tick_clock) {
+    tick_clock_ = tick_clock;
+  }
+
  private:
+  // Most recently used first.
   typedef std::list<Entry> EntryList;
+  typedef base::hash_map<std::string, EntryList::iterator> EntryMap;
+
+  static std::string GetKey(const std::string& realm,
+                            Auth::Scheme scheme,
+                            const std::string& account);
+  base::TimeTicks NowTicks() const;
+  bool IsExpired(const Entry& entry, base::TimeTicks now) const;
+  void Erase(EntryMap::iterator it);
+
   EntryList entries_;
+  EntryMap entries_by_key_;
+  size_t max_entries_;
+  base::TimeDelta entry_lifetime_;
+  base::TickClock* tick_clock_;
 };
 
 } // namespace sippet
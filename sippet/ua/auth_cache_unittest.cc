@@ -0,0 +1,144 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/ua/auth_cache.h"
+
+#include "base/strings/utf_string_conversions.h"
+#include "base/test/simple_test_tick_clock.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const char kRealm[] = "atlanta.com";
+const char kAlice[] = "sip:alice@atlanta.com";
+const char kBob[] = "sip:bob@atlanta.com";
+
+net::AuthCredentials MakeCredentials(const char *username) {
+  return net::AuthCredentials(base::ASCIIToUTF16(username),
+                              base::ASCIIToUTF16("secret"));
+}
+
+}  // namespace
+
+TEST(AuthCacheTest, KeyedByAccount) {
+  AuthCache cache;
+  cache.Add(kRealm, net::HttpAuth::AUTH_SCHEME_DIGEST, kAlice,
+            MakeCredentials("alice"));
+  cache.Add(kRealm, net::HttpAuth::AUTH_SCHEME_DIGEST, kBob,
+            MakeCredentials("bob"));
+  EXPECT_EQ(2u, cache.size());
+
+  AuthCache::Entry *entry =
+      cache.Lookup(kRealm, net::HttpAuth::AUTH_SCHEME_DIGEST, kBob);
+  ASSERT_TRUE(entry);
+  EXPECT_EQ(base::ASCIIToUTF16("bob"), entry->credentials().username());
+  EXPECT_FALSE(cache.Lookup(kRealm, net::HttpAuth::AUTH_SCHEME_BASIC, kBob));
+  EXPECT_FALSE(cache.Lookup("biloxi.com", net::HttpAuth::AUTH_SCHEME_DIGEST,
+                            kBob));
+
+  // Only removed when the credentials match.
+  EXPECT_FALSE(cache.Remove(kRealm, net::HttpAuth::AUTH_SCHEME_DIGEST, kBob,
+                            MakeCredentials("alice")));
+  EXPECT_TRUE(cache.Remove(kRealm, net::HttpAuth::AUTH_SCHEME_DIGEST, kBob,
+                           MakeCredentials("bob")));
+  EXPECT_FALSE(cache.Lookup(kRealm, net::HttpAuth::AUTH_SCHEME_DIGEST, kBob));
+  EXPECT_EQ(1u, cache.size());
+}
+
+TEST(AuthCacheTest, EvictsLeastRecentlyUsed) {
+  AuthCache cache;
+  cache.set_max_entries(2);
+  cache.Add("a", net::HttpAuth::AUTH_SCHEME_DIGEST, "", MakeCredentials("a"));
+  cache.Add("b", net::HttpAuth::AUTH_SCHEME_DIGEST, "", MakeCredentials("b"));
+  // Using "a" makes "b" the oldest.
+  EXPECT_TRUE(cache.Lookup("a", net::HttpAuth::AUTH_SCHEME_DIGEST, ""));
+  cache.Add("c", net::HttpAuth::AUTH_SCHEME_DIGEST, "", MakeCredentials("c"));
+  EXPECT_EQ(2u, cache.size());
+  EXPECT_TRUE(cache.Lookup("a", net::HttpAuth::AUTH_SCHEME_DIGEST, ""));
+  EXPECT_FALSE(cache.Lookup("b", net::HttpAuth::AUTH_SCHEME_DIGEST, ""));
+  EXPECT_TRUE(cache.Lookup("c", net::HttpAuth::AUTH_SCHEME_DIGEST, ""));
+
+  cache.set_max_entries(1);
+  EXPECT_EQ(1u, cache.size());
+  EXPECT_TRUE(cache.Lookup("c", net::HttpAuth::AUTH_SCHEME_DIGEST, ""));
+}
+
+TEST(AuthCacheTest, ExpiresUnusedEntries) {
+  base::SimpleTestTickClock clock;
+  AuthCache cache;
+  cache.set_tick_clock_for_testing(&clock);
+  cache.set_entry_lifetime(base::TimeDelta::FromMinutes(10));
+  cache.Add(kRealm, net::HttpAuth::AUTH_SCHEME_DIGEST, kAlice,
+            MakeCredentials("alice"));
+
+  clock.Advance(base::TimeDelta::FromMinutes(9));
+  EXPECT_TRUE(cache.Lookup(kRealm, net::HttpAuth::AUTH_SCHEME_DIGEST,
+                           kAlice));
+  // The lookup refreshed it.
+  clock.Advance(base::TimeDelta::FromMinutes(9));
+  EXPECT_TRUE(cache.Lookup(kRealm, net::HttpAuth::AUTH_SCHEME_DIGEST,
+                           kAlice));
+  clock.Advance(base::TimeDelta::FromMinutes(11));
+  EXPECT_FALSE(cache.Lookup(kRealm, net::HttpAuth::AUTH_SCHEME_DIGEST,
+                            kAlice));
+  EXPECT_EQ(0u, cache.size());
+}
+
+TEST(AuthCacheTest, LookupPreemptive) {
+  AuthCache cache;
+  Challenge challenge(Challenge::Digest);
+  challenge.set_realm(kRealm);
+  challenge.set_nonce("dcd98b7102dd2f0e8b11d0f600bfb0c093");
+  GURL origin("sip:atlanta.com:5060");
+
+  // Entries without a challenge are skipped.
+  cache.Add("biloxi.com", net::HttpAuth::AUTH_SCHEME_DIGEST, kAlice,
+            MakeCredentials("alice"));
+  AuthCache::Entry *entry = cache.Add(kRealm,
+      net::HttpAuth::AUTH_SCHEME_DIGEST, kAlice, MakeCredentials("alice"));
+  entry->SetChallenge(challenge, net::HttpAuth::AUTH_SERVER, origin);
+  entry = cache.Add(kRealm, net::HttpAuth::AUTH_SCHEME_DIGEST, kBob,
+                    MakeCredentials("bob"));
+  entry->SetChallenge(challenge, net::HttpAuth::AUTH_SERVER, origin);
+
+  std::vector<AuthCache::Entry*> entries;
+  cache.LookupPreemptive(kAlice, &entries);
+  ASSERT_EQ(1u, entries.size());
+  EXPECT_EQ(base::ASCIIToUTF16("alice"), entries[0]->credentials().username());
+  EXPECT_EQ("dcd98b7102dd2f0e8b11d0f600bfb0c093",
+            entries[0]->challenge().nonce());
+  EXPECT_EQ(net::HttpAuth::AUTH_SERVER, entries[0]->target());
+  EXPECT_EQ(origin, entries[0]->origin());
+  EXPECT_EQ(2, entries[0]->IncrementNonceCount());
+
+  // A stale nonce restarts the count.
+  EXPECT_TRUE(cache.UpdateStaleChallenge(kRealm,
+      net::HttpAuth::AUTH_SCHEME_DIGEST, kAlice));
+  EXPECT_EQ(2, entries[0]->IncrementNonceCount());
+
+  entries.clear();
+  cache.LookupPreemptive("sip:carol@atlanta.com", &entries);
+  EXPECT_TRUE(entries.empty());
+}
+
+TEST(AuthCacheTest, DigestHA1DroppedWithCredentials) {
+  AuthCache cache;
+  AuthCache::Entry *entry = cache.Add(kRealm,
+      net::HttpAuth::AUTH_SCHEME_DIGEST, kAlice, MakeCredentials("alice"));
+  entry->set_digest_ha1("SHA-256", "ha1");
+  EXPECT_EQ("ha1", entry->digest_ha1("SHA-256"));
+  EXPECT_EQ("", entry->digest_ha1("MD5"));
+
+  // Kept while the credentials are the same.
+  entry = cache.Add(kRealm, net::HttpAuth::AUTH_SCHEME_DIGEST, kAlice,
+                    MakeCredentials("alice"));
+  EXPECT_EQ("ha1", entry->digest_ha1("SHA-256"));
+  entry = cache.Add(kRealm, net::HttpAuth::AUTH_SCHEME_DIGEST, kAlice,
+                    MakeCredentials("alice2"));
+  EXPECT_EQ("", entry->digest_ha1("SHA-256"));
+}
+
+} // End of sippet namespace
@@ -89,6 +89,11 @@ int AuthController::HandleAuthChallenge(
 
   target_ = target;
 
+  // Look it up for reading only, as it's shared with the request.
+  const Response *const_response = response.get();
+  const From *from = const_response->get<From>();
+  account_ = from ? from->address().spec() : std::string();
+
   // Give the existing auth handler first try at the authentication headers.
   // This will also evict the entry in the HttpAuthCache if the previous
   // challenge appeared to be rejected, or is using a stale nonce in the Digest
@@ -97,6 +102,7 @@ int AuthController::HandleAuthChallenge(
     Auth::AuthorizationResult result =
         Auth::HandleChallengeResponse(handler_.get(),
                                       response,
+                                      realm_,
                                       disabled_schemes_);
     switch (result) {
       case net::HttpAuth::AUTHORIZATION_RESULT_ACCEPT:
@@ -109,7 +115,8 @@ int AuthController::HandleAuthChallenge(
         break;
       case net::HttpAuth::AUTHORIZATION_RESULT_STALE:
         if (auth_cache_->UpdateStaleChallenge(handler_->realm(),
-                                              handler_->auth_scheme())) {
+                                              handler_->auth_scheme(),
+                                              account_)) {
           InvalidateCurrentHandler(INVALIDATE_HANDLER);
         } else {
           // It's possible that a server could incorrectly issue a stale
@@ -137,9 +144,11 @@ int AuthController::HandleAuthChallenge(
       // Find the best authentication challenge that we support.
       Auth::ChooseBestChallenge(auth_handler_factory_,
                                 response,
+                                realm_,
                                 disabled_schemes_,
                                 net_log,
-                                &handler_);
+                                &handler_,
+                                &challenge_);
       if (!handler_.get()) {
         // We found no supported challenge -- let the transaction continue so
         // the app ends up displaying an error page.
@@ -188,6 +197,7 @@ void AuthController::ResetAuth(const net::AuthCredentials& credentials) {
     identity_.invalid = false;
     identity_.credentials = credentials;
   }
+  rejected_auth_info_ = nullptr;
 
   // Add the auth entry to the cache before restarting. We don't know whether
   // the identity is valid yet, but if it is valid we want other transactions
@@ -202,10 +212,15 @@ void AuthController::ResetAuth(const net::AuthCredentials& credentials) {
     case net::HttpAuth::IDENT_SRC_NONE:
     case net::HttpAuth::IDENT_SRC_DEFAULT_CREDENTIALS:
       break;
-    default:
-      auth_cache_->Add(handler_->realm(), handler_->auth_scheme(),
-                       identity_.credentials);
+    default: {
+      AuthCache::Entry* entry = auth_cache_->Add(handler_->realm(),
+          handler_->auth_scheme(), account_, identity_.credentials);
+      if (challenge_.get()) {
+        entry->SetChallenge(*challenge_, handler_->target(),
+                            handler_->origin());
+      }
       break;
+    }
   }
 }
 
@@ -214,8 +229,16 @@ int AuthController::AddAuthorizationHeaders(
     const net::CompletionCallback& callback,
     const net::BoundNetLog& net_log) {
   const net::AuthCredentials* credentials = nullptr;
-  if (identity_.source != net::HttpAuth::IDENT_SRC_DEFAULT_CREDENTIALS)
+  AuthCache::Entry* entry = nullptr;
+  if (identity_.source != net::HttpAuth::IDENT_SRC_DEFAULT_CREDENTIALS) {
     credentials = &identity_.credentials;
+    // Lets the handler reuse what it derived from the cached credentials.
+    entry = auth_cache_->Lookup(handler_->realm(), handler_->auth_scheme(),
+                                account_);
+    if (entry && !entry->credentials().Equals(*credentials))
+      entry = nullptr;
+  }
+  handler_->set_auth_cache_entry(entry);
   DCHECK(callback_.is_null());
   int rv = handler_->GenerateAuth(
       credentials, request,
@@ -267,8 +290,11 @@ void AuthController::InvalidateRejectedAuthFromCache() {
   // Clear the cache entry for the identity we just failed on.
   // Note: we require the credentials to match before invalidating
   // since the entry in the cache may be newer than what we used last time.
-  auth_cache_->Remove(handler_->realm(), handler_->auth_scheme(),
+  auth_cache_->Remove(handler_->realm(), handler_->auth_scheme(), account_,
                       identity_.credentials);
+  if (net::HttpAuth::IDENT_SRC_NONE != identity_.source
+      && net::HttpAuth::IDENT_SRC_DEFAULT_CREDENTIALS != identity_.source)
+    rejected_auth_info_ = CreateAuthChallengeInfo();
 }
 
 bool AuthController::SelectNextAuthIdentityToTry() {
@@ -276,8 +302,8 @@ bool AuthController::SelectNextAuthIdentityToTry() {
   DCHECK(identity_.invalid);
 
   // Check the auth cache for a realm entry.
-  AuthCache::Entry* entry =
-      auth_cache_->Lookup(handler_->realm(), handler_->auth_scheme());
+  AuthCache::Entry* entry = auth_cache_->Lookup(
+      handler_->realm(), handler_->auth_scheme(), account_);
 
   if (entry) {
     identity_.source = net::HttpAuth::IDENT_SRC_REALM_LOOKUP;
@@ -304,12 +330,17 @@ bool AuthController::SelectNextAuthIdentityToTry() {
 
 void AuthController::PopulateAuthChallenge() {
   // Populates auth_info_ with the authentication challenge info.
+  auth_info_ = CreateAuthChallengeInfo();
+}
 
-  auth_info_ = new net::AuthChallengeInfo;
-  auth_info_->is_proxy = (target_ == net::HttpAuth::AUTH_PROXY);
-  auth_info_->challenger = net::HostPortPair::FromURL(auth_origin_);
-  auth_info_->scheme = Auth::SchemeToString(handler_->auth_scheme());
-  auth_info_->realm = handler_->realm();
+scoped_refptr<net::AuthChallengeInfo>
+    AuthController::CreateAuthChallengeInfo() const {
+  scoped_refptr<net::AuthChallengeInfo> auth_info(new net::AuthChallengeInfo);
+  auth_info->is_proxy = (handler_->target() == net::HttpAuth::AUTH_PROXY);
+  auth_info->challenger = net::HostPortPair::FromURL(handler_->origin());
+  auth_info->scheme = Auth::SchemeToString(handler_->auth_scheme());
+  auth_info->realm = handler_->realm();
+  return auth_info;
 }
 
 bool AuthController::DisableOnAuthHandlerResult(int result) {
@@ -52,6 +52,13 @@ class AuthController :
   // Take the authentication challenge information.
   scoped_refptr<net::AuthChallengeInfo> auth_info();
 
+  // The challenge information of the last identity rejected, if any since
+  // the last |ResetAuth|, so that the credentials given for it are not
+  // given again.
+  scoped_refptr<net::AuthChallengeInfo> rejected_auth_info() {
+    return rejected_auth_info_;
+  }
+
   // Check whether the controller has any authentication pending.
   bool HaveAuth() const;
 
@@ -70,6 +77,16 @@ class AuthController :
     return target_;
   }
 
+  // The realm of the challenges handled, when each challenger of the
+  // request has its own controller; empty (the default) handles the best
+  // challenge of any realm.
+  const std::string& realm() const {
+    return realm_;
+  }
+  void set_realm(const std::string& realm) {
+    realm_ = realm;
+  }
+
  private:
   virtual ~AuthController();
 
@@ -101,6 +118,10 @@ class AuthController :
   // credentials can be prompted.
   void PopulateAuthChallenge();
 
+  // The challenge information of the current handler, for the target and
+  // origin it was created for.
+  scoped_refptr<net::AuthChallengeInfo> CreateAuthChallengeInfo() const;
+
   // If |result| indicates a permanent failure, disables the current
   // auth scheme for this controller and returns true.  Returns false
   // otherwise.
@@ -116,11 +137,22 @@ class AuthController :
   // Holds the {scheme, host, port} for the authentication target.
   GURL auth_origin_;
 
+  // Restricts the challenges handled, if not empty.
+  std::string realm_;
+
+  // The From address of the challenged requests, keying the cached
+  // identities along with the realm and scheme.
+  std::string account_;
+
   // |handler_| encapsulates the logic for the particular auth-scheme.
   // This includes the challenge's parameters. If NULL, then there is no
   // associated auth handler.
   scoped_ptr<AuthHandler> handler_;
 
+  // The challenge |handler_| was created from, cached along with the
+  // identity.
+  scoped_ptr<Challenge> challenge_;
+
   // |identity_| holds the credentials that should be used by
   // the handler_ to generate challenge responses. This identity can come from
   // a number of places (url, cache, prompt).
@@ -129,6 +161,9 @@ class AuthController :
   // Contains information about the auth challenge.
   scoped_refptr<net::AuthChallengeInfo> auth_info_;
 
+  // The challenge of the last identity rejected.
+  scoped_refptr<net::AuthChallengeInfo> rejected_auth_info_;
+
   // True if default credentials have already been tried for this transaction
   // in response to an HTTP authentication challenge.
   bool default_credentials_used_;
@@ -34,7 +34,8 @@ net::NetLog::EventType EventTypeFromAuthTarget(Auth::Target target) {
 AuthHandler::AuthHandler()
   : auth_scheme_(net::HttpAuth::AUTH_SCHEME_MAX),
     score_(-1),
-    target_(net::HttpAuth::AUTH_NONE) {
+    target_(net::HttpAuth::AUTH_NONE),
+    auth_cache_entry_(nullptr) {
 }
 
 AuthHandler::~AuthHandler() {
@@ -73,6 +74,7 @@ int AuthHandler::GenerateAuth(
       credentials, request,
       base::Bind(&AuthHandler::OnGenerateAuthComplete,
                  base::Unretained(this)));
+  auth_cache_entry_ = nullptr;
   if (rv != net::ERR_IO_PENDING)
     FinishGenerateAuth();
   return rv;
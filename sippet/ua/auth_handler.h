@@ -6,6 +6,7 @@
 #define SIPPET_UA_AUTH_HANDLER_H_
 
 #include "sippet/ua/auth.h"
+#include "sippet/ua/auth_cache.h"
 #include "net/log/net_log.h"
 #include "net/base/completion_callback.h"
 
@@ -74,6 +75,13 @@ class AuthHandler {
                    const scoped_refptr<Request> &request,
                    const net::CompletionCallback& callback);
 
+  // Sets the cache entry holding the credentials of the next
+  // |GenerateAuth()|, so that schemes can keep there what they derive from
+  // them. It's only used during that call, and may be NULL.
+  void set_auth_cache_entry(AuthCache::Entry* entry) {
+    auth_cache_entry_ = entry;
+  }
+
   // The authentication scheme as an enumerated value.
   Auth::Scheme auth_scheme() const {
     return auth_scheme_;
@@ -147,6 +155,9 @@ class AuthHandler {
   // origin server.
   Auth::Target target_;
 
+  // The cache entry of the credentials being used, if any.
+  AuthCache::Entry* auth_cache_entry_;
+
   net::BoundNetLog net_log_;
 
  private:
@@ -10,12 +10,16 @@
 #include "base/logging.h"
 #include "base/md5.h"
 #include "base/rand_util.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
 #include "net/base/net_errors.h"
 #include "net/base/net_util.h"
+#include "crypto/sha2.h"
+#include "sippet/base/sha512_256.h"
 #include "sippet/ua/auth.h"
+#include "sippet/ua/auth_cache.h"
 #include "sippet/message/request.h"
 #include "url/gurl.h"
 
@@ -28,30 +32,35 @@ namespace sippet {
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
-// Digest authentication is specified in RFC 2617.
-// The expanded derivations are listed in the tables below.
+// Digest authentication is specified in RFC 2617, and RFC 7616 adds the
+// SHA-256 and SHA-512-256 algorithms, allowed in SIP by RFC 8760.
+// The expanded derivations are listed in the tables below, where H is the
+// hash function of the algorithm (MD5 when unspecified).
 
 //==========+==========+==========================================+
 //    qop   |algorithm |               response                   |
 //==========+==========+==========================================+
-//    ?     |  ?, md5, | MD5(MD5(A1):nonce:MD5(A2))               |
-//          | md5-sess |                                          |
+//    ?     |  ?, H,   | H(H(A1):nonce:H(A2))                     |
+//          |  H-sess  |                                          |
 //--------- +----------+------------------------------------------+
-//   auth,  |  ?, md5, | MD5(MD5(A1):nonce:nc:cnonce:qop:MD5(A2)) |
-// auth-int | md5-sess |                                          |
+//   auth,  |  ?, H,   | H(H(A1):nonce:nc:cnonce:qop:H(A2))       |
+// auth-int |  H-sess  |                                          |
 //==========+==========+==========================================+
 //    qop   |algorithm |                  A1                      |
 //==========+==========+==========================================+
-//          | ?, md5   | user:realm:password                      |
+//          | ?, H     | user:realm:password                      |
 //----------+----------+------------------------------------------+
-//          | md5-sess | MD5(user:realm:password):nonce:cnonce    |
+//          | H-sess   | H(user:realm:password):nonce:cnonce      |
 //==========+==========+==========================================+
 //    qop   |algorithm |                  A2                      |
 //==========+==========+==========================================+
 //  ?, auth |          | req-method:req-uri                       |
 //----------+----------+------------------------------------------+
-// auth-int |          | req-method:req-uri:MD5(req-entity-body)  |
+// auth-int |          | req-method:req-uri:H(req-entity-body)    |
 //=====================+==========================================+
+//
+// H(user:realm:password) only depends on the credentials, so it's kept in
+// the auth cache entry, and each request only hashes the rest.
 
 AuthHandlerDigest::NonceGenerator::NonceGenerator() {
 }
@@ -223,6 +232,14 @@ bool AuthHandlerDigest::ParseChallenge(
       algorithm_ = ALGORITHM_MD5;
     } else if (base::LowerCaseEqualsASCII(algorithm, "md5-sess")) {
       algorithm_ = ALGORITHM_MD5_SESS;
+    } else if (base::LowerCaseEqualsASCII(algorithm, "sha-256")) {
+      algorithm_ = ALGORITHM_SHA256;
+    } else if (base::LowerCaseEqualsASCII(algorithm, "sha-256-sess")) {
+      algorithm_ = ALGORITHM_SHA256_SESS;
+    } else if (base::LowerCaseEqualsASCII(algorithm, "sha-512-256")) {
+      algorithm_ = ALGORITHM_SHA512_256;
+    } else if (base::LowerCaseEqualsASCII(algorithm, "sha-512-256-sess")) {
+      algorithm_ = ALGORITHM_SHA512_256_SESS;
     } else {
       DVLOG(1) << "Unknown value of algorithm";
       return false;  // FAIL -- unsupported value of algorithm.
@@ -249,6 +266,21 @@ bool AuthHandlerDigest::ParseChallenge(
   if (nonce_.empty())
     return false;
 
+  // Servers offer one challenge per algorithm, so prefer the stronger ones
+  // (RFC 8760 section 2.4).
+  switch (algorithm_) {
+    case ALGORITHM_SHA256:
+    case ALGORITHM_SHA256_SESS:
+      score_ = 3;
+      break;
+    case ALGORITHM_SHA512_256:
+    case ALGORITHM_SHA512_256_SESS:
+      score_ = 4;
+      break;
+    default:
+      break;
+  }
+
   return true;
 }
 
@@ -267,6 +299,48 @@ std::string AuthHandlerDigest::QopToString(QualityOfProtection qop) {
   }
 }
 
+// static
+bool AuthHandlerDigest::IsSessionAlgorithm(DigestAlgorithm algorithm) {
+  return algorithm == ALGORITHM_MD5_SESS
+      || algorithm == ALGORITHM_SHA256_SESS
+      || algorithm == ALGORITHM_SHA512_256_SESS;
+}
+
+// static
+const char* AuthHandlerDigest::HashName(DigestAlgorithm algorithm) {
+  switch (algorithm) {
+    case ALGORITHM_SHA256:
+    case ALGORITHM_SHA256_SESS:
+      return "SHA-256";
+    case ALGORITHM_SHA512_256:
+    case ALGORITHM_SHA512_256_SESS:
+      return "SHA-512-256";
+    default:
+      return "MD5";
+  }
+}
+
+// static
+std::string AuthHandlerDigest::HashString(DigestAlgorithm algorithm,
+                                          const std::string& data) {
+  switch (algorithm) {
+    case ALGORITHM_SHA256:
+    case ALGORITHM_SHA256_SESS: {
+      std::string hash(crypto::SHA256HashString(data));
+      return base::StringToLowerASCII(
+          base::HexEncode(hash.data(), hash.size()));
+    }
+    case ALGORITHM_SHA512_256:
+    case ALGORITHM_SHA512_256_SESS: {
+      std::string hash(SHA512_256HashString(data));
+      return base::StringToLowerASCII(
+          base::HexEncode(hash.data(), hash.size()));
+    }
+    default:
+      return base::MD5String(data);
+  }
+}
+
 // static
 Credentials::Algorithm AuthHandlerDigest::AlgorithmToCredentials(
     DigestAlgorithm algorithm) {
@@ -275,6 +349,14 @@ Credentials::Algorithm AuthHandlerDigest::AlgorithmToCredentials(
       return Credentials::MD5;
     case ALGORITHM_MD5_SESS:
       return Credentials::MD5_sess;
+    case ALGORITHM_SHA256:
+      return Credentials::SHA_256;
+    case ALGORITHM_SHA256_SESS:
+      return Credentials::SHA_256_sess;
+    case ALGORITHM_SHA512_256:
+      return Credentials::SHA_512_256;
+    case ALGORITHM_SHA512_256_SESS:
+      return Credentials::SHA_512_256_sess;
     default:
       NOTREACHED();
       return Credentials::Algorithm(-1);
@@ -303,26 +385,41 @@ std::string AuthHandlerDigest::AssembleResponseDigest(
   // the nonce-count is an 8 digit hex string.
   std::string nc = base::StringPrintf("%08x", nonce_count);
 
-  // ha1 = MD5(A1)
-  std::string ha1 = base::MD5String(base::UTF16ToUTF8(credentials.username())
-      + ":" + original_realm_ + ":" +
-      base::UTF16ToUTF8(credentials.password()));
-  if (algorithm_ == AuthHandlerDigest::ALGORITHM_MD5_SESS)
-    ha1 = base::MD5String(ha1 + ":" + nonce_ + ":" + cnonce);
+  // ha1 = H(A1)
+  std::string ha1 = GetHA1(credentials);
+  if (IsSessionAlgorithm(algorithm_))
+    ha1 = HashString(algorithm_, ha1 + ":" + nonce_ + ":" + cnonce);
 
-  // ha2 = MD5(A2)
+  // ha2 = H(A2)
   std::string a2 = method + ":" + request_uri;
   if (qop_ == AuthHandlerDigest::QOP_AUTH_INT)
-    a2 += ":" + base::MD5String(body);
+    a2 += ":" + HashString(algorithm_, body);
 
-  std::string ha2 = base::MD5String(a2);
+  std::string ha2 = HashString(algorithm_, a2);
 
   std::string nc_part;
   if (qop_ != AuthHandlerDigest::QOP_UNSPECIFIED) {
     nc_part = nc + ":" + cnonce + ":" + QopToString(qop_) + ":";
   }
 
-  return base::MD5String(ha1 + ":" + nonce_ + ":" + nc_part + ha2);
+  return HashString(algorithm_, ha1 + ":" + nonce_ + ":" + nc_part + ha2);
+}
+
+std::string AuthHandlerDigest::GetHA1(
+    const net::AuthCredentials& credentials) const {
+  const char* hash_name = HashName(algorithm_);
+  if (auth_cache_entry_) {
+    DCHECK(auth_cache_entry_->credentials().Equals(credentials));
+    const std::string& ha1 = auth_cache_entry_->digest_ha1(hash_name);
+    if (!ha1.empty())
+      return ha1;
+  }
+  std::string ha1 = HashString(algorithm_,
+      base::UTF16ToUTF8(credentials.username()) + ":" + original_realm_
+      + ":" + base::UTF16ToUTF8(credentials.password()));
+  if (auth_cache_entry_)
+    auth_cache_entry_->set_digest_ha1(hash_name, ha1);
+  return ha1;
 }
 
 void AuthHandlerDigest::AssembleCredentials(
@@ -352,7 +449,7 @@ void AuthHandlerDigest::AssembleCredentials(
     cred->set_algorithm(AlgorithmToCredentials(algorithm_));
   }
   std::string response = AssembleResponseDigest(method, request_uri,
-    request->content(), credentials, cnonce, nonce_count);
+    request->encoded_content(), credentials, cnonce, nonce_count);
   cred->set_response(response);
   if (!opaque_.empty()) {
     cred->set_opaque(opaque_);
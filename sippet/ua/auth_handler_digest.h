@@ -107,6 +107,12 @@ class AuthHandlerDigest : public AuthHandler {
     // Hash is run only once during the first WWW-Authenticate handshake.
     // (SESS means session).
     ALGORITHM_MD5_SESS,
+
+    // The same, hashing with SHA-256 and SHA-512/256 (RFC 7616, RFC 8760).
+    ALGORITHM_SHA256,
+    ALGORITHM_SHA256_SESS,
+    ALGORITHM_SHA512_256,
+    ALGORITHM_SHA512_256_SESS,
   };
 
   // Possible values for QualityOfProtection.
@@ -134,6 +140,17 @@ class AuthHandlerDigest : public AuthHandler {
   // Convert enum value back to string.
   static std::string QopToString(QualityOfProtection qop);
 
+  // Whether |algorithm| is a session variant, hashing the nonces into A1.
+  static bool IsSessionAlgorithm(DigestAlgorithm algorithm);
+
+  // The name of the hash function of |algorithm|, which keys the H(A1)
+  // kept in the cache entry.
+  static const char* HashName(DigestAlgorithm algorithm);
+
+  // Hashes |data| with the function of |algorithm|, in lowercase hex.
+  static std::string HashString(DigestAlgorithm algorithm,
+                                const std::string& data);
+
   // Convert enum value back to Credentials types.
   static Credentials::Algorithm AlgorithmToCredentials(
     DigestAlgorithm algorithm);
@@ -144,6 +161,10 @@ class AuthHandlerDigest : public AuthHandler {
                                      std::string* method,
                                      std::string* request_uri) const;
 
+  // Returns H(user:realm:password), reusing the one kept by the cache entry
+  // for |credentials|, if any.
+  std::string GetHA1(const net::AuthCredentials& credentials) const;
+
   // Build up  the 'response' production.
   std::string AssembleResponseDigest(const std::string& method,
                                      const std::string& request_uri,
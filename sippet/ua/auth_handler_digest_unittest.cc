@@ -255,6 +255,60 @@ TEST(AuthHandlerDigest, AuthIntAndMd5Sess) {
             auth_token);
 }
 
+TEST(AuthHandlerDigest, AuthAndSha256) {
+  std::string auth_token;
+  EXPECT_TRUE(RespondToChallenge(
+      "Digest realm=\"biloxi.com\", "
+      "qop=\"auth,auth-int\", "
+      "algorithm=SHA-256, "
+      "nonce=\"dcd98b7102dd2f0e8b11d0f600bfb0c093\", "
+      "opaque=\"5ccc069c403ebaf9f0171e9517f40e41\"",
+      Method::INVITE,
+      "sip:bob@biloxi.com",
+      "",
+      "0a4f113b",
+      &auth_token));
+  EXPECT_EQ("Authorization: Digest username=\"bob\", "
+            "realm=\"biloxi.com\", "
+            "nonce=\"dcd98b7102dd2f0e8b11d0f600bfb0c093\", "
+            "uri=\"sip:bob@biloxi.com\", "
+            "algorithm=SHA-256, "
+            "response=\"b3b5a6c69453abafaab9ae4dccdac90a"
+            "076b6c80615d5f3498e7433b6e93bf4f\", "
+            "opaque=\"5ccc069c403ebaf9f0171e9517f40e41\", "
+            "qop=auth, "
+            "nc=00000001, "
+            "cnonce=\"0a4f113b\"",
+            auth_token);
+}
+
+TEST(AuthHandlerDigest, AuthAndSha512_256Sess) {
+  std::string auth_token;
+  EXPECT_TRUE(RespondToChallenge(
+      "Digest realm=\"biloxi.com\", "
+      "qop=\"auth,auth-int\", "
+      "algorithm=SHA-512-256-sess, "
+      "nonce=\"dcd98b7102dd2f0e8b11d0f600bfb0c093\", "
+      "opaque=\"5ccc069c403ebaf9f0171e9517f40e41\"",
+      Method::INVITE,
+      "sip:bob@biloxi.com",
+      "",
+      "0a4f113b",
+      &auth_token));
+  EXPECT_EQ("Authorization: Digest username=\"bob\", "
+            "realm=\"biloxi.com\", "
+            "nonce=\"dcd98b7102dd2f0e8b11d0f600bfb0c093\", "
+            "uri=\"sip:bob@biloxi.com\", "
+            "algorithm=SHA-512-256-sess, "
+            "response=\"077d9677be83f41f162d1a4453dc1633"
+            "89919f81e5927391d972f477da767633\", "
+            "opaque=\"5ccc069c403ebaf9f0171e9517f40e41\", "
+            "qop=auth, "
+            "nc=00000001, "
+            "cnonce=\"0a4f113b\"",
+            auth_token);
+}
+
 TEST(AuthHandlerDigest, HandleAnotherChallenge) {
   scoped_ptr<AuthHandlerDigest::Factory> factory(
       new AuthHandlerDigest::Factory());
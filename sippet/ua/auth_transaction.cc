@@ -4,21 +4,57 @@
 
 #include "sippet/ua/auth_transaction.h"
 
+#include <algorithm>
+
+#include "base/bind.h"
 #include "net/base/net_errors.h"
+#include "sippet/message/headers.h"
 #include "sippet/message/message.h"
 #include "sippet/ua/auth_controller.h"
 #include "sippet/ua/dialog.h"
 
 namespace sippet {
 
+namespace {
+
+// Drops the credentials for |realm| that |request| already carries, such as
+// those added preemptively, before adding the new ones.
+template<class CredentialsType>
+void RemoveCredentials(const scoped_refptr<Request> &request,
+                       const std::string &realm) {
+  Message::iterator i = request->find_first<CredentialsType>();
+  while (request->end() != i) {
+    CredentialsType *credentials = dyn_cast<CredentialsType>(i);
+    if (credentials->HasRealm() && realm == credentials->realm()) {
+      request->erase(i);
+      i = request->find_first<CredentialsType>();
+    } else {
+      i = request->find_next<CredentialsType>(i);
+    }
+  }
+}
+
+}  // namespace
+
+AuthTransaction::Challenger::Challenger()
+  : target(net::HttpAuth::AUTH_NONE) {
+}
+
+AuthTransaction::Challenger::~Challenger() {
+}
+
 AuthTransaction::AuthTransaction(AuthCache *auth_cache,
     AuthHandlerFactory *auth_handler_factory,
     PasswordHandler::Factory *password_handler_factory,
     const net::BoundNetLog &bound_net_log) :
-  auth_controller_(new AuthController(auth_cache, auth_handler_factory)),
   next_state_(STATE_NONE),
   bound_net_log_(bound_net_log),
-  password_handler_factory_(password_handler_factory) {
+  auth_cache_(auth_cache),
+  auth_handler_factory_(auth_handler_factory),
+  password_handler_factory_(password_handler_factory),
+  pending_credentials_(0),
+  credentials_result_(net::OK),
+  next_challenger_(0) {
   DCHECK(password_handler_factory_);
 }
 
@@ -33,6 +69,7 @@ int AuthTransaction::HandleChallengeAuthentication(
   callback_ = callback;
   incoming_response_ = incoming_response;
   outgoing_request_ = outgoing_request;
+  next_challenger_ = 0;
   next_state_ = STATE_HANDLE_AUTH_CHALLENGE;
   return DoLoop(net::OK);
 }
@@ -79,19 +116,62 @@ int AuthTransaction::DoLoop(int last_io_result) {
         break;
     }
   } while (rv != net::ERR_IO_PENDING && next_state_ != STATE_NONE);
+  if (rv != net::ERR_IO_PENDING) {
+    // Don't keep the messages alive until the next challenge.
+    outgoing_request_ = nullptr;
+    incoming_response_ = nullptr;
+  }
   return rv;
 }
 
 int AuthTransaction::DoHandleAuthChallenge() {
   next_state_ = STATE_HANDLE_AUTH_CHALLENGE_COMPLETE;
-  return auth_controller_->HandleAuthChallenge(incoming_response_,
-      bound_net_log_);
+  challenged_.clear();
+  std::vector<std::string> realms;
+  Auth::GetChallengeRealms(incoming_response_, &realms);
+  if (realms.empty())
+    return net::ERR_UNSUPPORTED_AUTH_SCHEME;
+  Auth::Target target = Auth::GetChallengeTarget(incoming_response_);
+  if (net::HttpAuth::AUTH_SERVER == target) {
+    // Only one server challenges: those of the realms it left are stale.
+    for (ScopedVector<Challenger>::iterator i = challengers_.begin();
+         i != challengers_.end();) {
+      if (net::HttpAuth::AUTH_SERVER == (*i)->target
+          && std::find(realms.begin(), realms.end(), (*i)->realm)
+             == realms.end()) {
+        i = challengers_.erase(i);
+      } else {
+        ++i;
+      }
+    }
+  }
+  for (std::vector<std::string>::const_iterator i = realms.begin();
+       i != realms.end(); ++i) {
+    Challenger *challenger = GetChallenger(target, *i);
+    int rv = challenger->auth_controller->HandleAuthChallenge(
+        incoming_response_, bound_net_log_);
+    if (net::OK != rv)
+      return rv;
+    challenged_.push_back(challenger);
+  }
+  return net::OK;
 }
 
 int AuthTransaction::DoHandleAuthChallengeComplete() {
-  if (!auth_controller_->HaveAuthHandler())
+  bool supported = false;
+  bool needs_credentials = false;
+  for (std::vector<Challenger*>::const_iterator i = challenged_.begin();
+       i != challenged_.end(); ++i) {
+    AuthController *auth_controller = (*i)->auth_controller.get();
+    if (!auth_controller->HaveAuthHandler())
+      continue;
+    supported = true;
+    if (auth_controller->auth_info())
+      needs_credentials = true;
+  }
+  if (!supported)
     return net::ERR_UNSUPPORTED_AUTH_SCHEME;
-  if (auth_controller_->auth_info()) {
+  if (needs_credentials) {
     next_state_ = STATE_GET_CREDENTIALS;
     return net::OK;
   } else {
@@ -101,22 +181,43 @@ int AuthTransaction::DoHandleAuthChallengeComplete() {
 }
 
 int AuthTransaction::DoGetCredentials() {
-  DCHECK(auth_controller_->auth_info());
   next_state_ = STATE_GET_CREDENTIALS_COMPLETE;
-  scoped_ptr<PasswordHandler> password_handler =
-      password_handler_factory_->CreatePasswordHandler();
-  return password_handler->GetCredentials(
-      auth_controller_->auth_info().get(),
-      &username_,
-      &password_,
-      base::Bind(&AuthTransaction::OnIOComplete,
-          base::Unretained(this)));
+  pending_credentials_ = 0;
+  credentials_result_ = net::OK;
+  // All are asked at once, so that no challenger waits for another.
+  for (std::vector<Challenger*>::const_iterator i = challenged_.begin();
+       i != challenged_.end(); ++i) {
+    Challenger *challenger = *i;
+    AuthController *auth_controller = challenger->auth_controller.get();
+    if (!auth_controller->HaveAuthHandler() || !auth_controller->auth_info())
+      continue;
+    // Kept until the next challenge, as it may complete asynchronously.
+    challenger->password_handler =
+        password_handler_factory_->CreatePasswordHandlerForRequest(
+            outgoing_request_);
+    if (auth_controller->rejected_auth_info().get()) {
+      challenger->password_handler->OnCredentialsRejected(
+          auth_controller->rejected_auth_info().get());
+    }
+    int rv = challenger->password_handler->GetCredentials(
+        auth_controller->auth_info().get(),
+        &challenger->username,
+        &challenger->password,
+        base::Bind(&AuthTransaction::OnGetCredentialsComplete,
+            base::Unretained(this), challenger));
+    if (net::ERR_IO_PENDING == rv)
+      ++pending_credentials_;
+    else
+      SetCredentials(challenger, rv);
+  }
+  if (pending_credentials_ > 0)
+    return net::ERR_IO_PENDING;
+  return credentials_result_;
 }
 
 int AuthTransaction::DoGetCredentialsComplete(int result) {
   DCHECK_NE(net::ERR_IO_PENDING, result);
   if (result == net::OK) {
-    auth_controller_->ResetAuth(net::AuthCredentials(username_, password_));
     next_state_ = STATE_ADD_AUTHORIZATION_HEADERS;
     return net::OK;
   } else {
@@ -127,16 +228,71 @@ int AuthTransaction::DoGetCredentialsComplete(int result) {
 }
 
 int AuthTransaction::DoAddAuthorizationHeaders() {
+  // Every challenger authorizes the retry, not only those challenging now.
+  while (next_challenger_ < challengers_.size()
+         && !challengers_[next_challenger_]->auth_controller->HaveAuth())
+    ++next_challenger_;
+  if (challengers_.size() == next_challenger_) {
+    next_state_ = STATE_NONE;
+    return net::OK;
+  }
   next_state_ = STATE_ADD_AUTHORIZATION_HEADERS_COMPLETE;
-  return auth_controller_->AddAuthorizationHeaders(outgoing_request_,
+  Challenger *challenger = challengers_[next_challenger_];
+  if (net::HttpAuth::AUTH_PROXY == challenger->target)
+    RemoveCredentials<ProxyAuthorization>(outgoing_request_,
+                                          challenger->realm);
+  else
+    RemoveCredentials<Authorization>(outgoing_request_, challenger->realm);
+  return challenger->auth_controller->AddAuthorizationHeaders(
+      outgoing_request_,
       base::Bind(&AuthTransaction::OnIOComplete,
           base::Unretained(this)), bound_net_log_);
 }
 
 int AuthTransaction::DoAddAuthorizationHeadersComplete(int result) {
   DCHECK_NE(net::ERR_IO_PENDING, result);
-  next_state_ = STATE_NONE;
-  return result;
+  if (net::OK != result) {
+    next_state_ = STATE_NONE;
+    return result;
+  }
+  ++next_challenger_;
+  next_state_ = STATE_ADD_AUTHORIZATION_HEADERS;
+  return net::OK;
+}
+
+AuthTransaction::Challenger *AuthTransaction::GetChallenger(
+    Auth::Target target, const std::string &realm) {
+  for (ScopedVector<Challenger>::const_iterator i = challengers_.begin();
+       i != challengers_.end(); ++i) {
+    if (target == (*i)->target && realm == (*i)->realm)
+      return *i;
+  }
+  Challenger *challenger = new Challenger;
+  challenger->target = target;
+  challenger->realm = realm;
+  challenger->auth_controller =
+      new AuthController(auth_cache_, auth_handler_factory_);
+  challenger->auth_controller->set_realm(realm);
+  challengers_.push_back(challenger);
+  return challenger;
+}
+
+void AuthTransaction::OnGetCredentialsComplete(Challenger *challenger,
+                                               int result) {
+  DCHECK_GT(pending_credentials_, 0u);
+  SetCredentials(challenger, result);
+  if (0 == --pending_credentials_)
+    OnIOComplete(credentials_result_);
+}
+
+void AuthTransaction::SetCredentials(Challenger *challenger, int result) {
+  DCHECK_NE(net::ERR_IO_PENDING, result);
+  if (net::OK == result) {
+    challenger->auth_controller->ResetAuth(
+        net::AuthCredentials(challenger->username, challenger->password));
+  } else if (net::OK == credentials_result_) {
+    credentials_result_ = result;
+  }
 }
 
 void AuthTransaction::RunUserCallback(int status) {
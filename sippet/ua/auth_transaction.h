@@ -5,12 +5,17 @@
 #ifndef SIPPET_UA_AUTH_TRANSACTION_H_
 #define SIPPET_UA_AUTH_TRANSACTION_H_
 
+#include <string>
+#include <vector>
+
 #include "base/memory/ref_counted.h"
+#include "base/memory/scoped_vector.h"
 #include "base/strings/string16.h"
 
 #include "net/base/completion_callback.h"
 #include "net/log/net_log.h"
 
+#include "sippet/ua/auth.h"
 #include "sippet/ua/password_handler.h"
 
 namespace sippet {
@@ -23,6 +28,13 @@ class AuthHandlerFactory;
 
 // The AuthTransaction collects password from the user, when needed, and also
 // waits for asynchronous authentication schemes, such as GSSAPI and SSPI.
+//
+// Each challenger of the request, known by the target and realm of its
+// challenges, gets its own |AuthController|: when several proxies challenge
+// in the same response, their credentials are got at once, and the retried
+// request carries an authorization for each one. Challengers that don't
+// challenge again, such as the proxies passed before the server asked,
+// keep authorizing the retries.
 class AuthTransaction {
  public:
   AuthTransaction(AuthCache *auth_cache,
@@ -47,7 +59,21 @@ class AuthTransaction {
     STATE_NONE,
   };
 
+  // The authentication of a single challenger.
+  struct Challenger {
+    Challenger();
+    ~Challenger();
+
+    Auth::Target target;
+    std::string realm;
+    scoped_refptr<AuthController> auth_controller;
+    scoped_ptr<PasswordHandler> password_handler;
+    base::string16 username;
+    base::string16 password;
+  };
+
   void OnIOComplete(int result);
+  void OnGetCredentialsComplete(Challenger *challenger, int result);
 
   int DoLoop(int last_io_result);
   int DoHandleAuthChallenge();
@@ -57,6 +83,11 @@ class AuthTransaction {
   int DoAddAuthorizationHeaders();
   int DoAddAuthorizationHeadersComplete(int result);
 
+  // Returns the challenger of |realm| for |target|, creating it if new.
+  Challenger *GetChallenger(Auth::Target target, const std::string &realm);
+  // Uses the credentials got for |challenger|.
+  void SetCredentials(Challenger *challenger, int result);
+
   void RunUserCallback(int status);
 
   State next_state_;
@@ -66,12 +97,18 @@ class AuthTransaction {
 
   scoped_refptr<Request> outgoing_request_;
   scoped_refptr<Response> incoming_response_;
-  scoped_refptr<AuthController> auth_controller_;
+  AuthCache *auth_cache_;
+  AuthHandlerFactory *auth_handler_factory_;
   PasswordHandler::Factory *password_handler_factory_;
-  scoped_ptr<PasswordHandler> password_handler_;
 
-  base::string16 username_;
-  base::string16 password_;
+  ScopedVector<Challenger> challengers_;
+  // Those challenging in |incoming_response_|.
+  std::vector<Challenger*> challenged_;
+  // Credentials requests not completed yet, and the first error got.
+  size_t pending_credentials_;
+  int credentials_result_;
+  // The next challenger to authorize |outgoing_request_|.
+  size_t next_challenger_;
 
   DISALLOW_COPY_AND_ASSIGN(AuthTransaction);
 };
@@ -0,0 +1,169 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/ua/auth_transaction.h"
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/strings/utf_string_conversions.h"
+#include "net/base/auth.h"
+#include "net/base/net_errors.h"
+#include "net/base/test_completion_callback.h"
+#include "sippet/message/headers.h"
+#include "sippet/message/message.h"
+#include "sippet/ua/auth_cache.h"
+#include "sippet/ua/auth_handler_digest.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const char kRequest[] =
+    "REGISTER sip:chicago.com SIP/2.0\r\n"
+    "From: <sip:alice@atlanta.com>;tag=456248\r\n"
+    "To: <sip:alice@atlanta.com>\r\n"
+    "Call-ID: 843817637684230@998sdasdh09\r\n"
+    "CSeq: 1826 REGISTER\r\n"
+    "\r\n";
+
+// Two proxies challenging at once, the first one offering two algorithms.
+const char kProxyChallenges[] =
+    "SIP/2.0 407 Proxy Authentication Required\r\n"
+    "Proxy-Authenticate: Digest realm=\"atlanta.com\", "
+    "nonce=\"f84f1cec41e6cbe5aea9c8e88d359\", algorithm=MD5\r\n"
+    "Proxy-Authenticate: Digest realm=\"atlanta.com\", "
+    "nonce=\"f84f1cec41e6cbe5aea9c8e88d359\", algorithm=SHA-256\r\n"
+    "Proxy-Authenticate: Digest realm=\"biloxi.com\", "
+    "nonce=\"c60f3082ee1212b402a21831ae\"\r\n"
+    "\r\n";
+
+const char kServerChallenge[] =
+    "SIP/2.0 401 Unauthorized\r\n"
+    "WWW-Authenticate: Digest realm=\"chicago.com\", "
+    "nonce=\"dcd98b7102dd2f0e8b11d0f600bfb0c093\"\r\n"
+    "\r\n";
+
+// Gives the credentials asynchronously, recording the realms asked.
+class PendingPasswordHandlerFactory : public PasswordHandler::Factory {
+ public:
+  class Handler : public PasswordHandler {
+   public:
+    explicit Handler(PendingPasswordHandlerFactory *factory)
+      : factory_(factory) {}
+
+    int GetCredentials(const net::AuthChallengeInfo* auth_info,
+                       base::string16 *username,
+                       base::string16 *password,
+                       const net::CompletionCallback& callback) override {
+      factory_->realms_.push_back(auth_info->realm);
+      *username = base::ASCIIToUTF16("alice");
+      *password = base::ASCIIToUTF16(auth_info->realm);
+      factory_->pending_.push_back(callback);
+      return net::ERR_IO_PENDING;
+    }
+
+   private:
+    PendingPasswordHandlerFactory *factory_;
+  };
+
+  scoped_ptr<PasswordHandler> CreatePasswordHandler() override {
+    scoped_ptr<PasswordHandler> handler(new Handler(this));
+    return handler.Pass();
+  }
+
+  void CompleteAll() {
+    std::vector<net::CompletionCallback> pending;
+    pending.swap(pending_);
+    for (size_t i = 0; i < pending.size(); ++i)
+      pending[i].Run(net::OK);
+  }
+
+  std::vector<std::string> realms_;
+  std::vector<net::CompletionCallback> pending_;
+};
+
+class AuthTransactionTest : public testing::Test {
+ public:
+  AuthTransactionTest()
+    : auth_transaction_(&auth_cache_, &auth_handler_factory_,
+                        &password_handler_factory_, net::BoundNetLog()),
+      original_request_(dyn_cast<Request>(Message::Parse(kRequest))) {
+  }
+
+  // Handles |response| to |original_request_|, returning the request to
+  // retry with.
+  scoped_refptr<Request> HandleChallenge(const char *response) {
+    scoped_refptr<Response> incoming_response(
+        dyn_cast<Response>(Message::Parse(response)));
+    incoming_response->set_refer_to(original_request_);
+    scoped_refptr<Request> outgoing_request(
+        original_request_->CloneRequest());
+    net::TestCompletionCallback callback;
+    int rv = auth_transaction_.HandleChallengeAuthentication(
+        outgoing_request, incoming_response, callback.callback());
+    if (net::ERR_IO_PENDING == rv) {
+      password_handler_factory_.CompleteAll();
+      rv = callback.WaitForResult();
+    }
+    EXPECT_EQ(net::OK, rv);
+    return outgoing_request;
+  }
+
+  // The realms and algorithms of the proxy credentials of |request|.
+  std::set<std::string> GetProxyCredentials(
+      const scoped_refptr<Request> &request) {
+    std::set<std::string> credentials;
+    for (Message::iterator i = request->find_first<ProxyAuthorization>();
+         request->end() != i;
+         i = request->find_next<ProxyAuthorization>(i)) {
+      ProxyAuthorization *proxy_authorization =
+          dyn_cast<ProxyAuthorization>(i);
+      credentials.insert(proxy_authorization->realm() + " "
+          + (proxy_authorization->HasAlgorithm()
+                ? proxy_authorization->algorithm() : "MD5"));
+    }
+    return credentials;
+  }
+
+  AuthCache auth_cache_;
+  AuthHandlerDigest::Factory auth_handler_factory_;
+  PendingPasswordHandlerFactory password_handler_factory_;
+  AuthTransaction auth_transaction_;
+  scoped_refptr<Request> original_request_;
+};
+
+}  // namespace
+
+TEST_F(AuthTransactionTest, AnswersAllChallengersAtOnce) {
+  scoped_refptr<Request> request(HandleChallenge(kProxyChallenges));
+  // Both were asked before any completed.
+  ASSERT_EQ(2u, password_handler_factory_.realms_.size());
+  EXPECT_EQ("atlanta.com", password_handler_factory_.realms_[0]);
+  EXPECT_EQ("biloxi.com", password_handler_factory_.realms_[1]);
+
+  std::set<std::string> credentials(GetProxyCredentials(request));
+  EXPECT_EQ(2u, credentials.size());
+  EXPECT_EQ(1u, credentials.count("atlanta.com SHA-256"));
+  EXPECT_EQ(1u, credentials.count("biloxi.com MD5"));
+  EXPECT_FALSE(request->get<Authorization>());
+}
+
+TEST_F(AuthTransactionTest, ProxiesKeepAuthorizing) {
+  HandleChallenge(kProxyChallenges);
+
+  // The proxies let the retry through; the server challenges it.
+  scoped_refptr<Request> request(HandleChallenge(kServerChallenge));
+  ASSERT_EQ(3u, password_handler_factory_.realms_.size());
+  EXPECT_EQ("chicago.com", password_handler_factory_.realms_[2]);
+  EXPECT_EQ(2u, GetProxyCredentials(request).size());
+  Authorization *authorization = request->get<Authorization>();
+  ASSERT_TRUE(authorization);
+  EXPECT_EQ("chicago.com", authorization->realm());
+}
+
+} // namespace sippet
@@ -0,0 +1,452 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/ua/b2b_bridge.h"
+
+#include "base/logging.h"
+#include "net/base/completion_callback.h"
+#include "net/base/net_errors.h"
+#include "sippet/message/headers.h"
+#include "sippet/message/request.h"
+#include "sippet/message/response.h"
+#include "sippet/message/status_code.h"
+#include "sippet/ua/dialog.h"
+#include "sippet/ua/ua_user_agent.h"
+
+namespace sippet {
+namespace ua {
+
+namespace {
+
+// Max-Forwards of bridged requests without one (RFC 3261 section 16.6).
+const unsigned kDefaultMaxForwards = 70;
+
+// Headers of a request shared with the one relayed to the other leg: all
+// but those the user agent sets on each leg.
+bool IsRelayedRequestHeader(const Header &header) {
+  switch (header.type()) {
+    case Header::HDR_VIA:
+    case Header::HDR_FROM:
+    case Header::HDR_TO:
+    case Header::HDR_CALL_ID:
+    case Header::HDR_CSEQ:
+    case Header::HDR_MAX_FORWARDS:
+    case Header::HDR_CONTACT:
+    case Header::HDR_SUPPORTED:
+    case Header::HDR_ROUTE:
+    case Header::HDR_RECORD_ROUTE:
+    case Header::HDR_AUTHORIZATION:
+    case Header::HDR_PROXY_AUTHORIZATION:
+    case Header::HDR_RACK:
+      return false;
+    default:
+      return true;
+  }
+}
+
+// Headers of a response shared with the one relayed to the other leg.
+// Reliable provisional responses are negotiated on each leg, so their
+// |Require| and |RSeq| aren't relayed either.
+bool IsRelayedResponseHeader(const Header &header) {
+  switch (header.type()) {
+    case Header::HDR_VIA:
+    case Header::HDR_FROM:
+    case Header::HDR_TO:
+    case Header::HDR_CALL_ID:
+    case Header::HDR_CSEQ:
+    case Header::HDR_CONTACT:
+    case Header::HDR_RECORD_ROUTE:
+    case Header::HDR_WWW_AUTHENTICATE:
+    case Header::HDR_PROXY_AUTHENTICATE:
+    case Header::HDR_AUTHENTICATION_INFO:
+    case Header::HDR_REQUIRE:
+    case Header::HDR_RSEQ:
+      return false;
+    default:
+      return true;
+  }
+}
+
+// Requests refreshing the remote target of their dialogs, which get the
+// |Contact| of the bridge (RFC 3261 section 12.2).
+bool IsTargetRefresh(const Method &method) {
+  return Method::INVITE == method
+      || Method::UPDATE == method
+      || Method::SUBSCRIBE == method
+      || Method::NOTIFY == method
+      || Method::REFER == method;
+}
+
+// Whether the body of |message| is a whole SDP, as sent or received.
+bool HasSessionDescription(const Message &message) {
+  const ContentType *content_type = message.get<ContentType>();
+  return content_type
+      && "application" == content_type->MediaType::type()
+      && "sdp" == content_type->subtype()
+      && !message.get<ContentEncoding>();
+}
+
+std::string GetCallId(const Message *message) {
+  const CallId *call_id = message->get<CallId>();
+  return call_id ? call_id->value() : std::string();
+}
+
+void SendOrLog(UserAgent *user_agent, const scoped_refptr<Message> &message) {
+  int rv = user_agent->Send(message, net::CompletionCallback());
+  if (net::OK != rv && net::ERR_IO_PENDING != rv)
+    DVLOG(1) << "Couldn't send the bridged message: "
+             << net::ErrorToString(rv);
+}
+
+}  // namespace
+
+B2BBridge::DialogPair::DialogPair()
+  : confirmed(false) {
+}
+
+B2BBridge::DialogPair::~DialogPair() {
+}
+
+B2BBridge::Call::Call()
+  : completed(false) {
+}
+
+B2BBridge::Call::~Call() {
+}
+
+B2BBridge::DialogPair *B2BBridge::Call::FindByIncomingTag(
+    const std::string &tag) {
+  for (ScopedVector<DialogPair>::iterator i = pairs.begin(),
+       ie = pairs.end(); i != ie; ++i) {
+    if ((*i)->incoming_tag == tag)
+      return *i;
+  }
+  return nullptr;
+}
+
+B2BBridge::DialogPair *B2BBridge::Call::FindByOutgoingTag(
+    const std::string &tag) {
+  for (ScopedVector<DialogPair>::iterator i = pairs.begin(),
+       ie = pairs.end(); i != ie; ++i) {
+    if ((*i)->outgoing_tag == tag)
+      return *i;
+  }
+  return nullptr;
+}
+
+B2BBridge::Relay::Relay()
+  : call(nullptr), pair(nullptr) {
+}
+
+B2BBridge::Relay::~Relay() {
+}
+
+B2BBridge::B2BBridge(UserAgent *user_agent)
+  : user_agent_(user_agent),
+    media_anchor_(nullptr) {
+  DCHECK(user_agent);
+}
+
+B2BBridge::~B2BBridge() {
+  // Each call is there twice.
+  for (CallMap::iterator i = calls_.begin(), ie = calls_.end(); i != ie; ++i) {
+    if (i->first == i->second->incoming_call_id)
+      delete i->second;
+  }
+}
+
+int B2BBridge::Bridge(const scoped_refptr<Request> &incoming_request,
+                      const GURL &target) {
+  const Request *const_request = incoming_request.get();
+  const From *from = const_request->get<From>();
+  const To *to = const_request->get<To>();
+  std::string call_id(GetCallId(const_request));
+  if (!from || !to || call_id.empty()) {
+    DVLOG(1) << "Incomplete request, cannot bridge it";
+    return net::ERR_INVALID_ARGUMENT;
+  }
+  if (calls_.count(call_id)) {
+    DVLOG(1) << "Call already bridged";
+    return net::ERR_UNEXPECTED;
+  }
+  const MaxForwards *max_forwards = const_request->get<MaxForwards>();
+  if (max_forwards && 0 == max_forwards->value()) {
+    // RFC 3261 section 16.3, step 3.
+    SendOrLog(user_agent_,
+              incoming_request->CreateResponse(SIP_TOO_MANY_HOPS));
+    return net::ERR_INVALID_ARGUMENT;
+  }
+
+  scoped_refptr<Request> request(user_agent_->CreateRequest(
+      incoming_request->method(), target, from->address(), to->address()));
+  request->get<MaxForwards>()->set_value(
+      max_forwards ? max_forwards->value() - 1 : kDefaultMaxForwards);
+  const_request->ShareIf(request.get(), IsRelayedRequestHeader);
+  RelayContent(*const_request, request.get());
+
+  Call *call = new Call;
+  call->incoming_request = incoming_request;
+  call->outgoing_request = request;
+  call->incoming_call_id = call_id;
+  call->outgoing_call_id = GetCallId(request.get());
+  calls_[call->incoming_call_id] = call;
+  calls_[call->outgoing_call_id] = call;
+  int rv = SendRelay(request, incoming_request, call, nullptr);
+  if (net::OK != rv && net::ERR_IO_PENDING != rv)
+    DestroyCall(call);
+  return rv;
+}
+
+int B2BBridge::RelayResponse(const scoped_refptr<Response> &response,
+                             const scoped_refptr<Dialog> &dialog) {
+  const scoped_refptr<Request> &sent = response->refer_to();
+  RelayMap::iterator i = sent ? relays_.find(sent->id()) : relays_.end();
+  if (relays_.end() == i)
+    return net::ERR_INVALID_ARGUMENT;
+  int response_code = response->response_code();
+  if (100 == response_code)
+    return net::OK;
+  Relay relay(i->second);
+  Call *call = relay.call;
+  // The initial request is kept until the call is destroyed, as each fork
+  // of the outgoing leg may confirm a dialog with a 2xx of its own.
+  if (200 <= response_code && (relay.pair || 2 != response_code / 100))
+    relays_.erase(i);
+
+  scoped_refptr<Response> relayed(relay.source->CreateResponse(
+      response_code, response->reason_phrase()));
+  if (!relayed)
+    return net::ERR_UNEXPECTED;
+  const Response *const_response = response.get();
+  const_response->ShareIf(relayed.get(), IsRelayedResponseHeader);
+  if (response_code < 300) {
+    const Request *const_outgoing = call->outgoing_request.get();
+    const_outgoing->ShareTo<Contact>(relayed.get());
+  }
+  RelayContent(*const_response, relayed.get());
+
+  DialogPair *pair = relay.pair;
+  if (!pair)
+    pair = MapInitialResponse(call, const_response, relayed);
+  bool outgoing_leg = GetCallId(sent.get()) == call->outgoing_call_id;
+  if (pair && dialog) {
+    if (outgoing_leg)
+      pair->outgoing_dialog = dialog;
+    else
+      pair->incoming_dialog = dialog;
+  }
+
+  int rv = user_agent_->Send(relayed, net::CompletionCallback());
+  if (pair) {
+    scoped_refptr<Dialog> relayed_dialog(
+        user_agent_->GetDialog(relayed.get()));
+    if (relayed_dialog) {
+      if (outgoing_leg)
+        pair->incoming_dialog = relayed_dialog;
+      else
+        pair->outgoing_dialog = relayed_dialog;
+    }
+  }
+
+  if (200 <= response_code) {
+    if (!relay.pair) {
+      call->completed = true;
+      if (pair && 2 == response_code / 100) {
+        pair->confirmed = true;
+      } else if (2 != response_code / 100) {
+        // The early dialogs of the other forks are gone.
+        for (size_t j = call->pairs.size(); j > 0; --j) {
+          if (!call->pairs[j - 1]->confirmed)
+            ErasePair(call, call->pairs[j - 1]);
+        }
+      }
+    } else if (Method::BYE == relay.source->method()) {
+      ErasePair(call, relay.pair);
+    }
+    MaybeDestroyCall(call);
+  }
+  return rv;
+}
+
+int B2BBridge::RelayRequest(const scoped_refptr<Request> &request) {
+  Call *call = FindCall(request.get());
+  if (!call)
+    return net::ERR_INVALID_ARGUMENT;
+  const Request *const_request = request.get();
+  bool incoming_leg = GetCallId(const_request) == call->incoming_call_id;
+
+  if (Method::CANCEL == request->method()) {
+    if (!incoming_leg || call->completed) {
+      DVLOG(1) << "Nothing to cancel";
+      return net::ERR_UNEXPECTED;
+    }
+    SendOrLog(user_agent_, request->CreateResponse(SIP_OK));
+    scoped_refptr<Request> cancel;
+    int rv = call->outgoing_request->CreateCancel(cancel);
+    if (net::OK != rv)
+      return rv;
+    // The 487 (Request Terminated) of the outgoing request is relayed as
+    // any other response.
+    return user_agent_->Send(cancel, net::CompletionCallback());
+  }
+
+  DialogPair *pair = nullptr;
+  if (incoming_leg) {
+    const To *to = const_request->get<To>();
+    if (to && to->HasTag())
+      pair = call->FindByIncomingTag(to->tag());
+  } else {
+    const From *from = const_request->get<From>();
+    if (from && from->HasTag())
+      pair = call->FindByOutgoingTag(from->tag());
+  }
+  Dialog *other = nullptr;
+  if (pair) {
+    other = incoming_leg ? pair->outgoing_dialog.get()
+                         : pair->incoming_dialog.get();
+  }
+  if (!other) {
+    DVLOG(1) << "No dialog to relay the " << request->method().str()
+             << " to";
+    return net::ERR_UNEXPECTED;
+  }
+
+  scoped_refptr<Request> relayed;
+  scoped_refptr<Request> &invite =
+      incoming_leg ? pair->outgoing_invite : pair->incoming_invite;
+  if (Method::ACK == request->method()) {
+    // ACKs of 2xx are end-to-end: the one of the INVITE sent on the other
+    // leg is created by its dialog.
+    if (!invite)
+      return net::ERR_UNEXPECTED;
+    relayed = other->CreateAck(invite);
+  } else {
+    relayed = other->CreateRequest(request->method());
+  }
+  if (!relayed)
+    return net::ERR_UNEXPECTED;
+  const_request->ShareIf(relayed.get(), IsRelayedRequestHeader);
+  if (IsTargetRefresh(request->method())) {
+    const Request *const_outgoing = call->outgoing_request.get();
+    const_outgoing->ShareTo<Contact>(relayed.get());
+  }
+  RelayContent(*const_request, relayed.get());
+
+  if (Method::ACK == request->method())
+    return user_agent_->Send(relayed, net::CompletionCallback());
+  if (Method::INVITE == request->method())
+    invite = relayed;
+  return SendRelay(relayed, request, call, pair);
+}
+
+bool B2BBridge::HasCall(const Message *message) const {
+  return nullptr != FindCall(message);
+}
+
+void B2BBridge::RemoveCall(const Message *message) {
+  Call *call = FindCall(message);
+  if (call)
+    DestroyCall(call);
+}
+
+B2BBridge::Call *B2BBridge::FindCall(const Message *message) const {
+  CallMap::const_iterator i = calls_.find(GetCallId(message));
+  return calls_.end() != i ? i->second : nullptr;
+}
+
+void B2BBridge::DestroyCall(Call *call) {
+  calls_.erase(call->incoming_call_id);
+  calls_.erase(call->outgoing_call_id);
+  for (RelayMap::iterator i = relays_.begin(); i != relays_.end();) {
+    if (i->second.call == call)
+      relays_.erase(i++);
+    else
+      ++i;
+  }
+  delete call;
+}
+
+void B2BBridge::ErasePair(Call *call, DialogPair *pair) {
+  for (RelayMap::iterator i = relays_.begin(); i != relays_.end();) {
+    if (i->second.pair == pair)
+      relays_.erase(i++);
+    else
+      ++i;
+  }
+  for (ScopedVector<DialogPair>::iterator i = call->pairs.begin(),
+       ie = call->pairs.end(); i != ie; ++i) {
+    if (*i == pair) {
+      call->pairs.erase(i);
+      return;
+    }
+  }
+}
+
+void B2BBridge::MaybeDestroyCall(Call *call) {
+  if (call->completed && call->pairs.empty())
+    DestroyCall(call);
+}
+
+void B2BBridge::RelayContent(const Message &source, Message *relayed) const {
+  if (!source.has_content())
+    return;
+  if (media_anchor_ && HasSessionDescription(source)) {
+    scoped_ptr<SessionDescription> description(
+        SessionDescription::Parse(source.shared_content()));
+    if (description) {
+      SessionDescription::Editor editor(*description);
+      if (media_anchor_->AnchorMedia(source, *description, &editor)) {
+        relayed->set_content(editor.Build());
+        return;
+      }
+    } else {
+      DVLOG(1) << "Malformed SDP body, relayed as is";
+    }
+  }
+  relayed->set_content(source.shared_content());
+}
+
+int B2BBridge::SendRelay(const scoped_refptr<Request> &relayed,
+                         const scoped_refptr<Request> &source,
+                         Call *call,
+                         DialogPair *pair) {
+  Relay &relay = relays_[relayed->id()];
+  relay.source = source;
+  relay.call = call;
+  relay.pair = pair;
+  int rv = user_agent_->Send(relayed, net::CompletionCallback());
+  if (net::OK != rv && net::ERR_IO_PENDING != rv) {
+    DVLOG(1) << "Couldn't relay the " << relayed->method().str() << ": "
+             << net::ErrorToString(rv);
+    relays_.erase(relayed->id());
+  }
+  return rv;
+}
+
+B2BBridge::DialogPair *B2BBridge::MapInitialResponse(
+    Call *call,
+    const Response *response,
+    const scoped_refptr<Response> &relayed) {
+  const To *to = response->get<To>();
+  if (!to || !to->HasTag())
+    return nullptr;
+  DialogPair *pair = call->FindByOutgoingTag(to->tag());
+  if (pair) {
+    // Already looked up for writing when tagged by |CreateResponse|.
+    relayed->get<To>()->set_tag(pair->incoming_tag);
+    return pair;
+  }
+  // A new fork answering: its dialog on the incoming leg keeps the tag
+  // |CreateResponse| just generated.
+  const Response *const_relayed = relayed.get();
+  pair = new DialogPair;
+  pair->incoming_tag = const_relayed->get<To>()->tag();
+  pair->outgoing_tag = to->tag();
+  pair->outgoing_invite = call->outgoing_request;
+  call->pairs.push_back(pair);
+  return pair;
+}
+
+} // namespace ua
+} // namespace sippet
@@ -0,0 +1,205 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_UA_B2B_BRIDGE_H_
+#define SIPPET_UA_B2B_BRIDGE_H_
+
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/containers/hash_tables.h"
+#include "base/memory/ref_counted.h"
+#include "base/memory/scoped_vector.h"
+#include "sippet/message/session_description.h"
+#include "url/gurl.h"
+
+namespace sippet {
+
+class Message;
+class Request;
+class Response;
+
+namespace ua {
+
+class Dialog;
+class UserAgent;
+
+// Bridges calls as a back-to-back user agent (RFC 3261 section 6) does:
+// each incoming request starting a call is answered by the user agent
+// itself, as the server of the incoming leg, and passed on as a new request
+// of its own, on the outgoing leg, with its own Call-ID, tags and sequence
+// numbers. The responses and the requests within the dialogs of one leg are
+// then relayed to the other.
+//
+// The messages of the two legs share the headers and the body of the ones
+// they're relayed from until changed (see |Message::ShareTo|), instead of
+// copying them, leaving out the headers that belong to each leg: those
+// identifying its dialog and transactions, its routes and contacts, and its
+// credentials and challenges, which the user agent handles on each leg. So
+// an application changing what's relayed, e.g. the SDP body or a
+// |PAssertedIdentity|, only pays for what it changes. SDP bodies can be
+// rewritten on the way by a |MediaAnchor|, e.g. to anchor the media on a
+// relay.
+//
+// Each dialog of the outgoing leg, of each fork of the outgoing request, is
+// mapped to a dialog of its own on the incoming leg, answering with a tag of
+// its own. Bridges are used from the |UserAgent::Delegate| callbacks:
+//
+//   void OnIncomingRequest(const scoped_refptr<Request> &request,
+//                          const scoped_refptr<Dialog> &dialog) override {
+//     if (bridge_.HasCall(request.get()))
+//       bridge_.RelayRequest(request);
+//     else if (Method::INVITE == request->method())
+//       bridge_.Bridge(request, LookupTarget(request));
+//   }
+//   void OnIncomingResponse(const scoped_refptr<Response> &response,
+//                           const scoped_refptr<Dialog> &dialog) override {
+//     bridge_.RelayResponse(response, dialog);
+//   }
+class B2BBridge {
+ public:
+  // Rewrites the SDP offers and answers relayed from one leg to the other
+  // (see |SessionDescription|), e.g. setting the connection addresses and
+  // the media ports of a media relay.
+  class MediaAnchor {
+   public:
+    virtual ~MediaAnchor() {}
+
+    // Called for the SDP body of |message|, received on one leg, before
+    // it's relayed to the other. The changes made with |editor| are
+    // spliced into the relayed body. Returns false to relay the body
+    // unchanged, still shared with |message|.
+    virtual bool AnchorMedia(const Message &message,
+                             const SessionDescription &description,
+                             SessionDescription::Editor *editor) = 0;
+  };
+
+  explicit B2BBridge(UserAgent *user_agent);
+  ~B2BBridge();
+
+  // Not owned. Without one, the default, bodies are relayed untouched, as
+  // are bodies other than a whole application/sdp one, or encoded with a
+  // |ContentEncoding|.
+  void set_media_anchor(MediaAnchor *media_anchor) {
+    media_anchor_ = media_anchor;
+  }
+
+  // Sends the request of the outgoing leg of |incoming_request| to
+  // |target|, from and to the same addresses. Returns
+  // |net::ERR_INVALID_ARGUMENT|, after answering it with a 483 (Too Many
+  // Hops), if its |MaxForwards| is exhausted, and |net::ERR_UNEXPECTED| if
+  // its call is already bridged.
+  int Bridge(const scoped_refptr<Request> &incoming_request,
+             const GURL &target);
+
+  // Relays a response to a request sent by the bridge to the other leg,
+  // recording the |dialog| it pertains to. 100 (Trying) responses are
+  // hop-by-hop, and aren't relayed. Returns |net::ERR_INVALID_ARGUMENT| if
+  // the response doesn't refer to a request of the bridge.
+  int RelayResponse(const scoped_refptr<Response> &response,
+                    const scoped_refptr<Dialog> &dialog);
+
+  // Relays a request received within a dialog of a bridged call, or a
+  // CANCEL of the incoming request, to the other leg. Returns
+  // |net::ERR_UNEXPECTED| if the dialog it pertains to has no counterpart
+  // on the other leg yet.
+  int RelayRequest(const scoped_refptr<Request> &request);
+
+  // Whether |message| pertains to a call of the bridge, on either leg.
+  bool HasCall(const Message *message) const;
+
+  // Forgets the call of |message|, from either leg. Calls are forgotten
+  // anyway once their initial request failed, or all of their dialogs were
+  // terminated by a BYE.
+  void RemoveCall(const Message *message);
+
+  // Number of calls being bridged.
+  size_t call_count() const { return calls_.size() / 2; }
+
+ private:
+  // Dialogs of both legs, mapped to each other.
+  struct DialogPair {
+    DialogPair();
+    ~DialogPair();
+
+    // The tag of the bridge on the incoming leg, and the one of the remote
+    // user agent on the outgoing leg.
+    std::string incoming_tag;
+    std::string outgoing_tag;
+    scoped_refptr<Dialog> incoming_dialog;
+    scoped_refptr<Dialog> outgoing_dialog;
+    // The last INVITEs the bridge sent on each leg, acknowledged by the
+    // ACKs relayed from the other one.
+    scoped_refptr<Request> incoming_invite;
+    scoped_refptr<Request> outgoing_invite;
+    // Set once a 2xx confirmed the dialogs.
+    bool confirmed;
+  };
+
+  struct Call {
+    Call();
+    ~Call();
+
+    DialogPair *FindByIncomingTag(const std::string &tag);
+    DialogPair *FindByOutgoingTag(const std::string &tag);
+
+    scoped_refptr<Request> incoming_request;
+    scoped_refptr<Request> outgoing_request;
+    std::string incoming_call_id;
+    std::string outgoing_call_id;
+    ScopedVector<DialogPair> pairs;
+    // Set once the initial request got its final response.
+    bool completed;
+  };
+
+  // A request sent by the bridge, relayed from |source|.
+  struct Relay {
+    Relay();
+    ~Relay();
+
+    scoped_refptr<Request> source;
+    Call *call;
+    // NULL for the initial request of the call.
+    DialogPair *pair;
+  };
+
+  // Calls keyed by the Call-IDs of both legs.
+  typedef base::hash_map<std::string, Call*> CallMap;
+  // Relays keyed by the id of the request sent.
+  typedef base::hash_map<std::string, Relay> RelayMap;
+
+  Call *FindCall(const Message *message) const;
+  void DestroyCall(Call *call);
+  // Forgets |pair|, and the requests relayed within its dialogs.
+  void ErasePair(Call *call, DialogPair *pair);
+  // Destroys |call| once no dialog is left to relay.
+  void MaybeDestroyCall(Call *call);
+
+  // Sets the body of |source| on |relayed|, going through the media
+  // anchor if any.
+  void RelayContent(const Message &source, Message *relayed) const;
+
+  int SendRelay(const scoped_refptr<Request> &relayed,
+                const scoped_refptr<Request> &source,
+                Call *call,
+                DialogPair *pair);
+
+  // Maps the response of the outgoing leg to the initial request onto the
+  // incoming leg, returning the pair of dialogs it pertains to, or NULL.
+  DialogPair *MapInitialResponse(Call *call,
+                                 const Response *response,
+                                 const scoped_refptr<Response> &relayed);
+
+  UserAgent *user_agent_;
+  MediaAnchor *media_anchor_;
+  CallMap calls_;
+  RelayMap relays_;
+
+  DISALLOW_COPY_AND_ASSIGN(B2BBridge);
+};
+
+} // namespace ua
+} // namespace sippet
+
+#endif // SIPPET_UA_B2B_BRIDGE_H_
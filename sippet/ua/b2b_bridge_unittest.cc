@@ -0,0 +1,372 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/ua/b2b_bridge.h"
+
+#include <string>
+#include <vector>
+
+#include "net/base/net_errors.h"
+#include "sippet/message/headers.h"
+#include "sippet/message/request.h"
+#include "sippet/message/response.h"
+#include "sippet/message/session_description.h"
+#include "sippet/message/status_code.h"
+#include "sippet/test/simulation/simulated_network.h"
+#include "sippet/test/simulation/simulated_peer.h"
+#include "sippet/transport/network_layer.h"
+#include "sippet/transport/network_settings.h"
+#include "sippet/ua/auth_handler_digest.h"
+#include "sippet/ua/dialog_controller.h"
+#include "sippet/ua/password_handler.h"
+#include "sippet/ua/ua_user_agent.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+namespace ua {
+
+namespace {
+
+const char kCallerAddress[] = "10.0.0.1:5060/UDP";
+const char kBridgeAddress[] = "10.0.0.2:5060/UDP";
+const char kCalleeAddress[] = "10.0.0.3:5060/UDP";
+
+const char kOffer[] =
+  "v=0\r\n"
+  "o=alice 2890844526 2890844526 IN IP4 10.0.0.1\r\n"
+  "s=-\r\n"
+  "c=IN IP4 10.0.0.1\r\n"
+  "t=0 0\r\n"
+  "m=audio 49170 RTP/AVP 0\r\n";
+
+const char kAnswer[] =
+  "v=0\r\n"
+  "o=bob 2808844564 2808844564 IN IP4 biloxi.example.com\r\n"
+  "s=-\r\n"
+  "c=IN IP4 10.0.0.3\r\n"
+  "t=0 0\r\n"
+  "m=audio 3456 RTP/AVP 0\r\n";
+
+// The bridge never answers challenges.
+class NullPasswordHandlerFactory : public PasswordHandler::Factory {
+ public:
+  scoped_ptr<PasswordHandler> CreatePasswordHandler() override {
+    return scoped_ptr<PasswordHandler>();
+  }
+};
+
+// Bridges the incoming INVITEs to the callee, as in the example of
+// |B2BBridge|.
+class BridgingDelegate : public UserAgent::Delegate {
+ public:
+  BridgingDelegate() : bridge_(nullptr) {}
+
+  void set_bridge(B2BBridge *bridge) { bridge_ = bridge; }
+
+  // UserAgent::Delegate methods:
+  void OnChannelConnected(const EndPoint &destination, int err) override {}
+  void OnChannelClosed(const EndPoint &destination) override {}
+  void OnIncomingRequest(const scoped_refptr<Request> &request,
+                         const scoped_refptr<Dialog> &dialog) override {
+    if (bridge_->HasCall(request.get()))
+      bridge_->RelayRequest(request);
+    else if (Method::INVITE == request->method())
+      bridge_->Bridge(request, GURL("sip:10.0.0.3"));
+  }
+  void OnIncomingResponse(const scoped_refptr<Response> &response,
+                          const scoped_refptr<Dialog> &dialog) override {
+    bridge_->RelayResponse(response, dialog);
+  }
+  void OnTimedOut(const scoped_refptr<Request> &request,
+                  const scoped_refptr<Dialog> &dialog) override {}
+  void OnTransportError(const scoped_refptr<Request> &request, int error,
+                        const scoped_refptr<Dialog> &dialog) override {}
+
+ private:
+  B2BBridge *bridge_;
+};
+
+// Anchors the media of both legs on a relay at 192.0.2.1.
+class RelayMediaAnchor : public B2BBridge::MediaAnchor {
+ public:
+  RelayMediaAnchor() : anchored_(0) {}
+
+  int anchored() const { return anchored_; }
+
+  // B2BBridge::MediaAnchor methods:
+  bool AnchorMedia(const Message &message,
+                   const SessionDescription &description,
+                   SessionDescription::Editor *editor) override {
+    ++anchored_;
+    editor->SetConnectionAddress(SessionDescription::kSessionLevel,
+                                 "192.0.2.1");
+    for (size_t i = 0; i < description.media().size(); ++i)
+      editor->SetMediaPort(i, 20000 + 2 * static_cast<int>(i));
+    return true;
+  }
+
+ private:
+  int anchored_;
+};
+
+std::string GetCallId(const Message &message) {
+  const CallId *call_id = message.get<CallId>();
+  return call_id ? call_id->value() : std::string();
+}
+
+std::string GetFromTag(const Message &message) {
+  const From *from = message.get<From>();
+  return from ? from->tag() : std::string();
+}
+
+std::string GetToTag(const Message &message) {
+  const To *to = message.get<To>();
+  return to ? to->tag() : std::string();
+}
+
+// The To tags of the responses with |response_code| received by |peer|.
+std::vector<std::string> GetToTags(const SimulatedPeer &peer,
+                                   int response_code) {
+  std::vector<std::string> tags;
+  for (std::vector<scoped_refptr<Response> >::const_iterator i =
+       peer.responses().begin(), ie = peer.responses().end();
+       i != ie; ++i) {
+    if (response_code == (*i)->response_code())
+      tags.push_back(GetToTag(**i));
+  }
+  return tags;
+}
+
+} // namespace
+
+class B2BBridgeTest : public testing::Test {
+ public:
+  void SetUp() override {
+    network_.reset(new SimulatedNetwork);
+    caller_.reset(new SimulatedPeer(network_.get(), kCallerAddress));
+    callee_.reset(new SimulatedPeer(network_.get(), kCalleeAddress));
+    user_agent_.reset(new UserAgent(&auth_handler_factory_,
+        &password_handler_factory_,
+        DialogController::GetDefaultDialogController(), net::BoundNetLog()));
+    bridge_.reset(new B2BBridge(user_agent_.get()));
+    delegate_.set_bridge(bridge_.get());
+    user_agent_->AppendHandler(&delegate_);
+    NetworkSettings settings;
+    network_->ApplyTo(&settings);
+    network_layer_.reset(new NetworkLayer(user_agent_.get(), settings));
+    user_agent_->SetNetworkLayer(network_layer_.get());
+    network_->AddNode(EndPoint::FromString(kBridgeAddress),
+                      network_layer_.get());
+  }
+
+  void TearDown() override {
+    network_layer_.reset();
+    bridge_.reset();
+    user_agent_.reset();
+    callee_.reset();
+    caller_.reset();
+    network_.reset();
+  }
+
+  // Sends an INVITE with an offer from the caller to the bridge, returning
+  // the INVITE relayed to the callee, or NULL.
+  scoped_refptr<Request> Call() {
+    invite_ = caller_->CreateRequest(Method::INVITE, GURL("sip:10.0.0.2"));
+    scoped_ptr<Subject> subject(new Subject("Lunch"));
+    invite_->push_back(subject.Pass());
+    scoped_ptr<ContentType> content_type(new ContentType("application",
+                                                         "sdp"));
+    invite_->push_back(content_type.Pass());
+    invite_->set_content(kOffer);
+    int rv = caller_->Send(invite_);
+    EXPECT_TRUE(net::OK == rv || net::ERR_IO_PENDING == rv);
+    RunFor(100);
+    return callee_->LastRequest(Method::INVITE);
+  }
+
+  void RunFor(int milliseconds) {
+    network_->RunFor(base::TimeDelta::FromMilliseconds(milliseconds));
+  }
+
+ protected:
+  AuthHandlerDigest::Factory auth_handler_factory_;
+  NullPasswordHandlerFactory password_handler_factory_;
+  BridgingDelegate delegate_;
+  scoped_ptr<SimulatedNetwork> network_;
+  scoped_ptr<SimulatedPeer> caller_;
+  scoped_ptr<SimulatedPeer> callee_;
+  scoped_ptr<UserAgent> user_agent_;
+  scoped_ptr<B2BBridge> bridge_;
+  scoped_ptr<NetworkLayer> network_layer_;
+  scoped_refptr<Request> invite_;
+};
+
+TEST_F(B2BBridgeTest, RelaysCall) {
+  scoped_refptr<Request> outgoing(Call());
+  ASSERT_TRUE(outgoing);
+  EXPECT_EQ(1u, bridge_->call_count());
+
+  // A call of its own on the outgoing leg, sharing the other headers and
+  // the body of the incoming INVITE.
+  const Request *const_outgoing = outgoing.get();
+  EXPECT_NE(GetCallId(*invite_), GetCallId(*outgoing));
+  EXPECT_NE(GetFromTag(*invite_), GetFromTag(*outgoing));
+  ASSERT_TRUE(const_outgoing->get<Subject>());
+  EXPECT_EQ("Lunch", const_outgoing->get<Subject>()->value());
+  ASSERT_TRUE(const_outgoing->get<ContentType>());
+  EXPECT_EQ(kOffer, outgoing->content());
+  EXPECT_EQ(69u, const_outgoing->get<MaxForwards>()->value());
+
+  callee_->Answer(outgoing, SIP_RINGING, "callee");
+  RunFor(100);
+  scoped_refptr<Response> ringing(caller_->LastResponse(SIP_RINGING));
+  ASSERT_TRUE(ringing);
+  // Tagged by the bridge, on the incoming leg.
+  std::string incoming_tag(GetToTag(*ringing));
+  EXPECT_FALSE(incoming_tag.empty());
+  EXPECT_NE("callee", incoming_tag);
+
+  callee_->Answer(outgoing, SIP_OK, "callee");
+  RunFor(100);
+  scoped_refptr<Response> ok(caller_->LastResponse(SIP_OK));
+  ASSERT_TRUE(ok);
+  EXPECT_EQ(SIP_OK, caller_->FinalResponseCode(Method::INVITE));
+  EXPECT_EQ(incoming_tag, GetToTag(*ok));
+  // The bridge is the remote target of the caller.
+  const Response *const_ok = ok.get();
+  ASSERT_TRUE(const_ok->get<Contact>());
+  EXPECT_EQ("10.0.0.2",
+            const_ok->get<Contact>()->front().sip_address().host());
+
+  caller_->Send(caller_->CreateDialogRequest(Method::ACK, ok));
+  RunFor(100);
+  scoped_refptr<Request> ack(callee_->LastRequest(Method::ACK));
+  ASSERT_TRUE(ack);
+  EXPECT_EQ(GetCallId(*outgoing), GetCallId(*ack));
+  EXPECT_EQ("callee", GetToTag(*ack));
+
+  // The BYE is answered by the callee, and ends the call.
+  caller_->Send(caller_->CreateDialogRequest(Method::BYE, ok));
+  RunFor(100);
+  scoped_refptr<Request> bye(callee_->LastRequest(Method::BYE));
+  ASSERT_TRUE(bye);
+  EXPECT_EQ(GetCallId(*outgoing), GetCallId(*bye));
+  EXPECT_EQ(SIP_OK, caller_->FinalResponseCode(Method::BYE));
+  EXPECT_EQ(0u, bridge_->call_count());
+}
+
+TEST_F(B2BBridgeTest, MapsTagsOfForks) {
+  scoped_refptr<Request> outgoing(Call());
+  ASSERT_TRUE(outgoing);
+
+  // Two forks downstream answer the outgoing INVITE, each with a dialog of
+  // its own.
+  callee_->Answer(outgoing, SIP_RINGING, "fork1");
+  callee_->Answer(outgoing, SIP_RINGING, "fork2");
+  RunFor(100);
+  std::vector<std::string> tags(GetToTags(*caller_, SIP_RINGING));
+  ASSERT_EQ(2u, tags.size());
+  EXPECT_NE(tags[0], tags[1]);
+  EXPECT_NE("fork1", tags[0]);
+  EXPECT_NE("fork2", tags[1]);
+
+  // The second fork answers, confirming its own dialog on both legs.
+  callee_->Answer(outgoing, SIP_OK, "fork2");
+  RunFor(100);
+  scoped_refptr<Response> ok(caller_->LastResponse(SIP_OK));
+  ASSERT_TRUE(ok);
+  EXPECT_EQ(tags[1], GetToTag(*ok));
+
+  caller_->Send(caller_->CreateDialogRequest(Method::ACK, ok));
+  RunFor(100);
+  scoped_refptr<Request> ack(callee_->LastRequest(Method::ACK));
+  ASSERT_TRUE(ack);
+  EXPECT_EQ("fork2", GetToTag(*ack));
+
+  caller_->Send(caller_->CreateDialogRequest(Method::BYE, ok));
+  RunFor(100);
+  scoped_refptr<Request> bye(callee_->LastRequest(Method::BYE));
+  ASSERT_TRUE(bye);
+  EXPECT_EQ("fork2", GetToTag(*bye));
+  EXPECT_EQ(SIP_OK, caller_->FinalResponseCode(Method::BYE));
+}
+
+TEST_F(B2BBridgeTest, RelaysCancel) {
+  scoped_refptr<Request> outgoing(Call());
+  ASSERT_TRUE(outgoing);
+  callee_->Answer(outgoing, SIP_RINGING);
+  RunFor(100);
+
+  scoped_refptr<Request> cancel;
+  ASSERT_EQ(net::OK, invite_->CreateCancel(cancel));
+  caller_->Send(cancel);
+  RunFor(100);
+  // Answered on the incoming leg by the bridge itself.
+  EXPECT_EQ(SIP_OK, caller_->FinalResponseCode(Method::CANCEL));
+  scoped_refptr<Request> relayed(callee_->LastRequest(Method::CANCEL));
+  ASSERT_TRUE(relayed);
+  EXPECT_EQ(GetCallId(*outgoing), GetCallId(*relayed));
+
+  // The 487 of the outgoing INVITE is relayed as any other response.
+  EXPECT_EQ(SIP_REQUEST_TERMINATED,
+            caller_->FinalResponseCode(Method::INVITE));
+  EXPECT_EQ(0u, bridge_->call_count());
+}
+
+TEST_F(B2BBridgeTest, RelaysErrorResponse) {
+  scoped_refptr<Request> outgoing(Call());
+  ASSERT_TRUE(outgoing);
+
+  scoped_refptr<Response> busy(outgoing->CreateResponse(SIP_BUSY_HERE));
+  scoped_ptr<RetryAfter> retry_after(new RetryAfter(60));
+  busy->push_back(retry_after.Pass());
+  callee_->Send(busy);
+  RunFor(100);
+
+  scoped_refptr<Response> relayed(caller_->LastResponse(SIP_BUSY_HERE));
+  ASSERT_TRUE(relayed);
+  EXPECT_EQ(SIP_BUSY_HERE, caller_->FinalResponseCode(Method::INVITE));
+  EXPECT_EQ(GetCallId(*invite_), GetCallId(*relayed));
+  const Response *const_relayed = relayed.get();
+  ASSERT_TRUE(const_relayed->get<RetryAfter>());
+  EXPECT_EQ(60u, const_relayed->get<RetryAfter>()->value());
+  EXPECT_FALSE(const_relayed->get<Contact>());
+  EXPECT_EQ(0u, bridge_->call_count());
+}
+
+TEST_F(B2BBridgeTest, AnchorsMedia) {
+  RelayMediaAnchor media_anchor;
+  bridge_->set_media_anchor(&media_anchor);
+  scoped_refptr<Request> outgoing(Call());
+  ASSERT_TRUE(outgoing);
+  EXPECT_EQ(1, media_anchor.anchored());
+  const std::string &offer = outgoing->content();
+  EXPECT_NE(std::string::npos, offer.find("c=IN IP4 192.0.2.1\r\n"));
+  EXPECT_NE(std::string::npos, offer.find("m=audio 20000 RTP/AVP 0\r\n"));
+  // The lines left alone are spliced as they were.
+  EXPECT_NE(std::string::npos, offer.find(
+      "o=alice 2890844526 2890844526 IN IP4 10.0.0.1\r\n"));
+
+  scoped_refptr<Response> ok(outgoing->CreateResponse(SIP_OK));
+  ok->get<To>()->set_tag("callee");
+  scoped_ptr<Contact> contact(new Contact(callee_->contact()));
+  ok->push_back(contact.Pass());
+  scoped_ptr<ContentType> content_type(new ContentType("application",
+                                                       "sdp"));
+  ok->push_back(content_type.Pass());
+  ok->set_content(kAnswer);
+  callee_->Send(ok);
+  RunFor(100);
+
+  scoped_refptr<Response> relayed(caller_->LastResponse(SIP_OK));
+  ASSERT_TRUE(relayed);
+  EXPECT_EQ(2, media_anchor.anchored());
+  const std::string &answer = relayed->content();
+  EXPECT_NE(std::string::npos, answer.find("c=IN IP4 192.0.2.1\r\n"));
+  EXPECT_NE(std::string::npos, answer.find("m=audio 20000 RTP/AVP 0\r\n"));
+  EXPECT_EQ(std::string::npos, answer.find("10.0.0.3"));
+}
+
+} // namespace ua
+} // namespace sippet
@@ -0,0 +1,312 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/ua/credential_cache.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/stl_util.h"
+#include "base/time/tick_clock.h"
+#include "net/base/auth.h"
+#include "net/base/host_port_pair.h"
+#include "net/base/net_errors.h"
+#include "sippet/message/message.h"
+#include "sippet/ua/auth_cache.h"
+
+namespace sippet {
+
+namespace {
+
+// The account keying the credentials of |request|, as |AuthController| does.
+std::string GetAccount(const scoped_refptr<Request> &request) {
+  if (!request.get())
+    return std::string();
+  // Look it up for reading only, as it's shared with the request.
+  const Request *const_request = request.get();
+  const From *from = const_request->get<From>();
+  return from ? from->address().spec() : std::string();
+}
+
+scoped_refptr<net::AuthChallengeInfo> CopyAuthChallengeInfo(
+    const net::AuthChallengeInfo &auth_info) {
+  scoped_refptr<net::AuthChallengeInfo> copy(new net::AuthChallengeInfo);
+  copy->is_proxy = auth_info.is_proxy;
+  copy->challenger = auth_info.challenger;
+  copy->scheme = auth_info.scheme;
+  copy->realm = auth_info.realm;
+  return copy;
+}
+
+} // namespace
+
+// The handler given to the transactions, which gets the credentials from
+// the cache.
+class CredentialCache::Handler : public PasswordHandler {
+ public:
+  Handler(CredentialCache *cache,
+          const scoped_refptr<Request> &request)
+    : cache_(cache),
+      request_(request),
+      account_(GetAccount(request)),
+      lookup_(nullptr),
+      username_(nullptr),
+      password_(nullptr) {
+  }
+
+  ~Handler() override {
+    if (lookup_)
+      cache_->CancelWait(this);
+  }
+
+  const scoped_refptr<Request> &request() const { return request_; }
+  const std::string &account() const { return account_; }
+
+  // The lookup waited for, if any.
+  Lookup *lookup() const { return lookup_; }
+  void set_lookup(Lookup *lookup) { lookup_ = lookup; }
+
+  // Completes the wait for the lookup with its result.
+  void Complete(int result,
+                const base::string16 &username,
+                const base::string16 &password) {
+    DCHECK(!callback_.is_null());
+    lookup_ = nullptr;
+    if (net::OK == result) {
+      *username_ = username;
+      *password_ = password;
+    }
+    net::CompletionCallback callback(callback_);
+    callback_.Reset();
+    callback.Run(result);
+  }
+
+  // sippet::PasswordHandler methods:
+  int GetCredentials(const net::AuthChallengeInfo* auth_info,
+                     base::string16 *username,
+                     base::string16 *password,
+                     const net::CompletionCallback& callback) override {
+    DCHECK(!lookup_);
+    int result = cache_->GetCredentials(this, auth_info, username, password);
+    if (net::ERR_IO_PENDING == result) {
+      username_ = username;
+      password_ = password;
+      callback_ = callback;
+    }
+    return result;
+  }
+
+  void OnCredentialsRejected(
+      const net::AuthChallengeInfo* auth_info) override {
+    cache_->Invalidate(account_, *auth_info);
+  }
+
+ private:
+  CredentialCache *cache_;
+  scoped_refptr<Request> request_;
+  std::string account_;
+  Lookup *lookup_;
+  base::string16 *username_;
+  base::string16 *password_;
+  net::CompletionCallback callback_;
+
+  DISALLOW_COPY_AND_ASSIGN(Handler);
+};
+
+// A lookup of the handlers of |factory_|, and the handlers waiting for it.
+struct CredentialCache::Lookup {
+  scoped_ptr<PasswordHandler> handler;
+  scoped_refptr<net::AuthChallengeInfo> auth_info;
+  base::string16 username;
+  base::string16 password;
+  std::vector<Handler*> waiters;
+};
+
+CredentialCache::Entry::Entry()
+  : result(net::OK) {
+}
+
+CredentialCache::Entry::~Entry() {
+}
+
+CredentialCache::CredentialCache(PasswordHandler::Factory *factory,
+                                 size_t max_entries)
+  : factory_(factory),
+    ttl_(base::TimeDelta::FromSeconds(kDefaultTtlSeconds)),
+    negative_ttl_(base::TimeDelta::FromSeconds(kDefaultNegativeTtlSeconds)),
+    entries_(max_entries),
+    tick_clock_(nullptr),
+    weak_factory_(this) {
+  DCHECK(factory_);
+}
+
+CredentialCache::~CredentialCache() {
+  STLDeleteValues(&lookups_);
+}
+
+void CredentialCache::Prefetch(const scoped_refptr<Request> &request,
+                               AuthCache *auth_cache) {
+  DCHECK(auth_cache);
+  std::string account(GetAccount(request));
+  std::vector<AuthCache::Entry*> entries;
+  auth_cache->LookupPreemptive(account, &entries);
+  for (std::vector<AuthCache::Entry*>::const_iterator i = entries.begin();
+       i != entries.end(); ++i) {
+    const AuthCache::Entry *entry = *i;
+    scoped_refptr<net::AuthChallengeInfo> auth_info(
+        new net::AuthChallengeInfo);
+    auth_info->is_proxy = (entry->target() == net::HttpAuth::AUTH_PROXY);
+    auth_info->challenger = net::HostPortPair::FromURL(entry->origin());
+    auth_info->scheme = Auth::SchemeToString(entry->scheme());
+    auth_info->realm = entry->realm();
+    std::string key(GetKey(account, *auth_info));
+    if (GetFreshEntry(key) || lookups_.end() != lookups_.find(key))
+      continue;
+    DVLOG(1) << "Prefetching the credentials of " << account
+             << " for realm " << entry->realm();
+    StartLookup(key, request, auth_info.get());
+  }
+}
+
+void CredentialCache::Invalidate(const std::string &account,
+                                 const net::AuthChallengeInfo &auth_info) {
+  EntryCache::iterator i = entries_.Peek(GetKey(account, auth_info));
+  if (entries_.end() != i)
+    entries_.Erase(i);
+}
+
+void CredentialCache::Clear() {
+  entries_.Clear();
+}
+
+scoped_ptr<PasswordHandler> CredentialCache::CreatePasswordHandler() {
+  return CreatePasswordHandlerForRequest(nullptr);
+}
+
+scoped_ptr<PasswordHandler> CredentialCache::CreatePasswordHandlerForRequest(
+    const scoped_refptr<Request> &request) {
+  scoped_ptr<PasswordHandler> handler(new Handler(this, request));
+  return handler.Pass();
+}
+
+std::string CredentialCache::GetKey(const std::string &account,
+                                    const net::AuthChallengeInfo &auth_info) {
+  // None of them can hold a NUL.
+  std::string key(auth_info.is_proxy ? "P" : "S");
+  key.append(1, '\0').append(auth_info.challenger.ToString())
+     .append(1, '\0').append(auth_info.scheme)
+     .append(1, '\0').append(auth_info.realm)
+     .append(1, '\0').append(account);
+  return key;
+}
+
+int CredentialCache::GetCredentials(Handler *handler,
+                                    const net::AuthChallengeInfo *auth_info,
+                                    base::string16 *username,
+                                    base::string16 *password) {
+  DCHECK(auth_info);
+  std::string key(GetKey(handler->account(), *auth_info));
+  const Entry *entry = GetFreshEntry(key);
+  if (!entry) {
+    LookupMap::iterator i = lookups_.find(key);
+    if (lookups_.end() == i) {
+      if (net::ERR_IO_PENDING != StartLookup(key, handler->request(),
+                                             auth_info)) {
+        // Stored, even if expiring at once.
+        entry = &entries_.Peek(key)->second;
+      } else {
+        i = lookups_.find(key);
+      }
+    }
+    if (!entry) {
+      i->second->waiters.push_back(handler);
+      handler->set_lookup(i->second);
+      return net::ERR_IO_PENDING;
+    }
+  }
+  if (net::OK == entry->result) {
+    *username = entry->username;
+    *password = entry->password;
+  }
+  return entry->result;
+}
+
+void CredentialCache::CancelWait(Handler *handler) {
+  std::vector<Handler*> &waiters = handler->lookup()->waiters;
+  waiters.erase(std::remove(waiters.begin(), waiters.end(), handler),
+                waiters.end());
+  handler->set_lookup(nullptr);
+}
+
+const CredentialCache::Entry *CredentialCache::GetFreshEntry(
+    const std::string &key) {
+  EntryCache::iterator i = entries_.Get(key);
+  if (entries_.end() == i)
+    return nullptr;
+  if (i->second.expires <= NowTicks()) {
+    entries_.Erase(i);
+    return nullptr;
+  }
+  return &i->second;
+}
+
+int CredentialCache::StartLookup(const std::string &key,
+                                 const scoped_refptr<Request> &request,
+                                 const net::AuthChallengeInfo *auth_info) {
+  DCHECK(lookups_.end() == lookups_.find(key));
+  scoped_ptr<Lookup> lookup(new Lookup);
+  lookup->handler = request.get()
+      ? factory_->CreatePasswordHandlerForRequest(request)
+      : factory_->CreatePasswordHandler();
+  lookup->auth_info = CopyAuthChallengeInfo(*auth_info);
+  int result = lookup->handler->GetCredentials(
+      lookup->auth_info.get(), &lookup->username, &lookup->password,
+      base::Bind(&CredentialCache::OnLookupComplete,
+                 weak_factory_.GetWeakPtr(), key));
+  if (net::ERR_IO_PENDING == result) {
+    lookups_[key] = lookup.release();
+    return result;
+  }
+  StoreEntry(key, *lookup, result);
+  return result;
+}
+
+void CredentialCache::OnLookupComplete(const std::string &key, int result) {
+  DCHECK_NE(net::ERR_IO_PENDING, result);
+  LookupMap::iterator i = lookups_.find(key);
+  DCHECK(lookups_.end() != i);
+  scoped_ptr<Lookup> lookup(i->second);
+  lookups_.erase(i);
+  StoreEntry(key, *lookup, result);
+  // Completing a waiter may destroy others, which then leave |waiters|.
+  while (!lookup->waiters.empty()) {
+    Handler *waiter = lookup->waiters.front();
+    lookup->waiters.erase(lookup->waiters.begin());
+    waiter->Complete(result, lookup->username, lookup->password);
+  }
+}
+
+void CredentialCache::StoreEntry(const std::string &key,
+                                 const Lookup &lookup,
+                                 int result) {
+  Entry entry;
+  entry.result = result;
+  if (net::OK == result) {
+    entry.username = lookup.username;
+    entry.password = lookup.password;
+    entry.expires = NowTicks() + ttl_;
+  } else {
+    DVLOG(1) << "Failed to get the credentials for realm "
+             << lookup.auth_info->realm << ": " << net::ErrorToString(result);
+    entry.expires = NowTicks() + negative_ttl_;
+  }
+  entries_.Put(key, entry);
+}
+
+base::TimeTicks CredentialCache::NowTicks() const {
+  return tick_clock_ ? tick_clock_->NowTicks() : base::TimeTicks::Now();
+}
+
+} // namespace sippet
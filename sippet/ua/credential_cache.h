@@ -0,0 +1,149 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_UA_CREDENTIAL_CACHE_H_
+#define SIPPET_UA_CREDENTIAL_CACHE_H_
+
+#include <map>
+#include <string>
+
+#include "base/containers/mru_cache.h"
+#include "base/memory/weak_ptr.h"
+#include "base/time/time.h"
+#include "sippet/ua/password_handler.h"
+
+namespace base {
+class TickClock;
+}
+
+namespace sippet {
+
+class AuthCache;
+
+// Caches the credentials given by the handlers of another
+// |PasswordHandler::Factory|, for those looking them up in a server, such as
+// a directory or a REST service, so that a challenge not answered from the
+// |AuthCache| doesn't wait for a round trip every time:
+//  - credentials found are kept for |ttl|, and lookups that failed, such as
+//    for unknown accounts, for |negative_ttl|, so that they don't hit the
+//    server on each challenge either;
+//  - concurrent lookups of the same credentials wait for a single one;
+//  - credentials rejected are dropped (see
+//    |PasswordHandler::OnCredentialsRejected|), and looked up again.
+// Credentials are keyed by the account (the From address of the request),
+// by the target and challenger, and by the realm and scheme of the
+// challenge.
+//
+// |Prefetch| looks up ahead the credentials of the challenges an account
+// answered before, as kept by the |AuthCache|, e.g. when the refresh of its
+// registration is scheduled, so that they are at hand if its identity was
+// dropped from the |AuthCache| meanwhile:
+//
+//   CredentialCache credential_cache(&ldap_password_handler_factory);
+//   UserAgent user_agent(..., &credential_cache, ...);
+//   ...
+//   credential_cache.Prefetch(last_register, user_agent.auth_cache());
+class CredentialCache : public PasswordHandler::Factory {
+ public:
+  // Default time credentials found are kept, in seconds.
+  static const int kDefaultTtlSeconds = 600;
+  // Default time failed lookups are kept, in seconds.
+  static const int kDefaultNegativeTtlSeconds = 30;
+  // Default number of credentials kept.
+  static const size_t kDefaultMaxEntries = 4096;
+
+  // |factory| is not owned, and must outlive the cache.
+  explicit CredentialCache(PasswordHandler::Factory *factory,
+                           size_t max_entries = kDefaultMaxEntries);
+  ~CredentialCache() override;
+
+  void set_ttl(base::TimeDelta ttl) {
+    ttl_ = ttl;
+  }
+  void set_negative_ttl(base::TimeDelta negative_ttl) {
+    negative_ttl_ = negative_ttl;
+  }
+
+  // Looks up the credentials of the account of |request| for the challenges
+  // it answered, as kept by |auth_cache|, unless cached or looked up
+  // already. The handlers doing it are created for |request|.
+  void Prefetch(const scoped_refptr<Request> &request, AuthCache *auth_cache);
+
+  // Drops the credentials of |account| for |auth_info|.
+  void Invalidate(const std::string &account,
+                  const net::AuthChallengeInfo &auth_info);
+
+  // Drops all credentials; lookups in progress are left to complete.
+  void Clear();
+
+  // Number of credentials and failures currently cached.
+  size_t size() const {
+    return entries_.size();
+  }
+
+  // sippet::PasswordHandler::Factory methods:
+  scoped_ptr<PasswordHandler> CreatePasswordHandler() override;
+  scoped_ptr<PasswordHandler> CreatePasswordHandlerForRequest(
+      const scoped_refptr<Request> &request) override;
+
+  // The clock used to expire credentials. Not owned.
+  void set_tick_clock_for_testing(base::TickClock *tick_clock) {
+    tick_clock_ = tick_clock;
+  }
+
+ private:
+  class Handler;
+  struct Lookup;
+
+  // The result of a lookup.
+  struct Entry {
+    Entry();
+    ~Entry();
+
+    // |OK| or the error of the lookup.
+    int result;
+    base::string16 username;
+    base::string16 password;
+    base::TimeTicks expires;
+  };
+
+  typedef base::HashingMRUCache<std::string, Entry> EntryCache;
+  // Owns the lookups.
+  typedef std::map<std::string, Lookup*> LookupMap;
+
+  static std::string GetKey(const std::string &account,
+                            const net::AuthChallengeInfo &auth_info);
+
+  // Called by the handlers.
+  int GetCredentials(Handler *handler,
+                     const net::AuthChallengeInfo *auth_info,
+                     base::string16 *username,
+                     base::string16 *password);
+  void CancelWait(Handler *handler);
+
+  // The unexpired entry of |key|, or null.
+  const Entry *GetFreshEntry(const std::string &key);
+  // Starts looking up |key|. Returns the result, with the entry stored, or
+  // |ERR_IO_PENDING| if added to |lookups_|.
+  int StartLookup(const std::string &key,
+                  const scoped_refptr<Request> &request,
+                  const net::AuthChallengeInfo *auth_info);
+  void OnLookupComplete(const std::string &key, int result);
+  void StoreEntry(const std::string &key, const Lookup &lookup, int result);
+  base::TimeTicks NowTicks() const;
+
+  PasswordHandler::Factory *factory_;
+  base::TimeDelta ttl_;
+  base::TimeDelta negative_ttl_;
+  EntryCache entries_;
+  LookupMap lookups_;
+  base::TickClock *tick_clock_;
+  base::WeakPtrFactory<CredentialCache> weak_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(CredentialCache);
+};
+
+} // namespace sippet
+
+#endif // SIPPET_UA_CREDENTIAL_CACHE_H_
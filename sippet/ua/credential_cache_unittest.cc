@@ -0,0 +1,235 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/ua/credential_cache.h"
+
+#include <vector>
+
+#include "base/bind.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/test/simple_test_tick_clock.h"
+#include "net/base/auth.h"
+#include "net/base/host_port_pair.h"
+#include "net/base/net_errors.h"
+#include "net/base/test_completion_callback.h"
+#include "sippet/message/message.h"
+#include "sippet/ua/auth_cache.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const char kRealm[] = "atlanta.com";
+const char kOrigin[] = "sip:atlanta.com:5060";
+
+scoped_refptr<Request> CreateRequest(const std::string &from) {
+  return dyn_cast<Request>(Message::Parse(
+      "REGISTER sip:registrar.atlanta.com SIP/2.0\r\n"
+      "From: <" + from + ">;tag=456248\r\n"
+      "To: <" + from + ">\r\n"
+      "Call-ID: 843817637684230@998sdasdh09\r\n"
+      "CSeq: 1826 REGISTER\r\n"
+      "\r\n"));
+}
+
+scoped_refptr<net::AuthChallengeInfo> CreateAuthInfo(
+    const std::string &realm) {
+  scoped_refptr<net::AuthChallengeInfo> auth_info(new net::AuthChallengeInfo);
+  auth_info->is_proxy = false;
+  auth_info->challenger = net::HostPortPair::FromURL(GURL(kOrigin));
+  auth_info->scheme = "digest";
+  auth_info->realm = realm;
+  return auth_info;
+}
+
+// Looks up the credentials of the users named after their account, held
+// until told to complete when |async| is set. Only "sip:alice" is known.
+class FakeDirectory : public PasswordHandler::Factory {
+ public:
+  class Handler : public PasswordHandler {
+   public:
+    Handler(FakeDirectory *directory, const scoped_refptr<Request> &request)
+      : directory_(directory), request_(request) {}
+
+    int GetCredentials(const net::AuthChallengeInfo* auth_info,
+                       base::string16 *username,
+                       base::string16 *password,
+                       const net::CompletionCallback& callback) override {
+      ++directory_->lookups_;
+      const Request *const_request = request_.get();
+      bool known = const_request->get<From>()->address().spec()
+          == "sip:alice@atlanta.com";
+      int result = known ? net::OK : net::ERR_ACCESS_DENIED;
+      if (known) {
+        *username = base::ASCIIToUTF16("alice");
+        *password = base::ASCIIToUTF16(directory_->password_);
+      }
+      if (!directory_->async_)
+        return result;
+      directory_->pending_.push_back(base::Bind(callback, result));
+      return net::ERR_IO_PENDING;
+    }
+
+   private:
+    FakeDirectory *directory_;
+    scoped_refptr<Request> request_;
+  };
+
+  FakeDirectory() : lookups_(0), async_(false), password_("secret") {}
+
+  scoped_ptr<PasswordHandler> CreatePasswordHandler() override {
+    NOTREACHED();
+    return scoped_ptr<PasswordHandler>();
+  }
+  scoped_ptr<PasswordHandler> CreatePasswordHandlerForRequest(
+      const scoped_refptr<Request> &request) override {
+    scoped_ptr<PasswordHandler> handler(new Handler(this, request));
+    return handler.Pass();
+  }
+
+  void CompleteAll() {
+    std::vector<base::Closure> pending;
+    pending.swap(pending_);
+    for (size_t i = 0; i < pending.size(); ++i)
+      pending[i].Run();
+  }
+
+  int lookups_;
+  bool async_;
+  std::string password_;
+  std::vector<base::Closure> pending_;
+};
+
+class CredentialCacheTest : public testing::Test {
+ public:
+  CredentialCacheTest()
+    : cache_(&directory_),
+      alice_(CreateRequest("sip:alice@atlanta.com")),
+      bob_(CreateRequest("sip:bob@atlanta.com")) {
+    cache_.set_tick_clock_for_testing(&clock_);
+  }
+
+  // Gets the credentials of |request| through a handler of the cache.
+  int GetCredentials(const scoped_refptr<Request> &request,
+                     base::string16 *password) {
+    scoped_ptr<PasswordHandler> handler(
+        cache_.CreatePasswordHandlerForRequest(request));
+    base::string16 username;
+    return handler->GetCredentials(CreateAuthInfo(kRealm).get(), &username,
+                                   password, net::CompletionCallback());
+  }
+
+  FakeDirectory directory_;
+  base::SimpleTestTickClock clock_;
+  CredentialCache cache_;
+  scoped_refptr<Request> alice_;
+  scoped_refptr<Request> bob_;
+};
+
+}  // namespace
+
+TEST_F(CredentialCacheTest, CachesUntilExpired) {
+  base::string16 password;
+  EXPECT_EQ(net::OK, GetCredentials(alice_, &password));
+  EXPECT_EQ(base::ASCIIToUTF16("secret"), password);
+  password.clear();
+  EXPECT_EQ(net::OK, GetCredentials(alice_, &password));
+  EXPECT_EQ(base::ASCIIToUTF16("secret"), password);
+  EXPECT_EQ(1, directory_.lookups_);
+
+  clock_.Advance(
+      base::TimeDelta::FromSeconds(CredentialCache::kDefaultTtlSeconds));
+  EXPECT_EQ(net::OK, GetCredentials(alice_, &password));
+  EXPECT_EQ(2, directory_.lookups_);
+}
+
+TEST_F(CredentialCacheTest, CachesFailures) {
+  base::string16 password;
+  EXPECT_EQ(net::ERR_ACCESS_DENIED, GetCredentials(bob_, &password));
+  EXPECT_EQ(net::ERR_ACCESS_DENIED, GetCredentials(bob_, &password));
+  EXPECT_EQ(1, directory_.lookups_);
+  EXPECT_TRUE(password.empty());
+
+  // Failures are kept for a shorter time.
+  clock_.Advance(base::TimeDelta::FromSeconds(
+      CredentialCache::kDefaultNegativeTtlSeconds));
+  EXPECT_EQ(net::ERR_ACCESS_DENIED, GetCredentials(bob_, &password));
+  EXPECT_EQ(2, directory_.lookups_);
+}
+
+TEST_F(CredentialCacheTest, DropsRejectedCredentials) {
+  base::string16 password;
+  EXPECT_EQ(net::OK, GetCredentials(alice_, &password));
+  directory_.password_ = "changed";
+
+  scoped_ptr<PasswordHandler> handler(
+      cache_.CreatePasswordHandlerForRequest(alice_));
+  handler->OnCredentialsRejected(CreateAuthInfo(kRealm).get());
+  EXPECT_EQ(0u, cache_.size());
+  EXPECT_EQ(net::OK, GetCredentials(alice_, &password));
+  EXPECT_EQ(base::ASCIIToUTF16("changed"), password);
+  EXPECT_EQ(2, directory_.lookups_);
+}
+
+TEST_F(CredentialCacheTest, CoalescesLookups) {
+  directory_.async_ = true;
+  scoped_ptr<PasswordHandler> first(
+      cache_.CreatePasswordHandlerForRequest(alice_));
+  scoped_ptr<PasswordHandler> second(
+      cache_.CreatePasswordHandlerForRequest(alice_));
+  scoped_ptr<PasswordHandler> gone(
+      cache_.CreatePasswordHandlerForRequest(alice_));
+  base::string16 username[3], password[3];
+  net::TestCompletionCallback callback[3];
+  EXPECT_EQ(net::ERR_IO_PENDING, first->GetCredentials(
+      CreateAuthInfo(kRealm).get(), &username[0], &password[0],
+      callback[0].callback()));
+  EXPECT_EQ(net::ERR_IO_PENDING, second->GetCredentials(
+      CreateAuthInfo(kRealm).get(), &username[1], &password[1],
+      callback[1].callback()));
+  EXPECT_EQ(net::ERR_IO_PENDING, gone->GetCredentials(
+      CreateAuthInfo(kRealm).get(), &username[2], &password[2],
+      callback[2].callback()));
+  EXPECT_EQ(1, directory_.lookups_);
+
+  // Destroying a handler stops its wait, not the lookup.
+  gone.reset();
+  directory_.CompleteAll();
+  EXPECT_EQ(net::OK, callback[0].WaitForResult());
+  EXPECT_EQ(net::OK, callback[1].WaitForResult());
+  EXPECT_EQ(base::ASCIIToUTF16("alice"), username[1]);
+  EXPECT_EQ(base::ASCIIToUTF16("secret"), password[1]);
+  EXPECT_FALSE(callback[2].have_result());
+  EXPECT_EQ(1u, cache_.size());
+}
+
+TEST_F(CredentialCacheTest, PrefetchesFromAuthCache) {
+  AuthCache auth_cache;
+  AuthCache::Entry *entry = auth_cache.Add(
+      kRealm, net::HttpAuth::AUTH_SCHEME_DIGEST, "sip:alice@atlanta.com",
+      net::AuthCredentials(base::ASCIIToUTF16("alice"),
+                           base::ASCIIToUTF16("secret")));
+  Challenge challenge(Challenge::Digest);
+  challenge.set_realm(kRealm);
+  entry->SetChallenge(challenge, net::HttpAuth::AUTH_SERVER,
+                      GURL(kOrigin));
+
+  cache_.Prefetch(alice_, &auth_cache);
+  EXPECT_EQ(1, directory_.lookups_);
+  // Already cached.
+  cache_.Prefetch(alice_, &auth_cache);
+  EXPECT_EQ(1, directory_.lookups_);
+
+  base::string16 password;
+  EXPECT_EQ(net::OK, GetCredentials(alice_, &password));
+  EXPECT_EQ(base::ASCIIToUTF16("secret"), password);
+  EXPECT_EQ(1, directory_.lookups_);
+
+  // Nothing to prefetch for accounts never challenged.
+  cache_.Prefetch(bob_, &auth_cache);
+  EXPECT_EQ(1, directory_.lookups_);
+}
+
+} // namespace sippet
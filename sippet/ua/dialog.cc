@@ -7,6 +7,7 @@
 #include <algorithm>
 #include <string>
 
+#include "sippet/base/memory_accounting.h"
 #include "sippet/base/sequences.h"
 #include "sippet/message/request.h"
 #include "sippet/message/response.h"
@@ -57,10 +58,22 @@ Dialog::Dialog(
     remote_uri_(remote_uri),
     remote_target_(remote_target),
     is_secure_(is_secure),
-    route_set_(route_set) {
+    route_set_(route_set),
+    has_remote_rseq_(false),
+    remote_rseq_(0),
+    remote_rseq_sequence_(0) {
+  MemoryAccounting::Add(MemoryAccounting::DIALOGS, sizeof(Dialog));
+  if (!route_set_.empty()) {
+    first_route_ = SipURI(route_set_.front());
+    next_hop_ = EndPoint::FromSipURI(first_route_);
+  } else {
+    next_hop_ = EndPoint::FromGURL(remote_target_);
+  }
 }
 
 Dialog::~Dialog() {
+  MemoryAccounting::Add(MemoryAccounting::DIALOGS,
+                        -static_cast<int64>(sizeof(Dialog)));
 }
 
 scoped_refptr<Request> Dialog::CreateRequest(const Method &method) {
@@ -106,6 +119,38 @@ scoped_refptr<Request> Dialog::CreateAck(
   return ack;
 }
 
+scoped_refptr<Request> Dialog::CreatePrack(
+    const scoped_refptr<Response> &response) {
+  const Response *const_response = response.get();
+  const RSeq *rseq = const_response->get<RSeq>();
+  const Cseq *cseq = const_response->get<Cseq>();
+  if (!rseq || !cseq) {
+    DVLOG(1) << "PRACK requests require a reliable provisional response";
+    return 0;
+  }
+  if (has_remote_rseq_ && remote_rseq_sequence_ == cseq->sequence()
+      && rseq->value() != remote_rseq_ + 1) {
+    DVLOG(1) << "Discarded reliable provisional response " << rseq->value()
+             << ", expecting " << remote_rseq_ + 1;
+    return 0;
+  }
+  has_remote_rseq_ = true;
+  remote_rseq_ = rseq->value();
+  remote_rseq_sequence_ = cseq->sequence();
+  scoped_refptr<Request> prack(CreateRequest(Method::PRACK));
+  scoped_ptr<RAck> rack(
+      new RAck(rseq->value(), cseq->sequence(), cseq->method()));
+  prack->push_back(rack.Pass());
+  return prack;
+}
+
+void Dialog::set_remote_target(const GURL &remote_target) {
+  remote_target_ = remote_target;
+  // Requests keep being sent to the first route, if any.
+  if (route_set_.empty())
+    next_hop_ = EndPoint::FromGURL(remote_target_);
+}
+
 scoped_refptr<Dialog> Dialog::Create(
     const scoped_refptr<Response> &response) {
   if (response->refer_to() == nullptr)
@@ -166,9 +211,7 @@ scoped_refptr<Request> Dialog::CreateRequestInternal(
   if (route_set().empty()) {
     request_uri = remote_target();
   } else {
-    GURL first(route_set().front());
-    SipURI uri(first);
-    if (uri.has_parameters() && uri.parameter("lr").first) {
+    if (first_route_.parameter("lr", NULL)) {
       request_uri = remote_target();
       route.reset(new Route);
       for (std::vector<GURL>::const_iterator i = route_set().begin(),
@@ -176,7 +219,7 @@ scoped_refptr<Request> Dialog::CreateRequestInternal(
         route->push_back(RouteParam(*i));
       }
     } else {
-      request_uri = first;  // TODO(david): strip not allowed parameters
+      request_uri = route_set().front();  // TODO(david): strip not allowed parameters
       std::vector<GURL>::const_iterator i = route_set().begin(),
                                         ie = route_set().end();
       i++;  // discard the first
@@ -11,6 +11,8 @@
 #include "base/memory/ref_counted.h"
 #include "sippet/message/method.h"
 #include "sippet/message/status_code.h"
+#include "sippet/transport/end_point.h"
+#include "sippet/uri/uri.h"
 
 namespace sippet {
 
@@ -58,9 +60,11 @@ class Dialog :
 
   // Unique value used to identify the dialog.
   std::string id() {
-    std::ostringstream oss;
-    oss << call_id() << ":" << local_tag() << ":" << remote_tag();
-    return oss.str();
+    std::string id;
+    id.reserve(call_id_.size() + local_tag_.size() + remote_tag_.size() + 2);
+    id.append(call_id_).append(1, ':').append(local_tag_).append(1, ':')
+      .append(remote_tag_);
+    return id;
   }
 
   // The Call-Id of the dialog.
@@ -120,6 +124,14 @@ class Dialog :
     return route_set_;
   }
 
+  // Where the requests within the dialog are sent: the first entry of the
+  // route set, or the remote target when there's none. It's resolved once,
+  // and again on target refreshes, so that |UserAgent::Send| doesn't parse
+  // the URIs of each request (see |NetworkLayer::SendToNextHop|).
+  const EndPoint &next_hop() const {
+    return next_hop_;
+  }
+
   // Create a |Request| whithin a dialog.
   scoped_refptr<Request> CreateRequest(const Method &method);
 
@@ -136,6 +148,11 @@ class Dialog :
   // request being acknowledged.
   scoped_refptr<Request> CreateAck(const scoped_refptr<Request> &invite);
 
+  // Create a |Method::PRACK| request for a reliable provisional response
+  // (RFC 3262 section 4). Returns NULL if the response isn't the next one
+  // expected, as retransmissions and responses out of order are discarded.
+  scoped_refptr<Request> CreatePrack(const scoped_refptr<Response> &response);
+
  private:
   friend class base::RefCountedThreadSafe<Dialog>;
   friend class DialogStore;
@@ -170,6 +187,17 @@ class Dialog :
   bool is_secure_;
   std::vector<GURL> route_set_;
 
+  // The RSeq of the last reliable provisional response acknowledged, and
+  // the CSeq of its request.
+  bool has_remote_rseq_;
+  unsigned remote_rseq_;
+  unsigned remote_rseq_sequence_;
+
+  // The first entry of |route_set_|, parsed once for the loose routing check
+  // done on every request.
+  SipURI first_route_;
+  EndPoint next_hop_;
+
   // Create a |Dialog|.
   static scoped_refptr<Dialog> Create(
       const scoped_refptr<Response> &response);
@@ -179,6 +207,9 @@ class Dialog :
     state_ = state;
   }
 
+  // Replace the remote target, on target refreshes (DialogStore only).
+  void set_remote_target(const GURL &remote_target);
+
   // Set the dialog remote sequence (UserAgent only).
   void set_remote_sequence(unsigned sequence) {
     remote_sequence_ = sequence;
@@ -13,6 +13,12 @@ namespace sippet {
 
 namespace {
 
+// Requests that may change the remote target of their dialog (RFC 3261
+// section 12.2, RFC 3311 section 5.1).
+bool IsTargetRefresh(const Method &method) {
+  return Method::INVITE == method || Method::UPDATE == method;
+}
+
 class DefaultDialogController : public DialogController {
  public:
   DefaultDialogController() {}
@@ -34,6 +40,12 @@ scoped_refptr<Dialog> DefaultDialogController::HandleRequest(
   if (Method::BYE == request->method()) {
     // Terminate dialog on BYE requests
     dialog = store->TerminateDialog(request);
+  } else if (Message::Incoming == request->direction()) {
+    // Other requests within a dialog, such as session refreshes, are
+    // handed upwards along with it
+    dialog = store->GetDialog(request.get());
+    if (dialog && IsTargetRefresh(request->method()))
+      store->RefreshTarget(dialog, request.get());
   }
   return dialog;
 }
@@ -46,8 +58,9 @@ scoped_refptr<Dialog> DefaultDialogController::HandleResponse(
   Method method(dyn_cast<Cseq>(i)->method());
   scoped_refptr<Dialog> dialog;
   int response_code = response->response_code();
-  // Create dialog on response_code > 100 for INVITE requests with to-tag
-  if (Method::INVITE == method
+  // Create dialog on response_code > 100 for INVITE requests with to-tag,
+  // and on 2xx for SUBSCRIBE requests (RFC 6665 section 4.1.2.1)
+  if ((Method::INVITE == method || Method::SUBSCRIBE == method)
       && response_code > 100
       && response->get<To>()->HasTag()) {
     dialog = store->GetDialog(response.get());
@@ -70,7 +83,14 @@ scoped_refptr<Dialog> DefaultDialogController::HandleResponse(
           break;
       }
     }
+  } else if (Method::UPDATE == method && 2 == response_code/100) {
+    dialog = store->GetDialog(response.get());
   }
+  // The remote target may change with the 2xx of a target refresh, as well
+  // as with the 2xx confirming an early dialog.
+  if (dialog && Message::Incoming == response->direction()
+      && IsTargetRefresh(method) && 2 == response_code/100)
+    store->RefreshTarget(dialog, response.get());
   return dialog;
 }
 
@@ -29,7 +29,9 @@ class DialogController {
 
   // The default implementation is compliant with RFC 3261 only. That means it
   // will create dialogs based on INVITE responses, and destroy them based on
-  // BYE requests.
+  // BYE requests. SUBSCRIBE responses create dialogs too (RFC 6665), which
+  // are terminated by their subscription usage (see |UserAgent::Terminate
+  // Dialog|).
   static DialogController *GetDefaultDialogController();
 };
 
@@ -0,0 +1,81 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/ua/dialog_replicator.h"
+
+#include "base/bind.h"
+#include "base/location.h"
+#include "base/logging.h"
+#include "base/single_thread_task_runner.h"
+#include "sippet/ua/snapshot_io.h"
+
+namespace sippet {
+
+DialogReplicator::DialogReplicator(Delegate *delegate, size_t capacity)
+  : delegate_(delegate),
+    ring_(capacity),
+    dropped_deltas_(0),
+    drain_interval_(
+        base::TimeDelta::FromMilliseconds(kDefaultDrainIntervalMs)),
+    replicator_thread_("SipDialogReplicator") {
+  DCHECK(delegate);
+}
+
+DialogReplicator::~DialogReplicator() {
+  Stop();
+}
+
+bool DialogReplicator::Start() {
+  DCHECK(!replicator_thread_.IsRunning());
+  if (!replicator_thread_.Start())
+    return false;
+  replicator_thread_.task_runner()->PostTask(FROM_HERE,
+      base::Bind(&DialogReplicator::OnStart, base::Unretained(this)));
+  return true;
+}
+
+void DialogReplicator::Stop() {
+  if (!replicator_thread_.IsRunning())
+    return;
+  replicator_thread_.task_runner()->PostTask(FROM_HERE,
+      base::Bind(&DialogReplicator::OnStop, base::Unretained(this)));
+  replicator_thread_.Stop();
+}
+
+void DialogReplicator::Append(std::string *delta) {
+  DCHECK(delta);
+  if (!ring_.Push(delta))
+    base::subtle::NoBarrier_AtomicIncrement(&dropped_deltas_, 1);
+}
+
+int DialogReplicator::dropped_deltas() const {
+  return base::subtle::NoBarrier_Load(&dropped_deltas_);
+}
+
+void DialogReplicator::OnStart() {
+  drain_timer_.reset(new base::RepeatingTimer<DialogReplicator>);
+  drain_timer_->Start(FROM_HERE, drain_interval_, this,
+      &DialogReplicator::Drain);
+  Drain();
+}
+
+void DialogReplicator::OnStop() {
+  drain_timer_.reset();
+  Drain();
+}
+
+void DialogReplicator::Drain() {
+  // Each delta is framed by its size, in the order it was appended.
+  SnapshotWriter writer(&batch_);
+  std::string delta;
+  while (ring_.Pop(&delta))
+    writer.WriteString(delta);
+  if (batch_.empty())
+    return;
+  DVLOG(2) << "Replicating " << batch_.size() << " bytes of dialog deltas";
+  delegate_->OnReplicationBatch(batch_);
+  batch_.clear();
+}
+
+} // End of sippet namespace
@@ -0,0 +1,99 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_UA_DIALOG_REPLICATOR_H_
+#define SIPPET_UA_DIALOG_REPLICATOR_H_
+
+#include <string>
+
+#include "base/atomicops.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/threading/thread.h"
+#include "base/time/time.h"
+#include "base/timer/timer.h"
+#include "sippet/base/spsc_ring.h"
+
+namespace sippet {
+
+// Streams the changes of the dialogs of an active |DialogStore| to a
+// standby one, so that the standby can take over the calls in progress
+// without waiting for a snapshot.
+//
+// The store encodes a compact delta whenever a dialog is confirmed, has
+// its sequence numbers or remote target changed, or is terminated, and
+// swaps it into a bounded ring through |Append|, never waiting for the
+// peer. A replicator thread drains the ring periodically, batching the
+// deltas, and hands each batch to the |Delegate|, which carries it to the
+// standby, where |DialogStore::ApplyReplicationBatch| replays it. When the
+// ring is full, deltas are dropped and counted; the standby should then be
+// resynchronized from a snapshot.
+//
+// Deltas are in the native byte order of |SnapshotWriter|: the standby must
+// run the same build. The ring has a single producer: a replicator can't be
+// shared by stores used from different threads.
+class DialogReplicator {
+ public:
+  class Delegate {
+   public:
+    virtual ~Delegate() {}
+
+    // Called on the replicator thread with each batch of deltas.
+    virtual void OnReplicationBatch(const std::string &batch) = 0;
+  };
+
+  // Default number of deltas held by the ring.
+  static const size_t kDefaultCapacity = 4096;
+
+  // Default interval between replicator thread drains.
+  static const int kDefaultDrainIntervalMs = 20;
+
+  // The |delegate| must outlive the replicator.
+  explicit DialogReplicator(Delegate *delegate,
+                            size_t capacity = kDefaultCapacity);
+
+  // Stops the replicator, if still running.
+  ~DialogReplicator();
+
+  // Starts the replicator thread. Deltas appended before are kept, up to
+  // the ring capacity, and sent once started. Returns false if the thread
+  // could not be started.
+  bool Start();
+
+  // Sends what's left in the ring and joins the replicator thread. Deltas
+  // appended afterwards stay in the ring.
+  void Stop();
+
+  // Called from the thread of the store, taking the contents of |delta|.
+  // Never blocks.
+  void Append(std::string *delta);
+
+  // The deltas lost because the ring was full.
+  int dropped_deltas() const;
+
+  void set_drain_interval_for_testing(base::TimeDelta interval) {
+    drain_interval_ = interval;
+  }
+
+ private:
+  // Run on the replicator thread.
+  void OnStart();
+  void OnStop();
+  void Drain();
+
+  Delegate *delegate_;
+  SpscRing<std::string> ring_;
+  base::subtle::Atomic32 dropped_deltas_;
+  base::TimeDelta drain_interval_;
+  base::Thread replicator_thread_;
+
+  // Only accessed from |replicator_thread_|.
+  scoped_ptr<base::RepeatingTimer<DialogReplicator> > drain_timer_;
+  std::string batch_;
+
+  DISALLOW_COPY_AND_ASSIGN(DialogReplicator);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_UA_DIALOG_REPLICATOR_H_
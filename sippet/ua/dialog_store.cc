@@ -4,13 +4,64 @@
 
 #include "sippet/ua/dialog_store.h"
 
+#include "base/files/file_path.h"
+#include "base/files/important_file_writer.h"
+#include "base/files/memory_mapped_file.h"
 #include "sippet/base/stl_extras.h"
 #include "sippet/message/message.h"
 #include "sippet/ua/dialog.h"
+#include "sippet/ua/dialog_replicator.h"
+#include "sippet/ua/snapshot_io.h"
 
 namespace sippet {
 
-DialogStore::DialogStore() {
+namespace {
+
+// "SDLG", followed by the format version.
+const uint32 kSnapshotMagic = 0x474c4453;
+const uint32 kSnapshotVersion = 1;
+
+// Flags of a dialog in the snapshot.
+enum {
+  SNAPSHOT_HAS_LOCAL_SEQUENCE = 1 << 0,
+  SNAPSHOT_HAS_REMOTE_SEQUENCE = 1 << 1,
+  SNAPSHOT_IS_SECURE = 1 << 2,
+  SNAPSHOT_HAS_REMOTE_RSEQ = 1 << 3,
+};
+
+// Operations of the replication deltas. Confirmations carry the whole
+// dialog; the others, its key and the fields that may have changed.
+enum {
+  REPLICATE_CONFIRMED = 1,
+  REPLICATE_UPDATED = 2,
+  REPLICATE_TERMINATED = 3,
+};
+
+size_t HashPiece(const base::StringPiece &piece) {
+  return BASE_HASH_NAMESPACE::hash<base::StringPiece>()(piece);
+}
+
+bool ReadURL(SnapshotReader *reader, GURL *url) {
+  std::string spec;
+  if (!reader->ReadString(&spec))
+    return false;
+  *url = GURL(spec);
+  return url->is_valid();
+}
+
+}  // namespace
+
+DialogKey::DialogKey(const base::StringPiece &call_id,
+                     const base::StringPiece &local_tag,
+                     const base::StringPiece &remote_tag)
+  : call_id(call_id), local_tag(local_tag), remote_tag(remote_tag) {
+  hash = HashPiece(call_id);
+  hash = hash * 31 + HashPiece(local_tag);
+  hash = hash * 31 + HashPiece(remote_tag);
+}
+
+DialogStore::DialogStore()
+  : replicator_(nullptr) {
 }
 
 DialogStore::~DialogStore() {
@@ -18,44 +69,331 @@ DialogStore::~DialogStore() {
 
 scoped_refptr<Dialog> DialogStore::GenerateDialog(
     const scoped_refptr<Response> &response) {
-  DialogMapType::iterator i = dialogs_.find(response->GetDialogId());
+  DialogMapType::iterator i =
+      dialogs_.find(GetMessageDialogKey(response.get()));
   if (dialogs_.end() != i)
     return i->second;
   scoped_refptr<Dialog> dialog(Dialog::Create(response));
-  if (dialog)
-    dialogs_.insert(std::make_pair(dialog->id(), dialog));
+  if (dialog) {
+    InsertDialog(dialog);
+    if (Dialog::STATE_CONFIRMED == dialog->state_)
+      Replicate(REPLICATE_CONFIRMED, dialog.get());
+  }
   return dialog;
 }
 
 scoped_refptr<Dialog> DialogStore::TerminateDialog(
     const scoped_refptr<Request> &request) {
-  DialogMapType::iterator i = dialogs_.find(request->GetDialogId());
+  DialogMapType::iterator i =
+      dialogs_.find(GetMessageDialogKey(request.get()));
   if (dialogs_.end() == i)
     return nullptr;
   scoped_refptr<Dialog> dialog(i->second);
+  Replicate(REPLICATE_TERMINATED, dialog.get());
   dialog->set_state(Dialog::STATE_TERMINATED);
-  dialogs_.erase(i);
+  EraseDialog(i);
   return dialog;
 }
 
 void DialogStore::TerminateDialog(const scoped_refptr<Dialog> &dialog) {
-  DialogMapType::iterator i = dialogs_.find(dialog->id());
+  DialogMapType::iterator i = dialogs_.find(GetDialogKey(dialog.get()));
   if (dialogs_.end() != i) {
+    Replicate(REPLICATE_TERMINATED, dialog.get());
     dialog->set_state(Dialog::STATE_TERMINATED);
-    dialogs_.erase(i);
+    EraseDialog(i);
   }
 }
 
 void DialogStore::ConfirmDialog(const scoped_refptr<Dialog> &dialog) {
-  DCHECK(dialogs_.find(dialog->id()) != dialogs_.end());
+  DCHECK(dialogs_.find(GetDialogKey(dialog.get())) != dialogs_.end());
   dialog->set_state(Dialog::STATE_CONFIRMED);
+  Replicate(REPLICATE_CONFIRMED, dialog.get());
+}
+
+void DialogStore::RefreshTarget(const scoped_refptr<Dialog> &dialog,
+                                const Message *message) {
+  const Contact *contact = message->get<Contact>();
+  if (contact && !contact->empty()
+      && contact->front().address() != dialog->remote_target_) {
+    dialog->set_remote_target(contact->front().address());
+    Replicate(REPLICATE_UPDATED, dialog.get());
+  }
+}
+
+void DialogStore::SequenceChanged(const scoped_refptr<Dialog> &dialog) {
+  Replicate(REPLICATE_UPDATED, dialog.get());
 }
 
 scoped_refptr<Dialog> DialogStore::GetDialog(const Message *message) {
-  DialogMapType::iterator i = dialogs_.find(message->GetDialogId());
+  DialogMapType::iterator i = dialogs_.find(GetMessageDialogKey(message));
   if (dialogs_.end() == i)
     return nullptr;
   return i->second;
 }
 
+void DialogStore::GetDialogsByCallId(
+    const base::StringPiece &call_id,
+    std::vector<scoped_refptr<Dialog> > *dialogs) {
+  std::pair<CallIdIndexType::iterator, CallIdIndexType::iterator> range =
+      dialogs_by_call_id_.equal_range(call_id);
+  for (CallIdIndexType::iterator i = range.first; i != range.second; ++i)
+    dialogs->push_back(i->second);
+}
+
+DialogKey DialogStore::GetMessageDialogKey(const Message *message) {
+  base::StringPiece call_id;
+  base::StringPiece from_tag;
+  base::StringPiece to_tag;
+  const CallId *call_id_header = message->get<CallId>();
+  if (call_id_header)
+    call_id = call_id_header->value();
+  const From *from = message->get<From>();
+  if (from && from->HasTag())
+    from_tag = from->tag();
+  const To *to = message->get<To>();
+  if (to && to->HasTag())
+    to_tag = to->tag();
+  // The From tag is the local one in outgoing requests and incoming
+  // responses.
+  bool from_is_local =
+      isa<Request>(message) == (Message::Outgoing == message->direction());
+  if (from_is_local)
+    return DialogKey(call_id, from_tag, to_tag);
+  return DialogKey(call_id, to_tag, from_tag);
+}
+
+bool DialogStore::SaveSnapshot(const base::FilePath &path) const {
+  std::string data;
+  SnapshotWriter writer(&data);
+  writer.WriteUint32(kSnapshotMagic);
+  writer.WriteUint32(kSnapshotVersion);
+  writer.WriteUint32(static_cast<uint32>(dialogs_.size()));
+  for (DialogMapType::const_iterator i = dialogs_.begin(),
+       ie = dialogs_.end(); i != ie; ++i)
+    WriteDialog(i->second.get(), &writer);
+  return base::ImportantFileWriter::WriteFileAtomically(path, data);
+}
+
+bool DialogStore::LoadSnapshot(const base::FilePath &path) {
+  base::MemoryMappedFile file;
+  if (!file.Initialize(path))
+    return false;
+  SnapshotReader reader(file.data(), file.length());
+  uint32 magic, version, dialog_count;
+  if (!reader.ReadUint32(&magic) || kSnapshotMagic != magic
+      || !reader.ReadUint32(&version) || kSnapshotVersion != version
+      || !reader.ReadUint32(&dialog_count))
+    return false;
+
+  // Read everything first, so that a truncated snapshot changes nothing.
+  std::vector<scoped_refptr<Dialog> > loaded;
+  for (uint32 i = 0; i < dialog_count; ++i) {
+    scoped_refptr<Dialog> dialog(ReadDialog(&reader));
+    if (!dialog)
+      return false;
+    loaded.push_back(dialog);
+  }
+  if (!reader.empty())
+    return false;
+
+  dialogs_by_call_id_.clear();
+  dialogs_.clear();
+  for (std::vector<scoped_refptr<Dialog> >::iterator i = loaded.begin(),
+       ie = loaded.end(); i != ie; ++i) {
+    if (!dialogs_.count(GetDialogKey(i->get())))
+      InsertDialog(*i);
+  }
+  return true;
+}
+
+DialogKey DialogStore::GetDialogKey(const Dialog *dialog) {
+  return DialogKey(dialog->call_id_, dialog->local_tag_, dialog->remote_tag_);
+}
+
+void DialogStore::InsertDialog(const scoped_refptr<Dialog> &dialog) {
+  dialogs_.insert(std::make_pair(GetDialogKey(dialog.get()), dialog));
+  dialogs_by_call_id_.insert(
+      std::make_pair(base::StringPiece(dialog->call_id_), dialog.get()));
+}
+
+void DialogStore::EraseDialog(DialogMapType::iterator i) {
+  Dialog *dialog = i->second.get();
+  std::pair<CallIdIndexType::iterator, CallIdIndexType::iterator> range =
+      dialogs_by_call_id_.equal_range(dialog->call_id_);
+  for (CallIdIndexType::iterator j = range.first; j != range.second; ++j) {
+    if (j->second == dialog) {
+      dialogs_by_call_id_.erase(j);
+      break;
+    }
+  }
+  // The key points to the dialog strings: erase it while referenced.
+  dialogs_.erase(i);
+}
+
+void DialogStore::WriteDialog(const Dialog *dialog, SnapshotWriter *writer) {
+  uint32 flags = 0;
+  if (dialog->has_local_sequence_)
+    flags |= SNAPSHOT_HAS_LOCAL_SEQUENCE;
+  if (dialog->has_remote_sequence_)
+    flags |= SNAPSHOT_HAS_REMOTE_SEQUENCE;
+  if (dialog->is_secure_)
+    flags |= SNAPSHOT_IS_SECURE;
+  if (dialog->has_remote_rseq_)
+    flags |= SNAPSHOT_HAS_REMOTE_RSEQ;
+  writer->WriteUint32(static_cast<uint32>(dialog->state_));
+  writer->WriteUint32(flags);
+  writer->WriteString(dialog->call_id_);
+  writer->WriteString(dialog->local_tag_);
+  writer->WriteString(dialog->remote_tag_);
+  writer->WriteUint32(dialog->local_sequence_);
+  writer->WriteUint32(dialog->remote_sequence_);
+  writer->WriteUint32(dialog->remote_rseq_);
+  writer->WriteUint32(dialog->remote_rseq_sequence_);
+  writer->WriteString(dialog->local_uri_.spec());
+  writer->WriteString(dialog->remote_uri_.spec());
+  writer->WriteString(dialog->remote_target_.spec());
+  writer->WriteUint32(static_cast<uint32>(dialog->route_set_.size()));
+  for (std::vector<GURL>::const_iterator i = dialog->route_set_.begin(),
+       ie = dialog->route_set_.end(); i != ie; ++i)
+    writer->WriteString(i->spec());
+}
+
+scoped_refptr<Dialog> DialogStore::ReadDialog(SnapshotReader *reader) {
+  uint32 state, flags, local_sequence, remote_sequence, remote_rseq,
+      remote_rseq_sequence, route_count;
+  std::string call_id, local_tag, remote_tag, remote_target;
+  GURL local_uri, remote_uri;
+  if (!reader->ReadUint32(&state)
+      || state > static_cast<uint32>(Dialog::STATE_CONFIRMED)
+      || !reader->ReadUint32(&flags)
+      || !reader->ReadString(&call_id)
+      || !reader->ReadString(&local_tag)
+      || !reader->ReadString(&remote_tag)
+      || !reader->ReadUint32(&local_sequence)
+      || !reader->ReadUint32(&remote_sequence)
+      || !reader->ReadUint32(&remote_rseq)
+      || !reader->ReadUint32(&remote_rseq_sequence)
+      || !ReadURL(reader, &local_uri)
+      || !ReadURL(reader, &remote_uri)
+      || !reader->ReadString(&remote_target)
+      || !reader->ReadUint32(&route_count))
+    return nullptr;
+  std::vector<GURL> route_set;
+  for (uint32 i = 0; i < route_count; ++i) {
+    GURL route;
+    if (!ReadURL(reader, &route))
+      return nullptr;
+    route_set.push_back(route);
+  }
+  scoped_refptr<Dialog> dialog(new Dialog(
+      static_cast<Dialog::State>(state), call_id, local_tag, remote_tag,
+      0 != (flags & SNAPSHOT_HAS_LOCAL_SEQUENCE), local_sequence,
+      0 != (flags & SNAPSHOT_HAS_REMOTE_SEQUENCE), remote_sequence,
+      local_uri, remote_uri, GURL(remote_target),
+      0 != (flags & SNAPSHOT_IS_SECURE), route_set));
+  dialog->has_remote_rseq_ = 0 != (flags & SNAPSHOT_HAS_REMOTE_RSEQ);
+  dialog->remote_rseq_ = remote_rseq;
+  dialog->remote_rseq_sequence_ = remote_rseq_sequence;
+  return dialog;
+}
+
+void DialogStore::Replicate(uint32 operation, const Dialog *dialog) {
+  // Standby stores only need the dialogs they can take over.
+  if (!replicator_ || (REPLICATE_TERMINATED != operation
+                       && Dialog::STATE_CONFIRMED != dialog->state_))
+    return;
+  std::string delta;
+  SnapshotWriter writer(&delta);
+  writer.WriteUint32(operation);
+  if (REPLICATE_CONFIRMED == operation) {
+    WriteDialog(dialog, &writer);
+  } else {
+    writer.WriteString(dialog->call_id_);
+    writer.WriteString(dialog->local_tag_);
+    writer.WriteString(dialog->remote_tag_);
+    if (REPLICATE_UPDATED == operation) {
+      uint32 flags = 0;
+      if (dialog->has_local_sequence_)
+        flags |= SNAPSHOT_HAS_LOCAL_SEQUENCE;
+      if (dialog->has_remote_sequence_)
+        flags |= SNAPSHOT_HAS_REMOTE_SEQUENCE;
+      writer.WriteUint32(flags);
+      writer.WriteUint32(dialog->local_sequence_);
+      writer.WriteUint32(dialog->remote_sequence_);
+      writer.WriteString(dialog->remote_target_.spec());
+    }
+  }
+  replicator_->Append(&delta);
+}
+
+bool DialogStore::ApplyReplicationBatch(const base::StringPiece &batch) {
+  SnapshotReader reader(reinterpret_cast<const uint8*>(batch.data()),
+                        batch.size());
+  std::string delta;
+  while (!reader.empty()) {
+    if (!reader.ReadString(&delta) || !ApplyDelta(delta))
+      return false;
+  }
+  return true;
+}
+
+bool DialogStore::ApplyDelta(const std::string &delta) {
+  SnapshotReader reader(reinterpret_cast<const uint8*>(delta.data()),
+                        delta.size());
+  uint32 operation;
+  if (!reader.ReadUint32(&operation))
+    return false;
+  if (REPLICATE_CONFIRMED == operation) {
+    scoped_refptr<Dialog> dialog(ReadDialog(&reader));
+    if (!dialog || !reader.empty())
+      return false;
+    DialogMapType::iterator i = dialogs_.find(GetDialogKey(dialog.get()));
+    if (dialogs_.end() != i)
+      EraseDialog(i);
+    InsertDialog(dialog);
+    return true;
+  }
+
+  std::string call_id, local_tag, remote_tag;
+  if (!reader.ReadString(&call_id)
+      || !reader.ReadString(&local_tag)
+      || !reader.ReadString(&remote_tag))
+    return false;
+  DialogMapType::iterator i =
+      dialogs_.find(DialogKey(call_id, local_tag, remote_tag));
+  switch (operation) {
+    case REPLICATE_UPDATED: {
+      uint32 flags, local_sequence, remote_sequence;
+      std::string remote_target;
+      if (!reader.ReadUint32(&flags)
+          || !reader.ReadUint32(&local_sequence)
+          || !reader.ReadUint32(&remote_sequence)
+          || !reader.ReadString(&remote_target)
+          || !reader.empty())
+        return false;
+      if (dialogs_.end() == i)
+        return true;
+      Dialog *dialog = i->second.get();
+      dialog->has_local_sequence_ =
+          0 != (flags & SNAPSHOT_HAS_LOCAL_SEQUENCE);
+      dialog->local_sequence_ = local_sequence;
+      dialog->has_remote_sequence_ =
+          0 != (flags & SNAPSHOT_HAS_REMOTE_SEQUENCE);
+      dialog->remote_sequence_ = remote_sequence;
+      if (remote_target != dialog->remote_target_.spec())
+        dialog->set_remote_target(GURL(remote_target));
+      return true;
+    }
+    case REPLICATE_TERMINATED:
+      if (!reader.empty())
+        return false;
+      if (dialogs_.end() != i) {
+        i->second->set_state(Dialog::STATE_TERMINATED);
+        EraseDialog(i);
+      }
+      return true;
+  }
+  return false;
+}
+
 }  // namespace sippet
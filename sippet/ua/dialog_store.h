@@ -5,21 +5,74 @@
 #ifndef SIPPET_UA_DIALOG_STORE_H_
 #define SIPPET_UA_DIALOG_STORE_H_
 
-#include <map>
 #include <string>
+#include <vector>
 #include "base/basictypes.h"
+#include "base/containers/hash_tables.h"
 #include "base/memory/ref_counted.h"
+#include "base/strings/string_piece.h"
+
+namespace base {
+class FilePath;
+}
 
 namespace sippet {
 
 class Dialog;
+class DialogReplicator;
 class Message;
 class Request;
 class Response;
+class SnapshotReader;
+class SnapshotWriter;
+
+// Identifies a dialog by its Call-ID and tags, as seen by this user agent.
+// The pieces point to the strings of a dialog or a message, which must
+// outlive the key, so that messages are matched without building a string.
+// The hash is computed once.
+struct DialogKey {
+  DialogKey(const base::StringPiece &call_id,
+            const base::StringPiece &local_tag,
+            const base::StringPiece &remote_tag);
+
+  base::StringPiece call_id;
+  base::StringPiece local_tag;
+  base::StringPiece remote_tag;
+  size_t hash;
+};
+
+inline bool operator==(const DialogKey &a, const DialogKey &b) {
+  return a.hash == b.hash
+      && a.call_id == b.call_id
+      && a.local_tag == b.local_tag
+      && a.remote_tag == b.remote_tag;
+}
+
+} // End of sippet namespace
+
+// To be used in base::hash_map
+namespace BASE_HASH_NAMESPACE {
+
+template<>
+struct hash<sippet::DialogKey> {
+  size_t operator()(const sippet::DialogKey &key) const {
+    return key.hash;
+  }
+};
+
+} // End of BASE_HASH_NAMESPACE namespace
+
+namespace sippet {
 
 // The |DialogStore| is responsible for generating dialogs, as well as
 // terminating them. It also stores them, providing the ability to retrieve
 // them whenever required.
+//
+// The dialogs can be saved to and restored from a snapshot file, such as
+// the one of |LocationService|, so that a restarting user agent can still
+// send requests, or tear down calls, within the dialogs it had. Their
+// changes can also be streamed to a standby store by a |DialogReplicator|,
+// as they happen.
 class DialogStore {
  public:
   DialogStore();
@@ -42,13 +95,70 @@ class DialogStore {
   // Confirms an existing dialog.
   void ConfirmDialog(const scoped_refptr<Dialog> &dialog);
 
+  // Replaces the remote target of |dialog| with the |Contact| of |message|,
+  // a target refresh request or its 2xx response, if it has one.
+  void RefreshTarget(const scoped_refptr<Dialog> &dialog,
+                     const Message *message);
+
+  // Records that the local or remote sequence number of |dialog| changed,
+  // as requests were sent or received within it.
+  void SequenceChanged(const scoped_refptr<Dialog> &dialog);
+
   // Given any message, retrieves the matching dialog.
   scoped_refptr<Dialog> GetDialog(const Message *message);
 
+  // Appends the dialogs of a given Call-ID to |dialogs|: the early and
+  // confirmed dialogs created by the forks of a single request.
+  void GetDialogsByCallId(const base::StringPiece &call_id,
+                          std::vector<scoped_refptr<Dialog> > *dialogs);
+
+  // The key of the dialog a message belongs to.
+  static DialogKey GetMessageDialogKey(const Message *message);
+
+  // Number of early and confirmed dialogs.
+  size_t size() const { return dialogs_.size(); }
+
+  // Saves the Call-ID, tags, sequence numbers, URIs and route set of all
+  // dialogs to |path|, atomically replacing it.
+  bool SaveSnapshot(const base::FilePath &path) const;
+
+  // Replaces all dialogs with the ones saved to |path|. Returns false,
+  // keeping the current dialogs, if the snapshot can't be read.
+  bool LoadSnapshot(const base::FilePath &path);
+
+  // Streams the confirmations, updates and terminations of the confirmed
+  // dialogs to |replicator|, which must outlive the store, or stops doing
+  // so if null.
+  void set_replicator(DialogReplicator *replicator) {
+    replicator_ = replicator;
+  }
+
+  // Replays a batch of deltas of the |DialogReplicator| of an active store.
+  // Updates and terminations of unknown dialogs are skipped. Returns false
+  // if the batch is malformed, keeping the deltas preceding the bad one.
+  bool ApplyReplicationBatch(const base::StringPiece &batch);
+
  private:
-  typedef std::map<std::string, scoped_refptr<Dialog> > DialogMapType;
+  // Keyed by the dialog's own Call-ID and tags.
+  typedef base::hash_map<DialogKey, scoped_refptr<Dialog> > DialogMapType;
+  typedef base::hash_multimap<base::StringPiece, Dialog*> CallIdIndexType;
+
+  static DialogKey GetDialogKey(const Dialog *dialog);
+  void InsertDialog(const scoped_refptr<Dialog> &dialog);
+  void EraseDialog(DialogMapType::iterator i);
+
+  // The encoding of whole dialogs, shared by the snapshots and the
+  // replication.
+  static void WriteDialog(const Dialog *dialog, SnapshotWriter *writer);
+  static scoped_refptr<Dialog> ReadDialog(SnapshotReader *reader);
+
+  // Appends the delta of |operation| on |dialog| to the replicator, if any.
+  void Replicate(uint32 operation, const Dialog *dialog);
+  bool ApplyDelta(const std::string &delta);
 
   DialogMapType dialogs_;
+  CallIdIndexType dialogs_by_call_id_;
+  DialogReplicator *replicator_;
 
   DISALLOW_COPY_AND_ASSIGN(DialogStore);
 };
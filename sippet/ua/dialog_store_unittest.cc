@@ -0,0 +1,236 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/ua/dialog_store.h"
+
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "sippet/message/message.h"
+#include "sippet/ua/dialog.h"
+#include "sippet/ua/dialog_replicator.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const char kInvite[] =
+  "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK776asdhds\r\n"
+  "Max-Forwards: 70\r\n"
+  "To: Bob <sip:bob@biloxi.com>\r\n"
+  "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+  "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+  "CSeq: 314159 INVITE\r\n"
+  "Contact: <sip:alice@pc33.atlanta.com>\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n";
+
+const char kBye[] =
+  "BYE sip:bob@192.0.2.4 SIP/2.0\r\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bKnashds10\r\n"
+  "Max-Forwards: 70\r\n"
+  "To: Bob <sip:bob@biloxi.com>;tag=a6c85cf\r\n"
+  "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+  "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+  "CSeq: 231 BYE\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n";
+
+const char kReinvite[] =
+  "INVITE sip:bob@192.0.2.4 SIP/2.0\r\n"
+  "Via: SIP/2.0/UDP 192.0.2.10:5070;branch=z9hG4bKnashds11\r\n"
+  "Max-Forwards: 70\r\n"
+  "To: Bob <sip:bob@biloxi.com>;tag=a6c85cf\r\n"
+  "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+  "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+  "CSeq: 314160 INVITE\r\n"
+  "Contact: <sip:alice@192.0.2.10:5070>\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n";
+
+scoped_refptr<Request> ParseRequest(const char *data) {
+  return dyn_cast<Request>(Message::Parse(data));
+}
+
+// A response to |request| whose To carries |to_tag|.
+scoped_refptr<Response> CreateResponse(const scoped_refptr<Request> &request,
+                                       int response_code,
+                                       const char *reason_phrase,
+                                       const char *to_tag) {
+  scoped_refptr<Response> response(
+      request->CreateResponse(response_code, reason_phrase));
+  response->get<To>()->set_tag(to_tag);
+  return response;
+}
+
+// Collects the batches of a replicator, to be read once it's stopped.
+class BatchCollector : public DialogReplicator::Delegate {
+ public:
+  void OnReplicationBatch(const std::string &batch) override {
+    batches_.append(batch);
+  }
+
+  const std::string &batches() const { return batches_; }
+
+ private:
+  std::string batches_;
+};
+
+}  // namespace
+
+TEST(DialogStoreTest, MatchesInDialogRequests) {
+  DialogStore store;
+  scoped_refptr<Request> invite(ParseRequest(kInvite));
+  scoped_refptr<Response> ringing(
+      CreateResponse(invite, 180, "Ringing", "a6c85cf"));
+  scoped_refptr<Dialog> dialog(store.GenerateDialog(ringing));
+  ASSERT_TRUE(dialog.get());
+  EXPECT_EQ(Dialog::STATE_EARLY, dialog->state());
+  EXPECT_EQ("a84b4c76e66710@pc33.atlanta.com:a6c85cf:1928301774",
+            dialog->id());
+  EXPECT_EQ(dialog.get(), store.GetDialog(ringing.get()).get());
+  // Generating it again returns the same dialog.
+  EXPECT_EQ(dialog.get(), store.GenerateDialog(ringing).get());
+
+  scoped_refptr<Request> bye(ParseRequest(kBye));
+  EXPECT_EQ(dialog.get(), store.GetDialog(bye.get()).get());
+  EXPECT_EQ(dialog.get(), store.TerminateDialog(bye).get());
+  EXPECT_EQ(Dialog::STATE_TERMINATED, dialog->state());
+  EXPECT_FALSE(store.GetDialog(bye.get()).get());
+}
+
+TEST(DialogStoreTest, IndexesByCallId) {
+  DialogStore store;
+  scoped_refptr<Request> invite(ParseRequest(kInvite));
+  scoped_refptr<Dialog> first(store.GenerateDialog(
+      CreateResponse(invite, 180, "Ringing", "a6c85cf")));
+  scoped_refptr<Dialog> second(store.GenerateDialog(
+      CreateResponse(invite, 183, "Session Progress", "b7d96d0")));
+  ASSERT_TRUE(first.get());
+  ASSERT_TRUE(second.get());
+  EXPECT_NE(first.get(), second.get());
+
+  std::vector<scoped_refptr<Dialog> > dialogs;
+  store.GetDialogsByCallId("a84b4c76e66710@pc33.atlanta.com", &dialogs);
+  EXPECT_EQ(2u, dialogs.size());
+
+  store.TerminateDialog(first);
+  dialogs.clear();
+  store.GetDialogsByCallId("a84b4c76e66710@pc33.atlanta.com", &dialogs);
+  ASSERT_EQ(1u, dialogs.size());
+  EXPECT_EQ(second.get(), dialogs[0].get());
+
+  dialogs.clear();
+  store.GetDialogsByCallId("unknown@pc33.atlanta.com", &dialogs);
+  EXPECT_TRUE(dialogs.empty());
+}
+
+TEST(DialogStoreTest, RefreshesNextHop) {
+  DialogStore store;
+  scoped_refptr<Request> invite(ParseRequest(kInvite));
+  scoped_refptr<Dialog> dialog(store.GenerateDialog(
+      CreateResponse(invite, 200, "OK", "a6c85cf")));
+  ASSERT_TRUE(dialog.get());
+  EXPECT_EQ("pc33.atlanta.com", dialog->next_hop().host());
+  EXPECT_EQ(5060, dialog->next_hop().port());
+
+  scoped_refptr<Request> reinvite(ParseRequest(kReinvite));
+  ASSERT_EQ(dialog.get(), store.GetDialog(reinvite.get()).get());
+  store.RefreshTarget(dialog, reinvite.get());
+  EXPECT_EQ(GURL("sip:alice@192.0.2.10:5070"), dialog->remote_target());
+  EXPECT_EQ("192.0.2.10", dialog->next_hop().host());
+  EXPECT_EQ(5070, dialog->next_hop().port());
+}
+
+TEST(DialogStoreTest, Snapshot) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath path(temp_dir.path().AppendASCII("dialogs"));
+
+  DialogStore store;
+  scoped_refptr<Request> invite(ParseRequest(kInvite));
+  scoped_refptr<Dialog> dialog(store.GenerateDialog(
+      CreateResponse(invite, 200, "OK", "a6c85cf")));
+  ASSERT_TRUE(dialog.get());
+  ASSERT_TRUE(store.SaveSnapshot(path));
+
+  // The restored dialog matches the requests within it.
+  DialogStore restored;
+  ASSERT_TRUE(restored.LoadSnapshot(path));
+  EXPECT_EQ(1u, restored.size());
+  scoped_refptr<Request> bye(ParseRequest(kBye));
+  scoped_refptr<Dialog> restored_dialog(restored.GetDialog(bye.get()));
+  ASSERT_TRUE(restored_dialog.get());
+  EXPECT_NE(dialog.get(), restored_dialog.get());
+  EXPECT_EQ(dialog->id(), restored_dialog->id());
+  EXPECT_EQ(dialog->state(), restored_dialog->state());
+  EXPECT_EQ(dialog->local_sequence(), restored_dialog->local_sequence());
+  EXPECT_EQ(dialog->remote_sequence(), restored_dialog->remote_sequence());
+  EXPECT_EQ(dialog->local_uri(), restored_dialog->local_uri());
+  EXPECT_EQ(dialog->remote_uri(), restored_dialog->remote_uri());
+  EXPECT_EQ(dialog->remote_target(), restored_dialog->remote_target());
+  EXPECT_EQ(dialog->route_set(), restored_dialog->route_set());
+  EXPECT_EQ(dialog->next_hop().host(), restored_dialog->next_hop().host());
+
+  // A truncated snapshot is rejected, keeping the current dialogs.
+  std::string data;
+  ASSERT_TRUE(base::ReadFileToString(path, &data));
+  data.resize(data.size() - 1);
+  ASSERT_EQ(static_cast<int>(data.size()),
+            base::WriteFile(path, data.data(), data.size()));
+  EXPECT_FALSE(restored.LoadSnapshot(path));
+  EXPECT_EQ(1u, restored.size());
+}
+
+TEST(DialogStoreTest, Replication) {
+  BatchCollector collector;
+  DialogReplicator replicator(&collector);
+  DialogStore active;
+  active.set_replicator(&replicator);
+  ASSERT_TRUE(replicator.Start());
+
+  // Early dialogs aren't replicated until confirmed.
+  scoped_refptr<Request> invite(ParseRequest(kInvite));
+  scoped_refptr<Dialog> early(active.GenerateDialog(
+      CreateResponse(invite, 180, "Ringing", "b7d96d0")));
+  scoped_refptr<Dialog> dialog(active.GenerateDialog(
+      CreateResponse(invite, 200, "OK", "a6c85cf")));
+  ASSERT_TRUE(early.get());
+  ASSERT_TRUE(dialog.get());
+  scoped_refptr<Request> request(dialog->CreateRequest(Method::INFO));
+  active.SequenceChanged(dialog);
+  active.RefreshTarget(dialog, ParseRequest(kReinvite).get());
+  replicator.Stop();
+  EXPECT_EQ(0, replicator.dropped_deltas());
+
+  DialogStore standby;
+  ASSERT_TRUE(standby.ApplyReplicationBatch(collector.batches()));
+  EXPECT_EQ(1u, standby.size());
+  scoped_refptr<Request> bye(ParseRequest(kBye));
+  scoped_refptr<Dialog> replica(standby.GetDialog(bye.get()));
+  ASSERT_TRUE(replica.get());
+  EXPECT_EQ(Dialog::STATE_CONFIRMED, replica->state());
+  EXPECT_EQ(dialog->local_sequence(), replica->local_sequence());
+  EXPECT_EQ(GURL("sip:alice@192.0.2.10:5070"), replica->remote_target());
+  EXPECT_EQ("192.0.2.10", replica->next_hop().host());
+
+  // Terminations are replayed too; a truncated batch is rejected.
+  BatchCollector termination_collector;
+  DialogReplicator termination_replicator(&termination_collector);
+  active.set_replicator(&termination_replicator);
+  active.TerminateDialog(dialog);
+  ASSERT_TRUE(termination_replicator.Start());
+  termination_replicator.Stop();
+  std::string batch(termination_collector.batches());
+  ASSERT_FALSE(batch.empty());
+  EXPECT_FALSE(standby.ApplyReplicationBatch(
+      base::StringPiece(batch.data(), batch.size() - 1)));
+  EXPECT_EQ(1u, standby.size());
+  EXPECT_TRUE(standby.ApplyReplicationBatch(batch));
+  EXPECT_EQ(0u, standby.size());
+}
+
+} // End of sippet namespace
@@ -0,0 +1,344 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/ua/digest_authenticator.h"
+
+#include "base/base64.h"
+#include "base/bind.h"
+#include "base/logging.h"
+#include "base/md5.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_util.h"
+#include "base/time/clock.h"
+#include "crypto/hmac.h"
+#include "crypto/random.h"
+#include "crypto/sha2.h"
+#include "net/base/net_errors.h"
+#include "net/http/http_util.h"
+#include "sippet/base/sha512_256.h"
+#include "sippet/message/headers.h"
+#include "sippet/message/request.h"
+#include "sippet/message/response.h"
+
+namespace sippet {
+
+namespace {
+
+const size_t kNonceKeySize = 32;
+const size_t kNonceTimeSize = 8;
+const size_t kNonceMacSize = 16;
+
+// Hashes |data| with the function named |hash|, in lowercase hex.
+std::string HashString(const std::string& hash, const std::string& data) {
+  std::string digest;
+  if (hash == "SHA-256")
+    digest = crypto::SHA256HashString(data);
+  else if (hash == "SHA-512-256")
+    digest = SHA512_256HashString(data);
+  else
+    return base::MD5String(data);
+  return base::StringToLowerASCII(
+      base::HexEncode(digest.data(), digest.size()));
+}
+
+// Splits the digest |algorithm| into its hash function name and whether
+// it's a session variant. Returns false if unsupported.
+bool ParseAlgorithm(const std::string& algorithm,
+                    std::string* hash,
+                    bool* session) {
+  std::string name(base::StringToLowerASCII(algorithm));
+  *session = base::EndsWith(name, "-sess", base::CompareCase::SENSITIVE);
+  if (*session)
+    name.resize(name.size() - 5);
+  if (name == "md5")
+    *hash = "MD5";
+  else if (name == "sha-256")
+    *hash = "SHA-256";
+  else if (name == "sha-512-256")
+    *hash = "SHA-512-256";
+  else
+    return false;
+  return true;
+}
+
+// Finds the digest credentials of |request| for |realm|.
+template <class HeaderType>
+const Credentials* FindCredentials(const Request* request,
+                                   const std::string& realm) {
+  for (Message::const_iterator i = request->find_first<HeaderType>(),
+       ie = request->end(); i != ie; i = request->find_next<HeaderType>(i)) {
+    const HeaderType* header = dyn_cast<HeaderType>(&*i);
+    if (base::LowerCaseEqualsASCII(header->scheme(), "digest")
+        && header->HasRealm() && header->realm() == realm)
+      return header;
+  }
+  return nullptr;
+}
+
+// Returns the unquoted value of the parameter |name|, or empty.
+std::string GetParam(const Credentials* credentials, const char* name) {
+  has_parameters::const_param_iterator i = credentials->param_find(name);
+  if (i == credentials->param_end())
+    return std::string();
+  return net::HttpUtil::Unquote(i->second);
+}
+
+}  // namespace
+
+// A verification in progress, kept while the credential store works.
+struct DigestAuthenticator::Verification {
+  std::string username;
+  std::string nonce;
+  std::string uri;
+  std::string response;
+  std::string hash;
+  bool session;
+  std::string qop;
+  std::string nc;
+  uint32 nc_value;
+  std::string cnonce;
+  std::string method;
+  std::string body;
+  bool expired;
+  std::string cache_key;
+  std::string ha1;
+  VerifyCallback callback;
+};
+
+DigestAuthenticator::CacheEntry::CacheEntry()
+  : last_nc(0),
+    last_result(RESULT_REJECTED) {
+}
+
+DigestAuthenticator::CacheEntry::~CacheEntry() {
+}
+
+DigestAuthenticator::DigestAuthenticator(Auth::Target target,
+                                         const std::string& realm,
+                                         CredentialStore* credential_store)
+  : target_(target),
+    realm_(realm),
+    credential_store_(credential_store),
+    nonce_lifetime_(
+        base::TimeDelta::FromSeconds(kDefaultNonceLifetimeSeconds)),
+    cache_(kDefaultMaxCacheEntries),
+    clock_(nullptr),
+    weak_factory_(this) {
+  DCHECK(credential_store_);
+  DCHECK(target_ == net::HttpAuth::AUTH_SERVER
+         || target_ == net::HttpAuth::AUTH_PROXY);
+  algorithms_.push_back("SHA-256");
+  algorithms_.push_back("MD5");
+  crypto::RandBytes(WriteInto(&nonce_key_, kNonceKeySize + 1),
+                    kNonceKeySize);
+}
+
+DigestAuthenticator::~DigestAuthenticator() {
+}
+
+void DigestAuthenticator::AddChallenges(
+    const scoped_refptr<Response>& response, bool stale) {
+  std::string nonce(CreateNonce());
+  for (std::vector<std::string>::const_iterator i = algorithms_.begin(),
+       ie = algorithms_.end(); i != ie; ++i) {
+    scoped_ptr<Header> header;
+    Challenge* challenge;
+    if (net::HttpAuth::AUTH_PROXY == target_) {
+      ProxyAuthenticate* proxy_authenticate =
+          new ProxyAuthenticate(Challenge::Digest);
+      header.reset(proxy_authenticate);
+      challenge = proxy_authenticate;
+    } else {
+      WwwAuthenticate* www_authenticate =
+          new WwwAuthenticate(Challenge::Digest);
+      header.reset(www_authenticate);
+      challenge = www_authenticate;
+    }
+    challenge->set_realm(realm_);
+    challenge->set_nonce(nonce);
+    challenge->set_algorithm(*i);
+    challenge->set_qop("auth");
+    if (stale)
+      challenge->set_stale(true);
+    response->push_back(header.Pass());
+  }
+}
+
+DigestAuthenticator::Result DigestAuthenticator::Verify(
+    const scoped_refptr<Request>& request,
+    const VerifyCallback& callback) {
+  DCHECK(request);
+  // Look it up for reading only, as it may be shared.
+  const Request* const_request = request.get();
+  const Credentials* credentials =
+      net::HttpAuth::AUTH_PROXY == target_
+          ? FindCredentials<ProxyAuthorization>(const_request, realm_)
+          : FindCredentials<Authorization>(const_request, realm_);
+  if (!credentials)
+    return RESULT_NO_CREDENTIALS;
+
+  scoped_ptr<Verification> verification(new Verification);
+  verification->username = GetParam(credentials, "username");
+  verification->nonce = GetParam(credentials, "nonce");
+  verification->uri = GetParam(credentials, "uri");
+  verification->response = base::StringToLowerASCII(
+      GetParam(credentials, "response"));
+  verification->qop = GetParam(credentials, "qop");
+  verification->nc = GetParam(credentials, "nc");
+  verification->cnonce = GetParam(credentials, "cnonce");
+  std::string algorithm(GetParam(credentials, "algorithm"));
+  if (algorithm.empty())
+    algorithm = "MD5";
+  if (verification->username.empty() || verification->nonce.empty()
+      || verification->uri.empty() || verification->response.empty()
+      || !ParseAlgorithm(algorithm, &verification->hash,
+                         &verification->session))
+    return RESULT_REJECTED;
+  verification->nc_value = 0;
+  if (!verification->qop.empty()) {
+    int nc_value;
+    if ((verification->qop != "auth" && verification->qop != "auth-int")
+        || verification->cnonce.empty()
+        || !base::HexStringToInt(verification->nc, &nc_value)
+        || nc_value <= 0)
+      return RESULT_REJECTED;
+    verification->nc_value = static_cast<uint32>(nc_value);
+  } else if (verification->session) {
+    return RESULT_REJECTED;  // Session variants need a client nonce.
+  }
+  if (!CheckNonce(verification->nonce, &verification->expired))
+    return RESULT_REJECTED;
+
+  verification->method = const_request->method().str();
+  if (verification->qop == "auth-int")
+    verification->body = const_request->encoded_content();
+  verification->cache_key = verification->username;
+  verification->cache_key.append(1, '\0').append(realm_)
+                         .append(1, '\0').append(verification->nonce);
+
+  Cache::iterator it = cache_.Get(verification->cache_key);
+  if (it != cache_.end() && it->second.hash == verification->hash) {
+    const CacheEntry& entry = it->second;
+    if (entry.last_response == verification->response
+        && (verification->qop.empty()
+            || entry.last_nc == verification->nc_value))
+      return entry.last_result;  // A retransmission.
+    verification->ha1 = entry.ha1;
+    return ContinueVerify(verification.get());
+  }
+
+  // Owned by the callback from now on, which keeps it while the store
+  // works, even if this authenticator goes away.
+  Verification* pending = verification.release();
+  pending->callback = callback;
+  net::CompletionCallback on_get_ha1_complete(
+      base::Bind(&DigestAuthenticator::OnGetHA1Complete,
+                 weak_factory_.GetWeakPtr(), base::Owned(pending)));
+  int rv = credential_store_->GetHA1(pending->username, realm_,
+      pending->hash, &pending->ha1, on_get_ha1_complete);
+  if (net::ERR_IO_PENDING == rv)
+    return RESULT_PENDING;
+  if (net::OK != rv)
+    return RESULT_REJECTED;
+  return ContinueVerify(pending);
+}
+
+std::string DigestAuthenticator::CreateNonce() {
+  int64 seconds = (Now() - base::Time::UnixEpoch()).InSeconds();
+  std::string data;
+  for (int i = kNonceTimeSize - 1; i >= 0; --i)
+    data.push_back(static_cast<char>(seconds >> (i * 8)));
+  crypto::HMAC hmac(crypto::HMAC::SHA256);
+  unsigned char mac[crypto::kSHA256Length];
+  if (!hmac.Init(nonce_key_)
+      || !hmac.Sign(data + realm_, mac, sizeof(mac))) {
+    NOTREACHED();
+  }
+  data.append(reinterpret_cast<const char*>(mac), kNonceMacSize);
+  std::string nonce;
+  base::Base64Encode(data, &nonce);
+  return nonce;
+}
+
+bool DigestAuthenticator::CheckNonce(const std::string& nonce,
+                                     bool* expired) {
+  std::string data;
+  if (!base::Base64Decode(nonce, &data)
+      || data.size() != kNonceTimeSize + kNonceMacSize)
+    return false;
+  std::string time_part(data, 0, kNonceTimeSize);
+  crypto::HMAC hmac(crypto::HMAC::SHA256);
+  if (!hmac.Init(nonce_key_)
+      || !hmac.VerifyTruncated(time_part + realm_,
+                               base::StringPiece(data.data() + kNonceTimeSize,
+                                                 kNonceMacSize)))
+    return false;
+  int64 seconds = 0;
+  for (size_t i = 0; i < kNonceTimeSize; ++i)
+    seconds = (seconds << 8) | static_cast<uint8>(data[i]);
+  base::TimeDelta age =
+      Now() - base::Time::UnixEpoch() - base::TimeDelta::FromSeconds(seconds);
+  *expired = age > nonce_lifetime_ || age < base::TimeDelta();
+  return true;
+}
+
+DigestAuthenticator::Result DigestAuthenticator::ContinueVerify(
+    Verification* verification) {
+  std::string ha1(verification->ha1);
+  if (verification->session) {
+    ha1 = HashString(verification->hash, ha1 + ":" + verification->nonce
+        + ":" + verification->cnonce);
+  }
+  std::string a2(verification->method + ":" + verification->uri);
+  if (verification->qop == "auth-int")
+    a2 += ":" + HashString(verification->hash, verification->body);
+  std::string data(ha1 + ":" + verification->nonce + ":");
+  if (!verification->qop.empty()) {
+    data += verification->nc + ":" + verification->cnonce + ":"
+        + verification->qop + ":";
+  }
+  data += HashString(verification->hash, a2);
+  bool valid = HashString(verification->hash, data) == verification->response;
+
+  Result result = RESULT_REJECTED;
+  if (valid)
+    result = verification->expired ? RESULT_STALE : RESULT_AUTHORIZED;
+
+  Cache::iterator it = cache_.Peek(verification->cache_key);
+  if (it == cache_.end() || it->second.hash != verification->hash) {
+    CacheEntry entry;
+    entry.hash = verification->hash;
+    entry.ha1 = verification->ha1;
+    it = cache_.Put(verification->cache_key, entry);
+  }
+  CacheEntry& entry = it->second;
+  if (RESULT_AUTHORIZED == result && !verification->qop.empty()) {
+    if (verification->nc_value <= entry.last_nc) {
+      result = RESULT_REJECTED;  // Replayed.
+    } else {
+      entry.last_nc = verification->nc_value;
+    }
+  }
+  // Only the last response accepted is answered again, so that a replay
+  // with an old nonce count is never mistaken for a retransmission.
+  if (RESULT_REJECTED != result || entry.last_response.empty()) {
+    entry.last_response = verification->response;
+    entry.last_result = result;
+  }
+  return result;
+}
+
+void DigestAuthenticator::OnGetHA1Complete(Verification* verification,
+                                           int result) {
+  Result verify_result = RESULT_REJECTED;
+  if (net::OK == result)
+    verify_result = ContinueVerify(verification);
+  verification->callback.Run(verify_result);
+}
+
+base::Time DigestAuthenticator::Now() const {
+  return clock_ ? clock_->Now() : base::Time::Now();
+}
+
+} // namespace sippet
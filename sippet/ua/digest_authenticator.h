@@ -0,0 +1,170 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_UA_DIGEST_AUTHENTICATOR_H_
+#define SIPPET_UA_DIGEST_AUTHENTICATOR_H_
+
+#include <string>
+#include <vector>
+
+#include "base/callback.h"
+#include "base/containers/mru_cache.h"
+#include "base/memory/ref_counted.h"
+#include "base/memory/weak_ptr.h"
+#include "base/time/time.h"
+#include "net/base/completion_callback.h"
+#include "sippet/ua/auth.h"
+
+namespace base {
+class Clock;
+}
+
+namespace sippet {
+
+class Request;
+class Response;
+
+// The server side of the digest authentication (RFC 3261 section 22.4 and
+// RFC 8760), for registrars and proxies: it challenges requests and
+// verifies their credentials.
+//
+// Nonces are stateless: each one carries its creation time and an
+// HMAC-SHA256 of it and the realm, so that any authenticator sharing the
+// nonce key can check them without remembering what it issued. Expired
+// nonces are reported as stale, so that clients retry without prompting.
+//
+// The H(username:realm:password) of users come from a |CredentialStore|,
+// which may take its time. Verified credentials are cached by (username,
+// realm, nonce): retransmissions get the same result without hashing, and
+// requests reusing a nonce with a higher nonce count only hash the request
+// part. A nonce count not higher than the last accepted one is a replay.
+class DigestAuthenticator {
+ public:
+  // Where the credentials of the users are kept, such as a subscriber
+  // database.
+  class CredentialStore {
+   public:
+    virtual ~CredentialStore() {}
+
+    // Gets the H(username:realm:password) of |username| in |realm| into
+    // |*ha1|, as lowercase hex, hashed with the function named |hash|
+    // ("MD5", "SHA-256" or "SHA-512-256"). Returns OK, an error if the user
+    // is unknown, or |ERR_IO_PENDING| if |callback| will be run with the
+    // result. |ha1| is kept valid until then.
+    virtual int GetHA1(const std::string& username,
+                       const std::string& realm,
+                       const std::string& hash,
+                       std::string* ha1,
+                       const net::CompletionCallback& callback) = 0;
+  };
+
+  enum Result {
+    // The callback will be run with the result.
+    RESULT_PENDING,
+    // The credentials are valid.
+    RESULT_AUTHORIZED,
+    // The request has no credentials for the realm: challenge it.
+    RESULT_NO_CREDENTIALS,
+    // The credentials are valid, but the nonce expired: challenge it again
+    // with |stale| set.
+    RESULT_STALE,
+    // The credentials are wrong, malformed, or replayed.
+    RESULT_REJECTED,
+  };
+
+  typedef base::Callback<void(Result)> VerifyCallback;
+
+  // Default nonce lifetime.
+  static const int kDefaultNonceLifetimeSeconds = 300;
+
+  // Default number of verified credentials kept.
+  static const size_t kDefaultMaxCacheEntries = 4096;
+
+  // |target| tells whether it challenges as a server or as a proxy, and
+  // |realm| is the protection space. |credential_store| must outlive it.
+  DigestAuthenticator(Auth::Target target,
+                      const std::string& realm,
+                      CredentialStore* credential_store);
+  ~DigestAuthenticator();
+
+  const std::string& realm() const {
+    return realm_;
+  }
+
+  // The algorithms offered, in order of preference, one challenge each.
+  // Defaults to SHA-256 and then MD5, for older clients.
+  void set_algorithms(const std::vector<std::string>& algorithms) {
+    algorithms_ = algorithms;
+  }
+
+  // Time a nonce is accepted for, after being issued.
+  void set_nonce_lifetime(base::TimeDelta nonce_lifetime) {
+    nonce_lifetime_ = nonce_lifetime;
+  }
+
+  // The HMAC key signing the nonces; a random one is made on construction.
+  // Authenticators verifying each other's nonces must share it.
+  void set_nonce_key(const std::string& nonce_key) {
+    nonce_key_ = nonce_key;
+  }
+
+  // Adds the WWW-Authenticate or Proxy-Authenticate headers to |response|,
+  // one per algorithm, with a fresh nonce. |stale| tells the client that
+  // its credentials were right, but not the nonce.
+  void AddChallenges(const scoped_refptr<Response>& response, bool stale);
+
+  // Verifies the credentials of |request| for the realm. Returns the result,
+  // or |RESULT_PENDING| if |callback| will be run with it.
+  Result Verify(const scoped_refptr<Request>& request,
+                const VerifyCallback& callback);
+
+  // Sets the clock used to issue and expire nonces. Not owned.
+  void set_clock_for_testing(base::Clock* clock) {
+    clock_ = clock;
+  }
+
+ private:
+  struct Verification;
+
+  // What is kept of the credentials verified for a nonce.
+  struct CacheEntry {
+    CacheEntry();
+    ~CacheEntry();
+
+    std::string hash;
+    std::string ha1;
+    // The last nonce count accepted, and the last response seen with the
+    // result it got.
+    uint32 last_nc;
+    std::string last_response;
+    Result last_result;
+  };
+
+  typedef base::HashingMRUCache<std::string, CacheEntry> Cache;
+
+  std::string CreateNonce();
+  // Returns false if |nonce| wasn't signed with the nonce key; otherwise
+  // sets |*expired|.
+  bool CheckNonce(const std::string& nonce, bool* expired);
+
+  Result ContinueVerify(Verification* verification);
+  void OnGetHA1Complete(Verification* verification, int result);
+  base::Time Now() const;
+
+  Auth::Target target_;
+  std::string realm_;
+  CredentialStore* credential_store_;
+  std::vector<std::string> algorithms_;
+  base::TimeDelta nonce_lifetime_;
+  std::string nonce_key_;
+  Cache cache_;
+  base::Clock* clock_;
+  base::WeakPtrFactory<DigestAuthenticator> weak_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(DigestAuthenticator);
+};
+
+} // namespace sippet
+
+#endif // SIPPET_UA_DIGEST_AUTHENTICATOR_H_
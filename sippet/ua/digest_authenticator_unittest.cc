@@ -0,0 +1,213 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/ua/digest_authenticator.h"
+
+#include "base/bind.h"
+#include "base/md5.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_util.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/test/simple_test_clock.h"
+#include "crypto/sha2.h"
+#include "net/base/net_errors.h"
+#include "net/base/test_completion_callback.h"
+#include "sippet/message/headers.h"
+#include "sippet/message/request.h"
+#include "sippet/message/response.h"
+#include "sippet/message/status_code.h"
+#include "sippet/ua/auth_handler_digest.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const char kRealm[] = "atlanta.com";
+
+const char kRegister[] =
+  "REGISTER sip:atlanta.com SIP/2.0\r\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bKnashds7\r\n"
+  "Max-Forwards: 70\r\n"
+  "To: Alice <sip:alice@atlanta.com>\r\n"
+  "From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+  "Call-ID: a84b4c76e66710@pc33.atlanta.com\r\n"
+  "CSeq: 1 REGISTER\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n";
+
+class FakeCredentialStore : public DigestAuthenticator::CredentialStore {
+ public:
+  FakeCredentialStore() : async_(false), lookups_(0) {}
+  ~FakeCredentialStore() override {}
+
+  void set_async(bool async) { async_ = async; }
+  int lookups() const { return lookups_; }
+
+  int GetHA1(const std::string& username,
+             const std::string& realm,
+             const std::string& hash,
+             std::string* ha1,
+             const net::CompletionCallback& callback) override {
+    ++lookups_;
+    if (username != "alice")
+      return net::ERR_ACCESS_DENIED;
+    std::string data(username + ":" + realm + ":secret");
+    if (hash == "SHA-256") {
+      std::string digest(crypto::SHA256HashString(data));
+      *ha1 = base::StringToLowerASCII(
+          base::HexEncode(digest.data(), digest.size()));
+    } else {
+      *ha1 = base::MD5String(data);
+    }
+    if (!async_)
+      return net::OK;
+    callback_ = callback;
+    return net::ERR_IO_PENDING;
+  }
+
+  void Complete() {
+    net::CompletionCallback callback(callback_);
+    callback_.Reset();
+    callback.Run(net::OK);
+  }
+
+ private:
+  bool async_;
+  int lookups_;
+  net::CompletionCallback callback_;
+};
+
+void SaveResult(DigestAuthenticator::Result* out,
+                DigestAuthenticator::Result result) {
+  *out = result;
+}
+
+class DigestAuthenticatorTest : public testing::Test {
+ public:
+  DigestAuthenticatorTest()
+    : authenticator_(net::HttpAuth::AUTH_SERVER, kRealm, &store_) {
+    clock_.SetNow(base::Time::Now());
+    authenticator_.set_clock_for_testing(&clock_);
+  }
+
+  // Challenges a REGISTER, returning the preferred challenge.
+  scoped_ptr<WwwAuthenticate> CreateChallenge() {
+    scoped_refptr<Request> request(CreateRequest());
+    scoped_refptr<Response> response(
+        request->CreateResponse(SIP_UNAUTHORIZED));
+    authenticator_.AddChallenges(response, false);
+    return response->get<WwwAuthenticate>()->Clone();
+  }
+
+  scoped_refptr<Request> CreateRequest() {
+    return dyn_cast<Request>(Message::Parse(kRegister));
+  }
+
+  // Answers |challenge| as |username| with |password| and nonce count |nc|.
+  scoped_refptr<Request> Answer(const WwwAuthenticate& challenge,
+                                const char* username,
+                                const char* password,
+                                int nc) {
+    scoped_ptr<AuthHandler> handler;
+    EXPECT_EQ(net::OK, factory_.CreateAuthHandler(challenge,
+        net::HttpAuth::AUTH_SERVER, GURL("sip:atlanta.com:5060"),
+        AuthHandlerFactory::CREATE_CHALLENGE, nc, net::BoundNetLog(),
+        &handler));
+    scoped_refptr<Request> request(CreateRequest());
+    net::AuthCredentials credentials(base::ASCIIToUTF16(username),
+                                     base::ASCIIToUTF16(password));
+    net::TestCompletionCallback callback;
+    EXPECT_EQ(net::OK, handler->GenerateAuth(&credentials, request,
+                                             callback.callback()));
+    return request;
+  }
+
+  DigestAuthenticator::Result Verify(const scoped_refptr<Request>& request) {
+    return authenticator_.Verify(request,
+        DigestAuthenticator::VerifyCallback());
+  }
+
+  base::SimpleTestClock clock_;
+  FakeCredentialStore store_;
+  DigestAuthenticator authenticator_;
+  AuthHandlerDigest::Factory factory_;
+};
+
+}  // namespace
+
+TEST_F(DigestAuthenticatorTest, ChallengesPerAlgorithm) {
+  scoped_refptr<Response> response(
+      CreateRequest()->CreateResponse(SIP_UNAUTHORIZED));
+  authenticator_.AddChallenges(response, true);
+  Message::iterator i = response->find_first<WwwAuthenticate>();
+  ASSERT_NE(response->end(), i);
+  WwwAuthenticate* first = dyn_cast<WwwAuthenticate>(i);
+  EXPECT_EQ(kRealm, first->realm());
+  EXPECT_EQ("SHA-256", first->algorithm());
+  EXPECT_TRUE(first->stale());
+  i = response->find_next<WwwAuthenticate>(i);
+  ASSERT_NE(response->end(), i);
+  WwwAuthenticate* second = dyn_cast<WwwAuthenticate>(i);
+  EXPECT_EQ("MD5", second->algorithm());
+  EXPECT_EQ(first->nonce(), second->nonce());
+}
+
+TEST_F(DigestAuthenticatorTest, VerifiesAndCaches) {
+  EXPECT_EQ(DigestAuthenticator::RESULT_NO_CREDENTIALS,
+            Verify(CreateRequest()));
+
+  scoped_ptr<WwwAuthenticate> challenge(CreateChallenge());
+  scoped_refptr<Request> request(Answer(*challenge, "alice", "secret", 1));
+  EXPECT_EQ(DigestAuthenticator::RESULT_AUTHORIZED, Verify(request));
+  EXPECT_EQ(1, store_.lookups());
+
+  // Retransmissions and new nonce counts don't reach the store.
+  EXPECT_EQ(DigestAuthenticator::RESULT_AUTHORIZED, Verify(request));
+  scoped_refptr<Request> next(Answer(*challenge, "alice", "secret", 2));
+  EXPECT_EQ(DigestAuthenticator::RESULT_AUTHORIZED, Verify(next));
+  EXPECT_EQ(1, store_.lookups());
+
+  // Replaying an old nonce count is rejected.
+  EXPECT_EQ(DigestAuthenticator::RESULT_REJECTED, Verify(request));
+}
+
+TEST_F(DigestAuthenticatorTest, RejectsWrongCredentials) {
+  scoped_ptr<WwwAuthenticate> challenge(CreateChallenge());
+  EXPECT_EQ(DigestAuthenticator::RESULT_REJECTED,
+            Verify(Answer(*challenge, "alice", "guess", 1)));
+  EXPECT_EQ(DigestAuthenticator::RESULT_REJECTED,
+            Verify(Answer(*challenge, "mallory", "secret", 1)));
+
+  // Nonces signed with another key are rejected too.
+  DigestAuthenticator other(net::HttpAuth::AUTH_SERVER, kRealm, &store_);
+  scoped_refptr<Response> response(
+      CreateRequest()->CreateResponse(SIP_UNAUTHORIZED));
+  other.AddChallenges(response, false);
+  EXPECT_EQ(DigestAuthenticator::RESULT_REJECTED,
+            Verify(Answer(*response->get<WwwAuthenticate>(), "alice",
+                          "secret", 1)));
+}
+
+TEST_F(DigestAuthenticatorTest, ExpiredNonceIsStale) {
+  scoped_ptr<WwwAuthenticate> challenge(CreateChallenge());
+  clock_.Advance(base::TimeDelta::FromSeconds(
+      DigestAuthenticator::kDefaultNonceLifetimeSeconds + 1));
+  EXPECT_EQ(DigestAuthenticator::RESULT_STALE,
+            Verify(Answer(*challenge, "alice", "secret", 1)));
+}
+
+TEST_F(DigestAuthenticatorTest, AsyncCredentialStore) {
+  store_.set_async(true);
+  scoped_ptr<WwwAuthenticate> challenge(CreateChallenge());
+  DigestAuthenticator::Result result = DigestAuthenticator::RESULT_PENDING;
+  EXPECT_EQ(DigestAuthenticator::RESULT_PENDING,
+            authenticator_.Verify(Answer(*challenge, "alice", "secret", 1),
+                                  base::Bind(&SaveResult, &result)));
+  EXPECT_EQ(DigestAuthenticator::RESULT_PENDING, result);
+  store_.Complete();
+  EXPECT_EQ(DigestAuthenticator::RESULT_AUTHORIZED, result);
+}
+
+} // namespace sippet
@@ -0,0 +1,212 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/ua/dispatcher.h"
+
+#include "base/bind.h"
+#include "base/logging.h"
+#include "net/base/completion_callback.h"
+#include "net/base/net_errors.h"
+#include "sippet/message/headers.h"
+#include "sippet/message/request.h"
+#include "sippet/message/response.h"
+
+namespace sippet {
+
+Dispatcher::Backend::Backend()
+  : failures(0) {
+}
+
+Dispatcher::Backend::~Backend() {
+}
+
+Dispatcher::Dispatcher(ua::UserAgent *user_agent,
+                       NetworkLayer *network_layer,
+                       const GURL &local_uri)
+  : user_agent_(user_agent),
+    network_layer_(network_layer),
+    local_uri_(local_uri),
+    hash_key_(HASH_CALL_ID),
+    check_interval_(
+        base::TimeDelta::FromSeconds(kDefaultCheckIntervalSeconds)),
+    max_failures_(kDefaultMaxFailures),
+    check_timer_(user_agent->timer_wheel()) {
+  DCHECK(user_agent);
+  DCHECK(network_layer);
+}
+
+Dispatcher::~Dispatcher() {
+}
+
+bool Dispatcher::AddBackend(const GURL &uri) {
+  if (!ring_.Add(uri.spec()))
+    return false;
+  Backend &backend = backends_[uri.spec()];
+  backend.uri = uri;
+  backend.next_hop = EndPoint::FromGURL(uri);
+  if (!check_timer_.IsRunning())
+    ScheduleChecks();
+  return true;
+}
+
+bool Dispatcher::RemoveBackend(const GURL &uri) {
+  if (!ring_.Remove(uri.spec()))
+    return false;
+  backends_.erase(uri.spec());
+  if (backends_.empty())
+    check_timer_.Stop();
+  return true;
+}
+
+bool Dispatcher::IsBackendUp(const GURL &uri) const {
+  return ring_.IsUp(uri.spec());
+}
+
+GURL Dispatcher::SelectBackend(const Request &request) const {
+  const std::string *node = ring_.Find(GetKey(request));
+  if (!node)
+    return GURL();
+  BackendMap::const_iterator i = backends_.find(*node);
+  DCHECK(backends_.end() != i);
+  return i->second.uri;
+}
+
+bool Dispatcher::HandleStatelessRequest(
+    const scoped_refptr<Request> &request) {
+  const std::string *node = ring_.Find(GetKey(*request));
+  if (!node) {
+    DVLOG(1) << "No backend up for " << request->method().str();
+    Reply(request, SIP_SERVICE_UNAVAILABLE);
+    return true;
+  }
+  BackendMap::iterator i = backends_.find(*node);
+  DCHECK(backends_.end() != i);
+  int rv = network_layer_->ForwardRequestToNextHop(request,
+      i->second.next_hop, net::CompletionCallback());
+  if (net::ERR_TOO_MANY_REDIRECTS == rv) {
+    Reply(request, SIP_TOO_MANY_HOPS);
+  } else if (net::OK != rv && net::ERR_IO_PENDING != rv) {
+    DVLOG(1) << "Failed to forward to " << *node << ": "
+             << net::ErrorToString(rv);
+  }
+  return true;
+}
+
+void Dispatcher::OnChannelConnected(const EndPoint &destination, int err) {
+  // Nothing to do
+}
+
+void Dispatcher::OnChannelClosed(const EndPoint &destination) {
+  // Nothing to do
+}
+
+void Dispatcher::OnIncomingRequest(
+    const scoped_refptr<Request> &incoming_request,
+    const scoped_refptr<Dialog> &dialog) {
+  // Nothing to do
+}
+
+void Dispatcher::OnIncomingResponse(
+    const scoped_refptr<Response> &incoming_response,
+    const scoped_refptr<Dialog> &dialog) {
+  if (!incoming_response->refer_to())
+    return;
+  Backend *backend = GetCheckedBackend(*incoming_response->refer_to());
+  if (!backend)
+    return;
+  if (SIP_SERVICE_UNAVAILABLE == incoming_response->response_code())
+    CheckFailed(backend);
+  else
+    CheckSucceeded(backend);
+}
+
+void Dispatcher::OnTimedOut(
+    const scoped_refptr<Request> &request,
+    const scoped_refptr<Dialog> &dialog) {
+  Backend *backend = GetCheckedBackend(*request);
+  if (backend)
+    CheckFailed(backend);
+}
+
+void Dispatcher::OnTransportError(
+    const scoped_refptr<Request> &request, int error,
+    const scoped_refptr<Dialog> &dialog) {
+  Backend *backend = GetCheckedBackend(*request);
+  if (backend)
+    CheckFailed(backend);
+}
+
+base::StringPiece Dispatcher::GetKey(const Request &request) const {
+  if (HASH_FROM_TAG == hash_key_) {
+    const From *from = request.get<From>();
+    if (from && from->HasTag())
+      return from->tag();
+  }
+  const CallId *call_id = request.get<CallId>();
+  if (call_id)
+    return call_id->value();
+  return base::StringPiece();
+}
+
+void Dispatcher::OnCheckTimer() {
+  // All backends are checked at once, so that a single timer is running.
+  for (BackendMap::iterator i = backends_.begin(), ie = backends_.end();
+       i != ie; ++i) {
+    Backend *backend = &i->second;
+    if (!backend->check_id.empty())
+      CheckFailed(backend);  // Unanswered since the previous tick
+    scoped_refptr<Request> request(user_agent_->CreateRequest(
+        Method::OPTIONS, backend->uri, local_uri_, backend->uri));
+    backend->check_id = request->id();
+    int rv = user_agent_->Send(request, net::CompletionCallback());
+    if (net::OK != rv && net::ERR_IO_PENDING != rv)
+      CheckFailed(backend);
+  }
+  ScheduleChecks();
+}
+
+void Dispatcher::ScheduleChecks() {
+  check_timer_.Start(check_interval_,
+      base::Bind(&Dispatcher::OnCheckTimer, base::Unretained(this)));
+}
+
+Dispatcher::Backend *Dispatcher::GetCheckedBackend(const Request &request) {
+  if (Method::OPTIONS != request.method())
+    return NULL;
+  for (BackendMap::iterator i = backends_.begin(), ie = backends_.end();
+       i != ie; ++i) {
+    if (i->second.check_id == request.id())
+      return &i->second;
+  }
+  return NULL;
+}
+
+void Dispatcher::CheckSucceeded(Backend *backend) {
+  backend->check_id.clear();
+  backend->failures = 0;
+  if (!ring_.IsUp(backend->uri.spec())) {
+    LOG(INFO) << "Backend " << backend->uri.spec() << " is up";
+    ring_.SetUp(backend->uri.spec(), true);
+  }
+}
+
+void Dispatcher::CheckFailed(Backend *backend) {
+  backend->check_id.clear();
+  if (++backend->failures < max_failures_
+      || !ring_.IsUp(backend->uri.spec()))
+    return;
+  LOG(WARNING) << "Backend " << backend->uri.spec() << " is down";
+  ring_.SetUp(backend->uri.spec(), false);
+}
+
+void Dispatcher::Reply(const scoped_refptr<Request> &request,
+                       StatusCode code) {
+  // ACKs are never answered.
+  if (Method::ACK == request->method())
+    return;
+  network_layer_->Send(request->CreateResponse(code),
+                       net::CompletionCallback());
+}
+
+} // namespace sippet
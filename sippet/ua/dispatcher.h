@@ -0,0 +1,144 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_UA_DISPATCHER_H_
+#define SIPPET_UA_DISPATCHER_H_
+
+#include <map>
+#include <string>
+
+#include "base/time/time.h"
+#include "sippet/message/status_code.h"
+#include "sippet/transport/end_point.h"
+#include "sippet/transport/network_layer.h"
+#include "sippet/transport/timer_wheel.h"
+#include "sippet/ua/hash_ring.h"
+#include "sippet/ua/ua_user_agent.h"
+#include "url/gurl.h"
+
+namespace sippet {
+
+// Distributes the incoming requests over a set of backend servers, acting as
+// the |NetworkLayer::StatelessDelegate| of a stateless proxy: no transaction
+// nor dialog state is kept, and responses go back through the |Via|s.
+//
+// Backends are picked by consistent hashing (see |HashRing|) of the Call-ID
+// or, optionally, of the From tag, so that all the requests of a call reach
+// the same backend without sharing any session state, and adding or
+// removing a backend only moves the calls it takes or leaves. Hashing on the
+// From tag only keeps the requests sent by the caller together.
+//
+// Backends are checked with an OPTIONS request each |check_interval|, all of
+// them from the same tick of the |UserAgent| timers. Any answer but a 503
+// (Service Unavailable) keeps a backend up; |max_failures| consecutive
+// checks unanswered before the next one, timed out or failed mark it down,
+// and its calls go to the next backends of the ring until it answers again.
+// Requests are answered statelessly with a 503 when all backends are down.
+class Dispatcher : public NetworkLayer::StatelessDelegate,
+                   public ua::UserAgent::Delegate {
+ public:
+  enum HashKey {
+    HASH_CALL_ID,
+    HASH_FROM_TAG,
+  };
+
+  // Default interval between the checks of the backends, in seconds.
+  static const int kDefaultCheckIntervalSeconds = 10;
+
+  // Default number of consecutive failed checks marking a backend down.
+  static const int kDefaultMaxFailures = 2;
+
+  // |user_agent| sends the checks, from |local_uri|, and |network_layer|
+  // forwards the requests; the dispatcher must be set as the stateless
+  // delegate of the latter, and as a handler of the former. Neither is
+  // owned, and both must outlive it.
+  Dispatcher(ua::UserAgent *user_agent,
+             NetworkLayer *network_layer,
+             const GURL &local_uri);
+  ~Dispatcher() override;
+
+  void set_hash_key(HashKey hash_key) { hash_key_ = hash_key; }
+  void set_check_interval(const base::TimeDelta &check_interval) {
+    check_interval_ = check_interval;
+  }
+  void set_max_failures(int max_failures) { max_failures_ = max_failures; }
+
+  // Adds a backend, taken as up until checked, to which requests are sent
+  // regardless of their Request-URI and Route. Returns false if it's
+  // already there.
+  bool AddBackend(const GURL &uri);
+
+  // Removes a backend; its calls go to the next backends of the ring.
+  // Returns false if it's unknown.
+  bool RemoveBackend(const GURL &uri);
+
+  bool IsBackendUp(const GURL &uri) const;
+
+  // The up backend that gets |request|, or an empty URL if none is.
+  GURL SelectBackend(const Request &request) const;
+
+  // NetworkLayer::StatelessDelegate methods:
+  bool HandleStatelessRequest(const scoped_refptr<Request> &request) override;
+
+  // ua::UserAgent::Delegate methods:
+  void OnChannelConnected(const EndPoint &destination, int err) override;
+  void OnChannelClosed(const EndPoint &destination) override;
+  void OnIncomingRequest(
+      const scoped_refptr<Request> &incoming_request,
+      const scoped_refptr<Dialog> &dialog) override;
+  void OnIncomingResponse(
+      const scoped_refptr<Response> &incoming_response,
+      const scoped_refptr<Dialog> &dialog) override;
+  void OnTimedOut(
+      const scoped_refptr<Request> &request,
+      const scoped_refptr<Dialog> &dialog) override;
+  void OnTransportError(
+      const scoped_refptr<Request> &request, int error,
+      const scoped_refptr<Dialog> &dialog) override;
+
+ private:
+  struct Backend {
+    Backend();
+    ~Backend();
+
+    GURL uri;
+    EndPoint next_hop;
+    // Id of the last check sent, until answered or failed.
+    std::string check_id;
+    int failures;
+  };
+
+  // Keyed by the spec of the backend URI, as in |ring_|.
+  typedef std::map<std::string, Backend> BackendMap;
+
+  base::StringPiece GetKey(const Request &request) const;
+
+  // Sends the checks of all backends, and schedules the next ones.
+  void OnCheckTimer();
+  void ScheduleChecks();
+
+  // The backend whose last check is |request|, if any.
+  Backend *GetCheckedBackend(const Request &request);
+  void CheckSucceeded(Backend *backend);
+  void CheckFailed(Backend *backend);
+
+  // Answers |request| without a transaction.
+  void Reply(const scoped_refptr<Request> &request, StatusCode code);
+
+  ua::UserAgent *user_agent_;
+  NetworkLayer *network_layer_;
+  GURL local_uri_;
+  HashKey hash_key_;
+  base::TimeDelta check_interval_;
+  int max_failures_;
+  BackendMap backends_;
+  HashRing ring_;
+  TimerWheel::Timer check_timer_;
+
+  DISALLOW_COPY_AND_ASSIGN(Dispatcher);
+};
+
+} // namespace sippet
+
+#endif // SIPPET_UA_DISPATCHER_H_
@@ -0,0 +1,304 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/ua/fork_context.h"
+
+#include "base/basictypes.h"
+#include "base/logging.h"
+#include "net/base/completion_callback.h"
+#include "net/base/net_errors.h"
+#include "sippet/message/headers.h"
+#include "sippet/message/request.h"
+#include "sippet/message/response.h"
+#include "sippet/message/status_code.h"
+#include "sippet/ua/ua_user_agent.h"
+
+namespace sippet {
+namespace ua {
+
+namespace {
+
+// Max-Forwards of forwarded requests without one (RFC 3261 section 16.6).
+const unsigned kDefaultMaxForwards = 70;
+
+// Headers of the incoming request copied to the branch requests, the
+// Max-Forwards being decremented instead.
+bool IsForwardedRequestHeader(const Header &header) {
+  return Header::HDR_MAX_FORWARDS != header.type();
+}
+
+// Headers of the branch responses copied to the upstream responses.
+bool IsForwardedResponseHeader(const Header &header) {
+  return Header::HDR_VIA != header.type();
+}
+
+// RFC 3261 section 16.7, step 6: 6xx responses are preferred, and then the
+// lowest response class.
+bool IsBetterResponse(int response_code, int best_response_code) {
+  if (0 == best_response_code)
+    return true;
+  if (6 == best_response_code / 100)
+    return false;
+  if (6 == response_code / 100)
+    return true;
+  return response_code / 100 < best_response_code / 100;
+}
+
+}  // namespace
+
+ForkContext::Branch::Branch(const GURL &target)
+  : target(target), state(BRANCH_IDLE), cancelled(false) {
+}
+
+ForkContext::Branch::~Branch() {
+}
+
+ForkContext::ForkContext(UserAgent *user_agent,
+                         const scoped_refptr<Request> &incoming_request,
+                         const std::vector<GURL> &targets,
+                         Mode mode)
+  : user_agent_(user_agent),
+    incoming_request_(incoming_request),
+    mode_(mode),
+    best_response_code_(0),
+    stopped_(false),
+    cancelled_(false),
+    final_response_sent_(false),
+    complete_(false) {
+  DCHECK(user_agent);
+  DCHECK(incoming_request);
+  const Request *const_request = incoming_request.get();
+  const Via *via = const_request->get<Via>();
+  if (via && !via->empty() && via->front().HasBranch())
+    key_ = via->front().branch();
+  else
+    key_ = incoming_request->id();
+  for (std::vector<GURL>::const_iterator i = targets.begin(),
+       ie = targets.end(); i != ie; ++i)
+    branches_.push_back(new Branch(*i));
+}
+
+ForkContext::~ForkContext() {
+}
+
+void ForkContext::Start() {
+  const Request *const_request = incoming_request_.get();
+  const MaxForwards *max_forwards = const_request->get<MaxForwards>();
+  if (max_forwards && 0 == max_forwards->value()) {
+    // RFC 3261 section 16.3, step 3.
+    best_response_code_ = SIP_TOO_MANY_HOPS;
+    CancelBranches();
+  }
+  StartBranches();
+  MaybeComplete();
+}
+
+void ForkContext::HandleResponse(const scoped_refptr<Response> &response) {
+  const scoped_refptr<Request> &request = response->refer_to();
+  if (!request || Method::CANCEL == request->method())
+    return;
+  Branch *branch = FindBranch(request->id());
+  if (!branch)
+    return;
+  int response_code = response->response_code();
+  if (response_code < 200) {
+    if (BRANCH_TRYING == branch->state) {
+      branch->state = BRANCH_PROCEEDING;
+      if (branch->cancelled)
+        SendCancel(branch);
+    }
+    if (response_code > 100 && !final_response_sent_)
+      SendUpstream(CreateUpstreamResponse(response));
+    return;
+  }
+  if (2 == response_code / 100) {
+    // All 2xx are sent upstream, including those of other forks of the
+    // same branch, each confirming its own dialog.
+    branch->state = BRANCH_COMPLETED;
+    final_response_sent_ = true;
+    SendUpstream(CreateUpstreamResponse(response));
+    CancelBranches();
+    MaybeComplete();
+    return;
+  }
+  if (BRANCH_COMPLETED == branch->state)
+    return;
+  CompleteBranch(branch, response, response_code);
+  if (6 == response_code / 100)
+    CancelBranches();
+  StartBranches();
+  MaybeComplete();
+}
+
+void ForkContext::HandleError(const std::string &request_id, int error) {
+  Branch *branch = FindBranch(request_id);
+  if (!branch || BRANCH_COMPLETED == branch->state)
+    return;
+  // RFC 3261 section 16.7, step 6: a timeout counts as a 408, and network
+  // errors as a 503 (section 16.9).
+  CompleteBranch(branch, nullptr, net::ERR_TIMED_OUT == error
+      ? SIP_REQUEST_TIMEOUT : SIP_SERVICE_UNAVAILABLE);
+  StartBranches();
+  MaybeComplete();
+}
+
+void ForkContext::Cancel() {
+  cancelled_ = true;
+  CancelBranches();
+  MaybeComplete();
+}
+
+ForkContext::Branch *ForkContext::FindBranch(const std::string &request_id) {
+  for (ScopedVector<Branch>::iterator i = branches_.begin(),
+       ie = branches_.end(); i != ie; ++i) {
+    if ((*i)->request && (*i)->request->id() == request_id)
+      return *i;
+  }
+  return nullptr;
+}
+
+void ForkContext::StartBranches() {
+  for (ScopedVector<Branch>::iterator i = branches_.begin(),
+       ie = branches_.end(); i != ie && !stopped_; ++i) {
+    Branch *branch = *i;
+    if (BRANCH_IDLE != branch->state) {
+      if (SEQUENTIAL == mode_ && BRANCH_COMPLETED != branch->state)
+        return;
+      continue;
+    }
+    if (StartBranch(branch) && SEQUENTIAL == mode_)
+      return;
+  }
+}
+
+bool ForkContext::StartBranch(Branch *branch) {
+  branch->request = CreateBranchRequest(branch->target);
+  branch->state = BRANCH_TRYING;
+  sent_requests_.push_back(branch->request);
+  int rv = user_agent_->SendForkRequest(this, branch->request);
+  if (net::OK == rv || net::ERR_IO_PENDING == rv)
+    return true;
+  DVLOG(1) << "Couldn't fork to " << branch->target.spec() << ": "
+           << net::ErrorToString(rv);
+  CompleteBranch(branch, nullptr, SIP_SERVICE_UNAVAILABLE);
+  return false;
+}
+
+scoped_refptr<Request> ForkContext::CreateBranchRequest(
+    const GURL &target) const {
+  const Request *const_request = incoming_request_.get();
+  scoped_refptr<Request> request(
+      new Request(const_request->method(), target));
+  const_request->ShareIf(request.get(), IsForwardedRequestHeader);
+  const MaxForwards *max_forwards = const_request->get<MaxForwards>();
+  scoped_ptr<MaxForwards> new_max_forwards(new MaxForwards(
+      max_forwards ? max_forwards->value() - 1 : kDefaultMaxForwards));
+  request->push_back(new_max_forwards.Pass());
+  if (const_request->has_content())
+    request->set_content(const_request->shared_content());
+  return request;
+}
+
+void ForkContext::CancelBranch(Branch *branch) {
+  if (branch->cancelled)
+    return;
+  branch->cancelled = true;
+  if (BRANCH_IDLE == branch->state)
+    branch->state = BRANCH_COMPLETED;
+  else if (BRANCH_PROCEEDING == branch->state)
+    SendCancel(branch);
+}
+
+void ForkContext::CancelBranches() {
+  stopped_ = true;
+  for (ScopedVector<Branch>::iterator i = branches_.begin(),
+       ie = branches_.end(); i != ie; ++i)
+    CancelBranch(*i);
+}
+
+void ForkContext::SendCancel(Branch *branch) {
+  scoped_refptr<Request> cancel;
+  if (net::OK != branch->request->CreateCancel(cancel))
+    return;
+  sent_requests_.push_back(cancel);
+  ignore_result(user_agent_->SendForkRequest(this, cancel));
+}
+
+void ForkContext::CompleteBranch(Branch *branch,
+                                 const scoped_refptr<Response> &response,
+                                 int response_code) {
+  branch->state = BRANCH_COMPLETED;
+  if (SIP_UNAUTHORIZED == response_code
+      || SIP_PROXY_AUTHENTICATION_REQUIRED == response_code)
+    challenges_.push_back(response);
+  if (IsBetterResponse(response_code, best_response_code_)) {
+    best_response_ = response;
+    best_response_code_ = response_code;
+  }
+}
+
+void ForkContext::MaybeComplete() {
+  if (complete_)
+    return;
+  for (ScopedVector<Branch>::const_iterator i = branches_.begin(),
+       ie = branches_.end(); i != ie; ++i) {
+    if (BRANCH_COMPLETED != (*i)->state)
+      return;
+  }
+  complete_ = true;
+  if (final_response_sent_)
+    return;
+  final_response_sent_ = true;
+  if (SIP_SERVICE_UNAVAILABLE == best_response_code_) {
+    // RFC 3261 section 16.7, step 6: the 503 would make the upstream
+    // elements try another server, while it's just this one failing.
+    best_response_ = nullptr;
+    best_response_code_ = SIP_SERVER_INTERNAL_ERROR;
+  } else if (0 == best_response_code_) {
+    best_response_code_ = cancelled_
+        ? SIP_REQUEST_TERMINATED : SIP_REQUEST_TIMEOUT;
+  }
+  if (!best_response_) {
+    SendUpstream(incoming_request_->CreateResponse(
+        static_cast<StatusCode>(best_response_code_)));
+    return;
+  }
+  scoped_refptr<Response> response(CreateUpstreamResponse(best_response_));
+  // RFC 3261 section 16.7, step 7: all challenges go upstream.
+  for (std::vector<scoped_refptr<Response> >::const_iterator i =
+       challenges_.begin(), ie = challenges_.end(); i != ie; ++i) {
+    if (*i == best_response_)
+      continue;
+    const Response *challenge = i->get();
+    challenge->ShareTo<WwwAuthenticate>(response.get());
+    challenge->ShareTo<ProxyAuthenticate>(response.get());
+  }
+  SendUpstream(response);
+}
+
+scoped_refptr<Response> ForkContext::CreateUpstreamResponse(
+    const scoped_refptr<Response> &response) const {
+  scoped_refptr<Response> upstream_response(new Response(
+      response->response_code(), response->reason_phrase(),
+      Message::Outgoing));
+  upstream_response->set_refer_to(incoming_request_);
+  const Request *const_request = incoming_request_.get();
+  const_request->ShareTo<Via>(upstream_response.get());
+  const Response *const_response = response.get();
+  const_response->ShareIf(upstream_response.get(), IsForwardedResponseHeader);
+  if (const_response->has_content())
+    upstream_response->set_content(const_response->shared_content());
+  return upstream_response;
+}
+
+void ForkContext::SendUpstream(const scoped_refptr<Response> &response) {
+  int rv = user_agent_->Send(response, net::CompletionCallback());
+  if (net::OK != rv && net::ERR_IO_PENDING != rv) {
+    DVLOG(1) << "Couldn't send the fork response upstream: "
+             << net::ErrorToString(rv);
+  }
+}
+
+} // namespace ua
+} // namespace sippet
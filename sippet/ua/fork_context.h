@@ -0,0 +1,159 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_UA_FORK_CONTEXT_H_
+#define SIPPET_UA_FORK_CONTEXT_H_
+
+#include <string>
+#include <vector>
+
+#include "base/memory/ref_counted.h"
+#include "base/memory/scoped_vector.h"
+#include "url/gurl.h"
+
+namespace sippet {
+
+class Request;
+class Response;
+
+namespace ua {
+
+class UserAgent;
+
+// Forks an incoming request to several targets, as a stateful proxy does
+// (RFC 3261 section 16.7), each branch being an outgoing request of its own
+// client transaction. Provisional and 2xx responses are sent upstream as
+// they arrive, so that each fork gets its own early and confirmed dialogs;
+// other final responses are held until all branches complete, and only the
+// best one is sent upstream.
+//
+// The first 2xx or 6xx cancels the other branches, and so does a CANCEL of
+// the incoming request. Branches that haven't received a provisional
+// response yet are cancelled once they do (RFC 3261 section 9.1).
+//
+// Branch requests share the headers of the incoming request until changed
+// (see |Message::ShareTo|), instead of copying them once per target. The
+// |Via| headers of the incoming request are kept, for the next hops to
+// detect loops, and the |NetworkLayer| stamps its own on top of them (see
+// |NetworkLayer::SendProxiedRequest|); responses sent upstream get the ones
+// of the incoming request back.
+//
+// Fork contexts are created and owned by the |UserAgent| (see
+// |UserAgent::Fork|). The |Route| headers are forwarded unchanged: the
+// entries referring to this proxy must be removed before forking.
+class ForkContext {
+ public:
+  enum Mode {
+    // All targets are tried at once.
+    PARALLEL,
+    // Targets are tried in order, the next one after a non-2xx final
+    // response other than 6xx.
+    SEQUENTIAL,
+  };
+
+  ForkContext(UserAgent *user_agent,
+              const scoped_refptr<Request> &incoming_request,
+              const std::vector<GURL> &targets,
+              Mode mode);
+  ~ForkContext();
+
+  // The topmost |Via| branch of the incoming request, which its CANCEL
+  // shares, or its id when there's none.
+  const std::string &key() const { return key_; }
+
+  const scoped_refptr<Request> &incoming_request() const {
+    return incoming_request_;
+  }
+
+  // All requests sent by the fork: branch requests and their CANCELs.
+  const std::vector<scoped_refptr<Request> > &sent_requests() const {
+    return sent_requests_;
+  }
+
+  // A fork is complete once a final response was sent upstream and no
+  // branch can change anything else.
+  bool is_complete() const { return complete_; }
+
+  // Sends the first branches.
+  void Start();
+
+  // Handles a response to one of the |sent_requests|.
+  void HandleResponse(const scoped_refptr<Response> &response);
+
+  // Handles a timeout or a network error of one of the |sent_requests|.
+  void HandleError(const std::string &request_id, int error);
+
+  // Cancels all branches, as asked by a CANCEL of the incoming request.
+  void Cancel();
+
+ private:
+  enum BranchState {
+    BRANCH_IDLE,
+    BRANCH_TRYING,
+    BRANCH_PROCEEDING,
+    BRANCH_COMPLETED,
+  };
+
+  struct Branch {
+    explicit Branch(const GURL &target);
+    ~Branch();
+
+    GURL target;
+    // NULL until sent.
+    scoped_refptr<Request> request;
+    BranchState state;
+    // Branches cancelled before getting a provisional response send their
+    // CANCEL once they do.
+    bool cancelled;
+  };
+
+  Branch *FindBranch(const std::string &request_id);
+
+  // Sends the idle branches: all of them, or the next one that can be sent,
+  // depending on the |Mode|.
+  void StartBranches();
+  bool StartBranch(Branch *branch);
+  scoped_refptr<Request> CreateBranchRequest(const GURL &target) const;
+
+  void CancelBranch(Branch *branch);
+  void CancelBranches();
+  void SendCancel(Branch *branch);
+
+  // Completes |branch| with a final response, or with a synthesized
+  // |response_code| when |response| is NULL.
+  void CompleteBranch(Branch *branch,
+                      const scoped_refptr<Response> &response,
+                      int response_code);
+
+  // Sends the best final response upstream once no branch is pending.
+  void MaybeComplete();
+
+  scoped_refptr<Response> CreateUpstreamResponse(
+      const scoped_refptr<Response> &response) const;
+  void SendUpstream(const scoped_refptr<Response> &response);
+
+  UserAgent *user_agent_;
+  scoped_refptr<Request> incoming_request_;
+  std::string key_;
+  Mode mode_;
+  ScopedVector<Branch> branches_;
+  std::vector<scoped_refptr<Request> > sent_requests_;
+  // The best final response so far, or NULL if synthesized.
+  scoped_refptr<Response> best_response_;
+  int best_response_code_;
+  // The 401 and 407 responses, whose challenges are all sent upstream.
+  std::vector<scoped_refptr<Response> > challenges_;
+  // Set once no more branches are to be started.
+  bool stopped_;
+  bool cancelled_;
+  bool final_response_sent_;
+  bool complete_;
+
+  DISALLOW_COPY_AND_ASSIGN(ForkContext);
+};
+
+} // namespace ua
+} // namespace sippet
+
+#endif // SIPPET_UA_FORK_CONTEXT_H_
@@ -0,0 +1,259 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/ua/fork_context.h"
+
+#include <vector>
+
+#include "net/base/net_errors.h"
+#include "sippet/message/headers.h"
+#include "sippet/message/request.h"
+#include "sippet/message/response.h"
+#include "sippet/message/status_code.h"
+#include "sippet/test/simulation/simulated_network.h"
+#include "sippet/test/simulation/simulated_peer.h"
+#include "sippet/transport/network_layer.h"
+#include "sippet/transport/network_settings.h"
+#include "sippet/ua/auth_handler_digest.h"
+#include "sippet/ua/dialog_controller.h"
+#include "sippet/ua/password_handler.h"
+#include "sippet/ua/ua_user_agent.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+namespace ua {
+
+namespace {
+
+const char kCallerAddress[] = "10.0.0.1:5060/UDP";
+const char kProxyAddress[] = "10.0.0.2:5060/UDP";
+const char kFirstCalleeAddress[] = "10.0.0.3:5060/UDP";
+const char kSecondCalleeAddress[] = "10.0.0.4:5060/UDP";
+
+// The proxy never answers challenges.
+class NullPasswordHandlerFactory : public PasswordHandler::Factory {
+ public:
+  scoped_ptr<PasswordHandler> CreatePasswordHandler() override {
+    return scoped_ptr<PasswordHandler>();
+  }
+};
+
+// Forks the incoming INVITEs to both callees.
+class ForkingDelegate : public UserAgent::Delegate {
+ public:
+  ForkingDelegate() : user_agent_(nullptr), mode_(ForkContext::PARALLEL) {}
+
+  void Initialize(UserAgent *user_agent, ForkContext::Mode mode) {
+    user_agent_ = user_agent;
+    mode_ = mode;
+  }
+
+  // UserAgent::Delegate methods:
+  void OnChannelConnected(const EndPoint &destination, int err) override {}
+  void OnChannelClosed(const EndPoint &destination) override {}
+  void OnIncomingRequest(const scoped_refptr<Request> &request,
+                         const scoped_refptr<Dialog> &dialog) override {
+    if (Method::INVITE != request->method())
+      return;
+    std::vector<GURL> targets;
+    targets.push_back(GURL("sip:10.0.0.3"));
+    targets.push_back(GURL("sip:10.0.0.4"));
+    EXPECT_EQ(net::OK, user_agent_->Fork(request, targets, mode_));
+  }
+  void OnIncomingResponse(const scoped_refptr<Response> &response,
+                          const scoped_refptr<Dialog> &dialog) override {}
+  void OnTimedOut(const scoped_refptr<Request> &request,
+                  const scoped_refptr<Dialog> &dialog) override {}
+  void OnTransportError(const scoped_refptr<Request> &request, int error,
+                        const scoped_refptr<Dialog> &dialog) override {}
+
+ private:
+  UserAgent *user_agent_;
+  ForkContext::Mode mode_;
+};
+
+// Number of Via values of |message|, over all of its Via headers.
+size_t CountVias(const Message &message) {
+  size_t count = 0;
+  for (Message::const_iterator i = message.find_first<Via>(),
+       ie = message.end(); i != ie; i = message.find_next<Via>(i))
+    count += dyn_cast<Via>(i)->size();
+  return count;
+}
+
+std::string GetTopmostBranch(const Message &message) {
+  const Via *via = message.get<Via>();
+  return via && !via->empty() ? via->front().branch() : std::string();
+}
+
+} // namespace
+
+class ForkContextTest : public testing::Test {
+ public:
+  void Initialize(ForkContext::Mode mode) {
+    network_.reset(new SimulatedNetwork);
+    caller_.reset(new SimulatedPeer(network_.get(), kCallerAddress));
+    first_callee_.reset(
+        new SimulatedPeer(network_.get(), kFirstCalleeAddress));
+    second_callee_.reset(
+        new SimulatedPeer(network_.get(), kSecondCalleeAddress));
+    user_agent_.reset(new UserAgent(&auth_handler_factory_,
+        &password_handler_factory_,
+        DialogController::GetDefaultDialogController(), net::BoundNetLog()));
+    delegate_.Initialize(user_agent_.get(), mode);
+    user_agent_->AppendHandler(&delegate_);
+    NetworkSettings settings;
+    network_->ApplyTo(&settings);
+    proxy_.reset(new NetworkLayer(user_agent_.get(), settings));
+    user_agent_->SetNetworkLayer(proxy_.get());
+    network_->AddNode(EndPoint::FromString(kProxyAddress), proxy_.get());
+  }
+
+  void TearDown() override {
+    proxy_.reset();
+    user_agent_.reset();
+    first_callee_.reset();
+    second_callee_.reset();
+    caller_.reset();
+    network_.reset();
+  }
+
+  // Sends an INVITE from the caller to the proxy.
+  scoped_refptr<Request> SendInvite() {
+    scoped_refptr<Request> invite(
+        caller_->CreateRequest(Method::INVITE, GURL("sip:10.0.0.2")));
+    int rv = caller_->Send(invite);
+    EXPECT_TRUE(net::OK == rv || net::ERR_IO_PENDING == rv);
+    return invite;
+  }
+
+  size_t CountForks() {
+    UserAgent::Introspection introspection;
+    user_agent_->Introspect(&introspection);
+    return introspection.forks;
+  }
+
+  void RunFor(int milliseconds) {
+    network_->RunFor(base::TimeDelta::FromMilliseconds(milliseconds));
+  }
+
+ protected:
+  AuthHandlerDigest::Factory auth_handler_factory_;
+  NullPasswordHandlerFactory password_handler_factory_;
+  ForkingDelegate delegate_;
+  scoped_ptr<SimulatedNetwork> network_;
+  scoped_ptr<SimulatedPeer> caller_;
+  scoped_ptr<SimulatedPeer> first_callee_;
+  scoped_ptr<SimulatedPeer> second_callee_;
+  scoped_ptr<UserAgent> user_agent_;
+  scoped_ptr<NetworkLayer> proxy_;
+};
+
+TEST_F(ForkContextTest, BranchesKeepUpstreamVias) {
+  Initialize(ForkContext::PARALLEL);
+  scoped_refptr<Request> invite(SendInvite());
+  RunFor(100);
+
+  scoped_refptr<Request> first(first_callee_->LastRequest(Method::INVITE));
+  scoped_refptr<Request> second(second_callee_->LastRequest(Method::INVITE));
+  ASSERT_TRUE(first);
+  ASSERT_TRUE(second);
+  // The Via of the proxy, with a branch of its own, on top of the caller's.
+  std::string upstream_branch(GetTopmostBranch(*invite));
+  EXPECT_EQ(2u, CountVias(*first));
+  EXPECT_EQ(2u, CountVias(*second));
+  EXPECT_NE(upstream_branch, GetTopmostBranch(*first));
+  EXPECT_NE(GetTopmostBranch(*first), GetTopmostBranch(*second));
+  const Request *const_first = first.get();
+  EXPECT_EQ("10.0.0.2", const_first->get<Via>()->front().sent_by().host());
+  EXPECT_EQ(69u, const_first->get<MaxForwards>()->value());
+
+  // Responses reach the caller with its own Via only.
+  first_callee_->Answer(first, SIP_RINGING);
+  RunFor(100);
+  scoped_refptr<Response> ringing(caller_->LastResponse(SIP_RINGING));
+  ASSERT_TRUE(ringing);
+  EXPECT_EQ(1u, CountVias(*ringing));
+  EXPECT_EQ(upstream_branch, GetTopmostBranch(*ringing));
+}
+
+TEST_F(ForkContextTest, SendsBestResponseUpstream) {
+  const struct {
+    int first_answer;
+    int second_answer;
+    int best_response_code;
+  } kCases[] = {
+    // 6xx are preferred.
+    { SIP_BUSY_HERE, SIP_DECLINE, SIP_DECLINE },
+    // Then the lowest class.
+    { SIP_SERVICE_UNAVAILABLE, SIP_NOT_FOUND, SIP_NOT_FOUND },
+    // And a 503 is turned into a 500.
+    { SIP_SERVICE_UNAVAILABLE, SIP_SERVICE_UNAVAILABLE,
+      SIP_SERVER_INTERNAL_ERROR },
+  };
+  for (size_t i = 0; i < arraysize(kCases); ++i) {
+    Initialize(ForkContext::PARALLEL);
+    first_callee_->set_invite_answer(kCases[i].first_answer);
+    second_callee_->set_invite_answer(kCases[i].second_answer);
+    SendInvite();
+    RunFor(1000);
+    EXPECT_EQ(kCases[i].best_response_code,
+              caller_->FinalResponseCode(Method::INVITE)) << i;
+    EXPECT_EQ(0u, CountForks()) << i;
+    TearDown();
+  }
+}
+
+TEST_F(ForkContextTest, CancelsOtherBranchesOn2xx) {
+  Initialize(ForkContext::PARALLEL);
+  SendInvite();
+  RunFor(100);
+  scoped_refptr<Request> first(first_callee_->LastRequest(Method::INVITE));
+  scoped_refptr<Request> second(second_callee_->LastRequest(Method::INVITE));
+  ASSERT_TRUE(first);
+  ASSERT_TRUE(second);
+  first_callee_->Answer(first, SIP_RINGING);
+  second_callee_->Answer(second, SIP_RINGING);
+  RunFor(100);
+
+  first_callee_->Answer(first, SIP_OK);
+  RunFor(100);
+  EXPECT_EQ(SIP_OK, caller_->FinalResponseCode(Method::INVITE));
+  EXPECT_EQ(0, first_callee_->CountRequests(Method::CANCEL));
+  scoped_refptr<Request> cancel(
+      second_callee_->LastRequest(Method::CANCEL));
+  ASSERT_TRUE(cancel);
+  // The CANCEL only takes the Via of the branch it cancels.
+  EXPECT_EQ(1u, CountVias(*cancel));
+  EXPECT_EQ(GetTopmostBranch(*second), GetTopmostBranch(*cancel));
+
+  // The 487 of the cancelled branch isn't sent upstream.
+  RunFor(1000);
+  EXPECT_EQ(SIP_OK, caller_->FinalResponseCode(Method::INVITE));
+  EXPECT_FALSE(caller_->LastResponse(SIP_REQUEST_TERMINATED));
+  EXPECT_EQ(0u, CountForks());
+}
+
+TEST_F(ForkContextTest, SequentialTriesNextTargetOnFailure) {
+  Initialize(ForkContext::SEQUENTIAL);
+  SendInvite();
+  RunFor(100);
+  scoped_refptr<Request> first(first_callee_->LastRequest(Method::INVITE));
+  ASSERT_TRUE(first);
+  EXPECT_EQ(0, second_callee_->CountRequests(Method::INVITE));
+
+  first_callee_->Answer(first, SIP_BUSY_HERE);
+  RunFor(100);
+  scoped_refptr<Request> second(second_callee_->LastRequest(Method::INVITE));
+  ASSERT_TRUE(second);
+  EXPECT_EQ(0, caller_->FinalResponseCode(Method::INVITE));
+
+  second_callee_->Answer(second, SIP_OK);
+  RunFor(100);
+  EXPECT_EQ(SIP_OK, caller_->FinalResponseCode(Method::INVITE));
+  EXPECT_FALSE(caller_->LastResponse(SIP_BUSY_HERE));
+}
+
+} // namespace ua
+} // namespace sippet
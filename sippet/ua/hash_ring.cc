@@ -0,0 +1,96 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/ua/hash_ring.h"
+
+#include <algorithm>
+
+#include "base/hash.h"
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+
+namespace sippet {
+
+HashRing::HashRing(size_t replicas)
+  : replicas_(replicas) {
+  DCHECK_GT(replicas, 0u);
+}
+
+HashRing::~HashRing() {
+}
+
+bool HashRing::Add(const std::string &node) {
+  if (nodes_.size() != IndexOf(node))
+    return false;
+  Node new_node;
+  new_node.name = node;
+  new_node.up = true;
+  nodes_.push_back(new_node);
+  Rebuild();
+  return true;
+}
+
+bool HashRing::Remove(const std::string &node) {
+  size_t index = IndexOf(node);
+  if (nodes_.size() == index)
+    return false;
+  nodes_.erase(nodes_.begin() + index);
+  Rebuild();
+  return true;
+}
+
+bool HashRing::SetUp(const std::string &node, bool up) {
+  size_t index = IndexOf(node);
+  if (nodes_.size() == index)
+    return false;
+  nodes_[index].up = up;
+  return true;
+}
+
+bool HashRing::IsUp(const std::string &node) const {
+  size_t index = IndexOf(node);
+  return nodes_.size() != index && nodes_[index].up;
+}
+
+const std::string *HashRing::Find(const base::StringPiece &key) const {
+  if (points_.empty())
+    return NULL;
+  Point point;
+  point.hash = base::Hash(key.data(), key.size());
+  point.node = 0;
+  size_t start = std::lower_bound(points_.begin(), points_.end(), point)
+      - points_.begin();
+  // Walk clockwise past the points of the nodes that are down.
+  for (size_t i = 0, size = points_.size(); i < size; ++i) {
+    const Node &node = nodes_[points_[(start + i) % size].node];
+    if (node.up)
+      return &node.name;
+  }
+  return NULL;
+}
+
+size_t HashRing::IndexOf(const std::string &node) const {
+  size_t index = 0;
+  for (; index < nodes_.size(); ++index) {
+    if (node == nodes_[index].name)
+      break;
+  }
+  return index;
+}
+
+void HashRing::Rebuild() {
+  points_.clear();
+  points_.reserve(nodes_.size() * replicas_);
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    for (size_t j = 0; j < replicas_; ++j) {
+      Point point;
+      point.hash = base::Hash(nodes_[i].name + "#" + base::SizeTToString(j));
+      point.node = i;
+      points_.push_back(point);
+    }
+  }
+  std::sort(points_.begin(), points_.end());
+}
+
+} // End of sippet namespace
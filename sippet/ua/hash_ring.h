@@ -0,0 +1,81 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_UA_HASH_RING_H_
+#define SIPPET_UA_HASH_RING_H_
+
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/strings/string_piece.h"
+
+namespace sippet {
+
+// Maps keys to nodes by consistent hashing: each node is hashed to
+// |replicas| points of a 32-bit ring, and a key belongs to the node of the
+// first point at or after its own hash. Adding or removing a node only
+// moves the keys of the points it takes or leaves, about 1/N of them.
+//
+// Nodes can also be marked down without leaving the ring: their keys go to
+// the next points that are up, spread over the other nodes, and come back
+// once the node is up again. Lookups are a binary search on a sorted
+// vector; membership changes rebuild it.
+class HashRing {
+ public:
+  // Default number of points per node, enough for a fair share of the keys
+  // with a few dozen nodes.
+  static const size_t kDefaultReplicas = 160;
+
+  explicit HashRing(size_t replicas = kDefaultReplicas);
+  ~HashRing();
+
+  // Adds an up |node|. Returns false if it's already in the ring.
+  bool Add(const std::string &node);
+
+  // Returns false if |node| isn't in the ring.
+  bool Remove(const std::string &node);
+
+  // Marks |node| up or down. Returns false if it isn't in the ring.
+  bool SetUp(const std::string &node, bool up);
+
+  bool IsUp(const std::string &node) const;
+
+  // Number of nodes, up or down.
+  size_t size() const { return nodes_.size(); }
+
+  // The up node owning |key|, or NULL if all nodes are down. The pointer is
+  // valid until the ring membership changes.
+  const std::string *Find(const base::StringPiece &key) const;
+
+ private:
+  struct Node {
+    std::string name;
+    bool up;
+  };
+
+  struct Point {
+    uint32 hash;
+    size_t node;
+
+    bool operator<(const Point &other) const {
+      return hash < other.hash;
+    }
+  };
+
+  // Index of |node| in |nodes_|, or |nodes_.size()| if absent.
+  size_t IndexOf(const std::string &node) const;
+  void Rebuild();
+
+  size_t replicas_;
+  std::vector<Node> nodes_;
+  // Sorted by hash.
+  std::vector<Point> points_;
+
+  DISALLOW_COPY_AND_ASSIGN(HashRing);
+};
+
+} // End of sippet namespace
+
+#endif // SIPPET_UA_HASH_RING_H_
@@ -0,0 +1,88 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/ua/hash_ring.h"
+
+#include <map>
+
+#include "base/strings/string_number_conversions.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const int kKeys = 3000;
+
+std::string MakeKey(int i) {
+  return base::IntToString(i) + "@pc33.atlanta.com";
+}
+
+// The owner of each key, by key index.
+std::vector<std::string> MapKeys(const HashRing &ring) {
+  std::vector<std::string> owners;
+  for (int i = 0; i < kKeys; ++i) {
+    const std::string *owner = ring.Find(MakeKey(i));
+    owners.push_back(owner ? *owner : std::string());
+  }
+  return owners;
+}
+
+}  // namespace
+
+TEST(HashRingTest, SpreadsKeys) {
+  HashRing ring;
+  EXPECT_FALSE(ring.Find("a84b4c76e66710@pc33.atlanta.com"));
+  EXPECT_TRUE(ring.Add("sip:10.0.0.1"));
+  EXPECT_TRUE(ring.Add("sip:10.0.0.2"));
+  EXPECT_TRUE(ring.Add("sip:10.0.0.3"));
+  EXPECT_FALSE(ring.Add("sip:10.0.0.3"));
+  EXPECT_EQ(3u, ring.size());
+
+  std::map<std::string, int> counts;
+  std::vector<std::string> owners(MapKeys(ring));
+  for (size_t i = 0; i < owners.size(); ++i)
+    ++counts[owners[i]];
+  ASSERT_EQ(3u, counts.size());
+  for (std::map<std::string, int>::iterator i = counts.begin();
+       i != counts.end(); ++i) {
+    EXPECT_GT(i->second, kKeys / 3 / 2) << i->first;
+  }
+}
+
+TEST(HashRingTest, RemapsOnlyTheKeysOfALeavingNode) {
+  HashRing ring;
+  ring.Add("sip:10.0.0.1");
+  ring.Add("sip:10.0.0.2");
+  ring.Add("sip:10.0.0.3");
+  std::vector<std::string> before(MapKeys(ring));
+
+  // Marking a node down moves its keys only, and they come back.
+  EXPECT_TRUE(ring.SetUp("sip:10.0.0.2", false));
+  EXPECT_FALSE(ring.IsUp("sip:10.0.0.2"));
+  std::vector<std::string> down(MapKeys(ring));
+  for (int i = 0; i < kKeys; ++i) {
+    EXPECT_NE("sip:10.0.0.2", down[i]);
+    if ("sip:10.0.0.2" != before[i])
+      EXPECT_EQ(before[i], down[i]) << i;
+  }
+  ring.SetUp("sip:10.0.0.2", true);
+  EXPECT_EQ(before, MapKeys(ring));
+
+  // So does removing it.
+  EXPECT_TRUE(ring.Remove("sip:10.0.0.2"));
+  EXPECT_FALSE(ring.Remove("sip:10.0.0.2"));
+  std::vector<std::string> removed(MapKeys(ring));
+  for (int i = 0; i < kKeys; ++i) {
+    if ("sip:10.0.0.2" != before[i])
+      EXPECT_EQ(before[i], removed[i]) << i;
+  }
+
+  // With all nodes down, no key has an owner.
+  ring.SetUp("sip:10.0.0.1", false);
+  ring.SetUp("sip:10.0.0.3", false);
+  EXPECT_FALSE(ring.Find(MakeKey(0)));
+}
+
+}  // namespace sippet
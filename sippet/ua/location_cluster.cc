@@ -0,0 +1,362 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/ua/location_cluster.h"
+
+#include "base/auto_reset.h"
+#include "base/logging.h"
+#include "base/time/tick_clock.h"
+#include "net/base/net_errors.h"
+#include "sippet/ua/snapshot_io.h"
+
+namespace sippet {
+
+namespace {
+
+// "SCLU", starting each batch, followed by the name of the sending node.
+const uint32 kBatchMagic = 0x554c4353;
+
+// The entries of a batch, each followed by its address-of-record.
+enum Operation {
+  // The Call-ID, CSeq and bindings of a REGISTER, for the owner.
+  OPERATION_UPDATE = 1,
+  // The Call-ID and CSeq of a "Contact: *" REGISTER, for the owner.
+  OPERATION_REMOVE_ALL,
+  // The owner's bindings changed, for the nodes that fetched them.
+  OPERATION_INVALIDATE,
+  // A lookup, for the owner.
+  OPERATION_FETCH,
+  // The owner's bindings, answering a fetch.
+  OPERATION_FETCH_REPLY,
+};
+
+void WriteBindings(const LocationService::BindingList &bindings,
+                   SnapshotWriter *writer) {
+  writer->WriteUint32(static_cast<uint32>(bindings.size()));
+  for (LocationService::BindingList::const_iterator i = bindings.begin(),
+       ie = bindings.end(); i != ie; ++i)
+    LocationService::WriteBinding(*i, writer);
+}
+
+bool ReadBindings(SnapshotReader *reader,
+                  LocationService::BindingList *bindings) {
+  uint32 count;
+  if (!reader->ReadUint32(&count))
+    return false;
+  for (uint32 i = 0; i < count; ++i) {
+    LocationService::Binding binding;
+    if (!LocationService::ReadBinding(reader, &binding))
+      return false;
+    bindings->push_back(binding);
+  }
+  return true;
+}
+
+// Cached bindings may expire before the entry does.
+void CopyUnexpired(const LocationService::BindingList &bindings,
+                   LocationService::BindingList *unexpired) {
+  base::Time now = base::Time::Now();
+  unexpired->clear();
+  for (LocationService::BindingList::const_iterator i = bindings.begin(),
+       ie = bindings.end(); i != ie; ++i) {
+    if (i->expires > now)
+      unexpired->push_back(*i);
+  }
+}
+
+}  // namespace
+
+LocationCluster::CacheEntry::CacheEntry() {
+}
+
+LocationCluster::CacheEntry::~CacheEntry() {
+}
+
+LocationCluster::Fetch::Fetch() {
+}
+
+LocationCluster::Fetch::~Fetch() {
+}
+
+LocationCluster::LocationCluster(const std::string &local_node,
+                                 LocationService *location_service,
+                                 Delegate *delegate)
+  : local_node_(local_node),
+    location_service_(location_service),
+    delegate_(delegate),
+    flush_interval_(
+        base::TimeDelta::FromMilliseconds(kDefaultFlushIntervalMs)),
+    cache_ttl_(base::TimeDelta::FromSeconds(kDefaultCacheTtlSeconds)),
+    fetch_timeout_(
+        base::TimeDelta::FromMilliseconds(kDefaultFetchTimeoutMs)),
+    cache_(kDefaultCacheMaxEntries),
+    applying_(false),
+    tick_clock_(NULL) {
+  DCHECK(location_service);
+  DCHECK(delegate);
+  ring_.Add(local_node);
+  location_service_->set_observer(this);
+}
+
+LocationCluster::~LocationCluster() {
+  location_service_->set_observer(NULL);
+}
+
+const std::string &LocationCluster::OwnerOf(const SipURI &aor) const {
+  const std::string *owner = ring_.Find(aor.spec());
+  return owner ? *owner : local_node_;
+}
+
+int LocationCluster::Lookup(const SipURI &aor,
+                            LocationService::BindingList *bindings,
+                            const net::CompletionCallback &callback) {
+  DCHECK(bindings);
+  const std::string &owner = OwnerOf(aor);
+  if (owner == local_node_) {
+    location_service_->Lookup(aor, bindings);
+    return net::OK;
+  }
+  std::string key(aor.spec());
+  Cache::iterator i = cache_.Get(key);
+  if (cache_.end() != i) {
+    if (NowTicks() < i->second.expires) {
+      CopyUnexpired(i->second.bindings, bindings);
+      return net::OK;
+    }
+    cache_.Erase(i);
+  }
+
+  Fetch &fetch = fetches_[key];
+  PendingLookup lookup;
+  lookup.bindings = bindings;
+  lookup.callback = callback;
+  fetch.lookups.push_back(lookup);
+  if (1 == fetch.lookups.size()) {
+    // Fetches aren't delayed, and carry what's queued for the owner.
+    fetch.deadline = NowTicks() + fetch_timeout_;
+    StartEntry(owner, OPERATION_FETCH, key);
+    SendBatch(owner);
+  }
+  MaybeStartTimer();
+  return net::ERR_IO_PENDING;
+}
+
+bool LocationCluster::HandleBatch(const base::StringPiece &batch) {
+  SnapshotReader reader(reinterpret_cast<const uint8*>(batch.data()),
+                        batch.size());
+  uint32 magic;
+  std::string sender;
+  if (!reader.ReadUint32(&magic) || kBatchMagic != magic
+      || !reader.ReadString(&sender)) {
+    DVLOG(1) << "Malformed location batch";
+    return false;
+  }
+  bool valid = true;
+  while (!reader.empty()) {
+    if (!ApplyEntry(sender, &reader)) {
+      DVLOG(1) << "Malformed location batch entry from " << sender;
+      valid = false;
+      break;
+    }
+  }
+  // Answers to the fetches aren't delayed either.
+  SendBatch(sender);
+  return valid;
+}
+
+void LocationCluster::Flush() {
+  BatchMap batches;
+  batches.swap(batches_);
+  for (BatchMap::const_iterator i = batches.begin(), ie = batches.end();
+       i != ie; ++i)
+    delegate_->SendBatch(i->first, i->second);
+}
+
+void LocationCluster::InvalidateCache() {
+  cache_.Clear();
+}
+
+void LocationCluster::OnBindingsUpdated(
+    const SipURI &aor,
+    const std::string &call_id,
+    uint32 cseq,
+    const LocationService::BindingList &bindings) {
+  std::string key(aor.spec());
+  const std::string &owner = OwnerOf(aor);
+  if (owner == local_node_) {
+    Invalidate(key);
+    return;
+  }
+  Cache::iterator i = cache_.Peek(key);
+  if (cache_.end() != i)
+    cache_.Erase(i);
+  // Requests applied for another node were sent by their owner, as seen
+  // from there, and aren't sent back.
+  if (applying_)
+    return;
+  SnapshotWriter writer(StartEntry(owner, OPERATION_UPDATE, key));
+  writer.WriteString(call_id);
+  writer.WriteUint32(cseq);
+  WriteBindings(bindings, &writer);
+  MaybeStartTimer();
+}
+
+void LocationCluster::OnBindingsRemoved(const SipURI &aor,
+                                        const std::string &call_id,
+                                        uint32 cseq) {
+  std::string key(aor.spec());
+  const std::string &owner = OwnerOf(aor);
+  if (owner == local_node_) {
+    Invalidate(key);
+    return;
+  }
+  Cache::iterator i = cache_.Peek(key);
+  if (cache_.end() != i)
+    cache_.Erase(i);
+  if (applying_)
+    return;
+  SnapshotWriter writer(StartEntry(owner, OPERATION_REMOVE_ALL, key));
+  writer.WriteString(call_id);
+  writer.WriteUint32(cseq);
+  MaybeStartTimer();
+}
+
+std::string *LocationCluster::StartEntry(const std::string &node,
+                                         uint32 operation,
+                                         const std::string &aor) {
+  std::string *batch = &batches_[node];
+  SnapshotWriter writer(batch);
+  if (batch->empty()) {
+    writer.WriteUint32(kBatchMagic);
+    writer.WriteString(local_node_);
+  }
+  writer.WriteUint32(operation);
+  writer.WriteString(aor);
+  return batch;
+}
+
+void LocationCluster::SendBatch(const std::string &node) {
+  BatchMap::iterator i = batches_.find(node);
+  if (batches_.end() == i)
+    return;
+  std::string batch;
+  batch.swap(i->second);
+  batches_.erase(i);
+  delegate_->SendBatch(node, batch);
+}
+
+void LocationCluster::Invalidate(const std::string &aor) {
+  ReaderMap::iterator i = readers_.find(aor);
+  if (readers_.end() == i)
+    return;
+  for (std::set<std::string>::const_iterator j = i->second.begin(),
+       je = i->second.end(); j != je; ++j)
+    StartEntry(*j, OPERATION_INVALIDATE, aor);
+  readers_.erase(i);
+  MaybeStartTimer();
+}
+
+bool LocationCluster::ApplyEntry(const std::string &sender,
+                                 SnapshotReader *reader) {
+  uint32 operation;
+  std::string aor;
+  if (!reader->ReadUint32(&operation) || !reader->ReadString(&aor))
+    return false;
+  switch (operation) {
+    case OPERATION_UPDATE:
+    case OPERATION_REMOVE_ALL: {
+      std::string call_id;
+      uint32 cseq;
+      LocationService::BindingList bindings;
+      if (!reader->ReadString(&call_id) || !reader->ReadUint32(&cseq))
+        return false;
+      if (OPERATION_UPDATE == operation && !ReadBindings(reader, &bindings))
+        return false;
+      SipURI uri(aor);
+      if (!uri.is_valid())
+        return false;
+      base::AutoReset<bool> applying(&applying_, true);
+      bool updated = OPERATION_UPDATE == operation
+          ? location_service_->Update(uri, call_id, cseq, bindings)
+          : location_service_->RemoveAll(uri, call_id, cseq);
+      if (!updated)
+        DVLOG(1) << "Out of order REGISTER for " << aor << " from " << sender;
+      return true;
+    }
+    case OPERATION_INVALIDATE: {
+      Cache::iterator i = cache_.Peek(aor);
+      if (cache_.end() != i)
+        cache_.Erase(i);
+      return true;
+    }
+    case OPERATION_FETCH: {
+      SipURI uri(aor);
+      if (!uri.is_valid())
+        return false;
+      LocationService::BindingList bindings;
+      location_service_->Lookup(uri, &bindings);
+      readers_[aor].insert(sender);
+      SnapshotWriter writer(StartEntry(sender, OPERATION_FETCH_REPLY, aor));
+      WriteBindings(bindings, &writer);
+      return true;
+    }
+    case OPERATION_FETCH_REPLY: {
+      CacheEntry entry;
+      if (!ReadBindings(reader, &entry.bindings))
+        return false;
+      entry.expires = NowTicks() + cache_ttl_;
+      cache_.Put(aor, entry);
+      CompleteFetch(aor, &entry.bindings);
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+void LocationCluster::CompleteFetch(
+    const std::string &aor,
+    const LocationService::BindingList *bindings) {
+  FetchMap::iterator i = fetches_.find(aor);
+  if (fetches_.end() == i)
+    return;
+  std::vector<PendingLookup> lookups;
+  lookups.swap(i->second.lookups);
+  fetches_.erase(i);
+  for (std::vector<PendingLookup>::const_iterator j = lookups.begin(),
+       je = lookups.end(); j != je; ++j) {
+    if (bindings)
+      CopyUnexpired(*bindings, j->bindings);
+    j->callback.Run(bindings ? net::OK : net::ERR_TIMED_OUT);
+  }
+}
+
+void LocationCluster::MaybeStartTimer() {
+  if (!timer_.IsRunning())
+    timer_.Start(FROM_HERE, flush_interval_, this, &LocationCluster::OnTimer);
+}
+
+void LocationCluster::OnTimer() {
+  Flush();
+  base::TimeTicks now = NowTicks();
+  std::vector<std::string> expired;
+  for (FetchMap::const_iterator i = fetches_.begin(), ie = fetches_.end();
+       i != ie; ++i) {
+    if (i->second.deadline <= now)
+      expired.push_back(i->first);
+  }
+  for (std::vector<std::string>::const_iterator i = expired.begin(),
+       ie = expired.end(); i != ie; ++i) {
+    DVLOG(1) << "Fetch of " << *i << " timed out";
+    CompleteFetch(*i, NULL);
+  }
+  if (batches_.empty() && fetches_.empty())
+    timer_.Stop();
+}
+
+base::TimeTicks LocationCluster::NowTicks() const {
+  return tick_clock_ ? tick_clock_->NowTicks() : base::TimeTicks::Now();
+}
+
+} // namespace sippet
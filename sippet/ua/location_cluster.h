@@ -0,0 +1,218 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_UA_LOCATION_CLUSTER_H_
+#define SIPPET_UA_LOCATION_CLUSTER_H_
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/containers/mru_cache.h"
+#include "base/strings/string_piece.h"
+#include "base/time/time.h"
+#include "base/timer/timer.h"
+#include "net/base/completion_callback.h"
+#include "sippet/ua/hash_ring.h"
+#include "sippet/ua/location_service.h"
+
+namespace base {
+class TickClock;
+}
+
+namespace sippet {
+
+class SnapshotReader;
+
+// Shares the |LocationService| of the registrars of several front ends, so
+// that a REGISTER received by one node is found by the INVITEs received by
+// any other, without a central database.
+//
+// Addresses-of-record are partitioned over the nodes by consistent hashing
+// (see |HashRing|): each one is owned by a single node, which keeps all of
+// its bindings. The requests applied to the location service of any other
+// node, by its |Registrar|, are carried to the owner, where they're applied
+// again, out of order requests being rejected there as well. They're
+// queued and sent in batches, each |flush_interval|, to the |Delegate|,
+// which carries them between nodes; nothing waits for the owner.
+//
+// Lookups of the addresses-of-record owned by the node are answered by its
+// location service. Others are read through a local cache: on a miss, the
+// bindings are fetched from the owner, coalescing the lookups of the same
+// address-of-record meanwhile. Owners invalidate the entries cached by the
+// other nodes whenever the bindings change; entries are also dropped after
+// |cache_ttl|, in case an invalidation was lost. Fetches, and the answers
+// to them, aren't batched, but sent right away.
+//
+// A node marked down in the |ring| leaves its addresses-of-record to the
+// next nodes, which only get their bindings back as they're refreshed, and
+// so do the nodes getting them back when it's up again. Dialogs aren't
+// clustered here: the |Dispatcher| keeps the requests of a call on the node
+// hashing its Call-ID, and a |DialogReplicator| streams them to a standby.
+//
+// Batches are in the native byte order of |SnapshotWriter|: all nodes must
+// run the same build. The cluster is used from the thread of its location
+// service.
+class LocationCluster : public LocationService::Observer {
+ public:
+  class Delegate {
+   public:
+    virtual ~Delegate() {}
+
+    // Carries |batch| to |node|, to be handed to its |HandleBatch|. Batches
+    // sent to the same node must arrive in order.
+    virtual void SendBatch(const std::string &node,
+                           const std::string &batch) = 0;
+  };
+
+  // Default interval between the flushes of the queued batches.
+  static const int kDefaultFlushIntervalMs = 20;
+
+  // Default time cached bindings are kept, in seconds.
+  static const int kDefaultCacheTtlSeconds = 30;
+
+  // Default number of addresses-of-record cached.
+  static const size_t kDefaultCacheMaxEntries = 10000;
+
+  // Default time a fetch waits for the owner, in milliseconds.
+  static const int kDefaultFetchTimeoutMs = 1000;
+
+  // Adds |local_node| to the ring, and observes |location_service|. Neither
+  // the service nor the |delegate| is owned, and both must outlive it.
+  LocationCluster(const std::string &local_node,
+                  LocationService *location_service,
+                  Delegate *delegate);
+  ~LocationCluster() override;
+
+  const std::string &local_node() const { return local_node_; }
+
+  // The nodes of the cluster. Entries cached for the addresses-of-record
+  // whose owner changed are only dropped after |cache_ttl|, unless
+  // |InvalidateCache| is called.
+  HashRing *ring() { return &ring_; }
+
+  void set_flush_interval(const base::TimeDelta &flush_interval) {
+    flush_interval_ = flush_interval;
+  }
+  void set_cache_ttl(const base::TimeDelta &cache_ttl) {
+    cache_ttl_ = cache_ttl;
+  }
+  void set_fetch_timeout(const base::TimeDelta &fetch_timeout) {
+    fetch_timeout_ = fetch_timeout;
+  }
+
+  // The node owning |aor|: the local one, if all the others are down.
+  const std::string &OwnerOf(const SipURI &aor) const;
+
+  // Gets the current bindings of |aor|, highest q-values first, none if it
+  // isn't registered. Returns |net::ERR_IO_PENDING| if they're fetched from
+  // the owner, |callback| being run once |bindings| are set, or with
+  // |net::ERR_TIMED_OUT| if it doesn't answer in time; |bindings| must be
+  // kept until then.
+  int Lookup(const SipURI &aor,
+             LocationService::BindingList *bindings,
+             const net::CompletionCallback &callback);
+
+  // Handles a batch sent by another node. Returns false if it's malformed,
+  // keeping what preceded the bad entry.
+  bool HandleBatch(const base::StringPiece &batch);
+
+  // Sends the queued batches right away, e.g. before leaving the cluster.
+  void Flush();
+
+  // Drops all cached bindings, e.g. after the ring membership changed.
+  void InvalidateCache();
+
+  // Number of addresses-of-record cached.
+  size_t cache_size() const { return cache_.size(); }
+
+  void set_tick_clock_for_testing(base::TickClock *tick_clock) {
+    tick_clock_ = tick_clock;
+  }
+
+  // LocationService::Observer methods:
+  void OnBindingsUpdated(const SipURI &aor,
+                         const std::string &call_id,
+                         uint32 cseq,
+                         const LocationService::BindingList &bindings)
+      override;
+  void OnBindingsRemoved(const SipURI &aor,
+                         const std::string &call_id,
+                         uint32 cseq) override;
+
+ private:
+  struct CacheEntry {
+    CacheEntry();
+    ~CacheEntry();
+
+    LocationService::BindingList bindings;
+    base::TimeTicks expires;
+  };
+
+  struct PendingLookup {
+    LocationService::BindingList *bindings;
+    net::CompletionCallback callback;
+  };
+
+  struct Fetch {
+    Fetch();
+    ~Fetch();
+
+    std::vector<PendingLookup> lookups;
+    base::TimeTicks deadline;
+  };
+
+  typedef base::HashingMRUCache<std::string, CacheEntry> Cache;
+  // Keyed by the address-of-record being fetched.
+  typedef std::map<std::string, Fetch> FetchMap;
+  // The batch being queued for each node.
+  typedef std::map<std::string, std::string> BatchMap;
+  // The nodes that fetched each address-of-record owned by this one since
+  // it last changed.
+  typedef std::map<std::string, std::set<std::string> > ReaderMap;
+
+  // Appends an entry of |operation| on |aor| to the batch queued for
+  // |node|, returning the batch to append the rest of the entry to.
+  std::string *StartEntry(const std::string &node,
+                          uint32 operation,
+                          const std::string &aor);
+  // Sends the batch queued for |node| right away, if any.
+  void SendBatch(const std::string &node);
+  // Queues an invalidation of |aor| for the nodes that fetched it.
+  void Invalidate(const std::string &aor);
+
+  bool ApplyEntry(const std::string &sender, SnapshotReader *reader);
+  void CompleteFetch(const std::string &aor,
+                     const LocationService::BindingList *bindings);
+
+  void MaybeStartTimer();
+  void OnTimer();
+
+  base::TimeTicks NowTicks() const;
+
+  std::string local_node_;
+  LocationService *location_service_;
+  Delegate *delegate_;
+  HashRing ring_;
+  base::TimeDelta flush_interval_;
+  base::TimeDelta cache_ttl_;
+  base::TimeDelta fetch_timeout_;
+  Cache cache_;
+  FetchMap fetches_;
+  BatchMap batches_;
+  ReaderMap readers_;
+  // Set while applying the requests of another node, which aren't sent
+  // back.
+  bool applying_;
+  base::RepeatingTimer<LocationCluster> timer_;
+  base::TickClock *tick_clock_;
+
+  DISALLOW_COPY_AND_ASSIGN(LocationCluster);
+};
+
+} // namespace sippet
+
+#endif // SIPPET_UA_LOCATION_CLUSTER_H_
@@ -0,0 +1,147 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/ua/location_cluster.h"
+
+#include <deque>
+#include <utility>
+
+#include "base/bind.h"
+#include "base/strings/stringprintf.h"
+#include "base/test/simple_test_tick_clock.h"
+#include "net/base/net_errors.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const char kCallId[] = "a84b4c76e66710@pc33.atlanta.com";
+
+void SaveResult(int *result, int rv) {
+  *result = rv;
+}
+
+// Holds the batches sent until delivered.
+class QueueingDelegate : public LocationCluster::Delegate {
+ public:
+  void SendBatch(const std::string &node, const std::string &batch) override {
+    batches.push_back(std::make_pair(node, batch));
+  }
+
+  std::deque<std::pair<std::string, std::string> > batches;
+};
+
+}  // namespace
+
+class LocationClusterTest : public testing::Test {
+ public:
+  LocationClusterTest()
+    : a_("a", &service_a_, &delegate_),
+      b_("b", &service_b_, &delegate_) {
+    a_.ring()->Add("b");
+    b_.ring()->Add("a");
+    clock_.Advance(base::TimeDelta::FromSeconds(1));
+    a_.set_tick_clock_for_testing(&clock_);
+    // An address-of-record owned by "b".
+    for (int i = 0; aor_.spec().empty() || "b" != a_.OwnerOf(aor_); ++i)
+      aor_ = SipURI(base::StringPrintf("sip:user%d@atlanta.com", i));
+    EXPECT_EQ("b", b_.OwnerOf(aor_));
+  }
+
+  LocationService::BindingList CreateBindings(const char *contact) {
+    LocationService::BindingList bindings(1);
+    bindings[0].contact = SipURI(contact);
+    bindings[0].expires = base::Time::Now() + base::TimeDelta::FromHours(1);
+    return bindings;
+  }
+
+  // Delivers the batches sent, and those sent in answer to them.
+  void Deliver() {
+    while (!delegate_.batches.empty()) {
+      std::pair<std::string, std::string> batch(delegate_.batches.front());
+      delegate_.batches.pop_front();
+      EXPECT_TRUE(("a" == batch.first ? a_ : b_).HandleBatch(batch.second));
+    }
+  }
+
+ protected:
+  base::SimpleTestTickClock clock_;
+  QueueingDelegate delegate_;
+  LocationService service_a_;
+  LocationService service_b_;
+  LocationCluster a_;
+  LocationCluster b_;
+  SipURI aor_;
+};
+
+TEST_F(LocationClusterTest, RegisterOnAnyNodeLookupOnAnyNode) {
+  EXPECT_TRUE(service_a_.Update(aor_, kCallId, 1,
+                                CreateBindings("sip:alice@192.0.2.4")));
+  // Batched until flushed.
+  EXPECT_TRUE(delegate_.batches.empty());
+  a_.Flush();
+  Deliver();
+  LocationService::BindingList bindings;
+  ASSERT_TRUE(service_b_.Lookup(aor_, &bindings));
+  EXPECT_EQ("sip:alice@192.0.2.4", bindings[0].contact.spec());
+
+  // Read through the cache of "a".
+  int result = net::ERR_UNEXPECTED;
+  EXPECT_EQ(net::ERR_IO_PENDING, a_.Lookup(aor_, &bindings,
+      base::Bind(&SaveResult, &result)));
+  Deliver();
+  EXPECT_EQ(net::OK, result);
+  ASSERT_EQ(1u, bindings.size());
+  EXPECT_EQ(1u, a_.cache_size());
+  bindings.clear();
+  EXPECT_EQ(net::OK, a_.Lookup(aor_, &bindings, net::CompletionCallback()));
+  EXPECT_EQ(1u, bindings.size());
+
+  // The owner drops what "a" cached once the bindings change.
+  EXPECT_TRUE(service_b_.Update(aor_, kCallId, 2,
+                                CreateBindings("sip:alice@192.0.2.5")));
+  b_.Flush();
+  Deliver();
+  EXPECT_EQ(0u, a_.cache_size());
+  EXPECT_EQ(net::ERR_IO_PENDING, a_.Lookup(aor_, &bindings,
+      base::Bind(&SaveResult, &result)));
+  Deliver();
+  EXPECT_EQ(2u, bindings.size());
+}
+
+TEST_F(LocationClusterTest, CoalescesFetchesAndExpiresCache) {
+  EXPECT_TRUE(service_b_.Update(aor_, kCallId, 1,
+                                CreateBindings("sip:alice@192.0.2.4")));
+  LocationService::BindingList first, second;
+  int first_result = net::ERR_UNEXPECTED;
+  int second_result = net::ERR_UNEXPECTED;
+  EXPECT_EQ(net::ERR_IO_PENDING, a_.Lookup(aor_, &first,
+      base::Bind(&SaveResult, &first_result)));
+  EXPECT_EQ(net::ERR_IO_PENDING, a_.Lookup(aor_, &second,
+      base::Bind(&SaveResult, &second_result)));
+  EXPECT_EQ(1u, delegate_.batches.size());
+  Deliver();
+  EXPECT_EQ(net::OK, first_result);
+  EXPECT_EQ(net::OK, second_result);
+  EXPECT_EQ(1u, second.size());
+
+  clock_.Advance(base::TimeDelta::FromSeconds(
+      LocationCluster::kDefaultCacheTtlSeconds));
+  EXPECT_EQ(net::ERR_IO_PENDING, a_.Lookup(aor_, &first,
+      base::Bind(&SaveResult, &first_result)));
+  Deliver();
+
+  // Removals are carried to the owner as well.
+  EXPECT_TRUE(service_a_.RemoveAll(aor_, kCallId, 2));
+  a_.Flush();
+  Deliver();
+  EXPECT_FALSE(service_b_.Lookup(aor_, &second));
+  EXPECT_EQ(net::ERR_IO_PENDING, a_.Lookup(aor_, &first,
+      base::Bind(&SaveResult, &first_result)));
+  Deliver();
+  EXPECT_TRUE(first.empty());
+}
+
+} // End of sippet namespace
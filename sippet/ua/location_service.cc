@@ -0,0 +1,316 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/ua/location_service.h"
+
+#include <algorithm>
+
+#include "base/bind.h"
+#include "base/files/file_path.h"
+#include "base/files/important_file_writer.h"
+#include "base/files/memory_mapped_file.h"
+#include "base/stl_util.h"
+#include "base/time/clock.h"
+#include "sippet/ua/snapshot_io.h"
+
+namespace sippet {
+
+namespace {
+
+// "SLOC", followed by the format version.
+const uint32 kSnapshotMagic = 0x434f4c53;
+const uint32 kSnapshotVersion = 1;
+
+// Contacts without a q-value are sorted as q=1.
+const int kDefaultQ = 1000;
+
+bool HigherQ(const LocationService::Binding &a,
+             const LocationService::Binding &b) {
+  return (a.q < 0 ? kDefaultQ : a.q) > (b.q < 0 ? kDefaultQ : b.q);
+}
+
+}  // namespace
+
+LocationService::Binding::Binding()
+  : q(-1), reg_id(0), cseq(0) {
+}
+
+LocationService::Binding::~Binding() {
+}
+
+LocationService::Record::Record(const SipURI &aor, TimerWheel *timer_wheel)
+  : aor(aor), expiration_timer(timer_wheel) {
+}
+
+LocationService::Record::~Record() {
+}
+
+LocationService::LocationService()
+  : binding_count_(0),
+    timer_wheel_(
+        base::TimeDelta::FromSeconds(kExpirationResolutionSeconds)),
+    observer_(NULL),
+    clock_(NULL) {
+}
+
+LocationService::~LocationService() {
+  Clear();
+}
+
+bool LocationService::Update(const SipURI &aor,
+                             const std::string &call_id,
+                             uint32 cseq,
+                             const BindingList &bindings) {
+  RecordMap::iterator i = records_.find(aor);
+  Record *record = records_.end() == i ? NULL : i->second;
+  if (record) {
+    for (BindingList::const_iterator j = bindings.begin(),
+         je = bindings.end(); j != je; ++j) {
+      if (IsOutOfOrder(record, *j, call_id, cseq))
+        return false;
+    }
+  }
+
+  base::Time now = Now();
+  for (BindingList::const_iterator j = bindings.begin(),
+       je = bindings.end(); j != je; ++j) {
+    if (j->expires <= now) {
+      if (record) {
+        BindingList::iterator k = FindBinding(record, *j);
+        if (k != record->bindings.end()) {
+          record->bindings.erase(k);
+          --binding_count_;
+        }
+      }
+      continue;
+    }
+    if (!record) {
+      record = new Record(aor, &timer_wheel_);
+      records_.insert(std::make_pair(record->aor, record));
+    }
+    BindingList::iterator k = FindBinding(record, *j);
+    if (k == record->bindings.end()) {
+      record->bindings.push_back(*j);
+      ++binding_count_;
+      k = record->bindings.end() - 1;
+    } else {
+      *k = *j;
+    }
+    k->call_id = call_id;
+    k->cseq = cseq;
+  }
+  if (record)
+    Refresh(record);
+  if (observer_)
+    observer_->OnBindingsUpdated(aor, call_id, cseq, bindings);
+  return true;
+}
+
+bool LocationService::RemoveAll(const SipURI &aor,
+                                const std::string &call_id,
+                                uint32 cseq) {
+  RecordMap::iterator i = records_.find(aor);
+  if (records_.end() != i) {
+    Record *record = i->second;
+    for (BindingList::const_iterator j = record->bindings.begin(),
+         je = record->bindings.end(); j != je; ++j) {
+      if (j->call_id == call_id && j->cseq >= cseq)
+        return false;
+    }
+    DestroyRecord(record);
+  }
+  // Other nodes may still have bindings to remove.
+  if (observer_)
+    observer_->OnBindingsRemoved(aor, call_id, cseq);
+  return true;
+}
+
+bool LocationService::Lookup(const SipURI &aor,
+                             BindingList *bindings) const {
+  DCHECK(bindings);
+  bindings->clear();
+  RecordMap::const_iterator i = records_.find(aor);
+  if (records_.end() == i)
+    return false;
+  // The timer may not have run yet.
+  base::Time now = Now();
+  const BindingList &record_bindings = i->second->bindings;
+  for (BindingList::const_iterator j = record_bindings.begin(),
+       je = record_bindings.end(); j != je; ++j) {
+    if (j->expires > now)
+      bindings->push_back(*j);
+  }
+  std::stable_sort(bindings->begin(), bindings->end(), HigherQ);
+  return !bindings->empty();
+}
+
+bool LocationService::SaveSnapshot(const base::FilePath &path) const {
+  std::string data;
+  SnapshotWriter writer(&data);
+  writer.WriteUint32(kSnapshotMagic);
+  writer.WriteUint32(kSnapshotVersion);
+  writer.WriteUint32(static_cast<uint32>(records_.size()));
+  for (RecordMap::const_iterator i = records_.begin(), ie = records_.end();
+       i != ie; ++i) {
+    const Record *record = i->second;
+    writer.WriteString(record->aor.spec());
+    writer.WriteUint32(static_cast<uint32>(record->bindings.size()));
+    for (BindingList::const_iterator j = record->bindings.begin(),
+         je = record->bindings.end(); j != je; ++j)
+      WriteBinding(*j, &writer);
+  }
+  return base::ImportantFileWriter::WriteFileAtomically(path, data);
+}
+
+bool LocationService::LoadSnapshot(const base::FilePath &path) {
+  base::MemoryMappedFile file;
+  if (!file.Initialize(path))
+    return false;
+  SnapshotReader reader(file.data(), file.length());
+  uint32 magic, version, record_count;
+  if (!reader.ReadUint32(&magic) || kSnapshotMagic != magic
+      || !reader.ReadUint32(&version) || kSnapshotVersion != version
+      || !reader.ReadUint32(&record_count))
+    return false;
+
+  // Read everything first, so that a truncated snapshot changes nothing.
+  base::Time now = Now();
+  std::vector<std::pair<SipURI, BindingList> > loaded;
+  for (uint32 i = 0; i < record_count; ++i) {
+    std::string aor;
+    uint32 binding_count;
+    if (!reader.ReadString(&aor) || !reader.ReadUint32(&binding_count))
+      return false;
+    loaded.push_back(std::make_pair(SipURI(aor), BindingList()));
+    if (!loaded.back().first.is_valid())
+      return false;
+    BindingList &bindings = loaded.back().second;
+    for (uint32 j = 0; j < binding_count; ++j) {
+      Binding binding;
+      if (!ReadBinding(&reader, &binding))
+        return false;
+      if (binding.expires > now)
+        bindings.push_back(binding);
+    }
+  }
+  if (!reader.empty())
+    return false;
+
+  Clear();
+  for (std::vector<std::pair<SipURI, BindingList> >::iterator i =
+       loaded.begin(), ie = loaded.end(); i != ie; ++i) {
+    if (i->second.empty() || records_.count(i->first))
+      continue;
+    Record *record = new Record(i->first, &timer_wheel_);
+    record->bindings.swap(i->second);
+    binding_count_ += record->bindings.size();
+    records_.insert(std::make_pair(record->aor, record));
+    Refresh(record);
+  }
+  return true;
+}
+
+// static
+void LocationService::WriteBinding(const Binding &binding,
+                                   SnapshotWriter *writer) {
+  writer->WriteString(binding.contact.spec());
+  writer->WriteInt64(binding.expires.ToInternalValue());
+  writer->WriteUint32(static_cast<uint32>(binding.q));
+  writer->WriteString(binding.instance_id);
+  writer->WriteUint32(binding.reg_id);
+  writer->WriteString(binding.call_id);
+  writer->WriteUint32(binding.cseq);
+}
+
+// static
+bool LocationService::ReadBinding(SnapshotReader *reader, Binding *binding) {
+  std::string contact;
+  int64 expires;
+  uint32 q;
+  if (!reader->ReadString(&contact)
+      || !reader->ReadInt64(&expires)
+      || !reader->ReadUint32(&q)
+      || !reader->ReadString(&binding->instance_id)
+      || !reader->ReadUint32(&binding->reg_id)
+      || !reader->ReadString(&binding->call_id)
+      || !reader->ReadUint32(&binding->cseq))
+    return false;
+  binding->contact = SipURI(contact);
+  binding->expires = base::Time::FromInternalValue(expires);
+  binding->q = static_cast<int>(q);
+  return binding->contact.is_valid();
+}
+
+bool LocationService::SameBinding(const Binding &a, const Binding &b) {
+  // RFC 5626 section 6: flows of the same instance are told apart by their
+  // reg-id, as their Contact URIs may change.
+  if (!a.instance_id.empty() && a.reg_id && !b.instance_id.empty()
+      && b.reg_id)
+    return a.instance_id == b.instance_id && a.reg_id == b.reg_id;
+  return SipURIEquals(a.contact, b.contact);
+}
+
+LocationService::BindingList::iterator LocationService::FindBinding(
+    Record *record, const Binding &binding) {
+  BindingList::iterator i = record->bindings.begin();
+  for (; i != record->bindings.end(); ++i) {
+    if (SameBinding(*i, binding))
+      break;
+  }
+  return i;
+}
+
+bool LocationService::IsOutOfOrder(Record *record,
+                                   const Binding &binding,
+                                   const std::string &call_id,
+                                   uint32 cseq) {
+  BindingList::iterator i = FindBinding(record, binding);
+  return i != record->bindings.end() && i->call_id == call_id
+      && i->cseq >= cseq;
+}
+
+void LocationService::Refresh(Record *record) {
+  base::Time now = Now();
+  base::Time earliest;
+  BindingList &bindings = record->bindings;
+  for (BindingList::iterator i = bindings.begin(); i != bindings.end();) {
+    if (i->expires <= now) {
+      i = bindings.erase(i);
+      --binding_count_;
+      continue;
+    }
+    if (earliest.is_null() || i->expires < earliest)
+      earliest = i->expires;
+    ++i;
+  }
+  if (bindings.empty()) {
+    DestroyRecord(record);
+    return;
+  }
+  record->expiration_timer.Start(earliest - now,
+      base::Bind(&LocationService::OnRecordExpired, base::Unretained(this),
+                 record));
+}
+
+void LocationService::OnRecordExpired(Record *record) {
+  Refresh(record);
+}
+
+void LocationService::DestroyRecord(Record *record) {
+  binding_count_ -= record->bindings.size();
+  records_.erase(record->aor);
+  delete record;
+}
+
+void LocationService::Clear() {
+  STLDeleteContainerPairSecondPointers(records_.begin(), records_.end());
+  records_.clear();
+  binding_count_ = 0;
+}
+
+base::Time LocationService::Now() const {
+  return clock_ ? clock_->Now() : base::Time::Now();
+}
+
+} // namespace sippet
@@ -0,0 +1,183 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_UA_LOCATION_SERVICE_H_
+#define SIPPET_UA_LOCATION_SERVICE_H_
+
+#include <string>
+#include <vector>
+
+#include "base/containers/hash_tables.h"
+#include "base/time/time.h"
+#include "sippet/transport/timer_wheel.h"
+#include "sippet/uri/uri.h"
+
+namespace base {
+class Clock;
+class FilePath;
+}
+
+namespace sippet {
+
+class SnapshotReader;
+class SnapshotWriter;
+
+// The location service of a registrar (RFC 3261 section 10): it binds
+// addresses-of-record to the contact addresses registered for them.
+//
+// Each address-of-record keeps its bindings in a single vector, so that
+// looking it up touches a single hash table entry and a contiguous block of
+// bindings. Expired bindings are never returned, and are removed by one
+// timer per address-of-record, armed at its earliest expiration on a coarse
+// |TimerWheel|, so that a large number of registrations costs no more than
+// a slot link each.
+//
+// The table can be saved to and restored from a snapshot file, so that a
+// restarting registrar doesn't lose its registrations. Snapshots are read
+// through a memory mapping, and are only meant to be read back by the same
+// build on the same architecture.
+class LocationService {
+ public:
+  // A contact address registered for an address-of-record.
+  struct Binding {
+    Binding();
+    ~Binding();
+
+    // The registered Contact URI.
+    SipURI contact;
+    // When the binding expires; bindings updated with an expiration not in
+    // the future are removed.
+    base::Time expires;
+    // The Contact q-value, in thousandths, or -1 if absent.
+    int q;
+    // The +sip.instance and reg-id Contact parameters (RFC 5626), empty and
+    // zero if absent. Bindings with both are matched by them, instead of by
+    // their Contact URI, as each identifies a flow of the instance.
+    std::string instance_id;
+    uint32 reg_id;
+    // The Call-ID and CSeq of the REGISTER that last updated the binding.
+    std::string call_id;
+    uint32 cseq;
+  };
+
+  typedef std::vector<Binding> BindingList;
+
+  // Told of the requests applied by |Update| and |RemoveAll|, e.g. to carry
+  // them to the other nodes of a cluster (see |LocationCluster|).
+  class Observer {
+   public:
+    virtual ~Observer() {}
+
+    virtual void OnBindingsUpdated(const SipURI &aor,
+                                   const std::string &call_id,
+                                   uint32 cseq,
+                                   const BindingList &bindings) = 0;
+    virtual void OnBindingsRemoved(const SipURI &aor,
+                                   const std::string &call_id,
+                                   uint32 cseq) = 0;
+  };
+
+  // Resolution of the wheel expiring the bindings.
+  static const int kExpirationResolutionSeconds = 1;
+
+  LocationService();
+  ~LocationService();
+
+  // Number of addresses-of-record with bindings.
+  size_t size() const { return records_.size(); }
+
+  // Number of bindings, of all addresses-of-record.
+  size_t binding_count() const { return binding_count_; }
+
+  // Applies the bindings of a REGISTER request to |aor|: each one is added,
+  // refreshed or removed, according to its |expires|. |call_id| and |cseq|
+  // come from the request. Returns false, changing nothing, if a binding
+  // being updated was last updated by a request with the same Call-ID and a
+  // CSeq not lower than |cseq|; that is, an out of order request.
+  bool Update(const SipURI &aor,
+              const std::string &call_id,
+              uint32 cseq,
+              const BindingList &bindings);
+
+  // Removes all bindings of |aor|, as a "Contact: *" request does, subject
+  // to the same Call-ID and CSeq check as |Update|.
+  bool RemoveAll(const SipURI &aor, const std::string &call_id, uint32 cseq);
+
+  // Gets the current bindings of |aor|, highest q-values first. Returns
+  // false if there's none.
+  bool Lookup(const SipURI &aor, BindingList *bindings) const;
+
+  // Sets the observer of the changes, which must outlive the service, or
+  // none if NULL.
+  void set_observer(Observer *observer) { observer_ = observer; }
+
+  // The encoding of a binding, shared by the snapshots and the
+  // |LocationCluster|.
+  static void WriteBinding(const Binding &binding, SnapshotWriter *writer);
+  static bool ReadBinding(SnapshotReader *reader, Binding *binding);
+
+  // Saves all bindings to |path|, atomically replacing it.
+  bool SaveSnapshot(const base::FilePath &path) const;
+
+  // Replaces all bindings with the ones saved to |path|, dropping those
+  // expired meanwhile. Returns false, keeping the current bindings, if the
+  // snapshot can't be read.
+  bool LoadSnapshot(const base::FilePath &path);
+
+  // Sets the clock used to expire the bindings. Not owned.
+  void set_clock_for_testing(base::Clock *clock) {
+    clock_ = clock;
+  }
+
+ private:
+  struct Record {
+    Record(const SipURI &aor, TimerWheel *timer_wheel);
+    ~Record();
+
+    SipURI aor;
+    BindingList bindings;
+    TimerWheel::Timer expiration_timer;
+
+    DISALLOW_COPY_AND_ASSIGN(Record);
+  };
+
+  typedef base::hash_map<SipURI, Record*, SipURIHasher, SipURIEqualTo>
+      RecordMap;
+
+  // Returns true if |a| and |b| bind the same contact.
+  static bool SameBinding(const Binding &a, const Binding &b);
+
+  // Returns the binding of |record| that |binding| updates, if any, or the
+  // end of its bindings otherwise.
+  static BindingList::iterator FindBinding(Record *record,
+                                           const Binding &binding);
+
+  // Returns true if a binding of |record| would be updated by |binding| of
+  // a request out of order.
+  static bool IsOutOfOrder(Record *record,
+                           const Binding &binding,
+                           const std::string &call_id,
+                           uint32 cseq);
+
+  // Removes the expired bindings of |record|, and destroys it if there are
+  // none left. Otherwise, arms its timer at the earliest expiration.
+  void Refresh(Record *record);
+  void OnRecordExpired(Record *record);
+  void DestroyRecord(Record *record);
+  void Clear();
+
+  base::Time Now() const;
+
+  RecordMap records_;
+  size_t binding_count_;
+  TimerWheel timer_wheel_;
+  Observer *observer_;
+  base::Clock *clock_;
+
+  DISALLOW_COPY_AND_ASSIGN(LocationService);
+};
+
+} // namespace sippet
+
+#endif // SIPPET_UA_LOCATION_SERVICE_H_
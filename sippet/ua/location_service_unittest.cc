@@ -0,0 +1,190 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/ua/location_service.h"
+
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/test/simple_test_clock.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+const char kAlice[] = "sip:alice@atlanta.com";
+const char kCallId[] = "a84b4c76e66710@pc33.atlanta.com";
+
+}  // namespace
+
+class LocationServiceTest : public testing::Test {
+ public:
+  LocationServiceTest() {
+    clock_.SetNow(base::Time::Now());
+    location_service_.set_clock_for_testing(&clock_);
+  }
+
+  LocationService::Binding CreateBinding(const char *contact,
+                                         int seconds,
+                                         int q = -1) {
+    LocationService::Binding binding;
+    binding.contact = SipURI(contact);
+    binding.expires = clock_.Now() + base::TimeDelta::FromSeconds(seconds);
+    binding.q = q;
+    return binding;
+  }
+
+  bool Update(const char *call_id, uint32 cseq,
+              const LocationService::Binding &binding) {
+    LocationService::BindingList bindings(1, binding);
+    return location_service_.Update(SipURI(kAlice), call_id, cseq, bindings);
+  }
+
+  LocationService::BindingList Lookup() {
+    LocationService::BindingList bindings;
+    location_service_.Lookup(SipURI(kAlice), &bindings);
+    return bindings;
+  }
+
+ protected:
+  base::SimpleTestClock clock_;
+  LocationService location_service_;
+};
+
+TEST_F(LocationServiceTest, AddRefreshAndRemove) {
+  LocationService::BindingList bindings;
+  bindings.push_back(CreateBinding("sip:alice@192.0.2.4", 3600, 500));
+  bindings.push_back(CreateBinding("sip:alice@192.0.2.5", 3600));
+  EXPECT_TRUE(location_service_.Update(SipURI(kAlice), kCallId, 1,
+                                       bindings));
+  EXPECT_EQ(1u, location_service_.size());
+  EXPECT_EQ(2u, location_service_.binding_count());
+
+  // The address-of-record is compared as a SIP-URI.
+  EXPECT_TRUE(location_service_.Lookup(SipURI("sip:alice@ATLANTA.com"),
+                                       &bindings));
+  ASSERT_EQ(2u, bindings.size());
+  EXPECT_EQ("sip:alice@192.0.2.5", bindings[0].contact.spec());
+  EXPECT_EQ("sip:alice@192.0.2.4", bindings[1].contact.spec());
+  EXPECT_EQ(kCallId, bindings[1].call_id);
+  EXPECT_EQ(1u, bindings[1].cseq);
+
+  // Refreshing updates the binding in place.
+  EXPECT_TRUE(Update(kCallId, 2,
+                     CreateBinding("sip:alice@192.0.2.4", 7200, 900)));
+  bindings = Lookup();
+  ASSERT_EQ(2u, bindings.size());
+  EXPECT_EQ("sip:alice@192.0.2.4", bindings[1].contact.spec());
+  EXPECT_EQ(900, bindings[1].q);
+  EXPECT_EQ(2u, bindings[1].cseq);
+
+  // A zero expiration removes it.
+  EXPECT_TRUE(Update(kCallId, 3, CreateBinding("sip:alice@192.0.2.4", 0)));
+  bindings = Lookup();
+  ASSERT_EQ(1u, bindings.size());
+  EXPECT_EQ("sip:alice@192.0.2.5", bindings[0].contact.spec());
+  EXPECT_EQ(1u, location_service_.binding_count());
+
+  EXPECT_TRUE(Update(kCallId, 4, CreateBinding("sip:alice@192.0.2.5", 0)));
+  EXPECT_FALSE(location_service_.Lookup(SipURI(kAlice), &bindings));
+  EXPECT_EQ(0u, location_service_.size());
+  EXPECT_EQ(0u, location_service_.binding_count());
+}
+
+TEST_F(LocationServiceTest, OutOfOrderRequestsChangeNothing) {
+  EXPECT_TRUE(Update(kCallId, 5, CreateBinding("sip:alice@192.0.2.4", 60)));
+  EXPECT_FALSE(Update(kCallId, 5, CreateBinding("sip:alice@192.0.2.4", 0)));
+  EXPECT_FALSE(Update(kCallId, 4, CreateBinding("sip:alice@192.0.2.4", 0)));
+  EXPECT_FALSE(location_service_.RemoveAll(SipURI(kAlice), kCallId, 5));
+  EXPECT_EQ(1u, Lookup().size());
+
+  // Other Call-IDs aren't ordered.
+  EXPECT_TRUE(Update("other", 1, CreateBinding("sip:alice@192.0.2.4", 0)));
+  EXPECT_TRUE(Lookup().empty());
+}
+
+TEST_F(LocationServiceTest, OutboundFlowsMatchByInstanceAndRegId) {
+  LocationService::Binding first(CreateBinding("sip:alice@192.0.2.4", 60));
+  first.instance_id = "\"<urn:uuid:00000000-0000-1000-8000-AABBCCDDEEFF>\"";
+  first.reg_id = 1;
+  EXPECT_TRUE(Update(kCallId, 1, first));
+
+  // Same flow, from another address.
+  LocationService::Binding moved(first);
+  moved.contact = SipURI("sip:alice@192.0.2.9");
+  EXPECT_TRUE(Update(kCallId, 2, moved));
+  LocationService::BindingList bindings(Lookup());
+  ASSERT_EQ(1u, bindings.size());
+  EXPECT_EQ("sip:alice@192.0.2.9", bindings[0].contact.spec());
+
+  // Another flow of the same instance.
+  LocationService::Binding second(moved);
+  second.reg_id = 2;
+  EXPECT_TRUE(Update(kCallId, 3, second));
+  EXPECT_EQ(2u, Lookup().size());
+}
+
+TEST_F(LocationServiceTest, RemoveAll) {
+  LocationService::BindingList bindings;
+  bindings.push_back(CreateBinding("sip:alice@192.0.2.4", 60));
+  bindings.push_back(CreateBinding("sip:alice@192.0.2.5", 60));
+  EXPECT_TRUE(location_service_.Update(SipURI(kAlice), kCallId, 1,
+                                       bindings));
+  EXPECT_TRUE(location_service_.RemoveAll(SipURI(kAlice), kCallId, 2));
+  EXPECT_TRUE(Lookup().empty());
+  EXPECT_EQ(0u, location_service_.binding_count());
+}
+
+TEST_F(LocationServiceTest, ExpiredBindingsAreNotReturned) {
+  EXPECT_TRUE(Update(kCallId, 1, CreateBinding("sip:alice@192.0.2.4", 60)));
+  EXPECT_TRUE(Update(kCallId, 2, CreateBinding("sip:alice@192.0.2.5", 120)));
+  clock_.Advance(base::TimeDelta::FromSeconds(60));
+  LocationService::BindingList bindings(Lookup());
+  ASSERT_EQ(1u, bindings.size());
+  EXPECT_EQ("sip:alice@192.0.2.5", bindings[0].contact.spec());
+}
+
+TEST_F(LocationServiceTest, Snapshot) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath path(temp_dir.path().AppendASCII("location"));
+
+  LocationService::Binding binding(
+      CreateBinding("sip:alice@192.0.2.4;transport=tcp", 60, 700));
+  binding.instance_id = "\"<urn:uuid:00000000-0000-1000-8000-AABBCCDDEEFF>\"";
+  binding.reg_id = 1;
+  EXPECT_TRUE(Update(kCallId, 1, binding));
+  EXPECT_TRUE(Update(kCallId, 2, CreateBinding("sip:alice@192.0.2.5", 30)));
+  ASSERT_TRUE(location_service_.SaveSnapshot(path));
+
+  // Bindings expired meanwhile aren't restored.
+  clock_.Advance(base::TimeDelta::FromSeconds(30));
+  LocationService restored;
+  restored.set_clock_for_testing(&clock_);
+  ASSERT_TRUE(restored.LoadSnapshot(path));
+  EXPECT_EQ(1u, restored.size());
+  EXPECT_EQ(1u, restored.binding_count());
+  LocationService::BindingList bindings;
+  ASSERT_TRUE(restored.Lookup(SipURI(kAlice), &bindings));
+  ASSERT_EQ(1u, bindings.size());
+  EXPECT_EQ("sip:alice@192.0.2.4;transport=tcp", bindings[0].contact.spec());
+  EXPECT_EQ(binding.expires, bindings[0].expires);
+  EXPECT_EQ(700, bindings[0].q);
+  EXPECT_EQ(binding.instance_id, bindings[0].instance_id);
+  EXPECT_EQ(1u, bindings[0].reg_id);
+  EXPECT_EQ(kCallId, bindings[0].call_id);
+  EXPECT_EQ(1u, bindings[0].cseq);
+
+  // A truncated snapshot is rejected, keeping the current bindings.
+  std::string data;
+  ASSERT_TRUE(base::ReadFileToString(path, &data));
+  data.resize(data.size() - 1);
+  ASSERT_EQ(static_cast<int>(data.size()),
+            base::WriteFile(path, data.data(), data.size()));
+  EXPECT_FALSE(restored.LoadSnapshot(path));
+  EXPECT_EQ(1u, restored.binding_count());
+}
+
+} // namespace sippet
@@ -5,6 +5,7 @@
 #ifndef SIPPET_UA_PASSWORD_HANDLER_H_
 #define SIPPET_UA_PASSWORD_HANDLER_H_
 
+#include "base/memory/ref_counted.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/strings/string16.h"
 #include "net/base/completion_callback.h"
@@ -15,6 +16,8 @@ class AuthChallengeInfo;
 
 namespace sippet {
 
+class Request;
+
 // This is the interface for the application-specific class that will route
 // authentication info to the user and collect his username and password.
 class PasswordHandler {
@@ -25,6 +28,14 @@ class PasswordHandler {
 
     // Returns the application-specific |PasswordHandler| implementation.
     virtual scoped_ptr<PasswordHandler> CreatePasswordHandler() = 0;
+
+    // Returns the implementation for the credentials of |request|. All
+    // requests share the same one, unless a |UserAgent| sends requests of
+    // several accounts.
+    virtual scoped_ptr<PasswordHandler> CreatePasswordHandlerForRequest(
+        const scoped_refptr<Request> &request) {
+      return CreatePasswordHandler();
+    }
   };
 
   virtual ~PasswordHandler() {}
@@ -36,6 +47,11 @@ class PasswordHandler {
                              base::string16 *username,
                              base::string16 *password,
                              const net::CompletionCallback& callback) = 0;
+
+  // Tells that the credentials given for |auth_info| were rejected, before
+  // asking them again. Handlers caching credentials shall drop them.
+  virtual void OnCredentialsRejected(const net::AuthChallengeInfo* auth_info) {
+  }
 };
 
 } // namespace sippet
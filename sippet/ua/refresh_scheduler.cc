@@ -0,0 +1,129 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/ua/refresh_scheduler.h"
+
+#include <algorithm>
+
+#include "base/bind.h"
+#include "base/logging.h"
+#include "base/rand_util.h"
+#include "base/time/tick_clock.h"
+
+namespace sippet {
+
+namespace {
+
+// Refreshes are sent this long before the binding expires, at most, so
+// that a transaction can complete in time.
+const int kMaxRefreshMarginSeconds = 32;
+
+}  // namespace
+
+RefreshScheduler::Refresh::Refresh(RefreshScheduler *scheduler,
+                                   const base::Closure &task)
+  : scheduler_(scheduler),
+    task_(task),
+    failures_(0),
+    paced_(false),
+    timer_(scheduler->timer_wheel()) {
+  DCHECK(!task.is_null());
+}
+
+RefreshScheduler::Refresh::~Refresh() {
+}
+
+void RefreshScheduler::Refresh::ScheduleRefresh(
+    const base::TimeDelta &expires) {
+  failures_ = 0;
+  Start(scheduler_->GetRefreshDelay(expires));
+}
+
+void RefreshScheduler::Refresh::ScheduleRetry() {
+  Start(scheduler_->GetRetryDelay(failures_++));
+}
+
+void RefreshScheduler::Refresh::ScheduleNow() {
+  Start(base::TimeDelta());
+}
+
+void RefreshScheduler::Refresh::Cancel() {
+  timer_.Stop();
+}
+
+void RefreshScheduler::Refresh::Start(const base::TimeDelta &delay) {
+  paced_ = false;
+  timer_.Start(delay, base::Bind(&Refresh::OnTimer, base::Unretained(this)));
+}
+
+void RefreshScheduler::Refresh::OnTimer() {
+  if (!paced_) {
+    base::TimeDelta wait(scheduler_->ReserveTurn());
+    if (wait > base::TimeDelta()) {
+      paced_ = true;
+      timer_.Start(wait,
+          base::Bind(&Refresh::OnTimer, base::Unretained(this)));
+      return;
+    }
+  }
+  paced_ = false;
+  task_.Run();
+}
+
+RefreshScheduler::RefreshScheduler(TimerWheel *timer_wheel, int max_rate)
+  : timer_wheel_(timer_wheel),
+    interval_(base::TimeDelta::FromSeconds(1) / std::max(max_rate, 1)),
+    tick_clock_(nullptr),
+    rand_int_(base::Bind(&base::RandInt)) {
+  DCHECK(timer_wheel);
+}
+
+RefreshScheduler::~RefreshScheduler() {
+}
+
+base::TimeDelta RefreshScheduler::GetRefreshDelay(
+    const base::TimeDelta &expires) const {
+  if (expires <= base::TimeDelta())
+    return base::TimeDelta();
+  base::TimeDelta latest(expires - std::min(
+      base::TimeDelta::FromSeconds(kMaxRefreshMarginSeconds), expires / 2));
+  if (alignment_ > base::TimeDelta()) {
+    // Bindings shorter than the alignment may have no boundary in time.
+    int64 due = (Now() - base::TimeTicks() + latest).InMicroseconds();
+    base::TimeDelta aligned(latest -
+        base::TimeDelta::FromMicroseconds(due % alignment_.InMicroseconds()));
+    if (aligned > base::TimeDelta())
+      return aligned;
+  }
+  return RandDelay(latest - latest / 4, latest);
+}
+
+base::TimeDelta RefreshScheduler::GetRetryDelay(int failures) const {
+  // The doubling stops long before overflowing.
+  base::TimeDelta max(base::TimeDelta::FromSeconds(kMaxRetrySeconds));
+  base::TimeDelta delay(base::TimeDelta::FromSeconds(kBaseRetrySeconds));
+  for (int i = 0; i < failures && delay < max; ++i)
+    delay *= 2;
+  delay = std::min(delay, max);
+  return RandDelay(delay / 2, delay);
+}
+
+base::TimeDelta RefreshScheduler::ReserveTurn() {
+  base::TimeTicks now(Now());
+  base::TimeTicks turn(std::max(now, next_turn_));
+  next_turn_ = turn + interval_;
+  return turn - now;
+}
+
+base::TimeTicks RefreshScheduler::Now() const {
+  return tick_clock_ ? tick_clock_->NowTicks() : base::TimeTicks::Now();
+}
+
+base::TimeDelta RefreshScheduler::RandDelay(const base::TimeDelta &min,
+                                            const base::TimeDelta &max) const {
+  int window = static_cast<int>((max - min).InMilliseconds());
+  return min + base::TimeDelta::FromMilliseconds(rand_int_.Run(0, window));
+}
+
+} // namespace sippet
@@ -0,0 +1,137 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_UA_REFRESH_SCHEDULER_H_
+#define SIPPET_UA_REFRESH_SCHEDULER_H_
+
+#include "base/callback.h"
+#include "base/time/time.h"
+#include "net/base/rand_callback.h"
+#include "sippet/transport/timer_wheel.h"
+
+namespace base {
+class TickClock;
+}
+
+namespace sippet {
+
+// Schedules the refreshes of many soft-state bindings, such as the
+// registrations of the lines of a user agent, so that bindings created
+// together don't hit their server together forever:
+//  - each refresh is sent at a random point of the last quarter of the
+//    binding lifetime, leaving time for one transaction before it expires;
+//  - failed refreshes are retried after a random fraction of a delay that
+//    doubles with each consecutive failure (RFC 5626 section 4.5), which
+//    spreads the lines again after a mass failure, such as a registrar
+//    restart;
+//  - no more than |max_rate| refreshes are sent per second: those due
+//    meanwhile wait for their turn.
+//
+// On mobile devices, refreshes can rather be aligned on the windows of the
+// platform alarms (see |set_alignment|), so that they wake the radio along
+// with the other periodic work of the device; the rate still spreads them.
+//
+// Refreshes run on a |TimerWheel|, so that they are released in batches of
+// one wheel tick. It's meant to be used from the thread of the wheel.
+class RefreshScheduler {
+ public:
+  // Default maximum number of refreshes sent per second.
+  static const int kDefaultMaxRate = 50;
+  // Delay before the first retry, in seconds (RFC 5626 section 4.5).
+  static const int kBaseRetrySeconds = 30;
+  // Retries are never delayed longer, in seconds.
+  static const int kMaxRetrySeconds = 1800;
+
+  // The refresh of a single binding, whose task runs when due. Destroying
+  // it cancels the refresh. The scheduler must outlive it.
+  class Refresh {
+   public:
+    Refresh(RefreshScheduler *scheduler, const base::Closure &task);
+    ~Refresh();
+
+    // Returns true while the task is about to run.
+    bool IsScheduled() const { return timer_.IsRunning(); }
+
+    // Consecutive failures since the last refresh scheduled.
+    int failures() const { return failures_; }
+
+    // Schedules the refresh of a binding expiring in |expires|, after a
+    // successful refresh.
+    void ScheduleRefresh(const base::TimeDelta &expires);
+
+    // Schedules another attempt after a failure.
+    void ScheduleRetry();
+
+    // Runs the task as soon as the rate allows, as when the binding has to
+    // be refreshed at once.
+    void ScheduleNow();
+
+    void Cancel();
+
+   private:
+    void Start(const base::TimeDelta &delay);
+    void OnTimer();
+
+    RefreshScheduler *scheduler_;
+    base::Closure task_;
+    int failures_;
+    // Set once the refresh got its turn.
+    bool paced_;
+    TimerWheel::Timer timer_;
+
+    DISALLOW_COPY_AND_ASSIGN(Refresh);
+  };
+
+  // |timer_wheel| isn't owned, and must outlive the scheduler.
+  explicit RefreshScheduler(TimerWheel *timer_wheel,
+                            int max_rate = kDefaultMaxRate);
+  ~RefreshScheduler();
+
+  TimerWheel *timer_wheel() const { return timer_wheel_; }
+
+  // Refreshes of bindings lasting long enough are sent at the last multiple
+  // of |alignment| of the clock before they are due, instead of at random.
+  // Zero (default) doesn't align them.
+  void set_alignment(const base::TimeDelta &alignment) {
+    alignment_ = alignment;
+  }
+
+  // When to refresh a binding expiring in |expires|.
+  base::TimeDelta GetRefreshDelay(const base::TimeDelta &expires) const;
+
+  // When to retry after |failures| consecutive failures.
+  base::TimeDelta GetRetryDelay(int failures) const;
+
+  // Reserves the next turn to send a refresh due now, returning how long
+  // it has to wait for it.
+  base::TimeDelta ReserveTurn();
+
+  void set_tick_clock_for_testing(base::TickClock *tick_clock) {
+    tick_clock_ = tick_clock;
+  }
+  void set_rand_int_for_testing(const net::RandIntCallback &rand_int) {
+    rand_int_ = rand_int;
+  }
+
+ private:
+  base::TimeTicks Now() const;
+
+  // A random delay between |min| and |max|.
+  base::TimeDelta RandDelay(const base::TimeDelta &min,
+                            const base::TimeDelta &max) const;
+
+  TimerWheel *timer_wheel_;
+  base::TimeDelta interval_;
+  base::TimeDelta alignment_;
+  // The first turn not taken yet.
+  base::TimeTicks next_turn_;
+  base::TickClock *tick_clock_;
+  net::RandIntCallback rand_int_;
+
+  DISALLOW_COPY_AND_ASSIGN(RefreshScheduler);
+};
+
+} // namespace sippet
+
+#endif // SIPPET_UA_REFRESH_SCHEDULER_H_
@@ -0,0 +1,98 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/ua/refresh_scheduler.h"
+
+#include "base/bind.h"
+#include "base/test/simple_test_tick_clock.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+int MinRandInt(int min, int max) {
+  return min;
+}
+
+int MaxRandInt(int min, int max) {
+  return max;
+}
+
+}  // namespace
+
+class RefreshSchedulerTest : public testing::Test {
+ public:
+  RefreshSchedulerTest()
+    : scheduler_(&timer_wheel_, 10) {
+    clock_.Advance(base::TimeDelta::FromSeconds(1));
+    scheduler_.set_tick_clock_for_testing(&clock_);
+  }
+
+  base::SimpleTestTickClock clock_;
+  TimerWheel timer_wheel_;
+  RefreshScheduler scheduler_;
+};
+
+TEST_F(RefreshSchedulerTest, RefreshBeforeExpiration) {
+  base::TimeDelta expires(base::TimeDelta::FromSeconds(3600));
+
+  scheduler_.set_rand_int_for_testing(base::Bind(&MaxRandInt));
+  EXPECT_EQ(base::TimeDelta::FromSeconds(3600 - 32),
+            scheduler_.GetRefreshDelay(expires));
+
+  scheduler_.set_rand_int_for_testing(base::Bind(&MinRandInt));
+  EXPECT_EQ(base::TimeDelta::FromSeconds(3568 - 892),
+            scheduler_.GetRefreshDelay(expires));
+}
+
+TEST_F(RefreshSchedulerTest, ShortBindingRefreshedAtHalf) {
+  scheduler_.set_rand_int_for_testing(base::Bind(&MaxRandInt));
+  EXPECT_EQ(base::TimeDelta::FromSeconds(20),
+            scheduler_.GetRefreshDelay(base::TimeDelta::FromSeconds(40)));
+  EXPECT_EQ(base::TimeDelta(),
+            scheduler_.GetRefreshDelay(base::TimeDelta()));
+}
+
+TEST_F(RefreshSchedulerTest, AlignedRefresh) {
+  scheduler_.set_alignment(base::TimeDelta::FromSeconds(900));
+  scheduler_.set_rand_int_for_testing(base::Bind(&MaxRandInt));
+
+  // Due at 3569s of the clock, sent at 2700s.
+  EXPECT_EQ(base::TimeDelta::FromSeconds(2699),
+            scheduler_.GetRefreshDelay(base::TimeDelta::FromSeconds(3600)));
+
+  // No boundary before a shorter binding is due.
+  EXPECT_EQ(base::TimeDelta::FromSeconds(568),
+            scheduler_.GetRefreshDelay(base::TimeDelta::FromSeconds(600)));
+}
+
+TEST_F(RefreshSchedulerTest, RetryBackoff) {
+  scheduler_.set_rand_int_for_testing(base::Bind(&MaxRandInt));
+  EXPECT_EQ(base::TimeDelta::FromSeconds(30), scheduler_.GetRetryDelay(0));
+  EXPECT_EQ(base::TimeDelta::FromSeconds(60), scheduler_.GetRetryDelay(1));
+  EXPECT_EQ(base::TimeDelta::FromSeconds(960), scheduler_.GetRetryDelay(5));
+  EXPECT_EQ(base::TimeDelta::FromSeconds(1800), scheduler_.GetRetryDelay(6));
+  EXPECT_EQ(base::TimeDelta::FromSeconds(1800),
+            scheduler_.GetRetryDelay(1000));
+
+  scheduler_.set_rand_int_for_testing(base::Bind(&MinRandInt));
+  EXPECT_EQ(base::TimeDelta::FromSeconds(15), scheduler_.GetRetryDelay(0));
+  EXPECT_EQ(base::TimeDelta::FromSeconds(900), scheduler_.GetRetryDelay(6));
+}
+
+TEST_F(RefreshSchedulerTest, TurnsAreRateLimited) {
+  base::TimeDelta interval(base::TimeDelta::FromMilliseconds(100));
+
+  EXPECT_EQ(base::TimeDelta(), scheduler_.ReserveTurn());
+  EXPECT_EQ(interval, scheduler_.ReserveTurn());
+  EXPECT_EQ(interval * 2, scheduler_.ReserveTurn());
+
+  // Turns not taken aren't accumulated.
+  clock_.Advance(base::TimeDelta::FromSeconds(10));
+  EXPECT_EQ(base::TimeDelta(), scheduler_.ReserveTurn());
+  EXPECT_EQ(interval, scheduler_.ReserveTurn());
+}
+
+} // namespace sippet
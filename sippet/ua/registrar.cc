@@ -0,0 +1,245 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/ua/registrar.h"
+
+#include <algorithm>
+
+#include "base/bind.h"
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+#include "net/base/completion_callback.h"
+#include "sippet/message/headers.h"
+#include "sippet/message/request.h"
+#include "sippet/message/response.h"
+
+namespace sippet {
+
+namespace {
+
+// Contact parameters of RFC 5626.
+const char kInstanceParam[] = "+sip.instance";
+const char kRegIdParam[] = "reg-id";
+
+// RFC 3261 section 10.3, step 5: the address-of-record is the To URI
+// without its parameters and headers.
+SipURI GetAddressOfRecord(const SipURI &to) {
+  std::string aor(to.scheme());
+  aor.append(":");
+  if (to.has_username()) {
+    aor.append(to.username());
+    aor.append("@");
+  }
+  aor.append(to.host());
+  if (to.has_port()) {
+    aor.append(":");
+    aor.append(to.port());
+  }
+  return SipURI(aor);
+}
+
+}  // namespace
+
+Registrar::Registrar(ua::UserAgent *user_agent,
+                     LocationService *location_service)
+  : user_agent_(user_agent),
+    location_service_(location_service),
+    authenticator_(NULL),
+    default_expires_(kDefaultExpires),
+    min_expires_(kDefaultMinExpires),
+    max_expires_(kDefaultMaxExpires),
+    weak_factory_(this) {
+  DCHECK(user_agent);
+  DCHECK(location_service);
+}
+
+Registrar::~Registrar() {
+}
+
+void Registrar::OnChannelConnected(const EndPoint &destination, int err) {
+  // Nothing to do
+}
+
+void Registrar::OnChannelClosed(const EndPoint &destination) {
+  // Nothing to do
+}
+
+void Registrar::OnIncomingRequest(
+    const scoped_refptr<Request> &incoming_request,
+    const scoped_refptr<Dialog> &dialog) {
+  if (Method::REGISTER != incoming_request->method())
+    return;
+  if (!authenticator_) {
+    ProcessRegister(incoming_request);
+    return;
+  }
+  DigestAuthenticator::Result result = authenticator_->Verify(
+      incoming_request, base::Bind(&Registrar::OnVerifyComplete,
+                                   weak_factory_.GetWeakPtr(),
+                                   incoming_request));
+  if (DigestAuthenticator::RESULT_PENDING != result)
+    HandleVerifyResult(incoming_request, result);
+}
+
+void Registrar::OnIncomingResponse(
+    const scoped_refptr<Response> &incoming_response,
+    const scoped_refptr<Dialog> &dialog) {
+  // Nothing to do
+}
+
+void Registrar::OnTimedOut(
+    const scoped_refptr<Request> &request,
+    const scoped_refptr<Dialog> &dialog) {
+  // Nothing to do
+}
+
+void Registrar::OnTransportError(
+    const scoped_refptr<Request> &request, int error,
+    const scoped_refptr<Dialog> &dialog) {
+  // Nothing to do
+}
+
+void Registrar::OnVerifyComplete(const scoped_refptr<Request> &request,
+                                 DigestAuthenticator::Result result) {
+  HandleVerifyResult(request, result);
+}
+
+void Registrar::HandleVerifyResult(const scoped_refptr<Request> &request,
+                                   DigestAuthenticator::Result result) {
+  switch (result) {
+    case DigestAuthenticator::RESULT_AUTHORIZED:
+      ProcessRegister(request);
+      break;
+    case DigestAuthenticator::RESULT_NO_CREDENTIALS:
+    case DigestAuthenticator::RESULT_STALE: {
+      scoped_refptr<Response> response(
+          request->CreateResponse(SIP_UNAUTHORIZED));
+      authenticator_->AddChallenges(response,
+          DigestAuthenticator::RESULT_STALE == result);
+      SendResponse(response);
+      break;
+    }
+    default:
+      SendResponse(request, SIP_FORBIDDEN);
+      break;
+  }
+}
+
+void Registrar::ProcessRegister(const scoped_refptr<Request> &request) {
+  // Read only, as it may be shared.
+  const Request *const_request = request.get();
+  const CallId *call_id = const_request->get<CallId>();
+  const Cseq *cseq = const_request->get<Cseq>();
+  if (!call_id || !cseq) {
+    SendResponse(request, SIP_BAD_REQUEST);
+    return;
+  }
+  const To *to = const_request->get<To>();
+  if (!to || !to->sip_address().is_valid()) {
+    SendResponse(request, SIP_NOT_FOUND);
+    return;
+  }
+  SipURI aor(GetAddressOfRecord(to->sip_address()));
+  const Expires *expires = const_request->get<Expires>();
+  unsigned request_expires = expires ? expires->value() : default_expires_;
+
+  base::Time now = base::Time::Now();
+  bool remove_all = false;
+  int contact_headers = 0;
+  LocationService::BindingList bindings;
+  for (Message::const_iterator i = const_request->find_first<Contact>(),
+       ie = const_request->end(); i != ie;
+       i = const_request->find_next<Contact>(i)) {
+    const Contact *contact = dyn_cast<Contact>(i);
+    ++contact_headers;
+    if (contact->is_all()) {
+      remove_all = true;
+      continue;
+    }
+    for (Contact::const_iterator j = contact->begin(), je = contact->end();
+         j != je; ++j) {
+      unsigned seconds = j->HasExpires() ? j->expires() : request_expires;
+      if (seconds != 0 && seconds < min_expires_) {
+        scoped_refptr<Response> response(
+            request->CreateResponse(SIP_INTERVAL_TOO_BRIEF));
+        scoped_ptr<MinExpires> min_expires(new MinExpires(min_expires_));
+        response->push_back(min_expires.Pass());
+        SendResponse(response);
+        return;
+      }
+      LocationService::Binding binding;
+      binding.contact = j->sip_address();
+      if (!binding.contact.is_valid()) {
+        SendResponse(request, SIP_BAD_REQUEST);
+        return;
+      }
+      binding.expires = now + base::TimeDelta::FromSeconds(
+          std::min(seconds, max_expires_));
+      if (j->HasQvalue())
+        binding.q = static_cast<int>(j->qvalue() * 1000 + 0.5);
+      ContactInfo::const_param_iterator k = j->param_find(kInstanceParam);
+      if (j->param_end() != k)
+        binding.instance_id = k->second;
+      k = j->param_find(kRegIdParam);
+      if (j->param_end() != k)
+        base::StringToUint(k->second, &binding.reg_id);
+      bindings.push_back(binding);
+    }
+  }
+
+  bool updated;
+  if (remove_all) {
+    // Only allowed alone, and with a zero Expires (section 10.3, step 6).
+    if (1 != contact_headers || !bindings.empty() || !expires
+        || 0 != expires->value()) {
+      SendResponse(request, SIP_BAD_REQUEST);
+      return;
+    }
+    updated = location_service_->RemoveAll(aor, call_id->value(),
+                                           cseq->sequence());
+  } else {
+    updated = location_service_->Update(aor, call_id->value(),
+                                        cseq->sequence(), bindings);
+  }
+  if (!updated) {
+    DVLOG(1) << "Out of order REGISTER for " << aor.spec();
+    SendResponse(request, SIP_SERVER_INTERNAL_ERROR);
+    return;
+  }
+
+  // Answer with all current bindings, and their remaining time.
+  scoped_refptr<Response> response(request->CreateResponse(SIP_OK));
+  LocationService::BindingList current;
+  if (location_service_->Lookup(aor, &current)) {
+    scoped_ptr<Contact> contact(new Contact);
+    for (LocationService::BindingList::const_iterator i = current.begin(),
+         ie = current.end(); i != ie; ++i) {
+      ContactInfo info(GURL(i->contact.spec()));
+      int64 remaining = (i->expires - now).InSeconds();
+      info.set_expires(static_cast<unsigned>(std::max<int64>(remaining, 1)));
+      if (i->q > 0)
+        info.set_qvalue(i->q / 1000.0);
+      if (!i->instance_id.empty())
+        info.param_set(kInstanceParam, i->instance_id);
+      if (i->reg_id)
+        info.param_set(kRegIdParam, base::UintToString(i->reg_id));
+      contact->push_back(info);
+    }
+    response->push_back(contact.Pass());
+  }
+  scoped_ptr<Date> date(new Date(now));
+  response->push_back(date.Pass());
+  SendResponse(response);
+}
+
+void Registrar::SendResponse(const scoped_refptr<Request> &request,
+                             StatusCode code) {
+  SendResponse(request->CreateResponse(code));
+}
+
+void Registrar::SendResponse(const scoped_refptr<Response> &response) {
+  user_agent_->Send(response, net::CompletionCallback());
+}
+
+} // namespace sippet
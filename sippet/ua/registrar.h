@@ -0,0 +1,88 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_UA_REGISTRAR_H_
+#define SIPPET_UA_REGISTRAR_H_
+
+#include "base/memory/weak_ptr.h"
+#include "sippet/message/status_code.h"
+#include "sippet/ua/digest_authenticator.h"
+#include "sippet/ua/location_service.h"
+#include "sippet/ua/ua_user_agent.h"
+
+namespace sippet {
+
+// A registrar (RFC 3261 section 10.3): it answers the REGISTER requests
+// received by a |UserAgent|, keeping their bindings in a |LocationService|
+// that proxies can then look up. Other requests are left for the other
+// handlers of the |UserAgent|.
+//
+// When a |DigestAuthenticator| is set, requests are only accepted once
+// their credentials are verified, and challenged otherwise.
+class Registrar : public ua::UserAgent::Delegate {
+ public:
+  // Expiration of bindings registered without one, in seconds.
+  static const unsigned kDefaultExpires = 3600;
+  // Bindings can't be registered for less than this, in seconds.
+  static const unsigned kDefaultMinExpires = 60;
+  // Longer expirations are shortened to this, in seconds.
+  static const unsigned kDefaultMaxExpires = 86400;
+
+  // |user_agent| sends the responses, and |location_service| keeps the
+  // bindings. Neither is owned, and both must outlive it.
+  Registrar(ua::UserAgent *user_agent, LocationService *location_service);
+  ~Registrar() override;
+
+  // Sets the authenticator verifying the requests. Not owned; NULL, the
+  // default, accepts all requests.
+  void set_authenticator(DigestAuthenticator *authenticator) {
+    authenticator_ = authenticator;
+  }
+
+  void set_default_expires(unsigned seconds) { default_expires_ = seconds; }
+  void set_min_expires(unsigned seconds) { min_expires_ = seconds; }
+  void set_max_expires(unsigned seconds) { max_expires_ = seconds; }
+
+  // ua::UserAgent::Delegate methods:
+  void OnChannelConnected(const EndPoint &destination, int err) override;
+  void OnChannelClosed(const EndPoint &destination) override;
+  void OnIncomingRequest(
+      const scoped_refptr<Request> &incoming_request,
+      const scoped_refptr<Dialog> &dialog) override;
+  void OnIncomingResponse(
+      const scoped_refptr<Response> &incoming_response,
+      const scoped_refptr<Dialog> &dialog) override;
+  void OnTimedOut(
+      const scoped_refptr<Request> &request,
+      const scoped_refptr<Dialog> &dialog) override;
+  void OnTransportError(
+      const scoped_refptr<Request> &request, int error,
+      const scoped_refptr<Dialog> &dialog) override;
+
+ private:
+  void OnVerifyComplete(const scoped_refptr<Request> &request,
+                        DigestAuthenticator::Result result);
+  void HandleVerifyResult(const scoped_refptr<Request> &request,
+                          DigestAuthenticator::Result result);
+
+  // Applies an authorized REGISTER to the location service, and answers it.
+  void ProcessRegister(const scoped_refptr<Request> &request);
+
+  void SendResponse(const scoped_refptr<Request> &request, StatusCode code);
+  void SendResponse(const scoped_refptr<Response> &response);
+
+  ua::UserAgent *user_agent_;
+  LocationService *location_service_;
+  DigestAuthenticator *authenticator_;
+  unsigned default_expires_;
+  unsigned min_expires_;
+  unsigned max_expires_;
+  base::WeakPtrFactory<Registrar> weak_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(Registrar);
+};
+
+} // namespace sippet
+
+#endif // SIPPET_UA_REGISTRAR_H_
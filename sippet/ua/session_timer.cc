@@ -0,0 +1,225 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/ua/session_timer.h"
+
+#include <algorithm>
+
+#include "base/bind.h"
+#include "base/logging.h"
+#include "base/strings/string_util.h"
+#include "net/base/completion_callback.h"
+#include "net/base/net_errors.h"
+#include "sippet/message/headers.h"
+#include "sippet/message/request.h"
+#include "sippet/message/response.h"
+#include "sippet/message/status_code.h"
+#include "sippet/ua/dialog.h"
+#include "sippet/ua/ua_user_agent.h"
+
+namespace sippet {
+
+namespace {
+
+const char kTimerOptionTag[] = "timer";
+const char kRefresherUac[] = "uac";
+const char kRefresherUas[] = "uas";
+
+// The BYE is sent this long before the session expires, at most (RFC 4028
+// section 10).
+const int kMaxExpirationMarginSeconds = 32;
+
+template<class HeaderType>
+bool HasOptionTag(const Message *message, const char *option_tag) {
+  for (Message::const_iterator i = message->find_first<HeaderType>(),
+       ie = message->end(); i != ie; i = message->find_next<HeaderType>(i)) {
+    const HeaderType *header = dyn_cast<HeaderType>(i);
+    for (typename HeaderType::const_iterator j = header->begin(),
+         je = header->end(); j != je; ++j) {
+      if (base::EqualsCaseInsensitiveASCII(*j, option_tag))
+        return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+SessionTimer::SessionTimer(ua::UserAgent *user_agent, Delegate *delegate)
+  : user_agent_(user_agent),
+    delegate_(delegate),
+    session_expires_(kDefaultSessionExpires),
+    min_se_(kDefaultMinSE),
+    refresher_(false),
+    refresh_timer_(user_agent->timer_wheel()),
+    expiration_timer_(user_agent->timer_wheel()) {
+  DCHECK(delegate);
+}
+
+SessionTimer::~SessionTimer() {
+}
+
+void SessionTimer::AddToRequest(const scoped_refptr<Request> &request) const {
+  Supported *supported = request->get<Supported>();
+  if (supported) {
+    supported->push_back(kTimerOptionTag);
+  } else {
+    scoped_ptr<Supported> new_supported(new Supported(kTimerOptionTag));
+    request->push_back(new_supported.Pass());
+  }
+  // The refresher is left for the UAS to choose.
+  scoped_ptr<SessionExpires> session_expires(
+      new SessionExpires(session_expires_));
+  request->push_back(session_expires.Pass());
+  scoped_ptr<MinSE> min_se(new MinSE(min_se_));
+  request->push_back(min_se.Pass());
+}
+
+bool SessionTimer::HandleResponse(const scoped_refptr<Response> &response,
+                                  const scoped_refptr<Dialog> &dialog) {
+  const scoped_refptr<Request> &request = response->refer_to();
+  if (!request || (Method::INVITE != request->method()
+                   && Method::UPDATE != request->method()))
+    return false;
+  int response_code = response->response_code();
+  if (response_code < 200)
+    return false;
+  bool is_refresh = refresh_request_ && refresh_request_ == request;
+  const Response *const_response = response.get();
+  if (SIP_SESSION_INTERVAL_TOO_SMALL == response_code) {
+    // RFC 4028 section 7.3: try again with the interval asked for.
+    const MinSE *min_se = const_response->get<MinSE>();
+    if (!min_se || min_se->value() <= session_expires_)
+      return false;
+    session_expires_ = min_se->value();
+    min_se_ = std::max(min_se_, session_expires_);
+    if (!is_refresh)
+      return true;
+    SendRefresh();
+    return false;
+  }
+  if (2 != response_code / 100) {
+    // RFC 4028 section 10: refreshes failing this way end the session,
+    // while other failures are retried at the next refresh.
+    if (is_refresh && (SIP_CALL_TRANSACTION_DOES_NOT_EXIST == response_code
+                       || SIP_REQUEST_TIMEOUT == response_code))
+      OnExpirationTimer();
+    return false;
+  }
+  dialog_ = dialog;
+  const SessionExpires *session_expires = const_response->get<SessionExpires>();
+  if (!session_expires) {
+    // The session doesn't expire (RFC 4028 section 7.2).
+    Stop();
+    return false;
+  }
+  Start(session_expires->value(), !session_expires->HasRefresher()
+      || kRefresherUac == session_expires->refresher());
+  return false;
+}
+
+scoped_refptr<Response> SessionTimer::HandleRequest(
+    const scoped_refptr<Request> &request,
+    const scoped_refptr<Dialog> &dialog) {
+  const Request *const_request = request.get();
+  const SessionExpires *session_expires = const_request->get<SessionExpires>();
+  if (session_expires && session_expires->value() < min_se_) {
+    // RFC 4028 section 8.1.
+    scoped_refptr<Response> response(
+        request->CreateResponse(SIP_SESSION_INTERVAL_TOO_SMALL));
+    scoped_ptr<MinSE> min_se(new MinSE(min_se_));
+    response->push_back(min_se.Pass());
+    return response;
+  }
+  scoped_refptr<Response> response(dialog
+      ? dialog->CreateResponse(SIP_OK, request)
+      : request->CreateResponse(SIP_OK));
+  if (dialog)
+    dialog_ = dialog;
+  if (!session_expires) {
+    Stop();
+    return response;
+  }
+  // RFC 4028 section 9: a UAC not supporting session timers can't refresh.
+  bool peer_supported = HasOptionTag<Supported>(const_request,
+                                                kTimerOptionTag);
+  std::string refresher(kRefresherUas);
+  if (peer_supported) {
+    refresher = session_expires->HasRefresher()
+        ? session_expires->refresher() : kRefresherUac;
+  }
+  scoped_ptr<SessionExpires> response_session_expires(
+      new SessionExpires(session_expires->value()));
+  response_session_expires->set_refresher(refresher);
+  response->push_back(response_session_expires.Pass());
+  if (kRefresherUac == refresher) {
+    scoped_ptr<Require> require(new Require(kTimerOptionTag));
+    response->push_back(require.Pass());
+  }
+  Start(session_expires->value(), kRefresherUas == refresher);
+  return response;
+}
+
+void SessionTimer::HandleError(const scoped_refptr<Request> &request) {
+  if (refresh_request_ && refresh_request_ == request)
+    OnExpirationTimer();
+}
+
+void SessionTimer::Stop() {
+  refresh_timer_.Stop();
+  expiration_timer_.Stop();
+  refresh_request_ = nullptr;
+}
+
+void SessionTimer::Start(unsigned interval, bool refresher) {
+  session_expires_ = interval;
+  refresher_ = refresher;
+  base::TimeDelta session_interval(base::TimeDelta::FromSeconds(interval));
+  if (refresher) {
+    refresh_timer_.Start(session_interval / 2,
+        base::Bind(&SessionTimer::OnRefreshTimer, base::Unretained(this)));
+  } else {
+    refresh_timer_.Stop();
+  }
+  base::TimeDelta margin(std::min(
+      base::TimeDelta::FromSeconds(kMaxExpirationMarginSeconds),
+      session_interval / 3));
+  expiration_timer_.Start(session_interval - margin,
+      base::Bind(&SessionTimer::OnExpirationTimer, base::Unretained(this)));
+}
+
+void SessionTimer::SendRefresh() {
+  if (!dialog_) {
+    DVLOG(1) << "No dialog to refresh";
+    return;
+  }
+  refresh_request_ = dialog_->CreateRequest(Method::UPDATE);
+  // UPDATE is a target refresh request (RFC 3311 section 5.1).
+  scoped_ptr<Contact> contact(new Contact(GURL("sip:domain.invalid")));
+  refresh_request_->push_back(contact.Pass());
+  scoped_ptr<Supported> supported(new Supported(kTimerOptionTag));
+  refresh_request_->push_back(supported.Pass());
+  scoped_ptr<SessionExpires> session_expires(
+      new SessionExpires(session_expires_));
+  session_expires->set_refresher(kRefresherUac);
+  refresh_request_->push_back(session_expires.Pass());
+  scoped_ptr<MinSE> min_se(new MinSE(min_se_));
+  refresh_request_->push_back(min_se.Pass());
+  int rv = user_agent_->Send(refresh_request_, net::CompletionCallback());
+  if (net::OK != rv && net::ERR_IO_PENDING != rv) {
+    DVLOG(1) << "Couldn't send the session refresh: "
+             << net::ErrorToString(rv);
+  }
+}
+
+void SessionTimer::OnRefreshTimer() {
+  SendRefresh();
+}
+
+void SessionTimer::OnExpirationTimer() {
+  Stop();
+  delegate_->OnSessionExpired();
+}
+
+} // namespace sippet
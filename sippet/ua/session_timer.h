@@ -0,0 +1,106 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_UA_SESSION_TIMER_H_
+#define SIPPET_UA_SESSION_TIMER_H_
+
+#include "base/memory/ref_counted.h"
+#include "sippet/transport/timer_wheel.h"
+
+namespace sippet {
+
+class Dialog;
+class Request;
+class Response;
+
+namespace ua {
+class UserAgent;
+}
+
+// Keeps an INVITE dialog alive through the stateful proxies in its path
+// (RFC 4028): the session interval is negotiated with |Session-Expires| and
+// |Min-SE| headers, and the side chosen as refresher sends an UPDATE at half
+// the interval, cheaper than a re-INVITE as it carries no session
+// description. The other side terminates the session if it isn't refreshed
+// in time.
+//
+// Timers run on the wheel of the |UserAgent|, shared by all dialog usages,
+// instead of posting one delayed task per session.
+class SessionTimer {
+ public:
+  // Session interval requested by default, in seconds.
+  static const unsigned kDefaultSessionExpires = 1800;
+  // Shorter intervals are rejected, in seconds (RFC 4028 section 4).
+  static const unsigned kDefaultMinSE = 90;
+
+  class Delegate {
+   public:
+    virtual ~Delegate() {}
+
+    // The session wasn't refreshed in time, and should be terminated with
+    // a BYE (RFC 4028 section 10).
+    virtual void OnSessionExpired() = 0;
+  };
+
+  // Neither |user_agent| nor |delegate| is owned, and both must outlive it.
+  SessionTimer(ua::UserAgent *user_agent, Delegate *delegate);
+  ~SessionTimer();
+
+  void set_session_expires(unsigned seconds) { session_expires_ = seconds; }
+  void set_min_se(unsigned seconds) { min_se_ = seconds; }
+
+  // The negotiated interval, once running, or the one to be requested.
+  unsigned session_expires() const { return session_expires_; }
+
+  // Returns true while the session has to be refreshed.
+  bool is_running() const { return expiration_timer_.IsRunning(); }
+
+  // Returns true if this side sends the refreshes.
+  bool is_refresher() const { return refresher_; }
+
+  // Asks for a session timer in an outgoing INVITE.
+  void AddToRequest(const scoped_refptr<Request> &request) const;
+
+  // Handles a final response to the INVITE or to a refresh, starting the
+  // timers on 2xx. Returns true if the INVITE has to be sent again (see
+  // |AddToRequest|), as its interval was too small; refreshes are sent
+  // again without the caller.
+  bool HandleResponse(const scoped_refptr<Response> &response,
+                      const scoped_refptr<Dialog> &dialog);
+
+  // Negotiates the interval of an incoming INVITE or UPDATE, returning its
+  // response: a 422 if the interval is too small, or a 2xx otherwise.
+  scoped_refptr<Response> HandleRequest(const scoped_refptr<Request> &request,
+                                        const scoped_refptr<Dialog> &dialog);
+
+  // Handles a timeout or a network error of |request|, which terminates
+  // the session if it was a refresh.
+  void HandleError(const scoped_refptr<Request> &request);
+
+  // Stops the timers, as when the session is terminated.
+  void Stop();
+
+ private:
+  void Start(unsigned interval, bool refresher);
+  void SendRefresh();
+  void OnRefreshTimer();
+  void OnExpirationTimer();
+
+  ua::UserAgent *user_agent_;
+  Delegate *delegate_;
+  unsigned session_expires_;
+  unsigned min_se_;
+  bool refresher_;
+  scoped_refptr<Dialog> dialog_;
+  // The last refresh sent, if any.
+  scoped_refptr<Request> refresh_request_;
+  TimerWheel::Timer refresh_timer_;
+  TimerWheel::Timer expiration_timer_;
+
+  DISALLOW_COPY_AND_ASSIGN(SessionTimer);
+};
+
+} // namespace sippet
+
+#endif // SIPPET_UA_SESSION_TIMER_H_
@@ -0,0 +1,51 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/ua/snapshot_io.h"
+
+#include <string.h>
+
+namespace sippet {
+
+void SnapshotWriter::WriteUint32(uint32 value) {
+  output_->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void SnapshotWriter::WriteInt64(int64 value) {
+  output_->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void SnapshotWriter::WriteString(const std::string &value) {
+  WriteUint32(static_cast<uint32>(value.size()));
+  output_->append(value);
+}
+
+bool SnapshotReader::ReadUint32(uint32 *value) {
+  return Read(value, sizeof(*value));
+}
+
+bool SnapshotReader::ReadInt64(int64 *value) {
+  return Read(value, sizeof(*value));
+}
+
+bool SnapshotReader::ReadString(std::string *value) {
+  uint32 size;
+  if (!ReadUint32(&size) || size > size_)
+    return false;
+  value->assign(reinterpret_cast<const char*>(data_), size);
+  data_ += size;
+  size_ -= size;
+  return true;
+}
+
+bool SnapshotReader::Read(void *value, size_t size) {
+  if (size > size_)
+    return false;
+  memcpy(value, data_, size);
+  data_ += size;
+  size_ -= size;
+  return true;
+}
+
+} // namespace sippet
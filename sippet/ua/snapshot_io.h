@@ -0,0 +1,57 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_UA_SNAPSHOT_IO_H_
+#define SIPPET_UA_SNAPSHOT_IO_H_
+
+#include <string>
+
+#include "base/basictypes.h"
+
+namespace sippet {
+
+// Writes the values of the snapshot files of the user agent tables (see
+// |LocationService::SaveSnapshot| and |DialogStore::SaveSnapshot|), in
+// the native byte order: snapshots are only meant to be read back by the
+// same build on the same architecture.
+class SnapshotWriter {
+ public:
+  explicit SnapshotWriter(std::string *output) : output_(output) {}
+
+  void WriteUint32(uint32 value);
+  void WriteInt64(int64 value);
+  // The size, followed by the bytes.
+  void WriteString(const std::string &value);
+
+ private:
+  std::string *output_;
+
+  DISALLOW_COPY_AND_ASSIGN(SnapshotWriter);
+};
+
+// Reads the values written by |SnapshotWriter|, failing instead of reading
+// past the end.
+class SnapshotReader {
+ public:
+  SnapshotReader(const uint8 *data, size_t size)
+    : data_(data), size_(size) {}
+
+  bool empty() const { return 0 == size_; }
+
+  bool ReadUint32(uint32 *value);
+  bool ReadInt64(int64 *value);
+  bool ReadString(std::string *value);
+
+ private:
+  bool Read(void *value, size_t size);
+
+  const uint8 *data_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(SnapshotReader);
+};
+
+} // namespace sippet
+
+#endif // SIPPET_UA_SNAPSHOT_IO_H_
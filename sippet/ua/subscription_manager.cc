@@ -0,0 +1,392 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/ua/subscription_manager.h"
+
+#include <algorithm>
+
+#include "base/bind.h"
+#include "base/logging.h"
+#include "base/stl_util.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_util.h"
+#include "net/base/completion_callback.h"
+#include "net/base/net_errors.h"
+#include "sippet/message/headers.h"
+#include "sippet/message/request.h"
+#include "sippet/message/response.h"
+#include "sippet/ua/dialog.h"
+
+namespace sippet {
+
+namespace {
+
+// The Event and Subscription-State headers aren't parsed by the message
+// layer, and so are handled as generic headers.
+const char kEvent[] = "Event";
+const char kEventCompact[] = "o";
+const char kSubscriptionState[] = "Subscription-State";
+
+// Returns the event package of |message|, without its parameters, or an
+// empty string if there's no Event header.
+std::string GetEvent(const Message *message) {
+  for (Message::const_iterator i = message->find_first<Generic>(),
+       ie = message->end(); i != ie; i = message->find_next<Generic>(i)) {
+    const Generic *generic = dyn_cast<Generic>(i);
+    std::string name(generic->header_name());
+    if (!base::EqualsCaseInsensitiveASCII(name, kEvent)
+        && !base::EqualsCaseInsensitiveASCII(name, kEventCompact))
+      continue;
+    std::string value(generic->header_value());
+    std::string event;
+    base::TrimWhitespaceASCII(value.substr(0, value.find(';')),
+                              base::TRIM_ALL, &event);
+    return event;
+  }
+  return std::string();
+}
+
+}  // namespace
+
+SubscriptionManager::Subscription::Subscription(
+    const scoped_refptr<Dialog> &dialog, TimerWheel *timer_wheel)
+  : dialog(dialog),
+    call_id(dialog->call_id()),
+    local_tag(dialog->local_tag()),
+    remote_tag(dialog->remote_tag()),
+    resource(NULL),
+    expiration_timer(timer_wheel),
+    throttle_timer(timer_wheel) {
+}
+
+SubscriptionManager::Subscription::~Subscription() {
+}
+
+SubscriptionManager::Resource::Resource(EventPackage *package,
+                                        const SipURI &uri)
+  : package(package), uri(uri) {
+}
+
+SubscriptionManager::Resource::~Resource() {
+}
+
+SubscriptionManager::EventPackage::EventPackage(
+    const std::string &event,
+    const std::string &type,
+    const std::string &subtype,
+    const base::TimeDelta &throttle_interval)
+  : event(event),
+    type(type),
+    subtype(subtype),
+    throttle_interval(throttle_interval) {
+}
+
+SubscriptionManager::EventPackage::~EventPackage() {
+  STLDeleteContainerPairSecondPointers(resources.begin(), resources.end());
+}
+
+SubscriptionManager::SubscriptionManager(ua::UserAgent *user_agent,
+                                         Delegate *delegate)
+  : user_agent_(user_agent),
+    delegate_(delegate),
+    default_expires_(kDefaultExpires),
+    min_expires_(kDefaultMinExpires),
+    max_expires_(kDefaultMaxExpires) {
+  DCHECK(user_agent);
+  DCHECK(delegate);
+}
+
+SubscriptionManager::~SubscriptionManager() {
+  for (SubscriptionMap::iterator i = subscriptions_.begin(),
+       ie = subscriptions_.end(); i != ie; ++i) {
+    user_agent_->TerminateDialog(i->second->dialog);
+    delete i->second;
+  }
+  subscriptions_.clear();
+  STLDeleteValues(&packages_);
+}
+
+void SubscriptionManager::AddEventPackage(
+    const std::string &event,
+    const std::string &type,
+    const std::string &subtype,
+    const base::TimeDelta &throttle_interval) {
+  DCHECK(packages_.find(event) == packages_.end());
+  packages_[event] = new EventPackage(event, type, subtype,
+                                      throttle_interval);
+}
+
+bool SubscriptionManager::SetState(
+    const std::string &event,
+    const SipURI &resource_uri,
+    const scoped_refptr<base::RefCountedString> &state) {
+  EventPackageMap::iterator i = packages_.find(event);
+  if (packages_.end() == i)
+    return false;
+  Resource *resource = GetResource(i->second, resource_uri);
+  resource->state = state;
+  base::LinkNode<Subscription> *node = resource->subscriptions.head();
+  while (node != resource->subscriptions.end()) {
+    Subscription *subscription = node->value();
+    node = node->next();
+    Notify(subscription);
+  }
+  return true;
+}
+
+void SubscriptionManager::OnChannelConnected(const EndPoint &destination,
+                                             int err) {
+  // Nothing to do
+}
+
+void SubscriptionManager::OnChannelClosed(const EndPoint &destination) {
+  // Nothing to do
+}
+
+void SubscriptionManager::OnIncomingRequest(
+    const scoped_refptr<Request> &incoming_request,
+    const scoped_refptr<Dialog> &dialog) {
+  if (Method::SUBSCRIBE != incoming_request->method())
+    return;
+  ProcessSubscribe(incoming_request);
+}
+
+void SubscriptionManager::OnIncomingResponse(
+    const scoped_refptr<Response> &incoming_response,
+    const scoped_refptr<Dialog> &dialog) {
+  const scoped_refptr<Request> &request = incoming_response->refer_to();
+  if (!request || Method::NOTIFY != request->method()
+      || incoming_response->response_code() < 300)
+    return;
+  Subscription *subscription = FindSubscription(request.get());
+  if (!subscription)
+    return;
+  // RFC 6665 section 4.2.2.2: failed NOTIFYs end the subscription, unless
+  // the subscriber only asked to retry later.
+  const Response *const_response = incoming_response.get();
+  if (const_response->get<RetryAfter>())
+    return;
+  DVLOG(1) << "NOTIFY rejected with "
+           << incoming_response->response_code()
+           << "; removing the subscription";
+  DestroySubscription(subscription);
+}
+
+void SubscriptionManager::OnTimedOut(
+    const scoped_refptr<Request> &request,
+    const scoped_refptr<Dialog> &dialog) {
+  if (Method::NOTIFY != request->method())
+    return;
+  Subscription *subscription = FindSubscription(request.get());
+  if (subscription)
+    DestroySubscription(subscription);
+}
+
+void SubscriptionManager::OnTransportError(
+    const scoped_refptr<Request> &request, int error,
+    const scoped_refptr<Dialog> &dialog) {
+  if (Method::NOTIFY != request->method())
+    return;
+  Subscription *subscription = FindSubscription(request.get());
+  if (subscription)
+    DestroySubscription(subscription);
+}
+
+SubscriptionManager::Resource *SubscriptionManager::GetResource(
+    EventPackage *package, const SipURI &uri) {
+  ResourceMap::iterator i = package->resources.find(uri);
+  if (package->resources.end() != i)
+    return i->second;
+  Resource *resource = new Resource(package, uri);
+  package->resources[uri] = resource;
+  return resource;
+}
+
+void SubscriptionManager::MaybeDestroyResource(Resource *resource) {
+  if (resource->state || !resource->subscriptions.empty())
+    return;
+  resource->package->resources.erase(resource->uri);
+  delete resource;
+}
+
+SubscriptionManager::Subscription *SubscriptionManager::FindSubscription(
+    const Message *message) {
+  SubscriptionMap::iterator i =
+      subscriptions_.find(DialogStore::GetMessageDialogKey(message));
+  return subscriptions_.end() != i ? i->second : NULL;
+}
+
+void SubscriptionManager::ProcessSubscribe(
+    const scoped_refptr<Request> &request) {
+  // Read only, as it may be shared.
+  const Request *const_request = request.get();
+  EventPackageMap::iterator package = packages_.find(GetEvent(const_request));
+  if (packages_.end() == package) {
+    SendResponse(request, SIP_BAD_EVENT);
+    return;
+  }
+  const Expires *expires = const_request->get<Expires>();
+  unsigned seconds = expires ? expires->value() : default_expires_;
+  if (seconds != 0 && seconds < min_expires_) {
+    scoped_refptr<Response> response(
+        request->CreateResponse(SIP_INTERVAL_TOO_BRIEF));
+    scoped_ptr<MinExpires> min_expires(new MinExpires(min_expires_));
+    response->push_back(min_expires.Pass());
+    SendResponse(response);
+    return;
+  }
+  seconds = std::min(seconds, max_expires_);
+
+  Subscription *subscription = NULL;
+  const To *to = const_request->get<To>();
+  if (to && to->HasTag()) {
+    // A refresh, or an unsubscription.
+    subscription = FindSubscription(const_request);
+    if (!subscription
+        || subscription->resource->package != package->second) {
+      SendResponse(request, SIP_CALL_TRANSACTION_DOES_NOT_EXIST);
+      return;
+    }
+    SendResponse(CreateSubscribeResponse(request, seconds));
+  } else {
+    if (!to || !to->sip_address().is_valid()
+        || !const_request->get<Contact>()) {
+      SendResponse(request, SIP_BAD_REQUEST);
+      return;
+    }
+    const SipURI &uri = const_request->sip_request_uri();
+    if (!delegate_->OnSubscribe(package->first, uri, request)) {
+      SendResponse(request, SIP_FORBIDDEN);
+      return;
+    }
+    subscription = CreateSubscription(
+        CreateSubscribeResponse(request, seconds),
+        GetResource(package->second, uri));
+    if (!subscription)
+      return;
+  }
+
+  subscription->expires = base::TimeTicks::Now()
+      + base::TimeDelta::FromSeconds(seconds);
+  if (0 == seconds) {
+    // RFC 6665 section 4.2.1.4: an unsubscription gets a final NOTIFY.
+    subscription->expiration_timer.Stop();
+    OnExpirationTimer(subscription);
+    return;
+  }
+  subscription->expiration_timer.Start(
+      base::TimeDelta::FromSeconds(seconds),
+      base::Bind(&SubscriptionManager::OnExpirationTimer,
+                 base::Unretained(this), subscription));
+  // The current state is sent at once, regardless of the throttle.
+  subscription->throttle_timer.Stop();
+  SendNotify(subscription, "active;expires=" + base::UintToString(seconds));
+}
+
+scoped_refptr<Response> SubscriptionManager::CreateSubscribeResponse(
+    const scoped_refptr<Request> &request, unsigned seconds) {
+  // RFC 6665 section 4.2.1.1: the 200 OK carries the granted duration.
+  scoped_refptr<Response> response(request->CreateResponse(SIP_OK));
+  scoped_ptr<Expires> expires(new Expires(seconds));
+  response->push_back(expires.Pass());
+  return response;
+}
+
+SubscriptionManager::Subscription *SubscriptionManager::CreateSubscription(
+    const scoped_refptr<Response> &response, Resource *resource) {
+  // Sending the 200 OK creates the dialog (RFC 6665 section 4.1.2.1).
+  SendResponse(response);
+  scoped_refptr<Dialog> dialog(user_agent_->GetDialog(response.get()));
+  if (!dialog) {
+    DVLOG(1) << "Couldn't create the subscription dialog";
+    MaybeDestroyResource(resource);
+    return NULL;
+  }
+  Subscription *subscription =
+      new Subscription(dialog, user_agent_->timer_wheel());
+  subscription->resource = resource;
+  resource->subscriptions.Append(subscription);
+  subscriptions_[DialogKey(subscription->call_id, subscription->local_tag,
+                           subscription->remote_tag)] = subscription;
+  return subscription;
+}
+
+void SubscriptionManager::DestroySubscription(Subscription *subscription) {
+  subscriptions_.erase(DialogKey(subscription->call_id,
+                                 subscription->local_tag,
+                                 subscription->remote_tag));
+  subscription->RemoveFromList();
+  user_agent_->TerminateDialog(subscription->dialog);
+  Resource *resource = subscription->resource;
+  delete subscription;
+  MaybeDestroyResource(resource);
+}
+
+void SubscriptionManager::Notify(Subscription *subscription) {
+  if (subscription->throttle_timer.IsRunning())
+    return;  // The latest state will be sent once it fires.
+  base::TimeDelta elapsed =
+      base::TimeTicks::Now() - subscription->last_notify;
+  base::TimeDelta interval =
+      subscription->resource->package->throttle_interval;
+  if (elapsed < interval) {
+    subscription->throttle_timer.Start(interval - elapsed,
+        base::Bind(&SubscriptionManager::OnThrottleTimer,
+                   base::Unretained(this), subscription));
+    return;
+  }
+  OnThrottleTimer(subscription);
+}
+
+void SubscriptionManager::OnThrottleTimer(Subscription *subscription) {
+  int64 remaining =
+      (subscription->expires - base::TimeTicks::Now()).InSeconds();
+  SendNotify(subscription, "active;expires="
+      + base::Int64ToString(std::max<int64>(remaining, 0)));
+}
+
+void SubscriptionManager::OnExpirationTimer(Subscription *subscription) {
+  subscription->throttle_timer.Stop();
+  SendNotify(subscription, "terminated;reason=timeout");
+  DestroySubscription(subscription);
+}
+
+void SubscriptionManager::SendNotify(Subscription *subscription,
+                                     const std::string &subscription_state) {
+  EventPackage *package = subscription->resource->package;
+  scoped_refptr<Request> notify(
+      subscription->dialog->CreateRequest(Method::NOTIFY));
+  scoped_ptr<Contact> contact(new Contact(GURL("sip:domain.invalid")));
+  notify->push_back(contact.Pass());
+  scoped_ptr<Generic> event(new Generic(kEvent, package->event));
+  notify->push_back(event.Pass());
+  scoped_ptr<Generic> state(
+      new Generic(kSubscriptionState, subscription_state));
+  notify->push_back(state.Pass());
+  const scoped_refptr<base::RefCountedString> &content =
+      subscription->resource->state;
+  if (content) {
+    scoped_ptr<ContentType> content_type(
+        new ContentType(package->type, package->subtype));
+    notify->push_back(content_type.Pass());
+    notify->set_content(content);
+  }
+  subscription->last_notify = base::TimeTicks::Now();
+  int rv = user_agent_->Send(notify, net::CompletionCallback());
+  if (net::OK != rv && net::ERR_IO_PENDING != rv) {
+    DVLOG(1) << "Couldn't send the NOTIFY: " << net::ErrorToString(rv);
+  }
+}
+
+void SubscriptionManager::SendResponse(const scoped_refptr<Request> &request,
+                                       StatusCode code) {
+  SendResponse(request->CreateResponse(code));
+}
+
+void SubscriptionManager::SendResponse(
+    const scoped_refptr<Response> &response) {
+  user_agent_->Send(response, net::CompletionCallback());
+}
+
+} // namespace sippet
@@ -0,0 +1,199 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SIPPET_UA_SUBSCRIPTION_MANAGER_H_
+#define SIPPET_UA_SUBSCRIPTION_MANAGER_H_
+
+#include <map>
+#include <string>
+
+#include "base/containers/hash_tables.h"
+#include "base/containers/linked_list.h"
+#include "base/memory/ref_counted.h"
+#include "base/memory/ref_counted_memory.h"
+#include "base/time/time.h"
+#include "sippet/message/status_code.h"
+#include "sippet/transport/timer_wheel.h"
+#include "sippet/ua/dialog_store.h"
+#include "sippet/ua/ua_user_agent.h"
+#include "sippet/uri/uri.h"
+
+namespace sippet {
+
+// The notifier side of the SIP event framework (RFC 6665): it answers the
+// SUBSCRIBE requests received by a |UserAgent| for the event packages added
+// to it, and sends a NOTIFY to every subscriber whenever the state of the
+// watched resource changes. Other requests are left for the other handlers
+// of the |UserAgent|.
+//
+// Each package has a throttle interval: state changes arriving faster than
+// that are coalesced, and only the latest state is notified once the
+// interval elapses (RFC 6665 section 4.2.2.3). The state of a resource is
+// kept in a single buffer, which all the NOTIFYs sent for it share.
+//
+// Subscription expirations and throttles are driven by the timer wheel of
+// the |UserAgent|, so that a large number of subscriptions costs no more
+// than a single tick.
+class SubscriptionManager : public ua::UserAgent::Delegate {
+ public:
+  // Expiration of subscriptions without one, in seconds.
+  static const unsigned kDefaultExpires = 3600;
+  // Subscriptions can't last less than this, in seconds.
+  static const unsigned kDefaultMinExpires = 60;
+  // Longer expirations are shortened to this, in seconds.
+  static const unsigned kDefaultMaxExpires = 86400;
+
+  class Delegate {
+   public:
+    virtual ~Delegate() {}
+
+    // Authorizes a new subscription to |resource| for the |event| package.
+    // Refreshes of accepted subscriptions aren't authorized again.
+    virtual bool OnSubscribe(const std::string &event,
+                             const SipURI &resource,
+                             const scoped_refptr<Request> &subscribe) = 0;
+  };
+
+  // |user_agent| sends the responses and NOTIFYs, and |delegate| authorizes
+  // the subscriptions. Neither is owned, and both must outlive it.
+  SubscriptionManager(ua::UserAgent *user_agent, Delegate *delegate);
+  ~SubscriptionManager() override;
+
+  // Accepts subscriptions to the |event| package, whose bodies are of type
+  // |type|/|subtype|. NOTIFYs of a subscription aren't sent more often than
+  // |throttle_interval|.
+  void AddEventPackage(const std::string &event,
+                       const std::string &type,
+                       const std::string &subtype,
+                       const base::TimeDelta &throttle_interval);
+
+  // Changes the state of |resource| for the |event| package, and notifies
+  // the subscribers of it. Returns false if the package is unknown.
+  bool SetState(const std::string &event,
+                const SipURI &resource,
+                const scoped_refptr<base::RefCountedString> &state);
+
+  // Number of active subscriptions.
+  size_t subscription_count() const { return subscriptions_.size(); }
+
+  void set_default_expires(unsigned seconds) { default_expires_ = seconds; }
+  void set_min_expires(unsigned seconds) { min_expires_ = seconds; }
+  void set_max_expires(unsigned seconds) { max_expires_ = seconds; }
+
+  // ua::UserAgent::Delegate methods:
+  void OnChannelConnected(const EndPoint &destination, int err) override;
+  void OnChannelClosed(const EndPoint &destination) override;
+  void OnIncomingRequest(
+      const scoped_refptr<Request> &incoming_request,
+      const scoped_refptr<Dialog> &dialog) override;
+  void OnIncomingResponse(
+      const scoped_refptr<Response> &incoming_response,
+      const scoped_refptr<Dialog> &dialog) override;
+  void OnTimedOut(
+      const scoped_refptr<Request> &request,
+      const scoped_refptr<Dialog> &dialog) override;
+  void OnTransportError(
+      const scoped_refptr<Request> &request, int error,
+      const scoped_refptr<Dialog> &dialog) override;
+
+ private:
+  struct EventPackage;
+  struct Resource;
+
+  struct Subscription : public base::LinkNode<Subscription> {
+    Subscription(const scoped_refptr<Dialog> &dialog, TimerWheel *timer_wheel);
+    ~Subscription();
+
+    scoped_refptr<Dialog> dialog;
+    // Copies of the dialog identifiers, which the subscription key points
+    // to.
+    std::string call_id;
+    std::string local_tag;
+    std::string remote_tag;
+    Resource *resource;
+    base::TimeTicks expires;
+    // When the last NOTIFY was sent.
+    base::TimeTicks last_notify;
+    TimerWheel::Timer expiration_timer;
+    // Running while a state change waits for the throttle interval.
+    TimerWheel::Timer throttle_timer;
+
+    DISALLOW_COPY_AND_ASSIGN(Subscription);
+  };
+
+  struct Resource {
+    Resource(EventPackage *package, const SipURI &uri);
+    ~Resource();
+
+    EventPackage *package;
+    SipURI uri;
+    // NULL until set.
+    scoped_refptr<base::RefCountedString> state;
+    base::LinkedList<Subscription> subscriptions;
+
+    DISALLOW_COPY_AND_ASSIGN(Resource);
+  };
+
+  typedef base::hash_map<SipURI, Resource*, SipURIHasher, SipURIEqualTo>
+      ResourceMap;
+
+  struct EventPackage {
+    EventPackage(const std::string &event,
+                 const std::string &type,
+                 const std::string &subtype,
+                 const base::TimeDelta &throttle_interval);
+    ~EventPackage();
+
+    std::string event;
+    std::string type;
+    std::string subtype;
+    base::TimeDelta throttle_interval;
+    ResourceMap resources;
+
+    DISALLOW_COPY_AND_ASSIGN(EventPackage);
+  };
+
+  typedef std::map<std::string, EventPackage*> EventPackageMap;
+  typedef base::hash_map<DialogKey, Subscription*> SubscriptionMap;
+
+  Resource *GetResource(EventPackage *package, const SipURI &uri);
+  void MaybeDestroyResource(Resource *resource);
+
+  Subscription *FindSubscription(const Message *message);
+
+  void ProcessSubscribe(const scoped_refptr<Request> &request);
+  scoped_refptr<Response> CreateSubscribeResponse(
+      const scoped_refptr<Request> &request, unsigned seconds);
+  // Answers a new subscription to |resource| with |response|, returning
+  // NULL if its dialog couldn't be created.
+  Subscription *CreateSubscription(const scoped_refptr<Response> &response,
+                                   Resource *resource);
+  // Removes |subscription|, terminating its dialog.
+  void DestroySubscription(Subscription *subscription);
+
+  // Sends the current state to |subscription|, at once or after the
+  // throttle interval.
+  void Notify(Subscription *subscription);
+  void OnThrottleTimer(Subscription *subscription);
+  void OnExpirationTimer(Subscription *subscription);
+  void SendNotify(Subscription *subscription,
+                  const std::string &subscription_state);
+
+  void SendResponse(const scoped_refptr<Request> &request, StatusCode code);
+  void SendResponse(const scoped_refptr<Response> &response);
+
+  ua::UserAgent *user_agent_;
+  Delegate *delegate_;
+  EventPackageMap packages_;
+  SubscriptionMap subscriptions_;
+  unsigned default_expires_;
+  unsigned min_expires_;
+  unsigned max_expires_;
+
+  DISALLOW_COPY_AND_ASSIGN(SubscriptionManager);
+};
+
+} // namespace sippet
+
+#endif // SIPPET_UA_SUBSCRIPTION_MANAGER_H_
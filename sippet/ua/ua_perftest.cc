@@ -0,0 +1,190 @@
+// Copyright (c) 2014 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string>
+#include <vector>
+
+#include "base/memory/scoped_ptr.h"
+#include "base/message_loop/message_loop.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_util.h"
+#include "base/strings/stringprintf.h"
+#include "base/strings/utf_string_conversions.h"
+#include "net/base/completion_callback.h"
+#include "net/base/net_errors.h"
+#include "sippet/message/message.h"
+#include "sippet/test/perf/perf_test_util.h"
+#include "sippet/ua/auth_handler_digest.h"
+#include "sippet/ua/dialog.h"
+#include "sippet/ua/dialog_controller.h"
+#include "sippet/ua/dialog_store.h"
+#include "sippet/ua/password_handler.h"
+#include "sippet/ua/ua_user_agent.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+// Number of times each operation is repeated.
+const int kIterations = 20000;
+
+// Dialogs created, and looked up, at each size of the dialog store.
+const int kProbes = 1000;
+
+// Sizes of the dialog store, in dialogs.
+const int kStoreSizes[] = { 1, 100, 10000, 100000 };
+
+struct DigestChallenge {
+  const char *trace;
+  const char *challenge;
+};
+
+const DigestChallenge kDigestChallenges[] = {
+  { "md5",
+    "Digest realm=\"biloxi.com\", "
+    "nonce=\"dcd98b7102dd2f0e8b11d0f600bfb0c093\"" },
+  { "md5_auth",
+    "Digest realm=\"biloxi.com\", qop=\"auth\", algorithm=MD5, "
+    "nonce=\"dcd98b7102dd2f0e8b11d0f600bfb0c093\"" },
+  { "md5_sess_auth",
+    "Digest realm=\"biloxi.com\", qop=\"auth\", algorithm=MD5-sess, "
+    "nonce=\"dcd98b7102dd2f0e8b11d0f600bfb0c093\"" },
+  { "sha256_auth",
+    "Digest realm=\"biloxi.com\", qop=\"auth\", algorithm=SHA-256, "
+    "nonce=\"dcd98b7102dd2f0e8b11d0f600bfb0c093\"" },
+};
+
+const char kInviteFormat[] =
+  "INVITE sip:bob@biloxi.com SIP/2.0\r\n"
+  "Via: SIP/2.0/UDP pc33.atlanta.com;branch=z9hG4bK%d\r\n"
+  "Max-Forwards: 70\r\n"
+  "To: Bob <sip:bob@biloxi.com>\r\n"
+  "From: Alice <sip:alice@atlanta.com>;tag=%d\r\n"
+  "Call-ID: %d@pc33.atlanta.com\r\n"
+  "CSeq: 314159 INVITE\r\n"
+  "Contact: <sip:alice@pc33.atlanta.com>\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n";
+
+// An incoming INVITE, |index| telling its Call-ID and tag apart.
+scoped_refptr<Request> CreateInvite(int index) {
+  return dyn_cast<Request>(Message::Parse(
+      base::StringPrintf(kInviteFormat, index, index, index)));
+}
+
+// Builds the 180 answering |index|, which creates an early dialog.
+scoped_refptr<Response> CreateRinging(int index) {
+  return CreateInvite(index)->CreateResponse(180, "Ringing");
+}
+
+// The user agent only builds requests here, without asking for passwords.
+class NullPasswordHandlerFactory : public PasswordHandler::Factory {
+ public:
+  scoped_ptr<PasswordHandler> CreatePasswordHandler() override {
+    return scoped_ptr<PasswordHandler>();
+  }
+};
+
+}  // namespace
+
+// Measures the response digest, through |GenerateAuth|.
+TEST(UaPerfTest, DigestResponse) {
+  net::AuthCredentials credentials(base::ASCIIToUTF16("bob"),
+                                   base::ASCIIToUTF16("zanzibar"));
+  for (size_t i = 0; i < arraysize(kDigestChallenges); ++i) {
+    AuthHandlerDigest::Factory factory;
+    factory.set_nonce_generator(
+        new AuthHandlerDigest::FixedNonceGenerator("0a4f113b"));
+    scoped_ptr<Header> header(Header::Parse(
+        std::string("WWW-Authenticate: ") + kDigestChallenges[i].challenge));
+    WwwAuthenticate *www_authenticate = dyn_cast<WwwAuthenticate>(header);
+    ASSERT_TRUE(www_authenticate);
+    scoped_ptr<AuthHandler> handler;
+    ASSERT_EQ(net::OK, factory.CreateAuthHandler(*www_authenticate,
+        net::HttpAuth::AUTH_SERVER, GURL("sip:biloxi.com"),
+        AuthHandlerFactory::CREATE_CHALLENGE, 1, net::BoundNetLog(),
+        &handler));
+
+    // Each response goes into a request of its own.
+    std::vector<scoped_refptr<Request> > requests;
+    for (int j = 0; j < kIterations; ++j)
+      requests.push_back(
+          new Request(Method::INVITE, GURL("sip:bob@biloxi.com")));
+
+    // Digest responses are generated synchronously.
+    PerfMeasurement measurement("ua_digest_response",
+                                kDigestChallenges[i].trace, kIterations);
+    for (int j = 0; j < kIterations; ++j) {
+      handler->GenerateAuth(&credentials, requests[j],
+                            net::CompletionCallback());
+    }
+    measurement.Done("response");
+    EXPECT_TRUE(requests.back()->get<Authorization>());
+  }
+}
+
+// Measures creating and finding dialogs as the store grows, so that costs
+// growing with the number of dialogs stand out.
+TEST(UaPerfTest, DialogStore) {
+  DialogStore store;
+  int created = 0;
+  for (size_t i = 0; i < arraysize(kStoreSizes); ++i) {
+    // Grows the store up to its next size, without measuring.
+    for (; created < kStoreSizes[i]; ++created)
+      ASSERT_TRUE(store.GenerateDialog(CreateRinging(created)).get());
+
+    std::string trace(base::IntToString(kStoreSizes[i]) + "_dialogs");
+    std::vector<scoped_refptr<Response> > responses;
+    for (int j = 0; j < kProbes; ++j)
+      responses.push_back(CreateRinging(created + j));
+
+    PerfMeasurement generate("ua_dialog_generate", trace, kProbes);
+    for (int j = 0; j < kProbes; ++j)
+      store.GenerateDialog(responses[j]);
+    generate.Done("dialog");
+    created += kProbes;
+
+    PerfMeasurement lookup("ua_dialog_lookup", trace, kIterations);
+    for (int j = 0; j < kIterations; ++j)
+      store.GetDialog(responses[j % kProbes].get());
+    lookup.Done("lookup");
+    EXPECT_TRUE(store.GetDialog(responses.back().get()).get());
+  }
+}
+
+TEST(UaPerfTest, DialogCreateRequest) {
+  DialogStore store;
+  scoped_refptr<Dialog> dialog(store.GenerateDialog(CreateRinging(0)));
+  ASSERT_TRUE(dialog.get());
+
+  PerfMeasurement measurement("ua_dialog_create_request", "bye",
+                              kIterations);
+  for (int j = 0; j < kIterations; ++j)
+    dialog->CreateRequest(Method::BYE);
+  measurement.Done("request");
+}
+
+TEST(UaPerfTest, UserAgentCreateRequest) {
+  base::MessageLoop message_loop;
+  AuthHandlerDigest::Factory auth_handler_factory;
+  NullPasswordHandlerFactory password_handler_factory;
+  scoped_ptr<ua::UserAgent> user_agent(new ua::UserAgent(
+      &auth_handler_factory, &password_handler_factory,
+      DialogController::GetDefaultDialogController(), net::BoundNetLog()));
+
+  const Method methods[] = { Method::INVITE, Method::REGISTER };
+  for (size_t i = 0; i < arraysize(methods); ++i) {
+    PerfMeasurement measurement("ua_create_request",
+        base::StringToLowerASCII(std::string(methods[i].str())),
+        kIterations);
+    for (int j = 0; j < kIterations; ++j) {
+      user_agent->CreateRequest(methods[i], GURL("sip:bob@biloxi.com"),
+          GURL("sip:alice@atlanta.com"), GURL("sip:bob@biloxi.com"));
+    }
+    measurement.Done("request");
+  }
+}
+
+}  // namespace sippet
@@ -14,6 +14,8 @@
 #include "base/i18n/time_formatting.h"
 #include "net/base/net_errors.h"
 #include "sippet/ua/dialog.h"
+#include "sippet/ua/auth_handler.h"
+#include "sippet/ua/auth_handler_factory.h"
 #include "sippet/uri/uri.h"
 #include "sippet/base/tags.h"
 #include "sippet/base/sequences.h"
@@ -33,6 +35,10 @@ UserAgent::OutgoingRequestContext::OutgoingRequestContext(
 UserAgent::OutgoingRequestContext::~OutgoingRequestContext() {
 }
 
+UserAgent::Introspection::Introspection()
+  : dialogs(0), outgoing_requests(0), forks(0), auth_cache_entries(0) {
+}
+
 UserAgent::UserAgent(AuthHandlerFactory *auth_handler_factory,
     PasswordHandler::Factory *password_handler_factory,
     DialogController *dialog_controller,
@@ -42,7 +48,10 @@ UserAgent::UserAgent(AuthHandlerFactory *auth_handler_factory,
       password_handler_factory_(password_handler_factory),
       weak_factory_(this),
       dialog_store_(new DialogStore),
-      dialog_controller_(dialog_controller) {
+      dialog_controller_(dialog_controller),
+      timer_wheel_(
+          base::TimeDelta::FromMilliseconds(kUsageTimerResolutionMs)),
+      next_hop_prefetch_(PREFETCH_RESOLVE) {
   DCHECK(auth_handler_factory);
   DCHECK(password_handler_factory);
   DCHECK(dialog_controller_);
@@ -51,6 +60,8 @@ UserAgent::UserAgent(AuthHandlerFactory *auth_handler_factory,
 UserAgent::~UserAgent() {
   STLDeleteContainerPairSecondPointers(
       outgoing_requests_.begin(), outgoing_requests_.end());
+  fork_requests_.clear();
+  STLDeleteContainerPairSecondPointers(forks_.begin(), forks_.end());
 }
 
 void UserAgent::AppendHandler(Delegate *delegate) {
@@ -94,6 +105,10 @@ scoped_refptr<Request> UserAgent::CreateRequest(
   scoped_ptr<Supported> supported(new Supported);
   supported->push_back("path");
   supported->push_back("outbound");
+  if (Method::INVITE == method) {
+    // Provisional responses are acknowledged by |OnIncomingResponse|.
+    supported->push_back("100rel");
+  }
   request->push_back(supported.Pass());
 
   std::string contact_address("sip:");
@@ -117,10 +132,10 @@ scoped_refptr<Request> UserAgent::CreateRequest(
 
   // Adds the Route-Set, case it exists
   if (route_set_.size() > 0) {
-    SipURI first_uri(route_set_.front().spec());
+    const SipURI &first_uri = first_route_;
     if (first_uri.is_valid()) {
       scoped_ptr<Route> route(new Route);
-      if (first_uri.parameter("lr").first) {
+      if (first_uri.parameter("lr", NULL)) {
         for (UrlListType::iterator i = route_set_.begin(),
              ie = route_set_.end(); i != ie; i++) {
           route->push_back(RouteParam(*i));
@@ -149,14 +164,118 @@ int UserAgent::Send(
     const net::CompletionCallback& callback) {
   if (isa<Response>(message)) {
     scoped_refptr<Response> response = dyn_cast<Response>(message);
-    dialog_controller_->HandleResponse(dialog_store_.get(), response);
+    scoped_refptr<Dialog> dialog =
+        dialog_controller_->HandleResponse(dialog_store_.get(), response);
+    PrefetchNextHop(dialog, response.get());
   } else {
     scoped_refptr<Request> request = dyn_cast<Request>(message);
-    dialog_controller_->HandleRequest(dialog_store_.get(), request);
+    // A BYE takes its dialog out of the store.
+    scoped_refptr<Dialog> dialog =
+        dialog_controller_->HandleRequest(dialog_store_.get(), request);
+    if (!dialog)
+      dialog = dialog_store_->GetDialog(request.get());
+    // ACKs reuse the credentials of their INVITEs and CANCELs can't be
+    // challenged.
+    if (Method::ACK != request->method()
+        && Method::CANCEL != request->method())
+      AddPreemptiveAuthorization(request);
+    // Requests within a dialog took a new local sequence number; ACKs and
+    // CANCELs reuse the one of the request they refer to.
+    if (dialog && Dialog::STATE_TERMINATED != dialog->state()
+        && Method::ACK != request->method()
+        && Method::CANCEL != request->method())
+      dialog_store_->SequenceChanged(dialog);
+    if (dialog)
+      return network_layer_->SendToNextHop(request, dialog->next_hop(),
+                                           callback);
   }
   return network_layer_->Send(message, callback);
 }
 
+int UserAgent::Fork(const scoped_refptr<Request> &incoming_request,
+                    const std::vector<GURL> &targets,
+                    ForkContext::Mode mode) {
+  if (targets.empty())
+    return net::ERR_INVALID_ARGUMENT;
+  scoped_ptr<ForkContext> fork(
+      new ForkContext(this, incoming_request, targets, mode));
+  if (forks_.count(fork->key())) {
+    DVLOG(1) << "Request already being forked";
+    return net::ERR_UNEXPECTED;
+  }
+  ForkContext *started_fork = fork.release();
+  forks_.insert(std::make_pair(base::StringPiece(started_fork->key()),
+                               started_fork));
+  started_fork->Start();
+  MaybeDestroyFork(started_fork);
+  return net::OK;
+}
+
+scoped_refptr<Dialog> UserAgent::GetDialog(const Message *message) {
+  return dialog_store_->GetDialog(message);
+}
+
+void UserAgent::TerminateDialog(const scoped_refptr<Dialog> &dialog) {
+  dialog_store_->TerminateDialog(dialog);
+}
+
+void UserAgent::Introspect(Introspection *introspection) const {
+  DCHECK(introspection);
+  introspection->dialogs = dialog_store_->size();
+  introspection->outgoing_requests = outgoing_requests_.size();
+  introspection->forks = forks_.size();
+  introspection->auth_cache_entries = auth_cache_.size();
+}
+
+void UserAgent::PrefetchNextHop(const scoped_refptr<Dialog> &dialog,
+                                const Response *response) {
+  // Dialogs are created, confirmed and refreshed by 101-299 responses;
+  // prefetching the hop of a dialog already used costs a table lookup.
+  if (PREFETCH_NONE == next_hop_prefetch_ || !dialog
+      || Dialog::STATE_TERMINATED == dialog->state()
+      || 100 >= response->response_code() || 300 <= response->response_code())
+    return;
+  network_layer_->Prefetch(dialog->next_hop(),
+                           PREFETCH_CONNECT == next_hop_prefetch_);
+}
+
+void UserAgent::AddPreemptiveAuthorization(
+    const scoped_refptr<Request> &request) {
+  // Look it up for reading only, as it may be shared.
+  const Request *const_request = request.get();
+  if (const_request->get<Authorization>()
+      || const_request->get<ProxyAuthorization>())
+    return;
+  const From *from = const_request->get<From>();
+  if (!from)
+    return;
+  std::vector<AuthCache::Entry*> entries;
+  auth_cache_.LookupPreemptive(from->address().spec(), &entries);
+  for (std::vector<AuthCache::Entry*>::iterator i = entries.begin(),
+       ie = entries.end(); i != ie; ++i) {
+    AuthCache::Entry *entry = *i;
+    if (net::HttpAuth::AUTH_SCHEME_DIGEST != entry->scheme())
+      continue;
+    // Proxies challenge whatever goes through them, but server credentials
+    // are only valid for the server that asked for them.
+    if (net::HttpAuth::AUTH_SERVER == entry->target()
+        && SipURI(entry->origin()).host_piece()
+           != request->sip_request_uri().host_piece())
+      continue;
+    scoped_ptr<AuthHandler> handler;
+    int rv = auth_handler_factory_->CreatePreemptiveAuthHandler(
+        entry->challenge(), entry->target(), entry->origin(),
+        entry->IncrementNonceCount(), net_log_, &handler);
+    if (net::OK != rv)
+      continue;
+    // Digest credentials are generated synchronously.
+    handler->set_auth_cache_entry(entry);
+    rv = handler->GenerateAuth(&entry->credentials(), request,
+                               net::CompletionCallback());
+    DCHECK_NE(net::ERR_IO_PENDING, rv);
+  }
+}
+
 bool UserAgent::HandleChallengeAuthentication(
     const scoped_refptr<Response> &incoming_response,
     const scoped_refptr<Dialog> &dialog) {
@@ -175,7 +294,8 @@ bool UserAgent::HandleChallengeAuthentication(
     outgoing_request_context->auth_transaction_.reset(
         new AuthTransaction(&auth_cache_, auth_handler_factory_,
             password_handler_factory_, net_log_));
-    outgoing_requests_.insert(std::make_pair(original_request->id(),
+    outgoing_requests_.insert(std::make_pair(
+        base::StringPiece(outgoing_request_context->original_request_->id()),
         outgoing_request_context));
   } else {
     outgoing_request_context = i->second;
@@ -184,14 +304,29 @@ bool UserAgent::HandleChallengeAuthentication(
   outgoing_request_context->last_dialog_ = dialog;
   outgoing_request_context->last_response_ = incoming_response;
   scoped_refptr<Request> outgoing_request(original_request->CloneRequest());
+  // Drop the credentials sent preemptively for the challenging target; the
+  // new ones are added once authenticated.
+  if (SIP_UNAUTHORIZED == response_code) {
+    for (Message::iterator j = outgoing_request->find_first<Authorization>();
+         outgoing_request->end() != j;
+         j = outgoing_request->find_first<Authorization>())
+      outgoing_request->erase(j);
+  } else {
+    for (Message::iterator j =
+             outgoing_request->find_first<ProxyAuthorization>();
+         outgoing_request->end() != j;
+         j = outgoing_request->find_first<ProxyAuthorization>())
+      outgoing_request->erase(j);
+  }
   if (dialog) {
     // Update the dialog sequence for each authenticated request
     Message::iterator i = outgoing_request->find_first<Cseq>();
     if (outgoing_request->end() != i) {
       dialog->set_local_sequence(dyn_cast<Cseq>(i)->sequence());
+      dialog_store_->SequenceChanged(dialog);
     }
   }
-  outgoing_request_context->outgoing_requests_.push_back(outgoing_request);
+  outgoing_request_context->outgoing_request_ = outgoing_request;
   AuthTransaction *auth_transaction =
       outgoing_request_context->auth_transaction_.get();
   int rv = auth_transaction->HandleChallengeAuthentication(outgoing_request,
@@ -215,8 +350,9 @@ void UserAgent::OnAuthenticationComplete(
   OutgoingRequestContext *outgoing_request_context = i->second;
   if (net::OK == rv) {
     // Remove topmost Via header
-    scoped_refptr<Request> current_outgoing_request =
-        outgoing_request_context->outgoing_requests_.back();
+    const scoped_refptr<Request> &current_outgoing_request =
+        outgoing_request_context->outgoing_request_;
+    outgoing_request_context->last_response_ = nullptr;
     Message::iterator j =
         current_outgoing_request->find_first<Via>();
     if (current_outgoing_request->end() != j) {
@@ -229,8 +365,11 @@ void UserAgent::OnAuthenticationComplete(
       OnResendRequestComplete(request_id, rv);
     }
   } else {
-    RunUserIncomingResponseCallback(outgoing_request_context->last_response_,
-        outgoing_request_context->last_dialog_);
+    // The challenge is the final response.
+    scoped_refptr<Response> response(outgoing_request_context->last_response_);
+    scoped_refptr<Dialog> dialog(outgoing_request_context->last_dialog_);
+    DestroyOutgoingRequestContext(request_id);
+    RunUserIncomingResponseCallback(response, dialog);
   }
 }
 
@@ -242,11 +381,76 @@ void UserAgent::OnResendRequestComplete(
     return;
   OutgoingRequestContext *outgoing_request_context = i->second;
   if (net::OK != rv) {
-    RunUserTransportErrorCallback(outgoing_request_context->original_request_,
-        rv, outgoing_request_context->last_dialog_);
+    // No final response will come, so the context goes away first.
+    scoped_refptr<Request> original_request(
+        outgoing_request_context->original_request_);
+    scoped_refptr<Dialog> dialog(outgoing_request_context->last_dialog_);
+    DestroyOutgoingRequestContext(request_id);
+    RunUserTransportErrorCallback(original_request, rv, dialog);
   }
 }
 
+void UserAgent::DestroyOutgoingRequestContext(const std::string &request_id) {
+  OutgoingRequestMap::iterator i = outgoing_requests_.find(request_id);
+  if (outgoing_requests_.end() == i)
+    return;
+  // The key points to the id of the context's request.
+  OutgoingRequestContext *outgoing_request_context = i->second;
+  outgoing_requests_.erase(i);
+  delete outgoing_request_context;
+}
+
+int UserAgent::SendForkRequest(ForkContext *fork,
+                               const scoped_refptr<Request> &request) {
+  fork_requests_.insert(std::make_pair(base::StringPiece(request->id()),
+                                       fork));
+  net::CompletionCallback callback(base::Bind(&UserAgent::OnForkRequestSent,
+                                              weak_factory_.GetWeakPtr(),
+                                              request->id()));
+  // Branches get a Via of their own on top of the upstream ones, while
+  // CANCELs take the one of the branch they cancel.
+  int rv;
+  if (Method::CANCEL == request->method())
+    rv = Send(request, callback);
+  else
+    rv = network_layer_->SendProxiedRequest(request, callback);
+  if (net::OK != rv && net::ERR_IO_PENDING != rv)
+    fork_requests_.erase(request->id());
+  return rv;
+}
+
+void UserAgent::OnForkRequestSent(const std::string &request_id, int rv) {
+  DCHECK_NE(rv, net::ERR_IO_PENDING);
+  if (net::OK == rv)
+    return;
+  ForkContext *fork = GetForkOfRequest(request_id);
+  if (!fork)
+    return;
+  fork->HandleError(request_id, rv);
+  MaybeDestroyFork(fork);
+}
+
+ForkContext *UserAgent::GetForkOfRequest(const std::string &request_id) {
+  ForkMap::iterator i = fork_requests_.find(request_id);
+  return fork_requests_.end() == i ? nullptr : i->second;
+}
+
+void UserAgent::MaybeDestroyFork(ForkContext *fork) {
+  if (!fork->is_complete())
+    return;
+  // The keys point to the ids of the fork's requests.
+  const std::vector<scoped_refptr<Request> > &requests =
+      fork->sent_requests();
+  for (std::vector<scoped_refptr<Request> >::const_iterator i =
+       requests.begin(), ie = requests.end(); i != ie; ++i) {
+    ForkMap::iterator j = fork_requests_.find((*i)->id());
+    if (fork_requests_.end() != j && fork == j->second)
+      fork_requests_.erase(j);
+  }
+  forks_.erase(fork->key());
+  delete fork;
+}
+
 void UserAgent::OnChannelConnected(const EndPoint &destination, int err) {
   for (std::vector<Delegate*>::iterator i = handlers_.begin();
        i != handlers_.end(); i++) {
@@ -261,10 +465,39 @@ void UserAgent::OnChannelClosed(const EndPoint &destination) {
   }
 }
 
+void UserAgent::OnNetworkChanged() {
+  for (std::vector<Delegate*>::iterator i = handlers_.begin();
+       i != handlers_.end(); i++) {
+    (*i)->OnNetworkChanged();
+  }
+}
+
 void UserAgent::OnIncomingRequest(
     const scoped_refptr<Request> &request) {
+  if (Method::CANCEL == request->method()) {
+    // A CANCEL shares the topmost Via branch of the request it cancels.
+    const Request *const_request = request.get();
+    const Via *via = const_request->get<Via>();
+    ForkMap::iterator i = forks_.end();
+    if (via && !via->empty() && via->front().HasBranch())
+      i = forks_.find(via->front().branch());
+    if (forks_.end() != i) {
+      ForkContext *fork = i->second;
+      Send(request->CreateResponse(SIP_OK), net::CompletionCallback());
+      fork->Cancel();
+      MaybeDestroyFork(fork);
+      return;
+    }
+  }
   scoped_refptr<Dialog> dialog =
       dialog_controller_->HandleRequest(dialog_store_.get(), request);
+  if (Method::PRACK == request->method()) {
+    // The network layer already stopped the retransmissions of the
+    // acknowledged response, and rejected the PRACKs matching none.
+    Send(dialog ? dialog->CreateResponse(SIP_OK, request)
+                : request->CreateResponse(SIP_OK),
+         net::CompletionCallback());
+  }
   RunUserIncomingRequestCallback(request, dialog);
 }
 
@@ -272,34 +505,42 @@ void UserAgent::OnIncomingResponse(
     const scoped_refptr<Response> &response) {
   scoped_refptr<Dialog> dialog =
       dialog_controller_->HandleResponse(dialog_store_.get(), response);
+  PrefetchNextHop(dialog, response.get());
+  ForkContext *fork = response->refer_to()
+      ? GetForkOfRequest(response->refer_to()->id()) : nullptr;
+  if (fork) {
+    fork->HandleResponse(response);
+    MaybeDestroyFork(fork);
+    return;
+  }
+  if (response->IsReliableProvisional()
+      && !AcknowledgeProvisionalResponse(response, dialog))
+    return;
+  if (response->refer_to()
+      && Method::PRACK == response->refer_to()->method()) {
+    // PRACKs are sent by the user agent itself.
+    if (200 <= response->response_code())
+      DestroyOutgoingRequestContext(response->refer_to()->id());
+    return;
+  }
   if (HandleChallengeAuthentication(response, dialog))
     return;
   if (200 <= response->response_code()
-      && nullptr != response->refer_to()) {
-    OutgoingRequestMap::iterator i =
-        outgoing_requests_.find(response->refer_to()->id());
-    if (outgoing_requests_.end() != i) {
-      OutgoingRequestContext *outgoing_request_context = i->second;
-      // Remove the original request first
-      outgoing_requests_.erase(
-          outgoing_request_context->original_request_->id());
-      // Remove children authenticating requests
-      std::vector<scoped_refptr<Request> >& outgoing_requests =
-          outgoing_request_context->outgoing_requests_;
-      for (std::vector<scoped_refptr<Request> >::iterator j =
-          outgoing_requests.begin(); j != outgoing_requests.end(); ++j) {
-        outgoing_requests_.erase((*j)->id());
-      }
-      // Finally delete context
-      delete outgoing_request_context;
-    }
-  }
+      && nullptr != response->refer_to())
+    DestroyOutgoingRequestContext(response->refer_to()->id());
   RunUserIncomingResponseCallback(response, dialog);
 }
 
 void UserAgent::OnTimedOut(const scoped_refptr<Request> &request) {
+  DestroyOutgoingRequestContext(request->id());
   scoped_refptr<Dialog> dialog =
       dialog_controller_->HandleRequestError(dialog_store_.get(), request);
+  ForkContext *fork = GetForkOfRequest(request->id());
+  if (fork) {
+    fork->HandleError(request->id(), net::ERR_TIMED_OUT);
+    MaybeDestroyFork(fork);
+    return;
+  }
   for (std::vector<Delegate*>::iterator i = handlers_.begin();
        i != handlers_.end(); i++) {
     (*i)->OnTimedOut(request, dialog);
@@ -308,14 +549,37 @@ void UserAgent::OnTimedOut(const scoped_refptr<Request> &request) {
 
 void UserAgent::OnTransportError(
     const scoped_refptr<Request> &request, int err) {
+  DestroyOutgoingRequestContext(request->id());
   scoped_refptr<Dialog> dialog =
       dialog_controller_->HandleRequestError(dialog_store_.get(), request);
+  ForkContext *fork = GetForkOfRequest(request->id());
+  if (fork) {
+    fork->HandleError(request->id(), err);
+    MaybeDestroyFork(fork);
+    return;
+  }
   for (std::vector<Delegate*>::iterator i = handlers_.begin();
        i != handlers_.end(); i++) {
     (*i)->OnTransportError(request, err, dialog);
   }
 }
 
+bool UserAgent::AcknowledgeProvisionalResponse(
+    const scoped_refptr<Response> &response,
+    const scoped_refptr<Dialog> &dialog) {
+  if (!dialog) {
+    DVLOG(1) << "Reliable provisional response without a dialog";
+    return true;
+  }
+  scoped_refptr<Request> prack(dialog->CreatePrack(response));
+  if (!prack)
+    return false;
+  int rv = Send(prack, net::CompletionCallback());
+  if (net::OK != rv && net::ERR_IO_PENDING != rv)
+    DVLOG(1) << "Couldn't send the PRACK: " << net::ErrorToString(rv);
+  return true;
+}
+
 void UserAgent::RunUserIncomingRequestCallback(
     const scoped_refptr<Request> &request,
     const scoped_refptr<Dialog> &dialog) {
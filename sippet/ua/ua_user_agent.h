@@ -6,13 +6,18 @@
 #define SIPPET_UA_USER_AGENT_H_
 
 #include "sippet/transport/network_layer.h"
+#include "sippet/transport/timer_wheel.h"
 #include "sippet/ua/dialog.h"
 #include "sippet/ua/auth_transaction.h"
 #include "sippet/ua/auth_cache.h"
+#include "sippet/ua/fork_context.h"
+#include "sippet/uri/uri.h"
 
-#include <map>
 #include <vector>
 
+#include "base/containers/hash_tables.h"
+#include "base/strings/string_piece.h"
+
 namespace sippet {
 
 class Message;
@@ -31,7 +36,10 @@ namespace ua {
 // |Delegate| implementation. Also, if that response contains an authentication
 // challenge, it will authenticate using one of the available schemes provided
 // by the |AuthHandlerFactory|, collecting usernames and passwords through the
-// |PasswordHandler| implementation.
+// |PasswordHandler| implementation. Once a digest challenge is answered,
+// new requests of the same account are authorized preemptively with the
+// cached challenge and the next nonce count, saving the round trip until
+// the nonce gets stale.
 //
 // As server, it will receive any incoming request from the network and pass
 // them upwards. Provisional and success responses will automatically create
@@ -40,9 +48,17 @@ namespace ua {
 // Multiple |Delegate| implementations may be provided to the |UserAgent|, each
 // handling, or not, their own set of requests, responses and connection
 // feedbacks.
+//
+// Acting as a stateful proxy, it can also fork incoming requests to several
+// targets through a |ForkContext|. Responses, timeouts and errors of the
+// forked requests, and the CANCELs of requests being forked, are then
+// handled by the |ForkContext| instead of the delegates.
 class UserAgent :
   public NetworkLayer::Delegate {
  public:
+  // Resolution of the timers of the dialog usages, in milliseconds.
+  static const int kUsageTimerResolutionMs = 100;
+
   class Delegate {
    public:
     virtual ~Delegate() {}
@@ -79,6 +95,36 @@ class UserAgent :
     virtual void OnTransportError(
         const scoped_refptr<Request> &request, int error,
         const scoped_refptr<Dialog> &dialog) = 0;
+
+    // The IP addresses of the host changed, and the channels were closed.
+    // Registrations should be refreshed through the new network.
+    virtual void OnNetworkChanged() {}
+  };
+
+  // The state of a user agent, see |Introspect|.
+  struct Introspection {
+    Introspection();
+
+    size_t dialogs;
+    // Requests sent and waiting for their final response, counting their
+    // authenticated retries once.
+    size_t outgoing_requests;
+    // Incoming requests being forked.
+    size_t forks;
+    // Accounts and challenges of |auth_cache|.
+    size_t auth_cache_entries;
+  };
+
+  // How the next hop of a dialog is prepared as soon as the dialog is
+  // created or confirmed, or its remote target refreshed, so that the next
+  // request within it, such as the ACK or the BYE hanging up, doesn't wait
+  // for DNS (see |NetworkLayer::Prefetch|).
+  enum NextHopPrefetch {
+    PREFETCH_NONE,
+    // Resolve its host.
+    PREFETCH_RESOLVE,
+    // Open TCP and TLS channels to it too.
+    PREFETCH_CONNECT,
   };
 
   // Construct a |UserAgent|.
@@ -97,11 +143,17 @@ class UserAgent :
   // constituted by a single URI.
   void set_route_set(const std::vector<GURL> &route_set) {
     route_set_.assign(route_set.begin(), route_set.end());
+    first_route_ = route_set_.empty() ? SipURI() : SipURI(route_set_.front());
   }
   const std::vector<GURL> &route_set() {
     return route_set_;
   }
 
+  // Defaults to |PREFETCH_RESOLVE|.
+  void set_next_hop_prefetch(NextHopPrefetch next_hop_prefetch) {
+    next_hop_prefetch_ = next_hop_prefetch;
+  }
+
   // Append an User Agent handler. Handlers receive events in the same order
   // they were registered.
   void AppendHandler(Delegate *delegate);
@@ -118,12 +170,47 @@ class UserAgent :
       unsigned local_sequence=0);
 
   // Send a message throughout the nextwork layer. This function encapsulates
-  // the dialog creation/destruction handling.
+  // the dialog creation/destruction handling. Requests within a dialog are
+  // sent to its cached next hop.
   int Send(
       const scoped_refptr<Message> &message,
       const net::CompletionCallback& callback);
 
+  // Forks an incoming request to |targets|, answering it with the responses
+  // of the branches (see |ForkContext|). Returns |net::ERR_INVALID_ARGUMENT|
+  // if there are no targets, and |net::ERR_UNEXPECTED| if the request is
+  // already being forked.
+  int Fork(const scoped_refptr<Request> &incoming_request,
+           const std::vector<GURL> &targets,
+           ForkContext::Mode mode);
+
+  // Returns the dialog |message| pertains to, or NULL if none.
+  scoped_refptr<Dialog> GetDialog(const Message *message);
+
+  // Terminates |dialog|, once none of its usages needs it anymore. Dialogs
+  // created by SUBSCRIBE requests aren't terminated by a BYE, and so are
+  // terminated by their usage instead.
+  void TerminateDialog(const scoped_refptr<Dialog> &dialog);
+
+  // The dialogs of the user agent, to be saved to snapshots or replicated
+  // to a standby (see |DialogStore|).
+  DialogStore *dialog_store() { return dialog_store_.get(); }
+
+  // The wheel driving the timers of the dialog usages (subscriptions,
+  // session refreshes...), so that all of them share a single tick.
+  TimerWheel *timer_wheel() { return &timer_wheel_; }
+
+  // The identities used to authenticate the requests, and the challenges
+  // they answered (see |CredentialCache::Prefetch|).
+  AuthCache *auth_cache() { return &auth_cache_; }
+
+  // Fills |introspection| with the sizes of the tables of the user agent.
+  // Like |NetworkLayer::Introspect|, it's cheap and, called on the thread
+  // of the network layer, consistent with it.
+  void Introspect(Introspection *introspection) const;
+
  private:
+  friend class ForkContext;
   friend struct base::DefaultDeleter<UserAgent>;
   ~UserAgent() override;
 
@@ -133,29 +220,62 @@ class UserAgent :
   struct OutgoingRequestContext {
     // Holds the outgoing request instance.
     scoped_refptr<Request> original_request_;
-    // Holds the outgoing request instances.
-    std::vector<scoped_refptr<Request> > outgoing_requests_;
+    // Holds the last authenticated copy of |original_request_|; previous
+    // attempts are released as soon as a new challenge replaces them.
+    scoped_refptr<Request> outgoing_request_;
     // First sent time
     base::Time parted_time_;
     // Used to manage authentication
     scoped_ptr<AuthTransaction> auth_transaction_;
     // Used to hold the last matched dialog (when authenticating)
     scoped_refptr<Dialog> last_dialog_;
-    // Used to hold the last received response
+    // Used to hold the last received challenge, until the request is
+    // authenticated again
     scoped_refptr<Response> last_response_;
 
     OutgoingRequestContext(const scoped_refptr<Request>& original_request);
     ~OutgoingRequestContext();
   };
 
-  typedef std::map<std::string, OutgoingRequestContext*>
+  // Keyed by the id of |original_request_|, which the retries share.
+  typedef base::hash_map<base::StringPiece, OutgoingRequestContext*>
       OutgoingRequestMap;
 
+  // Fork contexts keyed by |ForkContext::key|, and by the ids of their
+  // |ForkContext::sent_requests|.
+  typedef base::hash_map<base::StringPiece, ForkContext*> ForkMap;
+
+  // Prefetches the next hop of |dialog|, if |response| created, confirmed
+  // or refreshed it.
+  void PrefetchNextHop(const scoped_refptr<Dialog> &dialog,
+                       const Response *response);
+
+  // Adds the credentials of the digest challenges cached for the account of
+  // |request|, unless it's already authorized.
+  void AddPreemptiveAuthorization(const scoped_refptr<Request> &request);
+
   bool HandleChallengeAuthentication(
       const scoped_refptr<Response> &incoming_response,
       const scoped_refptr<Dialog> &dialog);
+
+  // Sends the PRACK of a reliable provisional response. Returns false if
+  // the response has to be discarded, being a retransmission or out of
+  // order (RFC 3262 section 4).
+  bool AcknowledgeProvisionalResponse(
+      const scoped_refptr<Response> &response,
+      const scoped_refptr<Dialog> &dialog);
   void OnAuthenticationComplete(const std::string &request_id, int rv);
   void OnResendRequestComplete(const std::string &request_id, int rv);
+  // Forgets the outgoing request context of |request_id|, if any.
+  void DestroyOutgoingRequestContext(const std::string &request_id);
+
+  // Sends a request of |fork|, routing its responses and errors back to it.
+  int SendForkRequest(ForkContext *fork,
+                      const scoped_refptr<Request> &request);
+  void OnForkRequestSent(const std::string &request_id, int rv);
+  ForkContext *GetForkOfRequest(const std::string &request_id);
+  // Destroys |fork| if it's complete.
+  void MaybeDestroyFork(ForkContext *fork);
 
   // sippet::NetworkLayer::Delegate methods:
   void OnChannelConnected(const EndPoint &destination, int err) override;
@@ -165,6 +285,7 @@ class UserAgent :
   void OnTimedOut(const scoped_refptr<Request> &request) override;
   void OnTransportError(
       const scoped_refptr<Request> &request, int err) override;
+  void OnNetworkChanged() override;
 
   void RunUserIncomingRequestCallback(
       const scoped_refptr<Request> &request,
@@ -179,6 +300,8 @@ class UserAgent :
 
   NetworkLayer *network_layer_;
   UrlListType route_set_;
+  // Parsed copy of the first entry of |route_set_|.
+  SipURI first_route_;
   HandlerListType handlers_;
   AuthCache auth_cache_;
   AuthHandlerFactory *auth_handler_factory_;
@@ -188,6 +311,10 @@ class UserAgent :
   scoped_ptr<DialogStore> dialog_store_;
   DialogController *dialog_controller_;
   OutgoingRequestMap outgoing_requests_;
+  ForkMap forks_;
+  ForkMap fork_requests_;
+  TimerWheel timer_wheel_;
+  NextHopPrefetch next_hop_prefetch_;
 
   base::WeakPtrFactory<UserAgent> weak_factory_;
   DISALLOW_COPY_AND_ASSIGN(UserAgent);
@@ -10,7 +10,9 @@
 #include <algorithm>
 
 #include "sippet/base/stl_extras.h"
+#include "sippet/uri/uri_canon_internal.h"
 
+#include "base/basictypes.h"
 #include "base/logging.h"
 #include "base/strings/string_piece.h"
 #include "base/strings/string_util.h"
@@ -79,24 +81,77 @@ bool InitCanonicalTelURI(const STR& input_spec,
 std::pair<bool, std::string> LookupKeyValue(
     const std::string &spec,
     const std::string &name,
-    uri::Component query,
-    bool (*extractor)(const char*, uri::Component*,
-        uri::Component*, uri::Component*)) {
-  uri::Component key, value;
-  while ((*extractor)(
-          spec.data(), &query, &key, &value)) {
-      std::string unescaped_key(
-          uri_details::UnescapedComponentString(spec, key));
-      if (!base::EqualsCaseInsensitiveASCII(unescaped_key, name))
-        continue;
-      return std::make_pair(true,
-          uri_details::UnescapedComponentString(spec, value));
+    const uri::Component &component,
+    const uri_details::KeyValueIndex &index,
+    uri_details::KeyValueIndex::Extractor extractor) {
+  uri::Component value;
+  if (!index.Find(spec, component, extractor, name, &value))
+    return std::make_pair(false, "");
+  return std::make_pair(true,
+      uri_details::UnescapedComponentString(spec, value));
+}
+
+bool LookupKeyValue(
+    const std::string &spec,
+    const base::StringPiece &name,
+    const uri::Component &component,
+    const uri_details::KeyValueIndex &index,
+    uri_details::KeyValueIndex::Extractor extractor,
+    base::StringPiece *value) {
+  uri::Component found;
+  if (!index.Find(spec, component, extractor, name, &found))
+    return false;
+  if (value) {
+    if (found.len > 0)
+      value->set(spec.data() + found.begin, found.len);
+    else
+      value->clear();
   }
-  return std::make_pair(false, "");
+  return true;
+}
+
+bool KeyMatches(const std::string &spec,
+                const uri::Component &key,
+                const base::StringPiece &name) {
+  base::StringPiece raw_key(spec.data() + key.begin, key.len);
+  if (raw_key.find('%') == base::StringPiece::npos)
+    return base::EqualsCaseInsensitiveASCII(raw_key, name);
+  // Escaped keys are rare enough to be unescaped at every comparison.
+  return base::EqualsCaseInsensitiveASCII(
+      uri_details::UnescapedComponentString(spec, key), name);
 }
 
 }  // namespace
 
+namespace uri_details {
+
+bool KeyValueIndex::Find(const std::string &spec,
+                         const uri::Component &component,
+                         Extractor extractor,
+                         const base::StringPiece &name,
+                         uri::Component *value) const {
+  if (!component.is_nonempty())
+    return false;
+  if (!built_) {
+    uri::Component query(component), key, entry_value;
+    while ((*extractor)(spec.data(), &query, &key, &entry_value)) {
+      if (key.len > 0)
+        entries_.push_back(std::make_pair(key, entry_value));
+    }
+    built_ = true;
+  }
+  for (std::vector<Entry>::const_iterator i = entries_.begin(),
+       ie = entries_.end(); i != ie; ++i) {
+    if (KeyMatches(spec, i->first, name)) {
+      *value = i->second;
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace uri_details
+
 // SipURI --------------------------------------------------------------------
 
 SipURI::SipURI() : is_valid_(false) {
@@ -109,7 +164,9 @@ SipURI::SipURI(const GURL &other) {
 
 SipURI::SipURI(const SipURI& other) : spec_(other.spec_),
   is_valid_(other.is_valid_),
-  parsed_(other.parsed_) {
+  parsed_(other.parsed_),
+  parameter_index_(other.parameter_index_),
+  header_index_(other.header_index_) {
 }
 
 SipURI::SipURI(const std::string& uri_string) {
@@ -156,6 +213,8 @@ SipURI& SipURI::operator=(const SipURI& other) {
   spec_ = other.spec_;
   is_valid_ = other.is_valid_;
   parsed_ = other.parsed_;
+  parameter_index_ = other.parameter_index_;
+  header_index_ = other.header_index_;
   return *this;
 }
 
@@ -168,9 +227,8 @@ const std::string& SipURI::spec() const {
   return empty;
 }
 
-bool SipURI::Equivalent(const SipURI& other) {
-  // TODO(david)
-  return false;
+bool SipURI::Equivalent(const SipURI& other) const {
+  return SipURIEquals(*this, other);
 }
 
 SipURI SipURI::GetWithEmptyHeaders() const {
@@ -187,6 +245,7 @@ SipURI SipURI::GetWithEmptyHeaders() const {
 
   // Clear the headers.
   other.parsed_.headers.reset();
+  other.header_index_.Reset();
   return other;
 }
 
@@ -196,16 +255,21 @@ SipURI SipURI::GetOrigin() const {
   if (!is_valid_)
     return SipURI();
 
-  std::ostringstream spec;
-  spec << scheme() << ":" << host();
-  if (has_port())
-    spec << port();
-  bool exists;
-  std::string value;
-  tie(exists, value) = parameter("transport");
-  if (exists)
-    spec << ";transport=" << value;
-  return SipURI(spec.str());
+  std::string spec;
+  spec.reserve(spec_.size());
+  scheme_piece().AppendToString(&spec);
+  spec += ':';
+  host_piece().AppendToString(&spec);
+  if (has_port()) {
+    spec += ':';
+    port_piece().AppendToString(&spec);
+  }
+  base::StringPiece transport;
+  if (parameter("transport", &transport)) {
+    spec += ";transport=";
+    transport.AppendToString(&spec);
+  }
+  return SipURI(spec);
 }
 
 bool SipURI::SchemeIs(const char* lower_ascii_scheme) const {
@@ -294,6 +358,8 @@ void SipURI::Swap(SipURI* other) {
   spec_.swap(other->spec_);
   std::swap(is_valid_, other->is_valid_);
   std::swap(parsed_, other->parsed_);
+  parameter_index_.Swap(&other->parameter_index_);
+  header_index_.Swap(&other->header_index_);
 }
 
 const SipURI& SipURI::EmptyURI() {
@@ -302,15 +368,27 @@ const SipURI& SipURI::EmptyURI() {
 }
 
 std::pair<bool, std::string> SipURI::parameter(const std::string &name) const {
-  return LookupKeyValue(spec_, name, parsed_.parameters,
+  return LookupKeyValue(spec_, name, parsed_.parameters, parameter_index_,
       &uri::ExtractParametersKeyValue);
 }
 
 std::pair<bool, std::string> SipURI::header(const std::string &name) const {
-  return LookupKeyValue(spec_, name, parsed_.headers,
+  return LookupKeyValue(spec_, name, parsed_.headers, header_index_,
       &uri::ExtractHeadersKeyValue);
 }
 
+bool SipURI::parameter(const base::StringPiece &name,
+                       base::StringPiece *value) const {
+  return LookupKeyValue(spec_, name, parsed_.parameters, parameter_index_,
+      &uri::ExtractParametersKeyValue, value);
+}
+
+bool SipURI::header(const base::StringPiece &name,
+                    base::StringPiece *value) const {
+  return LookupKeyValue(spec_, name, parsed_.headers, header_index_,
+      &uri::ExtractHeadersKeyValue, value);
+}
+
 // TelURI --------------------------------------------------------------------
 
 TelURI::TelURI() : is_valid_(false) {
@@ -323,7 +401,8 @@ TelURI::TelURI(const GURL &other) {
 
 TelURI::TelURI(const TelURI& other) : spec_(other.spec_),
   is_valid_(other.is_valid_),
-  parsed_(other.parsed_) {
+  parsed_(other.parsed_),
+  parameter_index_(other.parameter_index_) {
 }
 
 TelURI::TelURI(const std::string& uri_string) {
@@ -366,6 +445,7 @@ TelURI& TelURI::operator=(const TelURI& other) {
   spec_ = other.spec_;
   is_valid_ = other.is_valid_;
   parsed_ = other.parsed_;
+  parameter_index_ = other.parameter_index_;
   return *this;
 }
 
@@ -439,6 +519,7 @@ void TelURI::Swap(TelURI* other) {
   spec_.swap(other->spec_);
   std::swap(is_valid_, other->is_valid_);
   std::swap(parsed_, other->parsed_);
+  parameter_index_.Swap(&other->parameter_index_);
 }
 
 const TelURI& TelURI::EmptyURI() {
@@ -447,10 +528,214 @@ const TelURI& TelURI::EmptyURI() {
 }
 
 std::pair<bool, std::string> TelURI::parameter(const std::string &name) const {
-  return LookupKeyValue(spec_, name, parsed_.parameters,
+  return LookupKeyValue(spec_, name, parsed_.parameters, parameter_index_,
       &uri::ExtractParametersKeyValue);
 }
 
+bool TelURI::parameter(const base::StringPiece &name,
+                       base::StringPiece *value) const {
+  return LookupKeyValue(spec_, name, parsed_.parameters, parameter_index_,
+      &uri::ExtractParametersKeyValue, value);
+}
+
+// Comparison ----------------------------------------------------------------
+
+namespace {
+
+// Parameters that make URIs differ when present in only one of them.
+const char *const kSignificantParameters[] = {
+  "user", "ttl", "method", "maddr",
+};
+
+// Reads the character at |*cur|, decoding escape sequences, and advances
+// |*cur| past it.
+unsigned char ReadDecodedChar(const char* spec, int* cur, int end) {
+  unsigned char ch = static_cast<unsigned char>(spec[*cur]);
+  int i = *cur;
+  if (ch != '%' || !url::DecodeEscaped(spec, &i, end, &ch))
+    ch = static_cast<unsigned char>(spec[i]);
+  *cur = i + 1;
+  return ch;
+}
+
+unsigned char Fold(unsigned char ch, bool ignore_case) {
+  return ignore_case ? base::ToLowerASCII(ch) : ch;
+}
+
+bool ComponentsEqual(const char* a_spec, const uri::Component& a,
+                     const char* b_spec, const uri::Component& b,
+                     bool ignore_case) {
+  int i = a.begin, i_end = a.begin + std::max(a.len, 0);
+  int j = b.begin, j_end = b.begin + std::max(b.len, 0);
+  while (i < i_end && j < j_end) {
+    if (Fold(ReadDecodedChar(a_spec, &i, i_end), ignore_case) !=
+        Fold(ReadDecodedChar(b_spec, &j, j_end), ignore_case))
+      return false;
+  }
+  return i == i_end && j == j_end;
+}
+
+bool ComponentEqualsASCII(const char* spec, const uri::Component& component,
+                          const char* lower_ascii) {
+  int i = component.begin, end = component.begin + std::max(component.len, 0);
+  for (; i < end && *lower_ascii; ++lower_ascii) {
+    if (base::ToLowerASCII(ReadDecodedChar(spec, &i, end)) != *lower_ascii)
+      return false;
+  }
+  return i == end && !*lower_ascii;
+}
+
+// FNV-1a over the decoded characters of |component|, starting from |hash|.
+size_t HashComponent(const char* spec, const uri::Component& component,
+                     bool ignore_case, size_t hash) {
+  int i = component.begin, end = component.begin + std::max(component.len, 0);
+  while (i < end) {
+    hash ^= Fold(ReadDecodedChar(spec, &i, end), ignore_case);
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+const size_t kHashSeed = 2166136261U;
+
+// Looks for the pair whose key matches |key| in |b_spec|'s |b_query|.
+bool FindMatchingKey(const char* a_spec, const uri::Component& key,
+                     const char* b_spec, uri::Component b_query,
+                     uri_details::KeyValueIndex::Extractor extractor,
+                     uri::Component* value) {
+  uri::Component b_key;
+  while ((*extractor)(b_spec, &b_query, &b_key, value)) {
+    if (b_key.len > 0 && ComponentsEqual(a_spec, key, b_spec, b_key, true))
+      return true;
+  }
+  return false;
+}
+
+bool IsSignificantParameter(const char* spec, const uri::Component& key) {
+  for (size_t i = 0; i < arraysize(kSignificantParameters); ++i) {
+    if (ComponentEqualsASCII(spec, key, kSignificantParameters[i]))
+      return true;
+  }
+  return false;
+}
+
+// Checks the pairs of |a_query| against |b_query|. Every pair present in both
+// must have matching values; pairs found only in |a_query| are accepted when
+// |ignore_missing| allows it.
+bool KeyValuesMatch(const char* a_spec, uri::Component a_query,
+                    const char* b_spec, const uri::Component& b_query,
+                    uri_details::KeyValueIndex::Extractor extractor,
+                    bool (*ignore_missing)(const char*, const uri::Component&)) {
+  uri::Component key, value, other_value;
+  while ((*extractor)(a_spec, &a_query, &key, &value)) {
+    if (key.len <= 0)
+      continue;
+    if (FindMatchingKey(a_spec, key, b_spec, b_query, extractor,
+                        &other_value)) {
+      if (!ComponentsEqual(a_spec, value, b_spec, other_value, true))
+        return false;
+    } else if (!ignore_missing(a_spec, key)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool IgnoreInsignificantParameter(const char* spec,
+                                  const uri::Component& key) {
+  return !IsSignificantParameter(spec, key);
+}
+
+bool NeverIgnore(const char* spec, const uri::Component& key) {
+  return false;
+}
+
+// Sums up the hashes of the pairs in |component|, so that their order doesn't
+// matter. Like the comparison, only the first pair of a repeated key counts.
+size_t HashKeyValues(const char* spec, const uri::Component& component,
+                     uri_details::KeyValueIndex::Extractor extractor,
+                     bool (*ignore)(const char*, const uri::Component&)) {
+  size_t hash = 0;
+  uri::Component query(component), key, value, previous;
+  while ((*extractor)(spec, &query, &key, &value)) {
+    if (key.len <= 0 || ignore(spec, key))
+      continue;
+    uri::Component before(component.begin, key.begin - component.begin);
+    if (FindMatchingKey(spec, key, spec, before, extractor, &previous))
+      continue;
+    hash += HashComponent(spec, value, true,
+                          HashComponent(spec, key, true, kHashSeed));
+  }
+  return hash;
+}
+
+}  // namespace
+
+bool SipURIEquals(const SipURI &a, const SipURI &b) {
+  if (!a.is_valid() || !b.is_valid())
+    return false;
+  if (a.SchemeIsSecure() != b.SchemeIsSecure())
+    return false;
+
+  const char* a_spec = a.possibly_invalid_spec().data();
+  const char* b_spec = b.possibly_invalid_spec().data();
+  const uri::Parsed& a_parsed = a.parsed_for_possibly_invalid_spec();
+  const uri::Parsed& b_parsed = b.parsed_for_possibly_invalid_spec();
+
+  // User info is the only case sensitive component.
+  if (a.has_username() != b.has_username() ||
+      a.has_password() != b.has_password() ||
+      !ComponentsEqual(a_spec, a_parsed.username,
+                       b_spec, b_parsed.username, false) ||
+      !ComponentsEqual(a_spec, a_parsed.password,
+                       b_spec, b_parsed.password, false))
+    return false;
+
+  if (!ComponentsEqual(a_spec, a_parsed.host, b_spec, b_parsed.host, true))
+    return false;
+
+  // A URI omitting the port doesn't match one with the default port.
+  if (a.has_port() != b.has_port() || a.IntPort() != b.IntPort())
+    return false;
+
+  return KeyValuesMatch(a_spec, a_parsed.parameters,
+                        b_spec, b_parsed.parameters,
+                        &uri::ExtractParametersKeyValue,
+                        &IgnoreInsignificantParameter) &&
+         KeyValuesMatch(b_spec, b_parsed.parameters,
+                        a_spec, a_parsed.parameters,
+                        &uri::ExtractParametersKeyValue,
+                        &IgnoreInsignificantParameter) &&
+         KeyValuesMatch(a_spec, a_parsed.headers,
+                        b_spec, b_parsed.headers,
+                        &uri::ExtractHeadersKeyValue, &NeverIgnore) &&
+         KeyValuesMatch(b_spec, b_parsed.headers,
+                        a_spec, a_parsed.headers,
+                        &uri::ExtractHeadersKeyValue, &NeverIgnore);
+}
+
+size_t SipURIHash(const SipURI &uri) {
+  if (!uri.is_valid())
+    return 0;
+
+  const char* spec = uri.possibly_invalid_spec().data();
+  const uri::Parsed& parsed = uri.parsed_for_possibly_invalid_spec();
+
+  size_t hash = kHashSeed ^ (uri.SchemeIsSecure() ? 1 : 0);
+  hash = HashComponent(spec, parsed.username, false, hash);
+  hash = HashComponent(spec, parsed.password, false, hash);
+  hash = HashComponent(spec, parsed.host, true, hash);
+  hash = hash * 31 + static_cast<size_t>(uri.IntPort());
+
+  // Only parameters that can't be ignored by the comparison count.
+  hash += HashKeyValues(spec, parsed.parameters,
+                        &uri::ExtractParametersKeyValue,
+                        &IgnoreInsignificantParameter);
+  hash = hash * 31 + HashKeyValues(spec, parsed.headers,
+                                   &uri::ExtractHeadersKeyValue, &NeverIgnore);
+  return hash;
+}
+
 }  // namespace sippet
 
 std::ostream& operator<<(std::ostream& out, const sippet::SipURI& uri) {
@@ -5,10 +5,14 @@
 #ifndef SIPPET_MESSAGE_URI_H_
 #define SIPPET_MESSAGE_URI_H_
 
+#include <utility>
+#include <vector>
+
 #include "url/gurl.h"
 #include "sippet/uri/uri_parse.h"
 #include "sippet/uri/uri_canon.h"
 #include "sippet/uri/uri_util.h"
+#include "base/strings/string_piece.h"
 #include "base/strings/string_util.h"
 
 namespace sippet {
@@ -24,6 +28,16 @@ std::string ComponentString(const std::string &spec,
   return std::string(spec, comp.begin, comp.len);
 }
 
+// Returns a view of the substring of the input identified by the given
+// component. The view is only valid while |spec| is alive and unchanged.
+inline
+base::StringPiece ComponentStringPiece(const std::string &spec,
+                                       const uri::Component& comp) {
+  if (comp.len <= 0)
+    return base::StringPiece();
+  return base::StringPiece(spec.data() + comp.begin, comp.len);
+}
+
 // Returns the unescaped substring of the input identified by the given
 // component.
 inline
@@ -36,6 +50,43 @@ std::string UnescapedComponentString(const std::string &spec,
   return unescaped;
 }
 
+// Locates the key-value pairs of a parameters or headers component. The
+// component is scanned once, on the first lookup, and the positions of the
+// pairs are kept for the lookups that follow. Positions refer to the spec,
+// so the index stays valid when copied along with it.
+class KeyValueIndex {
+ public:
+  typedef bool (*Extractor)(const char*, uri::Component*,
+                            uri::Component*, uri::Component*);
+
+  KeyValueIndex() : built_(false) {}
+
+  // Forgets the pairs, to be used when the indexed component changes.
+  void Reset() {
+    built_ = false;
+    entries_.clear();
+  }
+
+  void Swap(KeyValueIndex *other) {
+    std::swap(built_, other->built_);
+    entries_.swap(other->entries_);
+  }
+
+  // Finds the pair whose key matches |name|, ignoring case, and sets |value|
+  // to the position of its (still escaped) value.
+  bool Find(const std::string &spec,
+            const uri::Component &component,
+            Extractor extractor,
+            const base::StringPiece &name,
+            uri::Component *value) const;
+
+ private:
+  typedef std::pair<uri::Component, uri::Component> Entry;
+
+  mutable bool built_;
+  mutable std::vector<Entry> entries_;
+};
+
 } // End of uri_details namespace
 
 // The SipURI object accepts sip and sips schemes.
@@ -138,9 +189,8 @@ class SipURI {
     return spec_ < other.spec_;
   }
 
-  // Performs equality comparison using RFC 3261 standard.  It fails to compare
-  // SIP headers, therefore it cannot be used to compare these kind of URIs.
-  bool Equivalent(const SipURI& other);
+  // Performs equality comparison using RFC 3261 standard. See SipURIEquals.
+  bool Equivalent(const SipURI& other) const;
 
   // A helper function that is equivalent to removing all headers
   SipURI GetWithEmptyHeaders() const;
@@ -191,6 +241,31 @@ class SipURI {
     return uri_details::ComponentString(spec_, parsed_.headers);
   }
 
+  // Same as above, but returning views into the spec instead of copies. They
+  // are valid while the URI is alive and unchanged. Unlike username() and
+  // password(), the corresponding views are not unescaped.
+  base::StringPiece scheme_piece() const {
+    return uri_details::ComponentStringPiece(spec_, parsed_.scheme);
+  }
+  base::StringPiece username_piece() const {
+    return uri_details::ComponentStringPiece(spec_, parsed_.username);
+  }
+  base::StringPiece password_piece() const {
+    return uri_details::ComponentStringPiece(spec_, parsed_.password);
+  }
+  base::StringPiece host_piece() const {
+    return uri_details::ComponentStringPiece(spec_, parsed_.host);
+  }
+  base::StringPiece port_piece() const {
+    return uri_details::ComponentStringPiece(spec_, parsed_.port);
+  }
+  base::StringPiece parameters_piece() const {
+    return uri_details::ComponentStringPiece(spec_, parsed_.parameters);
+  }
+  base::StringPiece headers_piece() const {
+    return uri_details::ComponentStringPiece(spec_, parsed_.headers);
+  }
+
   // Existance querying. These functions will return true if the corresponding
   // URI component exists in this URI. Note that existance is different than
   // being nonempty. sip:user@domain.com? has headers that just happens to
@@ -259,6 +334,15 @@ class SipURI {
   // Returns the given header if available.
   std::pair<bool, std::string> header(const std::string &name) const;
 
+  // Same as above, but without copying: when found, |value| (if not NULL) is
+  // set to the value as it appears in the spec, still escaped. Parameters and
+  // headers are indexed on the first lookup, so that later lookups don't
+  // rescan the URI.
+  bool parameter(const base::StringPiece &name,
+                 base::StringPiece *value) const;
+  bool header(const base::StringPiece &name,
+              base::StringPiece *value) const;
+
  private:
   // The actual text of the URI, in canonical ASCII form.
   std::string spec_;
@@ -270,6 +354,10 @@ class SipURI {
 
   // Identified components of the canonical spec.
   uri::Parsed parsed_;
+
+  // Positions of the parameters and headers, built on demand.
+  uri_details::KeyValueIndex parameter_index_;
+  uri_details::KeyValueIndex header_index_;
 };
 
 // The TelURI object accepts only TEL-URI schemes.
@@ -387,6 +475,18 @@ class TelURI {
     return uri_details::ComponentString(spec_, parsed_.parameters);
   }
 
+  // Same as above, but returning views into the spec instead of copies. They
+  // are valid while the URI is alive and unchanged.
+  base::StringPiece scheme_piece() const {
+    return uri_details::ComponentStringPiece(spec_, parsed_.scheme);
+  }
+  base::StringPiece telephone_subscriber_piece() const {
+    return uri_details::ComponentStringPiece(spec_, parsed_.username);
+  }
+  base::StringPiece parameters_piece() const {
+    return uri_details::ComponentStringPiece(spec_, parsed_.parameters);
+  }
+
   // Existance querying. These functions will return true if the corresponding
   // URI component exists in this URI. Note that existance is different than
   // being nonempty. sip:user@domain.com? has headers that just happens to
@@ -413,6 +513,10 @@ class TelURI {
   // Returns the given parameter if available.
   std::pair<bool, std::string> parameter(const std::string &name) const;
 
+  // Same as above, but without copying. See SipURI::parameter.
+  bool parameter(const base::StringPiece &name,
+                 base::StringPiece *value) const;
+
  private:
   // The actual text of the URI, in canonical ASCII form.
   std::string spec_;
@@ -424,6 +528,35 @@ class TelURI {
 
   // Identified components of the canonical spec.
   uri::Parsed parsed_;
+
+  // Positions of the parameters, built on demand.
+  uri_details::KeyValueIndex parameter_index_;
+};
+
+// Compares two SIP-URIs as described in RFC 3261, section 19.1.4: escaped
+// characters match their unescaped forms, everything but the user info is
+// compared without regard to case, and the order of parameters and headers
+// doesn't matter. Parameters present in only one of the URIs are ignored,
+// except for user, ttl, method and maddr. Headers must be present in both.
+// Invalid URIs are never equal. It doesn't allocate.
+bool SipURIEquals(const SipURI &a, const SipURI &b);
+
+// Returns a hash of |uri| consistent with SipURIEquals: equal URIs always get
+// the same hash.
+size_t SipURIHash(const SipURI &uri);
+
+// Functors for using SIP-URIs as keys of hashed containers, for example
+// base::hash_map<SipURI, Binding, SipURIHasher, SipURIEqualTo>.
+struct SipURIHasher {
+  size_t operator()(const SipURI &uri) const {
+    return SipURIHash(uri);
+  }
+};
+
+struct SipURIEqualTo {
+  bool operator()(const SipURI &a, const SipURI &b) const {
+    return SipURIEquals(a, b);
+  }
 };
 
 } // End of sippet namespace
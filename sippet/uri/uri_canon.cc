@@ -179,8 +179,147 @@ void DoHeaders(const CHAR* spec,
   }
 }
 
+bool IsComponentOfType(const char* spec,
+                       const uri::Component& component,
+                       SharedCharTypes type) {
+  for (int i = component.begin, end = component.end(); i < end; ++i) {
+    unsigned char uch = static_cast<unsigned char>(spec[i]);
+    if (uch >= 0x80 || !IsCharOfType(uch, type))
+      return false;
+  }
+  return true;
+}
+
+bool IsLowerAlpha(char ch) {
+  return ch >= 'a' && ch <= 'z';
+}
+
+bool IsDigit(char ch) {
+  return ch >= '0' && ch <= '9';
+}
+
+// Dotted-quad IPv4 addresses are canonical when every part is a decimal
+// number no greater than 255 without leading zeros.
+bool IsCanonicalIPv4Address(const char* host, int host_len) {
+  int parts = 0;
+  int i = 0;
+  while (i < host_len) {
+    int part_begin = i;
+    int value = 0;
+    while (i < host_len && IsDigit(host[i]) && i - part_begin < 3)
+      value = value * 10 + (host[i++] - '0');
+    int part_len = i - part_begin;
+    if (part_len == 0 || value > 255 ||
+        (part_len > 1 && host[part_begin] == '0'))
+      return false;
+    if (++parts == 4)
+      return i == host_len;
+    if (i == host_len || host[i++] != '.')
+      return false;
+  }
+  return false;
+}
+
+// Host names are canonical when made only of lower case letters, digits,
+// dashes and single dots, and when their last label can't be taken for a
+// number, which would make the canonicalizer treat them as an IPv4 address.
+bool IsCanonicalHost(const char* spec, const uri::Component& host) {
+  const char* begin = spec + host.begin;
+  const char* end = begin + host.len;
+  if (IsDigit(*begin) && IsCanonicalIPv4Address(begin, host.len))
+    return true;
+  for (const char* p = begin; p != end; ++p) {
+    if (*p == '.') {
+      if (p == begin || p[-1] == '.')
+        return false;
+    } else if (!IsLowerAlpha(*p) && !IsDigit(*p) && *p != '-') {
+      return false;
+    }
+  }
+  const char* last = end;
+  if (last[-1] == '.')
+    --last;
+  const char* label = last;
+  while (label != begin && label[-1] != '.')
+    --label;
+  return label != last && IsLowerAlpha(*label);
+}
+
+bool IsCanonicalPort(const char* spec,
+                     const uri::Component& port,
+                     int default_port) {
+  if (port.len <= 0 || port.len > 5 || spec[port.begin] == '0')
+    return false;
+  int value = 0;
+  for (int i = port.begin, end = port.end(); i < end; ++i) {
+    if (!IsDigit(spec[i]))
+      return false;
+    value = value * 10 + (spec[i] - '0');
+  }
+  return value <= 65535 && value != default_port;
+}
+
 }  // namespace
 
+bool IsCanonicalSipURI(const char* spec,
+                       int spec_len,
+                       const uri::Parsed& parsed) {
+  // The scheme was matched without regard to case, but must be lower case.
+  if (parsed.scheme.begin != 0)
+    return false;
+  int default_port = DefaultPortForScheme(spec, parsed.scheme.len);
+  if (default_port == uri::PORT_UNSPECIFIED)
+    return false;
+
+  // Every component must start where the previous one ended, so that the
+  // canonical output would be |spec| itself.
+  int cur = parsed.scheme.end() + 1;  // Skip past the colon.
+  if (parsed.username.is_valid() || parsed.password.is_valid()) {
+    // Empty user names and passwords are stripped by the canonicalizer.
+    if (parsed.username.begin != cur || parsed.username.len <= 0 ||
+        !IsComponentOfType(spec, parsed.username, CHAR_USERINFO))
+      return false;
+    cur = parsed.username.end();
+    if (parsed.password.is_valid()) {
+      if (parsed.password.begin != cur + 1 || parsed.password.len <= 0 ||
+          !IsComponentOfType(spec, parsed.password, CHAR_USERINFO))
+        return false;
+      cur = parsed.password.end();
+    }
+    if (cur >= spec_len || spec[cur++] != '@')
+      return false;
+  }
+
+  if (parsed.host.begin != cur || parsed.host.len <= 0 ||
+      !IsCanonicalHost(spec, parsed.host))
+    return false;
+  cur = parsed.host.end();
+
+  if (parsed.port.is_valid()) {
+    if (parsed.port.begin != cur + 1 ||
+        !IsCanonicalPort(spec, parsed.port, default_port))
+      return false;
+    cur = parsed.port.end();
+  }
+
+  if (parsed.parameters.is_valid()) {
+    if (parsed.parameters.begin != cur || parsed.parameters.len <= 0 ||
+        !IsComponentOfType(spec, parsed.parameters, CHAR_PARAMETERS))
+      return false;
+    cur = parsed.parameters.end();
+  }
+
+  // An empty header component is dropped along with its '?'.
+  if (parsed.headers.is_valid()) {
+    if (parsed.headers.begin != cur + 1 || parsed.headers.len <= 0 ||
+        !IsComponentOfType(spec, parsed.headers, CHAR_HEADERS))
+      return false;
+    cur = parsed.headers.end();
+  }
+
+  return cur == spec_len;
+}
+
 bool CanonicalizeUserInfo(const char* username_source,
                           const uri::Component& username,
                           const char* password_source,
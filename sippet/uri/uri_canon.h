@@ -301,6 +301,16 @@ bool CanonicalizeSipURI(const base::char16* spec,
                         CanonOutput* output,
                         uri::Parsed* new_parsed);
 
+// Returns true when the SIP-URI in |spec|, as parsed by ParseSipURI, is in
+// the exact form CanonicalizeSipURI would produce, so that |spec| and
+// |parsed| can be used as the canonical output without running it. Only the
+// common shapes are recognized: IPv6 literals, upper case letters, characters
+// requiring escapes, default ports or anything else the canonicalizer would
+// rewrite make it return false.
+bool IsCanonicalSipURI(const char* spec,
+                       int spec_len,
+                       const uri::Parsed& parsed);
+
 // Use for tel URIs.
 bool CanonicalizeTelURI(const char* spec,
                         int spec_len,
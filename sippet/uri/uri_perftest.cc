@@ -0,0 +1,117 @@
+// Copyright (c) 2013 The Sippet Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sippet/uri/uri.h"
+
+#include <string>
+#include <vector>
+
+#include "base/strings/stringprintf.h"
+#include "sippet/test/perf/perf_test_util.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace sippet {
+
+namespace {
+
+// Number of distinct URIs per list, and times each list is parsed.
+const int kListSize = 10000;
+const int kPasses = 5;
+
+typedef std::vector<std::string> UriList;
+
+UriList MakeList(const char *format) {
+  UriList list;
+  list.reserve(kListSize);
+  for (int i = 0; i < kListSize; ++i)
+    list.push_back(base::StringPrintf(format, i, i % 256));
+  return list;
+}
+
+// Each format gets the URI index and a number below 256.
+const struct {
+  const char *trace;
+  const char *format;
+} kSipLists[] = {
+  { "canonical", "sip:user%d@host%d.example.com;transport=tcp" },
+  { "ipv6", "sip:alice%d@[2001:db8::%x]:5070;transport=udp" },
+  { "escaped_user", "sip:%%22bob%%20%d%%22:pass@biloxi.com:5%03d" },
+  { "mixed_case", "SIP:Carol%d@Chicago%d.COM;Transport=TCP" },
+  { "many_params",
+    "sip:proxy%d.example.com;lr;transport=tcp;maddr=192.0.2.%d;ttl=16;"
+    "method=INVITE;x-a=1;x-b=2;x-c=3?subject=project%%20x&priority=urgent" },
+};
+
+const struct {
+  const char *trace;
+  const char *format;
+} kTelLists[] = {
+  { "global", "tel:+1-201-555-%04d;isub=%d" },
+  { "local", "tel:%d-%d;phone-context=example.com" },
+  { "visual_separators", "tel:+358 (555) %d;postd=pp%d" },
+};
+
+// Allocations expected from building a canonical SIP-URI: its spec only.
+const double kMaxCanonicalAllocations = 1;
+
+}  // namespace
+
+TEST(UriPerfTest, SipURI) {
+  for (size_t i = 0; i < arraysize(kSipLists); ++i) {
+    UriList list(MakeList(kSipLists[i].format));
+    for (size_t k = 0; k < list.size(); ++k)
+      ASSERT_TRUE(SipURI(list[k]).is_valid()) << list[k];
+
+    PerfMeasurement measurement("sip_uri_parse", kSipLists[i].trace,
+                                kListSize * kPasses);
+    for (int j = 0; j < kPasses; ++j) {
+      for (size_t k = 0; k < list.size(); ++k)
+        SipURI uri(list[k]);
+    }
+    double allocations = measurement.Done("uri");
+#if defined(NDEBUG)
+    // Debug builds also run the full canonicalizer on canonical input.
+    if (i == 0)
+      EXPECT_LE(allocations, kMaxCanonicalAllocations);
+#endif
+  }
+}
+
+TEST(UriPerfTest, TelURI) {
+  for (size_t i = 0; i < arraysize(kTelLists); ++i) {
+    UriList list(MakeList(kTelLists[i].format));
+    for (size_t k = 0; k < list.size(); ++k)
+      ASSERT_TRUE(TelURI(list[k]).is_valid()) << list[k];
+
+    PerfMeasurement measurement("tel_uri_parse", kTelLists[i].trace,
+                                kListSize * kPasses);
+    for (int j = 0; j < kPasses; ++j) {
+      for (size_t k = 0; k < list.size(); ++k)
+        TelURI uri(list[k]);
+    }
+    measurement.Done("uri");
+  }
+}
+
+TEST(UriPerfTest, ParameterLookup) {
+  UriList list(MakeList(kSipLists[arraysize(kSipLists) - 1].format));
+  std::vector<SipURI> uris;
+  uris.reserve(list.size());
+  for (size_t k = 0; k < list.size(); ++k)
+    uris.push_back(SipURI(list[k]));
+
+  PerfMeasurement measurement("sip_uri_parameter", "lookup",
+                              kListSize * kPasses * 3);
+  base::StringPiece value;
+  for (int j = 0; j < kPasses; ++j) {
+    for (size_t k = 0; k < uris.size(); ++k) {
+      uris[k].parameter("transport", &value);
+      uris[k].parameter("lr", &value);
+      uris[k].parameter("maddr", &value);
+    }
+  }
+  measurement.Done("lookup");
+}
+
+}  // namespace sippet
@@ -8,6 +8,7 @@
 #include <string>
 
 #include "base/basictypes.h"
+#include "sippet/uri/uri_util.h"
 
 #include "testing/gtest/include/gtest/gtest.h"
 
@@ -104,6 +105,55 @@ TEST(SipURI, Parser) {
   }
 }
 
+TEST(SipURI, CanonicalFastPath) {
+  struct {
+    const char *input;
+    bool canonical;
+  } tests[] = {
+    {"sip:alice@atlanta.com", true},
+    {"sips:alice:secret@atlanta.com:5070;transport=tcp;lr?subject=x", true},
+    {"sip:192.0.2.1;lr", true},
+    {"sip:p1.example.com.:5080", true},
+    {"sip:+1-212-555-1212%3B1234@gw.com;user=phone", true},
+    {"SIP:alice@atlanta.com", false},
+    {"sip:alice@Atlanta.com", false},
+    {"sip:alice@atlanta.com:5060", false},
+    {"sips:alice@atlanta.com:5061", false},
+    {"sip:alice@atlanta.com:05070", false},
+    {"sip:@atlanta.com", false},
+    {"sip:alice:@atlanta.com", false},
+    {"sip:alice@atlanta.com?", false},
+    {"sip:alice smith@atlanta.com", false},
+    {"sip:192.0.2.01", false},
+    {"sip:0x7f.1", false},
+    {"sip:host.123", false},
+    {"sip:a..b.com", false},
+    {"sip:[2001:db8::1]", false},
+    {" sip:alice@atlanta.com", false},
+  };
+
+  for (size_t i = 0; i < arraysize(tests); ++i) {
+    std::string input(tests[i].input);
+    int length = static_cast<int>(input.size());
+    sippet::uri::Parsed parsed;
+    sippet::uri::ParseSipURI(input.data(), length, &parsed);
+    EXPECT_EQ(tests[i].canonical,
+              sippet::uri::IsCanonicalSipURI(input.data(), length, parsed))
+        << input;
+
+    // Either way, the resulting URI must be the canonical one.
+    SipURI uri(input);
+    if (tests[i].canonical) {
+      EXPECT_TRUE(uri.is_valid()) << input;
+      EXPECT_EQ(input, uri.spec());
+    }
+  }
+
+  EXPECT_EQ("sip:alice@atlanta.com",
+            SipURI("sip:alice@atlanta.com:5060").spec());
+  EXPECT_EQ("sip:alice@atlanta.com", SipURI("SIP:alice@ATLANTA.com").spec());
+}
+
 TEST(SipURI, ParameterAndHeaders) {
   SipURI uri("sip:alice@atlanta.com;param=%40route66?subject=Project%20X");
   ASSERT_TRUE(uri.is_valid());
@@ -145,6 +195,125 @@ TEST(SipURI, LooseRoutingParameter) {
   EXPECT_EQ("", p.second);
 }
 
+TEST(SipURI, ComponentPieces) {
+  SipURI uri("sip:bob%20b:pass@biloxi.com:5070;transport=tcp?subject=x");
+  ASSERT_TRUE(uri.is_valid());
+
+  const std::string &spec = uri.spec();
+  EXPECT_EQ(spec.data(), uri.scheme_piece().data());
+  EXPECT_EQ("sip", uri.scheme_piece().as_string());
+  EXPECT_EQ("bob%20b", uri.username_piece().as_string());
+  EXPECT_EQ("bob b", uri.username());
+  EXPECT_EQ("pass", uri.password_piece().as_string());
+  EXPECT_EQ(uri.host(), uri.host_piece().as_string());
+  EXPECT_EQ("5070", uri.port_piece().as_string());
+  EXPECT_EQ(uri.parameters(), uri.parameters_piece().as_string());
+  EXPECT_EQ("subject=x", uri.headers_piece().as_string());
+
+  SipURI bare("sip:biloxi.com");
+  EXPECT_TRUE(bare.username_piece().empty());
+  EXPECT_TRUE(bare.port_piece().empty());
+  EXPECT_TRUE(bare.parameters_piece().empty());
+  EXPECT_TRUE(bare.headers_piece().empty());
+}
+
+TEST(SipURI, GetOrigin) {
+  SipURI uri("sip:bob@biloxi.com:5070;transport=tcp;lr?subject=x");
+  EXPECT_EQ("sip:biloxi.com:5070;transport=tcp", uri.GetOrigin().spec());
+  SipURI secure("sips:bob@biloxi.com");
+  EXPECT_EQ("sips:biloxi.com", secure.GetOrigin().spec());
+}
+
+TEST(SipURI, ParameterIndex) {
+  SipURI uri("sip:alice@atlanta.com;Transport=TCP;lr;maddr=192.0.2.1"
+      "?subject=Project%20X");
+  ASSERT_TRUE(uri.is_valid());
+
+  base::StringPiece value;
+  EXPECT_TRUE(uri.parameter("transport", &value));
+  EXPECT_EQ("TCP", value.as_string());
+  EXPECT_TRUE(uri.parameter("maddr", &value));
+  EXPECT_EQ("192.0.2.1", value.as_string());
+  EXPECT_TRUE(uri.parameter("lr", &value));
+  EXPECT_TRUE(value.empty());
+  EXPECT_TRUE(uri.parameter("LR", NULL));
+  EXPECT_FALSE(uri.parameter("ttl", &value));
+  EXPECT_FALSE(uri.parameter("subject", NULL));
+
+  // Header values are left escaped.
+  EXPECT_TRUE(uri.header("Subject", &value));
+  EXPECT_EQ("Project%20X", value.as_string());
+  EXPECT_EQ("Project X", uri.header("subject").second);
+
+  // Copies carry the index along, and it must still point into their specs.
+  SipURI copy(uri);
+  EXPECT_TRUE(copy.parameter("maddr", &value));
+  EXPECT_EQ(copy.spec().data() + copy.spec().find("192.0.2.1"), value.data());
+
+  SipURI origin(uri.GetWithEmptyHeaders());
+  EXPECT_TRUE(origin.parameter("transport", NULL));
+  EXPECT_FALSE(origin.header("subject", NULL));
+}
+
+TEST(TelURI, ParameterIndex) {
+  TelURI uri("tel:+358-555-1234567;postd=pp22;isub=1411");
+  ASSERT_TRUE(uri.is_valid());
+
+  base::StringPiece value;
+  EXPECT_TRUE(uri.parameter("isub", &value));
+  EXPECT_EQ("1411", value.as_string());
+  EXPECT_TRUE(uri.parameter("POSTD", &value));
+  EXPECT_EQ("pp22", value.as_string());
+  EXPECT_FALSE(uri.parameter("phone-context", NULL));
+
+  EXPECT_EQ("tel", uri.scheme_piece().as_string());
+  EXPECT_EQ("+358-555-1234567", uri.telephone_subscriber_piece().as_string());
+  EXPECT_EQ(uri.parameters(), uri.parameters_piece().as_string());
+}
+
+// Examples from RFC 3261, section 19.1.4.
+TEST(SipURI, Equivalence) {
+  const char *equivalent[][2] = {
+    { "sip:%61lice@atlanta.com;transport=TCP",
+      "sip:alice@AtLanTa.CoM;Transport=tcp" },
+    { "sip:carol@chicago.com",
+      "sip:carol@chicago.com;newparam=5" },
+    { "sip:carol@chicago.com;security=on",
+      "sip:carol@chicago.com;newparam=5" },
+    { "sip:biloxi.com;transport=tcp;method=REGISTER?to=sip:bob%40biloxi.com",
+      "sip:biloxi.com;method=REGISTER;transport=tcp?to=sip:bob%40biloxi.com" },
+    { "sip:alice@atlanta.com?subject=project%20x&priority=urgent",
+      "sip:alice@atlanta.com?priority=urgent&subject=project%20x" },
+  };
+  const char *different[][2] = {
+    { "SIP:ALICE@AtLanTa.CoM;Transport=udp",
+      "sip:alice@AtLanTa.CoM;Transport=UDP" },
+    { "sip:bob@biloxi.com", "sip:bob@biloxi.com:5060" },
+    { "sip:bob@biloxi.com", "sip:bob@biloxi.com;transport=udp;user=phone" },
+    { "sip:bob@biloxi.com;transport=udp",
+      "sip:bob@biloxi.com:6000;transport=tcp" },
+    { "sip:carol@chicago.com",
+      "sip:carol@chicago.com?Subject=next%20meeting" },
+    { "sip:bob@phone21.boxesbybob.com", "sip:bob@192.0.2.4" },
+    { "sips:alice@atlanta.com", "sip:alice@atlanta.com" },
+  };
+
+  for (size_t i = 0; i < arraysize(equivalent); ++i) {
+    SipURI a(equivalent[i][0]), b(equivalent[i][1]);
+    EXPECT_TRUE(sippet::SipURIEquals(a, b)) << a << " " << b;
+    EXPECT_TRUE(sippet::SipURIEquals(b, a)) << b << " " << a;
+    EXPECT_TRUE(a.Equivalent(b));
+    EXPECT_EQ(sippet::SipURIHash(a), sippet::SipURIHash(b)) << a << " " << b;
+  }
+  for (size_t i = 0; i < arraysize(different); ++i) {
+    SipURI a(different[i][0]), b(different[i][1]);
+    EXPECT_FALSE(sippet::SipURIEquals(a, b)) << a << " " << b;
+    EXPECT_FALSE(sippet::SipURIEquals(b, a)) << b << " " << a;
+  }
+
+  EXPECT_FALSE(sippet::SipURIEquals(SipURI(), SipURI()));
+}
+
 TEST(TelURI, Parser) {
   struct {
     const char *input;
@@ -202,3 +371,44 @@ TEST(TelURI, ToSipURI) {
     EXPECT_EQ(tests[i].output, uri.ToSipURI(origin).spec());
   }
 }
+
+TEST(DialPlan, NormalizeToE164) {
+  sippet::uri::DialPlan dial_plan;
+  dial_plan.country_code = "44";
+  dial_plan.national_prefix = "0";
+  dial_plan.international_prefix = "00";
+  dial_plan.min_national_length = 7;
+
+  struct {
+    const char *input;
+    const char *output;  // NULL if not normalized
+  } tests[] = {
+    {"+1 (212) 555-1234", "+12125551234"},
+    {"0012125551234", "+12125551234"},
+    {"020 7946 0958", "+442079460958"},
+    {"2079460958", "+442079460958"},
+    {"1234", nullptr},          // an extension
+    {"alice", nullptr},
+    {"555-1234;ext=1", nullptr},
+    {"12+34", nullptr},
+    {"+", nullptr},
+    {"+1234567890123456", nullptr},  // too long
+  };
+
+  for (size_t i = 0; i < arraysize(tests); ++i) {
+    std::string e164;
+    bool normalized =
+        sippet::uri::NormalizeToE164(tests[i].input, dial_plan, &e164);
+    EXPECT_EQ(nullptr != tests[i].output, normalized) << tests[i].input;
+    if (tests[i].output)
+      EXPECT_EQ(tests[i].output, e164);
+  }
+
+  // Without a country code, only international numbers are normalized.
+  std::string e164;
+  EXPECT_FALSE(sippet::uri::NormalizeToE164("02079460958",
+                                            sippet::uri::DialPlan(), &e164));
+  EXPECT_TRUE(sippet::uri::NormalizeToE164("+44 20 7946 0958",
+                                           sippet::uri::DialPlan(), &e164));
+  EXPECT_EQ("+442079460958", e164);
+}
@@ -4,6 +4,8 @@
 
 #include "sippet/uri/uri_util.h"
 
+#include <string>
+
 #include "sippet/uri/uri.h"
 
 #include "url/url_canon_internal.h"
@@ -41,6 +43,44 @@ inline bool DoCompareSchemeComponent(const CHAR* spec,
       compare_to);
 }
 
+// Uses |spec| as the canonical output when it's already in canonical form,
+// which is the case for almost every SIP-URI received from the network.
+// Wide input always goes through the full canonicalization.
+bool AdoptCanonicalSipURI(const char* spec, int spec_len,
+                          const uri::Parsed& parsed,
+                          uri::CanonOutput* output,
+                          uri::Parsed* output_parsed) {
+  if (output->length() != 0 || !uri::IsCanonicalSipURI(spec, spec_len, parsed))
+    return false;
+#ifndef NDEBUG
+  // Make sure the full canonicalization would have given the same result.
+  std::string canonical;
+  url::StdStringCanonOutput canonical_output(&canonical);
+  uri::Parsed canonical_parsed;
+  DCHECK(uri::CanonicalizeSipURI(spec, spec_len, parsed, nullptr,
+                                 &canonical_output, &canonical_parsed));
+  canonical_output.Complete();
+  DCHECK_EQ(std::string(spec, spec_len), canonical);
+  DCHECK(canonical_parsed.scheme == parsed.scheme);
+  DCHECK(canonical_parsed.username == parsed.username);
+  DCHECK(canonical_parsed.password == parsed.password);
+  DCHECK(canonical_parsed.host == parsed.host);
+  DCHECK(canonical_parsed.port == parsed.port);
+  DCHECK(canonical_parsed.parameters == parsed.parameters);
+  DCHECK(canonical_parsed.headers == parsed.headers);
+#endif
+  output->Append(spec, spec_len);
+  *output_parsed = parsed;
+  return true;
+}
+
+bool AdoptCanonicalSipURI(const base::char16* spec, int spec_len,
+                          const uri::Parsed& parsed,
+                          uri::CanonOutput* output,
+                          uri::Parsed* output_parsed) {
+  return false;
+}
+
 template<typename CHAR>
 bool DoCanonicalize(const CHAR* in_spec, int in_spec_len,
                     uri::CharsetConverter* charset_converter,
@@ -64,6 +104,9 @@ bool DoCanonicalize(const CHAR* in_spec, int in_spec_len,
   if (DoCompareSchemeComponent(spec, scheme, "sip") ||
       DoCompareSchemeComponent(spec, scheme, "sips")) {
     uri::ParseSipURI(spec, spec_len, &parsed_input);
+    if (AdoptCanonicalSipURI(spec, spec_len, parsed_input,
+                             output, output_parsed))
+      return true;
     success = uri::CanonicalizeSipURI(spec, spec_len, parsed_input,
                                             charset_converter, output,
                                             output_parsed);
@@ -95,8 +138,22 @@ void DoDecodeURIEscapeSequences(const CHAR* input, int length,
   }
 }
 
+// E.164 numbers have at most this many digits.
+const size_t kMaxE164Digits = 15;
+
+bool IsVisualSeparator(char c) {
+  return '-' == c || '.' == c || '(' == c || ')' == c || ' ' == c;
+}
+
 }  // namespace
 
+DialPlan::DialPlan()
+  : min_national_length(0) {
+}
+
+DialPlan::~DialPlan() {
+}
+
 bool Canonicalize(const char* spec,
                   int spec_len,
                   uri::CharsetConverter* charset_converter,
@@ -120,5 +177,52 @@ void DecodeURIEscapeSequences(const char* input, int length,
   DoDecodeURIEscapeSequences(input, length, output);
 }
 
+bool NormalizeToE164(const base::StringPiece& dialed,
+                     const DialPlan& dial_plan,
+                     std::string* e164) {
+  DCHECK(e164);
+  bool international = false;
+  std::string digits;
+  digits.reserve(dialed.size());
+  for (size_t i = 0; i < dialed.size(); ++i) {
+    char c = dialed[i];
+    if (IsVisualSeparator(c))
+      continue;
+    if ('+' == c && digits.empty() && !international) {
+      international = true;
+    } else if (base::IsAsciiDigit(c)) {
+      digits.push_back(c);
+    } else {
+      return false;
+    }
+  }
+  if (digits.empty())
+    return false;
+
+  if (!international && !dial_plan.international_prefix.empty()
+      && base::StartsWith(digits, dial_plan.international_prefix,
+                          base::CompareCase::SENSITIVE)) {
+    digits.erase(0, dial_plan.international_prefix.size());
+    international = true;
+  }
+  if (!international) {
+    if (dial_plan.country_code.empty())
+      return false;
+    if (!dial_plan.national_prefix.empty()
+        && base::StartsWith(digits, dial_plan.national_prefix,
+                            base::CompareCase::SENSITIVE))
+      digits.erase(0, dial_plan.national_prefix.size());
+    if (digits.empty() || digits.size() < dial_plan.min_national_length)
+      return false;
+    digits.insert(0, dial_plan.country_code);
+  }
+  if (digits.size() > kMaxE164Digits)
+    return false;
+
+  e164->assign("+");
+  e164->append(digits);
+  return true;
+}
+
 }  // namespace uri
 }  // namespace sippet
@@ -5,7 +5,10 @@
 #ifndef SIPPET_URI_URI_UTIL_H_
 #define SIPPET_URI_URI_UTIL_H_
 
+#include <string>
+
 #include "base/strings/string16.h"
+#include "base/strings/string_piece.h"
 
 namespace url {
 struct CharsetConverter;
@@ -47,6 +50,35 @@ bool Canonicalize(const base::char16* spec,
 void DecodeURIEscapeSequences(const char* input, int length,
                               CanonOutputT<char>* output);
 
+// Phone numbers ---------------------------------------------------------------
+
+// The rules telling how numbers are dialed where a user agent is, to get
+// their international form.
+struct DialPlan {
+  DialPlan();
+  ~DialPlan();
+
+  // The country calling code, e.g. "1" (NANP) or "44" (UK). Without one,
+  // only numbers in their international form are normalized.
+  std::string country_code;
+  // Dialed before national numbers, e.g. "1" (NANP) or "0" (UK); optional.
+  std::string national_prefix;
+  // Dialed before international numbers, e.g. "011" (NANP) or "00" (UK).
+  std::string international_prefix;
+  // National numbers with fewer digits are extensions or short codes, which
+  // aren't normalized.
+  size_t min_national_length;
+};
+
+// Normalizes the |dialed| phone number to E.164, "+" followed by its digits,
+// dropping the visual separators (RFC 3966 section 5.1.1) and replacing the
+// national and international prefixes of |dial_plan|. Returns false if
+// |dialed| isn't a normalizable number, such as a user name, a short code
+// or a number with pause or DTMF digits.
+bool NormalizeToE164(const base::StringPiece& dialed,
+                     const DialPlan& dial_plan,
+                     std::string* e164);
+
 } // End of uri namespace
 } // End of sippet namespace
 